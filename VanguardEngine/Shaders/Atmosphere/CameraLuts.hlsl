@@ -0,0 +1,93 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Camera.hlsli"
+#include "Atmosphere/Atmosphere.hlsli"
+#include "Atmosphere/CameraLuts.hlsli"
+
+struct BindData
+{
+	uint cameraBuffer;
+	uint cameraIndex;
+	uint atmosphereBuffer;
+	uint transmissionTexture;
+	uint scatteringTexture;
+	float solarZenithAngle;
+	uint skyViewTexture;
+	uint aerialPerspectiveScatteringTexture;
+	uint aerialPerspectiveTransmittanceTexture;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+// Sky radiance without the exposure, light shafts or the sun disk, which are all applied when composing.
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void SkyViewMain(uint3 dispatchId : SV_DispatchThreadID)
+{
+	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
+	StructuredBuffer<AtmosphereData> atmosphereBuffer = ResourceDescriptorHeap[bindData.atmosphereBuffer];
+	Texture2D<float4> transmittanceLut = ResourceDescriptorHeap[bindData.transmissionTexture];
+	Texture3D<float4> scatteringLut = ResourceDescriptorHeap[bindData.scatteringTexture];
+	RWTexture2D<float4> skyViewTexture = ResourceDescriptorHeap[bindData.skyViewTexture];
+
+	if (any(dispatchId.xy >= (uint2)skyViewLutSize))
+		return;
+
+	Camera camera = cameraBuffer[bindData.cameraIndex];
+	AtmosphereData atmosphere = atmosphereBuffer[0];
+
+	const float3 sunDirection = float3(sin(bindData.solarZenithAngle), 0.f, cos(bindData.solarZenithAngle));
+	const float3 cameraPoint = ComputeAtmosphereCameraPosition(camera) - ComputeAtmospherePlanetCenter(atmosphere);
+
+	const float2 uv = (dispatchId.xy + 0.5f) / skyViewLutSize;
+	const float3 direction = SkyViewLutUvToDirection(atmosphere, cameraPoint, sunDirection, uv);
+
+	float3 transmittance;
+	const float3 radiance = GetSkyRadiance(atmosphere, transmittanceLut, scatteringLut, bilinearWrap, cameraPoint, direction, 0.f, sunDirection, transmittance);
+
+	skyViewTexture[dispatchId.xy] = float4(radiance, 1.f);
+}
+
+// Froxels aligned with the screen, without the exposure or light shafts.
+[RootSignature(RS)]
+[numthreads(4, 4, 4)]
+void AerialPerspectiveMain(uint3 dispatchId : SV_DispatchThreadID)
+{
+	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
+	StructuredBuffer<AtmosphereData> atmosphereBuffer = ResourceDescriptorHeap[bindData.atmosphereBuffer];
+	Texture2D<float4> transmittanceLut = ResourceDescriptorHeap[bindData.transmissionTexture];
+	Texture3D<float4> scatteringLut = ResourceDescriptorHeap[bindData.scatteringTexture];
+	RWTexture3D<float4> scatteringVolume = ResourceDescriptorHeap[bindData.aerialPerspectiveScatteringTexture];
+	RWTexture3D<float4> transmittanceVolume = ResourceDescriptorHeap[bindData.aerialPerspectiveTransmittanceTexture];
+
+	uint width, height, depth;
+	scatteringVolume.GetDimensions(width, height, depth);
+	if (any(dispatchId >= uint3(width, height, depth)))
+		return;
+
+	Camera camera = cameraBuffer[bindData.cameraIndex];
+	AtmosphereData atmosphere = atmosphereBuffer[0];
+
+	const float3 sunDirection = float3(sin(bindData.solarZenithAngle), 0.f, cos(bindData.solarZenithAngle));
+	const float3 planetCenter = ComputeAtmospherePlanetCenter(atmosphere);
+	const float3 cameraPoint = ComputeAtmosphereCameraPosition(camera) - planetCenter;
+
+	const float2 uv = (dispatchId.xy + 0.5f) / float2(width, height);
+	const float3 direction = ComputeRayDirection(camera, uv);
+	float3 slicePoint = cameraPoint + direction * AerialPerspectiveSliceDistance(dispatchId.z);
+
+	// Froxels under the planet surface are never visible, but are still filtered with visible ones. Clamping them to the
+	// surface keeps the precomputed table lookups valid.
+	const float sliceRadius = length(slicePoint);
+	if (sliceRadius < atmosphere.radiusBottom + 0.001f)
+	{
+		slicePoint *= (atmosphere.radiusBottom + 0.001f) / sliceRadius;
+	}
+
+	float3 transmittance;
+	const float3 scattering = GetSkyRadianceToPoint(atmosphere, transmittanceLut, scatteringLut, bilinearWrap, cameraPoint, slicePoint, 0.f, sunDirection, transmittance);
+
+	scatteringVolume[dispatchId] = float4(scattering, 1.f);
+	transmittanceVolume[dispatchId] = float4(transmittance, 1.f);
+}
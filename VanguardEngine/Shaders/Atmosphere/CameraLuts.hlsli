@@ -0,0 +1,128 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#ifndef __CAMERALUTS_HLSLI__
+#define __CAMERALUTS_HLSLI__
+
+#include "Atmosphere/Atmosphere.hlsli"
+
+// Low resolution LUTs of the atmosphere as seen from the camera, recomputed every frame from the precomputed tables.
+// See "A Scalable and Production Ready Sky and Atmosphere Rendering Technique" [https://sebh.github.io/publications/egsr2020.pdf]
+
+static const float2 skyViewLutSize = float2(192, 108);
+static const uint aerialPerspectiveSlices = 32;
+static const float aerialPerspectiveDistance = 32.f;  // Kilometers covered by the aerial perspective volume.
+
+// Tangent frame around the camera's up direction, with the sun's azimuth along the forward axis. The sky is symmetric
+// about the plane of the up and sun directions, so only half of the azimuths are stored.
+void GetSkyViewFrame(float3 cameraPoint, float3 sunDirection, out float3 up, out float3 forward, out float3 right)
+{
+	up = normalize(cameraPoint);
+	forward = sunDirection - up * dot(up, sunDirection);
+
+	// Sun at the zenith or nadir, any azimuth works.
+	if (dot(forward, forward) < 1e-8f)
+	{
+		forward = abs(up.z) < 0.999f ? cross(up, float3(0, 0, 1)) : cross(up, float3(1, 0, 0));
+	}
+
+	forward = normalize(forward);
+	right = cross(up, forward);
+}
+
+// Angle between the zenith and the horizon, and between the horizon and the nadir.
+void GetSkyViewHorizon(AtmosphereData atmosphere, float radius, out float zenithHorizonAngle, out float beta)
+{
+	const float horizonDistance = sqrt(max(radius * radius - atmosphere.radiusBottom * atmosphere.radiusBottom, 0.f));
+	beta = acos(horizonDistance / radius);
+	zenithHorizonAngle = pi - beta;
+}
+
+// Non-linear in elevation to concentrate texels at the horizon, and in azimuth to concentrate them towards the sun.
+float3 SkyViewLutUvToDirection(AtmosphereData atmosphere, float3 cameraPoint, float3 sunDirection, float2 uv)
+{
+	uv = float2(TextureCoordToUnitRange(uv.x, skyViewLutSize.x), TextureCoordToUnitRange(uv.y, skyViewLutSize.y));
+
+	float zenithHorizonAngle;
+	float beta;
+	GetSkyViewHorizon(atmosphere, length(cameraPoint), zenithHorizonAngle, beta);
+
+	float viewZenithAngle;
+	if (uv.y < 0.5f)
+	{
+		float coord = 1.f - 2.f * uv.y;
+		viewZenithAngle = zenithHorizonAngle * (1.f - coord * coord);
+	}
+
+	else
+	{
+		float coord = uv.y * 2.f - 1.f;
+		viewZenithAngle = zenithHorizonAngle + beta * coord * coord;
+	}
+
+	const float cosAzimuth = -(uv.x * uv.x * 2.f - 1.f);
+
+	float3 up;
+	float3 forward;
+	float3 right;
+	GetSkyViewFrame(cameraPoint, sunDirection, up, forward, right);
+
+	const float sinZenith = sin(viewZenithAngle);
+	const float sinAzimuth = sqrt(saturate(1.f - cosAzimuth * cosAzimuth));
+
+	return up * cos(viewZenithAngle) + (forward * cosAzimuth + right * sinAzimuth) * sinZenith;
+}
+
+float2 SkyViewLutDirectionToUv(AtmosphereData atmosphere, float3 cameraPoint, float3 sunDirection, float3 direction)
+{
+	float3 up;
+	float3 forward;
+	float3 right;
+	GetSkyViewFrame(cameraPoint, sunDirection, up, forward, right);
+
+	float zenithHorizonAngle;
+	float beta;
+	GetSkyViewHorizon(atmosphere, length(cameraPoint), zenithHorizonAngle, beta);
+
+	const float viewZenithAngle = acos(clamp(dot(direction, up), -1.f, 1.f));
+
+	float2 uv;
+	if (viewZenithAngle < zenithHorizonAngle)
+	{
+		uv.y = (1.f - sqrt(1.f - viewZenithAngle / zenithHorizonAngle)) * 0.5f;
+	}
+
+	else
+	{
+		uv.y = sqrt((viewZenithAngle - zenithHorizonAngle) / beta) * 0.5f + 0.5f;
+	}
+
+	const float3 tangent = direction - up * dot(direction, up);
+	const float cosAzimuth = dot(tangent, tangent) > 1e-8f ? dot(normalize(tangent), forward) : 1.f;
+	uv.x = sqrt(saturate(-cosAzimuth * 0.5f + 0.5f));
+
+	return float2(UnitRangeToTextureCoord(uv.x, skyViewLutSize.x), UnitRangeToTextureCoord(uv.y, skyViewLutSize.y));
+}
+
+// Each slice holds the aerial perspective to its far end, linearly distributed over the covered distance.
+float AerialPerspectiveSliceDistance(uint slice)
+{
+	return (slice + 1.f) / aerialPerspectiveSlices * aerialPerspectiveDistance;
+}
+
+// Distance in kilometers, within the covered distance. Scattering in RGB, transmittance in RGB.
+void SampleAerialPerspective(Texture3D<float4> scatteringVolume, Texture3D<float4> transmittanceVolume, SamplerState volumeSampler, float2 uv, float distance,
+	out float3 scattering, out float3 transmittance)
+{
+	const float slice = distance / aerialPerspectiveDistance * aerialPerspectiveSlices;
+	const float3 uvw = float3(uv, saturate((slice - 0.5f) / aerialPerspectiveSlices));
+
+	scattering = scatteringVolume.SampleLevel(volumeSampler, uvw, 0).rgb;
+	transmittance = transmittanceVolume.SampleLevel(volumeSampler, uvw, 0).rgb;
+
+	// The first slice ends a slice's distance away, fade towards the camera where there's no perspective.
+	const float weight = saturate(slice);
+	scattering *= weight;
+	transmittance = lerp(1.f, transmittance, weight);
+}
+
+#endif  // __CAMERALUTS_HLSLI__
@@ -5,6 +5,8 @@
 #include "Geometry.hlsli"
 #include "Atmosphere/Atmosphere.hlsli"
 #include "Atmosphere/Visibility.hlsli"
+#include "Atmosphere/CameraLuts.hlsli"
+#include "Volumetrics/Fog.hlsli"
 
 struct BindData
 {
@@ -15,7 +17,7 @@ struct BindData
 	uint cloudsDepthTexture;
 	uint cloudsVisibilityTexture;
 	uint cloudsCirrusTexture;
-	uint weatherTexture;
+	uint cloudShadowTexture;
 	uint geometryDepthTexture;
 	uint outputTexture;
 	uint transmissionTexture;
@@ -25,6 +27,12 @@ struct BindData
 	float globalWeatherCoverage;
 	float time;
 	float2 wind;
+	uint skyViewTexture;
+	uint aerialPerspectiveScatteringTexture;
+	// Boundary
+	uint aerialPerspectiveTransmittanceTexture;
+	float3 padding;
+	FogData fogData;
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
@@ -81,7 +89,7 @@ void Main(uint3 dispatchId : SV_DispatchThreadID)
 	Texture2D<float> cloudsDepthTexture = ResourceDescriptorHeap[bindData.cloudsDepthTexture];
 	Texture2D<float> cloudsVisibilityTexture = ResourceDescriptorHeap[bindData.cloudsVisibilityTexture];
 	Texture2D<float4> cloudsCirrusTexture = ResourceDescriptorHeap[bindData.cloudsCirrusTexture];
-	Texture2D<float3> weatherTexture = ResourceDescriptorHeap[bindData.weatherTexture];
+	Texture2D<float> cloudShadowTexture = ResourceDescriptorHeap[bindData.cloudShadowTexture];
 	Texture2D<float> geometryDepthTexture = ResourceDescriptorHeap[bindData.geometryDepthTexture];
 	RWTexture2D<float4> outputTexture = ResourceDescriptorHeap[bindData.outputTexture];
 
@@ -166,7 +174,7 @@ void Main(uint3 dispatchId : SV_DispatchThreadID)
 			GetSunAndSkyIrradiance(atmosphere, transmittanceLut, irradianceLut, bilinearWrap, hitPosition - planetCenter, surfaceNormal, sunDirection, sunIrradiance, skyIrradiance);
 		
 			// The irradiance on the planet surface is heavily influenced by visibility.
-			float sunVisibility = CalculateSunVisibility(hitPosition, sunDirection, weatherTexture);
+			float sunVisibility = CalculateSunVisibility(hitPosition, sunDirection, cloudShadowTexture, WeatherScroll(bindData.wind, bindData.time));
 			float skyVisibility = CalculateSkyVisibility(hitPosition, bindData.globalWeatherCoverage);
 			
 			float3 radiance = atmosphere.surfaceColor * (1.f / pi) * ((sunIrradiance * sunVisibility) + (skyIrradiance * skyVisibility));
@@ -270,24 +278,6 @@ void Main(uint3 dispatchId : SV_DispatchThreadID)
 	
 	if (lastDepth >= 0.f)
 	{
-		float3 hitPosition = cameraPosition + rayDirection * lastDepth;
-		
-		// This is a horrible hack, possibly one of the worst in the whole project.
-		// GetSkyRadianceToPoint treats shadows as omission of scattering near the camera, while
-		// GetSkyRadiance treats shadows as omission away from the camera, at the other end of the view ray.
-		// This disparity causes far away clouds, which are viewed by a ray that is traversing some volume
-		// of shadow, to appear too bright against a darkened sky, as all that in-scattered light from the sky
-		// is not occluded at the eye, while the surrouding sky does account for that.
-		// As a result, GetSkyRadianceToPointNearShadow was created, which is not at all correct but a good
-		// enough approximation for distant objects. Ideally, there would be no blending done here and the
-		// GetSkyRadianceToPointNearShadow function would be used, but I don't have the time to properly
-		// fix that function to be correct.
-		
-		float3 perspectiveTransmittanceNear;
-		float3 perspectiveTransmittanceFar;
-		float3 perspectiveScatteringNear = GetSkyRadianceToPoint(atmosphere, transmittanceLut, scatteringLut, bilinearWrap, cameraPosition - planetCenter, hitPosition - planetCenter, shadowLength, sunDirection, perspectiveTransmittanceNear);
-		float3 perspectiveScatteringFar = GetSkyRadianceToPointNearShadow(atmosphere, transmittanceLut, scatteringLut, bilinearWrap, cameraPosition - planetCenter, hitPosition - planetCenter, shadowLength, sunDirection, perspectiveTransmittanceFar);
-		
 		// Blend between the near and far values.
 #ifdef ENABLE_FAR_SHADOW_FIX
 		float blendFactor = smoothstep(20, 90, lastDepth);
@@ -300,17 +290,68 @@ void Main(uint3 dispatchId : SV_DispatchThreadID)
 		float blendFactor = 0.f;
 #endif
 		
-		perspectiveScattering = lerp(perspectiveScatteringNear, perspectiveScatteringFar, blendFactor);
-		perspectiveTransmittance = lerp(perspectiveTransmittanceNear, perspectiveTransmittanceFar, blendFactor);
+#if defined(ATMOSPHERE_CAMERA_LUTS)
+		// The aerial perspective volume only covers unshadowed views near the camera.
+		if (shadowLength == 0.f && blendFactor == 0.f && lastDepth < aerialPerspectiveDistance)
+		{
+			Texture3D<float4> aerialPerspectiveScattering = ResourceDescriptorHeap[bindData.aerialPerspectiveScatteringTexture];
+			Texture3D<float4> aerialPerspectiveTransmittance = ResourceDescriptorHeap[bindData.aerialPerspectiveTransmittanceTexture];
+			
+			SampleAerialPerspective(aerialPerspectiveScattering, aerialPerspectiveTransmittance, bilinearClamp, uv, lastDepth, perspectiveScattering, perspectiveTransmittance);
+		}
+		
+		else
+#endif
+		{
+			float3 hitPosition = cameraPosition + rayDirection * lastDepth;
+			
+			// This is a horrible hack, possibly one of the worst in the whole project.
+			// GetSkyRadianceToPoint treats shadows as omission of scattering near the camera, while
+			// GetSkyRadiance treats shadows as omission away from the camera, at the other end of the view ray.
+			// This disparity causes far away clouds, which are viewed by a ray that is traversing some volume
+			// of shadow, to appear too bright against a darkened sky, as all that in-scattered light from the sky
+			// is not occluded at the eye, while the surrouding sky does account for that.
+			// As a result, GetSkyRadianceToPointNearShadow was created, which is not at all correct but a good
+			// enough approximation for distant objects. Ideally, there would be no blending done here and the
+			// GetSkyRadianceToPointNearShadow function would be used, but I don't have the time to properly
+			// fix that function to be correct.
+			
+			float3 perspectiveTransmittanceNear;
+			float3 perspectiveTransmittanceFar;
+			float3 perspectiveScatteringNear = GetSkyRadianceToPoint(atmosphere, transmittanceLut, scatteringLut, bilinearWrap, cameraPosition - planetCenter, hitPosition - planetCenter, shadowLength, sunDirection, perspectiveTransmittanceNear);
+			float3 perspectiveScatteringFar = GetSkyRadianceToPointNearShadow(atmosphere, transmittanceLut, scatteringLut, bilinearWrap, cameraPosition - planetCenter, hitPosition - planetCenter, shadowLength, sunDirection, perspectiveTransmittanceFar);
+			
+			perspectiveScattering = lerp(perspectiveScatteringNear, perspectiveScatteringFar, blendFactor);
+			perspectiveTransmittance = lerp(perspectiveTransmittanceNear, perspectiveTransmittanceFar, blendFactor);
+		}
 	}
 	
 	else
 	{
-		perspectiveScattering = GetSkyRadiance(atmosphere, transmittanceLut, scatteringLut, bilinearWrap, cameraPosition - planetCenter, rayDirection, shadowLength, sunDirection, perspectiveTransmittance);
+#if defined(ATMOSPHERE_CAMERA_LUTS)
+		// Without light shafts or the sun disk there's nothing to attenuate, and the sky view holds all of the scattering.
+		if (shadowLength == 0.f && all(finalColor == 0.f))
+		{
+			Texture2D<float4> skyViewTexture = ResourceDescriptorHeap[bindData.skyViewTexture];
+			
+			const float2 skyViewUv = SkyViewLutDirectionToUv(atmosphere, cameraPosition - planetCenter, sunDirection, rayDirection);
+			perspectiveScattering = skyViewTexture.SampleLevel(bilinearClamp, skyViewUv, 0).rgb;
+			perspectiveTransmittance = 1.f;
+		}
+		
+		else
+#endif
+		{
+			perspectiveScattering = GetSkyRadiance(atmosphere, transmittanceLut, scatteringLut, bilinearWrap, cameraPosition - planetCenter, rayDirection, shadowLength, sunDirection, perspectiveTransmittance);
+		}
 	}
 	
 	perspectiveScattering *= atmosphereRadianceExposure;
 	finalColor = finalColor * perspectiveTransmittance + perspectiveScattering;
 	
+	// Volumetric fog is nearest to the camera, so it's applied last. Sky pixels take the whole fog range.
+	const float4 fog = SampleVolumetricFog(bindData.fogData, uv, hitSurface ? geometryDepth : bindData.fogData.range);
+	finalColor = finalColor * fog.a + fog.rgb;
+	
 	outputTexture[dispatchId.xy] = float4(finalColor, 1);
 }
\ No newline at end of file
@@ -7,18 +7,18 @@
 #include "Constants.hlsli"
 #include "Clouds/Core.hlsli"
 
-// Position must be in atmosphere space.
-float CalculateSunVisibility(float3 position, float3 sunDirection, Texture2D<float3> weatherTexture)
+// Position must be in atmosphere space, sun direction points towards the sun.
+float CalculateSunVisibility(float3 position, float3 sunDirection, Texture2D<float> cloudShadowTexture, float2 weatherScroll)
 {
-    // Sample the weather texture as a crude approximation for sun visibility. The ray marched visibility can't be
-    // reliably used here as it encodes aggregate shadow along the ray, instead of at the end point.
-    float theta = acos(-sunDirection.z);
-    float distance = cloudLayerBottom - position.z;
-    float displacement = distance * tan(theta) * -sign(sunDirection.x);
+    // Project onto the bottom of the cloud layer along the sun direction, the cloud shadow map holds the optical
+    // depth from there to the top of the layer. See Clouds/Shadow.hlsl.
+    sunDirection.z = max(sunDirection.z, cloudShadowMinSunHeight);
+    float distance = max(cloudLayerBottom - position.z, 0.f) / sunDirection.z;
+    float3 layerPosition = position + sunDirection * distance;
     
-    float3 weather = SampleWeather(weatherTexture, position + float3(displacement, 0.f, 0.f));
+    float opticalDepth = cloudShadowTexture.SampleLevel(bilinearWrap, WeatherUv(layerPosition, weatherScroll), 0);
     
-    return saturate(1 - min(weather.x, 0.6) * 1.8);
+    return exp(-opticalDepth);
 }
 
 // Position must be in atmosphere space.
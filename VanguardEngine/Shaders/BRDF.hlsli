@@ -7,6 +7,16 @@
 
 // Implementation of Cook-Torrance BRDF.
 
+// Direct lighting evaluates in minimum precision when BRDF_HALF_PRECISION is defined, hardware without 16 bit math falls back
+// to full precision.
+#ifdef BRDF_HALF_PRECISION
+typedef min16float brdf_float;
+typedef min16float3 brdf_float3;
+#else
+typedef float brdf_float;
+typedef float3 brdf_float3;
+#endif
+
 // Diffuse BRDF component.
 float3 LambertianDiffuse(float3 baseColor)
 {
@@ -76,14 +86,27 @@ float3 CookTorranceSpecular(float3 normal, float3 view, float3 halfway, float3 l
 
 float3 BRDF(float3 normal, float3 view, float3 halfway, float3 light, float3 baseColor, float metalness, float roughness, float3 radiance)
 {
-	const float3 fNaught = lerp(float3(0.04, 0.04, 0.04), baseColor, metalness);
-
-	const float3 specularFactor = FresnelSchlick(saturate(dot(view, halfway)), fNaught);
-	const float3 diffuseFactor = (float3(1.0, 1.0, 1.0) - specularFactor) * (1.0 - metalness);
-
-	const float3 weightedRadiance = radiance * saturate(dot(normal, light));
-
-	return (diffuseFactor * LambertianDiffuse(baseColor) + CookTorranceSpecular(normal, view, halfway, light, roughness, specularFactor)) * weightedRadiance;
+	// Dot products and the distribution stay in full precision, the distribution's denominator underflows half precision on
+	// smooth surfaces. Every other term is bounded, so it tolerates minimum precision.
+	const brdf_float normalDotView = saturate(dot(normal, view));
+	const brdf_float normalDotLight = saturate(dot(normal, light));
+	const brdf_float viewDotHalfway = saturate(dot(view, halfway));
+	const brdf_float3 color = baseColor;
+	const brdf_float metal = metalness;
+	const brdf_float rough = roughness;
+
+	const brdf_float3 fNaught = lerp((brdf_float3)0.04, color, metal);
+	const brdf_float3 specularFactor = fNaught + ((brdf_float)1.0 - fNaught) * pow((brdf_float)1.0 - viewDotHalfway, 5.0);  // Fresnel.
+	const brdf_float3 diffuseFactor = ((brdf_float)1.0 - specularFactor) * ((brdf_float)1.0 - metal);
+
+	const brdf_float geometryConstant = ((rough + 1.0) * (rough + 1.0)) / 8.0;  // Direct lighting.
+	const brdf_float geometry = SchlickGGX(normalDotView, geometryConstant) * SchlickGGX(normalDotLight, geometryConstant);
+
+	const float3 DFG = TrowbridgeReitzGGX(normal, halfway, roughness) * (float3)(specularFactor * geometry);
+	const float3 specular = DFG / (4.0 * normalDotView * normalDotLight + 0.001);  // Prevent division by 0.
+	const float3 diffuse = diffuseFactor * (color / (brdf_float)pi);
+
+	return (diffuse + specular) * radiance * (float)normalDotLight;
 }
 
 #endif  // __BRDF_HLSLI__
\ No newline at end of file
@@ -6,11 +6,25 @@
 struct BindData
 {
 	uint inputTexture;
-	uint outputTexture;
+	uint outputTexture;  // Mip 0.
+	uint downsampleTexture;  // Mip 1.
+	uint padding;
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
 
+// Extraction is fused with the first downsample. Each group extracts a tile of mip 0 into groupshared memory, including
+// the downsample filter's footprint around the 16x16 texels it owns, then downsamples the tile to 8x8 texels of mip 1
+// without a round trip through memory or a barrier between dispatches.
+
+static const int tileSize = 20;
+static const int tileBorder = 2;
+
+// Separated channels to reduce bank conflicts.
+groupshared float groupRed[tileSize * tileSize];
+groupshared float groupGreen[tileSize * tileSize];
+groupshared float groupBlue[tileSize * tileSize];
+
 float3 KarisAverage(float3 a, float3 b, float3 c, float3 d)
 {
 	// See: https://graphicrants.blogspot.com/2013/12/tone-mapping.html
@@ -23,26 +37,109 @@ float3 KarisAverage(float3 a, float3 b, float3 c, float3 d)
 	return (a * weightA + b * weightB + c * weightC + d * weightD) / (weightA + weightB + weightC + weightD);
 }
 
+float3 ExtractTexel(Texture2D<float4> input, uint2 texel, float2 texelSize)
+{
+	float2 center = (texel * 2.f + 1.f);
+	
+	// 4 bilinear samples to prevent undersampling.
+	float3 a = input.SampleLevel(linearMipPointClamp, (center + float2(-1.f, -1.f)) * texelSize, 0).rgb;  // Top left.
+	float3 b = input.SampleLevel(linearMipPointClamp, (center + float2(1.f, -1.f)) * texelSize, 0).rgb;  // Top right.
+	float3 c = input.SampleLevel(linearMipPointClamp, (center + float2(-1.f, 1.f)) * texelSize, 0).rgb;  // Bottom left.
+	float3 d = input.SampleLevel(linearMipPointClamp, (center + float2(1.f, 1.f)) * texelSize, 0).rgb;  // Bottom right.
+	
+	// Partial Karis average, applied in blocks of 4 samples.
+	// See: http://advances.realtimerendering.com/s2014/sledgehammer/Next-Generation-Post-Processing-in-Call-of-Duty-Advanced-Warfare-v17.pptx
+	return KarisAverage(a, b, c, d);
+}
+
+float3 LoadTile(int2 location)
+{
+	const int index = location.y * tileSize + location.x;
+	return float3(groupRed[index], groupGreen[index], groupBlue[index]);
+}
+
+float3 Average(float3 a, float3 b, float3 c, float3 d)
+{
+	return (a + b + c + d) * 0.25f;
+}
+
+// Matches a bilinear sample on the corner shared by four texels, see Downsample.
+float3 BoxSample(int2 corner)
+{
+	return Average(LoadTile(corner + int2(-1, -1)), LoadTile(corner + int2(0, -1)), LoadTile(corner + int2(-1, 0)), LoadTile(corner));
+}
+
+float3 QuadSample(int2 corner)
+{
+	float3 a = BoxSample(corner + int2(-1, -1));  // Top left.
+	float3 b = BoxSample(corner + int2(1, -1));  // Top right.
+	float3 c = BoxSample(corner + int2(-1, 1));  // Bottom left.
+	float3 d = BoxSample(corner + int2(1, 1));  // Bottom right.
+	
+	return Average(a, b, c, d);
+}
+
+float3 FilteredSample(int2 corner)
+{
+	// Same 36 tap filter as the other downsamples.
+	float3 result = 0.5f * QuadSample(corner);  // Center.
+	result += 0.125f * QuadSample(corner + int2(-1, -1));  // Top left.
+	result += 0.125f * QuadSample(corner + int2(1, -1));  // Top right.
+	result += 0.125f * QuadSample(corner + int2(-1, 1));  // Bottom left.
+	result += 0.125f * QuadSample(corner + int2(1, 1));  // Bottom right.
+	
+	return result;
+}
+
 [RootSignature(RS)]
 [numthreads(8, 8, 1)]
-void Main(uint3 dispatchId : SV_DispatchThreadID)
+void Main(uint3 groupId : SV_GroupID, uint3 groupThreadId : SV_GroupThreadID, uint groupIndex : SV_GroupIndex)
 {
 	Texture2D<float4> input = ResourceDescriptorHeap[bindData.inputTexture];
 	RWTexture2D<float3> output = ResourceDescriptorHeap[bindData.outputTexture];
+	RWTexture2D<float3> downsample = ResourceDescriptorHeap[bindData.downsampleTexture];
 	
 	float2 inputDimensions;
 	input.GetDimensions(inputDimensions.x, inputDimensions.y);
+	const float2 texelSize = 1.f / inputDimensions;
 	
-	float2 center = (dispatchId.xy * 2.f + 1.f);
-	float2 texelSize = 1.f / inputDimensions;
+	uint2 outputDimensions;
+	output.GetDimensions(outputDimensions.x, outputDimensions.y);
 	
-	// 4 bilinear samples to prevent undersampling.
-	float3 a = input.Sample(linearMipPointClamp, (center + float2(-1.f, -1.f)) * texelSize).rgb;  // Top left.
-	float3 b = input.Sample(linearMipPointClamp, (center + float2(1.f, -1.f)) * texelSize).rgb;  // Top right.
-	float3 c = input.Sample(linearMipPointClamp, (center + float2(-1.f, 1.f)) * texelSize).rgb;  // Bottom left.
-	float3 d = input.Sample(linearMipPointClamp, (center + float2(1.f, 1.f)) * texelSize).rgb;  // Bottom right.
+	const int2 tileOrigin = int2(groupId.xy * 16) - tileBorder;
 	
-	// Partial Karis average, applied in blocks of 4 samples.
-	// See: http://advances.realtimerendering.com/s2014/sledgehammer/Next-Generation-Post-Processing-in-Call-of-Duty-Advanced-Warfare-v17.pptx
-	output[dispatchId.xy] = KarisAverage(a, b, c, d);
+	for (int i = groupIndex; i < tileSize * tileSize; i += 64)
+	{
+		const int2 local = int2(i % tileSize, i / tileSize);
+		const int2 texel = tileOrigin + local;
+		
+		// Texels outside of mip 0 are black, like the downsample's border sampler.
+		float3 value = 0.f;
+		if (all(texel >= 0) && all(texel < int2(outputDimensions)))
+		{
+			value = ExtractTexel(input, texel, texelSize);
+			
+			// Only write the owned texels, the border belongs to neighboring groups.
+			if (all(local >= tileBorder) && all(local < tileSize - tileBorder))
+			{
+				output[texel] = value;
+			}
+		}
+		
+		groupRed[i] = value.r;
+		groupGreen[i] = value.g;
+		groupBlue[i] = value.b;
+	}
+	
+	GroupMemoryBarrierWithGroupSync();
+	
+	uint2 downsampleDimensions;
+	downsample.GetDimensions(downsampleDimensions.x, downsampleDimensions.y);
+	
+	const uint2 texel = groupId.xy * 8 + groupThreadId.xy;
+	if (all(texel < downsampleDimensions))
+	{
+		// The downsampled texel's center is the corner between the owned mip 0 texels.
+		downsample[texel] = FilteredSample(int2(groupThreadId.xy * 2 + 1) + tileBorder);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,29 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#ifndef __BLOOM_FILTER_HLSLI__
+#define __BLOOM_FILTER_HLSLI__
+
+#include "RootSignature.hlsli"
+
+template <typename T>
+float3 FilteredSample(T source, uint level, float2 uv, float2 texelSize)
+{	
+	// 3x3 Bartlett filter.
+	// See: http://advances.realtimerendering.com/s2014/sledgehammer/Next-Generation-Post-Processing-in-Call-of-Duty-Advanced-Warfare-v17.pptx,
+	// https://www.researchgate.net/publication/220868865_Pyramid_filters_based_on_bilinear_interpolation
+
+	// Clamp to edge sampler, see: https://www.froyok.fr/blog/2021-12-ue4-custom-bloom/
+	float3 result = 1.f * source.SampleLevel(linearMipPointClamp, uv + float2(-texelSize.x, -texelSize.y), level).rgb;
+	result += 2.f * source.SampleLevel(linearMipPointClamp, uv + float2(0.f, -texelSize.y), level).rgb;
+	result += 1.f * source.SampleLevel(linearMipPointClamp, uv + float2(texelSize.x, -texelSize.y), level).rgb;
+	result += 2.f * source.SampleLevel(linearMipPointClamp, uv + float2(-texelSize.x, 0.f), level).rgb;
+	result += 4.f * source.SampleLevel(linearMipPointClamp, uv + float2(0.f, 0.f), level).rgb;
+	result += 2.f * source.SampleLevel(linearMipPointClamp, uv + float2(texelSize.x, 0.f), level).rgb;
+	result += 1.f * source.SampleLevel(linearMipPointClamp, uv + float2(-texelSize.x, texelSize.y), level).rgb;
+	result += 2.f * source.SampleLevel(linearMipPointClamp, uv + float2(0.f, texelSize.y), level).rgb;
+	result += 1.f * source.SampleLevel(linearMipPointClamp, uv + float2(texelSize.x, texelSize.y), level).rgb;
+
+	return result / 16.f;
+}
+
+#endif  // __BLOOM_FILTER_HLSLI__
\ No newline at end of file
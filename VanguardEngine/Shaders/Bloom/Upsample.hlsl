@@ -1,6 +1,7 @@
 // Copyright (c) 2019-2022 Andrew Depke
 
 #include "RootSignature.hlsli"
+#include "Bloom/Filter.hlsli"
 
 struct BindData
 {
@@ -12,27 +13,6 @@ struct BindData
 
 ConstantBuffer<BindData> bindData : register(b0);
 
-template <typename T>
-float3 FilteredSample(T source, uint level, float2 uv, float2 texelSize)
-{	
-	// 3x3 Bartlett filter.
-	// See: http://advances.realtimerendering.com/s2014/sledgehammer/Next-Generation-Post-Processing-in-Call-of-Duty-Advanced-Warfare-v17.pptx,
-	// https://www.researchgate.net/publication/220868865_Pyramid_filters_based_on_bilinear_interpolation
-
-	// Clamp to edge sampler, see: https://www.froyok.fr/blog/2021-12-ue4-custom-bloom/
-	float3 result = 1.f * source.SampleLevel(linearMipPointClamp, uv + float2(-texelSize.x, -texelSize.y), level).rgb;
-	result += 2.f * source.SampleLevel(linearMipPointClamp, uv + float2(0.f, -texelSize.y), level).rgb;
-	result += 1.f * source.SampleLevel(linearMipPointClamp, uv + float2(texelSize.x, -texelSize.y), level).rgb;
-	result += 2.f * source.SampleLevel(linearMipPointClamp, uv + float2(-texelSize.x, 0.f), level).rgb;
-	result += 4.f * source.SampleLevel(linearMipPointClamp, uv + float2(0.f, 0.f), level).rgb;
-	result += 2.f * source.SampleLevel(linearMipPointClamp, uv + float2(texelSize.x, 0.f), level).rgb;
-	result += 1.f * source.SampleLevel(linearMipPointClamp, uv + float2(-texelSize.x, texelSize.y), level).rgb;
-	result += 2.f * source.SampleLevel(linearMipPointClamp, uv + float2(0.f, texelSize.y), level).rgb;
-	result += 1.f * source.SampleLevel(linearMipPointClamp, uv + float2(texelSize.x, texelSize.y), level).rgb;
-
-	return result / 16.f;
-}
-
 [RootSignature(RS)]
 [numthreads(8, 8, 1)]
 void Main(uint3 dispatchId : SV_DispatchThreadID)
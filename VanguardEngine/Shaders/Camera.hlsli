@@ -21,8 +21,13 @@ struct Camera
 	float farPlane;
 	float fieldOfView;  // Horizontal, radians.
 	float aspectRatio;
+	float2 jitter;  // Clip space offset applied to the projection, the last frame matrices are unjittered.
+	float2 lastFrameJitter;
 };
 
+// Root descriptor of RS_CAMERA shaders, bound by the command list to every camera of the frame.
+StructuredBuffer<Camera> frameCameras : register(t0, space1);
+
 float4 UvToClipSpace(float2 uv)
 {
 	uv = float2(uv.x, 1.f - uv.y);  // Reverse the y axis.
@@ -44,13 +49,15 @@ float4 ClipToViewSpace(Camera camera, float4 clipSpace)
 	return viewSpace / viewSpace.w;  // Perspective division.
 }
 
+// View depth over the far plane, one for the sky. Read from the projection, which may have its far plane at infinity.
 float LinearizeDepth(Camera camera, float hyperbolicDepth)
 {
-	// Reversed planes for the inverse depth buffer.
-	float nearPlane = camera.farPlane;
-	float farPlane = camera.nearPlane;
+	// Clip space z = viewZ * _m22 + _m32 and w = -viewZ, for both finite and infinite inverse Z projections.
+	const float denominator = hyperbolicDepth + camera.projection._m22;
+	if (denominator <= 0.f)
+		return 1.f;
 
-	return (2.f * farPlane) / (nearPlane + farPlane - (1.f - hyperbolicDepth) * (nearPlane - farPlane));
+	return min(camera.projection._m32 / (denominator * camera.farPlane), 1.f);
 }
 
 float3 ComputeRayDirection(Camera camera, float2 uv)
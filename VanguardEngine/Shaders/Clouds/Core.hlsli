@@ -11,10 +11,27 @@
 #include "Volumetrics/PhaseFunctions.hlsli"
 #include "Atmosphere/Atmosphere.hlsli"
 
-float3 SampleWeather(Texture2D<float3> weatherTexture, float3 position)
+// The weather texture tiles and is only regenerated when its parameters change, wind advects it by scrolling the lookup.
+// Must match Clouds::GetWeatherScroll.
+float2 WeatherScroll(float2 wind, float time)
+{
+	const float timeDilation = 0.003;
+	return frac(wind * time * timeDilation);
+}
+
+// Cloud shadow map tuning, shared between generation and lookup.
+static const float cloudShadowExtinction = 4.0;  // Per kilometer of unit density.
+static const float cloudShadowMinSunHeight = 0.05;  // Limits the horizontal travel through the layer at sunset.
+
+float2 WeatherUv(float3 position, float2 scroll)
 {
 	const float frequency = 0.015;
-	return weatherTexture.Sample(bilinearWrap, position.xy * frequency + (0.5.xx));
+	return position.xy * frequency + (0.5.xx) + scroll;
+}
+
+float3 SampleWeather(Texture2D<float3> weatherTexture, float3 position, float2 scroll)
+{
+	return weatherTexture.Sample(bilinearWrap, WeatherUv(position, scroll));
 }
 
 float SampleBaseShape(Texture3D<float> noiseTexture, float3 position, uint mip)
@@ -78,7 +95,7 @@ float SampleCloudDensity(Texture2D<float3> weatherTexture, Texture3D<float> base
 	detailSample = false;
 #endif
 
-	float3 weather = SampleWeather(weatherTexture, position);
+	float3 weather = SampleWeather(weatherTexture, position, WeatherScroll(wind, time));
 	float coverage = weather.x;
 	const float type = weather.y;
 
@@ -205,7 +222,7 @@ float ComputeLightEnergy(Texture2D<float3> weatherTexture, Texture3D<float> base
 {
 	// Lighting model inspired by GPU Pro 7 page 119, Frostbite, and Nubis 2017 real-time volumetric cloudscapes.
 
-	float3 weather = SampleWeather(weatherTexture, position);
+	float3 weather = SampleWeather(weatherTexture, position, WeatherScroll(wind, time));
 	float absorption = weather.z;
 
 	// Sample the mean density at the sample position using a higher mip level.
@@ -415,7 +432,7 @@ MARCH_RESULT RayMarchInternal(Texture3D<float> baseShapeNoiseTexture, Texture3D<
 }
 
 MARCH_RESULT RayMarchClouds(Texture3D<float> baseShapeNoiseTexture, Texture3D<float> detailShapeNoiseTexture, StructuredBuffer<float3> atmosphereIrradiance,
-	Texture2D<float3> weatherTexture, Texture2D<float> geometryDepthTexture, Texture2D<float> blueNoiseTexture, Camera camera, float2 baseUv, float2 jitteredUv,
+	Texture2D<float3> weatherTexture, Texture2D<float> geometryDepthTexture, Texture2DArray<float> blueNoiseTexture, uint blueNoiseSlice, Camera camera, float2 baseUv, float2 jitteredUv,
 	uint2 outputResolution, float3 direction, float3 sunDirection, float2 wind, float time, out float3 scatteredLuminance, out float transmittance,
 	out float depth)
 {
@@ -502,13 +519,13 @@ MARCH_RESULT RayMarchClouds(Texture3D<float> baseShapeNoiseTexture, Texture3D<fl
 	}
 
 	// Offset the origin with blue noise to prevent banding artifacts. See: https://www.diva-portal.org/smash/get/diva2:1223894/FULLTEXT01.pdf
-	uint blueNoiseWidth, blueNoiseHeight;
-	blueNoiseTexture.GetDimensions(blueNoiseWidth, blueNoiseHeight);
+	uint blueNoiseWidth, blueNoiseHeight, blueNoiseSlices;
+	blueNoiseTexture.GetDimensions(blueNoiseWidth, blueNoiseHeight, blueNoiseSlices);
 	const float upscaleResolutionMultiplier = 4.f;
 	// Sample blue noise at one pixel per upscaled sample, so scale the coordinates by the resolution scale.
 	float2 blueNoiseSamplePos = jitteredUv * outputResolution * upscaleResolutionMultiplier;
 	blueNoiseSamplePos = blueNoiseSamplePos / float2(blueNoiseWidth, blueNoiseHeight);
-	float rayOffset = blueNoiseTexture.Sample(pointWrap, blueNoiseSamplePos);
+	float rayOffset = blueNoiseTexture.SampleLevel(pointWrap, float3(blueNoiseSamplePos, blueNoiseSlice), 0);
 	float jitter = rayOffset;  // Note: don't rescale to [-1, 1], as this could render participating media behind the camera.
 	
 #ifdef CLOUDS_LOW_DETAIL
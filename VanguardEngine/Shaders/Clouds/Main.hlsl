@@ -23,6 +23,8 @@ struct BindData
 	float2 wind;
 	uint2 outputResolution;
 	uint2 upscaledResolution;
+	uint blueNoiseSlice;
+	uint tileBuffer;  // Classified tiles, tiled draws only.
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
@@ -48,6 +50,25 @@ PixelIn VSMain(VertexIn input)
 	return output;
 }
 
+static const uint tileSize = 8;  // Matches the tile classification.
+
+// Each instance covers one tile of the output from the tile classification.
+[RootSignature(RS)]
+PixelIn VSTileMain(VertexIn input, uint instanceId : SV_InstanceID)
+{
+	StructuredBuffer<uint> tileBuffer = ResourceDescriptorHeap[bindData.tileBuffer];
+	const uint packedTile = tileBuffer[instanceId];
+	const uint2 tile = uint2(packedTile & 0xFFFF, packedTile >> 16);
+
+	static const uint2 corners[6] = { uint2(0, 0), uint2(1, 0), uint2(0, 1), uint2(0, 1), uint2(1, 0), uint2(1, 1) };
+
+	PixelIn output;
+	output.uv = min((tile + corners[input.vertexId]) * tileSize / (float2)bindData.outputResolution, 1.0);
+	output.positionCS = float4((output.uv.x - 0.5) * 2.0, -(output.uv.y - 0.5) * 2.0, 0, 1);  // Z of 0 due to the inverse depth.
+
+	return output;
+}
+
 [RootSignature(RS)]
 #ifdef CLOUDS_ONLY_DEPTH
 float PSMain(PixelIn input) : SV_Target
@@ -78,18 +99,18 @@ float4 PSMain(PixelIn input) : SV_Target
 	StructuredBuffer<float3> atmosphereIrradiance = ResourceDescriptorHeap[bindData.atmosphereIrradianceBuffer];
 	Texture2D<float3> weatherTexture = ResourceDescriptorHeap[bindData.weatherTexture];
 	Texture2D<float> geometryDepthTexture = ResourceDescriptorHeap[bindData.geometryDepthTexture];
-	Texture2D<float> blueNoiseTexture = ResourceDescriptorHeap[bindData.blueNoiseTexture];
+	Texture2DArray<float> blueNoiseTexture = ResourceDescriptorHeap[bindData.blueNoiseTexture];
 
 	float3 scatteredLuminance;
 	float transmittance;
 	float depth;  // Kilometers.
 #ifdef CLOUDS_DEBUG_MARCHCOUNT
 	int stepCount = RayMarchClouds(baseShapeNoiseTexture, detailShapeNoiseTexture, atmosphereIrradiance, weatherTexture,
-		geometryDepthTexture, blueNoiseTexture, camera, input.uv, jitteredUv, bindData.outputResolution, rayDirection,
+		geometryDepthTexture, blueNoiseTexture, bindData.blueNoiseSlice, camera, input.uv, jitteredUv, bindData.outputResolution, rayDirection,
 		sunDirection, bindData.wind, bindData.time, scatteredLuminance, transmittance, depth);
 #else
 	RayMarchClouds(baseShapeNoiseTexture, detailShapeNoiseTexture, atmosphereIrradiance, weatherTexture,
-		geometryDepthTexture, blueNoiseTexture, camera, input.uv, jitteredUv, bindData.outputResolution, rayDirection,
+		geometryDepthTexture, blueNoiseTexture, bindData.blueNoiseSlice, camera, input.uv, jitteredUv, bindData.outputResolution, rayDirection,
 		sunDirection, bindData.wind, bindData.time, scatteredLuminance, transmittance, depth);
 #endif
 
@@ -0,0 +1,58 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Constants.hlsli"
+#include "Clouds/Core.hlsli"
+
+struct BindData
+{
+	uint weatherTexture;
+	uint shadowTexture;
+	float solarZenithAngle;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void Main(uint3 dispatchId : SV_DispatchThreadID)
+{
+	Texture2D<float3> weatherTexture = ResourceDescriptorHeap[bindData.weatherTexture];
+	RWTexture2D<float> shadowTexture = ResourceDescriptorHeap[bindData.shadowTexture];
+
+	uint width, height;
+	shadowTexture.GetDimensions(width, height);
+
+	if (dispatchId.x >= width || dispatchId.y >= height)
+		return;
+
+	float3 sunDirection = float3(sin(bindData.solarZenithAngle), 0.f, cos(bindData.solarZenithAngle));
+	sunDirection.z = max(sunDirection.z, cloudShadowMinSunHeight);  // Must match CalculateSunVisibility.
+
+	// Texels are in unscrolled weather space, so the map tiles with the weather texture and wind only scrolls the lookup.
+	// Invert WeatherUv to find the point on the bottom of the cloud layer.
+	const float frequency = 0.015;
+	float2 uv = (dispatchId.xy + 0.5.xx) / float2(width, height);
+	float3 origin = float3((uv - 0.5.xx) / frequency, cloudLayerBottom);
+
+	// Only the weather coverage and height gradient are integrated. The noise advects independently of the weather
+	// and would tie the map to the wind, while contributing little to a shadow cast over kilometers.
+	const int steps = 16;
+	const float marchLength = (cloudLayerTop - cloudLayerBottom) / sunDirection.z;
+	const float stepSize = marchLength / steps;
+
+	float opticalDepth = 0.f;
+	for (int i = 0; i < steps; ++i)
+	{
+		float3 position = origin + sunDirection * stepSize * (i + 0.5);
+		float3 weather = weatherTexture.SampleLevel(bilinearWrap, WeatherUv(position, 0.xx), 0);
+
+		const float heightFraction = (position.z - cloudLayerBottom) / (cloudLayerTop - cloudLayerBottom);
+		const float coverage = pow(weather.x, 1.0 - 0.8 * abs(heightFraction - 0.6));
+		const float density = GetDensityHeightGradientForPoint(position, weather.y) * coverage;
+
+		opticalDepth += density * weather.z * stepSize;  // Absorption increases for rain clouds.
+	}
+
+	shadowTexture[dispatchId.xy] = opticalDepth * cloudShadowExtinction;
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Camera.hlsli"
+#include "Constants.hlsli"
+
+struct BindData
+{
+	uint hiZTexture;
+	uint hiZMipLevels;
+	uint cameraBuffer;
+	uint cameraIndex;
+	uint scatteringTransmittanceTexture;
+	uint depthTexture;
+	uint tileBuffer;
+	uint indirectBuffer;  // Tile draw arguments, cleared before classification.
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+static const uint tileSize = 8;
+
+groupshared bool groupMarch;
+
+// The cloud march ends at the geometry, so a tile only needs marching when its farthest geometry reaches past the nearest
+// point of the cloud layer. Conservative, the Hi-Z is built from the early depth and may have holes that the late depth
+// fills in.
+bool ShouldMarch(uint2 tile, uint2 outputSize)
+{
+	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
+	Camera camera = cameraBuffer[bindData.cameraIndex];
+
+	const float planetRadius = 6360.0;  // #TODO: Get from atmosphere data.
+
+	// Inside or above the layer, any ray can start in the clouds.
+	const float3 origin = camera.position.xyz / 1000.0;  // Meters to kilometers.
+	const float cloudDistance = planetRadius + cloudLayerBottom - length(origin - planetCenter);
+	if (cloudDistance <= 0)
+		return true;
+
+	// The march samples the geometry depth with jitter and a minimum filter, dilate the tile to cover those samples.
+	const float2 minUv = saturate(((float2)tile * tileSize - 1.0) / outputSize);
+	const float2 maxUv = saturate(((float2)tile * tileSize + tileSize + 1.0) / outputSize);
+
+	Texture2D<float> hiZTexture = ResourceDescriptorHeap[bindData.hiZTexture];
+	uint width, height, mipCount;
+	hiZTexture.GetDimensions(0, width, height, mipCount);
+	mipCount = min(mipCount, bindData.hiZMipLevels);
+
+	// Within a texel of the sampled mip the rectangle is covered by the sampler's 2x2 footprint, which keeps the farthest depth.
+	const float projectedSize = max((maxUv.x - minUv.x) * width, (maxUv.y - minUv.y) * height);
+	const float level = ceil(log2(max(projectedSize, 1.0)));
+	if (level >= mipCount)
+		return true;
+
+	const float depth = hiZTexture.SampleLevel(linearMipPointClampMinimum, (minUv + maxUv) * 0.5, level);
+	if (depth <= 0)
+		return true;  // Sky, inverse Z.
+
+	// Compared in view depth, the same as the march's geometry test.
+	const float farthestDepth = LinearizeDepth(camera, depth) * camera.farPlane / 1000.0;  // Meters to kilometers.
+
+	return farthestDepth >= cloudDistance;
+}
+
+// Lists the tiles of the low resolution cloud output that need marching for an indirect draw, and writes the results of an
+// empty march into the rest.
+[RootSignature(RS)]
+[numthreads(tileSize, tileSize, 1)]
+void Main(uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex, uint3 dispatchId : SV_DispatchThreadID)
+{
+	RWTexture2D<float4> scatteringTransmittanceTexture = ResourceDescriptorHeap[bindData.scatteringTransmittanceTexture];
+	RWTexture2D<float> depthTexture = ResourceDescriptorHeap[bindData.depthTexture];
+
+	uint2 outputSize;
+	scatteringTransmittanceTexture.GetDimensions(outputSize.x, outputSize.y);
+
+	if (groupIndex == 0)
+	{
+		groupMarch = ShouldMarch(groupId.xy, outputSize);
+		if (groupMarch)
+		{
+			RWStructuredBuffer<uint> tileBuffer = ResourceDescriptorHeap[bindData.tileBuffer];
+			RWStructuredBuffer<uint4> indirectBuffer = ResourceDescriptorHeap[bindData.indirectBuffer];
+
+			uint index;
+			InterlockedAdd(indirectBuffer[0].y, 1, index);
+			tileBuffer[index] = groupId.x | (groupId.y << 16);
+		}
+	}
+
+	if (all(dispatchId.xy == 0))
+	{
+		RWStructuredBuffer<uint4> indirectBuffer = ResourceDescriptorHeap[bindData.indirectBuffer];
+		indirectBuffer[0].x = 6;  // Two triangles per tile instance.
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	if (!groupMarch && all(dispatchId.xy < outputSize))
+	{
+		scatteringTransmittanceTexture[dispatchId.xy] = float4(0, 0, 0, 1);
+		depthTexture[dispatchId.xy] = 1000000;  // Matches an early out of the march.
+	}
+}
@@ -23,6 +23,26 @@ struct BindData
 
 ConstantBuffer<BindData> bindData : register(b0);
 
+static const float historyDepthTolerance = 0.1;  // Relative to the farthest depth in the neighborhood.
+static const float historyVelocityLimit = 32.f;  // Pixels per frame of motion where history is fully rejected.
+
+// Min and max of the low resolution 3x3 neighborhood.
+void NeighborhoodBounds(Texture2D<float> targetTexture, uint2 location, out float minValue, out float maxValue)
+{
+	minValue = targetTexture[location];
+	maxValue = minValue;
+
+	for (int y = -1; y <= 1; ++y)
+	{
+		for (int x = -1; x <= 1; ++x)
+		{
+			const float value = targetTexture[location + int2(x, y)];
+			minValue = min(minValue, value);
+			maxValue = max(maxValue, value);
+		}
+	}
+}
+
 // 3x3 neighborhood clamp filter by Playdead Games
 // From: https://github.com/playdeadgames/temporal/blob/master/Assets/Shaders/TemporalReprojection.shader
 template <typename T, typename U>
@@ -100,7 +120,19 @@ void Main(uint3 dispatchId : SV_DispatchThreadID)
 	// Run through a series of history rejection tests to discard bad history.
 	bool reject = false;
 	
-	if (any(oldUv.x > 1.f) || any(oldUv < 0.f))
+	if (any(oldUv > 1.f) || any(oldUv < 0.f))
+	{
+		reject = true;
+	}
+	
+	// Disocclusion between cloud layers, the history sample belongs to a cloud at a depth that isn't covered by any of
+	// the new samples around this pixel. Each low resolution neighbor traced a different subpixel, so compare against the
+	// neighborhood's range instead of the single sample.
+	float neighborhoodMinDepth;
+	float neighborhoodMaxDepth;
+	NeighborhoodBounds(newDepthTexture, lowResSampleCoords, neighborhoodMinDepth, neighborhoodMaxDepth);
+	const float depthTolerance = neighborhoodMaxDepth * historyDepthTolerance;
+	if (oldDepth < neighborhoodMinDepth - depthTolerance || oldDepth > neighborhoodMaxDepth + depthTolerance)
 	{
 		reject = true;
 	}
@@ -126,6 +158,10 @@ void Main(uint3 dispatchId : SV_DispatchThreadID)
 	
 	float blendWeight = JitterAlignedPixel(newUv, uint2(width, height), bindData.timeSlice);
 	
+	// Fast motion smears the history across many pixels before each one is retraced, fade it out with velocity.
+	const float2 pixelVelocity = (newUv - oldUv) * float2(width, height);
+	blendWeight *= saturate(1.f - length(pixelVelocity) / historyVelocityLimit);
+	
 	if (!reject)
 	{
 		// Apply neighborhood clipping.
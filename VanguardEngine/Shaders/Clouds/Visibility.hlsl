@@ -22,6 +22,7 @@ struct BindData
 	uint2 upscaledResolution;
 	float2 wind;
 	float time;
+	uint blueNoiseSlice;
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
@@ -36,7 +37,7 @@ float RayMarch(Camera camera, float2 baseUv, float2 jitteredUv, uint width, uint
 	StructuredBuffer<float3> atmosphereIrradiance = ResourceDescriptorHeap[bindData.atmosphereIrradianceBuffer];
 	Texture2D<float3> weatherTexture = ResourceDescriptorHeap[bindData.weatherTexture];
 	Texture2D<float> geometryDepthTexture = ResourceDescriptorHeap[bindData.geometryDepthTexture];
-	Texture2D<float> blueNoiseTexture = ResourceDescriptorHeap[bindData.blueNoiseTexture];
+	Texture2DArray<float> blueNoiseTexture = ResourceDescriptorHeap[bindData.blueNoiseTexture];
 	
 	const float planetRadius = 6360.0;  // #TODO: Get from atmosphere data.
 	
@@ -84,13 +85,13 @@ float RayMarch(Camera camera, float2 baseUv, float2 jitteredUv, uint width, uint
 		return 0;
 	}
 	
-	uint blueNoiseWidth, blueNoiseHeight;
-	blueNoiseTexture.GetDimensions(blueNoiseWidth, blueNoiseHeight);
+	uint blueNoiseWidth, blueNoiseHeight, blueNoiseSlices;
+	blueNoiseTexture.GetDimensions(blueNoiseWidth, blueNoiseHeight, blueNoiseSlices);
 	const float upscaleResolutionMultiplier = 4.f;
 	// Sample blue noise at one pixel per upscaled sample, so scale the coordinates by the resolution scale.
 	float2 blueNoiseSamplePos = jitteredUv * uint2(width, height) * upscaleResolutionMultiplier;
 	blueNoiseSamplePos = blueNoiseSamplePos / float2(blueNoiseWidth, blueNoiseHeight);
-	float rayOffset = blueNoiseTexture.Sample(pointWrap, blueNoiseSamplePos);
+	float rayOffset = blueNoiseTexture.SampleLevel(pointWrap, float3(blueNoiseSamplePos, bindData.blueNoiseSlice), 0);
 	float jitter = (rayOffset - 0.5f) * 2.f;  // Rescale to [-1, 1]
 	jitter *= 0.5;
 	
@@ -9,8 +9,6 @@ struct BindData
 	uint weatherTexture;
 	float globalCoverage;
 	float precipitation;
-	float time;
-	float2 wind;
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
@@ -26,11 +24,9 @@ void Main(uint3 dispatchId : SV_DispatchThreadID)
 	weatherTexture.GetDimensions(width, height);
 	float weatherSize = float(width);
 
+	// Not advected here, the noise tiles so wind scrolls the lookup instead. See WeatherScroll.
 	float2 coord = float2(dispatchId.xy) * (1.0 / weatherSize);
 
-	const float timeDilation = 0.003;
-	coord += bindData.wind * bindData.time * timeDilation;
-
 	float coverage = PerlinNoise2D(coord, 8, 4);
 	coverage = saturate(RemapRange(coverage, 1.0 - bindData.globalCoverage, 1, 0, 1));
 	
@@ -1,70 +1,145 @@
 // Copyright (c) 2019-2022 Andrew Depke
 
 #include "RootSignature.hlsli"
-#include "VertexAssembly.hlsli"
-#include "Object.hlsli"
 #include "Camera.hlsli"
 #include "Clusters/Clusters.hlsli"
 
 struct BindData
 {
-	uint batchId;
-	uint objectBuffer;
 	uint cameraBuffer;
 	uint cameraIndex;
-	uint vertexPositionBuffer;
+	uint depthTexture;
 	uint visibilityBuffer;
 	float logY;
-	float padding;
 	int3 dimensions;
+	uint denseListBuffer;
+	uint volumetricSlices;  // Near slices binned even without geometry, for volumetric fog.
+	uint indirectBuffer;  // Binning dispatch, the group count doubles as the dense list's length. Cleared before culling.
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
 
-struct VertexIn
-{
-	uint vertexId : SV_VertexID;
-	uint instanceId : SV_InstanceID;
-};
+// Each group marks the depth slices covered by one froxel tile of the depth buffer. Slices are gathered into a groupshared
+// mask, so every visible cluster is written once instead of once per pixel, and no geometry needs to be drawn again. The
+// group is the only one marking its tile's column of clusters, so it also compacts the column's active clusters into the
+// binning list once the mask is complete, without another pass reading the visibility back.
 
-struct PSInput
-{
-	float4 positionCS : SV_POSITION;  // Clip space.
-	float depthVS : DEPTH;  // View space.
-};
+static const uint groupSize = 8;
+static const uint maxSlices = 2048;  // Deeper slices are rare, and written directly.
 
-[RootSignature(RS)]
-PSInput VSMain(VertexIn input)
+groupshared uint sliceMask[maxSlices / 32];
+groupshared uint deepSlices;  // Any slice past the mask was marked, every deep slice of the column is binned.
+
+void MarkSlice(uint2 tile, uint slice)
 {
-	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
-	ObjectData object = objectBuffer[bindData.batchId + input.instanceId];
-	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
-	Camera camera = cameraBuffer[bindData.cameraIndex];
+	if (slice < maxSlices)
+	{
+		InterlockedOr(sliceMask[slice / 32], 1u << (slice % 32));
+	}
 
-	VertexAssemblyData assemblyData;
-	assemblyData.positionBuffer = bindData.vertexPositionBuffer;
-	assemblyData.extraBuffer = 0;  // Unused.
-	assemblyData.metadata = object.vertexMetadata;
-
-	PSInput output;
-	output.positionCS = LoadVertexPosition(assemblyData, input.vertexId);
-	output.positionCS = mul(output.positionCS, object.worldMatrix);
-	output.positionCS = mul(output.positionCS, camera.view);
-	output.depthVS = output.positionCS.z;
-	output.positionCS = mul(output.positionCS, camera.projection);
-	
-	return output;
+	else
+	{
+		RWBuffer<uint> clusterVisibilityBuffer = ResourceDescriptorHeap[bindData.visibilityBuffer];
+		clusterVisibilityBuffer[ClusterId2Index(bindData.dimensions, uint3(tile, slice))] = true;
+		deepSlices = true;
+	}
 }
 
 [RootSignature(RS)]
-[earlydepthstencil]
-void PSMain(PSInput input)
+[numthreads(groupSize, groupSize, 1)]
+void Main(uint3 groupId : SV_GroupID, uint3 groupThreadId : SV_GroupThreadID, uint groupIndex : SV_GroupIndex)
 {
 	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
 	Camera camera = cameraBuffer[bindData.cameraIndex];
+	Texture2D<float> depthTexture = ResourceDescriptorHeap[bindData.depthTexture];
+
+	for (uint i = groupIndex; i < maxSlices / 32; i += groupSize * groupSize)
+	{
+		sliceMask[i] = 0;
+	}
+
+	if (groupIndex == 0)
+	{
+		deepSlices = false;
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	uint2 size;
+	depthTexture.GetDimensions(size.x, size.y);
+
+	const uint2 tileOrigin = groupId.xy * FROXEL_SIZE;
+	const uint2 tileEnd = min(tileOrigin + FROXEL_SIZE, size);
+
+	// Neighboring pixels mostly share a slice, only mark a slice when it changes.
+	uint lastSlice = 0xFFFFFFFF;
+
+	for (uint y = tileOrigin.y + groupThreadId.y; y < tileEnd.y; y += groupSize)
+	{
+		for (uint x = tileOrigin.x + groupThreadId.x; x < tileEnd.x; x += groupSize)
+		{
+			const float depth = depthTexture[uint2(x, y)];
+			if (depth <= 0.f)
+			{
+				continue;  // Inverse depth, the far plane is the sky.
+			}
+
+			const float depthVS = ClipToViewSpace(camera, float4(0.f, 0.f, depth, 1.f)).z;
+			const uint slice = min(DrawToClusterId(FROXEL_SIZE, bindData.logY, camera, float2(x, y), depthVS).z, bindData.dimensions.z - 1);
+			if (slice != lastSlice)
+			{
+				MarkSlice(groupId.xy, slice);
+				lastSlice = slice;
+			}
+		}
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	// Fully depth culled clusters keep their cleared visibility flag.
 	RWBuffer<uint> clusterVisibilityBuffer = ResourceDescriptorHeap[bindData.visibilityBuffer];
+	RWStructuredBuffer<uint> denseClusterList = ResourceDescriptorHeap[bindData.denseListBuffer];
+	RWStructuredBuffer<uint3> indirectBuffer = ResourceDescriptorHeap[bindData.indirectBuffer];
+
+	if (all(groupId.xy == 0) && groupIndex == 0)
+	{
+		indirectBuffer[0].yz = 1;  // One binning group per active cluster.
+	}
 
-	// Fully depth culled clusters will have their visibility flag set to false.
-	uint3 clusterId = DrawToClusterId(FROXEL_SIZE, bindData.logY, camera, input.positionCS.xy, input.depthVS);
-	clusterVisibilityBuffer[ClusterId2Index(bindData.dimensions, clusterId)] = true;
-}
\ No newline at end of file
+	// Every lane runs the same number of iterations, so the wave operations see whole waves.
+	const uint slices = (uint)bindData.dimensions.z;
+	for (uint base = 0; base < slices; base += groupSize * groupSize)
+	{
+		const uint slice = base + groupIndex;
+		const uint clusterIndex = ClusterId2Index(bindData.dimensions, uint3(groupId.xy, slice));
+
+		bool visible = false;
+		bool active = false;
+		if (slice < slices)
+		{
+			visible = slice < maxSlices ? (sliceMask[slice / 32] & (1u << (slice % 32))) != 0 : deepSlices;
+			active = visible || slice < bindData.volumetricSlices;
+		}
+
+		if (visible && slice < maxSlices)
+		{
+			clusterVisibilityBuffer[clusterIndex] = true;
+		}
+
+		// Reserve a contiguous range for the wave's active clusters with a single atomic.
+		const uint count = WaveActiveCountBits(active);
+		const uint offset = WavePrefixCountBits(active);
+		uint first = 0;
+		if (WaveIsFirstLane() && count > 0)
+		{
+			InterlockedAdd(indirectBuffer[0].x, count, first);
+		}
+
+		first = WaveReadLaneFirst(first);
+
+		if (active)
+		{
+			denseClusterList[first + offset] = clusterIndex;
+		}
+	}
+}
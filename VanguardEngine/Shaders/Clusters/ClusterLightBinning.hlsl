@@ -3,18 +3,18 @@
 #include "RootSignature.hlsli"
 #include "Light.hlsli"
 #include "Geometry.hlsli"
+#include "Clusters/Clusters.hlsli"
 
 struct BindData
 {
-	uint cameraBuffer;
-	uint cameraIndex;
 	uint denseClusterListBuffer;
 	uint clusterBoundsBuffer;
-	uint lightsBuffer;
-	uint lightCount;
+	uint visibleLightsBuffer;
+	uint visibleLightCounterBuffer;
 	uint lightCounterBuffer;
 	uint lightListBuffer;
 	uint lightInfoBuffer;
+	uint lightListCapacity;
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
@@ -23,36 +23,57 @@ static const uint threadGroupSize = 64;
 
 groupshared AABB froxelBounds;
 groupshared uint localLightCount;
-groupshared uint localLightList[MAX_LIGHTS_PER_FROXEL];
+groupshared uint localLightList[MAX_LIGHTS_PER_FROXEL * 2];  // Room to pad the sort to a power of two.
 groupshared uint globalLightListOffset;
 
-bool LightInFroxel(Camera camera, Light light, AABB aabb)
+// See: https://bartwronski.com/2017/04/13/cull-that-cone/
+bool ConeSphereIntersection(VisibleLight light, float3 center, float radius)
 {
-	switch (light.type)
+	const float3 offset = center - light.positionVS;
+	const float lengthSquared = dot(offset, offset);
+	const float alongAxis = dot(offset, light.directionVS);
+	const float closestDistance = light.coneCos * sqrt(max(lengthSquared - alongAxis * alongAxis, 0.f)) - alongAxis * light.coneSin;
+
+	const bool angleCull = closestDistance > radius;
+	const bool frontCull = alongAxis > radius + light.radius;
+	const bool backCull = alongAxis < -radius;
+
+	return !(angleCull || frontCull || backCull);
+}
+
+bool LightInFroxel(VisibleLight light, AABB aabb)
+{
+	if (!SphereAABBIntersection(light.positionVS, light.radius, aabb))
 	{
-		case LightType::Point:
-		{
-			// #TODO: Precompute view space position of each light in a separate pass to prevent redundant work.
-			float4 viewSpace = mul(float4(light.position, 1.f), camera.view);
-			return SphereAABBIntersection(viewSpace.xyz, ComputeLightRadius(light), aabb);
-		}
-		case LightType::Directional:
-			return true;
+		return false;
 	}
-	
-	return false;
+
+	const float3 center = (aabb.min.xyz + aabb.max.xyz) * 0.5;
+	const float3 extents = (aabb.max.xyz - aabb.min.xyz) * 0.5;
+
+	if (light.type == (uint)LightType::Spot)
+	{
+		return ConeSphereIntersection(light, center, length(extents));
+	}
+
+	if (light.type == (uint)LightType::Area)
+	{
+		// Reject froxels entirely behind the emitting side.
+		return dot(center - light.positionVS, light.directionVS) + dot(extents, abs(light.directionVS)) >= 0.f;
+	}
+
+	return true;
 }
 
-// Bins all lights into froxels. One thread group per froxel.
+// Bins the frustum culled lights into froxels. One thread group per froxel.
 [RootSignature(RS)]
 [numthreads(threadGroupSize, 1, 1)]
 void Main(uint3 dispatchId : SV_DispatchThreadID, uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex)
 {
-	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
-	Camera camera = cameraBuffer[bindData.cameraIndex];
 	StructuredBuffer<uint> denseClusterList = ResourceDescriptorHeap[bindData.denseClusterListBuffer];
 	StructuredBuffer<AABB> clusterBounds = ResourceDescriptorHeap[bindData.clusterBoundsBuffer];
-	StructuredBuffer<Light> lights = ResourceDescriptorHeap[bindData.lightsBuffer];
+	StructuredBuffer<VisibleLight> visibleLights = ResourceDescriptorHeap[bindData.visibleLightsBuffer];
+	StructuredBuffer<uint> visibleLightCounter = ResourceDescriptorHeap[bindData.visibleLightCounterBuffer];
 	RWStructuredBuffer<uint> lightCounter = ResourceDescriptorHeap[bindData.lightCounterBuffer];
 	RWStructuredBuffer<uint> lightList = ResourceDescriptorHeap[bindData.lightListBuffer];
 	RWStructuredBuffer<uint2> clusterLightInfo = ResourceDescriptorHeap[bindData.lightInfoBuffer];
@@ -68,16 +89,19 @@ void Main(uint3 dispatchId : SV_DispatchThreadID, uint3 groupId : SV_GroupID, ui
 	
 	GroupMemoryBarrierWithGroupSync();
 	
+	const uint visibleLightCount = visibleLightCounter[0];
+	
 	// Interleaved iteration between all threads in the group. Divides the work evenly.
-	for (uint i = groupIndex; i < bindData.lightCount; i += threadGroupSize)
+	for (uint i = groupIndex; i < visibleLightCount; i += threadGroupSize)
 	{
-		if (LightInFroxel(camera, lights[i], froxelBounds))
+		const VisibleLight light = visibleLights[i];
+		if (LightInFroxel(light, froxelBounds))
 		{
 			uint index;
 			InterlockedAdd(localLightCount, 1, index);
 			if (index < MAX_LIGHTS_PER_FROXEL)
 			{
-				localLightList[index] = i;
+				localLightList[index] = light.lightIndex;
 			}
 		}
 	}
@@ -89,10 +113,51 @@ void Main(uint3 dispatchId : SV_DispatchThreadID, uint3 groupId : SV_GroupID, ui
 	{
 		localLightCount = min(localLightCount, MAX_LIGHTS_PER_FROXEL);  // Prevent overflowing light bins.
 		InterlockedAdd(lightCounter[0], localLightCount, globalLightListOffset);
+		// The global list is sized for the average froxel, so once it's exhausted froxels keep only what fits.
+		localLightCount = min(localLightCount, bindData.lightListCapacity - min(globalLightListOffset, bindData.lightListCapacity));
 		clusterLightInfo[denseClusterList[groupId.x]] = uint2(globalLightListOffset, localLightCount);
 	}
 	
 	GroupMemoryBarrierWithGroupSync();
+
+	// Sort the froxel's lights, so shading can walk the lists of neighboring froxels in lockstep. Bitonic sort, padded with
+	// invalid indices that sort to the end.
+	uint sortSize = 1;
+	while (sortSize < localLightCount)
+	{
+		sortSize <<= 1;
+	}
+
+	for (uint i = localLightCount + groupIndex; i < sortSize; i += threadGroupSize)
+	{
+		localLightList[i] = 0xFFFFFFFF;
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	for (uint size = 2; size <= sortSize; size <<= 1)
+	{
+		for (uint stride = size >> 1; stride > 0; stride >>= 1)
+		{
+			for (uint i = groupIndex; i < sortSize; i += threadGroupSize)
+			{
+				const uint partner = i ^ stride;
+				if (partner > i)
+				{
+					const uint first = localLightList[i];
+					const uint second = localLightList[partner];
+					const bool ascending = (i & size) == 0;
+					if ((first > second) == ascending)
+					{
+						localLightList[i] = second;
+						localLightList[partner] = first;
+					}
+				}
+			}
+
+			GroupMemoryBarrierWithGroupSync();
+		}
+	}
 	
 	// Merge the local light list with our partition in the global list.
 	for (uint i = groupIndex; i < localLightCount; i += threadGroupSize)
@@ -0,0 +1,110 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Light.hlsli"
+#include "Culling.hlsli"
+#include "Clusters/Clusters.hlsli"
+
+struct BindData
+{
+	uint cullingViewBuffer;
+	uint cameraIndex;
+	uint lightsBuffer;
+	uint lightCount;  // Slots, including free slots.
+	uint visibleLightsBuffer;
+	uint visibleLightCounterBuffer;
+	uint directionalLightListBuffer;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+groupshared uint localLightCount;
+groupshared uint globalLightOffset;
+
+// Compacts the local lights within the view frustum, transformed into view space for the cluster tests. Directional lights
+// are gathered into their own list instead. One thread per light.
+[RootSignature(RS)]
+[numthreads(64, 1, 1)]
+void Main(uint3 dispatchId : SV_DispatchThreadID, uint groupIndex : SV_GroupIndex)
+{
+	StructuredBuffer<CullingView> cullingViewBuffer = ResourceDescriptorHeap[bindData.cullingViewBuffer];
+	CullingView view = cullingViewBuffer[bindData.cameraIndex];
+	StructuredBuffer<Light> lights = ResourceDescriptorHeap[bindData.lightsBuffer];
+	RWStructuredBuffer<VisibleLight> visibleLights = ResourceDescriptorHeap[bindData.visibleLightsBuffer];
+	RWStructuredBuffer<uint> visibleLightCounter = ResourceDescriptorHeap[bindData.visibleLightCounterBuffer];
+	RWStructuredBuffer<uint> directionalLightList = ResourceDescriptorHeap[bindData.directionalLightListBuffer];
+
+	if (groupIndex == 0)
+	{
+		localLightCount = 0;
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	bool visible = false;
+	VisibleLight visibleLight;
+	visibleLight.lightIndex = dispatchId.x;
+	visibleLight.coneCos = 0.f;
+	visibleLight.coneSin = 0.f;
+	visibleLight.padding = 0.f;
+
+	const Light light = lights[min(dispatchId.x, bindData.lightCount - 1)];
+	if (dispatchId.x < bindData.lightCount && (uint)light.type != freeLightSlot)
+	{
+		visibleLight.type = (uint)light.type;
+		visibleLight.positionVS = mul(float4(light.position, 1.f), view.view).xyz;
+		visibleLight.directionVS = normalize(mul(float4(light.direction, 0.f), view.view).xyz);
+		visibleLight.radius = ComputeLightRadius(light);
+
+		switch (light.type)
+		{
+			case LightType::Directional:
+			{
+				uint slot;
+				InterlockedAdd(directionalLightList[0], 1, slot);
+				directionalLightList[1 + slot] = dispatchId.x;
+				break;
+			}
+			case LightType::Spot:
+			{
+				visibleLight.coneCos = light.spotCosOuter;
+				visibleLight.coneSin = sqrt(saturate(1.f - light.spotCosOuter * light.spotCosOuter));
+				visible = IsSphereInFrustum(light.position, visibleLight.radius, view);
+				break;
+			}
+			case LightType::Area:
+			{
+				// Range is measured from the closest point on the rectangle.
+				visibleLight.radius += length(light.areaExtents);
+				visible = IsSphereInFrustum(light.position, visibleLight.radius, view);
+				break;
+			}
+			default:
+			{
+				visible = IsSphereInFrustum(light.position, visibleLight.radius, view);
+				break;
+			}
+		}
+	}
+
+	// Count within the group first, so there's only one global atomic per group.
+	uint localOffset = 0;
+	if (visible)
+	{
+		InterlockedAdd(localLightCount, 1, localOffset);
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	if (groupIndex == 0)
+	{
+		InterlockedAdd(visibleLightCounter[0], localLightCount, globalLightOffset);
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	if (visible)
+	{
+		visibleLights[globalLightOffset + localOffset] = visibleLight;
+	}
+}
\ No newline at end of file
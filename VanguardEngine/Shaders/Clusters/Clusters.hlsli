@@ -5,6 +5,21 @@
 
 #include "Camera.hlsli"
 
+// Local lights that passed frustum culling, in view space. Transformed once per frame instead of once per froxel.
+struct VisibleLight
+{
+	float3 positionVS;
+	float radius;  // Bounding sphere, centered on the position.
+	// Boundary
+	float3 directionVS;  // Spot and area lights.
+	uint lightIndex;
+	// Boundary
+	uint type;  // LightType.
+	float coneCos;  // Spot light outer angle.
+	float coneSin;
+	float padding;
+};
+
 uint ClusterId2Index(uint3 dimensions, uint3 id)
 {
 	return id.x + (dimensions.x * (id.y + dimensions.y * id.z));
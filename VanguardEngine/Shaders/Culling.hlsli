@@ -0,0 +1,146 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#ifndef __CULLING_HLSLI__
+#define __CULLING_HLSLI__
+
+#include "RootSignature.hlsli"
+
+#pragma pack_matrix(row_major)
+
+// Constants of a view for the culling shaders, built once per frame next to the cameras and indexed the same way. A
+// fraction of the camera's size, and bounds are tested in world space instead of being transformed into view space.
+struct CullingView
+{
+	float4 frustumPlanes[6];  // World space, normalized and facing inwards. Left, right, bottom, top, near and far.
+	matrix view;
+	matrix viewProjection;
+	float4 position;  // World space.
+	float2 projectionScale;  // Projection _m00 and _m11.
+	float nearPlane;
+	uint orthographic;
+	float2 hiZSize;  // Dimensions of the Hi-Z pyramid's first level, only valid for the views culled against it.
+	uint hiZMipCount;  // Levels of the Hi-Z texture, not all of them are generated.
+	float padding;
+};
+
+// Sphere center is in view space, with +Z going outwards from the camera.
+// Credit: 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere
+bool ProjectSphere(float3 center, float radius, CullingView view, out float4 aabb)
+{
+	// Near plane culling.
+	if (center.z < view.nearPlane + radius)
+		return false;
+
+	float2 cx = -center.xz;
+	float2 vx = float2(sqrt(dot(cx, cx) - radius * radius), radius);
+	float2 minx = mul(cx, float2x2(vx.x, vx.y, -vx.y, vx.x));
+	float2 maxx = mul(cx, float2x2(vx.x, -vx.y, vx.y, vx.x));
+
+	float2 cy = -center.yz;
+	float2 vy = float2(sqrt(dot(cy, cy) - radius * radius), radius);
+	float2 miny = mul(cy, float2x2(vy.x, vy.y, -vy.y, vy.x));
+	float2 maxy = mul(cy, float2x2(vy.x, -vy.y, vy.y, vy.x));
+
+	float p00 = view.projectionScale.x;
+	float p11 = view.projectionScale.y;
+	aabb = float4(minx.x / minx.y * p00, miny.x / miny.y * p11, maxx.x / maxx.y * p00, maxy.x / maxy.y * p11);
+	aabb = aabb.xwzy * float4(0.5, -0.5, 0.5, -0.5) + 0.5.xxxx;
+
+	return true;
+}
+
+// Sphere center is in world space.
+bool IsSphereInFrustum(float3 center, float radius, CullingView view)
+{
+	bool visible = true;
+
+	[unroll]
+	for (uint i = 0; i < 6; ++i)
+	{
+		visible = visible && dot(view.frustumPlanes[i].xyz, center) + view.frustumPlanes[i].w >= -radius;
+	}
+
+	return visible;
+}
+
+// Box center and extents are in world space, the box being aligned to the world's axes.
+bool IsBoxInFrustum(float3 center, float3 extents, CullingView view)
+{
+	bool visible = true;
+
+	[unroll]
+	for (uint i = 0; i < 6; ++i)
+	{
+		// Distance of the box's corner furthest along the plane's normal.
+		const float4 plane = view.frustumPlanes[i];
+		visible = visible && dot(plane.xyz, center) + plane.w + dot(abs(plane.xyz), extents) >= 0.f;
+	}
+
+	return visible;
+}
+
+// Tests the world space sphere against a Hi-Z built from the current frame's depth.
+bool IsSphereOccluded(float3 center, float radius, CullingView view, uint hiZTextureIndex, uint hiZMipLevels)
+{
+	center = mul(float4(center, 1.f), view.view).xyz;
+
+	// Convention here is +Z going outwards from camera.
+	center.z *= -1;
+
+	float4 aabb;
+	if (!ProjectSphere(center, radius, view, aabb))
+		return false;
+
+	Texture2D<float> hiZTexture = ResourceDescriptorHeap[hiZTextureIndex];
+	const uint mipCount = min(view.hiZMipCount, hiZMipLevels) - 1;
+
+	float projectedWidth = (aabb.z - aabb.x) * view.hiZSize.x;
+	float projectedHeight = (aabb.w - aabb.y) * view.hiZSize.y;
+
+	float level = min(floor(log2(max(projectedWidth, projectedHeight))), mipCount);
+	float2 uv = (aabb.xy + aabb.zw) * 0.5;
+	float depth = hiZTexture.SampleLevel(linearMipPointClampMinimum, uv, level);
+	float depthSphere = view.nearPlane / (center.z - radius);
+
+	return depthSphere < depth;  // Inverse Z.
+}
+
+// Tests the world space box against a Hi-Z built from the current frame's depth, over the screen rectangle of its corners.
+bool IsBoxOccluded(float3 center, float3 extents, CullingView view, uint hiZTextureIndex, uint hiZMipLevels)
+{
+	float2 minUv = 1.f;
+	float2 maxUv = 0.f;
+	float nearest = 1e30f;  // Closest view depth of the corners, clip space W of a perspective projection.
+
+	[unroll]
+	for (uint i = 0; i < 8; ++i)
+	{
+		const float3 corner = center + extents * float3(i & 1 ? 1.f : -1.f, i & 2 ? 1.f : -1.f, i & 4 ? 1.f : -1.f);
+		const float4 clipSpace = mul(float4(corner, 1.f), view.viewProjection);
+		const float2 uv = clipSpace.xy / clipSpace.w * float2(0.5f, -0.5f) + 0.5f;
+		minUv = min(minUv, uv);
+		maxUv = max(maxUv, uv);
+		nearest = min(nearest, clipSpace.w);
+	}
+
+	// The rectangle is meaningless once a corner crosses the near plane.
+	if (nearest < view.nearPlane)
+		return false;
+
+	minUv = saturate(minUv);
+	maxUv = saturate(maxUv);
+
+	Texture2D<float> hiZTexture = ResourceDescriptorHeap[hiZTextureIndex];
+	const uint mipCount = min(view.hiZMipCount, hiZMipLevels) - 1;
+
+	float projectedWidth = (maxUv.x - minUv.x) * view.hiZSize.x;
+	float projectedHeight = (maxUv.y - minUv.y) * view.hiZSize.y;
+
+	float level = min(floor(log2(max(max(projectedWidth, projectedHeight), 1.f))), mipCount);
+	float depth = hiZTexture.SampleLevel(linearMipPointClampMinimum, (minUv + maxUv) * 0.5, level);
+	float depthBox = view.nearPlane / nearest;
+
+	return depthBox < depth;  // Inverse Z.
+}
+
+#endif  // __CULLING_HLSLI__
\ No newline at end of file
@@ -8,8 +8,14 @@
 #include "Light.hlsli"
 #include "Clusters/Clusters.hlsli"
 #include "IBL/ImageBasedLighting.hlsli"
+#include "IBL/SphericalHarmonics.hlsli"
 #include "Atmosphere/Atmosphere.hlsli"
 #include "Atmosphere/Visibility.hlsli"
+#include "MeshShading.hlsli"
+#include "VisibilityBuffer.hlsli"
+#include "Shadows.hlsli"
+#include "VirtualShadows/Core.hlsli"
+#include "Impostors.hlsli"
 
 struct ClusterData
 {
@@ -18,12 +24,12 @@ struct ClusterData
 	float logY;
 	int froxelSize;
 	uint3 dimensions;
-	float padding;
+	uint directionalLightListBuffer;  // Count followed by light indices.
 };
 
 struct IblData
 {
-	uint irradianceTexture;
+	uint irradianceBuffer;  // Spherical harmonics of the sky.
 	uint prefilterTexture;
 	uint brdfTexture;
 	uint prefilterLevels;
@@ -31,7 +37,7 @@ struct IblData
 
 struct BindData
 {
-	uint batchId;
+	uint instanceBuffer;
 	uint objectBuffer;
 	uint cameraBuffer;
 	uint cameraIndex;
@@ -41,11 +47,27 @@ struct BindData
 	uint lightBuffer;
 	uint atmosphereIrradianceBuffer;
 	float globalWeatherCoverage;
-	uint weatherTexture;
-	float padding;
+	uint cloudShadowTexture;
+	uint sceneAccelerationStructure;  // Ray traced sun shadows only, zero otherwise.
 	ClusterData clusterData;
 	IblData iblData;
 	uint2 outputResolution;
+	float2 weatherScroll;
+#ifdef IMPOSTOR
+	ImpostorDrawData impostorData;
+#else
+	MeshletDrawData meshletData;  // Mesh shader path only.
+#endif
+	uint visibilityTexture;  // Visibility buffer path only.
+	uint indexBuffer;  // Visibility buffer path only.
+	uint outputTexture;  // Visibility buffer path only.
+	uint transformBuffer;
+	ShadowData shadowData;
+	VirtualShadowData virtualShadowData;
+	uint ambientOcclusionTexture;  // Half resolution, zero when disabled.
+	uint reflectionTexture;  // Half resolution, premultiplied by the confidence in alpha, zero when disabled.
+	uint probeIrradianceBuffer;  // Spherical harmonics of the reflection probes, indexed by the probe lights.
+	uint probePrefilterTexture;  // Cube arrays, indexed the same.
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
@@ -54,6 +76,7 @@ struct VertexIn
 {
 	uint vertexId : SV_VertexID;
 	uint instanceId : SV_InstanceID;
+	uint batchId : BATCH;  // Instance data of the draw, see MeshSystem::BindArguments().
 };
 
 struct PixelIn
@@ -66,14 +89,14 @@ struct PixelIn
 	float3 bitangent : BITANGENT;  // World space.
 	float depthVS : DEPTH;  // View space.
 	float4 color : COLOR;
-	uint instanceId : SV_InstanceID;
+	nointerpolation uint objectId : OBJECT;
 };
 
-[RootSignature(RS)]
-PixelIn VSMain(VertexIn input)
+PixelIn AssembleVertex(uint objectId, uint vertexId)
 {
 	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
-	ObjectData object = objectBuffer[bindData.batchId + input.instanceId];
+	ObjectData object = objectBuffer[objectId];
+	TransformData transform = LoadTransform(bindData.transformBuffer, object);
 	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
 	Camera camera = cameraBuffer[bindData.cameraIndex];
 	
@@ -82,49 +105,278 @@ PixelIn VSMain(VertexIn input)
 	assemblyData.extraBuffer = bindData.vertexExtraBuffer;
 	assemblyData.metadata = object.vertexMetadata;
 	
-	float4 position = LoadVertexPosition(assemblyData, input.vertexId);
-	float4 normal = float4(LoadVertexNormal(assemblyData, input.vertexId), 0.f);
-	float2 uv = LoadVertexTexcoord(assemblyData, input.vertexId);
-	float4 tangent = LoadVertexTangent(assemblyData, input.vertexId);
-	float4 bitangent = LoadVertexBitangent(assemblyData, input.vertexId);
-	float4 color = LoadVertexColor(assemblyData, input.vertexId);
+	float4 position = LoadVertexPosition(assemblyData, vertexId);
+	float4 normal = float4(LoadVertexNormal(assemblyData, vertexId), 0.f);
+	float2 uv = LoadVertexTexcoord(assemblyData, vertexId);
+	float4 tangent = LoadVertexTangent(assemblyData, vertexId);
+	float4 bitangent = LoadVertexBitangent(assemblyData, vertexId);
+	float4 color = LoadVertexColor(assemblyData, vertexId);
 	
 	PixelIn output;
 	output.positionCS = position;
-	output.positionCS = mul(output.positionCS, object.worldMatrix);
+	output.positionCS = mul(output.positionCS, transform.worldMatrix);
 	output.positionCS = mul(output.positionCS, camera.view);
 	output.depthVS = output.positionCS.z;
 	output.positionCS = mul(output.positionCS, camera.projection);
-	output.position = mul(position, object.worldMatrix).xyz;
-	output.normal = normalize(mul(normal, object.worldMatrix)).xyz;
+	output.position = mul(position, transform.worldMatrix).xyz;
+	output.normal = normalize(mul(normal, transform.worldMatrix)).xyz;
 	output.uv = uv;
-	output.tangent = normalize(mul(tangent, object.worldMatrix)).xyz;
-	output.bitangent = normalize(mul(bitangent, object.worldMatrix)).xyz;
+	output.tangent = normalize(mul(tangent, transform.worldMatrix)).xyz;
+	output.bitangent = normalize(mul(bitangent, transform.worldMatrix)).xyz;
 	output.color = color;
-	output.instanceId = input.instanceId;
+	output.objectId = objectId;
 	
 	return output;
 }
 
 [RootSignature(RS)]
-float4 PSMain(PixelIn input) : SV_Target
+PixelIn VSMain(VertexIn input)
+{
+	return AssembleVertex(LoadObjectId(bindData.instanceBuffer, input.batchId, input.instanceId), input.vertexId);
+}
+
+#ifndef IMPOSTOR
+[RootSignature(RS)]
+[numthreads(meshletGroupSize, 1, 1)]
+void ASMain(uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex)
+{
+	AmplifyMeshlets(bindData.meshletData, bindData.objectBuffer, groupId, groupIndex);
+}
+
+[RootSignature(RS)]
+[outputtopology("triangle")]
+[numthreads(128, 1, 1)]
+void MSMain(uint groupId : SV_GroupID, uint groupIndex : SV_GroupIndex, in payload MeshletPayload input, out vertices PixelIn outputVertices[meshletMaxVertices], out indices uint3 outputTriangles[meshletMaxTriangles])
+{
+	Meshlet meshlet = LoadMeshlet(bindData.meshletData, input.meshlets[groupId]);
+	const uint triangleCount = meshlet.indexCount / 3;
+
+	SetMeshOutputCounts(meshlet.vertexCount, triangleCount);
+
+	if (groupIndex < meshlet.vertexCount)
+	{
+		outputVertices[groupIndex] = AssembleVertex(input.objectId, LoadMeshletVertex(bindData.meshletData, meshlet, groupIndex));
+	}
+
+	if (groupIndex < triangleCount)
+	{
+		outputTriangles[groupIndex] = LoadMeshletTriangle(bindData.meshletData, meshlet, groupIndex);
+	}
+}
+#endif
+
+// Adds a reflection probe's irradiance and prefiltered reflection, weighted by its influence at the position.
+void AccumulateProbe(Light light, float3 position, float3 normal, float3 viewDirection, float roughness, inout LocalEnvironment environment)
+{
+	const float radius = light.areaExtents.x;
+	const float3 offset = position - light.position;
+	const float weight = 1.f - smoothstep(0.7f, 1.f, length(offset) / radius);
+	if (weight <= 0.f)
+		return;
+
+	StructuredBuffer<float4> irradianceBuffer = ResourceDescriptorHeap[bindData.probeIrradianceBuffer];
+	TextureCubeArray<float4> prefilterMap = ResourceDescriptorHeap[bindData.probePrefilterTexture];
+
+	// Parallax correction, the captured scene is treated as lying on the influence sphere, so reflections line up
+	// away from the probe's center.
+	const float3 reflection = reflect(-viewDirection, normal);
+	const float b = dot(offset, reflection);
+	const float c = dot(offset, offset) - radius * radius;
+	const float3 corrected = offset + reflection * (-b + sqrt(max(b * b - c, 0.f)));
+
+	const float mip = roughness * (bindData.iblData.prefilterLevels - 1.f);
+	environment.irradiance += float4(EvaluateIrradianceSH(irradianceBuffer, light.probeIndex, normal), 1.f) * weight;
+	environment.prefilter += float4(prefilterMap.SampleLevel(bilinearClamp, float4(corrected, light.probeIndex), mip).rgb, 1.f) * weight;
+}
+
+// Interpolated surface attributes, from rasterization or reconstructed from the visibility buffer.
+struct Surface
+{
+	float2 positionSS;  // Screen space.
+	float3 position;  // World space.
+	float3 normal;  // World space.
+	float2 uv;
+	float2 uvDdx;  // Screen space derivatives, for texture filtering.
+	float2 uvDdy;
+	float3 tangent;  // World space.
+	float3 bitangent;  // World space.
+	float depthVS;  // View space.
+	float4 color;
+	uint objectId;
+};
+
+// The prepass alpha tests and the forward pass only shades what it left with an equal depth test, so the surface is only
+// alpha tested here when there's no prepass.
+#ifdef PROBE_CAPTURE
+#define ALPHA_TEST
+#endif
+
+// Lighting of a surface whose material is already evaluated, impostors bring their own.
+float3 ShadeMaterial(Surface input, Material materialSample)
 {
-	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
-	ObjectData object = objectBuffer[bindData.batchId + input.instanceId];
 	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
 	Camera camera = cameraBuffer[bindData.cameraIndex];
-	Camera sunCamera = cameraBuffer[2];  // #TODO: Remove this terrible hardcoding.
-	StructuredBuffer<MaterialData> materialBuffer = ResourceDescriptorHeap[bindData.materialBuffer];
-	MaterialData material = materialBuffer[object.materialIndex];
+
+	float3 output = float3(0.0, 0.0, 0.0);
+	float3 viewDirection = normalize(camera.position.xyz - input.position);
+	float3 normalDirection = materialSample.normal;
+
+	const float2 screenUv = input.positionSS / bindData.outputResolution;
+	LocalEnvironment localEnvironment;
+	localEnvironment.irradiance = 0.xxxx;
+	localEnvironment.prefilter = 0.xxxx;
+	localEnvironment.screenReflection = 0.xxxx;
+
+	if (bindData.ambientOcclusionTexture > 0)
+	{
+		Texture2D<float> ambientOcclusionTexture = ResourceDescriptorHeap[bindData.ambientOcclusionTexture];
+		materialSample.occlusion *= ambientOcclusionTexture.SampleLevel(bilinearClamp, screenUv, 0);
+	}
+
+	if (bindData.reflectionTexture > 0)
+	{
+		// The reflections are traced as mirrors, rough surfaces keep the wider lobe of the prefiltered environment.
+		Texture2D<float4> reflectionTexture = ResourceDescriptorHeap[bindData.reflectionTexture];
+		localEnvironment.screenReflection = reflectionTexture.SampleLevel(bilinearClamp, screenUv, 0) * (1.f - smoothstep(0.2f, 0.5f, materialSample.roughness));
+	}
+	
+	StructuredBuffer<Light> lights = ResourceDescriptorHeap[bindData.lightBuffer];
+	StructuredBuffer<uint> clusteredLightList = ResourceDescriptorHeap[bindData.clusterData.lightListBuffer];
+	StructuredBuffer<uint2> clusteredLightInfo = ResourceDescriptorHeap[bindData.clusterData.lightInfoBuffer];
+	StructuredBuffer<uint> directionalLightList = ResourceDescriptorHeap[bindData.clusterData.directionalLightListBuffer];
+	StructuredBuffer<float3> atmosphereIrradiance = ResourceDescriptorHeap[bindData.atmosphereIrradianceBuffer];
+	Texture2D<float> cloudShadowTexture = ResourceDescriptorHeap[bindData.cloudShadowTexture];
+	
+#ifdef PROBE_CAPTURE
+	// Probe captures don't have a cluster grid, so only the sun and the sky light them. Cascades are still selected by the
+	// depth in the main view, which they were fit to.
+	const float viewDepth = -mul(float4(input.position, 1.f), cameraBuffer[0].view).z;
+#else
+	const float viewDepth = -input.depthVS;
+
+	uint3 clusterId = DrawToClusterId(bindData.clusterData.froxelSize, bindData.clusterData.logY, camera, input.positionSS, input.depthVS);
+	uint2 lightInfo = clusteredLightInfo[ClusterId2Index(bindData.clusterData.dimensions, clusterId)];
+
+	// Waves straddling froxels walk their lists in lockstep. Lists are sorted, so the smallest pending light across the wave
+	// is uniform, loaded once for the wave, and shaded by every lane whose list contains it.
+	uint i = 0;
+	while (WaveActiveAnyTrue(i < lightInfo.y))
+	{
+		const uint laneLightIndex = i < lightInfo.y ? clusteredLightList[lightInfo.x + i] : 0xFFFFFFFF;
+		const uint lightIndex = WaveActiveMin(laneLightIndex);
+		Light light = lights[lightIndex];
+
+		// Lanes waiting on a later light skip this one, without leaving the loop so the wave stays converged.
+		if (laneLightIndex == lightIndex)
+		{
+			++i;
+
+			// Reflection probes are binned like lights, and blended by their influence over the surface.
+			if (light.type == LightType::Probe)
+			{
+				AccumulateProbe(light, input.position, normalDirection, viewDirection, materialSample.roughness, localEnvironment);
+			}
+
+			else
+			{
+				if (light.probeIndex > 0)
+				{
+					light.color *= CalculateLocalShadow(bindData.shadowData, cameraBuffer, light.probeIndex, light.type == LightType::Point, light.position, input.position, input.normal);
+				}
+
+				LightSample sample = SampleLight(light, materialSample, camera, viewDirection, input.position, normalDirection);
+				output += sample.diffuse.rgb;
+			}
+		}
+	}
+
+	// Overlapping probes share their influence, elsewhere the sky fills in the remainder.
+	const float probeWeight = localEnvironment.irradiance.a;
+	if (probeWeight > 1.f)
+	{
+		localEnvironment.irradiance /= probeWeight;
+		localEnvironment.prefilter /= probeWeight;
+	}
+#endif
+	
+	// Directional lights affect every froxel, so they're evaluated once here instead of being binned.
+	const uint directionalLightCount = directionalLightList[0];
+	for (uint j = 0; j < directionalLightCount; ++j)
+	{
+		Light light = lights[directionalLightList[1 + j]];
+		
+		// Directional lights are just the combined irradiance of the sun and sky.
+		const float3 separatedSunIrradianceNearCamera = atmosphereIrradiance[0];
+		const float3 separatedSkyIrradianceNearCamera = atmosphereIrradiance[1];
+		
+		float3 cameraPositionAtmoSpace = ComputeAtmosphereCameraPosition(camera);
+		float3 cameraPoint = cameraPositionAtmoSpace - planetCenter;
+		// Convert to kilometers. The atmosphere should probably provide a helper function to convert, but oh well.
+		float3 hitPositionAtmoSpace = input.position / 1000.f;
+		
+		float3 sunIrradiance;
+		float3 skyIrradiance;
+		RecomposeSeparableSunAndSkyIrradiance(cameraPoint, normalDirection, -light.direction, separatedSunIrradianceNearCamera,
+			separatedSkyIrradianceNearCamera, sunIrradiance, skyIrradiance);
+		
+		float sunVisibility = CalculateSunVisibility(hitPositionAtmoSpace, -light.direction, cloudShadowTexture, bindData.weatherScroll);
+		sunVisibility *= CalculateCascadedShadow(bindData.shadowData, cameraBuffer, input.position, input.normal, viewDepth);
+		sunVisibility *= CalculateVirtualShadow(bindData.virtualShadowData, cameraBuffer, input.position, input.normal, bindData.shadowData.normalOffset);
+		sunVisibility *= CalculateRayTracedShadow(bindData.sceneAccelerationStructure, input.position, input.normal, -light.direction);
+		const float skyVisibility = CalculateSkyVisibility(cameraPositionAtmoSpace, bindData.globalWeatherCoverage);
+		
+		// Combine both atmospheric irradiance contributions, attenuated by any visibility modifications, such as
+		// clouds blocking out the sun.
+		// Multiply against the existing color to preserve custom light modifications.
+		//light.color *= (sunIrradiance * sunVisibility) + (skyIrradiance * skyVisibility);
+		
+		// Note that the sky irradiance contribution was removed, since this *should* already be getting contributed
+		// by IBL? Comparing IBL lighting with pure skyIrradiance lighting shows that they are nothing alike however,
+		// so this is definitely not the most physically accurate model.
+		light.color *= (sunIrradiance * sunVisibility);
+		
+		LightSample sample = SampleLight(light, materialSample, camera, viewDirection, input.position, normalDirection);
+		output += sample.diffuse.rgb;
+	}
+	
+	StructuredBuffer<float4> irradianceBuffer = ResourceDescriptorHeap[bindData.iblData.irradianceBuffer];
+	TextureCube<float4> prefilterMap = ResourceDescriptorHeap[bindData.iblData.prefilterTexture];
+	Texture2D<float4> brdfMap = ResourceDescriptorHeap[bindData.iblData.brdfTexture];
+	
+	float width, height, prefilterMipCount;
+	prefilterMap.GetDimensions(0, width, height, prefilterMipCount);
+
+	const float3 irradiance = EvaluateIrradianceSH(irradianceBuffer, 0, normalDirection);
+
+	float3 ibl = ComputeIBL(normalDirection, viewDirection, materialSample, bindData.iblData.prefilterLevels, irradiance, prefilterMap, brdfMap, anisotropicWrap, localEnvironment);
+	output += ibl;
+
+	output += materialSample.emissive;
+	
+	return output;
+}
+
+// Returns false if the surface is alpha tested out.
+bool ShadeSurface(Surface input, out float4 output)
+{
+	output = float4(0.0, 0.0, 0.0, 1.0);
+
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	ObjectData object = objectBuffer[input.objectId];
+	MaterialData material = LoadMaterial(bindData.materialBuffer, object.materialIndex);
+	SamplerState materialSampler = SamplerDescriptorHeap[material.samplerIndex];
 	
 	float4 baseColor = input.color;
 	
-	if (material.baseColor > 0)
+	if (HasMaterialTexture(materialFeatureBaseColor, material.baseColor))
 	{
 		Texture2D<float4> baseColorMap = ResourceDescriptorHeap[material.baseColor];
-		baseColor = baseColorMap.Sample(anisotropicWrap, input.uv);
+		baseColor = baseColorMap.SampleGrad(materialSampler, input.uv, input.uvDdx, input.uvDdy);
 		
-		clip(baseColor.a < alphaTestThreshold ? -1 : 1);
+#ifdef ALPHA_TEST
+		if (baseColor.a < alphaTestThreshold)
+			return false;
+#endif
 	}
 	
 	float2 metallicRoughness = { 1.0, 1.0 };
@@ -132,46 +384,40 @@ float4 PSMain(PixelIn input) : SV_Target
 	float ambientOcclusion = 1.0;
 	float3 emissive = { 1.0, 1.0, 1.0 };
 	
-	if (material.metallicRoughness > 0)
+	if (HasMaterialTexture(materialFeatureMetallicRoughness, material.metallicRoughness))
 	{
 		Texture2D<float4> metallicRoughnessMap = ResourceDescriptorHeap[material.metallicRoughness];
-		metallicRoughness = metallicRoughnessMap.Sample(anisotropicWrap, input.uv).bg;  // GLTF 2.0 spec.
+		metallicRoughness = metallicRoughnessMap.SampleGrad(materialSampler, input.uv, input.uvDdx, input.uvDdy).bg;  // GLTF 2.0 spec.
 	}
 
-	if (material.normal > 0)
+	if (HasMaterialTexture(materialFeatureNormal, material.normal))
 	{
 		// Construct the TBN matrix.
 		float3x3 TBN = float3x3(input.tangent, input.bitangent, input.normal);
 
 		Texture2D<float4> normalMap = ResourceDescriptorHeap[material.normal];
-		normal = normalMap.Sample(anisotropicWrap, input.uv).rgb;
-		normal = normal * 2.0 - 1.0;  // Remap from [0, 1] to [-1, 1].
+		normal.xy = normalMap.SampleGrad(materialSampler, input.uv, input.uvDdx, input.uvDdy).rg;
+		normal.xy = normal.xy * 2.0 - 1.0;  // Remap from [0, 1] to [-1, 1].
+		normal.z = sqrt(saturate(1.0 - dot(normal.xy, normal.xy)));  // Reconstructed, BC5 normal maps only store two channels.
 		normal = normalize(mul(normal, TBN));  // Convert the normal vector from tangent space to world space.
 	}
 
-	if (material.occlusion > 0)
+	if (HasMaterialTexture(materialFeatureOcclusion, material.occlusion))
 	{
 		Texture2D<float4> occlusionMap = ResourceDescriptorHeap[material.occlusion];
-		ambientOcclusion = occlusionMap.Sample(anisotropicWrap, input.uv).r;
+		ambientOcclusion = occlusionMap.SampleGrad(materialSampler, input.uv, input.uvDdx, input.uvDdy).r;
 	}
 
-	if (material.emissive > 0)
+	if (HasMaterialTexture(materialFeatureEmissive, material.emissive))
 	{
 		Texture2D<float4> emissiveMap = ResourceDescriptorHeap[material.emissive];
-		emissive = emissiveMap.Sample(anisotropicWrap, input.uv).rgb;
+		emissive = emissiveMap.SampleGrad(materialSampler, input.uv, input.uvDdx, input.uvDdy).rgb;
 	}
 	
 	baseColor *= material.baseColorFactor;
 	metallicRoughness *= float2(material.metallicFactor, material.roughnessFactor);
 	emissive *= material.emissiveFactor;
 	
-	float4 output;
-	output.rgb = float3(0.0, 0.0, 0.0);
-	output.a = baseColor.a;
-
-	float3 viewDirection = normalize(camera.position.xyz - input.position);
-	float3 normalDirection = normal;
-	
 	Material materialSample;
 	materialSample.baseColor = baseColor;
 	materialSample.metalness = metallicRoughness.r;
@@ -179,65 +425,186 @@ float4 PSMain(PixelIn input) : SV_Target
 	materialSample.normal = normal;
 	materialSample.occlusion = ambientOcclusion;
 	materialSample.emissive = emissive;
-	
-	StructuredBuffer<Light> lights = ResourceDescriptorHeap[bindData.lightBuffer];
-	StructuredBuffer<uint> clusteredLightList = ResourceDescriptorHeap[bindData.clusterData.lightListBuffer];
-	StructuredBuffer<uint2> clusteredLightInfo = ResourceDescriptorHeap[bindData.clusterData.lightInfoBuffer];
-	StructuredBuffer<float3> atmosphereIrradiance = ResourceDescriptorHeap[bindData.atmosphereIrradianceBuffer];
-	Texture2D<float3> weatherTexture = ResourceDescriptorHeap[bindData.weatherTexture];
-	
-	uint3 clusterId = DrawToClusterId(bindData.clusterData.froxelSize, bindData.clusterData.logY, camera, input.positionCS.xy, input.depthVS);
-	uint2 lightInfo = clusteredLightInfo[ClusterId2Index(bindData.clusterData.dimensions, clusterId)];
-	for (uint i = 0; i < lightInfo.y; ++i)
+
+	output.rgb = ShadeMaterial(input, materialSample);
+	output.a = baseColor.a;
+
+	return true;
+}
+
+Surface CreateSurface(PixelIn input)
+{
+	Surface surface;
+	surface.positionSS = input.positionCS.xy;
+	surface.position = input.position;
+	surface.normal = input.normal;
+	surface.uv = input.uv;
+	surface.uvDdx = ddx(input.uv);
+	surface.uvDdy = ddy(input.uv);
+	surface.tangent = input.tangent;
+	surface.bitangent = input.bitangent;
+	surface.depthVS = input.depthVS;
+	surface.color = input.color;
+	surface.objectId = input.objectId;
+
+	return surface;
+}
+
+[RootSignature(RS)]
+float4 PSMain(PixelIn input) : SV_Target
+{
+	const Surface surface = CreateSurface(input);
+
+	float4 output;
+#ifdef ALPHA_TEST
+	if (!ShadeSurface(surface, output))
+		discard;
+#else
+	ShadeSurface(surface, output);  // A discard would disable early depth testing.
+#endif
+
+	return output;
+}
+
+struct TransparentPixelOutput
+{
+	float4 accumulation : SV_Target0;  // Premultiplied color and coverage, weighted and summed.
+	float revealage : SV_Target1;  // Product of the transmittances, blended by the pipeline.
+};
+
+// Weighted blended order independent transparency, from McGuire and Bavoil. Nearer surfaces are weighted higher, which
+// approximates the sorted result without sorting, the composite pass normalizes the weighted sum.
+[RootSignature(RS)]
+TransparentPixelOutput TransparentPSMain(PixelIn input)
+{
+	float4 output;
+	ShadeSurface(CreateSurface(input), output);
+
+	const float alpha = saturate(output.a);
+	const float depth = abs(input.depthVS);
+	const float weight = alpha * clamp(10.0 / (1e-5 + pow(depth / 5.0, 2.0) + pow(depth / 200.0, 6.0)), 1e-2, 3e3);
+
+	TransparentPixelOutput result;
+	result.accumulation = float4(output.rgb * alpha, alpha) * weight;
+	result.revealage = alpha;
+
+	return result;
+}
+
+// Visibility buffer path, reconstructs each pixel's surface from the triangle the prepass stored, so vertex work is only
+// paid once per pixel and shading has no quad overdraw.
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void CSMain(uint3 dispatchId : SV_DispatchThreadID)
+{
+	if (any(dispatchId.xy >= bindData.outputResolution))
+		return;
+
+	Texture2D<uint2> visibilityTexture = ResourceDescriptorHeap[bindData.visibilityTexture];
+	RWTexture2D<float4> outputTexture = ResourceDescriptorHeap[bindData.outputTexture];
+
+	float4 output = float4(0.0, 0.0, 0.0, 1.0);  // Matches the forward pass clear.
+
+	uint objectId;
+	uint primitiveId;
+	if (DecodeVisibility(visibilityTexture[dispatchId.xy], objectId, primitiveId))
 	{
-		uint lightIndex = clusteredLightList[lightInfo.x + i];
-		Light light = lights[lightIndex];
-		
-		// Directional lights are just the combined irradiance of the sun and sky.
-		if (light.type == LightType::Directional)
+		StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+		const uint3 indices = LoadTriangleIndices(bindData.indexBuffer, objectBuffer[objectId], primitiveId);
+
+		PixelIn vertices[3];
+		for (uint i = 0; i < 3; ++i)
 		{
-			const float3 separatedSunIrradianceNearCamera = atmosphereIrradiance[0];
-			const float3 separatedSkyIrradianceNearCamera = atmosphereIrradiance[1];
-			
-			float3 cameraPositionAtmoSpace = ComputeAtmosphereCameraPosition(camera);
-			float3 cameraPoint = cameraPositionAtmoSpace - planetCenter;
-			// Convert to kilometers. The atmosphere should probably provide a helper function to convert, but oh well.
-			float3 hitPositionAtmoSpace = input.position / 1000.f;
-			
-			float3 sunIrradiance;
-			float3 skyIrradiance;
-			RecomposeSeparableSunAndSkyIrradiance(cameraPoint, normal, -light.direction, separatedSunIrradianceNearCamera,
-				separatedSkyIrradianceNearCamera, sunIrradiance, skyIrradiance);
-			
-			const float sunVisibility = CalculateSunVisibility(hitPositionAtmoSpace, light.direction, weatherTexture);
-			const float skyVisibility = CalculateSkyVisibility(cameraPositionAtmoSpace, bindData.globalWeatherCoverage);
-			
-			// Combine both atmospheric irradiance contributions, attenuated by any visibility modifications, such as
-			// clouds blocking out the sun.
-			// Multiply against the existing color to preserve custom light modifications.
-			//light.color *= (sunIrradiance * sunVisibility) + (skyIrradiance * skyVisibility);
-			
-			// Note that the sky irradiance contribution was removed, since this *should* already be getting contributed
-			// by IBL? Comparing IBL lighting with pure skyIrradiance lighting shows that they are nothing alike however,
-			// so this is definitely not the most physically accurate model.
-			light.color *= (sunIrradiance * sunVisibility);
+			vertices[i] = AssembleVertex(objectId, indices[i]);
+		}
+
+		const float2 positionSS = dispatchId.xy + 0.5;
+		float2 positionNDC = positionSS / bindData.outputResolution * 2.0 - 1.0;
+		positionNDC.y = -positionNDC.y;
+
+		const BarycentricDerivatives barycentrics = ComputeBarycentrics(vertices[0].positionCS, vertices[1].positionCS, vertices[2].positionCS, positionNDC, bindData.outputResolution);
+		const float3 lambda = barycentrics.lambda;
+
+		Surface surface;
+		surface.positionSS = positionSS;
+		surface.position = InterpolateAttribute(lambda, vertices[0].position, vertices[1].position, vertices[2].position);
+		surface.normal = normalize(InterpolateAttribute(lambda, vertices[0].normal, vertices[1].normal, vertices[2].normal));
+		surface.uv = InterpolateAttribute(lambda, vertices[0].uv, vertices[1].uv, vertices[2].uv);
+		surface.uvDdx = InterpolateAttribute(barycentrics.ddx, vertices[0].uv, vertices[1].uv, vertices[2].uv);
+		surface.uvDdy = InterpolateAttribute(barycentrics.ddy, vertices[0].uv, vertices[1].uv, vertices[2].uv);
+		surface.tangent = normalize(InterpolateAttribute(lambda, vertices[0].tangent, vertices[1].tangent, vertices[2].tangent));
+		surface.bitangent = normalize(InterpolateAttribute(lambda, vertices[0].bitangent, vertices[1].bitangent, vertices[2].bitangent));
+		surface.depthVS = InterpolateAttribute(lambda, vertices[0].depthVS, vertices[1].depthVS, vertices[2].depthVS);
+		surface.color = InterpolateAttribute(lambda, vertices[0].color, vertices[1].color, vertices[2].color);
+		surface.objectId = objectId;
+
+		if (!ShadeSurface(surface, output))
+		{
+			output = float4(0.0, 0.0, 0.0, 1.0);
 		}
-		
-		LightSample sample = SampleLight(light, materialSample, camera, viewDirection, input.position, normalDirection);
-		output.rgb += sample.diffuse.rgb;
 	}
-	
-	TextureCube<float4> irradianceMap = ResourceDescriptorHeap[bindData.iblData.irradianceTexture];
-	TextureCube<float4> prefilterMap = ResourceDescriptorHeap[bindData.iblData.prefilterTexture];
-	Texture2D<float4> brdfMap = ResourceDescriptorHeap[bindData.iblData.brdfTexture];
-	
-	float width, height, prefilterMipCount;
-	prefilterMap.GetDimensions(0, width, height, prefilterMipCount);
 
-	float3 ibl = ComputeIBL(normalDirection, viewDirection, materialSample, bindData.iblData.prefilterLevels, irradianceMap, prefilterMap, brdfMap, anisotropicWrap);
-	output.rgb += ibl;
+	outputTexture[dispatchId.xy] = output;
+}
+
+#ifdef IMPOSTOR
+[RootSignature(RS)]
+ImpostorVertex ImpostorVSMain(uint vertexId : SV_VertexID, uint instanceId : SV_InstanceID)
+{
+	const uint objectId = LoadObjectId(bindData.instanceBuffer, 0, instanceId);
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	ObjectData object = objectBuffer[objectId];
+	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
+	Camera camera = cameraBuffer[bindData.cameraIndex];
+
+	return CreateImpostorVertex(bindData.impostorData, object, LoadTransform(bindData.transformBuffer, object), camera, objectId, vertexId);
+}
+
+struct ImpostorPixelOutput
+{
+	float4 color : SV_Target;
+	float depth : SV_Depth;  // Resolved exactly as in the prepass, passing its equal depth test.
+};
+
+[RootSignature(RS)]
+ImpostorPixelOutput ImpostorPSMain(ImpostorVertex input)
+{
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	ObjectData object = objectBuffer[input.objectId];
+	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
+	Camera camera = cameraBuffer[bindData.cameraIndex];
+
+	const ImpostorSurface impostor = ResolveImpostor(bindData.impostorData, object, LoadTransform(bindData.transformBuffer, object), camera, input.position);
+	if (impostor.coverage < alphaTestThreshold)
+		discard;
+
+	Surface surface;
+	surface.positionSS = input.positionCS.xy;
+	surface.position = impostor.position;
+	surface.normal = impostor.normal;
+	surface.uv = 0.xx;
+	surface.uvDdx = 0.xx;
+	surface.uvDdy = 0.xx;
+	surface.tangent = 0.xxx;
+	surface.bitangent = 0.xxx;
+	surface.depthVS = mul(float4(impostor.position, 1.f), camera.view).z;
+	surface.color = 1.xxxx;
+	surface.objectId = input.objectId;
+
+	// Occlusion and emission aren't baked.
+	Material material;
+	material.baseColor = float4(impostor.albedo, 1.f);
+	material.metalness = impostor.metalness;
+	material.normal = impostor.normal;
+	material.roughness = impostor.roughness * impostor.roughness;
+	material.emissive = 0.xxx;
+	material.occlusion = 1.f;
+	material.padding = 0.xxx;
+
+	ImpostorPixelOutput output;
+	output.color = float4(ShadeMaterial(surface, material), 1.f);
+	output.depth = GetImpostorDepth(impostor, camera);
 
-	output.rgb += materialSample.emissive;
-	
 	return output;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
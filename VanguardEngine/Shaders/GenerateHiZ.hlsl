@@ -4,108 +4,156 @@
 
 struct BindData
 {
-	uint mipBase;
+	uint inputTextureIndex;  // Depth stencil.
+	uint counterBuffer;  // Groups finished, reset by the last group.
 	uint mipCount;
-	float2 texelSize;
+	uint groupCount;
 	// Boundary
-	uint4 outputTextureIndices;
+	float2 texelSize;
+	float2 padding;
 	// Boundary
-	uint inputTextureIndex;
+	uint4 outputTextureIndices[4];
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
 
-groupshared float groupColor[64];
+// Single pass downsampler, similar to AMD's FidelityFX SPD. Each group reduces a 64x64 tile of the first mip down to a
+// single texel, seven mips in total. The last group to finish then reduces those texels through the remaining mips, so
+// the whole pyramid is built in one dispatch without barriers between levels.
+
+static const uint tileSize = 64;  // First mip texels along each axis of a group's tile.
+static const uint tileMips = 7;
 
-void StoreGroupColor(uint index, float color)
+groupshared float groupDepth[16][16];
+groupshared uint groupIsLast;
+
+uint GetOutputIndex(uint mip)
 {
-	groupColor[index] = color;
+	return bindData.outputTextureIndices[mip / 4][mip % 4];
 }
 
-float LoadGroupColor(uint index)
+void StoreMip(uint mip, uint2 texel, float value)
 {
-	return groupColor[index];
+	if (mip < bindData.mipCount)
+	{
+		// Coherent, the last group reads the final tile mip written by every other group.
+		globallycoherent RWTexture2D<float> output = ResourceDescriptorHeap[GetOutputIndex(mip)];
+		output[texel] = value;
+	}
 }
 
-struct Input
+float LoadFirstMip(uint2 texel, uint firstMip)
 {
-	uint groupIndex : SV_GroupIndex;
-	uint3 dispatchId : SV_DispatchThreadID;
-};
+	if (firstMip == 0)
+	{
+		// Single sample, hi-z texture dimensions are a power of 2.
+		Texture2D<float4> inputTexture = ResourceDescriptorHeap[bindData.inputTextureIndex];
+		return inputTexture.SampleLevel(linearMipPointClampMinimum, bindData.texelSize * (texel + float2(0.5, 0.5)), 0).r;
+	}
 
-// Similar to generate mip maps, but applies minification instead of mean sampling.
+	globallycoherent RWTexture2D<float> source = ResourceDescriptorHeap[GetOutputIndex(firstMip - 1)];
 
-[RootSignature(RS)]
-[numthreads(8, 8, 1)]
-void Main(Input input)
-{ 
-	Texture2D<float4> inputTexture = ResourceDescriptorHeap[bindData.inputTextureIndex];
-	
-	float2 uv = bindData.texelSize * (input.dispatchId.xy + float2(0.5, 0.5));
-
-	// Single sample, hi-z texture dimensions are a power of 2.
-	float4 sourceSample = inputTexture.SampleLevel(linearMipPointClampMinimum, uv, bindData.mipBase);
-	
-	RWTexture2D<float> outputMip0 = ResourceDescriptorHeap[bindData.outputTextureIndices[0]];
-	outputMip0[input.dispatchId.xy] = sourceSample;
-	
-	if (bindData.mipCount == 1)
+	uint2 size;
+	source.GetDimensions(size.x, size.y);
+
+	// Clamp instead of reading out of bounds, which returns zero and would break the minification.
+	const uint2 base = texel * 2;
+	const uint2 last = size - 1;
+	const float a = source[min(base, last)];
+	const float b = source[min(base + uint2(1, 0), last)];
+	const float c = source[min(base + uint2(0, 1), last)];
+	const float d = source[min(base + uint2(1, 1), last)];
+
+	return min(min(a, b), min(c, d));
+}
+
+// Applies minification instead of mean sampling, for conservative occlusion tests.
+void DownsampleTile(uint2 tile, uint firstMip, uint groupIndex)
+{
+	const uint2 thread = uint2(groupIndex % 16, groupIndex / 16);
+	const uint2 origin = tile * tileSize + thread * 4;
+
+	// Each thread reduces a 4x4 block of the first mip, one quad at a time.
+	float quads[4];
+	for (uint i = 0; i < 4; ++i)
 	{
-		return;
+		const uint2 quadOrigin = origin + uint2(i % 2, i / 2) * 2;
+
+		float quad = 0;
+		for (uint j = 0; j < 4; ++j)
+		{
+			const uint2 texel = quadOrigin + uint2(j % 2, j / 2);
+			const float value = LoadFirstMip(texel, firstMip);
+			StoreMip(firstMip, texel, value);
+			quad = j == 0 ? value : min(quad, value);
+		}
+
+		StoreMip(firstMip + 1, quadOrigin / 2, quad);
+		quads[i] = quad;
 	}
-	
-	StoreGroupColor(input.groupIndex, sourceSample);
-	
-	GroupMemoryBarrierWithGroupSync();
-	
-	// X and Y are even.
-	if ((input.groupIndex & 0x9) == 0)
+
+	float value = min(min(quads[0], quads[1]), min(quads[2], quads[3]));
+	StoreMip(firstMip + 2, origin / 4, value);
+	groupDepth[thread.y][thread.x] = value;
+
+	// Halve the 16x16 texels in groupshared memory each step, down to the tile's single texel.
+	for (uint level = 1; level <= 4; ++level)
 	{
-		sourceSample = min(sourceSample, LoadGroupColor(input.groupIndex + 0x01));
-		sourceSample = min(sourceSample, LoadGroupColor(input.groupIndex + 0x08));
-		sourceSample = min(sourceSample, LoadGroupColor(input.groupIndex + 0x09));
-		
-		RWTexture2D<float> outputMip1 = ResourceDescriptorHeap[bindData.outputTextureIndices[1]];
-		outputMip1[input.dispatchId.xy / 2] = sourceSample;
-		
-		StoreGroupColor(input.groupIndex, sourceSample);
+		GroupMemoryBarrierWithGroupSync();
+
+		const uint size = 16 >> level;
+		const bool active = thread.x < size && thread.y < size;
+		if (active)
+		{
+			const uint2 base = thread * 2;
+			value = min(min(groupDepth[base.y][base.x], groupDepth[base.y][base.x + 1]), min(groupDepth[base.y + 1][base.x], groupDepth[base.y + 1][base.x + 1]));
+			StoreMip(firstMip + 2 + level, tile * size + thread, value);
+		}
+
+		GroupMemoryBarrierWithGroupSync();
+
+		if (active)
+		{
+			groupDepth[thread.y][thread.x] = value;
+		}
 	}
-	
-	if (bindData.mipCount == 2)
+}
+
+[RootSignature(RS)]
+[numthreads(256, 1, 1)]
+void Main(uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex)
+{
+	DownsampleTile(groupId.xy, 0, groupIndex);
+
+	if (bindData.mipCount <= tileMips)
 	{
 		return;
 	}
-	
-	GroupMemoryBarrierWithGroupSync();
-	
-	// X and Y are multiples of 4.
-	if ((input.groupIndex & 0x1B) == 0)
-	{
-		sourceSample = min(sourceSample, LoadGroupColor(input.groupIndex + 0x02));
-		sourceSample = min(sourceSample, LoadGroupColor(input.groupIndex + 0x10));
-		sourceSample = min(sourceSample, LoadGroupColor(input.groupIndex + 0x12));
-		
-		RWTexture2D<float> outputMip2 = ResourceDescriptorHeap[bindData.outputTextureIndices[2]];
-		outputMip2[input.dispatchId.xy / 4] = sourceSample;
-		
-		StoreGroupColor(input.groupIndex, sourceSample);
-	}
-	
-	if (bindData.mipCount == 3)
+
+	// Make the tile's writes visible to the other groups before signaling.
+	DeviceMemoryBarrierWithGroupSync();
+
+	if (groupIndex == 0)
 	{
-		return;
+		globallycoherent RWStructuredBuffer<uint> counter = ResourceDescriptorHeap[bindData.counterBuffer];
+
+		uint finished;
+		InterlockedAdd(counter[0], 1, finished);
+		groupIsLast = finished == bindData.groupCount - 1;
+
+		if (groupIsLast)
+		{
+			counter[0] = 0;  // Ready for the next dispatch.
+		}
 	}
-	
+
 	GroupMemoryBarrierWithGroupSync();
-	
-	// X and Y are multiples of 8 (only one thread qualifies).
-	if (input.groupIndex == 0)
+
+	if (!groupIsLast)
 	{
-		sourceSample = min(sourceSample, LoadGroupColor(input.groupIndex + 0x04));
-		sourceSample = min(sourceSample, LoadGroupColor(input.groupIndex + 0x20));
-		sourceSample = min(sourceSample, LoadGroupColor(input.groupIndex + 0x24));
-		
-		RWTexture2D<float> outputMip3 = ResourceDescriptorHeap[bindData.outputTextureIndices[3]];
-		outputMip3[input.dispatchId.xy / 8] = sourceSample;
+		return;
 	}
+
+	// The first pass' last mip is at most 64x64 texels, which a single tile covers.
+	DownsampleTile(uint2(0, 0), tileMips, groupIndex);
 }
\ No newline at end of file
@@ -5,61 +5,118 @@
 #include "ImportanceSampling.hlsli"
 #include "BRDF.hlsli"
 #include "CubeMap.hlsli"
+#include "IBL/SphericalHarmonics.hlsli"
 
 struct BindData
 {
 	uint luminanceTexture;
-	uint irradianceTexture;
+	uint irradianceBuffer;  // Spherical harmonics, nine coefficients per cube.
 	uint brdfTexture;
 	uint cubeFace;
 	// Boundary
+	uint firstSlice;  // Of the output cube in cube arrays, zero for single cubes.
+	// Boundary
 	uint prefilterMips[PREFILTER_LEVELS];
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
 
-// Reference: https://cdn2.unrealengine.com/Resources/files/2013SiggraphPresentationsNotes-26915738.pdf
+// Projection resolution of each face, sampled from the luminance mip closest to it.
+static const uint irradianceFaceSize = 32;
+static const uint irradianceGroupSize = 256;
+
+groupshared float3 waveCoefficients[irradianceGroupSize / 4][shCoefficientCount];  // Waves have at least four lanes.
+
+float CubeAreaElement(float x, float y)
+{
+	return atan2(x * y, sqrt(x * x + y * y + 1.f));
+}
 
+// Reference: https://www.rorydriscoll.com/2012/01/15/cubemap-texel-solid-angle/
+float CubeTexelSolidAngle(float2 uv, float halfTexel)
+{
+	const float2 minimum = uv - halfTexel;
+	const float2 maximum = uv + halfTexel;
+
+	return CubeAreaElement(minimum.x, minimum.y) - CubeAreaElement(minimum.x, maximum.y) - CubeAreaElement(maximum.x, minimum.y) + CubeAreaElement(maximum.x, maximum.y);
+}
+
+// Projects the luminance cube onto second order spherical harmonics in a single group, writing nine coefficients to the
+// cube's index. The cosine lobe convolution is applied to the coefficients, so they evaluate directly to irradiance.
+// Reference: https://cseweb.ucsd.edu/~ravir/papers/envmap/envmap.pdf
 [RootSignature(RS)]
-[numthreads(8, 8, 1)]
-void IrradianceMain(uint3 dispatchId : SV_DispatchThreadID)
+[numthreads(irradianceGroupSize, 1, 1)]
+void IrradianceMain(uint groupIndex : SV_GroupIndex)
 {
-	RWTexture2DArray<float4> irradianceMap = ResourceDescriptorHeap[bindData.irradianceTexture];
+	RWStructuredBuffer<float4> irradianceBuffer = ResourceDescriptorHeap[bindData.irradianceBuffer];
 	TextureCube<float4> luminanceMap = ResourceDescriptorHeap[bindData.luminanceTexture];
-	
-	float width, height, elements;
-	irradianceMap.GetDimensions(width, height, elements);
-	
-	float2 uv = (dispatchId.xy + 0.5f) / width;
-	uv = uv * 2.f - 1.f;
-	
-	float3 forward = normalize(ComputeDirection(uv, dispatchId.z));
-	float3 up = float3(0.f, 0.f, 1.f);
-	float3 left = normalize(cross(up, forward));
-	up = normalize(cross(forward, left));
-	
-	// Intervals for numerical integration.
-	static const int steps = 20;
-	float3 irradianceSum = 0.f;
-	
-	// Traverse a hemisphere in spherical coordinates.
-	for (int i = 0; i < steps; ++i)
+
+	float width, height, mipCount;
+	luminanceMap.GetDimensions(0, width, height, mipCount);
+	const float mip = clamp(log2(width / irradianceFaceSize), 0.f, mipCount - 1.f);
+	const float halfTexel = 1.f / irradianceFaceSize;
+
+	float3 coefficients[shCoefficientCount];
+	[unroll]
+	for (uint i = 0; i < shCoefficientCount; ++i)
+	{
+		coefficients[i] = 0.f;
+	}
+
+	for (uint texel = groupIndex; texel < irradianceFaceSize * irradianceFaceSize * 6; texel += irradianceGroupSize)
 	{
-		float theta = 2.f * pi * ((float)i / float(steps - 1.f));
-		for (int j = 0; j < steps; ++j)
+		const uint face = texel / (irradianceFaceSize * irradianceFaceSize);
+		const uint2 pixel = uint2(texel % irradianceFaceSize, (texel / irradianceFaceSize) % irradianceFaceSize);
+		const float2 uv = (pixel + 0.5f) / irradianceFaceSize * 2.f - 1.f;
+
+		const float3 direction = normalize(ComputeDirection(uv, face));
+		const float3 value = luminanceMap.SampleLevel(bilinearClamp, direction, mip).rgb * CubeTexelSolidAngle(uv, halfTexel);
+
+		float basis[shCoefficientCount];
+		SHBasis(direction, basis);
+
+		[unroll]
+		for (uint i = 0; i < shCoefficientCount; ++i)
 		{
-			float phi = 0.5f * pi * ((float)j / float(steps - 1.f));
-			float3 tangentSpace = normalize(float3(sin(phi) * cos(theta), sin(phi) * sin(theta), cos(phi)));
-			float3 worldSpace = tangentSpace.x * left + tangentSpace.y * up + tangentSpace.z * forward;
-			float3 value = luminanceMap.SampleLevel(bilinearClamp, worldSpace, 0.f).rgb;
-			irradianceSum += value * cos(phi) * sin(phi);  // Scaling improves light distribution.
+			coefficients[i] += value * basis[i];
 		}
 	}
-	
-	const float samples = steps * steps;
-	irradianceMap[dispatchId] = float4(pi * irradianceSum / samples, 0.f);
+
+	const uint wave = groupIndex / WaveGetLaneCount();
+	[unroll]
+	for (uint i = 0; i < shCoefficientCount; ++i)
+	{
+		const float3 sum = WaveActiveSum(coefficients[i]);
+		if (WaveIsFirstLane())
+		{
+			waveCoefficients[wave][i] = sum;
+		}
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	if (groupIndex < shCoefficientCount)
+	{
+		float3 sum = 0.f;
+		const uint waveCount = irradianceGroupSize / WaveGetLaneCount();
+		for (uint i = 0; i < waveCount; ++i)
+		{
+			sum += waveCoefficients[i][groupIndex];
+		}
+
+		// Cosine lobe convolution per band, over pi to match the lambertian term applied by shading.
+		const float band = groupIndex == 0 ? 1.f : groupIndex < 4 ? 2.f / 3.f : 0.25f;
+		irradianceBuffer[(bindData.firstSlice / 6) * shCoefficientCount + groupIndex] = float4(sum * band, 0.f);
+	}
 }
 
+// Reference: https://cdn2.unrealengine.com/Resources/files/2013SiggraphPresentationsNotes-26915738.pdf
+
+// Samples per roughness level. Filtered importance sampling reads a mip as wide as each sample's share of the lobe, so
+// rough levels converge with few samples. The mirror level is a single sample. Covers every level up to lg(128).
+static const uint prefilterSampleCounts[8] = { 1, 24, 32, 48, 64, 64, 64, 64 };
+
+// Reference: https://developer.nvidia.com/gpugems/gpugems3/part-iii-rendering/chapter-20-gpu-based-importance-sampling
 [RootSignature(RS)]
 [numthreads(8, 8, 1)]
 void PrefilterMain(uint3 dispatchId : SV_DispatchThreadID)
@@ -69,13 +126,16 @@ void PrefilterMain(uint3 dispatchId : SV_DispatchThreadID)
 	RWTexture2DArray<float4> baseMip = ResourceDescriptorHeap[bindData.prefilterMips[0]];
 	float width, height, depth;
 	baseMip.GetDimensions(width, height, depth);
-	const float baseMipSize = width;
-	const float saTexel = (4.f * pi) / (6.f * baseMipSize * baseMipSize);
 	
 	const uint maskShift = log2(width);
 	const uint xyIndex = dispatchId.y * width + dispatchId.x;
 	
 	TextureCube<float4> luminanceMap = ResourceDescriptorHeap[bindData.luminanceTexture];
+
+	// Solid angle of a texel in the base mip of the source, not the output.
+	float sourceSize, sourceHeight, sourceMipCount;
+	luminanceMap.GetDimensions(0, sourceSize, sourceHeight, sourceMipCount);
+	const float saTexel = (4.f * pi) / (6.f * sourceSize * sourceSize);
 	
 	for (int i = 0; i < PREFILTER_LEVELS; ++i)
 	{
@@ -97,8 +157,7 @@ void PrefilterMain(uint3 dispatchId : SV_DispatchThreadID)
 			float3 reflection = normal;
 			float3 view = reflection;
 		
-			// Sample count.
-			const int steps = roughness * 256 + 1;
+			const int steps = prefilterSampleCounts[i];
 			float sumWeight = 0.f;
 			float3 sumSamples = 0.f;
 	
@@ -118,14 +177,15 @@ void PrefilterMain(uint3 dispatchId : SV_DispatchThreadID)
 					float halfwayDotView = saturate(dot(halfway, view));
 					float pdf = D * normalDotHalfway / (4.f * halfwayDotView) + 0.0001f;
 					float saSample = 1.f / ((float)steps * pdf + 0.0001f);
-					float mip = roughness == 0.f ? 0.f : 0.5f * log2(saSample / saTexel);
+					// Biased up a level, the footprints of neighboring samples overlap rather than leave gaps.
+					float mip = roughness == 0.f ? 0.f : clamp(0.5f * log2(saSample / saTexel) + 1.f, 0.f, sourceMipCount - 1.f);
 					
 					sumWeight += normalDotLight;
 					sumSamples += luminanceMap.SampleLevel(bilinearClamp, light, mip).rgb * normalDotLight;
 				}
 			}
 	
-			prefilterMap[uint3(pixel, bindData.cubeFace)] = float4(sumSamples / sumWeight, 0.f);
+			prefilterMap[uint3(pixel, bindData.firstSlice + bindData.cubeFace)] = float4(sumSamples / sumWeight, 0.f);
 		}
 	}
 }
@@ -6,13 +6,24 @@
 #include "Material.hlsli"
 #include "BRDF.hlsli"
 
-// Performs diffuse and specular IBL.
-float3 ComputeIBL(float3 normalDirection, float3 viewDirection, Material material, uint prefilterLevels, TextureCube irradianceLut, TextureCube prefilterLut, Texture2D brdfLut, SamplerState lutSampler)
+// Lighting layered over the sky's lookup tables, each premultiplied by its coverage in alpha.
+struct LocalEnvironment
+{
+	float4 irradiance;  // Reflection probes.
+	float4 prefilter;  // Reflection probes.
+	float4 screenReflection;  // Replaces the probes and the sky where it hits.
+};
+
+// Performs diffuse and specular IBL. Reflection probes replace as much of the sky's irradiance and lookup tables as they
+// cover, and screen space reflections replace as much of the resulting prefiltered environment as their confidence.
+float3 ComputeIBL(float3 normalDirection, float3 viewDirection, Material material, uint prefilterLevels, float3 irradiance, TextureCube prefilterLut, Texture2D brdfLut, SamplerState lutSampler, LocalEnvironment local)
 {
 	float3 reflectionDirection = reflect(-viewDirection, normalDirection);
 	// Note that prefilterLevels is most likely smaller than the mip levels of the prefilter map. This reduces glowing rim artifacts on
 	// highly rough metals due to losing too much data in the prefilter map.
 	float3 prefilterSample = prefilterLut.SampleLevel(lutSampler, reflectionDirection, material.roughness * (prefilterLevels - 1.f)).rgb;
+	prefilterSample = prefilterSample * (1.f - local.prefilter.a) + local.prefilter.rgb;
+	prefilterSample = prefilterSample * (1.f - local.screenReflection.a) + local.screenReflection.rgb;
 	float2 brdf = brdfLut.Sample(lutSampler, float2(saturate(dot(normalDirection, viewDirection)), material.roughness)).xy;
 	
 	float3 fNaught = lerp(0.04.xxx, material.baseColor.rgb, material.metalness);
@@ -21,7 +32,7 @@ float3 ComputeIBL(float3 normalDirection, float3 viewDirection, Material materia
 	
 	float3 specularFactor = fresnel;
 	float3 diffuseFactor = (1.f - specularFactor) * (1.f - material.metalness);
-	float3 irradiance = irradianceLut.Sample(lutSampler, normalDirection).rgb;
+	irradiance = irradiance * (1.f - local.irradiance.a) + local.irradiance.rgb;
 	float3 diffuse = irradiance * material.baseColor.rgb;
 	
 	return (diffuseFactor * diffuse + specular) * material.occlusion;
@@ -0,0 +1,40 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#ifndef __SPHERICALHARMONICS_HLSLI__
+#define __SPHERICALHARMONICS_HLSLI__
+
+// Second order, three bands.
+static const uint shCoefficientCount = 9;
+
+// Real spherical harmonics basis, evaluated in a unit direction.
+void SHBasis(float3 direction, out float basis[shCoefficientCount])
+{
+	basis[0] = 0.282095f;
+	basis[1] = 0.488603f * direction.y;
+	basis[2] = 0.488603f * direction.z;
+	basis[3] = 0.488603f * direction.x;
+	basis[4] = 1.092548f * direction.x * direction.y;
+	basis[5] = 1.092548f * direction.y * direction.z;
+	basis[6] = 0.315392f * (3.f * direction.z * direction.z - 1.f);
+	basis[7] = 1.092548f * direction.x * direction.z;
+	basis[8] = 0.546274f * (direction.x * direction.x - direction.y * direction.y);
+}
+
+// Diffuse irradiance over pi around the normal, from the coefficients of the cube at the index. The projection already
+// convolved the radiance with the cosine lobe, see IrradianceMain() in IBL/Convolution.hlsl.
+float3 EvaluateIrradianceSH(StructuredBuffer<float4> coefficients, uint index, float3 normal)
+{
+	float basis[shCoefficientCount];
+	SHBasis(normal, basis);
+
+	float3 irradiance = 0.f;
+	[unroll]
+	for (uint i = 0; i < shCoefficientCount; ++i)
+	{
+		irradiance += coefficients[index * shCoefficientCount + i].rgb * basis[i];
+	}
+
+	return max(irradiance, 0.f);
+}
+
+#endif  // __SPHERICALHARMONICS_HLSLI__
\ No newline at end of file
@@ -0,0 +1,132 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "VertexAssembly.hlsli"
+#include "Object.hlsli"
+#include "Material.hlsli"
+#include "Constants.hlsli"
+#include "VisibilityBuffer.hlsli"
+#include "Impostors.hlsli"
+
+struct BindData
+{
+	uint objectBuffer;
+	uint vertexPositionBuffer;
+	uint vertexExtraBuffer;
+	uint materialBuffer;
+	uint indexBuffer;
+	uint objectId;  // Subset being drawn, of an entity drawing the mesh.
+	float radius;  // Object space sphere around every subset.
+	float padding;
+	float3 center;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+struct Input
+{
+	uint vertexId : SV_VertexID;  // Of the subset's triangle list, vertices are fetched through the index buffer.
+	uint frameId : SV_InstanceID;
+};
+
+struct Output
+{
+	float4 positionCS : SV_POSITION;
+	float4 clipDistance : SV_ClipDistance;  // Keeps each instance within its frame of the slot.
+	float depth : DEPTH;  // Toward the frame's view, [0, 1] over the sphere.
+	float3 normal : NORMAL;  // Object space.
+	float2 uv : UV;
+	float3 tangent : TANGENT;
+	float3 bitangent : BITANGENT;
+	float4 color : COLOR;
+};
+
+// Every frame of the slot is an instance, drawn orthographically from its direction into its cell of the slot's viewport.
+[RootSignature(RS)]
+Output VSMain(Input input)
+{
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	ObjectData object = objectBuffer[bindData.objectId];
+
+	VertexAssemblyData assemblyData;
+	assemblyData.positionBuffer = bindData.vertexPositionBuffer;
+	assemblyData.extraBuffer = bindData.vertexExtraBuffer;
+	assemblyData.metadata = object.vertexMetadata;
+
+	const uint vertexId = LoadTriangleIndices(bindData.indexBuffer, object, input.vertexId / 3)[input.vertexId % 3];
+	const float3 position = (LoadVertexPosition(assemblyData, vertexId).xyz - bindData.center) / bindData.radius;
+
+	const uint2 frame = uint2(input.frameId % impostorFramesPerSide, input.frameId / impostorFramesPerSide);
+	const float3 direction = GetImpostorFrameDirection(frame);
+	float3 right;
+	float3 up;
+	GetImpostorFrameBasis(direction, right, up);
+
+	const float2 framePosition = float2(dot(position, right), dot(position, up));
+	const float2 cellCenter = float2((frame.x + 0.5f) / impostorFramesPerSide * 2.f - 1.f, 1.f - (frame.y + 0.5f) / impostorFramesPerSide * 2.f);
+
+	Output output;
+	output.depth = dot(position, direction) * 0.5f + 0.5f;
+	output.positionCS = float4(cellCenter + framePosition / impostorFramesPerSide, output.depth, 1.f);  // Inverse Z, nearer is greater.
+	output.clipDistance = float4(1.f + framePosition.x, 1.f - framePosition.x, 1.f + framePosition.y, 1.f - framePosition.y);
+	output.normal = LoadVertexNormal(assemblyData, vertexId);
+	output.uv = LoadVertexTexcoord(assemblyData, vertexId);
+	output.tangent = LoadVertexTangent(assemblyData, vertexId).xyz;
+	output.bitangent = LoadVertexBitangent(assemblyData, vertexId).xyz;
+	output.color = LoadVertexColor(assemblyData, vertexId);
+
+	return output;
+}
+
+struct PixelOutput
+{
+	float4 albedo : SV_Target0;
+	float4 normal : SV_Target1;
+	float2 depth : SV_Target2;
+};
+
+// Same material evaluation as the forward pass, without occlusion and emission, which impostors don't carry.
+[RootSignature(RS)]
+PixelOutput PSMain(Output input)
+{
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	MaterialData material = LoadMaterial(bindData.materialBuffer, objectBuffer[bindData.objectId].materialIndex);
+	SamplerState materialSampler = SamplerDescriptorHeap[material.samplerIndex];
+
+	float4 baseColor = input.color;
+	if (HasMaterialTexture(materialFeatureBaseColor, material.baseColor))
+	{
+		Texture2D<float4> baseColorMap = ResourceDescriptorHeap[material.baseColor];
+		baseColor = baseColorMap.Sample(materialSampler, input.uv);
+		if (baseColor.a < alphaTestThreshold)
+			discard;
+	}
+
+	float2 metallicRoughness = float2(1.f, 1.f);
+	if (HasMaterialTexture(materialFeatureMetallicRoughness, material.metallicRoughness))
+	{
+		Texture2D<float4> metallicRoughnessMap = ResourceDescriptorHeap[material.metallicRoughness];
+		metallicRoughness = metallicRoughnessMap.Sample(materialSampler, input.uv).bg;  // GLTF 2.0 spec.
+	}
+
+	float3 normal = normalize(input.normal);
+	if (HasMaterialTexture(materialFeatureNormal, material.normal))
+	{
+		Texture2D<float4> normalMap = ResourceDescriptorHeap[material.normal];
+		float3 tangentNormal;
+		tangentNormal.xy = normalMap.Sample(materialSampler, input.uv).rg * 2.f - 1.f;
+		tangentNormal.z = sqrt(saturate(1.f - dot(tangentNormal.xy, tangentNormal.xy)));
+		normal = normalize(mul(tangentNormal, float3x3(input.tangent, input.bitangent, input.normal)));
+	}
+
+	baseColor *= material.baseColorFactor;
+	metallicRoughness *= float2(material.metallicFactor, material.roughnessFactor);
+
+	// Full coverage, the cleared texels around the mesh have none.
+	PixelOutput output;
+	output.albedo = float4(baseColor.rgb, 1.f);
+	output.normal = float4(normal * 0.5f + 0.5f, metallicRoughness.g);
+	output.depth = float2(input.depth, metallicRoughness.r);
+
+	return output;
+}
\ No newline at end of file
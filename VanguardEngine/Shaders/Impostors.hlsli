@@ -0,0 +1,202 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#ifndef __IMPOSTORS_HLSLI__
+#define __IMPOSTORS_HLSLI__
+
+#include "Object.hlsli"
+#include "Camera.hlsli"
+
+#pragma pack_matrix(row_major)
+
+// Matches Impostors.h.
+static const uint impostorFramesPerSide = 8;
+static const uint impostorFrameResolution = 32;
+static const uint impostorSlotsPerSide = 8;
+static const uint impostorSlotResolution = impostorFramesPerSide * impostorFrameResolution;
+static const uint impostorAtlasResolution = impostorSlotsPerSide * impostorSlotResolution;
+static const uint impostorPrimary = 1u << 31;  // Flags the subset of an entity that draws the quad.
+
+struct ImpostorData
+{
+	float3 center;  // Object space sphere around every subset.
+	float radius;
+	uint slot;  // In the atlases.
+	uint ready;  // Baked, distant instances draw it.
+	float2 padding;
+};
+
+// Takes the place of MeshletDrawData in the bind data of impostor draws, impostors are never drawn by mesh shaders.
+struct ImpostorDrawData
+{
+	uint impostorBuffer;
+	uint albedoAtlas;  // Base color, coverage in alpha.
+	uint normalAtlas;  // Object space normal, perceptual roughness in alpha.
+	uint depthAtlas;  // Depth toward the frame's view within the sphere, metalness.
+	float4 padding[3];
+};
+
+ImpostorData LoadImpostor(uint impostorBuffer, ObjectData object)
+{
+	StructuredBuffer<ImpostorData> impostors = ResourceDescriptorHeap[impostorBuffer];
+	return impostors[(object.impostorIndex & ~impostorPrimary) - 1];
+}
+
+// Maps a unit direction onto the [-1, 1] square, the inverse of DecodeOctahedral.
+float2 EncodeOctahedral(float3 direction)
+{
+	direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+	if (direction.z < 0.f)
+	{
+		direction.xy = (1.f - abs(direction.yx)) * float2(direction.x >= 0.f ? 1.f : -1.f, direction.y >= 0.f ? 1.f : -1.f);
+	}
+
+	return direction.xy;
+}
+
+// Frames cover the whole sphere, each one looks at the center from this direction.
+float3 GetImpostorFrameDirection(uint2 frame)
+{
+	return DecodeOctahedral((frame + 0.5f) / impostorFramesPerSide * 2.f - 1.f);
+}
+
+// Axes of a frame's image, shared by baking and sampling.
+void GetImpostorFrameBasis(float3 direction, out float3 right, out float3 up)
+{
+	const float3 reference = abs(direction.y) < 0.999f ? float3(0.f, 1.f, 0.f) : float3(0.f, 0.f, 1.f);
+	right = normalize(cross(reference, direction));
+	up = cross(direction, right);
+}
+
+uint2 GetImpostorSlotOrigin(uint slot)
+{
+	return uint2(slot % impostorSlotsPerSide, slot / impostorSlotsPerSide) * impostorSlotResolution;
+}
+
+// Camera facing quad around the instance's sphere, wide enough to cover its silhouette from up close.
+struct ImpostorVertex
+{
+	float4 positionCS : SV_POSITION;
+	float3 position : POSITION;  // World space, on the quad.
+	nointerpolation uint objectId : OBJECT;
+};
+
+ImpostorVertex CreateImpostorVertex(ImpostorDrawData data, ObjectData object, TransformData transform, Camera camera, uint objectId, uint vertexId)
+{
+	static const float2 corners[6] = { float2(-1.f, -1.f), float2(1.f, -1.f), float2(1.f, 1.f), float2(-1.f, -1.f), float2(1.f, 1.f), float2(-1.f, 1.f) };
+
+	const ImpostorData impostor = LoadImpostor(data.impostorBuffer, object);
+	const float3 center = mul(float4(impostor.center, 1.f), transform.worldMatrix).xyz;
+	const float radius = impostor.radius * GetMaxScale(transform.worldMatrix);
+
+	const float3 toCamera = camera.position.xyz - center;
+	const float distance = length(toCamera);
+	float3 right;
+	float3 up;
+	GetImpostorFrameBasis(toCamera / distance, right, up);
+
+	// Half width of the sphere's cone of tangents at the center's depth.
+	const float extent = radius * distance / sqrt(max(distance * distance - radius * radius, radius * radius * 0.01f));
+	const float2 corner = corners[vertexId];
+
+	ImpostorVertex output;
+	output.position = center + (right * corner.x + up * corner.y) * extent;
+	output.positionCS = mul(mul(float4(output.position, 1.f), camera.view), camera.projection);
+	output.objectId = objectId;
+
+	return output;
+}
+
+struct ImpostorSurface
+{
+	float3 position;  // World space.
+	float3 objectPosition;  // Object space, for motion vectors.
+	float3 normal;  // World space.
+	float3 albedo;
+	float roughness;  // Perceptual.
+	float metalness;
+	float coverage;
+};
+
+// Blends the four frames around the view direction. The pixel's ray is intersected with each frame's plane, so every frame
+// is sampled where it shows the same point of the mesh, and the frame's depth then moves the point off the plane. Both
+// passes drawing impostors resolve their surface here, their depths have to match.
+ImpostorSurface ResolveImpostor(ImpostorDrawData data, ObjectData object, TransformData transform, Camera camera, float3 quadPosition)
+{
+	Texture2D<float4> albedoAtlas = ResourceDescriptorHeap[data.albedoAtlas];
+	Texture2D<float4> normalAtlas = ResourceDescriptorHeap[data.normalAtlas];
+	Texture2D<float2> depthAtlas = ResourceDescriptorHeap[data.depthAtlas];
+
+	const ImpostorData impostor = LoadImpostor(data.impostorBuffer, object);
+	const float3x3 worldRotation = (float3x3)transform.worldMatrix;
+	const float scale = GetMaxScale(transform.worldMatrix);
+	const float3 center = mul(float4(impostor.center, 1.f), transform.worldMatrix).xyz;
+
+	// Into object space relative to the center, exact for rotations with uniform scaling.
+	const float3 rayOrigin = mul(worldRotation, camera.position.xyz - center) / (scale * scale);
+	const float3 rayDirection = normalize(mul(worldRotation, quadPosition - camera.position.xyz));
+
+	const float2 grid = (EncodeOctahedral(normalize(rayOrigin)) * 0.5f + 0.5f) * impostorFramesPerSide - 0.5f;
+	const float2 base = clamp(floor(grid), 0.f, impostorFramesPerSide - 1.f);
+	const float2 blend = saturate(grid - base);
+	const uint2 slotOrigin = GetImpostorSlotOrigin(impostor.slot);
+
+	float4 albedo = 0.xxxx;
+	float4 normal = 0.xxxx;
+	float metalness = 0.f;
+	float3 position = 0.xxx;
+
+	[unroll]
+	for (uint i = 0; i < 4; ++i)
+	{
+		const uint2 offset = uint2(i & 1, i >> 1);
+		const uint2 frame = min(uint2(base) + offset, impostorFramesPerSide - 1);
+		const float weight = (offset.x ? blend.x : 1.f - blend.x) * (offset.y ? blend.y : 1.f - blend.y);
+
+		const float3 direction = GetImpostorFrameDirection(frame);
+		float3 right;
+		float3 up;
+		GetImpostorFrameBasis(direction, right, up);
+
+		const float3 hit = rayOrigin - rayDirection * dot(rayOrigin, direction) / min(dot(rayDirection, direction), -1e-4f);
+		const float2 frameUv = float2(dot(hit, right), -dot(hit, up)) / impostor.radius * 0.5f + 0.5f;
+
+		// Held half a texel inside the frame, filtering would bleed the neighboring frames in.
+		const float2 texel = clamp(frameUv * impostorFrameResolution, 0.5f, impostorFrameResolution - 0.5f);
+		const float2 uv = (slotOrigin + frame * impostorFrameResolution + texel) / impostorAtlasResolution;
+
+		// Uncovered texels are cleared to zero, so every filtered channel is weighted by coverage. Rays passing outside of
+		// the frame miss it.
+		const float frameWeight = all(frameUv == saturate(frameUv)) ? weight : 0.f;
+		const float4 frameAlbedo = albedoAtlas.SampleLevel(bilinearClamp, uv, 0) * frameWeight;
+		const float4 frameNormal = normalAtlas.SampleLevel(bilinearClamp, uv, 0) * frameWeight;
+		const float2 frameDepth = depthAtlas.SampleLevel(bilinearClamp, uv, 0) * frameWeight;
+
+		albedo += frameAlbedo;
+		normal += frameNormal;
+		metalness += frameDepth.y;
+		position += (hit + direction * (frameDepth.x / max(frameAlbedo.a, 1e-4f) * 2.f - 1.f) * impostor.radius) * frameAlbedo.a;
+	}
+
+	const float inverseCoverage = 1.f / max(albedo.a, 1e-4f);
+
+	ImpostorSurface surface;
+	surface.coverage = albedo.a;
+	surface.albedo = albedo.rgb * inverseCoverage;
+	surface.roughness = saturate(normal.a * inverseCoverage);
+	surface.metalness = saturate(metalness * inverseCoverage);
+	surface.objectPosition = position * inverseCoverage + impostor.center;
+	surface.position = mul(float4(surface.objectPosition, 1.f), transform.worldMatrix).xyz;
+	surface.normal = normalize(mul(normal.xyz * inverseCoverage * 2.f - 1.f, worldRotation));
+
+	return surface;
+}
+
+// Inverse Z depth of the resolved surface.
+float GetImpostorDepth(ImpostorSurface surface, Camera camera)
+{
+	precise const float4 positionCS = mul(mul(float4(surface.position, 1.f), camera.view), camera.projection);
+
+	return positionCS.z / positionCS.w;
+}
+
+#endif  // __IMPOSTORS_HLSLI__
\ No newline at end of file
@@ -10,9 +10,14 @@
 enum class LightType
 {
 	Point,
-	Directional
+	Directional,
+	Spot,
+	Area,  // Rectangular and one sided.
+	Probe  // Reflection probe, blended into the image based lighting instead of being lit.
 };
 
+static const uint freeLightSlot = 0xFFFFFFFF;  // Type of unused slots in the light buffer.
+
 struct Light
 {
 	float3 position;
@@ -20,14 +25,24 @@ struct Light
 	// Boundary
 	float3 color;  // Combined diffuse and specular.
 	float luminance;  // Nits.
-	float3 direction;
-	float padding;
+	// Boundary
+	float3 direction;  // Spot and area lights emit along the direction.
+	float spotCosOuter;
+	// Boundary
+	float3 tangent;  // Area light width axis.
+	float spotCosInner;
+	// Boundary
+	float2 areaExtents;  // Half width and height. Probes store their influence radius in x.
+	uint probeIndex;  // Cube of the probe in the probe arrays. Point and spot lights store their first local shadow tile plus one, zero when unshadowed.
+	float radius;  // Influence range, attenuation reaches zero at it. Unused by directional lights and probes.
 };
 
 float ComputeLightRadius(Light light)
 {
-	// #TEMP
-	return 150.f;
+	if (light.type == LightType::Probe)
+		return light.areaExtents.x;
+
+	return light.radius;
 }
 
 float ComputeLightAttenuation(Light light, float distance)
@@ -68,6 +83,32 @@ LightSample SampleLight(Light light, Material material, Camera camera, float3 vi
 			lightDirection = normalize(-light.direction);
 			break;
 		}
+		case LightType::Spot:
+		{
+			lightDirection = normalize(light.position - surfacePosition);
+
+			float distance = length(light.position - surfacePosition);
+			float attenuation = ComputeLightAttenuation(light, distance);
+			attenuation *= smoothstep(light.spotCosOuter, light.spotCosInner, dot(-lightDirection, light.direction));
+			radiance *= attenuation;
+			break;
+		}
+		case LightType::Area:
+		{
+			// Representative point approximation, lit from the closest point on the rectangle.
+			const float3 bitangent = cross(light.direction, light.tangent);
+			const float3 offset = surfacePosition - light.position;
+			const float2 local = clamp(float2(dot(offset, light.tangent), dot(offset, bitangent)), -light.areaExtents, light.areaExtents);
+			const float3 closestPoint = light.position + light.tangent * local.x + bitangent * local.y;
+
+			lightDirection = normalize(closestPoint - surfacePosition);
+
+			float distance = length(closestPoint - surfacePosition);
+			float attenuation = ComputeLightAttenuation(light, distance);
+			attenuation *= saturate(dot(-lightDirection, light.direction));  // One sided.
+			radiance *= attenuation;
+			break;
+		}
 	}
 	
 	float3 halfwayDirection = normalize(viewDirection + lightDirection);
@@ -3,23 +3,81 @@
 #ifndef __MATERIAL_HLSLI__
 #define __MATERIAL_HLSLI__
 
+// Texture words hold the bindless index in their low bits.
+struct PackedMaterialData
+{
+	uint baseColor;  // Sampler heap index in the high bits.
+	uint metallicRoughness;  // Metallic factor as a 12 bit unorm in the high bits.
+	uint normal;  // Roughness factor as a 12 bit unorm in the high bits.
+	uint occlusion;
+	// Boundary
+	uint emissive;
+	uint emissiveFactor;  // R11G11B10 float.
+	uint2 baseColorFactor;  // Half precision.
+};
+
+static const uint materialTextureBits = 20;  // Mirrors materialTextureBits, see ShaderStructs.h.
+static const uint materialTextureMask = (1 << materialTextureBits) - 1;
+
 struct MaterialData
 {
 	uint baseColor;
 	uint metallicRoughness;
 	uint normal;
 	uint occlusion;
-	// Boundary
 	uint emissive;
 	float3 emissiveFactor;
-	// Boundary
 	float4 baseColorFactor;
-	// Boundary
 	float metallicFactor;
 	float roughnessFactor;
-	float2 padding;
+	uint samplerIndex;  // Shared by every texture of the material.
 };
 
+float3 UnpackR11G11B10(uint packed)
+{
+	// Each channel is a half without the sign bit and the low mantissa bits.
+	return float3(f16tof32((packed << 4) & 0x7FF0), f16tof32((packed >> 7) & 0x7FF0), f16tof32((packed >> 17) & 0x7FE0));
+}
+
+MaterialData LoadMaterial(uint materialBuffer, uint index)
+{
+	StructuredBuffer<PackedMaterialData> materials = ResourceDescriptorHeap[materialBuffer];
+	const PackedMaterialData packed = materials[index];
+
+	MaterialData material;
+	material.baseColor = packed.baseColor & materialTextureMask;
+	material.metallicRoughness = packed.metallicRoughness & materialTextureMask;
+	material.normal = packed.normal & materialTextureMask;
+	material.occlusion = packed.occlusion & materialTextureMask;
+	material.emissive = packed.emissive & materialTextureMask;
+	material.emissiveFactor = UnpackR11G11B10(packed.emissiveFactor);
+	material.baseColorFactor = float4(f16tof32(packed.baseColorFactor.x), f16tof32(packed.baseColorFactor.x >> 16), f16tof32(packed.baseColorFactor.y), f16tof32(packed.baseColorFactor.y >> 16));
+	material.metallicFactor = (packed.metallicRoughness >> materialTextureBits) / 4095.0;
+	material.roughnessFactor = (packed.normal >> materialTextureBits) / 4095.0;
+	material.samplerIndex = packed.baseColor >> materialTextureBits;
+
+	return material;
+}
+
+// Mirrors MaterialFeature, see ShaderStructs.h.
+static const uint materialFeatureBaseColor = 1 << 0;
+static const uint materialFeatureMetallicRoughness = 1 << 1;
+static const uint materialFeatureNormal = 1 << 2;
+static const uint materialFeatureOcclusion = 1 << 3;
+static const uint materialFeatureEmissive = 1 << 4;
+static const uint materialFeatureBlend = 1 << 5;
+
+// Pipelines specialized on a material bucket define MATERIAL_FEATURES, so texture paths the bucket never samples are
+// compiled out. The index is still checked, materials can finish loading before their draws are bucketed again.
+bool HasMaterialTexture(uint feature, uint textureIndex)
+{
+#ifdef MATERIAL_FEATURES
+	return (MATERIAL_FEATURES & feature) != 0 && textureIndex > 0;
+#else
+	return textureIndex > 0;
+#endif
+}
+
 struct Material
 {
 	float4 baseColor;
@@ -2,137 +2,441 @@
 
 #include "RootSignature.hlsli"
 #include "Object.hlsli"
-#include "Camera.hlsli"
+#include "Culling.hlsli"
+#include "VirtualShadows/Core.hlsli"
+#include "Impostors.hlsli"
 
 struct BindData
 {
 	uint inputBuffer;
 	uint outputBuffer;
+	uint instanceBuffer;
+	uint visibleInstanceBuffer;
 	uint objectBuffer;
-	uint cameraBuffer;
+	uint transformBuffer;
+	uint cullingViewBuffer;
 	uint cameraIndex;
-	uint drawCount;
+	uint batchCount;
+	uint instanceCount;
 	uint cullingLevel;
 	uint hiZTexture;
 	uint hiZMipLevels;
+	uint visibilityBuffer;  // Last frame's instance visibility bits.
+	uint nextVisibilityBuffer;  // Late phase only.
+	uint lodResolution;  // Height of the view in pixels, zero always draws the full detail level.
+	float lodErrorThreshold;  // Coarser levels are drawn while their error projects below this many pixels.
+	uint countInstances;  // Counts every visible instance on the output's counter, only for culling statistics.
+	uint virtualPageTable;  // Virtual shadow phase only.
+	uint impostorBuffer;  // Main view only, zero never draws impostors.
+	uint impostorArgumentBuffer;
+	uint impostorInstanceBuffer;
+	uint impostorResolution;  // Height of the view in pixels.
+	float impostorScreenSize;  // Instances whose sphere projects below this many pixels draw their impostor.
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
 
 struct MeshIndirectArgument
 {
-	uint batchId;
+	uint2 indexBufferLocation;
+	uint indexBufferSize;
+	uint indexBufferFormat;
+	uint batchId;  // Offset of the batch's first instance in the instance list.
 	uint indexCountPerInstance;
 	uint instanceCount;
 	uint startIndexLocation;
 	int baseVertexLocation;
 	uint startInstanceLocation;
-	float2 padding;
+	uint bucket;
+	uint lodLevel;
+	uint lodCount;
+	float lodError;
 };
 
-// Credit: 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D Sphere
-bool ProjectSphere(float3 center, float radius, Camera camera, out float4 aabb)
+struct MeshInstance
+{
+	uint objectId;
+	uint batch;
+};
+
+static const uint maxMeshLods = 4;  // Matches maxMeshLods in RenderComponents.h.
+
+// World space bounds of an object. The box is the object space box transformed into a box aligned to the world's axes.
+struct ObjectBounds
+{
+	float3 center;
+	float radius;
+	float3 boxCenter;
+	float3 boxExtents;
+};
+
+ObjectBounds ComputeBounds(ObjectData object, TransformData transform)
+{
+	ObjectBounds bounds;
+	bounds.center = mul(float4(object.boundingSphereCenter, 1.f), transform.worldMatrix).xyz;
+	bounds.radius = object.boundingSphereRadius * GetMaxScale(transform.worldMatrix);
+	bounds.boxCenter = mul(float4(object.boundsCenter, 1.f), transform.worldMatrix).xyz;
+	bounds.boxExtents = mul(object.boundsExtents, abs((float3x3)transform.worldMatrix));
+
+	return bounds;
+}
+
+// The sphere is cheaper to test, the box is tighter around long, thin or off-center subsets. Orthographic views have no
+// near plane to test against, see CreateCullingView().
+bool IsInFrustum(ObjectData object, TransformData transform, CullingView view, out ObjectBounds bounds)
+{
+	bounds = ComputeBounds(object, transform);
+
+	return IsSphereInFrustum(bounds.center, bounds.radius, view) && IsBoxInFrustum(bounds.boxCenter, bounds.boxExtents, view);
+}
+
+// Both tests are conservative, either footprint being hidden is enough.
+bool IsOccluded(ObjectBounds bounds, CullingView view)
+{
+	return IsBoxOccluded(bounds.boxCenter, bounds.boxExtents, view, bindData.hiZTexture, bindData.hiZMipLevels) ||
+		IsSphereOccluded(bounds.center, bounds.radius, view, bindData.hiZTexture, bindData.hiZMipLevels);
+}
+
+bool WasVisible(uint instance)
+{
+	StructuredBuffer<uint> visibilityBuffer = ResourceDescriptorHeap[bindData.visibilityBuffer];
+	return (visibilityBuffer[instance / 32] & (1u << (instance % 32))) != 0;
+}
+
+// Coarsest level of detail of the instance's batch whose simplification error projects below the threshold. Sizes are
+// measured at the front of the bounding sphere, so every part of the instance is drawn with at least this much detail.
+uint SelectLod(MeshInstance instance, TransformData transform, ObjectBounds bounds, CullingView view)
+{
+	if (bindData.lodResolution == 0)
+		return 0;
+
+	StructuredBuffer<MeshIndirectArgument> inputBuffer = ResourceDescriptorHeap[bindData.inputBuffer];
+	const uint lodCount = inputBuffer[instance.batch].lodCount;
+	if (lodCount <= 1)
+		return 0;
+
+	// Errors are in object space, scaled by the instance's largest axis.
+	const float scale = GetMaxScale(transform.worldMatrix);
+
+	// Orthographic views have a fixed scale, perspective views shrink with depth.
+	float pixelsPerUnit = bindData.lodResolution * 0.5f * view.projectionScale.y;
+	if (!view.orthographic)
+	{
+		const float depth = -mul(float4(bounds.center, 1.f), view.view).z;
+		pixelsPerUnit /= max(depth - bounds.radius, view.nearPlane);
+	}
+
+	uint lod = 0;
+	for (uint i = 1; i < lodCount; ++i)
+	{
+		if (inputBuffer[instance.batch + i].lodError * scale * pixelsPerUnit > bindData.lodErrorThreshold)
+			break;
+
+		lod = i;
+	}
+
+	return lod;
+}
+
+// Distant instances of baked meshes draw an impostor in place of every subset. The impostor's sphere is shared by the
+// subsets, so they all agree, and the first subset appends the instance to the impostor list.
+bool DrawImpostor(ObjectData object, MeshInstance instance, TransformData transform, CullingView view)
 {
-	// Near plane culling.
-	if (center.z < camera.nearPlane + radius)
+	if (bindData.impostorBuffer == 0 || object.impostorIndex == 0 || view.orthographic)
 		return false;
 
-	float2 cx = -center.xz;
-	float2 vx = float2(sqrt(dot(cx, cx) - radius * radius), radius);
-	float2 minx = mul(cx, float2x2(vx.x, vx.y, -vx.y, vx.x));
-	float2 maxx = mul(cx, float2x2(vx.x, -vx.y, vx.y, vx.x));
+	const ImpostorData impostor = LoadImpostor(bindData.impostorBuffer, object);
+	if (!impostor.ready)
+		return false;
 
-	float2 cy = -center.yz;
-	float2 vy = float2(sqrt(dot(cy, cy) - radius * radius), radius);
-	float2 miny = mul(cy, float2x2(vy.x, vy.y, -vy.y, vy.x));
-	float2 maxy = mul(cy, float2x2(vy.x, -vy.y, vy.y, vy.x));
+	const float3 center = mul(float4(impostor.center, 1.f), transform.worldMatrix).xyz;
+	const float radius = impostor.radius * GetMaxScale(transform.worldMatrix);
+	const float depth = -mul(float4(center, 1.f), view.view).z;
+	if (radius * bindData.impostorResolution * view.projectionScale.y / max(depth, view.nearPlane) >= bindData.impostorScreenSize)
+		return false;
 
-	float p00 = camera.lastFrameProjection._m00;
-	float p11 = camera.lastFrameProjection._m11;
-	aabb = float4(minx.x / minx.y * p00, miny.x / miny.y * p11, maxx.x / maxx.y * p00, maxy.x / maxy.y * p11);
-	aabb = aabb.xwzy * float4(0.5, -0.5, 0.5, -0.5) + 0.5.xxxx;
+	if (object.impostorIndex & impostorPrimary)
+	{
+		RWStructuredBuffer<uint4> argumentBuffer = ResourceDescriptorHeap[bindData.impostorArgumentBuffer];
+		RWStructuredBuffer<uint> instanceBuffer = ResourceDescriptorHeap[bindData.impostorInstanceBuffer];
+
+		// A single quad, instanced once per impostor.
+		const uint count = WaveActiveCountBits(true);
+		uint first = 0;
+		if (WaveIsFirstLane())
+		{
+			InterlockedAdd(argumentBuffer[0].y, count, first);
+		}
+
+		instanceBuffer[WaveReadLaneFirst(first) + WavePrefixCountBits(true)] = instance.objectId;
+	}
 
 	return true;
 }
 
-bool IsVisible(ObjectData object, Camera camera)
-{
-	float3 center = float3(object.worldMatrix._m30, object.worldMatrix._m31, object.worldMatrix._m32);
-	float radius = object.boundingSphereRadius * 4.f;  // #TODO: Something weird with bounding sphere size...
-
-	// Project sphere into view space.
-	float4 viewSpace = mul(float4(center, 1.f), camera.view);
-	center = (viewSpace / viewSpace.w).xyz;  // Perspective division.
-
-	matrix projectionTranspose = transpose(camera.lastFrameProjection);
-	float4 r0 = float4(projectionTranspose._m00, projectionTranspose._m01, projectionTranspose._m02, projectionTranspose._m03);
-	float4 r1 = float4(projectionTranspose._m10, projectionTranspose._m11, projectionTranspose._m12, projectionTranspose._m13);
-	float4 r2 = float4(projectionTranspose._m20, projectionTranspose._m21, projectionTranspose._m22, projectionTranspose._m23);
-	float4 r3 = float4(projectionTranspose._m30, projectionTranspose._m31, projectionTranspose._m32, projectionTranspose._m33);
-
-	// https://fgiesen.wordpress.com/2012/08/31/frustum-planes-from-the-projection-matrix/
-	// Frustum plane inequalities:
-	// -w <= x <= w
-	// -w <= y <= w
-	// 0 <= z <= w
-	// #TODO: More efficient frustum culling: https://github.com/zeux/niagara/blob/master/src/shaders/drawcull.comp.glsl
-
-	bool visible = true;
-	visible = visible && -radius <= mul(center, r3 + r0);  // Left plane
-	visible = visible && -radius <= mul(center, r3 - r0);  // Right plane
-	visible = visible && -radius <= mul(center, r3 + r1);  // Bottom plane
-	visible = visible && -radius <= mul(center, r3 - r1);  // Top plane
-	visible = visible && -radius <= mul(center, r3);  // Near plane
-	visible = visible && -radius <= mul(center, r3 - r2);  // Far plane
-
-	if (visible && bindData.cullingLevel > 1)
+// Multiple views write consecutive ranges of draw arguments, each view's arguments point into its own range of the
+// visible instance list. Levels of detail draw from the consecutive arguments after their batch's.
+void AppendInstance(MeshInstance instance, uint view = 0, uint lod = 0)
+{
+	StructuredBuffer<MeshIndirectArgument> inputBuffer = ResourceDescriptorHeap[bindData.inputBuffer];
+	RWStructuredBuffer<MeshIndirectArgument> outputBuffer = ResourceDescriptorHeap[bindData.outputBuffer];
+	RWStructuredBuffer<uint> visibleInstanceBuffer = ResourceDescriptorHeap[bindData.visibleInstanceBuffer];
+
+	// Compact the visible instances to the front of their batch's range. Neighboring instances tend to share a batch, so
+	// the appending lanes are grouped by argument, and each group reserves its contiguous slots with a single atomic.
+	const uint argument = view * bindData.batchCount + instance.batch + lod;
+	while (true)
+	{
+		if (argument == WaveReadLaneFirst(argument))
+		{
+			const uint count = WaveActiveCountBits(true);
+			uint first = 0;
+			if (WaveIsFirstLane())
+			{
+				InterlockedAdd(outputBuffer[argument].instanceCount, count, first);
+			}
+
+			const uint slot = WaveReadLaneFirst(first) + WavePrefixCountBits(true);
+			visibleInstanceBuffer[outputBuffer[argument].batchId + slot] = instance.objectId;
+
+			break;
+		}
+	}
+
+	if (bindData.countInstances)
+	{
+		outputBuffer.IncrementCounter();  // Visible instances of the phase, read back for culling statistics.
+	}
+}
+
+// One dispatch row per view. Each view and level of detail has its own copy of the instance list ranges, so visible
+// instance lists hold maxMeshLods instance lists per view.
+[RootSignature(RS)]
+[numthreads(64, 1, 1)]
+void ResetMain(uint3 dispatchId : SV_DispatchThreadID)
+{
+	StructuredBuffer<MeshIndirectArgument> inputBuffer = ResourceDescriptorHeap[bindData.inputBuffer];
+	RWStructuredBuffer<MeshIndirectArgument> outputBuffer = ResourceDescriptorHeap[bindData.outputBuffer];
+
+	uint index = dispatchId.x;
+	uint view = dispatchId.y;
+	if (index < bindData.batchCount)
+	{
+		MeshIndirectArgument argument = inputBuffer[index];
+		argument.instanceCount = 0;
+		argument.batchId += (view * maxMeshLods + argument.lodLevel) * bindData.instanceCount;
+		argument.startInstanceLocation = view * bindData.batchCount + index;  // Fetches the argument's own batch offset.
+		outputBuffer[view * bindData.batchCount + index] = argument;
+	}
+}
+
+// Empties the impostor list, apart from ResetMain since only the main view binds it.
+[RootSignature(RS)]
+[numthreads(1, 1, 1)]
+void ImpostorResetMain()
+{
+	RWStructuredBuffer<uint4> argumentBuffer = ResourceDescriptorHeap[bindData.impostorArgumentBuffer];
+	argumentBuffer[0] = uint4(6, 0, 0, 0);
+}
+
+// Draws instances visible last frame. With occlusion culling disabled, draws every instance in the frustum.
+[RootSignature(RS)]
+[numthreads(64, 1, 1)]
+void EarlyMain(uint dispatchId : SV_DispatchThreadID)
+{
+	StructuredBuffer<MeshInstance> instanceBuffer = ResourceDescriptorHeap[bindData.instanceBuffer];
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	StructuredBuffer<CullingView> cullingViewBuffer = ResourceDescriptorHeap[bindData.cullingViewBuffer];
+	CullingView view = cullingViewBuffer[bindData.cameraIndex];
+
+	uint index = dispatchId.x;
+	if (index < bindData.instanceCount)
 	{
-		// Convention here is +Z going outwards from camera.
-		center.z *= -1;
-		radius *= 0.25;  // Revert the weird 4x scaling above.
-		radius += 2;  // Add buffering zone to reduce artifacts from 1-frame delay.
+		MeshInstance instance = instanceBuffer[index];
+		ObjectData object = objectBuffer[instance.objectId];
+		TransformData transform = LoadTransform(bindData.transformBuffer, object);
+
+		ObjectBounds bounds;
+		bool visible = IsInFrustum(object, transform, view, bounds) || bindData.cullingLevel == 0;
+		if (bindData.cullingLevel > 1)
+			visible = visible && WasVisible(index);
 
-		float4 aabb;
-		if (ProjectSphere(center, radius, camera, aabb))
+		if (visible && !DrawImpostor(object, instance, transform, view))
 		{
-			Texture2D<float> hiZTexture = ResourceDescriptorHeap[bindData.hiZTexture];
-			uint width, height, mipCount;
-			hiZTexture.GetDimensions(0, width, height, mipCount);
-			mipCount = min(mipCount, bindData.hiZMipLevels) - 1;
+			AppendInstance(instance, 0, SelectLod(instance, transform, bounds, view));
+		}
+	}
+}
 
-			float projectedWidth = (aabb.z - aabb.x) * width;
-			float projectedHeight = (aabb.w - aabb.y) * height;
+// Frustum culling for orthographic views without any visibility history, such as the shadow cascades. One dispatch row
+// per view, the views' cameras follow the camera index.
+[RootSignature(RS)]
+[numthreads(64, 1, 1)]
+void ShadowMain(uint3 dispatchId : SV_DispatchThreadID)
+{
+	StructuredBuffer<MeshInstance> instanceBuffer = ResourceDescriptorHeap[bindData.instanceBuffer];
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	StructuredBuffer<CullingView> cullingViewBuffer = ResourceDescriptorHeap[bindData.cullingViewBuffer];
+	CullingView view = cullingViewBuffer[bindData.cameraIndex + dispatchId.y];
 
-			float level = min(floor(log2(max(projectedWidth, projectedHeight))), mipCount);
-			float2 uv = (aabb.xy + aabb.zw) * 0.5;
-			float depth = hiZTexture.SampleLevel(linearMipPointClampMinimum, uv, level);
-			float depthSphere = camera.nearPlane / (center.z - radius);
+	uint index = dispatchId.x;
+	if (index < bindData.instanceCount)
+	{
+		MeshInstance instance = instanceBuffer[index];
+		ObjectData object = objectBuffer[instance.objectId];
+		TransformData transform = LoadTransform(bindData.transformBuffer, object);
 
-			visible = visible && depthSphere >= depth;  // Inverse Z.
+		ObjectBounds bounds;
+		if (IsInFrustum(object, transform, view, bounds))
+		{
+			AppendInstance(instance, dispatchId.y, SelectLod(instance, transform, bounds, view));
 		}
 	}
+}
 
-	return visible;
+// Frustum culling for the cube faces of a reflection probe capture, perspective views without any visibility history. One
+// dispatch row per face, the faces' cameras follow the camera index.
+[RootSignature(RS)]
+[numthreads(64, 1, 1)]
+void ProbeMain(uint3 dispatchId : SV_DispatchThreadID)
+{
+	StructuredBuffer<MeshInstance> instanceBuffer = ResourceDescriptorHeap[bindData.instanceBuffer];
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	StructuredBuffer<CullingView> cullingViewBuffer = ResourceDescriptorHeap[bindData.cullingViewBuffer];
+	CullingView view = cullingViewBuffer[bindData.cameraIndex + dispatchId.y];
+
+	uint index = dispatchId.x;
+	if (index < bindData.instanceCount)
+	{
+		MeshInstance instance = instanceBuffer[index];
+		ObjectData object = objectBuffer[instance.objectId];
+		TransformData transform = LoadTransform(bindData.transformBuffer, object);
+
+		ObjectBounds bounds;
+		if (IsInFrustum(object, transform, view, bounds))
+		{
+			AppendInstance(instance, dispatchId.y, SelectLod(instance, transform, bounds, view));
+		}
+	}
 }
 
+// Casters of the virtual shadow map, only kept if they cover a page rendering this frame.
 [RootSignature(RS)]
 [numthreads(64, 1, 1)]
-void Main(uint dispatchId : SV_DispatchThreadID)
+void VirtualShadowMain(uint dispatchId : SV_DispatchThreadID)
 {
-	StructuredBuffer<MeshIndirectArgument> inputBuffer = ResourceDescriptorHeap[bindData.inputBuffer];
-	AppendStructuredBuffer<MeshIndirectArgument> outputBuffer = ResourceDescriptorHeap[bindData.outputBuffer];
+	StructuredBuffer<MeshInstance> instanceBuffer = ResourceDescriptorHeap[bindData.instanceBuffer];
 	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
-	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
-	Camera camera = cameraBuffer[bindData.cameraIndex];
+	StructuredBuffer<CullingView> cullingViewBuffer = ResourceDescriptorHeap[bindData.cullingViewBuffer];
+	StructuredBuffer<VirtualShadowPage> pageTable = ResourceDescriptorHeap[bindData.virtualPageTable];
+	CullingView view = cullingViewBuffer[bindData.cameraIndex];
 
 	uint index = dispatchId.x;
-	if (index < bindData.drawCount)
+	if (index >= bindData.instanceCount)
+		return;
+
+	MeshInstance instance = instanceBuffer[index];
+	ObjectData object = objectBuffer[instance.objectId];
+	TransformData transform = LoadTransform(bindData.transformBuffer, object);
+
+	ObjectBounds bounds;
+	if (!IsInFrustum(object, transform, view, bounds))
+		return;
+
+	// The box's footprint on the light's plane, always within the sphere's.
+	const float texelSize = 2.f / (view.projectionScale.x * virtualResolution);  // Matches VirtualTexelSize().
+	const float3 boxCenter = mul(float4(bounds.boxCenter, 1.f), view.view).xyz;
+	const float2 extents = mul(bounds.boxExtents, abs((float3x3)view.view)).xy;
+	const int2 minPage = WorldTexelToPage(LightToWorldTexel(boxCenter + float3(-extents.x, extents.y, 0.f), texelSize));
+	const int2 maxPage = WorldTexelToPage(LightToWorldTexel(boxCenter + float3(extents.x, -extents.y, 0.f), texelSize));
+
+	// Large casters aren't worth testing page by page.
+	bool visible = any(maxPage - minPage >= 16);
+	for (int y = minPage.y; y <= maxPage.y && !visible; ++y)
+	{
+		for (int x = minPage.x; x <= maxPage.x && !visible; ++x)
+		{
+			const int2 worldPage = int2(x, y);
+			const VirtualShadowPage page = pageTable[PageSlot(worldPage)];
+			visible = (page.flags & virtualPageRendering) && page.tag == PackPageTag(worldPage);
+		}
+	}
+
+	if (visible)
+	{
+		AppendInstance(instance);
+	}
+}
+
+#ifndef WAVE_SIZE
+groupshared uint visibilityWords[2];
+#endif
+
+// Tests every instance against the Hi-Z, drawing newly visible instances and storing visibility for the next frame.
+[RootSignature(RS)]
+[numthreads(64, 1, 1)]
+#ifdef WAVE_SIZE
+[WaveSize(WAVE_SIZE)]
+#endif
+void LateMain(uint dispatchId : SV_DispatchThreadID, uint groupIndex : SV_GroupIndex, uint groupId : SV_GroupID)
+{
+	StructuredBuffer<MeshInstance> instanceBuffer = ResourceDescriptorHeap[bindData.instanceBuffer];
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	StructuredBuffer<CullingView> cullingViewBuffer = ResourceDescriptorHeap[bindData.cullingViewBuffer];
+	RWStructuredBuffer<uint> nextVisibilityBuffer = ResourceDescriptorHeap[bindData.nextVisibilityBuffer];
+	CullingView view = cullingViewBuffer[bindData.cameraIndex];
+
+#ifndef WAVE_SIZE
+	if (groupIndex < 2)
+		visibilityWords[groupIndex] = 0;
+
+	GroupMemoryBarrierWithGroupSync();
+#endif
+
+	bool visible = false;
+	uint index = dispatchId.x;
+	if (index < bindData.instanceCount)
 	{
-		uint objectId = inputBuffer[index].batchId;  // #TODO: Sufficient for now, won't work with instancing.
-		ObjectData object = objectBuffer[objectId];
-		if (IsVisible(object, camera))
+		MeshInstance instance = instanceBuffer[index];
+		ObjectData object = objectBuffer[instance.objectId];
+		TransformData transform = LoadTransform(bindData.transformBuffer, object);
+
+		ObjectBounds bounds;
+		visible = IsInFrustum(object, transform, view, bounds) || bindData.cullingLevel == 0;
+		if (bindData.cullingLevel > 1)
 		{
-			outputBuffer.Append(inputBuffer[index]);
+			visible = visible && !IsOccluded(bounds, view);
+
+			// Instances visible last frame were already drawn in the early phase.
+			if (visible && !WasVisible(index) && !DrawImpostor(object, instance, transform, view))
+			{
+				AppendInstance(instance, 0, SelectLod(instance, transform, bounds, view));
+			}
 		}
 	}
-}
\ No newline at end of file
+
+#ifdef WAVE_SIZE
+	// Lanes of the one dimensional group run consecutive instances, so the wave's ballot is already its one or two words
+	// of visibility, without groupshared atomics or barriers. Waves own whole words, same as groups below.
+	const uint4 ballot = WaveActiveBallot(visible);
+	const uint lane = WaveGetLaneIndex();
+	const uint word = (index - lane) / 32 + lane;
+	if (lane < WAVE_SIZE / 32 && word * 32 < bindData.instanceCount)
+	{
+		nextVisibilityBuffer[word] = ballot[lane];
+	}
+#else
+	if (visible)
+	{
+		InterlockedOr(visibilityWords[groupIndex / 32], 1u << (groupIndex % 32));
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	// Each group owns two whole words, so they can be written without clearing the buffer first.
+	if (groupIndex < 2 && groupId * 64 + groupIndex * 32 < bindData.instanceCount)
+	{
+		nextVisibilityBuffer[groupId * 2 + groupIndex] = visibilityWords[groupIndex];
+	}
+#endif
+}
@@ -0,0 +1,136 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#ifndef __MESHSHADING_HLSLI__
+#define __MESHSHADING_HLSLI__
+
+#include "RootSignature.hlsli"
+#include "Object.hlsli"
+#include "Meshlet.hlsli"
+
+// Amplification groups test this many meshlets of a single instance, launching a mesh group for each visible one.
+static const uint meshletGroupSize = 64;
+static const uint meshletMaxVertices = 64;
+static const uint meshletMaxTriangles = 124;
+
+static const uint meshletDrawRequireVisible = 1 << 0;  // Only draw instances set in the draw visibility bits.
+static const uint meshletDrawExcludeVisible = 1 << 1;  // Skip instances set in the skip visibility bits.
+static const uint meshletDrawCull = 1 << 2;  // Frustum and backface cull meshlets.
+static const uint meshletDrawOcclusion = 1 << 3;  // Occlusion cull meshlets against the Hi-Z.
+
+struct MeshletDrawData
+{
+	uint meshletBuffer;
+	uint meshletVertexBuffer;
+	uint meshletTriangleBuffer;
+	uint meshInstanceBuffer;
+	uint drawVisibilityBuffer;
+	uint skipVisibilityBuffer;
+	uint flags;
+	uint hiZTexture;
+	uint hiZMipLevels;
+	uint instanceCount;
+	uint instanceRowSize;  // Instances per row of groups, large scenes exceed the dispatch size limit.
+	uint instanceOffset;  // First instance of the dispatch, large scenes are split over multiple dispatches.
+	uint cullCameraIndex;  // Differs from the drawing camera when the camera is frozen.
+	uint cullingViewBuffer;
+	uint transformBuffer;
+	float padding;
+};
+
+struct MeshInstance
+{
+	uint objectId;
+	uint batch;
+};
+
+struct MeshletPayload
+{
+	uint objectId;
+	uint meshlets[meshletGroupSize];
+};
+
+groupshared MeshletPayload meshletPayload;
+groupshared uint payloadCount;
+
+bool IsInstanceVisible(uint visibilityBuffer, uint index)
+{
+	StructuredBuffer<uint> visibility = ResourceDescriptorHeap[visibilityBuffer];
+	return (visibility[index / 32] & (1u << (index % 32))) != 0;
+}
+
+// Amplification stage of the meshlet draws, must be called from a meshletGroupSize thread group. Group x is the chunk of
+// meshlets, groups y and z are the instance.
+void AmplifyMeshlets(MeshletDrawData data, uint objectBuffer, uint3 groupId, uint groupIndex)
+{
+	StructuredBuffer<CullingView> cullingViews = ResourceDescriptorHeap[data.cullingViewBuffer];
+	CullingView view = cullingViews[data.cullCameraIndex];
+
+	if (groupIndex == 0)
+		payloadCount = 0;
+
+	GroupMemoryBarrierWithGroupSync();
+
+	uint index = data.instanceOffset + groupId.z * data.instanceRowSize + groupId.y;
+	bool visible = index < data.instanceCount;
+	if (visible && (data.flags & meshletDrawRequireVisible))
+		visible = IsInstanceVisible(data.drawVisibilityBuffer, index);
+	if (visible && (data.flags & meshletDrawExcludeVisible))
+		visible = !IsInstanceVisible(data.skipVisibilityBuffer, index);
+
+	if (visible)
+	{
+		StructuredBuffer<MeshInstance> instanceBuffer = ResourceDescriptorHeap[data.meshInstanceBuffer];
+		StructuredBuffer<ObjectData> objects = ResourceDescriptorHeap[objectBuffer];
+		const uint objectId = instanceBuffer[index].objectId;
+		ObjectData object = objects[objectId];
+		TransformData transform = LoadTransform(data.transformBuffer, object);
+
+		if (groupIndex == 0)
+			meshletPayload.objectId = objectId;
+
+		const uint localMeshlet = groupId.x * meshletGroupSize + groupIndex;
+		if (localMeshlet < object.meshletCount)
+		{
+			const uint meshletIndex = object.meshletOffset + localMeshlet;
+			bool meshletVisible = true;
+			if (data.flags & meshletDrawCull)
+			{
+				StructuredBuffer<Meshlet> meshlets = ResourceDescriptorHeap[data.meshletBuffer];
+				meshletVisible = IsMeshletVisible(meshlets[meshletIndex], transform, view, data.flags & meshletDrawOcclusion, data.hiZTexture, data.hiZMipLevels);
+			}
+
+			if (meshletVisible)
+			{
+				uint slot;
+				InterlockedAdd(payloadCount, 1, slot);
+				meshletPayload.meshlets[slot] = meshletIndex;
+			}
+		}
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	DispatchMesh(payloadCount, 1, 1, meshletPayload);
+}
+
+Meshlet LoadMeshlet(MeshletDrawData data, uint meshletIndex)
+{
+	StructuredBuffer<Meshlet> meshlets = ResourceDescriptorHeap[data.meshletBuffer];
+	return meshlets[meshletIndex];
+}
+
+// Vertex ID of a meshlet vertex, for the vertex assembly.
+uint LoadMeshletVertex(MeshletDrawData data, Meshlet meshlet, uint vertex)
+{
+	StructuredBuffer<uint> vertices = ResourceDescriptorHeap[data.meshletVertexBuffer];
+	return vertices[meshlet.vertexOffset + vertex];
+}
+
+uint3 LoadMeshletTriangle(MeshletDrawData data, Meshlet meshlet, uint triangle)
+{
+	StructuredBuffer<uint> triangles = ResourceDescriptorHeap[data.meshletTriangleBuffer];
+	const uint packed = triangles[meshlet.triangleOffset + triangle];
+	return uint3(packed & 0xFF, (packed >> 8) & 0xFF, (packed >> 16) & 0xFF);
+}
+
+#endif  // __MESHSHADING_HLSLI__
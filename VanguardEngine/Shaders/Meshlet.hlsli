@@ -0,0 +1,40 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#ifndef __MESHLET_HLSLI__
+#define __MESHLET_HLSLI__
+
+#include "Object.hlsli"
+#include "Culling.hlsli"
+
+struct Meshlet
+{
+	float3 center;
+	float radius;
+	float3 coneApex;
+	float coneCutoff;
+	float3 coneAxis;
+	uint indexOffset;
+	uint indexCount;
+	uint vertexOffset;
+	uint vertexCount;
+	uint triangleOffset;
+};
+
+bool IsMeshletVisible(Meshlet meshlet, TransformData transform, CullingView view, bool occlusion, uint hiZTexture, uint hiZMipLevels)
+{
+	float3 center = mul(float4(meshlet.center, 1.f), transform.worldMatrix).xyz;
+	float radius = meshlet.radius * GetMaxScale(transform.worldMatrix);
+
+	// Backface culling, the cone is only approximate under non-uniform scaling.
+	float3 coneApex = mul(float4(meshlet.coneApex, 1.f), transform.worldMatrix).xyz;
+	float3 coneAxis = normalize(mul(float4(meshlet.coneAxis, 0.f), transform.worldMatrix).xyz);
+	if (dot(normalize(coneApex - view.position.xyz), coneAxis) >= meshlet.coneCutoff)
+		return false;
+
+	if (!IsSphereInFrustum(center, radius, view))
+		return false;
+
+	return !occlusion || !IsSphereOccluded(center, radius, view, hiZTexture, hiZMipLevels);
+}
+
+#endif  // __MESHLET_HLSLI__
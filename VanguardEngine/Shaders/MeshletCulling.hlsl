@@ -0,0 +1,125 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Object.hlsli"
+#include "Meshlet.hlsli"
+
+struct BindData
+{
+	uint meshletBuffer;
+	uint instanceBuffer;
+	uint objectBuffer;
+	uint transformBuffer;
+	uint cullingViewBuffer;
+	uint cameraIndex;
+	uint visibilityBuffer;  // This frame's instance visibility bits.
+	uint outputBuffer;
+	uint visibleInstanceBuffer;
+	uint instanceCount;
+	uint cullingLevel;
+	uint hiZTexture;
+	uint hiZMipLevels;
+	uint instanceRowSize;  // Instances per row of groups, large scenes exceed the dispatch size limit.
+	uint batchArgumentBuffer;  // Source of each batch's index view.
+	uint bucketBuffer;
+	uint bucketCountBuffer;  // Meshlet draws of each material bucket.
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+struct MeshIndirectArgument
+{
+	uint2 indexBufferLocation;
+	uint indexBufferSize;
+	uint indexBufferFormat;
+	uint batchId;  // Offset of the meshlet's instance in the visible instance list.
+	uint indexCountPerInstance;
+	uint instanceCount;
+	uint startIndexLocation;
+	int baseVertexLocation;
+	uint startInstanceLocation;
+	uint bucket;
+	uint lodLevel;
+	uint lodCount;
+	float lodError;
+};
+
+struct MeshInstance
+{
+	uint objectId;
+	uint batch;
+};
+
+struct MaterialBucket
+{
+	uint batchOffset;
+	uint batchCount;
+	uint meshletDrawOffset;
+	uint meshletDrawCount;
+};
+
+// One group per instance, expands the visible instances into one draw per visible meshlet. Draws are written into the
+// region of their batch's material bucket, so the forward pass can draw each bucket with its own pipeline.
+[RootSignature(RS)]
+[numthreads(64, 1, 1)]
+void Main(uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex)
+{
+	StructuredBuffer<Meshlet> meshletBuffer = ResourceDescriptorHeap[bindData.meshletBuffer];
+	StructuredBuffer<MeshInstance> instanceBuffer = ResourceDescriptorHeap[bindData.instanceBuffer];
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	StructuredBuffer<CullingView> cullingViewBuffer = ResourceDescriptorHeap[bindData.cullingViewBuffer];
+	StructuredBuffer<uint> visibilityBuffer = ResourceDescriptorHeap[bindData.visibilityBuffer];
+	RWStructuredBuffer<MeshIndirectArgument> outputBuffer = ResourceDescriptorHeap[bindData.outputBuffer];
+	RWStructuredBuffer<uint> visibleInstanceBuffer = ResourceDescriptorHeap[bindData.visibleInstanceBuffer];
+	StructuredBuffer<MeshIndirectArgument> batchArgumentBuffer = ResourceDescriptorHeap[bindData.batchArgumentBuffer];
+	StructuredBuffer<MaterialBucket> bucketBuffer = ResourceDescriptorHeap[bindData.bucketBuffer];
+	RWStructuredBuffer<uint> bucketCountBuffer = ResourceDescriptorHeap[bindData.bucketCountBuffer];
+	CullingView view = cullingViewBuffer[bindData.cameraIndex];
+
+	uint index = groupId.y * bindData.instanceRowSize + groupId.x;
+	if (index >= bindData.instanceCount)
+		return;
+
+	// Instances culled by mesh culling have no visible meshlets.
+	if ((visibilityBuffer[index / 32] & (1u << (index % 32))) == 0)
+		return;
+
+	MeshInstance instance = instanceBuffer[index];
+	ObjectData object = objectBuffer[instance.objectId];
+	TransformData transform = LoadTransform(bindData.transformBuffer, object);
+	MeshIndirectArgument batchArgument = batchArgumentBuffer[instance.batch];
+	MaterialBucket bucket = bucketBuffer[batchArgument.bucket];
+
+	for (uint i = groupIndex; i < object.meshletCount; i += 64)
+	{
+		Meshlet meshlet = meshletBuffer[object.meshletOffset + i];
+
+		if (IsMeshletVisible(meshlet, transform, view, bindData.cullingLevel >= 2, bindData.hiZTexture, bindData.hiZMipLevels))
+		{
+			uint slot;
+			InterlockedAdd(bucketCountBuffer[batchArgument.bucket], 1, slot);
+			if (slot < bucket.meshletDrawCount)
+			{
+				slot += bucket.meshletDrawOffset;
+
+				MeshIndirectArgument argument;
+				argument.indexBufferLocation = batchArgument.indexBufferLocation;
+				argument.indexBufferSize = batchArgument.indexBufferSize;
+				argument.indexBufferFormat = batchArgument.indexBufferFormat;
+				argument.batchId = slot;
+				argument.indexCountPerInstance = meshlet.indexCount;
+				argument.instanceCount = 1;
+				argument.startIndexLocation = meshlet.indexOffset;  // Relative to the subset's index view.
+				argument.baseVertexLocation = 0;
+				argument.startInstanceLocation = slot;  // Fetches the argument's own batch offset.
+				argument.bucket = batchArgument.bucket;
+				argument.lodLevel = 0;  // Meshlets are only built for the full detail level.
+				argument.lodCount = 1;
+				argument.lodError = 0.f;
+
+				outputBuffer[slot] = argument;
+				visibleInstanceBuffer[slot] = instance.objectId;
+			}
+		}
+	}
+}
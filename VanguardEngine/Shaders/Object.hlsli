@@ -7,13 +7,48 @@
 
 #pragma pack_matrix(row_major)
 
-struct ObjectData
+// Transform of a mesh entity, shared by the objects of all of its subsets.
+struct TransformData
 {
 	matrix worldMatrix;
+	matrix lastFrameWorldMatrix;
+};
+
+// A single subset of a mesh entity.
+struct ObjectData
+{
 	VertexMetadata vertexMetadata;
+	uint transformIndex;
 	uint materialIndex;
-	float boundingSphereRadius;
-	float2 padding;
+	float boundingSphereRadius;  // Object space.
+	uint meshletOffset;
+	uint meshletCount;
+	uint batchIndex;
+	uint indexOffset;  // In bytes.
+	uint indexSize;
+	float3 boundingSphereCenter;  // Object space.
+	float3 boundsCenter;  // Object space box.
+	float3 boundsExtents;
+	uint impostorIndex;  // Impostor record plus one, zero without one. The subset drawing the quad is flagged, see Impostors.hlsli.
 };
 
+TransformData LoadTransform(uint transformBuffer, ObjectData object)
+{
+	StructuredBuffer<TransformData> transforms = ResourceDescriptorHeap[transformBuffer];
+	return transforms[object.transformIndex];
+}
+
+// Largest scale of the matrix's axes, for scaling object space distances.
+float GetMaxScale(matrix worldMatrix)
+{
+	return sqrt(max(max(dot(worldMatrix[0].xyz, worldMatrix[0].xyz), dot(worldMatrix[1].xyz, worldMatrix[1].xyz)), dot(worldMatrix[2].xyz, worldMatrix[2].xyz)));
+}
+
+// Instanced mesh draws index objects through the visible instance list written by mesh culling.
+uint LoadObjectId(uint instanceBuffer, uint batchOffset, uint instanceId)
+{
+	StructuredBuffer<uint> instances = ResourceDescriptorHeap[instanceBuffer];
+	return instances[batchOffset + instanceId];
+}
+
 #endif  // __OBJECT_HLSLI__
\ No newline at end of file
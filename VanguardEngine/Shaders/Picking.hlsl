@@ -0,0 +1,26 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+
+struct BindData
+{
+	uint objectIdTexture;  // Object offset by one in the first channel, zero is empty.
+	uint outputBuffer;
+	uint2 pixel;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+// Copies the object ID under a single pixel into a buffer, which is then read back.
+[RootSignature(RS)]
+[numthreads(1, 1, 1)]
+void Main()
+{
+	Texture2D<uint> objectIdTexture = ResourceDescriptorHeap[bindData.objectIdTexture];
+	RWStructuredBuffer<uint> outputBuffer = ResourceDescriptorHeap[bindData.outputBuffer];
+
+	uint2 size;
+	objectIdTexture.GetDimensions(size.x, size.y);
+
+	outputBuffer[0] = all(bindData.pixel < size) ? objectIdTexture[bindData.pixel] : 0;
+}
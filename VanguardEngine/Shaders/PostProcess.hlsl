@@ -2,47 +2,57 @@
 
 #include "RootSignature.hlsli"
 #include "ToneMapping.hlsli"
+#include "Color.hlsli"
+#include "Bloom/Filter.hlsli"
 
 struct BindData
 {
-	uint mainOutput;
+	uint hdrTexture;
+	uint bloomTexture;
+	uint outputTexture;
+	float bloomIntensity;
+	// Boundary
+	float bloomInternalBlend;
 	float3 padding;
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
 
-struct VSInput
+// Composites bloom, tone maps and encodes the result in one pass, so the HDR target is only read once and never
+// written back. The final bloom upsample into mip 0 is fused in as well, mip 1 is filtered at the output pixel directly.
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void Main(uint3 dispatchId : SV_DispatchThreadID)
 {
-	uint vertexID : SV_VertexID;
-};
+	Texture2D<float4> hdrTexture = ResourceDescriptorHeap[bindData.hdrTexture];
+	Texture2D<float3> bloomTexture = ResourceDescriptorHeap[bindData.bloomTexture];
+	RWTexture2D<float4> outputTexture = ResourceDescriptorHeap[bindData.outputTexture];
 
-struct PSInput
-{
-	float4 positionCS : SV_POSITION;
-	float2 uv : UV;
-};
+	float2 outputDimensions;
+	outputTexture.GetDimensions(outputDimensions.x, outputDimensions.y);
 
-[RootSignature(RS)]
-PSInput VSMain(VSInput input)
-{
-	PSInput output;
-	output.uv = float2((input.vertexID << 1) & 2, input.vertexID & 2);
-	output.positionCS = float4((output.uv.x - 0.5) * 2.0, -(output.uv.y - 0.5) * 2.0, 0, 1);
+	if (any(dispatchId.xy >= (uint2)outputDimensions))
+	{
+		return;
+	}
 
-	return output;
-}
+	float2 bloomDimensions;
+	float bloomLevels;
+	bloomTexture.GetDimensions(0, bloomDimensions.x, bloomDimensions.y, bloomLevels);
+
+	const float2 center = (dispatchId.xy + 0.5f) / outputDimensions;
+
+	const float3 bloomBase = FilteredSample(bloomTexture, 0, center, 1.f / outputDimensions);
+	const float3 bloomUpsample = FilteredSample(bloomTexture, 1, center, 1.f / bloomDimensions);
+	const float3 bloom = lerp(bloomBase, bloomUpsample, bindData.bloomInternalBlend);
+
+	float3 color = hdrTexture[dispatchId.xy].rgb;
+	color = lerp(color, bloom, bindData.bloomIntensity);
 
-[RootSignature(RS)]
-float4 PSMain(PSInput input) : SV_Target
-{
-	Texture2D<float4> mainOutput = ResourceDescriptorHeap[bindData.mainOutput];
-	const float4 mainOutputHDR = mainOutput.Sample(bilinearWrap, input.uv);
-	
 #ifdef ENABLE_TONEMAPPING
-	const float3 toneMapped = ToneMap(mainOutputHDR.rgb);
-#else
-    const float3 toneMapped = mainOutputHDR.rgb;
+	color = ToneMap(color);
 #endif
 
-	return float4(toneMapped, 1.f);
+	// The output is sRGB, but typed UAV stores can't encode it.
+	outputTexture[dispatchId.xy] = float4(LinearToSRGB(saturate(color)), 1.f);
 }
\ No newline at end of file
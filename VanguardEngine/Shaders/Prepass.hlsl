@@ -4,14 +4,27 @@
 #include "VertexAssembly.hlsli"
 #include "Object.hlsli"
 #include "Camera.hlsli"
+#include "Material.hlsli"
+#include "Constants.hlsli"
+#include "MeshShading.hlsli"
+#include "VisibilityBuffer.hlsli"
+#include "Impostors.hlsli"
 
 struct BindData
 {
-	uint batchId;
+	uint instanceBuffer;
 	uint objectBuffer;
-	uint cameraBuffer;
+	uint cameraBuffer;  // Unread, the cameras are bound as a root descriptor.
 	uint cameraIndex;
 	uint vertexPositionBuffer;
+	uint vertexExtraBuffer;  // Alpha tested only.
+	uint materialBuffer;  // Alpha tested only.
+#ifdef IMPOSTOR
+	ImpostorDrawData impostorData;
+#else
+	MeshletDrawData meshletData;  // Mesh shader path only.
+#endif
+	uint transformBuffer;
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
@@ -20,31 +33,185 @@ struct Input
 {
 	uint vertexId : SV_VertexID;
 	uint instanceId : SV_InstanceID;
+	uint batchId : BATCH;  // Instance data of the draw, see MeshSystem::BindArguments().
 };
 
 struct Output
 {
 	float4 positionCS : SV_POSITION;  // Clip space.
+	float4 currentPositionCS : CURRENT_POSITION;  // Unjittered clip space, the system value is in pixels by the pixel shader.
+	float4 lastPositionCS : LAST_POSITION;  // Last frame's clip space.
+	nointerpolation uint objectId : OBJECT;
+#ifdef ALPHA_TEST
+	float2 uv : UV;
+#endif
 };
 
-[RootSignature(RS)]
+Output TransformVertex(VertexAssemblyData assemblyData, uint vertexId, TransformData transform, Camera camera, uint objectId)
+{
+	const float4 position = LoadVertexPosition(assemblyData, vertexId);
+
+	Output output;
+	output.positionCS = mul(mul(mul(position, transform.worldMatrix), camera.view), camera.projection);
+	output.currentPositionCS = output.positionCS;
+	output.currentPositionCS.xy -= camera.jitter * output.currentPositionCS.w;  // Last frame's projection is unjittered.
+	output.lastPositionCS = mul(mul(mul(position, transform.lastFrameWorldMatrix), camera.lastFrameView), camera.lastFrameProjection);
+	output.objectId = objectId;
+#ifdef ALPHA_TEST
+	output.uv = LoadVertexTexcoord(assemblyData, vertexId);
+#endif
+
+	return output;
+}
+
+[RootSignature(RS_CAMERA)]
 Output VSMain(Input input)
 {
+	const uint objectId = LoadObjectId(bindData.instanceBuffer, input.batchId, input.instanceId);
 	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
-	ObjectData object = objectBuffer[bindData.batchId + input.instanceId];
-	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
-	Camera camera = cameraBuffer[bindData.cameraIndex];
+	ObjectData object = objectBuffer[objectId];
+	Camera camera = frameCameras[bindData.cameraIndex];
 
 	VertexAssemblyData assemblyData;
 	assemblyData.positionBuffer = bindData.vertexPositionBuffer;
-	assemblyData.extraBuffer = 0;  // Unused.
+	assemblyData.extraBuffer = bindData.vertexExtraBuffer;
 	assemblyData.metadata = object.vertexMetadata;
 
-	Output output;
-	output.positionCS = LoadVertexPosition(assemblyData, input.vertexId);
-	output.positionCS = mul(output.positionCS, object.worldMatrix);
-	output.positionCS = mul(output.positionCS, camera.view);
-	output.positionCS = mul(output.positionCS, camera.projection);
+	return TransformVertex(assemblyData, input.vertexId, LoadTransform(bindData.transformBuffer, object), camera, objectId);
+}
+
+#ifndef IMPOSTOR
+[RootSignature(RS_CAMERA)]
+[numthreads(meshletGroupSize, 1, 1)]
+void ASMain(uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex)
+{
+	AmplifyMeshlets(bindData.meshletData, bindData.objectBuffer, groupId, groupIndex);
+}
+
+[RootSignature(RS_CAMERA)]
+[outputtopology("triangle")]
+[numthreads(128, 1, 1)]
+void MSMain(uint groupId : SV_GroupID, uint groupIndex : SV_GroupIndex, in payload MeshletPayload input, out vertices Output outputVertices[meshletMaxVertices], out indices uint3 outputTriangles[meshletMaxTriangles])
+{
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	ObjectData object = objectBuffer[input.objectId];
+	TransformData transform = LoadTransform(bindData.transformBuffer, object);
+	Camera camera = frameCameras[bindData.cameraIndex];
+	Meshlet meshlet = LoadMeshlet(bindData.meshletData, input.meshlets[groupId]);
+	const uint triangleCount = meshlet.indexCount / 3;
+
+	SetMeshOutputCounts(meshlet.vertexCount, triangleCount);
+
+	if (groupIndex < meshlet.vertexCount)
+	{
+		VertexAssemblyData assemblyData;
+		assemblyData.positionBuffer = bindData.vertexPositionBuffer;
+		assemblyData.extraBuffer = bindData.vertexExtraBuffer;
+		assemblyData.metadata = object.vertexMetadata;
+
+		outputVertices[groupIndex] = TransformVertex(assemblyData, LoadMeshletVertex(bindData.meshletData, meshlet, groupIndex), transform, camera, input.objectId);
+	}
+
+	if (groupIndex < triangleCount)
+	{
+		outputTriangles[groupIndex] = LoadMeshletTriangle(bindData.meshletData, meshlet, groupIndex);
+	}
+}
+#endif
+
+struct PixelOutput
+{
+#ifdef VISIBILITY_BUFFER
+	uint2 visibility : SV_Target0;
+	float2 motion : SV_Target1;
+#else
+	float2 motion : SV_Target0;
+#endif
+#ifdef PICKING
+	uint objectId : SV_Target1;  // Same encoding as the visibility buffer, which is picked from directly instead.
+#endif
+};
+
+// Screen space motion in UV units, pointing from the unjittered position of this frame to the position of last frame.
+// Alpha tested variants discard here, so that the forward pass's equal depth test rejects the cut out pixels without a
+// discard of its own. Opaque variants never discard, keeping early depth testing.
+[RootSignature(RS_CAMERA)]
+PixelOutput PSMain(Output input, uint primitiveId : SV_PrimitiveID)
+{
+#ifdef ALPHA_TEST
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	MaterialData material = LoadMaterial(bindData.materialBuffer, objectBuffer[input.objectId].materialIndex);
+
+	if (HasMaterialTexture(materialFeatureBaseColor, material.baseColor))
+	{
+		Texture2D<float4> baseColorMap = ResourceDescriptorHeap[material.baseColor];
+		SamplerState materialSampler = SamplerDescriptorHeap[material.samplerIndex];
+		if (baseColorMap.Sample(materialSampler, input.uv).a < alphaTestThreshold)
+			discard;
+	}
+#endif
+
+	const float2 currentUv = ClipSpaceToUv(input.currentPositionCS / input.currentPositionCS.w);
+	const float2 lastUv = ClipSpaceToUv(input.lastPositionCS / input.lastPositionCS.w);
+
+	PixelOutput output;
+#ifdef VISIBILITY_BUFFER
+	output.visibility = EncodeVisibility(input.objectId, primitiveId);
+#endif
+#ifdef PICKING
+	output.objectId = EncodeVisibility(input.objectId, primitiveId).x;
+#endif
+	output.motion = lastUv - currentUv;
+
+	return output;
+}
+
+#ifdef IMPOSTOR
+// Instances of the impostor list are the objects of the entities' first subsets, each draws a single quad.
+[RootSignature(RS_CAMERA)]
+ImpostorVertex ImpostorVSMain(uint vertexId : SV_VertexID, uint instanceId : SV_InstanceID)
+{
+	const uint objectId = LoadObjectId(bindData.instanceBuffer, 0, instanceId);
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	ObjectData object = objectBuffer[objectId];
+	Camera camera = frameCameras[bindData.cameraIndex];
+
+	return CreateImpostorVertex(bindData.impostorData, object, LoadTransform(bindData.transformBuffer, object), camera, objectId, vertexId);
+}
+
+struct ImpostorPixelOutput
+{
+	float2 motion : SV_Target0;
+#ifdef PICKING
+	uint objectId : SV_Target1;
+#endif
+	float depth : SV_Depth;
+};
+
+// Writes the depth of the resolved surface, which the forward pass then matches.
+[RootSignature(RS_CAMERA)]
+ImpostorPixelOutput ImpostorPSMain(ImpostorVertex input)
+{
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	ObjectData object = objectBuffer[input.objectId];
+	TransformData transform = LoadTransform(bindData.transformBuffer, object);
+	Camera camera = frameCameras[bindData.cameraIndex];
+
+	const ImpostorSurface surface = ResolveImpostor(bindData.impostorData, object, transform, camera, input.position);
+	if (surface.coverage < alphaTestThreshold)
+		discard;
+
+	float4 currentPositionCS = mul(mul(float4(surface.position, 1.f), camera.view), camera.projection);
+	currentPositionCS.xy -= camera.jitter * currentPositionCS.w;
+	const float4 lastPositionCS = mul(mul(mul(float4(surface.objectPosition, 1.f), transform.lastFrameWorldMatrix), camera.lastFrameView), camera.lastFrameProjection);
+
+	ImpostorPixelOutput output;
+	output.motion = ClipSpaceToUv(lastPositionCS / lastPositionCS.w) - ClipSpaceToUv(currentPositionCS / currentPositionCS.w);
+#ifdef PICKING
+	output.objectId = EncodeVisibility(input.objectId, 0).x;
+#endif
+	output.depth = GetImpostorDepth(surface, camera);
 
 	return output;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
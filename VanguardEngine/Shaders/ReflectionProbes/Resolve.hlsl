@@ -0,0 +1,64 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Camera.hlsli"
+#include "CubeMap.hlsli"
+
+struct BindData
+{
+	uint cameraBuffer;
+	uint firstCameraIndex;  // Camera of the first face, the other faces follow.
+	uint colorTexture;  // Capture atlas.
+	uint depthTexture;
+	// Boundary
+	uint skyTexture;  // Atmosphere luminance cube.
+	uint outputTexture;
+	uint faceMask;  // Faces captured this frame.
+	uint tileSize;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+// Copies the faces rendered into the capture atlas into the probe's capture cube. Each texel is projected with its face's
+// camera instead of relying on the faces matching the cube layout, and texels without geometry are filled from the sky.
+
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void Main(uint3 dispatchId : SV_DispatchThreadID)
+{
+	if ((bindData.faceMask & (1u << dispatchId.z)) == 0)
+		return;
+
+	RWTexture2DArray<float4> outputTexture = ResourceDescriptorHeap[bindData.outputTexture];
+
+	uint width, height, elements;
+	outputTexture.GetDimensions(width, height, elements);
+	if (any(dispatchId.xy >= uint2(width, height)))
+		return;
+
+	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
+	Texture2D<float4> colorTexture = ResourceDescriptorHeap[bindData.colorTexture];
+	Texture2D<float> depthTexture = ResourceDescriptorHeap[bindData.depthTexture];
+	TextureCube<float4> skyTexture = ResourceDescriptorHeap[bindData.skyTexture];
+
+	float2 uv = (dispatchId.xy + 0.5f) / float2(width, height);
+	uv = uv * 2.f - 1.f;
+	const float3 direction = normalize(ComputeDirection(uv, dispatchId.z));
+
+	// The face's camera looks down the face's axis with a 90 degree field of view, so the direction lands within its tile.
+	const Camera camera = cameraBuffer[bindData.firstCameraIndex + dispatchId.z];
+	float4 clipSpace = mul(float4(mul(float4(direction, 0.f), camera.view).xyz, 1.f), camera.projection);
+	clipSpace /= clipSpace.w;
+
+	// Faces are laid out in a 3x2 grid.
+	const uint2 tile = uint2(dispatchId.z % 3, dispatchId.z / 3) * bindData.tileSize;
+	const uint2 pixel = tile + min((uint2)(ClipSpaceToUv(clipSpace) * bindData.tileSize), bindData.tileSize - 1);
+
+	float3 color = colorTexture[pixel].rgb;
+	if (depthTexture[pixel] <= 0.f)  // Inverse depth buffer, nothing was drawn.
+	{
+		color = skyTexture.SampleLevel(bilinearClamp, direction, 0).rgb;
+	}
+
+	outputTexture[dispatchId] = float4(color, 1.f);
+}
@@ -3,9 +3,23 @@
 #ifndef __ROOTSIGNATURE_HLSLI__
 #define __ROOTSIGNATURE_HLSLI__
 
+#define RS_FLAGS "RootFlags(CBV_SRV_UAV_HEAP_DIRECTLY_INDEXED | SAMPLER_HEAP_DIRECTLY_INDEXED),"
+
 #define RS \
-	"RootFlags(CBV_SRV_UAV_HEAP_DIRECTLY_INDEXED | SAMPLER_HEAP_DIRECTLY_INDEXED)," \
+	RS_FLAGS \
 	"RootConstants(b0, num32BitConstants = 64)," \
+	RS_SAMPLERS
+
+// Binds the camera buffer as a root descriptor, read through frameCameras. Draws read the camera in every vertex, a root
+// descriptor saves the dependent load of a descriptor from the heap. The descriptor takes two of the 64 root signature
+// DWORDs from the root constants, the bind data must fit in the rest.
+#define RS_CAMERA \
+	RS_FLAGS \
+	"RootConstants(b0, num32BitConstants = 62)," \
+	"SRV(t0, space = 1)," \
+	RS_SAMPLERS
+
+#define RS_SAMPLERS \
 	"StaticSampler(" \
 		"s0," \
 		"filter = FILTER_MIN_MAG_MIP_POINT," \
@@ -119,6 +133,17 @@
 		"minLOD = 0.f," \
 		"maxLOD = 100.f," \
 		"borderColor = STATIC_BORDER_COLOR_TRANSPARENT_BLACK," \
+		"visibility = SHADER_VISIBILITY_ALL)," \
+	"StaticSampler(" \
+		"s11," \
+		"filter = FILTER_COMPARISON_MIN_MAG_LINEAR_MIP_POINT," \
+		"addressU = TEXTURE_ADDRESS_CLAMP," \
+		"addressV = TEXTURE_ADDRESS_CLAMP," \
+		"addressW = TEXTURE_ADDRESS_CLAMP," \
+		"mipLODBias = 0.f," \
+		"minLOD = 0.f," \
+		"maxLOD = 100.f," \
+		"comparisonFunc = COMPARISON_GREATER_EQUAL," \
 		"visibility = SHADER_VISIBILITY_ALL)" \
 
 SamplerState pointClamp: register(s0);
@@ -133,5 +158,6 @@ SamplerState downsampleBorder : register(s8);  // Black border color, see: https
 
 SamplerState linearMipPointClampMinimum : register(s9);
 SamplerState linearMipPointTransparentBorder : register(s10);  // Border with alpha=0.
+SamplerComparisonState shadowComparison : register(s11);  // Inverse Z, passes when the reference is nearer or equal.
 
 #endif  // __ROOTSIGNATURE_HLSLI__
\ No newline at end of file
@@ -0,0 +1,167 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Object.hlsli"
+
+struct BindData
+{
+	uint objectBuffer;
+	uint batchRecordBuffer;
+	uint batchInstanceCountBuffer;
+	uint instanceBatchSlotBuffer;  // Position of each instance within its batch.
+	uint argumentBuffer;
+	uint instanceBuffer;
+	uint recordCount;  // Batch records, including free records.
+	uint slotCount;  // Instance slots, including free slots.
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+struct MeshIndirectArgument
+{
+	uint2 indexBufferLocation;
+	uint indexBufferSize;
+	uint indexBufferFormat;
+	uint batchId;  // Offset of the batch's first instance in the instance list.
+	uint indexCountPerInstance;
+	uint instanceCount;
+	uint startIndexLocation;
+	int baseVertexLocation;
+	uint startInstanceLocation;
+	uint bucket;
+	uint lodLevel;
+	uint lodCount;
+	float lodError;
+};
+
+// Arguments are laid out by material bucket, so a record's argument index differs from its record index.
+struct MeshBatchRecord
+{
+	MeshIndirectArgument argument;
+	uint argumentIndex;
+	uint padding;
+};
+
+struct MeshInstance
+{
+	uint objectId;
+	uint batch;
+};
+
+static const uint invalidBatch = 0xFFFFFFFF;  // Free instance slots and batch records.
+static const uint scanGroupSize = 1024;
+
+[RootSignature(RS)]
+[numthreads(64, 1, 1)]
+void ClearMain(uint dispatchId : SV_DispatchThreadID)
+{
+	RWStructuredBuffer<uint> batchInstanceCountBuffer = ResourceDescriptorHeap[bindData.batchInstanceCountBuffer];
+
+	if (dispatchId.x < bindData.recordCount)
+	{
+		batchInstanceCountBuffer[dispatchId.x] = 0;
+	}
+}
+
+[RootSignature(RS)]
+[numthreads(64, 1, 1)]
+void CountMain(uint dispatchId : SV_DispatchThreadID)
+{
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	RWStructuredBuffer<uint> batchInstanceCountBuffer = ResourceDescriptorHeap[bindData.batchInstanceCountBuffer];
+	RWStructuredBuffer<uint> instanceBatchSlotBuffer = ResourceDescriptorHeap[bindData.instanceBatchSlotBuffer];
+
+	uint index = dispatchId.x;
+	if (index < bindData.slotCount)
+	{
+		uint batch = objectBuffer[index].batchIndex;
+		if (batch != invalidBatch)
+		{
+			uint slot;
+			InterlockedAdd(batchInstanceCountBuffer[batch], 1, slot);
+			instanceBatchSlotBuffer[index] = slot;
+		}
+	}
+}
+
+groupshared uint scanTotals[scanGroupSize];
+
+// Single group exclusive prefix sum over the batch instance counts, each thread scans a contiguous chunk of records.
+[RootSignature(RS)]
+[numthreads(scanGroupSize, 1, 1)]
+void ScanMain(uint groupIndex : SV_GroupIndex)
+{
+	StructuredBuffer<MeshBatchRecord> batchRecordBuffer = ResourceDescriptorHeap[bindData.batchRecordBuffer];
+	RWStructuredBuffer<uint> batchInstanceCountBuffer = ResourceDescriptorHeap[bindData.batchInstanceCountBuffer];
+	RWStructuredBuffer<MeshIndirectArgument> argumentBuffer = ResourceDescriptorHeap[bindData.argumentBuffer];
+
+	uint chunkSize = (bindData.recordCount + scanGroupSize - 1) / scanGroupSize;
+	uint first = min(groupIndex * chunkSize, bindData.recordCount);
+	uint last = min(first + chunkSize, bindData.recordCount);
+
+	uint total = 0;
+	for (uint i = first; i < last; ++i)
+	{
+		total += batchInstanceCountBuffer[i];
+	}
+
+	scanTotals[groupIndex] = total;
+	GroupMemoryBarrierWithGroupSync();
+
+	for (uint offset = 1; offset < scanGroupSize; offset <<= 1)
+	{
+		uint value = groupIndex >= offset ? scanTotals[groupIndex - offset] : 0;
+		GroupMemoryBarrierWithGroupSync();
+		scanTotals[groupIndex] += value;
+		GroupMemoryBarrierWithGroupSync();
+	}
+
+	uint batchOffset = scanTotals[groupIndex] - total;
+	for (uint j = first; j < last; ++j)
+	{
+		MeshBatchRecord record = batchRecordBuffer[j];
+		if (record.argumentIndex == invalidBatch)
+			continue;  // Free records have no instances.
+
+		MeshIndirectArgument argument = record.argument;
+		argument.batchId = batchOffset;
+		argument.instanceCount = batchInstanceCountBuffer[j];
+		argument.startInstanceLocation = record.argumentIndex;  // Fetches the argument's own batch offset.
+		if (argument.lodLevel > 0)
+		{
+			// Levels of detail follow their batch's full detail record and share its instance range, culling gives each
+			// level its own copy of the range. Nothing draws them unculled.
+			argument.batchId -= batchInstanceCountBuffer[j - argument.lodLevel];
+		}
+
+		argumentBuffer[record.argumentIndex] = argument;
+
+		batchOffset += argument.instanceCount;
+	}
+}
+
+[RootSignature(RS)]
+[numthreads(64, 1, 1)]
+void ScatterMain(uint dispatchId : SV_DispatchThreadID)
+{
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	StructuredBuffer<MeshBatchRecord> batchRecordBuffer = ResourceDescriptorHeap[bindData.batchRecordBuffer];
+	RWStructuredBuffer<uint> instanceBatchSlotBuffer = ResourceDescriptorHeap[bindData.instanceBatchSlotBuffer];
+	RWStructuredBuffer<MeshIndirectArgument> argumentBuffer = ResourceDescriptorHeap[bindData.argumentBuffer];
+	RWStructuredBuffer<MeshInstance> instanceBuffer = ResourceDescriptorHeap[bindData.instanceBuffer];
+
+	uint index = dispatchId.x;
+	if (index < bindData.slotCount)
+	{
+		uint batch = objectBuffer[index].batchIndex;
+		if (batch != invalidBatch)
+		{
+			// Instances reference their batch's argument, not its record.
+			MeshInstance instance;
+			instance.objectId = index;
+			instance.batch = batchRecordBuffer[batch].argumentIndex;
+
+			instanceBuffer[argumentBuffer[instance.batch].batchId + instanceBatchSlotBuffer[index]] = instance;
+		}
+	}
+}
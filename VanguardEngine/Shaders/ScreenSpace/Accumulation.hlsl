@@ -0,0 +1,69 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+
+struct BindData
+{
+	uint currentTexture;
+	uint historyTexture;  // Zero if there's no history.
+	uint motionTexture;
+	uint outputTexture;
+	// Boundary
+	float historyWeight;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+// Blends the current frame's noisy screen space lighting into the reprojected history. The history is clamped to the range
+// of the current 3x3 neighborhood, which rejects disoccluded samples at the cost of some of the convergence.
+// Shared by ambient occlusion and reflections, single channel textures simply ignore the extra channels.
+
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void Main(uint3 dispatchId : SV_DispatchThreadID)
+{
+	Texture2D<float4> currentTexture = ResourceDescriptorHeap[bindData.currentTexture];
+	RWTexture2D<float4> outputTexture = ResourceDescriptorHeap[bindData.outputTexture];
+
+	uint width, height;
+	outputTexture.GetDimensions(width, height);
+	if (dispatchId.x >= width || dispatchId.y >= height)
+		return;
+
+	const int2 pixel = dispatchId.xy;
+	const int2 last = int2(width, height) - 1;
+
+	const float4 current = currentTexture[pixel];
+	float4 result = current;
+
+	if (bindData.historyTexture > 0)
+	{
+		Texture2D<float4> historyTexture = ResourceDescriptorHeap[bindData.historyTexture];
+		Texture2D<float2> motionTexture = ResourceDescriptorHeap[bindData.motionTexture];
+
+		float4 minValue = current;
+		float4 maxValue = current;
+
+		for (int y = -1; y <= 1; ++y)
+		{
+			for (int x = -1; x <= 1; ++x)
+			{
+				const float4 neighbor = currentTexture[clamp(pixel + int2(x, y), 0, last)];
+				minValue = min(minValue, neighbor);
+				maxValue = max(maxValue, neighbor);
+			}
+		}
+
+		const float2 uv = (pixel + 0.5) / float2(width, height);
+		const float2 historyUv = uv + motionTexture.SampleLevel(pointClamp, uv, 0);
+
+		if (all(historyUv >= 0.f) && all(historyUv <= 1.f))
+		{
+			const float4 history = clamp(historyTexture.SampleLevel(bilinearClamp, historyUv, 0), minValue, maxValue);
+
+			result = lerp(current, history, bindData.historyWeight);
+		}
+	}
+
+	outputTexture[pixel] = result;
+}
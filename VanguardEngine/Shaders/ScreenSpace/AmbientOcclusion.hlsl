@@ -0,0 +1,147 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Camera.hlsli"
+#include "Constants.hlsli"
+#include "ScreenSpace/Common.hlsli"
+
+struct BindData
+{
+	uint cameraBuffer;
+	uint cameraIndex;
+	uint depthTexture;
+	uint hiZTexture;
+	// Boundary
+	uint outputTexture;
+	float radius;  // View space, meters.
+	float power;
+	uint frame;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+// Ground truth based ambient occlusion, integrating the visible arc of the cosine weighted hemisphere between the two horizons
+// of a few screen space slices per pixel. The slices rotate every frame, the temporal accumulation converges them.
+// See: "Practical Realtime Strategies for Accurate Indirect Occlusion", Jimenez et al. 2016.
+// Horizon steps further from the pixel read coarser levels of the Hi-Z pyramid, as in XeGTAO's prefiltered depth. The
+// pyramid keeps the farthest depth of each texel, which underestimates occlusion rather than adding false occlusion.
+
+static const uint sliceCount = 2;
+static const uint stepCount = 6;  // Per side of each slice.
+static const float falloffRange = 0.4;  // Fraction of the radius over which samples fade out.
+
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void Main(uint3 dispatchId : SV_DispatchThreadID)
+{
+	RWTexture2D<float> outputTexture = ResourceDescriptorHeap[bindData.outputTexture];
+
+	uint width, height;
+	outputTexture.GetDimensions(width, height);
+	if (dispatchId.x >= width || dispatchId.y >= height)
+		return;
+
+	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
+	Camera camera = cameraBuffer[bindData.cameraIndex];
+	Texture2D<float> depthTexture = ResourceDescriptorHeap[bindData.depthTexture];
+	Texture2D<float> hiZTexture = ResourceDescriptorHeap[bindData.hiZTexture];
+
+	uint depthWidth, depthHeight;
+	depthTexture.GetDimensions(depthWidth, depthHeight);
+	uint hiZWidth, hiZHeight, hiZLevels;
+	hiZTexture.GetDimensions(0, hiZWidth, hiZHeight, hiZLevels);
+
+	const float2 depthResolution = float2(depthWidth, depthHeight);
+	const float2 uv = (dispatchId.xy + 0.5) / float2(width, height);
+	const float depth = depthTexture.SampleLevel(pointClamp, uv, 0);
+
+	if (depth <= 0.f)  // Inverse depth buffer, the sky is unoccluded.
+	{
+		outputTexture[dispatchId.xy] = 1.f;
+		return;
+	}
+
+	const float3 position = ReconstructViewPosition(camera, uv, depth);
+	const float3 normal = ReconstructViewNormal(camera, depthTexture, uv, 1.f / depthResolution, position);
+	const float3 viewDirection = normalize(-position);
+
+	// Project the radius into depth buffer pixels.
+	const float radiusPixels = bindData.radius * camera.projection[1][1] * 0.5f * depthHeight / -position.z;
+	if (radiusPixels < 1.f)
+	{
+		outputTexture[dispatchId.xy] = 1.f;
+		return;
+	}
+
+	// The pyramid is at most as large as the depth buffer, scale the step spacing into its texels.
+	const float hiZScale = (float)hiZWidth / depthWidth;
+	const float falloffScale = -1.f / (bindData.radius * falloffRange);
+	const float falloffBias = 1.f / falloffRange;
+
+	const float sliceNoise = InterleavedGradientNoise(dispatchId.xy, bindData.frame);
+	const float stepNoise = InterleavedGradientNoise(dispatchId.yx, bindData.frame);
+
+	float visibility = 0.f;
+
+	for (uint slice = 0; slice < sliceCount; ++slice)
+	{
+		const float angle = (slice + sliceNoise) * pi / sliceCount;
+		const float2 direction = float2(cos(angle), sin(angle));  // Screen space, y points down.
+		const float3 sliceDirection = float3(direction.x, -direction.y, 0.f);
+
+		const float3 orthoDirection = sliceDirection - dot(sliceDirection, viewDirection) * viewDirection;
+		const float3 axis = normalize(cross(orthoDirection, viewDirection));
+		const float3 projectedNormal = normal - axis * dot(normal, axis);
+		const float projectedLength = length(projectedNormal);
+
+		const float cosN = saturate(dot(projectedNormal, viewDirection) / max(projectedLength, 0.0001f));
+		const float n = sign(dot(orthoDirection, projectedNormal)) * acos(cosN);
+
+		// Start from the lowest horizons of the hemisphere around the projected normal.
+		const float lowHorizonCos0 = cos(n + pi * 0.5f);
+		const float lowHorizonCos1 = cos(n - pi * 0.5f);
+		float horizonCos0 = lowHorizonCos0;
+		float horizonCos1 = lowHorizonCos1;
+
+		for (uint step = 0; step < stepCount; ++step)
+		{
+			// Quadratic spacing, dense near the pixel where contact occlusion matters most.
+			float t = (step + stepNoise) / stepCount;
+			t *= t;
+
+			const float offsetPixels = max(t * radiusPixels, 1.f);
+			const float level = clamp(log2(offsetPixels * hiZScale) - 3.f, 0.f, hiZLevels - 1.f);
+			const float2 offsetUv = direction * offsetPixels / depthResolution;
+
+			const float2 sampleUv0 = uv + offsetUv;
+			const float2 sampleUv1 = uv - offsetUv;
+			const float3 delta0 = ReconstructViewPosition(camera, sampleUv0, hiZTexture.SampleLevel(pointClamp, sampleUv0, level)) - position;
+			const float3 delta1 = ReconstructViewPosition(camera, sampleUv1, hiZTexture.SampleLevel(pointClamp, sampleUv1, level)) - position;
+			const float distance0 = length(delta0);
+			const float distance1 = length(delta1);
+
+			// Samples past the radius fade to the lowest horizon, so distant geometry doesn't occlude.
+			const float weight0 = saturate(distance0 * falloffScale + falloffBias);
+			const float weight1 = saturate(distance1 * falloffScale + falloffBias);
+
+			horizonCos0 = max(horizonCos0, lerp(lowHorizonCos0, dot(delta0 / max(distance0, 0.0001f), viewDirection), weight0));
+			horizonCos1 = max(horizonCos1, lerp(lowHorizonCos1, dot(delta1 / max(distance1, 0.0001f), viewDirection), weight1));
+		}
+
+		// Clamp the horizons to the hemisphere, then integrate the cosine weighted arc between them.
+		float h0 = -acos(horizonCos1);
+		float h1 = acos(horizonCos0);
+		h0 = n + clamp(h0 - n, -pi * 0.5f, pi * 0.5f);
+		h1 = n + clamp(h1 - n, -pi * 0.5f, pi * 0.5f);
+
+		const float sinN = sin(n);
+		const float arc0 = (cosN + 2.f * h0 * sinN - cos(2.f * h0 - n)) * 0.25f;
+		const float arc1 = (cosN + 2.f * h1 * sinN - cos(2.f * h1 - n)) * 0.25f;
+
+		visibility += projectedLength * (arc0 + arc1);
+	}
+
+	visibility /= sliceCount;
+
+	outputTexture[dispatchId.xy] = pow(saturate(visibility), bindData.power);
+}
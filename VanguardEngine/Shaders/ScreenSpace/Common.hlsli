@@ -0,0 +1,45 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#ifndef __SCREENSPACE_COMMON_HLSLI__
+#define __SCREENSPACE_COMMON_HLSLI__
+
+#include "RootSignature.hlsli"
+#include "Camera.hlsli"
+
+float3 ReconstructViewPosition(Camera camera, float2 uv, float depth)
+{
+	float4 clipSpace = UvToClipSpace(uv);
+	clipSpace.z = depth;
+
+	return ClipToViewSpace(camera, clipSpace).xyz;
+}
+
+// There's no normal buffer, so normals are the geometric normals of the depth buffer. Differencing against the neighbor
+// closest in depth keeps the normals of edges from bleeding into the background.
+float3 ReconstructViewNormal(Camera camera, Texture2D<float> depthTexture, float2 uv, float2 texelSize, float3 center)
+{
+	const float2 leftUv = uv - float2(texelSize.x, 0.f);
+	const float2 rightUv = uv + float2(texelSize.x, 0.f);
+	const float2 upUv = uv - float2(0.f, texelSize.y);
+	const float2 downUv = uv + float2(0.f, texelSize.y);
+
+	const float3 left = ReconstructViewPosition(camera, leftUv, depthTexture.SampleLevel(pointClamp, leftUv, 0));
+	const float3 right = ReconstructViewPosition(camera, rightUv, depthTexture.SampleLevel(pointClamp, rightUv, 0));
+	const float3 up = ReconstructViewPosition(camera, upUv, depthTexture.SampleLevel(pointClamp, upUv, 0));
+	const float3 down = ReconstructViewPosition(camera, downUv, depthTexture.SampleLevel(pointClamp, downUv, 0));
+
+	const float3 dx = abs(right.z - center.z) < abs(center.z - left.z) ? right - center : center - left;
+	const float3 dy = abs(down.z - center.z) < abs(center.z - up.z) ? down - center : center - up;
+
+	return normalize(cross(dy, dx));
+}
+
+// See: "Next Generation Post Processing in Call of Duty: Advanced Warfare", Jimenez 2014.
+float InterleavedGradientNoise(float2 pixel, uint frame)
+{
+	pixel += (frame % 64) * 5.588238f;
+
+	return frac(52.9829189f * frac(dot(pixel, float2(0.06711056f, 0.00583715f))));
+}
+
+#endif  // __SCREENSPACE_COMMON_HLSLI__
@@ -0,0 +1,154 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Camera.hlsli"
+#include "ScreenSpace/Common.hlsli"
+
+struct BindData
+{
+	uint cameraBuffer;
+	uint cameraIndex;
+	uint depthTexture;
+	uint hiZTexture;
+	// Boundary
+	uint colorTexture;  // Resolved color of the last frame, zero without history.
+	uint motionTexture;
+	uint outputTexture;
+	uint maxSteps;
+	// Boundary
+	float maxDistance;  // View space, meters.
+	float thickness;  // View space, meters.
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+// Mirror reflections traced through the Hi-Z pyramid, shading hits with the last frame's resolved color. Misses and fading hits
+// leave the remainder to the IBL prefilter, the output is premultiplied by its confidence.
+// The pyramid keeps the farthest depth of each texel, so a ray passing behind it has certainly passed behind something in the
+// texel. The trace ascends levels while the ray stays in front, steps back down when it doesn't, and confirms hits against the
+// full resolution depth with a thickness, since a farthest depth pyramid alone can't bound the surface from the front.
+
+float ViewDepth(Camera camera, float depth)
+{
+	return LinearizeDepth(camera, depth) * camera.farPlane;
+}
+
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void Main(uint3 dispatchId : SV_DispatchThreadID)
+{
+	RWTexture2D<float4> outputTexture = ResourceDescriptorHeap[bindData.outputTexture];
+
+	uint width, height;
+	outputTexture.GetDimensions(width, height);
+	if (dispatchId.x >= width || dispatchId.y >= height)
+		return;
+
+	outputTexture[dispatchId.xy] = 0.xxxx;
+
+	if (bindData.colorTexture == 0)
+		return;
+
+	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
+	Camera camera = cameraBuffer[bindData.cameraIndex];
+	Texture2D<float> depthTexture = ResourceDescriptorHeap[bindData.depthTexture];
+	Texture2D<float> hiZTexture = ResourceDescriptorHeap[bindData.hiZTexture];
+	Texture2D<float4> colorTexture = ResourceDescriptorHeap[bindData.colorTexture];
+	Texture2D<float2> motionTexture = ResourceDescriptorHeap[bindData.motionTexture];
+
+	uint depthWidth, depthHeight;
+	depthTexture.GetDimensions(depthWidth, depthHeight);
+	uint hiZWidth, hiZHeight, hiZLevels;
+	hiZTexture.GetDimensions(0, hiZWidth, hiZHeight, hiZLevels);
+
+	const float2 uv = (dispatchId.xy + 0.5) / float2(width, height);
+	const float depth = depthTexture.SampleLevel(pointClamp, uv, 0);
+
+	if (depth <= 0.f)  // Inverse depth buffer.
+		return;
+
+	const float3 position = ReconstructViewPosition(camera, uv, depth);
+	const float3 normal = ReconstructViewNormal(camera, depthTexture, uv, 1.f / float2(depthWidth, depthHeight), position);
+	const float3 reflection = reflect(normalize(position), normal);
+
+	// Clip the ray at the near plane, rays towards the camera would otherwise project behind it.
+	float rayLength = bindData.maxDistance;
+	if (position.z + reflection.z * rayLength > -camera.nearPlane)
+	{
+		rayLength = (-camera.nearPlane - position.z) / reflection.z;
+	}
+
+	float4 startClip = mul(float4(position, 1.f), camera.projection);
+	float4 endClip = mul(float4(position + reflection * rayLength, 1.f), camera.projection);
+	startClip /= startClip.w;
+	endClip /= endClip.w;
+
+	// Depth is linear in screen space, so the ray is traced with a linear parameter over its screen space projection.
+	const float3 start = float3(ClipSpaceToUv(startClip), startClip.z);
+	const float3 delta = float3(ClipSpaceToUv(endClip), endClip.z) - start;
+
+	const float2 deltaTexels = delta.xy * float2(hiZWidth, hiZHeight);
+	const float texelStep = 1.f / max(max(abs(deltaTexels.x), abs(deltaTexels.y)), 0.0001f);  // Ray parameter of one level 0 texel.
+	const uint maxLevel = min(hiZLevels - 1, 6);
+
+	float lastT = 0.f;
+	float t = texelStep;  // Skip the starting texel, it contains the surface itself.
+	uint level = 0;
+	bool hit = false;
+	float3 rayPoint = start;
+
+	for (uint i = 0; i < bindData.maxSteps && t <= 1.f; ++i)
+	{
+		rayPoint = start + delta * t;
+		if (any(rayPoint.xy < 0.f) || any(rayPoint.xy > 1.f))
+			break;
+
+		if (level == 0)
+		{
+			const float sceneDepth = depthTexture.SampleLevel(pointClamp, rayPoint.xy, 0);
+			if (rayPoint.z < sceneDepth)  // Inverse depth buffer, the ray is behind the surface.
+			{
+				if (ViewDepth(camera, rayPoint.z) - ViewDepth(camera, sceneDepth) < bindData.thickness)
+				{
+					hit = true;
+					break;
+				}
+
+				// Passed behind a thin surface, keep going at full detail.
+				lastT = t;
+				t += texelStep;
+				continue;
+			}
+		}
+
+		else if (rayPoint.z < hiZTexture.SampleLevel(pointClamp, rayPoint.xy, level))
+		{
+			// Crossed behind something within this step, retrace it at a finer level.
+			t = lastT + texelStep * exp2(level - 1);
+			--level;
+			continue;
+		}
+
+		lastT = t;
+		t += texelStep * exp2(level);
+		level = min(level + 1, maxLevel);
+	}
+
+	if (!hit)
+		return;
+
+	// Shade the hit with the last frame's color at its reprojected position.
+	const float2 historyUv = rayPoint.xy + motionTexture.SampleLevel(pointClamp, rayPoint.xy, 0);
+	if (any(historyUv < 0.f) || any(historyUv > 1.f))
+		return;
+
+	const float3 color = colorTexture.SampleLevel(bilinearClamp, historyUv, 0).rgb;
+
+	// Fade out near the screen edges, at the end of the ray, and for rays facing the camera which mostly hit back faces.
+	const float2 edge = min(historyUv, 1.f - historyUv);
+	float confidence = saturate(min(edge.x, edge.y) * 10.f);
+	confidence *= 1.f - smoothstep(0.75f, 1.f, t);
+	confidence *= 1.f - saturate(reflection.z * 2.f);
+
+	outputTexture[dispatchId.xy] = float4(color * confidence, confidence);
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Color.hlsli"
+
+struct BindData
+{
+	uint historyTexture;  // Resolved color of the previous frame.
+	uint motionTexture;
+	uint outputTexture;
+	uint tileSize;  // Pixels per side of a shading rate image texel.
+	// Boundary
+	uint2 outputResolution;
+	float contrastThreshold;  // Tiles below it shade at 2x2, below a quarter of it at 4x4.
+	float motionScale;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+// D3D12_SHADING_RATE values.
+static const uint shadingRate1x1 = 0x0;
+static const uint shadingRate2x2 = 0x5;
+static const uint shadingRate4x4 = 0xA;
+
+groupshared uint tileContrast;
+groupshared uint tileMotion;
+
+// Contrast is measured after tonemapping, where steps in bright and dark regions compare as they're perceived.
+float TonemappedLuminance(float3 color)
+{
+	const float luminance = LinearToLuminance(color);
+	return luminance / (1.f + luminance);
+}
+
+// A group per tile, threads sample a grid spread over the tile.
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void Main(uint3 groupId : SV_GroupID, uint3 groupThreadId : SV_GroupThreadID, uint groupIndex : SV_GroupIndex)
+{
+	Texture2D<float4> historyTexture = ResourceDescriptorHeap[bindData.historyTexture];
+	Texture2D<float2> motionTexture = ResourceDescriptorHeap[bindData.motionTexture];
+	RWTexture2D<uint> outputTexture = ResourceDescriptorHeap[bindData.outputTexture];
+
+	if (groupIndex == 0)
+	{
+		tileContrast = 0;
+		tileMotion = 0;
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	const uint step = max(bindData.tileSize / 8, 1);
+	const uint2 pixel = min(groupId.xy * bindData.tileSize + groupThreadId.xy * step, bindData.outputResolution - 1);
+
+	// The tile shows what was at its reprojected position last frame.
+	const float2 motion = motionTexture[pixel] * bindData.outputResolution;
+	const int2 historyPixel = clamp(int2(pixel + 0.5f + motion), 0, int2(bindData.outputResolution) - 2);  // Room for the neighbors.
+
+	const float center = TonemappedLuminance(historyTexture[historyPixel].rgb);
+	const float right = TonemappedLuminance(historyTexture[historyPixel + int2(1, 0)].rgb);
+	const float down = TonemappedLuminance(historyTexture[historyPixel + int2(0, 1)].rgb);
+
+	// Positive floats order like their bits.
+	InterlockedMax(tileContrast, asuint(max(abs(center - right), abs(center - down))));
+	InterlockedMax(tileMotion, asuint(length(motion)));
+
+	GroupMemoryBarrierWithGroupSync();
+
+	if (groupIndex == 0)
+	{
+		const float contrast = asfloat(tileContrast) / (1.f + asfloat(tileMotion) / bindData.motionScale);
+
+		uint rate = shadingRate1x1;
+		if (contrast < bindData.contrastThreshold * 0.25f)
+			rate = shadingRate4x4;
+		else if (contrast < bindData.contrastThreshold)
+			rate = shadingRate2x2;
+
+		outputTexture[groupId.xy] = rate;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,162 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#ifndef __SHADOWS_HLSLI__
+#define __SHADOWS_HLSLI__
+
+#include "RootSignature.hlsli"
+#include "Camera.hlsli"
+
+static const uint maxShadowCascades = 4;
+static const uint firstCascadeCamera = 3;  // Matches CascadedShadows::firstCameraIndex, the other cascades follow.
+static const uint firstLocalShadowCamera = 14;  // Matches LocalShadows::firstCameraIndex, a camera per tile.
+static const uint localShadowTilesPerSide = 6;  // Matches LocalShadows::tilesPerSide.
+
+struct ShadowData
+{
+	uint shadowMap;  // Atlas of the cascades, in a 2x2 grid.
+	uint cascadeCount;  // Zero when shadows are disabled.
+	uint localShadowAtlas;  // Zero when the pass doesn't shade local lights.
+	float normalOffset;  // In shadow map texels.
+	float4 cascadeSplits;  // Far view space depth of each cascade.
+};
+
+// Fraction of the sun's light reaching the position, fully lit beyond the last cascade. View depth is positive.
+float CalculateCascadedShadow(ShadowData data, StructuredBuffer<Camera> cameraBuffer, float3 position, float3 normal, float viewDepth)
+{
+	if (data.cascadeCount == 0)
+		return 1.f;
+
+	uint cascade = 0;
+	[unroll]
+	for (uint i = 0; i < maxShadowCascades; ++i)
+	{
+		if (viewDepth > data.cascadeSplits[i])
+			cascade = i + 1;
+	}
+
+	if (cascade >= data.cascadeCount)
+		return 1.f;
+
+	Camera camera = cameraBuffer[firstCascadeCamera + cascade];
+	Texture2D<float> shadowMap = ResourceDescriptorHeap[data.shadowMap];
+
+	uint width, height;
+	shadowMap.GetDimensions(width, height);
+	const float tileSize = width * 0.5;
+	const float texel = 1.f / tileSize;
+
+	// Offset along the normal by the cascade's texel size in world space, avoids acne on surfaces at grazing angles.
+	const float texelWorldSize = 2.f / (camera.projection._m00 * tileSize);
+	position += normal * texelWorldSize * data.normalOffset;
+
+	const float4 positionCS = mul(mul(float4(position, 1.f), camera.view), camera.projection);  // Orthographic, w is 1.
+	float2 uv = ClipSpaceToUv(positionCS);
+	if (any(uv < 0.f) || any(uv > 1.f))
+		return 1.f;
+
+	// Keep the filter footprint inside of the cascade's tile.
+	uv = clamp(uv, 1.5f * texel, 1.f - 1.5f * texel);
+	const float2 atlasUv = (uv + float2(cascade % 2, cascade / 2)) * 0.5f;
+
+	// 3x3 PCF, each tap is bilinearly filtered by the comparison sampler.
+	float visibility = 0.f;
+	[unroll]
+	for (int y = -1; y <= 1; ++y)
+	{
+		[unroll]
+		for (int x = -1; x <= 1; ++x)
+		{
+			visibility += shadowMap.SampleCmpLevelZero(shadowComparison, atlasUv + float2(x, y) * texel * 0.5f, positionCS.z);
+		}
+	}
+
+	return visibility / 9.f;
+}
+
+// Fraction of a point or spot light's light reaching the position. The shadow index is the light's first tile plus one,
+// point lights own six consecutive tiles in cube face order.
+float CalculateLocalShadow(ShadowData data, StructuredBuffer<Camera> cameraBuffer, uint shadowIndex, bool cube, float3 lightPosition, float3 position, float3 normal)
+{
+	if (data.localShadowAtlas == 0)
+		return 1.f;
+
+	uint face = 0;
+	if (cube)
+	{
+		// Face of the major axis, in the order of ComputeDirection() in CubeMap.hlsli.
+		const float3 direction = position - lightPosition;
+		const float3 absDirection = abs(direction);
+		if (absDirection.x >= absDirection.y && absDirection.x >= absDirection.z)
+			face = direction.x >= 0.f ? 0 : 1;
+		else if (absDirection.y >= absDirection.z)
+			face = direction.y >= 0.f ? 2 : 3;
+		else
+			face = direction.z >= 0.f ? 4 : 5;
+	}
+
+	const uint tile = shadowIndex - 1 + face;
+	Camera camera = cameraBuffer[firstLocalShadowCamera + tile];
+	Texture2D<float> shadowMap = ResourceDescriptorHeap[data.localShadowAtlas];
+
+	uint width, height;
+	shadowMap.GetDimensions(width, height);
+	const float tileSize = (float)width / localShadowTilesPerSide;
+	const float texel = 1.f / tileSize;
+
+	// Perspective texels grow with the distance to the light, so does the normal offset.
+	const float lightDepth = -mul(float4(position, 1.f), camera.view).z;
+	const float texelWorldSize = 2.f * lightDepth / (camera.projection._m00 * tileSize);
+	position += normal * texelWorldSize * data.normalOffset;
+
+	float4 positionCS = mul(mul(float4(position, 1.f), camera.view), camera.projection);
+	positionCS.xyz /= positionCS.w;
+	float2 uv = ClipSpaceToUv(positionCS);
+	if (positionCS.w <= 0.f || any(uv < 0.f) || any(uv > 1.f))
+		return 1.f;
+
+	// Keep the filter footprint inside of the face's tile.
+	uv = clamp(uv, 1.5f * texel, 1.f - 1.5f * texel);
+	const float2 atlasUv = (uv + float2(tile % localShadowTilesPerSide, tile / localShadowTilesPerSide)) / localShadowTilesPerSide;
+	const float atlasTexel = texel / localShadowTilesPerSide;
+
+	float visibility = 0.f;
+	[unroll]
+	for (int y = -1; y <= 1; ++y)
+	{
+		[unroll]
+		for (int x = -1; x <= 1; ++x)
+		{
+			visibility += shadowMap.SampleCmpLevelZero(shadowComparison, atlasUv + float2(x, y) * atlasTexel * 0.5f, positionCS.z);
+		}
+	}
+
+	return visibility / 9.f;
+}
+
+static const float rayTracedShadowBias = 0.02f;  // Meters along the normal, clears the surface's own triangles.
+static const float rayTracedShadowDistance = 10000.f;
+
+// Fraction of the sun's light reaching the position, traced inline against the scene's acceleration structure. Hard
+// shadows, every hit is opaque.
+float CalculateRayTracedShadow(uint accelerationStructure, float3 position, float3 normal, float3 sunDirection)
+{
+	if (accelerationStructure == 0)
+		return 1.f;
+
+	RaytracingAccelerationStructure scene = ResourceDescriptorHeap[accelerationStructure];
+
+	RayDesc ray;
+	ray.Origin = position + normal * rayTracedShadowBias;
+	ray.Direction = sunDirection;
+	ray.TMin = 0.f;
+	ray.TMax = rayTracedShadowDistance;
+
+	// Any hit occludes, so the first one ends the search.
+	RayQuery<RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH | RAY_FLAG_SKIP_PROCEDURAL_PRIMITIVES | RAY_FLAG_FORCE_OPAQUE> query;
+	query.TraceRayInline(scene, RAY_FLAG_NONE, 0xFF, ray);
+	query.Proceed();
+
+	return query.CommittedStatus() == COMMITTED_TRIANGLE_HIT ? 0.f : 1.f;
+}
+
+#endif  // __SHADOWS_HLSLI__
\ No newline at end of file
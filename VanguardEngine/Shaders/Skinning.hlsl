@@ -0,0 +1,75 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+
+struct BindData
+{
+	uint positionBuffer;
+	uint extraBuffer;
+	uint skinBuffer;
+	uint jointBuffer;
+	uint sourcePositionOffset;  // Bytes, of the subset's first vertex.
+	uint sourceExtraOffset;
+	uint outputPositionOffset;
+	uint outputExtraOffset;
+	uint skinOffset;  // Subsets without influences are copied in the bind pose, ~0.
+	uint vertexCount;
+	uint firstJoint;  // Joint matrices of the entity's skin.
+	uint extraStride;
+	uint normalOffset;  // Within the interleaved extra vertex, missing attributes are ~0.
+	uint tangentOffset;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+static const uint missingAttribute = 0xFFFFFFFF;
+static const uint positionSize = 12;  // Skinned meshes store full precision positions.
+static const uint skinVertexSize = 16;
+
+[RootSignature(RS)]
+[numthreads(64, 1, 1)]
+void Main(uint3 dispatchId : SV_DispatchThreadID)
+{
+	const uint vertex = dispatchId.x;
+	if (vertex >= bindData.vertexCount)
+		return;
+
+	RWByteAddressBuffer positionBuffer = ResourceDescriptorHeap[bindData.positionBuffer];
+	RWByteAddressBuffer extraBuffer = ResourceDescriptorHeap[bindData.extraBuffer];
+	ByteAddressBuffer skinBuffer = ResourceDescriptorHeap[bindData.skinBuffer];
+	StructuredBuffer<matrix> jointBuffer = ResourceDescriptorHeap[bindData.jointBuffer];
+
+	matrix skinMatrix = matrix(1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f);
+	if (bindData.skinOffset != missingAttribute)
+	{
+		// Four 16 bit joint indices, followed by their 16 bit unorm weights.
+		const uint4 influences = skinBuffer.Load4(bindData.skinOffset + vertex * skinVertexSize);
+		const uint4 joints = uint4(influences.x & 0xFFFF, influences.x >> 16, influences.y & 0xFFFF, influences.y >> 16) + bindData.firstJoint;
+		const float4 weights = float4(influences.z & 0xFFFF, influences.z >> 16, influences.w & 0xFFFF, influences.w >> 16) / 65535.f;
+
+		skinMatrix = jointBuffer[joints.x] * weights.x + jointBuffer[joints.y] * weights.y + jointBuffer[joints.z] * weights.z + jointBuffer[joints.w] * weights.w;
+	}
+
+	const float3 position = asfloat(positionBuffer.Load3(bindData.sourcePositionOffset + vertex * positionSize));
+	positionBuffer.Store3(bindData.outputPositionOffset + vertex * positionSize, asuint(mul(float4(position, 1.f), skinMatrix).xyz));
+
+	// Copy the whole vertex along, then skin the normal and tangent in place. The bitangent sign stays.
+	const uint sourceExtra = bindData.sourceExtraOffset + vertex * bindData.extraStride;
+	const uint outputExtra = bindData.outputExtraOffset + vertex * bindData.extraStride;
+	for (uint i = 0; i < bindData.extraStride; i += 4)
+	{
+		extraBuffer.Store(outputExtra + i, extraBuffer.Load(sourceExtra + i));
+	}
+
+	if (bindData.normalOffset != missingAttribute)
+	{
+		const float3 normal = asfloat(extraBuffer.Load3(sourceExtra + bindData.normalOffset));
+		extraBuffer.Store3(outputExtra + bindData.normalOffset, asuint(normalize(mul(normal, (float3x3)skinMatrix))));
+	}
+
+	if (bindData.tangentOffset != missingAttribute)
+	{
+		const float3 tangent = asfloat(extraBuffer.Load3(sourceExtra + bindData.tangentOffset));
+		extraBuffer.Store3(outputExtra + bindData.tangentOffset, asuint(normalize(mul(tangent, (float3x3)skinMatrix))));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,126 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Camera.hlsli"
+#include "Color.hlsli"
+
+struct BindData
+{
+	uint cameraBuffer;
+	uint cameraIndex;
+	uint colorTexture;  // Jittered.
+	uint depthTexture;
+	// Boundary
+	uint historyTexture;  // Zero if there's no history.
+	uint outputTexture;
+	float historyWeight;
+	uint motionTexture;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+// Resolves the jittered samples of each frame into the reprojected history. The history is clamped to the color range of
+// the current frame's 3x3 neighborhood to reject disoccluded and changed samples.
+// See: "High Quality Temporal Supersampling", Karis 2014.
+
+// Blending in a tonemapped space keeps bright samples from dominating, which would otherwise flicker.
+float3 Tonemap(float3 color)
+{
+	return color * rcp(1.f + LinearToLuminance(color));
+}
+
+float3 InverseTonemap(float3 color)
+{
+	return color * rcp(max(1.f - LinearToLuminance(color), 0.0001f));
+}
+
+// Surfaces at infinity, such as the sky, only move with the camera's rotation.
+float2 ReprojectDirection(Camera camera, float2 uv)
+{
+	const float3 direction = ComputeRayDirection(camera, uv);
+
+	float4 lastClipSpace = mul(mul(float4(direction, 0.f), camera.lastFrameView), camera.lastFrameProjection);
+	lastClipSpace /= lastClipSpace.w;
+
+	return ClipSpaceToUv(lastClipSpace);
+}
+
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void Main(uint3 dispatchId : SV_DispatchThreadID)
+{
+	Texture2D<float4> colorTexture = ResourceDescriptorHeap[bindData.colorTexture];
+	Texture2D<float> depthTexture = ResourceDescriptorHeap[bindData.depthTexture];
+	RWTexture2D<float4> outputTexture = ResourceDescriptorHeap[bindData.outputTexture];
+
+	uint width, height;
+	outputTexture.GetDimensions(width, height);
+	if (dispatchId.x >= width || dispatchId.y >= height)
+		return;
+
+	const int2 pixel = dispatchId.xy;
+	const int2 last = int2(width, height) - 1;
+
+	const float3 color = Tonemap(colorTexture[pixel].rgb);
+	float3 minColor = color;
+	float3 maxColor = color;
+
+	// Reprojecting the closest surface keeps the edges of moving objects from picking up the background's history.
+	float closestDepth = depthTexture[pixel];
+	int2 closestPixel = pixel;
+
+	for (int y = -1; y <= 1; ++y)
+	{
+		for (int x = -1; x <= 1; ++x)
+		{
+			const int2 neighbor = clamp(pixel + int2(x, y), 0, last);
+			const float3 neighborColor = Tonemap(colorTexture[neighbor].rgb);
+			minColor = min(minColor, neighborColor);
+			maxColor = max(maxColor, neighborColor);
+
+			const float neighborDepth = depthTexture[neighbor];
+			if (neighborDepth > closestDepth)  // Inverse depth buffer.
+			{
+				closestDepth = neighborDepth;
+				closestPixel = neighbor;
+			}
+		}
+	}
+
+	float3 result = color;
+
+	if (bindData.historyTexture > 0)
+	{
+		StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
+		Camera camera = cameraBuffer[bindData.cameraIndex];
+
+		Texture2D<float4> historyTexture = ResourceDescriptorHeap[bindData.historyTexture];
+		Texture2D<float2> motionTexture = ResourceDescriptorHeap[bindData.motionTexture];
+
+		const float2 resolution = float2(width, height);
+		const float2 uv = (pixel + 0.5) / resolution;
+		const float2 closestUv = (closestPixel + 0.5) / resolution;
+
+		// Geometry has motion vectors from the prepass, which include object motion. The sky has none, so it's reprojected
+		// from the camera motion alone.
+		float2 motion = motionTexture[closestPixel];
+		if (closestDepth <= 0.f)  // Inverse depth buffer.
+		{
+			// The history is unjittered, so remove this frame's jitter from the sample's position before comparing.
+			const float2 jitterUv = camera.jitter * float2(0.5f, -0.5f);
+			motion = ReprojectDirection(camera, closestUv) - (closestUv - jitterUv);
+		}
+
+		const float2 historyUv = uv + motion;
+
+		if (all(historyUv >= 0.f) && all(historyUv <= 1.f))
+		{
+			float3 history = Tonemap(historyTexture.SampleLevel(bilinearClamp, historyUv, 0).rgb);
+			history = clamp(history, minColor, maxColor);
+
+			result = lerp(color, history, bindData.historyWeight);
+		}
+	}
+
+	outputTexture[pixel] = float4(InverseTonemap(result), 1.f);
+}
\ No newline at end of file
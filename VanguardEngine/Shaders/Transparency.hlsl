@@ -0,0 +1,43 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+
+struct BindData
+{
+	uint accumulationTexture;
+	uint revealageTexture;
+	uint outputTexture;
+	float padding;
+	// Boundary
+	uint2 outputResolution;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+// Resolves the weighted blended transparency over the opaque scene, the average weighted color covers the background by
+// one minus the revealage.
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void CompositeMain(uint3 dispatchId : SV_DispatchThreadID)
+{
+	if (any(dispatchId.xy >= bindData.outputResolution))
+		return;
+
+	Texture2D<float4> accumulationTexture = ResourceDescriptorHeap[bindData.accumulationTexture];
+	Texture2D<float> revealageTexture = ResourceDescriptorHeap[bindData.revealageTexture];
+	RWTexture2D<float4> outputTexture = ResourceDescriptorHeap[bindData.outputTexture];
+
+	const float revealage = revealageTexture[dispatchId.xy];
+	if (revealage >= 1.f)
+		return;  // No transparent surfaces.
+
+	float4 accumulation = accumulationTexture[dispatchId.xy];
+	// Half precision sums of many bright surfaces can overflow.
+	if (any(isinf(accumulation)))
+		accumulation = accumulation.aaaa;
+
+	const float3 average = accumulation.rgb / max(accumulation.a, 1e-5f);
+	float4 output = outputTexture[dispatchId.xy];
+	output.rgb = lerp(average, output.rgb, revealage);
+	outputTexture[dispatchId.xy] = output;
+}
\ No newline at end of file
@@ -5,25 +5,32 @@
 
 struct BindData
 {
-	uint mipBase;
-	uint mipCount;
-	float2 texelSize;
-	// Boundary
-	uint4 outputTextureIndices;
-	// Boundary
 	uint inputTextureIndex;
+	uint counterBuffer;  // Groups finished for each layer, reset by the last group.
+	uint mipCount;  // Including the source mip.
+	uint groupCount;  // Per layer.
+	// Boundary
+	float2 texelSize;  // Of mip 1.
 	uint sRGB;
 	uint resourceType;  // 0=2d, 1=2d array.
-	uint layer;
+	// Boundary
+	uint4 outputTextureIndices[4];  // Starting at mip 1.
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
 
+// Single pass downsampler, similar to AMD's FidelityFX SPD. Each group reduces a 64x64 tile of mip 1 down to a single
+// texel, seven mips in total. The last group of each layer then reduces those texels through the remaining mips.
+
+static const uint tileSize = 64;  // Texels along each axis of a group's tile, in the tile's first mip.
+static const uint tileMips = 7;
+
 // Separated channels to reduce bank conflicts.
-groupshared float groupRed[64];
-groupshared float groupGreen[64];
-groupshared float groupBlue[64];
-groupshared float groupAlpha[64];
+groupshared float groupRed[256];
+groupshared float groupGreen[256];
+groupshared float groupBlue[256];
+groupshared float groupAlpha[256];
+groupshared uint groupIsLast;
 
 void StoreGroupColor(uint index, float4 color)
 {
@@ -44,137 +51,222 @@ float4 SRGBAdjustedColor(float4 sample)
 	{
 		sample.rgb = LinearToSRGB(sample.rgb);
 	}
-	
+
+	return sample;
+}
+
+float4 LinearAdjustedColor(float4 sample)
+{
+	if (bindData.sRGB)
+	{
+		sample.rgb = SRGBToLinear(sample.rgb);
+	}
+
 	return sample;
 }
 
-void WriteMip(float4 source, uint2 xy, uint outputIndex)
+uint GetOutputIndex(uint mip)
 {
+	return bindData.outputTextureIndices[(mip - 1) / 4][(mip - 1) % 4];
+}
+
+void WriteMip(uint mip, uint2 xy, uint layer, float4 source)
+{
+	if (mip >= bindData.mipCount)
+	{
+		return;
+	}
+
+	// Coherent, the last group reads the final tile mip written by every other group.
 	switch (bindData.resourceType)
 	{
 		case 0:
 		{
-			RWTexture2D<float4> mip = ResourceDescriptorHeap[bindData.outputTextureIndices[outputIndex]];
-			mip[xy] = SRGBAdjustedColor(source);
+			globallycoherent RWTexture2D<float4> output = ResourceDescriptorHeap[GetOutputIndex(mip)];
+			output[xy] = SRGBAdjustedColor(source);
 			break;
 		}
 		case 1:
 		{
-			RWTexture2DArray<float4> mip = ResourceDescriptorHeap[bindData.outputTextureIndices[outputIndex]];
-			mip[uint3(xy, bindData.layer)] = SRGBAdjustedColor(source);
+			globallycoherent RWTexture2DArray<float4> output = ResourceDescriptorHeap[GetOutputIndex(mip)];
+			output[uint3(xy, layer)] = SRGBAdjustedColor(source);
 			break;
 		}
 	}
 }
 
-struct Input
+float4 ReadMip(uint mip, uint2 xy, uint layer)
 {
-	uint groupIndex : SV_GroupIndex;
-	uint3 dispatchId : SV_DispatchThreadID;
-};
+	float4 result = 0;
 
-[RootSignature(RS)]
-[numthreads(8, 8, 1)]
-void Main(Input input)
-{
-	float2 offset = bindData.texelSize * 0.5;
-	
-	float4 sourceSample;
-	
 	switch (bindData.resourceType)
 	{
 		case 0:
 		{
-			Texture2D<float4> inputTexture = ResourceDescriptorHeap[bindData.inputTextureIndex];
-			
-			float2 uv = bindData.texelSize * (input.dispatchId.xy + float2(0.25, 0.25));
-			
-			// Perform 4 samples to prevent undersampling non power of two textures.
-			sourceSample = inputTexture.SampleLevel(bilinearClamp, uv, bindData.mipBase);
-			sourceSample += inputTexture.SampleLevel(bilinearClamp, uv + float2(offset.x, 0.0), bindData.mipBase);
-			sourceSample += inputTexture.SampleLevel(bilinearClamp, uv + float2(0.0, offset.y), bindData.mipBase);
-			sourceSample += inputTexture.SampleLevel(bilinearClamp, uv + float2(offset.x, offset.y), bindData.mipBase);
+			globallycoherent RWTexture2D<float4> source = ResourceDescriptorHeap[GetOutputIndex(mip)];
+
+			uint2 size;
+			source.GetDimensions(size.x, size.y);
+			result = source[min(xy, size - 1)];
 			break;
 		}
 		case 1:
 		{
-			Texture2DArray<float4> inputTexture = ResourceDescriptorHeap[bindData.inputTextureIndex];
-			
-			float3 uv = float3(bindData.texelSize * (input.dispatchId.xy + float2(0.25, 0.25)), bindData.layer);
-
-			// Perform 4 samples to prevent undersampling non power of two textures.
-			sourceSample = inputTexture.SampleLevel(bilinearClamp, uv, bindData.mipBase);
-			sourceSample += inputTexture.SampleLevel(bilinearClamp, uv + float3(offset.x, 0.0, 0.0), bindData.mipBase);
-			sourceSample += inputTexture.SampleLevel(bilinearClamp, uv + float3(0.0, offset.y, 0.0), bindData.mipBase);
-			sourceSample += inputTexture.SampleLevel(bilinearClamp, uv + float3(offset.x, offset.y, 0.0), bindData.mipBase);
+			globallycoherent RWTexture2DArray<float4> source = ResourceDescriptorHeap[GetOutputIndex(mip)];
+
+			uint3 size;
+			source.GetDimensions(size.x, size.y, size.z);
+			result = source[uint3(min(xy, size.xy - 1), layer)];
 			break;
 		}
 	}
-	
-	sourceSample *= 0.25;
-	
-	WriteMip(sourceSample, input.dispatchId.xy, 0);
-	
-	if (bindData.mipCount == 1)
+
+	return LinearAdjustedColor(result);
+}
+
+float4 LoadFirstMip(uint2 xy, uint layer, uint firstMip)
+{
+	float4 sourceSample = 0;
+
+	if (firstMip == 1)
 	{
-		return;
+		const float2 offset = bindData.texelSize * 0.5;
+		const float2 uv = bindData.texelSize * (xy + float2(0.25, 0.25));
+
+		switch (bindData.resourceType)
+		{
+			case 0:
+			{
+				Texture2D<float4> inputTexture = ResourceDescriptorHeap[bindData.inputTextureIndex];
+
+				// Perform 4 samples to prevent undersampling non power of two textures.
+				sourceSample = inputTexture.SampleLevel(bilinearClamp, uv, 0);
+				sourceSample += inputTexture.SampleLevel(bilinearClamp, uv + float2(offset.x, 0.0), 0);
+				sourceSample += inputTexture.SampleLevel(bilinearClamp, uv + float2(0.0, offset.y), 0);
+				sourceSample += inputTexture.SampleLevel(bilinearClamp, uv + float2(offset.x, offset.y), 0);
+				break;
+			}
+			case 1:
+			{
+				Texture2DArray<float4> inputTexture = ResourceDescriptorHeap[bindData.inputTextureIndex];
+
+				// Perform 4 samples to prevent undersampling non power of two textures.
+				sourceSample = inputTexture.SampleLevel(bilinearClamp, float3(uv, layer), 0);
+				sourceSample += inputTexture.SampleLevel(bilinearClamp, float3(uv + float2(offset.x, 0.0), layer), 0);
+				sourceSample += inputTexture.SampleLevel(bilinearClamp, float3(uv + float2(0.0, offset.y), layer), 0);
+				sourceSample += inputTexture.SampleLevel(bilinearClamp, float3(uv + float2(offset.x, offset.y), layer), 0);
+				break;
+			}
+		}
 	}
-	
-	StoreGroupColor(input.groupIndex, sourceSample);
-	
-	GroupMemoryBarrierWithGroupSync();
-	
-	// X and Y are even.
-	if ((input.groupIndex & 0x9) == 0)
+
+	else
 	{
-		sourceSample += LoadGroupColor(input.groupIndex + 0x01);
-		sourceSample += LoadGroupColor(input.groupIndex + 0x08);
-		sourceSample += LoadGroupColor(input.groupIndex + 0x09);
-		
-		sourceSample *= 0.25;
+		// Clamped, so that texels past the edge of a non power of two mip don't pull in black.
+		const uint2 base = xy * 2;
+		sourceSample = ReadMip(firstMip - 1, base, layer);
+		sourceSample += ReadMip(firstMip - 1, base + uint2(1, 0), layer);
+		sourceSample += ReadMip(firstMip - 1, base + uint2(0, 1), layer);
+		sourceSample += ReadMip(firstMip - 1, base + uint2(1, 1), layer);
+	}
 
-		WriteMip(sourceSample, input.dispatchId.xy / 2, 1);
+	return sourceSample * 0.25;
+}
 
-		StoreGroupColor(input.groupIndex, sourceSample);
-	}
-	
-	if (bindData.mipCount == 2)
+void DownsampleTile(uint2 tile, uint layer, uint firstMip, uint groupIndex)
+{
+	const uint2 thread = uint2(groupIndex % 16, groupIndex / 16);
+	const uint2 origin = tile * tileSize + thread * 4;
+
+	// Each thread reduces a 4x4 block of the first mip, one quad at a time.
+	float4 color = 0;
+	for (uint i = 0; i < 4; ++i)
 	{
-		return;
+		const uint2 quadOrigin = origin + uint2(i % 2, i / 2) * 2;
+
+		float4 quad = 0;
+		for (uint j = 0; j < 4; ++j)
+		{
+			const uint2 xy = quadOrigin + uint2(j % 2, j / 2);
+			const float4 sourceSample = LoadFirstMip(xy, layer, firstMip);
+			WriteMip(firstMip, xy, layer, sourceSample);
+			quad += sourceSample;
+		}
+
+		quad *= 0.25;
+		WriteMip(firstMip + 1, quadOrigin / 2, layer, quad);
+		color += quad;
 	}
-	
-	GroupMemoryBarrierWithGroupSync();
-	
-	// X and Y are multiples of 4.
-	if ((input.groupIndex & 0x1B) == 0)
+
+	color *= 0.25;
+	WriteMip(firstMip + 2, origin / 4, layer, color);
+	StoreGroupColor(groupIndex, color);
+
+	// Halve the 16x16 texels in groupshared memory each step, down to the tile's single texel.
+	for (uint level = 1; level <= 4; ++level)
 	{
-		sourceSample += LoadGroupColor(input.groupIndex + 0x02);
-		sourceSample += LoadGroupColor(input.groupIndex + 0x10);
-		sourceSample += LoadGroupColor(input.groupIndex + 0x12);
-		
-		sourceSample *= 0.25;
-
-		WriteMip(sourceSample, input.dispatchId.xy / 4, 2);
-		
-		StoreGroupColor(input.groupIndex, sourceSample);
+		GroupMemoryBarrierWithGroupSync();
+
+		const uint size = 16 >> level;
+		const bool active = thread.x < size && thread.y < size;
+		if (active)
+		{
+			const uint base = thread.y * 2 * 16 + thread.x * 2;
+			color = LoadGroupColor(base);
+			color += LoadGroupColor(base + 1);
+			color += LoadGroupColor(base + 16);
+			color += LoadGroupColor(base + 17);
+			color *= 0.25;
+
+			WriteMip(firstMip + 2 + level, tile * size + thread, layer, color);
+		}
+
+		GroupMemoryBarrierWithGroupSync();
+
+		if (active)
+		{
+			StoreGroupColor(thread.y * 16 + thread.x, color);
+		}
 	}
-	
-	if (bindData.mipCount == 3)
+}
+
+[RootSignature(RS)]
+[numthreads(256, 1, 1)]
+void Main(uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex)
+{
+	const uint layer = groupId.z;
+
+	DownsampleTile(groupId.xy, layer, 1, groupIndex);
+
+	if (bindData.mipCount <= tileMips + 1)
 	{
 		return;
 	}
-	
+
+	// Make the tile's writes visible to the other groups before signaling.
+	DeviceMemoryBarrierWithGroupSync();
+
+	if (groupIndex == 0)
+	{
+		globallycoherent RWStructuredBuffer<uint> counter = ResourceDescriptorHeap[bindData.counterBuffer];
+
+		uint finished;
+		InterlockedAdd(counter[layer], 1, finished);
+		groupIsLast = finished == bindData.groupCount - 1;
+
+		if (groupIsLast)
+		{
+			counter[layer] = 0;  // Ready for the next dispatch.
+		}
+	}
+
 	GroupMemoryBarrierWithGroupSync();
-	
-	// X and Y are multiples of 8 (only one thread qualifies).
-	if (input.groupIndex == 0)
+
+	if (!groupIsLast)
 	{
-		sourceSample += LoadGroupColor(input.groupIndex + 0x04);
-		sourceSample += LoadGroupColor(input.groupIndex + 0x20);
-		sourceSample += LoadGroupColor(input.groupIndex + 0x24);
-		
-		sourceSample *= 0.25;
-		
-		WriteMip(sourceSample, input.dispatchId.xy / 8, 3);
+		return;
 	}
+
+	// A 16k texture's mip 7 is 128x128 texels, so a single tile covers the remaining mips.
+	DownsampleTile(uint2(0, 0), layer, tileMips + 1, groupIndex);
 }
\ No newline at end of file
@@ -5,43 +5,189 @@
 
 struct BindData
 {
-	uint mipBase;
-	uint mipCount;
+	uint mipBase;  // Sampled source mip.
+	uint mipCount;  // Generated by this dispatch, up to 8.
 	uint inputTextureIndex;
 	uint sRGB;
 	// Boundary
-	uint outputTextureIndex;
-	float3 texelSize;
+	uint counterBuffer;  // Groups finished, reset by the last group.
+	uint groupCount;
+	float texelSize;  // Of the first generated mip, textures are cubes.
+	float padding;
+	// Boundary
+	uint4 outputTextureIndices[2];  // Starting at mipBase + 1.
 };
 
 ConstantBuffer<BindData> bindData : register(b0);
 
+// Single pass downsampler, see Mipmap2d. Each group reduces an 8x8x8 tile of the first generated mip down to a single
+// texel, four mips in total. The last group then reduces those texels through up to four more mips.
+
+static const uint tileSize = 8;
+static const uint tileMips = 4;
+
+// Separated channels to reduce bank conflicts.
+groupshared float groupRed[64];
+groupshared float groupGreen[64];
+groupshared float groupBlue[64];
+groupshared float groupAlpha[64];
+groupshared uint groupIsLast;
+
+void StoreGroupColor(uint index, float4 color)
+{
+	groupRed[index] = color.r;
+	groupGreen[index] = color.g;
+	groupBlue[index] = color.b;
+	groupAlpha[index] = color.a;
+}
+
+float4 LoadGroupColor(uint index)
+{
+	return float4(groupRed[index], groupGreen[index], groupBlue[index], groupAlpha[index]);
+}
+
 float4 SRGBAdjustedColor(float4 sample)
 {
 	if (bindData.sRGB)
 	{
 		sample.rgb = LinearToSRGB(sample.rgb);
 	}
-	
+
 	return sample;
 }
 
-struct Input
+float4 LinearAdjustedColor(float4 sample)
 {
-	uint groupIndex : SV_GroupIndex;
-	uint3 dispatchId : SV_DispatchThreadID;
-};
+	if (bindData.sRGB)
+	{
+		sample.rgb = SRGBToLinear(sample.rgb);
+	}
+
+	return sample;
+}
+
+uint GroupIndex(uint3 thread, uint size)
+{
+	return (thread.z * size + thread.y) * size + thread.x;
+}
+
+// Mips are relative to the first generated mip.
+void WriteMip(uint mip, uint3 xyz, float4 source)
+{
+	if (mip < bindData.mipCount)
+	{
+		// Coherent, the last group reads the final tile mip written by every other group.
+		globallycoherent RWTexture3D<float4> output = ResourceDescriptorHeap[bindData.outputTextureIndices[mip / 4][mip % 4]];
+		output[xyz] = SRGBAdjustedColor(source);
+	}
+}
+
+float4 LoadFirstMip(uint3 xyz, uint firstMip)
+{
+	if (firstMip == 0)
+	{
+		Texture3D<float4> inputTexture = ResourceDescriptorHeap[bindData.inputTextureIndex];
+
+		// Sampling between the eight source texels filters all of them.
+		return inputTexture.SampleLevel(bilinearWrap, bindData.texelSize * (xyz + 0.5.xxx), bindData.mipBase);
+	}
+
+	globallycoherent RWTexture3D<float4> source = ResourceDescriptorHeap[bindData.outputTextureIndices[(firstMip - 1) / 4][(firstMip - 1) % 4]];
+
+	uint3 size;
+	source.GetDimensions(size.x, size.y, size.z);
+
+	float4 sourceSample = 0;
+	for (uint i = 0; i < 8; ++i)
+	{
+		sourceSample += LinearAdjustedColor(source[min(xyz * 2 + uint3(i % 2, (i / 2) % 2, i / 4), size - 1)]);
+	}
+
+	return sourceSample * 0.125;
+}
+
+void DownsampleTile(uint3 tile, uint firstMip, uint groupIndex)
+{
+	const uint3 thread = uint3(groupIndex % 4, (groupIndex / 4) % 4, groupIndex / 16);
+	const uint3 origin = tile * tileSize + thread * 2;
+
+	// Each thread reduces a 2x2x2 block of the first mip.
+	float4 color = 0;
+	for (uint i = 0; i < 8; ++i)
+	{
+		const uint3 xyz = origin + uint3(i % 2, (i / 2) % 2, i / 4);
+		const float4 sourceSample = LoadFirstMip(xyz, firstMip);
+		WriteMip(firstMip, xyz, sourceSample);
+		color += sourceSample;
+	}
+
+	color *= 0.125;
+	WriteMip(firstMip + 1, origin / 2, color);
+	StoreGroupColor(groupIndex, color);
+
+	// Halve the 4x4x4 texels in groupshared memory each step, down to the tile's single texel.
+	for (uint level = 1; level <= 2; ++level)
+	{
+		GroupMemoryBarrierWithGroupSync();
+
+		const uint size = 4 >> level;
+		const bool active = all(thread < size);
+		if (active)
+		{
+			color = 0;
+			for (uint j = 0; j < 8; ++j)
+			{
+				color += LoadGroupColor(GroupIndex(thread * 2 + uint3(j % 2, (j / 2) % 2, j / 4), 4));
+			}
+
+			color *= 0.125;
+			WriteMip(firstMip + 1 + level, tile * size + thread, color);
+		}
+
+		GroupMemoryBarrierWithGroupSync();
+
+		if (active)
+		{
+			StoreGroupColor(GroupIndex(thread, 4), color);
+		}
+	}
+}
 
 [RootSignature(RS)]
-[numthreads(8, 8, 1)]
-void Main(Input input)
+[numthreads(64, 1, 1)]
+void Main(uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex)
 {
-	Texture3D<float4> inputTexture = ResourceDescriptorHeap[bindData.inputTextureIndex];
+	DownsampleTile(groupId, 0, groupIndex);
 
-	float3 uvw = float3(bindData.texelSize * (input.dispatchId.xyz + 0.5.xxx));
+	if (bindData.mipCount <= tileMips)
+	{
+		return;
+	}
 
-	float4 sourceSample = inputTexture.SampleLevel(bilinearWrap, uvw, bindData.mipBase);
+	// Make the tile's writes visible to the other groups before signaling.
+	DeviceMemoryBarrierWithGroupSync();
+
+	if (groupIndex == 0)
+	{
+		globallycoherent RWStructuredBuffer<uint> counter = ResourceDescriptorHeap[bindData.counterBuffer];
+
+		uint finished;
+		InterlockedAdd(counter[0], 1, finished);
+		groupIsLast = finished == bindData.groupCount - 1;
+
+		if (groupIsLast)
+		{
+			counter[0] = 0;  // Ready for the next dispatch.
+		}
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	if (!groupIsLast)
+	{
+		return;
+	}
 
-	RWTexture3D<float4> outputTexture = ResourceDescriptorHeap[bindData.outputTextureIndex];
-	outputTexture[input.dispatchId.xyz] = SRGBAdjustedColor(sourceSample);
+	// The dispatch is sized so that the first pass' last mip fits within a single tile.
+	DownsampleTile(uint3(0, 0, 0), tileMips, groupIndex);
 }
\ No newline at end of file
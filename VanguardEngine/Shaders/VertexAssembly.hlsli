@@ -7,17 +7,22 @@ static const uint vertexChannelPosition = 0;
 static const uint vertexChannelNormal = 1;
 static const uint vertexChannelTexcoord = 2;
 static const uint vertexChannelTangent = 3;
-static const uint vertexChannelBitangent = 4;
+static const uint vertexChannelBitangent = 4;  // Never stored, derived from the normal and tangent.
 static const uint vertexChannelColor = 5;
 static const uint vertexChannels = 6;
 
 struct VertexMetadata
 {
 	uint activeChannels;  // Bit mask of vertex attributes.
-	float3 padding;
+	uint quantizedChannels;  // Bit mask of active attributes stored in their compressed format.
+	float2 padding;
 	// Tightly packed.
 	uint4 channelStrides[vertexChannels / 4 + 1];
 	uint4 channelOffsets[vertexChannels / 4 + 1];
+	float3 positionMin;  // Quantized positions are relative to the mesh bounds.
+	float padding2;
+	float3 positionExtent;
+	float padding3;
 };
 
 struct VertexAssemblyData
@@ -30,14 +35,84 @@ struct VertexAssemblyData
 
 ConstantBuffer<VertexMetadata> vertexMetadata : register(b0, space3);
 
+// Pipelines specialized on a vertex layout define VERTEX_CHANNELS and VERTEX_QUANTIZED, the active and quantized channel
+// masks. Strides then fold to constants and loads of missing attributes are compiled out.
 bool HasVertexAttribute(VertexMetadata metadata, uint channel)
 {
+#ifdef VERTEX_CHANNELS
+	return (VERTEX_CHANNELS & (1u << channel)) != 0;
+#else
 	return metadata.activeChannels & (1u << channel);
+#endif
+}
+
+// Quantized formats, all 4 byte aligned:
+//   Position: 16 bit unorm xyz relative to the mesh bounds, padded to 8 bytes.
+//   Normal: 16 bit snorm octahedral.
+//   Texcoord: half precision.
+//   Tangent: 15 bit unorm octahedral, with the bitangent sign in the top bit.
+// Bitangents are never stored, they're derived from the normal and the signed tangent.
+bool IsVertexAttributeQuantized(VertexMetadata metadata, uint channel)
+{
+#ifdef VERTEX_QUANTIZED
+	return (VERTEX_QUANTIZED & (1u << channel)) != 0;
+#else
+	return metadata.quantizedChannels & (1u << channel);
+#endif
+}
+
+// Stored size of a channel, see MeshFactory::GetEncodedAttributeSize.
+uint GetVertexAttributeSize(VertexMetadata metadata, uint channel)
+{
+	if (!HasVertexAttribute(metadata, channel))
+		return 0;
+
+	const bool quantized = IsVertexAttributeQuantized(metadata, channel);
+	switch (channel)
+	{
+	case vertexChannelPosition: return quantized ? 8 : 12;
+	case vertexChannelNormal: return quantized ? 4 : 12;
+	case vertexChannelTexcoord: return quantized ? 4 : 8;
+	case vertexChannelTangent: return quantized ? 4 : 16;
+	case vertexChannelColor: return 16;
+	default: return 0;
+	}
+}
+
+float3 DecodeOctahedral(float2 encoded)
+{
+	float3 direction = float3(encoded, 1.f - abs(encoded.x) - abs(encoded.y));
+	float fold = saturate(-direction.z);
+	direction.x += direction.x >= 0.f ? -fold : fold;
+	direction.y += direction.y >= 0.f ? -fold : fold;
+
+	return normalize(direction);
+}
+
+float2 UnpackSnorm16x2(uint packed)
+{
+	int2 values = int2(packed << 16, packed) >> 16;  // Sign extend.
+	return max(float2(values) / 32767.f, -1.f);
 }
 
 uint GetVertexChannelStride(VertexMetadata metadata, uint channel)
 {
+#ifdef VERTEX_CHANNELS
+	// Extras are interleaved in channel order, positions have their own buffer.
+	if (channel == vertexChannelPosition)
+		return GetVertexAttributeSize(metadata, vertexChannelPosition);
+
+	uint stride = 0;
+	[unroll]
+	for (uint i = vertexChannelNormal; i < vertexChannels; ++i)
+	{
+		stride += GetVertexAttributeSize(metadata, i);
+	}
+
+	return stride;
+#else
 	return metadata.channelStrides[channel / 4][channel % 4];
+#endif
 }
 
 uint GetVertexChannelOffset(VertexMetadata metadata, uint channel)
@@ -53,6 +128,13 @@ uint GetVertexChannelIndex(VertexMetadata metadata, uint vertexId, uint channel)
 float4 LoadVertexPosition(VertexAssemblyData assembly, uint vertexId)
 {
 	ByteAddressBuffer positions = ResourceDescriptorHeap[assembly.positionBuffer];
+
+	if (IsVertexAttributeQuantized(assembly.metadata, vertexChannelPosition))
+	{
+		uint2 packed = positions.Load<uint2>(GetVertexChannelIndex(assembly.metadata, vertexId, vertexChannelPosition));
+		float3 normalized = float3(packed.x & 0xFFFF, packed.x >> 16, packed.y & 0xFFFF) / 65535.f;
+		return float4(assembly.metadata.positionMin + normalized * assembly.metadata.positionExtent, 1.f);
+	}
 	
 	return HasVertexAttribute(assembly.metadata, vertexChannelPosition) ?
 		float4(positions.Load<float3>(GetVertexChannelIndex(assembly.metadata, vertexId, vertexChannelPosition)), 1) :
@@ -62,6 +144,11 @@ float4 LoadVertexPosition(VertexAssemblyData assembly, uint vertexId)
 float3 LoadVertexNormal(VertexAssemblyData assembly, uint vertexId)
 {
 	ByteAddressBuffer extras = ResourceDescriptorHeap[assembly.extraBuffer];
+
+	if (IsVertexAttributeQuantized(assembly.metadata, vertexChannelNormal))
+	{
+		return DecodeOctahedral(UnpackSnorm16x2(extras.Load(GetVertexChannelIndex(assembly.metadata, vertexId, vertexChannelNormal))));
+	}
 	
 	return HasVertexAttribute(assembly.metadata, vertexChannelNormal) ?
 		extras.Load<float3>(GetVertexChannelIndex(assembly.metadata, vertexId, vertexChannelNormal)) :
@@ -71,6 +158,12 @@ float3 LoadVertexNormal(VertexAssemblyData assembly, uint vertexId)
 float2 LoadVertexTexcoord(VertexAssemblyData assembly, uint vertexId)
 {
 	ByteAddressBuffer extras = ResourceDescriptorHeap[assembly.extraBuffer];
+
+	if (IsVertexAttributeQuantized(assembly.metadata, vertexChannelTexcoord))
+	{
+		uint packed = extras.Load(GetVertexChannelIndex(assembly.metadata, vertexId, vertexChannelTexcoord));
+		return float2(f16tof32(packed), f16tof32(packed >> 16));
+	}
 	
 	return HasVertexAttribute(assembly.metadata, vertexChannelTexcoord) ?
 		extras.Load<float2>(GetVertexChannelIndex(assembly.metadata, vertexId, vertexChannelTexcoord)) :
@@ -80,6 +173,13 @@ float2 LoadVertexTexcoord(VertexAssemblyData assembly, uint vertexId)
 float4 LoadVertexTangent(VertexAssemblyData assembly, uint vertexId)
 {
 	ByteAddressBuffer extras = ResourceDescriptorHeap[assembly.extraBuffer];
+
+	if (IsVertexAttributeQuantized(assembly.metadata, vertexChannelTangent))
+	{
+		uint packed = extras.Load(GetVertexChannelIndex(assembly.metadata, vertexId, vertexChannelTangent));
+		float2 encoded = float2(packed & 0x7FFF, (packed >> 15) & 0x7FFF) / 32767.f * 2.f - 1.f;
+		return float4(DecodeOctahedral(encoded), (packed >> 31) ? -1.f : 1.f);
+	}
 	
 	return HasVertexAttribute(assembly.metadata, vertexChannelTangent) ?
 		extras.Load<float4>(GetVertexChannelIndex(assembly.metadata, vertexId, vertexChannelTangent)) :
@@ -88,19 +188,9 @@ float4 LoadVertexTangent(VertexAssemblyData assembly, uint vertexId)
 
 float4 LoadVertexBitangent(VertexAssemblyData assembly, uint vertexId)
 {
-	if (HasVertexAttribute(assembly.metadata, vertexChannelBitangent))
-	{
-		ByteAddressBuffer extras = ResourceDescriptorHeap[assembly.extraBuffer];
-		
-		return extras.Load<float4>(GetVertexChannelIndex(assembly.metadata, vertexId, vertexChannelBitangent));
-	}
-	
-	else
-	{
-		float3 normal = LoadVertexNormal(assembly, vertexId);
-		float3 tangent = LoadVertexTangent(assembly, vertexId).xyz;
-		return float4(cross(normal, tangent), 1.f);
-	}
+	float3 normal = LoadVertexNormal(assembly, vertexId);
+	float4 tangent = LoadVertexTangent(assembly, vertexId);
+	return float4(cross(normal, tangent.xyz) * (tangent.w < 0.f ? -1.f : 1.f), 1.f);
 }
 
 float4 LoadVertexColor(VertexAssemblyData assembly, uint vertexId)
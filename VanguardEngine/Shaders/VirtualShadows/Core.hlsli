@@ -0,0 +1,121 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#ifndef __VIRTUAL_SHADOWS_CORE_HLSLI__
+#define __VIRTUAL_SHADOWS_CORE_HLSLI__
+
+#include "RootSignature.hlsli"
+#include "Camera.hlsli"
+
+// Matches VirtualShadowMap.h.
+static const uint virtualPageSize = 128;  // Texels per side of a page.
+static const uint virtualPageTableSize = 128;  // Pages per side of the virtual texture.
+static const uint virtualResolution = virtualPageSize * virtualPageTableSize;
+static const uint physicalPoolSize = 32;  // Pages per side of the physical pool.
+static const uint physicalPageCount = physicalPoolSize * physicalPoolSize;
+static const uint invalidPhysicalPage = 0xFFFFFFFF;
+
+static const uint virtualPageDirty = 1 << 0;  // Contents are stale, rendered once requested.
+static const uint virtualPageRendering = 1 << 1;  // Rendered this frame.
+static const uint virtualPageNeedsMapping = 1 << 2;  // Requested without a physical page.
+
+// Each slot of the page table holds one world space page of the light's plane. Slots wrap around, so as the window of
+// pages follows the view, only the pages entering the window take the slots of the pages leaving it.
+struct VirtualShadowPage
+{
+	uint physicalPage;
+	uint tag;  // Packed world page the slot holds.
+	uint flags;
+	uint lastUsedFrame;
+};
+
+struct VirtualShadowData
+{
+	uint enabled;
+	uint pageTable;
+	uint physicalPages;
+	uint cameraIndex;
+};
+
+// Texels are anchored to the light's view space, so that they don't move with the window.
+int2 LightToWorldTexel(float3 positionLS, float texelSize)
+{
+	return int2(floor(float2(positionLS.x, -positionLS.y) / texelSize));
+}
+
+int2 WorldTexelToPage(int2 worldTexel)
+{
+	return int2(floor(float2(worldTexel) / virtualPageSize));
+}
+
+uint PageSlot(int2 worldPage)
+{
+	const uint2 wrapped = uint2(worldPage & (virtualPageTableSize - 1));  // Two's complement wraps negative pages.
+	return wrapped.y * virtualPageTableSize + wrapped.x;
+}
+
+uint PackPageTag(int2 worldPage)
+{
+	return (uint(worldPage.x) & 0xFFFF) | (uint(worldPage.y) << 16);
+}
+
+uint2 PhysicalPageOrigin(uint physicalPage)
+{
+	return uint2(physicalPage % physicalPoolSize, physicalPage / physicalPoolSize) * virtualPageSize;
+}
+
+// Texel size of the shadow camera's orthographic projection, in meters.
+float VirtualTexelSize(Camera camera)
+{
+	return 2.f / (camera.projection._m00 * virtualResolution);
+}
+
+// Returns false if the texel's page isn't resident.
+bool LoadVirtualShadowDepth(StructuredBuffer<VirtualShadowPage> pageTable, Texture2D<uint> physicalPages, int2 worldTexel, out float depth)
+{
+	const int2 worldPage = WorldTexelToPage(worldTexel);
+	const VirtualShadowPage page = pageTable[PageSlot(worldPage)];
+
+	depth = 0.f;
+	if (page.physicalPage == invalidPhysicalPage || page.tag != PackPageTag(worldPage))
+		return false;
+
+	const uint2 texel = PhysicalPageOrigin(page.physicalPage) + uint2(worldTexel - worldPage * virtualPageSize);
+	depth = asfloat(physicalPages[texel]);
+
+	return true;
+}
+
+// Fraction of the sun's light reaching the position, fully lit where no page is resident.
+float CalculateVirtualShadow(VirtualShadowData data, StructuredBuffer<Camera> cameraBuffer, float3 position, float3 normal, float normalOffset)
+{
+	if (data.enabled == 0)
+		return 1.f;
+
+	Camera camera = cameraBuffer[data.cameraIndex];
+	StructuredBuffer<VirtualShadowPage> pageTable = ResourceDescriptorHeap[data.pageTable];
+	Texture2D<uint> physicalPages = ResourceDescriptorHeap[data.physicalPages];
+
+	const float texelSize = VirtualTexelSize(camera);
+	position += normal * texelSize * normalOffset;
+
+	const float3 positionLS = mul(float4(position, 1.f), camera.view).xyz;
+	const float depth = mul(float4(positionLS, 1.f), camera.projection).z;
+
+	// Bilinear 2x2 PCF, taps resolve their own page since they can straddle page borders.
+	const float2 texelPosition = float2(positionLS.x, -positionLS.y) / texelSize - 0.5f;
+	const int2 baseTexel = int2(floor(texelPosition));
+	const float2 weights = frac(texelPosition);
+
+	float taps[4];
+	[unroll]
+	for (uint i = 0; i < 4; ++i)
+	{
+		float casterDepth;
+		const bool resident = LoadVirtualShadowDepth(pageTable, physicalPages, baseTexel + int2(i % 2, i / 2), casterDepth);
+		taps[i] = !resident || depth >= casterDepth ? 1.f : 0.f;  // Inverse Z.
+	}
+
+	return lerp(lerp(taps[0], taps[1], weights.x), lerp(taps[2], taps[3], weights.x), weights.y);
+}
+
+#endif  // __VIRTUAL_SHADOWS_CORE_HLSLI__
\ No newline at end of file
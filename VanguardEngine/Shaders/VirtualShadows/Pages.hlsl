@@ -0,0 +1,316 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Camera.hlsli"
+#include "Object.hlsli"
+#include "VirtualShadows/Core.hlsli"
+
+static const uint pageFlagReset = 1 << 0;  // Discards every page, the table and pool have no valid contents.
+static const uint pageFlagInvalidateAll = 1 << 1;  // Every page is stale, such as after the sun moved.
+
+struct BindData
+{
+	uint pageTable;
+	uint physicalOwners;  // Slot owning each physical page.
+	uint pageRequests;
+	uint renderList;  // Slots rendered this frame.
+	uint clearArguments;
+	uint physicalPages;
+	uint depthTexture;
+	uint cameraBuffer;
+	uint viewCameraIndex;
+	uint shadowCameraIndex;
+	int2 windowOrigin;  // World page of the window's first page.
+	uint2 depthResolution;
+	uint invalidationRanges;
+	uint invalidationRangeCount;
+	uint objectBuffer;
+	uint transformBuffer;
+	uint frame;
+	uint flags;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+bool InWindow(int2 worldPage)
+{
+	return all(worldPage >= bindData.windowOrigin) && all(worldPage < bindData.windowOrigin + int(virtualPageTableSize));
+}
+
+// Requests the page of every visible surface.
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void MarkMain(uint3 dispatchId : SV_DispatchThreadID)
+{
+	if (any(dispatchId.xy >= bindData.depthResolution))
+		return;
+
+	Texture2D<float> depthTexture = ResourceDescriptorHeap[bindData.depthTexture];
+	const float depth = depthTexture[dispatchId.xy];
+	if (depth == 0.f)
+		return;  // Sky, inverse Z.
+
+	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
+	Camera viewCamera = cameraBuffer[bindData.viewCameraIndex];
+	Camera shadowCamera = cameraBuffer[bindData.shadowCameraIndex];
+
+	const float2 uv = (float2(dispatchId.xy) + 0.5f) / float2(bindData.depthResolution);
+	float4 positionCS = UvToClipSpace(uv);
+	positionCS.z = depth;
+	const float4 positionVS = ClipToViewSpace(viewCamera, positionCS);
+	const float3 positionWS = mul(positionVS, viewCamera.inverseView).xyz;
+	const float3 positionLS = mul(float4(positionWS, 1.f), shadowCamera.view).xyz;
+
+	const int2 worldPage = WorldTexelToPage(LightToWorldTexel(positionLS, VirtualTexelSize(shadowCamera)));
+	if (InWindow(worldPage))
+	{
+		RWStructuredBuffer<uint> pageRequests = ResourceDescriptorHeap[bindData.pageRequests];
+		pageRequests[PageSlot(worldPage)] = 1;
+	}
+}
+
+void InvalidateSphere(RWStructuredBuffer<VirtualShadowPage> pageTable, Camera shadowCamera, matrix worldMatrix, float3 sphereCenter, float radius)
+{
+	const float3 center = mul(float4(sphereCenter, 1.f), worldMatrix).xyz;
+	const float3 centerLS = mul(float4(center, 1.f), shadowCamera.view).xyz;
+	const float texelSize = VirtualTexelSize(shadowCamera);
+
+	// The light is orthographic, so the shadow lands within the sphere's footprint on the light's plane.
+	int2 minPage = WorldTexelToPage(LightToWorldTexel(centerLS + float3(-radius, radius, 0.f), texelSize));
+	int2 maxPage = WorldTexelToPage(LightToWorldTexel(centerLS + float3(radius, -radius, 0.f), texelSize));
+	minPage = max(minPage, bindData.windowOrigin);
+	maxPage = min(maxPage, bindData.windowOrigin + int(virtualPageTableSize) - 1);
+
+	for (int y = minPage.y; y <= maxPage.y; ++y)
+	{
+		for (int x = minPage.x; x <= maxPage.x; ++x)
+		{
+			const int2 worldPage = int2(x, y);
+			const uint slot = PageSlot(worldPage);
+			if (pageTable[slot].tag == PackPageTag(worldPage))
+			{
+				InterlockedOr(pageTable[slot].flags, virtualPageDirty);
+			}
+		}
+	}
+}
+
+// Dirties the pages under moved instances, at both their current and last transforms. One group per instance range.
+[RootSignature(RS)]
+[numthreads(64, 1, 1)]
+void InvalidateMain(uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex)
+{
+	StructuredBuffer<uint2> invalidationRanges = ResourceDescriptorHeap[bindData.invalidationRanges];
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
+	RWStructuredBuffer<VirtualShadowPage> pageTable = ResourceDescriptorHeap[bindData.pageTable];
+	Camera shadowCamera = cameraBuffer[bindData.shadowCameraIndex];
+
+	const uint2 range = invalidationRanges[groupId.x];
+	for (uint i = range.x + groupIndex; i < range.y; i += 64)
+	{
+		ObjectData object = objectBuffer[i];
+		if (object.batchIndex == 0xFFFFFFFF)
+			continue;  // Free slot.
+
+		TransformData transform = LoadTransform(bindData.transformBuffer, object);
+		InvalidateSphere(pageTable, shadowCamera, transform.worldMatrix, object.boundingSphereCenter, object.boundingSphereRadius * GetMaxScale(transform.worldMatrix));
+		InvalidateSphere(pageTable, shadowCamera, transform.lastFrameWorldMatrix, object.boundingSphereCenter, object.boundingSphereRadius * GetMaxScale(transform.lastFrameWorldMatrix));
+	}
+}
+
+static const uint allocateGroupSize = 1024;
+static const uint slotsPerThread = (virtualPageTableSize * virtualPageTableSize) / allocateGroupSize;
+static const uint physicalPagesPerThread = (physicalPageCount + allocateGroupSize - 1) / allocateGroupSize;
+
+groupshared uint freePages[physicalPageCount];
+groupshared uint freeCount;
+groupshared uint initialFreeCount;
+groupshared uint neededCount;
+groupshared uint assignedCount;
+groupshared uint renderCount;
+
+// Maps the requested pages to physical pages, evicting pages that weren't requested this frame once the pool runs out,
+// then lists the requested pages that need rendering. A single group, so every phase can synchronize.
+[RootSignature(RS)]
+[numthreads(allocateGroupSize, 1, 1)]
+void AllocateMain(uint groupIndex : SV_GroupIndex)
+{
+	RWStructuredBuffer<VirtualShadowPage> pageTable = ResourceDescriptorHeap[bindData.pageTable];
+	RWStructuredBuffer<uint> physicalOwners = ResourceDescriptorHeap[bindData.physicalOwners];
+	RWStructuredBuffer<uint> pageRequests = ResourceDescriptorHeap[bindData.pageRequests];
+	RWStructuredBuffer<uint> renderList = ResourceDescriptorHeap[bindData.renderList];
+	RWStructuredBuffer<uint> clearArguments = ResourceDescriptorHeap[bindData.clearArguments];
+
+	if (groupIndex == 0)
+	{
+		freeCount = 0;
+		neededCount = 0;
+		assignedCount = 0;
+		renderCount = 0;
+	}
+
+	if (bindData.flags & pageFlagReset)
+	{
+		for (uint i = 0; i < slotsPerThread; ++i)
+		{
+			const uint slot = groupIndex * slotsPerThread + i;
+			VirtualShadowPage page;
+			page.physicalPage = invalidPhysicalPage;
+			page.tag = 0;
+			page.flags = 0;
+			page.lastUsedFrame = 0;
+			pageTable[slot] = page;
+		}
+
+		for (uint j = 0; j < physicalPagesPerThread; ++j)
+		{
+			const uint physical = groupIndex * physicalPagesPerThread + j;
+			if (physical < physicalPageCount)
+			{
+				physicalOwners[physical] = invalidPhysicalPage;
+			}
+		}
+	}
+
+	DeviceMemoryBarrierWithGroupSync();
+
+	// Gather the unowned physical pages.
+	for (uint j = 0; j < physicalPagesPerThread; ++j)
+	{
+		const uint physical = groupIndex * physicalPagesPerThread + j;
+		if (physical < physicalPageCount && physicalOwners[physical] == invalidPhysicalPage)
+		{
+			uint index;
+			InterlockedAdd(freeCount, 1, index);
+			freePages[index] = physical;
+		}
+	}
+
+	// Consume the requests. Requested slots that hold another world page are reused for the requested one.
+	for (uint i = 0; i < slotsPerThread; ++i)
+	{
+		const uint slot = groupIndex * slotsPerThread + i;
+		VirtualShadowPage page = pageTable[slot];
+		page.flags &= ~(virtualPageRendering | virtualPageNeedsMapping);
+		if (bindData.flags & pageFlagInvalidateAll)
+		{
+			page.flags |= virtualPageDirty;
+		}
+
+		if (pageRequests[slot] != 0)
+		{
+			pageRequests[slot] = 0;
+
+			// The window covers every slot exactly once, so the slot's world page follows from the window.
+			const int2 wrapped = int2(slot % virtualPageTableSize, slot / virtualPageTableSize);
+			const int2 worldPage = bindData.windowOrigin + ((wrapped - bindData.windowOrigin) & int(virtualPageTableSize - 1));
+			const uint tag = PackPageTag(worldPage);
+
+			if (page.tag != tag)
+			{
+				page.tag = tag;
+				page.flags |= virtualPageDirty;
+			}
+
+			page.lastUsedFrame = bindData.frame;
+
+			if (page.physicalPage == invalidPhysicalPage)
+			{
+				page.flags |= virtualPageNeedsMapping;
+				InterlockedAdd(neededCount, 1);
+			}
+		}
+
+		pageTable[slot] = page;
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	if (groupIndex == 0)
+	{
+		initialFreeCount = freeCount;
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	// Evict pages that weren't requested this frame, only as many as are missing.
+	if (neededCount > initialFreeCount)
+	{
+		for (uint i = 0; i < slotsPerThread; ++i)
+		{
+			const uint slot = groupIndex * slotsPerThread + i;
+			VirtualShadowPage page = pageTable[slot];
+			if (page.physicalPage != invalidPhysicalPage && page.lastUsedFrame != bindData.frame)
+			{
+				uint index;
+				InterlockedAdd(freeCount, 1, index);
+				if (index < neededCount)
+				{
+					freePages[index] = page.physicalPage;
+					physicalOwners[page.physicalPage] = invalidPhysicalPage;
+					page.physicalPage = invalidPhysicalPage;
+					pageTable[slot] = page;
+				}
+			}
+		}
+	}
+
+	DeviceMemoryBarrierWithGroupSync();
+
+	// Evictions past the missing count didn't write their page.
+	const uint available = min(freeCount, max(neededCount, initialFreeCount));
+
+	for (uint i = 0; i < slotsPerThread; ++i)
+	{
+		const uint slot = groupIndex * slotsPerThread + i;
+		VirtualShadowPage page = pageTable[slot];
+
+		if (page.flags & virtualPageNeedsMapping)
+		{
+			uint index;
+			InterlockedAdd(assignedCount, 1, index);
+			if (index < available)
+			{
+				page.physicalPage = freePages[index];
+				page.flags |= virtualPageDirty;
+				physicalOwners[page.physicalPage] = slot;
+			}
+		}
+
+		// Dirty pages that weren't requested stay dirty, and render once they are.
+		if (page.physicalPage != invalidPhysicalPage && page.lastUsedFrame == bindData.frame && (page.flags & virtualPageDirty))
+		{
+			page.flags = (page.flags & ~virtualPageDirty) | virtualPageRendering;
+
+			uint index;
+			InterlockedAdd(renderCount, 1, index);
+			renderList[index] = slot;
+		}
+
+		pageTable[slot] = page;
+	}
+
+	GroupMemoryBarrierWithGroupSync();
+
+	// One group per 8x8 texels of each rendered page.
+	if (groupIndex == 0)
+	{
+		clearArguments[0] = virtualPageSize / 8;
+		clearArguments[1] = virtualPageSize / 8;
+		clearArguments[2] = renderCount;
+	}
+}
+
+// Clears the physical pages about to be rendered.
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void ClearMain(uint3 dispatchId : SV_DispatchThreadID, uint3 groupId : SV_GroupID)
+{
+	StructuredBuffer<VirtualShadowPage> pageTable = ResourceDescriptorHeap[bindData.pageTable];
+	StructuredBuffer<uint> renderList = ResourceDescriptorHeap[bindData.renderList];
+	RWTexture2D<uint> physicalPages = ResourceDescriptorHeap[bindData.physicalPages];
+
+	const uint physicalPage = pageTable[renderList[groupId.z]].physicalPage;
+	physicalPages[PhysicalPageOrigin(physicalPage) + dispatchId.xy] = 0;  // Inverse Z.
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "VertexAssembly.hlsli"
+#include "Object.hlsli"
+#include "Camera.hlsli"
+#include "VirtualShadows/Core.hlsli"
+
+struct BindData
+{
+	uint instanceBuffer;
+	uint objectBuffer;
+	uint transformBuffer;
+	uint cameraBuffer;
+	uint cameraIndex;
+	uint vertexPositionBuffer;
+	uint pageTable;
+	uint physicalPages;
+	int2 windowOrigin;  // World page of the window's first page.
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+struct Input
+{
+	uint vertexId : SV_VertexID;
+	uint instanceId : SV_InstanceID;
+	uint batchId : BATCH;  // Instance data of the draw, see MeshSystem::BindArguments().
+};
+
+struct Output
+{
+	float4 positionCS : SV_POSITION;
+};
+
+[RootSignature(RS)]
+Output VSMain(Input input)
+{
+	const uint objectId = LoadObjectId(bindData.instanceBuffer, input.batchId, input.instanceId);
+	StructuredBuffer<ObjectData> objectBuffer = ResourceDescriptorHeap[bindData.objectBuffer];
+	ObjectData object = objectBuffer[objectId];
+	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
+	Camera camera = cameraBuffer[bindData.cameraIndex];
+
+	VertexAssemblyData assemblyData;
+	assemblyData.positionBuffer = bindData.vertexPositionBuffer;
+	assemblyData.extraBuffer = 0;  // Unused.
+	assemblyData.metadata = object.vertexMetadata;
+
+	Output output;
+	output.positionCS = mul(mul(mul(LoadVertexPosition(assemblyData, input.vertexId), LoadTransform(bindData.transformBuffer, object).worldMatrix), camera.view), camera.projection);
+
+	return output;
+}
+
+// Rasterizes the whole window without any targets, each pixel lands in its page's physical texel if the page renders
+// this frame. Depth is resolved with atomics, inverse Z.
+[RootSignature(RS)]
+void PSMain(Output input)
+{
+	const int2 worldTexel = bindData.windowOrigin * int(virtualPageSize) + int2(input.positionCS.xy);
+	const int2 worldPage = WorldTexelToPage(worldTexel);
+
+	StructuredBuffer<VirtualShadowPage> pageTable = ResourceDescriptorHeap[bindData.pageTable];
+	const VirtualShadowPage page = pageTable[PageSlot(worldPage)];
+	if (!(page.flags & virtualPageRendering) || page.tag != PackPageTag(worldPage))
+		return;
+
+	RWTexture2D<uint> physicalPages = ResourceDescriptorHeap[bindData.physicalPages];
+	const uint2 texel = PhysicalPageOrigin(page.physicalPage) + uint2(worldTexel - worldPage * int(virtualPageSize));
+
+	// Casters in front of the near plane are clamped instead of clipped.
+	InterlockedMax(physicalPages[texel], asuint(saturate(input.positionCS.z)));
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#ifndef __VISIBILITYBUFFER_HLSLI__
+#define __VISIBILITYBUFFER_HLSLI__
+
+#include "Object.hlsli"
+
+// The prepass writes the object (offset by one, zero is empty) and the triangle within its subset for each pixel.
+// Instanced batch draws start at the subset's first index, so the primitive ID is the triangle within the subset.
+uint2 EncodeVisibility(uint objectId, uint primitiveId)
+{
+	return uint2(objectId + 1, primitiveId);
+}
+
+bool DecodeVisibility(uint2 encoded, out uint objectId, out uint primitiveId)
+{
+	objectId = encoded.x - 1;
+	primitiveId = encoded.y;
+
+	return encoded.x > 0;
+}
+
+uint3 LoadTriangleIndices(uint indexBuffer, ObjectData object, uint primitiveId)
+{
+	StructuredBuffer<uint> indices = ResourceDescriptorHeap[indexBuffer];
+
+	if (object.indexSize == 2)
+	{
+		const uint first = object.indexOffset / 2 + primitiveId * 3;
+
+		uint3 result;
+		for (uint i = 0; i < 3; ++i)
+		{
+			const uint index = first + i;
+			const uint packed = indices[index / 2];
+			result[i] = (index % 2) ? packed >> 16 : packed & 0xFFFF;
+		}
+
+		return result;
+	}
+
+	const uint first = object.indexOffset / 4 + primitiveId * 3;
+	return uint3(indices[first], indices[first + 1], indices[first + 2]);
+}
+
+struct BarycentricDerivatives
+{
+	float3 lambda;
+	float3 ddx;  // Change over one pixel step.
+	float3 ddy;
+};
+
+// Perspective correct barycentrics of a pixel within a clip space triangle, along with their screen space derivatives for
+// texture filtering. See: "The Filtered and Culled Visibility Buffer", Wihlidal 2016.
+BarycentricDerivatives ComputeBarycentrics(float4 positionCS0, float4 positionCS1, float4 positionCS2, float2 positionNDC, float2 resolution)
+{
+	const float3 inverseW = rcp(float3(positionCS0.w, positionCS1.w, positionCS2.w));
+	const float2 ndc0 = positionCS0.xy * inverseW.x;
+	const float2 ndc1 = positionCS1.xy * inverseW.y;
+	const float2 ndc2 = positionCS2.xy * inverseW.z;
+
+	const float inverseDeterminant = rcp(determinant(float2x2(ndc2 - ndc1, ndc0 - ndc1)));
+
+	BarycentricDerivatives result;
+	result.ddx = float3(ndc1.y - ndc2.y, ndc2.y - ndc0.y, ndc0.y - ndc1.y) * inverseDeterminant * inverseW;
+	result.ddy = float3(ndc2.x - ndc1.x, ndc0.x - ndc2.x, ndc1.x - ndc0.x) * inverseDeterminant * inverseW;
+
+	float ddxSum = dot(result.ddx, float3(1.f, 1.f, 1.f));
+	float ddySum = dot(result.ddy, float3(1.f, 1.f, 1.f));
+
+	const float2 delta = positionNDC - ndc0;
+	const float interpolatedInverseW = inverseW.x + delta.x * ddxSum + delta.y * ddySum;
+	const float interpolatedW = rcp(interpolatedInverseW);
+
+	result.lambda.x = interpolatedW * (inverseW.x + delta.x * result.ddx.x + delta.y * result.ddy.x);
+	result.lambda.y = interpolatedW * (delta.x * result.ddx.y + delta.y * result.ddy.y);
+	result.lambda.z = interpolatedW * (delta.x * result.ddx.z + delta.y * result.ddy.z);
+
+	// Convert from NDC to pixel steps, screen space y points down.
+	result.ddx *= 2.f / resolution.x;
+	result.ddy *= -2.f / resolution.y;
+	ddxSum *= 2.f / resolution.x;
+	ddySum *= -2.f / resolution.y;
+
+	result.ddx = rcp(interpolatedInverseW + ddxSum) * (result.lambda * interpolatedInverseW + result.ddx) - result.lambda;
+	result.ddy = rcp(interpolatedInverseW + ddySum) * (result.lambda * interpolatedInverseW + result.ddy) - result.lambda;
+
+	return result;
+}
+
+float InterpolateAttribute(float3 weights, float a, float b, float c) { return a * weights.x + b * weights.y + c * weights.z; }
+float2 InterpolateAttribute(float3 weights, float2 a, float2 b, float2 c) { return a * weights.x + b * weights.y + c * weights.z; }
+float3 InterpolateAttribute(float3 weights, float3 a, float3 b, float3 c) { return a * weights.x + b * weights.y + c * weights.z; }
+float4 InterpolateAttribute(float3 weights, float4 a, float4 b, float4 c) { return a * weights.x + b * weights.y + c * weights.z; }
+
+#endif  // __VISIBILITYBUFFER_HLSLI__
\ No newline at end of file
@@ -0,0 +1,43 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#ifndef __FOG_HLSLI__
+#define __FOG_HLSLI__
+
+#include "RootSignature.hlsli"
+
+struct FogData
+{
+	uint integratedTexture;  // Zero when volumetric fog is disabled.
+	float range;  // View depth of the last slice, in meters.
+	float2 padding;
+};
+
+// Slices are distributed quadratically in view depth, concentrating resolution near the camera.
+float FogSliceToDepth(float slice, float range)
+{
+	return slice * slice * range;
+}
+
+float FogDepthToSlice(float depth, float range)
+{
+	return sqrt(saturate(depth / range));
+}
+
+// Returns the in-scattered light between the camera and the view depth in rgb, and the transmittance in alpha.
+float4 SampleVolumetricFog(FogData data, float2 uv, float viewDepth)
+{
+	if (data.integratedTexture == 0)
+		return float4(0.f, 0.f, 0.f, 1.f);
+
+	Texture3D<float4> integratedTexture = ResourceDescriptorHeap[data.integratedTexture];
+
+	uint width, height, depth;
+	integratedTexture.GetDimensions(width, height, depth);
+
+	// Slices hold the light integrated up to their far boundary, offset by half a slice to land on it.
+	const float slice = saturate(FogDepthToSlice(viewDepth, data.range) - 0.5f / depth);
+
+	return integratedTexture.SampleLevel(bilinearClamp, float3(uv, slice), 0);
+}
+
+#endif  // __FOG_HLSLI__
@@ -0,0 +1,45 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Volumetrics/Fog.hlsli"
+
+struct BindData
+{
+	uint scatteringTexture;
+	uint outputTexture;
+	float range;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+[RootSignature(RS)]
+[numthreads(8, 8, 1)]
+void Main(uint3 dispatchId : SV_DispatchThreadID)
+{
+	Texture3D<float4> scatteringTexture = ResourceDescriptorHeap[bindData.scatteringTexture];
+	RWTexture3D<float4> outputTexture = ResourceDescriptorHeap[bindData.outputTexture];
+
+	uint width, height, depth;
+	outputTexture.GetDimensions(width, height, depth);
+
+	if (dispatchId.x >= width || dispatchId.y >= height)
+		return;
+
+	float3 scatteredLuminance = 0.xxx;
+	float transmittance = 1.f;
+
+	// Front to back, each slice stores the accumulation up to its far boundary.
+	for (uint z = 0; z < depth; ++z)
+	{
+		const float4 froxel = scatteringTexture[uint3(dispatchId.xy, z)];
+		const float sliceLength = FogSliceToDepth((z + 1.f) / depth, bindData.range) - FogSliceToDepth((float)z / depth, bindData.range);
+
+		// Energy conserving integration, see ComputeScatteringIntegration.
+		const float extinction = max(froxel.a, 0.0000001f);
+		const float sliceTransmittance = exp(-extinction * sliceLength);
+		scatteredLuminance += transmittance * (froxel.rgb - froxel.rgb * sliceTransmittance) / extinction;
+		transmittance *= sliceTransmittance;
+
+		outputTexture[uint3(dispatchId.xy, z)] = float4(scatteredLuminance, transmittance);
+	}
+}
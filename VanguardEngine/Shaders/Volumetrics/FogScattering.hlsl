@@ -0,0 +1,165 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include "RootSignature.hlsli"
+#include "Camera.hlsli"
+#include "Light.hlsli"
+#include "Clusters/Clusters.hlsli"
+#include "Atmosphere/Visibility.hlsli"
+#include "Shadows.hlsli"
+#include "Volumetrics/Fog.hlsli"
+#include "Volumetrics/PhaseFunctions.hlsli"
+
+struct ClusterData
+{
+	uint lightListBuffer;
+	uint lightInfoBuffer;
+	float logY;
+	int froxelSize;
+	uint3 dimensions;
+	uint directionalLightListBuffer;
+};
+
+struct BindData
+{
+	uint cameraBuffer;
+	uint cameraIndex;
+	uint lightBuffer;
+	uint atmosphereIrradianceBuffer;
+	uint cloudShadowTexture;
+	uint historyTexture;  // Zero without history.
+	uint outputTexture;
+	float range;
+	float3 albedo;
+	float density;  // Extinction at the base height, per meter.
+	float heightFalloff;  // Exponential falloff above the base height, per meter.
+	float baseHeight;
+	float anisotropy;
+	float historyWeight;
+	float2 weatherScroll;
+	float jitter;  // Depth offset of this frame's samples within their slice, in [0, 1).
+	float padding;
+	uint2 outputResolution;  // Resolution the cluster grid is laid over.
+	float2 padding2;
+	ClusterData clusterData;
+	ShadowData shadowData;
+};
+
+ConstantBuffer<BindData> bindData : register(b0);
+
+float ComputeFogDensity(float3 position)
+{
+	return bindData.density * exp(-bindData.heightFalloff * max(position.z - bindData.baseHeight, 0.f));
+}
+
+// Radiance scattered towards the viewer by a local light, before the scattering coefficient.
+float3 SampleLocalLight(Light light, float3 position, float3 viewDirection)
+{
+	float3 toLight = light.position - position;
+	const float distance = length(toLight);
+	toLight /= max(distance, 0.0001f);
+
+	float attenuation = ComputeLightAttenuation(light, distance);
+
+	if (light.type == LightType::Spot)
+	{
+		attenuation *= smoothstep(light.spotCosOuter, light.spotCosInner, dot(-toLight, light.direction));
+	}
+
+	else if (light.type == LightType::Area)
+	{
+		attenuation *= saturate(dot(-toLight, light.direction));  // One sided.
+	}
+
+	return light.color * attenuation * HenyeyGreensteinPhase(dot(-viewDirection, toLight), bindData.anisotropy);
+}
+
+[RootSignature(RS)]
+[numthreads(4, 4, 4)]
+void Main(uint3 dispatchId : SV_DispatchThreadID)
+{
+	RWTexture3D<float4> outputTexture = ResourceDescriptorHeap[bindData.outputTexture];
+
+	uint width, height, depth;
+	outputTexture.GetDimensions(width, height, depth);
+
+	if (any(dispatchId >= uint3(width, height, depth)))
+		return;
+
+	StructuredBuffer<Camera> cameraBuffer = ResourceDescriptorHeap[bindData.cameraBuffer];
+	StructuredBuffer<Light> lights = ResourceDescriptorHeap[bindData.lightBuffer];
+	StructuredBuffer<uint> clusteredLightList = ResourceDescriptorHeap[bindData.clusterData.lightListBuffer];
+	StructuredBuffer<uint2> clusteredLightInfo = ResourceDescriptorHeap[bindData.clusterData.lightInfoBuffer];
+	StructuredBuffer<uint> directionalLightList = ResourceDescriptorHeap[bindData.clusterData.directionalLightListBuffer];
+	StructuredBuffer<float3> atmosphereIrradiance = ResourceDescriptorHeap[bindData.atmosphereIrradianceBuffer];
+	Texture2D<float> cloudShadowTexture = ResourceDescriptorHeap[bindData.cloudShadowTexture];
+
+	Camera camera = cameraBuffer[bindData.cameraIndex];
+
+	// Each frame samples a different depth within the slice, the temporal blend integrates them.
+	const float2 uv = (dispatchId.xy + 0.5.xx) / float2(width, height);
+	const float viewDepth = FogSliceToDepth((dispatchId.z + bindData.jitter) / depth, bindData.range);
+
+	float4 positionVS = ClipToViewSpace(camera, UvToClipSpace(uv));
+	positionVS.xyz *= viewDepth / -positionVS.z;
+	const float3 position = mul(float4(positionVS.xyz, 1.f), camera.inverseView).xyz;
+	const float3 viewDirection = normalize(camera.position.xyz - position);
+
+	const float density = ComputeFogDensity(position);
+	float3 luminance = 0.xxx;
+
+	if (density > 0.f)
+	{
+		// Directional lights are the sun, lit by the atmosphere the same as in the forward pass.
+		const uint directionalLightCount = directionalLightList[0];
+		for (uint i = 0; i < directionalLightCount; ++i)
+		{
+			Light light = lights[directionalLightList[1 + i]];
+
+			float visibility = CalculateSunVisibility(position / 1000.f, -light.direction, cloudShadowTexture, bindData.weatherScroll);
+			visibility *= CalculateCascadedShadow(bindData.shadowData, cameraBuffer, position, 0.xxx, viewDepth);
+
+			const float phase = HenyeyGreensteinPhase(dot(-viewDirection, -light.direction), bindData.anisotropy);
+			luminance += light.color * atmosphereIrradiance[0] * visibility * phase;
+		}
+
+		// Sky light is treated as uniform over the sphere.
+		luminance += atmosphereIrradiance[1] * IsotropicPhase(0.f);
+
+		// Local lights come from the cluster grid, binned up to the fog range even where there's no geometry.
+		const float2 positionSS = uv * bindData.outputResolution;
+		uint3 clusterId = DrawToClusterId(bindData.clusterData.froxelSize, bindData.clusterData.logY, camera, positionSS, -viewDepth);
+		clusterId = min(clusterId, bindData.clusterData.dimensions - 1);
+		const uint2 lightInfo = clusteredLightInfo[ClusterId2Index(bindData.clusterData.dimensions, clusterId)];
+		for (uint j = 0; j < lightInfo.y; ++j)
+		{
+			const Light light = lights[clusteredLightList[lightInfo.x + j]];
+			if (light.type == LightType::Probe)
+				continue;  // Binned with the lights, but they don't emit.
+
+			luminance += SampleLocalLight(light, position, viewDirection);
+		}
+	}
+
+	// Scattering and extinction.
+	float4 result = float4(luminance * bindData.albedo * density, density);
+
+	if (bindData.historyTexture != 0)
+	{
+		Texture3D<float4> historyTexture = ResourceDescriptorHeap[bindData.historyTexture];
+
+		// Reproject into last frame's grid, the last frame matrices are unjittered.
+		const float4 lastPositionVS = mul(float4(position, 1.f), camera.lastFrameView);
+		const float4 lastPositionCS = mul(lastPositionVS, camera.lastFrameProjection);
+		const float2 lastUv = ClipSpaceToUv(lastPositionCS / lastPositionCS.w);
+		const float lastSlice = FogDepthToSlice(-lastPositionVS.z, bindData.range);
+		const float3 lastUvw = float3(lastUv, lastSlice);
+
+		if (all(lastUvw >= 0.f) && all(lastUvw <= 1.f) && lastPositionVS.z < 0.f)
+		{
+			const float4 history = historyTexture.SampleLevel(bilinearClamp, lastUvw, 0);
+			result = lerp(result, history, bindData.historyWeight);
+		}
+	}
+
+	outputTexture[dispatchId] = result;
+}
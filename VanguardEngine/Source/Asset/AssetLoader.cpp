@@ -3,6 +3,7 @@
 #include <Asset/AssetLoader.h>
 #include <Asset/TextureLoader.h>
 #include <Asset/AssetManager.h>
+#include <Asset/MeshCache.h>
 #include <Rendering/Device.h>
 #include <Rendering/RenderComponents.h>
 #include <Rendering/PrimitiveAssembly.h>
@@ -10,24 +11,282 @@
 #include <Rendering/Resource.h>
 #include <Rendering/ShaderStructs.h>
 #include <Utility/StringTools.h>
+#include <Utility/HashCombine.h>
+#include <Utility/Math.h>
 
 #define TINYGLTF_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <tiny_gltf.h>
 
+#include <meshoptimizer.h>
+
 #include <vector>
 #include <list>
 #include <utility>
 #include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+#include <memory>
+#include <cstring>
 
 namespace AssetLoader
 {
-	size_t CreateMaterial(RenderDevice& device, const tinygltf::Material& material, const tinygltf::Model& model)
+	constexpr float overdrawThreshold = 1.05f;  // Allowed vertex cache efficiency loss when optimizing for overdraw.
+
+	// Covers the source file and its buffers, along with the import options.
+	size_t HashMeshSource(const std::filesystem::path& path, const tinygltf::Model& model, bool optimize, bool quantize)
+	{
+		VGScopedCPUStat("Hash Mesh Source");
+
+		std::ifstream stream{ path, std::ios::binary };
+		const std::string source{ std::istreambuf_iterator<char>{ stream }, std::istreambuf_iterator<char>{} };
+
+		size_t hash = std::hash<std::string_view>{}(source);
+		for (const auto& buffer : model.buffers)
+		{
+			HashCombine(hash, std::string_view{ reinterpret_cast<const char*>(buffer.data.data()), buffer.data.size() });
+		}
+
+		HashCombine(hash, optimize, quantize);
+
+		return hash;
+	}
+
+	TransformComponent ReadNodeTransform(const tinygltf::Node& node)
+	{
+		auto scale = XMVectorReplicate(1.f);
+		auto rotation = XMQuaternionIdentity();
+		auto translation = XMVectorZero();
+
+		// Column major matrices of column vectors, read in order that's the row vector matrix we use.
+		if (node.matrix.size() == 16)
+		{
+			XMFLOAT4X4 matrix;
+			for (int i = 0; i < 16; ++i)
+			{
+				matrix.m[i / 4][i % 4] = static_cast<float>(node.matrix[i]);
+			}
+
+			XMMatrixDecompose(&scale, &rotation, &translation, XMLoadFloat4x4(&matrix));
+		}
+
+		else
+		{
+			if (node.scale.size() == 3)
+			{
+				scale = XMVectorSet(static_cast<float>(node.scale[0]), static_cast<float>(node.scale[1]), static_cast<float>(node.scale[2]), 0.f);
+			}
+
+			if (node.rotation.size() == 4)
+			{
+				rotation = XMVectorSet(static_cast<float>(node.rotation[0]), static_cast<float>(node.rotation[1]), static_cast<float>(node.rotation[2]), static_cast<float>(node.rotation[3]));
+			}
+
+			if (node.translation.size() == 3)
+			{
+				translation = XMVectorSet(static_cast<float>(node.translation[0]), static_cast<float>(node.translation[1]), static_cast<float>(node.translation[2]), 0.f);
+			}
+		}
+
+		// Transforms rotate by their negated angles.
+		const auto angles = QuaternionToEuler(rotation);
+
+		TransformComponent transform;
+		XMStoreFloat3(&transform.scale, scale);
+		transform.rotation = { -angles.x, -angles.y, -angles.z };
+		XMStoreFloat3(&transform.translation, translation);
+
+		return transform;
+	}
+
+	// Subsets are numbered by mesh then primitive, the order the assemblies are built in. Fills the flattened index of each
+	// of the model's nodes, negative for nodes outside of the scene.
+	std::vector<ModelNode> ReadSceneNodes(const tinygltf::Model& model, const tinygltf::Scene& scene, std::vector<int32_t>& flattenedNodes)
 	{
-		size_t result = AssetManager::Get().EnqueueMaterialLoad(material);
+		std::vector<size_t> meshSubsets;  // First subset of each mesh.
+		meshSubsets.reserve(model.meshes.size());
+
+		size_t subsets = 0;
+		for (const auto& mesh : model.meshes)
+		{
+			meshSubsets.emplace_back(subsets);
+			subsets += mesh.primitives.size();
+		}
+
+		std::vector<ModelNode> nodes;
+		std::vector<std::pair<int, int32_t>> stack;  // Source node and the index of its flattened parent.
+		flattenedNodes.assign(model.nodes.size(), -1);
+
+		for (auto it = scene.nodes.rbegin(); it != scene.nodes.rend(); ++it)
+		{
+			stack.emplace_back(*it, -1);
+		}
+
+		while (!stack.empty())
+		{
+			const auto [index, parent] = stack.back();
+			stack.pop_back();
+
+			const auto& node = model.nodes[index];
+			const auto flattened = static_cast<int32_t>(nodes.size());
+			flattenedNodes[index] = flattened;
+
+			auto& entry = nodes.emplace_back();
+			entry.name = node.name;
+			entry.parent = parent;
+			entry.transform = ReadNodeTransform(node);
+			entry.skin = node.skin;
+
+			if (node.mesh >= 0)
+			{
+				entry.firstSubset = meshSubsets[node.mesh];
+				entry.subsetCount = model.meshes[node.mesh].primitives.size();
+			}
+
+			for (auto it = node.children.rbegin(); it != node.children.rend(); ++it)
+			{
+				stack.emplace_back(*it, flattened);
+			}
+		}
+
+		return nodes;
+	}
+
+	// Copies the elements of a float accessor, nothing for other component types. Elements smaller than T are zero extended.
+	template <typename T>
+	std::vector<T> ReadFloatAccessor(const tinygltf::Model& model, int index)
+	{
+		std::vector<T> result;
+		if (index < 0)
+			return result;
+
+		const auto& accessor = model.accessors[index];
+		if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || accessor.bufferView < 0)
+			return result;
+
+		const auto& bufferView = model.bufferViews[accessor.bufferView];
+		const auto stride = accessor.ByteStride(bufferView);
+		if (stride <= 0)
+			return result;
+
+		const auto elementSize = std::min<size_t>(tinygltf::GetNumComponentsInType(accessor.type) * sizeof(float), sizeof(T));
+		const auto* data = model.buffers[bufferView.buffer].data.data() + bufferView.byteOffset + accessor.byteOffset;
+
+		result.resize(accessor.count);
+		for (size_t i = 0; i < accessor.count; ++i)
+		{
+			std::memcpy(&result[i], data + i * stride, elementSize);
+		}
+
 		return result;
 	}
 
+	std::vector<ModelSkin> ReadSkins(const tinygltf::Model& model, const std::vector<int32_t>& flattenedNodes)
+	{
+		XMFLOAT4X4 identity;
+		XMStoreFloat4x4(&identity, XMMatrixIdentity());
+
+		std::vector<ModelSkin> skins;
+		skins.reserve(model.skins.size());
+
+		for (const auto& skin : model.skins)
+		{
+			auto& entry = skins.emplace_back();
+			entry.joints.reserve(skin.joints.size());
+			for (const auto joint : skin.joints)
+			{
+				entry.joints.emplace_back(flattenedNodes[joint]);
+			}
+
+			// Column major matrices of column vectors, read in order that's the row vector matrix we use. Skins without
+			// matrices are bound at the joints' origins.
+			entry.inverseBindMatrices = ReadFloatAccessor<XMFLOAT4X4>(model, skin.inverseBindMatrices);
+			entry.inverseBindMatrices.resize(skin.joints.size(), identity);
+		}
+
+		return skins;
+	}
+
+	// Channels of nodes outside of the scene and of morph target weights are dropped, as are keyframes that aren't floats.
+	std::shared_ptr<const std::vector<AnimationClip>> ReadAnimations(const tinygltf::Model& model, const std::vector<int32_t>& flattenedNodes)
+	{
+		if (model.animations.empty())
+		{
+			return nullptr;
+		}
+
+		auto clips = std::make_shared<std::vector<AnimationClip>>();
+		clips->reserve(model.animations.size());
+
+		for (const auto& animation : model.animations)
+		{
+			auto& clip = clips->emplace_back();
+			clip.name = animation.name;
+
+			for (const auto& channel : animation.channels)
+			{
+				if (channel.target_node < 0 || flattenedNodes[channel.target_node] < 0)
+					continue;
+
+				AnimationChannel entry{ .node = static_cast<uint32_t>(flattenedNodes[channel.target_node]) };
+
+				if (channel.target_path == "translation") entry.path = AnimationPath::Translation;
+				else if (channel.target_path == "rotation") entry.path = AnimationPath::Rotation;
+				else if (channel.target_path == "scale") entry.path = AnimationPath::Scale;
+				else continue;
+
+				const auto& sampler = animation.samplers[channel.sampler];
+				if (sampler.interpolation == "STEP") entry.interpolation = AnimationInterpolation::Step;
+				else if (sampler.interpolation == "CUBICSPLINE") entry.interpolation = AnimationInterpolation::CubicSpline;
+				else entry.interpolation = AnimationInterpolation::Linear;
+
+				entry.times = ReadFloatAccessor<float>(model, sampler.input);
+				entry.values = ReadFloatAccessor<XMFLOAT4>(model, sampler.output);
+
+				const size_t keyValues = entry.interpolation == AnimationInterpolation::CubicSpline ? 3 : 1;
+				if (entry.times.empty() || entry.values.size() != entry.times.size() * keyValues)
+				{
+					VGLogWarning(logAsset, "Dropping animation channel with unsupported keyframes in animation '{}'.", Str2WideStr(animation.name));
+					continue;
+				}
+
+				clip.duration = std::max(clip.duration, entry.times.back());
+				clip.channels.emplace_back(std::move(entry));
+			}
+		}
+
+		return clips;
+	}
+
+	// Joint indices are stored as integers and weights as floats or normalized integers, the mesh factory reads both as floats.
+	std::vector<unsigned char> ConvertSkinAttribute(const tinygltf::Accessor& accessor, const unsigned char* data, bool normalized)
+	{
+		std::vector<unsigned char> converted(accessor.count * sizeof(XMFLOAT4));
+		auto* target = reinterpret_cast<float*>(converted.data());
+
+		for (size_t i = 0; i < accessor.count * 4; ++i)
+		{
+			switch (accessor.componentType)
+			{
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: target[i] = data[i] / (normalized ? 255.f : 1.f); break;
+			case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: target[i] = reinterpret_cast<const uint16_t*>(data)[i] / (normalized ? 65535.f : 1.f); break;
+			default: target[i] = reinterpret_cast<const float*>(data)[i]; break;
+			}
+		}
+
+		return converted;
+	}
+
+	// Keeps images encoded instead of decoding them during the import, materials decode them in parallel as they load.
+	bool StoreEncodedImage(tinygltf::Image* image, const int, std::string*, std::string*, int, int, const unsigned char* bytes, int size, void*)
+	{
+		image->image.assign(bytes, bytes + size);
+		image->as_is = true;
+
+		return true;
+	}
+
 	template <typename T, typename U, typename V>
 	auto FindVertexAttribute(const char* name, U&& model, V&& primitive) -> std::pair<const T*, size_t>
 	{
@@ -47,36 +306,37 @@ namespace AssetLoader
 		return { nullptr, 0 };
 	}
 
-	MeshComponent LoadMesh(RenderDevice& device, MeshFactory& factory, const std::filesystem::path& path)
+	std::optional<MeshImport> ImportMesh(const MeshFactory& factory, const std::filesystem::path& path, bool optimize, bool quantize)
 	{
-		VGScopedCPUStat("Load Mesh");
+		VGScopedCPUStat("Import Mesh");
 
 		if (!std::filesystem::exists(path))
 		{
 			VGLogError(logAsset, "Asset '{}' does not exist in the filesystem.", path.filename().generic_wstring());
-			return {};
+			return std::nullopt;
 		}
 
 		std::string error;
 		std::string warning;
 
-		tinygltf::Model& model = AssetManager::Get().models.emplace_back();
-		AssetManager::Get().newModel = true;
+		MeshImport result;
+		auto& model = result.model;
 		tinygltf::TinyGLTF loader;
+		loader.SetImageLoader(&StoreEncodedImage, nullptr);
 
-		bool result = false;
+		bool loaded = false;
 
 		{
 			VGScopedCPUStat("Import");
 
 			if (path.has_extension() && path.extension() == ".gltf")
 			{
-				result = loader.LoadASCIIFromFile(&model, &error, &warning, path.generic_string());
+				loaded = loader.LoadASCIIFromFile(&model, &error, &warning, path.generic_string());
 			}
 
 			else if (path.has_extension() && path.extension() == ".glb")
 			{
-				result = loader.LoadBinaryFromFile(&model, &error, &warning, path.generic_string());
+				loaded = loader.LoadBinaryFromFile(&model, &error, &warning, path.generic_string());
 			}
 
 			else
@@ -95,7 +355,7 @@ namespace AssetLoader
 			VGLogError(logAsset, "GLTF load: {}", Str2WideStr(error));
 		}
 
-		if (!result)
+		if (!loaded)
 		{
 			VGLogError(logAsset, "Failed to load asset '{}'.", path.filename().generic_wstring());
 		}
@@ -106,10 +366,9 @@ namespace AssetLoader
 		}
 
 		std::vector<PrimitiveAssembly> assemblies;
-		std::vector<size_t> materials;
 		std::vector<uint32_t> materialIndices;
-		std::vector<float> boundingSpheres;
 		std::list<std::vector<uint32_t>> indices;  // We convert indices instead of using TinyGLTF's stream. One buffer per assembly. Stable buffers.
+		std::list<std::vector<unsigned char>> vertices;  // Reordered vertex streams of optimized assemblies, one buffer per attribute. Stable buffers.
 
 		if (model.scenes.size() > 1)
 		{
@@ -118,34 +377,41 @@ namespace AssetLoader
 		else if (model.scenes.size() < 1)
 		{
 			VGLogWarning(logAsset, "Asset '{}' does not contain any scenes.", path.filename().generic_wstring());
-			return {};
+			return std::nullopt;
 		}
 
 		const auto& scene = model.scenes[model.defaultScene];
 		if (scene.nodes.size() == 0)
 		{
 			VGLogWarning(logAsset, "Asset '{}' does not contain any nodes in the scene.", path.filename().generic_wstring());
-			return {};
+			return std::nullopt;
 		}
 
-		for (const auto& material : model.materials)
-		{
-			materials.emplace_back(CreateMaterial(device, material, model));
-		}
+		std::vector<int32_t> flattenedNodes;
+		result.nodes = ReadSceneNodes(model, scene, flattenedNodes);
 
-		//for (const auto nodeIndex : scene.nodes)
-		for (const auto& mesh : model.meshes)
+		// Read ahead of the cooked mesh, which releases the model's buffers.
+		result.skins = ReadSkins(model, flattenedNodes);
+		result.animations = ReadAnimations(model, flattenedNodes);
+
+		const auto sourceHash = HashMeshSource(path, model, optimize, quantize);
+
+		result.cacheFile = std::make_unique<MappedFile>();
+		if (LoadMeshCache(*result.cacheFile, sourceHash, result.mesh.component, result.data))
 		{
-			//const auto& node = model.nodes[nodeIndex];
+			VGLog(logAsset, "Loaded cooked mesh of asset '{}'.", path.filename().generic_wstring());
 
-			// Process the node's mesh.
-			//if (node.mesh >= 0)
-			//model.meshes[node.mesh]
+			// Only the materials and their encoded images are needed from here on.
+			model.buffers = {};
 
-			// Process all the node's children.
-			//for (const auto child : node.children)
-			//model.nodes[child]
+			return result;
+		}
+
+		result.cacheFile.reset();
 
+		// Every mesh is built once, nodes instance them by subset range.
+		for (const auto& mesh : model.meshes)
+		{
 			for (const auto& primitive : mesh.primitives)
 			{
 				PrimitiveAssembly assembly;
@@ -179,44 +445,67 @@ namespace AssetLoader
 					}
 				}
 
+				const auto getAttributeData = [&model](const tinygltf::Accessor& accessor)
+				{
+					const auto& bufferView = model.bufferViews[accessor.bufferView];
+					const auto& buffer = model.buffers[bufferView.buffer];
+					return buffer.data.data() + accessor.byteOffset + bufferView.byteOffset;
+				};
+
+				VGAssert(primitive.attributes.contains("POSITION"), "Primitives must contain vertex positions.");
+				const auto& positionAccessor = model.accessors[primitive.attributes.at("POSITION")];
+				auto vertexCount = positionAccessor.count;
+
+				// Reorder the triangles for the post-transform cache and then for overdraw, before reversing the winding since
+				// meshoptimizer expects counter-clockwise front faces. Then reorder the vertices for fetch locality.
+				std::vector<uint32_t> vertexRemap;
+				if (optimize)
+				{
+					const auto* positions = reinterpret_cast<const float*>(getAttributeData(positionAccessor));
+					meshopt_optimizeVertexCache(primitiveIndices.data(), primitiveIndices.data(), primitiveIndices.size(), vertexCount);
+					meshopt_optimizeOverdraw(primitiveIndices.data(), primitiveIndices.data(), primitiveIndices.size(), positions, vertexCount, sizeof(XMFLOAT3), overdrawThreshold);
+
+					vertexRemap.resize(vertexCount);
+					vertexCount = meshopt_optimizeVertexFetchRemap(vertexRemap.data(), primitiveIndices.data(), primitiveIndices.size(), positionAccessor.count);
+					meshopt_remapIndexBuffer(primitiveIndices.data(), primitiveIndices.data(), primitiveIndices.size(), vertexRemap.data());
+				}
+
 				indices.emplace_back(std::move(primitiveIndices));
 				assembly.AddIndexStream(std::span{ indices.back().data(), indexAccessor.count });
 
 				for (const auto& [name, idx] : primitive.attributes)
 				{
 					const auto& accessor = model.accessors[idx];
-					const auto& bufferView = model.bufferViews[accessor.bufferView];
-					const auto& buffer = model.buffers[bufferView.buffer];
-					const auto* data = buffer.data.data() + accessor.byteOffset + bufferView.byteOffset;
+					VGAssert(accessor.count == positionAccessor.count, "Mismatched vertex attribute counts.");
+					const auto* data = getAttributeData(accessor);
+					auto elementSize = tinygltf::GetComponentSizeInBytes(accessor.componentType) * tinygltf::GetNumComponentsInType(accessor.type);
 
-					switch (accessor.type)
+					if ((name == "JOINTS_0" || name == "WEIGHTS_0") && accessor.type == TINYGLTF_TYPE_VEC4 && accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT)
 					{
-					case TINYGLTF_TYPE_VEC2: assembly.AddVertexStream(name, std::span{ (XMFLOAT2*)data, accessor.count }); break;
-					case TINYGLTF_TYPE_VEC3: assembly.AddVertexStream(name, std::span{ (XMFLOAT3*)data, accessor.count }); break;
-					case TINYGLTF_TYPE_VEC4: assembly.AddVertexStream(name, std::span{ (XMFLOAT4*)data, accessor.count }); break;
-					default: VGAssert(false, "Unknown primitive accessor type."); break;
+						data = vertices.emplace_back(ConvertSkinAttribute(accessor, data, name == "WEIGHTS_0")).data();
+						elementSize = sizeof(XMFLOAT4);
 					}
-				}
 
-				const auto* positionStream = reinterpret_cast<XMFLOAT3*>(assembly.GetAttributeData("POSITION"));
-				const auto positionCount = assembly.GetAttributeCount("POSITION");
-				float radius = 0.f;
+					// Vertex buffers can be shared between primitives, so remap into our own copy.
+					if (vertexRemap.size() > 0)
+					{
+						auto& remapped = vertices.emplace_back(vertexCount * elementSize);
+						meshopt_remapVertexBuffer(remapped.data(), data, accessor.count, elementSize, vertexRemap.data());
+						data = remapped.data();
+					}
 
-				for (int i = 0; i < positionCount; ++i)
-				{
-					radius = std::max(
-						std::max(
-							std::max(radius, positionStream[i].x),
-							positionStream[i].y
-						),
-						positionStream[i].z
-					);
+					switch (accessor.type)
+					{
+					case TINYGLTF_TYPE_VEC2: assembly.AddVertexStream(name, std::span{ (XMFLOAT2*)data, vertexCount }); break;
+					case TINYGLTF_TYPE_VEC3: assembly.AddVertexStream(name, std::span{ (XMFLOAT3*)data, vertexCount }); break;
+					case TINYGLTF_TYPE_VEC4: assembly.AddVertexStream(name, std::span{ (XMFLOAT4*)data, vertexCount }); break;
+					default: VGAssert(false, "Unknown primitive accessor type."); break;
+					}
 				}
 
-				// Can't use since it's too large for a single meshlet...
-				//auto bounds = meshopt_computeClusterBounds(assembly.GetIndexStream().data(), assembly.GetIndexStream().size(), positionStream, assembly.GetAttributeCount("POSITION"), sizeof(XMFLOAT3));
+				// Primitives are too large for a single meshlet, the mesh factory splits them and computes per-meshlet bounds,
+				// along with the bounds of the whole subset.
 
-				boundingSpheres.emplace_back(radius);
 				assemblies.emplace_back(std::move(assembly));
 				materialIndices.emplace_back(primitive.material);
 			}
@@ -231,6 +520,41 @@ namespace AssetLoader
 			}
 		}
 
-		return factory.CreateMeshComponent(assemblies, materials, materialIndices, boundingSpheres);
+		// The assemblies view the model and the streams above, the built mesh owns its data.
+		result.mesh = factory.BuildMesh(assemblies, materialIndices, quantize);
+		result.data = result.mesh.View();
+
+		model.buffers = {};
+
+		if (!SaveMeshCache(sourceHash, result.mesh))
+		{
+			VGLogWarning(logAsset, "Failed to cook mesh of asset '{}'.", path.filename().generic_wstring());
+		}
+
+		return result;
+	}
+
+	MeshComponent FinalizeMesh(MeshFactory& factory, MeshImport&& import)
+	{
+		VGScopedCPUStat("Finalize Mesh");
+
+		// Materials are loaded over time from the model, their buffer indices are available immediately. The model is
+		// released along with the import, the queued materials keep its encoded images.
+		const auto materials = AssetManager::Get().EnqueueMaterialLoads(import.model);
+
+		return factory.UploadMesh(std::move(import.mesh.component), import.data, materials);
+	}
+
+	MeshComponent LoadMesh(RenderDevice& device, MeshFactory& factory, const std::filesystem::path& path)
+	{
+		VGScopedCPUStat("Load Mesh");
+
+		auto import = ImportMesh(factory, path, *CvarGet("meshOptimization", int) > 0, *CvarGet("vertexQuantization", int) > 0);
+		if (!import)
+		{
+			return {};
+		}
+
+		return FinalizeMesh(factory, std::move(*import));
 	}
 }
\ No newline at end of file
@@ -3,13 +3,59 @@
 #pragma once
 
 #include <Rendering/RenderComponents.h>
+#include <Rendering/MeshFactory.h>
+#include <Core/CoreComponents.h>
+#include <Utility/MappedFile.h>
+
+#include <tiny_gltf.h>
 
 #include <filesystem>
+#include <optional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
 
 class RenderDevice;
-class MeshFactory;
 
 namespace AssetLoader
 {
+	// Node of the model's scene, the hierarchy is flattened with parents before their children.
+	struct ModelNode
+	{
+		std::string name;
+		int32_t parent;  // Index of the parent node, negative for the scene's roots.
+		TransformComponent transform;  // Relative to the parent.
+		size_t firstSubset = 0;
+		size_t subsetCount = 0;  // Of the node's mesh, zero for nodes without one.
+		int32_t skin = -1;  // Index of the skin deforming the node's mesh, negative for none.
+	};
+
+	// Joints deforming the meshes of the nodes using the skin.
+	struct ModelSkin
+	{
+		std::vector<int32_t> joints;  // Indices of the joint nodes, negative for joints outside of the scene.
+		std::vector<XMFLOAT4X4> inverseBindMatrices;
+	};
+
+	// Parsed and encoded mesh, along with the model its materials are loaded from.
+	struct MeshImport
+	{
+		tinygltf::Model model;
+		MeshFactory::MeshData mesh;  // Only the component is set when loaded from the mesh cache.
+		std::unique_ptr<MappedFile> cacheFile;
+		MeshFactory::MeshDataView data;  // Views either the built mesh or the mapped cache entry.
+		std::vector<ModelNode> nodes;  // Read from the model, so cached meshes keep their hierarchy.
+		std::vector<ModelSkin> skins;
+		std::shared_ptr<const std::vector<AnimationClip>> animations;  // Channels animate nodes by index, null without any.
+	};
+
+	// Parses and encodes the mesh without touching the device or asset manager, safe to call from any thread. Encoded
+	// meshes are cooked into the mesh cache, later imports of the same source map the cooked mesh instead of encoding.
+	// Images are left encoded in the model, they're decoded as their materials load.
+	std::optional<MeshImport> ImportMesh(const MeshFactory& factory, const std::filesystem::path& path, bool optimize, bool quantize);
+	// Uploads an imported mesh and queues its materials, on the render thread.
+	MeshComponent FinalizeMesh(MeshFactory& factory, MeshImport&& import);
+
 	MeshComponent LoadMesh(RenderDevice& device, MeshFactory& factory, const std::filesystem::path& path);
 }
\ No newline at end of file
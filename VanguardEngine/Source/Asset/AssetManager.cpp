@@ -2,105 +2,545 @@
 
 #include <Asset/AssetManager.h>
 #include <Asset/AssetLoader.h>
+#include <Asset/TextureLoader.h>
 #include <Rendering/Renderer.h>
 #include <Rendering/ShaderStructs.h>
+#include <Rendering/ResourceFormat.h>
+#include <Core/CoreComponents.h>
+#include <Core/CoreSystems.h>
+#include <Utility/HashCombine.h>
+#include <Threading/Thread.h>
+#include <Core/Memory.h>
 
-MeshComponent AssetManager::LoadModel(const std::filesystem::path& path)
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <tuple>
+#include <unordered_map>
+
+namespace
+{
+	// Single node models without a transform of their own are given to the entity as one mesh.
+	bool HasHierarchy(const std::vector<AssetLoader::ModelNode>& nodes)
+	{
+		if (nodes.size() != 1)
+		{
+			return nodes.size() > 1;
+		}
+
+		const auto& transform = nodes.front().transform;
+		const auto identity = TransformComponent{};
+
+		return std::memcmp(&transform, &identity, sizeof(TransformComponent)) != 0;
+	}
+}
+
+size_t AssetManager::GetModelKey(const std::filesystem::path& path, bool optimize, bool quantize) const
 {
-	return AssetLoader::LoadMesh(*device, *Renderer::Get().meshFactory, path);
+	size_t hash = 0;
+	HashCombine(hash, std::filesystem::absolute(path).lexically_normal().generic_wstring(), optimize, quantize);
+
+	return hash;
 }
 
-size_t AssetManager::EnqueueMaterialLoad(const tinygltf::Material& material)
+void AssetManager::UpdateModelOffsets()
 {
-	VGAssert(models.size() > 0, "No models available to queue materials for.");
+	const auto& factory = *Renderer::Get().meshFactory;
+	if (factory.GetRevision() == meshRevision)
+	{
+		return;
+	}
+
+	for (auto& [key, model] : loadedModels)
+	{
+		if (const auto offset = factory.GetRelocation(model.mesh.globalOffset.index); offset && !model.loading)
+		{
+			model.mesh.globalOffset = *offset;
+		}
+	}
 
-	const auto index = Renderer::Get().materialFactory->Create();
+	meshRevision = factory.GetRevision();
+}
 
-	if (newModel)
+void AssetManager::FinalizeImport(PendingModel& pending)
+{
+	auto import = pending.import.get();
+	if (!import)
 	{
-		modelMaterialQueues.emplace_back();
-		newModel = false;
+		loadedModels.erase(pending.key);
+
+		return;
 	}
-	modelMaterialQueues.back().emplace(std::make_pair(material, index));
 
-	return index;
+	auto& model = loadedModels.at(pending.key);
+	model.nodes = std::move(import->nodes);
+	model.skins = std::move(import->skins);
+	model.animations = std::move(import->animations);
+	model.mesh = AssetLoader::FinalizeMesh(*Renderer::Get().meshFactory, std::move(*import));
+	model.loading = false;
 }
 
-void AssetManager::Update()
+void AssetManager::InstantiateNodes(entt::registry& registry, entt::entity root, LoadedModel& model)
 {
-	tinygltf::Model* model = nullptr;
-	MaterialQueue* queue = nullptr;
+	std::vector<entt::entity> entities;
+	entities.reserve(model.nodes.size());
 
-	while (models.size() > 0)
+	// Parents are created before their children.
+	for (const auto& node : model.nodes)
 	{
-		queue = &modelMaterialQueues.front();
-		if (queue->size() == 0)
+		const auto entity = registry.create();
+		if (!node.name.empty())
 		{
-			models.pop_front();
-			modelMaterialQueues.pop_front();
+			registry.emplace<NameComponent>(entity, node.name);
 		}
 
-		else
+		registry.emplace<TransformComponent>(entity, node.transform);
+		TransformSystem::Attach(registry, entity, node.parent < 0 ? root : entities[node.parent]);
+
+		entities.emplace_back(entity);
+	}
+
+	// Joints can follow the nodes they deform, so skins are bound once every node exists.
+	for (size_t i = 0; i < model.nodes.size(); ++i)
+	{
+		const auto& node = model.nodes[i];
+		const auto entity = entities[i];
+
+		// Added ahead of the mesh, so the renderer sees the skin along with it.
+		if (node.subsetCount > 0 && node.skin >= 0 && static_cast<size_t>(node.skin) < model.skins.size())
 		{
-			model = &models.front();
-			break;
+			const auto& skin = model.skins[node.skin];
+
+			SkinComponent skinComponent{ .inverseBindMatrices = skin.inverseBindMatrices };
+			skinComponent.joints.reserve(skin.joints.size());
+			for (const auto joint : skin.joints)
+			{
+				skinComponent.joints.emplace_back(joint < 0 ? entt::null : entities[joint]);
+			}
+
+			registry.emplace<SkinComponent>(entity, std::move(skinComponent));
+		}
+
+		if (node.subsetCount > 0)
+		{
+			MeshComponent mesh{
+				.subsets = { model.mesh.subsets.begin() + node.firstSubset, model.mesh.subsets.begin() + node.firstSubset + node.subsetCount },
+				.globalOffset = model.mesh.globalOffset,
+				.metadata = model.mesh.metadata
+			};
+
+			registry.emplace<MeshComponent>(entity, std::move(mesh));
+			++model.references;
+		}
+	}
+
+	if (model.animations)
+	{
+		registry.emplace_or_replace<AnimationComponent>(root, AnimationComponent{ .clips = model.animations, .nodes = std::move(entities) });
+	}
+}
+
+void AssetManager::FinalizeModels(entt::registry& registry)
+{
+	VGScopedCPUStat("Finalize Models");
+
+	UpdateModelOffsets();
+
+	for (auto it = pendingModels.begin(); it != pendingModels.end();)
+	{
+		if (it->import.wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready)
+		{
+			++it;
+			continue;
 		}
+
+		FinalizeImport(*it);
+		it = pendingModels.erase(it);
+	}
+
+	for (auto& [key, model] : loadedModels)
+	{
+		if (model.loading || model.waiting.empty())
+		{
+			continue;
+		}
+
+		for (const auto entity : model.waiting)
+		{
+			// The entity may have been destroyed while loading.
+			if (!registry.valid(entity))
+			{
+				continue;
+			}
+
+			if (HasHierarchy(model.nodes))
+			{
+				InstantiateNodes(registry, entity, model);
+			}
+
+			else
+			{
+				registry.emplace_or_replace<MeshComponent>(entity, model.mesh);
+				++model.references;
+			}
+
+			registry.emplace_or_replace<ModelComponent>(entity, model.path);
+		}
+
+		model.waiting.clear();
+	}
+}
+
+void AssetManager::Initialize(RenderDevice* inDevice)
+{
+	device = inDevice;
+
+	CvarCreate("assetUploadBudget", "Texture data uploaded by finishing material loads each frame, in megabytes. At least one material is uploaded each frame", 32);
+}
+
+MeshComponent AssetManager::LoadModel(const std::filesystem::path& path)
+{
+	const auto optimize = *CvarGet("meshOptimization", int) > 0;
+	const auto quantize = *CvarGet("vertexQuantization", int) > 0;
+	const auto key = GetModelKey(path, optimize, quantize);
+
+	UpdateModelOffsets();
+
+	if (auto it = loadedModels.find(key); it != loadedModels.end() && it->second.loading)
+	{
+		const auto pending = std::find_if(pendingModels.begin(), pendingModels.end(), [key](const auto& pending) { return pending.key == key; });
+		FinalizeImport(*pending);
+		pendingModels.erase(pending);
+	}
+
+	if (auto it = loadedModels.find(key); it != loadedModels.end())
+	{
+		++it->second.references;
+
+		return it->second.mesh;
+	}
+
+	auto mesh = AssetLoader::LoadMesh(*device, *Renderer::Get().meshFactory, path);
+	if (mesh.subsets.size() > 0)
+	{
+		loadedModels[key] = LoadedModel{ .mesh = mesh, .path = path, .references = 1, .loading = false };
 	}
 
-	if (!model)
+	return mesh;
+}
+
+void AssetManager::LoadModelAsync(const std::filesystem::path& path, entt::entity entity)
+{
+	// Console variables are read here, they aren't safe to read from the worker.
+	const auto optimize = *CvarGet("meshOptimization", int) > 0;
+	const auto quantize = *CvarGet("vertexQuantization", int) > 0;
+	const auto key = GetModelKey(path, optimize, quantize);
+
+	// Shared models give the entity their mesh during the next update.
+	auto [it, inserted] = loadedModels.try_emplace(key);
+	it->second.waiting.emplace_back(entity);
+
+	if (!inserted)
+	{
 		return;
-	
-	auto [material, bufferIndex] = queue->front();
-	queue->pop();
+	}
+
+	it->second.path = path;
+
+	auto& pending = pendingModels.emplace_back();
+	pending.key = key;
+	pending.import = std::async(std::launch::async, [factory = Renderer::Get().meshFactory.get(), path, optimize, quantize]()
+	{
+		// Streams in over several frames, off of the cores the frame runs on.
+		ScopedThreadPlacement placement{ ThreadPlacement::Efficiency };
+		ScopedMemoryTag memoryTag{ MemoryTag::Asset };
 
-	// Create a single material and upload it to the GPU.
+		return AssetLoader::ImportMesh(*factory, path, optimize, quantize);
+	});
+}
+
+void AssetManager::ReleaseModel(const MeshComponent& mesh)
+{
+	UpdateModelOffsets();
 
-	const auto CreateTexture = [&](int index, std::wstring_view name, DXGI_FORMAT format, bool mipmap) -> uint32_t
+	const auto it = std::find_if(loadedModels.begin(), loadedModels.end(), [&mesh](const auto& model)
 	{
-		if (index < 0)
+		return !model.second.loading && model.second.mesh.globalOffset.index == mesh.globalOffset.index;
+	});
+
+	if (it == loadedModels.end() || it->second.references == 0)
+	{
+		VGLogWarning(logAsset, "Released a model mesh which isn't loaded.");
+
+		return;
+	}
+
+	if (--it->second.references == 0 && it->second.waiting.empty())
+	{
+		Renderer::Get().meshFactory->FreeMesh(it->second.mesh);
+		loadedModels.erase(it);
+	}
+}
+
+std::optional<std::filesystem::path> AssetManager::GetModelPath(const MeshComponent& mesh)
+{
+	UpdateModelOffsets();
+
+	const auto it = std::find_if(loadedModels.begin(), loadedModels.end(), [&mesh](const auto& model)
+	{
+		return !model.second.loading && model.second.mesh.globalOffset.index == mesh.globalOffset.index;
+	});
+
+	if (it == loadedModels.end() || it->second.mesh.subsets.size() != mesh.subsets.size())
+	{
+		return std::nullopt;
+	}
+
+	return it->second.path;
+}
+
+std::vector<size_t> AssetManager::EnqueueMaterialLoads(tinygltf::Model& model)
+{
+	std::vector<size_t> materials;
+	if (model.materials.empty())
+	{
+		return materials;
+	}
+
+	auto images = std::make_shared<ModelImages>();
+	images->images.reserve(model.images.size());
+	for (auto& image : model.images)
+	{
+		images->images.emplace_back(std::move(image.image));
+	}
+
+	const auto GetAddressMode = [](int wrap)
+	{
+		switch (wrap)
 		{
-			return 0;
+		case TINYGLTF_TEXTURE_WRAP_CLAMP_TO_EDGE: return D3D12_TEXTURE_ADDRESS_MODE_CLAMP;
+		case TINYGLTF_TEXTURE_WRAP_MIRRORED_REPEAT: return D3D12_TEXTURE_ADDRESS_MODE_MIRROR;
+		default: return D3D12_TEXTURE_ADDRESS_MODE_WRAP;
 		}
+	};
+
+	images->textureSources.reserve(model.textures.size());
+	images->textureAddressModes.reserve(model.textures.size());
+	for (const auto& texture : model.textures)
+	{
+		images->textureSources.emplace_back(texture.source);
+
+		// Textures without a sampler repeat (GLTF 2.0 spec).
+		const auto sampler = texture.sampler >= 0 ? model.samplers[texture.sampler] : tinygltf::Sampler{};
+		images->textureAddressModes.emplace_back(GetAddressMode(sampler.wrapS), GetAddressMode(sampler.wrapT));
+	}
+
+	materials.reserve(model.materials.size());
+	for (auto& material : model.materials)
+	{
+		const auto index = Renderer::Get().materialFactory->Create();
+		materialQueue.emplace(QueuedMaterial{ std::move(material), images, index });
+		materials.emplace_back(index);
+	}
+
+	return materials;
+}
+
+void AssetManager::DecodeMaterials()
+{
+	VGScopedCPUStat("Decode Materials");
 
-		const auto& texture = model->images[model->textures[index].source];
+	// Roughness is stored in the first channel and metalness in the second, read back from green and blue (GLTF 2.0 spec).
+	constexpr auto metallicRoughnessSwizzle = D3D12_ENCODE_SHADER_4_COMPONENT_MAPPING(
+		D3D12_SHADER_COMPONENT_MAPPING_FORCE_VALUE_0,
+		D3D12_SHADER_COMPONENT_MAPPING_FROM_MEMORY_COMPONENT_0,
+		D3D12_SHADER_COMPONENT_MAPPING_FROM_MEMORY_COMPONENT_1,
+		D3D12_SHADER_COMPONENT_MAPPING_FORCE_VALUE_1);
 
-		TextureDescription description{
-			.bindFlags = BindFlag::ShaderResource,
-			.accessFlags = AccessFlag::CPUWrite,
-			.width = (uint32_t)texture.width,
-			.height = (uint32_t)texture.height,
-			.format = format,
-			.mipMapping = mipmap
+	while (pendingMaterials.size() < maxPendingMaterials && materialQueue.size() > 0)
+	{
+		const auto queued = std::move(materialQueue.front());
+		materialQueue.pop();
+
+		const auto& material = queued.material;
+		const auto& images = queued.images;
+
+		auto& pending = pendingMaterials.emplace_back();
+		pending.bufferIndex = queued.bufferIndex;
+
+		// Textures are transcoded to a block compressed format, BC4 and BC5 storing the given channels, with a swizzle
+		// restoring them to where the shaders expect them. Decodes share the model's encoded images.
+		const auto DecodeTexture = [&](int index, std::wstring_view name, DXGI_FORMAT format, bool mipmap, TextureChannel channel, size_t offset,
+			uint32_t firstChannel = 0, uint32_t secondChannel = 1, uint32_t swizzle = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING)
+		{
+			if (index < 0)
+			{
+				return;
+			}
+
+			auto& texture = pending.textures.emplace_back();
+			texture.name = name;
+			texture.swizzle = swizzle;
+			texture.mipmap = mipmap;
+			texture.channel = channel;
+			texture.offset = offset;
+			texture.image = std::async(std::launch::async, [images, source = images->textureSources[index], format, firstChannel, secondChannel]()
+			{
+				ScopedThreadPlacement placement{ ThreadPlacement::Efficiency };
+				ScopedMemoryTag memoryTag{ MemoryTag::Asset };
+
+				return AssetLoader::DecodeTexture(images->images[source], format, firstChannel, secondChannel);
+			});
 		};
-		auto resource = device->GetResourceManager().Create(description, name);
-		device->GetResourceManager().Write(resource, texture.image);
-		if (mipmap)
+
+		// #TODO: Include asset name in texture name.
+		DecodeTexture(material.pbrMetallicRoughness.baseColorTexture.index, VGText("Base color asset texture"), DXGI_FORMAT_BC1_UNORM_SRGB, true, TextureChannel::BaseColor, offsetof(MaterialData, baseColor));
+		DecodeTexture(material.pbrMetallicRoughness.metallicRoughnessTexture.index, VGText("Metallic roughness asset texture"), DXGI_FORMAT_BC5_UNORM, true, TextureChannel::MetallicRoughness, offsetof(MaterialData, metallicRoughness), 1, 2, metallicRoughnessSwizzle);
+		DecodeTexture(material.normalTexture.index, VGText("Normal asset texture"), DXGI_FORMAT_BC5_UNORM, true, TextureChannel::Normal, offsetof(MaterialData, normal));
+		DecodeTexture(material.occlusionTexture.index, VGText("Occlusion asset texture"), DXGI_FORMAT_BC4_UNORM, false, TextureChannel::Occlusion, offsetof(MaterialData, occlusion));
+		DecodeTexture(material.emissiveTexture.index, VGText("Emissive asset texture"), DXGI_FORMAT_BC1_UNORM_SRGB, false, TextureChannel::Emissive, offsetof(MaterialData, emissive));
+
+		auto& materialData = pending.data;
+		materialData.emissiveFactor.x = static_cast<float>(material.emissiveFactor[0]);
+		materialData.emissiveFactor.y = static_cast<float>(material.emissiveFactor[1]);
+		materialData.emissiveFactor.z = static_cast<float>(material.emissiveFactor[2]);
+		materialData.baseColorFactor.x = static_cast<float>(material.pbrMetallicRoughness.baseColorFactor[0]);
+		materialData.baseColorFactor.y = static_cast<float>(material.pbrMetallicRoughness.baseColorFactor[1]);
+		materialData.baseColorFactor.z = static_cast<float>(material.pbrMetallicRoughness.baseColorFactor[2]);
+		materialData.baseColorFactor.w = static_cast<float>(material.pbrMetallicRoughness.baseColorFactor[3]);
+		materialData.metallicFactor = static_cast<float>(material.pbrMetallicRoughness.metallicFactor);
+		materialData.roughnessFactor = static_cast<float>(material.pbrMetallicRoughness.roughnessFactor);
+		materialData.blend = material.alphaMode == "BLEND";  // Masked materials are alpha tested like the rest.
+
+		// Materials sample all of their textures with one sampler, taken from the first texture present.
+		for (const auto index : { material.pbrMetallicRoughness.baseColorTexture.index, material.pbrMetallicRoughness.metallicRoughnessTexture.index,
+			material.normalTexture.index, material.occlusionTexture.index, material.emissiveTexture.index })
 		{
-			device->GetResourceManager().GenerateMipmaps(device->GetDirectList(), resource);
+			if (index >= 0)
+			{
+				std::tie(materialData.addressU, materialData.addressV) = images->textureAddressModes[index];
+				break;
+			}
 		}
-		device->GetDirectList().TransitionBarrier(resource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	}
+}
 
-		return device->GetResourceManager().Get(resource).SRV->bindlessIndex;
-	};
+void AssetManager::FinalizeMaterials(const entt::registry& registry)
+{
+	VGScopedCPUStat("Finalize Materials");
+
+	std::vector<size_t> ready;
+	for (size_t i = 0; i < pendingMaterials.size(); ++i)
+	{
+		const auto& textures = pendingMaterials[i].textures;
+		if (std::all_of(textures.begin(), textures.end(), [](const auto& texture) { return texture.image.wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready; }))
+		{
+			ready.emplace_back(i);
+		}
+	}
+
+	if (ready.empty())
+	{
+		return;
+	}
+
+	XMFLOAT3 cameraPosition{};
+	registry.view<const TransformComponent, const CameraComponent>().each([&](auto entity, const auto& transform, const auto& camera)
+	{
+		cameraPosition = transform.translation;
+	});
+
+	const auto camera = XMLoadFloat3(&cameraPosition);
+
+	// Projected size of each material's largest subset, relative to the field of view. Materials not used by any mesh yet
+	// are the least important.
+	std::unordered_map<size_t, float> importance;
+	for (const auto index : ready)
+	{
+		importance[pendingMaterials[index].bufferIndex] = 0.f;
+	}
+
+	registry.view<const WorldTransformComponent, const MeshComponent>().each([&](auto entity, const auto& transform, const auto& mesh)
+	{
+		const auto maxScale = transform.maxScale;
+		const auto worldMatrix = XMLoadFloat4x4(&transform.matrix);
+
+		for (const auto& subset : mesh.subsets)
+		{
+			const auto it = importance.find(subset.materialIndex);
+			if (it == importance.end())
+			{
+				continue;
+			}
+
+			const auto center = XMVector3Transform(XMLoadFloat3(&subset.boundingSphereCenter), worldMatrix);
+			const auto distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(center, camera)));
+			const auto radius = subset.boundingSphereRadius * maxScale;
+			const auto size = distance > radius ? radius / (distance - radius) : std::numeric_limits<float>::max();
+			it->second = std::max(it->second, size);
+		}
+	});
+
+	std::stable_sort(ready.begin(), ready.end(), [&](auto left, auto right)
+	{
+		return importance[pendingMaterials[left].bufferIndex] > importance[pendingMaterials[right].bufferIndex];
+	});
+
+	auto& streamer = Renderer::Get().textureStreamer;
+	const auto budget = static_cast<size_t>(std::max(*CvarGet("assetUploadBudget", int), 0)) * 1024 * 1024;
+	size_t uploadedBytes = 0;
+
+	std::vector<size_t> finished;
+
+	for (const auto index : ready)
+	{
+		if (finished.size() > 0 && uploadedBytes >= budget)
+		{
+			break;
+		}
+
+		auto& pending = pendingMaterials[index];
+
+		// Each texture's initial residency is the upload cost.
+		const auto residentBytes = streamer.GetResidentBytes();
+
+		// Textures are streamed, starting at a low resolution. The streamer patches the material as their residency changes.
+		for (auto& texture : pending.textures)
+		{
+			auto image = texture.image.get();
+			if (!image)
+			{
+				continue;
+			}
+
+			// Uncompressed fallbacks keep their channels in place.
+			const auto swizzle = IsResourceFormatBlockCompressed(image->format) ? texture.swizzle : D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+			const uint32_t textureIndex = streamer.Create(std::move(*image), swizzle, texture.mipmap, texture.channel, texture.name, pending.bufferIndex, texture.offset);
+			std::memcpy(reinterpret_cast<std::byte*>(&pending.data) + texture.offset, &textureIndex, sizeof(textureIndex));
+		}
+
+		Renderer::Get().materialFactory->Write(pending.bufferIndex, pending.data);
+
+		uploadedBytes += streamer.GetResidentBytes() - residentBytes;
+		finished.emplace_back(index);
+	}
+
+	// Erase from the back, keeping the remaining indices valid.
+	std::sort(finished.begin(), finished.end(), std::greater<>{});
+	for (const auto index : finished)
+	{
+		pendingMaterials.erase(pendingMaterials.begin() + index);
+	}
+}
+
+void AssetManager::Update(entt::registry& registry)
+{
+	ScopedMemoryTag memoryTag{ MemoryTag::Asset };
 
-	MaterialData materialData;
-	// #TODO: Include asset name in texture name.
-	materialData.baseColor = CreateTexture(material.pbrMetallicRoughness.baseColorTexture.index, VGText("Base color asset texture"), DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, true);
-	materialData.metallicRoughness = CreateTexture(material.pbrMetallicRoughness.metallicRoughnessTexture.index, VGText("Metallic roughness asset texture"), DXGI_FORMAT_R8G8B8A8_UNORM, true);
-	materialData.normal = CreateTexture(material.normalTexture.index, VGText("Normal asset texture"), DXGI_FORMAT_R8G8B8A8_UNORM, true);
-	materialData.occlusion = CreateTexture(material.occlusionTexture.index, VGText("Occlusion asset texture"), DXGI_FORMAT_R8G8B8A8_UNORM, false);
-	materialData.emissive = CreateTexture(material.emissiveTexture.index, VGText("Emissive asset texture"), DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, false);
-	materialData.emissiveFactor.x = static_cast<float>(material.emissiveFactor[0]);
-	materialData.emissiveFactor.y = static_cast<float>(material.emissiveFactor[1]);
-	materialData.emissiveFactor.z = static_cast<float>(material.emissiveFactor[2]);
-	materialData.baseColorFactor.x = static_cast<float>(material.pbrMetallicRoughness.baseColorFactor[0]);
-	materialData.baseColorFactor.y = static_cast<float>(material.pbrMetallicRoughness.baseColorFactor[1]);
-	materialData.baseColorFactor.z = static_cast<float>(material.pbrMetallicRoughness.baseColorFactor[2]);
-	materialData.baseColorFactor.w = static_cast<float>(material.pbrMetallicRoughness.baseColorFactor[3]);
-	materialData.metallicFactor = static_cast<float>(material.pbrMetallicRoughness.metallicFactor);
-	materialData.roughnessFactor = static_cast<float>(material.pbrMetallicRoughness.roughnessFactor);
-
-	const auto materialBuffer = Renderer::Get().materialFactory->materialBuffer;
-
-	device->GetResourceManager().Write(materialBuffer, materialData, bufferIndex * sizeof(MaterialData));
+	FinalizeModels(registry);
+	FinalizeMaterials(registry);
+	DecodeMaterials();
 }
\ No newline at end of file
@@ -3,39 +3,135 @@
 #pragma once
 
 #include <Utility/Singleton.h>
+#include <Asset/AssetLoader.h>
+#include <Asset/TextureLoader.h>
 #include <Rendering/RenderComponents.h>
 #include <Rendering/ResourceHandle.h>
+#include <Rendering/ShaderStructs.h>
+#include <Rendering/TextureStreaming.h>
 
 #include <tiny_gltf.h>
+#include <entt/entt.hpp>
 
 #include <filesystem>
-#include <list>
+#include <string_view>
+#include <memory>
 #include <queue>
 #include <utility>
+#include <future>
+#include <optional>
+#include <vector>
+#include <unordered_map>
 
 class RenderDevice;
 
 class AssetManager : public Singleton<AssetManager>
 {
-	using MaterialQueue = std::queue<std::pair<tinygltf::Material, size_t>>;
-
 private:
 	RenderDevice* device;
-	std::list<MaterialQueue> modelMaterialQueues;
 
-public:
-	// #TODO: Poor solution, should rework this.
-	std::list<tinygltf::Model> models;
-	bool newModel = false;
+	// Encoded images of a model, freed once its last material finishes decoding.
+	struct ModelImages
+	{
+		std::vector<std::vector<unsigned char>> images;
+		std::vector<int> textureSources;  // Image of each texture.
+		std::vector<std::pair<D3D12_TEXTURE_ADDRESS_MODE, D3D12_TEXTURE_ADDRESS_MODE>> textureAddressModes;  // Of each texture's sampler.
+	};
+
+	struct QueuedMaterial
+	{
+		tinygltf::Material material;
+		std::shared_ptr<const ModelImages> images;
+		size_t bufferIndex;
+	};
+
+	std::queue<QueuedMaterial> materialQueue;
+
+	// Models are shared by every load of the same source with the same import options, keeping one copy of the geometry
+	// and materials. Only the mesh components handed out are counted, waiting entities are counted once assigned.
+	struct LoadedModel
+	{
+		MeshComponent mesh;
+		std::filesystem::path path;
+		std::vector<AssetLoader::ModelNode> nodes;
+		std::vector<AssetLoader::ModelSkin> skins;
+		std::shared_ptr<const std::vector<AnimationClip>> animations;
+		size_t references = 0;
+		bool loading = true;
+		std::vector<entt::entity> waiting;  // Asynchronous loads to give the mesh to once loaded.
+	};
+
+	struct PendingModel
+	{
+		std::future<std::optional<AssetLoader::MeshImport>> import;
+		size_t key;
+	};
+
+	std::unordered_map<size_t, LoadedModel> loadedModels;
+	std::vector<PendingModel> pendingModels;
+
+	size_t meshRevision = 0;  // Mesh factory revision the loaded models' offsets are from.
+
+	size_t GetModelKey(const std::filesystem::path& path, bool optimize, bool quantize) const;
+	// Follows the loaded models' meshes when the mesh factory defragments.
+	void UpdateModelOffsets();
+	// Blocks until the import finishes, then uploads it. Failed imports are forgotten.
+	void FinalizeImport(PendingModel& pending);
+	// Creates an entity for each of the model's nodes under the root, nodes with a mesh get their subsets of the model's
+	// mesh. Each of them holds a reference. Skinned nodes are bound to their joint entities, and the root plays the model's
+	// first animation.
+	void InstantiateNodes(entt::registry& registry, entt::entity root, LoadedModel& model);
+	// Uploads the imports which finished, giving their entities a mesh, or their node hierarchy when the model has one.
+	void FinalizeModels(entt::registry& registry);
+
+	// Decoded and transcoded on a worker thread.
+	struct MaterialTexture
+	{
+		std::future<std::optional<AssetLoader::TextureImage>> image;
+		std::wstring_view name;
+		uint32_t swizzle;
+		bool mipmap;
+		TextureChannel channel;
+		size_t offset;  // Of the texture index within the material data.
+	};
+
+	struct PendingMaterial
+	{
+		MaterialData data{};  // Textures without a source stay at index 0.
+		size_t bufferIndex;
+		std::vector<MaterialTexture> textures;
+	};
+
+	// Bounds the materials decoding at once, which hold their source images until uploaded.
+	static constexpr size_t maxPendingMaterials = 16;
+
+	std::vector<PendingMaterial> pendingMaterials;
+
+	// Starts decoding queued materials, up to the pending limit.
+	void DecodeMaterials();
+	// Uploads the materials which finished decoding all of their textures within the frame's upload budget, largest on
+	// screen first.
+	void FinalizeMaterials(const entt::registry& registry);
 
 public:
-	void Initialize(RenderDevice* inDevice) { device = inDevice; }
+	void Initialize(RenderDevice* inDevice);
 
-	// Blocking load of the mesh data, will load materials over time.
+	// Blocking load of the mesh data, will load materials over time. Models already loaded are shared.
 	MeshComponent LoadModel(const std::filesystem::path& path);
+	// Parses and encodes the mesh data on a worker thread, then uploads it during an update and gives the entity its mesh
+	// component. Models with a node hierarchy instead get child entities following their nodes. Materials are loaded over
+	// time as with LoadModel. Models already loaded or loading are shared.
+	void LoadModelAsync(const std::filesystem::path& path, entt::entity entity);
+	// Drops a reference to a model's mesh, freeing its geometry once unreferenced. Materials stay loaded.
+	void ReleaseModel(const MeshComponent& mesh);
+	// Source of a loaded model's whole mesh, nothing for meshes that are a node's part of a model or weren't loaded here.
+	std::optional<std::filesystem::path> GetModelPath(const MeshComponent& mesh);
 
-	// Instead of loading all model materials in one frame, stagger loading out over multiple frames.
-	size_t EnqueueMaterialLoad(const tinygltf::Material& material);
+	// Instead of loading all model materials in one frame, stagger loading out over multiple frames. Takes the model's
+	// images, returns the buffer index of each material.
+	std::vector<size_t> EnqueueMaterialLoads(tinygltf::Model& model);
 
-	void Update();
+	void Update(entt::registry& registry);
+	// Models or materials are still loading, the scene will change without any input.
+	bool IsLoading() const noexcept { return !pendingModels.empty() || !pendingMaterials.empty(); }
 };
\ No newline at end of file
@@ -0,0 +1,170 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Asset/MeshCache.h>
+#include <Core/Base.h>
+#include <Core/Config.h>
+#include <Utility/MappedFile.h>
+#include <Utility/AlignedSize.h>
+
+#include <fstream>
+#include <string>
+#include <type_traits>
+
+namespace
+{
+	constexpr uint32_t meshCacheMagic = 0x434D4756;  // "VGMC"
+	constexpr uint32_t meshCacheVersion = 5;  // Bump when the mesh encoding or this layout changes.
+	constexpr size_t meshCacheAlignment = 16;  // Of each section, the mapping itself is page aligned.
+
+	// Followed by the subsets, then the data sections in the order of their sizes.
+	struct MeshCacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceHash;
+		VertexMetadata metadata;
+		uint64_t subsetCount;
+		uint64_t vertexPositionSize;
+		uint64_t vertexExtraSize;
+		uint64_t indexSize;
+		uint64_t meshletCount;
+		uint64_t meshletVertexCount;
+		uint64_t meshletTriangleCount;
+		uint64_t vertexSkinSize;
+	};
+
+	static_assert(std::is_trivially_copyable_v<MeshComponent::Subset>, "Mesh subsets are stored as is.");
+	static_assert(std::is_trivially_copyable_v<MeshletData>, "Meshlets are stored as is.");
+}
+
+namespace AssetLoader
+{
+	std::filesystem::path GetMeshCachePath(size_t sourceHash)
+	{
+		return Config::engineRootPath / "Cache" / "Meshes" / (std::to_string(sourceHash) + ".mesh");
+	}
+
+	bool LoadMeshCache(MappedFile& file, size_t sourceHash, MeshComponent& component, MeshFactory::MeshDataView& data)
+	{
+		VGScopedCPUStat("Load Mesh Cache");
+
+		if (!file.Open(GetMeshCachePath(sourceHash)))
+		{
+			return false;
+		}
+
+		const auto bytes = file.Data();
+		if (bytes.size() < sizeof(MeshCacheHeader))
+		{
+			return false;
+		}
+
+		const auto* header = reinterpret_cast<const MeshCacheHeader*>(bytes.data());
+		if (header->magic != meshCacheMagic || header->version != meshCacheVersion || header->sourceHash != sourceHash)
+		{
+			return false;
+		}
+
+		// Returns the next section, or nothing if the file is truncated.
+		size_t offset = sizeof(MeshCacheHeader);
+		bool truncated = false;
+		const auto Section = [&](size_t size) -> const std::byte*
+		{
+			offset = AlignedSize(offset, meshCacheAlignment);
+			if (offset + size > bytes.size())
+			{
+				truncated = true;
+				return nullptr;
+			}
+
+			const auto* section = bytes.data() + offset;
+			offset += size;
+
+			return section;
+		};
+
+		const auto* subsets = reinterpret_cast<const MeshComponent::Subset*>(Section(header->subsetCount * sizeof(MeshComponent::Subset)));
+		const auto* vertexPositions = reinterpret_cast<const uint8_t*>(Section(header->vertexPositionSize));
+		const auto* vertexExtras = reinterpret_cast<const uint8_t*>(Section(header->vertexExtraSize));
+		const auto* indices = reinterpret_cast<const uint8_t*>(Section(header->indexSize));
+		const auto* meshlets = reinterpret_cast<const MeshletData*>(Section(header->meshletCount * sizeof(MeshletData)));
+		const auto* meshletVertices = reinterpret_cast<const uint32_t*>(Section(header->meshletVertexCount * sizeof(uint32_t)));
+		const auto* meshletTriangles = reinterpret_cast<const uint32_t*>(Section(header->meshletTriangleCount * sizeof(uint32_t)));
+		const auto* vertexSkins = reinterpret_cast<const uint8_t*>(Section(header->vertexSkinSize));
+
+		if (truncated)
+		{
+			VGLogWarning(logAsset, "Mesh cache entry is truncated, rebuilding.");
+			file.Close();
+
+			return false;
+		}
+
+		component = {};
+		component.metadata = header->metadata;
+		component.subsets.assign(subsets, subsets + header->subsetCount);
+
+		data.vertexPositionData = { vertexPositions, header->vertexPositionSize };
+		data.vertexExtraData = { vertexExtras, header->vertexExtraSize };
+		data.indexData = { indices, header->indexSize };
+		data.meshlets = { meshlets, header->meshletCount };
+		data.meshletVertices = { meshletVertices, header->meshletVertexCount };
+		data.meshletTriangles = { meshletTriangles, header->meshletTriangleCount };
+		data.vertexSkinData = { vertexSkins, header->vertexSkinSize };
+
+		return true;
+	}
+
+	bool SaveMeshCache(size_t sourceHash, const MeshFactory::MeshData& mesh)
+	{
+		VGScopedCPUStat("Save Mesh Cache");
+
+		const auto path = GetMeshCachePath(sourceHash);
+
+		std::error_code error;
+		std::filesystem::create_directories(path.parent_path(), error);
+
+		std::ofstream stream{ path, std::ios::binary };
+		if (!stream.is_open())
+		{
+			return false;
+		}
+
+		MeshCacheHeader header{
+			.magic = meshCacheMagic,
+			.version = meshCacheVersion,
+			.sourceHash = sourceHash,
+			.metadata = mesh.component.metadata,
+			.subsetCount = mesh.component.subsets.size(),
+			.vertexPositionSize = mesh.vertexPositionData.size(),
+			.vertexExtraSize = mesh.vertexExtraData.size(),
+			.indexSize = mesh.indexData.size(),
+			.meshletCount = mesh.meshletData.meshlets.size(),
+			.meshletVertexCount = mesh.meshletData.vertices.size(),
+			.meshletTriangleCount = mesh.meshletData.triangles.size(),
+			.vertexSkinSize = mesh.vertexSkinData.size()
+		};
+
+		size_t offset = 0;
+		const auto WriteSection = [&](const void* source, size_t size)
+		{
+			static constexpr char padding[meshCacheAlignment]{};
+			const auto aligned = AlignedSize(offset, meshCacheAlignment);
+			stream.write(padding, aligned - offset);
+			stream.write(static_cast<const char*>(source), size);
+			offset = aligned + size;
+		};
+
+		WriteSection(&header, sizeof(header));
+		WriteSection(mesh.component.subsets.data(), mesh.component.subsets.size() * sizeof(MeshComponent::Subset));
+		WriteSection(mesh.vertexPositionData.data(), mesh.vertexPositionData.size());
+		WriteSection(mesh.vertexExtraData.data(), mesh.vertexExtraData.size());
+		WriteSection(mesh.indexData.data(), mesh.indexData.size());
+		WriteSection(mesh.meshletData.meshlets.data(), mesh.meshletData.meshlets.size() * sizeof(MeshletData));
+		WriteSection(mesh.meshletData.vertices.data(), mesh.meshletData.vertices.size() * sizeof(uint32_t));
+		WriteSection(mesh.meshletData.triangles.data(), mesh.meshletData.triangles.size() * sizeof(uint32_t));
+		WriteSection(mesh.vertexSkinData.data(), mesh.vertexSkinData.size());
+
+		return static_cast<bool>(stream);
+	}
+}
\ No newline at end of file
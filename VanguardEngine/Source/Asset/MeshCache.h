@@ -0,0 +1,22 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/MeshFactory.h>
+#include <Rendering/RenderComponents.h>
+
+#include <filesystem>
+
+class MappedFile;
+
+// Cooked meshes, stored the way the mesh factory uploads them so that loading skips the import entirely. Entries are
+// keyed by a hash of the source data and the options the mesh was built with, edits to either build a new entry.
+namespace AssetLoader
+{
+	std::filesystem::path GetMeshCachePath(size_t sourceHash);
+
+	// Maps the cooked mesh, the data views the mapping and is only valid while the file stays open. Fails for missing or
+	// outdated entries.
+	bool LoadMeshCache(MappedFile& file, size_t sourceHash, MeshComponent& component, MeshFactory::MeshDataView& data);
+	bool SaveMeshCache(size_t sourceHash, const MeshFactory::MeshData& mesh);
+}
\ No newline at end of file
@@ -0,0 +1,383 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Asset/SceneSnapshot.h>
+#include <Asset/AssetManager.h>
+#include <Core/Base.h>
+#include <Core/Config.h>
+#include <Core/Globals.h>
+#include <Core/CoreComponents.h>
+#include <Rendering/RenderComponents.h>
+#include <Utility/MappedFile.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <span>
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+#include <type_traits>
+#include <utility>
+
+namespace
+{
+	constexpr uint32_t sceneSnapshotMagic = 0x53534756;  // "VGSS"
+	constexpr uint32_t sceneSnapshotVersion = 2;  // Bump when a stored component or this layout changes.
+
+	struct SceneSnapshotHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+	};
+
+	// Stored in place of the mesh, which only holds offsets into the mesh factory.
+	struct SnapshotModel
+	{
+		std::wstring path;
+	};
+
+	// Archives of entt snapshots. Trivially copyable components are stored as is, strings as their length and characters.
+	class OutputArchive
+	{
+	private:
+		std::vector<std::byte>& buffer;
+
+		void Write(const void* data, size_t size)
+		{
+			const auto* bytes = static_cast<const std::byte*>(data);
+			buffer.insert(buffer.end(), bytes, bytes + size);
+		}
+
+		template <typename T>
+		void Write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values are stored as is.");
+			Write(&value, sizeof(T));
+		}
+
+		template <typename CharType>
+		void Write(const std::basic_string<CharType>& string)
+		{
+			Write(static_cast<uint64_t>(string.size()));
+			Write(string.data(), string.size() * sizeof(CharType));
+		}
+
+		void Write(const NameComponent& component) { Write(component.name); }
+		void Write(const SnapshotModel& component) { Write(component.path); }
+
+	public:
+		OutputArchive(std::vector<std::byte>& inBuffer) : buffer(inBuffer) {}
+
+		// Entities, counts and the header.
+		template <typename T>
+		void operator()(const T& value)
+		{
+			Write(value);
+		}
+
+		template <typename Component>
+		void operator()(entt::entity entity, const Component& component)
+		{
+			Write(entity);
+			Write(component);
+		}
+	};
+
+	// Reads past the end of the data are zeroed and flag the archive as truncated.
+	class InputArchive
+	{
+	private:
+		std::span<const std::byte> data;
+		size_t offset = 0;
+		bool truncated = false;
+
+		void Read(void* destination, size_t size)
+		{
+			if (truncated || size > data.size() - offset)
+			{
+				truncated = true;
+				std::memset(destination, 0, size);
+
+				return;
+			}
+
+			std::memcpy(destination, data.data() + offset, size);
+			offset += size;
+		}
+
+		template <typename T>
+		void Read(T& value)
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Only trivially copyable values are stored as is.");
+			Read(&value, sizeof(T));
+		}
+
+		template <typename CharType>
+		void Read(std::basic_string<CharType>& string)
+		{
+			uint64_t size = 0;
+			Read(size);
+
+			if (truncated || size > (data.size() - offset) / sizeof(CharType))
+			{
+				truncated = true;
+
+				return;
+			}
+
+			string.resize(size);
+			Read(string.data(), size * sizeof(CharType));
+		}
+
+		void Read(NameComponent& component) { Read(component.name); }
+		void Read(SnapshotModel& component) { Read(component.path); }
+
+	public:
+		InputArchive(std::span<const std::byte> inData) : data(inData) {}
+
+		// Entities and the header.
+		template <typename T>
+		void operator()(T& value)
+		{
+			Read(value);
+		}
+
+		// Counts, which size the loader's allocations, so they're checked against the remaining data.
+		void operator()(std::underlying_type_t<entt::entity>& count)
+		{
+			Read(count);
+
+			if (count > (data.size() - offset) / sizeof(entt::entity))
+			{
+				truncated = true;
+				count = 0;
+			}
+		}
+
+		template <typename Component>
+		void operator()(entt::entity& entity, Component& component)
+		{
+			Read(entity);
+			Read(component);
+		}
+
+		bool Truncated() const noexcept { return truncated; }
+	};
+
+	template <typename... Components>
+	void StageComponents(const entt::registry& registry, entt::entity entity, entt::registry& staging, entt::entity staged)
+	{
+		([&]
+		{
+			if (const auto* component = registry.try_get<Components>(entity))
+			{
+				staging.emplace<Components>(staged, *component);
+			}
+		}(), ...);
+	}
+
+	// Components of entities that already have them are replaced, the rest are inserted together.
+	template <typename Component>
+	void InsertStaged(entt::registry& registry, const entt::registry& staging, const std::unordered_map<entt::entity, entt::entity>& targets)
+	{
+		std::vector<entt::entity> entities;
+		std::vector<Component> components;
+
+		staging.view<const Component>().each([&](auto staged, const auto& component)
+		{
+			const auto entity = targets.at(staged);
+			if (registry.all_of<Component>(entity))
+			{
+				registry.replace<Component>(entity, component);
+			}
+
+			else
+			{
+				entities.emplace_back(entity);
+				components.emplace_back(component);
+			}
+		});
+
+		registry.insert<Component>(entities.begin(), entities.end(), components.begin());
+	}
+
+	template <typename Component>
+	entt::entity FindFirst(const entt::registry& registry)
+	{
+		const auto view = registry.view<const Component>();
+		return view.empty() ? entt::entity{ entt::null } : view.front();
+	}
+}
+
+namespace SceneSnapshot
+{
+	std::optional<std::filesystem::path> GetScenePath()
+	{
+		const auto argument = std::find(GCommandLineArgs.begin(), GCommandLineArgs.end(), L"-scene");
+		if (argument == GCommandLineArgs.end() || std::next(argument) == GCommandLineArgs.end())
+			return std::nullopt;
+
+		const std::filesystem::path path{ *std::next(argument) };
+		if (path.is_absolute() || std::filesystem::exists(path))
+			return path;
+
+		return Config::engineRootPath / path;
+	}
+
+	std::filesystem::path GetDefaultPath()
+	{
+		return Config::engineRootPath / "Scenes" / "Snapshot.vgscene";
+	}
+
+	bool Save(const entt::registry& registry, const std::filesystem::path& path)
+	{
+		VGScopedCPUStat("Save Scene Snapshot");
+
+		// Only the stored components of root entities are staged, model nodes are rebuilt from their root's model.
+		entt::registry staging;
+		size_t unknownMeshes = 0;
+
+		registry.view<const TransformComponent>().each([&](auto entity, const auto& transform)
+		{
+			if (const auto* relationship = registry.try_get<RelationshipComponent>(entity); relationship && relationship->parent != entt::null)
+				return;
+
+			std::optional<std::filesystem::path> modelPath;
+			if (const auto* model = registry.try_get<ModelComponent>(entity))
+			{
+				modelPath = model->path;
+			}
+
+			else if (const auto* mesh = registry.try_get<MeshComponent>(entity))
+			{
+				modelPath = AssetManager::Get().GetModelPath(*mesh);
+				unknownMeshes += modelPath ? 0 : 1;
+			}
+
+			if (!modelPath && !registry.any_of<LightComponent, CameraComponent, ReflectionProbeComponent, TimeOfDayComponent>(entity))
+				return;
+
+			const auto staged = staging.create();
+			staging.emplace<TransformComponent>(staged, transform);
+			if (modelPath)
+			{
+				staging.emplace<SnapshotModel>(staged, modelPath->generic_wstring());
+			}
+
+			StageComponents<NameComponent, LightComponent, CameraComponent, ReflectionProbeComponent, TimeOfDayComponent>(registry, entity, staging, staged);
+		});
+
+		std::vector<std::byte> buffer;
+		OutputArchive archive{ buffer };
+		archive(SceneSnapshotHeader{ .magic = sceneSnapshotMagic, .version = sceneSnapshotVersion });
+
+		// Loaded in the same order.
+		entt::snapshot{ staging }
+			.entities(archive)
+			.component<NameComponent, TransformComponent, SnapshotModel, LightComponent, CameraComponent, ReflectionProbeComponent, TimeOfDayComponent>(archive);
+
+		std::error_code error;
+		std::filesystem::create_directories(path.parent_path(), error);
+
+		std::ofstream stream{ path, std::ios::binary };
+		if (!stream.is_open() || !stream.write(reinterpret_cast<const char*>(buffer.data()), buffer.size()))
+		{
+			VGLogError(logAsset, "Failed to write scene snapshot '{}'.", path.generic_wstring());
+
+			return false;
+		}
+
+		if (unknownMeshes > 0)
+		{
+			VGLogWarning(logAsset, "Left {} meshes without a model out of the scene snapshot.", unknownMeshes);
+		}
+
+		VGLog(logAsset, "Saved scene snapshot '{}' with {} entities.", path.generic_wstring(), staging.alive());
+
+		return true;
+	}
+
+	bool Load(entt::registry& registry, const std::filesystem::path& path)
+	{
+		VGScopedCPUStat("Load Scene Snapshot");
+
+		MappedFile file;
+		if (!file.Open(path))
+		{
+			VGLogError(logAsset, "Failed to open scene snapshot '{}'.", path.generic_wstring());
+
+			return false;
+		}
+
+		InputArchive archive{ file.Data() };
+		SceneSnapshotHeader header{};
+		archive(header);
+
+		if (header.magic != sceneSnapshotMagic || header.version != sceneSnapshotVersion)
+		{
+			VGLogError(logAsset, "Scene snapshot '{}' is invalid or outdated.", path.generic_wstring());
+
+			return false;
+		}
+
+		entt::registry staging;
+		entt::snapshot_loader{ staging }
+			.entities(archive)
+			.component<NameComponent, TransformComponent, SnapshotModel, LightComponent, CameraComponent, ReflectionProbeComponent, TimeOfDayComponent>(archive);
+
+		if (archive.Truncated())
+		{
+			VGLogError(logAsset, "Scene snapshot '{}' is truncated.", path.generic_wstring());
+
+			return false;
+		}
+
+		// The camera and sun already exist, owned by the engine and renderer. The snapshot's first of each is applied to them.
+		auto camera = FindFirst<CameraComponent>(registry);
+		auto sun = FindFirst<TimeOfDayComponent>(registry);
+
+		std::unordered_map<entt::entity, entt::entity> targets;
+		std::vector<entt::entity> created;
+		staging.each([&](auto staged)
+		{
+			if (camera != entt::null && staging.all_of<CameraComponent>(staged))
+			{
+				targets[staged] = std::exchange(camera, entt::null);
+			}
+
+			else if (sun != entt::null && staging.all_of<TimeOfDayComponent>(staged))
+			{
+				targets[staged] = std::exchange(sun, entt::null);
+			}
+
+			else
+			{
+				created.emplace_back(staged);
+			}
+		});
+
+		std::vector<entt::entity> entities(created.size());
+		registry.create(entities.begin(), entities.end());
+		for (size_t i = 0; i < created.size(); ++i)
+		{
+			targets[created[i]] = entities[i];
+		}
+
+		InsertStaged<NameComponent>(registry, staging, targets);
+		InsertStaged<TransformComponent>(registry, staging, targets);
+		InsertStaged<LightComponent>(registry, staging, targets);
+		InsertStaged<CameraComponent>(registry, staging, targets);
+		InsertStaged<ReflectionProbeComponent>(registry, staging, targets);
+		InsertStaged<TimeOfDayComponent>(registry, staging, targets);
+
+		// Cooked models map their mesh cache entry, entities sharing a model share one import.
+		staging.view<const SnapshotModel>().each([&](auto staged, const auto& model)
+		{
+			AssetManager::Get().LoadModelAsync(model.path, targets.at(staged));
+		});
+
+		VGLog(logAsset, "Loaded scene snapshot '{}' with {} entities.", path.generic_wstring(), staging.alive());
+
+		return true;
+	}
+}
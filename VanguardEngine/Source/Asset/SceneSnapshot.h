@@ -0,0 +1,25 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <entt/entt.hpp>
+
+#include <filesystem>
+#include <optional>
+
+// Binary snapshots of the scene, loaded in place of building the default scene with '-scene <file>'. Only root entities
+// are stored, with their names, transforms, lights, cameras, reflection probes and times of day. Meshes are stored as
+// the path of their model, whose mesh cache entry and materials are loaded asynchronously like any other model, and
+// whose node hierarchy is rebuilt from the model.
+namespace SceneSnapshot
+{
+	// Path given on the command line, if any.
+	std::optional<std::filesystem::path> GetScenePath();
+	// Written to when no path was given on the command line.
+	std::filesystem::path GetDefaultPath();
+
+	bool Save(const entt::registry& registry, const std::filesystem::path& path);
+	// Maps the snapshot and creates its entities in bulk. The snapshot's camera and sun are applied to the registry's
+	// existing camera and sun, if it has them.
+	bool Load(entt::registry& registry, const std::filesystem::path& path);
+}
@@ -0,0 +1,283 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Asset/TextureCompression.h>
+#include <Core/Base.h>
+#include <Rendering/ResourceFormat.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+	using Block = unsigned char[16][4];
+
+	void LoadBlock(const unsigned char* texels, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, Block& block)
+	{
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			const auto x = std::min(blockX * 4 + i % 4, width - 1);
+			const auto y = std::min(blockY * 4 + i / 4, height - 1);
+			std::memcpy(block[i], texels + (static_cast<size_t>(y) * width + x) * 4, 4);
+		}
+	}
+
+	uint16_t PackColor(const float (&color)[3])
+	{
+		const auto r = static_cast<uint32_t>(std::clamp(std::round(color[0] * 31.f / 255.f), 0.f, 31.f));
+		const auto g = static_cast<uint32_t>(std::clamp(std::round(color[1] * 63.f / 255.f), 0.f, 63.f));
+		const auto b = static_cast<uint32_t>(std::clamp(std::round(color[2] * 31.f / 255.f), 0.f, 31.f));
+
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	void UnpackColor(uint16_t packed, float (&color)[3])
+	{
+		// Replicate the high bits into the low bits, matching how the hardware expands to 8 bits.
+		const auto r = (packed >> 11) & 31;
+		const auto g = (packed >> 5) & 63;
+		const auto b = packed & 31;
+
+		color[0] = static_cast<float>((r << 3) | (r >> 2));
+		color[1] = static_cast<float>((g << 2) | (g >> 4));
+		color[2] = static_cast<float>((b << 3) | (b >> 2));
+	}
+
+	// Always in the four color mode, BC3 ignores the endpoint order and BC1 images with translucency use BC3.
+	void CompressColorBlock(const Block& block, unsigned char* output)
+	{
+		float mean[3]{};
+		for (const auto& texel : block)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				mean[c] += texel[c] / 16.f;
+			}
+		}
+
+		// Symmetric, upper triangle only.
+		float covariance[3][3]{};
+		for (const auto& texel : block)
+		{
+			const float delta[3] = { texel[0] - mean[0], texel[1] - mean[1], texel[2] - mean[2] };
+			for (int i = 0; i < 3; ++i)
+			{
+				for (int j = i; j < 3; ++j)
+				{
+					covariance[i][j] += delta[i] * delta[j];
+				}
+			}
+		}
+
+		// Power iteration for the principal axis.
+		float axis[3] = { 1.f, 1.f, 1.f };
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			const float next[3] = {
+				covariance[0][0] * axis[0] + covariance[0][1] * axis[1] + covariance[0][2] * axis[2],
+				covariance[0][1] * axis[0] + covariance[1][1] * axis[1] + covariance[1][2] * axis[2],
+				covariance[0][2] * axis[0] + covariance[1][2] * axis[1] + covariance[2][2] * axis[2]
+			};
+
+			const auto length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+			if (length < std::numeric_limits<float>::epsilon())
+			{
+				break;  // Flat block, any axis works.
+			}
+
+			for (int c = 0; c < 3; ++c)
+			{
+				axis[c] = next[c] / length;
+			}
+		}
+
+		float minProjection = std::numeric_limits<float>::max();
+		float maxProjection = std::numeric_limits<float>::lowest();
+		for (const auto& texel : block)
+		{
+			const auto projection = (texel[0] - mean[0]) * axis[0] + (texel[1] - mean[1]) * axis[1] + (texel[2] - mean[2]) * axis[2];
+			minProjection = std::min(minProjection, projection);
+			maxProjection = std::max(maxProjection, projection);
+		}
+
+		float start[3];
+		float end[3];
+		for (int c = 0; c < 3; ++c)
+		{
+			start[c] = mean[c] + axis[c] * maxProjection;
+			end[c] = mean[c] + axis[c] * minProjection;
+		}
+
+		auto color0 = PackColor(start);
+		auto color1 = PackColor(end);
+		if (color0 < color1)
+		{
+			std::swap(color0, color1);
+		}
+
+		float palette[4][3];
+		UnpackColor(color0, palette[0]);
+		UnpackColor(color1, palette[1]);
+		for (int c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2.f * palette[0][c] + palette[1][c]) / 3.f;
+			palette[3][c] = (palette[0][c] + 2.f * palette[1][c]) / 3.f;
+		}
+
+		uint32_t indices = 0;
+		if (color0 != color1)
+		{
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				uint32_t best = 0;
+				float bestError = std::numeric_limits<float>::max();
+				for (uint32_t j = 0; j < 4; ++j)
+				{
+					float error = 0.f;
+					for (int c = 0; c < 3; ++c)
+					{
+						const auto delta = block[i][c] - palette[j][c];
+						error += delta * delta;
+					}
+
+					if (error < bestError)
+					{
+						best = j;
+						bestError = error;
+					}
+				}
+
+				indices |= best << (i * 2);
+			}
+		}
+
+		std::memcpy(output, &color0, 2);
+		std::memcpy(output + 2, &color1, 2);
+		std::memcpy(output + 4, &indices, 4);
+	}
+
+	// Always in the eight value mode, between the channel's extremes.
+	void CompressChannelBlock(const Block& block, uint32_t channel, unsigned char* output)
+	{
+		unsigned char minValue = 255;
+		unsigned char maxValue = 0;
+		for (const auto& texel : block)
+		{
+			minValue = std::min(minValue, texel[channel]);
+			maxValue = std::max(maxValue, texel[channel]);
+		}
+
+		float palette[8];
+		palette[0] = maxValue;
+		palette[1] = minValue;
+		for (int i = 2; i < 8; ++i)
+		{
+			palette[i] = ((8 - i) * palette[0] + (i - 1) * palette[1]) / 7.f;
+		}
+
+		uint64_t indices = 0;
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			uint64_t best = 0;
+			float bestError = std::numeric_limits<float>::max();
+			for (uint32_t j = 0; j < 8; ++j)
+			{
+				const auto error = std::abs(block[i][channel] - palette[j]);
+				if (error < bestError)
+				{
+					best = j;
+					bestError = error;
+				}
+			}
+
+			indices |= best << (i * 3);
+		}
+
+		output[0] = maxValue;
+		output[1] = minValue;
+		for (int i = 0; i < 6; ++i)
+		{
+			output[2 + i] = static_cast<unsigned char>(indices >> (i * 8));
+		}
+	}
+}
+
+namespace TextureCompression
+{
+	bool IsFormatSupported(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_BC1_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+		case DXGI_FORMAT_BC3_UNORM:
+		case DXGI_FORMAT_BC3_UNORM_SRGB:
+		case DXGI_FORMAT_BC4_UNORM:
+		case DXGI_FORMAT_BC5_UNORM:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	bool HasTranslucency(const unsigned char* texels, uint32_t width, uint32_t height)
+	{
+		const auto count = static_cast<size_t>(width) * height;
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (texels[i * 4 + 3] < 255)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	std::vector<unsigned char> Compress(const unsigned char* texels, uint32_t width, uint32_t height, DXGI_FORMAT format, uint32_t firstChannel, uint32_t secondChannel)
+	{
+		VGScopedCPUStat("Block Compress");
+		VGAssert(IsFormatSupported(format), "Block compressing to an unsupported format.");
+
+		// sRGB blocks are encoded in sRGB space, the endpoints are decoded before interpolation.
+		const auto linearFormat = IsResourceFormatSRGB(format) ? ConvertResourceFormatToLinear(format) : format;
+
+		const auto blocksX = (width + 3) / 4;
+		const auto blocksY = (height + 3) / 4;
+		const auto blockSize = GetResourceFormatSize(format) * 2;  // 16 texels.
+
+		std::vector<unsigned char> result;
+		result.resize(static_cast<size_t>(blocksX) * blocksY * blockSize);
+
+		Block block;
+		for (uint32_t y = 0; y < blocksY; ++y)
+		{
+			for (uint32_t x = 0; x < blocksX; ++x)
+			{
+				LoadBlock(texels, width, height, x, y, block);
+				auto* output = result.data() + (static_cast<size_t>(y) * blocksX + x) * blockSize;
+
+				switch (linearFormat)
+				{
+				case DXGI_FORMAT_BC1_UNORM:
+					CompressColorBlock(block, output);
+					break;
+				case DXGI_FORMAT_BC3_UNORM:
+					CompressChannelBlock(block, 3, output);
+					CompressColorBlock(block, output + 8);
+					break;
+				case DXGI_FORMAT_BC4_UNORM:
+					CompressChannelBlock(block, firstChannel, output);
+					break;
+				case DXGI_FORMAT_BC5_UNORM:
+					CompressChannelBlock(block, firstChannel, output);
+					CompressChannelBlock(block, secondChannel, output + 8);
+					break;
+				}
+			}
+		}
+
+		return result;
+	}
+}
\ No newline at end of file
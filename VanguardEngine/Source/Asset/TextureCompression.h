@@ -0,0 +1,20 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <dxgiformat.h>
+
+#include <cstdint>
+#include <vector>
+
+// CPU block compression of RGBA8 images, fitting each block's endpoints to the extremes of its texels along their
+// principal axis. Fast enough for import time, though not as accurate as an exhaustive search. BC7 isn't encoded.
+namespace TextureCompression
+{
+	bool IsFormatSupported(DXGI_FORMAT format);
+	bool HasTranslucency(const unsigned char* texels, uint32_t width, uint32_t height);
+
+	// Encodes tightly packed RGBA8 texels into BC1, BC3, BC4 or BC5 blocks. BC4 stores the first channel, BC5 stores the
+	// first and second channels. Images that aren't a multiple of the block size repeat their edge texels.
+	std::vector<unsigned char> Compress(const unsigned char* texels, uint32_t width, uint32_t height, DXGI_FORMAT format, uint32_t firstChannel = 0, uint32_t secondChannel = 1);
+}
\ No newline at end of file
@@ -1,19 +1,218 @@
 // Copyright (c) 2019-2022 Andrew Depke
 
 #include <Asset/TextureLoader.h>
+#include <Asset/TextureCompression.h>
 #include <Rendering/Device.h>
 #include <Rendering/Resource.h>
+#include <Rendering/ResourceFormat.h>
+#include <Core/Config.h>
+#include <Utility/HashCombine.h>
+#include <Utility/MappedFile.h>
 
 #include <vector>
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <cstring>
+#include <string>
+#include <string_view>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize.h>
+
+namespace
+{
+	// See: https://docs.microsoft.com/en-us/windows/win32/direct3ddds/dx-graphics-dds-pguide
+	struct DdsPixelFormat
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t rBitMask;
+		uint32_t gBitMask;
+		uint32_t bBitMask;
+		uint32_t aBitMask;
+	};
+
+	struct DdsHeader
+	{
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		DdsPixelFormat pixelFormat;
+		uint32_t caps;
+		uint32_t caps2;
+		uint32_t caps3;
+		uint32_t caps4;
+		uint32_t reserved2;
+	};
+
+	struct DdsHeaderDx10
+	{
+		DXGI_FORMAT format;
+		uint32_t resourceDimension;
+		uint32_t miscFlag;
+		uint32_t arraySize;
+		uint32_t miscFlags2;
+	};
+
+	static_assert(sizeof(DdsHeader) == 124, "DDS header must match the file layout.");
+	static_assert(sizeof(DdsHeaderDx10) == 20, "DDS DX10 header must match the file layout.");
+
+	constexpr uint32_t MakeFourCC(char a, char b, char c, char d)
+	{
+		return static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8) | (static_cast<uint32_t>(c) << 16) | (static_cast<uint32_t>(d) << 24);
+	}
+
+	constexpr uint32_t ddsMagic = MakeFourCC('D', 'D', 'S', ' ');
+	constexpr uint32_t ddsFlagsRequired = 0x1 | 0x2 | 0x4 | 0x1000;  // Caps, height, width, pixel format.
+	constexpr uint32_t ddsFlagMipCount = 0x20000;
+	constexpr uint32_t ddsFlagLinearSize = 0x80000;
+	constexpr uint32_t ddsPixelFourCC = 0x4;
+	constexpr uint32_t ddsPixelRGB = 0x40;
+	constexpr uint32_t ddsCapsTexture = 0x1000;
+	constexpr uint32_t ddsCapsComplexMipmap = 0x8 | 0x400000;
+	constexpr uint32_t ddsCaps2Cubemap = 0x200;
+	constexpr uint32_t ddsDimensionTexture2D = 3;
+
+	DXGI_FORMAT GetLegacyDdsFormat(const DdsPixelFormat& pixelFormat)
+	{
+		if (pixelFormat.flags & ddsPixelFourCC)
+		{
+			switch (pixelFormat.fourCC)
+			{
+			case MakeFourCC('D', 'X', 'T', '1'): return DXGI_FORMAT_BC1_UNORM;
+			case MakeFourCC('D', 'X', 'T', '3'): return DXGI_FORMAT_BC2_UNORM;
+			case MakeFourCC('D', 'X', 'T', '5'): return DXGI_FORMAT_BC3_UNORM;
+			case MakeFourCC('A', 'T', 'I', '1'):
+			case MakeFourCC('B', 'C', '4', 'U'): return DXGI_FORMAT_BC4_UNORM;
+			case MakeFourCC('A', 'T', 'I', '2'):
+			case MakeFourCC('B', 'C', '5', 'U'): return DXGI_FORMAT_BC5_UNORM;
+			}
+		}
+
+		else if ((pixelFormat.flags & ddsPixelRGB) && pixelFormat.rgbBitCount == 32 && pixelFormat.rBitMask == 0x000000FF && pixelFormat.gBitMask == 0x0000FF00 && pixelFormat.bBitMask == 0x00FF0000)
+		{
+			return DXGI_FORMAT_R8G8B8A8_UNORM;
+		}
+
+		return DXGI_FORMAT_UNKNOWN;
+	}
+
+	uint32_t GetMipCount(uint32_t width, uint32_t height)
+	{
+		return static_cast<uint32_t>(std::bit_width(std::max(width, height)));
+	}
+
+	size_t GetMipSize(DXGI_FORMAT format, uint32_t width, uint32_t height, uint32_t mip)
+	{
+		return static_cast<size_t>(GetResourceFormatRowSize(format, std::max(width >> mip, 1u))) * GetResourceFormatRowCount(format, std::max(height >> mip, 1u));
+	}
+
+	std::vector<unsigned char> Resample(const unsigned char* source, uint32_t sourceWidth, uint32_t sourceHeight, uint32_t width, uint32_t height, bool sRGB)
+	{
+		VGScopedCPUStat("Resample");
+
+		std::vector<unsigned char> result;
+		result.resize(static_cast<size_t>(width) * height * 4);
+
+		if (sRGB)
+		{
+			stbir_resize_uint8_srgb(source, sourceWidth, sourceHeight, 0, result.data(), width, height, 0, 4, 3, 0);
+		}
+
+		else
+		{
+			stbir_resize_uint8(source, sourceWidth, sourceHeight, 0, result.data(), width, height, 0, 4);
+		}
+
+		return result;
+	}
+
+	constexpr uint32_t transcodeCacheVersion = 1;  // Bump when the encoder changes, invalidating cached images.
+
+	std::filesystem::path GetTextureCachePath(size_t hash)
+	{
+		return Config::engineRootPath / "Cache" / "Textures" / (std::to_string(hash) + ".dds");
+	}
+
+	// Block compressed textures must be a multiple of the block size, excluding the smaller mips.
+	DXGI_FORMAT ResolveTranscodeFormat(DXGI_FORMAT format, uint32_t width, uint32_t height)
+	{
+		if (IsResourceFormatBlockCompressed(format) && (width % 4 != 0 || height % 4 != 0 || !TextureCompression::IsFormatSupported(format)))
+		{
+			return IsResourceFormatSRGB(format) ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM;
+		}
+
+		return format;
+	}
+
+	AssetLoader::TextureImage BuildTextureImage(const std::vector<unsigned char>& texels, uint32_t width, uint32_t height, DXGI_FORMAT format, uint32_t firstChannel, uint32_t secondChannel)
+	{
+		const auto sRGB = IsResourceFormatSRGB(format);
+		const auto compress = IsResourceFormatBlockCompressed(format);
+		const auto mipCount = GetMipCount(width, height);
+
+		AssetLoader::TextureImage image;
+		image.width = width;
+		image.height = height;
+		image.format = format;
+		image.storage.reserve(mipCount);
+
+		// Each mip is resampled from the one above it.
+		std::vector<unsigned char> mipTexels = texels;
+		for (uint32_t i = 0; i < mipCount; ++i)
+		{
+			const auto mipWidth = std::max(width >> i, 1u);
+			const auto mipHeight = std::max(height >> i, 1u);
+
+			if (i > 0)
+			{
+				mipTexels = Resample(mipTexels.data(), std::max(width >> (i - 1), 1u), std::max(height >> (i - 1), 1u), mipWidth, mipHeight, sRGB);
+			}
+
+			image.storage.emplace_back(compress ? TextureCompression::Compress(mipTexels.data(), mipWidth, mipHeight, format, firstChannel, secondChannel) : mipTexels);
+		}
+
+		// Moving the image keeps the storage's allocations, so the views stay valid.
+		image.mips.assign(image.storage.begin(), image.storage.end());
+
+		return image;
+	}
+}
+
 namespace AssetLoader
 {
-	TextureHandle LoadTexture(RenderDevice& device, std::filesystem::path path, bool sRGB)
+	std::optional<TextureImage> ReadTexture(const std::filesystem::path& path)
 	{
-		VGScopedCPUStat("Load Texture");
+		VGScopedCPUStat("Read Texture");
+
+		if (path.extension() == ".dds")
+		{
+			auto image = LoadDds(path);
+			if (!image)
+			{
+				VGLogError(logAsset, "Failed to load texture at '{}'.", path.generic_wstring());
+				return std::nullopt;
+			}
+
+			// Mips are written as they are, so partial chains only keep the most detailed mip.
+			if (image->mips.size() != GetMipCount(image->width, image->height))
+			{
+				image->mips.resize(1);
+			}
+
+			return image;
+		}
 
 		int pixelsX;
 		int pixelsY;
@@ -30,35 +229,271 @@ namespace AssetLoader
 		if (!data)
 		{
 			VGLogError(logAsset, "Failed to load texture at '{}'.", path.generic_wstring());
-			return {};
+			return std::nullopt;
 		}
 
-		std::vector<uint8_t> dataResource;
+		TextureImage image;
+		image.width = pixelsX;
+		image.height = pixelsY;
+		image.format = DXGI_FORMAT_R8G8B8A8_UNORM;
 
 		{
 			VGScopedCPUStat("Copy");
 
+			auto& dataResource = image.storage.emplace_back();
 			dataResource.resize(static_cast<size_t>(pixelsX) * static_cast<size_t>(pixelsY) * static_cast<size_t>(STBI_rgb_alpha));
 
 			std::memcpy(dataResource.data(), data, dataResource.size());
+			image.mips.emplace_back(dataResource);
 
 			STBI_FREE(data);
 		}
 
+		return image;
+	}
+
+	TextureHandle CreateTexture(RenderDevice& device, const TextureImage& image, bool sRGB)
+	{
+		VGScopedCPUStat("Create Texture");
+
 		TextureDescription description{};
 		description.bindFlags = BindFlag::ShaderResource;
 		description.accessFlags = AccessFlag::CPUWrite;
-		description.width = pixelsX;
-		description.height = pixelsY;
-		description.format = sRGB ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM;
+		description.width = image.width;
+		description.height = image.height;
+		description.format = sRGB && ConvertResourceFormatToSRGB(image.format) != DXGI_FORMAT_UNKNOWN ? ConvertResourceFormatToSRGB(image.format) : image.format;
+		description.mipMapping = image.mips.size() > 1;
 
 		// #TODO: Derive name from asset name + texture type.
 		auto textureResource = device.GetResourceManager().Create(description, VGText("Asset texture"));
 
-		device.GetResourceManager().Write(textureResource, dataResource);
+		for (uint32_t i = 0; i < image.mips.size(); ++i)
+		{
+			device.GetResourceManager().Write(textureResource, image.mips[i], i);
+		}
 
 		device.GetDirectList().TransitionBarrier(textureResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
 
 		return textureResource;
 	}
+
+	TextureHandle LoadTexture(RenderDevice& device, std::filesystem::path path, bool sRGB)
+	{
+		VGScopedCPUStat("Load Texture");
+
+		const auto image = ReadTexture(path);
+		if (!image)
+		{
+			return {};
+		}
+
+		return CreateTexture(device, *image, sRGB);
+	}
+
+	std::optional<TextureImage> LoadDds(const std::filesystem::path& path)
+	{
+		VGScopedCPUStat("Load DDS");
+
+		auto file = std::make_unique<MappedFile>();
+		if (!file->Open(path))
+		{
+			return std::nullopt;
+		}
+
+		const auto data = file->Data();
+		size_t offset = 0;
+
+		// Copies the next structure out of the mapping, the file's layout doesn't guarantee alignment.
+		const auto Read = [&](auto& value)
+		{
+			if (offset + sizeof(value) > data.size())
+			{
+				return false;
+			}
+
+			std::memcpy(&value, data.data() + offset, sizeof(value));
+			offset += sizeof(value);
+
+			return true;
+		};
+
+		uint32_t magic = 0;
+		DdsHeader header{};
+
+		if (!Read(magic) || !Read(header) || magic != ddsMagic || header.size != sizeof(DdsHeader) || (header.flags & ddsFlagsRequired) != ddsFlagsRequired)
+		{
+			VGLogWarning(logAsset, "Invalid DDS header in '{}'.", path.generic_wstring());
+			return std::nullopt;
+		}
+
+		TextureImage image;
+		image.width = header.width;
+		image.height = header.height;
+
+		if ((header.pixelFormat.flags & ddsPixelFourCC) && header.pixelFormat.fourCC == MakeFourCC('D', 'X', '1', '0'))
+		{
+			DdsHeaderDx10 extendedHeader{};
+
+			if (!Read(extendedHeader) || extendedHeader.resourceDimension != ddsDimensionTexture2D || extendedHeader.arraySize > 1 || (extendedHeader.miscFlag & 0x4))
+			{
+				VGLogWarning(logAsset, "Unsupported DDS texture in '{}', only 2D textures are supported.", path.generic_wstring());
+				return std::nullopt;
+			}
+
+			image.format = extendedHeader.format;
+		}
+
+		else
+		{
+			image.format = GetLegacyDdsFormat(header.pixelFormat);
+		}
+
+		if (image.format == DXGI_FORMAT_UNKNOWN || GetResourceFormatSize(image.format) == 0 || (header.caps2 & ddsCaps2Cubemap) || image.width == 0 || image.height == 0)
+		{
+			VGLogWarning(logAsset, "Unsupported DDS format in '{}'.", path.generic_wstring());
+			return std::nullopt;
+		}
+
+		const auto mipCount = header.flags & ddsFlagMipCount ? std::clamp(header.mipMapCount, 1u, GetMipCount(image.width, image.height)) : 1u;
+		image.mips.reserve(mipCount);
+
+		// Mips view the mapping directly, nothing is read until they're uploaded.
+		for (uint32_t i = 0; i < mipCount; ++i)
+		{
+			const auto size = GetMipSize(image.format, image.width, image.height, i);
+			if (offset + size > data.size())
+			{
+				VGLogWarning(logAsset, "Truncated DDS texture in '{}'.", path.generic_wstring());
+				return std::nullopt;
+			}
+
+			image.mips.emplace_back(reinterpret_cast<const unsigned char*>(data.data() + offset), size);
+			offset += size;
+		}
+
+		image.file = std::move(file);
+
+		return image;
+	}
+
+	bool SaveDds(const std::filesystem::path& path, const TextureImage& image)
+	{
+		VGScopedCPUStat("Save DDS");
+
+		std::error_code error;
+		std::filesystem::create_directories(path.parent_path(), error);
+
+		std::ofstream stream{ path, std::ios::binary };
+		if (!stream.is_open())
+		{
+			return false;
+		}
+
+		DdsHeader header{};
+		header.size = sizeof(DdsHeader);
+		header.flags = ddsFlagsRequired | ddsFlagLinearSize | (image.mips.size() > 1 ? ddsFlagMipCount : 0);
+		header.height = image.height;
+		header.width = image.width;
+		header.pitchOrLinearSize = static_cast<uint32_t>(image.mips.front().size());
+		header.depth = 1;
+		header.mipMapCount = static_cast<uint32_t>(image.mips.size());
+		header.pixelFormat.size = sizeof(DdsPixelFormat);
+		header.pixelFormat.flags = ddsPixelFourCC;
+		header.pixelFormat.fourCC = MakeFourCC('D', 'X', '1', '0');
+		header.caps = ddsCapsTexture | (image.mips.size() > 1 ? ddsCapsComplexMipmap : 0);
+
+		DdsHeaderDx10 extendedHeader{};
+		extendedHeader.format = image.format;
+		extendedHeader.resourceDimension = ddsDimensionTexture2D;
+		extendedHeader.arraySize = 1;
+
+		stream.write(reinterpret_cast<const char*>(&ddsMagic), sizeof(ddsMagic));
+		stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		stream.write(reinterpret_cast<const char*>(&extendedHeader), sizeof(extendedHeader));
+
+		for (const auto& mip : image.mips)
+		{
+			stream.write(reinterpret_cast<const char*>(mip.data()), mip.size());
+		}
+
+		return static_cast<bool>(stream);
+	}
+
+	TextureImage TranscodeTexture(const std::vector<unsigned char>& texels, uint32_t width, uint32_t height, DXGI_FORMAT format, uint32_t firstChannel, uint32_t secondChannel)
+	{
+		VGScopedCPUStat("Transcode Texture");
+
+		format = ResolveTranscodeFormat(format, width, height);
+
+		size_t hash = std::hash<std::string_view>{}(std::string_view{ reinterpret_cast<const char*>(texels.data()), texels.size() });
+		HashCombine(hash, width, height, static_cast<uint32_t>(format), firstChannel, secondChannel, transcodeCacheVersion);
+
+		const auto cachePath = GetTextureCachePath(hash);
+		if (auto cached = LoadDds(cachePath); cached && cached->width == width && cached->height == height && cached->format == format && cached->mips.size() == GetMipCount(width, height))
+		{
+			return std::move(*cached);
+		}
+
+		auto image = BuildTextureImage(texels, width, height, format, firstChannel, secondChannel);
+
+		if (!SaveDds(cachePath, image))
+		{
+			VGLogWarning(logAsset, "Failed to cache transcoded texture.");
+		}
+
+		return image;
+	}
+
+	std::optional<TextureImage> DecodeTexture(const std::vector<unsigned char>& encoded, DXGI_FORMAT format, uint32_t firstChannel, uint32_t secondChannel)
+	{
+		VGScopedCPUStat("Decode Texture");
+
+		// Keyed by the encoded bytes and the requested format, so a cache hit doesn't need to decode at all.
+		size_t hash = std::hash<std::string_view>{}(std::string_view{ reinterpret_cast<const char*>(encoded.data()), encoded.size() });
+		HashCombine(hash, static_cast<uint32_t>(format), firstChannel, secondChannel, transcodeCacheVersion);
+
+		const auto cachePath = GetTextureCachePath(hash);
+		if (auto cached = LoadDds(cachePath); cached && cached->mips.size() == GetMipCount(cached->width, cached->height))
+		{
+			return std::move(*cached);
+		}
+
+		int width;
+		int height;
+		int components;
+
+		unsigned char* data = nullptr;
+
+		{
+			VGScopedCPUStat("STB Load");
+
+			data = stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()), &width, &height, &components, STBI_rgb_alpha);
+		}
+
+		if (!data)
+		{
+			VGLogError(logAsset, "Failed to decode texture.");
+			return std::nullopt;
+		}
+
+		std::vector<unsigned char> texels{ data, data + static_cast<size_t>(width) * static_cast<size_t>(height) * STBI_rgb_alpha };
+		STBI_FREE(data);
+
+		// BC1 can't store translucency.
+		if (ConvertResourceFormatToLinear(format) == DXGI_FORMAT_BC1_UNORM && TextureCompression::HasTranslucency(texels.data(), width, height))
+		{
+			format = IsResourceFormatSRGB(format) ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM;
+		}
+
+		format = ResolveTranscodeFormat(format, width, height);
+
+		auto image = BuildTextureImage(texels, width, height, format, firstChannel, secondChannel);
+
+		if (!SaveDds(cachePath, image))
+		{
+			VGLogWarning(logAsset, "Failed to cache transcoded texture.");
+		}
+
+		return image;
+	}
 }
\ No newline at end of file
@@ -3,12 +3,50 @@
 #pragma once
 
 #include <Rendering/ResourceHandle.h>
+#include <Utility/MappedFile.h>
+
+#include <dxgiformat.h>
 
 #include <filesystem>
+#include <optional>
+#include <vector>
+#include <span>
+#include <memory>
+#include <cstdint>
 
 class RenderDevice;
 
 namespace AssetLoader
 {
+	// Texels of each mip, most detailed first. Block compressed mips are rows of 4x4 blocks. Images loaded from disk
+	// view their mapped file, so mips are only paged in when they're uploaded, otherwise the image owns its mips.
+	struct TextureImage
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+		std::vector<std::span<const unsigned char>> mips;
+		std::vector<std::vector<unsigned char>> storage;  // Owned mips, empty when mapped.
+		std::unique_ptr<MappedFile> file;
+	};
+
+	// DDS files keep their format and mips, everything else is decoded to RGBA8 without mips. Doesn't touch the device,
+	// safe to call from any thread.
+	std::optional<TextureImage> ReadTexture(const std::filesystem::path& path);
+	// Creates and uploads the read image, on the render thread.
+	TextureHandle CreateTexture(RenderDevice& device, const TextureImage& image, bool sRGB);
+	// Reads and creates the texture at once.
 	TextureHandle LoadTexture(RenderDevice& device, std::filesystem::path path, bool sRGB);
+
+	// 2D textures only, without arrays or cubes. The file stays mapped for the lifetime of the image.
+	std::optional<TextureImage> LoadDds(const std::filesystem::path& path);
+	bool SaveDds(const std::filesystem::path& path, const TextureImage& image);
+
+	// Builds the full mip chain of tightly packed RGBA8 texels, block compressing each mip when the format is block
+	// compressed. BC4 and BC5 store the given source channels. Results are cached on disk, so each image is only
+	// transcoded once. Falls back to RGBA8 if the image can't be compressed.
+	TextureImage TranscodeTexture(const std::vector<unsigned char>& texels, uint32_t width, uint32_t height, DXGI_FORMAT format, uint32_t firstChannel = 0, uint32_t secondChannel = 1);
+	// Decodes an encoded image (PNG, JPEG, ...) to RGBA8 and transcodes it. Cached by the encoded bytes, so previously
+	// transcoded images skip decoding. Translucent images requested as BC1 are stored as BC3. Thread safe.
+	std::optional<TextureImage> DecodeTexture(const std::vector<unsigned char>& encoded, DXGI_FORMAT format, uint32_t firstChannel = 0, uint32_t secondChannel = 1);
 }
\ No newline at end of file
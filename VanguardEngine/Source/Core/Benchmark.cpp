@@ -0,0 +1,535 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Core/Benchmark.h>
+#include <Core/Base.h>
+#include <Core/Config.h>
+#include <Core/Globals.h>
+#include <Core/ConsoleVariable.h>
+#include <Rendering/Renderer.h>
+#include <Rendering/Device.h>
+#include <Rendering/RenderComponents.h>
+#include <Rendering/RenderSystems.h>
+#include <Asset/AssetManager.h>
+
+#include <json.hpp>
+
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+	XMFLOAT3 ReadFloat3(const nlohmann::json& object, const char* key, const XMFLOAT3& fallback)
+	{
+		if (!object.contains(key) || !object[key].is_array() || object[key].size() != 3)
+			return fallback;
+
+		const auto& value = object[key];
+		return { value[0].get<float>(), value[1].get<float>(), value[2].get<float>() };
+	}
+
+	std::filesystem::path ResolvePath(const std::filesystem::path& path)
+	{
+		return path.is_absolute() ? path : Config::engineRootPath / path;
+	}
+
+	StressSettings ReadStressSettings(const nlohmann::json& object, const StressSettings& fallback)
+	{
+		return {
+			.objectCount = object.value("Objects", fallback.objectCount),
+			.lightCount = object.value("Lights", fallback.lightCount),
+			.lightBoundsMin = ReadFloat3(object, "LightBoundsMin", fallback.lightBoundsMin),
+			.lightBoundsMax = ReadFloat3(object, "LightBoundsMax", fallback.lightBoundsMax),
+			.cloudCoverage = object.value("CloudCoverage", fallback.cloudCoverage),
+			.cloudRayMarchQuality = object.value("CloudRayMarchQuality", fallback.cloudRayMarchQuality),
+			.cloudRenderScale = object.value("CloudRenderScale", fallback.cloudRenderScale),
+			.seed = object.value("Seed", fallback.seed)
+		};
+	}
+
+	// Every combination of the swept values, each applied over the base settings.
+	std::vector<StressSettings> ExpandSweep(const nlohmann::json& sweep, const StressSettings& base)
+	{
+		std::vector<StressSettings> runs{ base };
+
+		for (const auto& [key, values] : sweep.items())
+		{
+			if (!values.is_array() || values.empty())
+			{
+				VGLogWarning(logCore, "Skipping benchmark sweep of '{}', expected an array of values.", key);
+				continue;
+			}
+
+			std::vector<StressSettings> expanded;
+			expanded.reserve(runs.size() * values.size());
+
+			for (const auto& settings : runs)
+			{
+				for (const auto& value : values)
+				{
+					expanded.emplace_back(ReadStressSettings(nlohmann::json{ { key, value } }, settings));
+				}
+			}
+
+			runs = std::move(expanded);
+		}
+
+		return runs;
+	}
+
+	std::string ToNarrow(const std::wstring& text)
+	{
+		std::string result(text.size(), '\0');
+		std::transform(text.begin(), text.end(), result.begin(), [](wchar_t character) { return static_cast<char>(character); });
+
+		return result;
+	}
+
+	nlohmann::json SummaryToJson(const auto& summary)
+	{
+		return {
+			{ "Mean", summary.mean },
+			{ "P50", summary.median },
+			{ "P95", summary.percentile95 },
+			{ "P99", summary.percentile99 },
+			{ "Samples", summary.samples }
+		};
+	}
+}
+
+Benchmark::TimingSummary Benchmark::Summarize(std::vector<float> values)
+{
+	if (values.empty())
+		return {};
+
+	std::sort(values.begin(), values.end());
+
+	const auto percentile = [&](float fraction)
+	{
+		return values[std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()))];
+	};
+
+	return {
+		.mean = std::accumulate(values.begin(), values.end(), 0.f) / values.size(),
+		.median = percentile(0.5f),
+		.percentile95 = percentile(0.95f),
+		.percentile99 = percentile(0.99f),
+		.samples = values.size()
+	};
+}
+
+TransformComponent Benchmark::SampleCameraPath(float time) const
+{
+	TransformComponent transform{};
+
+	if (cameraPath.size() == 1 || time <= cameraPath.front().time)
+	{
+		transform.translation = cameraPath.front().translation;
+		transform.rotation = cameraPath.front().rotation;
+
+		return transform;
+	}
+
+	if (time >= cameraPath.back().time)
+	{
+		transform.translation = cameraPath.back().translation;
+		transform.rotation = cameraPath.back().rotation;
+
+		return transform;
+	}
+
+	const auto next = std::upper_bound(cameraPath.begin(), cameraPath.end(), time, [](float value, const auto& key) { return value < key.time; });
+	const auto index = static_cast<size_t>(std::distance(cameraPath.begin(), next)) - 1;
+
+	const auto& p1 = cameraPath[index];
+	const auto& p2 = cameraPath[index + 1];
+	const auto& p0 = cameraPath[index > 0 ? index - 1 : index];
+	const auto& p3 = cameraPath[std::min(index + 2, cameraPath.size() - 1)];
+
+	const auto segment = std::max(p2.time - p1.time, 0.0001f);
+	const auto t = (time - p1.time) / segment;
+
+	// Catmull-Rom through the positions keeps the motion smooth across keys, rotations are blended linearly.
+	const auto translation = XMVectorCatmullRom(XMLoadFloat3(&p0.translation), XMLoadFloat3(&p1.translation), XMLoadFloat3(&p2.translation), XMLoadFloat3(&p3.translation), t);
+	const auto rotation = XMVectorLerp(XMLoadFloat3(&p1.rotation), XMLoadFloat3(&p2.rotation), t);
+
+	XMStoreFloat3(&transform.translation, translation);
+	XMStoreFloat3(&transform.rotation, rotation);
+
+	return transform;
+}
+
+void Benchmark::FinishRun()
+{
+	RunResult result{
+		.cpuFrame = Summarize(cpuFrameTimes),
+		.gpuFrame = Summarize(gpuFrameTimes)
+	};
+
+	for (const auto& [pass, times] : gpuPassTimes)
+	{
+		result.gpuPasses[pass] = Summarize(times);
+	}
+
+	if (replaying)
+	{
+		// The timeline is captured every replayed frame, the last one is as good as any other.
+		const auto& timeline = Renderer::Get().GetGraphTimeline();
+		ReplayGraph graph{ .divergedFrames = divergedFrames };
+
+		for (const auto index : timeline.order)
+		{
+			const auto& pass = timeline.passes[index];
+			if (!pass.enabled)
+				continue;
+
+			graph.passes.emplace_back(ReplayPass{
+				.name = std::string{ pass.name },
+				.asyncCompute = pass.asyncCompute,
+				.barriers = pass.transitions + pass.uavBarriers + pass.aliasingBarriers
+			});
+		}
+
+		for (const auto& transient : timeline.transients)
+		{
+			graph.transients.emplace_back(ReplayTransient{
+				.name = ToNarrow(transient.name),
+				.texture = transient.texture,
+				.size = transient.size,
+				.aliased = transient.heap.has_value()
+			});
+		}
+
+		if (divergedFrames > 0)
+		{
+			VGLogWarning(logCore, "Benchmark '{}' run {} replayed {} frames with a different graph structure, the scene wasn't static.", name, run, divergedFrames);
+		}
+
+		result.replay = std::move(graph);
+
+		// The next run builds its scene, which needs the renderer to take in changes again.
+		Renderer::Get().SetReplaying(false);
+		replaying = false;
+		replayHash = 0;
+		divergedFrames = 0;
+	}
+
+	VGLog(logCore, "Benchmark '{}' run {} finished after {} frames, CPU frame mean {:.3f} ms, GPU frame mean {:.3f} ms.",
+		name, run, cpuFrameTimes.size(), result.cpuFrame.mean, result.gpuFrame.mean);
+
+	results.emplace_back(std::move(result));
+
+	cpuFrameTimes.clear();
+	gpuFrameTimes.clear();
+	gpuPassTimes.clear();
+}
+
+void Benchmark::WriteResults() const
+{
+	std::filesystem::create_directories(outputPath.parent_path());
+
+	nlohmann::json runs = nlohmann::json::array();
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const auto& result = results[i];
+
+		nlohmann::json passes = nlohmann::json::object();
+		for (const auto& [pass, summary] : result.gpuPasses)
+		{
+			passes[pass] = SummaryToJson(summary);
+		}
+
+		nlohmann::json runResult = {
+			{ "CPUFrame", SummaryToJson(result.cpuFrame) },
+			{ "GPUFrame", SummaryToJson(result.gpuFrame) },
+			{ "GPUPasses", passes }
+		};
+
+		if (result.replay)
+		{
+			nlohmann::json replayPasses = nlohmann::json::array();
+			for (const auto& pass : result.replay->passes)
+			{
+				replayPasses.push_back({
+					{ "Name", pass.name },
+					{ "Queue", pass.asyncCompute ? "Compute" : "Graphics" },
+					{ "Barriers", pass.barriers }
+				});
+			}
+
+			nlohmann::json replayTransients = nlohmann::json::array();
+			for (const auto& transient : result.replay->transients)
+			{
+				replayTransients.push_back({
+					{ "Name", transient.name },
+					{ "Texture", transient.texture },
+					{ "Bytes", transient.size },
+					{ "Aliased", transient.aliased }
+				});
+			}
+
+			runResult["Replay"] = {
+				{ "DivergedFrames", result.replay->divergedFrames },
+				{ "Passes", replayPasses },
+				{ "Transients", replayTransients }
+			};
+		}
+
+		if (i < stressRuns.size())
+		{
+			const auto& settings = stressRuns[i];
+			runResult["Objects"] = settings.objectCount;
+			runResult["Lights"] = settings.lightCount;
+			runResult["CloudCoverage"] = settings.cloudCoverage;
+			runResult["CloudRayMarchQuality"] = settings.cloudRayMarchQuality;
+			runResult["CloudRenderScale"] = settings.cloudRenderScale;
+		}
+
+		runs.emplace_back(std::move(runResult));
+	}
+
+	const nlohmann::json summary = {
+		{ "Name", name },
+		{ "Timestep", timestep },
+		{ "ReplayFrames", replayFrames },
+		{ "Runs", runs }
+	};
+
+	auto jsonPath = outputPath;
+	jsonPath += ".json";
+	std::ofstream jsonStream{ jsonPath };
+	jsonStream << summary.dump(4);
+
+	// One row per run and metric, the stress settings as columns so that scaling curves can be plotted directly.
+	auto csvPath = outputPath;
+	csvPath += ".csv";
+	std::ofstream csvStream{ csvPath };
+	csvStream << "Run,Objects,Lights,CloudCoverage,CloudRayMarchQuality,CloudRenderScale,Metric,Mean,P50,P95,P99,Samples\n";
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const auto settings = i < stressRuns.size() ? stressRuns[i] : StressSettings{};
+
+		const auto WriteRow = [&](const std::string& metric, const TimingSummary& timing)
+		{
+			csvStream << i << ',' << settings.objectCount << ',' << settings.lightCount << ',' << settings.cloudCoverage << ','
+				<< settings.cloudRayMarchQuality << ',' << settings.cloudRenderScale << ",\"" << metric << "\"," << timing.mean << ','
+				<< timing.median << ',' << timing.percentile95 << ',' << timing.percentile99 << ',' << timing.samples << '\n';
+		};
+
+		WriteRow("CPU frame", results[i].cpuFrame);
+		WriteRow("GPU frame", results[i].gpuFrame);
+
+		for (const auto& [pass, timing] : results[i].gpuPasses)
+		{
+			WriteRow("GPU pass: " + pass, timing);
+		}
+	}
+
+	if (!jsonStream.good() || !csvStream.good())
+	{
+		VGLogError(logCore, "Failed to write benchmark results to '{}'.", outputPath.generic_string());
+		return;
+	}
+
+	VGLog(logCore, "Benchmark '{}' finished {} runs. Results written to '{}'.", name, results.size(), outputPath.generic_string());
+}
+
+std::optional<std::filesystem::path> Benchmark::GetScenePath()
+{
+	const auto argument = std::find(GCommandLineArgs.begin(), GCommandLineArgs.end(), L"-benchmark");
+	if (argument == GCommandLineArgs.end() || std::next(argument) == GCommandLineArgs.end())
+		return std::nullopt;
+
+	const std::filesystem::path path{ *std::next(argument) };
+	if (std::filesystem::exists(path))
+		return path;
+
+	return ResolvePath(path);
+}
+
+bool Benchmark::Load(const std::filesystem::path& path)
+{
+	VGScopedCPUStat("Benchmark Load");
+
+	std::ifstream stream{ path };
+	if (!stream.is_open())
+	{
+		VGLogError(logCore, "Failed to open benchmark scene '{}'.", path.generic_string());
+		return false;
+	}
+
+	// Exceptions are disabled, so parse errors are reported through a discarded value.
+	const auto scene = nlohmann::json::parse(stream, nullptr, false);
+	if (scene.is_discarded() || !scene.is_object())
+	{
+		VGLogError(logCore, "Failed to parse benchmark scene '{}'.", path.generic_string());
+		return false;
+	}
+
+	name = scene.value("Name", path.stem().string());
+	warmupFrames = scene.value("WarmupFrames", warmupFrames);
+	timestep = std::max(scene.value("Timestep", timestep), 0.0001f);
+	outputPath = ResolvePath(scene.value("Output", "Benchmarks/" + name));
+	replayFrames = scene.value("Replay", replayFrames);
+
+	if (scene.contains("Models") && scene["Models"].is_array())
+	{
+		for (const auto& model : scene["Models"])
+		{
+			if (!model.contains("Path") || !model["Path"].is_string())
+			{
+				VGLogWarning(logCore, "Skipping benchmark model without a path.");
+				continue;
+			}
+
+			models.emplace_back(ModelPlacement{
+				.path = ResolvePath(model["Path"].get<std::string>()),
+				.transform = {
+					.scale = ReadFloat3(model, "Scale", { 1.f, 1.f, 1.f }),
+					.rotation = ReadFloat3(model, "Rotation", { 0.f, 0.f, 0.f }),
+					.translation = ReadFloat3(model, "Translation", { 0.f, 0.f, 0.f })
+				}
+			});
+		}
+	}
+
+	if (scene.contains("Stress") && scene["Stress"].is_object())
+	{
+		const auto& stress = scene["Stress"];
+		auto& stressScene = StressScene::Get();
+
+		if (stress.contains("Model") && stress["Model"].is_string())
+		{
+			stressScene.modelPath = ResolvePath(stress["Model"].get<std::string>());
+		}
+
+		stressScene.gridSpacing = stress.value("Spacing", stressScene.gridSpacing);
+		stressScene.gridScale = stress.value("Scale", stressScene.gridScale);
+
+		const auto base = ReadStressSettings(stress, {});
+		stressRuns = stress.contains("Sweep") && stress["Sweep"].is_object() ? ExpandSweep(stress["Sweep"], base) : std::vector{ base };
+	}
+
+	if (scene.contains("CameraPath") && scene["CameraPath"].is_array())
+	{
+		for (const auto& key : scene["CameraPath"])
+		{
+			cameraPath.emplace_back(CameraKey{
+				.time = key.value("Time", 0.f),
+				.translation = ReadFloat3(key, "Translation", { 0.f, 0.f, 0.f }),
+				.rotation = ReadFloat3(key, "Rotation", { 0.f, 0.f, 0.f })
+			});
+		}
+	}
+
+	if (cameraPath.empty())
+	{
+		VGLogError(logCore, "Benchmark scene '{}' has no camera path.", path.generic_string());
+		return false;
+	}
+
+	std::stable_sort(cameraPath.begin(), cameraPath.end(), [](const auto& left, const auto& right) { return left.time < right.time; });
+
+	if (replayFrames > 0)
+		VGLog(logCore, "Loaded benchmark '{}', replaying {} frames from the start of the camera path.", name, replayFrames);
+	else
+		VGLog(logCore, "Loaded benchmark '{}', {} camera keys over {:.2f} seconds.", name, cameraPath.size(), cameraPath.back().time);
+
+	return true;
+}
+
+void Benchmark::BuildScene(entt::registry& registry, entt::entity spectator)
+{
+	VGScopedCPUStat("Benchmark Build Scene");
+
+	camera = spectator;
+	registry.get<TransformComponent>(camera) = SampleCameraPath(0.f);
+
+	// Uncapped, with pass timing for the per-pass results.
+	CvarSet("frameRateLimit", 0);
+	CvarSet("backgroundFrameRate", 0);
+	CvarSet("onDemandRendering", 0);
+	CvarSet("gpuPassTiming", 1);
+
+	// Models are loaded synchronously, streaming in during the capture would skew the timings.
+	for (const auto& model : models)
+	{
+		const auto entity = registry.create();
+		registry.emplace<NameComponent>(entity, model.path.stem().string());
+		registry.emplace<TransformComponent>(entity, model.transform);
+		registry.emplace<MeshComponent>(entity, AssetManager::Get().LoadModel(model.path));
+	}
+}
+
+void Benchmark::Update(entt::registry& registry)
+{
+	// Each stress run rebuilds its scene before warming up, which also covers uploading the new instances.
+	if (frame == 0 && run < stressRuns.size())
+	{
+		StressScene::Get().Build(registry, stressRuns[run]);
+	}
+
+	if (replaying)
+		return;
+
+	// The scene has settled by the end of the warm up, from there on the frame is replayed as is.
+	if (replayFrames > 0 && frame == warmupFrames)
+	{
+		Renderer::Get().SetReplaying(true);
+		replaying = true;
+
+		return;
+	}
+
+	// The camera holds at the start of the path while warming up, and for the whole run while replaying.
+	const auto time = frame < warmupFrames || replayFrames > 0 ? 0.f : (frame - warmupFrames) * timestep;
+
+	auto& transform = registry.get<TransformComponent>(camera);
+	transform = SampleCameraPath(time);
+	registry.patch<TransformComponent>(camera);
+
+	CameraSystem::Place(transform, registry.get<CameraComponent>(camera));
+}
+
+bool Benchmark::Record(float cpuFrameTimeMs)
+{
+	if (frame++ < warmupFrames)
+		return true;
+
+	cpuFrameTimes.emplace_back(cpuFrameTimeMs);
+
+	// GPU timings trail by the frames in flight, which the warm up covers.
+	auto& device = *Renderer::Get().device;
+	gpuFrameTimes.emplace_back(device.GetGPUFrameTime());
+
+	for (const auto& pass : device.GetProfiler().GetStatistics())
+	{
+		gpuPassTimes[pass.name].emplace_back(pass.lastTime);
+	}
+
+	if (replaying)
+	{
+		const auto hash = Renderer::Get().GetGraphHash();
+		if (replayHash == 0)
+			replayHash = hash;
+		else if (hash != replayHash)
+			++divergedFrames;
+
+		if (frame - warmupFrames < replayFrames)
+			return true;
+	}
+
+	else if ((frame - warmupFrames) * timestep < cameraPath.back().time)
+		return true;
+
+	FinishRun();
+
+	frame = 0;
+	if (++run < stressRuns.size())
+		return true;
+
+	WriteResults();
+
+	return false;
+}
\ No newline at end of file
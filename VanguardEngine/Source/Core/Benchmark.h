@@ -0,0 +1,121 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Core/CoreComponents.h>
+#include <Core/StressScene.h>
+
+#include <entt/entt.hpp>
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+#include <map>
+
+// Scripted performance capture, enabled with '-benchmark <scene.json>'. The scene description is built in place of the
+// default scene, then a recorded camera path plays back with a fixed timestep. After warming up, every frame's CPU and GPU
+// times are collected, and a summary is written as JSON and CSV once the path ends. Stress sweeps play the path once for
+// each combination of the swept settings, giving scaling curves of the frame times. Replays hold the camera at the start
+// of the path instead, and render the same frame repeatedly without updating the scene or assets, which isolates changes
+// to the GPU passes from the noise of the scene. The executed graph's pass order, barriers and transients are written with
+// the results, so replays of different builds can be compared pass by pass.
+class Benchmark
+{
+private:
+	struct CameraKey
+	{
+		float time;  // Seconds.
+		XMFLOAT3 translation;
+		XMFLOAT3 rotation;
+	};
+
+	struct ModelPlacement
+	{
+		std::filesystem::path path;
+		TransformComponent transform;
+	};
+
+	std::string name;
+	uint32_t warmupFrames = 60;
+	float timestep = 1.f / 60.f;  // Seconds.
+	std::filesystem::path outputPath;  // Without extension.
+	uint32_t replayFrames = 0;  // Frames each run replays after warming up, zero plays the camera path instead.
+
+	struct TimingSummary
+	{
+		float mean = 0.f;  // Milliseconds.
+		float median = 0.f;
+		float percentile95 = 0.f;
+		float percentile99 = 0.f;
+		size_t samples = 0;
+	};
+
+	struct ReplayPass
+	{
+		std::string name;
+		bool asyncCompute = false;
+		uint32_t barriers = 0;  // Transitions, UAV and aliasing barriers issued before the pass.
+	};
+
+	struct ReplayTransient
+	{
+		std::string name;
+		bool texture = false;
+		uint64_t size = 0;  // Bytes.
+		bool aliased = false;  // Placed in a heap shared with other transients.
+	};
+
+	// Graph executed by the replayed frames.
+	struct ReplayGraph
+	{
+		std::vector<ReplayPass> passes;  // In execution order.
+		std::vector<ReplayTransient> transients;
+		uint32_t divergedFrames = 0;  // Built a graph with another structure than the first replayed frame.
+	};
+
+	struct RunResult
+	{
+		TimingSummary cpuFrame;
+		TimingSummary gpuFrame;
+		std::map<std::string, TimingSummary> gpuPasses;
+		std::optional<ReplayGraph> replay;
+	};
+
+	std::vector<ModelPlacement> models;
+	std::vector<StressSettings> stressRuns;  // Empty without a stress scene, the path then plays once.
+	std::vector<CameraKey> cameraPath;
+
+	entt::entity camera = entt::null;
+	size_t run = 0;
+	uint32_t frame = 0;  // Within the run, including warm up.
+	std::vector<float> cpuFrameTimes;  // Milliseconds.
+	std::vector<float> gpuFrameTimes;
+	std::map<std::string, std::vector<float>> gpuPassTimes;
+	std::vector<RunResult> results;
+
+	bool replaying = false;
+	size_t replayHash = 0;  // Graph structure of the first replayed frame.
+	uint32_t divergedFrames = 0;
+
+	static TimingSummary Summarize(std::vector<float> values);
+
+	TransformComponent SampleCameraPath(float time) const;
+	void FinishRun();
+	void WriteResults() const;
+
+public:
+	// Path of the scene description given on the command line, if any.
+	static std::optional<std::filesystem::path> GetScenePath();
+
+	bool Load(const std::filesystem::path& path);
+	void BuildScene(entt::registry& registry, entt::entity spectator);
+
+	float GetTimestep() const noexcept { return timestep; }
+	// The scene, assets and simulation are left untouched while replaying.
+	bool IsReplaying() const noexcept { return replaying; }
+	// Places the camera for the frame about to be rendered.
+	void Update(entt::registry& registry);
+	// Collects the timings of the frame that just finished. Returns false once the benchmark has ended.
+	bool Record(float cpuFrameTimeMs);
+};
\ No newline at end of file
@@ -3,6 +3,7 @@
 #pragma once
 
 #include <filesystem>
+#include <string>
 
 namespace Config
 {
@@ -15,6 +16,7 @@ namespace Config
 	inline std::filesystem::path fontsPath;
 	inline std::filesystem::path materialsPath;
 	inline std::filesystem::path utilitiesPath;
+	inline std::string qualityPreset;  // Low, Medium, High or Ultra, Auto picks one for the adapter.
 
 	void Initialize();
 };
\ No newline at end of file
@@ -16,6 +16,7 @@
 #define CvarCreate(name, description, defaultValue) CvarManager::Get().CreateVariable(name, description, defaultValue)
 #define CvarGet(name, type) CvarManager::Get().GetVariable<type>(name ## _hs)
 #define CvarSet(name, value) CvarManager::Get().SetVariable(name ## _hs, value)
+#define CvarGetHandle(name, type) CvarManager::Get().GetHandle<type>(name ## _hs)
 
 using namespace entt::literals;
 
@@ -32,8 +33,42 @@ struct Cvar
 	CvarType type;
 	std::string name;
 	std::string description;
+	size_t generation = 0;  // Incremented each time the variable is set.
 };
 
+// Typed reference directly into a variable's storage, avoiding the name lookup on every access. Storage never moves, so
+// handles stay valid for the lifetime of the manager.
+template <typename T>
+class CvarHandle
+{
+private:
+	const T* data = nullptr;
+	const Cvar* cvar = nullptr;
+
+public:
+	CvarHandle() = default;
+	CvarHandle(const T* inData, const Cvar* inCvar) : data(inData), cvar(inCvar) {}
+
+	const T& operator*() const { return *data; }
+	explicit operator bool() const { return data != nullptr; }
+
+	size_t Generation() const { return cvar->generation; }
+	// True if the variable was set since the generation was last observed, the observed generation is then updated.
+	bool Changed(size_t& observedGeneration) const;
+};
+
+template <typename T>
+inline bool CvarHandle<T>::Changed(size_t& observedGeneration) const
+{
+	if (observedGeneration != cvar->generation)
+	{
+		observedGeneration = cvar->generation;
+		return true;
+	}
+
+	return false;
+}
+
 using CvarCallableType = void (*)();
 
 struct CvarStorage
@@ -62,12 +97,18 @@ private:
 	const T* GetVariable(uint32_t nameHash);
 	bool ExecuteVariable(uint32_t nameHash);
 
+	template <typename T>
+	T* GetStorage(const Cvar& cvar);
+
 public:
 	template <typename T>
-	Cvar& CreateVariable(const std::string& name, const std::string& description, const T& defaultValue);
+	CvarHandle<T> CreateVariable(const std::string& name, const std::string& description, const T& defaultValue);
 
 	template <typename T>
 	const T* GetVariable(entt::hashed_string name);
+	// Invalid if the variable doesn't exist yet.
+	template <typename T>
+	CvarHandle<T> GetHandle(entt::hashed_string name);
 
 	template <typename T>
 	bool SetVariable(entt::hashed_string name, const T& value);
@@ -101,14 +142,27 @@ inline constexpr Cvar::CvarType FindCvarType()
 }
 
 template <typename T>
-Cvar& CvarManager::CreateVariable(const std::string& name, const std::string& description, const T& defaultValue)
+inline T* CvarManager::GetStorage(const Cvar& cvar)
+{
+	void* data = nullptr;
+
+	std::visit([index = cvar.index, &data](auto&& buffer)
+	{
+		data = buffer.data() + index;
+	}, storage[(uint32_t)cvar.type].buffer);
+
+	return (T*)data;
+}
+
+template <typename T>
+CvarHandle<T> CvarManager::CreateVariable(const std::string& name, const std::string& description, const T& defaultValue)
 {
 	const auto hash = entt::hashed_string::value(name.data(), name.size());
 
 	auto existing = cvars.find(hash);
 	if (existing != cvars.end())
 	{
-		return existing->second;
+		return { GetStorage<T>(existing->second), &existing->second };
 	}
 
 	if constexpr (!std::is_same_v<T, CvarCallableType>)
@@ -137,16 +191,10 @@ Cvar& CvarManager::CreateVariable(const std::string& name, const std::string& de
 		.description = description
 	}).first;
 
-	void* data = nullptr;
+	auto* data = GetStorage<T>(it->second);
+	*data = defaultValue;
 
-	std::visit([index, &data](auto&& buffer)
-	{
-		data = buffer.data() + index;
-	}, storage[(uint32_t)type].buffer);
-
-	*(T*)data = defaultValue;
-
-	return it->second;
+	return { data, &it->second };
 }
 
 template <typename T>
@@ -156,21 +204,24 @@ const T* CvarManager::GetVariable(entt::hashed_string name)
 }
 
 template <typename T>
-const T* CvarManager::GetVariable(uint32_t nameHash)
+CvarHandle<T> CvarManager::GetHandle(entt::hashed_string name)
 {
-	const auto it = cvars.find(nameHash);
+	const auto it = cvars.find(name.value());
 	if (it != cvars.end())
 	{
-		const auto index = it->second.index;
-		const auto type = it->second.type;
-		void* data = nullptr;
+		return { GetStorage<T>(it->second), &it->second };
+	}
 
-		std::visit([index, &data](auto&& buffer)
-		{
-			data = buffer.data() + index;
-		}, storage[(uint32_t)type].buffer);
+	return {};
+}
 
-		return (const T*)data;
+template <typename T>
+const T* CvarManager::GetVariable(uint32_t nameHash)
+{
+	const auto it = cvars.find(nameHash);
+	if (it != cvars.end())
+	{
+		return GetStorage<T>(it->second);
 	}
 
 	return nullptr;
@@ -198,16 +249,8 @@ bool CvarManager::SetVariable(uint32_t nameHash, const T& value)
 			VGLog(logCore, "Cvar '{}' set to value: <function>", Str2WideStr(it->second.name));
 		}
 
-		const auto index = it->second.index;
-		const auto type = it->second.type;
-		void* data = nullptr;
-
-		std::visit([index, &data](auto&& buffer)
-		{
-			data = buffer.data() + index;
-		}, storage[(uint32_t)type].buffer);
-
-		*(T*)data = value;
+		*GetStorage<T>(it->second) = value;
+		++it->second.generation;
 		return true;
 	}
 
@@ -226,16 +269,7 @@ inline bool CvarManager::ExecuteVariable(uint32_t nameHash)
 	{
 		VGLog(logCore, "Cvar '{}' executed.", Str2WideStr(it->second.name));
 
-		const auto index = it->second.index;
-		const auto type = it->second.type;
-		void* data = nullptr;
-
-		std::visit([index, &data](auto&& buffer)
-		{
-			data = buffer.data() + index;
-		}, storage[(uint32_t)type].buffer);
-
-		(*(CvarCallableType*)data)();
+		(*GetStorage<CvarCallableType>(it->second))();
 		return true;
 	}
 
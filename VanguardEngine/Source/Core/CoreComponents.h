@@ -3,8 +3,12 @@
 #pragma once
 
 #include <DirectXMath.h>
+#include <entt/entt.hpp>
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
 
 using namespace DirectX;
 
@@ -13,12 +17,77 @@ struct NameComponent
 	std::string name;
 };
 
+// Relative to the parent, if any. Modify with registry.patch() or registry.replace(), the transform system only propagates
+// transforms it was notified of.
 struct TransformComponent
 {
 	XMFLOAT3 scale{ 1.f, 1.f, 1.f };
-	XMFLOAT3 rotation{ 0.f, 0.f, 0.f };
+	XMFLOAT3 rotation{ 0.f, 0.f, 0.f };  // Euler angles in radians, composed as a quaternion.
 	XMFLOAT3 translation{ 0.f, 0.f, 0.f };
 };
 
+// Links an entity into a transform hierarchy. Change with TransformSystem::Attach() and Detach(), which keep the sibling
+// lists and depths consistent.
+struct RelationshipComponent
+{
+	entt::entity parent = entt::null;
+	entt::entity firstChild = entt::null;
+	entt::entity previousSibling = entt::null;
+	entt::entity nextSibling = entt::null;
+	uint32_t depth = 0;  // Roots are at zero.
+};
+
+// World transform cached by the transform system, added along with the transform. Read only, renderers observe its updates
+// instead of the local transform's.
+struct WorldTransformComponent
+{
+	XMFLOAT4X4 matrix{ 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+	XMFLOAT4 rotation{ 0.f, 0.f, 0.f, 1.f };  // Quaternion.
+	XMFLOAT3 translation{ 0.f, 0.f, 0.f };
+	float maxScale = 1.f;  // Largest axis scale, bounds are scaled by it.
+};
+
+enum class AnimationPath
+{
+	Translation,
+	Rotation,  // Quaternions.
+	Scale
+};
+
+enum class AnimationInterpolation
+{
+	Linear,
+	Step,
+	CubicSpline  // Each key stores its in tangent, value and out tangent.
+};
+
+// Keyframes of one transform property of a node.
+struct AnimationChannel
+{
+	uint32_t node;  // Index of the entity in the animation component's nodes.
+	AnimationPath path;
+	AnimationInterpolation interpolation;
+	std::vector<float> times;  // Seconds, ascending.
+	std::vector<XMFLOAT4> values;  // Translations and scales leave w unused.
+};
+
+struct AnimationClip
+{
+	std::string name;
+	float duration = 0.f;
+	std::vector<AnimationChannel> channels;
+};
+
+// Plays one of a model's animation clips on its node entities, which the animation system writes the local transforms of.
+struct AnimationComponent
+{
+	std::shared_ptr<const std::vector<AnimationClip>> clips;  // Shared by every instance of the model.
+	std::vector<entt::entity> nodes;
+	uint32_t clip = 0;
+	float time = 0.f;
+	float speed = 1.f;
+	bool loop = true;
+};
+
 // Empty for now, used to tag entities that are being controlled.
 struct ControlComponent {};
\ No newline at end of file
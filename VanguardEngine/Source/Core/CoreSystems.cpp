@@ -4,9 +4,149 @@
 #include <Core/CoreComponents.h>
 #include <Rendering/Renderer.h>
 #include <Window/WindowFrame.h>
+#include <Utility/Math.h>
 
 #include <imgui.h>
 
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+namespace
+{
+	entt::observer transformObserver;  // Entities with new or changed transforms or relationships.
+
+	void OnTransformConstructed(entt::registry& registry, entt::entity entity)
+	{
+		registry.emplace_or_replace<WorldTransformComponent>(entity);
+	}
+
+	// Removes the entity from its parent's children, leaving its own children attached.
+	void Unlink(entt::registry& registry, entt::entity entity)
+	{
+		auto& relationship = registry.get<RelationshipComponent>(entity);
+		if (relationship.parent == entt::null)
+		{
+			return;
+		}
+
+		if (relationship.previousSibling != entt::null)
+		{
+			registry.get<RelationshipComponent>(relationship.previousSibling).nextSibling = relationship.nextSibling;
+		}
+
+		else
+		{
+			registry.get<RelationshipComponent>(relationship.parent).firstChild = relationship.nextSibling;
+		}
+
+		if (relationship.nextSibling != entt::null)
+		{
+			registry.get<RelationshipComponent>(relationship.nextSibling).previousSibling = relationship.previousSibling;
+		}
+
+		relationship.parent = entt::null;
+		relationship.previousSibling = entt::null;
+		relationship.nextSibling = entt::null;
+	}
+
+	// Patches the relationship so that the subtree's world transforms are recomputed.
+	void SetDepth(entt::registry& registry, entt::entity entity, uint32_t depth)
+	{
+		registry.patch<RelationshipComponent>(entity, [depth](auto& relationship) { relationship.depth = depth; });
+
+		for (auto child = registry.get<RelationshipComponent>(entity).firstChild; child != entt::null;)
+		{
+			SetDepth(registry, child, depth + 1);
+			child = registry.get<RelationshipComponent>(child).nextSibling;
+		}
+	}
+
+	// Destroyed entities are unlinked, their children become roots.
+	void OnRelationshipDestroyed(entt::registry& registry, entt::entity entity)
+	{
+		Unlink(registry, entity);
+
+		auto child = registry.get<RelationshipComponent>(entity).firstChild;
+		while (child != entt::null)
+		{
+			auto& relationship = registry.get<RelationshipComponent>(child);
+			const auto next = relationship.nextSibling;
+			relationship.parent = entt::null;
+			relationship.previousSibling = entt::null;
+			relationship.nextSibling = entt::null;
+			SetDepth(registry, child, 0);
+			child = next;
+		}
+	}
+
+	void UpdateWorldTransform(entt::registry& registry, entt::entity entity, const WorldTransformComponent* parent)
+	{
+		const auto& transform = registry.get<TransformComponent>(entity);
+
+		// Transforms rotate by their negated angles.
+		auto rotation = EulerToQuaternion(XMVectorNegate(XMLoadFloat3(&transform.rotation)));
+		auto matrix = XMMatrixAffineTransformation(XMLoadFloat3(&transform.scale), XMVectorZero(), rotation, XMLoadFloat3(&transform.translation));
+		auto maxScale = std::max(std::max(std::abs(transform.scale.x), std::abs(transform.scale.y)), std::abs(transform.scale.z));
+
+		if (parent)
+		{
+			matrix = XMMatrixMultiply(matrix, XMLoadFloat4x4(&parent->matrix));
+			rotation = XMQuaternionMultiply(rotation, XMLoadFloat4(&parent->rotation));
+			maxScale *= parent->maxScale;
+		}
+
+		// Patched so that renderers upload the new matrix.
+		registry.patch<WorldTransformComponent>(entity, [&](auto& world)
+		{
+			XMStoreFloat4x4(&world.matrix, matrix);
+			XMStoreFloat4(&world.rotation, rotation);
+			XMStoreFloat3(&world.translation, matrix.r[3]);
+			world.maxScale = maxScale;
+		});
+	}
+
+	// Rotations are interpolated as quaternions, spherically between linear keys.
+	XMVECTOR SampleChannel(const AnimationChannel& channel, float time)
+	{
+		const auto& times = channel.times;
+		const auto cubic = channel.interpolation == AnimationInterpolation::CubicSpline;
+		const auto value = [&](size_t key) { return XMLoadFloat4(&channel.values[cubic ? key * 3 + 1 : key]); };
+
+		if (time <= times.front())
+			return value(0);
+		if (time >= times.back())
+			return value(times.size() - 1);
+
+		const auto next = static_cast<size_t>(std::upper_bound(times.begin(), times.end(), time) - times.begin());
+		const auto key = next - 1;
+		const auto interval = times[next] - times[key];
+		const auto t = interval > 0.f ? (time - times[key]) / interval : 0.f;
+
+		switch (channel.interpolation)
+		{
+		case AnimationInterpolation::Step:
+			return value(key);
+
+		case AnimationInterpolation::CubicSpline:
+		{
+			// Hermite spline, the tangents are per second.
+			const auto t2 = t * t;
+			const auto t3 = t2 * t;
+			const auto outTangent = XMLoadFloat4(&channel.values[key * 3 + 2]) * interval;
+			const auto inTangent = XMLoadFloat4(&channel.values[next * 3]) * interval;
+			const auto result = value(key) * (2.f * t3 - 3.f * t2 + 1.f) + outTangent * (t3 - 2.f * t2 + t) + value(next) * (3.f * t2 - 2.f * t3) + inTangent * (t3 - t2);
+
+			return channel.path == AnimationPath::Rotation ? XMQuaternionNormalize(result) : result;
+		}
+
+		default:
+			return channel.path == AnimationPath::Rotation ? XMQuaternionSlerp(value(key), value(next), t) : XMVectorLerp(value(key), value(next), t);
+		}
+	}
+}
+
 void ControlSystem::Update(entt::registry& registry)
 {
 	VGScopedCPUStat("Control System");
@@ -29,4 +169,197 @@ void ControlSystem::Update(entt::registry& registry)
 		Renderer::Get().window->RestrainCursor(CursorRestraint::None);
 		Renderer::Get().window->ShowCursor(true);
 	}
+}
+
+void AnimationSystem::Update(entt::registry& registry, float deltaTime)
+{
+	VGScopedCPUStat("Animation System");
+
+	for (const auto entity : registry.view<AnimationComponent>())
+	{
+		auto& animation = registry.get<AnimationComponent>(entity);
+		if (!animation.clips || animation.clip >= animation.clips->size() || animation.speed == 0.f)
+		{
+			continue;
+		}
+
+		const auto& clip = (*animation.clips)[animation.clip];
+
+		// Finished clips hold their last pose without touching the transforms.
+		if (!animation.loop && (animation.speed > 0.f ? animation.time >= clip.duration : animation.time <= 0.f))
+		{
+			continue;
+		}
+
+		animation.time += deltaTime * animation.speed;
+		if (animation.loop && clip.duration > 0.f)
+		{
+			animation.time = std::fmod(animation.time, clip.duration);
+			animation.time += animation.time < 0.f ? clip.duration : 0.f;
+		}
+
+		else
+		{
+			animation.time = std::clamp(animation.time, 0.f, clip.duration);
+		}
+
+		for (const auto& channel : clip.channels)
+		{
+			if (channel.times.empty() || channel.node >= animation.nodes.size())
+			{
+				continue;
+			}
+
+			const auto node = animation.nodes[channel.node];
+			if (!registry.valid(node) || !registry.all_of<TransformComponent>(node))
+			{
+				continue;
+			}
+
+			const auto value = SampleChannel(channel, animation.time);
+			registry.patch<TransformComponent>(node, [&](auto& transform)
+			{
+				switch (channel.path)
+				{
+				case AnimationPath::Translation: XMStoreFloat3(&transform.translation, value); break;
+				case AnimationPath::Scale: XMStoreFloat3(&transform.scale, value); break;
+				case AnimationPath::Rotation:
+				{
+					// Transforms rotate by their negated angles.
+					const auto angles = QuaternionToEuler(value);
+					transform.rotation = { -angles.x, -angles.y, -angles.z };
+					break;
+				}
+				}
+			});
+		}
+	}
+}
+
+void TransformSystem::Initialize(entt::registry& registry)
+{
+	registry.on_construct<TransformComponent>().connect<&OnTransformConstructed>();
+	registry.on_destroy<RelationshipComponent>().connect<&OnRelationshipDestroyed>();
+
+	transformObserver.connect(registry, entt::collector
+		.group<TransformComponent>()
+		.update<TransformComponent>()
+		.update<RelationshipComponent>());
+}
+
+bool TransformSystem::Update(entt::registry& registry)
+{
+	VGScopedCPUStat("Transform System");
+
+	if (transformObserver.empty())
+	{
+		return false;
+	}
+
+	std::vector<entt::entity> dirty;
+	dirty.reserve(transformObserver.size());
+	for (const auto entity : transformObserver)
+	{
+		if (registry.all_of<TransformComponent, WorldTransformComponent>(entity))
+		{
+			dirty.emplace_back(entity);
+		}
+	}
+
+	transformObserver.clear();
+
+	// Shallowest first, a dirty entity recomputes its whole subtree before any of its dirty descendants are reached.
+	const auto depth = [&registry](auto entity)
+	{
+		const auto* relationship = registry.try_get<RelationshipComponent>(entity);
+		return relationship ? relationship->depth : 0u;
+	};
+
+	std::sort(dirty.begin(), dirty.end(), [&depth](auto left, auto right) { return depth(left) < depth(right); });
+
+	std::unordered_set<entt::entity> updated;
+	std::vector<entt::entity> stack;
+
+	for (const auto root : dirty)
+	{
+		if (updated.contains(root))
+		{
+			continue;
+		}
+
+		stack.emplace_back(root);
+
+		// Depth first, every entity is visited after its parent.
+		while (!stack.empty())
+		{
+			const auto entity = stack.back();
+			stack.pop_back();
+			updated.emplace(entity);
+
+			const auto* relationship = registry.try_get<RelationshipComponent>(entity);
+			const auto* parent = relationship && relationship->parent != entt::null ? registry.try_get<WorldTransformComponent>(relationship->parent) : nullptr;
+
+			UpdateWorldTransform(registry, entity, parent);
+
+			if (!relationship)
+			{
+				continue;
+			}
+
+			for (auto child = relationship->firstChild; child != entt::null; child = registry.get<RelationshipComponent>(child).nextSibling)
+			{
+				if (registry.all_of<TransformComponent, WorldTransformComponent>(child))
+				{
+					stack.emplace_back(child);
+				}
+			}
+		}
+	}
+
+	return !updated.empty();
+}
+
+void TransformSystem::Attach(entt::registry& registry, entt::entity child, entt::entity parent)
+{
+	for (auto ancestor = parent; ancestor != entt::null;)
+	{
+		if (ancestor == child)
+		{
+			VGLogWarning(logCore, "Can't attach an entity to its own descendant.");
+
+			return;
+		}
+
+		const auto* relationship = registry.try_get<RelationshipComponent>(ancestor);
+		ancestor = relationship ? relationship->parent : entt::null;
+	}
+
+	registry.get_or_emplace<RelationshipComponent>(parent);
+	registry.get_or_emplace<RelationshipComponent>(child);
+	Unlink(registry, child);
+
+	auto& parentRelationship = registry.get<RelationshipComponent>(parent);
+	auto& relationship = registry.get<RelationshipComponent>(child);
+	relationship.parent = parent;
+	relationship.nextSibling = parentRelationship.firstChild;
+
+	if (parentRelationship.firstChild != entt::null)
+	{
+		registry.get<RelationshipComponent>(parentRelationship.firstChild).previousSibling = child;
+	}
+
+	parentRelationship.firstChild = child;
+
+	SetDepth(registry, child, parentRelationship.depth + 1);
+}
+
+void TransformSystem::Detach(entt::registry& registry, entt::entity entity)
+{
+	if (!registry.all_of<RelationshipComponent>(entity))
+	{
+		return;
+	}
+
+	Unlink(registry, entity);
+	SetDepth(registry, entity, 0);
 }
\ No newline at end of file
@@ -7,4 +7,26 @@
 struct ControlSystem
 {
 	static void Update(entt::registry& registry);
+};
+
+// Samples the playing clip of each animation component into the local transforms of its nodes, which the transform system
+// then propagates.
+struct AnimationSystem
+{
+	static void Update(entt::registry& registry, float deltaTime);
+};
+
+// Caches the world transforms of entities from their local transforms and hierarchy. Only entities whose transform or
+// relationship changed are recomputed, along with their descendants, parents before their children.
+struct TransformSystem
+{
+	// Before any transforms are created, world transforms are added along with them.
+	static void Initialize(entt::registry& registry);
+	// Returns whether any world transform changed.
+	static bool Update(entt::registry& registry);
+
+	// Makes the child's transform relative to the parent, detaching it from its previous parent.
+	static void Attach(entt::registry& registry, entt::entity child, entt::entity parent);
+	// Makes the entity a root, its transform becomes its world transform.
+	static void Detach(entt::registry& registry, entt::entity entity);
 };
\ No newline at end of file
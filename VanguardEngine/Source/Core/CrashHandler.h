@@ -14,6 +14,7 @@ void SuspendProcessThreads();
 void ResumeProcessThreads();
 void ReportInternalCrashEvent(const std::wstring& reason, bool printToLog);
 bool HasDebuggerAttached();
+void StopAsyncLogging();  // See Logging.h.
 
 // Used to immediate crashing, such as a critical log or assert statement.
 // Force inline so the debugger breaks on the offending line, not in here.
@@ -40,7 +41,7 @@ VGForceInline void RequestCrash(const std::function<void()>& handler = []() {})
 		// We were the first thread to report a crash, execute our handler.
 		handler();
 
-		spdlog::shutdown();  // Flushes all sinks.
+		StopAsyncLogging();  // Flushes all sinks.
 
 		if (HasDebuggerAttached())
 		{
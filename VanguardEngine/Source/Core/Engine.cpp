@@ -11,6 +11,10 @@
 #include <Core/CoreSystems.h>
 #include <Core/CrashHandler.h>
 #include <Core/LogSinks.h>
+#include <Core/Benchmark.h>
+#include <Core/StressScene.h>
+#include <Core/Memory.h>
+#include <Threading/JobSystem.h>
 
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
@@ -19,6 +23,8 @@
 #include <string>
 #include <memory>
 #include <chrono>
+#include <optional>
+#include <utility>
 
 // #TEMP
 #include <Rendering/RenderComponents.h>
@@ -26,6 +32,7 @@
 #include <Asset/AssetLoader.h>
 #include <Utility/Random.h>
 #include <Asset/AssetManager.h>
+#include <Asset/SceneSnapshot.h>
 //
 
 entt::registry registry;
@@ -36,7 +43,7 @@ void OnFocusChanged(bool focus)
 
 	VGLog(logWindow, "{}", (focus ? VGText("Acquired focus.") : VGText("Released focus.")));
 
-	// #TODO: Limit render FPS, disable audio.
+	// The renderer caps the frame rate while unfocused. #TODO: Disable audio.
 }
 
 void OnSizeChanged(uint32_t width, uint32_t height)
@@ -55,18 +62,10 @@ void EngineBoot()
 	auto msvcSink = std::make_shared<spdlog::sinks::msvc_sink_mt>();
 	auto tracySink = std::make_shared<TracySink_mt>();
 	auto editorSink = std::make_shared<EditorSink_mt>();
-	
-	logCore = std::make_shared<spdlog::logger>("core", spdlog::sinks_init_list{ fileSink, msvcSink, tracySink, editorSink });
-	logAsset = logCore->clone("asset");
-	logEditor = logCore->clone("editor");
-	logRendering = logCore->clone("rendering");
-	logThreading = logCore->clone("threading");
-	logUtility = logCore->clone("utility");
-	logWindow = logCore->clone("window");
-
-	spdlog::set_default_logger(logCore);
-	spdlog::set_pattern("[%H:%M:%S.%e][tid:%t][%n.%l] %v");
-	spdlog::flush_on(spdlog::level::err);
+
+	StartAsyncLogging({ fileSink, msvcSink, tracySink, editorSink });
+
+	spdlog::set_pattern("[%H:%M:%S.%e][tid:%t][%n.%l] %v");  // The thread ID is captured when the message is logged, not written.
 	spdlog::flush_every(1s);
 
 	// Not useful to set an error handler, this isn't invoked unless exceptions are enabled.
@@ -79,6 +78,8 @@ void EngineBoot()
 
 	Config::Initialize();
 
+	JobSystem::Get().Initialize();
+
 	Input::EnableDPIAwareness();
 
 	constexpr uint32_t defaultWindowSizeX = 1600;
@@ -94,9 +95,16 @@ void EngineBoot()
 	constexpr auto enableDebugging = false;
 #endif
 
-	auto device = std::make_unique<RenderDevice>(static_cast<HWND>(window->GetHandle()), false, enableDebugging);
+	constexpr auto enableEnhancedBarriers = true;
+
+	auto device = std::make_unique<RenderDevice>(static_cast<HWND>(window->GetHandle()), false, enableDebugging, enableEnhancedBarriers);
+
+	// The renderer creates entities with transforms of its own.
+	TransformSystem::Initialize(registry);
 	Renderer::Get().Initialize(std::move(window), std::move(device), registry);
 
+	StressScene::Get().Initialize();
+
 	// The input requires the user interface to be created first.
 	Input::Initialize(Renderer::Get().window->GetHandle());
 
@@ -104,7 +112,7 @@ void EngineBoot()
 	AssetManager::Get().Initialize(Renderer::Get().device.get());
 }
 
-void EngineLoop()
+void CreateDefaultScene()
 {
 	const auto AddHelmet = [](const TransformComponent& transform)
 	{
@@ -121,7 +129,7 @@ void EngineLoop()
 		const auto entity = registry.create();
 		registry.emplace<NameComponent>(entity, "Sponza");
 		registry.emplace<TransformComponent>(entity, transform);
-		registry.emplace<MeshComponent>(entity, AssetManager::Get().LoadModel(Config::shadersPath / "../Assets/Models/Sponza/glTF/Sponza.gltf"));
+		AssetManager::Get().LoadModelAsync(Config::shadersPath / "../Assets/Models/Sponza/glTF/Sponza.gltf", entity);
 
 		return entity;
 	};
@@ -131,21 +139,11 @@ void EngineLoop()
 		const auto entity = registry.create();
 		registry.emplace<NameComponent>(entity, "Bistro");
 		registry.emplace<TransformComponent>(entity, transform);
-		registry.emplace<MeshComponent>(entity, AssetManager::Get().LoadModel(Config::shadersPath / "../Assets/Models/Bistro/Bistro2.gltf"));
+		AssetManager::Get().LoadModelAsync(Config::shadersPath / "../Assets/Models/Bistro/Bistro2.gltf", entity);
 
 		return entity;
 	};
 
-	TransformComponent spectatorTransform{};
-	spectatorTransform.translation = { 0.f, 0.f, 70.f };
-	spectatorTransform.rotation = { 0.f, 0.f, 0.f };
-
-	const auto spectator = registry.create();
-	registry.emplace<NameComponent>(spectator, "Spectator");
-	registry.emplace<TransformComponent>(spectator, std::move(spectatorTransform));
-	registry.emplace<CameraComponent>(spectator);
-	registry.emplace<ControlComponent>(spectator);  // #TEMP
-
 	//AddHelmet({
 	//	.scale = { 100.f, 100.f, 100.f },
 	//	.rotation = { -169.5f * 3.14159f / 180.f, 0.f, 121.5f * 3.14159f / 180.f },
@@ -180,98 +178,243 @@ void EngineLoop()
 	//	.translation = { 120.f, -3.f, -3500.f }
 	//});
 
-	const auto helmetMesh = AssetManager::Get().LoadModel(Config::shadersPath / "../Assets/Models/DamagedHelmet/HelmetTangents.glb");
-	int perAxis = 0;
-	float spacing = 50.f;
-	for (int i = 0; i < perAxis; i++)
+	const auto light = registry.create();
+	registry.emplace<LightComponent>(light, LightComponent{ .type = LightType::Point, .color = { 1.f, 1.f, 1.f } });
+	registry.emplace<TransformComponent>(light, TransformComponent{ .scale = { 1.f, 1.f, 1.f }, .rotation = { 0.f, 0.f, 0.f }, .translation = { -15.f, 28.f, 3200.f } });
+
+	const auto probe = registry.create();
+	registry.emplace<ReflectionProbeComponent>(probe, ReflectionProbeComponent{ .radius = 60.f });
+	registry.emplace<TransformComponent>(probe, TransformComponent{ .scale = { 1.f, 1.f, 1.f }, .rotation = { 0.f, 0.f, 0.f }, .translation = { 0.f, 0.f, 110.f } });
+}
+
+void EngineLoop()
+{
+	std::optional<Benchmark> benchmark;
+	if (const auto scenePath = Benchmark::GetScenePath())
 	{
-		for (int j = 0; j < perAxis; j++)
+		benchmark.emplace();
+		if (!benchmark->Load(*scenePath))
 		{
-			for (int k = 0; k < perAxis; k++)
-			{
-				TransformComponent transform = {
-					.scale = { 10.f, 10.f, 10.f },
-					.rotation = { (float)Rand(-2.0, 2.0) * 3.142f, (float)Rand(-2.0, 2.0) * 3.142f, (float)Rand(-2.0, 2.0) * 3.142f },
-					.translation = {
-						(i * spacing) - (perAxis * spacing / 2.f),
-						(j * spacing) - (perAxis * spacing / 2.f),
-						(k * spacing) - (perAxis * spacing / 2.f)
-					}
-				};
-
-				const auto entity = registry.create();
-				registry.emplace<TransformComponent>(entity, transform);
-				registry.emplace<MeshComponent>(entity, helmetMesh);
-			}
+			return;
 		}
 	}
 
-	const auto light = registry.create();
-	registry.emplace<LightComponent>(light, LightComponent{ .type = LightType::Point, .color = { 1.f, 1.f, 1.f } });
-	registry.emplace<TransformComponent>(light, TransformComponent{ .scale = { 1.f, 1.f, 1.f }, .rotation = { 0.f, 0.f, 0.f }, .translation = { -15.f, 28.f, 3200.f } });
+	TransformComponent spectatorTransform{};
+	spectatorTransform.translation = { 0.f, 0.f, 70.f };
+	spectatorTransform.rotation = { 0.f, 0.f, 0.f };
 
-	int lightCount = 0;//10000;
-	//int lightCount = 20000;
+	const auto spectator = registry.create();
+	registry.emplace<NameComponent>(spectator, "Spectator");
+	registry.emplace<TransformComponent>(spectator, std::move(spectatorTransform));
+	registry.emplace<CameraComponent>(spectator);
 
-	for (int i = 0; i < lightCount; ++i)
+	// Scripted cameras don't take input.
+	if (benchmark)
 	{
-		LightComponent pointLight{ .type = LightType::Point, .color = { (float)Rand(0.2f, 1.f), (float)Rand(0.2f, 1.f), (float)Rand(0.2f, 1.f) } };
-		// Sponza lights.
-		TransformComponent transform{
-			.scale = { 1.f, 1.f, 1.f },
-			.rotation = { 0.f, 0.f, 0.f },
-			.translation = { (float)Rand(-150.0, 150.0), (float)Rand(-65.0, 65.0), (float)Rand(0.0, 120.0) }
-		};
-		
-		// Sun temple lights.
-		//TransformComponent transform{
-		//	.scale = { 1.f, 1.f, 1.f },
-		//	.rotation = { 0.f, 0.f, 0.f },
-		//	.translation = { (float)Rand(-150.0, 150.0), (float)Rand(-700, 700), (float)Rand(20, 100) }
-		//};
-
-		const auto light = registry.create();
-		registry.emplace<LightComponent>(light, pointLight);
-		registry.emplace<TransformComponent>(light, transform);
+		benchmark->BuildScene(registry, spectator);
 	}
 
+	else
+	{
+		registry.emplace<ControlComponent>(spectator);  // #TEMP
+
+		const auto scenePath = SceneSnapshot::GetScenePath();
+		if (!scenePath || !SceneSnapshot::Load(registry, *scenePath))
+		{
+			CreateDefaultScene();
+		}
+	}
+
+	// Saved between frames, the registry is read while rendering.
+	static bool saveSceneRequested = false;
+	CvarCreate("saveScene", "Saves a snapshot of the scene to the path given with '-scene', or the default snapshot path", +[]()
+	{
+		saveSceneRequested = true;
+	});
+
+	CvarCreate("onDemandRendering", "Only renders frames when there's input or the scene, camera or time of day changes, for editing in the background. 0=disabled, 1=enabled", 0);
+
+	// Frames rendered after the last change, letting temporal accumulation converge before rendering stops.
+	constexpr uint32_t settleFrames = 16;
+	uint32_t pendingFrames = settleFrames;
+
 	auto frameBegin = std::chrono::high_resolution_clock::now();
 	float lastDeltaTime = 0.f;
 
+	// Simulates the frame after the one being rendered. None of the systems touch the device, so they run on a worker while
+	// the main thread advances the frame, which mostly waits on the GPU.
+	const auto simulate = [&registry, &lastDeltaTime]()
+	{
+		ScopedMemoryTag memoryTag{ MemoryTag::Core };
+
+		CameraSystem::Update(registry, lastDeltaTime);
+		TimeOfDaySystem::Update(registry, lastDeltaTime);
+		AnimationSystem::Update(registry, lastDeltaTime);
+	};
+
+	ControlSystem::Update(registry);
+	simulate();
+
 	while (true)
 	{
+		// Minimized or occluded windows don't render at all, there's nothing to see.
+		const auto suspended = Renderer::Get().window->IsMinimized() || Renderer::Get().device->IsOccluded();
+		const auto onDemand = *CvarGet("onDemandRendering", int) > 0 && !benchmark;
+		const auto idle = suspended || (onDemand && pendingFrames == 0);
+
+		if (idle)
+		{
+			VGScopedCPUStat("Idle");
+
+			// Occlusion isn't signaled by a message, so suspended windows wake up to poll it.
+			constexpr DWORD pollInterval = 100;
+			::MsgWaitForMultipleObjects(0, nullptr, false, pollInterval, QS_ALLINPUT);
+		}
+
+		else
+		{
+			// Input is sampled as late as possible, once the swap chain is ready to queue this frame.
+			Renderer::Get().device->WaitForFrameLatency();
+		}
+
+		size_t messageCount = 0;
+
 		{
 			VGScopedCPUStat("Window Message Processing");
 
+			// Drain the queue so that bursts of raw input don't back up across frames, capped so that a message storm
+			// can't stall the frame entirely.
+			constexpr auto pumpBudget = 2ms;
+			const auto pumpBegin = std::chrono::high_resolution_clock::now();
+
 			MSG message{};
-			if (::PeekMessage(&message, nullptr, 0, 0, PM_REMOVE))
+			while (::PeekMessage(&message, nullptr, 0, 0, PM_REMOVE))
 			{
+				if (message.message == WM_QUIT)
+				{
+					return;
+				}
+
 				::TranslateMessage(&message);
 				::DispatchMessage(&message);
+				++messageCount;
+
+				if (std::chrono::high_resolution_clock::now() - pumpBegin > pumpBudget)
+				{
+					break;
+				}
 			}
+		}
+
+		if (suspended)
+		{
+			Renderer::Get().device->TestOcclusion();
+
+			// Don't simulate the time spent suspended.
+			frameBegin = std::chrono::high_resolution_clock::now();
+
+			continue;
+		}
+
+		// Replays render the same frame repeatedly, nothing may change the scene in between.
+		const auto replaying = benchmark && benchmark->IsReplaying();
 
-			if (message.message == WM_QUIT)
+		if (!replaying)
+		{
+			AssetManager::Get().Update(registry);
+			StressScene::Get().Update(registry);
+		}
+
+		if (std::exchange(saveSceneRequested, false))
+		{
+			SceneSnapshot::Save(registry, SceneSnapshot::GetScenePath().value_or(SceneSnapshot::GetDefaultPath()));
+		}
+
+		if (benchmark)
+		{
+			benchmark->Update(registry);
+		}
+
+		// The renderer uploads the world transforms changed since the last frame.
+		const auto transformsChanged = !replaying && TransformSystem::Update(registry);
+
+		if (onDemand)
+		{
+			bool timeOfDayAnimated = false;
+			registry.view<TimeOfDayComponent>().each([&timeOfDayAnimated](auto entity, const auto& timeOfDay)
 			{
-				return;
+				timeOfDayAnimated |= timeOfDay.animation != TimeOfDayAnimation::Static;
+			});
+
+			// Input covers the camera, the console and the editor, the rest change on their own.
+			if (messageCount > 0 || transformsChanged || timeOfDayAnimated || AssetManager::Get().IsLoading())
+			{
+				pendingFrames = settleFrames;
+			}
+
+			if (pendingFrames == 0)
+			{
+				frameBegin = std::chrono::high_resolution_clock::now();
+
+				continue;
+			}
+
+			--pendingFrames;
+
+			if (idle)
+			{
+				Renderer::Get().device->WaitForFrameLatency();
 			}
 		}
 
-		AssetManager::Get().Update();
+		else
+		{
+			pendingFrames = settleFrames;
+		}
 
-		ControlSystem::Update(registry);
-		CameraSystem::Update(registry, lastDeltaTime);
-		TimeOfDaySystem::Update(registry, lastDeltaTime);
+		// The simulation ran a frame ahead, the mouse is sampled again right before the camera is uploaded.
+		if (!replaying)
+		{
+			CameraSystem::UpdateLook(registry);
+		}
 
 		Renderer::Get().Render(registry);
 
+		// The render graph reads the registry while recording, so the next frame's simulation can only start once this frame
+		// has been submitted. Control stays on the main thread, it changes the window's cursor state.
+		JobCounter simulation;
+		if (!(benchmark && benchmark->IsReplaying()))
+		{
+			ControlSystem::Update(registry);
+			JobSystem::Get().Schedule(simulate, &simulation);
+		}
+
 		Renderer::Get().device->AdvanceCPU();
 
+		JobSystem::Get().Wait(simulation);
+
 		auto frameEnd = std::chrono::high_resolution_clock::now();
 		const auto frameDelta = std::chrono::duration_cast<std::chrono::microseconds>(frameEnd - frameBegin).count();
 		frameBegin = frameEnd;
 		lastDeltaTime = static_cast<float>(frameDelta) / 1000000.f;
 
-		Renderer::Get().SubmitFrameTime(frameDelta);
+		if (benchmark)
+		{
+			if (!benchmark->Record(lastDeltaTime * 1000.f))
+			{
+				return;
+			}
+
+			// Simulation steps at a fixed rate so that every run renders the same frames, regardless of the frame time.
+			lastDeltaTime = benchmark->GetTimestep();
+			Renderer::Get().SubmitFrameTime(static_cast<uint32_t>(lastDeltaTime * 1000000.f));
+		}
+
+		else
+		{
+			Renderer::Get().SubmitFrameTime(frameDelta);
+		}
+
 		Input::SubmitFrameTime(frameDelta);
 	}
 }
@@ -281,6 +424,11 @@ void EngineShutdown()
 	VGScopedCPUStat("Engine Shutdown");
 
 	VGLog(logCore, "Engine shutting down.");
+
+	JobSystem::Get().Shutdown();
+
+	// Static destruction can still log, the background thread doesn't outlive it.
+	StopAsyncLogging();
 }
 
 int32_t EngineMain()
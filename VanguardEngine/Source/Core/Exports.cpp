@@ -5,6 +5,6 @@
 extern "C"
 {
 	// DirectX Agility SDK
-	__declspec(dllexport) extern const uint32_t D3D12SDKVersion = 4;
+	__declspec(dllexport) extern const uint32_t D3D12SDKVersion = 614;  // Must match the shipped runtime, enhanced barriers need 1.608 or newer.
 	__declspec(dllexport) extern const char* D3D12SDKPath = ".\\D3D12\\";
 };
\ No newline at end of file
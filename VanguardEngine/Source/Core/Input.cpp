@@ -6,6 +6,7 @@
 #include <imgui.h>
 
 #include <limits>
+#include <utility>
 
 #include <Core/Windows/WindowsMinimal.h>
 #include <XInput.h>  // Required for gamepad support.
@@ -165,6 +166,12 @@ namespace Input
 	// End of ImGui backend functions
 
 	static bool pendingMonitorUpdate = true;
+
+	// Accumulated relative mouse motion from raw input, in device counts. Independent of the cursor, which is locked while
+	// controlling the camera, and of the pointer acceleration.
+	static bool rawMouseRegistered = false;
+	static int32_t rawMouseDeltaX = 0;
+	static int32_t rawMouseDeltaY = 0;
 	static int mouseTrackedArea = 0;  // Track all mouse movements
 
 	float GetDPIScale(void* monitor)
@@ -354,6 +361,19 @@ namespace Input
 		io.BackendPlatformName = "Vanguard Win64";
 
 		ImGui::GetMainViewport()->PlatformHandleRaw = window;
+
+		RAWINPUTDEVICE mouseDevice{
+			.usUsagePage = 0x01,  // HID_USAGE_PAGE_GENERIC
+			.usUsage = 0x02,  // HID_USAGE_GENERIC_MOUSE
+			.dwFlags = 0,
+			.hwndTarget = static_cast<HWND>(window)
+		};
+
+		rawMouseRegistered = ::RegisterRawInputDevices(&mouseDevice, 1, sizeof(mouseDevice));
+		if (!rawMouseRegistered)
+		{
+			VGLogWarning(logCore, "Failed to register raw mouse input, falling back to cursor deltas: {}", GetPlatformError());
+		}
 	}
 
 	void EnableDPIAwareness()
@@ -505,6 +525,24 @@ namespace Input
 			return false;
 		}
 
+		// Raw input events.
+
+		case WM_INPUT:
+		{
+			RAWINPUT input;
+			UINT size = sizeof(input);
+
+			// Keyboard and HID reports are larger, but only the mouse is registered.
+			if (::GetRawInputData(reinterpret_cast<HRAWINPUT>(lParam), RID_INPUT, &input, &size, sizeof(RAWINPUTHEADER)) != static_cast<UINT>(-1) &&
+				input.header.dwType == RIM_TYPEMOUSE && !(input.data.mouse.usFlags & MOUSE_MOVE_ABSOLUTE))
+			{
+				rawMouseDeltaX += input.data.mouse.lLastX;
+				rawMouseDeltaY += input.data.mouse.lLastY;
+			}
+
+			return false;  // The default procedure cleans up the input.
+		}
+
 		// Display events.
 
 		case WM_DISPLAYCHANGE:
@@ -533,6 +571,33 @@ namespace Input
 		UpdateGamepad();
 	}
 
+	bool HasRawMouse()
+	{
+		return rawMouseRegistered;
+	}
+
+	std::optional<std::pair<float, float>> ConsumeRawMouseDelta()
+	{
+		VGScopedCPUStat("Consume Raw Mouse Delta");
+
+		if (!rawMouseRegistered)
+			return std::nullopt;
+
+		// Pick up the motion since the frame's message processing. Only raw input is removed, the rest of the queue is left
+		// for the next frame in order.
+		MSG message{};
+		while (::PeekMessage(&message, nullptr, WM_INPUT, WM_INPUT, PM_REMOVE))
+		{
+			::DispatchMessage(&message);
+		}
+
+		const auto delta = std::make_pair(static_cast<float>(rawMouseDeltaX), static_cast<float>(rawMouseDeltaY));
+		rawMouseDeltaX = 0;
+		rawMouseDeltaY = 0;
+
+		return delta;
+	}
+
 	void SubmitFrameTime(uint32_t timeUs)
 	{
 		auto& io = ImGui::GetIO();
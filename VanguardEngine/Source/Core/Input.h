@@ -3,6 +3,8 @@
 #pragma once
 
 #include <cstdint>
+#include <optional>
+#include <utility>
 
 namespace Input
 {
@@ -13,5 +15,11 @@ namespace Input
 	bool ProcessWindowMessage(void* window, uint32_t message, int64_t wParam, uint64_t lParam);
 	void UpdateInputDevices(void* window);
 
+	// Whether relative mouse motion comes from raw input, fixed after initializing.
+	bool HasRawMouse();
+	// Relative mouse motion since the last call, drained from the message queue at the time of the call. Main thread only.
+	// Nothing if raw input is unavailable.
+	std::optional<std::pair<float, float>> ConsumeRawMouseDelta();
+
 	void SubmitFrameTime(uint32_t timeUs);
 };
\ No newline at end of file
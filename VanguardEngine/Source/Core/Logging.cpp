@@ -1,6 +1,10 @@
 // Copyright (c) 2019-2022 Andrew Depke
 
 #include <Core/Logging.h>
+#include <Threading/Thread.h>
+
+#include <spdlog/spdlog.h>
+#include <spdlog/async.h>
 
 std::shared_ptr<spdlog::logger> logAsset;
 std::shared_ptr<spdlog::logger> logCore;
@@ -8,4 +12,46 @@ std::shared_ptr<spdlog::logger> logEditor;
 std::shared_ptr<spdlog::logger> logRendering;
 std::shared_ptr<spdlog::logger> logThreading;
 std::shared_ptr<spdlog::logger> logUtility;
-std::shared_ptr<spdlog::logger> logWindow;
\ No newline at end of file
+std::shared_ptr<spdlog::logger> logWindow;
+
+namespace
+{
+	constexpr size_t logQueueSize = 8192;  // Messages, logging only blocks once the background thread falls this far behind.
+
+	std::vector<spdlog::sink_ptr> logSinks;
+
+	void CreateLoggers(std::shared_ptr<spdlog::logger> core)
+	{
+		core->flush_on(spdlog::level::err);
+
+		logCore = std::move(core);
+		logAsset = logCore->clone("asset");
+		logEditor = logCore->clone("editor");
+		logRendering = logCore->clone("rendering");
+		logThreading = logCore->clone("threading");
+		logUtility = logCore->clone("utility");
+		logWindow = logCore->clone("window");
+
+		spdlog::set_default_logger(logCore);
+	}
+}
+
+void StartAsyncLogging(std::vector<spdlog::sink_ptr> sinks)
+{
+	logSinks = std::move(sinks);
+
+	// Flushing to the sinks is background work.
+	spdlog::init_thread_pool(logQueueSize, 1, []() { SetThreadPlacement(ThreadPlacement::Efficiency); });
+	CreateLoggers(std::make_shared<spdlog::async_logger>("core", logSinks.begin(), logSinks.end(), spdlog::thread_pool(), spdlog::async_overflow_policy::block));
+}
+
+void StopAsyncLogging()
+{
+	// Destroying the thread pool joins the background thread after it drains the queue.
+	spdlog::shutdown();
+
+	if (!logSinks.empty())
+	{
+		CreateLoggers(std::make_shared<spdlog::logger>("core", logSinks.begin(), logSinks.end()));
+	}
+}
\ No newline at end of file
@@ -23,6 +23,7 @@
 #include <Tracy.hpp>
 
 #include <memory>
+#include <vector>
 
 // #TODO: Stringify errors, see: fmt::report_windows_error and fmt::windows_error.
 inline HRESULT GetPlatformError() { return GetLastError(); }
@@ -46,6 +47,12 @@ extern std::shared_ptr<spdlog::logger> logThreading;
 extern std::shared_ptr<spdlog::logger> logUtility;
 extern std::shared_ptr<spdlog::logger> logWindow;
 
+// Creates the loggers. Sinks are written from a background thread, so logging only formats the message into a queue
+// and never waits on file or debugger output.
+void StartAsyncLogging(std::vector<spdlog::sink_ptr> sinks);
+// Writes out all queued messages, logging is synchronous afterwards. Used once the process is shutting down or crashing.
+void StopAsyncLogging();
+
 #if ENABLE_PROFILING
 #define VGScopedCPUStat(name) ZoneScopedN(name)
 #define VGScopedCPUTransientStat(name) ZoneTransientN(__transientCpuZone, name, true)
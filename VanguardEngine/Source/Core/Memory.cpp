@@ -0,0 +1,194 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Core/Memory.h>
+#include <Core/Logging.h>
+
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <algorithm>
+
+// Replaces the global allocation functions, every new and delete of the engine goes through here. Each allocation is
+// prefixed with a header carrying its size and tag, so frees are accounted without a lookup. Libraries calling malloc
+// directly and allocations made inside of DLLs aren't seen.
+
+namespace
+{
+	struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) Header
+	{
+		size_t size;
+		uint32_t alignment;
+		MemoryTag tag;
+	};
+
+	// Padded apart, threads allocating under different tags don't contend over a cache line.
+	struct alignas(64) TagCounters
+	{
+		std::atomic<size_t> allocations;  // Since startup.
+		std::atomic<size_t> bytes;
+		std::atomic<size_t> liveAllocations;
+		std::atomic<size_t> liveBytes;
+	};
+
+	constexpr size_t tagCount = static_cast<size_t>(MemoryTag::Count);
+
+	TagCounters counters[tagCount];
+
+	// Cumulative counts at the last frame mark.
+	std::array<size_t, tagCount> markedAllocations = {};
+	std::array<size_t, tagCount> markedBytes = {};
+	MemoryStatistics statistics = {};
+
+	thread_local MemoryTag currentTag = MemoryTag::General;
+
+	// The backing heap, a scalable allocator only has to replace these two.
+	void* HeapAllocate(size_t size, size_t alignment) noexcept
+	{
+		if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+			return std::malloc(size);
+
+#ifdef _MSC_VER
+		return _aligned_malloc(size, alignment);
+#else
+		return std::aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+#endif
+	}
+
+	void HeapFree(void* block, size_t alignment) noexcept
+	{
+#ifdef _MSC_VER
+		if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+		{
+			_aligned_free(block);
+			return;
+		}
+#endif
+
+		std::free(block);
+	}
+
+	void* Allocate(size_t size, size_t alignment) noexcept
+	{
+		alignment = std::max(alignment, size_t{ __STDCPP_DEFAULT_NEW_ALIGNMENT__ });
+		const auto offset = std::max(sizeof(Header), alignment);  // Keeps the returned pointer aligned.
+
+		auto* const block = static_cast<std::byte*>(HeapAllocate(size + offset, alignment));
+		if (!block)
+		{
+			return nullptr;
+		}
+
+		auto* const pointer = block + offset;
+		auto* const header = reinterpret_cast<Header*>(pointer) - 1;
+		header->size = size;
+		header->alignment = static_cast<uint32_t>(alignment);
+		header->tag = currentTag;
+
+		auto& tag = counters[static_cast<size_t>(header->tag)];
+		tag.allocations.fetch_add(1, std::memory_order_relaxed);
+		tag.bytes.fetch_add(size, std::memory_order_relaxed);
+		tag.liveAllocations.fetch_add(1, std::memory_order_relaxed);
+		tag.liveBytes.fetch_add(size, std::memory_order_relaxed);
+
+		return pointer;
+	}
+
+	void Free(void* pointer) noexcept
+	{
+		if (!pointer)
+		{
+			return;
+		}
+
+		// Accounted to the tag it was allocated under, wherever it's freed.
+		const auto header = *(static_cast<Header*>(pointer) - 1);
+		auto& tag = counters[static_cast<size_t>(header.tag)];
+		tag.liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+		tag.liveBytes.fetch_sub(header.size, std::memory_order_relaxed);
+
+		HeapFree(static_cast<std::byte*>(pointer) - std::max(sizeof(Header), size_t{ header.alignment }), header.alignment);
+	}
+
+	void* AllocateOrThrow(size_t size, size_t alignment)
+	{
+		if (auto* const pointer = Allocate(size, alignment))
+		{
+			return pointer;
+		}
+
+		throw std::bad_alloc{};
+	}
+}
+
+ScopedMemoryTag::ScopedMemoryTag(MemoryTag tag) : previous(currentTag)
+{
+	currentTag = tag;
+}
+
+ScopedMemoryTag::~ScopedMemoryTag()
+{
+	currentTag = previous;
+}
+
+MemoryTag GetMemoryTag() noexcept
+{
+	return currentTag;
+}
+
+void MarkMemoryFrame()
+{
+	size_t frameAllocations = 0;
+	size_t liveBytes = 0;
+
+	for (size_t i = 0; i < tagCount; ++i)
+	{
+		const auto allocations = counters[i].allocations.load(std::memory_order_relaxed);
+		const auto bytes = counters[i].bytes.load(std::memory_order_relaxed);
+
+		statistics[i] = MemoryTagStatistics{
+			.liveAllocations = counters[i].liveAllocations.load(std::memory_order_relaxed),
+			.liveBytes = counters[i].liveBytes.load(std::memory_order_relaxed),
+			.frameAllocations = allocations - markedAllocations[i],
+			.frameBytes = bytes - markedBytes[i]
+		};
+
+		markedAllocations[i] = allocations;
+		markedBytes[i] = bytes;
+
+		frameAllocations += statistics[i].frameAllocations;
+		liveBytes += statistics[i].liveBytes;
+	}
+
+#if ENABLE_PROFILING
+	TracyPlot("CPU Heap Allocations", static_cast<int64_t>(frameAllocations));
+	TracyPlot("CPU Heap Rendering Allocations", static_cast<int64_t>(statistics[static_cast<size_t>(MemoryTag::Rendering)].frameAllocations));
+	TracyPlot("CPU Heap MB", static_cast<double>(liveBytes) / (1024.0 * 1024.0));
+#endif
+}
+
+const MemoryStatistics& GetMemoryStatistics() noexcept
+{
+	return statistics;
+}
+
+void* operator new(size_t size) { return AllocateOrThrow(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new[](size_t size) { return AllocateOrThrow(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new(size_t size, std::align_val_t alignment) { return AllocateOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment) { return AllocateOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return Allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return Allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return Allocate(size, static_cast<size_t>(alignment)); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return Allocate(size, static_cast<size_t>(alignment)); }
+
+void operator delete(void* pointer) noexcept { Free(pointer); }
+void operator delete[](void* pointer) noexcept { Free(pointer); }
+void operator delete(void* pointer, size_t) noexcept { Free(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { Free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { Free(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { Free(pointer); }
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept { Free(pointer); }
+void operator delete[](void* pointer, size_t, std::align_val_t) noexcept { Free(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { Free(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { Free(pointer); }
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { Free(pointer); }
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { Free(pointer); }
\ No newline at end of file
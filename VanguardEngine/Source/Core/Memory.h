@@ -0,0 +1,60 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Subsystem the CPU heap allocations of a thread are accounted to, set by ScopedMemoryTag.
+enum class MemoryTag : uint8_t
+{
+	General,  // Untagged.
+	Core,
+	Asset,
+	Rendering,
+	Editor,
+	UserInterface,
+	Count
+};
+
+inline constexpr std::array<const char*, static_cast<size_t>(MemoryTag::Count)> memoryTagNames = {
+	"General",
+	"Core",
+	"Asset",
+	"Rendering",
+	"Editor",
+	"User Interface"
+};
+
+// Tags the thread's allocations until the end of the scope, nested scopes restore the outer tag. Jobs take the tag of the
+// thread that scheduled them.
+class ScopedMemoryTag
+{
+private:
+	MemoryTag previous;
+
+public:
+	explicit ScopedMemoryTag(MemoryTag tag);
+	~ScopedMemoryTag();
+
+	ScopedMemoryTag(const ScopedMemoryTag&) = delete;
+	ScopedMemoryTag& operator=(const ScopedMemoryTag&) = delete;
+};
+
+MemoryTag GetMemoryTag() noexcept;
+
+struct MemoryTagStatistics
+{
+	size_t liveAllocations;
+	size_t liveBytes;
+	size_t frameAllocations;  // During the previous frame.
+	size_t frameBytes;
+};
+
+using MemoryStatistics = std::array<MemoryTagStatistics, static_cast<size_t>(MemoryTag::Count)>;
+
+// Closes the frame's allocation counts and plots them to the profiler. Called once per frame.
+void MarkMemoryFrame();
+// Indexed by MemoryTag, as of the last frame mark. Not thread safe with MarkMemoryFrame.
+const MemoryStatistics& GetMemoryStatistics() noexcept;
\ No newline at end of file
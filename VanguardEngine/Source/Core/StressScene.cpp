@@ -0,0 +1,135 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Core/StressScene.h>
+#include <Core/Base.h>
+#include <Core/Config.h>
+#include <Core/CoreComponents.h>
+#include <Rendering/Renderer.h>
+#include <Asset/AssetManager.h>
+#include <Utility/Random.h>
+
+#include <cmath>
+
+void StressScene::Initialize()
+{
+	modelPath = Config::shadersPath / "../Assets/Models/DamagedHelmet/HelmetTangents.glb";
+
+	CvarCreate("stressObjects", "Instances placed in a grid by 'stressBuild'", 0);
+	CvarCreate("stressLights", "Random point lights placed by 'stressBuild'", 0);
+	CvarCreate("stressCloudCoverage", "Cloud coverage applied by 'stressBuild'", 0.5f);
+	CvarCreate("stressBuild", "Replaces the stress scene with 'stressObjects' instances and 'stressLights' lights", +[]()
+	{
+		StressScene::Get().buildRequested = true;
+	});
+	CvarCreate("stressClear", "Removes the stress scene", +[]()
+	{
+		StressScene::Get().clearRequested = true;
+	});
+}
+
+void StressScene::Build(entt::registry& registry, const StressSettings& settings)
+{
+	VGScopedCPUStat("Stress Scene Build");
+
+	Clear(registry);
+
+	// Deterministic, so that each build of the same settings is comparable.
+	Seed(std::seed_seq{ settings.seed });
+
+	if (settings.objectCount > 0)
+	{
+		// Loaded synchronously, streaming in during a capture would skew the timings.
+		mesh = AssetManager::Get().LoadModel(modelPath);
+
+		const auto perAxis = static_cast<uint32_t>(std::ceil(std::cbrt(static_cast<double>(settings.objectCount))));
+		const auto offset = perAxis * gridSpacing / 2.f;
+
+		entities.reserve(settings.objectCount + settings.lightCount);
+
+		for (uint32_t i = 0; i < settings.objectCount; ++i)
+		{
+			const auto x = i % perAxis;
+			const auto y = (i / perAxis) % perAxis;
+			const auto z = i / (perAxis * perAxis);
+
+			TransformComponent transform = {
+				.scale = { gridScale, gridScale, gridScale },
+				.rotation = { (float)Rand(-2.0, 2.0) * 3.142f, (float)Rand(-2.0, 2.0) * 3.142f, (float)Rand(-2.0, 2.0) * 3.142f },
+				.translation = { (x * gridSpacing) - offset, (y * gridSpacing) - offset, (z * gridSpacing) - offset }
+			};
+
+			const auto entity = registry.create();
+			registry.emplace<TransformComponent>(entity, transform);
+			registry.emplace<MeshComponent>(entity, *mesh);
+			entities.emplace_back(entity);
+		}
+	}
+
+	for (uint32_t i = 0; i < settings.lightCount; ++i)
+	{
+		LightComponent pointLight{ .type = LightType::Point, .color = { (float)Rand(0.2f, 1.f), (float)Rand(0.2f, 1.f), (float)Rand(0.2f, 1.f) } };
+		TransformComponent transform{
+			.scale = { 1.f, 1.f, 1.f },
+			.rotation = { 0.f, 0.f, 0.f },
+			.translation = {
+				(float)Rand(settings.lightBoundsMin.x, settings.lightBoundsMax.x),
+				(float)Rand(settings.lightBoundsMin.y, settings.lightBoundsMax.y),
+				(float)Rand(settings.lightBoundsMin.z, settings.lightBoundsMax.z)
+			}
+		};
+
+		const auto light = registry.create();
+		registry.emplace<LightComponent>(light, pointLight);
+		registry.emplace<TransformComponent>(light, transform);
+		entities.emplace_back(light);
+	}
+
+	Renderer::Get().clouds.coverage = settings.cloudCoverage;
+	CvarSet("cloudRayMarchQuality", settings.cloudRayMarchQuality);
+	CvarSet("cloudRenderScale", settings.cloudRenderScale);
+
+	VGLog(logCore, "Built stress scene with {} objects and {} lights.", settings.objectCount, settings.lightCount);
+}
+
+void StressScene::Clear(entt::registry& registry)
+{
+	for (const auto entity : entities)
+	{
+		// Entities may have been deleted from the editor.
+		if (registry.valid(entity))
+		{
+			registry.destroy(entity);
+		}
+	}
+
+	entities.clear();
+
+	// The destroyed mesh components no longer use the model.
+	if (mesh)
+	{
+		AssetManager::Get().ReleaseModel(*mesh);
+		mesh.reset();
+	}
+}
+
+void StressScene::Update(entt::registry& registry)
+{
+	if (clearRequested)
+	{
+		clearRequested = false;
+		Clear(registry);
+	}
+
+	if (buildRequested)
+	{
+		buildRequested = false;
+
+		Build(registry, {
+			.objectCount = static_cast<uint32_t>(std::max(*CvarGet("stressObjects", int), 0)),
+			.lightCount = static_cast<uint32_t>(std::max(*CvarGet("stressLights", int), 0)),
+			.cloudCoverage = *CvarGet("stressCloudCoverage", float),
+			.cloudRayMarchQuality = *CvarGet("cloudRayMarchQuality", int),
+			.cloudRenderScale = *CvarGet("cloudRenderScale", float)
+		});
+	}
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Utility/Singleton.h>
+#include <Rendering/RenderComponents.h>
+
+#include <entt/entt.hpp>
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+struct StressSettings
+{
+	uint32_t objectCount = 0;  // Instances of the stress model, laid out in a cubic grid.
+	uint32_t lightCount = 0;  // Random point lights.
+	XMFLOAT3 lightBoundsMin = { -150.f, -65.f, 0.f };
+	XMFLOAT3 lightBoundsMax = { 150.f, 65.f, 120.f };
+	float cloudCoverage = 0.5f;
+	int cloudRayMarchQuality = 1;
+	float cloudRenderScale = 0.25f;
+	uint32_t seed = 0;
+};
+
+// Generated scenes for finding where mesh culling, light binning and instance uploads stop scaling. Each build replaces
+// the entities of the previous one and leaves the rest of the scene untouched. Built from the console with 'stressBuild',
+// or swept by the benchmark mode.
+class StressScene : public Singleton<StressScene>
+{
+public:
+	std::filesystem::path modelPath;
+	float gridSpacing = 50.f;
+	float gridScale = 10.f;
+
+private:
+	std::optional<MeshComponent> mesh;  // Holds a model reference while instances exist.
+	std::vector<entt::entity> entities;
+	bool buildRequested = false;
+	bool clearRequested = false;
+
+public:
+	void Initialize();  // Creates the console variables.
+
+	void Build(entt::registry& registry, const StressSettings& settings);
+	void Clear(entt::registry& registry);
+
+	// Applies builds requested from the console. Call outside of rendering.
+	void Update(entt::registry& registry);
+
+	size_t GetEntityCount() const noexcept { return entities.size(); }
+};
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <Core/Engine.h>
 #include <Core/Globals.h>
+#include <Threading/Thread.h>
 //#include <Core/Windows/WindowsMinimal.h>  // We actually can't include this since we need some API that's excluded from lean and mean.
 
 #define NOMINMAX
@@ -34,6 +35,8 @@ VGWarningPop
 	ParseCommandLine();
 
 	GProcessThreads.emplace_back(std::this_thread::get_id());
+	SetThreadName("Main");
+	SetThreadPlacement(ThreadPlacement::Performance);
 
 	return static_cast<int>(EngineMain());
 }
\ No newline at end of file
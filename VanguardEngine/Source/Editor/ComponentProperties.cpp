@@ -14,9 +14,14 @@ void ComponentProperties::RenderNameComponent(entt::registry& registry, entt::en
 
 	ImGui::Text("Name");
 	ImGui::SameLine();
-	ImGui::InputText("", component.name.data(), component.name.size(), ImGuiInputTextFlags_AutoSelectAll);
+	const bool edited = ImGui::InputText("", component.name.data(), component.name.size(), ImGuiInputTextFlags_AutoSelectAll);
 
 	component.name.resize(std::strlen(component.name.data()));
+
+	if (edited)
+	{
+		registry.patch<NameComponent>(entity);  // Notify name observers, such as the entity hierarchy.
+	}
 }
 
 void ComponentProperties::RenderTransformComponent(entt::registry& registry, entt::entity entity)
@@ -35,9 +40,15 @@ void ComponentProperties::RenderTransformComponent(entt::registry& registry, ent
 
 	ImGui::Text("Transform");
 
-	ImGui::DragFloat3("Translation", translation, 1.f, -100000.0, 100000.0, "%.4f");
-	ImGui::DragFloat3("Rotation", rotation, 0.5f, -360.0, 360.0, "%.4f");
-	ImGui::DragFloat3("Scale", scale, 0.025f, -10000.0, 10000.0, "%.4f");
+	bool changed = false;
+	changed |= ImGui::DragFloat3("Translation", translation, 1.f, -100000.0, 100000.0, "%.4f");
+	changed |= ImGui::DragFloat3("Rotation", rotation, 0.5f, -360.0, 360.0, "%.4f");
+	changed |= ImGui::DragFloat3("Scale", scale, 0.025f, -10000.0, 10000.0, "%.4f");
+
+	if (!changed)
+	{
+		return;
+	}
 
 	// Convert degrees to radians.
 	for (auto& dimension : rotation)
@@ -45,9 +56,13 @@ void ComponentProperties::RenderTransformComponent(entt::registry& registry, ent
 		dimension *= 3.14159265359f / 180.f;
 	}
 
-	component.translation = XMFLOAT3{ translation };
-	component.rotation = XMFLOAT3{ rotation };
-	component.scale = XMFLOAT3{ scale };
+	// Patch instead of writing the component directly so that observers see the change.
+	registry.patch<TransformComponent>(entity, [&](auto& transform)
+	{
+		transform.translation = XMFLOAT3{ translation };
+		transform.rotation = XMFLOAT3{ rotation };
+		transform.scale = XMFLOAT3{ scale };
+	});
 }
 
 void ComponentProperties::RenderControlComponent(entt::registry& registry, entt::entity entity)
@@ -79,7 +94,7 @@ void ComponentProperties::RenderMeshComponent(entt::registry& registry, entt::en
 	ImGui::Checkbox("Normal", isChannelActive(1) ? &enabled : &disabled);
 	ImGui::Checkbox("Texcoord", isChannelActive(2) ? &enabled : &disabled);
 	ImGui::Checkbox("Tangent", isChannelActive(3) ? &enabled : &disabled);
-	ImGui::Checkbox("Bitangent", isChannelActive(4) ? &enabled : &disabled);
+	ImGui::Checkbox("Bitangent (derived)", isChannelActive(1) && isChannelActive(3) ? &enabled : &disabled);
 	ImGui::Checkbox("Color", isChannelActive(5) ? &enabled : &disabled);
 	ImGui::Unindent();
 }
@@ -97,10 +112,47 @@ void ComponentProperties::RenderLightComponent(entt::registry& registry, entt::e
 
 	ImGui::Text("Light");
 
-	const char* lightTypes[] = { "Point", "Directional" };
-	ImGui::Combo("Light type", (int*)&component.type, lightTypes, std::size(lightTypes));
+	bool changed = false;
 
-	ImGui::InputFloat3("Color", (float*)&component.color);
+	const char* lightTypes[] = { "Point", "Directional", "Spot", "Area" };
+	changed |= ImGui::Combo("Light type", (int*)&component.type, lightTypes, std::size(lightTypes));
+
+	changed |= ImGui::InputFloat3("Color", (float*)&component.color);
+
+	if (component.type == LightType::Spot)
+	{
+		changed |= ImGui::SliderAngle("Inner cone angle", &component.innerConeAngle, 0.f, 90.f);
+		changed |= ImGui::SliderAngle("Outer cone angle", &component.outerConeAngle, 0.f, 90.f);
+	}
+
+	else if (component.type == LightType::Area)
+	{
+		changed |= ImGui::DragFloat2("Area size", (float*)&component.areaSize, 0.05f, 0.f, 1000.f);
+	}
+
+	if (component.type != LightType::Directional)
+	{
+		changed |= ImGui::DragFloat("Range", &component.range, 0.1f, 0.f, 10000.f, component.range > 0.f ? "%.1f m" : "Derived");
+	}
+
+	// Lights are only uploaded when patched.
+	if (changed)
+	{
+		registry.patch<LightComponent>(entity);
+	}
+}
+
+void ComponentProperties::RenderReflectionProbeComponent(entt::registry& registry, entt::entity entity)
+{
+	auto& component = registry.get<ReflectionProbeComponent>(entity);
+
+	ImGui::Text("Reflection Probe");
+
+	// Probes are only captured again when patched.
+	if (ImGui::DragFloat("Radius", &component.radius, 0.1f, 0.1f, 1000.f))
+	{
+		registry.patch<ReflectionProbeComponent>(entity);
+	}
 }
 
 void ComponentProperties::RenderTimeOfDayComponent(entt::registry& registry, entt::entity entity)
@@ -20,5 +20,6 @@ namespace ComponentProperties
 	void RenderMeshComponent(entt::registry& registry, entt::entity entity);
 	void RenderCameraComponent(entt::registry& registry, entt::entity entity);
 	void RenderLightComponent(entt::registry& registry, entt::entity entity);
+	void RenderReflectionProbeComponent(entt::registry& registry, entt::entity entity);
 	void RenderTimeOfDayComponent(entt::registry& registry, entt::entity entity);
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include <Rendering/Device.h>
 #include <Rendering/Renderer.h>
 #include <Rendering/ClusteredLightCulling.h>
+#include <Core/Memory.h>
 
 #include <imgui.h>
 #endif
@@ -63,6 +64,20 @@ void Editor::Update()
 	}
 
 	ui->Update();
+
+#if ENABLE_EDITOR
+	// Render the scene at the size it's displayed at, instead of cropping a full resolution image.
+	if (enabled)
+	{
+		const auto viewportSize = ui->GetSceneViewportSize();
+		Renderer::Get().SetSceneResolution(static_cast<uint32_t>(viewportSize.x), static_cast<uint32_t>(viewportSize.y));
+	}
+
+	else
+	{
+		Renderer::Get().SetSceneResolution(0, 0);
+	}
+#endif
 }
 
 void Editor::Render(RenderGraph& graph, RenderDevice& device, Renderer& renderer, RenderGraphResourceManager& resourceManager, entt::registry& registry,
@@ -70,6 +85,10 @@ void Editor::Render(RenderGraph& graph, RenderDevice& device, Renderer& renderer
 	RenderResource weather)
 {
 #if ENABLE_EDITOR
+	ScopedMemoryTag memoryTag{ MemoryTag::Editor };
+
+	resourceManager.captureTimeline = enabled && ui->captureRenderGraphTimeline;
+
 	if (enabled)
 	{
 		// Render the active overlay if there is one.
@@ -121,9 +140,12 @@ void Editor::Render(RenderGraph& graph, RenderDevice& device, Renderer& renderer
 			ui->DrawEntityHierarchy(registry);
 			ui->DrawEntityPropertyViewer(registry);
 			ui->DrawMetrics(&device, renderer.lastFrameTime);
+			ui->DrawMemory(&device, resourceManager);
+			ui->DrawGpuProfiler(&device);
 			ui->DrawRenderGraph(&device, resourceManager, resources.GetTexture(depthStencil), resources.GetTexture(outputLDR));
-			ui->DrawAtmosphereControls(&device, registry, renderer.atmosphere, renderer.clouds, resources.GetTexture(weather));
+			ui->DrawAtmosphereControls(&device, registry, renderer.atmosphere, renderer.clouds, renderer.volumetricFog, resources.GetTexture(weather));
 			ui->DrawBloomControls(renderer.bloom);
+			ui->DrawScreenSpaceControls(renderer.screenSpaceLighting);
 			ui->DrawRenderVisualizer(&device, renderer.clusteredCulling, overlayHandle);
 
 			renderer.userInterface->Render(list, resources.GetBuffer(cameraBuffer));
@@ -12,12 +12,18 @@
 #include <Rendering/Atmosphere.h>
 #include <Rendering/Clouds.h>
 #include <Rendering/Bloom.h>
+#include <Rendering/ScreenSpaceLighting.h>
 #include <Rendering/ClusteredLightCulling.h>
 #include <Utility/Math.h>
+#include <Core/Memory.h>
 
 #include <imgui_internal.h>
 
 #include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <unordered_map>
 #include <numeric>
 #include <string>
 #include <sstream>
@@ -34,9 +40,12 @@ void EditorUI::DrawMenu()
 			ImGui::MenuItem("Entity Hierarchy", nullptr, &entityHierarchyOpen);
 			ImGui::MenuItem("Entity Properties", nullptr, &entityPropertyViewerOpen);
 			ImGui::MenuItem("Metrics", nullptr, &metricsOpen);
+			ImGui::MenuItem("Memory", nullptr, &memoryOpen);
+			ImGui::MenuItem("GPU Profiler", nullptr, &gpuProfilerOpen);
 			ImGui::MenuItem("Render Graph", nullptr, &renderGraphOpen);
 			ImGui::MenuItem("Atmosphere Controls", nullptr, &atmosphereControlsOpen);
 			ImGui::MenuItem("Bloom Controls", nullptr, &bloomControlsOpen);
+			ImGui::MenuItem("Screen Space Controls", nullptr, &screenSpaceControlsOpen);
 			ImGui::MenuItem("Render Visualizer", nullptr, &renderVisualizerOpen);
 
 			ImGui::EndMenu();
@@ -747,9 +756,12 @@ void EditorUI::DrawLayout()
 		ImGui::DockBuilderDockWindow("Entity Hierarchy", entitiesDockId);
 		ImGui::DockBuilderDockWindow("Property Viewer", propertiesDockId);
 		ImGui::DockBuilderDockWindow("Metrics", metricsDockId);
+		ImGui::DockBuilderDockWindow("Memory", metricsDockId);
+		ImGui::DockBuilderDockWindow("GPU Profiler", metricsDockId);
 		ImGui::DockBuilderDockWindow("Render Graph", propertiesDockId);
 		ImGui::DockBuilderDockWindow("Sky Atmosphere", entitiesDockId);
 		ImGui::DockBuilderDockWindow("Bloom", entitiesDockId);
+		ImGui::DockBuilderDockWindow("Screen Space", entitiesDockId);
 		ImGui::DockBuilderDockWindow("Render Visualizer", propertiesDockId);
 		ImGui::DockBuilderDockWindow("Dear ImGui Demo", sceneDockId);
 		
@@ -775,7 +787,9 @@ void EditorUI::DrawScene(RenderDevice* device, entt::registry& registry, Texture
 {
 	const auto& sceneDescription = device->GetResourceManager().Get(sceneTexture).description;
 
-	ImGui::SetNextWindowSizeConstraints({ 100.f, 100.f }, { (float)sceneDescription.width, (float)sceneDescription.height });
+	// The scene follows the viewport size, which is limited by the back buffer. The scene texture is rounded up
+	// from the viewport size, so crop the remainder.
+	ImGui::SetNextWindowSizeConstraints({ 100.f, 100.f }, { (float)device->renderWidth, (float)device->renderHeight });
 
 	ImGui::PushStyleVar(ImGuiStyleVar_WindowPadding, { 0.f, 0.f });  // Remove window padding.
 
@@ -808,6 +822,22 @@ void EditorUI::DrawScene(RenderDevice* device, entt::registry& registry, Texture
 			});
 		}
 
+		// Single clicking the viewport outside of control selects the entity under the cursor, read back from the GPU.
+		else if (ImGui::IsMouseClicked(ImGuiMouseButton_Left) && ImGui::IsWindowHovered(ImGuiHoveredFlags_None) && registry.view<const ControlComponent>().empty())
+		{
+			// Map the cursor into the cropped region of the scene texture.
+			const auto cursor = (ImGui::GetMousePos() - sceneViewportMin) / (sceneViewportMax - sceneViewportMin);
+			const auto u = widthUV + cursor.x * (1.f - 2.f * widthUV);
+			const auto v = heightUV + cursor.y * (1.f - 2.f * heightUV);
+			const auto x = static_cast<uint32_t>(std::clamp(u, 0.f, 1.f) * (sceneDescription.width - 1));
+			const auto y = static_cast<uint32_t>(std::clamp(v, 0.f, 1.f) * (sceneDescription.height - 1));
+
+			Renderer::Get().RequestPick(x, y, [this](entt::entity entity)
+			{
+				hierarchySelectedEntity = entity;
+			});
+		}
+
 		// Use a dummy object to get proper drag drop bounds.
 		const float padding = 4.f;
 		ImGui::SetCursorPos(ImGui::GetWindowContentRegionMin() + ImVec2{ padding, padding });
@@ -883,60 +913,136 @@ void EditorUI::DrawControls(RenderDevice* device)
 	}
 }
 
+void EditorUI::RebuildEntityHierarchy(const entt::registry& registry)
+{
+	hierarchyDirty = false;
+	hierarchyRegistrySize = registry.size();
+	hierarchyReleased = registry.released();
+	hierarchyEntityCount = 0;
+	hierarchyEntries.clear();
+
+	const auto lowercase = [](std::string text)
+	{
+		std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return text;
+	};
+
+	const auto search = lowercase(hierarchySearch);
+
+	registry.each([&](auto entity)
+	{
+		++hierarchyEntityCount;
+
+		std::string label;
+		if (const auto* name = registry.try_get<NameComponent>(entity))
+		{
+			label = name->name;
+		}
+
+		else
+		{
+			// Strip the version info from the entity, we only care about the actual ID.
+			label = "Entity_" + std::to_string(registry.entity(entity));
+		}
+
+		if (search.empty() || lowercase(label).find(search) != std::string::npos)
+		{
+			hierarchyEntries.push_back({ entity, std::move(label) });
+		}
+	});
+
+	std::sort(hierarchyEntries.begin(), hierarchyEntries.end(), [](const auto& left, const auto& right)
+	{
+		return left.label != right.label ? left.label < right.label : left.entity < right.entity;
+	});
+}
+
 void EditorUI::DrawEntityHierarchy(entt::registry& registry)
 {
+	if (hierarchyRegistry != &registry)
+	{
+		hierarchyRegistry = &registry;
+		hierarchyDirty = true;
+
+		registry.on_construct<NameComponent>().connect<&EditorUI::OnNameChanged>(*this);
+		registry.on_update<NameComponent>().connect<&EditorUI::OnNameChanged>(*this);
+		registry.on_destroy<NameComponent>().connect<&EditorUI::OnNameChanged>(*this);
+	}
+
 	if (entityHierarchyOpen)
 	{
 		entt::entity selectedEntity = entt::null;
 
 		if (ImGui::Begin("Entity Hierarchy", &entityHierarchyOpen))
 		{
-			ImGui::Text("%i Entities", registry.size());
-			ImGui::Separator();
+			if (ImGui::InputTextWithHint("##HierarchySearch", "Search", hierarchySearch, std::size(hierarchySearch)))
+			{
+				hierarchyDirty = true;
+			}
 
-			registry.each([this, &registry, &selectedEntity](auto entity)
+			if (hierarchyDirty || registry.size() != hierarchyRegistrySize || registry.released() != hierarchyReleased)
 			{
-				ImGuiTreeNodeFlags nodeFlags = ImGuiTreeNodeFlags_None;
+				RebuildEntityHierarchy(registry);
+			}
 
-				if (entity == hierarchySelectedEntity)
-					nodeFlags |= ImGuiTreeNodeFlags_Selected;
+			if (hierarchySearch[0] != '\0')
+			{
+				ImGui::Text("%zu / %zu Entities", hierarchyEntries.size(), hierarchyEntityCount);
+			}
 
-				bool nodeOpen = false;
+			else
+			{
+				ImGui::Text("%zu Entities", hierarchyEntityCount);
+			}
 
-				ImGui::PushID(static_cast<int32_t>(entity));  // Use the entity as the ID.
+			ImGui::Separator();
 
-				if (registry.all_of<NameComponent>(entity))
-				{
-					nodeOpen = ImGui::TreeNodeEx("EntityTreeNode", nodeFlags, registry.get<NameComponent>(entity).name.c_str());
-				}
+			if (ImGui::BeginChild("EntityList"))
+			{
+				// Only the visible rows are submitted.
+				ImGuiListClipper clipper;
+				clipper.Begin(static_cast<int>(hierarchyEntries.size()));
 
-				else
+				while (clipper.Step())
 				{
-					// Strip the version info from the entity, we only care about the actual ID.
-					nodeOpen = ImGui::TreeNodeEx("EntityTreeNode", nodeFlags, "Entity_%i", registry.entity(entity));
-				}
+					for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+					{
+						const auto& [entity, label] = hierarchyEntries[i];
 
-				if (ImGui::IsItemClicked())
-				{
-					selectedEntity = entity;
-				}
+						ImGuiTreeNodeFlags nodeFlags = ImGuiTreeNodeFlags_None;
 
-				if (nodeOpen)
-				{
-					// #TODO: Draw entity children.
+						if (entity == hierarchySelectedEntity)
+							nodeFlags |= ImGuiTreeNodeFlags_Selected;
 
-					ImGui::TreePop();
-				}
+						ImGui::PushID(static_cast<int32_t>(entity));  // Use the entity as the ID.
 
-				ImGui::PopID();
+						const bool nodeOpen = ImGui::TreeNodeEx("EntityTreeNode", nodeFlags, "%s", label.c_str());
 
-				// Open the property viewer with focus on left click. Test the condition for each tree node.
-				if (ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left) && ImGui::IsItemHovered(ImGuiHoveredFlags_None))
-				{
-					entityPropertyViewerOpen = true;
-					entityPropertyViewerFocus = true;
+						if (ImGui::IsItemClicked())
+						{
+							selectedEntity = entity;
+						}
+
+						if (nodeOpen)
+						{
+							// #TODO: Draw entity children.
+
+							ImGui::TreePop();
+						}
+
+						ImGui::PopID();
+
+						// Open the property viewer with focus on left click. Test the condition for each tree node.
+						if (ImGui::IsMouseDoubleClicked(ImGuiMouseButton_Left) && ImGui::IsItemHovered(ImGuiHoveredFlags_None))
+						{
+							entityPropertyViewerOpen = true;
+							entityPropertyViewerFocus = true;
+						}
+					}
 				}
-			});
+			}
+
+			ImGui::EndChild();
 		}
 
 		ImGui::End();
@@ -965,11 +1071,16 @@ void EditorUI::DrawEntityPropertyViewer(entt::registry& registry)
 			{
 				uint32_t componentCount = 0;
 
-				for (auto& [metaID, renderFunction] : EntityReflection::componentList)
+				// Gather the selection's component types in a single pass over the pools.
+				std::vector<entt::id_type> entityComponents;
+				registry.visit(hierarchySelectedEntity, [&entityComponents](const auto info)
 				{
-					entt::id_type metaList[] = { metaID };
+					entityComponents.emplace_back(info.hash());
+				});
 
-					if (registry.runtime_view(std::cbegin(metaList), std::cend(metaList)).contains(hierarchySelectedEntity))
+				for (auto& [metaID, renderFunction] : EntityReflection::componentList)
+				{
+					if (std::find(entityComponents.begin(), entityComponents.end(), metaID) != entityComponents.end())
 					{
 						++componentCount;
 
@@ -1025,12 +1136,407 @@ void EditorUI::DrawMetrics(RenderDevice* device, float frameTimeMs)
 
 			ImGui::Text("Buffers (%u objects): %.2f MB", memoryInfo.bufferCount, memoryInfo.bufferBytes / (1024.f * 1024.f));
 			ImGui::Text("Textures (%u objects): %.2f MB", memoryInfo.textureCount, memoryInfo.textureBytes / (1024.f * 1024.f));
+
+			const auto& memoryBudget = device->GetMemoryBudget();
+			if (memoryBudget.budget > 0)
+			{
+				ImGui::Text("Adapter usage: %.2f / %.2f MB", memoryBudget.usage / (1024.f * 1024.f), memoryBudget.budget / (1024.f * 1024.f));
+			}
+
+			ImGui::Text("Streamed textures: %.2f MB", Renderer::Get().textureStreamer.GetResidentBytes() / (1024.f * 1024.f));
+
+			ImGui::Separator();
+			ImGui::Text("CPU Heap");
+
+			if (ImGui::BeginTable("HeapTable", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+			{
+				ImGui::TableSetupColumn("Subsystem");
+				ImGui::TableSetupColumn("Live (MB)");
+				ImGui::TableSetupColumn("Live Allocations");
+				ImGui::TableSetupColumn("Allocations / Frame");
+				ImGui::TableHeadersRow();
+
+				const auto& heapStatistics = GetMemoryStatistics();
+				for (size_t i = 0; i < heapStatistics.size(); ++i)
+				{
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					ImGui::Text(memoryTagNames[i]);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.2f", heapStatistics[i].liveBytes / (1024.f * 1024.f));
+					ImGui::TableNextColumn();
+					ImGui::Text("%zu", heapStatistics[i].liveAllocations);
+					ImGui::TableNextColumn();
+					ImGui::Text("%zu", heapStatistics[i].frameAllocations);
+				}
+
+				ImGui::EndTable();
+			}
+		}
+
+		ImGui::End();
+	}
+}
+
+void EditorUI::DrawMemory(RenderDevice* device, RenderGraphResourceManager& resourceManager)
+{
+	if (memoryOpen)
+	{
+		if (ImGui::Begin("Memory", &memoryOpen))
+		{
+			constexpr auto megabyte = 1024.f * 1024.f;
+
+			const auto& memoryBudget = device->GetMemoryBudget();
+			if (memoryBudget.budget > 0)
+			{
+				const auto fraction = static_cast<float>(memoryBudget.usage) / memoryBudget.budget;
+				const auto overlay = std::to_string(memoryBudget.usage / (1024 * 1024)) + " / " + std::to_string(memoryBudget.budget / (1024 * 1024)) + " MB";
+
+				ImGui::Text("Adapter budget");
+				ImGui::ProgressBar(fraction, { -1.f, 0.f }, overlay.c_str());
+			}
+
+			if (ImGui::CollapsingHeader("Allocator", ImGuiTreeNodeFlags_DefaultOpen))
+			{
+				const auto statistics = device->CalculateAllocatorStatistics();
+				const char* heapNames[] = { "Default", "Upload", "Readback", "Custom" };
+
+				if (ImGui::BeginTable("AllocatorTable", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+				{
+					ImGui::TableSetupColumn("Heap");
+					ImGui::TableSetupColumn("Blocks");
+					ImGui::TableSetupColumn("Allocations");
+					ImGui::TableSetupColumn("Used (MB)");
+					ImGui::TableSetupColumn("Reserved (MB)");
+					ImGui::TableHeadersRow();
+
+					for (size_t i = 0; i < std::size(heapNames); ++i)
+					{
+						const auto& stats = statistics.HeapType[i].Stats;
+
+						ImGui::TableNextRow();
+						ImGui::TableNextColumn();
+						ImGui::Text(heapNames[i]);
+						ImGui::TableNextColumn();
+						ImGui::Text("%u", stats.BlockCount);
+						ImGui::TableNextColumn();
+						ImGui::Text("%u", stats.AllocationCount);
+						ImGui::TableNextColumn();
+						ImGui::Text("%.2f", stats.AllocationBytes / megabyte);
+						ImGui::TableNextColumn();
+						ImGui::Text("%.2f", stats.BlockBytes / megabyte);
+					}
+
+					ImGui::EndTable();
+				}
+
+				// Reserved but unused memory is lost to fragmentation or block granularity.
+				const auto& total = statistics.Total.Stats;
+				ImGui::Text("Unused in blocks: %.2f MB", (total.BlockBytes - total.AllocationBytes) / megabyte);
+
+				if (ImGui::Button("Log detailed allocator statistics"))
+				{
+					VGLog(logEditor, "Allocator statistics: {}", device->BuildAllocatorStatsString(true));
+				}
+			}
+
+			if (ImGui::CollapsingHeader("Upload", ImGuiTreeNodeFlags_DefaultOpen))
+			{
+				const auto memoryInfo = device->GetResourceManager().QueryMemoryInfo();
+
+				ImGui::Text("Last frame: %.2f MB", memoryInfo.uploadFrameBytes / megabyte);
+				ImGui::Text("High-water mark: %.2f MB", memoryInfo.uploadPeakBytes / megabyte);
+				ImGui::Text("Pages held: %.2f MB", memoryInfo.uploadPoolBytes / megabyte);
+			}
+
+			if (ImGui::CollapsingHeader("Transients", ImGuiTreeNodeFlags_DefaultOpen))
+			{
+				const auto& transientStats = resourceManager.GetTransientStats();
+				const auto requested = transientStats.reused + transientStats.created;
+
+				ImGui::Text("Pooled: %u buffers, %u textures", transientStats.bufferCount, transientStats.textureCount);
+				ImGui::Text("Pooled memory: %.2f MB", transientStats.pooledBytes / megabyte);
+				ImGui::Text("Aliasing heaps: %.2f MB", transientStats.heapBytes / megabyte);
+				ImGui::Text("Reuse rate: %.1f%% (%u created)", requested > 0 ? 100.f * transientStats.reused / requested : 100.f, transientStats.created);
+			}
+
+			if (ImGui::CollapsingHeader("Largest Allocations", ImGuiTreeNodeFlags_DefaultOpen))
+			{
+				constexpr size_t allocationCount = 16;
+
+				if (ImGui::BeginTable("AllocationTable", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+				{
+					ImGui::TableSetupColumn("Name", ImGuiTableColumnFlags_WidthStretch);
+					ImGui::TableSetupColumn("Type");
+					ImGui::TableSetupColumn("Size (MB)");
+					ImGui::TableHeadersRow();
+
+					for (const auto& record : device->GetResourceManager().QueryLargestAllocations(allocationCount))
+					{
+						ImGui::TableNextRow();
+						ImGui::TableNextColumn();
+						ImGui::Text("%ls", record.name.c_str());
+						ImGui::TableNextColumn();
+						ImGui::Text(record.texture ? "Texture" : "Buffer");
+						ImGui::TableNextColumn();
+						ImGui::Text("%.2f", record.size / megabyte);
+					}
+
+					ImGui::EndTable();
+				}
+			}
 		}
 
 		ImGui::End();
 	}
 }
 
+void EditorUI::DrawGpuProfiler(RenderDevice* device)
+{
+	if (gpuProfilerOpen)
+	{
+		if (ImGui::Begin("GPU Profiler", &gpuProfilerOpen))
+		{
+			CvarHelpers::Checkbox("gpuPassTiming", "Pass timing enabled");
+			CvarHelpers::Checkbox("gpuPipelineStatistics", "Pipeline statistics enabled");
+
+			ImGui::Text("GPU frame: %.2f ms", device->GetGPUFrameTime());
+
+			const auto& counters = device->GetProfiler().GetCounters();
+			if (!counters.empty() && device->GetProfiler().CollectingStatistics())
+			{
+				ImGui::Separator();
+
+				for (const auto& counter : counters)
+				{
+					const auto fraction = counter.total > 0 ? 100.f * counter.value / counter.total : 0.f;
+					ImGui::Text("%s: %u / %u (%.1f%%)", counter.name.c_str(), counter.value, counter.total, fraction);
+				}
+
+				ImGui::Separator();
+			}
+
+			const auto statistics = device->GetProfiler().GetStatistics();
+			const auto pipelineColumns = device->GetProfiler().CollectingStatistics();
+			constexpr auto tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_ScrollY;
+
+			if (!statistics.empty() && ImGui::BeginTable("Passes", pipelineColumns ? 10 : 6, tableFlags))
+			{
+				ImGui::TableSetupScrollFreeze(0, 1);
+				ImGui::TableSetupColumn("Pass");
+				ImGui::TableSetupColumn("Last");
+				ImGui::TableSetupColumn("Average");
+				ImGui::TableSetupColumn("Median");
+				ImGui::TableSetupColumn("95%");
+				ImGui::TableSetupColumn("99%");
+				if (pipelineColumns)
+				{
+					ImGui::TableSetupColumn("Primitives");
+					ImGui::TableSetupColumn("VS invocations");
+					ImGui::TableSetupColumn("PS invocations");
+					ImGui::TableSetupColumn("CS invocations");
+				}
+				ImGui::TableHeadersRow();
+
+				for (const auto& pass : statistics)
+				{
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					ImGui::TextUnformatted(pass.name.c_str());
+					ImGui::TableNextColumn();
+					ImGui::Text("%.3f", pass.lastTime);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.3f", pass.averageTime);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.3f", pass.medianTime);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.3f", pass.percentile95Time);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.3f", pass.percentile99Time);
+
+					if (pipelineColumns && pass.pipeline)
+					{
+						ImGui::TableNextColumn();
+						ImGui::Text("%llu", pass.pipeline->IAPrimitives);
+						ImGui::TableNextColumn();
+						ImGui::Text("%llu", pass.pipeline->VSInvocations);
+						ImGui::TableNextColumn();
+						ImGui::Text("%llu", pass.pipeline->PSInvocations);
+						ImGui::TableNextColumn();
+						ImGui::Text("%llu", pass.pipeline->CSInvocations);
+					}
+				}
+
+				ImGui::EndTable();
+			}
+		}
+
+		ImGui::End();
+	}
+}
+
+void EditorUI::DrawRenderGraphTimeline(RenderDevice* device, const RenderGraphTimeline& timeline)
+{
+	const auto statistics = device->GetProfiler().GetStatistics();
+
+	std::unordered_map<std::string_view, float> passTimes;  // Average milliseconds.
+	float maxTime = 0.f;
+	for (const auto& pass : statistics)
+	{
+		passTimes[pass.name] = pass.averageTime;
+		maxTime = std::max(maxTime, pass.averageTime);
+	}
+
+	constexpr auto tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_SizingStretchProp | ImGuiTableFlags_ScrollY;
+
+	if (ImGui::BeginTable("TimelinePasses", 8, tableFlags, { 0.f, 300.f }))
+	{
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("#");
+		ImGui::TableSetupColumn("Pass");
+		ImGui::TableSetupColumn("Queue");
+		ImGui::TableSetupColumn("GPU (ms)");
+		ImGui::TableSetupColumn("Transitions");
+		ImGui::TableSetupColumn("Split end/begin");
+		ImGui::TableSetupColumn("UAV");
+		ImGui::TableSetupColumn("Aliasing");
+		ImGui::TableHeadersRow();
+
+		for (size_t position = 0; position < timeline.order.size(); ++position)
+		{
+			const auto& pass = timeline.passes[timeline.order[position]];
+
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("%zu", position);
+			ImGui::TableNextColumn();
+			if (pass.enabled) ImGui::TextUnformatted(pass.name.data(), pass.name.data() + pass.name.size());
+			else ImGui::TextDisabled("%.*s", static_cast<int>(pass.name.size()), pass.name.data());
+			ImGui::TableNextColumn();
+			ImGui::Text(pass.asyncCompute ? "Compute" : "Direct");
+			ImGui::TableNextColumn();
+
+			// Bar of the pass's average time relative to the most expensive pass.
+			if (const auto it = passTimes.find(pass.name); it != passTimes.end())
+			{
+				char text[16];
+				std::snprintf(text, std::size(text), "%.3f", it->second);
+				ImGui::ProgressBar(maxTime > 0.f ? it->second / maxTime : 0.f, { -1.f, 0.f }, text);
+			}
+
+			ImGui::TableNextColumn();
+			ImGui::Text("%u", pass.transitions);
+			ImGui::TableNextColumn();
+			ImGui::Text("%u / %u", pass.splitEnds, pass.splitBegins);
+			ImGui::TableNextColumn();
+			ImGui::Text("%u", pass.uavBarriers);
+			ImGui::TableNextColumn();
+			ImGui::Text("%u", pass.aliasingBarriers);
+		}
+
+		ImGui::EndTable();
+	}
+
+	if (timeline.order.empty())
+	{
+		return;
+	}
+
+	// Memory aliased transients are drawn in their heap, horizontally by lifetime and vertically by placement, so
+	// resources sharing memory can be seen handing it over. Every transient also gets a lifetime row.
+	const auto passWidth = ImGui::GetContentRegionAvail().x / timeline.order.size();
+	const auto heapHeight = 120.f;
+	const auto rowHeight = ImGui::GetTextLineHeight();
+	auto* drawList = ImGui::GetWindowDrawList();
+
+	const auto TransientColor = [](size_t index)
+	{
+		return ImColor::HSV(std::fmod(index * 0.618034f, 1.f), 0.6f, 0.8f);
+	};
+
+	const auto TransientTooltip = [](const RenderGraphTimeline::Transient& transient)
+	{
+		ImGui::BeginTooltip();
+		ImGui::Text("%ls", transient.name.c_str());
+		ImGui::Text("Passes %zu - %zu, %.2f MB", transient.first, transient.last, transient.size / (1024.f * 1024.f));
+		if (transient.heap)
+		{
+			ImGui::Text("Heap %zu at %.2f MB", *transient.heap, transient.offset / (1024.f * 1024.f));
+		}
+		ImGui::EndTooltip();
+	};
+
+	std::vector<size_t> heaps;
+	for (const auto& transient : timeline.transients)
+	{
+		if (transient.heap && std::find(heaps.begin(), heaps.end(), *transient.heap) == heaps.end())
+		{
+			heaps.emplace_back(*transient.heap);
+		}
+	}
+
+	std::sort(heaps.begin(), heaps.end());
+
+	for (const auto heap : heaps)
+	{
+		uint64_t heapSize = 0;
+		for (const auto& transient : timeline.transients)
+		{
+			if (transient.heap == heap)
+				heapSize = std::max(heapSize, transient.offset + transient.size);
+		}
+
+		ImGui::Text("Aliasing heap %zu (%.2f MB)", heap, heapSize / (1024.f * 1024.f));
+
+		const auto origin = ImGui::GetCursorScreenPos();
+		const auto width = passWidth * timeline.order.size();
+		drawList->AddRect(origin, origin + ImVec2{ width, heapHeight }, ImGui::GetColorU32(ImGuiCol_Border));
+
+		for (size_t i = 0; i < timeline.transients.size(); ++i)
+		{
+			const auto& transient = timeline.transients[i];
+			if (transient.heap != heap || heapSize == 0)
+				continue;
+
+			const auto min = origin + ImVec2{ transient.first * passWidth, heapHeight * transient.offset / heapSize };
+			const auto max = origin + ImVec2{ (transient.last + 1) * passWidth, heapHeight * (transient.offset + transient.size) / heapSize };
+			drawList->AddRectFilled(min, max, TransientColor(i));
+			drawList->AddRect(min, max, IM_COL32(0, 0, 0, 255));
+
+			if (ImGui::IsWindowHovered() && ImGui::IsMouseHoveringRect(min, max))
+			{
+				TransientTooltip(transient);
+			}
+		}
+
+		ImGui::Dummy({ width, heapHeight });
+	}
+
+	if (ImGui::TreeNode("Transient lifetimes"))
+	{
+		for (size_t i = 0; i < timeline.transients.size(); ++i)
+		{
+			const auto& transient = timeline.transients[i];
+
+			const auto origin = ImGui::GetCursorScreenPos();
+			const auto min = origin + ImVec2{ transient.first * passWidth, 0.f };
+			const auto max = origin + ImVec2{ (transient.last + 1) * passWidth, rowHeight };
+			drawList->AddRectFilled(min, max, TransientColor(i));
+
+			// Labeled from the start of the lifetime, the next row starts back at the left edge.
+			ImGui::SetCursorScreenPos(min);
+			ImGui::Text("%ls", transient.name.c_str());
+
+			if (ImGui::IsWindowHovered() && ImGui::IsMouseHoveringRect(min, max))
+			{
+				TransientTooltip(transient);
+			}
+		}
+
+		ImGui::TreePop();
+	}
+}
+
 void EditorUI::DrawRenderGraph(RenderDevice* device, RenderGraphResourceManager& resourceManager, TextureHandle depthStencil, TextureHandle scene)
 {
 	if (renderGraphOpen)
@@ -1041,6 +1547,18 @@ void EditorUI::DrawRenderGraph(RenderDevice* device, RenderGraphResourceManager&
 			{
 				ImGui::Checkbox("Linearize depth", &linearizeDepth);
 				ImGui::Checkbox("Allow transient resource reuse", &resourceManager.transientReuse);
+				ImGui::Checkbox("Allow transient memory aliasing", &resourceManager.transientAliasing);
+				ImGui::Checkbox("Cull unused passes", &resourceManager.passCulling);
+			}
+
+			if (ImGui::CollapsingHeader("Timeline"))
+			{
+				ImGui::Checkbox("Capture timeline", &captureRenderGraphTimeline);
+
+				if (captureRenderGraphTimeline && resourceManager.captureTimeline)
+				{
+					DrawRenderGraphTimeline(device, resourceManager.GetTimeline());
+				}
 			}
 
 			if (linearizeDepth)
@@ -1068,7 +1586,7 @@ void EditorUI::DrawRenderGraph(RenderDevice* device, RenderGraphResourceManager&
 	}
 }
 
-void EditorUI::DrawAtmosphereControls(RenderDevice* device, entt::registry& registry, Atmosphere& atmosphere, Clouds& clouds, TextureHandle weather)
+void EditorUI::DrawAtmosphereControls(RenderDevice* device, entt::registry& registry, Atmosphere& atmosphere, Clouds& clouds, VolumetricFog& volumetricFog, TextureHandle weather)
 {
 	if (atmosphereControlsOpen)
 	{
@@ -1119,6 +1637,17 @@ void EditorUI::DrawAtmosphereControls(RenderDevice* device, entt::registry& regi
 			
 			ImGui::Separator();
 
+			ImGui::Text("Fog");
+			CvarHelpers::Checkbox("volumetricFog", "Volumetric fog enabled");
+			CvarHelpers::Slider("volumetricFogRange", "Range", 16.f, 512.f);
+			ImGui::DragFloat("Density", &volumetricFog.density, 0.0005f, 0.f, 0.5f);
+			ImGui::DragFloat("Height falloff", &volumetricFog.heightFalloff, 0.001f, 0.f, 1.f);
+			ImGui::DragFloat("Base height", &volumetricFog.baseHeight, 0.5f);
+			ImGui::DragFloat("Anisotropy", &volumetricFog.anisotropy, 0.01f, -0.95f, 0.95f);
+			ImGui::ColorEdit3("Albedo", (float*)&volumetricFog.albedo);
+
+			ImGui::Separator();
+
 			ImGui::Text("Atmosphere");
 			bool dirty = false;
 			static float haze = 8;
@@ -1184,6 +1713,34 @@ void EditorUI::DrawBloomControls(Bloom& bloom)
 	}
 }
 
+void EditorUI::DrawScreenSpaceControls(ScreenSpaceLighting& screenSpaceLighting)
+{
+	if (screenSpaceControlsOpen)
+	{
+		if (ImGui::Begin("Screen Space", &screenSpaceControlsOpen))
+		{
+			ImGui::Text("Ambient occlusion");
+			CvarHelpers::Checkbox("screenSpaceAO", "Ambient occlusion enabled");
+			ImGui::DragFloat("Radius", &screenSpaceLighting.occlusionRadius, 0.01f, 0.05f, 10.f, "%.2f");
+			ImGui::DragFloat("Power", &screenSpaceLighting.occlusionPower, 0.01f, 0.1f, 4.f, "%.2f");
+
+			ImGui::Separator();
+			ImGui::Text("Reflections");
+			CvarHelpers::Checkbox("screenSpaceReflections", "Reflections enabled");
+			int steps = screenSpaceLighting.reflectionSteps;
+			if (ImGui::SliderInt("Max steps", &steps, 8, 256))
+				screenSpaceLighting.reflectionSteps = steps;
+			ImGui::DragFloat("Max distance", &screenSpaceLighting.reflectionDistance, 0.5f, 1.f, 500.f, "%.1f");
+			ImGui::DragFloat("Thickness", &screenSpaceLighting.reflectionThickness, 0.01f, 0.01f, 5.f, "%.2f");
+
+			ImGui::Separator();
+			ImGui::DragFloat("History weight", &screenSpaceLighting.historyWeight, 0.01f, 0.f, 0.98f, "%.2f");
+		}
+
+		ImGui::End();
+	}
+}
+
 void EditorUI::DrawRenderVisualizer(RenderDevice* device, ClusteredLightCulling& clusteredCulling, TextureHandle overlay)
 {
 	// We don't draw the overlay until the next frame, so just save it here.
@@ -1241,6 +1798,12 @@ void EditorUI::DrawRenderVisualizer(RenderDevice* device, ClusteredLightCulling&
 			}
 
 			ImGui::SliderFloat("Overlay alpha", &overlayAlpha, 0.05f, 1.f, "%.2f");
+
+			if (activeOverlay == RenderOverlay::Clusters)
+			{
+				const auto [binned, capacity] = clusteredCulling.GetLightListOccupancy();
+				ImGui::Text("Binned light indices: %u / %u", binned, capacity);
+			}
 		}
 
 		ImGui::End();
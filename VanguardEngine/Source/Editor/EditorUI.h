@@ -9,6 +9,7 @@
 
 #include <deque>
 #include <string>
+#include <vector>
 
 enum class RenderOverlay
 {
@@ -19,9 +20,12 @@ enum class RenderOverlay
 
 class RenderDevice;
 class RenderGraphResourceManager;
+struct RenderGraphTimeline;
 class Atmosphere;
 class Clouds;
+class VolumetricFog;
 class Bloom;
+class ScreenSpaceLighting;
 class ClusteredLightCulling;
 
 class EditorUI
@@ -30,6 +34,24 @@ private:
 	bool enabled = true;
 
 	entt::entity hierarchySelectedEntity = entt::null;
+
+	// Filtered and sorted entity hierarchy, only rebuilt when entities, names, or the search change. Large registries
+	// are then only paid for once per change instead of every frame.
+	struct HierarchyEntry
+	{
+		entt::entity entity;
+		std::string label;
+	};
+
+	std::vector<HierarchyEntry> hierarchyEntries;
+	size_t hierarchyEntityCount = 0;  // Alive entities at the last rebuild, before filtering.
+	const entt::registry* hierarchyRegistry = nullptr;  // Registry the name signals are connected to.
+	bool hierarchyDirty = true;
+	// Entity creation grows the entity list, destruction and recycling change the released list head. Together they
+	// detect changes to entities without names, which emit no signals.
+	size_t hierarchyRegistrySize = 0;
+	entt::entity hierarchyReleased = entt::null;
+	char hierarchySearch[128] = {};
 	bool linearizeDepth = true;
 
 	bool fullscreen = false;
@@ -39,9 +61,12 @@ private:
 	bool entityHierarchyOpen = true;
 	bool entityPropertyViewerOpen = true;
 	bool metricsOpen = true;
+	bool memoryOpen = true;
+	bool gpuProfilerOpen = true;
 	bool renderGraphOpen = true;
 	bool atmosphereControlsOpen = true;
 	bool bloomControlsOpen = true;
+	bool screenSpaceControlsOpen = true;
 	bool renderVisualizerOpen = true;
 	bool consoleOpen = false;
 
@@ -72,6 +97,10 @@ public:
 	int hiZOverlayMip = 0;
 
 	bool showFps = false;
+	bool captureRenderGraphTimeline = false;  // Applied to the graph between frames.
+
+	// Content size of the scene window, the scene renders at this resolution.
+	ImVec2 GetSceneViewportSize() const { return { sceneViewportMax.x - sceneViewportMin.x, sceneViewportMax.y - sceneViewportMin.y }; }
 
 private:
 	void DrawMenu();
@@ -80,6 +109,9 @@ private:
 	void DrawRenderOverlayProxy(RenderDevice* device, const ImVec2& min, const ImVec2& max);
 	bool ExecuteCommand(const std::string& command);
 	void DrawConsole(entt::registry& registry, const ImVec2& min, const ImVec2& max);
+	void DrawRenderGraphTimeline(RenderDevice* device, const RenderGraphTimeline& timeline);
+	void OnNameChanged(entt::registry& registry, entt::entity entity) { hierarchyDirty = true; }
+	void RebuildEntityHierarchy(const entt::registry& registry);
 
 public:
 	void Update();
@@ -90,9 +122,12 @@ public:
 	void DrawEntityHierarchy(entt::registry& registry);
 	void DrawEntityPropertyViewer(entt::registry& registry);
 	void DrawMetrics(RenderDevice* device, float frameTimeMs);
+	void DrawMemory(RenderDevice* device, RenderGraphResourceManager& resourceManager);
+	void DrawGpuProfiler(RenderDevice* device);
 	void DrawRenderGraph(RenderDevice* device, RenderGraphResourceManager& resourceManager, TextureHandle depthStencil, TextureHandle scene);
-	void DrawAtmosphereControls(RenderDevice* device, entt::registry& registry, Atmosphere& atmosphere, Clouds& clouds, TextureHandle weather);
+	void DrawAtmosphereControls(RenderDevice* device, entt::registry& registry, Atmosphere& atmosphere, Clouds& clouds, VolumetricFog& volumetricFog, TextureHandle weather);
 	void DrawBloomControls(Bloom& bloom);
+	void DrawScreenSpaceControls(ScreenSpaceLighting& screenSpaceLighting);
 	void DrawRenderVisualizer(RenderDevice* device, ClusteredLightCulling& clusteredCulling, TextureHandle overlay);
 
 	void AddConsoleMessage(const std::string& message);
@@ -21,6 +21,7 @@ namespace EntityReflection
 		{ entt::type_id<MeshComponent>().hash(), &ComponentProperties::RenderMeshComponent },
 		{ entt::type_id<CameraComponent>().hash(), &ComponentProperties::RenderCameraComponent },
 		{ entt::type_id<LightComponent>().hash(), &ComponentProperties::RenderLightComponent },
+		{ entt::type_id<ReflectionProbeComponent>().hash(), &ComponentProperties::RenderReflectionProbeComponent },
 		{ entt::type_id<TimeOfDayComponent>().hash(), &ComponentProperties::RenderTimeOfDayComponent }
 	};
 }
\ No newline at end of file
@@ -2,6 +2,15 @@
 
 #include <Rendering/Adapter.h>
 
+Adapter::~Adapter()
+{
+	if (budgetEvent)
+	{
+		budgetAdapter->UnregisterVideoMemoryBudgetChangeNotification(budgetCookie);
+		::CloseHandle(budgetEvent);
+	}
+}
+
 void Adapter::Initialize(ResourcePtr<IDXGIFactory7>& factory, D3D_FEATURE_LEVEL featureLevel, bool software)
 {
 	VGScopedCPUStat("Adapter Initialize");
@@ -34,12 +43,52 @@ void Adapter::Initialize(ResourcePtr<IDXGIFactory7>& factory, D3D_FEATURE_LEVEL
 
 	VGEnsure(adapterResource, "Failed to find a suitable render adapter.");
 
-	// #TODO: Adapter events.
-	//adapterResource->RegisterVideoMemoryBudgetChangeNotificationEvent();
+	if (SUCCEEDED(adapterResource->QueryInterface(IID_PPV_ARGS(budgetAdapter.Indirect()))))
+	{
+		budgetEvent = ::CreateEvent(nullptr, false, false, VGText("Video memory budget change"));
+		if (budgetEvent && FAILED(budgetAdapter->RegisterVideoMemoryBudgetChangeNotificationEvent(budgetEvent, &budgetCookie)))
+		{
+			VGLogWarning(logRendering, "Failed to register for video memory budget notifications.");
+			::CloseHandle(budgetEvent);
+			budgetEvent = nullptr;
+		}
+	}
+
+	else
+	{
+		VGLogWarning(logRendering, "Adapter doesn't support video memory budget queries.");
+	}
+
+	// #TODO: Hardware content protection teardown events.
 	//adapterResource->RegisterHardwareContentProtectionTeardownStatusEvent();
 
 	DXGI_ADAPTER_DESC1 adapterDesc;
 	adapterResource->GetDesc1(&adapterDesc);
 
+	vendorId = adapterDesc.VendorId;
+	dedicatedVideoMemory = adapterDesc.DedicatedVideoMemory;
+	softwareAdapter = (adapterDesc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) == DXGI_ADAPTER_FLAG_SOFTWARE;
+
 	VGLog(logRendering, "Using adapter: {}", adapterDesc.Description);
+}
+
+std::optional<DXGI_QUERY_VIDEO_MEMORY_INFO> Adapter::QueryLocalMemory() const
+{
+	if (!budgetAdapter)
+	{
+		return std::nullopt;
+	}
+
+	DXGI_QUERY_VIDEO_MEMORY_INFO info;
+	if (FAILED(budgetAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info)))
+	{
+		return std::nullopt;
+	}
+
+	return info;
+}
+
+bool Adapter::BudgetChanged() const
+{
+	return budgetEvent && ::WaitForSingleObject(budgetEvent, 0) == WAIT_OBJECT_0;
 }
\ No newline at end of file
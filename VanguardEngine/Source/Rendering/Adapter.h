@@ -6,13 +6,34 @@
 
 #include <Core/Windows/DirectX12Minimal.h>
 
+#include <optional>
+
 class Adapter
 {
 private:
 	ResourcePtr<IDXGIAdapter1> adapterResource;
 
+	// Video memory budget queries, not available on every adapter.
+	ResourcePtr<IDXGIAdapter3> budgetAdapter;
+	HANDLE budgetEvent = nullptr;  // Signaled by the OS when the budget changes.
+	DWORD budgetCookie = 0;
+
+	uint32_t vendorId = 0;  // PCI vendor ID.
+	size_t dedicatedVideoMemory = 0;  // Bytes, little or none for integrated adapters.
+	bool softwareAdapter = false;
+
 public:
+	~Adapter();
+
 	auto* Native() const noexcept { return adapterResource.Get(); }
+	auto GetVendorId() const noexcept { return vendorId; }
+	auto GetDedicatedVideoMemory() const noexcept { return dedicatedVideoMemory; }
+	auto IsSoftware() const noexcept { return softwareAdapter; }
 
 	void Initialize(ResourcePtr<IDXGIFactory7>& factory, D3D_FEATURE_LEVEL featureLevel, bool software);
+
+	// Budget and current usage of the adapter's local memory segment. Empty if the adapter doesn't support budget queries.
+	std::optional<DXGI_QUERY_VIDEO_MEMORY_INFO> QueryLocalMemory() const;
+	// Non-blocking, true if the budget changed since the last call.
+	bool BudgetChanged() const;
 };
\ No newline at end of file
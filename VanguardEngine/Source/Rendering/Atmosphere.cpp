@@ -9,15 +9,28 @@
 #include <Rendering/ShaderStructs.h>
 #include <Core/CoreComponents.h>
 #include <Rendering/RenderComponents.h>
+#include <Rendering/ResourceFormat.h>
+#include <Utility/AlignedSize.h>
+#include <Core/Config.h>
 
 #include <vector>
 #include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <string_view>
+#include <string>
 
 void Atmosphere::Precompute(CommandList& list, TextureHandle transmittanceHandle, TextureHandle scatteringHandle, TextureHandle irradianceHandle)
 {
 	constexpr auto groupSize = 8;
 	constexpr auto scatteringOrder = 4;
 
+	// Used by handle, outside of the render graph.
+	for (const auto texture : { deltaRayleighTexture, deltaMieTexture, deltaScatteringDensityTexture, deltaIrradianceTexture })
+	{
+		device->GetResourceManager().MarkUsed(texture);
+	}
+
 	const auto& transmittanceComponent = device->GetResourceManager().Get(transmittanceHandle);
 	const auto& scatteringComponent = device->GetResourceManager().Get(scatteringHandle);
 	const auto& irradianceComponent = device->GetResourceManager().Get(irradianceHandle);
@@ -175,7 +188,7 @@ void Atmosphere::Precompute(CommandList& list, TextureHandle transmittanceHandle
 	for (int i = 2; i <= scatteringOrder; ++i)
 	{
 		std::string zoneName = "Precompute scattering order " + std::to_string(i);
-		VGScopedGPUTransientStat(zoneName.c_str(), device->GetDirectContext(), list.Native());
+		VGScopedGPUTransientStat(zoneName.c_str(), device->GetQueueContext(list.Type()), list.Native());
 
 		// Scattering density.
 
@@ -272,6 +285,210 @@ void Atmosphere::Precompute(CommandList& list, TextureHandle transmittanceHandle
 	device->GetResourceManager().AddFrameDescriptor(device->GetFrameIndex(), std::move(deltaIrradianceUAV));
 }
 
+size_t Atmosphere::HashModel() const
+{
+	return std::hash<std::string_view>{}(std::string_view{ reinterpret_cast<const char*>(&model), sizeof(model) });
+}
+
+std::filesystem::path Atmosphere::GetLutCachePath(size_t modelHash) const
+{
+	const auto precision = fullPrecisionLuts ? "_32" : "_16";  // Each precision has its own cache, the texel sizes differ.
+
+	return Config::engineRootPath / "Cache" / ("Atmosphere_" + std::to_string(lutCacheVersion) + "_" + std::to_string(modelHash) + precision + ".bin");
+}
+
+bool Atmosphere::LoadLutCache()
+{
+	VGScopedCPUStat("Atmosphere LUT Cache Load");
+
+	std::ifstream cacheStream{ GetLutCachePath(HashModel()), std::ios::binary };
+	if (!cacheStream.is_open())
+	{
+		return false;
+	}
+
+	// Read everything before writing any of the LUTs, a truncated cache falls back to precomputing.
+	std::vector<std::byte> data[3];
+	const TextureHandle textures[] = { transmittanceTexture, scatteringTexture, irradianceTexture };
+	for (int i = 0; i < 3; ++i)
+	{
+		const auto& description = device->GetResourceManager().Get(textures[i]).description;
+		data[i].resize(description.width * description.height * description.depth * (GetResourceFormatSize(description.format) / 8));
+		cacheStream.read(reinterpret_cast<char*>(data[i].data()), data[i].size());
+	}
+
+	if (!cacheStream)
+	{
+		VGLogWarning(logRendering, "Atmosphere LUT cache is corrupt, precomputing.");
+
+		return false;
+	}
+
+	for (int i = 0; i < 3; ++i)
+	{
+		device->GetResourceManager().Write(textures[i], data[i]);
+	}
+
+	VGLog(logRendering, "Loaded precomputed atmosphere LUTs from cache.");
+
+	return true;
+}
+
+void Atmosphere::CreateLuts()
+{
+	auto& resourceManager = device->GetResourceManager();
+
+	const TextureHandle textures[] = { transmittanceTexture, scatteringTexture, irradianceTexture };
+	for (const auto texture : textures)
+	{
+		if (resourceManager.Valid(texture))
+		{
+			resourceManager.AddFrameResource(device->GetFrameIndex(), texture);  // Could still be in use by the GPU.
+		}
+	}
+
+	// A pending readback copied the previous LUTs, which no longer match the cache's precision.
+	if (lutReadback)
+	{
+		resourceManager.AddFrameAllocation(device->GetFrameIndex(), std::move(lutReadback->allocation));
+		lutReadback.reset();
+	}
+
+	// The scattering LUT is sampled per pixel by the compose, the camera LUTs and the clouds, 16-bit floats halve its
+	// bandwidth. The precompute's delta textures stay 32-bit, the scattering orders are summed in them.
+	const auto format = fullPrecisionLuts ? DXGI_FORMAT_R32G32B32A32_FLOAT : DXGI_FORMAT_R16G16B16A16_FLOAT;
+
+	TextureDescription transmittanceDesc{
+		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
+		.accessFlags = AccessFlag::CPUWrite | AccessFlag::GPUWrite,  // CPU write for loading the LUT cache.
+		.width = 256,
+		.height = 64,
+		.depth = 1,
+		.format = format,
+		.mipMapping = false
+	};
+
+	transmittanceTexture = resourceManager.Create(transmittanceDesc, VGText("Atmosphere precomputed transmittance"));
+
+	auto scatteringDesc = resourceManager.Get(deltaRayleighTexture).description;
+	scatteringDesc.accessFlags = transmittanceDesc.accessFlags;
+	scatteringDesc.format = format;
+	scatteringDesc.evictable = false;  // Sampled every frame.
+	scatteringTexture = resourceManager.Create(scatteringDesc, VGText("Atmosphere precomputed scattering"));
+
+	auto irradianceDesc = resourceManager.Get(deltaIrradianceTexture).description;
+	irradianceDesc.accessFlags = transmittanceDesc.accessFlags;
+	irradianceDesc.format = format;
+	irradianceDesc.evictable = false;
+	irradianceTexture = resourceManager.Create(irradianceDesc, VGText("Atmosphere precomputed irradiance"));
+
+	dirty = true;
+}
+
+void Atmosphere::ReadbackLuts(CommandList& list)
+{
+	const TextureHandle textures[] = { transmittanceTexture, scatteringTexture, irradianceTexture };
+
+	// The model changed again before the previous readback finished, the GPU may still be copying into it.
+	if (lutReadback)
+	{
+		device->GetResourceManager().AddFrameAllocation(device->GetFrameIndex(), std::move(lutReadback->allocation));
+		lutReadback.reset();
+	}
+
+	LutReadback readback;
+	readback.modelHash = HashModel();
+	readback.readyFrame = Renderer::Get().GetAppFrame() + RenderDevice::frameCount + 1;
+
+	// Each LUT is copied to its own aligned footprint in a shared buffer.
+	uint64_t size = 0;
+	for (int i = 0; i < 3; ++i)
+	{
+		const auto description = device->GetResourceManager().Get(textures[i]).Native()->GetDesc();
+
+		uint64_t footprintSize;
+		device->Native()->GetCopyableFootprints(&description, 0, 1, size, &readback.footprints[i], nullptr, nullptr, &footprintSize);
+		size = AlignedSize(readback.footprints[i].Offset + footprintSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+	}
+
+	readback.allocation = device->GetResourceManager().AllocateReadback(size, VGText("Atmosphere LUT readback"));
+	if (!readback.allocation)
+	{
+		return;
+	}
+
+	for (int i = 0; i < 3; ++i)
+	{
+		list.TransitionBarrier(textures[i], D3D12_RESOURCE_STATE_COPY_SOURCE);
+	}
+
+	list.FlushBarriers();
+
+	for (int i = 0; i < 3; ++i)
+	{
+		D3D12_TEXTURE_COPY_LOCATION source{};
+		source.pResource = device->GetResourceManager().Get(textures[i]).Native();
+		source.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+		source.SubresourceIndex = 0;
+
+		D3D12_TEXTURE_COPY_LOCATION destination{};
+		destination.pResource = readback.allocation->GetResource();
+		destination.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+		destination.PlacedFootprint = readback.footprints[i];
+
+		list.Native()->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+	}
+
+	lutReadback = std::move(readback);
+}
+
+void Atmosphere::SaveLutCache()
+{
+	VGScopedCPUStat("Atmosphere LUT Cache Save");
+
+	const auto path = GetLutCachePath(lutReadback->modelHash);
+
+	std::error_code error;
+	std::filesystem::create_directories(path.parent_path(), error);
+
+	std::ofstream cacheStream{ path, std::ios::binary };
+
+	std::byte* mappedData = nullptr;
+	const auto result = lutReadback->allocation->GetResource()->Map(0, nullptr, reinterpret_cast<void**>(&mappedData));
+	if (FAILED(result) || !cacheStream.is_open())
+	{
+		VGLogWarning(logRendering, "Failed to save the atmosphere LUT cache.");
+
+		lutReadback.reset();
+		return;
+	}
+
+	// Strip the row padding, the file contains tightly packed LUTs.
+	const TextureHandle textures[] = { transmittanceTexture, scatteringTexture, irradianceTexture };
+	for (int i = 0; i < 3; ++i)
+	{
+		const auto& description = device->GetResourceManager().Get(textures[i]).description;
+		const auto& footprint = lutReadback->footprints[i];
+		const auto rowSize = description.width * (GetResourceFormatSize(description.format) / 8);
+
+		for (uint32_t slice = 0; slice < footprint.Footprint.Depth; ++slice)
+		{
+			for (uint32_t row = 0; row < footprint.Footprint.Height; ++row)
+			{
+				const auto offset = footprint.Offset + (slice * footprint.Footprint.Height + row) * footprint.Footprint.RowPitch;
+				cacheStream.write(reinterpret_cast<const char*>(mappedData + offset), rowSize);
+			}
+		}
+	}
+
+	D3D12_RANGE writtenRange{ 0, 0 };
+	lutReadback->allocation->GetResource()->Unmap(0, &writtenRange);
+
+	VGLog(logRendering, "Saved precomputed atmosphere LUTs to cache.");
+
+	lutReadback.reset();
+}
+
 Atmosphere::~Atmosphere()
 {
 	device->GetResourceManager().Destroy(modelBuffer);
@@ -292,6 +509,12 @@ void Atmosphere::Initialize(RenderDevice* inDevice, entt::registry& registry)
 	CvarCreate("renderLightShafts", "Controls rendering of volumetric light shafts, currently only cast by clouds. 0=off, 1=on", 1);
 	CvarCreate("farVolumetricShadowFix", "Enables a fix for very distant objects that are masked by volumetric shadows, which normally "
 		"show up too brightly against the surrounding sky", 1);
+	CvarCreate("atmosphereCameraLuts", "Composes the sky and aerial perspective from low resolution LUTs computed per frame, instead of "
+		"evaluating the precomputed scattering per pixel. 0=off, 1=on", 1);
+	CvarCreate("environmentUpdatePeriod", "Frames per step of the time sliced sky luminance map, which image based lighting convolves once "
+		"complete. Longer periods are cheaper but lag further behind the sun", 1);
+	CvarCreate("atmosphereLutPrecision", "Storage of the precomputed atmosphere LUTs, full precision validates the reduced one. 0=32-bit float, "
+		"1=16-bit float", 1);
 
 	transmissionPrecomputeLayout = RenderPipelineLayout{}
 		.ComputeShader({ "Atmosphere/AtmospherePrecompute", "TransmittanceLutMain" });
@@ -317,6 +540,16 @@ void Atmosphere::Initialize(RenderDevice* inDevice, entt::registry& registry)
 	luminancePrecomputeLayout = RenderPipelineLayout{}
 		.ComputeShader({ "Atmosphere/Luminance", "Main" });
 
+	skyViewLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Atmosphere/CameraLuts", "SkyViewMain" });
+
+	aerialPerspectiveLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Atmosphere/CameraLuts", "AerialPerspectiveMain" });
+
+	composeLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Atmosphere/Compose", "Main" })
+		.Permutations({ { "RENDER_LIGHT_SHAFTS" }, { "ENABLE_FAR_SHADOW_FIX" }, { "CLOUDS_DEBUG_MARCHCOUNT" }, { "CLOUDS_DEBUG_TRANSMITTANCE" }, { "ATMOSPHERE_CAMERA_LUTS" } });
+
 	BufferDescription modelDesc{
 		.updateRate = ResourceFrequency::Static,
 		.bindFlags = BindFlag::ShaderResource,
@@ -327,18 +560,8 @@ void Atmosphere::Initialize(RenderDevice* inDevice, entt::registry& registry)
 
 	modelBuffer = device->GetResourceManager().Create(modelDesc, VGText("Atmosphere model data"));
 
-	TextureDescription transmittanceDesc{
-		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
-		.accessFlags = AccessFlag::GPUWrite,
-		.width = 256,
-		.height = 64,
-		.depth = 1,
-		.format = DXGI_FORMAT_R32G32B32A32_FLOAT,
-		.mipMapping = false
-	};
-
-	transmittanceTexture = device->GetResourceManager().Create(transmittanceDesc, VGText("Atmosphere precomputed transmittance"));
-
+	// Dimensions of the LUTs, which are created from these descriptions. The delta textures are only used while
+	// precomputing, and can be evicted in between.
 	TextureDescription scatteringDesc{
 		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
 		.accessFlags = AccessFlag::GPUWrite,
@@ -346,11 +569,10 @@ void Atmosphere::Initialize(RenderDevice* inDevice, entt::registry& registry)
 		.height = 128,
 		.depth = 32,
 		.format = DXGI_FORMAT_R32G32B32A32_FLOAT,
-		.mipMapping = false
+		.mipMapping = false,
+		.evictable = true
 	};
 
-	scatteringTexture = device->GetResourceManager().Create(scatteringDesc, VGText("Atmosphere precomputed scattering"));
-
 	TextureDescription irradianceDesc{
 		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
 		.accessFlags = AccessFlag::GPUWrite,
@@ -358,16 +580,18 @@ void Atmosphere::Initialize(RenderDevice* inDevice, entt::registry& registry)
 		.height = 16,
 		.depth = 1,
 		.format = DXGI_FORMAT_R32G32B32A32_FLOAT,
-		.mipMapping = false
+		.mipMapping = false,
+		.evictable = true
 	};
 
-	irradianceTexture = device->GetResourceManager().Create(irradianceDesc, VGText("Atmosphere precomputed irradiance"));
-
 	deltaRayleighTexture = device->GetResourceManager().Create(scatteringDesc, VGText("Atmosphere delta rayleigh"));
 	deltaMieTexture = device->GetResourceManager().Create(scatteringDesc, VGText("Atmosphere delta mie"));
 	deltaScatteringDensityTexture = device->GetResourceManager().Create(scatteringDesc, VGText("Atmosphere delta scattering density"));
 	deltaIrradianceTexture = device->GetResourceManager().Create(irradianceDesc, VGText("Atmosphere delta irradiance"));
 
+	fullPrecisionLuts = *CvarGet("atmosphereLutPrecision", int) == 0;
+	CreateLuts();
+
 	TextureDescription luminanceDesc{
 		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
 		.accessFlags = AccessFlag::GPUWrite,
@@ -421,6 +645,12 @@ void Atmosphere::Initialize(RenderDevice* inDevice, entt::registry& registry)
 
 AtmosphereResources Atmosphere::ImportResources(RenderGraph& graph)
 {
+	if ((*CvarGet("atmosphereLutPrecision", int) == 0) != fullPrecisionLuts)
+	{
+		fullPrecisionLuts = !fullPrecisionLuts;
+		CreateLuts();
+	}
+
 	const auto modelTag = graph.Import(modelBuffer);
 	const auto transmittanceTag = graph.Import(transmittanceTexture);
 	const auto scatteringTag = graph.Import(scatteringTexture);
@@ -429,31 +659,54 @@ AtmosphereResources Atmosphere::ImportResources(RenderGraph& graph)
 	return { modelTag, transmittanceTag, scatteringTag, irradianceTag };
 }
 
-void Atmosphere::Render(RenderGraph& graph, Clouds& clouds, AtmosphereResources resourceHandles, CloudResources cloudResources, RenderResource cameraBuffer,
-	RenderResource depthStencil, RenderResource outputHDR, entt::registry& registry)
+void Atmosphere::Render(RenderGraph& graph, Clouds& clouds, AtmosphereResources resourceHandles, CloudResources cloudResources, const VolumetricFog& volumetricFog,
+	RenderResource fogResource, RenderResource cameraBuffer, RenderResource depthStencil, RenderResource outputHDR, entt::registry& registry)
 {
+	if (lutReadback && Renderer::Get().GetAppFrame() >= lutReadback->readyFrame)
+	{
+		SaveLutCache();
+	}
+
 	if (dirty)
 	{
-		auto& precomputePass = graph.AddPass("Atmosphere Precompute Pass", ExecutionQueue::Compute);
-		precomputePass.Write(resourceHandles.transmittanceHandle, ResourceBind::UAV);
-		precomputePass.Write(resourceHandles.scatteringHandle, ResourceBind::UAV);
-		precomputePass.Write(resourceHandles.irradianceHandle, ResourceBind::UAV);
-		precomputePass.Bind([&, resourceHandles](CommandList& list, RenderPassResources& resources)
+		// Only precompute on cache misses, which makes switching between known models instant.
+		if (!LoadLutCache())
 		{
-			Precompute(list, resources.GetTexture(resourceHandles.transmittanceHandle), resources.GetTexture(resourceHandles.scatteringHandle), resources.GetTexture(resourceHandles.irradianceHandle));			
-		});
+			auto& precomputePass = graph.AddPass("Atmosphere Precompute Pass", ExecutionQueue::Compute);
+			precomputePass.Write(resourceHandles.transmittanceHandle, ResourceBind::UAV);
+			precomputePass.Write(resourceHandles.scatteringHandle, ResourceBind::UAV);
+			precomputePass.Write(resourceHandles.irradianceHandle, ResourceBind::UAV);
+			precomputePass.Bind([&, resourceHandles](CommandList& list, RenderPassResources& resources)
+			{
+				Precompute(list, resources.GetTexture(resourceHandles.transmittanceHandle), resources.GetTexture(resourceHandles.scatteringHandle), resources.GetTexture(resourceHandles.irradianceHandle));
+
+				ReadbackLuts(list);
+			});
+		}
 
 		// Update the model buffer. The precompute step doesn't actually use this buffer, instead just using root descriptors.
 		device->GetResourceManager().Write(modelBuffer, model);
 		
 		dirty = false;
+		luminanceDirty = true;  // Next frame, the environment map renders before the precompute.
 	}
 
 	const auto solarZenithAngle = registry.get<TimeOfDayComponent>(sunLight).solarZenithAngle;
 
-	// Update the sun light entity.
-	auto& lightTransform = registry.get<TransformComponent>(sunLight);
-	lightTransform.rotation = { 0.f, solarZenithAngle + 3.14159f / 2.f, 0.f };
+	// Update the sun light entity, patched so that the renderer uploads the light.
+	registry.patch<TransformComponent>(sunLight, [&](auto& transform)
+	{
+		transform.rotation = { 0.f, solarZenithAngle + 3.14159f / 2.f, 0.f };
+	});
+
+	const bool cameraLuts = *CvarGet("atmosphereCameraLuts", int) > 0;
+
+	// Tiny dispatches that replace most of the compose's per pixel scattering lookups, keeping its cost nearly independent of resolution.
+	std::optional<CameraLutResources> cameraLutResources;
+	if (cameraLuts)
+	{
+		cameraLutResources = RenderCameraLuts(graph, resourceHandles, cameraBuffer, solarZenithAngle);
+	}
 
 	auto& composePass = graph.AddPass("Sky Atmosphere Compose Pass", ExecutionQueue::Compute);
 	composePass.Read(cameraBuffer, ResourceBind::SRV);
@@ -465,25 +718,34 @@ void Atmosphere::Render(RenderGraph& graph, Clouds& clouds, AtmosphereResources
 	composePass.Read(cloudResources.cloudsDepth, ResourceBind::SRV);
 	composePass.Read(cloudResources.cloudsVisibilityMap, ResourceBind::SRV);
 	composePass.Read(cloudResources.cloudsCirrus, ResourceBind::SRV);
-	composePass.Read(cloudResources.weather, ResourceBind::SRV);
+	composePass.Read(cloudResources.cloudShadow, ResourceBind::SRV);
 	composePass.Read(depthStencil, ResourceBind::SRV);
+	if (cameraLutResources)
+	{
+		composePass.Read(cameraLutResources->skyView, ResourceBind::SRV);
+		composePass.Read(cameraLutResources->aerialPerspectiveScattering, ResourceBind::SRV);
+		composePass.Read(cameraLutResources->aerialPerspectiveTransmittance, ResourceBind::SRV);
+	}
+	if (fogResource.id != 0)
+	{
+		composePass.Read(fogResource, ResourceBind::SRV);
+	}
 	composePass.Write(outputHDR, TextureView{}.UAV("", 0));
-	composePass.Bind([&, cameraBuffer, resourceHandles, cloudResources, depthStencil, outputHDR, solarZenithAngle](CommandList& list, RenderPassResources& resources)
+	composePass.Bind([&, cameraBuffer, resourceHandles, cloudResources, fogResource, depthStencil, outputHDR, solarZenithAngle, cameraLutResources](CommandList& list, RenderPassResources& resources)
 	{
-		const auto renderLightShafts = *CvarGet("renderLightShafts", int);
-
-		auto composeLayout = RenderPipelineLayout{}
-			.ComputeShader({ "Atmosphere/Compose", "Main" })
-			.Macro({ "RENDER_LIGHT_SHAFTS", renderLightShafts });
-
+		uint32_t permutation = 0;
+		if (*CvarGet("renderLightShafts", int) > 0)
+			permutation |= 1 << 0;
 		if (*CvarGet("farVolumetricShadowFix", int) > 0)
-			composeLayout.Macro({ "ENABLE_FAR_SHADOW_FIX" });
+			permutation |= 1 << 1;
 		if (*CvarGet("cloudDebugMarchCount", int) > 0)
-			composeLayout.Macro({ "CLOUDS_DEBUG_MARCHCOUNT" });
+			permutation |= 1 << 2;
 		if (*CvarGet("cloudDebugTransmittance", int) > 0)
-			composeLayout.Macro({ "CLOUDS_DEBUG_TRANSMITTANCE" });
+			permutation |= 1 << 3;
+		if (cameraLutResources)
+			permutation |= 1 << 4;
 
-		list.BindPipeline(composeLayout);
+		list.BindPipeline(composeLayout.Permutation(permutation));
 
 		struct {
 			uint32_t cameraBuffer;
@@ -493,7 +755,7 @@ void Atmosphere::Render(RenderGraph& graph, Clouds& clouds, AtmosphereResources
 			uint32_t cloudsDepthTexture;
 			uint32_t cloudsVisibilityTexture;
 			uint32_t cloudsCirrusTexture;
-			uint32_t weatherTexture;
+			uint32_t cloudShadowTexture;
 			uint32_t geometryDepthTexture;
 			uint32_t outputTexture;
 			uint32_t transmissionTexture;
@@ -503,6 +765,11 @@ void Atmosphere::Render(RenderGraph& graph, Clouds& clouds, AtmosphereResources
 			float globalWeatherCoverage;
 			float time;
 			XMFLOAT2 wind;
+			uint32_t skyViewTexture;
+			uint32_t aerialPerspectiveScatteringTexture;
+			uint32_t aerialPerspectiveTransmittanceTexture;
+			float padding[3];
+			FogData fogData;
 		} bindData;
 
 		bindData.cameraBuffer = resources.Get(cameraBuffer);
@@ -512,7 +779,7 @@ void Atmosphere::Render(RenderGraph& graph, Clouds& clouds, AtmosphereResources
 		bindData.cloudsDepthTexture = resources.Get(cloudResources.cloudsDepth);
 		bindData.cloudsVisibilityTexture = resources.Get(cloudResources.cloudsVisibilityMap);
 		bindData.cloudsCirrusTexture = resources.Get(cloudResources.cloudsCirrus);
-		bindData.weatherTexture = resources.Get(cloudResources.weather);
+		bindData.cloudShadowTexture = resources.Get(cloudResources.cloudShadow);
 		bindData.geometryDepthTexture = resources.Get(depthStencil);
 		bindData.outputTexture = resources.Get(outputHDR, "");
 		bindData.transmissionTexture = resources.Get(resourceHandles.transmittanceHandle);
@@ -522,6 +789,10 @@ void Atmosphere::Render(RenderGraph& graph, Clouds& clouds, AtmosphereResources
 		bindData.globalWeatherCoverage = clouds.coverage;
 		bindData.time = Renderer::Get().GetAppTime();
 		bindData.wind = { clouds.windDirection.x * clouds.windStrength, clouds.windDirection.y * clouds.windStrength };
+		bindData.skyViewTexture = cameraLutResources ? resources.Get(cameraLutResources->skyView) : 0;
+		bindData.aerialPerspectiveScatteringTexture = cameraLutResources ? resources.Get(cameraLutResources->aerialPerspectiveScattering) : 0;
+		bindData.aerialPerspectiveTransmittanceTexture = cameraLutResources ? resources.Get(cameraLutResources->aerialPerspectiveTransmittance) : 0;
+		bindData.fogData = volumetricFog.GetFogData(resources, fogResource);
 
 		list.BindConstants("bindData", bindData);
 
@@ -533,24 +804,106 @@ void Atmosphere::Render(RenderGraph& graph, Clouds& clouds, AtmosphereResources
 	});
 }
 
-std::pair<RenderResource, RenderResource> Atmosphere::RenderEnvironmentMap(RenderGraph& graph, AtmosphereResources resourceHandles, RenderResource cameraBuffer,
-	entt::registry& registry)
+Atmosphere::CameraLutResources Atmosphere::RenderCameraLuts(RenderGraph& graph, AtmosphereResources resourceHandles, RenderResource cameraBuffer, float solarZenithAngle)
+{
+	auto& lutPass = graph.AddPass("Atmosphere Camera LUTs Pass", ExecutionQueue::Compute);
+	const auto skyViewTag = lutPass.Create(TransientTextureDescription{
+		.width = skyViewWidth,
+		.height = skyViewHeight,
+		.depth = 1,
+		.format = DXGI_FORMAT_R16G16B16A16_FLOAT
+	}, VGText("Atmosphere sky view LUT"));
+	const auto aerialPerspectiveScatteringTag = lutPass.Create(TransientTextureDescription{
+		.width = aerialPerspectiveSize,
+		.height = aerialPerspectiveSize,
+		.depth = aerialPerspectiveSize,
+		.format = DXGI_FORMAT_R16G16B16A16_FLOAT
+	}, VGText("Atmosphere aerial perspective scattering"));
+	const auto aerialPerspectiveTransmittanceTag = lutPass.Create(TransientTextureDescription{
+		.width = aerialPerspectiveSize,
+		.height = aerialPerspectiveSize,
+		.depth = aerialPerspectiveSize,
+		.format = DXGI_FORMAT_R16G16B16A16_FLOAT
+	}, VGText("Atmosphere aerial perspective transmittance"));
+	lutPass.Read(cameraBuffer, ResourceBind::SRV);
+	lutPass.Read(resourceHandles.modelHandle, ResourceBind::SRV);
+	lutPass.Read(resourceHandles.transmittanceHandle, ResourceBind::SRV);
+	lutPass.Read(resourceHandles.scatteringHandle, ResourceBind::SRV);
+	lutPass.Write(skyViewTag, TextureView{}.UAV("", 0));
+	lutPass.Write(aerialPerspectiveScatteringTag, TextureView{}.UAV("", 0));
+	lutPass.Write(aerialPerspectiveTransmittanceTag, TextureView{}.UAV("", 0));
+	lutPass.Bind([&, cameraBuffer, resourceHandles, solarZenithAngle, skyViewTag, aerialPerspectiveScatteringTag, aerialPerspectiveTransmittanceTag](CommandList& list, RenderPassResources& resources)
+	{
+		struct {
+			uint32_t cameraBuffer;
+			uint32_t cameraIndex;
+			uint32_t atmosphereBuffer;
+			uint32_t transmissionTexture;
+			uint32_t scatteringTexture;
+			float solarZenithAngle;
+			uint32_t skyViewTexture;
+			uint32_t aerialPerspectiveScatteringTexture;
+			uint32_t aerialPerspectiveTransmittanceTexture;
+		} bindData;
+
+		bindData.cameraBuffer = resources.Get(cameraBuffer);
+		bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
+		bindData.atmosphereBuffer = resources.Get(resourceHandles.modelHandle);
+		bindData.transmissionTexture = resources.Get(resourceHandles.transmittanceHandle);
+		bindData.scatteringTexture = resources.Get(resourceHandles.scatteringHandle);
+		bindData.solarZenithAngle = solarZenithAngle;
+		bindData.skyViewTexture = resources.Get(skyViewTag);
+		bindData.aerialPerspectiveScatteringTexture = resources.Get(aerialPerspectiveScatteringTag);
+		bindData.aerialPerspectiveTransmittanceTexture = resources.Get(aerialPerspectiveTransmittanceTag);
+
+		list.BindPipeline(skyViewLayout);
+		list.BindConstants("bindData", bindData);
+		list.Dispatch((skyViewWidth + 7) / 8, (skyViewHeight + 7) / 8, 1);
+
+		list.BindPipeline(aerialPerspectiveLayout);
+		list.BindConstants("bindData", bindData);
+		list.Dispatch(aerialPerspectiveSize / 4, aerialPerspectiveSize / 4, aerialPerspectiveSize / 4);
+	});
+
+	return { skyViewTag, aerialPerspectiveScatteringTag, aerialPerspectiveTransmittanceTag };
+}
+
+EnvironmentMapResources Atmosphere::RenderEnvironmentMap(RenderGraph& graph, AtmosphereResources resourceHandles, RenderResource cameraBuffer,
+	entt::registry& registry, bool holdLuminance)
 {
 	const auto luminanceTag = graph.Import(luminanceTexture);
 
 	const auto solarZenithAngle = registry.get<TimeOfDayComponent>(sunLight).solarZenithAngle;
 
+	// The sun normally moves slowly enough to hide the latency of time slicing, but not for sudden changes.
+	const auto fullRefresh = luminanceDirty || std::abs(solarZenithAngle - luminanceSolarZenithAngle) > solarZenithJump;
+	// Steps are spread over the update period, the luminance map is held on the frames in between.
+	luminanceFrame = (luminanceFrame + 1) % static_cast<uint32_t>(std::max(*CvarGet("environmentUpdatePeriod", int), 1));
+	const auto hold = (holdLuminance || luminanceFrame != 0) && !fullRefresh;
+	const auto step = fullRefresh ? 0 : luminanceStep;
+
+	luminanceDirty = false;
+	luminanceSolarZenithAngle = solarZenithAngle;
+
 	TextureView luminanceView{};
 	luminanceView.UAV("", 0);
+	luminanceView.Mips(0);  // Mipmaps are generated within the pass.
 
-	auto& luminancePass = graph.AddPass("Atmosphere Luminance Pass", ExecutionQueue::Compute);
+	auto& luminancePass = graph.AddPass("Atmosphere Luminance Pass", ExecutionQueue::Compute, !hold);
 	luminancePass.Read(cameraBuffer, ResourceBind::SRV);
 	luminancePass.Read(resourceHandles.transmittanceHandle, ResourceBind::SRV);
 	luminancePass.Read(resourceHandles.scatteringHandle, ResourceBind::SRV);
 	luminancePass.Read(resourceHandles.irradianceHandle, ResourceBind::SRV);
 	luminancePass.Write(luminanceTag, luminanceView);
-	luminancePass.Bind([&, cameraBuffer, resourceHandles, luminanceTag, solarZenithAngle](CommandList& list, RenderPassResources& resources)
+	luminancePass.Bind([&, cameraBuffer, resourceHandles, luminanceTag, solarZenithAngle, fullRefresh, step](CommandList& list, RenderPassResources& resources)
 	{
+		// The last step only generates mips.
+		if (!fullRefresh && step == luminanceSteps - 1)
+		{
+			device->GetResourceManager().GenerateMipmaps(list, luminanceTexture);
+			return;
+		}
+
 		struct BindData
 		{
 			AtmosphereData atmosphere;
@@ -561,6 +914,7 @@ std::pair<RenderResource, RenderResource> Atmosphere::RenderEnvironmentMap(Rende
 			uint32_t luminanceTexture;
 			uint32_t cameraBuffer;
 			uint32_t cameraIndex;
+			uint32_t cubeFace;
 		} bindData;
 
 		bindData.atmosphere = model;
@@ -571,18 +925,28 @@ std::pair<RenderResource, RenderResource> Atmosphere::RenderEnvironmentMap(Rende
 		bindData.luminanceTexture = resources.Get(luminanceTag);
 		bindData.cameraBuffer = resources.Get(cameraBuffer);
 		bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
+		bindData.cubeFace = fullRefresh ? 0 : step;
 
 		list.BindPipeline(luminancePrecomputeLayout);
 		list.BindConstants("bindData", bindData);
 
-		list.Dispatch(luminanceTextureSize / 8, luminanceTextureSize / 8, 6);
+		list.Dispatch(luminanceTextureSize / 8, luminanceTextureSize / 8, fullRefresh ? 6 : 1);
 
-		list.UAVBarrier(luminanceTexture);
-		list.FlushBarriers();
+		if (fullRefresh)
+		{
+			list.UAVBarrier(luminanceTexture);
+			list.FlushBarriers();
 
-		device->GetResourceManager().GenerateMipmaps(list, luminanceTexture);
+			device->GetResourceManager().GenerateMipmaps(list, luminanceTexture);
+		}
 	});
 
+	const auto luminanceUpdated = fullRefresh || (!hold && step == luminanceSteps - 1);
+	if (!hold)
+	{
+		luminanceStep = luminanceUpdated ? 0 : step + 1;
+	}
+
 	auto& irradiancePass = graph.AddPass("Atmosphere Separable Irradiance Pass", ExecutionQueue::Compute);
 	irradiancePass.Read(cameraBuffer, ResourceBind::SRV);
 	irradiancePass.Read(resourceHandles.transmittanceHandle, ResourceBind::SRV);
@@ -623,5 +987,5 @@ std::pair<RenderResource, RenderResource> Atmosphere::RenderEnvironmentMap(Rende
 		list.Dispatch(1, 1, 1);
 	});
 
-	return std::make_pair(luminanceTag, separableIrradiance);
+	return { luminanceTag, separableIrradiance, luminanceUpdated, fullRefresh };
 }
\ No newline at end of file
@@ -7,10 +7,15 @@
 #include <Rendering/RenderGraphResource.h>
 #include <Rendering/RenderPipeline.h>
 #include <Rendering/Clouds.h>
+#include <Rendering/VolumetricFog.h>
+#include <Utility/ResourcePtr.h>
 
 #include <entt/entt.hpp>
+#include <D3D12MemAlloc.h>
+
+#include <filesystem>
+#include <optional>
 
-#include <utility>
 
 class PipelineBuilder;
 class RenderDevice;
@@ -63,16 +68,25 @@ struct AtmosphereResources
 	RenderResource irradianceHandle;
 };
 
+struct EnvironmentMapResources
+{
+	RenderResource luminanceTexture;
+	RenderResource separableIrradiance;
+	bool luminanceUpdated;  // The time sliced luminance map was completed this frame.
+	bool fullRefresh;  // Completed within this frame, consumers should fully refresh as well.
+};
+
 class Atmosphere
 {
 public:
-	AtmosphereData model;
+	AtmosphereData model{};  // Value initialized, the padding is part of the LUT cache key.
 	entt::entity sunLight;  // Directional light entity for direct solar illumination.
 
 private:
 	RenderDevice* device = nullptr;
 
 	bool dirty = true;  // Needs to recompute LUTs.
+	bool fullPrecisionLuts = false;  // Validation mode, stored as 32-bit instead of 16-bit floats.
 	TextureHandle transmittanceTexture;
 	TextureHandle scatteringTexture;
 	TextureHandle irradianceTexture;
@@ -90,27 +104,78 @@ private:
 	RenderPipelineLayout multipleScatteringPrecomputeLayout;
 
 	void Precompute(CommandList& list, TextureHandle transmittanceHandle, TextureHandle scatteringHandle, TextureHandle irradianceHandle);
+	// (Re)creates the LUTs in the current precision, they need to be precomputed again.
+	void CreateLuts();
+
+	// Precomputed LUTs are cached on disk, keyed by a hash of the model. Cache misses read the LUTs back after precomputing.
+	static constexpr uint32_t lutCacheVersion = 1;  // Increment when the precompute shaders change.
+
+	struct LutReadback
+	{
+		ResourcePtr<D3D12MA::Allocation> allocation;
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprints[3];  // Transmittance, scattering, irradiance.
+		size_t modelHash;
+		uint32_t readyFrame;  // The copy's frame has retired.
+	};
+
+	std::optional<LutReadback> lutReadback;
+
+	size_t HashModel() const;
+	std::filesystem::path GetLutCachePath(size_t modelHash) const;
+	bool LoadLutCache();
+	void ReadbackLuts(CommandList& list);
+	void SaveLutCache();
 
 	// Storing the atmosphere model data in root descriptors is too expensive and doesn't leave sufficient space for other data,
 	// so cache it in a buffer and pass that around instead.
 	BufferHandle modelBuffer;
 
 	RenderPipelineLayout separableIrradianceLayout;
+	RenderPipelineLayout composeLayout;
+
+	// Sizes must match Atmosphere/CameraLuts.hlsli.
+	static constexpr uint32_t skyViewWidth = 192;
+	static constexpr uint32_t skyViewHeight = 108;
+	static constexpr uint32_t aerialPerspectiveSize = 32;  // Froxels in each dimension.
+	static_assert(aerialPerspectiveSize % 4 == 0, "aerialPerspectiveSize must be evenly divisible by 4.");
+
+	RenderPipelineLayout skyViewLayout;
+	RenderPipelineLayout aerialPerspectiveLayout;
+
+	struct CameraLutResources
+	{
+		RenderResource skyView;
+		RenderResource aerialPerspectiveScattering;
+		RenderResource aerialPerspectiveTransmittance;
+	};
+
+	// Sky view and aerial perspective of the current camera, for the compose.
+	CameraLutResources RenderCameraLuts(RenderGraph& graph, AtmosphereResources resourceHandles, RenderResource cameraBuffer, float solarZenithAngle);
 
 	static constexpr uint32_t luminanceTextureSize = 1024;
 	static_assert(luminanceTextureSize % 8 == 0, "luminanceTextureSize must be evenly divisible by 8.");
 
+	// The luminance map is updated over several frames, one cube face per frame followed by the mip chain.
+	static constexpr uint32_t luminanceSteps = 7;
+	static constexpr float solarZenithJump = 0.02f;  // Radians per frame that force a full refresh.
+
 	TextureHandle luminanceTexture;
 	RenderPipelineLayout luminancePrecomputeLayout;
+	uint32_t luminanceStep = 0;
+	uint32_t luminanceFrame = 0;  // Within the update period.
+	float luminanceSolarZenithAngle = 0.f;  // Previous frame's, to detect jumps.
+	bool luminanceDirty = true;  // LUTs were recomputed, requires a full refresh.
 
 public:
 	~Atmosphere();
 	void Initialize(RenderDevice* inDevice, entt::registry& registry);
 
 	AtmosphereResources ImportResources(RenderGraph& graph);
-	void Render(RenderGraph& graph, Clouds& clouds, AtmosphereResources resourceHandles, CloudResources cloudResources, RenderResource cameraBuffer,
-		RenderResource depthStencil, RenderResource outputHDRs, entt::registry& registry);
-	std::pair<RenderResource, RenderResource> RenderEnvironmentMap(RenderGraph& graph, AtmosphereResources resourceHandles, RenderResource cameraBuffer,
-		entt::registry& registry);
+	// Composes the sky, clouds and volumetric fog over the lit geometry. The fog resource is unused when its id is zero.
+	void Render(RenderGraph& graph, Clouds& clouds, AtmosphereResources resourceHandles, CloudResources cloudResources, const VolumetricFog& volumetricFog,
+		RenderResource fogResource, RenderResource cameraBuffer, RenderResource depthStencil, RenderResource outputHDRs, entt::registry& registry);
+	// Holding keeps the completed luminance map intact while a time sliced consumer is still reading it.
+	EnvironmentMapResources RenderEnvironmentMap(RenderGraph& graph, AtmosphereResources resourceHandles, RenderResource cameraBuffer,
+		entt::registry& registry, bool holdLuminance);
 	void MarkModelDirty() { dirty = true; }
 };
\ No newline at end of file
@@ -0,0 +1,28 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// FNV-1a, evaluated at compile time for bind names.
+constexpr uint32_t HashBindName(std::string_view name)
+{
+	uint32_t hash = 2166136261u;
+	for (const auto character : name)
+	{
+		hash ^= static_cast<uint8_t>(character);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+// Shader bind name hashed at compile time, resolved against a pipeline's reflected binds without string comparisons.
+struct BindSlot
+{
+	uint32_t hash;
+	std::string_view name;  // Only for diagnostics.
+
+	consteval BindSlot(const char* inName) : hash(HashBindName(inName)), name(inName) {}
+};
\ No newline at end of file
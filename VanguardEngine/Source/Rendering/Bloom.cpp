@@ -6,6 +6,7 @@
 #include <Rendering/RenderGraphResourceManager.h>
 #include <Rendering/Device.h>
 #include <Rendering/CommandList.h>
+#include <Core/ConsoleVariable.h>
 
 #include <vector>
 #include <string>
@@ -23,64 +24,76 @@ void Bloom::Initialize(RenderDevice* inDevice)
 
 	upsampleLayout = RenderPipelineLayout{}
 		.ComputeShader({ "Bloom/Upsample.hlsl", "Main" });
+
+	CvarCreate("bloomMipCount", "Downsamples of the bloom chain, fewer are cheaper but narrow the glow", 6);
 }
 
-void Bloom::Render(RenderGraph& graph, const RenderResource hdrSource)
+RenderResource Bloom::Render(RenderGraph& graph, const RenderResource hdrSource)
 {
-	auto& extractPass = graph.AddPass("Bloom Extract Pass", ExecutionQueue::Compute);
-	extractPass.Read(hdrSource, ResourceBind::SRV);
-	const auto extractTexture = extractPass.Create(TransientTextureDescription{
+	const auto bloomDownsamples = *CvarGet("bloomMipCount", int);
+	const auto [width, height] = graph.GetOutputResolution(device);
+	const auto mipLevels = (int)std::floor(std::log2(std::max(width, height)));
+	bloomPasses = std::max(std::min(bloomDownsamples, mipLevels - 1), 1);
+
+	// Extraction writes mip 0 and mip 1, the downsamples start from mip 1.
+	TextureView downsampleExtractView{};
+	downsampleExtractView.UAV("uav_extract", 0);
+	std::vector<std::pair<std::string, std::string>> downsampleExtractViewNames;
+	downsampleExtractViewNames.resize(bloomPasses);
+	for (int i = 0; i < bloomPasses; ++i)
+	{
+		downsampleExtractViewNames[i] = std::make_pair(std::string{ "srv_" } + std::to_string(i), std::string{ "uav_" } + std::to_string(i));
+		if (i > 0)
+		{
+			downsampleExtractView.SRV(downsampleExtractViewNames[i].first, i, 1);  // The input mip acts as the base level.
+		}
+		downsampleExtractView.UAV(downsampleExtractViewNames[i].second, i + 1);
+	}
+
+	// Extraction and all downsamples share a pass, avoiding the graph's barriers between them.
+	auto& downsamplePass = graph.AddPass("Bloom Downsample Pass", ExecutionQueue::Compute);
+	downsamplePass.Read(hdrSource, ResourceBind::SRV);
+	const auto extractTexture = downsamplePass.Create(TransientTextureDescription{
 		.width = 0,
 		.height = 0,
 		.resolutionScale = 0.5f,
 		.format = DXGI_FORMAT_R11G11B10_FLOAT,
 		.mipMapping = true
 	}, VGText("Bloom extraction output"));
-	extractPass.Write(extractTexture, TextureView{}
-		.UAV("", 0));
-	extractPass.Bind([&, hdrSource, extractTexture](CommandList& list, RenderPassResources& resources)
+	downsamplePass.Write(extractTexture, downsampleExtractView);
+	downsamplePass.Bind([this, hdrSource, extractTexture, downsampleExtractViewNames](CommandList& list, RenderPassResources& resources)
 	{
-		list.BindPipeline(extractLayout);
+		auto& extractTextureComponent = device->GetResourceManager().Get(resources.GetTexture(extractTexture));
 
-		struct BindData
 		{
-			uint32_t inputTexture;
-			uint32_t outputTexture;
-		} bindData;
+			VGScopedGPUStat("Extract and downsample pass 1", device->GetQueueContext(list.Type()), list.Native());
 
-		bindData.inputTexture = resources.Get(hdrSource);
-		bindData.outputTexture = resources.Get(extractTexture);
-		list.BindConstants("bindData", bindData);
+			list.BindPipeline(extractLayout);
 
-		const auto& extractTextureComponent = device->GetResourceManager().Get(resources.GetTexture(extractTexture));
-		uint32_t dispatchX = std::ceil(extractTextureComponent.description.width / 8.f);
-		uint32_t dispatchY = std::ceil(extractTextureComponent.description.height / 8.f);
+			struct BindData
+			{
+				uint32_t inputTexture;
+				uint32_t outputTexture;
+				uint32_t downsampleTexture;
+				uint32_t padding;
+			} bindData;
 
-		list.Dispatch(dispatchX, dispatchY, 1);
-	});
+			bindData.inputTexture = resources.Get(hdrSource);
+			bindData.outputTexture = resources.Get(extractTexture, "uav_extract");
+			bindData.downsampleTexture = resources.Get(extractTexture, downsampleExtractViewNames[0].second);
+			list.BindConstants("bindData", bindData);
 
-	constexpr auto bloomDownsamples = 6;
-	const auto [width, height] = graph.GetBackBufferResolution(device);
-	const auto mipLevels = (int)std::floor(std::log2(std::max(width, height)));
-	bloomPasses = std::min(bloomDownsamples, mipLevels - 1);
+			// Each group owns 16x16 texels of mip 0.
+			uint32_t dispatchX = std::ceil(extractTextureComponent.description.width / 16.f);
+			uint32_t dispatchY = std::ceil(extractTextureComponent.description.height / 16.f);
 
-	TextureView downsampleExtractView{};
-	std::vector<std::pair<std::string, std::string>> downsampleExtractViewNames;
-	downsampleExtractViewNames.resize(bloomPasses);
-	for (int i = 0; i < bloomPasses; ++i)
-	{
-		downsampleExtractViewNames[i] = std::make_pair(std::string{ "srv_" } + std::to_string(i), std::string{ "uav_" } + std::to_string(i));
-		downsampleExtractView.SRV(downsampleExtractViewNames[i].first, i, 1);  // The input mip acts as the base level.
-		downsampleExtractView.UAV(downsampleExtractViewNames[i].second, i + 1);
-	}
+			list.Dispatch(dispatchX, dispatchY, 1);
 
-	auto& downsamplePass = graph.AddPass("Bloom Downsample Pass", ExecutionQueue::Compute);
-	downsamplePass.Write(extractTexture, downsampleExtractView);
-	downsamplePass.Bind([this, extractTexture, downsampleExtractViewNames](CommandList& list, RenderPassResources& resources)
-	{
-		list.BindPipeline(downsampleLayout);
+			list.UAVBarrier(resources.GetTexture(extractTexture));
+			list.FlushBarriers();
+		}
 
-		auto& extractTextureComponent = device->GetResourceManager().Get(resources.GetTexture(extractTexture));
+		list.BindPipeline(downsampleLayout);
 
 		struct BindData
 		{
@@ -88,10 +101,10 @@ void Bloom::Render(RenderGraph& graph, const RenderResource hdrSource)
 			uint32_t outputTexture;
 		} bindData;
 
-		for (int i = 0; i < bloomPasses; ++i)
+		for (int i = 1; i < bloomPasses; ++i)
 		{
 			std::string zoneName = "Downsample pass " + std::to_string(i + 1);
-			VGScopedGPUTransientStat(zoneName.c_str(), device->GetDirectContext(), list.Native());
+			VGScopedGPUTransientStat(zoneName.c_str(), device->GetQueueContext(list.Type()), list.Native());
 
 			bindData.inputTexture = resources.Get(extractTexture, downsampleExtractViewNames[i].first);
 			bindData.outputTexture = resources.Get(extractTexture, downsampleExtractViewNames[i].second);
@@ -108,26 +121,24 @@ void Bloom::Render(RenderGraph& graph, const RenderResource hdrSource)
 		}
 	});
 
+	// Mip 0 is never written by the upsamples, the post process composition blends it in directly.
 	TextureView upsampleExtractView{};
 	upsampleExtractView.SRV("srv");
 	std::vector<std::string> upsampleExtractViewNames;
-	upsampleExtractViewNames.resize(bloomPasses);
-	for (int i = 0; i < bloomPasses; ++i)
+	upsampleExtractViewNames.resize(bloomPasses - 1);
+	for (int i = 0; i < bloomPasses - 1; ++i)
 	{
 		upsampleExtractViewNames[i] = std::string{ "uav_" } + std::to_string(i);
 		upsampleExtractView.UAV(upsampleExtractViewNames[i], bloomPasses - i - 1);  // Write to the prior mip.
 	}
 
-	auto& compositionPass = graph.AddPass("Bloom Upsample Pass", ExecutionQueue::Compute);
-	compositionPass.Read(extractTexture, upsampleExtractView);
-	compositionPass.Write(hdrSource, TextureView{}
-		.UAV("", 0));
-	compositionPass.Bind([this, extractTexture, hdrSource, upsampleExtractViewNames](CommandList& list, RenderPassResources& resources)
+	auto& upsamplePass = graph.AddPass("Bloom Upsample Pass", ExecutionQueue::Compute);
+	upsamplePass.Read(extractTexture, upsampleExtractView);
+	upsamplePass.Bind([this, extractTexture, upsampleExtractViewNames](CommandList& list, RenderPassResources& resources)
 	{
 		list.BindPipeline(upsampleLayout);
 
 		auto& extractTextureComponent = device->GetResourceManager().Get(resources.GetTexture(extractTexture));
-		auto& hdrTextureComponent = device->GetResourceManager().Get(resources.GetTexture(hdrSource));
 
 		struct BindData
 		{
@@ -135,15 +146,15 @@ void Bloom::Render(RenderGraph& graph, const RenderResource hdrSource)
 			uint32_t inputMip;
 			uint32_t outputTexture;
 			float intensity;
-		} bindData;
+		} bindData{};
 
 		bindData.inputTexture = resources.Get(extractTexture, "srv");
 		bindData.intensity = internalBlend;
 
-		for (int i = 0; i < bloomPasses; ++i)
+		for (int i = 0; i < bloomPasses - 1; ++i)
 		{
 			std::string zoneName = "Upsample pass " + std::to_string(i + 1);
-			VGScopedGPUTransientStat(zoneName.c_str(), device->GetDirectContext(), list.Native());
+			VGScopedGPUTransientStat(zoneName.c_str(), device->GetQueueContext(list.Type()), list.Native());
 
 			bindData.inputMip = bloomPasses - i;
 			bindData.outputTexture = resources.Get(extractTexture, upsampleExtractViewNames[i]);
@@ -158,17 +169,7 @@ void Bloom::Render(RenderGraph& graph, const RenderResource hdrSource)
 			list.UAVBarrier(resources.GetTexture(extractTexture));
 			list.FlushBarriers();
 		}
-
-		VGScopedGPUStat("Upsample composition", device->GetDirectContext(), list.Native());
-
-		bindData.inputMip = 0;
-		bindData.outputTexture = resources.Get(hdrSource);
-		bindData.intensity = intensity;
-		list.BindConstants("bindData", bindData);
-
-		uint32_t dispatchX = std::ceil(hdrTextureComponent.description.width / 8.f);
-		uint32_t dispatchY = std::ceil(hdrTextureComponent.description.height / 8.f);
-
-		list.Dispatch(dispatchX, dispatchY, 1);
 	});
+
+	return extractTexture;
 }
\ No newline at end of file
@@ -29,5 +29,6 @@ public:
 
 public:
 	void Initialize(RenderDevice* inDevice);
-	void Render(RenderGraph& graph, const RenderResource hdrSource);
+	// Returns the bloom texture, mip 0 and mip 1 are composited by the post process pass.
+	RenderResource Render(RenderGraph& graph, const RenderResource hdrSource);
 };
\ No newline at end of file
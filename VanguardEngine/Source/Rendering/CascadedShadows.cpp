@@ -0,0 +1,394 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/CascadedShadows.h>
+#include <Rendering/Device.h>
+#include <Rendering/Renderer.h>
+#include <Rendering/RenderSystems.h>
+#include <Rendering/RenderGraph.h>
+#include <Rendering/RenderPass.h>
+#include <Core/ConsoleVariable.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace
+{
+	constexpr float splitLambda = 0.8f;  // Blend of logarithmic and uniform splits, logarithmic favors the near cascades.
+	constexpr float cachePadding = 1.25f;  // Cached cascades cover more than their slice, so the view can move before they render again.
+	constexpr float casterDistance = 200.f;  // Distance towards the sun beyond a cascade's bounds that casters are kept, in meters.
+}
+
+namespace
+{
+	// Cascades are orthographic, so depth is linear and 16 bits are usually enough at half the bandwidth.
+	DXGI_FORMAT GetAtlasFormat()
+	{
+		return *CvarGet("shadowDepthFormat", int) > 0 ? DXGI_FORMAT_R16_TYPELESS : DXGI_FORMAT_R32_TYPELESS;
+	}
+}
+
+void CascadedShadows::CreateAtlas(uint32_t resolution, DXGI_FORMAT format)
+{
+	if (device->GetResourceManager().Valid(atlas))
+	{
+		device->GetResourceManager().Destroy(atlas);
+	}
+
+	TextureDescription atlasDesc{
+		.bindFlags = BindFlag::DepthStencil | BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::GPUWrite,
+		.width = resolution * 2,
+		.height = resolution * 2,
+		.depth = 1,
+		.format = format,  // Typeless for both the depth and shader resource views.
+		.mipMapping = false
+	};
+
+	atlas = device->GetResourceManager().Create(atlasDesc, VGText("Cascaded shadow atlas"));
+	cascadeResolution = resolution;
+	atlasFormat = format;
+	invalidated = true;
+}
+
+CascadedShadows::~CascadedShadows()
+{
+	if (device->GetResourceManager().Valid(atlas))
+	{
+		device->GetResourceManager().Destroy(atlas);
+	}
+}
+
+void CascadedShadows::Initialize(RenderDevice* inDevice)
+{
+	device = inDevice;
+
+	CvarCreate("shadows", "Sun shadow technique. 0=off, 1=cascaded, 2=virtual, 3=ray traced, which falls back to off without ray tracing support", 1);
+	CvarCreate("shadowResolution", "Resolution of each shadow cascade", 2048);
+	CvarCreate("shadowDepthFormat", "Depth format of the shadow cascades, 0=32 bit float, 1=16 bit unorm", 0);
+	CvarCreate("shadowDistance", "View distance covered by the shadow cascades, in meters", 300.f);
+	CvarCreate("shadowCascadeCaching", "Reuses the far shadow cascades until the view leaves their bounds or the scene changes", 1);
+	CvarCreate("shadowNormalOffset", "Offsets shadow lookups along the surface normal, in shadow map texels", 1.5f);
+
+	cullResetLayout = RenderPipelineLayout{}
+		.ComputeShader({ "MeshCulling", "ResetMain" });
+
+	cullLayout = RenderPipelineLayout{}
+		.ComputeShader({ "MeshCulling", "ShadowMain" });
+
+	// Depth only. Biased away from the sun, inverse Z. Casters in front of the near plane are clamped instead of clipped.
+	depthLayout = RenderPipelineLayout{}
+		.VertexShader({ "Prepass", "VSMain" })
+		.DepthEnabled(true, true)
+		.DepthBias(-2, -2.f)
+		.DepthClip(false);
+
+	CreateAtlas(static_cast<uint32_t>(*CvarGet("shadowResolution", int)), GetAtlasFormat());
+}
+
+void CascadedShadows::Update(const XMMATRIX& view, const XMMATRIX& projection, float nearPlane, float farPlane, const XMVECTOR& sunDirection,
+	const XMVECTOR& sunUpward, FrameVector<Camera>& cameras)
+{
+	VGAssert(cameras.size() == firstCameraIndex, "Cascade cameras must follow the existing cameras.");
+
+	const auto resolution = static_cast<uint32_t>(std::max(*CvarGet("shadowResolution", int), 64));
+	if (const auto format = GetAtlasFormat(); resolution != cascadeResolution || format != atlasFormat)
+	{
+		CreateAtlas(resolution, format);
+	}
+
+	XMFLOAT3 sun;
+	XMStoreFloat3(&sun, XMVector3Normalize(sunDirection));
+	const auto sunMoved = sun.x * lastSunDirection.x + sun.y * lastSunDirection.y + sun.z * lastSunDirection.z < 0.99999f;
+	lastSunDirection = sun;
+
+	const auto enabled = *CvarGet("shadows", int) == 1;
+	const auto caching = *CvarGet("shadowCascadeCaching", int) > 0;
+	const auto shadowDistance = std::clamp(*CvarGet("shadowDistance", float), nearPlane + 1.f, farPlane);
+
+	// Practical split scheme, distances are positive view depths.
+	for (uint32_t i = 0; i < cascadeCount; ++i)
+	{
+		const auto fraction = static_cast<float>(i + 1) / cascadeCount;
+		const auto logarithmic = nearPlane * std::pow(shadowDistance / nearPlane, fraction);
+		const auto uniform = nearPlane + (shadowDistance - nearPlane) * fraction;
+		splits[i] = splitLambda * logarithmic + (1.f - splitLambda) * uniform;
+	}
+
+	// Slice cross sections grow with the tangents of the view's half angles.
+	const auto tanX = 1.f / XMVectorGetX(projection.r[0]);
+	const auto tanY = 1.f / XMVectorGetY(projection.r[1]);
+	const auto tanSquared = tanX * tanX + tanY * tanY;
+
+	const auto inverseView = XMMatrixInverse(nullptr, view);
+	const auto viewPosition = inverseView.r[3];
+	const auto viewForward = XMVectorNegate(inverseView.r[2]);  // Right handed, looking down negative Z.
+
+	const auto lightView = XMMatrixLookToRH(XMVectorZero(), sunDirection, sunUpward);
+	const auto inverseLightView = XMMatrixInverse(nullptr, lightView);
+
+	for (uint32_t i = 0; i < cascadeCount; ++i)
+	{
+		auto& cascade = cascades[i];
+
+		// Nothing is rendered while disabled, so the atlas is stale once shadows are enabled again.
+		if (!enabled)
+		{
+			cascade.valid = false;
+			pendingCascades[i] = false;
+
+			continue;
+		}
+
+		const auto sliceNear = i == 0 ? nearPlane : splits[i - 1];
+		const auto sliceFar = splits[i];
+
+		// Smallest sphere containing the slice, independent of the view's rotation.
+		const auto centerDistance = std::min((sliceNear + sliceFar) * (1.f + tanSquared) * 0.5f, sliceFar);
+		const auto offset = sliceFar - centerDistance;
+		auto radius = std::sqrt(offset * offset + sliceFar * sliceFar * tanSquared);
+		radius = std::ceil(radius * 16.f) / 16.f;  // Rounding avoids the extent flickering with precision.
+
+		XMFLOAT3 center;
+		XMStoreFloat3(&center, XMVector3Transform(viewPosition + viewForward * centerDistance, lightView));
+
+		const auto cached = caching && i >= firstCachedCascade;
+		if (cached && cascade.valid && !invalidated && !sunMoved)
+		{
+			const auto reach = std::max({ std::abs(center.x - cascade.center.x), std::abs(center.y - cascade.center.y), std::abs(center.z - cascade.center.z) });
+			if (reach + radius <= cascade.extent)
+			{
+				pendingCascades[i] = false;
+
+				continue;
+			}
+		}
+
+		cascade.extent = cached ? radius * cachePadding : radius;
+
+		// Snap to whole texels, so that moving the view only shifts the rasterized depth by whole texels.
+		const auto texelSize = 2.f * cascade.extent / cascadeResolution;
+		center.x = std::floor(center.x / texelSize) * texelSize;
+		center.y = std::floor(center.y / texelSize) * texelSize;
+		cascade.center = center;
+
+		// Inverse Z, the near and far planes are swapped.
+		const auto depth = -center.z;
+		cascade.view = lightView;
+		cascade.projection = XMMatrixOrthographicOffCenterRH(center.x - cascade.extent, center.x + cascade.extent, center.y - cascade.extent,
+			center.y + cascade.extent, depth + cascade.extent, depth - cascade.extent - casterDistance);
+		cascade.valid = true;
+
+		pendingCascades[i] = true;
+	}
+
+	invalidated = false;
+
+	for (const auto& cascade : cascades)
+	{
+		XMFLOAT4 position;
+		XMStoreFloat4(&position, XMVector3Transform(XMLoadFloat3(&cascade.center), inverseLightView));
+		position.w = 0.f;
+
+		const auto inverseProjection = XMMatrixInverse(nullptr, cascade.projection);
+
+		cameras.emplace_back(Camera{
+			.position = position,
+			.view = cascade.view,
+			.projection = cascade.projection,
+			.inverseView = inverseLightView,
+			.inverseProjection = inverseProjection,
+			.lastFramePosition = position,
+			.lastFrameView = cascade.view,  // Motion is not needed for depth only passes.
+			.lastFrameProjection = cascade.projection,
+			.lastFrameInverseView = inverseLightView,
+			.lastFrameInverseProjection = inverseProjection,
+			.nearPlane = -cascade.center.z - cascade.extent - casterDistance,
+			.farPlane = -cascade.center.z + cascade.extent,
+			.fieldOfView = 0,
+			.aspectRatio = 1.f
+		});
+	}
+}
+
+RenderResource CascadedShadows::Render(RenderGraph& graph, const ShadowInputs& inputs)
+{
+	const auto atlasTag = graph.Import(atlas);
+
+	if (std::none_of(pendingCascades.begin(), pendingCascades.end(), [](auto pending) { return pending; }))
+	{
+		return atlasTag;
+	}
+
+	// Every cascade is culled in one dispatch, into consecutive ranges of draw arguments and visible instances. Sizes
+	// are rounded up so the transients are reused across small scene changes.
+	const auto& renderer = Renderer::Get();
+	const auto argumentCapacity = std::bit_ceil(std::max<size_t>(renderer.batchCount, 1)) * cascadeCount;
+	const auto instanceCapacity = std::bit_ceil(std::max<size_t>(renderer.renderableCount, 1)) * cascadeCount * maxMeshLods;  // A range per level of detail.
+
+	auto& shadowPass = graph.AddPass("Shadow Pass", ExecutionQueue::Graphics);
+	const auto culledArgsTag = shadowPass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+		.size = argumentCapacity,
+		.stride = sizeof(MeshIndirectArgument),
+		.uavCounter = true  // Counts the visible casters.
+	}, VGText("Shadow indirect render argument buffer"));
+	const auto visibleInstancesTag = shadowPass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+		.size = instanceCapacity,
+		.stride = sizeof(uint32_t)
+	}, VGText("Shadow visible instance buffer"));
+	shadowPass.Read(inputs.meshIndirectArgs, ResourceBind::SRV);
+	shadowPass.Read(inputs.meshInstances, ResourceBind::SRV);
+	shadowPass.Read(inputs.objectBuffer, ResourceBind::SRV);
+	shadowPass.Read(inputs.transformBuffer, ResourceBind::SRV);
+	shadowPass.Read(inputs.cameraBuffer, ResourceBind::SRV);
+	shadowPass.Read(inputs.cullingViewBuffer, ResourceBind::SRV);
+	shadowPass.Read(inputs.vertexPositions, ResourceBind::SRV);
+	shadowPass.Write(culledArgsTag, ResourceBind::UAV);
+	shadowPass.Write(visibleInstancesTag, ResourceBind::UAV);
+	shadowPass.Output(atlasTag, OutputBind::DSV, LoadType::Preserve);
+	shadowPass.Bind([this, inputs, atlasTag, culledArgsTag, visibleInstancesTag, pending = pendingCascades](CommandList& list, RenderPassResources& resources)
+	{
+		auto& renderer = Renderer::Get();
+
+		const auto culledArgs = resources.GetBuffer(culledArgsTag);
+		const auto visibleInstances = resources.GetBuffer(visibleInstancesTag);
+		const auto depthStencil = resources.GetTexture(atlasTag);
+		const auto& arguments = device->GetResourceManager().Get(culledArgs);
+
+		struct {
+			uint32_t inputBuffer;
+			uint32_t outputBuffer;
+			uint32_t instanceBuffer;
+			uint32_t visibleInstanceBuffer;
+			uint32_t objectBuffer;
+			uint32_t transformBuffer;
+			uint32_t cullingViewBuffer;
+			uint32_t cameraIndex;
+			uint32_t batchCount;
+			uint32_t instanceCount;
+			uint32_t cullingLevel;
+			uint32_t hiZTexture;
+			uint32_t hiZMipLevels;
+			uint32_t visibilityBuffer;
+			uint32_t nextVisibilityBuffer;
+			uint32_t lodResolution;
+			float lodErrorThreshold;
+			uint32_t countInstances;
+		} cullBindData{};
+
+		cullBindData.inputBuffer = resources.Get(inputs.meshIndirectArgs);
+		cullBindData.outputBuffer = resources.Get(culledArgsTag);
+		cullBindData.instanceBuffer = resources.Get(inputs.meshInstances);
+		cullBindData.visibleInstanceBuffer = resources.Get(visibleInstancesTag);
+		cullBindData.objectBuffer = resources.Get(inputs.objectBuffer);
+		cullBindData.transformBuffer = resources.Get(inputs.transformBuffer);
+		cullBindData.cullingViewBuffer = resources.Get(inputs.cullingViewBuffer);
+		cullBindData.batchCount = renderer.batchCount;
+		cullBindData.instanceCount = renderer.renderableCount;
+		cullBindData.cullingLevel = 1;  // Frustum only.
+		cullBindData.lodErrorThreshold = *CvarGet("meshLodThreshold", float);
+		cullBindData.lodResolution = cullBindData.lodErrorThreshold > 0.f ? cascadeResolution : 0;
+		cullBindData.countInstances = device->GetProfiler().CollectingStatistics();
+
+		struct {
+			uint32_t instanceBuffer;
+			uint32_t objectBuffer;
+			uint32_t cameraBuffer;
+			uint32_t cameraIndex;
+			uint32_t vertexPositionBuffer;
+			uint32_t padding[3];
+			MeshletDrawData meshletData;  // Unused.
+			uint32_t transformBuffer;
+		} bindData{};
+
+		bindData.instanceBuffer = resources.Get(visibleInstancesTag);
+		bindData.objectBuffer = resources.Get(inputs.objectBuffer);
+		bindData.transformBuffer = resources.Get(inputs.transformBuffer);
+		bindData.cameraBuffer = resources.Get(inputs.cameraBuffer);
+		bindData.vertexPositionBuffer = resources.Get(inputs.vertexPositions);
+
+		constexpr auto groupSize = 64;
+
+		// One dispatch row per cascade.
+		cullBindData.cameraIndex = firstCameraIndex;
+
+		list.BindPipeline(cullResetLayout);
+		list.BindConstants("bindData", cullBindData);
+		list.Dispatch(std::ceil((float)cullBindData.batchCount / groupSize), cascadeCount, 1);
+
+		list.UAVBarrier(culledArgs);
+		list.FlushBarriers();
+
+		list.BindPipeline(cullLayout);
+		list.BindConstants("bindData", cullBindData);
+		list.Dispatch(std::ceil((float)cullBindData.instanceCount / groupSize), cascadeCount, 1);
+
+		if (device->GetProfiler().CollectingStatistics())
+		{
+			device->GetProfiler().ReadCounter(list, device->GetFrameIndex(), "Shadow cascade casters", arguments.counterBuffer, static_cast<uint32_t>(renderer.renderableCount * cascadeCount));
+		}
+
+		list.TransitionBarrier(culledArgs, MeshSystem::argumentState);
+		list.TransitionBarrier(visibleInstances, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		list.FlushBarriers();
+
+		list.BindPipeline(depthLayout);
+		MeshSystem::BindArguments(renderer, list, culledArgs);
+
+		for (uint32_t i = 0; i < cascadeCount; ++i)
+		{
+			if (!pending[i])
+				continue;
+
+			// Cascades are laid out in a 2x2 grid.
+			const auto tileX = (i % 2) * cascadeResolution;
+			const auto tileY = (i / 2) * cascadeResolution;
+
+			const D3D12_VIEWPORT viewport{
+				.TopLeftX = static_cast<float>(tileX),
+				.TopLeftY = static_cast<float>(tileY),
+				.Width = static_cast<float>(cascadeResolution),
+				.Height = static_cast<float>(cascadeResolution),
+				.MinDepth = 0.f,
+				.MaxDepth = 1.f
+			};
+			const D3D12_RECT tile{
+				.left = static_cast<LONG>(tileX),
+				.top = static_cast<LONG>(tileY),
+				.right = static_cast<LONG>(tileX + cascadeResolution),
+				.bottom = static_cast<LONG>(tileY + cascadeResolution)
+			};
+
+			list.ClearDepthStencil(depthStencil, { &tile, 1 });
+
+			// Restricts the draws to the cascade's tile.
+			list.Native()->RSSetViewports(1, &viewport);
+			list.Native()->RSSetScissorRects(1, &tile);
+
+			bindData.cameraIndex = firstCameraIndex + i;
+			list.BindConstants("bindData", bindData);
+			const auto argumentOffset = i * renderer.batchCount * sizeof(MeshIndirectArgument);
+			list.ResumeRenderPass();
+			list.Native()->ExecuteIndirect(renderer.meshIndirectCommandSignature.Get(), renderer.batchCount, arguments.Native(), argumentOffset, nullptr, 0);
+		}
+
+		list.TransitionBarrier(culledArgs, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		list.TransitionBarrier(visibleInstances, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		list.FlushBarriers();
+	});
+
+	return atlasTag;
+}
+
+ShadowData CascadedShadows::GetShadowData(RenderPassResources& resources, RenderResource shadowAtlas) const
+{
+	ShadowData data{};
+	data.shadowMap = resources.Get(shadowAtlas);
+	data.cascadeCount = *CvarGet("shadows", int) == 1 ? cascadeCount : 0;
+	data.normalOffset = *CvarGet("shadowNormalOffset", float);
+	std::copy(splits.begin(), splits.end(), data.cascadeSplits);
+
+	return data;
+}
\ No newline at end of file
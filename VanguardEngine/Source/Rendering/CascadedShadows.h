@@ -0,0 +1,80 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Rendering/ResourceHandle.h>
+#include <Rendering/RenderPipeline.h>
+#include <Rendering/RenderGraphResource.h>
+#include <Rendering/ShaderStructs.h>
+#include <Utility/FrameArena.h>
+
+#include <array>
+
+class RenderDevice;
+class RenderGraph;
+class RenderPassResources;
+
+struct ShadowInputs
+{
+	RenderResource cameraBuffer;
+	RenderResource cullingViewBuffer;
+	RenderResource objectBuffer;
+	RenderResource transformBuffer;
+	RenderResource meshIndirectArgs;  // Unculled draw arguments of every batch.
+	RenderResource meshInstances;
+	RenderResource vertexPositions;
+};
+
+// Sun shadows from cascades fit to slices of the view frustum. Each cascade bounds its slice with a sphere, so its size
+// doesn't change as the camera rotates, and snaps to whole texels in light space, so the rasterized depth doesn't swim as
+// the camera moves. Casters are culled for every cascade in one GPU dispatch. Far cascades are padded and cached, only
+// rendering again once the view leaves their bounds, the sun moves or the scene's geometry changes.
+class CascadedShadows
+{
+public:
+	static constexpr uint32_t cascadeCount = 4;
+	static constexpr uint32_t firstCameraIndex = 3;  // Cascade cameras follow the spectator, frozen and sun cameras.
+	static constexpr uint32_t firstCachedCascade = 2;
+
+private:
+	struct Cascade
+	{
+		XMMATRIX view = XMMatrixIdentity();
+		XMMATRIX projection = XMMatrixIdentity();
+		XMFLOAT3 center;  // Light space, snapped to whole texels.
+		float extent;  // Half width, in light space.
+		bool valid = false;  // The atlas holds this cascade's depth.
+	};
+
+	RenderDevice* device;
+
+	RenderPipelineLayout cullResetLayout;
+	RenderPipelineLayout cullLayout;
+	RenderPipelineLayout depthLayout;
+
+	TextureHandle atlas;  // Every cascade in a 2x2 grid, persistent for caching.
+	uint32_t cascadeResolution = 0;
+	DXGI_FORMAT atlasFormat = DXGI_FORMAT_UNKNOWN;
+
+	std::array<Cascade, cascadeCount> cascades;
+	std::array<bool, cascadeCount> pendingCascades = {};  // Rendered this frame.
+	std::array<float, cascadeCount> splits = {};
+	XMFLOAT3 lastSunDirection = { 0.f, 0.f, 0.f };
+	bool invalidated = true;
+
+	void CreateAtlas(uint32_t resolution, DXGI_FORMAT format);
+
+public:
+	~CascadedShadows();
+
+	void Initialize(RenderDevice* inDevice);
+	// Scene geometry changed, cached cascades render again.
+	void Invalidate() noexcept { invalidated = true; }
+	// Fits the cascades to the unjittered view and appends their cameras, which must land at the first camera index.
+	void Update(const XMMATRIX& view, const XMMATRIX& projection, float nearPlane, float farPlane, const XMVECTOR& sunDirection,
+		const XMVECTOR& sunUpward, FrameVector<Camera>& cameras);
+	// Culls and renders the pending cascades, returns the shadow atlas.
+	RenderResource Render(RenderGraph& graph, const ShadowInputs& inputs);
+	ShadowData GetShadowData(RenderPassResources& resources, RenderResource shadowAtlas) const;
+};
\ No newline at end of file
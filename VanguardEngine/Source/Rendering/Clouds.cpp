@@ -7,9 +7,17 @@
 #include <Rendering/RenderPass.h>
 #include <Rendering/Atmosphere.h>
 #include <Rendering/RenderUtils.h>
+#include <Rendering/ResourceFormat.h>
 #include <Asset/TextureLoader.h>
+#include <Asset/TextureCompression.h>
 #include <Core/Config.h>
 #include <Utility/Math.h>
+#include <Utility/AlignedSize.h>
+#include <Threading/JobSystem.h>
+
+#include <fstream>
+#include <string>
+#include <cstring>
 
 void Clouds::GenerateWeather(CommandList& list, uint32_t weatherTexture)
 {
@@ -19,15 +27,11 @@ void Clouds::GenerateWeather(CommandList& list, uint32_t weatherTexture)
 		uint32_t weatherTexture;
 		float globalCoverage;
 		float precipitation;
-		float time;
-		XMFLOAT2 wind;
 	} bindData;
 
 	bindData.weatherTexture = weatherTexture;
 	bindData.globalCoverage = coverage;
 	bindData.precipitation = precipitation;
-	bindData.wind = { windDirection.x * windStrength, windDirection.y * windStrength };
-	bindData.time = Renderer::Get().GetAppTime();
 
 	list.BindConstants("bindData", bindData);
 
@@ -54,19 +58,245 @@ void Clouds::GenerateNoise(CommandList& list, uint32_t baseShapeTexture, uint32_
 	list.Dispatch(1, 1, 1);
 }
 
+void Clouds::GenerateShadow(CommandList& list, uint32_t weatherTexture, uint32_t shadowTexture, float solarZenithAngle)
+{
+	list.BindPipeline(shadowLayout);
+
+	struct {
+		uint32_t weatherTexture;
+		uint32_t shadowTexture;
+		float solarZenithAngle;
+	} bindData;
+
+	bindData.weatherTexture = weatherTexture;
+	bindData.shadowTexture = shadowTexture;
+	bindData.solarZenithAngle = solarZenithAngle;
+
+	list.BindConstants("bindData", bindData);
+
+	auto dispatchX = std::ceil((float)cloudShadowSize / 8);
+	auto dispatchY = std::ceil((float)cloudShadowSize / 8);
+
+	list.Dispatch((uint32_t)dispatchX, (uint32_t)dispatchY, 1);
+}
+
+std::filesystem::path Clouds::GetNoiseCachePath() const
+{
+	return Config::engineRootPath / "Cache" / ("CloudNoise_" + std::to_string(noiseCacheVersion) + ".bin");
+}
+
+void Clouds::ReadNoiseCache()
+{
+	VGScopedCPUStat("Clouds Noise Cache Read");
+
+	std::ifstream cacheStream{ GetNoiseCachePath(), std::ios::binary };
+	if (!cacheStream.is_open())
+	{
+		return;
+	}
+
+	// A truncated cache falls back to generating.
+	const auto baseMips = static_cast<uint32_t>(std::log2(baseShapeNoiseSize)) + 1;
+	cachedBaseNoise.resize(baseMips);
+	for (uint32_t mip = 0; mip < baseMips; ++mip)
+	{
+		const auto size = std::max(baseShapeNoiseSize >> mip, 1u);
+		cachedBaseNoise[mip].resize(static_cast<size_t>(GetResourceFormatRowSize(DXGI_FORMAT_BC4_UNORM, size)) * GetResourceFormatRowCount(DXGI_FORMAT_BC4_UNORM, size) * size);
+		cacheStream.read(reinterpret_cast<char*>(cachedBaseNoise[mip].data()), cachedBaseNoise[mip].size());
+	}
+
+	cachedDetailNoise.resize(static_cast<size_t>(detailShapeNoiseSize) * detailShapeNoiseSize * detailShapeNoiseSize);
+	cacheStream.read(reinterpret_cast<char*>(cachedDetailNoise.data()), cachedDetailNoise.size());
+
+	if (!cacheStream)
+	{
+		VGLogWarning(logRendering, "Clouds noise cache is corrupt, generating.");
+
+		cachedBaseNoise.clear();
+		cachedDetailNoise.clear();
+	}
+}
+
+bool Clouds::CreateCachedNoise()
+{
+	if (cachedBaseNoise.empty())
+	{
+		return false;
+	}
+
+	// Block compression can't be written by the GPU, the cached noise is read only.
+	TextureDescription baseShapeNoiseDesc{
+		.bindFlags = BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::CPUWrite,
+		.width = baseShapeNoiseSize,
+		.height = baseShapeNoiseSize,
+		.depth = baseShapeNoiseSize,
+		.format = DXGI_FORMAT_BC4_UNORM,
+		.mipMapping = true
+	};
+
+	TextureDescription detailShapeNoiseDesc{
+		.bindFlags = BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::CPUWrite,
+		.width = detailShapeNoiseSize,
+		.height = detailShapeNoiseSize,
+		.depth = detailShapeNoiseSize,
+		.format = DXGI_FORMAT_R8_UNORM
+	};
+
+	baseShapeNoise = device->GetResourceManager().Create(baseShapeNoiseDesc, VGText("Clouds base shape noise"));
+	detailShapeNoise = device->GetResourceManager().Create(detailShapeNoiseDesc, VGText("Clouds detail shape noise"));
+
+	for (uint32_t mip = 0; mip < cachedBaseNoise.size(); ++mip)
+	{
+		device->GetResourceManager().Write(baseShapeNoise, cachedBaseNoise[mip], mip);
+	}
+
+	device->GetResourceManager().Write(detailShapeNoise, cachedDetailNoise);
+
+	cachedBaseNoise = {};
+	cachedDetailNoise = {};
+
+	VGLog(logRendering, "Loaded clouds noise from cache.");
+
+	return true;
+}
+
+void Clouds::ReadbackNoise(CommandList& list)
+{
+	NoiseReadback readback;
+	readback.readyFrame = Renderer::Get().GetAppFrame() + RenderDevice::frameCount + 1;
+
+	// Every subresource is copied to its own aligned footprint in a shared buffer.
+	uint64_t size = 0;
+	for (const auto texture : { baseShapeNoise, detailShapeNoise })
+	{
+		const auto description = device->GetResourceManager().Get(texture).Native()->GetDesc();
+		const auto first = readback.footprints.size();
+		readback.footprints.resize(first + description.MipLevels);
+
+		uint64_t footprintSize;
+		device->Native()->GetCopyableFootprints(&description, 0, description.MipLevels, size, &readback.footprints[first], nullptr, nullptr, &footprintSize);
+		size = AlignedSize(size + footprintSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+	}
+
+	readback.allocation = device->GetResourceManager().AllocateReadback(size, VGText("Clouds noise readback"));
+	if (!readback.allocation)
+	{
+		return;
+	}
+
+	list.TransitionBarrier(baseShapeNoise, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	list.TransitionBarrier(detailShapeNoise, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	list.FlushBarriers();
+
+	size_t footprintIndex = 0;
+	for (const auto texture : { baseShapeNoise, detailShapeNoise })
+	{
+		auto* resource = device->GetResourceManager().Get(texture).Native();
+		for (uint32_t mip = 0; mip < resource->GetDesc().MipLevels; ++mip)
+		{
+			D3D12_TEXTURE_COPY_LOCATION source{};
+			source.pResource = resource;
+			source.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+			source.SubresourceIndex = mip;
+
+			D3D12_TEXTURE_COPY_LOCATION destination{};
+			destination.pResource = readback.allocation->GetResource();
+			destination.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+			destination.PlacedFootprint = readback.footprints[footprintIndex++];
+
+			list.Native()->CopyTextureRegion(&destination, 0, 0, 0, &source, nullptr);
+		}
+	}
+
+	noiseReadback = std::move(readback);
+}
+
+void Clouds::SaveNoiseCache()
+{
+	VGScopedCPUStat("Clouds Noise Cache Save");
+
+	const auto path = GetNoiseCachePath();
+
+	std::error_code error;
+	std::filesystem::create_directories(path.parent_path(), error);
+
+	std::ofstream cacheStream{ path, std::ios::binary };
+
+	std::byte* mappedData = nullptr;
+	const auto result = noiseReadback->allocation->GetResource()->Map(0, nullptr, reinterpret_cast<void**>(&mappedData));
+	if (FAILED(result) || !cacheStream.is_open())
+	{
+		VGLogWarning(logRendering, "Failed to save the clouds noise cache.");
+
+		noiseReadback.reset();
+		return;
+	}
+
+	// Each slice of the base shape mips is compressed separately, BC4 blocks don't span slices.
+	const auto baseMips = noiseReadback->footprints.size() - 1;
+	std::vector<unsigned char> texels;
+	for (size_t mip = 0; mip < baseMips; ++mip)
+	{
+		const auto& footprint = noiseReadback->footprints[mip];
+		texels.resize(static_cast<size_t>(footprint.Footprint.Width) * footprint.Footprint.Height * 4);
+
+		for (uint32_t slice = 0; slice < footprint.Footprint.Depth; ++slice)
+		{
+			for (uint32_t row = 0; row < footprint.Footprint.Height; ++row)
+			{
+				const auto offset = footprint.Offset + (slice * footprint.Footprint.Height + row) * footprint.Footprint.RowPitch;
+				for (uint32_t x = 0; x < footprint.Footprint.Width; ++x)
+				{
+					texels[(row * footprint.Footprint.Width + x) * 4] = static_cast<unsigned char>(mappedData[offset + x]);
+				}
+			}
+
+			const auto blocks = TextureCompression::Compress(texels.data(), footprint.Footprint.Width, footprint.Footprint.Height, DXGI_FORMAT_BC4_UNORM);
+			cacheStream.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+		}
+	}
+
+	// The detail shape is sampled at a high frequency, where block compression artifacts are visible. It's small enough
+	// to keep uncompressed, with the row padding stripped.
+	const auto& detailFootprint = noiseReadback->footprints.back();
+	for (uint32_t slice = 0; slice < detailFootprint.Footprint.Depth; ++slice)
+	{
+		for (uint32_t row = 0; row < detailFootprint.Footprint.Height; ++row)
+		{
+			const auto offset = detailFootprint.Offset + (slice * detailFootprint.Footprint.Height + row) * detailFootprint.Footprint.RowPitch;
+			cacheStream.write(reinterpret_cast<const char*>(mappedData + offset), detailFootprint.Footprint.Width);
+		}
+	}
+
+	D3D12_RANGE writtenRange{ 0, 0 };
+	noiseReadback->allocation->GetResource()->Unmap(0, &writtenRange);
+
+	VGLog(logRendering, "Saved clouds noise to cache.");
+
+	noiseReadback.reset();
+}
+
 Clouds::~Clouds()
 {
 	device->GetResourceManager().Destroy(baseShapeNoise);
 	device->GetResourceManager().Destroy(detailShapeNoise);
+	device->GetResourceManager().Destroy(cloudShadow);
 }
 
-void Clouds::Initialize(RenderDevice* inDevice)
+void Clouds::Initialize(RenderDevice* inDevice, JobCounter& startupJobs)
 {
 	device = inDevice;
 
-	CvarCreate("cloudRayMarchQuality", "Controls the ray march quality of the clouds. Increasing quality degrades performance. 0=lowDetail, 1=default, 2=groundTruth", 1);
-	CvarCreate("cloudRenderScale", "Controls the render scale of the volumetric clouds", 0.25f);
-	CvarCreate("cloudDebugMarchCount", "Debug cloud ray march steps", 0);
+	// The 4K cirrus texture dominates the startup of the clouds, both only read files.
+	JobSystem::Get().Schedule([this]() { ReadNoiseCache(); }, &startupJobs);
+	JobSystem::Get().Schedule([this]() { cirrusImage = AssetLoader::ReadTexture(Config::utilitiesPath / "Cirrus4k.png"); }, &startupJobs);
+
+	rayMarchQuality = CvarCreate("cloudRayMarchQuality", "Controls the ray march quality of the clouds. Increasing quality degrades performance. 0=lowDetail, 1=default, 2=groundTruth", 1);
+	renderScale = CvarCreate("cloudRenderScale", "Controls the render scale of the volumetric clouds", 0.25f);
+	debugMarchCount = CvarCreate("cloudDebugMarchCount", "Debug cloud ray march steps", 0);
+	tileClassification = CvarCreate("cloudTileClassification", "Only ray march the cloud tiles that geometry doesn't cover before the cloud layer", 1);
 	CvarCreate("cloudDebugTransmittance", "Debug cloud transmittance", 0);
 
 	weatherLayout = RenderPipelineLayout{}
@@ -78,6 +308,52 @@ void Clouds::Initialize(RenderDevice* inDevice)
 	detailNoiseLayout = RenderPipelineLayout{}
 		.ComputeShader({ "Clouds/Shapes", "DetailShapeMain" });
 
+	cloudsLayout = RenderPipelineLayout{}
+		.VertexShader({ "Clouds/Main", "VSMain" })
+		.PixelShader({ "Clouds/Main", "PSMain" })
+		.BlendMode(false, BlendMode{})
+		.DepthEnabled(false)
+		.Permutations({ { "CLOUDS_LOW_DETAIL" }, { "CLOUDS_MARCH_GROUND_TRUTH_DETAIL" }, { "CLOUDS_DEBUG_MARCHCOUNT" } });
+
+	cloudsTiledLayout = RenderPipelineLayout{}
+		.VertexShader({ "Clouds/Main", "VSTileMain" })
+		.PixelShader({ "Clouds/Main", "PSMain" })
+		.BlendMode(false, BlendMode{})
+		.DepthEnabled(false)
+		.Permutations({ { "CLOUDS_LOW_DETAIL" }, { "CLOUDS_MARCH_GROUND_TRUTH_DETAIL" }, { "CLOUDS_DEBUG_MARCHCOUNT" } });
+
+	visibilityLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Clouds/Visibility", "Main" })
+		.Macro({ "CLOUDS_LOW_DETAIL" })  // Always low detail, no matter the quality setting
+		// Interestingly, applying the ONLY_DEPTH macro does not appear to help performance. The issue there is likely the transmittance
+		// approximation being too conservative and allowing too many steps into the cloud. However, if this is done then small clouds
+		// will yield too much shadow and does not look visibily correct.
+		//.Macro({ "CLOUDS_ONLY_DEPTH" })
+		.Permutations({ { "CLOUDS_DEBUG_MARCHCOUNT" } });
+
+	shadowLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Clouds/Shadow", "Main" });
+
+	tileClassificationLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Clouds/TileClassification", "Main" });
+
+	std::vector<D3D12_INDIRECT_ARGUMENT_DESC> tileDrawArgDescs;
+	tileDrawArgDescs.emplace_back(D3D12_INDIRECT_ARGUMENT_DESC{
+		.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW
+	});
+
+	D3D12_COMMAND_SIGNATURE_DESC tileDrawSignatureDesc{};
+	tileDrawSignatureDesc.ByteStride = sizeof(D3D12_DRAW_ARGUMENTS);
+	tileDrawSignatureDesc.NumArgumentDescs = tileDrawArgDescs.size();
+	tileDrawSignatureDesc.pArgumentDescs = tileDrawArgDescs.data();
+	tileDrawSignatureDesc.NodeMask = 0;
+
+	const auto result = device->Native()->CreateCommandSignature(&tileDrawSignatureDesc, nullptr, IID_PPV_ARGS(tileDrawSignature.Indirect()));
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to create cloud tile indirect command signature: {}", result);
+	}
+
 	TextureDescription weatherDesc{
 		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
 		.accessFlags = AccessFlag::GPUWrite,
@@ -88,26 +364,47 @@ void Clouds::Initialize(RenderDevice* inDevice)
 	};
 	weather = device->GetResourceManager().Create(weatherDesc, VGText("Clouds weather"));
 
-	TextureDescription baseShapeNoiseDesc{
+	TextureDescription cloudShadowDesc{
 		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
 		.accessFlags = AccessFlag::GPUWrite,
-		.width = 128,
-		.height = 128,
-		.depth = 128,
-		.format = DXGI_FORMAT_R8_UNORM,
-		.mipMapping = true
+		.width = cloudShadowSize,
+		.height = cloudShadowSize,
+		.depth = 1,
+		.format = DXGI_FORMAT_R16_FLOAT
 	};
-	baseShapeNoise = device->GetResourceManager().Create(baseShapeNoiseDesc, VGText("Clouds base shape noise"));
+	cloudShadow = device->GetResourceManager().Create(cloudShadowDesc, VGText("Clouds shadow"));
+}
 
-	TextureDescription detailShapeNoiseDesc{
-		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
-		.accessFlags = AccessFlag::GPUWrite,
-		.width = 32,
-		.height = 32,
-		.depth = 32,
-		.format = DXGI_FORMAT_R8_UNORM
-	};
-	detailShapeNoise = device->GetResourceManager().Create(detailShapeNoiseDesc, VGText("Clouds detail shape noise"));
+void Clouds::FinishInitialize()
+{
+	if (CreateCachedNoise())
+	{
+		dirty = false;
+	}
+
+	else
+	{
+		TextureDescription baseShapeNoiseDesc{
+			.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
+			.accessFlags = AccessFlag::GPUWrite,
+			.width = baseShapeNoiseSize,
+			.height = baseShapeNoiseSize,
+			.depth = baseShapeNoiseSize,
+			.format = DXGI_FORMAT_R8_UNORM,
+			.mipMapping = true
+		};
+		baseShapeNoise = device->GetResourceManager().Create(baseShapeNoiseDesc, VGText("Clouds base shape noise"));
+
+		TextureDescription detailShapeNoiseDesc{
+			.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
+			.accessFlags = AccessFlag::GPUWrite,
+			.width = detailShapeNoiseSize,
+			.height = detailShapeNoiseSize,
+			.depth = detailShapeNoiseSize,
+			.format = DXGI_FORMAT_R8_UNORM
+		};
+		detailShapeNoise = device->GetResourceManager().Create(detailShapeNoiseDesc, VGText("Clouds detail shape noise"));
+	}
 
 	//TextureDescription distortionNoiseDesc{
 	//	.bindFlags = BindFlag::ShaderResource,
@@ -119,14 +416,27 @@ void Clouds::Initialize(RenderDevice* inDevice)
 	//};
 	//distortionNoise = device->GetResourceManager().Create(distortionNoiseDesc, VGText("Clouds distortion noise"));
 
-	cirrusClouds = AssetLoader::LoadTexture(*device, Config::utilitiesPath / "Cirrus4k.png", false);
+	if (cirrusImage)
+	{
+		cirrusClouds = AssetLoader::CreateTexture(*device, *cirrusImage, false);
+		cirrusImage.reset();
+	}
+}
+
+XMFLOAT2 Clouds::GetWeatherScroll() const
+{
+	// Wrapped in double precision, the shader's frac loses precision as the app time grows.
+	const auto time = Renderer::Get().GetAppTime();
+	const auto timeDilation = 0.003;
+
+	const auto scrollX = windDirection.x * windStrength * time * timeDilation;
+	const auto scrollY = windDirection.y * windStrength * time * timeDilation;
 
-	lastFrameScatteringUpscaled.id = 0;
-	lastFrameDepthUpscaled.id = 0;
-	lastFrameVisibilityUpscaled.id = 0;
+	return { (float)(scrollX - std::floor(scrollX)), (float)(scrollY - std::floor(scrollY)) };
 }
 
-CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, const Atmosphere& atmosphere, const RenderResource cameraBuffer, const RenderResource depthStencil, const RenderResource atmosphereIrradiance)
+CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, const Atmosphere& atmosphere, const RenderResource cameraBuffer, const RenderResource depthStencil,
+	const RenderResource atmosphereIrradiance, std::optional<RenderResource> hiZ)
 {
 	const auto weatherTag = graph.Import(weather);
 	const auto baseShapeNoiseTag = graph.Import(baseShapeNoise);
@@ -134,11 +444,17 @@ CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, cons
 	const auto cirrusTag = graph.Import(cirrusClouds);
 	const auto solarZenithAngle = registry.get<TimeOfDayComponent>(atmosphere.sunLight).solarZenithAngle;
 	const auto blueNoiseTag = graph.Import(RenderUtils::Get().blueNoise);
+	const auto cloudShadowTag = graph.Import(cloudShadow);
+
+	if (noiseReadback && Renderer::Get().GetAppFrame() >= noiseReadback->readyFrame)
+	{
+		SaveNoiseCache();
+	}
 
 	if (dirty)
 	{
 		auto& noisePass = graph.AddPass("Clouds Noise Pass", ExecutionQueue::Compute);
-		noisePass.Write(baseShapeNoiseTag, TextureView{}.UAV("", 0));
+		noisePass.Write(baseShapeNoiseTag, TextureView{}.UAV("", 0).Mips(0));  // Mipmapped within the pass.
 		noisePass.Write(detailShapeNoiseTag, TextureView{}.UAV("", 0));
 		noisePass.Bind([this, baseShapeNoiseTag, detailShapeNoiseTag](CommandList& list, RenderPassResources& resources)
 		{
@@ -149,35 +465,152 @@ CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, cons
 
 			// Mipmap the base shape noise for local density information.
 			device->GetResourceManager().GenerateMipmaps(list, baseShapeNoise);
+
+			ReadbackNoise(list);
 		});
 
 		dirty = false;
 	}
 
-	auto& weatherPass = graph.AddPass("Weather Pass", ExecutionQueue::Compute);
-	weatherPass.Write(weatherTag, TextureView{}.UAV("", 0));
-	weatherPass.Bind([this, weatherTag](CommandList& list, RenderPassResources& resources)
+	const bool weatherChanged = coverage != weatherCoverage || precipitation != weatherPrecipitation;
+	if (weatherChanged)
 	{
-		GenerateWeather(list, resources.Get(weatherTag));
-	});
+		auto& weatherPass = graph.AddPass("Weather Pass", ExecutionQueue::Compute);
+		weatherPass.Write(weatherTag, TextureView{}.UAV("", 0));
+		weatherPass.Bind([this, weatherTag](CommandList& list, RenderPassResources& resources)
+		{
+			GenerateWeather(list, resources.Get(weatherTag));
+		});
 
-	const float cloudRenderScale = *CvarGet("cloudRenderScale", float);
+		weatherCoverage = coverage;
+		weatherPrecipitation = precipitation;
+	}
 
-	auto& cloudsPass = graph.AddPass("Clouds Pass", ExecutionQueue::Graphics);
-	const auto cloudOutput = cloudsPass.Create(TransientTextureDescription{
+	// Small sun movements are imperceptible in the shadow, so an animated time of day doesn't regenerate every frame.
+	const auto shadowAngleThreshold = 0.002f;
+	if (weatherChanged || std::abs(solarZenithAngle - shadowSolarZenithAngle) > shadowAngleThreshold)
+	{
+		auto& shadowPass = graph.AddPass("Clouds Shadow Pass", ExecutionQueue::Compute);
+		shadowPass.Read(weatherTag, ResourceBind::SRV);
+		shadowPass.Write(cloudShadowTag, TextureView{}.UAV("", 0));
+		shadowPass.Bind([this, weatherTag, cloudShadowTag, solarZenithAngle](CommandList& list, RenderPassResources& resources)
+		{
+			GenerateShadow(list, resources.Get(weatherTag), resources.Get(cloudShadowTag), solarZenithAngle);
+		});
+
+		shadowSolarZenithAngle = solarZenithAngle;
+	}
+
+	const float cloudRenderScale = *renderScale * dynamicScale;
+
+	// Each frame traces one of the 16 subpixels under every low resolution pixel, the upscale reprojects the rest.
+	const uint32_t timeSlice = Renderer::Get().GetAppFrame() % 16;
+	const uint32_t blueNoiseSlice = Renderer::Get().GetAppFrame() % RenderUtils::blueNoiseSlices;
+
+	const TransientTextureDescription cloudOutputDesc{
 		.width = 0,
 		.height = 0,
 		.depth = 1,
 		.resolutionScale = cloudRenderScale,
 		.format = DXGI_FORMAT_R16G16B16A16_FLOAT
-	}, VGText("Clouds scattering transmittance"));
-	const auto cloudDepth = cloudsPass.Create(TransientTextureDescription{
+	};
+	const TransientTextureDescription cloudDepthDesc{
 		.width = 0,
 		.height = 0,
 		.depth = 1,
 		.resolutionScale = cloudRenderScale,
 		.format = DXGI_FORMAT_R32_FLOAT
-	}, VGText("Clouds depth"));
+	};
+
+	// Tiles where geometry ends every ray before the cloud layer are filled with an empty march, and only the rest are drawn.
+	const bool tiled = hiZ && *tileClassification > 0 && tileDrawSignature;
+
+	std::optional<RenderResource> tileListTag;
+	std::optional<RenderResource> tileDrawArgsTag;
+	RenderResource cloudOutput;
+	RenderResource cloudDepth;
+
+	if (tiled)
+	{
+		const auto [outputWidth, outputHeight] = graph.GetOutputResolution(device);
+		// Same truncation as the transient texture sizes.
+		const uint32_t tilesX = static_cast<uint32_t>(std::ceil(static_cast<uint32_t>(outputWidth * cloudRenderScale) / 8.f));
+		const uint32_t tilesY = static_cast<uint32_t>(std::ceil(static_cast<uint32_t>(outputHeight * cloudRenderScale) / 8.f));
+
+		BufferView tileDrawArgsView;
+		tileDrawArgsView.UAV("uav_visible");
+		tileDrawArgsView.UAV("uav_nonvisible", 0, 0, HeapType::NonVisible);
+
+		auto& classificationPass = graph.AddPass("Clouds Tile Classification", ExecutionQueue::Compute);
+		cloudOutput = classificationPass.Create(cloudOutputDesc, VGText("Clouds scattering transmittance"));
+		cloudDepth = classificationPass.Create(cloudDepthDesc, VGText("Clouds depth"));
+		tileListTag = classificationPass.Create(TransientBufferDescription{
+			.updateRate = ResourceFrequency::Static,  // UAVs.
+			.size = tilesX * tilesY,  // Worst case.
+			.stride = sizeof(uint32_t)
+		}, VGText("Clouds tile list"));
+		tileDrawArgsTag = classificationPass.Create(TransientBufferDescription{
+			.updateRate = ResourceFrequency::Static,  // UAVs.
+			.size = 1,
+			.stride = sizeof(D3D12_DRAW_ARGUMENTS)
+		}, VGText("Clouds tile indirect argument buffer"));
+		classificationPass.Read(*hiZ, ResourceBind::SRV);
+		classificationPass.Read(cameraBuffer, ResourceBind::SRV);
+		classificationPass.Write(cloudOutput, TextureView{}.UAV("", 0));
+		classificationPass.Write(cloudDepth, TextureView{}.UAV("", 0));
+		classificationPass.Write(*tileListTag, ResourceBind::UAV);
+		classificationPass.Write(*tileDrawArgsTag, tileDrawArgsView);
+		classificationPass.Bind([this, hiZ, cameraBuffer, cloudOutput, cloudDepth, tileListTag, tileDrawArgsTag, tilesX, tilesY]
+			(CommandList& list, RenderPassResources& resources)
+		{
+			// Classification counts the marched tiles straight into the draw's instance count.
+			RenderUtils::Get().ClearUAV(list, resources.GetBuffer(*tileDrawArgsTag), resources.Get(*tileDrawArgsTag, "uav_visible"), resources.GetDescriptor(*tileDrawArgsTag, "uav_nonvisible"));
+
+			list.UAVBarrier(resources.GetBuffer(*tileDrawArgsTag));
+			list.FlushBarriers();
+
+			list.BindPipeline(tileClassificationLayout);
+
+			struct {
+				uint32_t hiZTexture;
+				uint32_t hiZMipLevels;
+				uint32_t cameraBuffer;
+				uint32_t cameraIndex;
+				uint32_t scatteringTransmittanceTexture;
+				uint32_t depthTexture;
+				uint32_t tileBuffer;
+				uint32_t indirectBuffer;
+			} bindData;
+
+			bindData.hiZTexture = resources.Get(*hiZ);
+			bindData.hiZMipLevels = static_cast<uint32_t>(*CvarGet("hiZPyramidLevels", int));
+			bindData.cameraBuffer = resources.Get(cameraBuffer);
+			bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
+			bindData.scatteringTransmittanceTexture = resources.Get(cloudOutput);
+			bindData.depthTexture = resources.Get(cloudDepth);
+			bindData.tileBuffer = resources.Get(*tileListTag);
+			bindData.indirectBuffer = resources.Get(*tileDrawArgsTag, "uav_visible");
+
+			list.BindConstants("bindData", bindData);
+
+			// One group per tile.
+			list.Dispatch(tilesX, tilesY, 1);
+		});
+	}
+
+	auto& cloudsPass = graph.AddPass("Clouds Pass", ExecutionQueue::Graphics);
+	if (!tiled)
+	{
+		cloudOutput = cloudsPass.Create(cloudOutputDesc, VGText("Clouds scattering transmittance"));
+		cloudDepth = cloudsPass.Create(cloudDepthDesc, VGText("Clouds depth"));
+	}
+
+	else
+	{
+		cloudsPass.Read(*tileListTag, ResourceBind::SRV);
+		cloudsPass.Read(*tileDrawArgsTag, ResourceBind::Indirect);
+	}
+
 	cloudsPass.Read(cameraBuffer, ResourceBind::SRV);
 	cloudsPass.Read(weatherTag, ResourceBind::SRV);
 	cloudsPass.Read(baseShapeNoiseTag, ResourceBind::SRV);
@@ -188,23 +621,18 @@ CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, cons
 	cloudsPass.Output(cloudOutput, OutputBind::RTV, LoadType::Preserve);
 	cloudsPass.Write(cloudDepth, TextureView{}.UAV("", 0));
 	cloudsPass.Bind([this, weatherTag, baseShapeNoiseTag, detailShapeNoiseTag, solarZenithAngle,
-		cameraBuffer, depthStencil, cloudOutput, blueNoiseTag, cloudDepth, atmosphereIrradiance]
+		cameraBuffer, depthStencil, cloudOutput, blueNoiseTag, blueNoiseSlice, cloudDepth, atmosphereIrradiance, tiled, tileListTag, tileDrawArgsTag]
 		(CommandList& list, RenderPassResources& resources)
 	{
-		auto cloudsLayout = RenderPipelineLayout{}
-			.VertexShader({ "Clouds/Main", "VSMain" })
-			.PixelShader({ "Clouds/Main", "PSMain" })
-			.BlendMode(false, BlendMode{})
-			.DepthEnabled(false);
-
-		if (*CvarGet("cloudRayMarchQuality", int) < 1)
-			cloudsLayout.Macro({ "CLOUDS_LOW_DETAIL" });
-		else if (*CvarGet("cloudRayMarchQuality", int) > 1)
-			cloudsLayout.Macro({ "CLOUDS_MARCH_GROUND_TRUTH_DETAIL" });
-		if (*CvarGet("cloudDebugMarchCount", int) > 0)
-			cloudsLayout.Macro({ "CLOUDS_DEBUG_MARCHCOUNT" });
+		uint32_t permutation = 0;
+		if (*rayMarchQuality < 1)
+			permutation |= 1 << 0;
+		else if (*rayMarchQuality > 1)
+			permutation |= 1 << 1;
+		if (*debugMarchCount > 0)
+			permutation |= 1 << 2;
 
-		list.BindPipeline(cloudsLayout);
+		list.BindPipeline((tiled ? cloudsTiledLayout : cloudsLayout).Permutation(permutation));
 
 		struct {
 			uint32_t weatherTexture;
@@ -222,6 +650,8 @@ CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, cons
 			XMFLOAT2 wind;
 			uint32_t outputResolution[2];
 			uint32_t upscaledResolution[2];
+			uint32_t blueNoiseSlice;
+			uint32_t tileBuffer;
 		} bindData;
 
 		bindData.weatherTexture = resources.Get(weatherTag);
@@ -230,7 +660,7 @@ CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, cons
 		bindData.cameraBuffer = resources.Get(cameraBuffer);
 		bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
 		bindData.solarZenithAngle = solarZenithAngle;
-		bindData.timeSlice = Renderer::Get().GetAppFrame() % 16;
+		bindData.timeSlice = timeSlice;
 		bindData.depthTexture = resources.Get(cloudDepth);
 		bindData.geometryDepthTexture = resources.Get(depthStencil);
 		bindData.blueNoiseTexture = resources.Get(blueNoiseTag);
@@ -242,11 +672,26 @@ CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, cons
 		bindData.outputResolution[0] = cloudOutputComponent.description.width;
 		bindData.outputResolution[1] = cloudOutputComponent.description.height;
 
-		bindData.upscaledResolution[0] = device->renderWidth;
-		bindData.upscaledResolution[1] = device->renderHeight;
+		const auto [sceneWidth, sceneHeight] = Renderer::Get().GetSceneResolution();
+		bindData.upscaledResolution[0] = sceneWidth;
+		bindData.upscaledResolution[1] = sceneHeight;
+		bindData.blueNoiseSlice = blueNoiseSlice;
+		bindData.tileBuffer = tiled ? resources.Get(*tileListTag) : 0;
 
 		list.BindConstants("bindData", bindData);
-		list.DrawFullscreenQuad();
+
+		if (tiled)
+		{
+			list.ResumeRenderPass();
+
+			auto& indirectComponent = device->GetResourceManager().Get(resources.GetBuffer(*tileDrawArgsTag));
+			list.Native()->ExecuteIndirect(tileDrawSignature.Get(), 1, indirectComponent.allocation->GetResource(), 0, nullptr, 0);
+		}
+
+		else
+		{
+			list.DrawFullscreenQuad();
+		}
 	});
 
 	auto visibilityEnabled = *CvarGet("renderLightShafts", int);
@@ -268,20 +713,9 @@ CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, cons
 	visibilityPass.Write(cloudVisibility, TextureView{}
 		.UAV("", 0));
 	visibilityPass.Bind([this, cameraBuffer, weatherTag, baseShapeNoiseTag, depthStencil, blueNoiseTag, atmosphereIrradiance,
-		cloudVisibility, solarZenithAngle](CommandList& list, RenderPassResources& resources)
+		cloudVisibility, solarZenithAngle, blueNoiseSlice](CommandList& list, RenderPassResources& resources)
 	{
-		auto visibilityLayout = RenderPipelineLayout{}
-			.ComputeShader({ "Clouds/Visibility", "Main" })
-			.Macro({ "CLOUDS_LOW_DETAIL" });  // Always low detail, no matter the quality setting
-			// Interestingly, applying the ONLY_DEPTH macro does not appear to help performance. The issue there is likely the transmittance
-			// approximation being too conservative and allowing too many steps into the cloud. However, if this is done then small clouds
-			// will yield too much shadow and does not look visibily correct.
-			//.Macro({ "CLOUDS_ONLY_DEPTH" });
-		
-		if (*CvarGet("cloudDebugMarchCount", int) > 0)
-			visibilityLayout.Macro({ "CLOUDS_DEBUG_MARCHCOUNT" });
-
-		list.BindPipeline(visibilityLayout);
+		list.BindPipeline(visibilityLayout.Permutation(*debugMarchCount > 0 ? 1 : 0));
 
 		struct {
 			uint32_t outputTexture;
@@ -297,6 +731,7 @@ CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, cons
 			uint32_t upscaledResolution[2];
 			XMFLOAT2 wind;
 			float time;
+			uint32_t blueNoiseSlice;
 		} bindData;
 
 		bindData.outputTexture = resources.Get(cloudVisibility);
@@ -305,14 +740,16 @@ CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, cons
 		bindData.cameraBuffer = resources.Get(cameraBuffer);
 		bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
 		bindData.solarZenithAngle = solarZenithAngle;
-		bindData.timeSlice = Renderer::Get().GetAppFrame() % 16;
+		bindData.timeSlice = timeSlice;
 		bindData.geometryDepthTexture = resources.Get(depthStencil);
 		bindData.blueNoiseTexture = resources.Get(blueNoiseTag);
 		bindData.atmosphereIrradianceBuffer = resources.Get(atmosphereIrradiance);
-		bindData.upscaledResolution[0] = device->renderWidth;
-		bindData.upscaledResolution[1] = device->renderHeight;
+		const auto [sceneWidth, sceneHeight] = Renderer::Get().GetSceneResolution();
+		bindData.upscaledResolution[0] = sceneWidth;
+		bindData.upscaledResolution[1] = sceneHeight;
 		bindData.wind = { windDirection.x * windStrength, windDirection.y * windStrength };
 		bindData.time = Renderer::Get().GetAppTime();
+		bindData.blueNoiseSlice = blueNoiseSlice;
 
 		list.BindConstants("bindData", bindData);
 
@@ -323,41 +760,49 @@ CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, cons
 		list.Dispatch(dispatchX, dispatchY, 1);
 	});
 
-	auto& upscalePass = graph.AddPass("Clouds Upscale Pass", ExecutionQueue::Compute);
-	const auto cloudOutputUpscaled = upscalePass.Create(TransientTextureDescription{
+	const auto scatteringHistory = graph.CreateHistory(VGText("Clouds upscaled scattering transmittance"), TransientTextureDescription{
 		.width = 0,
 		.height = 0,
 		.depth = 1,
 		.resolutionScale = 1.f,
 		.format = DXGI_FORMAT_R16G16B16A16_FLOAT
-	}, VGText("Clouds upscaled scattering transmittance"));
-	const auto cloudDepthUpscaled = upscalePass.Create(TransientTextureDescription{
+	});
+	const auto depthHistory = graph.CreateHistory(VGText("Clouds upscaled depth"), TransientTextureDescription{
 		.width = 0,
 		.height = 0,
 		.depth = 1,
 		.resolutionScale = 1.f,
 		.format = DXGI_FORMAT_R32_FLOAT
-	}, VGText("Clouds upscaled depth"));
-	const auto cloudVisibilityUpscaled = upscalePass.Create(TransientTextureDescription{
+	});
+	const auto visibilityHistory = graph.CreateHistory(VGText("Clouds upscaled sky visibility"), TransientTextureDescription{
 		.width = 0,
 		.height = 0,
 		.depth = 1,
 		.resolutionScale = 1.f,
 		.format = DXGI_FORMAT_R16_FLOAT
-	}, VGText("Clouds upscaled sky visibility"));
+	});
+	const auto cloudOutputUpscaled = scatteringHistory.current;
+	const auto cloudDepthUpscaled = depthHistory.current;
+	const auto cloudVisibilityUpscaled = visibilityHistory.current;
+
+	auto& upscalePass = graph.AddPass("Clouds Upscale Pass", ExecutionQueue::Compute);
 	upscalePass.Read(cameraBuffer, ResourceBind::SRV);
 	upscalePass.Read(depthStencil, ResourceBind::SRV);
 	upscalePass.Read(cloudOutput, ResourceBind::SRV);
 	upscalePass.Read(cloudDepth, ResourceBind::SRV);
 	upscalePass.Read(cloudVisibility, ResourceBind::SRV);
-	upscalePass.Read(lastFrameScatteringUpscaled, ResourceBind::SRV);
-	upscalePass.Read(lastFrameDepthUpscaled, ResourceBind::SRV);
-	upscalePass.Read(lastFrameVisibilityUpscaled, ResourceBind::SRV);
+	for (const auto& history : { scatteringHistory, depthHistory, visibilityHistory })
+	{
+		if (history.Valid())
+		{
+			upscalePass.Read(history.previous, ResourceBind::SRV);
+		}
+	}
 	upscalePass.Write(cloudOutputUpscaled, TextureView{}.UAV("", 0));
 	upscalePass.Write(cloudDepthUpscaled, TextureView{}.UAV("", 0));
 	upscalePass.Write(cloudVisibilityUpscaled, TextureView{}.UAV("", 0));
-	upscalePass.Bind([this, cameraBuffer, depthStencil, cloudOutput, cloudDepth, cloudVisibility, oldUpscaled=lastFrameScatteringUpscaled,
-		oldDepthUpscaled=lastFrameDepthUpscaled, oldVisibilityUpscaled=lastFrameVisibilityUpscaled, cloudOutputUpscaled,
+	upscalePass.Bind([this, cameraBuffer, depthStencil, cloudOutput, cloudDepth, cloudVisibility, oldUpscaled=scatteringHistory.previous,
+		oldDepthUpscaled=depthHistory.previous, oldVisibilityUpscaled=visibilityHistory.previous, cloudOutputUpscaled,
 		cloudDepthUpscaled, cloudVisibilityUpscaled](CommandList& list, RenderPassResources& resources)
 	{
 		auto upscaleLayout = RenderPipelineLayout{}
@@ -383,7 +828,7 @@ CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, cons
 
 		bindData.cameraBuffer = resources.Get(cameraBuffer);
 		bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
-		bindData.timeSlice = Renderer::Get().GetAppFrame() % 16;
+		bindData.timeSlice = timeSlice;
 		bindData.geometryDepthTexture = resources.Get(depthStencil);
 		bindData.newScatteringTransmittanceTexture = resources.Get(cloudOutput);
 		bindData.newDepthTexture = resources.Get(cloudDepth);
@@ -411,9 +856,5 @@ CloudResources Clouds::Render(RenderGraph& graph, entt::registry& registry, cons
 		list.Dispatch(dispatchX, dispatchY, 1);
 	});
 
-	lastFrameScatteringUpscaled = cloudOutputUpscaled;
-	lastFrameDepthUpscaled = cloudDepthUpscaled;
-	lastFrameVisibilityUpscaled = cloudVisibilityUpscaled;
-
-	return { cloudOutputUpscaled, cloudDepthUpscaled, cloudVisibilityUpscaled, cirrusTag, weatherTag };
+	return { cloudOutputUpscaled, cloudDepthUpscaled, cloudVisibilityUpscaled, cirrusTag, weatherTag, cloudShadowTag };
 }
\ No newline at end of file
@@ -5,11 +5,21 @@
 #include <Rendering/RenderPipeline.h>
 #include <Rendering/RenderGraphResource.h>
 #include <Rendering/ResourceHandle.h>
+#include <Asset/TextureLoader.h>
+#include <Core/ConsoleVariable.h>
+#include <Utility/ResourcePtr.h>
+
+#include <D3D12MemAlloc.h>
+
+#include <filesystem>
+#include <optional>
+#include <vector>
 
 class RenderDevice;
 class RenderGraph;
 class CommandList;
 class Atmosphere;
+class JobCounter;
 
 struct CloudResources
 {
@@ -18,6 +28,7 @@ struct CloudResources
 	RenderResource cloudsVisibilityMap;
 	RenderResource cloudsCirrus;
 	RenderResource weather;
+	RenderResource cloudShadow;
 };
 
 class Clouds
@@ -27,39 +38,96 @@ public:
 	float precipitation = 0.3f;
 	float windStrength = 0.2f;
 	XMFLOAT2 windDirection = { 1, 0 };
+	float dynamicScale = 1.f;  // Dynamic resolution, applied on top of the cloud render scale.
 
 private:
 	RenderDevice* device;
 
-	bool dirty = true;
+	bool dirty = true;  // Needs to generate the shape noise.
+
+	CvarHandle<int> rayMarchQuality;
+	CvarHandle<float> renderScale;
+	CvarHandle<int> debugMarchCount;
+	CvarHandle<int> tileClassification;
+
+	// Weather parameters of the last generation, the weather texture is only regenerated when they change.
+	float weatherCoverage = -1.f;
+	float weatherPrecipitation = -1.f;
+	// Sun angle of the last cloud shadow generation. The shadow map lives in weather texture space, so the wind scroll
+	// is applied at lookup and only sun or weather changes require regenerating it.
+	float shadowSolarZenithAngle = -100.f;
 
 	static const int weatherSize = 1024;
 	static_assert(weatherSize % 8 == 0, "Weather size must be evenly divisible by 8.");
+	static const int cloudShadowSize = 512;
+	static_assert(cloudShadowSize % 8 == 0, "Cloud shadow size must be evenly divisible by 8.");
+	static const uint32_t baseShapeNoiseSize = 128;
+	static const uint32_t detailShapeNoiseSize = 32;
+
+	// The shape noise is generated once and cached on disk, with the base shape's mips block compressed. Later runs load
+	// the cache instead of generating. Cache misses read the noise back after generating.
+	static constexpr uint32_t noiseCacheVersion = 1;  // Increment when the shape noise shaders change.
+
+	struct NoiseReadback
+	{
+		ResourcePtr<D3D12MA::Allocation> allocation;
+		std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints;  // Base shape mips, then the detail shape.
+		uint32_t readyFrame;  // The copy's frame has retired.
+	};
+
+	std::optional<NoiseReadback> noiseReadback;
+
+	// Read by startup jobs, created once they're done. The cached noise is empty when the cache is missing or corrupt.
+	std::vector<std::vector<std::byte>> cachedBaseNoise;  // Each mip.
+	std::vector<std::byte> cachedDetailNoise;
+	std::optional<AssetLoader::TextureImage> cirrusImage;
+
+	std::filesystem::path GetNoiseCachePath() const;
+	void ReadNoiseCache();
+	bool CreateCachedNoise();
+	void ReadbackNoise(CommandList& list);
+	void SaveNoiseCache();
 
 	RenderPipelineLayout weatherLayout;
 	RenderPipelineLayout baseNoiseLayout;
 	RenderPipelineLayout detailNoiseLayout;
+	RenderPipelineLayout cloudsLayout;
+	RenderPipelineLayout cloudsTiledLayout;
+	RenderPipelineLayout visibilityLayout;
+	RenderPipelineLayout shadowLayout;
+	RenderPipelineLayout tileClassificationLayout;
+
+	// Draws one instance per cloud tile that needs marching, the instance count is written by the tile classification.
+	ResourcePtr<ID3D12CommandSignature> tileDrawSignature;
 
 	TextureHandle weather;  // 2D, channels: coverage, type, precipitation.
 	// Schneider separates density noise into FBM components and composes them while
 	// raymarching, but we can merge them here to reduce memory bandwidth at no fidelty
 	// loss (see frostbite slides).
-	TextureHandle baseShapeNoise;  // 3D, single channel.
+	TextureHandle baseShapeNoise;  // 3D, single channel. BC4 when loaded from the cache.
 	TextureHandle detailShapeNoise;  // 3D, single channel.
 
 	// Cirrus clouds are not raymarched, they come from a painted texture.
 	TextureHandle cirrusClouds;
 
-	RenderResource lastFrameScatteringUpscaled;
-	RenderResource lastFrameDepthUpscaled;
-	RenderResource lastFrameVisibilityUpscaled;
+	// Top-down optical depth towards the sun, tiling with the weather texture. Replaces per-pixel weather
+	// marching in the forward and atmosphere passes with a single fetch.
+	TextureHandle cloudShadow;  // 2D, single channel.
 
 	void GenerateWeather(CommandList& list, uint32_t weatherTexture);
 	void GenerateNoise(CommandList& list, uint32_t baseShapeTexture, uint32_t detailShapeTexture);
+	void GenerateShadow(CommandList& list, uint32_t weatherTexture, uint32_t shadowTexture, float solarZenithAngle);
 
 public:
 	~Clouds();
 
-	void Initialize(RenderDevice* inDevice);
-	CloudResources Render(RenderGraph& graph, entt::registry& registry, const Atmosphere& atmosphere, const RenderResource cameraBuffer, const RenderResource depthStencil, const RenderResource atmosphereIrradiance);
+	// Reads the noise cache and cirrus texture as startup jobs.
+	void Initialize(RenderDevice* inDevice, JobCounter& startupJobs);
+	// Creates the noise and cirrus textures, once the startup jobs are done.
+	void FinishInitialize();
+	// UV offset that advects the weather texture with the wind, for passes without wind and time.
+	XMFLOAT2 GetWeatherScroll() const;
+	// Without a Hi-Z of the current frame's depth, every tile is marched.
+	CloudResources Render(RenderGraph& graph, entt::registry& registry, const Atmosphere& atmosphere, const RenderResource cameraBuffer, const RenderResource depthStencil,
+		const RenderResource atmosphereIrradiance, std::optional<RenderResource> hiZ);
 };
\ No newline at end of file
@@ -10,19 +10,45 @@
 #include <Rendering/RenderComponents.h>
 #include <Rendering/ShaderStructs.h>
 #include <Rendering/RenderComponents.h>
-#include <Rendering/RenderSystems.h>
 #include <Core/CoreComponents.h>
 #include <Rendering/RenderUtils.h>
 
+#include <algorithm>
+#include <cstring>
+
+void ClusteredLightCulling::CreatePipelines()
+{
+	boundsLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Clusters/ClusterBounds.hlsl", "Main" })
+		.Macro({ "FROXEL_SIZE", *froxelSize });
+
+	depthCullLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Clusters/ClusterDepthCulling.hlsl", "Main" })
+		.Macro({ "FROXEL_SIZE", *froxelSize });
+
+	binningLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Clusters/ClusterLightBinning.hlsl", "Main" })
+		.Macro({ "MAX_LIGHTS_PER_FROXEL", *maxLightsPerFroxel });
+
+#if ENABLE_EDITOR
+	debugOverlayLayout = RenderPipelineLayout{}
+		.VertexShader({ "Clusters/ClusterDebugOverlay.hlsl", "VSMain" })
+		.PixelShader({ "Clusters/ClusterDebugOverlay.hlsl", "PSMain" })
+		.DepthEnabled(false)
+		.Macro({ "FROXEL_SIZE", *froxelSize })
+		.Macro({ "MAX_LIGHTS_PER_FROXEL", *maxLightsPerFroxel });
+#endif
+}
+
 ClusterGridInfo ClusteredLightCulling::ComputeGridInfo(const entt::registry& registry) const
 {
 	// Make sure there's at least one camera.
 	if (!registry.size<CameraComponent>())
 	{
-		return { 0, 0, 0, 0.f };
+		return { 0, 0, 0, 0.f, *froxelSize, 0 };
 	}
 
-	const auto& backBufferComponent = device->GetResourceManager().Get(device->GetBackBuffer());
+	const auto [sceneWidth, sceneHeight] = Renderer::Get().GetSceneResolution();
 
 	float cameraNearPlane;
 	float cameraFarPlane;
@@ -34,20 +60,25 @@ ClusterGridInfo ClusteredLightCulling::ComputeGridInfo(const entt::registry& reg
 		cameraFOV = camera.fieldOfView;
 	});
 
-	const auto froxelSize = *CvarGet("clusteredFroxelSize", int);
-	const auto x = static_cast<uint32_t>(std::ceil(backBufferComponent.description.width / (float)froxelSize));
-	const auto y = static_cast<uint32_t>(std::ceil(backBufferComponent.description.height / (float)froxelSize));
+	const auto x = static_cast<uint32_t>(std::ceil(sceneWidth / (float)*froxelSize));
+	const auto y = static_cast<uint32_t>(std::ceil(sceneHeight / (float)*froxelSize));
 	const float depthFactor = 1.f + (2.f * std::tan(cameraFOV / 4.f) / (float)y);
 	const auto z = static_cast<uint32_t>(std::floor(std::log(cameraFarPlane / cameraNearPlane) / std::log(depthFactor)));
 
-	return { x, y, z, depthFactor };
+	uint32_t volumetricZ = 0;
+	if (volumetricDistance > cameraNearPlane)
+	{
+		volumetricZ = std::min(static_cast<uint32_t>(std::ceil(std::log(volumetricDistance / cameraNearPlane) / std::log(depthFactor))), z);
+	}
+
+	return { x, y, z, depthFactor, *froxelSize, volumetricZ };
 }
 
 void ClusteredLightCulling::ComputeClusterGrid(CommandList& list, const RenderPipelineLayout& boundsLayout, uint32_t cameraBuffer, uint32_t clusterBoundsBuffer) const
 {
 	constexpr auto groupSize = 8;
 
-	const auto& backBufferComponent = device->GetResourceManager().Get(device->GetBackBuffer());
+	const auto [sceneWidth, sceneHeight] = Renderer::Get().GetSceneResolution();
 
 	struct BindData
 	{
@@ -66,8 +97,8 @@ void ClusteredLightCulling::ComputeClusterGrid(CommandList& list, const RenderPi
 	bindData.gridDimensionsY = gridInfo.y;
 	bindData.gridDimensionsZ = gridInfo.z;
 	bindData.nearK = gridInfo.depthFactor;
-	bindData.resolutionX = backBufferComponent.description.width;
-	bindData.resolutionY = backBufferComponent.description.height;
+	bindData.resolutionX = sceneWidth;
+	bindData.resolutionY = sceneHeight;
 	bindData.cameraBuffer = cameraBuffer;
 	bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
 	bindData.boundsBuffer = clusterBoundsBuffer;
@@ -77,33 +108,47 @@ void ClusteredLightCulling::ComputeClusterGrid(CommandList& list, const RenderPi
 	list.Dispatch(std::ceil(gridInfo.x * gridInfo.y * gridInfo.z / 64.f), 1, 1);
 }
 
+void ClusteredLightCulling::AllocateClusterBounds(uint32_t froxelCount)
+{
+	auto& resourceManager = device->GetResourceManager();
+
+	if (resourceManager.Valid(clusterBounds))
+	{
+		resourceManager.AddFrameResource(device->GetFrameIndex(), clusterBounds);  // Could still be in use by the GPU.
+	}
+
+	BufferDescription clusterBoundsDesc{};
+	clusterBoundsDesc.updateRate = ResourceFrequency::Static;
+	clusterBoundsDesc.bindFlags = BindFlag::UnorderedAccess | BindFlag::ShaderResource;
+	clusterBoundsDesc.accessFlags = AccessFlag::GPUWrite;
+	clusterBoundsDesc.size = froxelCount;
+	clusterBoundsDesc.stride = 32;
+
+	clusterBounds = resourceManager.Create(clusterBoundsDesc, VGText("Cluster bounds"));
+	dirty = true;
+}
+
 ClusteredLightCulling::~ClusteredLightCulling()
 {
-	device->GetResourceManager().Destroy(clusterBounds);
+	if (device->GetResourceManager().Valid(clusterBounds))
+	{
+		device->GetResourceManager().Destroy(clusterBounds);
+	}
 }
 
 void ClusteredLightCulling::Initialize(RenderDevice* inDevice)
 {
 	VGScopedCPUStat("Clustered Light Culling Initialize");
 
-	CvarCreate("maxLightsPerFroxel", "Max number of lights per froxel bin in light culling", 256);  // Can reduce this to save memory.
-	CvarCreate("clusteredFroxelSize", "Width and height of a froxel bin in light culling, in pixels", 64);
+	maxLightsPerFroxel = CvarCreate("maxLightsPerFroxel", "Max number of lights per froxel bin in light culling", 256);  // Can reduce this to save memory.
+	froxelSize = CvarCreate("clusteredFroxelSize", "Width and height of a froxel bin in light culling, in pixels", 64);
+	lightIndexDensity = CvarCreate("clusterLightIndexDensity", "Average lights per froxel the shared light index list is sized for, bins past the budget lose their lights", 32);
+	froxelSizeGeneration = froxelSize.Generation();
+	maxLightsPerFroxelGeneration = maxLightsPerFroxel.Generation();
 
 	device = inDevice;
 
-	// #TODO: Dynamically reallocate.
-	constexpr auto maxDivisionsX = 60;
-	constexpr auto maxDivisionsY = 34;
-	constexpr auto maxDivisionsZ = 280;
-
-	BufferDescription clusterBoundsDesc{};
-	clusterBoundsDesc.updateRate = ResourceFrequency::Static;
-	clusterBoundsDesc.bindFlags = BindFlag::UnorderedAccess | BindFlag::ShaderResource;
-	clusterBoundsDesc.accessFlags = AccessFlag::GPUWrite;
-	clusterBoundsDesc.size = maxDivisionsX * maxDivisionsY * maxDivisionsZ;
-	clusterBoundsDesc.stride = 32;
-
-	clusterBounds = device->GetResourceManager().Create(clusterBoundsDesc, VGText("Cluster bounds"));
+	CreatePipelines();
 
 	std::vector<D3D12_INDIRECT_ARGUMENT_DESC> binningIndirectArgDescs;
 	binningIndirectArgDescs.emplace_back(D3D12_INDIRECT_ARGUMENT_DESC{
@@ -123,16 +168,32 @@ void ClusteredLightCulling::Initialize(RenderDevice* inDevice)
 	}
 }
 
-ClusterResources ClusteredLightCulling::Render(RenderGraph& graph, const entt::registry& registry, RenderResource cameraBuffer, RenderResource depthStencil, RenderResource lightsBuffer, RenderResource instanceBuffer, MeshResources meshResources, RenderResource meshIndirectRenderArgs)
+ClusterResources ClusteredLightCulling::Render(RenderGraph& graph, const entt::registry& registry, RenderResource cameraBuffer, RenderResource cullingViewBuffer, RenderResource depthStencil, RenderResource lightsBuffer, uint32_t lightSlots)
 {
 	VGScopedCPUStat("Clustered Light Culling");
 
+	const auto froxelSizeChanged = froxelSize.Changed(froxelSizeGeneration);
+	const auto maxLightsChanged = maxLightsPerFroxel.Changed(maxLightsPerFroxelGeneration);
+	if (froxelSizeChanged || maxLightsChanged)
+	{
+		CreatePipelines();
+		dirty |= froxelSizeChanged;  // The cluster bounds depend on the froxel size.
+	}
+
 	gridInfo = ComputeGridInfo(registry);
 	if (gridInfo.x == 0 || gridInfo.y == 0 || gridInfo.z == 0)
 	{
 		return {};
 	}
 
+	const auto froxelCount = gridInfo.x * gridInfo.y * gridInfo.z;
+
+	// The grid follows the render resolution, froxel size and camera planes.
+	if (!device->GetResourceManager().Valid(clusterBounds) || device->GetResourceManager().Get(clusterBounds).description.size != froxelCount)
+	{
+		AllocateClusterBounds(froxelCount);
+	}
+
 	const auto clusterBoundsTag = graph.Import(clusterBounds);
 
 	if (dirty)
@@ -142,10 +203,6 @@ ClusterResources ClusteredLightCulling::Render(RenderGraph& graph, const entt::r
 		computeClusterGridPass.Write(clusterBoundsTag, ResourceBind::UAV);
 		computeClusterGridPass.Bind([&, cameraBuffer, clusterBoundsTag](CommandList& list, RenderPassResources& resources)
 		{
-			const auto boundsLayout = RenderPipelineLayout{}
-				.ComputeShader({ "Clusters/ClusterBounds.hlsl", "Main" })
-				.Macro({ "FROXEL_SIZE", *CvarGet("clusteredFroxelSize", int) });
-
 			ComputeClusterGrid(list, boundsLayout, resources.Get(cameraBuffer), resources.Get(clusterBoundsTag));
 		});
 
@@ -155,125 +212,88 @@ ClusterResources ClusteredLightCulling::Render(RenderGraph& graph, const entt::r
 	BufferView clusterVisibilityView{};
 	clusterVisibilityView.UAV("uav_visible");
 	clusterVisibilityView.UAV("uav_nonvisible", 0, 0, HeapType::NonVisible);
+	BufferView indirectBufferView;
+	indirectBufferView.UAV("uav_visible");
+	indirectBufferView.UAV("uav_nonvisible", 0, 0, HeapType::NonVisible);
 
-	auto& clusterDepthCullingPass = graph.AddPass("Cluster Depth Culling", ExecutionQueue::Graphics);
+	// Every lit surface is in the depth buffer, so visibility comes from a single read of each depth texel instead of drawing
+	// the geometry again. Each group owns a column of clusters, and compacts the active ones straight into the binning list.
+	auto& clusterDepthCullingPass = graph.AddPass("Cluster Depth Culling", ExecutionQueue::Compute);
 	clusterDepthCullingPass.Read(cameraBuffer, ResourceBind::SRV);
-	clusterDepthCullingPass.Read(depthStencil, ResourceBind::DSV);
-	clusterDepthCullingPass.Read(instanceBuffer, ResourceBind::SRV);
-	clusterDepthCullingPass.Read(meshResources.positionTag, ResourceBind::SRV);
-	clusterDepthCullingPass.Read(meshIndirectRenderArgs, ResourceBind::Indirect);
+	clusterDepthCullingPass.Read(depthStencil, ResourceBind::SRV);
 	const auto clusterVisibilityTag = clusterDepthCullingPass.Create(TransientBufferDescription{
 		.updateRate = ResourceFrequency::Static,  // Must be static for UAVs.
 		.size = gridInfo.x * gridInfo.y * gridInfo.z,
 		.format = DXGI_FORMAT_R8_UINT
 	}, VGText("Cluster visibility"));
 	clusterDepthCullingPass.Write(clusterVisibilityTag, clusterVisibilityView);
-	clusterDepthCullingPass.Bind([&, cameraBuffer, instanceBuffer, meshResources, meshIndirectRenderArgs, clusterVisibilityTag](CommandList& list, RenderPassResources& resources)
+	const auto denseClustersTag = clusterDepthCullingPass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // UAVs.
+		.size = gridInfo.x * gridInfo.y * gridInfo.z,  // Worst case.
+		.stride = sizeof(uint32_t)
+	}, VGText("Compacted cluster list"));
+	clusterDepthCullingPass.Write(denseClustersTag, ResourceBind::UAV);
+	const auto indirectBufferTag = clusterDepthCullingPass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // UAVs.
+		.size = 1,
+		.stride = sizeof(D3D12_DISPATCH_ARGUMENTS)
+	}, VGText("Cluster binning indirect argument buffer"));
+	clusterDepthCullingPass.Write(indirectBufferTag, indirectBufferView);
+	clusterDepthCullingPass.Bind([&, cameraBuffer, depthStencil, clusterVisibilityTag, denseClustersTag, indirectBufferTag](CommandList& list, RenderPassResources& resources)
 	{
-		const auto depthCullLayout = RenderPipelineLayout{}
-			.VertexShader({ "Clusters/ClusterDepthCulling.hlsl", "VSMain" })
-			.PixelShader({ "Clusters/ClusterDepthCulling.hlsl", "PSMain" })
-			.CullMode(D3D12_CULL_MODE_NONE)  // Transparents can't have back culling.
-			.DepthEnabled(true, false, DepthTestFunction::GreaterEqual)  // Opaque and transparents receive lighting, so they cannot be culled.
-			.Macro({ "FROXEL_SIZE", *CvarGet("clusteredFroxelSize", int) });
-
+		// Culling counts the active clusters straight into the binning dispatch.
 		RenderUtils::Get().ClearUAV(list, resources.GetBuffer(clusterVisibilityTag), resources.Get(clusterVisibilityTag, "uav_visible"), resources.GetDescriptor(clusterVisibilityTag, "uav_nonvisible"));
+		RenderUtils::Get().ClearUAV(list, resources.GetBuffer(indirectBufferTag), resources.Get(indirectBufferTag, "uav_visible"), resources.GetDescriptor(indirectBufferTag, "uav_nonvisible"));
 
 		list.UAVBarrier(resources.GetBuffer(clusterVisibilityTag));
+		list.UAVBarrier(resources.GetBuffer(indirectBufferTag));
 		list.FlushBarriers();
 
+		list.BindPipeline(depthCullLayout);
+
 		struct {
-			uint32_t batchId;
-			uint32_t objectBuffer;
 			uint32_t cameraBuffer;
 			uint32_t cameraIndex;
-			uint32_t vertexPositionBuffer;
+			uint32_t depthTexture;
 			uint32_t visibilityBuffer;
 			float logY;
-			float padding;
 			int32_t dimensions[3];
+			uint32_t denseListBuffer;
+			uint32_t volumetricSlices;
+			uint32_t indirectBuffer;
 		} bindData;
 
-		bindData.objectBuffer = resources.Get(instanceBuffer);
 		bindData.cameraBuffer = resources.Get(cameraBuffer);
-		bindData.vertexPositionBuffer = resources.Get(meshResources.positionTag);
+		bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
+		bindData.depthTexture = resources.Get(depthStencil);
 		bindData.visibilityBuffer = resources.Get(clusterVisibilityTag, "uav_visible");
+		bindData.logY = 1.f / std::log(gridInfo.depthFactor);
 		bindData.dimensions[0] = gridInfo.x;
 		bindData.dimensions[1] = gridInfo.y;
 		bindData.dimensions[2] = gridInfo.z;
-		bindData.logY = 1.f / std::log(gridInfo.depthFactor);
-
-		list.BindPipeline(depthCullLayout);
-
-		MeshSystem::Render(Renderer::Get(), registry, list, bindData, resources.GetBuffer(meshIndirectRenderArgs));
-	});
-
-	auto& clusterCompaction = graph.AddPass("Visible Cluster Compaction", ExecutionQueue::Compute);
-	clusterCompaction.Read(clusterVisibilityTag, ResourceBind::SRV);
-	const auto denseClustersTag = clusterCompaction.Create(TransientBufferDescription{
-		.updateRate = ResourceFrequency::Static,  // UAVs.
-		.size = gridInfo.x * gridInfo.y * gridInfo.z,  // Worst case.
-		.stride = sizeof(uint32_t),
-		.uavCounter = true
-	}, VGText("Compacted cluster list"));
-	clusterCompaction.Write(denseClustersTag, ResourceBind::UAV);
-	const auto indirectBufferTag = clusterCompaction.Create(TransientBufferDescription{
-		.updateRate = ResourceFrequency::Static,  // UAVs.
-		.size = 1,
-		.stride = sizeof(D3D12_DISPATCH_ARGUMENTS)
-	}, VGText("Cluster binning indirect argument buffer"));
-	clusterCompaction.Write(indirectBufferTag, ResourceBind::UAV);
-	clusterCompaction.Bind([&, clusterVisibilityTag, denseClustersTag, indirectBufferTag](CommandList& list, RenderPassResources& resources)
-	{
-		const auto compactionLayout = RenderPipelineLayout{}
-			.ComputeShader({ "Clusters/ClusterCompaction.hlsl", "Main" });
-
-		const auto 	indirectGenerationLayout = RenderPipelineLayout{}
-			.ComputeShader({ "Clusters/ClusterIndirectBufferGeneration.hlsl", "Main" });
-
-		auto& denseClustersComponent = device->GetResourceManager().Get(resources.GetBuffer(denseClustersTag));
-
-		list.BindPipeline(compactionLayout);
-
-		struct BindData
-		{
-			int32_t gridDimensionsX;
-			int32_t gridDimensionsY;
-			int32_t gridDimensionsZ;
-			uint32_t visibilityBuffer;
-			uint32_t denseListBuffer;
-		} bindData;
-
-		bindData.gridDimensionsX = gridInfo.x;
-		bindData.gridDimensionsY = gridInfo.y;
-		bindData.gridDimensionsZ = gridInfo.z;
-		bindData.visibilityBuffer = resources.Get(clusterVisibilityTag);
 		bindData.denseListBuffer = resources.Get(denseClustersTag);
+		bindData.volumetricSlices = gridInfo.volumetricZ;
+		bindData.indirectBuffer = resources.Get(indirectBufferTag, "uav_visible");
 
 		list.BindConstants("bindData", bindData);
 
-		uint32_t dispatchSize = static_cast<uint32_t>(std::ceil(gridInfo.x * gridInfo.y * gridInfo.z / 64.f));
-		list.Dispatch(dispatchSize, 1, 1);
+		// One group per froxel tile.
+		list.Dispatch(gridInfo.x, gridInfo.y, 1);
 
-		// Ensure that the compaction has finished.
-		list.UAVBarrier(resources.GetBuffer(denseClustersTag));
-		list.FlushBarriers();
-
-		struct IndirectBindData
+		if (device->GetProfiler().CollectingStatistics())
 		{
-			uint32_t denseClusterListBuffer;
-			uint32_t indirectBuffer;
-		} indirectBindData;
-
-		indirectBindData.denseClusterListBuffer = resources.Get(denseClustersTag);
-		indirectBindData.indirectBuffer = resources.Get(indirectBufferTag);
-
-		// Generate the indirect argument buffer.
-		list.BindPipeline(indirectGenerationLayout);
-		list.BindConstants("bindData", indirectBindData);
-		list.Dispatch(1, 1, 1);
+			// The dispatch's group count is the number of active clusters.
+			device->GetProfiler().ReadCounter(list, device->GetFrameIndex(), "Visible clusters", resources.GetBuffer(indirectBufferTag),
+				static_cast<uint32_t>(gridInfo.x * gridInfo.y * gridInfo.z));
+		}
 	});
 
+	BufferView visibleLightCounterView;
+	visibleLightCounterView.UAV("uav_visible");
+	visibleLightCounterView.UAV("uav_nonvisible", 0, 0, HeapType::NonVisible);
+	BufferView directionalLightListView;
+	directionalLightListView.UAV("uav_visible");
+	directionalLightListView.UAV("uav_nonvisible", 0, 0, HeapType::NonVisible);
 	BufferView lightCounterView;
 	lightCounterView.UAV("uav_visible");
 	lightCounterView.UAV("uav_nonvisible", 0, 0, HeapType::NonVisible);
@@ -281,78 +301,161 @@ ClusterResources ClusteredLightCulling::Render(RenderGraph& graph, const entt::r
 	lightInfoView.UAV("uav_visible");
 	lightInfoView.UAV("uav_nonvisible", 0, 0, HeapType::NonVisible);
 
-	auto& binningPass = graph.AddPass("Light Binning", ExecutionQueue::Compute);
-	binningPass.Read(denseClustersTag, ResourceBind::SRV);
-	binningPass.Read(clusterBoundsTag, ResourceBind::SRV);
-	binningPass.Read(lightsBuffer, ResourceBind::SRV);
-	const auto lightCounterTag = binningPass.Create(TransientBufferDescription{
+	// Transform and frustum cull the lights once, instead of in every froxel.
+	auto& lightCullingPass = graph.AddPass("Light Culling", ExecutionQueue::Compute);
+	lightCullingPass.Read(cullingViewBuffer, ResourceBind::SRV);
+	lightCullingPass.Read(lightsBuffer, ResourceBind::SRV);
+	const auto visibleLightsTag = lightCullingPass.Create(TransientBufferDescription{
 		.updateRate = ResourceFrequency::Static,
-		.size = 1,
+		.size = std::max(lightSlots, 1u),  // Worst case.
+		.stride = sizeof(XMFLOAT4) * 3  // See VisibleLight in Clusters.hlsli.
+	}, VGText("Visible light list"));
+	lightCullingPass.Write(visibleLightsTag, ResourceBind::UAV);
+	// Padded to the 64 bits binning is predicated on.
+	const auto visibleLightCounterTag = lightCullingPass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.size = 2,
 		.stride = sizeof(uint32_t)
-	}, VGText("Cluster binning light counter"));
-	binningPass.Write(lightCounterTag, lightCounterView);
-	const auto lightListTag = binningPass.Create(TransientBufferDescription{
+	}, VGText("Visible light counter"));
+	lightCullingPass.Write(visibleLightCounterTag, visibleLightCounterView);
+	const auto directionalLightListTag = lightCullingPass.Create(TransientBufferDescription{
 		.updateRate = ResourceFrequency::Static,
-		.size = gridInfo.x * gridInfo.y * gridInfo.z * *CvarGet("maxLightsPerFroxel", int),
+		.size = lightSlots + 1,  // Count and worst case.
 		.stride = sizeof(uint32_t)
-	}, VGText("Cluster binning light list"));
-	binningPass.Write(lightListTag, ResourceBind::UAV);
-	const auto lightInfoTag = binningPass.Create(TransientBufferDescription{
+	}, VGText("Directional light list"));
+	lightCullingPass.Write(directionalLightListTag, directionalLightListView);
+	// Binning is skipped when no light is visible, so its outputs are cleared here instead.
+	const auto lightCounterTag = lightCullingPass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.size = 1,
+		.stride = sizeof(uint32_t)
+	}, VGText("Cluster binning light counter"));
+	lightCullingPass.Write(lightCounterTag, lightCounterView);
+	const auto lightInfoTag = lightCullingPass.Create(TransientBufferDescription{
 		.updateRate = ResourceFrequency::Static,
 		.size = gridInfo.x * gridInfo.y * gridInfo.z,
 		.stride = sizeof(uint32_t) * 2
 	}, VGText("Cluster grid light info"));
-	binningPass.Write(lightInfoTag, lightInfoView);
-	binningPass.Read(indirectBufferTag, ResourceBind::Indirect);
-	binningPass.Read(cameraBuffer, ResourceBind::SRV);  // #TODO: Precompute view space light positions.
-	binningPass.Bind([&, denseClustersTag, clusterBoundsTag, lightsBuffer, lightCounterTag,
-		lightListTag, lightInfoTag, indirectBufferTag, cameraBuffer](CommandList& list, RenderPassResources& resources)
+	lightCullingPass.Write(lightInfoTag, lightInfoView);
+	lightCullingPass.Bind([&, cullingViewBuffer, lightsBuffer, lightSlots, visibleLightsTag, visibleLightCounterTag, directionalLightListTag,
+		lightCounterTag, lightInfoTag](CommandList& list, RenderPassResources& resources)
 	{
-		const auto binningLayout = RenderPipelineLayout{}
-			.ComputeShader({ "Clusters/ClusterLightBinning.hlsl", "Main" })
-			.Macro({ "MAX_LIGHTS_PER_FROXEL", *CvarGet("maxLightsPerFroxel", int) });
+		const auto lightCullingLayout = RenderPipelineLayout{}
+			.ComputeShader({ "Clusters/ClusterLightCulling.hlsl", "Main" });
 
+		RenderUtils::Get().ClearUAV(list, resources.GetBuffer(visibleLightCounterTag), resources.Get(visibleLightCounterTag, "uav_visible"), resources.GetDescriptor(visibleLightCounterTag, "uav_nonvisible"));
+		RenderUtils::Get().ClearUAV(list, resources.GetBuffer(directionalLightListTag), resources.Get(directionalLightListTag, "uav_visible"), resources.GetDescriptor(directionalLightListTag, "uav_nonvisible"));
 		RenderUtils::Get().ClearUAV(list, resources.GetBuffer(lightCounterTag), resources.Get(lightCounterTag, "uav_visible"), resources.GetDescriptor(lightCounterTag, "uav_nonvisible"));
 		RenderUtils::Get().ClearUAV(list, resources.GetBuffer(lightInfoTag), resources.Get(lightInfoTag, "uav_visible"), resources.GetDescriptor(lightInfoTag, "uav_nonvisible"));
 
-		list.UAVBarrier(resources.GetBuffer(lightCounterTag));
-		list.UAVBarrier(resources.GetBuffer(lightInfoTag));
+		list.UAVBarrier(resources.GetBuffer(visibleLightCounterTag));
+		list.UAVBarrier(resources.GetBuffer(directionalLightListTag));
 		list.FlushBarriers();
 
-		list.BindPipeline(binningLayout);
-
-		auto& lightComponent = device->GetResourceManager().Get(resources.GetBuffer(lightsBuffer));
+		list.BindPipeline(lightCullingLayout);
 
 		struct BindData
 		{
-			uint32_t cameraBuffer;
+			uint32_t cullingViewBuffer;
 			uint32_t cameraIndex;
-			uint32_t denseClusterListBuffer;
-			uint32_t clusterBoundsBuffer;
 			uint32_t lightsBuffer;
 			uint32_t lightCount;
+			uint32_t visibleLightsBuffer;
+			uint32_t visibleLightCounterBuffer;
+			uint32_t directionalLightListBuffer;
+		} bindData;
+
+		bindData.cullingViewBuffer = resources.Get(cullingViewBuffer);
+		bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
+		bindData.lightsBuffer = resources.Get(lightsBuffer);
+		bindData.lightCount = lightSlots;  // Including free slots.
+		bindData.visibleLightsBuffer = resources.Get(visibleLightsTag);
+		bindData.visibleLightCounterBuffer = resources.Get(visibleLightCounterTag, "uav_visible");
+		bindData.directionalLightListBuffer = resources.Get(directionalLightListTag, "uav_visible");
+
+		list.BindConstants("bindData", bindData);
+
+		list.Dispatch(std::max((uint32_t)std::ceil(bindData.lightCount / 64.f), 1u), 1, 1);
+	});
+
+	auto& binningPass = graph.AddPass("Light Binning", ExecutionQueue::Compute);
+	binningPass.Read(denseClustersTag, ResourceBind::SRV);
+	binningPass.Read(clusterBoundsTag, ResourceBind::SRV);
+	binningPass.Read(visibleLightsTag, ResourceBind::SRV);
+	binningPass.Read(visibleLightCounterTag, ResourceBind::SRV);
+	binningPass.Predicate(visibleLightCounterTag);
+	binningPass.Write(lightCounterTag, ResourceBind::UAV);
+	// Bins are variable length ranges of one shared index list, sized for the average bin rather than the fullest. A froxel
+	// never holds more lights than exist.
+	const auto lightsPerFroxel = std::min({ std::max(*lightIndexDensity, 1), *maxLightsPerFroxel, static_cast<int>(std::max(lightSlots, 1u)) });
+	const auto lightListCapacity = froxelCount * static_cast<uint32_t>(lightsPerFroxel);
+	const auto lightListTag = binningPass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.size = lightListCapacity,
+		.stride = sizeof(uint32_t)
+	}, VGText("Cluster binning light list"));
+	binningPass.Write(lightListTag, ResourceBind::UAV);
+	binningPass.Write(lightInfoTag, ResourceBind::UAV);
+	binningPass.Read(indirectBufferTag, ResourceBind::Indirect);
+	binningPass.Bind([&, denseClustersTag, clusterBoundsTag, visibleLightsTag, visibleLightCounterTag, lightCounterTag,
+		lightListTag, lightListCapacity, lightInfoTag, indirectBufferTag](CommandList& list, RenderPassResources& resources)
+	{
+		list.BindPipeline(binningLayout);
+
+		struct BindData
+		{
+			uint32_t denseClusterListBuffer;
+			uint32_t clusterBoundsBuffer;
+			uint32_t visibleLightsBuffer;
+			uint32_t visibleLightCounterBuffer;
 			uint32_t lightCounterBuffer;
 			uint32_t lightListBuffer;
 			uint32_t lightInfoBuffer;
+			uint32_t lightListCapacity;
 		} bindData;
 
-		bindData.cameraBuffer = resources.Get(cameraBuffer);
-		bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
 		bindData.denseClusterListBuffer = resources.Get(denseClustersTag);
 		bindData.clusterBoundsBuffer = resources.Get(clusterBoundsTag);
-		bindData.lightsBuffer = resources.Get(lightsBuffer);
-		bindData.lightCount = lightComponent.description.size;
-		bindData.lightCounterBuffer = resources.Get(lightCounterTag, "uav_visible");
+		bindData.visibleLightsBuffer = resources.Get(visibleLightsTag);
+		bindData.visibleLightCounterBuffer = resources.Get(visibleLightCounterTag);
+		bindData.lightCounterBuffer = resources.Get(lightCounterTag);
 		bindData.lightListBuffer = resources.Get(lightListTag);
-		bindData.lightInfoBuffer = resources.Get(lightInfoTag, "uav_visible");
+		bindData.lightInfoBuffer = resources.Get(lightInfoTag);
+		bindData.lightListCapacity = lightListCapacity;
 
 		list.BindConstants("bindData", bindData);
 
 		auto& indirectComponent = device->GetResourceManager().Get(resources.GetBuffer(indirectBufferTag));
 		list.Native()->ExecuteIndirect(binningIndirectSignature.Get(), 1, indirectComponent.allocation->GetResource(), 0, nullptr, 0);
+
+#if ENABLE_EDITOR
+		// The readback's copy has to run even when binning is skipped, the counter is then still cleared.
+		list.ClearPredication();
+		device->GetResourceManager().RequestReadback(list, resources.GetBuffer(lightCounterTag), 0, sizeof(uint32_t), [this, lightListCapacity](auto data)
+		{
+			uint32_t count;
+			std::memcpy(&count, data.data(), sizeof(count));
+			lightListOccupancy = { count, lightListCapacity };
+		});
+#endif
 	});
 
-	return { lightListTag, lightInfoTag, clusterVisibilityTag };
+	return { lightListTag, lightInfoTag, clusterVisibilityTag, directionalLightListTag };
+}
+
+ClusterData ClusteredLightCulling::GetClusterData(RenderPassResources& resources, const ClusterResources& clusterResources) const
+{
+	ClusterData data;
+	data.lightListBuffer = resources.Get(clusterResources.lightList);
+	data.lightInfoBuffer = resources.Get(clusterResources.lightInfo);
+	data.froxelSize = gridInfo.froxelSize;
+	data.dimensions[0] = gridInfo.x;
+	data.dimensions[1] = gridInfo.y;
+	data.dimensions[2] = gridInfo.z;
+	data.logY = 1.f / std::log(gridInfo.depthFactor);
+	data.directionalLightListBuffer = resources.Get(clusterResources.directionalLightList);
+
+	return data;
 }
 
 RenderResource ClusteredLightCulling::RenderDebugOverlay(RenderGraph& graph, RenderResource lightInfoBuffer, RenderResource clusterVisibilityBuffer)
@@ -367,13 +470,6 @@ RenderResource ClusteredLightCulling::RenderDebugOverlay(RenderGraph& graph, Ren
 	overlayPass.Output(clusterDebugOverlayTag, OutputBind::RTV, LoadType::Preserve);
 	overlayPass.Bind([&, lightInfoBuffer, clusterVisibilityBuffer](CommandList& list, RenderPassResources& resources)
 	{
-		const auto debugOverlayLayout = RenderPipelineLayout{}
-			.VertexShader({ "Clusters/ClusterDebugOverlay.hlsl", "VSMain" })
-			.PixelShader({ "Clusters/ClusterDebugOverlay.hlsl", "PSMain" })
-			.DepthEnabled(false)
-			.Macro({ "FROXEL_SIZE", *CvarGet("clusteredFroxelSize", int) })
-			.Macro({ "MAX_LIGHTS_PER_FROXEL", *CvarGet("maxLightsPerFroxel", int) });
-
 		list.BindPipeline(debugOverlayLayout);
 
 		struct BindData
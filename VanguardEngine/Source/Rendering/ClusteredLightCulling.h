@@ -6,9 +6,15 @@
 #include <Rendering/ResourceHandle.h>
 #include <Rendering/RenderGraphResource.h>
 #include <Rendering/RenderPipeline.h>
+#include <Rendering/ShaderStructs.h>
+#include <Core/ConsoleVariable.h>
 
 #include <entt/entt.hpp>
 
+#include <vector>
+#include <optional>
+#include <utility>
+
 // #TEMP
 struct MeshResources
 {
@@ -16,9 +22,18 @@ struct MeshResources
 	RenderResource extraTag;
 };
 
+// Culled indirect arguments and the visible instances they draw. Each culling phase produces its own list.
+struct MeshDrawList
+{
+	RenderResource indirectArgs;
+	RenderResource visibleInstances;
+	std::optional<RenderResource> drawCounts;  // Meshlet lists are counted per material bucket, see MeshSystem::Render().
+};
+
 class RenderDevice;
 class CommandList;
 class RenderGraph;
+class RenderPassResources;
 
 struct ClusterGridInfo
 {
@@ -26,6 +41,8 @@ struct ClusterGridInfo
 	uint32_t y;
 	uint32_t z;
 	float depthFactor;
+	int32_t froxelSize;
+	uint32_t volumetricZ;  // Depth slices binned regardless of geometry, so participating media receives local lights.
 };
 
 struct ClusterResources
@@ -33,6 +50,7 @@ struct ClusterResources
 	RenderResource lightList;
 	RenderResource lightInfo;
 	RenderResource lightVisibility;
+	RenderResource directionalLightList;  // Count followed by light indices, directional lights aren't binned.
 };
 
 class ClusteredLightCulling
@@ -42,16 +60,31 @@ private:
 
 	bool dirty = true;
 	ClusterGridInfo gridInfo;
-	BufferHandle clusterBounds;
+	BufferHandle clusterBounds;  // Sized to the grid, reallocated when the grid's froxel count changes.
+
+	CvarHandle<int> froxelSize;
+	CvarHandle<int> maxLightsPerFroxel;
+	CvarHandle<int> lightIndexDensity;
+	size_t froxelSizeGeneration = 0;
+	size_t maxLightsPerFroxelGeneration = 0;
+	float volumetricDistance = 0.f;
+
+	// Specialized on the froxel size and light list capacity, created again only when either changes.
+	RenderPipelineLayout boundsLayout;
+	RenderPipelineLayout depthCullLayout;
+	RenderPipelineLayout binningLayout;
 
 #if ENABLE_EDITOR
 	// Debugging visualizations.
 	RenderPipelineLayout debugOverlayLayout;
+	std::pair<uint32_t, uint32_t> lightListOccupancy = { 0, 0 };  // Binned light indices and capacity, read back from the GPU.
 #endif
 
 	ResourcePtr<ID3D12CommandSignature> binningIndirectSignature;
 
+	void CreatePipelines();
 	ClusterGridInfo ComputeGridInfo(const entt::registry& registry) const;
+	void AllocateClusterBounds(uint32_t froxelCount);
 	// Needs to be called every time the camera resolution or FOV changes.
 	void ComputeClusterGrid(CommandList& list, const RenderPipelineLayout& boundsLayout, uint32_t cameraBuffer, uint32_t clusterBoundsBuffer) const;
 
@@ -60,8 +93,16 @@ public:
 
 	void Initialize(RenderDevice* inDevice);
 	const ClusterGridInfo& GetGridInfo() const { return gridInfo; }
-	ClusterResources Render(RenderGraph& graph, const entt::registry& registry, RenderResource cameraBuffer, RenderResource depthStencil, RenderResource lightsBuffer, RenderResource instanceBuffer, MeshResources meshResources, RenderResource meshIndirectRenderArgs);
+	// Light grid lookup data for shading passes, see Clusters.hlsli.
+	ClusterData GetClusterData(RenderPassResources& resources, const ClusterResources& clusterResources) const;
+	ClusterResources Render(RenderGraph& graph, const entt::registry& registry, RenderResource cameraBuffer, RenderResource cullingViewBuffer, RenderResource depthStencil, RenderResource lightsBuffer, uint32_t lightSlots);
 	RenderResource RenderDebugOverlay(RenderGraph& graph, RenderResource lightInfoBuffer, RenderResource clusterVisibilityBuffer);
 
 	void MarkDirty() { dirty = true; };
+#if ENABLE_EDITOR
+	// Measured a few frames late, indices past the capacity were dropped.
+	std::pair<uint32_t, uint32_t> GetLightListOccupancy() const { return lightListOccupancy; }
+#endif
+	// View depth that clusters are binned up to even when empty of geometry, zero to only bin clusters with geometry.
+	void SetVolumetricDistance(float distance) { volumetricDistance = distance; }
 };
\ No newline at end of file
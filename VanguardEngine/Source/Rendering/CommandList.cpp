@@ -4,6 +4,10 @@
 #include <Rendering/Device.h>
 #include <Rendering/RenderGraph.h>
 #include <Rendering/PipelineState.h>
+#include <Rendering/ResourceFormat.h>
+
+#include <algorithm>
+#include <iterator>
 
 void ValidateTransition(const BufferDescription& description, D3D12_RESOURCE_STATES newState)
 {
@@ -36,7 +40,94 @@ void ValidateTransition(const TextureDescription& description, D3D12_RESOURCE_ST
 #endif
 }
 
-void CommandList::TransitionBarrierInternal(ID3D12Resource* resource, D3D12_RESOURCE_STATES oldState, D3D12_RESOURCE_STATES newState)
+// Enhanced barrier equivalents of legacy states. Shader stages are narrowed to compute shading when only compute work
+// runs on either side of the barrier.
+D3D12_BARRIER_SYNC ConvertStateToSync(D3D12_RESOURCE_STATES state, bool computeOnly)
+{
+	if (state == D3D12_RESOURCE_STATE_COMMON)
+		return D3D12_BARRIER_SYNC_ALL;
+
+	const auto shading = computeOnly ? D3D12_BARRIER_SYNC_COMPUTE_SHADING : D3D12_BARRIER_SYNC_ALL_SHADING;
+	const auto nonPixelShading = computeOnly ? D3D12_BARRIER_SYNC_COMPUTE_SHADING : D3D12_BARRIER_SYNC_NON_PIXEL_SHADING;
+
+	D3D12_BARRIER_SYNC sync = D3D12_BARRIER_SYNC_NONE;
+	if (state & D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER) sync |= shading;
+	if (state & D3D12_RESOURCE_STATE_INDEX_BUFFER) sync |= D3D12_BARRIER_SYNC_INDEX_INPUT;
+	if (state & D3D12_RESOURCE_STATE_RENDER_TARGET) sync |= D3D12_BARRIER_SYNC_RENDER_TARGET;
+	if (state & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) sync |= shading | D3D12_BARRIER_SYNC_BUILD_RAYTRACING_ACCELERATION_STRUCTURE |
+		D3D12_BARRIER_SYNC_EMIT_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO;  // Acceleration structure scratch and post-build info are UAV buffers.
+	if (state & D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE) sync |= D3D12_BARRIER_SYNC_BUILD_RAYTRACING_ACCELERATION_STRUCTURE | D3D12_BARRIER_SYNC_COPY_RAYTRACING_ACCELERATION_STRUCTURE |
+		D3D12_BARRIER_SYNC_EMIT_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO | shading;
+	if (state & (D3D12_RESOURCE_STATE_DEPTH_WRITE | D3D12_RESOURCE_STATE_DEPTH_READ)) sync |= D3D12_BARRIER_SYNC_DEPTH_STENCIL;
+	if (state & D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE) sync |= nonPixelShading;
+	if (state & D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE) sync |= D3D12_BARRIER_SYNC_PIXEL_SHADING;
+	if (state & D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT) sync |= D3D12_BARRIER_SYNC_EXECUTE_INDIRECT;
+	if (state & (D3D12_RESOURCE_STATE_COPY_DEST | D3D12_RESOURCE_STATE_COPY_SOURCE)) sync |= D3D12_BARRIER_SYNC_COPY;
+	if (state & (D3D12_RESOURCE_STATE_RESOLVE_DEST | D3D12_RESOURCE_STATE_RESOLVE_SOURCE)) sync |= D3D12_BARRIER_SYNC_RESOLVE;
+	if (state & D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE) sync |= D3D12_BARRIER_SYNC_PIXEL_SHADING;
+
+	return sync != D3D12_BARRIER_SYNC_NONE ? sync : D3D12_BARRIER_SYNC_ALL;
+}
+
+D3D12_BARRIER_ACCESS ConvertStateToAccess(D3D12_RESOURCE_STATES state)
+{
+	if (state == D3D12_RESOURCE_STATE_COMMON)
+		return D3D12_BARRIER_ACCESS_COMMON;
+
+	D3D12_BARRIER_ACCESS access = D3D12_BARRIER_ACCESS_COMMON;
+	if (state & D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER) access |= D3D12_BARRIER_ACCESS_VERTEX_BUFFER | D3D12_BARRIER_ACCESS_CONSTANT_BUFFER;
+	if (state & D3D12_RESOURCE_STATE_INDEX_BUFFER) access |= D3D12_BARRIER_ACCESS_INDEX_BUFFER;
+	if (state & D3D12_RESOURCE_STATE_RENDER_TARGET) access |= D3D12_BARRIER_ACCESS_RENDER_TARGET;
+	if (state & D3D12_RESOURCE_STATE_UNORDERED_ACCESS) access |= D3D12_BARRIER_ACCESS_UNORDERED_ACCESS;
+	if (state & D3D12_RESOURCE_STATE_DEPTH_WRITE) access |= D3D12_BARRIER_ACCESS_DEPTH_STENCIL_WRITE;
+	if (state & D3D12_RESOURCE_STATE_DEPTH_READ) access |= D3D12_BARRIER_ACCESS_DEPTH_STENCIL_READ;
+	if (state & (D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)) access |= D3D12_BARRIER_ACCESS_SHADER_RESOURCE;
+	if (state & D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT) access |= D3D12_BARRIER_ACCESS_INDIRECT_ARGUMENT;
+	if (state & D3D12_RESOURCE_STATE_COPY_DEST) access |= D3D12_BARRIER_ACCESS_COPY_DEST;
+	if (state & D3D12_RESOURCE_STATE_COPY_SOURCE) access |= D3D12_BARRIER_ACCESS_COPY_SOURCE;
+	if (state & D3D12_RESOURCE_STATE_RESOLVE_DEST) access |= D3D12_BARRIER_ACCESS_RESOLVE_DEST;
+	if (state & D3D12_RESOURCE_STATE_RESOLVE_SOURCE) access |= D3D12_BARRIER_ACCESS_RESOLVE_SOURCE;
+	if (state & D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE) access |= D3D12_BARRIER_ACCESS_RAYTRACING_ACCELERATION_STRUCTURE_READ | D3D12_BARRIER_ACCESS_RAYTRACING_ACCELERATION_STRUCTURE_WRITE;
+	if (state & D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE) access |= D3D12_BARRIER_ACCESS_SHADING_RATE_SOURCE;
+
+	return access;
+}
+
+// Only uses layouts shared by the direct and compute queues, resources move between queues in the common layout.
+D3D12_BARRIER_LAYOUT ConvertStateToLayout(D3D12_RESOURCE_STATES state)
+{
+	switch (state)
+	{
+	case D3D12_RESOURCE_STATE_COMMON: return D3D12_BARRIER_LAYOUT_COMMON;
+	case D3D12_RESOURCE_STATE_RENDER_TARGET: return D3D12_BARRIER_LAYOUT_RENDER_TARGET;
+	case D3D12_RESOURCE_STATE_UNORDERED_ACCESS: return D3D12_BARRIER_LAYOUT_UNORDERED_ACCESS;
+	case D3D12_RESOURCE_STATE_DEPTH_WRITE: return D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_WRITE;
+	case D3D12_RESOURCE_STATE_DEPTH_READ: return D3D12_BARRIER_LAYOUT_DEPTH_STENCIL_READ;
+	case D3D12_RESOURCE_STATE_COPY_DEST: return D3D12_BARRIER_LAYOUT_COPY_DEST;
+	case D3D12_RESOURCE_STATE_COPY_SOURCE: return D3D12_BARRIER_LAYOUT_COPY_SOURCE;
+	case D3D12_RESOURCE_STATE_RESOLVE_DEST: return D3D12_BARRIER_LAYOUT_RESOLVE_DEST;
+	case D3D12_RESOURCE_STATE_RESOLVE_SOURCE: return D3D12_BARRIER_LAYOUT_RESOLVE_SOURCE;
+	case D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE: return D3D12_BARRIER_LAYOUT_SHADING_RATE_SOURCE;  // Only read on the direct queue.
+	case D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE:
+	case D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE:
+	case D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE: return D3D12_BARRIER_LAYOUT_SHADER_RESOURCE;
+	default: return D3D12_BARRIER_LAYOUT_GENERIC_READ;  // Combined read states.
+	}
+}
+
+D3D12_RESOURCE_STATES CommandList::ResolveState(D3D12_RESOURCE_STATES oldState, D3D12_RESOURCE_STATES newState) const
+{
+	if (type != D3D12_COMMAND_LIST_TYPE_COMPUTE)
+		return newState;
+
+	VGAssert(IsComputeCompatibleState(oldState), "Compute command lists cannot transition resources out of graphics-only states.");
+
+	// Pixel shader reads are combined with non-pixel reads for convenience throughout pass code, but compute lists
+	// can only use the non-pixel state.
+	return newState & ~D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+}
+
+void CommandList::TransitionBarrierInternal(ID3D12Resource* resource, D3D12_RESOURCE_STATES oldState, D3D12_RESOURCE_STATES newState, D3D12_RESOURCE_BARRIER_FLAGS flags)
 {
 	VGScopedCPUStat("Transition Barrier");
 
@@ -56,7 +147,7 @@ void CommandList::TransitionBarrierInternal(ID3D12Resource* resource, D3D12_RESO
 
 	D3D12_RESOURCE_BARRIER barrier;
 	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+	barrier.Flags = flags;
 	barrier.Transition.pResource = resource;
 	barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
 	barrier.Transition.StateBefore = oldState;
@@ -65,6 +156,149 @@ void CommandList::TransitionBarrierInternal(ID3D12Resource* resource, D3D12_RESO
 	pendingBarriers.emplace_back(std::move(barrier));
 }
 
+void CommandList::TransitionBarrierTracked(entt::entity entity, ID3D12Resource* resource, D3D12_RESOURCE_STATES& componentState, D3D12_RESOURCE_STATES newState, D3D12_RESOURCE_BARRIER_FLAGS flags)
+{
+	if (!localStateTracking)
+	{
+		newState = ResolveState(componentState, newState);
+		TransitionBarrierInternal(resource, componentState, newState, flags);
+
+		// The resource isn't usable until the split barrier ends, so keep the old state until then.
+		if (flags == D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY)
+			return;
+
+		componentState = newState;
+
+		if (graph)
+		{
+			knownStates[entity] = newState;
+		}
+
+		return;
+	}
+
+	VGAssert(flags == D3D12_RESOURCE_BARRIER_FLAG_NONE, "Split barriers are not supported with local state tracking.");
+
+	// Resources already transitioned by this list have a known state. Otherwise the resource must not be used by any
+	// other pass in the graph, so the component state is stable during recording.
+	const auto knownIt = knownStates.find(entity);
+	const auto oldState = knownIt != knownStates.end() ? knownIt->second : componentState;
+	entryStates.try_emplace(entity, std::make_pair(resource, oldState));
+
+	newState = ResolveState(oldState, newState);
+	TransitionBarrierInternal(resource, oldState, newState, flags);
+	knownStates[entity] = newState;
+}
+
+void CommandList::SubmitBarriers(const std::vector<D3D12_RESOURCE_BARRIER>& barriers)
+{
+	if (!enhancedList)
+	{
+		list->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+
+		return;
+	}
+
+	// Barriers are tracked as legacy states everywhere, translate them here. Shader stages of graph compute passes
+	// only need compute shading, even when executing on the direct queue.
+	const auto computeOnly = type == D3D12_COMMAND_LIST_TYPE_COMPUTE || (graph && graph->GetPassQueue(passIndex) == ExecutionQueue::Compute);
+
+	std::vector<D3D12_RESOURCE_BARRIER> aliasingBarriers;
+	std::vector<D3D12_BUFFER_BARRIER> bufferBarriers;
+	std::vector<D3D12_TEXTURE_BARRIER> textureBarriers;
+
+	for (const auto& barrier : barriers)
+	{
+		D3D12_RESOURCE_STATES stateBefore;
+		D3D12_RESOURCE_STATES stateAfter;
+		ID3D12Resource* resource;
+		uint32_t subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+
+		switch (barrier.Type)
+		{
+		case D3D12_RESOURCE_BARRIER_TYPE_TRANSITION:
+			stateBefore = barrier.Transition.StateBefore;
+			stateAfter = barrier.Transition.StateAfter;
+			resource = barrier.Transition.pResource;
+			subresource = barrier.Transition.Subresource;
+			break;
+		case D3D12_RESOURCE_BARRIER_TYPE_UAV:
+			stateBefore = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+			stateAfter = D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+			resource = barrier.UAV.pResource;
+			break;
+		default:
+			// Activating a placed resource without knowing the previous resource has no exact equivalent, the legacy
+			// barrier can be mixed with enhanced barriers. Always precedes any transitions of the resource in the batch.
+			aliasingBarriers.emplace_back(barrier);
+			continue;
+		}
+
+		auto syncBefore = ConvertStateToSync(stateBefore, type == D3D12_COMMAND_LIST_TYPE_COMPUTE);  // The previous use could be any pass on this queue.
+		auto syncAfter = ConvertStateToSync(stateAfter, computeOnly);
+
+		if (barrier.Flags & D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY) syncAfter = D3D12_BARRIER_SYNC_SPLIT;
+		if (barrier.Flags & D3D12_RESOURCE_BARRIER_FLAG_END_ONLY) syncBefore = D3D12_BARRIER_SYNC_SPLIT;
+
+		if (resource->GetDesc().Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+		{
+			bufferBarriers.emplace_back(D3D12_BUFFER_BARRIER{
+				.SyncBefore = syncBefore,
+				.SyncAfter = syncAfter,
+				.AccessBefore = ConvertStateToAccess(stateBefore),
+				.AccessAfter = ConvertStateToAccess(stateAfter),
+				.pResource = resource,
+				.Offset = 0,
+				.Size = UINT64_MAX
+			});
+		}
+
+		else
+		{
+			textureBarriers.emplace_back(D3D12_TEXTURE_BARRIER{
+				.SyncBefore = syncBefore,
+				.SyncAfter = syncAfter,
+				.AccessBefore = ConvertStateToAccess(stateBefore),
+				.AccessAfter = ConvertStateToAccess(stateAfter),
+				.LayoutBefore = ConvertStateToLayout(stateBefore),
+				.LayoutAfter = ConvertStateToLayout(stateAfter),
+				.pResource = resource,
+				.Subresources = { .IndexOrFirstMipLevel = subresource, .NumMipLevels = 0 },  // Subresource index form, all bits set means every subresource.
+				.Flags = D3D12_TEXTURE_BARRIER_FLAG_NONE
+			});
+		}
+	}
+
+	if (aliasingBarriers.size())
+	{
+		list->ResourceBarrier(static_cast<UINT>(aliasingBarriers.size()), aliasingBarriers.data());
+	}
+
+	std::vector<D3D12_BARRIER_GROUP> groups;
+	groups.reserve(2);
+
+	if (bufferBarriers.size())
+	{
+		auto& group = groups.emplace_back();
+		group.Type = D3D12_BARRIER_TYPE_BUFFER;
+		group.NumBarriers = static_cast<UINT32>(bufferBarriers.size());
+		group.pBufferBarriers = bufferBarriers.data();
+	}
+
+	if (textureBarriers.size())
+	{
+		auto& group = groups.emplace_back();
+		group.Type = D3D12_BARRIER_TYPE_TEXTURE;
+		group.NumBarriers = static_cast<UINT32>(textureBarriers.size());
+		group.pTextureBarriers = textureBarriers.data();
+	}
+
+	if (groups.size())
+	{
+		enhancedList->Barrier(static_cast<UINT32>(groups.size()), groups.data());
+	}
+}
+
 void CommandList::BindResourceInternal(const std::string& bindName, BufferHandle handle, size_t offset, bool optional)
 {
 	VGAssert(boundPipeline, "Attempted to bind resource without first binding a pipeline.");
@@ -86,7 +320,7 @@ void CommandList::BindResourceInternal(const std::string& bindName, BufferHandle
 	switch (bindMetadata.type)
 	{
 	case PipelineStateReflection::ResourceBindType::ConstantBuffer:
-		if (boundPipeline->vertexShader)
+		if (boundPipeline->IsGraphics())
 		{
 			list->SetGraphicsRootConstantBufferView(bindMetadata.signatureIndex, bufferComponent.Native()->GetGPUVirtualAddress() + offset);
 		}
@@ -98,7 +332,7 @@ void CommandList::BindResourceInternal(const std::string& bindName, BufferHandle
 
 		break;
 	case PipelineStateReflection::ResourceBindType::ShaderResource:
-		if (boundPipeline->vertexShader)
+		if (boundPipeline->IsGraphics())
 		{
 			list->SetGraphicsRootShaderResourceView(bindMetadata.signatureIndex, bufferComponent.Native()->GetGPUVirtualAddress() + offset);
 		}
@@ -110,7 +344,7 @@ void CommandList::BindResourceInternal(const std::string& bindName, BufferHandle
 
 		break;
 	case PipelineStateReflection::ResourceBindType::UnorderedAccess:
-		if (boundPipeline->vertexShader)
+		if (boundPipeline->IsGraphics())
 		{
 			list->SetGraphicsRootUnorderedAccessView(bindMetadata.signatureIndex, bufferComponent.Native()->GetGPUVirtualAddress() + offset);
 		}
@@ -127,13 +361,14 @@ void CommandList::BindResourceInternal(const std::string& bindName, BufferHandle
 	}
 }
 
-void CommandList::Create(RenderDevice* inDevice, RenderGraph* inGraph, D3D12_COMMAND_LIST_TYPE type, size_t pass)
+void CommandList::Create(RenderDevice* inDevice, RenderGraph* inGraph, D3D12_COMMAND_LIST_TYPE inType, size_t pass)
 {
 	VGScopedCPUStat("Command List Create");
 
 	device = inDevice;
 	graph = inGraph;
 	passIndex = pass;
+	type = inType;
 
 	auto result = device->Native()->CreateCommandAllocator(type, IID_PPV_ARGS(allocator.Indirect()));
 	if (FAILED(result))
@@ -146,6 +381,24 @@ void CommandList::Create(RenderDevice* inDevice, RenderGraph* inGraph, D3D12_COM
 	{
 		VGLogCritical(logRendering, "Failed to create command list: {}", result);
 	}
+
+	if (device->UsingEnhancedBarriers())
+	{
+		result = list->QueryInterface(IID_PPV_ARGS(enhancedList.Indirect()));
+		if (FAILED(result))
+		{
+			VGLogCritical(logRendering, "Failed to get enhanced barrier command list interface: {}", result);
+		}
+	}
+
+	if (device->SupportsMeshShaders() && type == D3D12_COMMAND_LIST_TYPE_DIRECT)
+	{
+		result = list->QueryInterface(IID_PPV_ARGS(meshList.Indirect()));
+		if (FAILED(result))
+		{
+			VGLogCritical(logRendering, "Failed to get mesh shader command list interface: {}", result);
+		}
+	}
 }
 
 void CommandList::SetName(std::wstring_view name)
@@ -154,7 +407,13 @@ void CommandList::SetName(std::wstring_view name)
 	list->SetName(name.data());
 }
 
-void CommandList::TransitionBarrier(BufferHandle resource, D3D12_RESOURCE_STATES state)
+void CommandList::SetPass(RenderGraph* inGraph, size_t pass)
+{
+	graph = inGraph;
+	passIndex = pass;
+}
+
+void CommandList::TransitionBarrier(BufferHandle resource, D3D12_RESOURCE_STATES state, D3D12_RESOURCE_BARRIER_FLAGS flags)
 {
 	auto& component = device->GetResourceManager().Get(resource);
 
@@ -165,17 +424,26 @@ void CommandList::TransitionBarrier(BufferHandle resource, D3D12_RESOURCE_STATES
 	}
 
 	ValidateTransition(component.description, state);
-	TransitionBarrierInternal(component.Native(), component.state, state);
-	component.state = state;
+	TransitionBarrierTracked(resource.handle, component.Native(), component.state, state, flags);
 }
 
-void CommandList::TransitionBarrier(TextureHandle resource, D3D12_RESOURCE_STATES state)
+void CommandList::TransitionBarrier(TextureHandle resource, D3D12_RESOURCE_STATES state, D3D12_RESOURCE_BARRIER_FLAGS flags)
 {
 	auto& component = device->GetResourceManager().Get(resource);
 
 	ValidateTransition(component.description, state);
-	TransitionBarrierInternal(component.Native(), component.state, state);
-	component.state = state;
+	TransitionBarrierTracked(resource.handle, component.Native(), component.state, state, flags);
+}
+
+D3D12_RESOURCE_STATES CommandList::GetState(BufferHandle resource) const
+{
+	if (localStateTracking)
+	{
+		if (const auto knownIt = knownStates.find(resource.handle); knownIt != knownStates.end())
+			return knownIt->second;
+	}
+
+	return device->GetResourceManager().Get(resource).state;
 }
 
 void CommandList::UAVBarrier(BufferHandle resource)
@@ -198,6 +466,49 @@ void CommandList::UAVBarrier(TextureHandle resource)
 	pendingBarriers.emplace_back(std::move(barrier));
 }
 
+void CommandList::AccelerationStructureBarrier(BufferHandle resource)
+{
+	if (!enhancedList)
+	{
+		UAVBarrier(resource);
+
+		return;
+	}
+
+	// Only reaches the driver as an enhanced barrier, legacy transitions can't keep the same state.
+	D3D12_RESOURCE_BARRIER barrier;
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+	barrier.Transition.pResource = device->GetResourceManager().Get(resource).Native();
+	barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE;
+	barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE;
+	barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+
+	pendingBarriers.emplace_back(std::move(barrier));
+}
+
+void CommandList::AliasingBarrier(BufferHandle resource)
+{
+	D3D12_RESOURCE_BARRIER barrier;
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+	barrier.Aliasing.pResourceBefore = nullptr;  // Any placed resource could have been using the memory.
+	barrier.Aliasing.pResourceAfter = device->GetResourceManager().Get(resource).Native();
+
+	pendingBarriers.emplace_back(std::move(barrier));
+}
+
+void CommandList::AliasingBarrier(TextureHandle resource)
+{
+	D3D12_RESOURCE_BARRIER barrier;
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+	barrier.Aliasing.pResourceBefore = nullptr;  // Any placed resource could have been using the memory.
+	barrier.Aliasing.pResourceAfter = device->GetResourceManager().Get(resource).Native();
+
+	pendingBarriers.emplace_back(std::move(barrier));
+}
+
 void CommandList::FlushBarriers()
 {
 	VGScopedCPUStat("Command List Barrier Flush");
@@ -205,23 +516,64 @@ void CommandList::FlushBarriers()
 	if (!pendingBarriers.size())
 		return;
 
-	list->ResourceBarrier(static_cast<UINT>(pendingBarriers.size()), pendingBarriers.data());
+	SuspendRenderPass();
+	SubmitBarriers(pendingBarriers);
 
 	pendingBarriers.clear();
 }
 
+void CommandList::BeginLocalStateTracking()
+{
+	VGAssert(graph, "Local state tracking is only supported for render graph command lists.");
+
+	localStateTracking = true;
+}
+
+void CommandList::EndLocalStateTracking()
+{
+	for (const auto& [entity, entry] : entryStates)
+	{
+		const auto currentState = knownStates[entity];
+		if (currentState == entry.second)
+			continue;
+
+		// Transition directly instead of through TransitionBarrierInternal(), we need the exact entry state even when it's
+		// covered by the current state.
+		D3D12_RESOURCE_BARRIER barrier;
+		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+		barrier.Transition.pResource = entry.first;
+		barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+		barrier.Transition.StateBefore = currentState;
+		barrier.Transition.StateAfter = entry.second;
+
+		pendingBarriers.emplace_back(std::move(barrier));
+		knownStates[entity] = entry.second;
+	}
+
+	FlushBarriers();
+
+	entryStates.clear();
+	localStateTracking = false;
+}
+
 void CommandList::BindPipelineState(const PipelineState& state)
 {
 	VGScopedCPUStat("Bind Pipeline");
 
 	boundPipeline = &state;
 
+	if (state.IsGraphics())
+	{
+		ResumeRenderPass();
+	}
+
 	if (state.vertexShader)
 	{
 		list->IASetPrimitiveTopology(state.graphicsDescription.topology);
 	}
 
-	if (state.vertexShader)
+	if (state.IsGraphics())
 	{
 		list->SetGraphicsRootSignature(state.rootSignature.Get());
 	}
@@ -231,6 +583,24 @@ void CommandList::BindPipelineState(const PipelineState& state)
 		list->SetComputeRootSignature(state.rootSignature.Get());
 	}
 
+	// Setting the root signature drops the root arguments, so pipelines reading the frame's cameras through a root
+	// descriptor get it again with each bind.
+	if (const auto* cameraBind = state.GetReflectionData()->FindBind("frameCameras"); cameraBind)
+	{
+		VGAssert(graph && graph->GetFrameCameras().handle != entt::null, "Pipeline reads the frame's cameras, but the render graph has none.");
+
+		const auto address = device->GetResourceManager().Get(graph->GetFrameCameras()).Native()->GetGPUVirtualAddress();
+		if (state.IsGraphics())
+		{
+			list->SetGraphicsRootShaderResourceView(cameraBind->signatureIndex, address);
+		}
+
+		else
+		{
+			list->SetComputeRootShaderResourceView(cameraBind->signatureIndex, address);
+		}
+	}
+
 	list->SetPipelineState(state.Native());
 }
 
@@ -244,37 +614,47 @@ void CommandList::BindDescriptorAllocator(DescriptorAllocator& allocator, bool v
 {
 	VGScopedCPUStat("Bind Descriptor Allocator");
 
-	ID3D12DescriptorHeap* descriptorHeap;
 	if (visibleHeap)
-		descriptorHeap = allocator.defaultHeap.Native();
-	else
-		descriptorHeap = allocator.defaultNonVisibleHeap.Native();
+	{
+		// Shaders index both heaps directly.
+		ID3D12DescriptorHeap* descriptorHeaps[] = { allocator.defaultHeap.Native(), allocator.samplerHeap.Native() };
+		list->SetDescriptorHeaps(static_cast<uint32_t>(std::size(descriptorHeaps)), descriptorHeaps);
+	}
 
-	list->SetDescriptorHeaps(1, &descriptorHeap);
+	else
+	{
+		ID3D12DescriptorHeap* descriptorHeap = allocator.defaultNonVisibleHeap.Native();
+		list->SetDescriptorHeaps(1, &descriptorHeap);
+	}
 }
 
-void CommandList::BindConstants(const std::string& bindName, const std::vector<uint32_t>& data, size_t offset)
+void CommandList::BindConstants(BindSlot slot, std::span<const uint32_t> data, size_t offset)
 {
 	VGAssert(boundPipeline, "Attempted to bind resource without first binding a pipeline.");
-	VGAssert(boundPipeline->GetReflectionData()->resourceIndexMap.contains(bindName), "Shader does not contain constant bind '%s'", bindName.c_str());
 
-	const auto& bindMetadata = boundPipeline->GetReflectionData()->resourceIndexMap.at(bindName);  // Can't use operator[] due to lack of const-ness.
-	switch (bindMetadata.type)
+	const auto* bindMetadata = boundPipeline->GetReflectionData()->FindBind(slot);
+	VGAssert(bindMetadata, "Shader does not contain constant bind '%s'", std::string{ slot.name }.c_str());
+
+	switch (bindMetadata->type)
 	{
 	case PipelineStateReflection::ResourceBindType::RootConstants:
-		if (boundPipeline->vertexShader)
+		VGAssert(offset + data.size() <= bindMetadata->constantCount, "Bind data '%s' overflows the root constants.", std::string{ slot.name }.c_str());
+		// Partial updates can't be checked against the shader's layout, whole updates must cover everything it reads.
+		VGAssert(offset > 0 || data.size_bytes() >= bindMetadata->constantsSize, "Bind data '%s' is smaller than the shader's, the C++ and HLSL layouts differ.", std::string{ slot.name }.c_str());
+
+		if (boundPipeline->IsGraphics())
 		{
-			list->SetGraphicsRoot32BitConstants(bindMetadata.signatureIndex, data.size(), data.data(), offset);
+			list->SetGraphicsRoot32BitConstants(bindMetadata->signatureIndex, data.size(), data.data(), offset);
 		}
 
 		else
 		{
-			list->SetComputeRoot32BitConstants(bindMetadata.signatureIndex, data.size(), data.data(), offset);
+			list->SetComputeRoot32BitConstants(bindMetadata->signatureIndex, data.size(), data.data(), offset);
 		}
 
 		break;
 	default:
-		VGAssert(false, "Invalid binding, attempting to bind constants to binding '%s', where the bind type is '%i'.", bindName.c_str(), bindMetadata.type);
+		VGAssert(false, "Invalid binding, attempting to bind constants to binding '%s', where the bind type is '%i'.", std::string{ slot.name }.c_str(), bindMetadata->type);
 		break;
 	}
 }
@@ -286,7 +666,7 @@ void CommandList::BindResourceTable(const std::string& bindName, D3D12_GPU_DESCR
 
 	const auto& bindMetadata = boundPipeline->GetReflectionData()->resourceIndexMap.at(bindName);  // Can't use operator[] due to lack of const-ness.
 
-	if (boundPipeline->vertexShader)
+	if (boundPipeline->IsGraphics())
 	{
 		list->SetGraphicsRootDescriptorTable(bindMetadata.signatureIndex, descriptor);
 	}
@@ -297,18 +677,129 @@ void CommandList::BindResourceTable(const std::string& bindName, D3D12_GPU_DESCR
 	}
 }
 
+void CommandList::BeginRenderPass(const RenderPassTargets& targets)
+{
+	VGAssert(renderPassState == RenderPassState::None, "Attempted to begin a render pass within another render pass.");
+
+	renderPass = targets;
+	renderPassState = RenderPassState::Active;
+
+	const auto Discards = [](D3D12_RENDER_PASS_ENDING_ACCESS_TYPE type) { return type == D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_DISCARD; };
+	renderPassDiscards = std::any_of(renderPass.renderTargets.begin(), renderPass.renderTargets.begin() + renderPass.renderTargetCount,
+		[&](const auto& target) { return Discards(target.EndingAccess.Type); });
+	if (renderPass.depthStencil)
+	{
+		renderPassDiscards |= Discards(renderPass.depthStencil->DepthEndingAccess.Type) || Discards(renderPass.depthStencil->StencilEndingAccess.Type);
+	}
+
+	list->BeginRenderPass(renderPass.renderTargetCount, renderPass.renderTargets.data(), renderPass.depthStencil ? &*renderPass.depthStencil : nullptr, renderPass.flags);
+}
+
+void CommandList::EndRenderPass()
+{
+	if (renderPassState == RenderPassState::Active)
+	{
+		list->EndRenderPass();
+	}
+
+	renderPassState = RenderPassState::None;
+}
+
+void CommandList::SuspendRenderPass()
+{
+	if (renderPassState != RenderPassState::Active)
+		return;
+
+	VGAssert(!renderPassDiscards, "Attempted to suspend a render pass which discards its targets, the pass must not use unordered access.");
+
+	list->EndRenderPass();
+	renderPassState = RenderPassState::Suspended;
+}
+
+void CommandList::ResumeRenderPass()
+{
+	if (renderPassState != RenderPassState::Suspended)
+		return;
+
+	// Later segments load and store everything, only the first segment clears.
+	const auto Preserve = [](auto& beginning, auto& ending)
+	{
+		if (beginning.Type != D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_NO_ACCESS)
+			beginning.Type = D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_PRESERVE;
+		if (ending.Type != D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_NO_ACCESS)
+			ending.Type = D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE;
+	};
+
+	for (uint32_t i = 0; i < renderPass.renderTargetCount; ++i)
+	{
+		Preserve(renderPass.renderTargets[i].BeginningAccess, renderPass.renderTargets[i].EndingAccess);
+	}
+
+	if (renderPass.depthStencil)
+	{
+		Preserve(renderPass.depthStencil->DepthBeginningAccess, renderPass.depthStencil->DepthEndingAccess);
+		Preserve(renderPass.depthStencil->StencilBeginningAccess, renderPass.depthStencil->StencilEndingAccess);
+	}
+
+	renderPassDiscards = false;
+	renderPassState = RenderPassState::Active;
+
+	list->BeginRenderPass(renderPass.renderTargetCount, renderPass.renderTargets.data(), renderPass.depthStencil ? &*renderPass.depthStencil : nullptr, renderPass.flags);
+}
+
+void CommandList::SetPredication(BufferHandle buffer, size_t offset)
+{
+	VGAssert(offset % 8 == 0, "Predication offsets must be 8 byte aligned.");
+
+	auto& component = device->GetResourceManager().Get(buffer);
+	list->SetPredication(component.Native(), offset, D3D12_PREDICATION_OP_EQUAL_ZERO);
+}
+
+void CommandList::ClearPredication()
+{
+	list->SetPredication(nullptr, 0, D3D12_PREDICATION_OP_EQUAL_ZERO);
+}
+
+void CommandList::SetShadingRateImage(TextureHandle image)
+{
+	VGAssert(device->SupportsVariableRateShading(), "Attempted to set a shading rate image without variable rate shading support.");
+
+	// The image overrides the full base rate, draws don't carry their own rates.
+	const D3D12_SHADING_RATE_COMBINER combiners[D3D12_RS_SET_SHADING_RATE_COMBINER_COUNT] = { D3D12_SHADING_RATE_COMBINER_PASSTHROUGH, D3D12_SHADING_RATE_COMBINER_OVERRIDE };
+	list->RSSetShadingRate(D3D12_SHADING_RATE_1X1, combiners);
+	list->RSSetShadingRateImage(device->GetResourceManager().Get(image).Native());
+}
+
+void CommandList::ClearShadingRateImage()
+{
+	list->RSSetShadingRate(D3D12_SHADING_RATE_1X1, nullptr);
+	list->RSSetShadingRateImage(nullptr);
+}
+
 void CommandList::Dispatch(uint32_t x, uint32_t y, uint32_t z)
 {
+	SuspendRenderPass();
 	list->Dispatch(x, y, z);
 }
 
+void CommandList::DispatchMesh(uint32_t x, uint32_t y, uint32_t z)
+{
+	VGAssert(meshList, "Attempted to dispatch mesh shaders on a list without mesh shader support.");
+
+	ResumeRenderPass();
+	meshList->DispatchMesh(x, y, z);
+}
+
 void CommandList::DrawFullscreenQuad()
 {
+	ResumeRenderPass();
 	list->DrawInstanced(3, 1, 0, 0);
 }
 
 void CommandList::Copy(BufferHandle destination, BufferHandle source)
 {
+	SuspendRenderPass();
+
 	TransitionBarrier(destination, D3D12_RESOURCE_STATE_COPY_DEST);
 	TransitionBarrier(source, D3D12_RESOURCE_STATE_COPY_SOURCE);
 	FlushBarriers();
@@ -319,8 +810,48 @@ void CommandList::Copy(BufferHandle destination, BufferHandle source)
 	list->CopyResource(destinationComponent.Native(), sourceComponent.Native());
 }
 
+void CommandList::ClearRenderTarget(TextureHandle texture, std::span<const D3D12_RECT> rects)
+{
+	SuspendRenderPass();  // Clears aren't allowed within a render pass.
+
+	const auto clearValue = device->GetResourceManager().GetClearValue(texture);
+	const auto& component = device->GetResourceManager().Get(texture);
+
+	list->ClearRenderTargetView(*component.RTV, clearValue.Color, static_cast<UINT>(rects.size()), rects.data());
+}
+
+void CommandList::ClearDepthStencil(TextureHandle texture, std::span<const D3D12_RECT> rects)
+{
+	SuspendRenderPass();  // Clears aren't allowed within a render pass.
+
+	const auto clearValue = device->GetResourceManager().GetClearValue(texture);
+	const auto& component = device->GetResourceManager().Get(texture);
+
+	auto flags = D3D12_CLEAR_FLAG_DEPTH;
+	if (IsResourceFormatStencil(clearValue.Format))
+		flags |= D3D12_CLEAR_FLAG_STENCIL;
+
+	list->ClearDepthStencilView(*component.DSV, flags, clearValue.DepthStencil.Depth, clearValue.DepthStencil.Stencil, static_cast<UINT>(rects.size()), rects.data());
+}
+
+void CommandList::Copy(BufferHandle destination, size_t destinationOffset, BufferHandle source, size_t sourceOffset, size_t size)
+{
+	SuspendRenderPass();
+
+	TransitionBarrier(destination, D3D12_RESOURCE_STATE_COPY_DEST);
+	TransitionBarrier(source, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	FlushBarriers();
+
+	auto& destinationComponent = device->GetResourceManager().Get(destination);
+	auto& sourceComponent = device->GetResourceManager().Get(source);
+
+	list->CopyBufferRegion(destinationComponent.Native(), destinationOffset, sourceComponent.Native(), sourceOffset, size);
+}
+
 void CommandList::Copy(TextureHandle destination, TextureHandle source)
 {
+	SuspendRenderPass();
+
 	TransitionBarrier(destination, D3D12_RESOURCE_STATE_COPY_DEST);
 	TransitionBarrier(source, D3D12_RESOURCE_STATE_COPY_SOURCE);
 	FlushBarriers();
@@ -333,11 +864,26 @@ void CommandList::Copy(TextureHandle destination, TextureHandle source)
 
 HRESULT CommandList::Close()
 {
+	if (closingBarriers.size())
+	{
+		FlushBarriers();
+
+		SubmitBarriers(closingBarriers);
+		closingBarriers.clear();
+	}
+
 	return list->Close();
 }
 
 HRESULT CommandList::Reset()
 {
+	boundPipeline = nullptr;
+	pendingBarriers.clear();
+	closingBarriers.clear();
+	knownStates.clear();
+	entryStates.clear();
+	localStateTracking = false;
+
 	auto result = allocator->Reset();
 	if (FAILED(result))
 	{
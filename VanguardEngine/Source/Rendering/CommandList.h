@@ -4,10 +4,18 @@
 
 #include <Rendering/Base.h>
 #include <Rendering/ResourceHandle.h>
+#include <Rendering/BindSlot.h>
 
 #include <Core/Windows/DirectX12Minimal.h>
 
+#include <array>
 #include <cstring>
+#include <optional>
+#include <span>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 class RenderDevice;
 class RenderGraph;
@@ -16,67 +24,171 @@ class RenderPipelineLayout;
 class DescriptorAllocator;
 struct PipelineStateReflection;
 
+// States which are only valid on direct command lists, compute lists cannot transition into or out of these.
+inline bool IsComputeCompatibleState(D3D12_RESOURCE_STATES state)
+{
+	constexpr auto graphicsOnlyStates =
+		D3D12_RESOURCE_STATE_INDEX_BUFFER |
+		D3D12_RESOURCE_STATE_RENDER_TARGET |
+		D3D12_RESOURCE_STATE_DEPTH_WRITE |
+		D3D12_RESOURCE_STATE_DEPTH_READ |
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE |
+		D3D12_RESOURCE_STATE_STREAM_OUT |
+		D3D12_RESOURCE_STATE_RESOLVE_DEST |
+		D3D12_RESOURCE_STATE_RESOLVE_SOURCE |
+		D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE;
+
+	return (state & graphicsOnlyStates) == 0;
+}
+
+// Targets of a native render pass, with the accesses of its first segment.
+struct RenderPassTargets
+{
+	std::array<D3D12_RENDER_PASS_RENDER_TARGET_DESC, D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT> renderTargets;
+	uint32_t renderTargetCount = 0;
+	std::optional<D3D12_RENDER_PASS_DEPTH_STENCIL_DESC> depthStencil;
+	D3D12_RENDER_PASS_FLAGS flags = D3D12_RENDER_PASS_FLAG_NONE;
+};
+
 class CommandList
 {
 protected:
 	ResourcePtr<ID3D12CommandAllocator> allocator;  // #TODO: Potentially share allocators? Something to look into in the future.
 	ResourcePtr<ID3D12GraphicsCommandList5> list;
+	ResourcePtr<ID3D12GraphicsCommandList7> enhancedList;  // Only set when the device uses enhanced barriers.
+	ResourcePtr<ID3D12GraphicsCommandList6> meshList;  // Only set when the device supports mesh shaders.
 	RenderDevice* device;
 	RenderGraph* graph;
 	size_t passIndex;
+	D3D12_COMMAND_LIST_TYPE type;
 
 	// Stateful tracking of the bound pipeline.
 	const PipelineState* boundPipeline = nullptr;
 
 	std::vector<D3D12_RESOURCE_BARRIER> pendingBarriers;
+	std::vector<D3D12_RESOURCE_BARRIER> closingBarriers;  // Submitted after all other commands, when closing the list.
+
+	// Pass-local state tracking, used while passes are recording in parallel. Resource components are not written to,
+	// and any transitions made by the pass are reverted when tracking ends, so the graph's barrier plan stays valid.
+	bool localStateTracking = false;
+	std::unordered_map<entt::entity, D3D12_RESOURCE_STATES> knownStates;  // States last set by this list.
+	std::unordered_map<entt::entity, std::pair<ID3D12Resource*, D3D12_RESOURCE_STATES>> entryStates;  // States prior to pass-local transitions.
+
+	enum class RenderPassState
+	{
+		None,
+		Active,
+		Suspended
+	};
+
+	// Native render pass of a graphics pass. Barriers, dispatches, copies and clears aren't allowed within a render pass,
+	// so they suspend it, and the next graphics pipeline or draw resumes it with every target preserved.
+	RenderPassTargets renderPass;
+	RenderPassState renderPassState = RenderPassState::None;
+	bool renderPassDiscards = false;  // The active segment doesn't store all of its targets, so it can't be suspended.
 
 private:
-	void TransitionBarrierInternal(ID3D12Resource* resource, D3D12_RESOURCE_STATES oldState, D3D12_RESOURCE_STATES newState);
+	D3D12_RESOURCE_STATES ResolveState(D3D12_RESOURCE_STATES oldState, D3D12_RESOURCE_STATES newState) const;
+	void TransitionBarrierInternal(ID3D12Resource* resource, D3D12_RESOURCE_STATES oldState, D3D12_RESOURCE_STATES newState, D3D12_RESOURCE_BARRIER_FLAGS flags);
+	void TransitionBarrierTracked(entt::entity entity, ID3D12Resource* resource, D3D12_RESOURCE_STATES& componentState, D3D12_RESOURCE_STATES newState, D3D12_RESOURCE_BARRIER_FLAGS flags);
+	void SubmitBarriers(const std::vector<D3D12_RESOURCE_BARRIER>& barriers);  // Translates to enhanced barriers when supported.
 	void BindResourceInternal(const std::string& bindName, BufferHandle handle, size_t offset, bool optional);
 
 public:
 	auto* Native() const noexcept { return list.Get(); }
+	auto Type() const noexcept { return type; }
 
 	void Create(RenderDevice* inDevice, RenderGraph* inGraph, D3D12_COMMAND_LIST_TYPE type, size_t pass);
 	void SetName(std::wstring_view name);
-
-	// #TODO: Support split barriers.
-	void TransitionBarrier(BufferHandle resource, D3D12_RESOURCE_STATES state);
-	void TransitionBarrier(TextureHandle resource, D3D12_RESOURCE_STATES state);
+	void SetPass(RenderGraph* inGraph, size_t pass);  // Rebinds a pooled list to a new pass.
+
+	// Split barriers begin with BEGIN_ONLY, which leaves the tracked state unchanged, and the matching END_ONLY transition
+	// must be issued later on the same queue. Split barriers are not supported with local state tracking.
+	void TransitionBarrier(BufferHandle resource, D3D12_RESOURCE_STATES state, D3D12_RESOURCE_BARRIER_FLAGS flags = D3D12_RESOURCE_BARRIER_FLAG_NONE);
+	void TransitionBarrier(TextureHandle resource, D3D12_RESOURCE_STATES state, D3D12_RESOURCE_BARRIER_FLAGS flags = D3D12_RESOURCE_BARRIER_FLAG_NONE);
+	// State of the resource at this point in the list, including transitions made by the list under local tracking.
+	D3D12_RESOURCE_STATES GetState(BufferHandle resource) const;
+	// Transitions after all other commands in the list, used to hand resources off to another queue, or to begin split barriers.
+	template <typename T>
+	void ClosingTransitionBarrier(T resource, D3D12_RESOURCE_STATES state, D3D12_RESOURCE_BARRIER_FLAGS flags = D3D12_RESOURCE_BARRIER_FLAG_NONE);
 	void UAVBarrier(BufferHandle resource);
 	void UAVBarrier(TextureHandle resource);
+	// Orders builds, copies and ray queries of an acceleration structure, which never leaves its state.
+	void AccelerationStructureBarrier(BufferHandle resource);
+	// Activates a placed resource, the memory's previous contents are discarded.
+	void AliasingBarrier(BufferHandle resource);
+	void AliasingBarrier(TextureHandle resource);
 
 	// Batch submits all pending barriers to the driver.
 	void FlushBarriers();
+	std::span<const D3D12_RESOURCE_BARRIER> GetPendingBarriers() const noexcept { return pendingBarriers; }
+	size_t GetClosingBarrierCount() const noexcept { return closingBarriers.size(); }
+
+	// Used by the render graph around parallel pass recording. Ending local tracking restores the states from before it began.
+	void BeginLocalStateTracking();
+	void EndLocalStateTracking();
 
 	void BindPipelineState(const PipelineState& state);
 	void BindPipeline(const RenderPipelineLayout& layout);
 	void BindDescriptorAllocator(DescriptorAllocator& allocator, bool visibleHeap = true);
-	void BindConstants(const std::string& bindName, const std::vector<uint32_t>& data, size_t offset = 0);
+	void BindConstants(BindSlot slot, std::span<const uint32_t> data, size_t offset = 0);
 	template <typename T>
-	void BindConstants(const std::string& bindName, const T& data, size_t offset = 0);
+		requires (!std::is_convertible_v<const T&, std::span<const uint32_t>>)
+	void BindConstants(BindSlot slot, const T& data, size_t offset = 0);
 	void BindResource(const std::string& bindName, BufferHandle handle, size_t offset = 0);
 	void BindResourceOptional(const std::string& bindName, BufferHandle handle, size_t offset = 0);
 	void BindResourceTable(const std::string& bindName, D3D12_GPU_DESCRIPTOR_HANDLE descriptor);
 
+	// Render passes are only begun by the render graph. Native commands that aren't allowed within a render pass must suspend
+	// it first, and native draws must resume it.
+	void BeginRenderPass(const RenderPassTargets& targets);
+	void EndRenderPass();
+	void SuspendRenderPass();
+	void ResumeRenderPass();
+
+	// Skips draws, dispatches, copies and clears while the 64-bit value at the byte offset is zero, until cleared. The
+	// buffer must be in the predication state, and the offset 8 byte aligned. Barriers are never predicated.
+	void SetPredication(BufferHandle buffer, size_t offset);
+	void ClearPredication();
+
+	// Shades draws at the per-tile rates of the image, the texture must be in the shading rate state. Requires variable
+	// rate shading support.
+	void SetShadingRateImage(TextureHandle image);
+	void ClearShadingRateImage();
+
 	void Dispatch(uint32_t x, uint32_t y, uint32_t z);
+	void DispatchMesh(uint32_t x, uint32_t y, uint32_t z);  // Requires mesh shader support.
 	void DrawFullscreenQuad();
 
 	void Copy(BufferHandle destination, BufferHandle source);
+	void Copy(BufferHandle destination, size_t destinationOffset, BufferHandle source, size_t sourceOffset, size_t size);  // Byte offsets.
 	void Copy(TextureHandle destination, TextureHandle source);
 
+	// Clears with the texture's clear value, the whole texture if no rects are given. Stencil formats clear their stencil too.
+	void ClearRenderTarget(TextureHandle texture, std::span<const D3D12_RECT> rects = {});
+	void ClearDepthStencil(TextureHandle texture, std::span<const D3D12_RECT> rects = {});
+
 	HRESULT Close();
 	HRESULT Reset();
 };
 
 template <typename T>
-inline void CommandList::BindConstants(const std::string& bindName, const T& data, size_t offset)
+	requires (!std::is_convertible_v<const T&, std::span<const uint32_t>>)
+inline void CommandList::BindConstants(BindSlot slot, const T& data, size_t offset)
 {
-	std::vector<uint32_t> constants;
-	constants.resize(sizeof(T) / sizeof(uint32_t));
-	std::memcpy(constants.data(), &data, constants.size() * sizeof(uint32_t));
+	static_assert(std::is_trivially_copyable_v<T>, "Root constants must be trivially copyable.");
+	static_assert(sizeof(T) % sizeof(uint32_t) == 0, "Root constants must be a multiple of 32 bits.");
 
-	BindConstants(bindName, constants, offset);
+	BindConstants(slot, std::span{ reinterpret_cast<const uint32_t*>(&data), sizeof(T) / sizeof(uint32_t) }, offset);
+}
+
+template <typename T>
+inline void CommandList::ClosingTransitionBarrier(T resource, D3D12_RESOURCE_STATES state, D3D12_RESOURCE_BARRIER_FLAGS flags)
+{
+	const auto pendingCount = pendingBarriers.size();
+	TransitionBarrier(resource, state, flags);
+	closingBarriers.insert(closingBarriers.end(), pendingBarriers.begin() + pendingCount, pendingBarriers.end());
+	pendingBarriers.resize(pendingCount);
 }
 
 inline void CommandList::BindResource(const std::string& bindName, BufferHandle handle, size_t offset)
@@ -3,14 +3,31 @@
 #include <Rendering/DescriptorAllocator.h>
 #include <Rendering/Device.h>
 
-void DescriptorAllocator::Initialize(RenderDevice* inDevice, size_t shaderDescriptors, size_t renderTargetDescriptors, size_t depthStencilDescriptors)
+namespace
+{
+	// Fraction of a heap's descriptors in use before it doubles in size. Leaves room for a frame's worth of allocations,
+	// since heaps can only grow between frames.
+	constexpr float growThreshold = 0.75f;
+
+	constexpr size_t samplerDescriptors = 256;
+}
+
+void DescriptorAllocator::Initialize(RenderDevice* inDevice, size_t shaderDescriptors, size_t frameDescriptors, size_t renderTargetDescriptors, size_t depthStencilDescriptors)
 {
 	VGScopedCPUStat("Descriptor Allocator Initialize");
 
-	defaultHeap.Create(inDevice, DescriptorType::Default, shaderDescriptors, true);
-	defaultNonVisibleHeap.Create(inDevice, DescriptorType::Default, shaderDescriptors, false);
+	device = inDevice;
+	retiredHeaps.resize(RenderDevice::frameCount);
+
+	const auto totalFrameDescriptors = frameDescriptors * RenderDevice::frameCount;
+
+	defaultHeap.Create(inDevice, DescriptorType::Default, shaderDescriptors + totalFrameDescriptors, true);
+	defaultNonVisibleHeap.Create(inDevice, DescriptorType::Default, shaderDescriptors + totalFrameDescriptors, false);
+	frameHeap.Create(defaultHeap, frameDescriptors, RenderDevice::frameCount);
+	frameNonVisibleHeap.Create(defaultNonVisibleHeap, frameDescriptors, RenderDevice::frameCount);
 	renderTargetHeap.Create(inDevice, DescriptorType::RenderTarget, renderTargetDescriptors, false);
 	depthStencilHeap.Create(inDevice, DescriptorType::DepthStencil, depthStencilDescriptors, false);
+	samplerHeap.Create(inDevice, DescriptorType::Sampler, samplerDescriptors, true);
 }
 
 DescriptorHandle DescriptorAllocator::Allocate(DescriptorType type)
@@ -18,8 +35,9 @@ DescriptorHandle DescriptorAllocator::Allocate(DescriptorType type)
 	switch (type)
 	{
 	case DescriptorType::Default:
-	case DescriptorType::Sampler:
 		return defaultHeap.Allocate();
+	case DescriptorType::Sampler:
+		return samplerHeap.Allocate();
 	case DescriptorType::RenderTarget:
 		return renderTargetHeap.Allocate();
 	case DescriptorType::DepthStencil:
@@ -34,7 +52,42 @@ DescriptorHandle DescriptorAllocator::AllocateNonVisible()
 	return defaultNonVisibleHeap.Allocate();
 }
 
+DescriptorHandle DescriptorAllocator::AllocateFrame()
+{
+	return frameHeap.Allocate();
+}
+
+DescriptorHandle DescriptorAllocator::AllocateFrameNonVisible()
+{
+	return frameNonVisibleHeap.Allocate();
+}
+
+void DescriptorAllocator::Flush()
+{
+	VGScopedCPUStat("Descriptor Allocator Flush");
+
+	defaultHeap.Flush();
+	frameHeap.Flush();
+	samplerHeap.Flush();
+}
+
 void DescriptorAllocator::FrameStep(size_t frameIndex)
 {
 	VGScopedCPUStat("Descriptor Allocator Frame Step");
+
+	// The GPU has finished the frame that last used this index.
+	frameHeap.Reset(frameIndex);
+	frameNonVisibleHeap.Reset(frameIndex);
+	retiredHeaps[frameIndex].clear();
+
+	// Growing ahead of time keeps allocations during the frame from ever stalling on a new heap, or running out.
+	if (auto previousHeap = defaultHeap.GrowIfNeeded(growThreshold); previousHeap)
+	{
+		retiredHeaps[frameIndex].emplace_back(std::move(previousHeap));
+	}
+
+	// Non-visible heaps are never referenced by the GPU, the previous heaps are released right away.
+	defaultNonVisibleHeap.GrowIfNeeded(growThreshold);
+	renderTargetHeap.GrowIfNeeded(growThreshold);
+	depthStencilHeap.GrowIfNeeded(growThreshold);
 }
\ No newline at end of file
@@ -7,6 +7,8 @@
 
 #include <Core/Windows/DirectX12Minimal.h>
 
+#include <vector>
+
 class RenderDevice;
 
 class DescriptorAllocator
@@ -20,15 +22,30 @@ private:
 	FreeQueueDescriptorHeap defaultNonVisibleHeap;
 	FreeQueueDescriptorHeap renderTargetHeap;
 	FreeQueueDescriptorHeap depthStencilHeap;
+	FreeQueueDescriptorHeap samplerHeap;  // Shader-visible, never grows since sampler heaps are limited to 2048 samplers.
+
+	// Partitioned at the start of the default heaps.
+	LinearDescriptorHeap frameHeap;
+	LinearDescriptorHeap frameNonVisibleHeap;
+
+	// Shader-visible heaps replaced by growing, released once the GPU has finished the frames that used them.
+	std::vector<std::vector<ResourcePtr<ID3D12DescriptorHeap>>> retiredHeaps;
 
 public:
-	void Initialize(RenderDevice* inDevice, size_t shaderDescriptors, size_t renderTargetDescriptors, size_t depthStencilDescriptors);
+	// Frame descriptors are per frame, in addition to the persistent shader descriptors.
+	void Initialize(RenderDevice* inDevice, size_t shaderDescriptors, size_t frameDescriptors, size_t renderTargetDescriptors, size_t depthStencilDescriptors);
 
 	DescriptorHandle Allocate(DescriptorType type);
 	DescriptorHandle AllocateNonVisible();  // Used to obtain a default descriptor in a non-visible heap.
+	// Only valid until the end of the current frame, and never freed.
+	DescriptorHandle AllocateFrame();
+	DescriptorHandle AllocateFrameNonVisible();
 
 	D3D12_GPU_DESCRIPTOR_HANDLE GetBindlessHeap() const;
-	
+
+	// Makes the descriptors written since the last flush visible to shaders, call before submitting work.
+	void Flush();
+	// Heaps only grow here, before any command lists of the frame have bound them.
 	void FrameStep(size_t frameIndex);
 };
 
@@ -4,87 +4,233 @@
 #include <Rendering/Device.h>
 #include <Rendering/Resource.h>
 
+namespace
+{
+	D3D12_DESCRIPTOR_HEAP_TYPE GetHeapType(DescriptorType type)
+	{
+		switch (type)
+		{
+		case DescriptorType::Default: return D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+		case DescriptorType::Sampler: return D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER;
+		case DescriptorType::RenderTarget: return D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
+		case DescriptorType::DepthStencil: return D3D12_DESCRIPTOR_HEAP_TYPE_DSV;
+		}
+
+		return D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	}
+
+	ResourcePtr<ID3D12DescriptorHeap> CreateNativeHeap(RenderDevice* device, DescriptorType type, size_t descriptors, bool visible)
+	{
+		D3D12_DESCRIPTOR_HEAP_DESC heapDesc{};
+		heapDesc.Type = GetHeapType(type);
+		heapDesc.NumDescriptors = static_cast<UINT>(descriptors);
+		heapDesc.Flags = visible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+		heapDesc.NodeMask = 0;
+
+		ResourcePtr<ID3D12DescriptorHeap> heap;
+		auto result = device->Native()->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(heap.Indirect()));
+		if (FAILED(result))
+		{
+			VGLogCritical(logRendering, "Failed to create descriptor heap for type '{}' with {} descriptors: {}", (int)type, descriptors, result);
+		}
+
+		return heap;
+	}
+}
+
+#include <algorithm>
 #include <limits>
+#include <mutex>
 
-void DescriptorHeapBase::Create(RenderDevice* device, DescriptorType type, size_t descriptors, bool visible)
+void DescriptorHeapBase::Create(RenderDevice* inDevice, DescriptorType inType, size_t descriptors, bool inVisible)
 {
 	VGScopedCPUStat("Descriptor Heap Create");
 
-	D3D12_DESCRIPTOR_HEAP_TYPE heapType{};
+	device = inDevice;
+	type = inType;
+	visible = inVisible;
 
-	switch (type)
-	{
-	case DescriptorType::Default: heapType = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV; break;
-	case DescriptorType::Sampler: heapType = D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER; break;
-	case DescriptorType::RenderTarget: heapType = D3D12_DESCRIPTOR_HEAP_TYPE_RTV; break;
-	case DescriptorType::DepthStencil: heapType = D3D12_DESCRIPTOR_HEAP_TYPE_DSV; break;
-	}
+	heap = CreateNativeHeap(device, type, descriptors, visible);
 
-	D3D12_DESCRIPTOR_HEAP_DESC heapDesc{};
-	heapDesc.Type = heapType;
-	heapDesc.NumDescriptors = static_cast<UINT>(descriptors);
-	heapDesc.Flags = visible ? D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE : D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
-	heapDesc.NodeMask = 0;
-
-	auto result = device->Native()->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(heap.Indirect()));
-	if (FAILED(result))
+	if (visible)
 	{
-		VGLogCritical(logRendering, "Failed to create descriptor heap for type '{}' with {} descriptors: {}", (int)type, descriptors, result);
+		stagingHeap = CreateNativeHeap(device, type, descriptors, false);
+		cpuHeapStart = stagingHeap->GetCPUDescriptorHandleForHeapStart().ptr;
+		gpuHeapStart = heap->GetGPUDescriptorHandleForHeapStart().ptr;
+		visibleCpuStart = heap->GetCPUDescriptorHandleForHeapStart().ptr;
 	}
 
-	cpuHeapStart = heap->GetCPUDescriptorHandleForHeapStart().ptr;
-	if (visible)
-		gpuHeapStart = heap->GetGPUDescriptorHandleForHeapStart().ptr;
 	else
+	{
+		cpuHeapStart = heap->GetCPUDescriptorHandleForHeapStart().ptr;
 		gpuHeapStart = cpuHeapStart;
-	descriptorSize = device->Native()->GetDescriptorHandleIncrementSize(heapType);
+	}
+
+	descriptorSize = device->Native()->GetDescriptorHandleIncrementSize(GetHeapType(type));
 	totalDescriptors = descriptors;
 }
 
+size_t DescriptorHeapBase::Reserve(size_t descriptors)
+{
+	VGAssert(allocatedDescriptors == 0, "Descriptors must be reserved before any are allocated.");
+	VGAssert(reservedDescriptors + descriptors <= totalDescriptors, "Not enough unallocated descriptors to reserve %zu.", descriptors);
+
+	reservedDescriptors += descriptors;
+
+	return reservedDescriptors - descriptors;
+}
+
+void DescriptorHeapBase::CopyToVisible(size_t index, size_t descriptors)
+{
+	if (!stagingHeap || descriptors == 0)
+		return;
+
+	const D3D12_CPU_DESCRIPTOR_HANDLE destination{ visibleCpuStart + index * descriptorSize };
+	const D3D12_CPU_DESCRIPTOR_HANDLE source{ cpuHeapStart + index * descriptorSize };
+	device->Native()->CopyDescriptorsSimple(static_cast<UINT>(descriptors), destination, source, GetHeapType(type));
+}
+
+ResourcePtr<ID3D12DescriptorHeap> DescriptorHeapBase::Grow(size_t descriptors)
+{
+	VGScopedCPUStat("Descriptor Heap Grow");
+
+	VGLog(logRendering, "Growing descriptor heap for type '{}' from {} to {} descriptors.", (int)type, totalDescriptors, descriptors);
+
+	const auto usedDescriptors = reservedDescriptors + allocatedDescriptors;
+	const D3D12_CPU_DESCRIPTOR_HANDLE source{ cpuHeapStart };
+
+	// The staging heap is CPU-only and can be released as soon as it's been copied from.
+	auto previousHeap = std::move(heap);
+	auto previousStagingHeap = std::move(stagingHeap);
+
+	Create(device, type, descriptors, visible);
+
+	// One bulk copy of every descriptor, free or not, keeps all of the indices stable.
+	device->Native()->CopyDescriptorsSimple(static_cast<UINT>(usedDescriptors), { cpuHeapStart }, source, GetHeapType(type));
+	CopyToVisible(0, usedDescriptors);
+
+	return previousHeap;
+}
+
 DescriptorHandle FreeQueueDescriptorHeap::Allocate()
 {
 	VGScopedCPUStat("Descriptor Heap Allocate");
 
-	// If we have readily available space in the heap, use that first.
-	if (allocatedDescriptors < totalDescriptors)
-	{
-		++allocatedDescriptors;
+	std::scoped_lock scopedLock{ lock };
 
-		const auto offset = (allocatedDescriptors - 1) * descriptorSize;
+	uint32_t index;
 
-		DescriptorHandle handle{};
-		handle.parentHeap = this;
-		handle.cpuPointer = cpuHeapStart + offset;
-		handle.gpuPointer = gpuHeapStart + offset;
-		handle.bindlessIndex = allocatedDescriptors - 1;
-
-		return handle;
+	// Recycle freed descriptors first, keeping the heap compact.
+	if (!freeIndices.empty())
+	{
+		index = freeIndices.back();
+		freeIndices.pop_back();
 	}
 
 	else
 	{
-		VGEnsure(!freeQueue.empty(), "Ran out of free queue descriptor heap memory.");
+		VGEnsure(reservedDescriptors + allocatedDescriptors < totalDescriptors, "Ran out of free queue descriptor heap memory.");
 
-		auto handle = std::move(freeQueue.front());
-		freeQueue.pop();
+		index = static_cast<uint32_t>(reservedDescriptors + allocatedDescriptors);
+		++allocatedDescriptors;
+	}
 
-		return handle;
+	if (visible)
+	{
+		pendingIndices.emplace_back(index);
 	}
+
+	DescriptorHandle handle{};
+	handle.parentHeap = this;
+	handle.bindlessIndex = index;
+
+	return handle;
 }
 
 void FreeQueueDescriptorHeap::Free(DescriptorHandle&& handle)
 {
 	VGScopedCPUStat("Descriptor Heap Free");
 
-	freeQueue.push(std::move(handle));
+	std::scoped_lock scopedLock{ lock };
+
+	freeIndices.emplace_back(handle.bindlessIndex);
+	handle.parentHeap = nullptr;
 }
 
-FreeQueueDescriptorHeap::~FreeQueueDescriptorHeap()
+void FreeQueueDescriptorHeap::Flush()
 {
-	// Discard any remaining descriptors in the free queue.
-	while (freeQueue.size())
+	VGScopedCPUStat("Descriptor Heap Flush");
+
+	std::scoped_lock scopedLock{ lock };
+
+	if (pendingIndices.empty())
+		return;
+
+	// Allocations are mostly sequential, copy contiguous runs at once.
+	std::sort(pendingIndices.begin(), pendingIndices.end());
+
+	size_t runStart = 0;
+	for (size_t i = 1; i <= pendingIndices.size(); ++i)
 	{
-		freeQueue.front().parentHeap = nullptr;
-		freeQueue.pop();
+		if (i == pendingIndices.size() || pendingIndices[i] != pendingIndices[i - 1] + 1)
+		{
+			CopyToVisible(pendingIndices[runStart], i - runStart);
+			runStart = i;
+		}
 	}
+
+	pendingIndices.clear();
+}
+
+ResourcePtr<ID3D12DescriptorHeap> FreeQueueDescriptorHeap::GrowIfNeeded(float threshold)
+{
+	std::scoped_lock scopedLock{ lock };
+
+	const auto capacity = totalDescriptors - reservedDescriptors;
+	const auto liveDescriptors = allocatedDescriptors - freeIndices.size();
+
+	if (liveDescriptors < capacity * threshold)
+		return {};
+
+	// Any pending descriptors are copied along with the rest.
+	pendingIndices.clear();
+
+	return Grow(reservedDescriptors + capacity * 2);
+}
+
+void LinearDescriptorHeap::Create(DescriptorHeapBase& inParent, size_t partitionDescriptors, size_t partitions)
+{
+	parent = &inParent;
+	bindlessStart = parent->Reserve(partitionDescriptors * partitions);
+	partitionSize = partitionDescriptors;
+}
+
+DescriptorHandle LinearDescriptorHeap::Allocate()
+{
+	const auto index = allocated.fetch_add(1, std::memory_order_relaxed);
+	VGEnsure(index < partitionSize, "Ran out of linear descriptor heap memory.");
+
+	const auto heapIndex = bindlessStart + partition * partitionSize + index;
+
+	DescriptorHandle handle{};
+	handle.cpuPointer = parent->GetCPUHandle(heapIndex).ptr;
+	handle.gpuPointer = parent->GetGPUHandle(heapIndex).ptr;
+	handle.bindlessIndex = static_cast<uint32_t>(heapIndex);
+
+	return handle;
+}
+
+void LinearDescriptorHeap::Flush()
+{
+	const auto current = std::min(allocated.load(std::memory_order_relaxed), partitionSize);
+
+	parent->CopyToVisible(bindlessStart + partition * partitionSize + flushed, current - flushed);
+	flushed = current;
+}
+
+void LinearDescriptorHeap::Reset(size_t inPartition)
+{
+	partition = inPartition;
+	allocated.store(0, std::memory_order_relaxed);
+	flushed = 0;
 }
\ No newline at end of file
@@ -3,11 +3,13 @@
 #pragma once
 
 #include <Rendering/Base.h>
+#include <Threading/CriticalSection.h>
 
 #include <Core/Windows/DirectX12Minimal.h>
 
 #include <memory>
-#include <queue>
+#include <vector>
+#include <atomic>
 
 class RenderDevice;
 
@@ -23,9 +25,12 @@ struct DescriptorHandle
 {
 	friend class DescriptorHeapBase;
 	friend class FreeQueueDescriptorHeap;
+	friend class LinearDescriptorHeap;
 
 private:
 	FreeQueueDescriptorHeap* parentHeap = nullptr;  // Optional heap, if we were allocated from a free queue heap.
+	// Only used without a parent heap. Free queue heaps can grow into a new native heap, so their handles are resolved
+	// through the parent instead.
 	uint64_t cpuPointer = 0;
 	uint64_t gpuPointer = 0;
 
@@ -40,42 +45,104 @@ public:
 	DescriptorHandle& operator=(const DescriptorHandle&) = delete;
 	DescriptorHandle& operator=(DescriptorHandle&&) noexcept = default;
 
-	operator D3D12_CPU_DESCRIPTOR_HANDLE() const noexcept { return { cpuPointer }; }
-	operator D3D12_GPU_DESCRIPTOR_HANDLE() const noexcept { return { gpuPointer }; }
+	operator D3D12_CPU_DESCRIPTOR_HANDLE() const noexcept;
+	operator D3D12_GPU_DESCRIPTOR_HANDLE() const noexcept;
 
 	void Free();
 };
 
 class DescriptorHeapBase
 {
+	friend class LinearDescriptorHeap;
+
 protected:
+	RenderDevice* device = nullptr;
+	DescriptorType type = DescriptorType::Default;
+	bool visible = false;
+
 	ResourcePtr<ID3D12DescriptorHeap> heap;
-	size_t cpuHeapStart = 0;
+	// Shader-visible heaps can't be copied from, so descriptors are written into this CPU-only mirror and flushed into the
+	// visible heap before use. The mirror is also the source when growing.
+	ResourcePtr<ID3D12DescriptorHeap> stagingHeap;
+	size_t cpuHeapStart = 0;  // Where descriptors are written, in the staging heap if there is one.
 	size_t gpuHeapStart = 0;
+	size_t visibleCpuStart = 0;  // Destination of flushes from the staging heap.
 	size_t descriptorSize = 0;  // Increment size.
+	size_t reservedDescriptors = 0;  // At the start of the heap, before any allocated descriptors.
 	size_t allocatedDescriptors = 0;
 	size_t totalDescriptors = 0;
 
+	void CopyToVisible(size_t index, size_t descriptors);
+	// Recreates the heap with more descriptors, keeping the existing ones at the same indices. Returns the previous
+	// shader-visible heap, which must outlive any GPU work still referencing it.
+	ResourcePtr<ID3D12DescriptorHeap> Grow(size_t descriptors);
+
 public:
-	void Create(RenderDevice* device, DescriptorType type, size_t descriptors, bool visible);
+	void Create(RenderDevice* inDevice, DescriptorType inType, size_t descriptors, bool inVisible);
+	// Removes descriptors from the start of the heap for another allocator, returns the index of the first one. Reserved
+	// ranges keep their indices when the heap grows.
+	size_t Reserve(size_t descriptors);
 
 	auto* Native() noexcept { return heap.Get(); }
 
 	size_t GetGPUHeapStart() const { return gpuHeapStart; }
+	D3D12_CPU_DESCRIPTOR_HANDLE GetCPUHandle(size_t index) const noexcept { return { cpuHeapStart + index * descriptorSize }; }
+	D3D12_GPU_DESCRIPTOR_HANDLE GetGPUHandle(size_t index) const noexcept { return { gpuHeapStart + index * descriptorSize }; }
 };
 
+// Bump allocates, then recycles freed descriptors from a free list. Handles keep their index for their whole life, the
+// heap can grow without invalidating them.
 class FreeQueueDescriptorHeap : public DescriptorHeapBase
 {
 private:
-	std::queue<DescriptorHandle> freeQueue;
+	std::vector<uint32_t> freeIndices;
+	std::vector<uint32_t> pendingIndices;  // Allocated since the last flush, only tracked for shader-visible heaps.
+	CriticalSection lock;  // Passes can allocate descriptors while recording in parallel.
 
 public:
 	DescriptorHandle Allocate();
 	void Free(DescriptorHandle&& handle);
 
-	~FreeQueueDescriptorHeap();
+	// Copies newly written descriptors into the shader-visible heap. Must be called after writing descriptors and before
+	// submitting work that uses them.
+	void Flush();
+
+	// Grows ahead of running out when the live descriptors pass the threshold, returns the previous shader-visible heap
+	// if it grew. Must not be called while allocating, or while command lists bound to the heap are recording.
+	ResourcePtr<ID3D12DescriptorHeap> GrowIfNeeded(float threshold);
+};
+
+// Bump allocates descriptors which only live for a single frame, from a range reserved at the start of another heap. The
+// range is split into a partition per frame, each reset once the GPU has finished the frame that last used it.
+// Descriptors aren't freed individually, their handles have no parent heap.
+class LinearDescriptorHeap
+{
+private:
+	DescriptorHeapBase* parent = nullptr;
+	size_t bindlessStart = 0;
+	size_t partitionSize = 0;
+	size_t partition = 0;
+	std::atomic<size_t> allocated = 0;  // Within the current partition.
+	size_t flushed = 0;
+
+public:
+	void Create(DescriptorHeapBase& inParent, size_t partitionDescriptors, size_t partitions);
+
+	DescriptorHandle Allocate();
+	void Flush();  // Must not be called while allocating.
+	void Reset(size_t inPartition);  // Must not be called while allocating.
 };
 
+inline DescriptorHandle::operator D3D12_CPU_DESCRIPTOR_HANDLE() const noexcept
+{
+	return parentHeap ? parentHeap->GetCPUHandle(bindlessIndex) : D3D12_CPU_DESCRIPTOR_HANDLE{ cpuPointer };
+}
+
+inline DescriptorHandle::operator D3D12_GPU_DESCRIPTOR_HANDLE() const noexcept
+{
+	return parentHeap ? parentHeap->GetGPUHandle(bindlessIndex) : D3D12_GPU_DESCRIPTOR_HANDLE{ gpuPointer };
+}
+
 inline void DescriptorHandle::Free()
 {
 	// parentHeap isn't always valid.
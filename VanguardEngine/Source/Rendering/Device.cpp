@@ -4,9 +4,12 @@
 #include <Rendering/ResourceManager.h>
 #include <Core/Config.h>
 #include <Utility/AlignedSize.h>
+#include <Utility/StringTools.h>
 #include <Rendering/DREDHelper.h>
+#include <Core/Memory.h>
 
 #include <algorithm>
+#include <mutex>
 
 #if !BUILD_RELEASE
 #include <dxgidebug.h>
@@ -16,11 +19,15 @@ void OnDeviceRemoved(void* context, uint8_t)
 {
 	RequestCrash([context]()
 	{
-		auto* device = static_cast<ID3D12Device5*>(context);
+		auto* renderDevice = static_cast<RenderDevice*>(context);
+		auto* device = renderDevice->Native();
 		auto removedReason = device->GetDeviceRemovedReason();
 
 		VGLogError(logRendering, "Device removed, reason: {}", removedReason);
 
+		const auto breadcrumbs = renderDevice->GetBreadcrumbs().Report();
+		VGLogError(logRendering, "{}", breadcrumbs);
+
 		ResourcePtr<ID3D12DeviceRemovedExtendedData1> dred;
 		auto result = device->QueryInterface(IID_PPV_ARGS(dred.Indirect()));
 		if (FAILED(result))
@@ -32,6 +39,9 @@ void OnDeviceRemoved(void* context, uint8_t)
 		{
 			LogDredInfo(device, dred.Get());
 		}
+
+		// Also lands in the crash log, DRED is only enabled when debugging.
+		ReportInternalCrashEvent(VGText("Device removed.\n") + Str2WideStr(breadcrumbs), false);
 	});
 }
 
@@ -43,9 +53,15 @@ void RenderDevice::SetNames()
 	device->SetName(VGText("Primary render device"));
 
 	directCommandQueue->SetName(VGText("Direct command queue"));
+	computeCommandQueue->SetName(VGText("Compute command queue"));
+	copyCommandQueue->SetName(VGText("Copy command queue"));
+	directQueueFence->SetName(VGText("Direct queue fence"));
+	computeQueueFence->SetName(VGText("Compute queue fence"));
+	copyQueueFence->SetName(VGText("Copy queue fence"));
 	for (uint32_t i = 0; i < frameCount; ++i)
 	{
 		directCommandList[i].SetName(VGText("Direct command list"));
+		copyCommandList[i].SetName(VGText("Copy command list"));
 	}
 #endif
 }
@@ -82,18 +98,118 @@ void RenderDevice::ResetFrame(size_t frameID)
 		VGLogError(logRendering, "Failed to reset direct command list for frame {}: {}", frameIndex, result);
 	}
 
+	const auto copyResult = copyCommandList[frameIndex].Reset();
+	if (FAILED(copyResult))
+	{
+		VGLogError(logRendering, "Failed to reset copy command list for frame {}: {}", frameIndex, copyResult);
+	}
+
+	const auto endResult = frameEndCommandLists[frameIndex].Reset();
+	if (FAILED(endResult))
+	{
+		VGLogError(logRendering, "Failed to reset frame end command list for frame {}: {}", frameIndex, endResult);
+	}
+
+	if (timestampHeap)
+	{
+		directCommandList[frameIndex].Native()->EndQuery(timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, frameIndex * 2);
+	}
+
+	profiler.BeginFrame(frameIndex);
+	breadcrumbs.BeginFrame(frameIndex, frameID);
+
 	descriptorManager.FrameStep(frameIndex);
 
-	for (auto& list : frameCommandLists[frameIndex])
+	// Pooled lists are reset lazily when they're reallocated, lists that went unused stay closed.
+	frameDirectCommandLists[frameIndex].used = 0;
+	frameComputeCommandLists[frameIndex].used = 0;
+}
+
+void RenderDevice::CreateFrameTimer()
+{
+	for (uint32_t i = 0; i < frameCount; ++i)
+	{
+		frameEndCommandLists[i].Create(this, nullptr, D3D12_COMMAND_LIST_TYPE_DIRECT, -1);
+
+		// Close all lists except the current frame's list.
+		if (i > 0)
+		{
+			frameEndCommandLists[i].Close();
+		}
+	}
+
+	auto result = directCommandQueue->GetTimestampFrequency(&timestampFrequency);
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to get direct queue timestamp frequency, GPU frame timing is unavailable: {}", result);
+		return;
+	}
+
+	profiler.Initialize(this, timestampFrequency);
+
+	D3D12_QUERY_HEAP_DESC heapDesc{};
+	heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	heapDesc.Count = frameCount * 2;
+	heapDesc.NodeMask = 0;
+
+	result = device->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(timestampHeap.Indirect()));
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to create timestamp query heap, GPU frame timing is unavailable: {}", result);
+		return;
+	}
+
+	timestampReadback = resourceManager.AllocateReadback(frameCount * 2 * sizeof(uint64_t), VGText("Frame timestamp readback"));
+	if (!timestampReadback)
 	{
-		list->Reset();
+		timestampHeap.Reset();
+		return;
 	}
 
-	// #TODO: Don't discard the lists, they can be reused.
-	frameCommandLists[frameIndex].clear();
+	// Frames begin with their reset, except for the first.
+	directCommandList[GetFrameIndex()].Native()->EndQuery(timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, GetFrameIndex() * 2);
 }
 
-RenderDevice::RenderDevice(void* window, bool software, bool enableDebugging)
+void RenderDevice::ReadFrameTime(size_t frameIndex)
+{
+	if (!timestampReadback)
+		return;
+
+	const D3D12_RANGE readRange{ frameIndex * 2 * sizeof(uint64_t), (frameIndex * 2 + 2) * sizeof(uint64_t) };
+	uint64_t* mappedData = nullptr;
+
+	const auto result = timestampReadback->GetResource()->Map(0, &readRange, reinterpret_cast<void**>(&mappedData));
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to map frame timestamp readback: {}", result);
+		return;
+	}
+
+	const auto begin = mappedData[frameIndex * 2];
+	const auto end = mappedData[frameIndex * 2 + 1];
+
+	const D3D12_RANGE writtenRange{ 0, 0 };
+	timestampReadback->GetResource()->Unmap(0, &writtenRange);
+
+	if (end > begin)
+	{
+		gpuFrameTime = static_cast<float>(static_cast<double>(end - begin) * 1000.0 / timestampFrequency);
+	}
+}
+
+void RenderDevice::JoinComputeQueue()
+{
+	if (computeQueueValue == 0)
+		return;  // No compute work submitted yet.
+
+	const auto result = directCommandQueue->Wait(computeQueueFence.Get(), computeQueueValue);
+	if (FAILED(result))
+	{
+		VGLogCritical(logRendering, "Failed to join compute queue: {}", result);
+	}
+}
+
+RenderDevice::RenderDevice(void* window, bool software, bool enableDebugging, bool enableEnhancedBarriers)
 {
 	VGScopedCPUStat("Render Device Initialize");
 
@@ -203,6 +319,86 @@ RenderDevice::RenderDevice(void* window, bool software, bool enableDebugging)
 
 	device.Reset(deviceCom.Detach());
 
+	if (enableEnhancedBarriers)
+	{
+		D3D12_FEATURE_DATA_D3D12_OPTIONS12 options12{};
+		result = device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS12, &options12, sizeof(options12));
+		if (FAILED(result))
+		{
+			VGLogError(logRendering, "Failed to check feature support for category 'options12': {}", result);
+		}
+
+		enhancedBarriers = SUCCEEDED(result) && options12.EnhancedBarriersSupported;
+		if (!enhancedBarriers)
+		{
+			VGLogWarning(logRendering, "Enhanced barriers are not supported by the device, falling back to legacy barriers.");
+		}
+	}
+
+	VGLog(logRendering, "Using {} resource barriers.", enhancedBarriers ? VGText("enhanced") : VGText("legacy"));
+
+	D3D12_FEATURE_DATA_D3D12_OPTIONS7 options7{};
+	result = device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS7, &options7, sizeof(options7));
+	meshShaders = SUCCEEDED(result) && options7.MeshShaderTier >= D3D12_MESH_SHADER_TIER_1;
+
+	VGLog(logRendering, "Mesh shaders {}.", meshShaders ? VGText("supported") : VGText("not supported, using the vertex shader path"));
+
+	// Tier 2 is required for reading unmapped tiles, which in-flight frames can do while residency changes.
+	D3D12_FEATURE_DATA_D3D12_OPTIONS options{};
+	result = device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options));
+	reservedResources = SUCCEEDED(result) && options.TiledResourcesTier >= D3D12_TILED_RESOURCES_TIER_2;
+
+	VGLog(logRendering, "Reserved resources {}.", reservedResources ? VGText("supported") : VGText("not supported, streaming with committed resources"));
+
+	// Tier 1.1 is required for inline ray queries.
+	D3D12_FEATURE_DATA_D3D12_OPTIONS5 options5{};
+	result = device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS5, &options5, sizeof(options5));
+	raytracing = SUCCEEDED(result) && options5.RaytracingTier >= D3D12_RAYTRACING_TIER_1_1;
+
+	VGLog(logRendering, "Ray tracing {}.", raytracing ? VGText("supported") : VGText("not supported, ray traced shadows are unavailable"));
+
+	// Tier 2 is required for shading rate images.
+	D3D12_FEATURE_DATA_D3D12_OPTIONS6 options6{};
+	result = device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS6, &options6, sizeof(options6));
+	variableRateShading = SUCCEEDED(result) && options6.VariableShadingRateTier >= D3D12_VARIABLE_SHADING_RATE_TIER_2;
+	shadingRateTileSize = variableRateShading ? options6.ShadingRateImageTileSize : 0;
+
+	VGLog(logRendering, "Variable rate shading {}.", variableRateShading ? VGText("supported") : VGText("not supported, shading every pixel at full rate"));
+
+	// Compute passes compose over the scene color in place, so a compact scene color needs typed loads of its format.
+	D3D12_FEATURE_DATA_FORMAT_SUPPORT compactFormatSupport{ DXGI_FORMAT_R11G11B10_FLOAT };
+	result = device->CheckFeatureSupport(D3D12_FEATURE_FORMAT_SUPPORT, &compactFormatSupport, sizeof(compactFormatSupport));
+	compactColorLoads = SUCCEEDED(result) && (compactFormatSupport.Support2 & D3D12_FORMAT_SUPPORT2_UAV_TYPED_LOAD);
+
+	VGLog(logRendering, "Compact scene color {}.", compactColorLoads ? VGText("supported") : VGText("not supported, using 16-bit float scene color"));
+
+	// Specialized shaders pack one or two words of lane bits per wave, so only 32 and 64 lanes qualify. The narrower size
+	// is preferred, culling diverges heavily and idles fewer lanes in narrower waves. That's 32 lanes on NVIDIA, RDNA and
+	// Intel, and 64 on GCN, which only runs wave64.
+	D3D12_FEATURE_DATA_D3D12_OPTIONS1 options1{};
+	result = device->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS1, &options1, sizeof(options1));
+	if (SUCCEEDED(result) && options1.WaveOps)
+	{
+		for (const auto size : { 32u, 64u })
+		{
+			if (options1.WaveLaneCountMin <= size && size <= options1.WaveLaneCountMax)
+			{
+				waveSize = size;
+				break;
+			}
+		}
+	}
+
+	if (waveSize > 0)
+	{
+		VGLog(logRendering, "Wave specialized shaders use {} lanes, device supports {} to {}.", waveSize, options1.WaveLaneCountMin, options1.WaveLaneCountMax);
+	}
+
+	else
+	{
+		VGLog(logRendering, "Wave size not specialized, using the generic shader variants.");
+	}
+
 	D3D12MA::ALLOCATOR_DESC allocatorDesc{};
 	allocatorDesc.pAdapter = renderAdapter.Native();
 	allocatorDesc.pDevice = device.Get();
@@ -216,7 +412,9 @@ RenderDevice::RenderDevice(void* window, bool software, bool enableDebugging)
 
 	resourceManager.Initialize(this, frameCount);
 
-	descriptorManager.Initialize(this, 4096, 64, 16);
+	pipelineLibrary.Initialize(this);
+
+	descriptorManager.Initialize(this, 4096, 1024, 64, 16);
 
 	// #TODO: Condense building queues and command lists into a function.
 
@@ -247,6 +445,65 @@ RenderDevice::RenderDevice(void* window, bool software, bool enableDebugging)
 		}
 	}
 
+	// Compute
+
+	D3D12_COMMAND_QUEUE_DESC computeCommandQueueDesc{};
+	computeCommandQueueDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
+	computeCommandQueueDesc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
+	computeCommandQueueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	computeCommandQueueDesc.NodeMask = 0;
+
+	result = device->CreateCommandQueue(&computeCommandQueueDesc, IID_PPV_ARGS(computeCommandQueue.Indirect()));
+	if (FAILED(result))
+	{
+		VGLogCritical(logRendering, "Failed to create compute command queue: {}", result);
+	}
+
+	computeContext = TracyD3D12Context(device.Get(), computeCommandQueue.Get());
+
+	// Copy
+
+	D3D12_COMMAND_QUEUE_DESC copyCommandQueueDesc{};
+	copyCommandQueueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	copyCommandQueueDesc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
+	copyCommandQueueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	copyCommandQueueDesc.NodeMask = 0;
+
+	result = device->CreateCommandQueue(&copyCommandQueueDesc, IID_PPV_ARGS(copyCommandQueue.Indirect()));
+	if (FAILED(result))
+	{
+		VGLogCritical(logRendering, "Failed to create copy command queue: {}", result);
+	}
+
+	for (int i = 0; i < frameCount; ++i)
+	{
+		copyCommandList[i].Create(this, nullptr, D3D12_COMMAND_LIST_TYPE_COPY, -1);
+
+		// Close all lists except the current frame's list.
+		if (i > 0)
+		{
+			copyCommandList[i].Close();
+		}
+	}
+
+	result = device->CreateFence(directQueueValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(directQueueFence.Indirect()));
+	if (FAILED(result))
+	{
+		VGLogCritical(logRendering, "Failed to create direct queue fence: {}", result);
+	}
+
+	result = device->CreateFence(computeQueueValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(computeQueueFence.Indirect()));
+	if (FAILED(result))
+	{
+		VGLogCritical(logRendering, "Failed to create compute queue fence: {}", result);
+	}
+
+	result = device->CreateFence(copyQueueValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(copyQueueFence.Indirect()));
+	if (FAILED(result))
+	{
+		VGLogCritical(logRendering, "Failed to create copy queue fence: {}", result);
+	}
+
 	uint32_t hasTearing = false;
 	result = factory->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &hasTearing, sizeof(hasTearing));
 	if (FAILED(result))
@@ -257,11 +514,15 @@ RenderDevice::RenderDevice(void* window, bool software, bool enableDebugging)
 
 	if (hasTearing)
 	{
-		swapChainFlags = DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+		swapChainFlags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+		tearing = true;
 	}
 
 	VGLog(logRendering, "Swap chain tearing {}.", hasTearing ? VGText("enabled") : VGText("disabled"));
 
+	// Lets the CPU wait on the swap chain's queue of presents, instead of blocking inside of present.
+	swapChainFlags |= DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+
 	DXGI_SWAP_CHAIN_DESC1 swapChainDescription{};
 	swapChainDescription.Width = renderWidth;
 	swapChainDescription.Height = renderHeight;
@@ -286,6 +547,22 @@ RenderDevice::RenderDevice(void* window, bool software, bool enableDebugging)
 	swapChainWrapper.As(&swapChainWrapperConverted);
 	swapChain.Reset(swapChainWrapperConverted.Detach());
 
+	result = swapChain->SetMaximumFrameLatency(framesInFlight);
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to set swap chain maximum frame latency: {}", result);
+	}
+
+	frameLatencyEvent = swapChain->GetFrameLatencyWaitableObject();
+
+	// High resolution timers are far more precise than sleeping, which is tied to the scheduler's tick rate.
+	frameLimitTimer = ::CreateWaitableTimerExW(nullptr, nullptr, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!frameLimitTimer)
+	{
+		VGLogWarning(logRendering, "Failed to create high resolution frame limit timer: {}", GetPlatformError());
+		frameLimitTimer = ::CreateWaitableTimerExW(nullptr, nullptr, 0, TIMER_ALL_ACCESS);
+	}
+
 	result = factory->MakeWindowAssociation(static_cast<HWND>(window), DXGI_MWA_NO_ALT_ENTER);
 	if (FAILED(result))
 	{
@@ -307,8 +584,7 @@ RenderDevice::RenderDevice(void* window, bool software, bool enableDebugging)
 		VGLogCritical(logRendering, "Failed to create sync event: {}", GetPlatformError());
 	}
 
-	// Setup callbacks.
-#if !BUILD_RELEASE
+	// Setup callbacks. Always registered, so shipping builds still report the breadcrumbs of a device removal.
 	result = device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(deviceRemovedFence.Indirect()));
 	if (FAILED(result))
 	{
@@ -322,8 +598,7 @@ RenderDevice::RenderDevice(void* window, bool software, bool enableDebugging)
 		VGLogError(logRendering, "Failed to set device removed completion event: {}", result);
 	}
 
-	RegisterWaitForSingleObject(&deviceRemovedHandle, deviceRemovedEvent, &OnDeviceRemoved, device.Get(), INFINITE, 0);
-#endif
+	RegisterWaitForSingleObject(&deviceRemovedHandle, deviceRemovedEvent, &OnDeviceRemoved, this, INFINITE, 0);
 
 	constexpr auto frameBufferSize = 1024 * 64;
 
@@ -340,6 +615,11 @@ RenderDevice::RenderDevice(void* window, bool software, bool enableDebugging)
 		frameBuffers[i] = resourceManager.Create(description, VGText("Frame buffer"));
 	}
 
+	CreateFrameTimer();
+
+	breadcrumbs.Initialize(this);
+	breadcrumbs.BeginFrame(GetFrameIndex(), frame);  // Later frames begin with their reset.
+
 	SetupRenderTargets();
 
 	SetNames();
@@ -351,12 +631,14 @@ RenderDevice::~RenderDevice()
 
 	Synchronize();
 
+	pipelineLibrary.Save();
+
 	::CloseHandle(syncEvent);
+	::CloseHandle(frameLatencyEvent);
+	::CloseHandle(frameLimitTimer);
 
-#if !BUILD_RELEASE
 	::CloseHandle(deviceRemovedEvent);
 	//::CloseHandle(deviceRemovedHandle);  // This handle should not be closed? An invalid handle error is thrown when attempting to close it.
-#endif
 
 #if !BUILD_RELEASE
 	if (debugging)
@@ -497,6 +779,8 @@ std::pair<BufferHandle, size_t> RenderDevice::FrameAllocate(size_t size)
 {
 	const auto frameIndex = frame % frameCount;
 
+	std::scoped_lock lock{ frameBufferLock };
+
 	// Constant buffers require 256 byte alignment.
 	size = AlignedSize(size, 256);
 	frameBufferOffsets[frameIndex] += size;
@@ -504,16 +788,36 @@ std::pair<BufferHandle, size_t> RenderDevice::FrameAllocate(size_t size)
 	return { frameBuffers[frameIndex], frameBufferOffsets[frameIndex] - size };
 }
 
-std::shared_ptr<CommandList> RenderDevice::AllocateFrameCommandList(RenderGraph* graph, D3D12_COMMAND_LIST_TYPE type, size_t passIndex)
+CommandList* RenderDevice::AllocateFrameCommandList(RenderGraph* graph, D3D12_COMMAND_LIST_TYPE type, size_t passIndex)
 {
+	VGAssert(type == D3D12_COMMAND_LIST_TYPE_DIRECT || type == D3D12_COMMAND_LIST_TYPE_COMPUTE, "Unsupported frame command list type.");
+
 	const auto frameIndex = GetFrameIndex();
-	const auto size = frameCommandLists[frameIndex].size();
+	auto& pool = type == D3D12_COMMAND_LIST_TYPE_COMPUTE ? frameComputeCommandLists[frameIndex] : frameDirectCommandLists[frameIndex];
+
+	if (pool.used < pool.lists.size())
+	{
+		// The frame has retired, so the list's previous commands are no longer in use.
+		auto& list = pool.lists[pool.used++];
+
+		const auto result = list->Reset();
+		if (FAILED(result))
+		{
+			VGLogError(logRendering, "Failed to reset pooled frame command list: {}", result);
+		}
+
+		list->SetPass(graph, passIndex);
+
+		return list.get();
+	}
 
-	frameCommandLists[frameIndex].emplace_back(std::make_shared<CommandList>());
-	frameCommandLists[frameIndex][size]->Create(this, graph, type, passIndex);
-	frameCommandLists[frameIndex][size]->SetName(VGText("Frame command list"));
+	auto& list = pool.lists.emplace_back(std::make_unique<CommandList>());
+	++pool.used;
 
-	return frameCommandLists[frameIndex][size];
+	list->Create(this, graph, type, passIndex);
+	list->SetName(type == D3D12_COMMAND_LIST_TYPE_COMPUTE ? VGText("Frame compute command list") : VGText("Frame direct command list"));
+
+	return list.get();
 }
 
 DescriptorHandle RenderDevice::AllocateDescriptor(DescriptorType type)
@@ -521,10 +825,77 @@ DescriptorHandle RenderDevice::AllocateDescriptor(DescriptorType type)
 	return descriptorManager.Allocate(type);
 }
 
+uint64_t RenderDevice::SignalQueue(D3D12_COMMAND_LIST_TYPE type)
+{
+	auto* fence = directQueueFence.Get();
+	auto* value = &directQueueValue;
+
+	if (type == D3D12_COMMAND_LIST_TYPE_COMPUTE)
+	{
+		fence = computeQueueFence.Get();
+		value = &computeQueueValue;
+	}
+
+	else if (type == D3D12_COMMAND_LIST_TYPE_COPY)
+	{
+		fence = copyQueueFence.Get();
+		value = &copyQueueValue;
+	}
+
+	++*value;
+
+	const auto result = GetQueue(type)->Signal(fence, *value);
+	if (FAILED(result))
+	{
+		VGLogCritical(logRendering, "Failed to signal queue fence: {}", result);
+	}
+
+	return *value;
+}
+
+void RenderDevice::WaitQueue(D3D12_COMMAND_LIST_TYPE waitingType, D3D12_COMMAND_LIST_TYPE signalingType, uint64_t value)
+{
+	auto* fence = directQueueFence.Get();
+	if (signalingType == D3D12_COMMAND_LIST_TYPE_COMPUTE) fence = computeQueueFence.Get();
+	else if (signalingType == D3D12_COMMAND_LIST_TYPE_COPY) fence = copyQueueFence.Get();
+
+	const auto result = GetQueue(waitingType)->Wait(fence, value);
+	if (FAILED(result))
+	{
+		VGLogCritical(logRendering, "Failed to wait on queue fence: {}", result);
+	}
+}
+
+void RenderDevice::SubmitCopyList()
+{
+	VGScopedCPUStat("Submit Copy List");
+
+	auto& list = GetCopyList();
+
+	auto result = list.Close();
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to close copy command list: {}", result);
+	}
+
+	if (!copyListPending)
+		return;
+
+	copyListPending = false;
+
+	ID3D12CommandList* nativeList = list.Native();
+	copyCommandQueue->ExecuteCommandLists(1, &nativeList);
+
+	// Uploaded resources are first used on the direct queue, the compute queue already waits on the direct queue's uploads.
+	WaitQueue(D3D12_COMMAND_LIST_TYPE_DIRECT, D3D12_COMMAND_LIST_TYPE_COPY, SignalQueue(D3D12_COMMAND_LIST_TYPE_COPY));
+}
+
 void RenderDevice::Synchronize()
 {
 	VGScopedCPUStat("Synchronize");
 
+	JoinComputeQueue();
+
 	// Dispatch a signal at the end of the command queue. This will ensure all commands
 	// have finished execution.
 	auto result = directCommandQueue->Signal(syncFence.Get(), syncValues[GetFrameIndex()]);
@@ -548,7 +919,52 @@ void RenderDevice::Present()
 {
 	VGScopedCPUStat("Present");
 
-	swapChain->Present(vSync, 0);
+	// Vsync already paces the frames in the foreground, the background limit applies regardless.
+	auto limit = vSync ? 0 : frameRateLimit;
+	if (background && backgroundFrameRateLimit > 0)
+	{
+		limit = limit > 0 ? std::min(limit, backgroundFrameRateLimit) : backgroundFrameRateLimit;
+	}
+
+	if (limit > 0 && frameLimitTimer)
+	{
+		VGScopedCPUStat("Frame Limiter");
+
+		FILETIME fileTime;
+		::GetSystemTimePreciseAsFileTime(&fileTime);
+		const auto now = static_cast<int64_t>((static_cast<uint64_t>(fileTime.dwHighDateTime) << 32) | fileTime.dwLowDateTime);
+		const auto interval = static_cast<int64_t>(10'000'000 / limit);
+
+		// Don't try to catch up on frames that missed the limit.
+		const auto target = std::max(lastPresentTime + interval, now);
+		if (target > now)
+		{
+			LARGE_INTEGER dueTime;
+			dueTime.QuadPart = now - target;  // Negative is relative.
+
+			if (::SetWaitableTimerEx(frameLimitTimer, &dueTime, 0, nullptr, nullptr, nullptr, 0))
+			{
+				::WaitForSingleObject(frameLimitTimer, INFINITE);
+			}
+		}
+
+		lastPresentTime = target;
+	}
+
+	// Tearing lets presents without vsync go out immediately, instead of waiting in the flip queue for the next refresh.
+	const auto flags = !vSync && tearing && !fullscreenExclusive ? DXGI_PRESENT_ALLOW_TEARING : 0u;
+
+	occluded = swapChain->Present(vSync, flags) == DXGI_STATUS_OCCLUDED;
+}
+
+bool RenderDevice::TestOcclusion()
+{
+	VGScopedCPUStat("Test Occlusion");
+
+	// Test presents don't queue a frame, they only report whether one would be visible.
+	occluded = swapChain->Present(0, DXGI_PRESENT_TEST) == DXGI_STATUS_OCCLUDED;
+
+	return occluded;
 }
 
 void RenderDevice::AdvanceCPU()
@@ -559,15 +975,38 @@ void RenderDevice::AdvanceCPU()
 	const auto fenceValue = syncValues[GetFrameIndex()];
 	const auto nextFrameIndex = (frame + 1) % frameCount;
 
+	// The frame fence is only signaled on the direct queue, so it must cover this frame's async compute work too.
+	JoinComputeQueue();
+
+	// Ends the frame's timing after all of its work, including the async compute work joined above.
+	auto& endList = frameEndCommandLists[GetFrameIndex()];
+	if (timestampHeap)
+	{
+		const auto queryIndex = static_cast<UINT>(GetFrameIndex() * 2);
+		endList.Native()->EndQuery(timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex + 1);
+		endList.Native()->ResolveQueryData(timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, queryIndex, 2, timestampReadback->GetResource(), queryIndex * sizeof(uint64_t));
+	}
+
+	profiler.Resolve(endList, GetFrameIndex());
+
+	endList.Close();
+
+	ID3D12CommandList* endNativeList = endList.Native();
+	directCommandQueue->ExecuteCommandLists(1, &endNativeList);
+
 	auto result = directCommandQueue->Signal(syncFence.Get(), fenceValue);
 	if (FAILED(result))
 	{
 		VGLogCritical(logRendering, "Failed to signal the sync fence during CPU advance: {}", result);
 	}
 
-	if (syncFence->GetCompletedValue() < syncValues[nextFrameIndex])
+	// Each slot holds the value last signaled by its frame, wait on the frame leaving the allowed number in flight. The
+	// oldest slot is always waited on at most, its resources are reused next frame.
+	const auto waitValue = syncValues[(frame + frameCount - (framesInFlight - 1)) % frameCount];
+
+	if (syncFence->GetCompletedValue() < waitValue)
 	{
-		result = syncFence->SetEventOnCompletion(syncValues[nextFrameIndex], syncEvent);
+		result = syncFence->SetEventOnCompletion(waitValue, syncEvent);
 		if (FAILED(result))
 		{
 			VGLogCritical(logRendering, "Failed to set fence completion event during CPU advance: {}", result);
@@ -580,13 +1019,24 @@ void RenderDevice::AdvanceCPU()
 
 	syncValues[nextFrameIndex] = fenceValue + 1;
 
+	// The oldest frame has always retired by now, even with fewer frames in flight.
+	if (frame + 1 >= frameCount)
+	{
+		ReadFrameTime(nextFrameIndex);
+		profiler.ReadFrame(nextFrameIndex);
+	}
+
 	// The frame has finished, cleanup its resources. #TODO: Will leave additional GPU gaps if we're bottlenecking on the CPU, consider deferred cleanup?
 	frameBufferOffsets[nextFrameIndex] = 0;  // GPU has fully consumed the frame resources, we can now reuse the buffer.
 	resourceManager.CleanupFrameResources(frame + 1);
 	ResetFrame(frame + 1);
+	frameArena.Reset();  // The frame's CPU work is done, only the GPU was still using its resources.
+
+	UpdateMemoryBudget();
 
 	// #TODO: Check our CPU frame budget, try and get some additional work done if we have time?
 
+	MarkMemoryFrame();
 	VGStatFrameCPU();  // Mark the new frame.
 	++frame;
 
@@ -595,22 +1045,98 @@ void RenderDevice::AdvanceCPU()
 	//VGAssert(GetFrameIndex() == swapChain->GetCurrentBackBufferIndex(), "Mismatched swap chain frame index.");
 }
 
+void RenderDevice::WaitForFrameLatency()
+{
+	VGScopedCPUStat("Wait for Frame Latency");
+
+	if (frameLatencyEvent)
+	{
+		// Timeout in case the swap chain is occluded or being recreated.
+		::WaitForSingleObjectEx(frameLatencyEvent, 1000, true);
+	}
+}
+
+void RenderDevice::SetFramesInFlight(uint32_t count)
+{
+	count = std::clamp(count, 1u, frameCount);
+	if (count == framesInFlight)
+	{
+		return;
+	}
+
+	framesInFlight = count;
+
+	const auto result = swapChain->SetMaximumFrameLatency(framesInFlight);
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to set swap chain maximum frame latency: {}", result);
+	}
+
+	VGLog(logRendering, "Frames in flight set to {}.", framesInFlight);
+}
+
+void RenderDevice::UpdateMemoryBudget()
+{
+	// Usage changes every frame so it's always queried, the notification only tells us when the budget itself moved.
+	const auto budgetChanged = renderAdapter.BudgetChanged();
+
+	if (const auto info = renderAdapter.QueryLocalMemory(); info)
+	{
+		if (budgetChanged)
+		{
+			VGLog(logRendering, "Video memory budget changed: {} MB -> {} MB.", memoryBudget.budget / (1024 * 1024), info->Budget / (1024 * 1024));
+		}
+
+		memoryBudget.budget = info->Budget;
+		memoryBudget.usage = info->CurrentUsage;
+	}
+}
+
+D3D12MA::TotalStatistics RenderDevice::CalculateAllocatorStatistics()
+{
+	D3D12MA::TotalStatistics statistics;
+	allocator->CalculateStatistics(&statistics);
+
+	return statistics;
+}
+
+std::wstring RenderDevice::BuildAllocatorStatsString(bool detailed)
+{
+	WCHAR* statsString = nullptr;
+	allocator->BuildStatsString(&statsString, detailed);
+
+	std::wstring result = statsString;
+	allocator->FreeStatsString(statsString);
+
+	return result;
+}
+
 void RenderDevice::AdvanceGPU()
 {
 	VGScopedCPUStat("GPU Frame Advance");
 	VGStatFrameGPU(directContext);
+	VGStatFrameGPU(computeContext);
 }
 
 void RenderDevice::SetResolution(uint32_t width, uint32_t height, bool fullscreen)
 {
 	VGScopedCPUStat("Render Device Change Resolution");
 
-	Synchronize();
-
-	// Reset the sync values to the active sync value for this frame.
-	for (auto& syncValue : syncValues)
+	// Resizing requires that the GPU is done with the back buffers, which are only referenced by the frames in flight. Their
+	// work ends with the last frame's signal, covering async compute and presents, so wait on it instead of idling every
+	// queue. Called before this frame has submitted anything that uses the back buffers.
+	const auto lastFrameValue = syncValues[GetFrameIndex()] - 1;
+	if (syncFence->GetCompletedValue() < lastFrameValue)
 	{
-		syncValue = syncValues[GetFrameIndex()];
+		const auto result = syncFence->SetEventOnCompletion(lastFrameValue, syncEvent);
+		if (FAILED(result))
+		{
+			VGLogCritical(logRendering, "Failed to set fence completion event during resolution change: {}", result);
+		}
+
+		VGScopedCPUStat("Wait for GPU");
+
+		WaitForSingleObjectEx(syncEvent, INFINITE, false);
 	}
 
 	renderWidth = width;
@@ -628,6 +1154,11 @@ void RenderDevice::SetResolution(uint32_t width, uint32_t height, bool fullscree
 		VGLogError(logRendering, "Failed to set swap chain fullscreen state: {}", result);
 	}
 
+	else
+	{
+		fullscreenExclusive = fullscreen;
+	}
+
 	result = swapChain->ResizeBuffers(static_cast<UINT>(frameCount), static_cast<UINT>(width), static_cast<UINT>(height), DXGI_FORMAT_UNKNOWN, swapChainFlags);
 	if (FAILED(result))
 	{
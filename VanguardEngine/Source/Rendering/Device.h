@@ -5,8 +5,13 @@
 #include <Rendering/Base.h>
 #include <Rendering/ResourceManager.h>
 #include <Rendering/PipelineState.h>
+#include <Rendering/PipelineLibrary.h>
 #include <Rendering/DescriptorAllocator.h>
 #include <Rendering/CommandList.h>
+#include <Rendering/GpuProfiler.h>
+#include <Rendering/GpuBreadcrumbs.h>
+#include <Threading/CriticalSection.h>
+#include <Utility/FrameArena.h>
 
 // #TODO: Fix Windows.h leaking.
 #include <Rendering/ResourceHandle.h>
@@ -26,15 +31,28 @@ class RenderDevice
 public:
 	bool debugging = false;
 	bool vSync = false;
+	uint32_t frameRateLimit = 0;  // Presents per second when vsync is off, 0 is uncapped.
+	uint32_t backgroundFrameRateLimit = 0;  // Presents per second while in the background, with or without vsync. 0 is uncapped.
+	bool background = false;  // The window lost focus.
 	uint32_t renderWidth = 10;
 	uint32_t renderHeight = 10;
 
-	static constexpr uint32_t frameCount = 3;  // #TODO: Determine at runtime.
+	static constexpr uint32_t frameCount = 3;  // Buffered frame resources, the upper bound of frames in flight.
 
 private:
 	const D3D_FEATURE_LEVEL targetFeatureLevel = D3D_FEATURE_LEVEL_12_1;
 	const D3D_SHADER_MODEL targetShaderModel = D3D_SHADER_MODEL_6_3;
 	uint32_t swapChainFlags = 0;
+	bool tearing = false;  // Presents without vsync may tear, required for variable refresh rate displays.
+	bool fullscreenExclusive = false;  // Tearing isn't allowed in exclusive fullscreen.
+	bool enhancedBarriers = false;
+	bool meshShaders = false;
+	bool reservedResources = false;
+	bool raytracing = false;
+	bool variableRateShading = false;
+	uint32_t shadingRateTileSize = 0;
+	bool compactColorLoads = false;  // Typed UAV loads of R11G11B10_FLOAT, which unlike 16-bit floats aren't guaranteed.
+	uint32_t waveSize = 0;
 
 	// #NOTE: Ordering of these variables is significant for proper destruction!
 	ResourcePtr<ID3D12Device5> device;
@@ -44,18 +62,45 @@ private:
 	TracyD3D12Ctx directContext;
 	CommandList directCommandList[frameCount];  // #TODO: One per worker thread.
 
+	ResourcePtr<ID3D12CommandQueue> computeCommandQueue;
+	TracyD3D12Ctx computeContext;
+
+	// Large uploads to new resources, submitted ahead of the frame's direct queue work.
+	ResourcePtr<ID3D12CommandQueue> copyCommandQueue;
+	CommandList copyCommandList[frameCount];
+	bool copyListPending = false;  // Set by the resource manager when it records an upload.
+
+	// Cross-queue synchronization, each fence is only signaled by its own queue. Values increase monotonically.
+	ResourcePtr<ID3D12Fence> directQueueFence;
+	ResourcePtr<ID3D12Fence> computeQueueFence;
+	ResourcePtr<ID3D12Fence> copyQueueFence;
+	uint64_t directQueueValue = 0;
+	uint64_t computeQueueValue = 0;
+	uint64_t copyQueueValue = 0;
+
 	ResourcePtr<IDXGISwapChain3> swapChain;
 	size_t frame = 0;  // Stores the actual frame number. Refers to the current CPU frame being run, stepped after finishing CPU pass.
 
 	std::vector<uint64_t> syncValues;
 	ResourcePtr<ID3D12Fence> syncFence;
 	HANDLE syncEvent;
+	uint32_t framesInFlight = frameCount;  // CPU frames recorded ahead of the GPU, including the current one.
+	HANDLE frameLatencyEvent = nullptr;  // Signaled by the swap chain once it can queue another present.
+	HANDLE frameLimitTimer = nullptr;
+	int64_t lastPresentTime = 0;  // In 100 nanosecond ticks, matching the waitable timer.
+	bool occluded = false;  // Nothing presented is visible, until a test present says otherwise.
 
 	ResourcePtr<D3D12MA::Allocator> allocator;
 	ResourceManager resourceManager;
 
+	PipelineLibrary pipelineLibrary;
+
 	DescriptorAllocator descriptorManager;
 
+	FrameArena frameArena;  // CPU data of the frame being recorded.
+
+	GpuMemoryBudget memoryBudget;  // Refreshed on each CPU advance.
+
 	std::array<TextureHandle, frameCount> backBufferTextures;  // Render targets bound to the swap chain.
 
 	// Callbacks.
@@ -65,9 +110,27 @@ private:
 
 	std::array<BufferHandle, frameCount> frameBuffers;  // Per-frame shared dynamic heap.
 	std::array<size_t, frameCount> frameBufferOffsets = {};
-
-	// #TODO: Don't use shared_ptr's here.
-	std::array<std::vector<std::shared_ptr<CommandList>>, frameCount> frameCommandLists;  // Per-frame dynamic command lists.
+	CriticalSection frameBufferLock;
+
+	// Per-frame pools of command lists, one pool for each queue type. Lists are reset when reused, after the frame retires.
+	struct CommandListPool
+	{
+		std::vector<std::unique_ptr<CommandList>> lists;
+		size_t used = 0;
+	};
+
+	std::array<CommandListPool, frameCount> frameDirectCommandLists;
+	std::array<CommandListPool, frameCount> frameComputeCommandLists;
+
+	// GPU frame timing. The device list of each frame begins with a timestamp, and a final direct list ends the frame with
+	// another, resolving both into the readback. Frames are read back once they retire.
+	ResourcePtr<ID3D12QueryHeap> timestampHeap;
+	ResourcePtr<D3D12MA::Allocation> timestampReadback;
+	std::array<CommandList, frameCount> frameEndCommandLists;
+	uint64_t timestampFrequency = 0;  // Ticks per second of the direct queue.
+	float gpuFrameTime = 0.f;
+	GpuProfiler profiler;  // Per-pass timing, shares the frame end list for resolving.
+	GpuBreadcrumbs breadcrumbs;  // Reported on device removal.
 
 	// Name the D3D objects.
 	void SetNames();
@@ -77,11 +140,30 @@ private:
 	// Resets command lists and allocators.
 	void ResetFrame(size_t frameID);
 
+	void CreateFrameTimer();
+	void ReadFrameTime(size_t frameIndex);  // The frame must have retired.
+
+	// Makes the direct queue wait on all submitted compute work. Required before signaling frame completion.
+	void JoinComputeQueue();
+
+	void UpdateMemoryBudget();
+
 public:
-	RenderDevice(void* window, bool software, bool enableDebugging);
+	// Enhanced barriers are only used if requested and supported by the device, otherwise legacy barriers are used.
+	RenderDevice(void* window, bool software, bool enableDebugging, bool enableEnhancedBarriers);
 	~RenderDevice();
 
 	auto* Native() const noexcept { return device.Get(); }
+	const auto& GetAdapter() const noexcept { return renderAdapter; }
+	auto UsingEnhancedBarriers() const noexcept { return enhancedBarriers; }
+	auto SupportsMeshShaders() const noexcept { return meshShaders; }
+	auto SupportsReservedResources() const noexcept { return reservedResources; }
+	auto SupportsRaytracing() const noexcept { return raytracing; }
+	auto SupportsVariableRateShading() const noexcept { return variableRateShading; }
+	auto GetShadingRateTileSize() const noexcept { return shadingRateTileSize; }  // Pixels per side of a shading rate image texel.
+	auto SupportsCompactColorLoads() const noexcept { return compactColorLoads; }
+	// Wave size that wave specialized compute shaders are compiled for, zero when the device can't run 32 or 64 lane waves.
+	auto GetWaveSize() const noexcept { return waveSize; }
 
 	// Logs various data about the device's feature support. Not needed in optimized builds.
 	void CheckFeatureSupport();
@@ -89,28 +171,73 @@ public:
 	// Allocate a block of CPU write-only, GPU read-only memory from the per-frame dynamic heap.
 	std::pair<BufferHandle, size_t> FrameAllocate(size_t size);
 
-	// Allocate a per-frame command list, disposed of automatically.
-	std::shared_ptr<CommandList> AllocateFrameCommandList(RenderGraph* graph, D3D12_COMMAND_LIST_TYPE type, size_t passIndex);
+	// Allocate a per-frame command list from the frame's pool, valid until the frame is reset.
+	CommandList* AllocateFrameCommandList(RenderGraph* graph, D3D12_COMMAND_LIST_TYPE type, size_t passIndex);
 
 	DescriptorHandle AllocateDescriptor(DescriptorType type);
 
+	// Signals the queue's fence, returning the value that will be reached once all prior work on the queue finishes.
+	uint64_t SignalQueue(D3D12_COMMAND_LIST_TYPE type);
+	// GPU-side wait, stalls the waiting queue until the signaling queue reaches the value.
+	void WaitQueue(D3D12_COMMAND_LIST_TYPE waitingType, D3D12_COMMAND_LIST_TYPE signalingType, uint64_t value);
+
+	// Submits the frame's uploads on the copy queue if any were recorded, the direct queue waits on them.
+	void SubmitCopyList();
+
 	// Fully sync the GPU, flushes all commands.
 	void Synchronize();
 
 	void Present();
+	// Whether the last present was occluded, in which case frames shouldn't render. Test presents are cheap enough to poll.
+	bool IsOccluded() const noexcept { return occluded; }
+	bool TestOcclusion();
 
 	void AdvanceCPU();  // Steps the CPU frame counter, blocking sync with GPU.
+	// Blocks until the swap chain can take another frame, sample input right after to minimize latency.
+	void WaitForFrameLatency();
+	// Lower counts reduce input latency at the cost of GPU throughput, clamped to [1, frameCount].
+	void SetFramesInFlight(uint32_t count);
+	uint32_t GetFramesInFlight() const noexcept { return framesInFlight; }
 	void AdvanceGPU();  // Steps the GPU frame counter.
 	size_t GetFrameIndex() const noexcept { return frame % RenderDevice::frameCount; }
+	size_t GetFrameNumber() const noexcept { return frame; }
 
 	auto* GetDirectQueue() const noexcept { return directCommandQueue.Get(); }
 	auto* GetDirectContext() const noexcept { return directContext; }
 	auto& GetDirectList() noexcept { return directCommandList[GetFrameIndex()]; }
+	auto* GetComputeQueue() const noexcept { return computeCommandQueue.Get(); }
+	auto* GetComputeContext() const noexcept { return computeContext; }
+	auto* GetCopyQueue() const noexcept { return copyCommandQueue.Get(); }
+	auto& GetCopyList() noexcept { return copyCommandList[GetFrameIndex()]; }
+
+	ID3D12CommandQueue* GetQueue(D3D12_COMMAND_LIST_TYPE type) const noexcept;
+	auto* GetQueueContext(D3D12_COMMAND_LIST_TYPE type) const noexcept { return type == D3D12_COMMAND_LIST_TYPE_COMPUTE ? GetComputeContext() : GetDirectContext(); }
 
 	auto* GetSwapChain() const noexcept { return swapChain.Get(); }
 	auto GetBackBuffer() const noexcept { return backBufferTextures[swapChain->GetCurrentBackBufferIndex()]; }  // Resizing affects the buffer index, so use the swap chain's index.
 	auto& GetDescriptorAllocator() noexcept { return descriptorManager; }
+	auto& GetFrameArena() noexcept { return frameArena; }
 	auto& GetResourceManager() noexcept { return resourceManager; }
+	const auto& GetMemoryBudget() const noexcept { return memoryBudget; }
+	// Allocator statistics by heap type, slow to calculate, only meant for tooling.
+	D3D12MA::TotalStatistics CalculateAllocatorStatistics();
+	// The allocator's statistics as JSON, optionally with the full list of allocations.
+	std::wstring BuildAllocatorStatsString(bool detailed);
+	// Milliseconds the direct queue spent on the most recently retired frame, zero until a frame has retired.
+	float GetGPUFrameTime() const noexcept { return gpuFrameTime; }
+	auto& GetProfiler() noexcept { return profiler; }
+	auto& GetBreadcrumbs() noexcept { return breadcrumbs; }
+	auto& GetPipelineLibrary() noexcept { return pipelineLibrary; }
 
 	void SetResolution(uint32_t width, uint32_t height, bool fullscreen);
-};
\ No newline at end of file
+};
+
+inline ID3D12CommandQueue* RenderDevice::GetQueue(D3D12_COMMAND_LIST_TYPE type) const noexcept
+{
+	switch (type)
+	{
+	case D3D12_COMMAND_LIST_TYPE_COMPUTE: return GetComputeQueue();
+	case D3D12_COMMAND_LIST_TYPE_COPY: return GetCopyQueue();
+	default: return GetDirectQueue();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,156 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/GpuBreadcrumbs.h>
+#include <Rendering/Device.h>
+#include <Rendering/CommandList.h>
+
+#include <algorithm>
+#include <sstream>
+#include <cstring>
+
+namespace
+{
+	size_t MarkerIndex(size_t frameIndex, uint32_t slot, uint32_t maxPasses)
+	{
+		return (frameIndex * maxPasses + slot) * 2;
+	}
+}
+
+void GpuBreadcrumbs::Initialize(RenderDevice* device)
+{
+	frames.resize(RenderDevice::frameCount);
+
+	const auto size = RenderDevice::frameCount * maxPasses * 2 * sizeof(uint32_t);
+
+	// Readback memory is in the copy destination state that immediate writes require, and stays in system memory.
+	buffer = device->GetResourceManager().AllocateReadback(size, VGText("GPU breadcrumbs"));
+	if (!buffer)
+	{
+		VGLogError(logRendering, "Failed to allocate GPU breadcrumbs, device removals won't report the faulting pass.");
+		return;
+	}
+
+	const D3D12_RANGE readRange{ 0, size };
+	void* data = nullptr;
+
+	const auto result = buffer->GetResource()->Map(0, &readRange, &data);
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to map GPU breadcrumbs: {}", result);
+		buffer.Reset();
+		return;
+	}
+
+	std::memset(data, 0, size);
+
+	mappedData = static_cast<const uint32_t*>(data);
+	address = buffer->GetResource()->GetGPUVirtualAddress();
+}
+
+void GpuBreadcrumbs::BeginFrame(size_t frameIndex, size_t frame)
+{
+	if (frameIndex < frames.size())
+	{
+		// Zero is reserved for slots that were never written.
+		frames[frameIndex].marker = static_cast<uint32_t>(frame) + 1;
+		frames[frameIndex].passes.clear();
+	}
+}
+
+std::optional<uint32_t> GpuBreadcrumbs::AddPass(size_t frameIndex, std::string_view stableName)
+{
+	if (!Active())
+		return std::nullopt;
+
+	auto& passes = frames[frameIndex].passes;
+	if (passes.size() >= maxPasses)
+		return std::nullopt;
+
+	passes.emplace_back(stableName);
+
+	return static_cast<uint32_t>(passes.size() - 1);
+}
+
+void GpuBreadcrumbs::BeginPass(CommandList& list, size_t frameIndex, uint32_t slot)
+{
+	// Written once the work before it has started, so a pass counts as begun as soon as the GPU reaches it.
+	const D3D12_WRITEBUFFERIMMEDIATE_PARAMETER parameter{
+		.Dest = address + MarkerIndex(frameIndex, slot, maxPasses) * sizeof(uint32_t),
+		.Value = frames[frameIndex].marker
+	};
+	const auto mode = D3D12_WRITEBUFFERIMMEDIATE_MODE_MARKER_IN;
+
+	list.Native()->WriteBufferImmediate(1, &parameter, &mode);
+}
+
+void GpuBreadcrumbs::EndPass(CommandList& list, size_t frameIndex, uint32_t slot)
+{
+	// Written once all of the work before it has completed.
+	const D3D12_WRITEBUFFERIMMEDIATE_PARAMETER parameter{
+		.Dest = address + (MarkerIndex(frameIndex, slot, maxPasses) + 1) * sizeof(uint32_t),
+		.Value = frames[frameIndex].marker
+	};
+	const auto mode = D3D12_WRITEBUFFERIMMEDIATE_MODE_MARKER_OUT;
+
+	list.Native()->WriteBufferImmediate(1, &parameter, &mode);
+}
+
+std::string GpuBreadcrumbs::Report() const
+{
+	if (!Active())
+		return "GPU breadcrumbs are unavailable.";
+
+	std::vector<size_t> order;
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		if (frames[i].marker > 0)
+			order.emplace_back(i);
+	}
+
+	std::sort(order.begin(), order.end(), [this](auto left, auto right) { return frames[left].marker < frames[right].marker; });
+
+	std::stringstream stream;
+	stream << "GPU breadcrumbs:";
+
+	for (const auto frameIndex : order)
+	{
+		const auto& record = frames[frameIndex];
+
+		size_t finished = 0;
+		std::vector<std::string_view> running;
+		std::optional<std::string_view> next;
+
+		for (uint32_t slot = 0; slot < record.passes.size(); ++slot)
+		{
+			const auto index = MarkerIndex(frameIndex, slot, maxPasses);
+			const bool begun = mappedData[index] == record.marker;
+			const bool ended = mappedData[index + 1] == record.marker;
+
+			if (begun && ended)
+				++finished;
+			else if (begun)
+				running.emplace_back(record.passes[slot]);
+			else if (!next)
+				next = record.passes[slot];
+		}
+
+		stream << "\n\tFrame " << record.marker - 1 << ": " << finished << "/" << record.passes.size() << " passes finished";
+
+		// Async compute passes overlap the direct queue's, so more than one pass can be running.
+		if (!running.empty())
+		{
+			stream << ", running";
+			for (const auto name : running)
+			{
+				stream << " '" << name << "'";
+			}
+		}
+
+		if (next)
+		{
+			stream << ", next '" << *next << "'";
+		}
+	}
+
+	return stream.str();
+}
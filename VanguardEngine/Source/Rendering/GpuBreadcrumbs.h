@@ -0,0 +1,51 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Utility/ResourcePtr.h>
+
+#include <D3D12MemAlloc.h>
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <optional>
+
+class RenderDevice;
+class CommandList;
+
+// Always-on markers around render graph passes, cheap enough to leave in shipping builds unlike DRED. Each recorded pass
+// writes its frame's marker into a readback buffer as it begins and ends, so after a device removal the buffer tells which
+// passes of the frames in flight the GPU was still executing.
+class GpuBreadcrumbs
+{
+	static constexpr uint32_t maxPasses = 256;  // Per frame, passes past the limit aren't marked.
+
+private:
+	ResourcePtr<D3D12MA::Allocation> buffer;
+	const uint32_t* mappedData = nullptr;  // Mapped for the device's lifetime, still readable once the device is removed.
+	D3D12_GPU_VIRTUAL_ADDRESS address = 0;
+
+	struct FrameRecord
+	{
+		uint32_t marker = 0;  // Written by the frame's passes, zero until the frame is recorded.
+		std::vector<std::string_view> passes;  // Stable pass names of each slot.
+	};
+
+	std::vector<FrameRecord> frames;
+
+public:
+	void Initialize(RenderDevice* device);
+	bool Active() const noexcept { return mappedData != nullptr; }
+
+	// Clears the frame's slots, the frame must have retired.
+	void BeginFrame(size_t frameIndex, size_t frame);
+	// Reserves a slot for a pass of the frame being recorded, not thread safe. Returns nothing once the slots run out.
+	std::optional<uint32_t> AddPass(size_t frameIndex, std::string_view stableName);
+	void BeginPass(CommandList& list, size_t frameIndex, uint32_t slot);
+	void EndPass(CommandList& list, size_t frameIndex, uint32_t slot);
+
+	// Describes how far the GPU got through each recorded frame, oldest first.
+	std::string Report() const;
+};
@@ -0,0 +1,315 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/GpuProfiler.h>
+#include <Rendering/Device.h>
+#include <Rendering/CommandList.h>
+
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+	UINT QueryIndex(size_t frameIndex, uint32_t slot, uint32_t maxPasses)
+	{
+		return static_cast<UINT>((frameIndex * maxPasses + slot) * 2);
+	}
+
+	// Maps the range of a readback, returning null on failure. Unmapped by the caller.
+	template <typename T>
+	T* MapReadback(D3D12MA::Allocation* allocation, size_t first, size_t count)
+	{
+		const D3D12_RANGE readRange{ first * sizeof(T), (first + count) * sizeof(T) };
+		T* mappedData = nullptr;
+
+		const auto result = allocation->GetResource()->Map(0, &readRange, reinterpret_cast<void**>(&mappedData));
+		if (FAILED(result))
+		{
+			VGLogError(logRendering, "Failed to map GPU profiler readback: {}", result);
+			return nullptr;
+		}
+
+		return mappedData;
+	}
+
+	void UnmapReadback(D3D12MA::Allocation* allocation)
+	{
+		const D3D12_RANGE writtenRange{ 0, 0 };
+		allocation->GetResource()->Unmap(0, &writtenRange);
+	}
+
+	void AddStatistics(D3D12_QUERY_DATA_PIPELINE_STATISTICS& target, const D3D12_QUERY_DATA_PIPELINE_STATISTICS& source)
+	{
+		target.IAVertices += source.IAVertices;
+		target.IAPrimitives += source.IAPrimitives;
+		target.VSInvocations += source.VSInvocations;
+		target.GSInvocations += source.GSInvocations;
+		target.GSPrimitives += source.GSPrimitives;
+		target.CInvocations += source.CInvocations;
+		target.CPrimitives += source.CPrimitives;
+		target.PSInvocations += source.PSInvocations;
+		target.HSInvocations += source.HSInvocations;
+		target.DSInvocations += source.DSInvocations;
+		target.CSInvocations += source.CSInvocations;
+	}
+}
+
+void GpuProfiler::Initialize(RenderDevice* inDevice, uint64_t timestampFrequency)
+{
+	device = inDevice;
+	frequency = timestampFrequency;
+	framePasses.resize(RenderDevice::frameCount);
+	frameStatistics.resize(RenderDevice::frameCount, false);
+	frameCounters.resize(RenderDevice::frameCount);
+
+	D3D12_QUERY_HEAP_DESC heapDesc{};
+	heapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	heapDesc.Count = RenderDevice::frameCount * maxPasses * 2;
+	heapDesc.NodeMask = 0;
+
+	auto result = device->Native()->CreateQueryHeap(&heapDesc, IID_PPV_ARGS(queryHeap.Indirect()));
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to create pass timestamp query heap, GPU pass timing is unavailable: {}", result);
+		return;
+	}
+
+	readback = device->GetResourceManager().AllocateReadback(heapDesc.Count * sizeof(uint64_t), VGText("Pass timestamp readback"));
+	if (!readback)
+	{
+		queryHeap.Reset();
+		return;
+	}
+
+	counterReadback = device->GetResourceManager().AllocateReadback(RenderDevice::frameCount * maxCounters * sizeof(uint32_t), VGText("GPU counter readback"));
+
+	D3D12_QUERY_HEAP_DESC statisticsHeapDesc{};
+	statisticsHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_PIPELINE_STATISTICS;
+	statisticsHeapDesc.Count = RenderDevice::frameCount * maxPasses;
+	statisticsHeapDesc.NodeMask = 0;
+
+	result = device->Native()->CreateQueryHeap(&statisticsHeapDesc, IID_PPV_ARGS(statisticsHeap.Indirect()));
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to create pipeline statistics query heap, pass statistics are unavailable: {}", result);
+		return;
+	}
+
+	statisticsReadback = device->GetResourceManager().AllocateReadback(statisticsHeapDesc.Count * sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS),
+		VGText("Pipeline statistics readback"));
+	if (!statisticsReadback)
+	{
+		statisticsHeap.Reset();
+	}
+}
+
+void GpuProfiler::BeginFrame(size_t frameIndex)
+{
+	if (frameIndex < framePasses.size())
+	{
+		framePasses[frameIndex].clear();
+		frameStatistics[frameIndex] = CollectingStatistics();
+		frameCounters[frameIndex].clear();
+	}
+}
+
+std::optional<uint32_t> GpuProfiler::AddPass(size_t frameIndex, std::string_view stableName)
+{
+	if (!Active())
+		return std::nullopt;
+
+	auto& passes = framePasses[frameIndex];
+	if (passes.size() >= maxPasses)
+		return std::nullopt;
+
+	passes.emplace_back(stableName);
+
+	return static_cast<uint32_t>(passes.size() - 1);
+}
+
+void GpuProfiler::BeginPass(CommandList& list, size_t frameIndex, uint32_t slot)
+{
+	list.Native()->EndQuery(queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, QueryIndex(frameIndex, slot, maxPasses));
+
+	if (frameStatistics[frameIndex])
+	{
+		list.Native()->BeginQuery(statisticsHeap.Get(), D3D12_QUERY_TYPE_PIPELINE_STATISTICS, static_cast<UINT>(frameIndex * maxPasses + slot));
+	}
+}
+
+void GpuProfiler::EndPass(CommandList& list, size_t frameIndex, uint32_t slot)
+{
+	if (frameStatistics[frameIndex])
+	{
+		list.Native()->EndQuery(statisticsHeap.Get(), D3D12_QUERY_TYPE_PIPELINE_STATISTICS, static_cast<UINT>(frameIndex * maxPasses + slot));
+	}
+
+	list.Native()->EndQuery(queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, QueryIndex(frameIndex, slot, maxPasses) + 1);
+}
+
+void GpuProfiler::ReadCounter(CommandList& list, size_t frameIndex, std::string_view stableName, BufferHandle counterBuffer, uint32_t total)
+{
+	if (!counterReadback)
+		return;
+
+	size_t slot;
+
+	{
+		std::scoped_lock lock{ counterLock };
+
+		auto& frame = frameCounters[frameIndex];
+		if (frame.size() >= maxCounters)
+			return;
+
+		slot = frame.size();
+		frame.emplace_back(FrameCounter{ stableName, total });
+	}
+
+	const auto offset = (frameIndex * maxCounters + slot) * sizeof(uint32_t);
+
+	list.TransitionBarrier(counterBuffer, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	list.FlushBarriers();
+	list.SuspendRenderPass();
+	list.Native()->CopyBufferRegion(counterReadback->GetResource(), offset, device->GetResourceManager().Get(counterBuffer).Native(), 0, sizeof(uint32_t));
+	list.TransitionBarrier(counterBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+}
+
+void GpuProfiler::Resolve(CommandList& list, size_t frameIndex)
+{
+	// Resolves even when disabled, slots may have been reserved before it was toggled.
+	if (!queryHeap || framePasses[frameIndex].empty())
+		return;
+
+	const auto first = QueryIndex(frameIndex, 0, maxPasses);
+	const auto count = static_cast<UINT>(framePasses[frameIndex].size() * 2);
+
+	list.Native()->ResolveQueryData(queryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, first, count, readback->GetResource(), first * sizeof(uint64_t));
+
+	if (frameStatistics[frameIndex])
+	{
+		const auto statisticsFirst = static_cast<UINT>(frameIndex * maxPasses);
+		const auto statisticsCount = static_cast<UINT>(framePasses[frameIndex].size());
+
+		list.Native()->ResolveQueryData(statisticsHeap.Get(), D3D12_QUERY_TYPE_PIPELINE_STATISTICS, statisticsFirst, statisticsCount,
+			statisticsReadback->GetResource(), statisticsFirst * sizeof(D3D12_QUERY_DATA_PIPELINE_STATISTICS));
+	}
+}
+
+void GpuProfiler::ReadFrame(size_t frameIndex)
+{
+	if (!readback)
+		return;
+
+	if (const auto& frame = frameCounters[frameIndex]; !frame.empty())
+	{
+		if (const auto* values = MapReadback<uint32_t>(counterReadback.Get(), frameIndex * maxCounters, frame.size()))
+		{
+			for (size_t i = 0; i < frame.size(); ++i)
+			{
+				auto iter = std::find_if(counters.begin(), counters.end(), [&](const auto& counter) { return counter.name == frame[i].name; });
+				if (iter == counters.end())
+				{
+					iter = counters.emplace(counters.end(), GpuCounterStatistics{ .name = std::string{ frame[i].name } });
+				}
+
+				iter->value = values[frameIndex * maxCounters + i];
+				iter->total = frame[i].total;
+			}
+
+			UnmapReadback(counterReadback.Get());
+		}
+	}
+
+	const auto& passes = framePasses[frameIndex];
+	if (passes.empty())
+		return;
+
+	const auto first = QueryIndex(frameIndex, 0, maxPasses);
+	const auto* timestamps = MapReadback<uint64_t>(readback.Get(), first, passes.size() * 2);
+	if (!timestamps)
+		return;
+
+	const D3D12_QUERY_DATA_PIPELINE_STATISTICS* statistics = nullptr;
+	if (frameStatistics[frameIndex])
+	{
+		statistics = MapReadback<D3D12_QUERY_DATA_PIPELINE_STATISTICS>(statisticsReadback.Get(), frameIndex * maxPasses, passes.size());
+	}
+
+	++readFrames;
+
+	for (size_t i = 0; i < passes.size(); ++i)
+	{
+		const auto begin = timestamps[first + i * 2];
+		const auto end = timestamps[first + i * 2 + 1];
+		const auto time = end > begin ? static_cast<float>(static_cast<double>(end - begin) * 1000.0 / frequency) : 0.f;
+
+		auto iter = historyLookup.find(passes[i]);
+		if (iter == historyLookup.end())
+		{
+			iter = historyLookup.emplace(passes[i], history.size()).first;
+			history.emplace_back(PassHistory{ .name = std::string{ passes[i] } });
+		}
+
+		// Passes can run more than once a frame under the same name, their times add up.
+		auto& pass = history[iter->second];
+		if (pass.lastFrame == readFrames)
+		{
+			const auto previous = (pass.nextSample + historyCount - 1) % historyCount;
+			pass.samples[previous] += time;
+
+			if (statistics && pass.pipeline)
+			{
+				AddStatistics(*pass.pipeline, statistics[frameIndex * maxPasses + i]);
+			}
+
+			continue;
+		}
+
+		pass.samples[pass.nextSample] = time;
+		pass.nextSample = (pass.nextSample + 1) % historyCount;
+		pass.sampleCount = std::min(pass.sampleCount + 1, historyCount);
+		pass.lastFrame = readFrames;
+		pass.pipeline = statistics ? std::optional{ statistics[frameIndex * maxPasses + i] } : std::nullopt;
+	}
+
+	if (statistics)
+	{
+		UnmapReadback(statisticsReadback.Get());
+	}
+
+	UnmapReadback(readback.Get());
+}
+
+std::vector<GpuPassStatistics> GpuProfiler::GetStatistics() const
+{
+	std::vector<GpuPassStatistics> statistics;
+	statistics.reserve(history.size());
+
+	std::array<float, historyCount> sorted;
+
+	for (const auto& pass : history)
+	{
+		if (pass.sampleCount == 0 || pass.lastFrame + historyCount < readFrames)
+			continue;
+
+		const auto count = pass.sampleCount;
+		std::copy_n(pass.samples.begin(), count, sorted.begin());  // The ring is only partially filled while it's smaller than the history.
+		std::sort(sorted.begin(), sorted.begin() + count);
+
+		const auto percentile = [&](float fraction)
+		{
+			return sorted[std::min(count - 1, static_cast<size_t>(fraction * count))];
+		};
+
+		statistics.emplace_back(GpuPassStatistics{
+			.name = pass.name,
+			.lastTime = pass.samples[(pass.nextSample + historyCount - 1) % historyCount],
+			.averageTime = std::accumulate(sorted.begin(), sorted.begin() + count, 0.f) / count,
+			.medianTime = percentile(0.5f),
+			.percentile95Time = percentile(0.95f),
+			.percentile99Time = percentile(0.99f),
+			.pipeline = pass.pipeline
+		});
+	}
+
+	return statistics;
+}
\ No newline at end of file
@@ -0,0 +1,112 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Rendering/ResourceHandle.h>
+#include <Utility/ResourcePtr.h>
+#include <Threading/CriticalSection.h>
+
+#include <D3D12MemAlloc.h>
+
+#include <array>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <optional>
+
+class RenderDevice;
+class CommandList;
+
+struct GpuPassStatistics
+{
+	std::string name;
+	float lastTime;  // Milliseconds.
+	float averageTime;
+	float medianTime;
+	float percentile95Time;
+	float percentile99Time;
+	std::optional<D3D12_QUERY_DATA_PIPELINE_STATISTICS> pipeline;  // Most recent frame's, if collected.
+};
+
+// GPU written counter, such as the items surviving a culling pass, out of the total it was written from.
+struct GpuCounterStatistics
+{
+	std::string name;
+	uint32_t value;
+	uint32_t total;
+};
+
+// Engine-side GPU timing of render graph passes, independent of the profiling build flag. Each recorded pass is wrapped in
+// a pair of timestamps which are resolved at the end of the frame, and read back once the frame retires. Optionally also
+// queries the pipeline statistics of each pass, and reads back counters written by passes.
+class GpuProfiler
+{
+	static constexpr uint32_t maxPasses = 256;  // Per frame, passes past the limit aren't timed.
+	static constexpr uint32_t maxCounters = 32;  // Per frame.
+	static constexpr size_t historyCount = 128;  // Frames of samples the statistics are built from.
+
+private:
+	RenderDevice* device = nullptr;
+
+	ResourcePtr<ID3D12QueryHeap> queryHeap;
+	ResourcePtr<D3D12MA::Allocation> readback;
+	uint64_t frequency = 0;  // Ticks per second.
+
+	std::vector<std::vector<std::string_view>> framePasses;  // Stable pass names of each timed slot, per buffered frame.
+
+	ResourcePtr<ID3D12QueryHeap> statisticsHeap;
+	ResourcePtr<D3D12MA::Allocation> statisticsReadback;
+	std::vector<bool> frameStatistics;  // If the frame's passes queried pipeline statistics.
+
+	struct FrameCounter
+	{
+		std::string_view name;  // Stable.
+		uint32_t total;
+	};
+
+	ResourcePtr<D3D12MA::Allocation> counterReadback;
+	std::vector<std::vector<FrameCounter>> frameCounters;
+	CriticalSection counterLock;  // Counters are read from passes recording in parallel.
+	std::vector<GpuCounterStatistics> counters;  // Most recent values, in order of first appearance.
+
+	struct PassHistory
+	{
+		std::string name;
+		std::array<float, historyCount> samples = {};
+		size_t sampleCount = 0;
+		size_t nextSample = 0;
+		size_t lastFrame = 0;  // Read frame of the most recent sample, passes that stopped running are hidden.
+		std::optional<D3D12_QUERY_DATA_PIPELINE_STATISTICS> pipeline;
+	};
+
+	std::vector<PassHistory> history;  // In recording order of the passes' first appearance.
+	std::unordered_map<std::string_view, size_t> historyLookup;  // Keyed by the stable pass name.
+	size_t readFrames = 0;
+
+public:
+	bool enabled = true;
+	bool pipelineStatistics = false;  // Pipeline statistics queries and counters, heavier than timing alone.
+
+	// Requires the timestamp frequency of the queues the passes are recorded on.
+	void Initialize(RenderDevice* inDevice, uint64_t timestampFrequency);
+	bool Active() const noexcept { return enabled && queryHeap; }
+	bool CollectingStatistics() const noexcept { return Active() && pipelineStatistics && statisticsHeap; }
+
+	// Clears the frame's slots, the frame must have retired.
+	void BeginFrame(size_t frameIndex);
+	// Reserves a slot for a pass of the frame being recorded, not thread safe. Returns nothing once the slots run out.
+	std::optional<uint32_t> AddPass(size_t frameIndex, std::string_view stableName);
+	void BeginPass(CommandList& list, size_t frameIndex, uint32_t slot);
+	void EndPass(CommandList& list, size_t frameIndex, uint32_t slot);
+	// Copies a buffer's UAV counter for read back, the counter must be complete in the list. Thread safe.
+	void ReadCounter(CommandList& list, size_t frameIndex, std::string_view stableName, BufferHandle counterBuffer, uint32_t total);
+	// Records resolving the frame's timestamps, the list must execute after all of the frame's passes.
+	void Resolve(CommandList& list, size_t frameIndex);
+	// Reads back the timings of a retired frame into the statistics.
+	void ReadFrame(size_t frameIndex);
+
+	std::vector<GpuPassStatistics> GetStatistics() const;
+	const auto& GetCounters() const noexcept { return counters; }
+};
\ No newline at end of file
@@ -9,8 +9,12 @@
 
 ImageBasedLighting::~ImageBasedLighting()
 {
-	device->GetResourceManager().Destroy(irradianceTexture);
-	device->GetResourceManager().Destroy(prefilterTexture);
+	for (int i = 0; i < 2; ++i)
+	{
+		device->GetResourceManager().Destroy(irradianceBuffers[i]);
+		device->GetResourceManager().Destroy(prefilterTextures[i]);
+	}
+
 	device->GetResourceManager().Destroy(brdfTexture);
 }
 
@@ -30,18 +34,16 @@ void ImageBasedLighting::Initialize(RenderDevice* inDevice)
 		.ComputeShader({ "IBL/Convolution", "BRDFMain" })
 		.Macro({ "PREFILTER_LEVELS", prefilterLevels });
 
-	TextureDescription irradianceDesc{
+	BufferDescription irradianceDesc{
+		.updateRate = ResourceFrequency::Static,
 		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
 		.accessFlags = AccessFlag::GPUWrite,
-		.width = irradianceTextureSize,
-		.height = irradianceTextureSize,
-		.depth = 6,  // Texture cube.
-		.format = DXGI_FORMAT_R16G16B16A16_FLOAT,
-		.mipMapping = false,
-		.array = true
+		.size = irradianceCoefficients,
+		.stride = sizeof(XMFLOAT4)
 	};
 
-	irradianceTexture = device->GetResourceManager().Create(irradianceDesc, VGText("IBL irradiance"));
+	irradianceBuffers[0] = device->GetResourceManager().Create(irradianceDesc, VGText("IBL irradiance 0"));
+	irradianceBuffers[1] = device->GetResourceManager().Create(irradianceDesc, VGText("IBL irradiance 1"));
 
 	TextureDescription prefilterDesc{
 		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
@@ -54,7 +56,8 @@ void ImageBasedLighting::Initialize(RenderDevice* inDevice)
 		.array = true
 	};
 
-	prefilterTexture = device->GetResourceManager().Create(prefilterDesc, VGText("IBL prefilter"));
+	prefilterTextures[0] = device->GetResourceManager().Create(prefilterDesc, VGText("IBL prefilter 0"));
+	prefilterTextures[1] = device->GetResourceManager().Create(prefilterDesc, VGText("IBL prefilter 1"));
 
 	TextureDescription brdfDesc{
 		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
@@ -69,10 +72,8 @@ void ImageBasedLighting::Initialize(RenderDevice* inDevice)
 	brdfTexture = device->GetResourceManager().Create(brdfDesc, VGText("IBL BRDF"));
 }
 
-IBLResources ImageBasedLighting::UpdateLuts(RenderGraph& graph, RenderResource luminanceTexture, RenderResource cameraBuffer)
+IBLResources ImageBasedLighting::UpdateLuts(RenderGraph& graph, RenderResource luminanceTexture, RenderResource cameraBuffer, bool luminanceUpdated, bool fullRefresh)
 {
-	const auto irradianceTag = graph.Import(irradianceTexture);
-	const auto prefilterTag = graph.Import(prefilterTexture);
 	const auto brdfTag = graph.Import(brdfTexture);
 
 	if (!brdfRendered)
@@ -90,6 +91,8 @@ IBLResources ImageBasedLighting::UpdateLuts(RenderGraph& graph, RenderResource l
 				uint32_t convolutionTexture;
 				uint32_t brdfTexture;
 				uint32_t cubeFace;
+				uint32_t firstSlice;
+				uint32_t padding[3];
 				uint128_t prefilterMips[prefilterLevels];
 			} bindData;
 
@@ -102,10 +105,24 @@ IBLResources ImageBasedLighting::UpdateLuts(RenderGraph& graph, RenderResource l
 		brdfRendered = true;
 	}
 
-	auto& irradiancePass = graph.AddPass("IBL Irradiance Pass", ExecutionQueue::Compute);
+	if (luminanceUpdated)
+	{
+		convolutionStep = 0;
+	}
+
+	if (!Convolving())
+	{
+		return { graph.Import(irradianceBuffers[current]), graph.Import(prefilterTextures[current]), brdfTag };
+	}
+
+	const auto target = current ^ 1;
+	const auto irradianceTag = graph.Import(irradianceBuffers[target]);
+	const auto prefilterTag = graph.Import(prefilterTextures[target]);
+	const auto step = convolutionStep;
+
+	auto& irradiancePass = graph.AddPass("IBL Irradiance Pass", ExecutionQueue::Compute, fullRefresh || step == 0);
 	irradiancePass.Read(luminanceTexture, ResourceBind::SRV);
-	irradiancePass.Write(irradianceTag, TextureView{}
-		.UAV("array", 0));
+	irradiancePass.Write(irradianceTag, ResourceBind::UAV);
 	irradiancePass.Bind([&, luminanceTexture, irradianceTag](CommandList& list, RenderPassResources& resources)
 	{
 		list.BindPipeline(irradiancePrecomputeLayout);
@@ -113,17 +130,21 @@ IBLResources ImageBasedLighting::UpdateLuts(RenderGraph& graph, RenderResource l
 		struct BindData
 		{
 			uint32_t luminanceTexture;
-			uint32_t irradianceTexture;
+			uint32_t irradianceBuffer;
 			uint32_t brdfTexture;
 			uint32_t cubeFace;
+			uint32_t firstSlice;
+			uint32_t padding[3];
 			uint128_t prefilterMips[prefilterLevels];
 		} bindData;
 		
 		bindData.luminanceTexture = resources.Get(luminanceTexture);
-		bindData.irradianceTexture = resources.Get(irradianceTag, "array");
+		bindData.irradianceBuffer = resources.Get(irradianceTag);
+		bindData.firstSlice = 0;
 		list.BindConstants("bindData", bindData);
 
-		list.Dispatch(irradianceTextureSize / 8, irradianceTextureSize / 8, 6);
+		// A single group reduces the whole cube.
+		list.Dispatch(1, 1, 1);
 	});
 
 	TextureView prefilterView{};
@@ -135,34 +156,54 @@ IBLResources ImageBasedLighting::UpdateLuts(RenderGraph& graph, RenderResource l
 		prefilterView.UAV(prefilterViewNames[i], i);
 	}
 
-	auto& prefilterPass = graph.AddPass("IBL Prefilter Pass", ExecutionQueue::Compute);
+	// Every face for full refreshes, otherwise the step's face.
+	const auto firstFace = fullRefresh ? 0 : step - 1;
+	const auto lastFace = fullRefresh ? 6 : step;
+
+	auto& prefilterPass = graph.AddPass("IBL Prefilter Pass", ExecutionQueue::Compute, fullRefresh || step > 0);
 	prefilterPass.Read(luminanceTexture, ResourceBind::SRV);
 	prefilterPass.Write(prefilterTag, prefilterView);
-	prefilterPass.Bind([&, luminanceTexture, prefilterTag, prefilterViewNames](CommandList& list, RenderPassResources& resources)
+	prefilterPass.Bind([&, luminanceTexture, prefilterTag, prefilterViewNames, firstFace, lastFace](CommandList& list, RenderPassResources& resources)
 	{
 		list.BindPipeline(prefilterPrecomputeLayout);
 			
 		struct BindData
 		{
 			uint32_t luminanceTexture;
-			uint32_t irradianceTexture;
+			uint32_t irradianceBuffer;
 			uint32_t brdfTexture;
 			uint32_t cubeFace;
+			uint32_t firstSlice;
+			uint32_t padding[3];
 			uint128_t prefilterMips[prefilterLevels];
 		} bindData;
 		
 		bindData.luminanceTexture = resources.Get(luminanceTexture);
-		bindData.cubeFace = slice;
-		slice = (slice + 1) % 6;
+		bindData.firstSlice = 0;
 		for (int i = 0; i < prefilterLevels; ++i)
 		{
 			bindData.prefilterMips[i] = resources.Get(prefilterTag, prefilterViewNames[i]);
 		}
 
-		list.BindConstants("bindData", bindData);
+		// Each dispatch writes a single face.
+		for (uint32_t face = firstFace; face < lastFace; ++face)
+		{
+			bindData.cubeFace = face;
+			list.BindConstants("bindData", bindData);
 
-		list.Dispatch(prefilterTextureSize / 8, prefilterTextureSize / 8, 6);
+			list.Dispatch(prefilterTextureSize / 8, prefilterTextureSize / 8, 1);
+		}
 	});
 
-	return { irradianceTag, prefilterTag, brdfTag };
+	// Swap once the set is complete, the passes above run before any consumer of the returned resources.
+	++convolutionStep;
+	if (fullRefresh || convolutionStep == convolutionSteps)
+	{
+		convolutionStep = convolutionSteps;
+		current = target;
+
+		return { irradianceTag, prefilterTag, brdfTag };
+	}
+
+	return { graph.Import(irradianceBuffers[current]), graph.Import(prefilterTextures[current]), brdfTag };
 }
\ No newline at end of file
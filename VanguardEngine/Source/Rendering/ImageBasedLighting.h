@@ -20,19 +20,26 @@ struct IBLResources
 
 class ImageBasedLighting
 {
-private:
-	static constexpr uint32_t irradianceTextureSize = 32;
+public:
+	// Shared with the reflection probes, which are convolved by the same shaders.
+	static constexpr uint32_t irradianceCoefficients = 9;  // Second order spherical harmonics per cube, see SphericalHarmonics.hlsli.
 	static constexpr uint32_t prefilterTextureSize = 128;  // Resolution of base mip.
 	static constexpr uint32_t prefilterLevels = 6;  // Roughness bins, must be <= lg(prefilterTextureSize).
+
+private:
 	static constexpr uint32_t brdfTextureSize = 512;
 
-	static_assert(irradianceTextureSize % 8 == 0, "irradianceTextureSize must be evenly divisible by 8.");
 	static_assert(prefilterTextureSize % 8 == 0, "prefilterTextureSize must be evenly divisible by 8.");
+	static_assert(prefilterLevels <= 8, "prefilterLevels exceeds the sample count table in IBL/Convolution.hlsl.");
 	static_assert(brdfTextureSize % 8 == 0, "brdfTextureSize must be evenly divisible by 8.");
 
+	// Convolution is time sliced, the irradiance projection followed by one prefilter cube face per frame.
+	static constexpr uint32_t convolutionSteps = 7;
+
 public:
-	TextureHandle irradianceTexture;
-	TextureHandle prefilterTexture;
+	// Double buffered, consumers read a complete set while the other is convolved.
+	BufferHandle irradianceBuffers[2];
+	TextureHandle prefilterTextures[2];
 	TextureHandle brdfTexture;
 
 private:
@@ -43,12 +50,15 @@ private:
 	RenderDevice* device = nullptr;
 	bool brdfRendered = false;
 
-	uint32_t slice = 0;
+	uint32_t current = 0;  // Complete set.
+	uint32_t convolutionStep = convolutionSteps;  // Idle once all steps have run.
 
 public:
 	~ImageBasedLighting();
 	void Initialize(RenderDevice* inDevice);
-	IBLResources UpdateLuts(RenderGraph& graph, RenderResource luminanceTexture, RenderResource cameraBuffer);
+	// Starts convolving once the luminance map is updated, converging in a single frame for full refreshes.
+	IBLResources UpdateLuts(RenderGraph& graph, RenderResource luminanceTexture, RenderResource cameraBuffer, bool luminanceUpdated, bool fullRefresh);
 
 	uint32_t GetPrefilterLevels() const { return prefilterLevels; }
+	bool Convolving() const { return convolutionStep < convolutionSteps; }
 };
\ No newline at end of file
@@ -0,0 +1,384 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/Impostors.h>
+#include <Rendering/Device.h>
+#include <Rendering/MeshFactory.h>
+#include <Rendering/RenderGraph.h>
+#include <Rendering/RenderPass.h>
+#include <Rendering/CommandList.h>
+#include <Core/ConsoleVariable.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	struct BindData
+	{
+		uint32_t objectBuffer;
+		uint32_t vertexPositionBuffer;
+		uint32_t vertexExtraBuffer;
+		uint32_t materialBuffer;
+		uint32_t indexBuffer;
+		uint32_t objectId;
+		float radius;
+		float padding;
+		XMFLOAT3 center;
+	};
+
+	// Sphere around every subset, the subsets' spheres are bounded by the box around all of them.
+	void ComputeBounds(const MeshComponent& mesh, ImpostorData& data)
+	{
+		auto boundsMin = XMLoadFloat3(&mesh.subsets[0].boundsMin);
+		auto boundsMax = XMLoadFloat3(&mesh.subsets[0].boundsMax);
+		for (const auto& subset : mesh.subsets)
+		{
+			boundsMin = XMVectorMin(boundsMin, XMLoadFloat3(&subset.boundsMin));
+			boundsMax = XMVectorMax(boundsMax, XMLoadFloat3(&subset.boundsMax));
+		}
+
+		const auto center = (boundsMin + boundsMax) * 0.5f;
+		float sphereRadius = 0.f;
+		for (const auto& subset : mesh.subsets)
+		{
+			sphereRadius = std::max(sphereRadius, XMVectorGetX(XMVector3Length(XMLoadFloat3(&subset.boundingSphereCenter) - center)) + subset.boundingSphereRadius);
+		}
+
+		XMStoreFloat3(&data.center, center);
+		data.radius = std::max(std::min(sphereRadius, XMVectorGetX(XMVector3Length(boundsMax - center))), 1e-4f);
+	}
+}
+
+void Impostors::PatchRelocations()
+{
+	if (meshFactory->GetRevision() == meshRevision)
+		return;
+
+	meshRevision = meshFactory->GetRevision();
+
+	// Baked slots don't depend on where the mesh lives, only the key and the source of pending bakes move.
+	std::unordered_map<size_t, uint32_t> relocated;
+	relocated.reserve(meshRecords.size());
+
+	for (const auto [key, index] : meshRecords)
+	{
+		auto& record = records[index];
+		if (const auto offset = meshFactory->GetRelocation(key))
+		{
+			record.mesh.globalOffset = *offset;
+		}
+
+		relocated.emplace(record.mesh.globalOffset.index, index);
+	}
+
+	meshRecords = std::move(relocated);
+}
+
+void Impostors::ReleaseRecord(uint32_t index)
+{
+	auto& record = records[index];
+	if (record.slot)
+	{
+		slotAllocator.Free(*record.slot, 1);
+	}
+
+	meshRecords.erase(record.mesh.globalOffset.index);
+	recordAllocator.Free(index, 1);
+	record = Record{};
+}
+
+void Impostors::Bake(RenderGraph& graph, const ImpostorResources& resources, const ImpostorInputs& inputs, uint32_t index)
+{
+	const auto& record = records[index];
+	const auto instanceOffset = instances.at(record.representative).instanceOffset;
+
+	std::vector<uint32_t> indexCounts;
+	indexCounts.reserve(record.mesh.subsets.size());
+	for (const auto& subset : record.mesh.subsets)
+	{
+		indexCounts.emplace_back(static_cast<uint32_t>(subset.indices));
+	}
+
+	const auto slotX = (*record.slot % slotsPerSide) * slotResolution;
+	const auto slotY = (*record.slot / slotsPerSide) * slotResolution;
+
+	auto& bakePass = graph.AddPass("Impostor Bake Pass", ExecutionQueue::Graphics);
+	const auto depthTag = bakePass.Create(TransientTextureDescription{
+		.width = atlasResolution,
+		.height = atlasResolution,
+		.format = DXGI_FORMAT_R32_TYPELESS
+	}, VGText("Impostor bake depth"));
+	bakePass.Read(inputs.objectBuffer, ResourceBind::SRV);
+	bakePass.Read(inputs.vertexPositions, ResourceBind::SRV);
+	bakePass.Read(inputs.vertexExtras, ResourceBind::SRV);
+	bakePass.Read(inputs.materialBuffer, ResourceBind::SRV);
+	bakePass.Output(resources.albedoAtlas, OutputBind::RTV, LoadType::Preserve);
+	bakePass.Output(resources.normalAtlas, OutputBind::RTV, LoadType::Preserve);
+	bakePass.Output(resources.depthAtlas, OutputBind::RTV, LoadType::Preserve);
+	bakePass.Output(depthTag, OutputBind::DSV, LoadType::Clear);
+	bakePass.Bind([this, resources, inputs, instanceOffset, slotX, slotY, data = record.data, indexCounts = std::move(indexCounts)](CommandList& list, RenderPassResources& passResources)
+	{
+		BindData bindData{};
+		bindData.objectBuffer = passResources.Get(inputs.objectBuffer);
+		bindData.vertexPositionBuffer = passResources.Get(inputs.vertexPositions);
+		bindData.vertexExtraBuffer = passResources.Get(inputs.vertexExtras);
+		bindData.materialBuffer = passResources.Get(inputs.materialBuffer);
+		// The index buffer stays in an index and shader resource state, outside of the graph.
+		bindData.indexBuffer = device->GetResourceManager().Get(meshFactory->indexBuffer).SRV->bindlessIndex;
+		bindData.radius = data.radius;
+		bindData.center = data.center;
+
+		const D3D12_VIEWPORT viewport{
+			.TopLeftX = static_cast<float>(slotX),
+			.TopLeftY = static_cast<float>(slotY),
+			.Width = static_cast<float>(slotResolution),
+			.Height = static_cast<float>(slotResolution),
+			.MinDepth = 0.f,
+			.MaxDepth = 1.f
+		};
+		const D3D12_RECT slot{
+			.left = static_cast<LONG>(slotX),
+			.top = static_cast<LONG>(slotY),
+			.right = static_cast<LONG>(slotX + slotResolution),
+			.bottom = static_cast<LONG>(slotY + slotResolution)
+		};
+
+		list.BindPipeline(bakeLayout);
+
+		// Slots are reused once their mesh is gone, texels the new mesh doesn't cover have to read as uncovered.
+		list.ClearRenderTarget(passResources.GetTexture(resources.albedoAtlas), { &slot, 1 });
+		list.ClearRenderTarget(passResources.GetTexture(resources.normalAtlas), { &slot, 1 });
+		list.ClearRenderTarget(passResources.GetTexture(resources.depthAtlas), { &slot, 1 });
+
+		list.Native()->RSSetViewports(1, &viewport);
+		list.Native()->RSSetScissorRects(1, &slot);
+		list.ResumeRenderPass();
+
+		// Every frame of the slot is an instance of the subset's draw.
+		for (uint32_t i = 0; i < indexCounts.size(); ++i)
+		{
+			bindData.objectId = instanceOffset + i;
+			list.BindConstants("bindData", bindData);
+			list.Native()->DrawInstanced(indexCounts[i], framesPerSide * framesPerSide, 0, 0);
+		}
+	});
+}
+
+Impostors::~Impostors()
+{
+	device->GetResourceManager().Destroy(impostorBuffer);
+	device->GetResourceManager().Destroy(albedoAtlas);
+	device->GetResourceManager().Destroy(normalAtlas);
+	device->GetResourceManager().Destroy(depthAtlas);
+}
+
+void Impostors::Initialize(RenderDevice* inDevice, MeshFactory* inMeshFactory)
+{
+	device = inDevice;
+	meshFactory = inMeshFactory;
+	meshRevision = meshFactory->GetRevision();
+
+	CvarCreate("impostorScreenSize", "Projected diameter in pixels below which instances of baked meshes draw as impostors, only the batched "
+		"draws of the main view use them, 0=disabled", 48.f);
+	CvarCreate("impostorMinInstances", "Entities drawing a mesh before its impostor is baked", 16);
+
+	bakeLayout = RenderPipelineLayout{}
+		.VertexShader({ "ImpostorBake", "VSMain" })
+		.PixelShader({ "ImpostorBake", "PSMain" })
+		.DepthEnabled(true, true)
+		.CullMode(D3D12_CULL_MODE_NONE);  // Frames look from every side, back faces of open meshes are seen too.
+
+	BufferDescription impostorDescription{};
+	impostorDescription.updateRate = ResourceFrequency::Static;
+	impostorDescription.bindFlags = BindFlag::ShaderResource;
+	impostorDescription.accessFlags = AccessFlag::CPUWrite;
+	impostorDescription.size = maxMeshes;
+	impostorDescription.stride = sizeof(ImpostorData);
+
+	impostorBuffer = device->GetResourceManager().Create(impostorDescription, VGText("Impostor buffer"));
+
+	// Uncovered texels are cleared to zero in every channel, including the albedo's coverage.
+	TextureDescription atlasDescription{
+		.bindFlags = BindFlag::RenderTarget | BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::GPUWrite,
+		.width = atlasResolution,
+		.height = atlasResolution,
+		.depth = 1,
+		.format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB,
+		.clearValue = { .color = { 0.f, 0.f, 0.f, 0.f } },
+		.evictable = true  // Idle while impostors are disabled.
+	};
+
+	albedoAtlas = device->GetResourceManager().Create(atlasDescription, VGText("Impostor albedo atlas"));
+
+	atlasDescription.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	normalAtlas = device->GetResourceManager().Create(atlasDescription, VGText("Impostor normal atlas"));
+
+	atlasDescription.format = DXGI_FORMAT_R16G16_UNORM;
+	depthAtlas = device->GetResourceManager().Create(atlasDescription, VGText("Impostor depth atlas"));
+
+	std::vector<D3D12_INDIRECT_ARGUMENT_DESC> drawArgDescs;
+	drawArgDescs.emplace_back(D3D12_INDIRECT_ARGUMENT_DESC{
+		.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW
+	});
+
+	D3D12_COMMAND_SIGNATURE_DESC drawSignatureDesc{};
+	drawSignatureDesc.ByteStride = sizeof(D3D12_DRAW_ARGUMENTS);
+	drawSignatureDesc.NumArgumentDescs = drawArgDescs.size();
+	drawSignatureDesc.pArgumentDescs = drawArgDescs.data();
+	drawSignatureDesc.NodeMask = 0;
+
+	const auto result = device->Native()->CreateCommandSignature(&drawSignatureDesc, nullptr, IID_PPV_ARGS(drawSignature.Indirect()));
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to create impostor indirect command signature: {}", result);
+	}
+}
+
+uint32_t Impostors::AddInstance(entt::entity entity, const MeshComponent& mesh, uint32_t instanceOffset)
+{
+	if (mesh.subsets.empty())
+		return 0;
+
+	PatchRelocations();
+
+	auto iter = meshRecords.find(mesh.globalOffset.index);
+	if (iter == meshRecords.end())
+	{
+		// Out of records, the mesh keeps drawing in full.
+		const auto index = recordAllocator.Allocate(1);
+		if (!index)
+			return 0;
+
+		if (recordAllocator.Size() > records.size())
+		{
+			records.resize(recordAllocator.Size());
+		}
+
+		auto& record = records[*index];
+		record = Record{ .mesh = mesh };
+		ComputeBounds(mesh, record.data);
+
+		iter = meshRecords.emplace(mesh.globalOffset.index, *index).first;
+		dirtyRecords.emplace_back(*index);
+	}
+
+	auto& record = records[iter->second];
+	++record.references;
+	if (record.representative == entt::null)
+	{
+		record.representative = entity;
+	}
+
+	instances[entity] = Instance{ .record = iter->second, .instanceOffset = instanceOffset };
+
+	return iter->second + 1;
+}
+
+void Impostors::RemoveInstance(entt::entity entity)
+{
+	const auto iter = instances.find(entity);
+	if (iter == instances.end())
+		return;
+
+	PatchRelocations();
+
+	const auto index = iter->second.record;
+	instances.erase(iter);
+
+	auto& record = records[index];
+	if (--record.references == 0)
+	{
+		ReleaseRecord(index);
+
+		return;
+	}
+
+	// Any other entity drawing the mesh can be baked from.
+	if (record.representative == entity)
+	{
+		const auto other = std::find_if(instances.begin(), instances.end(), [index](const auto& instance) { return instance.second.record == index; });
+		record.representative = other != instances.end() ? other->first : entt::null;
+	}
+}
+
+uint32_t Impostors::GetImpostorIndex(entt::entity entity) const
+{
+	const auto iter = instances.find(entity);
+
+	return iter != instances.end() ? iter->second.record + 1 : 0;
+}
+
+std::optional<ImpostorResources> Impostors::Render(RenderGraph& graph, const ImpostorInputs& inputs)
+{
+	VGScopedCPUStat("Impostors");
+
+	PatchRelocations();
+
+	if (*CvarGet("impostorScreenSize", float) <= 0.f)
+		return std::nullopt;
+
+	// Frames execute in order, so last frame's bakes are done before anything reads this frame's records.
+	for (const auto index : bakedRecords)
+	{
+		if (index < records.size() && records[index].slot)
+		{
+			records[index].data.ready = 1;
+			dirtyRecords.emplace_back(index);
+		}
+	}
+
+	bakedRecords.clear();
+
+	for (const auto index : dirtyRecords)
+	{
+		device->GetResourceManager().Write(impostorBuffer, records[index].data, index * sizeof(ImpostorData));
+	}
+
+	dirtyRecords.clear();
+
+	const ImpostorResources resources{
+		.impostorBuffer = graph.Import(impostorBuffer),
+		.albedoAtlas = graph.Import(albedoAtlas),
+		.normalAtlas = graph.Import(normalAtlas),
+		.depthAtlas = graph.Import(depthAtlas)
+	};
+
+	// A single mesh is baked per frame, the first one with enough entities drawing it.
+	const auto minInstances = static_cast<uint32_t>(std::max(*CvarGet("impostorMinInstances", int), 1));
+	for (uint32_t i = 0; i < records.size(); ++i)
+	{
+		auto& record = records[i];
+		if (record.references < minInstances || record.slot || record.representative == entt::null)
+			continue;
+
+		// The atlas is full, remaining meshes keep drawing in full until a slot frees up.
+		record.slot = slotAllocator.Allocate(1);
+		if (!record.slot)
+			break;
+
+		record.data.slot = *record.slot;
+		Bake(graph, resources, inputs, i);
+		bakedRecords.emplace_back(i);
+
+		break;
+	}
+
+	return resources;
+}
+
+ImpostorDrawData Impostors::GetDrawData(RenderPassResources& resources, const ImpostorResources& impostorResources) const
+{
+	return ImpostorDrawData{
+		.impostorBuffer = resources.Get(impostorResources.impostorBuffer),
+		.albedoAtlas = resources.Get(impostorResources.albedoAtlas),
+		.normalAtlas = resources.Get(impostorResources.normalAtlas),
+		.depthAtlas = resources.Get(impostorResources.depthAtlas)
+	};
+}
+
+void Impostors::Draw(CommandList& list, BufferHandle arguments)
+{
+	list.ResumeRenderPass();
+	list.Native()->ExecuteIndirect(drawSignature.Get(), 1, device->GetResourceManager().Get(arguments).Native(), 0, nullptr, 0);
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Rendering/ResourceHandle.h>
+#include <Rendering/RenderPipeline.h>
+#include <Rendering/RenderGraphResource.h>
+#include <Rendering/RenderComponents.h>
+#include <Rendering/ShaderStructs.h>
+#include <Utility/FreeListAllocator.h>
+#include <Utility/ResourcePtr.h>
+
+#include <entt/entt.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <optional>
+
+class RenderDevice;
+class RenderGraph;
+class RenderPassResources;
+class CommandList;
+class MeshFactory;
+
+struct ImpostorResources
+{
+	RenderResource impostorBuffer;
+	RenderResource albedoAtlas;
+	RenderResource normalAtlas;
+	RenderResource depthAtlas;
+};
+
+struct ImpostorInputs
+{
+	RenderResource objectBuffer;
+	RenderResource vertexPositions;
+	RenderResource vertexExtras;
+	RenderResource materialBuffer;
+};
+
+// Octahedral impostors of meshes drawn by many entities. Once enough entities draw a mesh, its subsets are baked from a
+// grid of directions over the whole sphere into a slot of the impostor atlases, one mesh per frame. Mesh culling then
+// draws instances whose sphere projects below a few pixels as a single camera facing quad, which blends the frames nearest
+// to the view and writes the depth of the baked surface, so it's lit and occluded like the mesh it replaces. Only the main
+// view's batched draws use impostors, shadows, probes and the mesh shader paths keep drawing the meshes.
+class Impostors
+{
+public:
+	static constexpr uint32_t framesPerSide = 8;  // Matches Impostors.hlsli.
+	static constexpr uint32_t frameResolution = 32;
+	static constexpr uint32_t slotsPerSide = 8;
+	static constexpr uint32_t slotResolution = framesPerSide * frameResolution;
+	static constexpr uint32_t atlasResolution = slotsPerSide * slotResolution;
+	static constexpr uint32_t maxMeshes = 1024 * 4;
+	static constexpr uint32_t primaryFlag = 1u << 31;  // Set on the object drawing the quad, see Impostors.hlsli.
+
+private:
+	struct Record
+	{
+		MeshComponent mesh;  // Offsets are patched when defragmenting moves the mesh.
+		uint32_t references = 0;
+		entt::entity representative = entt::null;  // Its objects are drawn into the slot when baking.
+		std::optional<uint32_t> slot;
+		ImpostorData data;  // Ready once the bake executed, distant instances draw the impostor from then on.
+	};
+
+	struct Instance
+	{
+		uint32_t record;
+		uint32_t instanceOffset;  // Of the entity's objects.
+	};
+
+	RenderDevice* device;
+	MeshFactory* meshFactory;
+
+	RenderPipelineLayout bakeLayout;
+	ResourcePtr<ID3D12CommandSignature> drawSignature;
+
+	BufferHandle impostorBuffer;
+	TextureHandle albedoAtlas;
+	TextureHandle normalAtlas;
+	TextureHandle depthAtlas;
+
+	std::vector<Record> records;
+	std::unordered_map<size_t, uint32_t> meshRecords;  // Keyed by the mesh's global index offset.
+	std::unordered_map<entt::entity, Instance> instances;
+	std::vector<uint32_t> dirtyRecords;  // Uploaded on the next render.
+	std::vector<uint32_t> bakedRecords;  // Baked last frame, drawn from this frame.
+	FreeListAllocator recordAllocator{ maxMeshes };
+	FreeListAllocator slotAllocator{ slotsPerSide * slotsPerSide };
+	size_t meshRevision = 0;
+
+	void PatchRelocations();
+	void ReleaseRecord(uint32_t record);
+	void Bake(RenderGraph& graph, const ImpostorResources& resources, const ImpostorInputs& inputs, uint32_t record);
+
+public:
+	~Impostors();
+
+	void Initialize(RenderDevice* inDevice, MeshFactory* inMeshFactory);
+	// Counts the entity towards its mesh's impostor. Returns the impostor index its objects carry, zero without one.
+	uint32_t AddInstance(entt::entity entity, const MeshComponent& mesh, uint32_t instanceOffset);
+	void RemoveInstance(entt::entity entity);
+	// Impostor index of the entity's objects, zero without one. Safe to call concurrently.
+	uint32_t GetImpostorIndex(entt::entity entity) const;
+
+	// Uploads changed records and bakes the next mesh due. Nothing when disabled.
+	std::optional<ImpostorResources> Render(RenderGraph& graph, const ImpostorInputs& inputs);
+	ImpostorDrawData GetDrawData(RenderPassResources& resources, const ImpostorResources& impostorResources) const;
+	// Draws the impostor list's quads with the bound pipeline and constants.
+	void Draw(CommandList& list, BufferHandle arguments);
+};
\ No newline at end of file
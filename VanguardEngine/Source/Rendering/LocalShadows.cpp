@@ -0,0 +1,563 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/LocalShadows.h>
+#include <Rendering/Device.h>
+#include <Rendering/Renderer.h>
+#include <Rendering/RenderSystems.h>
+#include <Rendering/RenderGraph.h>
+#include <Rendering/RenderPass.h>
+#include <Rendering/CommandList.h>
+#include <Rendering/RenderComponents.h>
+#include <Core/ConsoleVariable.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	constexpr float maxSpotAngle = XM_PI * 0.95f;  // Wider cones would need a cube.
+
+	uint32_t GetFaceCount(uint32_t lightType)
+	{
+		return static_cast<LightType>(lightType) == LightType::Point ? ReflectionProbes::faceCount : 1;
+	}
+
+	uint32_t GetFaceMask(uint32_t faceCount)
+	{
+		return (1u << faceCount) - 1;
+	}
+}
+
+void LocalShadows::CreateAtlas(uint32_t resolution)
+{
+	if (device->GetResourceManager().Valid(atlas))
+	{
+		device->GetResourceManager().Destroy(atlas);
+	}
+
+	TextureDescription atlasDesc{
+		.bindFlags = BindFlag::DepthStencil | BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::GPUWrite,
+		.width = resolution * tilesPerSide,
+		.height = resolution * tilesPerSide,
+		.depth = 1,
+		.format = DXGI_FORMAT_R32_TYPELESS,  // Perspective depth needs the precision.
+		.mipMapping = false
+	};
+
+	atlas = device->GetResourceManager().Create(atlasDesc, VGText("Local shadow atlas"));
+	tileResolution = resolution;
+	invalidated = true;
+}
+
+std::optional<uint32_t> LocalShadows::AllocateTiles(uint32_t faceCount) const
+{
+	// Cube faces are consecutive tiles within a row, so shading finds every face from the first.
+	for (uint32_t row = 0; row < tilesPerSide; ++row)
+	{
+		uint32_t run = 0;
+		for (uint32_t column = 0; column < tilesPerSide; ++column)
+		{
+			const auto tile = row * tilesPerSide + column;
+			run = tileOwners[tile] == entt::null ? run + 1 : 0;
+			if (run == faceCount)
+			{
+				return tile + 1 - faceCount;
+			}
+		}
+	}
+
+	return std::nullopt;
+}
+
+void LocalShadows::ReleaseShadow(entt::entity entity)
+{
+	const auto iter = shadows.find(entity);
+	if (iter == shadows.end())
+		return;
+
+	for (uint32_t i = 0; i < iter->second.faceCount; ++i)
+	{
+		tileOwners[iter->second.firstTile + i] = entt::null;
+	}
+
+	if (iter->second.ready)
+	{
+		changedLights.emplace_back(entity);
+	}
+
+	shadows.erase(iter);
+}
+
+void LocalShadows::UpdateCameras(const Shadow& shadow, const LightRecord& light)
+{
+	const auto eye = XMLoadFloat3(&light.position);
+	const XMFLOAT4 position = { light.position.x, light.position.y, light.position.z, 0.f };
+	const auto farPlane = std::max(light.range, nearPlane * 2.f);
+
+	for (uint32_t face = 0; face < shadow.faceCount; ++face)
+	{
+		XMVECTOR forward;
+		XMVECTOR up;
+		float fieldOfView;
+
+		if (shadow.faceCount == ReflectionProbes::faceCount)
+		{
+			// Face order of ComputeDirection() in CubeMap.hlsli, matching the face selection in Shadows.hlsli.
+			const XMVECTOR forwards[ReflectionProbes::faceCount] = {
+				XMVectorSet(1.f, 0.f, 0.f, 0.f),
+				XMVectorSet(-1.f, 0.f, 0.f, 0.f),
+				XMVectorSet(0.f, 1.f, 0.f, 0.f),
+				XMVectorSet(0.f, -1.f, 0.f, 0.f),
+				XMVectorSet(0.f, 0.f, 1.f, 0.f),
+				XMVectorSet(0.f, 0.f, -1.f, 0.f)
+			};
+
+			forward = forwards[face];
+			up = face < 4 ? XMVectorSet(0.f, 0.f, 1.f, 0.f) : XMVectorSet(0.f, 1.f, 0.f, 0.f);
+			fieldOfView = XM_PIDIV2;
+		}
+
+		else
+		{
+			forward = XMVector3Normalize(XMLoadFloat3(&light.direction));
+			up = std::abs(light.direction.z) < 0.99f ? XMVectorSet(0.f, 0.f, 1.f, 0.f) : XMVectorSet(1.f, 0.f, 0.f, 0.f);
+			fieldOfView = std::clamp(2.f * std::acos(std::clamp(light.spotCosOuter, -1.f, 1.f)), 0.01f, maxSpotAngle);
+		}
+
+		const auto view = XMMatrixLookToRH(eye, forward, up);
+		const auto inverseView = XMMatrixInverse(nullptr, view);
+		const auto projection = XMMatrixPerspectiveFovRH(fieldOfView, 1.f, farPlane, nearPlane);  // Inverse Z.
+		const auto inverseProjection = XMMatrixInverse(nullptr, projection);
+
+		tileCameras[shadow.firstTile + face] = Camera{
+			.position = position,
+			.view = view,
+			.projection = projection,
+			.inverseView = inverseView,
+			.inverseProjection = inverseProjection,
+			.lastFramePosition = position,
+			.lastFrameView = view,  // Depth only, no motion.
+			.lastFrameProjection = projection,
+			.lastFrameInverseView = inverseView,
+			.lastFrameInverseProjection = inverseProjection,
+			.nearPlane = nearPlane,
+			.farPlane = farPlane,
+			.fieldOfView = fieldOfView,
+			.aspectRatio = 1.f
+		};
+	}
+}
+
+LocalShadows::~LocalShadows()
+{
+	if (device->GetResourceManager().Valid(atlas))
+	{
+		device->GetResourceManager().Destroy(atlas);
+	}
+}
+
+void LocalShadows::Initialize(RenderDevice* inDevice)
+{
+	device = inDevice;
+
+	CvarCreate("localShadows", "Shadows of point and spot lights, rendered into a cached atlas, 0=disabled, 1=enabled", 1);
+	CvarCreate("localShadowResolution", "Resolution of each face in the local light shadow atlas", 512);
+	CvarCreate("localShadowFaceBudget", "Faces of the local light shadow atlas rendered per frame at most, a point light renders six", 6);
+
+	cullResetLayout = RenderPipelineLayout{}
+		.ComputeShader({ "MeshCulling", "ResetMain" });
+
+	cullLayout = RenderPipelineLayout{}
+		.ComputeShader({ "MeshCulling", "ProbeMain" });
+
+	// Depth only. Biased away from the light, inverse Z.
+	depthLayout = RenderPipelineLayout{}
+		.VertexShader({ "Prepass", "VSMain" })
+		.DepthEnabled(true, true)
+		.DepthBias(-2, -2.f);
+
+	tileOwners.fill(entt::null);
+
+	CreateAtlas(static_cast<uint32_t>(*CvarGet("localShadowResolution", int)));
+}
+
+void LocalShadows::UpdateLight(entt::entity entity, const Light& light)
+{
+	const auto type = static_cast<LightType>(light.type);
+	if ((type != LightType::Point && type != LightType::Spot) || light.radius <= 0.f)
+	{
+		RemoveLight(entity);
+
+		return;
+	}
+
+	const LightRecord record{
+		.type = light.type,
+		.position = light.position,
+		.direction = light.direction,
+		.range = light.radius,
+		.spotCosOuter = light.spotCosOuter
+	};
+
+	// Lights are also uploaded again without changing, such as when their shadow becomes ready.
+	if (const auto iter = lights.find(entity); iter != lights.end())
+	{
+		const auto& last = iter->second;
+		if (last.type != record.type)
+		{
+			ReleaseShadow(entity);  // The face count changes, the tiles are allocated again.
+		}
+
+		else if (const auto shadow = shadows.find(entity); shadow != shadows.end() && std::memcmp(&last, &record, sizeof(record)) != 0)
+		{
+			shadow->second.pendingFaces = GetFaceMask(shadow->second.faceCount);
+		}
+	}
+
+	lights[entity] = record;
+}
+
+void LocalShadows::RemoveLight(entt::entity entity)
+{
+	lights.erase(entity);
+	ReleaseShadow(entity);
+}
+
+void LocalShadows::Update(const XMVECTOR& viewPosition, FrameVector<Camera>& cameras)
+{
+	VGAssert(cameras.size() == firstCameraIndex, "Local shadow cameras must follow the existing cameras.");
+
+	changedLights.clear();
+	renderTiles.clear();
+	++frame;
+
+	const auto resolution = static_cast<uint32_t>(std::max(*CvarGet("localShadowResolution", int), 64));
+	if (resolution != tileResolution)
+	{
+		CreateAtlas(resolution);
+	}
+
+	// Nothing is rendered while disabled, so every shadow is stale once they're enabled again.
+	if (*CvarGet("localShadows", int) == 0)
+	{
+		while (!shadows.empty())
+		{
+			ReleaseShadow(shadows.begin()->first);
+		}
+
+		movedBounds.clear();
+	}
+
+	else
+	{
+		for (auto& [entity, shadow] : shadows)
+		{
+			if (invalidated)
+			{
+				shadow.pendingFaces = GetFaceMask(shadow.faceCount);
+
+				continue;
+			}
+
+			const auto& light = lights.at(entity);
+			const BoundingSphere influence{ light.position, light.range };
+			if (std::any_of(movedBounds.begin(), movedBounds.end(), [&influence](const auto& bounds) { return influence.Intersects(bounds); }))
+			{
+				shadow.pendingFaces = GetFaceMask(shadow.faceCount);
+			}
+		}
+
+		invalidated = false;
+		movedBounds.clear();
+
+		// Approximate screen coverage of each light's range. Lights containing the view cover all of it.
+		struct Candidate
+		{
+			entt::entity entity;
+			float importance;
+		};
+
+		std::vector<Candidate> candidates;
+		candidates.reserve(lights.size());
+		for (const auto& [entity, light] : lights)
+		{
+			const auto distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&light.position) - viewPosition));
+			candidates.emplace_back(Candidate{ entity, light.range / std::max(distance - light.range, nearPlane) });
+		}
+
+		// At most one light per tile can win.
+		const auto winners = std::min<size_t>(candidates.size(), maxTiles);
+		std::partial_sort(candidates.begin(), candidates.begin() + winners, candidates.end(), [](const auto& left, const auto& right) { return left.importance > right.importance; });
+		candidates.resize(winners);
+
+		for (const auto& candidate : candidates)
+		{
+			if (const auto iter = shadows.find(candidate.entity); iter != shadows.end())
+			{
+				iter->second.lastUsed = frame;
+
+				continue;
+			}
+
+			// Evict the least recently used shadows until the light fits, shadows that already won this frame are kept.
+			const auto faceCount = GetFaceCount(lights.at(candidate.entity).type);
+			auto firstTile = AllocateTiles(faceCount);
+			while (!firstTile)
+			{
+				const auto victim = std::min_element(shadows.begin(), shadows.end(), [](const auto& left, const auto& right) { return left.second.lastUsed < right.second.lastUsed; });
+				if (victim == shadows.end() || victim->second.lastUsed == frame)
+					break;
+
+				ReleaseShadow(victim->first);
+				firstTile = AllocateTiles(faceCount);
+			}
+
+			if (!firstTile)
+				continue;
+
+			for (uint32_t i = 0; i < faceCount; ++i)
+			{
+				tileOwners[*firstTile + i] = candidate.entity;
+			}
+
+			shadows[candidate.entity] = Shadow{
+				.firstTile = *firstTile,
+				.faceCount = faceCount,
+				.pendingFaces = GetFaceMask(faceCount),
+				.lastUsed = frame
+			};
+		}
+
+		// Stale shadows of lights that lost their place would never render again, they're dropped instead.
+		std::vector<entt::entity> staleShadows;
+		for (const auto& [entity, shadow] : shadows)
+		{
+			if (shadow.lastUsed != frame && shadow.pendingFaces != 0)
+				staleShadows.emplace_back(entity);
+		}
+
+		for (const auto entity : staleShadows)
+		{
+			ReleaseShadow(entity);
+		}
+
+		// The most important lights render first. A light's faces render together, so it never shades with a partial
+		// cube, and stale shadows keep shading until their turn comes.
+		const auto budget = static_cast<uint32_t>(std::clamp(*CvarGet("localShadowFaceBudget", int), 1, static_cast<int>(maxRenderedFaces)));
+		for (const auto& candidate : candidates)
+		{
+			const auto iter = shadows.find(candidate.entity);
+			if (iter == shadows.end() || iter->second.pendingFaces == 0)
+				continue;
+
+			auto& shadow = iter->second;
+			if (!renderTiles.empty() && renderTiles.size() + std::popcount(shadow.pendingFaces) > budget)
+				continue;
+
+			UpdateCameras(shadow, lights.at(candidate.entity));
+
+			for (uint32_t i = 0; i < shadow.faceCount; ++i)
+			{
+				if (shadow.pendingFaces & (1u << i))
+					renderTiles.emplace_back(shadow.firstTile + i);
+			}
+
+			shadow.pendingFaces = 0;
+			if (!shadow.ready)
+			{
+				shadow.ready = true;
+				changedLights.emplace_back(candidate.entity);
+			}
+		}
+	}
+
+	// Tiles keep the cameras they were rendered with.
+	for (const auto& camera : tileCameras)
+	{
+		cameras.emplace_back(camera);
+	}
+
+	for (const auto tile : renderTiles)
+	{
+		cameras.emplace_back(tileCameras[tile]);
+	}
+}
+
+uint32_t LocalShadows::GetShadowIndex(entt::entity entity) const
+{
+	const auto iter = shadows.find(entity);
+	if (iter == shadows.end() || !iter->second.ready)
+		return 0;
+
+	return iter->second.firstTile + 1;
+}
+
+RenderResource LocalShadows::Render(RenderGraph& graph, const ShadowInputs& inputs)
+{
+	const auto atlasTag = graph.Import(atlas);
+
+	if (renderTiles.empty())
+	{
+		return atlasTag;
+	}
+
+	// Every face is culled in one dispatch, into consecutive ranges of draw arguments and visible instances, like the
+	// shadow cascades.
+	const auto& renderer = Renderer::Get();
+	const auto faceCount = static_cast<uint32_t>(renderTiles.size());
+	const auto argumentCapacity = std::bit_ceil(std::max<size_t>(renderer.batchCount, 1)) * maxRenderedFaces;
+	const auto instanceCapacity = std::bit_ceil(std::max<size_t>(renderer.renderableCount, 1)) * maxRenderedFaces * maxMeshLods;  // A range per level of detail.
+
+	auto& shadowPass = graph.AddPass("Local Shadow Pass", ExecutionQueue::Graphics);
+	const auto culledArgsTag = shadowPass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+		.size = argumentCapacity,
+		.stride = sizeof(MeshIndirectArgument),
+		.uavCounter = true  // Counts the visible casters.
+	}, VGText("Local shadow indirect render argument buffer"));
+	const auto visibleInstancesTag = shadowPass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+		.size = instanceCapacity,
+		.stride = sizeof(uint32_t)
+	}, VGText("Local shadow visible instance buffer"));
+	shadowPass.Read(inputs.meshIndirectArgs, ResourceBind::SRV);
+	shadowPass.Read(inputs.meshInstances, ResourceBind::SRV);
+	shadowPass.Read(inputs.objectBuffer, ResourceBind::SRV);
+	shadowPass.Read(inputs.transformBuffer, ResourceBind::SRV);
+	shadowPass.Read(inputs.cameraBuffer, ResourceBind::SRV);
+	shadowPass.Read(inputs.cullingViewBuffer, ResourceBind::SRV);
+	shadowPass.Read(inputs.vertexPositions, ResourceBind::SRV);
+	shadowPass.Write(culledArgsTag, ResourceBind::UAV);
+	shadowPass.Write(visibleInstancesTag, ResourceBind::UAV);
+	shadowPass.Output(atlasTag, OutputBind::DSV, LoadType::Preserve);
+	shadowPass.Bind([this, inputs, atlasTag, culledArgsTag, visibleInstancesTag, faceCount, tiles = renderTiles](CommandList& list, RenderPassResources& resources)
+	{
+		auto& renderer = Renderer::Get();
+
+		const auto culledArgs = resources.GetBuffer(culledArgsTag);
+		const auto visibleInstances = resources.GetBuffer(visibleInstancesTag);
+		const auto depthStencil = resources.GetTexture(atlasTag);
+		const auto& arguments = device->GetResourceManager().Get(culledArgs);
+
+		struct {
+			uint32_t inputBuffer;
+			uint32_t outputBuffer;
+			uint32_t instanceBuffer;
+			uint32_t visibleInstanceBuffer;
+			uint32_t objectBuffer;
+			uint32_t transformBuffer;
+			uint32_t cullingViewBuffer;
+			uint32_t cameraIndex;
+			uint32_t batchCount;
+			uint32_t instanceCount;
+			uint32_t cullingLevel;
+			uint32_t hiZTexture;
+			uint32_t hiZMipLevels;
+			uint32_t visibilityBuffer;
+			uint32_t nextVisibilityBuffer;
+			uint32_t lodResolution;
+			float lodErrorThreshold;
+			uint32_t countInstances;
+		} cullBindData{};
+
+		cullBindData.inputBuffer = resources.Get(inputs.meshIndirectArgs);
+		cullBindData.outputBuffer = resources.Get(culledArgsTag);
+		cullBindData.instanceBuffer = resources.Get(inputs.meshInstances);
+		cullBindData.visibleInstanceBuffer = resources.Get(visibleInstancesTag);
+		cullBindData.objectBuffer = resources.Get(inputs.objectBuffer);
+		cullBindData.transformBuffer = resources.Get(inputs.transformBuffer);
+		cullBindData.cullingViewBuffer = resources.Get(inputs.cullingViewBuffer);
+		cullBindData.cameraIndex = firstRenderCameraIndex;
+		cullBindData.batchCount = renderer.batchCount;
+		cullBindData.instanceCount = renderer.renderableCount;
+		cullBindData.cullingLevel = 1;  // Frustum only.
+		cullBindData.lodErrorThreshold = *CvarGet("meshLodThreshold", float);
+		cullBindData.lodResolution = cullBindData.lodErrorThreshold > 0.f ? tileResolution : 0;
+		cullBindData.countInstances = device->GetProfiler().CollectingStatistics();
+
+		struct {
+			uint32_t instanceBuffer;
+			uint32_t objectBuffer;
+			uint32_t cameraBuffer;
+			uint32_t cameraIndex;
+			uint32_t vertexPositionBuffer;
+			uint32_t padding[3];
+			MeshletDrawData meshletData;  // Unused.
+			uint32_t transformBuffer;
+		} bindData{};
+
+		bindData.instanceBuffer = resources.Get(visibleInstancesTag);
+		bindData.objectBuffer = resources.Get(inputs.objectBuffer);
+		bindData.transformBuffer = resources.Get(inputs.transformBuffer);
+		bindData.cameraBuffer = resources.Get(inputs.cameraBuffer);
+		bindData.vertexPositionBuffer = resources.Get(inputs.vertexPositions);
+
+		constexpr auto groupSize = 64;
+
+		// One dispatch row per face.
+		list.BindPipeline(cullResetLayout);
+		list.BindConstants("bindData", cullBindData);
+		list.Dispatch(std::ceil((float)cullBindData.batchCount / groupSize), faceCount, 1);
+
+		list.UAVBarrier(culledArgs);
+		list.FlushBarriers();
+
+		list.BindPipeline(cullLayout);
+		list.BindConstants("bindData", cullBindData);
+		list.Dispatch(std::ceil((float)cullBindData.instanceCount / groupSize), faceCount, 1);
+
+		if (device->GetProfiler().CollectingStatistics())
+		{
+			device->GetProfiler().ReadCounter(list, device->GetFrameIndex(), "Local shadow casters", arguments.counterBuffer, static_cast<uint32_t>(renderer.renderableCount * faceCount));
+		}
+
+		list.TransitionBarrier(culledArgs, MeshSystem::argumentState);
+		list.TransitionBarrier(visibleInstances, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		list.FlushBarriers();
+
+		list.BindPipeline(depthLayout);
+		MeshSystem::BindArguments(renderer, list, culledArgs);
+
+		for (uint32_t i = 0; i < faceCount; ++i)
+		{
+			const auto tileX = (tiles[i] % tilesPerSide) * tileResolution;
+			const auto tileY = (tiles[i] / tilesPerSide) * tileResolution;
+
+			const D3D12_VIEWPORT viewport{
+				.TopLeftX = static_cast<float>(tileX),
+				.TopLeftY = static_cast<float>(tileY),
+				.Width = static_cast<float>(tileResolution),
+				.Height = static_cast<float>(tileResolution),
+				.MinDepth = 0.f,
+				.MaxDepth = 1.f
+			};
+			const D3D12_RECT tile{
+				.left = static_cast<LONG>(tileX),
+				.top = static_cast<LONG>(tileY),
+				.right = static_cast<LONG>(tileX + tileResolution),
+				.bottom = static_cast<LONG>(tileY + tileResolution)
+			};
+
+			list.ClearDepthStencil(depthStencil, { &tile, 1 });
+
+			// Restricts the draws to the face's tile.
+			list.Native()->RSSetViewports(1, &viewport);
+			list.Native()->RSSetScissorRects(1, &tile);
+
+			bindData.cameraIndex = firstRenderCameraIndex + i;
+			list.BindConstants("bindData", bindData);
+			const auto argumentOffset = i * renderer.batchCount * sizeof(MeshIndirectArgument);
+			list.ResumeRenderPass();
+			list.Native()->ExecuteIndirect(renderer.meshIndirectCommandSignature.Get(), renderer.batchCount, arguments.Native(), argumentOffset, nullptr, 0);
+		}
+
+		list.TransitionBarrier(culledArgs, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		list.TransitionBarrier(visibleInstances, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		list.FlushBarriers();
+	});
+
+	return atlasTag;
+}
\ No newline at end of file
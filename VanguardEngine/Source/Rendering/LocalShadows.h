@@ -0,0 +1,106 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Rendering/ResourceHandle.h>
+#include <Rendering/RenderPipeline.h>
+#include <Rendering/RenderGraphResource.h>
+#include <Rendering/ShaderStructs.h>
+#include <Rendering/CascadedShadows.h>
+#include <Rendering/ReflectionProbes.h>
+#include <Utility/FrameArena.h>
+
+#include <entt/entt.hpp>
+
+#include <array>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+
+class RenderDevice;
+class RenderGraph;
+class RenderPassResources;
+
+// Shadows of point and spot lights, rendered into the tiles of one persistent atlas. Point lights take a row of six cube
+// faces, spot lights a single face. Tiles go to the lights covering the most of the screen, and are kept by lights that
+// fall out of favor until the space is needed, least recently used first. Faces are cached until an instance within the
+// light's range moves, and only a budget of faces renders each frame. Every face is culled and drawn through the
+// multi-view path of the shadow cascades.
+class LocalShadows
+{
+public:
+	// Matches Shadows.hlsli.
+	static constexpr uint32_t tilesPerSide = 6;
+	static constexpr uint32_t maxTiles = tilesPerSide * tilesPerSide;
+	static constexpr uint32_t maxRenderedFaces = 12;  // Upper bound of the per-frame budget.
+	static constexpr uint32_t firstCameraIndex = ReflectionProbes::firstCameraIndex + ReflectionProbes::faceCount;  // A camera per tile.
+	static constexpr uint32_t firstRenderCameraIndex = firstCameraIndex + maxTiles;  // Copies of the faces rendering this frame, contiguous for culling.
+	static constexpr uint32_t cameraCount = maxTiles + maxRenderedFaces;
+	static constexpr float nearPlane = 0.05f;
+
+private:
+	struct LightRecord
+	{
+		uint32_t type;
+		XMFLOAT3 position;
+		XMFLOAT3 direction;
+		float range;
+		float spotCosOuter;
+	};
+
+	struct Shadow
+	{
+		uint32_t firstTile;
+		uint32_t faceCount;
+		uint32_t pendingFaces = 0;  // Mask of the faces that need to render.
+		bool ready = false;  // Every face rendered at least once, shading can use it.
+		size_t lastUsed = 0;  // Frame the light last won its tiles.
+	};
+
+	RenderDevice* device;
+
+	RenderPipelineLayout cullResetLayout;
+	RenderPipelineLayout cullLayout;
+	RenderPipelineLayout depthLayout;
+
+	TextureHandle atlas;
+	uint32_t tileResolution = 0;
+
+	std::unordered_map<entt::entity, LightRecord> lights;  // Lights that can cast shadows.
+	std::unordered_map<entt::entity, Shadow> shadows;
+	std::array<entt::entity, maxTiles> tileOwners;
+	std::array<Camera, maxTiles> tileCameras = {};
+	std::vector<uint32_t> renderTiles;  // Tiles rendering this frame, in camera order.
+	std::vector<BoundingBox> movedBounds;  // Bounds of instances that moved since the last update.
+	std::vector<entt::entity> changedLights;  // Lights whose shadow index changed in the last update.
+	size_t frame = 0;
+	bool invalidated = true;
+
+	void CreateAtlas(uint32_t resolution);
+	std::optional<uint32_t> AllocateTiles(uint32_t faceCount) const;
+	void ReleaseShadow(entt::entity entity);
+	void UpdateCameras(const Shadow& shadow, const LightRecord& light);
+
+public:
+	~LocalShadows();
+
+	void Initialize(RenderDevice* inDevice);
+	// Scene geometry changed in ways bounds can't describe, every face renders again.
+	void Invalidate() noexcept { invalidated = true; }
+	// World bounds an instance moved from or to, faces of the lights whose range overlaps them render again.
+	void InvalidateBounds(const BoundingBox& bounds) { movedBounds.emplace_back(bounds); }
+	// Records the uploaded light, lights changing their shape render their faces again.
+	void UpdateLight(entt::entity entity, const Light& light);
+	void RemoveLight(entt::entity entity);
+	// Assigns the tiles and picks the faces to render this frame, then appends the face cameras, which must land at the
+	// first camera index.
+	void Update(const XMVECTOR& viewPosition, FrameVector<Camera>& cameras);
+	// Lights that gained or lost their shadow in the last update, which have to be uploaded again.
+	const std::vector<entt::entity>& GetChangedLights() const { return changedLights; }
+	// First tile of the light's shadow plus one, zero while the light is unshadowed.
+	uint32_t GetShadowIndex(entt::entity entity) const;
+
+	// Culls and renders the pending faces, returns the shadow atlas.
+	RenderResource Render(RenderGraph& graph, const ShadowInputs& inputs);
+};
\ No newline at end of file
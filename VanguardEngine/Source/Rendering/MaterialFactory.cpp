@@ -3,16 +3,77 @@
 #include <Rendering/MaterialFactory.h>
 #include <Rendering/Device.h>
 #include <Rendering/ResourceManager.h>
-#include <Rendering/ShaderStructs.h>
+#include <Core/ConsoleVariable.h>
 
-MaterialFactory::MaterialFactory(RenderDevice* device, size_t maxMaterials)
+#include <DirectXPackedVector.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+namespace
+{
+	uint32_t GetAddressModeIndex(D3D12_TEXTURE_ADDRESS_MODE mode)
+	{
+		switch (mode)
+		{
+		case D3D12_TEXTURE_ADDRESS_MODE_WRAP: return 0;
+		case D3D12_TEXTURE_ADDRESS_MODE_MIRROR: return 1;
+		default: return 2;  // Clamp.
+		}
+	}
+}
+
+uint32_t MaterialFactory::GetSamplerIndex(const MaterialData& data) const
+{
+	const auto index = (anisotropyLevel * addressModeCount + GetAddressModeIndex(data.addressU)) * addressModeCount + GetAddressModeIndex(data.addressV);
+
+	return samplers[index].bindlessIndex;
+}
+
+PackedMaterialData MaterialFactory::Pack(const MaterialData& data) const
+{
+	const auto PackTexture = [](uint32_t textureIndex, float factor)
+	{
+		VGAssert(textureIndex < (1u << materialTextureBits), "Texture index doesn't fit in the packed material.");
+
+		const auto unorm = static_cast<uint32_t>(std::lround(std::clamp(factor, 0.f, 1.f) * 4095.f));
+
+		return textureIndex | (unorm << materialTextureBits);
+	};
+
+	const auto PackHalves = [](float low, float high)
+	{
+		return static_cast<uint32_t>(PackedVector::XMConvertFloatToHalf(low)) | (static_cast<uint32_t>(PackedVector::XMConvertFloatToHalf(high)) << 16);
+	};
+
+	PackedVector::XMFLOAT3PK emissiveFactor;
+	PackedVector::XMStoreFloat3PK(&emissiveFactor, XMLoadFloat3(&data.emissiveFactor));
+
+	return PackedMaterialData{
+		.baseColor = PackTexture(data.baseColor, 0.f) | (GetSamplerIndex(data) << materialTextureBits),
+		.metallicRoughness = PackTexture(data.metallicRoughness, data.metallicFactor),
+		.normal = PackTexture(data.normal, data.roughnessFactor),
+		.occlusion = PackTexture(data.occlusion, 0.f),
+		.emissive = PackTexture(data.emissive, 0.f),
+		.emissiveFactor = emissiveFactor.v,
+		.baseColorFactor = {
+			PackHalves(data.baseColorFactor.x, data.baseColorFactor.y),
+			PackHalves(data.baseColorFactor.z, data.baseColorFactor.w)
+		}
+	};
+}
+
+MaterialFactory::MaterialFactory(RenderDevice* inDevice, size_t maxMaterials) : device(inDevice)
 {
 	BufferDescription desc{
 		.updateRate = ResourceFrequency::Static,
 		.bindFlags = BindFlag::ShaderResource,
 		.accessFlags = AccessFlag::CPUWrite,
 		.size = maxMaterials,
-		.stride = sizeof(MaterialData)
+		.stride = sizeof(PackedMaterialData)
 	};
 
 	materialBuffer = device->GetResourceManager().Create(desc, VGText("Material table"));
@@ -21,12 +82,119 @@ MaterialFactory::MaterialFactory(RenderDevice* device, size_t maxMaterials)
 	// don't read from uninitialized descriptor indexes.
 
 	std::vector<uint8_t> emptyBytes;
-	emptyBytes.resize(maxMaterials * sizeof(MaterialData), 0);
+	emptyBytes.resize(maxMaterials * sizeof(PackedMaterialData), 0);
 
 	device->GetResourceManager().Write(materialBuffer, emptyBytes);
+
+	constexpr D3D12_TEXTURE_ADDRESS_MODE addressModes[addressModeCount] = { D3D12_TEXTURE_ADDRESS_MODE_WRAP, D3D12_TEXTURE_ADDRESS_MODE_MIRROR, D3D12_TEXTURE_ADDRESS_MODE_CLAMP };
+
+	samplers.reserve(anisotropyLevels * addressModeCount * addressModeCount);
+	for (uint32_t level = 0; level < anisotropyLevels; ++level)
+	{
+		for (const auto addressU : addressModes)
+		{
+			for (const auto addressV : addressModes)
+			{
+				const D3D12_SAMPLER_DESC samplerDesc{
+					.Filter = level > 0 ? D3D12_FILTER_ANISOTROPIC : D3D12_FILTER_MIN_MAG_MIP_LINEAR,
+					.AddressU = addressU,
+					.AddressV = addressV,
+					.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP,
+					.MipLODBias = 0.f,
+					.MaxAnisotropy = 1u << level,
+					.ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER,
+					.BorderColor = {},
+					.MinLOD = 0.f,
+					.MaxLOD = D3D12_FLOAT32_MAX
+				};
+
+				auto& sampler = samplers.emplace_back(device->GetDescriptorAllocator().Allocate(DescriptorType::Sampler));
+				VGAssert(sampler.bindlessIndex < (1u << (32 - materialTextureBits)), "Sampler index doesn't fit in the packed material.");
+
+				device->Native()->CreateSampler(&samplerDesc, sampler);
+			}
+		}
+	}
+
+	CvarCreate("materialAnisotropy", "Anisotropic filtering level of material textures, 1=disabled, up to 16", 16);
 }
 
 size_t MaterialFactory::Create()
 {
+	materials.emplace_back();
+	features.emplace_back(0);
+
 	return count++;
+}
+
+void MaterialFactory::Write(size_t index, const MaterialData& data)
+{
+	VGAssert(index < count, "Writing material that hasn't been created.");
+
+	materials[index] = data;
+	dirtyMaterials.emplace_back(index);
+
+	// Texture index 0 is reserved for missing textures.
+	uint32_t materialFeatures = 0;
+	if (data.baseColor > 0) materialFeatures |= MaterialFeatureBaseColor;
+	if (data.metallicRoughness > 0) materialFeatures |= MaterialFeatureMetallicRoughness;
+	if (data.normal > 0) materialFeatures |= MaterialFeatureNormal;
+	if (data.occlusion > 0) materialFeatures |= MaterialFeatureOcclusion;
+	if (data.emissive > 0) materialFeatures |= MaterialFeatureEmissive;
+	if (data.blend) materialFeatures |= MaterialFeatureBlend;
+
+	if (features[index] != materialFeatures)
+	{
+		features[index] = materialFeatures;
+		++revision;
+	}
+}
+
+void MaterialFactory::WriteTexture(size_t index, size_t offset, uint32_t textureIndex)
+{
+	VGAssert(index < count, "Writing material that hasn't been created.");
+	VGAssert(offset + sizeof(uint32_t) <= offsetof(MaterialData, emissiveFactor), "Texture offset is outside of the material's textures.");
+	VGAssert(textureIndex > 0, "Patched textures must stay present.");
+
+	std::memcpy(reinterpret_cast<std::byte*>(&materials[index]) + offset, &textureIndex, sizeof(textureIndex));
+	dirtyMaterials.emplace_back(index);
+}
+
+void MaterialFactory::Flush()
+{
+	const auto anisotropy = static_cast<uint32_t>(std::clamp(*CvarGet("materialAnisotropy", int), 1, 16));
+	const auto level = std::min(static_cast<uint32_t>(std::bit_width(anisotropy)) - 1, anisotropyLevels - 1);
+	if (level != anisotropyLevel && count > 0)
+	{
+		dirtyMaterials.emplace_back(0);
+		dirtyMaterials.emplace_back(count - 1);
+	}
+
+	anisotropyLevel = level;
+
+	if (dirtyMaterials.empty())
+	{
+		return;
+	}
+
+	VGScopedCPUStat("Flush Materials");
+
+	// Materials are written in bursts as models finish loading, so the range is usually close to the dirty set.
+	const auto [first, last] = std::minmax_element(dirtyMaterials.begin(), dirtyMaterials.end());
+	const auto begin = *first;
+	const auto end = *last + 1;
+
+	auto* packed = static_cast<PackedMaterialData*>(device->GetResourceManager().ReserveWrite(materialBuffer, (end - begin) * sizeof(PackedMaterialData), begin * sizeof(PackedMaterialData)));
+	if (!packed)
+	{
+		VGLogError(logRendering, "Failed to upload materials, retrying next frame.");
+		return;
+	}
+
+	dirtyMaterials.clear();
+
+	for (auto i = begin; i < end; ++i)
+	{
+		packed[i - begin] = Pack(materials[i]);
+	}
 }
\ No newline at end of file
@@ -4,6 +4,10 @@
 
 #include <Rendering/Base.h>
 #include <Rendering/ResourceHandle.h>
+#include <Rendering/ShaderStructs.h>
+#include <Rendering/DescriptorHeap.h>
+
+#include <vector>
 
 class RenderDevice;
 
@@ -13,10 +17,37 @@ public:
 	BufferHandle materialBuffer;
 
 private:
+	RenderDevice* device;
 	size_t count = 0;
 
+	std::vector<MaterialData> materials;  // CPU copy of each material, packed when uploaded.
+	std::vector<size_t> dirtyMaterials;  // Written since the last flush, may contain duplicates.
+
+	std::vector<uint32_t> features;  // CPU copy of each material's feature bits, materials which haven't loaded have none.
+	size_t revision = 0;  // Stepped whenever a material's features change.
+
+	// Every pair of address modes at every anisotropy level, created up front in the sampler heap. Changing the global
+	// anisotropy only repacks the materials with other sampler indices, without touching pipelines or descriptors.
+	static constexpr uint32_t addressModeCount = 3;  // Wrap, mirror and clamp.
+	static constexpr uint32_t anisotropyLevels = 5;  // 1, 2, 4, 8 and 16.
+	std::vector<DescriptorHandle> samplers;
+	uint32_t anisotropyLevel = anisotropyLevels - 1;
+
+	uint32_t GetSamplerIndex(const MaterialData& data) const;
+	PackedMaterialData Pack(const MaterialData& data) const;
+
 public:
-	MaterialFactory(RenderDevice* device, size_t maxMaterials);
+	MaterialFactory(RenderDevice* inDevice, size_t maxMaterials);
 
 	size_t Create();
+	// Updates the material and its feature bits, uploaded on the next flush.
+	void Write(size_t index, const MaterialData& data);
+	// Patches a single texture index, at its offset within MaterialData. The texture must stay present, features are unchanged.
+	void WriteTexture(size_t index, size_t offset, uint32_t textureIndex);
+	// Uploads the materials written this frame in a single copy, covering the range between the first and last of them.
+	// Every material is uploaded when the anisotropy changes.
+	void Flush();
+
+	uint32_t GetFeatures(size_t index) const noexcept { return index < features.size() ? features[index] : 0; }
+	auto GetRevision() const noexcept { return revision; }
 };
\ No newline at end of file
@@ -3,9 +3,64 @@
 #include <Rendering/MeshFactory.h>
 #include <Rendering/Device.h>
 
+#include <meshoptimizer.h>
+#include <DirectXPackedVector.h>
+
 #include <string>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <array>
+#include <string_view>
+
+namespace
+{
+	uint16_t QuantizeUnorm16(float value)
+	{
+		return static_cast<uint16_t>(std::round(std::clamp(value, 0.f, 1.f) * 65535.f));
+	}
+
+	int16_t QuantizeSnorm16(float value)
+	{
+		return static_cast<int16_t>(std::round(std::clamp(value, -1.f, 1.f) * 32767.f));
+	}
+
+	uint32_t QuantizeUnorm15(float value)
+	{
+		return static_cast<uint32_t>(std::round(std::clamp(value, 0.f, 1.f) * 32767.f));
+	}
+
+	// Maps a unit direction onto the [-1, 1] square, see DecodeOctahedral in VertexAssembly.hlsli.
+	XMFLOAT2 EncodeOctahedral(const XMFLOAT3& direction)
+	{
+		const auto length = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+		if (length <= 0.f)
+			return { 0.f, 0.f };
+
+		XMFLOAT2 result{ direction.x / length, direction.y / length };
+		if (direction.z < 0.f)
+		{
+			const auto x = result.x;
+			result.x = (1.f - std::abs(result.y)) * (x >= 0.f ? 1.f : -1.f);
+			result.y = (1.f - std::abs(x)) * (result.y >= 0.f ? 1.f : -1.f);
+		}
+
+		return result;
+	}
+
+	const std::array<std::wstring_view, 7> bufferNames = {
+		VGText("Vertex position buffer"),
+		VGText("Vertex extra attributes buffer"),
+		VGText("Index buffer"),
+		VGText("Meshlet buffer"),
+		VGText("Meshlet vertex buffer"),
+		VGText("Meshlet triangle buffer"),
+		VGText("Vertex skin buffer")
+	};
+}
 
-uint32_t MeshFactory::SearchVertexChannel(const std::string& name)
+uint32_t MeshFactory::SearchVertexChannel(const std::string& name) const
 {
 	if (name.find("POSITION") != std::string::npos) return 0;
 	if (name.find("NORMAL") != std::string::npos) return 1;
@@ -16,30 +71,652 @@ uint32_t MeshFactory::SearchVertexChannel(const std::string& name)
 	return std::numeric_limits<uint32_t>::max();
 }
 
-PrimitiveOffset MeshFactory::AllocateMesh(const std::vector<uint8_t>& vertexPositionData, const std::vector<uint8_t>& vertexExtraData, const std::vector<uint8_t>& indexData)
+uint32_t MeshFactory::GetQuantizedChannels(const PrimitiveAssembly& assembly) const
+{
+	uint32_t quantizedChannels = 0;
+	for (const auto& [name, stream] : assembly.vertexStream)
+	{
+		const auto channel = SearchVertexChannel(name);
+		const auto size = assembly.GetAttributeSize(name);
+
+		switch (channel)
+		{
+		case vertexChannelPosition:
+		case vertexChannelNormal:
+			if (size == sizeof(XMFLOAT3)) quantizedChannels |= 1 << channel;
+			break;
+		case vertexChannelTexcoord:
+			if (size == sizeof(XMFLOAT2)) quantizedChannels |= 1 << channel;
+			break;
+		case vertexChannelTangent:
+			if (size == sizeof(XMFLOAT4)) quantizedChannels |= 1 << channel;  // Needs the bitangent sign.
+			break;
+		}
+	}
+
+	return quantizedChannels;
+}
+
+size_t MeshFactory::GetEncodedAttributeSize(uint32_t channel, size_t attributeSize, uint32_t quantizedChannels) const
+{
+	// Bitangents are always derived from the normal and the signed tangent. Colors are widened so that every layout of the
+	// same channels has the same strides.
+	if (channel == vertexChannelBitangent)
+		return 0;
+	if (channel == vertexChannelColor)
+		return sizeof(XMFLOAT4);
+
+	if (!(quantizedChannels & (1 << channel)))
+		return attributeSize;
+
+	switch (channel)
+	{
+	case vertexChannelPosition: return sizeof(uint16_t) * 4;  // Padded for aligned loads.
+	case vertexChannelNormal: return sizeof(int16_t) * 2;
+	case vertexChannelTexcoord: return sizeof(uint16_t) * 2;
+	case vertexChannelTangent: return sizeof(uint32_t);
+	default: return attributeSize;
+	}
+}
+
+void MeshFactory::EncodeVertexAttribute(uint32_t channel, const VertexMetadata& metadata, const uint8_t* source, size_t sourceSize, uint8_t* target) const
+{
+	if (channel == vertexChannelColor && sourceSize < sizeof(XMFLOAT4))
+	{
+		XMFLOAT4 color{ 0.f, 0.f, 0.f, 1.f };
+		std::memcpy(&color, source, sourceSize);
+		std::memcpy(target, &color, sizeof(color));
+
+		return;
+	}
+
+	if (!(metadata.quantizedChannels & (1 << channel)))
+	{
+		std::memcpy(target, source, sourceSize);
+
+		return;
+	}
+
+	switch (channel)
+	{
+	case vertexChannelPosition:
+	{
+		XMFLOAT3 position;
+		std::memcpy(&position, source, sizeof(position));
+		const uint16_t values[4] = {
+			QuantizeUnorm16((position.x - metadata.positionMin.x) / metadata.positionExtent.x),
+			QuantizeUnorm16((position.y - metadata.positionMin.y) / metadata.positionExtent.y),
+			QuantizeUnorm16((position.z - metadata.positionMin.z) / metadata.positionExtent.z),
+			0
+		};
+		std::memcpy(target, values, sizeof(values));
+		break;
+	}
+	case vertexChannelNormal:
+	{
+		XMFLOAT3 normal;
+		std::memcpy(&normal, source, sizeof(normal));
+		const auto encoded = EncodeOctahedral(normal);
+		const int16_t values[2] = { QuantizeSnorm16(encoded.x), QuantizeSnorm16(encoded.y) };
+		std::memcpy(target, values, sizeof(values));
+		break;
+	}
+	case vertexChannelTexcoord:
+	{
+		XMFLOAT2 texcoord;
+		std::memcpy(&texcoord, source, sizeof(texcoord));
+		const PackedVector::HALF values[2] = { PackedVector::XMConvertFloatToHalf(texcoord.x), PackedVector::XMConvertFloatToHalf(texcoord.y) };
+		std::memcpy(target, values, sizeof(values));
+		break;
+	}
+	case vertexChannelTangent:
+	{
+		XMFLOAT4 tangent;
+		std::memcpy(&tangent, source, sizeof(tangent));
+		const auto encoded = EncodeOctahedral({ tangent.x, tangent.y, tangent.z });
+		const uint32_t value = QuantizeUnorm15(encoded.x * 0.5f + 0.5f) | (QuantizeUnorm15(encoded.y * 0.5f + 0.5f) << 15) | (tangent.w < 0.f ? 1u << 31 : 0u);
+		std::memcpy(target, &value, sizeof(value));
+		break;
+	}
+	}
+}
+
+void MeshFactory::EncodeSkinInfluences(const XMFLOAT4& joints, const XMFLOAT4& weights, uint8_t* target) const
+{
+	const auto weightSum = weights.x + weights.y + weights.z + weights.w;
+	const auto weightScale = weightSum > 0.f ? 1.f / weightSum : 0.f;
+
+	const uint16_t values[8] = {
+		static_cast<uint16_t>(joints.x),
+		static_cast<uint16_t>(joints.y),
+		static_cast<uint16_t>(joints.z),
+		static_cast<uint16_t>(joints.w),
+		QuantizeUnorm16(weights.x * weightScale),
+		QuantizeUnorm16(weights.y * weightScale),
+		QuantizeUnorm16(weights.z * weightScale),
+		QuantizeUnorm16(weights.w * weightScale)
+	};
+
+	std::memcpy(target, values, sizeof(values));
+}
+
+size_t MeshFactory::BuildMeshlets(const PrimitiveAssembly& assembly, size_t indexSize, std::vector<uint8_t>& indexData, MeshletStreams& meshletData) const
+{
+	VGScopedCPUStat("Build Meshlets");
+
+	const auto* positions = reinterpret_cast<const float*>(assembly.GetAttributeData("POSITION"));
+	const auto vertexCount = assembly.GetAttributeCount("POSITION");
+	const auto positionStride = assembly.GetAttributeSize("POSITION");
+
+	// Meshoptimizer's normal cones expect counter-clockwise front faces, ours are clockwise.
+	std::vector<uint32_t> indices{ assembly.indexStream.begin(), assembly.indexStream.end() };
+	for (size_t i = 2; i < indices.size(); i += 3)
+	{
+		std::swap(indices[i - 1], indices[i]);
+	}
+
+	const auto maxMeshlets = meshopt_buildMeshletsBound(indices.size(), meshletMaxVertices, meshletMaxTriangles);
+	std::vector<meshopt_Meshlet> localMeshlets(maxMeshlets);
+	std::vector<uint32_t> meshletVertices(maxMeshlets * meshletMaxVertices);
+	std::vector<uint8_t> meshletTriangles(maxMeshlets * meshletMaxTriangles * 3);
+	const auto meshletCount = meshopt_buildMeshlets(localMeshlets.data(), meshletVertices.data(), meshletTriangles.data(), indices.data(), indices.size(),
+		positions, vertexCount, positionStride, meshletMaxVertices, meshletMaxTriangles, meshletConeWeight);
+
+	const auto indexStart = indexData.size();
+	indexData.resize(indexStart + indices.size() * indexSize);
+	size_t written = 0;
+
+	const auto writeIndex = [&](uint32_t value)
+	{
+		if (indexSize == sizeof(uint16_t))
+			reinterpret_cast<uint16_t*>(indexData.data() + indexStart)[written++] = static_cast<uint16_t>(value);
+		else
+			reinterpret_cast<uint32_t*>(indexData.data() + indexStart)[written++] = value;
+	};
+
+	meshletData.meshlets.reserve(meshletData.meshlets.size() + meshletCount);
+	for (size_t i = 0; i < meshletCount; ++i)
+	{
+		const auto& meshlet = localMeshlets[i];
+		const auto bounds = meshopt_computeMeshletBounds(&meshletVertices[meshlet.vertex_offset], &meshletTriangles[meshlet.triangle_offset],
+			meshlet.triangle_count, positions, vertexCount, positionStride);
+
+		meshletData.meshlets.emplace_back(MeshletData{
+			.center = { bounds.center[0], bounds.center[1], bounds.center[2] },
+			.radius = bounds.radius,
+			.coneApex = { bounds.cone_apex[0], bounds.cone_apex[1], bounds.cone_apex[2] },
+			.coneCutoff = bounds.cone_cutoff,
+			.coneAxis = { bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2] },
+			.indexOffset = static_cast<uint32_t>(written),  // Relative to the subset's index view.
+			.indexCount = meshlet.triangle_count * 3,
+			.vertexOffset = static_cast<uint32_t>(meshletData.vertices.size()),
+			.vertexCount = meshlet.vertex_count,
+			.triangleOffset = static_cast<uint32_t>(meshletData.triangles.size())
+		});
+
+		meshletData.vertices.insert(meshletData.vertices.end(), meshletVertices.begin() + meshlet.vertex_offset, meshletVertices.begin() + meshlet.vertex_offset + meshlet.vertex_count);
+
+		// Restore clockwise winding.
+		for (size_t j = 0; j < meshlet.triangle_count; ++j)
+		{
+			const auto* triangle = &meshletTriangles[meshlet.triangle_offset + j * 3];
+			writeIndex(meshletVertices[meshlet.vertex_offset + triangle[0]]);
+			writeIndex(meshletVertices[meshlet.vertex_offset + triangle[2]]);
+			writeIndex(meshletVertices[meshlet.vertex_offset + triangle[1]]);
+
+			meshletData.triangles.emplace_back(triangle[0] | (triangle[2] << 8) | (triangle[1] << 16));
+		}
+	}
+
+	indexData.resize(indexStart + written * indexSize);
+
+	return written;
+}
+
+void MeshFactory::BuildLods(const PrimitiveAssembly& assembly, size_t indexSize, std::vector<uint8_t>& indexData, MeshComponent::Subset& subset) const
+{
+	VGScopedCPUStat("Build Mesh LODs");
+
+	const auto* positions = reinterpret_cast<const float*>(assembly.GetAttributeData("POSITION"));
+	const auto vertexCount = assembly.GetAttributeCount("POSITION");
+	const auto positionStride = assembly.GetAttributeSize("POSITION");
+
+	subset.lodCount = 1;
+	subset.lods[0] = { 0, subset.indices, 0.f };
+
+	// Converts the relative errors of the simplifier into object space.
+	const auto errorScale = meshopt_simplifyScale(positions, vertexCount, positionStride);
+
+	// Each level simplifies the previous one, so the levels stay nested and the error only grows along the chain.
+	std::vector<uint32_t> source{ assembly.indexStream.begin(), assembly.indexStream.end() };
+	std::vector<uint32_t> simplified(source.size());
+	float error = 0.f;
+
+	while (subset.lodCount < maxMeshLods && source.size() / 3 > lodMinTriangles)
+	{
+		const auto targetCount = static_cast<size_t>(source.size() * lodReduction) / 3 * 3;
+		float levelError = 0.f;
+		const auto count = meshopt_simplify(simplified.data(), source.data(), source.size(), positions, vertexCount, positionStride, targetCount,
+			lodMaxError, &levelError);
+
+		// Stuck on the error bound, another level wouldn't draw meaningfully fewer triangles.
+		if (count == 0 || count > source.size() * (lodReduction + 1.f) * 0.5f)
+			break;
+
+		simplified.resize(count);
+		meshopt_optimizeVertexCache(simplified.data(), simplified.data(), count, vertexCount);
+
+		// Level index views start aligned for either format.
+		const auto indexStart = AlignedSize(indexData.size(), sizeof(uint32_t));
+		indexData.resize(indexStart + count * indexSize);
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (indexSize == sizeof(uint16_t))
+				reinterpret_cast<uint16_t*>(indexData.data() + indexStart)[i] = static_cast<uint16_t>(simplified[i]);
+			else
+				reinterpret_cast<uint32_t*>(indexData.data() + indexStart)[i] = simplified[i];
+		}
+
+		error = std::max(error, levelError * errorScale);
+		subset.lods[subset.lodCount++] = { indexStart - subset.localOffset.index, count, error };
+
+		source.swap(simplified);
+		simplified.resize(source.size());
+	}
+}
+
+void MeshFactory::ComputeBounds(const PrimitiveAssembly& assembly, MeshComponent::Subset& subset) const
+{
+	const auto* positions = reinterpret_cast<const XMFLOAT3*>(assembly.GetAttributeData("POSITION"));
+	const auto vertexCount = assembly.GetAttributeCount("POSITION");
+	if (vertexCount == 0)
+		return;
+
+	const auto component = [positions](size_t vertex, int axis)
+	{
+		return axis == 0 ? positions[vertex].x : axis == 1 ? positions[vertex].y : positions[vertex].z;
+	};
+
+	// Extreme vertices along each axis, giving the box and seeding the sphere.
+	std::array<size_t, 3> minVertex = {};
+	std::array<size_t, 3> maxVertex = {};
+	for (size_t i = 1; i < vertexCount; ++i)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (component(i, axis) < component(minVertex[axis], axis))
+				minVertex[axis] = i;
+			if (component(i, axis) > component(maxVertex[axis], axis))
+				maxVertex[axis] = i;
+		}
+	}
+
+	subset.boundsMin = { positions[minVertex[0]].x, positions[minVertex[1]].y, positions[minVertex[2]].z };
+	subset.boundsMax = { positions[maxVertex[0]].x, positions[maxVertex[1]].y, positions[maxVertex[2]].z };
+
+	// Ritter's sphere, seeded by the most distant pair of extreme vertices and grown to enclose every vertex.
+	int seedAxis = 0;
+	float seedDistance = 0.f;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const auto distance = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&positions[maxVertex[axis]]) - XMLoadFloat3(&positions[minVertex[axis]])));
+		if (distance > seedDistance)
+		{
+			seedAxis = axis;
+			seedDistance = distance;
+		}
+	}
+
+	auto center = (XMLoadFloat3(&positions[minVertex[seedAxis]]) + XMLoadFloat3(&positions[maxVertex[seedAxis]])) * 0.5f;
+	auto radius = std::sqrt(seedDistance) * 0.5f;
+
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		const auto offset = XMLoadFloat3(&positions[i]) - center;
+		const auto distance = XMVectorGetX(XMVector3Length(offset));
+		if (distance > radius)
+		{
+			const auto grownRadius = (radius + distance) * 0.5f;
+			center += offset * ((grownRadius - radius) / distance);
+			radius = grownRadius;
+		}
+	}
+
+	// Ritter's sphere is within a few percent of the minimum, but boxy subsets can be tighter around the box's center.
+	const auto boxCenter = (XMLoadFloat3(&subset.boundsMin) + XMLoadFloat3(&subset.boundsMax)) * 0.5f;
+	float boxRadius = 0.f;
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		boxRadius = std::max(boxRadius, XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&positions[i]) - boxCenter)));
+	}
+
+	boxRadius = std::sqrt(boxRadius);
+	if (boxRadius < radius)
+	{
+		center = boxCenter;
+		radius = boxRadius;
+	}
+
+	XMStoreFloat3(&subset.boundingSphereCenter, center);
+	subset.boundingSphereRadius = radius;
+}
+
+BufferHandle& MeshFactory::GetStreamBuffer(size_t stream)
+{
+	switch (stream)
+	{
+	case meshStreamPosition: return vertexPositionBuffer;
+	case meshStreamExtra: return vertexExtraBuffer;
+	case meshStreamIndex: return indexBuffer;
+	case meshStreamMeshlet: return meshletBuffer;
+	case meshStreamMeshletVertex: return meshletVertexBuffer;
+	case meshStreamMeshletTriangle: return meshletTriangleBuffer;
+	default: return vertexSkinBuffer;
+	}
+}
+
+PrimitiveOffset MeshFactory::GetPrimitiveOffset(const MeshAllocation& allocation) const
+{
+	// Vertex and index offsets are in bytes, the buffers are indexed by 32 bit chunks.
+	return PrimitiveOffset{
+		.index = allocation.offsets[meshStreamIndex] * sizeof(uint32_t),
+		.position = allocation.offsets[meshStreamPosition] * sizeof(uint32_t),
+		.extra = allocation.offsets[meshStreamExtra] * sizeof(uint32_t),
+		.meshlet = allocation.offsets[meshStreamMeshlet],
+		.skin = allocation.offsets[meshStreamSkin] * sizeof(uint32_t)
+	};
+}
+
+void MeshFactory::ReleaseAllocation(const MeshAllocation& allocation)
+{
+	for (size_t i = 0; i < meshStreamCount; ++i)
+	{
+		allocators[i].Free(allocation.offsets[i], allocation.counts[i]);
+		allocatedCounts[i] -= allocation.counts[i];
+	}
+}
+
+void MeshFactory::WriteMeshlets(const MeshAllocation& allocation)
+{
+	// Meshlets are the only data that needs patching, everything else is copied straight into upload memory.
+	std::vector<MeshletData> meshlets = allocation.meshlets;
+	for (auto& meshlet : meshlets)
+	{
+		meshlet.vertexOffset += allocation.offsets[meshStreamMeshletVertex];
+		meshlet.triangleOffset += allocation.offsets[meshStreamMeshletTriangle];
+	}
+
+	device->GetResourceManager().Write(meshletBuffer, meshlets, allocation.offsets[meshStreamMeshlet] * sizeof(MeshletData));
+}
+
+bool MeshFactory::AllocateRanges(MeshAllocation& allocation)
+{
+	for (size_t i = 0; i < meshStreamCount; ++i)
+	{
+		// Empty streams still take a slot, so that every mesh has a unique index offset.
+		allocation.counts[i] = std::max(allocation.counts[i], 1u);
+
+		const auto offset = allocators[i].Allocate(allocation.counts[i]);
+		if (!offset)
+		{
+			for (size_t j = 0; j < i; ++j)
+			{
+				allocators[j].Free(allocation.offsets[j], allocation.counts[j]);
+			}
+
+			return false;
+		}
+
+		allocation.offsets[i] = *offset;
+	}
+
+	for (size_t i = 0; i < meshStreamCount; ++i)
+	{
+		allocatedCounts[i] += allocation.counts[i];
+	}
+
+	return true;
+}
+
+std::optional<PrimitiveOffset> MeshFactory::AllocateMesh(const MeshDataView& data)
 {
-	device->GetResourceManager().Write(vertexPositionBuffer, vertexPositionData, vertexPositionOffset);
-	device->GetResourceManager().Write(vertexExtraBuffer, vertexExtraData, vertexExtrasOffset);
-	device->GetResourceManager().Write(indexBuffer, indexData, indexOffset);
+	VGAssert(data.vertexPositionData.size() % sizeof(uint32_t) == 0 && data.vertexExtraData.size() % sizeof(uint32_t) == 0 && data.indexData.size() % sizeof(uint32_t) == 0,
+		"Mesh data must be made of 32 bit chunks.");
+
+	MeshAllocation allocation;
+	allocation.counts = {
+		static_cast<uint32_t>(data.vertexPositionData.size() / sizeof(uint32_t)),
+		static_cast<uint32_t>(data.vertexExtraData.size() / sizeof(uint32_t)),
+		static_cast<uint32_t>(data.indexData.size() / sizeof(uint32_t)),
+		static_cast<uint32_t>(data.meshlets.size()),
+		static_cast<uint32_t>(data.meshletVertices.size()),
+		static_cast<uint32_t>(data.meshletTriangles.size()),
+		static_cast<uint32_t>(data.vertexSkinData.size() / sizeof(uint32_t))
+	};
+
+	if (!AllocateRanges(allocation))
+	{
+		return std::nullopt;
+	}
+
+	allocation.meshlets.assign(data.meshlets.begin(), data.meshlets.end());
+
+	device->GetResourceManager().Write(vertexPositionBuffer, data.vertexPositionData, allocation.offsets[meshStreamPosition] * sizeof(uint32_t));
+	device->GetResourceManager().Write(vertexExtraBuffer, data.vertexExtraData, allocation.offsets[meshStreamExtra] * sizeof(uint32_t));
+	device->GetResourceManager().Write(indexBuffer, data.indexData, allocation.offsets[meshStreamIndex] * sizeof(uint32_t));
+	device->GetResourceManager().Write(meshletVertexBuffer, data.meshletVertices, allocation.offsets[meshStreamMeshletVertex] * sizeof(uint32_t));
+	device->GetResourceManager().Write(meshletTriangleBuffer, data.meshletTriangles, allocation.offsets[meshStreamMeshletTriangle] * sizeof(uint32_t));
+	device->GetResourceManager().Write(vertexSkinBuffer, data.vertexSkinData, allocation.offsets[meshStreamSkin] * sizeof(uint32_t));
+	WriteMeshlets(allocation);
 
 	device->GetDirectList().TransitionBarrier(vertexPositionBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	device->GetDirectList().TransitionBarrier(vertexExtraBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
-	device->GetDirectList().TransitionBarrier(indexBuffer, D3D12_RESOURCE_STATE_INDEX_BUFFER);
+	device->GetDirectList().TransitionBarrier(meshletBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	device->GetDirectList().TransitionBarrier(meshletVertexBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	device->GetDirectList().TransitionBarrier(meshletTriangleBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	device->GetDirectList().TransitionBarrier(vertexSkinBuffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+	device->GetDirectList().TransitionBarrier(indexBuffer, D3D12_RESOURCE_STATE_INDEX_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
 	device->GetDirectList().FlushBarriers();
 
-	auto result = PrimitiveOffset{
-		.index = indexOffset,
-		.position = vertexPositionOffset,
-		.extra = vertexExtrasOffset
-	};
+	const auto result = GetPrimitiveOffset(allocation);
+	allocations[result.index] = std::move(allocation);
+
+	return result;
+}
 
-	vertexPositionOffset += vertexPositionData.size();
-	vertexExtrasOffset += vertexExtraData.size();
-	indexOffset += indexData.size();
+bool MeshFactory::IsFragmented() const
+{
+	for (size_t i = 0; i < meshStreamCount; ++i)
+	{
+		const auto size = allocators[i].Size();
+		if (size > capacities[i] / 2 && size - allocatedCounts[i] > size / 4)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+MeshComponent MeshFactory::UploadMesh(MeshComponent component, const MeshDataView& data, const std::vector<size_t>& materials)
+{
+	VGScopedCPUStat("Upload Mesh");
+
+	for (auto& subset : component.subsets)
+	{
+		subset.materialIndex = subset.materialIndex < materials.size() ? materials[subset.materialIndex] : 0;
+	}
+
+	const auto offset = AllocateMesh(data);
+	if (!offset)
+	{
+		VGLogError(logRendering, "Mesh buffers are out of space, failed to upload mesh.");
+		component.subsets.clear();
+
+		return component;
+	}
+
+	component.globalOffset = *offset;
+
+	return component;
+}
+
+void MeshFactory::FreeAllocation(size_t indexOffset)
+{
+	const auto iter = allocations.find(indexOffset);
+	if (iter == allocations.end())
+	{
+		VGLogWarning(logRendering, "Attempted to free a mesh which isn't allocated.");
+
+		return;
+	}
+
+	pendingFrees.emplace_back(device->GetFrameNumber(), std::move(iter->second));
+	allocations.erase(iter);
+}
+
+void MeshFactory::FreeMesh(const MeshComponent& component)
+{
+	FreeAllocation(component.globalOffset.index);
+}
+
+std::optional<PrimitiveOffset> MeshFactory::AllocateVertices(size_t positionSize, size_t extraSize)
+{
+	VGAssert(positionSize % sizeof(uint32_t) == 0 && extraSize % sizeof(uint32_t) == 0, "Vertex data must be made of 32 bit chunks.");
+
+	// The other streams take their single slot, which gives the vertices their own index offset to be keyed by.
+	MeshAllocation allocation;
+	allocation.counts[meshStreamPosition] = static_cast<uint32_t>(positionSize / sizeof(uint32_t));
+	allocation.counts[meshStreamExtra] = static_cast<uint32_t>(extraSize / sizeof(uint32_t));
+
+	if (!AllocateRanges(allocation))
+	{
+		return std::nullopt;
+	}
+
+	const auto result = GetPrimitiveOffset(allocation);
+	allocations[result.index] = std::move(allocation);
 
 	return result;
 }
 
+void MeshFactory::FreeVertices(const PrimitiveOffset& offset)
+{
+	FreeAllocation(offset.index);
+}
+
+void MeshFactory::Update(entt::registry& registry)
+{
+	VGScopedCPUStat("Mesh Factory Update");
+
+	const auto frame = device->GetFrameNumber();
+	std::erase_if(pendingFrees, [this, frame](const auto& pending)
+	{
+		if (frame < pending.first + RenderDevice::frameCount)
+		{
+			return false;
+		}
+
+		ReleaseAllocation(pending.second);
+
+		return true;
+	});
+
+	if (IsFragmented())
+	{
+		Defragment(registry);
+	}
+}
+
+void MeshFactory::Defragment(entt::registry& registry)
+{
+	VGScopedCPUStat("Defragment Meshes");
+
+	auto& resourceManager = device->GetResourceManager();
+	auto& list = device->GetDirectList();
+
+	// Compacted into new buffers instead of in place, since frames in flight are still drawing from the old ones.
+	std::array<BufferHandle, meshStreamCount> previousBuffers;
+	for (size_t i = 0; i < meshStreamCount; ++i)
+	{
+		auto& buffer = GetStreamBuffer(i);
+		previousBuffers[i] = buffer;
+		buffer = resourceManager.Create(resourceManager.Get(previousBuffers[i]).description, bufferNames[i]);
+
+		allocators[i] = FreeListAllocator{ capacities[i] };
+		allocatedCounts[i] = 0;
+	}
+
+	// Ranges waiting to retire are only referenced by the old buffers.
+	pendingFrees.clear();
+
+	std::unordered_map<size_t, MeshAllocation> compacted;
+	std::unordered_map<size_t, PrimitiveOffset> movedOffsets;  // Previous global index offset to the new offsets.
+	compacted.reserve(allocations.size());
+	movedOffsets.reserve(allocations.size());
+
+	for (auto& [previousIndex, allocation] : allocations)
+	{
+		const auto previousOffsets = allocation.offsets;
+
+		for (size_t i = 0; i < meshStreamCount; ++i)
+		{
+			allocation.offsets[i] = *allocators[i].Allocate(allocation.counts[i]);  // Packing can't run out of space.
+			allocatedCounts[i] += allocation.counts[i];
+
+			// Meshlets are rewritten from the CPU copy instead, with their new stream offsets.
+			if (i != meshStreamMeshlet)
+			{
+				const auto stride = resourceManager.Get(previousBuffers[i]).description.stride;
+				list.Copy(GetStreamBuffer(i), allocation.offsets[i] * stride, previousBuffers[i], previousOffsets[i] * stride, allocation.counts[i] * stride);
+			}
+		}
+
+		WriteMeshlets(allocation);
+
+		const auto offset = GetPrimitiveOffset(allocation);
+		movedOffsets[previousIndex] = offset;
+		compacted[offset.index] = std::move(allocation);
+	}
+
+	allocations = std::move(compacted);
+
+	for (size_t i = 0; i < meshStreamCount; ++i)
+	{
+		const auto state = i == meshStreamIndex ? D3D12_RESOURCE_STATE_INDEX_BUFFER | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE : D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE;
+		list.TransitionBarrier(GetStreamBuffer(i), state);
+
+		resourceManager.AddFrameResource(device->GetFrameIndex(), previousBuffers[i]);
+	}
+
+	list.FlushBarriers();
+
+	// Patching notifies the renderer, which rebuilds the records of every moved mesh.
+	for (const auto entity : registry.view<MeshComponent>())
+	{
+		const auto iter = movedOffsets.find(registry.get<MeshComponent>(entity).globalOffset.index);
+		if (iter != movedOffsets.end())
+		{
+			registry.patch<MeshComponent>(entity, [&](auto& mesh) { mesh.globalOffset = iter->second; });
+		}
+	}
+
+	relocations = std::move(movedOffsets);
+	++revision;
+
+	VGLog(logRendering, "Defragmented mesh buffers, {} meshes.", allocations.size());
+}
+
+std::optional<PrimitiveOffset> MeshFactory::GetRelocation(size_t previousIndexOffset) const
+{
+	if (const auto iter = relocations.find(previousIndexOffset); iter != relocations.end())
+	{
+		return iter->second;
+	}
+
+	return std::nullopt;
+}
+
 MeshFactory::MeshFactory(RenderDevice* inDevice, size_t maxVertices, size_t maxIndices)
 {
 	VGScopedCPUStat("Create Mesh Factory");
@@ -50,20 +727,56 @@ MeshFactory::MeshFactory(RenderDevice* inDevice, size_t maxVertices, size_t maxI
 	vertexDescription.size = maxVertices;
 	vertexDescription.stride = sizeof(float);  // Indexed by 32 bit chunks (floats, usually).
 	vertexDescription.updateRate = ResourceFrequency::Static;
-	vertexDescription.bindFlags = BindFlag::ShaderResource;
-	vertexDescription.accessFlags = AccessFlag::CPUWrite;
-	vertexPositionBuffer = device->GetResourceManager().Create(vertexDescription, VGText("Vertex position buffer"));
+	vertexDescription.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess;  // The skinning pass writes skinned vertices.
+	vertexDescription.accessFlags = AccessFlag::CPUWrite | AccessFlag::GPUWrite;
+	vertexDescription.format = DXGI_FORMAT_R32_TYPELESS;  // Byte address buffers.
+	vertexPositionBuffer = device->GetResourceManager().Create(vertexDescription, bufferNames[meshStreamPosition]);
 
 	vertexDescription.size *= 8;  // One attribute per element, so increase the size a bit.
-	vertexExtraBuffer = device->GetResourceManager().Create(vertexDescription, VGText("Vertex extra attributes buffer"));
+	vertexExtraBuffer = device->GetResourceManager().Create(vertexDescription, bufferNames[meshStreamExtra]);
+
+	// Sized like the position buffer, skinned vertices are a small part of the scene.
+	BufferDescription skinDescription{};
+	skinDescription.size = maxVertices;
+	skinDescription.stride = sizeof(uint32_t);
+	skinDescription.updateRate = ResourceFrequency::Static;
+	skinDescription.bindFlags = BindFlag::ShaderResource;
+	skinDescription.accessFlags = AccessFlag::CPUWrite;
+	skinDescription.format = DXGI_FORMAT_R32_TYPELESS;
+	vertexSkinBuffer = device->GetResourceManager().Create(skinDescription, bufferNames[meshStreamSkin]);
 
 	BufferDescription indexDescription{};
 	indexDescription.size = maxIndices;
 	indexDescription.stride = sizeof(uint32_t);
 	indexDescription.updateRate = ResourceFrequency::Static;
-	indexDescription.bindFlags = BindFlag::IndexBuffer;
+	indexDescription.bindFlags = BindFlag::IndexBuffer | BindFlag::ShaderResource;  // Visibility buffer shading fetches triangles.
 	indexDescription.accessFlags = AccessFlag::CPUWrite;
-	indexBuffer = device->GetResourceManager().Create(indexDescription, VGText("Index buffer"));
+	indexBuffer = device->GetResourceManager().Create(indexDescription, bufferNames[meshStreamIndex]);
+
+	BufferDescription meshletDescription{};
+	meshletDescription.size = maxIndices / (meshletMaxTriangles * 3) * 2;  // Leave room for partially filled meshlets.
+	meshletDescription.stride = sizeof(MeshletData);
+	meshletDescription.updateRate = ResourceFrequency::Static;
+	meshletDescription.bindFlags = BindFlag::ShaderResource;
+	meshletDescription.accessFlags = AccessFlag::CPUWrite;
+	meshletBuffer = device->GetResourceManager().Create(meshletDescription, bufferNames[meshStreamMeshlet]);
+
+	BufferDescription meshletStreamDescription{};
+	meshletStreamDescription.size = meshletDescription.size * meshletMaxVertices;
+	meshletStreamDescription.stride = sizeof(uint32_t);
+	meshletStreamDescription.updateRate = ResourceFrequency::Static;
+	meshletStreamDescription.bindFlags = BindFlag::ShaderResource;
+	meshletStreamDescription.accessFlags = AccessFlag::CPUWrite;
+	meshletVertexBuffer = device->GetResourceManager().Create(meshletStreamDescription, bufferNames[meshStreamMeshletVertex]);
+
+	meshletStreamDescription.size = meshletDescription.size * meshletMaxTriangles;
+	meshletTriangleBuffer = device->GetResourceManager().Create(meshletStreamDescription, bufferNames[meshStreamMeshletTriangle]);
+
+	for (size_t i = 0; i < meshStreamCount; ++i)
+	{
+		capacities[i] = static_cast<uint32_t>(device->GetResourceManager().Get(GetStreamBuffer(i)).description.size);
+		allocators[i] = FreeListAllocator{ capacities[i] };
+	}
 }
 
 MeshFactory::~MeshFactory()
@@ -71,4 +784,8 @@ MeshFactory::~MeshFactory()
 	device->GetResourceManager().Destroy(vertexPositionBuffer);
 	device->GetResourceManager().Destroy(vertexExtraBuffer);
 	device->GetResourceManager().Destroy(indexBuffer);
+	device->GetResourceManager().Destroy(meshletBuffer);
+	device->GetResourceManager().Destroy(meshletVertexBuffer);
+	device->GetResourceManager().Destroy(meshletTriangleBuffer);
+	device->GetResourceManager().Destroy(vertexSkinBuffer);
 }
\ No newline at end of file
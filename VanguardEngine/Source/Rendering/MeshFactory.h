@@ -5,9 +5,19 @@
 #include <Rendering/Base.h>
 #include <Rendering/PrimitiveAssembly.h>
 #include <Rendering/RenderComponents.h>
+#include <Utility/AlignedSize.h>
+#include <Utility/FreeListAllocator.h>
+
+#include <entt/entt.hpp>
 
 #include <vector>
 #include <utility>
+#include <limits>
+#include <span>
+#include <array>
+#include <optional>
+#include <unordered_map>
+#include <algorithm>
 
 class RenderDevice;
 
@@ -20,30 +30,193 @@ public:
 	BufferHandle indexBuffer;
 	BufferHandle vertexPositionBuffer;  // Stores vertex positions.
 	BufferHandle vertexExtraBuffer;  // Stores all other vertex attributes.
+	BufferHandle meshletBuffer;  // Stores meshlet culling bounds, see MeshletData.
+	BufferHandle meshletVertexBuffer;  // Vertex indices of each meshlet, relative to the mesh subset.
+	BufferHandle meshletTriangleBuffer;  // Packed triangles of each meshlet, three 8 bit meshlet vertex indices each.
+	BufferHandle vertexSkinBuffer;  // Joint influences of skinned vertices, only read by the skinning pass.
+
+	static constexpr size_t skinVertexSize = sizeof(uint16_t) * 8;  // Four joint indices, then four unorm weights.
 
 private:
-	size_t indexOffset = 0;
-	size_t vertexPositionOffset = 0;
-	size_t vertexExtrasOffset = 0;
+	// Buffers suballocated by each mesh.
+	enum MeshStream
+	{
+		meshStreamPosition,
+		meshStreamExtra,
+		meshStreamIndex,
+		meshStreamMeshlet,
+		meshStreamMeshletVertex,
+		meshStreamMeshletTriangle,
+		meshStreamSkin,
+		meshStreamCount
+	};
+
+	// Ranges of each stream, in elements of the stream buffer's stride.
+	struct MeshAllocation
+	{
+		std::array<uint32_t, meshStreamCount> offsets = {};
+		std::array<uint32_t, meshStreamCount> counts = {};
+		std::vector<MeshletData> meshlets;  // Relative to the allocation, kept to patch their offsets when compacting.
+	};
+
+	std::array<FreeListAllocator, meshStreamCount> allocators;
+	std::array<uint32_t, meshStreamCount> capacities = {};
+	std::array<size_t, meshStreamCount> allocatedCounts = {};
+	std::unordered_map<size_t, MeshAllocation> allocations;  // Keyed by the mesh's global index offset.
+	std::vector<std::pair<size_t, MeshAllocation>> pendingFrees;  // Frame freed on, released once it retires.
+	std::unordered_map<size_t, PrimitiveOffset> relocations;  // Previous global index offset to the new offsets, of the last defragmentation.
+	size_t revision = 0;  // Bumped by each defragmentation.
+
+	static constexpr size_t meshletMaxVertices = 64;
+	static constexpr size_t meshletMaxTriangles = 124;
+	static constexpr float meshletConeWeight = 0.25f;  // Favors tighter normal cones over fuller meshlets, for backface culling.
+	static constexpr float lodReduction = 0.5f;  // Triangles of each level relative to the previous level.
+	static constexpr float lodMaxError = 0.1f;  // Relative to the subset's extent, simplification stops short of the target beyond this.
+	static constexpr size_t lodMinTriangles = 64;  // Subsets this small aren't worth simplifying further.
+
+public:
+	// Meshlet data of a mesh, offsets are relative until the mesh is allocated.
+	struct MeshletStreams
+	{
+		std::vector<MeshletData> meshlets;
+		std::vector<uint32_t> vertices;
+		std::vector<uint32_t> triangles;
+	};
+
+	// Non-owning view of an encoded mesh's data, such as one mapped from the mesh cache.
+	struct MeshDataView
+	{
+		std::span<const uint8_t> vertexPositionData;
+		std::span<const uint8_t> vertexExtraData;
+		std::span<const uint8_t> indexData;
+		std::span<const MeshletData> meshlets;
+		std::span<const uint32_t> meshletVertices;
+		std::span<const uint32_t> meshletTriangles;
+		std::span<const uint8_t> vertexSkinData;
+	};
+
+	// Encoded mesh, ready to be uploaded. Subset offsets are relative to the mesh and subset material indices refer to the
+	// source's materials, until uploaded.
+	struct MeshData
+	{
+		MeshComponent component;
+		std::vector<uint8_t> vertexPositionData;
+		std::vector<uint8_t> vertexExtraData;
+		std::vector<uint8_t> indexData;
+		MeshletStreams meshletData;
+		std::vector<uint8_t> vertexSkinData;
 
-	uint32_t SearchVertexChannel(const std::string& name);
-	PrimitiveOffset AllocateMesh(const std::vector<uint8_t>& vertexPositionData, const std::vector<uint8_t>& vertexExtraData, const std::vector<uint8_t>& indexData);
+		MeshDataView View() const noexcept
+		{
+			return { vertexPositionData, vertexExtraData, indexData, meshletData.meshlets, meshletData.vertices, meshletData.triangles, vertexSkinData };
+		}
+	};
+
+private:
+	uint32_t SearchVertexChannel(const std::string& name) const;
+	// Quantized channels of an assembly, channels are only quantized if they're in the expected full precision format.
+	uint32_t GetQuantizedChannels(const PrimitiveAssembly& assembly) const;
+	size_t GetEncodedAttributeSize(uint32_t channel, size_t attributeSize, uint32_t quantizedChannels) const;
+	void EncodeVertexAttribute(uint32_t channel, const VertexMetadata& metadata, const uint8_t* source, size_t sourceSize, uint8_t* target) const;
+	// Writes skinVertexSize bytes, the weights are normalized.
+	void EncodeSkinInfluences(const XMFLOAT4& joints, const XMFLOAT4& weights, uint8_t* target) const;
+	// Appends the assembly's indices in meshlet order with the given index size, returns the number of indices written.
+	size_t BuildMeshlets(const PrimitiveAssembly& assembly, size_t indexSize, std::vector<uint8_t>& indexData, MeshletStreams& meshletData) const;
+	// Appends simplified index lists of the assembly after the subset's indices, filling the subset's levels of detail.
+	void BuildLods(const PrimitiveAssembly& assembly, size_t indexSize, std::vector<uint8_t>& indexData, MeshComponent::Subset& subset) const;
+	// Fills the subset's bounding box and sphere from the assembly's positions.
+	void ComputeBounds(const PrimitiveAssembly& assembly, MeshComponent::Subset& subset) const;
+	BufferHandle& GetStreamBuffer(size_t stream);
+	PrimitiveOffset GetPrimitiveOffset(const MeshAllocation& allocation) const;
+	void ReleaseAllocation(const MeshAllocation& allocation);
+	void WriteMeshlets(const MeshAllocation& allocation);
+	// Allocates the ranges of every stream, at least one element each. Returns false if any stream is out of space.
+	bool AllocateRanges(MeshAllocation& allocation);
+	// Returns nothing if any stream is out of space.
+	std::optional<PrimitiveOffset> AllocateMesh(const MeshDataView& data);
+	void FreeAllocation(size_t indexOffset);
+	// Whether holes make up too much of a stream that's filling up.
+	bool IsFragmented() const;
 
 public:
 	MeshFactory(RenderDevice* inDevice, size_t maxVertices, size_t maxIndices);
 	~MeshFactory();
 
-	inline MeshComponent CreateMeshComponent(const std::vector<PrimitiveAssembly>& assemblies, const std::vector<size_t>& materials, const std::vector<uint32_t>& materialIndices, const std::vector<float>& boundingSpheres);
+	// Encodes the assemblies without touching the device, safe to call from any thread.
+	inline MeshData BuildMesh(const std::vector<PrimitiveAssembly>& assemblies, const std::vector<uint32_t>& materialIndices, bool quantize) const;
+	// Uploads an encoded mesh, resolving its subset materials from the source's materials. Meshes which don't fit are
+	// returned without subsets.
+	MeshComponent UploadMesh(MeshComponent component, const MeshDataView& data, const std::vector<size_t>& materials);
+	// Releases the mesh's ranges once the frames which could be drawing it retire. Every component sharing the mesh's
+	// geometry must be removed.
+	void FreeMesh(const MeshComponent& component);
+	// Allocates position and extra ranges of the given sizes in bytes, for vertices written on the GPU such as an entity's
+	// skinned vertices. Returns nothing if either stream is out of space. The ranges move when defragmenting like a mesh's,
+	// keyed by the returned index offset.
+	std::optional<PrimitiveOffset> AllocateVertices(size_t positionSize, size_t extraSize);
+	// Releases vertices of AllocateVertices once the frames which could be drawing them retire.
+	void FreeVertices(const PrimitiveOffset& offset);
+
+	// Releases retired frees, and compacts the buffers once they've fragmented.
+	void Update(entt::registry& registry);
+	// Packs every mesh into new buffers on the GPU, patching the global offsets of the mesh components in the registry.
+	// Components held outside of the registry are patched by their owners, see GetRelocation. Frames in flight keep drawing
+	// from the old buffers.
+	void Defragment(entt::registry& registry);
+
+	auto GetRevision() const noexcept { return revision; }
+	// New offsets of a mesh moved by the last defragmentation.
+	std::optional<PrimitiveOffset> GetRelocation(size_t previousIndexOffset) const;
+
+	inline MeshComponent CreateMeshComponent(const std::vector<PrimitiveAssembly>& assemblies, const std::vector<size_t>& materials, const std::vector<uint32_t>& materialIndices);
 };
 
-inline MeshComponent MeshFactory::CreateMeshComponent(const std::vector<PrimitiveAssembly>& assemblies, const std::vector<size_t>& materials, const std::vector<uint32_t>& materialIndices, const std::vector<float>& boundingSpheres)
+inline MeshFactory::MeshData MeshFactory::BuildMesh(const std::vector<PrimitiveAssembly>& assemblies, const std::vector<uint32_t>& materialIndices, bool quantize) const
 {
-	VGScopedCPUStat("Create Mesh Component");
+	VGScopedCPUStat("Build Mesh");
+
+	MeshData mesh;
+	auto& component = mesh.component;
+	auto& vertexPositionData = mesh.vertexPositionData;
+	auto& vertexExtraData = mesh.vertexExtraData;
+	auto& indexData = mesh.indexData;
+	auto& meshletData = mesh.meshletData;
+	auto& vertexSkinData = mesh.vertexSkinData;
+
+	const auto hasSkin = [](const PrimitiveAssembly& assembly)
+	{
+		return assembly.vertexStream.contains("JOINTS_0") && assembly.vertexStream.contains("WEIGHTS_0");
+	};
 
-	MeshComponent component;
-	std::vector<uint8_t> vertexPositionData{};
-	std::vector<uint8_t> vertexExtraData{};
-	std::vector<uint8_t> indexData{};
+	uint32_t quantizedChannels = quantize ? GetQuantizedChannels(assemblies.front()) : 0;
+
+	// The skinning pass writes skinned positions, normals and tangents in full precision, copying the rest as is.
+	if (std::any_of(assemblies.begin(), assemblies.end(), hasSkin))
+	{
+		quantizedChannels &= 1 << vertexChannelTexcoord;
+	}
+
+	component.metadata.quantizedChannels = quantizedChannels;
+
+	// Quantized positions are stored relative to the bounds of every subset.
+	if (quantizedChannels & (1 << vertexChannelPosition))
+	{
+		XMVECTOR positionMin = XMVectorReplicate(std::numeric_limits<float>::max());
+		XMVECTOR positionMax = XMVectorReplicate(std::numeric_limits<float>::lowest());
+		for (const auto& assembly : assemblies)
+		{
+			const auto* positions = reinterpret_cast<const XMFLOAT3*>(assembly.GetAttributeData("POSITION"));
+			for (size_t i = 0; i < assembly.GetAttributeCount("POSITION"); ++i)
+			{
+				const auto position = XMLoadFloat3(&positions[i]);
+				positionMin = XMVectorMin(positionMin, position);
+				positionMax = XMVectorMax(positionMax, position);
+			}
+		}
+
+		XMStoreFloat3(&component.metadata.positionMin, positionMin);
+		XMStoreFloat3(&component.metadata.positionExtent, XMVectorMax(positionMax - positionMin, XMVectorReplicate(std::numeric_limits<float>::epsilon())));
+	}
 
 	// Create the bitmask of active channels and compute the strides/offsets for just the first assembly.
 	// This implies the assumption that all mesh subsets within a mesh component have the same vertex layout.
@@ -54,8 +227,14 @@ inline MeshComponent MeshFactory::CreateMeshComponent(const std::vector<Primitiv
 	for (const auto& [name, stream] : assemblies.front().vertexStream)
 	{
 		const auto channelIndex = SearchVertexChannel(name);
+		if (channelIndex >= vertexChannels)
+			continue;  // Skin influences have their own stream.
+
+		const auto attributeSize = GetEncodedAttributeSize(channelIndex, assemblies.front().GetAttributeSize(name), quantizedChannels);
+		if (attributeSize == 0)
+			continue;  // Derived attribute.
+
 		channelMask |= 1 << channelIndex;
-		const auto attributeSize = assemblies.front().GetAttributeSize(name);
 		offsets[channelIndex] = offset;
 		// The position channel offset doesn't affect the extras buffer.
 		if (channelIndex > 0)
@@ -67,6 +246,9 @@ inline MeshComponent MeshFactory::CreateMeshComponent(const std::vector<Primitiv
 	for (const auto& [name, stream] : assemblies.front().vertexStream)
 	{
 		const auto channelIndex = SearchVertexChannel(name);
+		if (channelIndex >= vertexChannels)
+			continue;
+
 		if (channelIndex > 0)
 		{
 			strides[channelIndex] = offset;
@@ -75,7 +257,7 @@ inline MeshComponent MeshFactory::CreateMeshComponent(const std::vector<Primitiv
 		else
 		{
 			// Position channel has an isolated stride.
-			strides[channelIndex] = assemblies.front().GetAttributeSize(name);
+			strides[channelIndex] = GetEncodedAttributeSize(channelIndex, assemblies.front().GetAttributeSize(name), quantizedChannels);
 		}
 	}
 
@@ -95,25 +277,44 @@ inline MeshComponent MeshFactory::CreateMeshComponent(const std::vector<Primitiv
 		PrimitiveOffset localOffset{
 			.index = indexData.size(),
 			.position = vertexPositionData.size(),
-			.extra = vertexExtraData.size()
+			.extra = vertexExtraData.size(),
+			.meshlet = meshletData.meshlets.size(),
+			.skin = vertexSkinData.size()
 		};
 
 		const std::string positionName = "POSITION";
 		VGAssert(assembly.vertexStream.contains(positionName), "Primitive assemblies must contain vertex position data.");
 
-		const auto& positionStream = assembly.vertexStream.at(positionName);
 		const size_t vertexCount = assembly.GetAttributeCount(positionName);
+		const size_t positionSize = assembly.GetAttributeSize(positionName);
+		const size_t encodedPositionSize = strides[vertexChannelPosition];
 		
-		vertexPositionData.resize(vertexPositionData.size() + vertexCount * assembly.GetAttributeSize(positionName));
-		std::memcpy(vertexPositionData.data() + localOffset.position, assembly.GetAttributeData(positionName), vertexPositionData.size() - localOffset.position);
+		vertexPositionData.resize(vertexPositionData.size() + vertexCount * encodedPositionSize);
+		for (size_t i = 0; i < vertexCount; ++i)
+		{
+			EncodeVertexAttribute(vertexChannelPosition, component.metadata, assembly.GetAttributeData(positionName) + i * positionSize, positionSize,
+				vertexPositionData.data() + localOffset.position + i * encodedPositionSize);
+		}
+
+		if (hasSkin(assembly))
+		{
+			const auto* joints = reinterpret_cast<const XMFLOAT4*>(assembly.GetAttributeData("JOINTS_0"));
+			const auto* weights = reinterpret_cast<const XMFLOAT4*>(assembly.GetAttributeData("WEIGHTS_0"));
+
+			vertexSkinData.resize(vertexSkinData.size() + vertexCount * skinVertexSize);
+			for (size_t i = 0; i < vertexCount; ++i)
+			{
+				EncodeSkinInfluences(joints[i], weights[i], vertexSkinData.data() + localOffset.skin + i * skinVertexSize);
+			}
+		}
 
 		size_t extraSize = 0;
 		for (const auto& [name, stream] : assembly.vertexStream)
 		{
-			if (name != positionName)
+			if (name != positionName && SearchVertexChannel(name) < vertexChannels)
 			{
 				VGAssert(assembly.GetAttributeCount(name) == vertexCount, "Mismatched vertex attribute counts.");
-				extraSize += assembly.GetAttributeSize(name);
+				extraSize += GetEncodedAttributeSize(SearchVertexChannel(name), assembly.GetAttributeSize(name), quantizedChannels);
 			}
 		}
 
@@ -125,27 +326,45 @@ inline MeshComponent MeshFactory::CreateMeshComponent(const std::vector<Primitiv
 			size_t attributeOffset = 0;
 			for (const auto& [name, stream] : assembly.vertexStream)
 			{
-				if (name != positionName)
+				if (name != positionName && SearchVertexChannel(name) < vertexChannels)
 				{
+					const auto channelIndex = SearchVertexChannel(name);
 					const size_t attributeSize = assembly.GetAttributeSize(name);
-					std::memcpy(vertexExtraData.data() + localOffset.extra + i * extraSize + attributeOffset, assembly.GetAttributeData(name) + i * attributeSize, attributeSize);
-					attributeOffset += attributeSize;
+					const size_t encodedSize = GetEncodedAttributeSize(channelIndex, attributeSize, quantizedChannels);
+					if (encodedSize > 0)
+					{
+						EncodeVertexAttribute(channelIndex, component.metadata, assembly.GetAttributeData(name) + i * attributeSize, attributeSize,
+							vertexExtraData.data() + localOffset.extra + i * extraSize + attributeOffset);
+						attributeOffset += encodedSize;
+					}
 				}
 			}
 		}
 
-		indexData.resize(indexData.size() + assembly.indexStream.size_bytes());
-		std::memcpy(indexData.data() + localOffset.index, assembly.indexStream.data(), indexData.size() - localOffset.index);
+		// Index views are per subset, so subsets with few enough vertices use 16 bit indices.
+		const size_t indexSize = vertexCount <= std::numeric_limits<uint16_t>::max() ? sizeof(uint16_t) : sizeof(uint32_t);
+		const auto indexCount = BuildMeshlets(assembly, indexSize, indexData, meshletData);
+		const auto meshletCount = meshletData.meshlets.size() - localOffset.meshlet;
 
-		if (materials.size() > 0)
-			component.subsets.emplace_back(localOffset, assembly.indexStream.size(), materials[materialIndices[index]], boundingSpheres[index]);
-		else
-			component.subsets.emplace_back(localOffset, assembly.indexStream.size(), 0, boundingSpheres[index]);
+		component.subsets.emplace_back(localOffset, indexCount, materialIndices[index], meshletCount, indexSize, vertexCount);
+		component.subsets.back().skinned = hasSkin(assembly);
+		BuildLods(assembly, indexSize, indexData, component.subsets.back());
+		ComputeBounds(assembly, component.subsets.back());
+
+		// Keep the next subset's indices aligned for either format.
+		indexData.resize(AlignedSize(indexData.size(), sizeof(uint32_t)));
 
 		++index;
 	}
 
-	component.globalOffset = AllocateMesh(vertexPositionData, vertexExtraData, indexData);
+	return mesh;
+}
+
+inline MeshComponent MeshFactory::CreateMeshComponent(const std::vector<PrimitiveAssembly>& assemblies, const std::vector<size_t>& materials, const std::vector<uint32_t>& materialIndices)
+{
+	VGScopedCPUStat("Create Mesh Component");
+
+	auto mesh = BuildMesh(assemblies, materialIndices, *CvarGet("vertexQuantization", int) > 0);
 
-	return component;
+	return UploadMesh(std::move(mesh.component), mesh.View(), materials);
 }
\ No newline at end of file
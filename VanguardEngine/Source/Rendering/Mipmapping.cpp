@@ -7,9 +7,81 @@
 #include <Rendering/ResourceFormat.h>
 #include <Utility/Math.h>
 
-#include <vector>
+#include <array>
 #include <cmath>
 
+void Mipmapper::CreateMipViews(RenderDevice& device, TextureComponent& component)
+{
+	const auto mipLevels = component.allocation->GetResource()->GetDesc().MipLevels;
+	if (component.mipUAVs.size() == mipLevels - 1)
+	{
+		return;
+	}
+
+	const auto layers = component.description.depth;
+
+	component.mipUAVs.reserve(mipLevels - 1);
+
+	for (uint32_t i = 1; i < mipLevels; ++i)
+	{
+		auto descriptor = device.AllocateDescriptor(DescriptorType::Default);
+
+		D3D12_UNORDERED_ACCESS_VIEW_DESC viewDesc{};
+		viewDesc.Format = ConvertResourceFormatToLinear(component.description.format);
+		if (layers == 1)
+		{
+			viewDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+			viewDesc.Texture2D.MipSlice = i;
+			viewDesc.Texture2D.PlaneSlice = 0;
+		}
+
+		else
+		{
+			if (component.description.array)
+			{
+				viewDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2DARRAY;
+				viewDesc.Texture2DArray.MipSlice = i;
+				viewDesc.Texture2DArray.FirstArraySlice = 0;
+				viewDesc.Texture2DArray.ArraySize = component.description.depth;
+				viewDesc.Texture2DArray.PlaneSlice = 0;
+			}
+
+			else
+			{
+				viewDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE3D;
+				viewDesc.Texture3D.MipSlice = i;
+				viewDesc.Texture3D.FirstWSlice = 0;
+				viewDesc.Texture3D.WSize = -1;
+			}
+		}
+
+		device.Native()->CreateUnorderedAccessView(component.allocation->GetResource(), nullptr, &viewDesc, descriptor);
+
+		component.mipUAVs.emplace_back(std::move(descriptor));
+	}
+}
+
+void Mipmapper::PrepareCounter(RenderDevice& device, CommandList& list)
+{
+	// Created lazily, descriptors aren't available yet when the resource manager initializes.
+	if (!device.GetResourceManager().Valid(counterBuffer))
+	{
+		counterBuffer = device.GetResourceManager().Create(BufferDescription{
+			.updateRate = ResourceFrequency::Static,
+			.bindFlags = BindFlag::UnorderedAccess,
+			.accessFlags = AccessFlag::CPUWrite,
+			.size = counterSize,
+			.stride = sizeof(uint32_t)
+		}, VGText("Mipmap downsample counter"));
+
+		// The last group of each dispatch resets its counter, so this is only needed once.
+		device.GetResourceManager().Write(counterBuffer, std::array<uint32_t, counterSize>{});
+	}
+
+	list.TransitionBarrier(counterBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	list.FlushBarriers();
+}
+
 void Mipmapper::Initialize(RenderDevice& device)
 {
 	layout2dState.Build(device, ComputePipelineStateDescription{
@@ -25,96 +97,59 @@ void Mipmapper::Generate2D(RenderDevice& device, CommandList& list, TextureHandl
 {
 	const auto layers = component.description.depth;
 	const auto mipLevels = component.allocation->GetResource()->GetDesc().MipLevels;
-	const auto mipDispatches = static_cast<uint32_t>(std::ceil(mipLevels / 4.f));
-
-	std::vector<DescriptorHandle> uavDescriptors;
-	uavDescriptors.reserve(layers * (mipLevels - 1));
-
-	for (int i = 0; i < layers; ++i)
+	if (mipLevels < 2)
 	{
-		for (int j = 0; j < mipDispatches; ++j)
-		{
-			const auto baseMipWidth = NextPowerOf2(component.description.width) >> j * 4;
-			const auto baseMipHeight = NextPowerOf2(component.description.height) >> j * 4;
-
-			struct BindData
-			{
-				uint32_t mipBase;
-				uint32_t mipCount;
-				XMFLOAT2 texelSize;
-				// Boundary
-				uint32_t outputTextureIndices[4];
-				// Boundary
-				uint32_t inputTextureIndex;
-				uint32_t sRGB;
-				uint32_t resourceType;
-				uint32_t layer;
-			} bindData;
-
-			bindData.mipBase = j * 4;  // Starting mip.
-			bindData.mipCount = std::min(mipLevels - bindData.mipBase - 1, 4u);  // How many mips to generate (0, 4].
-			bindData.sRGB = IsResourceFormatSRGB(component.description.format);
-			bindData.texelSize = { 2.f / baseMipWidth, 2.f / baseMipHeight };
-			bindData.inputTextureIndex = component.SRV->bindlessIndex;
-			bindData.resourceType = layers > 1 ? (component.description.array ? 1 : 2) : 0;
-			bindData.layer = i;
-
-			// Allocate UAVs.
-			for (int k = 0; k < bindData.mipCount; ++k)
-			{
-				auto descriptor = device.AllocateDescriptor(DescriptorType::Default);
-
-				D3D12_UNORDERED_ACCESS_VIEW_DESC viewDesc{};
-				viewDesc.Format = ConvertResourceFormatToLinear(component.description.format);
-				if (layers == 1)
-				{
-					viewDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
-					viewDesc.Texture2D.MipSlice = j * 4 + k + 1;
-					viewDesc.Texture2D.PlaneSlice = 0;
-				}
-
-				else
-				{
-					if (component.description.array)
-					{
-						viewDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2DARRAY;
-						viewDesc.Texture2DArray.MipSlice = j * 4 + k + 1;
-						viewDesc.Texture2DArray.FirstArraySlice = 0;
-						viewDesc.Texture2DArray.ArraySize = component.description.depth;
-						viewDesc.Texture2DArray.PlaneSlice = 0;
-					}
-
-					else
-					{
-						viewDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE3D;
-						viewDesc.Texture3D.MipSlice = j * 4 + k + 1;
-						viewDesc.Texture3D.FirstWSlice = 0;
-						viewDesc.Texture3D.WSize = -1;
-					}
-				}
-
-				device.Native()->CreateUnorderedAccessView(component.allocation->GetResource(), nullptr, &viewDesc, descriptor);
-
-				bindData.outputTextureIndices[k] = descriptor.bindlessIndex;
-
-				uavDescriptors.emplace_back(std::move(descriptor));
-			}
+		return;
+	}
 
-			list.BindPipelineState(layout2dState);
-			list.BindDescriptorAllocator(device.GetDescriptorAllocator());
-			list.BindConstants("bindData", bindData);
+	VGAssert(mipLevels <= 15, "Mipmapping supports up to 16k textures.");
+	VGAssert(layers <= counterSize, "Too many texture array layers for mipmapping.");
 
-			list.Dispatch(std::max((uint32_t)std::ceil(baseMipWidth / (2.f * 8.f)), 1u), std::max((uint32_t)std::ceil(baseMipHeight / (2.f * 8.f)), 1u), 1);
+	CreateMipViews(device, component);
+	PrepareCounter(device, list);
 
-			list.UAVBarrier(texture);
-			list.FlushBarriers();
-		}
-	}
+	struct BindData
+	{
+		uint32_t inputTextureIndex;
+		uint32_t counterBuffer;
+		uint32_t mipCount;
+		uint32_t groupCount;
+		// Boundary
+		XMFLOAT2 texelSize;
+		uint32_t sRGB;
+		uint32_t resourceType;
+		// Boundary
+		uint32_t outputTextureIndices[16];
+	} bindData{};
+
+	// Each group covers a 64x64 tile of mip 1.
+	const auto mipWidth = std::max(component.description.width >> 1, 1u);
+	const auto mipHeight = std::max(component.description.height >> 1, 1u);
+	const auto dispatchX = std::max((uint32_t)std::ceil(mipWidth / 64.f), 1u);
+	const auto dispatchY = std::max((uint32_t)std::ceil(mipHeight / 64.f), 1u);
+
+	bindData.inputTextureIndex = component.SRV->bindlessIndex;
+	bindData.counterBuffer = device.GetResourceManager().Get(counterBuffer).UAV->bindlessIndex;
+	bindData.mipCount = mipLevels;
+	bindData.groupCount = dispatchX * dispatchY;
+	bindData.texelSize = { 1.f / mipWidth, 1.f / mipHeight };
+	bindData.sRGB = IsResourceFormatSRGB(component.description.format);
+	bindData.resourceType = layers > 1 ? 1 : 0;
 
-	for (auto&& descriptor : uavDescriptors)
+	for (int i = 0; i < mipLevels - 1; ++i)
 	{
-		device.GetResourceManager().AddFrameDescriptor(device.GetFrameIndex(), std::move(descriptor));
+		bindData.outputTextureIndices[i] = component.mipUAVs[i].bindlessIndex;
 	}
+
+	list.BindPipelineState(layout2dState);
+	list.BindDescriptorAllocator(device.GetDescriptorAllocator());
+	list.BindConstants("bindData", bindData);
+
+	list.Dispatch(dispatchX, dispatchY, layers);
+
+	list.UAVBarrier(texture);
+	list.UAVBarrier(counterBuffer);
+	list.FlushBarriers();
 }
 
 void Mipmapper::Generate3D(RenderDevice& device, CommandList& list, TextureHandle texture, TextureComponent& component)
@@ -123,11 +158,20 @@ void Mipmapper::Generate3D(RenderDevice& device, CommandList& list, TextureHandl
 	VGAssert(IsPowerOf2(component.description.width), "3D textures must be power of 2 for mipmapping.");
 
 	const auto mipLevels = component.Native()->GetDesc().MipLevels;
-	for (int i = 0; i < mipLevels - 1; ++i)
+
+	CreateMipViews(device, component);
+	PrepareCounter(device, list);
+
+	list.BindPipelineState(layout3dState);
+	list.BindDescriptorAllocator(device.GetDescriptorAllocator());
+
+	// Each dispatch generates up to eight mips, which only fit in one dispatch once the first generated mip is 128^3 or
+	// smaller. Larger textures generate the first four mips separately.
+	uint32_t mipBase = 0;
+	while (mipBase < mipLevels - 1)
 	{
-		const float baseMipWidth = component.description.width >> i;
-		const float baseMipHeight = component.description.height >> i;
-		const float baseMipDepth = component.description.depth >> i;
+		const auto mipSize = std::max(component.description.width >> (mipBase + 1), 1u);
+		const auto dispatchSize = std::max((uint32_t)std::ceil(mipSize / 8.f), 1u);
 
 		struct {
 			uint32_t mipBase;
@@ -135,44 +179,34 @@ void Mipmapper::Generate3D(RenderDevice& device, CommandList& list, TextureHandl
 			uint32_t inputTextureIndex;
 			uint32_t sRGB;
 			// Boundary
-			uint32_t outputTextureIndex;
-			XMFLOAT3 texelSize;
-		} bindData;
+			uint32_t counterBuffer;
+			uint32_t groupCount;
+			float texelSize;
+			float padding;
+			// Boundary
+			uint32_t outputTextureIndices[8];
+		} bindData{};
 
-		bindData.mipBase = i;
-		bindData.mipCount = 1;  // #TODO: Compute multiple mip levels in a single dispatch.
-		bindData.sRGB = IsResourceFormatSRGB(component.description.format);
-		bindData.texelSize = { 2.f / baseMipWidth, 2.f / baseMipHeight, 2.f / baseMipDepth };
+		bindData.mipBase = mipBase;
+		bindData.mipCount = std::min(mipLevels - 1 - mipBase, mipSize > 128 ? 4u : 8u);
 		bindData.inputTextureIndex = component.SRV->bindlessIndex;
-		
-		auto descriptor = device.AllocateDescriptor(DescriptorType::Default);
-
-		D3D12_UNORDERED_ACCESS_VIEW_DESC viewDesc{
-			.Format = component.description.format,
-			.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE3D,
-			.Texture3D = {
-				.MipSlice = i + 1u,
-				.FirstWSlice = 0,
-				.WSize = -1u
-			}
-		};
-
-		device.Native()->CreateUnorderedAccessView(component.allocation->GetResource(), nullptr, &viewDesc, descriptor);
-		
-		bindData.outputTextureIndex = descriptor.bindlessIndex;
+		bindData.sRGB = IsResourceFormatSRGB(component.description.format);
+		bindData.counterBuffer = device.GetResourceManager().Get(counterBuffer).UAV->bindlessIndex;
+		bindData.groupCount = dispatchSize * dispatchSize * dispatchSize;
+		bindData.texelSize = 1.f / mipSize;
 
-		device.GetResourceManager().AddFrameDescriptor(device.GetFrameIndex(), std::move(descriptor));
+		for (int i = 0; i < bindData.mipCount; ++i)
+		{
+			bindData.outputTextureIndices[i] = component.mipUAVs[mipBase + i].bindlessIndex;
+		}
 
-		list.BindPipelineState(layout3dState);
-		list.BindDescriptorAllocator(device.GetDescriptorAllocator());
 		list.BindConstants("bindData", bindData);
-
-		auto dispatchX = std::max((uint32_t)std::ceil(baseMipWidth / (2.f * 8.f)), 1u);
-		auto dispatchY = std::max((uint32_t)std::ceil(baseMipHeight / (2.f * 8.f)), 1u);
-		auto dispatchZ = std::max((uint32_t)std::ceil(baseMipDepth / 2.f), 1u);
-		list.Dispatch(dispatchX, dispatchY, dispatchZ);
+		list.Dispatch(dispatchSize, dispatchSize, dispatchSize);
 
 		list.UAVBarrier(texture);
+		list.UAVBarrier(counterBuffer);
 		list.FlushBarriers();
+
+		mipBase += bindData.mipCount;
 	}
 }
\ No newline at end of file
@@ -9,12 +9,21 @@ class RenderDevice;
 class CommandList;
 struct TextureComponent;
 
+// Builds mip chains with a single pass downsampler, one dispatch per chain for 2D textures. Per mip UAVs are cached in
+// the texture component, so chains regenerated every frame don't allocate descriptors.
 class Mipmapper
 {
 private:
 	PipelineState layout2dState;
 	PipelineState layout3dState;
 
+	// Per layer count of finished groups, lets the last group of a dispatch build the mips past its tile.
+	BufferHandle counterBuffer;
+	static constexpr uint32_t counterSize = 64;
+
+	void CreateMipViews(RenderDevice& device, TextureComponent& component);
+	void PrepareCounter(RenderDevice& device, CommandList& list);
+
 public:
 	void Initialize(RenderDevice& device);
 
@@ -7,11 +7,24 @@
 #include <Utility/Math.h>
 
 #include <cmath>
+#include <bit>
 
 uint32_t OcclusionCulling::GetMipLevels(RenderGraph& graph)
 {
-	const auto [backBufferWidth, backBufferHeight] = graph.GetBackBufferResolution(device);
-	return std::min((int)std::floor(std::log2(std::max(backBufferWidth, backBufferHeight))) + 1, *CvarGet("hiZPyramidLevels", int));
+	const auto [backBufferWidth, backBufferHeight] = graph.GetOutputResolution(device);
+	const auto levels = std::min((int)std::floor(std::log2(std::max(backBufferWidth, backBufferHeight))) + 1, *CvarGet("hiZPyramidLevels", int));
+
+	// Two tiles deep covers a 16k pyramid.
+	return std::min(static_cast<uint32_t>(levels), maxMipLevels);
+}
+
+std::tuple<uint32_t, uint32_t, uint32_t> OcclusionCulling::GetHiZDimensions(uint32_t width, uint32_t height)
+{
+	// Previous power of 2 to ensure conservative culling.
+	const auto hiZWidth = PreviousPowerOf2(width);
+	const auto hiZHeight = PreviousPowerOf2(height);
+
+	return { hiZWidth, hiZHeight, static_cast<uint32_t>(std::bit_width(std::max(hiZWidth, hiZHeight))) };
 }
 
 void OcclusionCulling::Initialize(RenderDevice* inDevice)
@@ -19,11 +32,19 @@ void OcclusionCulling::Initialize(RenderDevice* inDevice)
 	CvarCreate("hiZPyramidLevels", "Maximum number of mipmaps to generate for the depth pyramid, used in occlusion culling", 16);
 
 	device = inDevice;
-	lastFrameHiZ.id = 0;
 
 	hiZLayout = RenderPipelineLayout{}
 		.ComputeShader({ "GenerateHiZ", "Main" });  // Similar to generate mips, but enough differences to warrant a new shader.
 
+	counterBuffer = device->GetResourceManager().Create(BufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.bindFlags = BindFlag::UnorderedAccess,
+		.accessFlags = AccessFlag::CPUWrite,
+		.size = 1,
+		.stride = sizeof(uint32_t)
+	}, VGText("Hi-Z downsample counter"));
+	device->GetResourceManager().Write(counterBuffer, uint32_t{ 0 });
+
 #if ENABLE_EDITOR
 	debugOverlayLayout = RenderPipelineLayout{}
 		.VertexShader({ "HiZDebugOverlay", "VSMain" })
@@ -31,13 +52,13 @@ void OcclusionCulling::Initialize(RenderDevice* inDevice)
 #endif
 }
 
-void OcclusionCulling::Render(RenderGraph& graph, bool cameraFrozen, const RenderResource depthStencilTag)
+RenderResource OcclusionCulling::AddHiZ(RenderGraph& graph, RenderPass& pass)
 {
-	const auto [backBufferWidth, backBufferHeight] = graph.GetBackBufferResolution(device);
-	auto hiZMipLevels = GetMipLevels(graph);
+	const auto [backBufferWidth, backBufferHeight] = graph.GetOutputResolution(device);
+	const auto [hiZWidth, hiZHeight, hiZMipCount] = GetHiZDimensions(backBufferWidth, backBufferHeight);
+	hiZMipLevels = GetMipLevels(graph);
 
 	TextureView hiZView{};
-	std::vector<std::string> hiZViewNames;
 	hiZViewNames.resize(hiZMipLevels);
 	for (int i = 0; i < hiZMipLevels; ++i)
 	{
@@ -45,64 +66,58 @@ void OcclusionCulling::Render(RenderGraph& graph, bool cameraFrozen, const Rende
 		hiZView.UAV(hiZViewNames[i], i);
 	}
 
-	auto& hiZPass = graph.AddPass("Hierarchical Z Pass", ExecutionQueue::Compute, !cameraFrozen);  // Disable Hi-Z updates when frozen.
-	auto hiZTag = hiZPass.Create(TransientTextureDescription{
-		// Previous power of 2 to ensure conservative culling.
-		.width = PreviousPowerOf2(backBufferWidth),
-		.height = PreviousPowerOf2(backBufferHeight),
+	hiZTag = pass.Create(TransientTextureDescription{
+		.width = hiZWidth,
+		.height = hiZHeight,
 		.format = DXGI_FORMAT_R32_FLOAT,
-		.mipMapping = true
+		.mipMapping = true,
+		.persistent = true
 	}, VGText("Hi-Z Depth pyramid"));
-	hiZPass.Read(depthStencilTag, ResourceBind::SRV);
-	hiZPass.Write(hiZTag, hiZView);
-	hiZPass.Bind([&, hiZTag, depthStencilTag, hiZMipLevels, hiZViewNames](CommandList& list, RenderPassResources& resources)
-	{
-		list.BindPipeline(hiZLayout);
-
-		struct {
-			uint32_t mipBase;
-			uint32_t mipCount;
-			XMFLOAT2 texelSize;
-			uint32_t outputTextureIndices[4];
-			uint32_t inputTextureIndex;
-		} bindData;
+	pass.Write(hiZTag, hiZView);
 
-		auto& depthComponent = device->GetResourceManager().Get(resources.GetTexture(depthStencilTag));
-		const auto mipDispatches = static_cast<uint32_t>(std::ceil(hiZMipLevels / 4.f));
-		for (int i = 0; i < mipDispatches; ++i)
-		{
-			const auto baseMipWidth = NextPowerOf2(depthComponent.description.width) >> i * 4;
-			const auto baseMipHeight = NextPowerOf2(depthComponent.description.height) >> i * 4;
-
-			bindData.mipBase = i * 4;  // Starting mip.
-			bindData.mipCount = std::min(hiZMipLevels - bindData.mipBase, 4u);  // How many mips to generate (0, 4].
-			bindData.texelSize = { 2.f / baseMipWidth, 2.f / baseMipHeight };
-
-			// First dispatch we read from the depth source.
-			if (i == 0)
-				bindData.inputTextureIndex = resources.Get(depthStencilTag);
-			else
-				bindData.inputTextureIndex = resources.Get(hiZTag, hiZViewNames[i * 4 - 1]);
-
-			for (int j = 0; j < bindData.mipCount; ++j)
-			{
-				bindData.outputTextureIndices[j] = resources.Get(hiZTag, hiZViewNames[i * 4 + j]);
-			}
-
-			list.BindConstants("bindData", bindData);
-
-			const auto dispatchX = std::max((uint32_t)std::ceil(baseMipWidth / (2.f * 8.f)), 1u);
-			const auto dispatchY = std::max((uint32_t)std::ceil(baseMipHeight / (2.f * 8.f)), 1u);
-			const auto dispatchZ = 1;
-
-			list.Dispatch(dispatchX, dispatchY, dispatchZ);
-			list.UAVBarrier(resources.GetTexture(hiZTag));
-			list.FlushBarriers();
-		}
-	});
+	counterTag = graph.Import(counterBuffer);
+	pass.Write(counterTag, ResourceBind::UAV);
+
+	return hiZTag;
+}
+
+void OcclusionCulling::GenerateHiZ(CommandList& list, RenderPassResources& resources, TextureHandle depthStencil)
+{
+	list.BindPipeline(hiZLayout);
+
+	struct {
+		uint32_t inputTextureIndex;
+		uint32_t counterBuffer;
+		uint32_t mipCount;
+		uint32_t groupCount;
+		XMFLOAT2 texelSize;
+		XMFLOAT2 padding;
+		uint32_t outputTextureIndices[maxMipLevels + 2];
+	} bindData{};
+
+	// The depth stencil is an output of the pass, so use its default view directly.
+	auto& depthComponent = device->GetResourceManager().Get(depthStencil);
+	auto& hiZComponent = device->GetResourceManager().Get(resources.GetTexture(hiZTag));
+
+	// Each group covers a tile of the first mip.
+	const auto dispatchX = std::max((uint32_t)std::ceil(hiZComponent.description.width / (float)tileSize), 1u);
+	const auto dispatchY = std::max((uint32_t)std::ceil(hiZComponent.description.height / (float)tileSize), 1u);
+
+	bindData.inputTextureIndex = depthComponent.SRV->bindlessIndex;
+	bindData.counterBuffer = resources.Get(counterTag);
+	bindData.mipCount = hiZMipLevels;
+	bindData.groupCount = dispatchX * dispatchY;
+	bindData.texelSize = { 2.f / NextPowerOf2(depthComponent.description.width), 2.f / NextPowerOf2(depthComponent.description.height) };
+
+	for (int i = 0; i < hiZMipLevels; ++i)
+	{
+		bindData.outputTextureIndices[i] = resources.Get(hiZTag, hiZViewNames[i]);
+	}
 
-	++swapCount;
-	lastFrameHiZ = hiZTag;
+	list.BindConstants("bindData", bindData);
+	list.Dispatch(dispatchX, dispatchY, 1);
+	list.UAVBarrier(resources.GetTexture(hiZTag));
+	list.FlushBarriers();
 }
 
 RenderResource OcclusionCulling::RenderDebugOverlay(RenderGraph& graph, int mipLevel, const RenderResource cameraBufferTag)
@@ -115,7 +130,7 @@ RenderResource OcclusionCulling::RenderDebugOverlay(RenderGraph& graph, int mipL
 	const auto debugOverlayTag = overlayPass.Create(TransientTextureDescription{
 		.format = DXGI_FORMAT_R16G16B16A16_FLOAT
 	}, VGText("Occlusion culling debug overlay"));
-	overlayPass.Read(lastFrameHiZ, hiZView);
+	overlayPass.Read(hiZTag, hiZView);
 	overlayPass.Read(cameraBufferTag, ResourceBind::SRV);
 	overlayPass.Output(debugOverlayTag, OutputBind::RTV, LoadType::Preserve);
 	overlayPass.Bind([&, debugOverlayTag, cameraBufferTag](CommandList& list, RenderPassResources& resources)
@@ -129,7 +144,7 @@ RenderResource OcclusionCulling::RenderDebugOverlay(RenderGraph& graph, int mipL
 			uint32_t cameraIndex;
 		} bindData;
 
-		bindData.hiZTexture = resources.Get(lastFrameHiZ);
+		bindData.hiZTexture = resources.Get(hiZTag);
 		bindData.cameraBuffer = resources.Get(cameraBufferTag);
 		bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
 
@@ -3,18 +3,34 @@
 #pragma once
 
 #include <Rendering/Base.h>
+#include <Rendering/ResourceHandle.h>
 #include <Rendering/RenderPipeline.h>
 #include <Rendering/RenderGraphResource.h>
 
+#include <string>
+#include <vector>
+#include <tuple>
+
 class RenderDevice;
 class RenderGraph;
+class RenderPass;
+class RenderPassResources;
+class CommandList;
 
 class OcclusionCulling
 {
 private:
 	RenderDevice* device;
-	uint32_t swapCount = 0;
-	RenderResource lastFrameHiZ;
+	RenderResource hiZTag;
+	RenderResource counterTag;
+	uint32_t hiZMipLevels = 0;
+	std::vector<std::string> hiZViewNames;
+
+	// Groups of the single pass downsampler that finished their tile, the last group builds the remaining mips.
+	BufferHandle counterBuffer;
+	static constexpr uint32_t tileSize = 64;
+	static constexpr uint32_t tileMips = 7;
+	static constexpr uint32_t maxMipLevels = tileMips * 2;
 
 	RenderPipelineLayout hiZLayout;
 
@@ -27,15 +43,14 @@ private:
 	uint32_t GetMipLevels(RenderGraph& graph);
 
 public:
+	// Dimensions of the depth pyramid for an output resolution, with its full mip chain.
+	static std::tuple<uint32_t, uint32_t, uint32_t> GetHiZDimensions(uint32_t width, uint32_t height);
+
 	void Initialize(RenderDevice* inDevice);
-	RenderResource GetLastFrameHiZ();
-	void Render(RenderGraph& graph, bool cameraFrozen, const RenderResource depthStencilTag);
+	// Adds the depth pyramid to a pass, which then builds it with GenerateHiZ(). Built mid-frame from the early depth,
+	// so that the late culling phase of the same pass can test against it.
+	RenderResource AddHiZ(RenderGraph& graph, RenderPass& pass);
+	// Records the pyramid generation in a single dispatch. The depth stencil must be in a non-pixel shader readable state.
+	void GenerateHiZ(CommandList& list, RenderPassResources& resources, TextureHandle depthStencil);
 	RenderResource RenderDebugOverlay(RenderGraph& graph, int mipLevel, const RenderResource cameraBufferTag);
-};
-
-inline RenderResource OcclusionCulling::GetLastFrameHiZ()
-{
-	VGAssert(swapCount % 2 == 0, "Occlusion culling Render() called before GetLastFrameHiZ().");
-	++swapCount;
-	return lastFrameHiZ;
-}
\ No newline at end of file
+};
\ No newline at end of file
@@ -118,6 +118,10 @@ namespace std
 				description.vertexShader.second,
 				std::filesystem::hash_value(description.pixelShader.first),
 				description.pixelShader.second,
+				std::filesystem::hash_value(description.amplificationShader.first),
+				description.amplificationShader.second,
+				std::filesystem::hash_value(description.meshShader.first),
+				description.meshShader.second,
 				description.blendDescription,
 				description.rasterizerDescription,
 				description.depthStencilDescription,
@@ -148,7 +152,8 @@ namespace std
 			size_t seed = 0;
 			HashCombine(seed,
 				std::filesystem::hash_value(description.shader.first),
-				description.shader.second);
+				description.shader.second,
+				description.waveSpecialized);
 			for (const auto& macro : description.macros)
 			{
 				HashCombine(seed, macro);
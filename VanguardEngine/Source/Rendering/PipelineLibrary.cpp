@@ -0,0 +1,162 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/PipelineLibrary.h>
+#include <Rendering/Device.h>
+#include <Core/Config.h>
+
+#include <fstream>
+#include <iterator>
+#include <mutex>
+
+std::filesystem::path PipelineLibrary::GetLibraryPath() const
+{
+	return Config::engineRootPath / "Cache" / "Pipelines.bin";
+}
+
+void PipelineLibrary::CreateLibrary(const void* data, size_t size)
+{
+	const auto result = device->Native()->CreatePipelineLibrary(data, size, IID_PPV_ARGS(library.Indirect()));
+	if (FAILED(result))
+	{
+		library.Reset();
+
+		// Libraries from a different driver or adapter are rejected, start a new one.
+		if (size > 0)
+		{
+			VGLogWarning(logRendering, "Pipeline library cache is stale: {}, discarding.", result);
+
+			serializedLibrary.clear();
+			CreateLibrary(nullptr, 0);
+		}
+
+		else
+		{
+			VGLogWarning(logRendering, "Failed to create pipeline library: {}", result);
+		}
+	}
+}
+
+std::wstring PipelineLibrary::GetPipelineName(size_t key)
+{
+	return std::to_wstring(key);
+}
+
+void PipelineLibrary::Initialize(RenderDevice* inDevice)
+{
+	VGScopedCPUStat("Pipeline Library Initialize");
+
+	device = inDevice;
+
+	D3D12_FEATURE_DATA_SHADER_CACHE shaderCache{};
+	const auto result = device->Native()->CheckFeatureSupport(D3D12_FEATURE_SHADER_CACHE, &shaderCache, sizeof(shaderCache));
+	if (FAILED(result) || !(shaderCache.SupportFlags & D3D12_SHADER_CACHE_SUPPORT_LIBRARY))
+	{
+		VGLogWarning(logRendering, "Pipeline libraries are not supported by the device, pipelines won't be cached.");
+
+		return;
+	}
+
+	std::ifstream libraryStream{ GetLibraryPath(), std::ios::binary };
+	if (libraryStream.is_open())
+	{
+		serializedLibrary.assign(std::istreambuf_iterator<char>{ libraryStream }, std::istreambuf_iterator<char>{});
+	}
+
+	CreateLibrary(serializedLibrary.size() ? serializedLibrary.data() : nullptr, serializedLibrary.size());
+}
+
+void PipelineLibrary::Save()
+{
+	VGScopedCPUStat("Pipeline Library Save");
+
+	if (!library || !dirty)
+	{
+		return;
+	}
+
+	std::vector<uint8_t> data(library->GetSerializedSize());
+	auto result = library->Serialize(data.data(), data.size());
+	if (FAILED(result))
+	{
+		VGLogWarning(logRendering, "Failed to serialize pipeline library: {}", result);
+
+		return;
+	}
+
+	const auto path = GetLibraryPath();
+
+	std::error_code error;
+	std::filesystem::create_directories(path.parent_path(), error);
+
+	std::ofstream libraryStream{ path, std::ios::binary };
+	if (!libraryStream.is_open())
+	{
+		VGLogWarning(logRendering, "Failed to save the pipeline library at '{}'.", path.generic_wstring());
+
+		return;
+	}
+
+	libraryStream.write(reinterpret_cast<const char*>(data.data()), data.size());
+	dirty = false;
+}
+
+ResourcePtr<ID3D12PipelineState> PipelineLibrary::Load(size_t key, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& description)
+{
+	std::scoped_lock lock{ libraryLock };
+
+	ResourcePtr<ID3D12PipelineState> pipeline;
+	if (library)
+	{
+		// Fails if the pipeline isn't stored, or was stored with a different description.
+		library->LoadGraphicsPipeline(GetPipelineName(key).c_str(), &description, IID_PPV_ARGS(pipeline.Indirect()));
+	}
+
+	return std::move(pipeline);
+}
+
+ResourcePtr<ID3D12PipelineState> PipelineLibrary::Load(size_t key, const D3D12_COMPUTE_PIPELINE_STATE_DESC& description)
+{
+	std::scoped_lock lock{ libraryLock };
+
+	ResourcePtr<ID3D12PipelineState> pipeline;
+	if (library)
+	{
+		library->LoadComputePipeline(GetPipelineName(key).c_str(), &description, IID_PPV_ARGS(pipeline.Indirect()));
+	}
+
+	return std::move(pipeline);
+}
+
+ResourcePtr<ID3D12PipelineState> PipelineLibrary::Load(size_t key, const D3D12_PIPELINE_STATE_STREAM_DESC& description)
+{
+	std::scoped_lock lock{ libraryLock };
+
+	ResourcePtr<ID3D12PipelineState> pipeline;
+	if (library)
+	{
+		library->LoadPipeline(GetPipelineName(key).c_str(), &description, IID_PPV_ARGS(pipeline.Indirect()));
+	}
+
+	return std::move(pipeline);
+}
+
+void PipelineLibrary::Store(size_t key, ID3D12PipelineState* pipeline)
+{
+	std::scoped_lock lock{ libraryLock };
+
+	if (!library)
+	{
+		return;
+	}
+
+	const auto result = library->StorePipeline(GetPipelineName(key).c_str(), pipeline);
+	if (FAILED(result))
+	{
+		// Names are unique, a pipeline with this key (but a different description) was already stored.
+		VGLogWarning(logRendering, "Failed to store pipeline in the library: {}", result);
+
+		return;
+	}
+
+	dirty = true;
+}
\ No newline at end of file
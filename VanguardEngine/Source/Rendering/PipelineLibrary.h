@@ -0,0 +1,40 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Threading/CriticalSection.h>
+
+#include <Core/Windows/DirectX12Minimal.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+class RenderDevice;
+
+// Persists compiled pipeline states across launches, so pipelines are loaded instead of compiled by the driver. Pipelines
+// are stored by name, the key must change whenever anything in the pipeline's description does.
+class PipelineLibrary
+{
+private:
+	RenderDevice* device = nullptr;
+	ResourcePtr<ID3D12PipelineLibrary1> library;  // Null if pipeline libraries aren't supported.
+	std::vector<uint8_t> serializedLibrary;  // Backs the library, must outlive it.
+	bool dirty = false;  // Pipelines were stored since loading.
+	CriticalSection libraryLock;  // Pipelines are built from several threads.
+
+	std::filesystem::path GetLibraryPath() const;
+	void CreateLibrary(const void* data, size_t size);
+	static std::wstring GetPipelineName(size_t key);
+
+public:
+	void Initialize(RenderDevice* inDevice);
+	void Save();
+
+	// Returns null if the pipeline isn't stored.
+	ResourcePtr<ID3D12PipelineState> Load(size_t key, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& description);
+	ResourcePtr<ID3D12PipelineState> Load(size_t key, const D3D12_COMPUTE_PIPELINE_STATE_DESC& description);
+	ResourcePtr<ID3D12PipelineState> Load(size_t key, const D3D12_PIPELINE_STATE_STREAM_DESC& description);
+	void Store(size_t key, ID3D12PipelineState* pipeline);
+};
\ No newline at end of file
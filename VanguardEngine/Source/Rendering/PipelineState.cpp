@@ -2,7 +2,11 @@
 
 #include <Rendering/PipelineState.h>
 #include <Rendering/Device.h>
+#include <Rendering/PipelineLibrary.h>
+#include <Rendering/ShaderStructs.h>
 #include <Core/Config.h>
+#include <Utility/HashCombine.h>
+#include <Utility/StringTools.h>
 
 #include <algorithm>
 #include <cctype>
@@ -10,12 +14,63 @@
 #include <sstream>
 #include <vector>
 #include <limits>
+#include <cstddef>
+
+namespace
+{
+	// Pipeline state stream subobjects must be pointer aligned.
+	template <D3D12_PIPELINE_STATE_SUBOBJECT_TYPE Type, typename T>
+	struct alignas(void*) PipelineStreamSubobject
+	{
+		D3D12_PIPELINE_STATE_SUBOBJECT_TYPE type = Type;
+		T value;
+	};
+
+	// The only input assembler data is the batch offset of mesh draws, fetched once per draw from the draw's own indirect
+	// argument, see MeshSystem::BindArguments(). Vertex shaders that don't declare it ignore it.
+	constexpr D3D12_INPUT_ELEMENT_DESC batchElement{
+		.SemanticName = "BATCH",
+		.SemanticIndex = 0,
+		.Format = DXGI_FORMAT_R32_UINT,
+		.InputSlot = 0,
+		.AlignedByteOffset = offsetof(MeshIndirectArgument, batchId),
+		.InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA,
+		.InstanceDataStepRate = std::numeric_limits<UINT>::max()  // Never steps within a draw.
+	};
+
+	D3D12_SHADER_BYTECODE GetBytecode(const std::unique_ptr<Shader>& shader)
+	{
+		return { shader ? shader->bytecode.data() : nullptr, shader ? shader->bytecode.size() : 0 };
+	}
+
+	size_t HashBytecode(const std::unique_ptr<Shader>& shader)
+	{
+		return shader ? std::hash<std::string_view>{}(std::string_view{ reinterpret_cast<const char*>(shader->bytecode.data()), shader->bytecode.size() }) : 0;
+	}
+}
+
+void PipelineState::CreateLibraryKey(std::optional<size_t> inCacheKey)
+{
+	libraryKey = inCacheKey;
+	if (libraryKey)
+	{
+		HashCombine(*libraryKey, HashBytecode(vertexShader), HashBytecode(pixelShader), HashBytecode(computeShader), HashBytecode(amplificationShader), HashBytecode(meshShader));
+		HashCombine(*libraryKey, std::string_view{ batchElement.SemanticName }, batchElement.AlignedByteOffset);  // Part of every graphics description.
+	}
+}
+
+const std::vector<uint8_t>& PipelineState::GetRootSignatureData() const
+{
+	if (vertexShader) return vertexShader->bytecode;
+	if (meshShader) return meshShader->bytecode;
+	return computeShader->bytecode;
+}
 
 void PipelineState::ReflectRootSignature()
 {
 	ResourcePtr<ID3D12RootSignatureDeserializer> deserializer;
 
-	const auto& rootSignatureData = vertexShader ? vertexShader->bytecode : computeShader->bytecode;
+	const auto& rootSignatureData = GetRootSignatureData();
 
 	const auto result = D3D12CreateRootSignatureDeserializer(rootSignatureData.data(), rootSignatureData.size(), IID_PPV_ARGS(deserializer.Indirect()));
 	if (FAILED(result))
@@ -32,6 +87,7 @@ void PipelineState::ReflectRootSignature()
 
 		size_t shaderRegister = 0;
 		size_t shaderSpace = 0;
+		size_t constantCount = 0;
 		PipelineStateReflection::ResourceBindType type;
 
 		switch (parameter.ParameterType)
@@ -39,6 +95,7 @@ void PipelineState::ReflectRootSignature()
 		case D3D12_ROOT_PARAMETER_TYPE::D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS:
 			shaderRegister = parameter.Constants.ShaderRegister;
 			shaderSpace = parameter.Constants.RegisterSpace;
+			constantCount = parameter.Constants.Num32BitValues;
 			type = PipelineStateReflection::ResourceBindType::RootConstants;
 			break;
 		case D3D12_ROOT_PARAMETER_TYPE::D3D12_ROOT_PARAMETER_TYPE_CBV:
@@ -117,9 +174,12 @@ void PipelineState::ReflectRootSignature()
 
 					else
 					{
-						reflection.resourceIndexMap[binding.name] = { type, static_cast<size_t>(i) };
+						reflection.resourceIndexMap[binding.name] = { type, static_cast<size_t>(i), constantCount };
 					}
 
+					auto& metadata = reflection.resourceIndexMap[binding.name];
+					metadata.constantsSize = std::max(metadata.constantsSize, binding.size);
+
 #if !BUILD_DEBUG
 					break;  // Stop iterating after the first binding, only do this in release for validation purposes.
 #endif
@@ -133,6 +193,8 @@ void PipelineState::ReflectRootSignature()
 			MatchShaderBindings(vertexShader);
 			MatchShaderBindings(pixelShader);
 			MatchShaderBindings(computeShader);
+			MatchShaderBindings(amplificationShader);
+			MatchShaderBindings(meshShader);
 			break;
 		case D3D12_SHADER_VISIBILITY_VERTEX:
 			MatchShaderBindings(vertexShader);
@@ -140,11 +202,36 @@ void PipelineState::ReflectRootSignature()
 		case D3D12_SHADER_VISIBILITY_PIXEL:
 			MatchShaderBindings(pixelShader);
 			break;
+		case D3D12_SHADER_VISIBILITY_AMPLIFICATION:
+			MatchShaderBindings(amplificationShader);
+			break;
+		case D3D12_SHADER_VISIBILITY_MESH:
+			MatchShaderBindings(meshShader);
+			break;
 		}
 	}
+
+	reflection.bindSlots.clear();
+	for (const auto& [name, metadata] : reflection.resourceIndexMap)
+	{
+		// HLSL packing starts every struct member on a new 16 byte register, which can quietly push bind data past the
+		// root constants.
+		if (metadata.type == PipelineStateReflection::ResourceBindType::RootConstants && metadata.constantsSize > metadata.constantCount * sizeof(uint32_t))
+		{
+			const auto& shaderPath = computeShader ? computeDescription.shader.first : meshShader ? graphicsDescription.meshShader.first : graphicsDescription.vertexShader.first;
+			VGLogError(logRendering, "Bind data '{}' of '{}' is {} bytes, larger than the {} bytes of root constants.", Str2WideStr(name), shaderPath.generic_wstring(),
+				metadata.constantsSize, metadata.constantCount * sizeof(uint32_t));
+		}
+
+		const auto hash = HashBindName(name);
+		VGAssert(std::none_of(reflection.bindSlots.begin(), reflection.bindSlots.end(), [hash](const auto& slot) { return slot.first == hash; }),
+			"Bind name hash collision for '%s'.", name.c_str());
+
+		reflection.bindSlots.emplace_back(hash, metadata);
+	}
 }
 
-void PipelineState::CreateShaders(RenderDevice& device, const std::vector<ShaderMacro>& macros)
+bool PipelineState::CreateShaders(RenderDevice& device, const std::vector<ShaderMacro>& macros)
 {
 	VGScopedCPUStat("Create Shaders");
 
@@ -154,19 +241,41 @@ void PipelineState::CreateShaders(RenderDevice& device, const std::vector<Shader
 	{
 		if (!graphicsDescription.vertexShader.first.empty()) vertexShader = std::move(CompileShader(shadersPath / graphicsDescription.vertexShader.first, ShaderType::Vertex, graphicsDescription.vertexShader.second, macros));
 		if (!graphicsDescription.pixelShader.first.empty()) pixelShader = std::move(CompileShader(shadersPath / graphicsDescription.pixelShader.first, ShaderType::Pixel, graphicsDescription.pixelShader.second, macros));
+		if (!graphicsDescription.amplificationShader.first.empty()) amplificationShader = std::move(CompileShader(shadersPath / graphicsDescription.amplificationShader.first, ShaderType::Amplification, graphicsDescription.amplificationShader.second, macros));
+		if (!graphicsDescription.meshShader.first.empty()) meshShader = std::move(CompileShader(shadersPath / graphicsDescription.meshShader.first, ShaderType::Mesh, graphicsDescription.meshShader.second, macros));
+
+		return (graphicsDescription.vertexShader.first.empty() || vertexShader)
+			&& (graphicsDescription.pixelShader.first.empty() || pixelShader)
+			&& (graphicsDescription.amplificationShader.first.empty() || amplificationShader)
+			&& (graphicsDescription.meshShader.first.empty() || meshShader);
 	}
 
 	else
 	{
 		computeShader = std::move(CompileShader(shadersPath / computeDescription.shader.first, ShaderType::Compute, computeDescription.shader.second, macros));
+
+		return computeShader != nullptr;
 	}
 }
 
+bool PipelineState::SourcesChanged() const
+{
+	for (const auto* shader : { vertexShader.get(), pixelShader.get(), computeShader.get(), amplificationShader.get(), meshShader.get() })
+	{
+		if (shader && shader->SourcesChanged())
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 void PipelineState::CreateRootSignature(RenderDevice& device)
 {
 	VGScopedCPUStat("Create Root Signature");
 
-	const auto& rootSignatureData = vertexShader ? vertexShader->bytecode : computeShader->bytecode;
+	const auto& rootSignatureData = GetRootSignatureData();
 
 	const auto result = device.Native()->CreateRootSignature(0, rootSignatureData.data(), rootSignatureData.size(), IID_PPV_ARGS(rootSignature.Indirect()));
 	if (FAILED(result))
@@ -177,23 +286,39 @@ void PipelineState::CreateRootSignature(RenderDevice& device)
 	ReflectRootSignature();
 }
 
-void PipelineState::Build(RenderDevice& device, const GraphicsPipelineStateDescription& inDescription)
+void PipelineState::Build(RenderDevice& device, const GraphicsPipelineStateDescription& inDescription, std::optional<size_t> inCacheKey)
 {
 	VGScopedCPUStat("Build Pipeline");
 
 	graphicsDescription = inDescription;
+	cacheKey = inCacheKey;
+
+	const auto compiled = CreateShaders(device, inDescription.macros);
+	CreateLibraryKey(cacheKey);
 
-	CreateShaders(device, inDescription.macros);
+	if (!vertexShader && !meshShader)
+	{
+		VGLogError(logRendering, "Missing required vertex or mesh shader for graphics pipeline state.");
 
-	if (!vertexShader)
+		return;
+	}
+
+	if (!compiled)
 	{
-		VGLogError(logRendering, "Missing required vertex shader for graphics pipeline state.");
+		VGLogError(logRendering, "Failed to compile shaders for graphics pipeline state.");
 
 		return;
 	}
 
 	CreateRootSignature(device);
 
+	if (meshShader)
+	{
+		BuildMeshPipeline(device);
+
+		return;
+	}
+
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC graphicsDesc{};
 	graphicsDesc.pRootSignature = rootSignature.Get();
 	graphicsDesc.VS = { vertexShader->bytecode.data(), vertexShader->bytecode.size() };
@@ -203,7 +328,7 @@ void PipelineState::Build(RenderDevice& device, const GraphicsPipelineStateDescr
 	graphicsDesc.SampleMask = std::numeric_limits<UINT>::max();
 	graphicsDesc.RasterizerState = graphicsDescription.rasterizerDescription;
 	graphicsDesc.DepthStencilState = graphicsDescription.depthStencilDescription;
-	graphicsDesc.InputLayout = { nullptr, 0 };  // We aren't using the input assembler, use programmable vertex pulling.
+	graphicsDesc.InputLayout = { &batchElement, 1 };  // Vertices use programmable vertex pulling.
 	graphicsDesc.IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED;  // Don't support strip topology cuts.
 	switch (graphicsDescription.topology)  // #TODO: Support patch topology, which is needed for hull and domain shaders.
 	{
@@ -219,35 +344,136 @@ void PipelineState::Build(RenderDevice& device, const GraphicsPipelineStateDescr
 	graphicsDesc.DSVFormat = inDescription.depthStencilFormat;
 	graphicsDesc.SampleDesc = { 1, 0 };  // #TODO: Support multi-sampling.
 	graphicsDesc.NodeMask = 0;
-	graphicsDesc.CachedPSO = { nullptr, 0 };  // #TODO: Pipeline caching.
+	graphicsDesc.CachedPSO = { nullptr, 0 };  // Cached through the pipeline library instead.
 	graphicsDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;  // #TODO: Add debugging flag if we're a software adapter.
 
+	if (libraryKey)
+	{
+		pipeline = device.GetPipelineLibrary().Load(*libraryKey, graphicsDesc);
+		if (pipeline)
+		{
+			return;
+		}
+	}
+
 	const auto result = device.Native()->CreateGraphicsPipelineState(&graphicsDesc, IID_PPV_ARGS(pipeline.Indirect()));
 	if (FAILED(result))
 	{
 		VGLogCritical(logRendering, "Failed to create graphics pipeline state: {}", result);
 	}
+
+	if (libraryKey)
+	{
+		device.GetPipelineLibrary().Store(*libraryKey, pipeline.Get());
+	}
 }
 
-void PipelineState::Build(RenderDevice& device, const ComputePipelineStateDescription& inDescription)
+void PipelineState::BuildMeshPipeline(RenderDevice& device)
+{
+	// Mesh shader pipelines can only be created from a pipeline state stream.
+	struct
+	{
+		PipelineStreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_ROOT_SIGNATURE, ID3D12RootSignature*> rootSignature;
+		PipelineStreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_AS, D3D12_SHADER_BYTECODE> amplificationShader;
+		PipelineStreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_MS, D3D12_SHADER_BYTECODE> meshShader;
+		PipelineStreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PS, D3D12_SHADER_BYTECODE> pixelShader;
+		PipelineStreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_BLEND, D3D12_BLEND_DESC> blend;
+		PipelineStreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_SAMPLE_MASK, UINT> sampleMask;
+		PipelineStreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RASTERIZER, D3D12_RASTERIZER_DESC> rasterizer;
+		PipelineStreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL, D3D12_DEPTH_STENCIL_DESC> depthStencil;
+		PipelineStreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_PRIMITIVE_TOPOLOGY, D3D12_PRIMITIVE_TOPOLOGY_TYPE> topology;
+		PipelineStreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_RENDER_TARGET_FORMATS, D3D12_RT_FORMAT_ARRAY> renderTargetFormats;
+		PipelineStreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_DEPTH_STENCIL_FORMAT, DXGI_FORMAT> depthStencilFormat;
+		PipelineStreamSubobject<D3D12_PIPELINE_STATE_SUBOBJECT_TYPE_SAMPLE_DESC, DXGI_SAMPLE_DESC> sampleDesc;
+	} stream;
+
+	stream.rootSignature.value = rootSignature.Get();
+	stream.amplificationShader.value = GetBytecode(amplificationShader);
+	stream.meshShader.value = GetBytecode(meshShader);
+	stream.pixelShader.value = GetBytecode(pixelShader);
+	stream.blend.value = graphicsDescription.blendDescription;
+	stream.sampleMask.value = std::numeric_limits<UINT>::max();
+	stream.rasterizer.value = graphicsDescription.rasterizerDescription;
+	stream.depthStencil.value = graphicsDescription.depthStencilDescription;
+	stream.topology.value = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;  // Mesh shaders only output triangles here.
+	stream.renderTargetFormats.value.NumRenderTargets = graphicsDescription.renderTargetCount;
+	std::copy(std::begin(graphicsDescription.renderTargetFormats), std::end(graphicsDescription.renderTargetFormats), std::begin(stream.renderTargetFormats.value.RTFormats));
+	stream.depthStencilFormat.value = graphicsDescription.depthStencilFormat;
+	stream.sampleDesc.value = { 1, 0 };  // #TODO: Support multi-sampling.
+
+	D3D12_PIPELINE_STATE_STREAM_DESC streamDesc{
+		.SizeInBytes = sizeof(stream),
+		.pPipelineStateSubobjectStream = &stream
+	};
+
+	if (libraryKey)
+	{
+		pipeline = device.GetPipelineLibrary().Load(*libraryKey, streamDesc);
+		if (pipeline)
+		{
+			return;
+		}
+	}
+
+	const auto result = device.Native()->CreatePipelineState(&streamDesc, IID_PPV_ARGS(pipeline.Indirect()));
+	if (FAILED(result))
+	{
+		VGLogCritical(logRendering, "Failed to create mesh shader pipeline state: {}", result);
+	}
+
+	if (libraryKey)
+	{
+		device.GetPipelineLibrary().Store(*libraryKey, pipeline.Get());
+	}
+}
+
+void PipelineState::Build(RenderDevice& device, const ComputePipelineStateDescription& inDescription, std::optional<size_t> inCacheKey)
 {
 	VGScopedCPUStat("Build Pipeline");
 
 	computeDescription = inDescription;
+	cacheKey = inCacheKey;
 
-	CreateShaders(device, inDescription.macros);
+	auto macros = inDescription.macros;
+	if (inDescription.waveSpecialized && device.GetWaveSize() > 0)
+	{
+		macros.emplace_back("WAVE_SIZE", device.GetWaveSize());
+	}
+
+	if (!CreateShaders(device, macros))
+	{
+		VGLogError(logRendering, "Failed to compile shader for compute pipeline state.");
+
+		return;
+	}
+
+	CreateLibraryKey(cacheKey);
 	CreateRootSignature(device);
 
 	D3D12_COMPUTE_PIPELINE_STATE_DESC computeDesc{};
 	computeDesc.pRootSignature = rootSignature.Get();
 	computeDesc.CS = { computeShader->bytecode.data(), computeShader->bytecode.size() };
 	computeDesc.NodeMask = 0;
-	computeDesc.CachedPSO = { nullptr, 0 };  // #TODO: Pipeline caching.
+	computeDesc.CachedPSO = { nullptr, 0 };  // Cached through the pipeline library instead.
 	computeDesc.Flags = D3D12_PIPELINE_STATE_FLAG_NONE;  // #TODO: Add debugging flag if we're a software adapter.
 
+	if (libraryKey)
+	{
+		pipeline = device.GetPipelineLibrary().Load(*libraryKey, computeDesc);
+		if (pipeline)
+		{
+			return;
+		}
+	}
+
 	const auto result = device.Native()->CreateComputePipelineState(&computeDesc, IID_PPV_ARGS(pipeline.Indirect()));
 	if (FAILED(result))
 	{
 		VGLogCritical(logRendering, "Failed to create compute pipeline state: {}", result);
 	}
+
+	if (libraryKey)
+	{
+		device.GetPipelineLibrary().Store(*libraryKey, pipeline.Get());
+	}
 }
\ No newline at end of file
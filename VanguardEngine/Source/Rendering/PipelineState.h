@@ -5,11 +5,13 @@
 #include <Rendering/Base.h>
 #include <Rendering/Shader.h>
 #include <Rendering/ShaderMacro.h>
+#include <Rendering/BindSlot.h>
 
 #include <Core/Windows/DirectX12Minimal.h>
 
 #include <filesystem>
 #include <map>
+#include <optional>
 #include <utility>
 #include <vector>
 
@@ -19,6 +21,9 @@ struct GraphicsPipelineStateDescription
 {
 	std::pair<std::filesystem::path, std::string> vertexShader;
 	std::pair<std::filesystem::path, std::string> pixelShader;
+	// Mesh shader pipelines replace the vertex shader, the amplification shader is optional.
+	std::pair<std::filesystem::path, std::string> amplificationShader;
+	std::pair<std::filesystem::path, std::string> meshShader;
 	std::vector<ShaderMacro> macros;
 	D3D12_BLEND_DESC blendDescription;
 	D3D12_RASTERIZER_DESC rasterizerDescription;
@@ -33,6 +38,7 @@ struct ComputePipelineStateDescription
 {
 	std::pair<std::filesystem::path, std::string> shader;
 	std::vector<ShaderMacro> macros;
+	bool waveSpecialized = false;  // Compiled with WAVE_SIZE defined as the device's preferred wave size, if it has one.
 };
 
 struct PipelineStateReflection
@@ -49,11 +55,28 @@ struct PipelineStateReflection
 	{
 		ResourceBindType type;
 		size_t signatureIndex;
+		size_t constantCount = 0;  // 32 bit values available to root constants.
+		size_t constantsSize = 0;  // Bytes of root constants read by the largest shader stage.
 	};
 
 	// Maps shader resource bind names to bind metadata, generated from the compiled
 	// shaders and the deserialized root signature.
 	std::map<std::string, ResourceBindMetadata> resourceIndexMap;
+	// Flattened copy of the index map keyed by bind name hash, pipelines only have a handful of binds.
+	std::vector<std::pair<uint32_t, ResourceBindMetadata>> bindSlots;
+
+	const ResourceBindMetadata* FindBind(BindSlot slot) const
+	{
+		for (const auto& [hash, metadata] : bindSlots)
+		{
+			if (hash == slot.hash)
+			{
+				return &metadata;
+			}
+		}
+
+		return nullptr;
+	}
 };
 
 class PipelineState
@@ -65,22 +88,38 @@ private:
 	GraphicsPipelineStateDescription graphicsDescription;
 	ComputePipelineStateDescription computeDescription;
 	PipelineStateReflection reflection;
+	std::optional<size_t> cacheKey;
+	std::optional<size_t> libraryKey;  // Name in the device's pipeline library, if cached.
 
+	const std::vector<uint8_t>& GetRootSignatureData() const;  // Root signatures are embedded in the shaders.
 	void ReflectRootSignature();
 
-	void CreateShaders(RenderDevice& device, const std::vector<ShaderMacro>& macros);
+	bool CreateShaders(RenderDevice& device, const std::vector<ShaderMacro>& macros);  // False if any stage failed to compile.
 	void CreateRootSignature(RenderDevice& device);
+	void BuildMeshPipeline(RenderDevice& device);
+	// Combines the caller's key with the compiled shaders, so edited shaders don't load stale pipelines.
+	void CreateLibraryKey(std::optional<size_t> inCacheKey);
 
 public:
 	ResourcePtr<ID3D12RootSignature> rootSignature;
 	std::unique_ptr<Shader> vertexShader;
 	std::unique_ptr<Shader> pixelShader;
 	std::unique_ptr<Shader> computeShader;
+	std::unique_ptr<Shader> amplificationShader;
+	std::unique_ptr<Shader> meshShader;
 
 	auto* Native() const noexcept { return pipeline.Get(); }
+	bool IsGraphics() const noexcept { return vertexShader || meshShader; }
 
 	auto* GetReflectionData() const noexcept { return &reflection; }
+	const auto& GetGraphicsDescription() const noexcept { return graphicsDescription; }
+	const auto& GetComputeDescription() const noexcept { return computeDescription; }
+	auto GetCacheKey() const noexcept { return cacheKey; }
+
+	// True if any shader's sources were written since the pipeline was built.
+	bool SourcesChanged() const;
 
-	void Build(RenderDevice& device, const GraphicsPipelineStateDescription& inDescription);
-	void Build(RenderDevice& device, const ComputePipelineStateDescription& inDescription);
+	// The cache key identifies the description (including output formats) in the pipeline library, uncached if empty.
+	void Build(RenderDevice& device, const GraphicsPipelineStateDescription& inDescription, std::optional<size_t> inCacheKey = std::nullopt);
+	void Build(RenderDevice& device, const ComputePipelineStateDescription& inDescription, std::optional<size_t> inCacheKey = std::nullopt);
 };
\ No newline at end of file
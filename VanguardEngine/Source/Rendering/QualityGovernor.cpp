@@ -0,0 +1,194 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/QualityGovernor.h>
+#include <Rendering/Device.h>
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+
+float QualityGovernor::GetValue(const Knob& knob) const
+{
+	return std::visit([](const auto& cvar) { return static_cast<float>(*cvar); }, knob.cvar);
+}
+
+void QualityGovernor::SetLevel(Knob& knob, size_t level)
+{
+	knob.level = level;
+
+	std::visit([&knob](const auto& cvar)
+	{
+		using T = std::decay_t<decltype(*cvar)>;
+		CvarManager::Get().SetVariable(entt::hashed_string{ knob.name }, static_cast<T>(knob.levels[knob.level]));
+		knob.generation = cvar.Generation();
+	}, knob.cvar);
+}
+
+void QualityGovernor::Capture(Knob& knob)
+{
+	const auto ceiling = GetValue(knob);
+
+	// The ladder is ordered by quality, which can run in either direction of the values.
+	const auto descending = knob.ladder.front() > knob.ladder.back();
+	knob.levels = { ceiling };
+	for (const auto value : knob.ladder)
+	{
+		if (descending ? value < ceiling : value > ceiling)
+		{
+			knob.levels.emplace_back(value);
+		}
+	}
+
+	knob.level = 0;
+	knob.generation = std::visit([](const auto& cvar) { return cvar.Generation(); }, knob.cvar);
+}
+
+void QualityGovernor::Restore()
+{
+	for (auto& knob : knobs)
+	{
+		if (knob.level > 0)
+		{
+			SetLevel(knob, 0);
+		}
+	}
+
+	lowered.clear();
+}
+
+void QualityGovernor::Initialize()
+{
+	enabled = CvarCreate("qualityGovernor", "Lowers the quality of expensive effects to keep the GPU frame time at the target, restoring it once "
+		"there's headroom, 0=disabled, 1=enabled", 0);
+	target = CvarCreate("qualityGovernorTarget", "GPU frame time targeted by the quality governor, in milliseconds", 16.6f);
+
+	// In the order effects are lowered when the pass timings aren't available.
+	knobs.push_back({ "cloudRenderScale", CvarGetHandle("cloudRenderScale", float), { 0.5f, 0.375f, 0.25f, 0.1875f, 0.125f },
+		{ "Clouds Pass", "Clouds Tile Classification", "Clouds Upscale Pass" } });
+	knobs.push_back({ "cloudRayMarchQuality", CvarGetHandle("cloudRayMarchQuality", int), { 2.f, 1.f, 0.f }, { "Clouds Pass" } });
+	knobs.push_back({ "environmentUpdatePeriod", CvarGetHandle("environmentUpdatePeriod", int), { 1.f, 2.f, 4.f, 8.f },
+		{ "Atmosphere Luminance Pass", "IBL Irradiance Pass", "IBL Prefilter Pass" } });
+	knobs.push_back({ "bloomMipCount", CvarGetHandle("bloomMipCount", int), { 6.f, 5.f, 4.f, 3.f }, { "Bloom Downsample Pass", "Bloom Upsample Pass" } });
+	knobs.push_back({ "maxLightsPerFroxel", CvarGetHandle("maxLightsPerFroxel", int), { 512.f, 256.f, 128.f, 64.f }, { "Light Binning" } });
+}
+
+void QualityGovernor::Update(RenderDevice& device)
+{
+	if (!*enabled)
+	{
+		if (governing)
+		{
+			Restore();
+			governing = false;
+		}
+
+		return;
+	}
+
+	if (!governing)
+	{
+		for (auto& knob : knobs)
+		{
+			Capture(knob);
+		}
+
+		governing = true;
+		frameTime = 0.f;
+		headroomFrames = 0;
+	}
+
+	// Values set from elsewhere, such as the console or memory pressure, become the knob's new ceiling.
+	for (size_t i = 0; i < knobs.size(); ++i)
+	{
+		auto& knob = knobs[i];
+		if (std::visit([&knob](const auto& cvar) { return cvar.Changed(knob.generation); }, knob.cvar))
+		{
+			Capture(knob);
+			std::erase(lowered, i);
+		}
+	}
+
+	const auto gpuTime = device.GetGPUFrameTime();
+	if (gpuTime <= 0.f)
+	{
+		return;
+	}
+
+	frameTime = frameTime > 0.f ? std::lerp(frameTime, gpuTime, 0.1f) : gpuTime;
+
+	if (cooldown > 0)
+	{
+		--cooldown;
+		return;
+	}
+
+	const auto budget = *target;
+	if (frameTime > budget)
+	{
+		headroomFrames = 0;
+
+		const auto statistics = device.GetProfiler().GetStatistics();
+		const auto Cost = [&statistics](const Knob& knob)
+		{
+			float cost = 0.f;
+			for (const auto& pass : statistics)
+			{
+				if (std::find(knob.passes.begin(), knob.passes.end(), pass.name) != knob.passes.end())
+				{
+					cost += pass.medianTime;
+				}
+			}
+
+			return cost;
+		};
+
+		// The most expensive knob with a level left, ties keep the declared order.
+		std::optional<size_t> selected;
+		float selectedCost = -1.f;
+		for (size_t i = 0; i < knobs.size(); ++i)
+		{
+			if (knobs[i].level + 1 >= knobs[i].levels.size())
+			{
+				continue;
+			}
+
+			if (const auto cost = Cost(knobs[i]); cost > selectedCost)
+			{
+				selected = i;
+				selectedCost = cost;
+			}
+		}
+
+		if (selected)
+		{
+			auto& knob = knobs[*selected];
+			SetLevel(knob, knob.level + 1);
+			lowered.emplace_back(*selected);
+
+			VGLog(logRendering, "Quality governor lowered '{}' to {} at {:.2f} ms.", Str2WideStr(knob.name), knob.levels[knob.level], frameTime);
+
+			// Wait for frames rendered at the new level to retire and be smoothed in before measuring again.
+			cooldown = RenderDevice::frameCount + settleFrames;
+		}
+	}
+
+	else if (frameTime < budget * restoreHeadroom && !lowered.empty())
+	{
+		if (++headroomFrames >= restoreFrames)
+		{
+			auto& knob = knobs[lowered.back()];
+			lowered.pop_back();
+			SetLevel(knob, knob.level - 1);
+
+			VGLog(logRendering, "Quality governor restored '{}' to {} at {:.2f} ms.", Str2WideStr(knob.name), knob.levels[knob.level], frameTime);
+
+			headroomFrames = 0;
+			cooldown = RenderDevice::frameCount + settleFrames;
+		}
+	}
+
+	else
+	{
+		headroomFrames = 0;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Core/ConsoleVariable.h>
+
+#include <variant>
+#include <vector>
+#include <string_view>
+
+class RenderDevice;
+
+// Holds the GPU frame time at a budget by stepping the quality cvars of expensive effects, alongside dynamic resolution.
+// Each knob steps down a fixed ladder, starting from the value it had when the governor took it over. The knob whose passes
+// cost the most is lowered first, and knobs are restored in the reverse order once the frame has held enough headroom.
+// Setting a knob's cvar while governed makes the new value its ceiling.
+class QualityGovernor
+{
+	struct Knob
+	{
+		const char* name;
+		std::variant<CvarHandle<int>, CvarHandle<float>> cvar;
+		std::vector<float> ladder;  // Quality levels from the highest to the lowest, integer cvars take them as is.
+		std::vector<std::string_view> passes;  // Stable names of the passes the knob's cost is measured from.
+		std::vector<float> levels;  // The ceiling followed by the lower ladder levels.
+		size_t level = 0;
+		size_t generation = 0;  // Of the cvar when last set by the governor.
+	};
+
+	static constexpr float restoreHeadroom = 0.8f;  // Of the target, below which quality is restored.
+	static constexpr uint32_t restoreFrames = 60;  // Headroom has to hold this long, otherwise restoring would oscillate.
+	static constexpr uint32_t settleFrames = 8;  // After a step, on top of the frames still in flight.
+
+	std::vector<Knob> knobs;
+	std::vector<size_t> lowered;  // Knob of each step down, restored last to first.
+	CvarHandle<int> enabled;
+	CvarHandle<float> target;
+	float frameTime = 0.f;  // Smoothed, single frames are too noisy to step on.
+	uint32_t cooldown = 0;
+	uint32_t headroomFrames = 0;
+	bool governing = false;
+
+	float GetValue(const Knob& knob) const;
+	void SetLevel(Knob& knob, size_t level);
+	void Capture(Knob& knob);
+	void Restore();
+
+public:
+	// The knobs' cvars must have been created.
+	void Initialize();
+	void Update(RenderDevice& device);
+};
\ No newline at end of file
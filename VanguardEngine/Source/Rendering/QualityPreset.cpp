@@ -0,0 +1,97 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/QualityPreset.h>
+#include <Rendering/Device.h>
+#include <Core/Config.h>
+#include <Core/ConsoleVariable.h>
+
+#include <array>
+
+namespace
+{
+	struct QualitySettings
+	{
+		const char* name;
+		float cloudRenderScale;
+		int cloudRayMarchQuality;
+		int maxLightsPerFroxel;
+		int clusteredFroxelSize;
+		int shadowResolution;
+		int screenSpaceAO;
+		int screenSpaceReflections;
+		int volumetricFog;
+	};
+
+	// Indexed by QualityPreset.
+	constexpr std::array<QualitySettings, 4> presets = {
+		QualitySettings{ "Low", 0.125f, 0, 64, 128, 1024, 0, 0, 0 },
+		QualitySettings{ "Medium", 0.2f, 1, 128, 64, 2048, 1, 0, 1 },
+		QualitySettings{ "High", 0.25f, 1, 256, 64, 2048, 1, 1, 1 },
+		QualitySettings{ "Ultra", 0.5f, 1, 512, 32, 4096, 1, 1, 1 }
+	};
+
+	constexpr size_t gigabyte = 1024ull * 1024 * 1024;
+
+	const wchar_t* GetVendorName(uint32_t vendorId)
+	{
+		switch (vendorId)
+		{
+		case 0x1002: return VGText("AMD");
+		case 0x10DE: return VGText("NVIDIA");
+		case 0x8086: return VGText("Intel");
+		case 0x1414: return VGText("Microsoft");
+		default: return VGText("unknown vendor");
+		}
+	}
+}
+
+QualityPreset SelectQualityPreset(const RenderDevice& device)
+{
+	for (size_t i = 0; i < presets.size(); ++i)
+	{
+		if (Config::qualityPreset == presets[i].name)
+		{
+			VGLog(logRendering, "Using the {} quality preset from the engine config.", Str2WideStr(Config::qualityPreset));
+
+			return static_cast<QualityPreset>(i);
+		}
+	}
+
+	if (Config::qualityPreset != "Auto")
+	{
+		VGLogWarning(logRendering, "Unknown quality preset '{}' in the engine config, picking one for the adapter.", Str2WideStr(Config::qualityPreset));
+	}
+
+	const auto& adapter = device.GetAdapter();
+	const auto memory = adapter.GetDedicatedVideoMemory();
+
+	// Integrated adapters share system memory and report little or none as dedicated, which puts them on the low preset
+	// along with software adapters. Ultra needs the memory for its larger shadow atlas and light lists, and the hardware
+	// generation that brings ray tracing and mesh shaders for the frame time.
+	auto preset = QualityPreset::High;
+	if (adapter.IsSoftware() || memory < 2 * gigabyte)
+		preset = QualityPreset::Low;
+	else if (memory < 4 * gigabyte)
+		preset = QualityPreset::Medium;
+	else if (memory >= 8 * gigabyte && device.SupportsRaytracing() && device.SupportsMeshShaders())
+		preset = QualityPreset::Ultra;
+
+	VGLog(logRendering, "Using the {} quality preset for {} with {} MB of dedicated video memory.", Str2WideStr(presets[static_cast<size_t>(preset)].name),
+		GetVendorName(adapter.GetVendorId()), memory / (1024 * 1024));
+
+	return preset;
+}
+
+void ApplyQualityPreset(QualityPreset preset)
+{
+	const auto& settings = presets[static_cast<size_t>(preset)];
+
+	CvarSet("cloudRenderScale", settings.cloudRenderScale);
+	CvarSet("cloudRayMarchQuality", settings.cloudRayMarchQuality);
+	CvarSet("maxLightsPerFroxel", settings.maxLightsPerFroxel);
+	CvarSet("clusteredFroxelSize", settings.clusteredFroxelSize);
+	CvarSet("shadowResolution", settings.shadowResolution);
+	CvarSet("screenSpaceAO", settings.screenSpaceAO);
+	CvarSet("screenSpaceReflections", settings.screenSpaceReflections);
+	CvarSet("volumetricFog", settings.volumetricFog);
+}
\ No newline at end of file
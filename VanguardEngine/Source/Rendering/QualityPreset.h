@@ -0,0 +1,18 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+class RenderDevice;
+
+enum class QualityPreset
+{
+	Low,
+	Medium,
+	High,  // The quality cvars' own defaults.
+	Ultra,
+};
+
+// Named by the engine config, otherwise picked from the adapter's dedicated memory and the device's feature support.
+QualityPreset SelectQualityPreset(const RenderDevice& device);
+// Overrides the quality cvars, once the subsystems created them. Cvars changed later keep their new values.
+void ApplyQualityPreset(QualityPreset preset);
\ No newline at end of file
@@ -0,0 +1,513 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/RayTracingScene.h>
+#include <Rendering/Device.h>
+#include <Rendering/MeshFactory.h>
+#include <Rendering/RenderGraph.h>
+#include <Rendering/RenderPass.h>
+#include <Rendering/CommandList.h>
+#include <Core/ConsoleVariable.h>
+#include <Utility/AlignedSize.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+namespace
+{
+	constexpr size_t structureAlignment = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT;
+
+	// Quantized positions are unit range within the mesh bounds, the instance transform scales them back.
+	XMMATRIX GetDequantizeMatrix(const MeshComponent& mesh)
+	{
+		if ((mesh.metadata.quantizedChannels & (1 << vertexChannelPosition)) == 0)
+			return XMMatrixIdentity();
+
+		const auto& extent = mesh.metadata.positionExtent;
+		const auto& minimum = mesh.metadata.positionMin;
+
+		return XMMatrixScaling(extent.x, extent.y, extent.z) * XMMatrixTranslation(minimum.x, minimum.y, minimum.z);
+	}
+
+	BufferDescription GetStructureDescription(size_t size)
+	{
+		return BufferDescription{
+			.updateRate = ResourceFrequency::Static,
+			.bindFlags = BindFlag::AccelerationStructure,
+			.accessFlags = AccessFlag::GPUWrite,
+			.size = AlignedSize(size, structureAlignment),
+			.stride = 1
+		};
+	}
+}
+
+void RayTracingScene::PatchRelocations()
+{
+	if (meshFactory->GetRevision() == meshRevision)
+		return;
+
+	meshRevision = meshFactory->GetRevision();
+
+	// Built structures keep their own copy of the geometry, only the key and the source of pending builds move.
+	std::unordered_map<size_t, entt::entity> relocated;
+	relocated.reserve(meshBottomLevels.size());
+
+	for (const auto [key, handle] : meshBottomLevels)
+	{
+		auto& bottomLevel = bottomLevels.Get(handle);
+		if (bottomLevel.references == 0)
+		{
+			ReleaseBottomLevel(handle);
+			continue;
+		}
+
+		if (const auto offset = meshFactory->GetRelocation(key))
+		{
+			bottomLevel.mesh.globalOffset = *offset;
+		}
+
+		relocated.emplace(bottomLevel.mesh.globalOffset.index, handle);
+	}
+
+	meshBottomLevels = std::move(relocated);
+}
+
+void RayTracingScene::ReleaseBottomLevel(entt::entity handle)
+{
+	auto& resourceManager = device->GetResourceManager();
+	if (const auto buffer = bottomLevels.Get(handle).buffer; resourceManager.Valid(buffer))
+	{
+		resourceManager.AddFrameResource(device->GetFrameIndex(), buffer);
+	}
+
+	bottomLevels.Erase(handle);
+}
+
+void RayTracingScene::WriteInstance(size_t slot)
+{
+	const auto& instance = instances[slot];
+	const auto& bottomLevel = bottomLevels.Get(instance.bottomLevel);
+
+	auto& desc = instanceDescs[slot];
+	XMStoreFloat3x4(reinterpret_cast<XMFLOAT3X4*>(desc.Transform), GetDequantizeMatrix(bottomLevel.mesh) * instance.worldMatrix);
+	desc.InstanceID = 0;
+	desc.InstanceMask = 0xFF;
+	desc.InstanceContributionToHitGroupIndex = 0;
+	desc.Flags = D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_CULL_DISABLE | D3D12_RAYTRACING_INSTANCE_FLAG_FORCE_OPAQUE;
+	desc.AccelerationStructure = 0;  // Resolved when uploading, the structure may not be built yet.
+
+	dirtySlots.emplace_back(static_cast<uint32_t>(slot));
+}
+
+void RayTracingScene::EnsureBuffer(BufferHandle& buffer, const BufferDescription& description, const wchar_t* name)
+{
+	auto& resourceManager = device->GetResourceManager();
+	if (resourceManager.Valid(buffer))
+	{
+		const auto& current = resourceManager.Get(buffer).description;
+		if (current.size * current.stride >= description.size * description.stride)
+			return;
+
+		// Frames in flight can still be using it.
+		resourceManager.AddFrameResource(device->GetFrameIndex(), buffer);
+	}
+
+	buffer = resourceManager.Create(description, name);
+}
+
+RayTracingScene::~RayTracingScene()
+{
+	auto& resourceManager = device->GetResourceManager();
+
+	bottomLevels.Each([&](entt::entity, const BottomLevel& bottomLevel)
+	{
+		if (resourceManager.Valid(bottomLevel.buffer))
+		{
+			resourceManager.Destroy(bottomLevel.buffer);
+		}
+	});
+
+	for (const auto buffer : { instanceBuffer, topLevel, scratchBuffer })
+	{
+		if (resourceManager.Valid(buffer))
+		{
+			resourceManager.Destroy(buffer);
+		}
+	}
+}
+
+void RayTracingScene::Initialize(RenderDevice* inDevice, MeshFactory* inMeshFactory)
+{
+	device = inDevice;
+	meshFactory = inMeshFactory;
+	meshRevision = meshFactory->GetRevision();
+}
+
+void RayTracingScene::AddInstance(entt::entity entity, const MeshComponent& mesh, const XMMATRIX& worldMatrix)
+{
+	if (mesh.subsets.empty())
+		return;
+
+	PatchRelocations();
+
+	auto iter = meshBottomLevels.find(mesh.globalOffset.index);
+	if (iter == meshBottomLevels.end())
+	{
+		iter = meshBottomLevels.emplace(mesh.globalOffset.index, bottomLevels.Insert(BottomLevel{ .mesh = mesh })).first;
+	}
+
+	++bottomLevels.Get(iter->second).references;
+
+	instanceSlots[entity] = instances.size();
+	instances.emplace_back(Instance{ .entity = entity, .bottomLevel = iter->second, .worldMatrix = worldMatrix });
+	instanceDescs.emplace_back();
+	WriteInstance(instances.size() - 1);
+	rebuild = true;
+}
+
+void RayTracingScene::RemoveInstance(entt::entity entity)
+{
+	const auto iter = instanceSlots.find(entity);
+	if (iter == instanceSlots.end())
+		return;
+
+	// Unreferenced structures are released when rendering, entities re-added with the same mesh keep theirs.
+	const auto slot = iter->second;
+	--bottomLevels.Get(instances[slot].bottomLevel).references;
+	instanceSlots.erase(iter);
+
+	if (slot + 1 < instances.size())
+	{
+		instances[slot] = instances.back();
+		instanceDescs[slot] = instanceDescs.back();
+		instanceSlots[instances[slot].entity] = slot;
+	}
+
+	instances.pop_back();
+	instanceDescs.pop_back();
+	rebuild = true;
+}
+
+void RayTracingScene::UpdateTransform(entt::entity entity, const XMMATRIX& worldMatrix)
+{
+	if (const auto iter = instanceSlots.find(entity); iter != instanceSlots.end())
+	{
+		instances[iter->second].worldMatrix = worldMatrix;
+		WriteInstance(iter->second);
+	}
+}
+
+RenderResource RayTracingScene::Render(RenderGraph& graph, const ShadowInputs& inputs)
+{
+	VGScopedCPUStat("Ray Tracing Scene");
+
+	PatchRelocations();
+
+	// Freed mesh ranges aren't reused until the frame retires, so keys of unreferenced structures are still unique here.
+	std::erase_if(meshBottomLevels, [this](const auto& entry)
+	{
+		if (bottomLevels.Get(entry.second).references > 0)
+			return false;
+
+		ReleaseBottomLevel(entry.second);
+		return true;
+	});
+
+	if (*CvarGet("shadows", int) != 3 || !device->SupportsRaytracing())
+	{
+		// Everything uploads once enabled again.
+		dirtySlots.clear();
+		rebuild = true;
+
+		return { .id = 0 };
+	}
+
+	auto& resourceManager = device->GetResourceManager();
+	const auto indexAddress = resourceManager.Get(meshFactory->indexBuffer).Native()->GetGPUVirtualAddress();
+	const auto positionAddress = resourceManager.Get(meshFactory->vertexPositionBuffer).Native()->GetGPUVirtualAddress();
+
+	struct BottomLevelBuild
+	{
+		entt::entity handle;
+		size_t firstGeometry;
+		size_t geometryCount;
+		size_t scratchOffset;
+	};
+
+	struct BottomLevelCompaction
+	{
+		BufferHandle source;
+		BufferHandle destination;
+	};
+
+	std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> geometries;
+	std::vector<BottomLevelBuild> builds;
+	std::vector<BottomLevelCompaction> compactions;
+	size_t scratchSize = 0;
+
+	for (const auto [key, handle] : meshBottomLevels)
+	{
+		auto& bottomLevel = bottomLevels.Get(handle);
+
+		// Compacted sizes are read back from an earlier frame, the source is released once this frame retires.
+		if (bottomLevel.compactedSize > 0 && !bottomLevel.compacted)
+		{
+			const auto compacted = resourceManager.Create(GetStructureDescription(bottomLevel.compactedSize), VGText("Compacted bottom level acceleration structure"));
+			compactions.emplace_back(BottomLevelCompaction{ bottomLevel.buffer, compacted });
+			resourceManager.AddFrameResource(device->GetFrameIndex(), bottomLevel.buffer);
+			bottomLevel.buffer = compacted;
+			bottomLevel.compacted = true;
+			rebuild = true;
+		}
+
+		if (resourceManager.Valid(bottomLevel.buffer))
+			continue;
+
+		const auto& mesh = bottomLevel.mesh;
+		const auto quantized = (mesh.metadata.quantizedChannels & (1 << vertexChannelPosition)) != 0;
+		const auto firstGeometry = geometries.size();
+
+		// Alpha tested materials are opaque to rays, shadows of foliage are solid.
+		for (const auto& subset : mesh.subsets)
+		{
+			auto& geometry = geometries.emplace_back();
+			geometry.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+			geometry.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+			geometry.Triangles.Transform3x4 = 0;
+			geometry.Triangles.IndexFormat = subset.indexSize == sizeof(uint16_t) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+			geometry.Triangles.VertexFormat = quantized ? DXGI_FORMAT_R16G16B16A16_UNORM : DXGI_FORMAT_R32G32B32_FLOAT;
+			geometry.Triangles.IndexCount = static_cast<UINT>(subset.indices);
+			geometry.Triangles.VertexCount = static_cast<UINT>(subset.vertices);
+			geometry.Triangles.IndexBuffer = indexAddress + mesh.globalOffset.index + subset.localOffset.index;
+			geometry.Triangles.VertexBuffer.StartAddress = positionAddress + mesh.globalOffset.position + subset.localOffset.position;
+			geometry.Triangles.VertexBuffer.StrideInBytes = mesh.metadata.channelStrides[0][vertexChannelPosition];
+		}
+
+		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS buildInputs{};
+		buildInputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+		buildInputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION;
+		buildInputs.NumDescs = static_cast<UINT>(mesh.subsets.size());
+		buildInputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+		buildInputs.pGeometryDescs = geometries.data() + firstGeometry;
+
+		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO prebuildInfo{};
+		device->Native()->GetRaytracingAccelerationStructurePrebuildInfo(&buildInputs, &prebuildInfo);
+
+		bottomLevel.buffer = resourceManager.Create(GetStructureDescription(prebuildInfo.ResultDataMaxSizeInBytes), VGText("Bottom level acceleration structure"));
+		builds.emplace_back(BottomLevelBuild{ handle, firstGeometry, mesh.subsets.size(), scratchSize });
+		scratchSize += AlignedSize(prebuildInfo.ScratchDataSizeInBytes, structureAlignment);
+		rebuild = true;
+	}
+
+	// Instance capacity grows in powers of two, so the top level structure and its buffers are rarely recreated.
+	const auto instanceCapacity = std::bit_ceil(std::max<size_t>(instances.size(), 1));
+
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS topLevelInputs{};
+	topLevelInputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+	topLevelInputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+	topLevelInputs.NumDescs = static_cast<UINT>(instanceCapacity);
+	topLevelInputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+
+	D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO topLevelInfo{};
+	device->Native()->GetRaytracingAccelerationStructurePrebuildInfo(&topLevelInputs, &topLevelInfo);
+
+	const auto lastTopLevel = topLevel;
+	const auto lastInstanceBuffer = instanceBuffer;
+	EnsureBuffer(topLevel, GetStructureDescription(topLevelInfo.ResultDataMaxSizeInBytes), VGText("Top level acceleration structure"));
+	EnsureBuffer(instanceBuffer, BufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.bindFlags = BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::CPUWrite,
+		.size = instanceCapacity,
+		.stride = sizeof(D3D12_RAYTRACING_INSTANCE_DESC)
+	}, VGText("Acceleration structure instance buffer"));
+
+	rebuild |= topLevel.handle != lastTopLevel.handle || instanceBuffer.handle != lastInstanceBuffer.handle || refits >= maxRefits;
+
+	if (!rebuild && dirtySlots.empty() && compactions.empty())
+	{
+		return graph.Import(topLevel);
+	}
+
+	const auto topLevelScratchOffset = scratchSize;
+	scratchSize += AlignedSize(std::max(topLevelInfo.ScratchDataSizeInBytes, topLevelInfo.UpdateScratchDataSizeInBytes), structureAlignment);
+
+	EnsureBuffer(scratchBuffer, BufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.bindFlags = BindFlag::UnorderedAccess,
+		.accessFlags = AccessFlag::GPUWrite,
+		.size = std::bit_ceil(scratchSize) / sizeof(uint32_t),
+		.stride = sizeof(uint32_t)
+	}, VGText("Acceleration structure scratch buffer"));
+
+	// Rebuilds resolve every instance's structure, refits only upload the instances that moved.
+	if (rebuild)
+	{
+		for (size_t i = 0; i < instances.size(); ++i)
+		{
+			const auto buffer = bottomLevels.Get(instances[i].bottomLevel).buffer;
+			instanceDescs[i].AccelerationStructure = resourceManager.Get(buffer).Native()->GetGPUVirtualAddress();
+		}
+
+		if (instances.size() > 0)
+		{
+			resourceManager.Write(instanceBuffer, std::as_bytes(std::span{ instanceDescs }));
+		}
+	}
+
+	else
+	{
+		std::sort(dirtySlots.begin(), dirtySlots.end());
+		dirtySlots.erase(std::unique(dirtySlots.begin(), dirtySlots.end()), dirtySlots.end());
+
+		for (size_t i = 0; i < dirtySlots.size();)
+		{
+			// Slots can be stale after removals, the rebuild already covered them.
+			if (dirtySlots[i] >= instances.size())
+				break;
+
+			size_t end = i + 1;
+			while (end < dirtySlots.size() && dirtySlots[end] == dirtySlots[end - 1] + 1 && dirtySlots[end] < instances.size())
+				++end;
+
+			for (size_t j = i; j < end; ++j)
+			{
+				const auto buffer = bottomLevels.Get(instances[dirtySlots[j]].bottomLevel).buffer;
+				instanceDescs[dirtySlots[j]].AccelerationStructure = resourceManager.Get(buffer).Native()->GetGPUVirtualAddress();
+			}
+
+			const auto range = std::span{ instanceDescs }.subspan(dirtySlots[i], end - i);
+			resourceManager.Write(instanceBuffer, std::as_bytes(range), dirtySlots[i] * sizeof(D3D12_RAYTRACING_INSTANCE_DESC));
+			i = end;
+		}
+	}
+
+	const auto update = !rebuild;
+	refits = update ? refits + 1 : 0;
+	rebuild = false;
+	dirtySlots.clear();
+
+	// Compacted sizes of this frame's builds, read back once the frame retires.
+	BufferHandle compactedSizeBuffer;
+	if (builds.size() > 0)
+	{
+		compactedSizeBuffer = resourceManager.Create(BufferDescription{
+			.updateRate = ResourceFrequency::Static,
+			.bindFlags = BindFlag::UnorderedAccess,
+			.accessFlags = AccessFlag::GPUWrite,
+			.size = builds.size(),
+			.stride = sizeof(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE_DESC)
+		}, VGText("Acceleration structure compacted size buffer"));
+		resourceManager.AddFrameResource(device->GetFrameIndex(), compactedSizeBuffer);
+	}
+
+	const auto topLevelTag = graph.Import(topLevel);
+	const auto instanceTag = graph.Import(instanceBuffer);
+	const auto scratchTag = graph.Import(scratchBuffer);
+
+	auto& buildPass = graph.AddPass("Acceleration Structure Build Pass", ExecutionQueue::Graphics);
+	buildPass.Read(inputs.vertexPositions, ResourceBind::SRV);
+	buildPass.Read(instanceTag, ResourceBind::SRV);
+	buildPass.Write(scratchTag, ResourceBind::UAV);
+	buildPass.Write(topLevelTag, ResourceBind::AccelerationStructure);
+	buildPass.Bind([this, topLevelTag, instanceTag, scratchTag, topLevelScratchOffset, update, compactedSizeBuffer, instanceCount = instances.size(),
+		geometries = std::move(geometries), builds = std::move(builds), compactions = std::move(compactions)](CommandList& list, RenderPassResources& resources)
+	{
+		auto& resourceManager = device->GetResourceManager();
+		const auto scratch = resources.GetBuffer(scratchTag);
+		const auto scratchAddress = resourceManager.Get(scratch).Native()->GetGPUVirtualAddress();
+
+		// Last frame's builds used the same scratch regions.
+		list.UAVBarrier(scratch);
+		list.FlushBarriers();
+		list.SuspendRenderPass();
+
+		for (const auto& compaction : compactions)
+		{
+			list.Native()->CopyRaytracingAccelerationStructure(resourceManager.Get(compaction.destination).Native()->GetGPUVirtualAddress(),
+				resourceManager.Get(compaction.source).Native()->GetGPUVirtualAddress(), D3D12_RAYTRACING_ACCELERATION_STRUCTURE_COPY_MODE_COMPACT);
+			list.AccelerationStructureBarrier(compaction.destination);
+		}
+
+		if (builds.size() > 0)
+		{
+			list.TransitionBarrier(compactedSizeBuffer, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+			list.FlushBarriers();
+
+			const auto sizeAddress = resourceManager.Get(compactedSizeBuffer).Native()->GetGPUVirtualAddress();
+
+			// Each build has its own scratch region, so the builds can overlap.
+			for (size_t i = 0; i < builds.size(); ++i)
+			{
+				const auto& build = builds[i];
+				const auto buffer = bottomLevels.Get(build.handle).buffer;
+
+				D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc{};
+				buildDesc.DestAccelerationStructureData = resourceManager.Get(buffer).Native()->GetGPUVirtualAddress();
+				buildDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+				buildDesc.Inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION;
+				buildDesc.Inputs.NumDescs = static_cast<UINT>(build.geometryCount);
+				buildDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+				buildDesc.Inputs.pGeometryDescs = geometries.data() + build.firstGeometry;
+				buildDesc.ScratchAccelerationStructureData = scratchAddress + build.scratchOffset;
+
+				const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC postbuildDesc{
+					.DestBuffer = sizeAddress + i * sizeof(D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE_DESC),
+					.InfoType = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE
+				};
+
+				list.Native()->BuildRaytracingAccelerationStructure(&buildDesc, 1, &postbuildDesc);
+				list.AccelerationStructureBarrier(buffer);
+			}
+
+			std::vector<entt::entity> handles;
+			handles.reserve(builds.size());
+			for (const auto& build : builds)
+			{
+				handles.emplace_back(build.handle);
+			}
+
+			// Structures can be released before their sizes arrive, the handles are versioned.
+			resourceManager.RequestReadback(list, compactedSizeBuffer, 0, builds.size() * sizeof(uint64_t), [this, handles = std::move(handles)](std::span<const std::byte> data)
+			{
+				for (size_t i = 0; i < handles.size(); ++i)
+				{
+					if (!bottomLevels.Valid(handles[i]))
+						continue;
+
+					uint64_t size;
+					std::memcpy(&size, data.data() + i * sizeof(uint64_t), sizeof(uint64_t));
+					bottomLevels.Get(handles[i]).compactedSize = static_cast<size_t>(size);
+				}
+			});
+		}
+
+		// Bottom level structures must be complete before the top level build reads them.
+		list.FlushBarriers();
+
+		const auto topLevelBuffer = resources.GetBuffer(topLevelTag);
+		const auto topLevelAddress = resourceManager.Get(topLevelBuffer).Native()->GetGPUVirtualAddress();
+
+		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc{};
+		buildDesc.DestAccelerationStructureData = topLevelAddress;
+		buildDesc.Inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+		buildDesc.Inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PREFER_FAST_TRACE | D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+		buildDesc.Inputs.NumDescs = static_cast<UINT>(instanceCount);
+		buildDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+		buildDesc.Inputs.InstanceDescs = resourceManager.Get(resources.GetBuffer(instanceTag)).Native()->GetGPUVirtualAddress();
+		buildDesc.ScratchAccelerationStructureData = scratchAddress + topLevelScratchOffset;
+
+		// Refits update in place, only the instance transforms changed since the last build.
+		if (update)
+		{
+			buildDesc.Inputs.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+			buildDesc.SourceAccelerationStructureData = topLevelAddress;
+		}
+
+		list.Native()->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr);
+		list.AccelerationStructureBarrier(topLevelBuffer);
+		list.FlushBarriers();
+	});
+
+	return topLevelTag;
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Rendering/ResourceHandle.h>
+#include <Rendering/RenderGraphResource.h>
+#include <Rendering/RenderComponents.h>
+#include <Rendering/CascadedShadows.h>
+#include <Utility/SlotMap.h>
+
+#include <entt/entt.hpp>
+
+#include <vector>
+#include <unordered_map>
+
+class RenderDevice;
+class RenderGraph;
+class MeshFactory;
+
+// Acceleration structures of the scene's meshes, traced by inline ray queries while shading. Each mesh gets a bottom level
+// structure the first time an entity draws it, shared by every entity drawing the mesh, and compacted once its compacted
+// size is read back. The top level structure is rebuilt when entities come or go, and otherwise only refit to the entities
+// that moved since the last build.
+class RayTracingScene
+{
+	static constexpr uint32_t maxRefits = 64;  // Refits degrade the tree as entities move, it's rebuilt after this many.
+
+	struct BottomLevel
+	{
+		MeshComponent mesh;  // Geometry to build from, offsets are patched when defragmenting moves the mesh.
+		BufferHandle buffer;
+		uint32_t references = 0;
+		size_t compactedSize = 0;  // Read back after the build, nonzero until the compaction is recorded.
+		bool compacted = false;
+	};
+
+	struct Instance
+	{
+		entt::entity entity;
+		entt::entity bottomLevel;
+		XMMATRIX worldMatrix;
+	};
+
+	RenderDevice* device;
+	MeshFactory* meshFactory;
+
+	SlotMap<BottomLevel> bottomLevels;
+	std::unordered_map<size_t, entt::entity> meshBottomLevels;  // Keyed by the mesh's global index offset.
+	size_t meshRevision = 0;
+
+	std::vector<Instance> instances;  // Dense, removed instances are swapped with the last.
+	std::vector<D3D12_RAYTRACING_INSTANCE_DESC> instanceDescs;  // Mirror of the instance buffer.
+	std::unordered_map<entt::entity, size_t> instanceSlots;
+	std::vector<uint32_t> dirtySlots;  // Instance descs to upload before the next refit.
+
+	BufferHandle instanceBuffer;
+	BufferHandle topLevel;
+	BufferHandle scratchBuffer;  // Shared by every build of a frame, in 256 byte aligned regions.
+	bool rebuild = true;  // Instances were added or removed, or a bottom level structure moved.
+	uint32_t refits = 0;
+
+	void PatchRelocations();
+	void ReleaseBottomLevel(entt::entity handle);
+	void WriteInstance(size_t slot);
+	void EnsureBuffer(BufferHandle& buffer, const BufferDescription& description, const wchar_t* name);
+
+public:
+	~RayTracingScene();
+
+	void Initialize(RenderDevice* inDevice, MeshFactory* inMeshFactory);
+	void AddInstance(entt::entity entity, const MeshComponent& mesh, const XMMATRIX& worldMatrix);
+	void RemoveInstance(entt::entity entity);
+	void UpdateTransform(entt::entity entity, const XMMATRIX& worldMatrix);
+
+	// Builds the pending bottom level structures and the top level structure. Returns the top level structure, or nothing
+	// when ray traced shadows are disabled or unsupported.
+	RenderResource Render(RenderGraph& graph, const ShadowInputs& inputs);
+};
\ No newline at end of file
@@ -0,0 +1,530 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/ReflectionProbes.h>
+#include <Rendering/Device.h>
+#include <Rendering/Renderer.h>
+#include <Rendering/RenderSystems.h>
+#include <Rendering/RenderGraph.h>
+#include <Rendering/RenderPass.h>
+#include <Rendering/CommandList.h>
+#include <Rendering/RenderComponents.h>
+#include <Core/CoreComponents.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <string>
+
+ReflectionProbes::~ReflectionProbes()
+{
+	device->GetResourceManager().Destroy(captureColor);
+	device->GetResourceManager().Destroy(captureDepth);
+	device->GetResourceManager().Destroy(captureCube);
+	device->GetResourceManager().Destroy(irradianceBuffer);
+	device->GetResourceManager().Destroy(prefilterArray);
+}
+
+void ReflectionProbes::Initialize(RenderDevice* inDevice, entt::registry& registry)
+{
+	device = inDevice;
+
+	refreshEnabled = CvarCreate("reflectionProbeRefresh", "Progressively captures the reflection probes again, one cube face per frame, 0=disabled, 1=enabled", 1);
+
+	cullResetLayout = RenderPipelineLayout{}
+		.ComputeShader({ "MeshCulling", "ResetMain" });
+
+	cullLayout = RenderPipelineLayout{}
+		.ComputeShader({ "MeshCulling", "ProbeMain" });
+
+	// Forward shading without a prepass, so the depth is written here.
+	captureLayout = RenderPipelineLayout{}
+		.VertexShader({ "Forward", "VSMain" })
+		.PixelShader({ "Forward", "PSMain" })
+		.DepthEnabled(true, true)
+		.Macro({ "PROBE_CAPTURE" });
+
+	resolveLayout = RenderPipelineLayout{}
+		.ComputeShader({ "ReflectionProbes/Resolve", "Main" });
+
+	irradianceLayout = RenderPipelineLayout{}
+		.ComputeShader({ "IBL/Convolution", "IrradianceMain" })
+		.Macro({ "PREFILTER_LEVELS", ImageBasedLighting::prefilterLevels });
+
+	prefilterLayout = RenderPipelineLayout{}
+		.ComputeShader({ "IBL/Convolution", "PrefilterMain" })
+		.Macro({ "PREFILTER_LEVELS", ImageBasedLighting::prefilterLevels });
+
+	TextureDescription colorDesc{
+		.bindFlags = BindFlag::RenderTarget | BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::GPUWrite,
+		.width = captureResolution * 3,
+		.height = captureResolution * 2,
+		.depth = 1,
+		.format = DXGI_FORMAT_R16G16B16A16_FLOAT,
+		.evictable = true  // Capture targets are idle once every probe is captured.
+	};
+
+	captureColor = device->GetResourceManager().Create(colorDesc, VGText("Reflection probe capture color"));
+
+	TextureDescription depthDesc{
+		.bindFlags = BindFlag::DepthStencil | BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::GPUWrite,
+		.width = captureResolution * 3,
+		.height = captureResolution * 2,
+		.depth = 1,
+		.format = DXGI_FORMAT_R32_TYPELESS,  // Typeless for both the depth and shader resource views.
+		.evictable = true
+	};
+
+	captureDepth = device->GetResourceManager().Create(depthDesc, VGText("Reflection probe capture depth"));
+
+	TextureDescription cubeDesc{
+		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
+		.accessFlags = AccessFlag::GPUWrite,
+		.width = captureResolution,
+		.height = captureResolution,
+		.depth = faceCount,  // Texture cube.
+		.format = DXGI_FORMAT_R16G16B16A16_FLOAT,
+		.mipMapping = true,  // Prefiltering samples coarser mips for rough lobes.
+		.array = true,
+		.evictable = true
+	};
+
+	captureCube = device->GetResourceManager().Create(cubeDesc, VGText("Reflection probe capture cube"));
+
+	BufferDescription irradianceDesc{
+		.updateRate = ResourceFrequency::Static,
+		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
+		.accessFlags = AccessFlag::GPUWrite,
+		.size = ImageBasedLighting::irradianceCoefficients * maxProbes,
+		.stride = sizeof(XMFLOAT4)
+	};
+
+	irradianceBuffer = device->GetResourceManager().Create(irradianceDesc, VGText("Reflection probe irradiance"));
+
+	TextureDescription prefilterDesc{
+		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
+		.accessFlags = AccessFlag::GPUWrite,
+		.width = ImageBasedLighting::prefilterTextureSize,
+		.height = ImageBasedLighting::prefilterTextureSize,
+		.depth = faceCount * maxProbes,
+		.format = DXGI_FORMAT_R16G16B16A16_FLOAT,
+		.mipMapping = true,  // Roughness bins are stored in mip levels.
+		.array = true,
+		.cubeArray = true
+	};
+
+	prefilterArray = device->GetResourceManager().Create(prefilterDesc, VGText("Reflection probe prefilter"));
+
+	slotEntities.fill(entt::null);
+
+	probeObserver.connect(registry, entt::collector
+		.group<WorldTransformComponent, ReflectionProbeComponent>().update<ReflectionProbeComponent>()
+		.update<WorldTransformComponent>().where<ReflectionProbeComponent>());
+	registry.on_destroy<ReflectionProbeComponent>().connect<&ReflectionProbes::OnProbeDestroyed>(*this);
+}
+
+void ReflectionProbes::StartCapture(const entt::registry& registry, entt::entity entity)
+{
+	captureSlot = probeSlots.at(entity);
+	capturePosition = registry.get<WorldTransformComponent>(entity).translation;
+}
+
+void ReflectionProbes::OnProbeDestroyed(entt::registry& registry, entt::entity entity)
+{
+	const auto iter = probeSlots.find(entity);
+	if (iter == probeSlots.end())
+		return;
+
+	const auto slot = iter->second;
+	slotEntities[slot] = entt::null;
+	slotCaptured[slot] = false;
+	probeSlots.erase(iter);
+
+	std::erase(dirtyProbes, entity);
+
+	// A progressive refresh of the probe is abandoned, its slot may be reused before the refresh would complete.
+	if (slot == captureSlot)
+	{
+		nextFace = faceCount;
+	}
+}
+
+void ReflectionProbes::Update(const entt::registry& registry)
+{
+	VGScopedCPUStat("Update Reflection Probes");
+
+	capturedProbes.clear();
+	pendingFaces = 0;
+	filterPending = false;
+
+	for (const auto entity : probeObserver)
+	{
+		if (!registry.all_of<WorldTransformComponent, ReflectionProbeComponent>(entity))
+			continue;
+
+		if (!probeSlots.contains(entity))
+		{
+			const auto freeSlot = std::find(slotEntities.begin(), slotEntities.end(), entt::null);
+			if (freeSlot == slotEntities.end())
+			{
+				VGLogError(logRendering, "Exceeded the maximum of {} reflection probes.", maxProbes);
+
+				continue;
+			}
+
+			*freeSlot = entity;
+			probeSlots.emplace(entity, static_cast<uint32_t>(std::distance(slotEntities.begin(), freeSlot)));
+		}
+
+		if (std::find(dirtyProbes.begin(), dirtyProbes.end(), entity) == dirtyProbes.end())
+		{
+			dirtyProbes.emplace_back(entity);
+		}
+	}
+
+	probeObserver.clear();
+
+	// Changed probes capture every face at once, interrupting any progressive refresh, which starts over with the next probe.
+	if (!dirtyProbes.empty())
+	{
+		StartCapture(registry, dirtyProbes.front());
+		dirtyProbes.erase(dirtyProbes.begin());
+
+		pendingFaces = (1u << faceCount) - 1;
+		nextFace = faceCount;
+		filterPending = true;
+	}
+
+	else if (*refreshEnabled > 0)
+	{
+		if (nextFace == faceCount)
+		{
+			for (uint32_t i = 1; i <= maxProbes; ++i)
+			{
+				const auto slot = (refreshSlot + i) % maxProbes;
+				if (slotCaptured[slot])
+				{
+					StartCapture(registry, slotEntities[slot]);
+					refreshSlot = slot;
+					nextFace = 0;
+
+					break;
+				}
+			}
+		}
+
+		if (nextFace < faceCount)
+		{
+			pendingFaces = 1u << nextFace;
+			++nextFace;
+			filterPending = nextFace == faceCount;
+		}
+	}
+
+	if (filterPending && !slotCaptured[captureSlot])
+	{
+		slotCaptured[captureSlot] = true;
+		capturedProbes.emplace_back(slotEntities[captureSlot]);
+	}
+}
+
+void ReflectionProbes::AppendCameras(FrameVector<Camera>& cameras) const
+{
+	VGAssert(cameras.size() == firstCameraIndex, "Probe cameras must follow the existing cameras.");
+
+	const auto projection = XMMatrixPerspectiveFovRH(XM_PIDIV2, 1.f, captureFarPlane, captureNearPlane);  // Inverse Z.
+	const auto inverseProjection = XMMatrixInverse(nullptr, projection);
+	const auto eye = XMLoadFloat3(&capturePosition);
+	const XMFLOAT4 position = { capturePosition.x, capturePosition.y, capturePosition.z, 0.f };
+
+	// Face order of ComputeDirection() in CubeMap.hlsli.
+	const XMVECTOR forwards[faceCount] = {
+		XMVectorSet(1.f, 0.f, 0.f, 0.f),
+		XMVectorSet(-1.f, 0.f, 0.f, 0.f),
+		XMVectorSet(0.f, 1.f, 0.f, 0.f),
+		XMVectorSet(0.f, -1.f, 0.f, 0.f),
+		XMVectorSet(0.f, 0.f, 1.f, 0.f),
+		XMVectorSet(0.f, 0.f, -1.f, 0.f)
+	};
+
+	for (uint32_t face = 0; face < faceCount; ++face)
+	{
+		// The resolve projects with these cameras, so any up direction works.
+		const auto up = face < 4 ? XMVectorSet(0.f, 0.f, 1.f, 0.f) : XMVectorSet(0.f, 1.f, 0.f, 0.f);
+		const auto view = XMMatrixLookToRH(eye, forwards[face], up);
+		const auto inverseView = XMMatrixInverse(nullptr, view);
+
+		cameras.emplace_back(Camera{
+			.position = position,
+			.view = view,
+			.projection = projection,
+			.inverseView = inverseView,
+			.inverseProjection = inverseProjection,
+			.lastFramePosition = position,
+			.lastFrameView = view,  // Captures don't need motion.
+			.lastFrameProjection = projection,
+			.lastFrameInverseView = inverseView,
+			.lastFrameInverseProjection = inverseProjection,
+			.nearPlane = captureNearPlane,
+			.farPlane = captureFarPlane,
+			.fieldOfView = XM_PIDIV2,
+			.aspectRatio = 1.f
+		});
+	}
+}
+
+std::optional<uint32_t> ReflectionProbes::GetProbeIndex(entt::entity entity) const
+{
+	const auto iter = probeSlots.find(entity);
+	if (iter == probeSlots.end() || !slotCaptured[iter->second])
+	{
+		return std::nullopt;
+	}
+
+	return iter->second;
+}
+
+ProbeResources ReflectionProbes::ImportResources(RenderGraph& graph)
+{
+	return { graph.Import(irradianceBuffer), graph.Import(prefilterArray) };
+}
+
+void ReflectionProbes::Render(RenderGraph& graph, const ProbeInputs& inputs, const ProbeResources& probeResources, const ProbeShading& shading)
+{
+	if (pendingFaces == 0)
+		return;
+
+	const auto colorTag = graph.Import(captureColor);
+	const auto depthTag = graph.Import(captureDepth);
+	const auto cubeTag = graph.Import(captureCube);
+
+	// Every face is culled in one dispatch, into consecutive ranges of draw arguments and visible instances, like the
+	// shadow cascades.
+	const auto& renderer = Renderer::Get();
+	const auto argumentCapacity = std::bit_ceil(std::max<size_t>(renderer.batchCount, 1)) * faceCount;
+	const auto instanceCapacity = std::bit_ceil(std::max<size_t>(renderer.renderableCount, 1)) * faceCount * maxMeshLods;  // A range per level of detail.
+
+	auto& capturePass = graph.AddPass("Reflection Probe Capture Pass", ExecutionQueue::Graphics);
+	const auto culledArgsTag = capturePass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+		.size = argumentCapacity,
+		.stride = sizeof(MeshIndirectArgument),
+		.uavCounter = true
+	}, VGText("Probe indirect render argument buffer"));
+	const auto visibleInstancesTag = capturePass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+		.size = instanceCapacity,
+		.stride = sizeof(uint32_t)
+	}, VGText("Probe visible instance buffer"));
+	capturePass.Read(inputs.meshIndirectArgs, ResourceBind::SRV);
+	capturePass.Read(inputs.meshInstances, ResourceBind::SRV);
+	capturePass.Read(inputs.cullingViewBuffer, ResourceBind::SRV);
+	shading.read(capturePass);
+	capturePass.Write(culledArgsTag, ResourceBind::UAV);
+	capturePass.Write(visibleInstancesTag, ResourceBind::UAV);
+	capturePass.Output(colorTag, OutputBind::RTV, LoadType::Preserve);
+	capturePass.Output(depthTag, OutputBind::DSV, LoadType::Preserve);
+	capturePass.Bind([this, inputs, shading, colorTag, depthTag, culledArgsTag, visibleInstancesTag, faces = pendingFaces](CommandList& list, RenderPassResources& resources)
+	{
+		auto& renderer = Renderer::Get();
+
+		const auto culledArgs = resources.GetBuffer(culledArgsTag);
+		const auto visibleInstances = resources.GetBuffer(visibleInstancesTag);
+		const auto renderTarget = resources.GetTexture(colorTag);
+		const auto depthStencil = resources.GetTexture(depthTag);
+		const auto& arguments = device->GetResourceManager().Get(culledArgs);
+
+		struct {
+			uint32_t inputBuffer;
+			uint32_t outputBuffer;
+			uint32_t instanceBuffer;
+			uint32_t visibleInstanceBuffer;
+			uint32_t objectBuffer;
+			uint32_t transformBuffer;
+			uint32_t cullingViewBuffer;
+			uint32_t cameraIndex;
+			uint32_t batchCount;
+			uint32_t instanceCount;
+			uint32_t cullingLevel;
+			uint32_t hiZTexture;
+			uint32_t hiZMipLevels;
+			uint32_t visibilityBuffer;
+			uint32_t nextVisibilityBuffer;
+			uint32_t lodResolution;
+			float lodErrorThreshold;
+			uint32_t countInstances;
+		} cullBindData{};
+
+		cullBindData.inputBuffer = resources.Get(inputs.meshIndirectArgs);
+		cullBindData.outputBuffer = resources.Get(culledArgsTag);
+		cullBindData.instanceBuffer = resources.Get(inputs.meshInstances);
+		cullBindData.visibleInstanceBuffer = resources.Get(visibleInstancesTag);
+		cullBindData.objectBuffer = resources.Get(inputs.objectBuffer);
+		cullBindData.transformBuffer = resources.Get(inputs.transformBuffer);
+		cullBindData.cullingViewBuffer = resources.Get(inputs.cullingViewBuffer);
+		cullBindData.cameraIndex = firstCameraIndex;  // One dispatch row per face.
+		cullBindData.batchCount = renderer.batchCount;
+		cullBindData.instanceCount = renderer.renderableCount;
+		cullBindData.cullingLevel = 1;  // Frustum only.
+		cullBindData.lodErrorThreshold = *CvarGet("meshLodThreshold", float);
+		cullBindData.lodResolution = cullBindData.lodErrorThreshold > 0.f ? captureResolution : 0;
+
+		constexpr auto groupSize = 64;
+
+		list.BindPipeline(cullResetLayout);
+		list.BindConstants("bindData", cullBindData);
+		list.Dispatch(std::ceil((float)cullBindData.batchCount / groupSize), faceCount, 1);
+
+		list.UAVBarrier(culledArgs);
+		list.FlushBarriers();
+
+		list.BindPipeline(cullLayout);
+		list.BindConstants("bindData", cullBindData);
+		list.Dispatch(std::ceil((float)cullBindData.instanceCount / groupSize), faceCount, 1);
+
+		list.TransitionBarrier(culledArgs, MeshSystem::argumentState);
+		list.TransitionBarrier(visibleInstances, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		list.FlushBarriers();
+
+		list.BindPipeline(captureLayout);
+		MeshSystem::BindArguments(renderer, list, culledArgs);
+
+		for (uint32_t face = 0; face < faceCount; ++face)
+		{
+			if ((faces & (1u << face)) == 0)
+				continue;
+
+			// Faces are laid out in a 3x2 grid.
+			const auto tileX = (face % 3) * captureResolution;
+			const auto tileY = (face / 3) * captureResolution;
+
+			const D3D12_VIEWPORT viewport{
+				.TopLeftX = static_cast<float>(tileX),
+				.TopLeftY = static_cast<float>(tileY),
+				.Width = static_cast<float>(captureResolution),
+				.Height = static_cast<float>(captureResolution),
+				.MinDepth = 0.f,
+				.MaxDepth = 1.f
+			};
+			const D3D12_RECT tile{
+				.left = static_cast<LONG>(tileX),
+				.top = static_cast<LONG>(tileY),
+				.right = static_cast<LONG>(tileX + captureResolution),
+				.bottom = static_cast<LONG>(tileY + captureResolution)
+			};
+
+			list.ClearRenderTarget(renderTarget, { &tile, 1 });
+			list.ClearDepthStencil(depthStencil, { &tile, 1 });
+
+			// Restricts the draws to the face's tile.
+			list.Native()->RSSetViewports(1, &viewport);
+			list.Native()->RSSetScissorRects(1, &tile);
+
+			shading.bind(list, resources, firstCameraIndex + face, resources.Get(visibleInstancesTag), resources.GetTexture(colorTag));
+			const auto argumentOffset = face * renderer.batchCount * sizeof(MeshIndirectArgument);
+			list.ResumeRenderPass();
+			list.Native()->ExecuteIndirect(renderer.meshIndirectCommandSignature.Get(), renderer.batchCount, arguments.Native(), argumentOffset, nullptr, 0);
+		}
+
+		list.TransitionBarrier(culledArgs, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		list.TransitionBarrier(visibleInstances, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		list.FlushBarriers();
+	});
+
+	auto& resolvePass = graph.AddPass("Reflection Probe Resolve Pass", ExecutionQueue::Compute);
+	resolvePass.Read(inputs.cameraBuffer, ResourceBind::SRV);
+	resolvePass.Read(colorTag, ResourceBind::SRV);
+	resolvePass.Read(depthTag, ResourceBind::SRV);
+	resolvePass.Read(inputs.skyLuminance, ResourceBind::SRV);
+	resolvePass.Write(cubeTag, TextureView{}
+		.UAV("", 0)
+		.Mips(0));  // Mipmapped within the pass.
+	resolvePass.Bind([this, inputs, colorTag, depthTag, cubeTag, faces = pendingFaces, filter = filterPending](CommandList& list, RenderPassResources& resources)
+	{
+		struct {
+			uint32_t cameraBuffer;
+			uint32_t firstCameraIndex;
+			uint32_t colorTexture;
+			uint32_t depthTexture;
+			uint32_t skyTexture;
+			uint32_t outputTexture;
+			uint32_t faceMask;
+			uint32_t tileSize;
+		} bindData;
+
+		bindData.cameraBuffer = resources.Get(inputs.cameraBuffer);
+		bindData.firstCameraIndex = firstCameraIndex;
+		bindData.colorTexture = resources.Get(colorTag);
+		bindData.depthTexture = resources.Get(depthTag);
+		bindData.skyTexture = resources.Get(inputs.skyLuminance);
+		bindData.outputTexture = resources.Get(cubeTag);
+		bindData.faceMask = faces;
+		bindData.tileSize = captureResolution;
+
+		list.BindPipeline(resolveLayout);
+		list.BindConstants("bindData", bindData);
+		list.Dispatch(captureResolution / 8, captureResolution / 8, faceCount);
+
+		// Mips are only needed by the prefilter, once the cube is complete.
+		if (filter)
+		{
+			list.UAVBarrier(resources.GetTexture(cubeTag));
+			list.FlushBarriers();
+
+			device->GetResourceManager().GenerateMipmaps(list, resources.GetTexture(cubeTag));
+		}
+	});
+
+	if (!filterPending)
+		return;
+
+	TextureView prefilterView{};
+	std::vector<std::string> prefilterViewNames;
+	prefilterViewNames.resize(ImageBasedLighting::prefilterLevels);
+	for (int i = 0; i < ImageBasedLighting::prefilterLevels; ++i)
+	{
+		prefilterViewNames[i] = std::to_string(i);
+		prefilterView.UAV(prefilterViewNames[i], i);
+	}
+
+	// Convolved into the probe's cube of the arrays, the same as the sky's lookup tables.
+	auto& filterPass = graph.AddPass("Reflection Probe Filter Pass", ExecutionQueue::Compute);
+	filterPass.Read(cubeTag, ResourceBind::SRV);
+	filterPass.Write(probeResources.irradiance, ResourceBind::UAV);
+	filterPass.Write(probeResources.prefilter, prefilterView);
+	filterPass.Bind([this, cubeTag, probeResources, prefilterViewNames, firstSlice = captureSlot * faceCount](CommandList& list, RenderPassResources& resources)
+	{
+		struct {
+			uint32_t luminanceTexture;
+			uint32_t irradianceBuffer;
+			uint32_t brdfTexture;
+			uint32_t cubeFace;
+			uint32_t firstSlice;
+			uint32_t padding[3];
+			uint128_t prefilterMips[ImageBasedLighting::prefilterLevels];
+		} bindData{};
+
+		bindData.luminanceTexture = resources.Get(cubeTag);
+		bindData.irradianceBuffer = resources.Get(probeResources.irradiance);
+		bindData.firstSlice = firstSlice;
+		for (int i = 0; i < ImageBasedLighting::prefilterLevels; ++i)
+		{
+			bindData.prefilterMips[i] = resources.Get(probeResources.prefilter, prefilterViewNames[i]);
+		}
+
+		list.BindPipeline(irradianceLayout);
+		list.BindConstants("bindData", bindData);
+		list.Dispatch(1, 1, 1);
+
+		// Each dispatch writes a single face.
+		list.BindPipeline(prefilterLayout);
+		for (uint32_t face = 0; face < faceCount; ++face)
+		{
+			bindData.cubeFace = face;
+			list.BindConstants("bindData", bindData);
+
+			list.Dispatch(ImageBasedLighting::prefilterTextureSize / 8, ImageBasedLighting::prefilterTextureSize / 8, 1);
+		}
+	});
+}
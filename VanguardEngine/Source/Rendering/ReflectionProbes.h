@@ -0,0 +1,117 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Rendering/ResourceHandle.h>
+#include <Rendering/RenderPipeline.h>
+#include <Rendering/RenderGraphResource.h>
+#include <Rendering/ShaderStructs.h>
+#include <Rendering/ImageBasedLighting.h>
+#include <Rendering/VirtualShadowMap.h>
+#include <Core/ConsoleVariable.h>
+#include <Utility/FrameArena.h>
+
+#include <entt/entt.hpp>
+
+#include <array>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+#include <functional>
+
+class RenderDevice;
+class RenderGraph;
+class RenderPass;
+class RenderPassResources;
+class CommandList;
+
+struct ProbeInputs
+{
+	RenderResource cameraBuffer;
+	RenderResource cullingViewBuffer;
+	RenderResource objectBuffer;
+	RenderResource transformBuffer;
+	RenderResource meshIndirectArgs;  // Unculled draw arguments of every batch.
+	RenderResource meshInstances;
+	RenderResource skyLuminance;  // Fills the texels without geometry.
+};
+
+struct ProbeResources
+{
+	RenderResource irradiance;  // Spherical harmonics, one set of coefficients per probe.
+	RenderResource prefilter;  // Cube arrays, one cube per probe.
+};
+
+// Captures are shaded by the renderer's forward shading, the same materials and lights as the view.
+struct ProbeShading
+{
+	std::function<void(RenderPass&)> read;  // Declares the shading resources.
+	std::function<void(CommandList&, RenderPassResources&, uint32_t cameraIndex, uint32_t instanceBuffer, TextureHandle output)> bind;
+};
+
+// Reflection probe entities, captured into cube arrays and convolved like the sky's image based lighting. A probe captures
+// all of its faces in a single frame when it's placed or changed, and is otherwise refreshed progressively, one face per
+// frame, in turns with the other probes. Each face is culled and drawn through the multi-view path of the shadow cascades.
+// Probes are uploaded as lights, so shading finds the probes covering it through the cluster grid.
+class ReflectionProbes
+{
+public:
+	static constexpr uint32_t maxProbes = 16;
+	static constexpr uint32_t faceCount = 6;
+	static constexpr uint32_t captureResolution = ImageBasedLighting::prefilterTextureSize;  // Filtering expects matching sizes.
+	static constexpr uint32_t firstCameraIndex = VirtualShadowMap::cameraIndex + 1;  // Face cameras follow the virtual shadow camera.
+	static constexpr float captureNearPlane = 0.1f;
+	static constexpr float captureFarPlane = 5000.f;
+
+private:
+	RenderDevice* device;
+
+	RenderPipelineLayout cullResetLayout;
+	RenderPipelineLayout cullLayout;
+	RenderPipelineLayout captureLayout;
+	RenderPipelineLayout resolveLayout;
+	RenderPipelineLayout irradianceLayout;
+	RenderPipelineLayout prefilterLayout;
+
+	TextureHandle captureColor;  // Every face in a 3x2 grid.
+	TextureHandle captureDepth;
+	TextureHandle captureCube;  // Resolved faces of the probe being captured, persistent across progressive refreshes.
+	BufferHandle irradianceBuffer;
+	TextureHandle prefilterArray;
+
+	CvarHandle<int> refreshEnabled;
+
+	entt::observer probeObserver;  // Probe entities added, changed or moved.
+	std::unordered_map<entt::entity, uint32_t> probeSlots;  // Cube of each probe in the arrays.
+	std::array<entt::entity, maxProbes> slotEntities;
+	std::array<bool, maxProbes> slotCaptured = {};  // The arrays hold a complete capture.
+	std::vector<entt::entity> dirtyProbes;
+	std::vector<entt::entity> capturedProbes;  // First captures completing this frame.
+
+	uint32_t captureSlot = 0;
+	XMFLOAT3 capturePosition = { 0.f, 0.f, 0.f };
+	uint32_t nextFace = faceCount;  // Progressive refreshes are idle once every face is captured.
+	uint32_t refreshSlot = 0;
+	uint32_t pendingFaces = 0;  // Mask of the faces captured this frame.
+	bool filterPending = false;  // The capture completes this frame.
+
+	void StartCapture(const entt::registry& registry, entt::entity entity);
+	void OnProbeDestroyed(entt::registry& registry, entt::entity entity);
+
+public:
+	~ReflectionProbes();
+
+	void Initialize(RenderDevice* inDevice, entt::registry& registry);
+	// Assigns probe slots and picks the faces to capture this frame, before the cameras and lights are uploaded.
+	void Update(const entt::registry& registry);
+	// Appends the face cameras of the current capture, which must land at the first camera index.
+	void AppendCameras(FrameVector<Camera>& cameras) const;
+	// Probes only resolve to a cube once their first capture completes.
+	std::optional<uint32_t> GetProbeIndex(entt::entity entity) const;
+	const std::vector<entt::entity>& GetCapturedProbes() const { return capturedProbes; }
+
+	ProbeResources ImportResources(RenderGraph& graph);
+	// Captures, resolves and convolves the pending faces.
+	void Render(RenderGraph& graph, const ProbeInputs& inputs, const ProbeResources& resources, const ProbeShading& shading);
+};
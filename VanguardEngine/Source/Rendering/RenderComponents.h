@@ -6,17 +6,23 @@
 #include <Rendering/ResourceHandle.h>
 #include <Rendering/ShaderStructs.h>
 
+#include <entt/entt.hpp>
+
 #include <vector>
+#include <array>
+#include <filesystem>
 
 struct PrimitiveOffset
 {
 	size_t index = 0;
 	size_t position = 0;
 	size_t extra = 0;
+	size_t meshlet = 0;  // In meshlets, not bytes.
+	size_t skin = 0;
 
 	PrimitiveOffset operator+(const PrimitiveOffset& other) const
 	{
-		return { index + other.index, position + other.position, extra + other.extra };
+		return { index + other.index, position + other.position, extra + other.extra, meshlet + other.meshlet, skin + other.skin };
 	}
 
 	PrimitiveOffset& operator+=(const PrimitiveOffset& other)
@@ -26,6 +32,16 @@ struct PrimitiveOffset
 	}
 };
 
+static constexpr size_t maxMeshLods = 4;  // Levels of detail of each subset, including the full detail level.
+
+// Simplified index list of a subset, drawing the subset's vertices.
+struct MeshLod
+{
+	size_t indexOffset;  // In bytes, relative to the subset's first index.
+	size_t indices;
+	float error;  // Object space deviation from the full detail surface.
+};
+
 // #TODO: Array of mesh materials bound to vertex/index offsets to enable multiple materials per mesh.
 struct MeshComponent
 {
@@ -34,14 +50,38 @@ struct MeshComponent
 		PrimitiveOffset localOffset;
 		size_t indices;
 		size_t materialIndex;
-		float boundingSphereRadius;
+		size_t meshlets;
+		size_t indexSize;  // Bytes per index, 16 bit when the vertex count allows.
+		size_t vertices;
+		size_t lodCount = 1;
+		std::array<MeshLod, maxMeshLods> lods = {};  // Finest first, the first level is the subset's own indices.
+		XMFLOAT3 boundsMin{};  // Object space box around the subset's vertices.
+		XMFLOAT3 boundsMax{};
+		XMFLOAT3 boundingSphereCenter{};  // Object space, not necessarily the box's center.
+		float boundingSphereRadius = 0.f;
+		bool skinned = false;  // Carries skin influences for its vertices, see Skinning.
 	};
 
 	std::vector<Subset> subsets;
 
 	PrimitiveOffset globalOffset;
 
-	VertexMetadata metadata;
+	VertexMetadata metadata{};
+};
+
+// Deforms the entity's mesh by the world transforms of its joints, which are usually nodes of the same model. The skinned
+// vertices are written once per frame into vertex ranges of the entity's own, see Skinning.
+struct SkinComponent
+{
+	std::vector<entt::entity> joints;
+	std::vector<XMFLOAT4X4> inverseBindMatrices;  // Of each joint, from the model's space into the joint's space.
+};
+
+// Source of the model the asset manager gave the entity, either its mesh or its node hierarchy. Scene snapshots store
+// this in place of the mesh.
+struct ModelComponent
+{
+	std::filesystem::path path;
 };
 
 struct CameraComponent
@@ -54,13 +94,25 @@ struct CameraComponent
 enum class LightType
 {
 	Point,
-	Directional
+	Directional,
+	Spot,
+	Area  // Rectangular and one sided.
 };
 
 struct LightComponent
 {
 	LightType type;
 	XMFLOAT3 color;
+	float innerConeAngle = 0.5f;  // Spot lights only, radians from the direction.
+	float outerConeAngle = 0.7f;
+	XMFLOAT2 areaSize = { 1.f, 1.f };  // Area lights only.
+	float range = 0.f;  // Meters, lights are culled past it. Zero derives the range from the color's intensity.
+};
+
+// Captures the surroundings into a cube, which replaces the sky's image based lighting within the radius.
+struct ReflectionProbeComponent
+{
+	float radius = 10.f;  // Influence, in meters. Reflections are parallax corrected against this sphere.
 };
 
 enum class TimeOfDayAnimation
@@ -6,14 +6,47 @@
 #include <Rendering/RenderPipeline.h>
 #include <Rendering/PipelineState.h>
 #include <Utility/StringTools.h>
+#include <Utility/HashCombine.h>
 #include <Rendering/ResourceFormat.h>
+#include <Threading/Thread.h>
 
 #include <algorithm>
+#include <optional>
+#include <execution>
+#include <mutex>
+#include <shared_mutex>
+#include <future>
 
 void RenderGraph::BuildAdjacencyLists()
 {
 	VGScopedCPUStat("Build Adjancency Lists");
 
+	adjacencyLists.assign(passes.size(), {});
+
+	// Writes cleared by an output don't depend on previous writes, only preserving writes create write-to-write edges.
+	std::vector<ResourceSet> preservingWrites(passes.size());
+	for (int i = 0; i < passes.size(); ++i)
+	{
+		for (const auto resource : passes[i]->writes)
+		{
+			const auto it = passes[i]->outputBindInfo.find(resource);
+			if (it == passes[i]->outputBindInfo.end() || it->second.second != LoadType::Clear)
+			{
+				preservingWrites[i].emplace(resource);
+			}
+		}
+	}
+
+	// Unordered accesses to disjoint mips of a texture share its state and don't overlap in memory, so they can be
+	// reordered freely.
+	const auto Dependent = [](const RenderPass& writer, const RenderPass& user, const RenderResource resource)
+	{
+		if (!writer.IsUnorderedAccess(resource) || !user.IsUnorderedAccess(resource))
+			return true;
+
+		return (writer.GetMipMask(resource) & user.GetMipMask(resource)) != 0;
+	};
+
 	for (int i = 0; i < passes.size(); ++i)
 	{
 		const auto& outer = passes[i];
@@ -25,38 +58,18 @@ void RenderGraph::BuildAdjacencyLists()
 
 			const auto& inner = passes[j];
 
-			std::vector<RenderResource> intersection;
-			// #TODO: We can stop as soon as there's a single intersection, std::set_intersection will find all intersections.
-			std::set_intersection(outer->writes.cbegin(), outer->writes.cend(), inner->reads.cbegin(), inner->reads.cend(), std::back_inserter(intersection));
+			// If there's a write-to-read or write-to-write dependency, create an edge. A clearing load implies a write
+			// without a read, and therefore no dependency.
+			if (!outer->writes.Intersects(inner->reads) && !outer->writes.Intersects(preservingWrites[j]))
+				continue;
 
-			if (intersection.size() == 0)
+			for (const auto resource : outer->writes)
 			{
-				// No direct write-to-read, but we may still have a write-to-write. However, we can't just check the intersection of writes since a clearing load would imply
-				// a write without a read, and therefore no dependency.
-
-				auto preservingWrites = inner->writes;
-
-				auto iter = preservingWrites.begin();
-				while (iter != preservingWrites.end())
+				if ((inner->reads.contains(resource) || preservingWrites[j].contains(resource)) && Dependent(*outer, *inner, resource))
 				{
-					if (inner->outputBindInfo.contains(*iter) && inner->outputBindInfo[*iter].second == LoadType::Clear)
-					{
-						iter = preservingWrites.erase(iter);
-					}
-
-					else
-					{
-						++iter;
-					}
+					adjacencyLists[i].emplace_back(j);
+					break;
 				}
-
-				std::set_intersection(outer->writes.cbegin(), outer->writes.cend(), preservingWrites.cbegin(), preservingWrites.cend(), std::back_inserter(intersection));
-			}
-
-			// If there's a write-to-read or write-to-write dependency, create an edge.
-			if (intersection.size() > 0)
-			{
-				adjacencyLists[i].emplace_back(j);
 			}
 		}
 	}
@@ -101,10 +114,74 @@ void RenderGraph::TopologicalSort()
 	}
 }
 
+bool RenderGraph::IsRootPass(const RenderPass& pass) const
+{
+	for (const auto resource : pass.reads)
+	{
+		if (sinks.contains(resource))
+			return true;
+	}
+
+	for (const auto resource : pass.writes)
+	{
+		if (sinks.contains(resource))
+			return true;
+
+		// Writes to imported and persistent resources are visible outside of this graph.
+		if (const auto it = resourceManager->transientBufferResources.find(resource); it != resourceManager->transientBufferResources.end())
+		{
+			if (it->second.first.persistent)
+				return true;
+		}
+
+		else if (const auto it = resourceManager->transientTextureResources.find(resource); it != resourceManager->transientTextureResources.end())
+		{
+			if (it->second.first.persistent)
+				return true;
+		}
+
+		else
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void RenderGraph::CullPasses()
+{
+	VGScopedCPUStat("Cull Passes");
+
+	// Edges always point forward in the sorted order, so a single reverse sweep finds every pass that reaches a root.
+	std::vector<bool> live(passes.size(), false);
+
+	for (auto iter = sorted.rbegin(); iter != sorted.rend(); ++iter)
+	{
+		const auto pass = *iter;
+
+		if (!passes[pass]->enabled)
+			continue;  // Disabled passes never execute, their outputs can't contribute to anything.
+
+		live[pass] = IsRootPass(*passes[pass]) || std::any_of(adjacencyLists[pass].cbegin(), adjacencyLists[pass].cend(), [&live](const auto adjacentPass)
+		{
+			return live[adjacentPass];
+		});
+	}
+
+	const auto culled = std::erase_if(sorted, [&live](const auto pass) { return !live[pass]; });
+	if (culled > 0)
+	{
+		VGLog(logRendering, "Culled {} render graph passes that don't contribute to any sink.", culled);
+	}
+}
+
 void RenderGraph::BuildDepthMap()
 {
 	VGScopedCPUStat("Build Depth Map");
 
+	depthMap.assign(passes.size(), 0);
+
 	for (const auto pass : sorted)
 	{
 		for (const auto adjacentPass : adjacencyLists[pass])
@@ -117,121 +194,357 @@ void RenderGraph::BuildDepthMap()
 	}
 }
 
-void RenderGraph::InjectBarriers(RenderDevice* device, size_t passId)
+size_t RenderGraph::ComputeStructureHash() const
 {
-	VGScopedCPUStat("Inject Barriers");
+	VGScopedCPUStat("Compute Structure Hash");
 
-	auto& pass = passes[passId];
-	auto& list = passLists[passId];
+	size_t hash = passes.size();
+	HashCombine(hash, resourceManager->passCulling);
 
-	const auto UAVBarrier = [&](auto handle)
+	for (const auto resource : sinks)
 	{
-		const auto& component = device->GetResourceManager().Get(handle);
-		if (component.state == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+		HashCombine(hash, resource.id - resourceBase);
+	}
+
+	for (const auto& pass : passes)
+	{
+		HashCombine(hash, pass->stableName, pass->queue, pass->enabled);
+
+		const auto HashResource = [this, &pass, &hash](const RenderResource resource)
 		{
-			// We don't know if the previous pass wrote to this resource or not, so just be safe and emit a UAV barrier.
-			// We could figure out whether or not a write actually happened by looking at the correct pass, but that's
-			// unnecessary for now.
+			// Resources from previous frames wrap around, which is still stable as long as the structure is.
+			HashCombine(hash, resource.id - resourceBase, pass->GetMipMask(resource));
 
-			list->UAVBarrier(handle);
-		}
+			if (const auto it = pass->bindInfo.find(resource); it != pass->bindInfo.end())
+				HashCombine(hash, it->second);
+
+			if (const auto it = pass->outputBindInfo.find(resource); it != pass->outputBindInfo.end())
+				HashCombine(hash, it->second.first, it->second.second);
+		};
+
+		if (pass->predicate)
+			HashCombine(hash, pass->predicate->buffer.id - resourceBase, pass->predicate->offset);
+
+		HashCombine(hash, pass->reads.size());
+		for (const auto resource : pass->reads) HashResource(resource);
+		HashCombine(hash, pass->writes.size());
+		for (const auto resource : pass->writes) HashResource(resource);
+	}
+
+	return hash;
+}
+
+void RenderGraph::BuildBarrierPlan(RenderDevice* device, bool asyncCompute)
+{
+	VGScopedCPUStat("Build Barrier Plan");
+
+	barrierPlan.assign(passes.size(), {});
+
+	const auto splitBarriers = *CvarGet("splitBarriers", int) > 0;
+
+	// Mirrors the transition skipping in command lists.
+	const auto Covers = [](D3D12_RESOURCE_STATES oldState, D3D12_RESOURCE_STATES newState)
+	{
+		if (newState == D3D12_RESOURCE_STATE_COMMON || oldState == D3D12_RESOURCE_STATE_COMMON)
+			return newState == oldState;
+
+		return (newState & oldState) == newState;
 	};
 
-	for (const auto resource : pass->reads)
+	struct LastUse
 	{
-		auto buffer = resourceManager->GetOptionalBuffer(resource);
-		auto texture = resourceManager->GetOptionalTexture(resource);
+		size_t pass;
+		size_t access;
+		size_t position;  // Position among passes on the same queue.
+		bool compute;
+		D3D12_RESOURCE_STATES state;
+		uint64_t pendingMips = 0;  // Mips written through UAVs since the last barrier on the resource.
+	};
+
+	std::unordered_map<entt::entity, LastUse> lastUses;
+	size_t directPosition = 0;
+	size_t computePosition = 0;
 
-		if (buffer) UAVBarrier(*buffer);
-		else if (texture) UAVBarrier(*texture);
+	for (const auto passIndex : sorted)
+	{
+		auto& pass = passes[passIndex];
 
-		const auto Transition = [&](D3D12_RESOURCE_STATES state)
+		if (!pass->enabled)
 		{
-			if (buffer)
+			continue;
+		}
+
+		const auto compute = asyncCompute && pass->queue == ExecutionQueue::Compute;
+		const auto position = compute ? computePosition++ : directPosition++;
+		auto& accesses = barrierPlan[passIndex];
+
+		const auto AddBuffer = [&](const BufferHandle buffer, D3D12_RESOURCE_STATES state, bool write)
+		{
+			// Dynamic buffers never transition. Neither do acceleration structures, their builds issue their own barriers.
+			const auto& description = device->GetResourceManager().Get(buffer).description;
+			if (description.updateRate == ResourceFrequency::Static && (description.bindFlags & BindFlag::AccelerationStructure) == 0)
+				accesses.emplace_back(ResourceAccess{ .entity = buffer.handle, .texture = false, .state = state, .write = write, .mips = ~0ull });
+		};
+
+		const auto AddAccess = [&](const RenderResource resource, D3D12_RESOURCE_STATES state, bool write)
+		{
+			if (auto buffer = resourceManager->GetOptionalBuffer(resource); buffer)
 			{
-				list->TransitionBarrier(*buffer, state);
+				AddBuffer(*buffer, state, write);
 
-				if (state == D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT)
-				{
-					// If we have a counter buffer, we need to make sure it's in the proper state.
-					auto& bufferComponent = device->GetResourceManager().Get(*buffer);
-					if (bufferComponent.description.uavCounter)
-					{
-						list->TransitionBarrier(bufferComponent.counterBuffer, state);
-					}
-				}
+				// If we have a counter buffer, we need to make sure it's in the proper state.
+				const auto& component = device->GetResourceManager().Get(*buffer);
+				if (component.description.uavCounter && ((state & D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT) || state == D3D12_RESOURCE_STATE_UNORDERED_ACCESS))
+					AddBuffer(component.counterBuffer, state, write);
 			}
 
-			else if (texture)
+			else
 			{
-				list->TransitionBarrier(*texture, state);
+				accesses.emplace_back(ResourceAccess{ .entity = resourceManager->GetTexture(resource).handle, .texture = true, .state = state, .write = write,
+					.mips = pass->GetMipMask(resource) });
 			}
 		};
 
-		switch (pass->bindInfo[resource])
+		for (const auto resource : pass->reads)
 		{
-		case ResourceBind::CBV: Transition(D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER); break;
-		case ResourceBind::SRV: Transition(D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE); break;
-		case ResourceBind::UAV: Transition(D3D12_RESOURCE_STATE_UNORDERED_ACCESS); break;
-		case ResourceBind::DSV: Transition(D3D12_RESOURCE_STATE_DEPTH_READ); break;
-		case ResourceBind::Indirect: Transition(D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT); break;
-		case ResourceBind::Common: Transition(D3D12_RESOURCE_STATE_COMMON); break;
+			D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_COMMON;
+			switch (pass->bindInfo[resource])
+			{
+			case ResourceBind::CBV: state = D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER; break;
+			case ResourceBind::SRV: state = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE; break;
+			case ResourceBind::UAV: state = D3D12_RESOURCE_STATE_UNORDERED_ACCESS; break;
+			case ResourceBind::DSV: state = D3D12_RESOURCE_STATE_DEPTH_READ; break;
+			case ResourceBind::Indirect: state = D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT | D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER; break;  // Mesh draws also fetch instance data from their arguments.
+			case ResourceBind::Common: state = D3D12_RESOURCE_STATE_COMMON; break;
+			case ResourceBind::AccelerationStructure: state = D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE; break;
+			case ResourceBind::ShadingRate: state = D3D12_RESOURCE_STATE_SHADING_RATE_SOURCE; break;
+			}
+
+			// The predication state is the indirect argument state, combined with however else the pass reads the buffer.
+			if (pass->predicate && pass->predicate->buffer == resource)
+				state |= D3D12_RESOURCE_STATE_PREDICATION;
+
+			AddAccess(resource, state, false);
 		}
-	}
 
-	for (const auto resource : pass->writes)
-	{
-		auto buffer = resourceManager->GetOptionalBuffer(resource);
-		auto texture = resourceManager->GetOptionalTexture(resource);
+		for (const auto resource : pass->writes)
+		{
+			if (pass->outputBindInfo.contains(resource))
+			{
+				switch (pass->outputBindInfo[resource].first)
+				{
+				case OutputBind::RTV: AddAccess(resource, D3D12_RESOURCE_STATE_RENDER_TARGET, false); break;
+				case OutputBind::DSV: AddAccess(resource, D3D12_RESOURCE_STATE_DEPTH_WRITE, false); break;
+				}
+			}
 
-		if (buffer) UAVBarrier(*buffer);
-		else if (texture) UAVBarrier(*texture);
+			else if (pass->bindInfo[resource] == ResourceBind::UAV)
+			{
+				AddAccess(resource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, true);
+			}
+		}
 
-		const auto Transition = [&](D3D12_RESOURCE_STATES state)
+		for (size_t i = 0; i < accesses.size(); ++i)
 		{
-			if (buffer)
+			auto& access = accesses[i];
+
+			// Compute lists can only use the non-pixel shader resource state.
+			const auto state = compute ? access.state & ~D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE : access.state;
+
+			uint64_t pendingMips = 0;
+
+			if (const auto it = lastUses.find(access.entity); it != lastUses.end() && it->second.pass != passIndex)
 			{
-				list->TransitionBarrier(*buffer, state);
+				const auto& last = it->second;
+				auto& lastAccess = barrierPlan[last.pass][last.access];
 
-				if (state == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+				// Cross-queue uses are already synchronized with fences.
+				if (last.compute == compute)
 				{
-					// If we have a counter buffer, we need to make sure it's in the proper state.
-					auto& bufferComponent = device->GetResourceManager().Get(*buffer);
-					if (bufferComponent.description.uavCounter)
+					// Only UAV accesses without a transition in between need to wait on writes, and only on writes to the
+					// mips they access. Writes to other mips stay pending for later accesses.
+					if (last.state == D3D12_RESOURCE_STATE_UNORDERED_ACCESS && state == D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
 					{
-						list->TransitionBarrier(bufferComponent.counterBuffer, state);
+						access.uavBarrier = (last.pendingMips & access.mips) != 0;
+						pendingMips = access.uavBarrier ? 0 : last.pendingMips;
+					}
+
+					// Split the transition if there's other work on the queue to overlap it with.
+					else if (splitBarriers && !Covers(last.state, state) && position > last.position + 1)
+					{
+						lastAccess.splitBegin = access.state;
+						access.splitEnd = true;
 					}
 				}
 			}
 
-			else if (texture)
+			if (access.write)
+				pendingMips |= access.mips;
+
+			lastUses[access.entity] = LastUse{ passIndex, i, position, compute, state, pendingMips };
+		}
+	}
+
+	// Resources only read during the frame, such as lookup tables and last frame's history, are transitioned once to the
+	// combination of every read state they're used in. Later reads are then covered, and since states persist across
+	// frames, the resource is already in its combined state next frame unless something else transitions it.
+	struct ReadBundle
+	{
+		D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_COMMON;
+		bool readOnly = true;
+		bool compute = false;  // Read on the async compute queue, which can't use graphics-only states.
+	};
+
+	const auto IsReadState = [](D3D12_RESOURCE_STATES state)
+	{
+		return state != D3D12_RESOURCE_STATE_COMMON && (state & ~(D3D12_RESOURCE_STATE_GENERIC_READ | D3D12_RESOURCE_STATE_DEPTH_READ)) == 0;
+	};
+
+	std::unordered_map<entt::entity, ReadBundle> bundles;
+
+	for (const auto passIndex : sorted)
+	{
+		const auto compute = asyncCompute && passes[passIndex]->queue == ExecutionQueue::Compute;
+
+		for (const auto& access : barrierPlan[passIndex])
+		{
+			auto& bundle = bundles[access.entity];
+			bundle.readOnly &= !access.write && IsReadState(access.state);
+			bundle.state |= compute ? access.state & ~D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE : access.state;
+			bundle.compute |= compute;
+		}
+	}
+
+	for (auto& accesses : barrierPlan)
+	{
+		for (auto& access : accesses)
+		{
+			const auto& bundle = bundles[access.entity];
+			if (!bundle.readOnly || (bundle.compute && !IsComputeCompatibleState(bundle.state)))
+				continue;
+
+			access.state = bundle.state;
+			access.splitBegin.reset();
+			access.splitEnd = false;
+		}
+	}
+}
+
+bool RenderGraph::InjectBarriers(RenderDevice* device, size_t passId, CommandList& handoffList)
+{
+	VGScopedCPUStat("Inject Barriers");
+
+	auto& pass = passes[passId];
+	auto& list = passLists[passId];
+	bool handedOff = false;
+
+	// Compute lists can't transition out of graphics-only states, so route these resources through the common state
+	// on the direct queue first.
+	const auto Handoff = [&](auto handle)
+	{
+		if (list->Type() != D3D12_COMMAND_LIST_TYPE_COMPUTE)
+			return;
+
+		if (!IsComputeCompatibleState(device->GetResourceManager().Get(handle).state))
+		{
+			handoffList.ClosingTransitionBarrier(handle, D3D12_RESOURCE_STATE_COMMON);
+			handedOff = true;
+		}
+	};
+
+	// Memory aliased transients are activated by their first pass, the memory's contents belong to a previous resource.
+	FrameVector<TextureHandle> discards{ &device->GetFrameArena() };
+
+	if (const auto it = resourceManager->aliasedActivations.find(passId); it != resourceManager->aliasedActivations.end())
+	{
+		for (const auto resource : it->second)
+		{
+			if (auto buffer = resourceManager->GetOptionalBuffer(resource); buffer)
 			{
-				list->TransitionBarrier(*texture, state);
+				list->AliasingBarrier(*buffer);
 			}
-		};
 
-		if (pass->outputBindInfo.contains(resource))
-		{
-			switch (pass->outputBindInfo[resource].first)
+			else
 			{
-			case OutputBind::RTV: Transition(D3D12_RESOURCE_STATE_RENDER_TARGET); break;
-			case OutputBind::DSV: Transition(D3D12_RESOURCE_STATE_DEPTH_WRITE); break;
+				const auto texture = resourceManager->GetTexture(resource);
+				list->AliasingBarrier(texture);
+
+				// Render targets and depth stencils must be initialized after activation, unless the pass clears them.
+				const auto& component = device->GetResourceManager().Get(texture);
+				const auto cleared = pass->outputBindInfo.contains(resource) && pass->outputBindInfo[resource].second == LoadType::Clear;
+				if (component.description.bindFlags & (BindFlag::RenderTarget | BindFlag::DepthStencil) && !cleared)
+				{
+					discards.emplace_back(texture);
+				}
 			}
 		}
+	}
 
-		else
+	auto& accesses = barrierPlan[passId];
+
+	for (const auto& access : accesses)
+	{
+		const auto Barrier = [&](auto handle)
 		{
-			switch (pass->bindInfo[resource])
+			Handoff(handle);
+
+			if (access.uavBarrier)
+				list->UAVBarrier(handle);
+
+			list->TransitionBarrier(handle, access.state, access.splitEnd ? D3D12_RESOURCE_BARRIER_FLAG_END_ONLY : D3D12_RESOURCE_BARRIER_FLAG_NONE);
+		};
+
+		if (access.texture) Barrier(TextureHandle{ access.entity });
+		else Barrier(BufferHandle{ access.entity });
+	}
+
+	auto* timelinePass = resourceManager->captureTimeline ? &resourceManager->timeline.passes[passId] : nullptr;
+	if (timelinePass)
+	{
+		for (const auto& barrier : list->GetPendingBarriers())
+		{
+			switch (barrier.Type)
 			{
-			case ResourceBind::UAV: Transition(D3D12_RESOURCE_STATE_UNORDERED_ACCESS); break;
+			case D3D12_RESOURCE_BARRIER_TYPE_TRANSITION:
+				if (barrier.Flags & D3D12_RESOURCE_BARRIER_FLAG_END_ONLY) timelinePass->splitEnds++;
+				else timelinePass->transitions++;
+				break;
+			case D3D12_RESOURCE_BARRIER_TYPE_ALIASING: timelinePass->aliasingBarriers++; break;
+			case D3D12_RESOURCE_BARRIER_TYPE_UAV: timelinePass->uavBarriers++; break;
 			}
 		}
 	}
 
-	for (auto& list : passLists)
+	list->FlushBarriers();
+
+	for (const auto texture : discards)
 	{
-		list->FlushBarriers();
+		// Discarding is only valid in output states, passes that first write through a UAV are expected to overwrite the texture.
+		const auto& component = device->GetResourceManager().Get(texture);
+		if (component.state == D3D12_RESOURCE_STATE_RENDER_TARGET || component.state == D3D12_RESOURCE_STATE_DEPTH_WRITE)
+		{
+			list->Native()->DiscardResource(component.Native(), nullptr);
+		}
 	}
+
+	// Begin transitions for later passes after this pass finishes, nothing else uses these resources in between.
+	const auto closingCount = list->GetClosingBarrierCount();
+
+	for (const auto& access : accesses)
+	{
+		if (access.splitBegin)
+		{
+			if (access.texture) list->ClosingTransitionBarrier(TextureHandle{ access.entity }, *access.splitBegin, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY);
+			else list->ClosingTransitionBarrier(BufferHandle{ access.entity }, *access.splitBegin, D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY);
+		}
+	}
+
+	if (timelinePass)
+	{
+		timelinePass->splitBegins += static_cast<uint32_t>(list->GetClosingBarrierCount() - closingCount);
+	}
+
+	return handedOff;
 }
 
 std::pair<uint32_t, uint32_t> RenderGraph::GetBackBufferResolution(RenderDevice* device)
@@ -243,22 +556,34 @@ std::pair<uint32_t, uint32_t> RenderGraph::GetBackBufferResolution(RenderDevice*
 	return std::make_pair(buffer.description.width, buffer.description.height);
 }
 
+std::pair<uint32_t, uint32_t> RenderGraph::GetOutputResolution(RenderDevice* device)
+{
+	if (outputResolution.first > 0 && outputResolution.second > 0)
+	{
+		return outputResolution;
+	}
+
+	return GetBackBufferResolution(device);
+}
+
 PipelineState& RenderGraph::RequestPipelineState(RenderDevice* device, const RenderPipelineLayout& layout, size_t passIndex)
 {
 	std::vector<DXGI_FORMAT> renderTargetFormats;
 	DXGI_FORMAT depthStencilFormat = DXGI_FORMAT_UNKNOWN;
-	renderTargetFormats.reserve(passes[passIndex]->outputBindInfo.size());
+	renderTargetFormats.reserve(passes[passIndex]->renderTargets.size());
 
-	for (const auto& [resource, bindInfo] : passes[passIndex]->outputBindInfo)
+	for (const auto resource : passes[passIndex]->renderTargets)
 	{
 		const auto& texture = device->GetResourceManager().Get(resourceManager->GetTexture(resource));
-		const auto format = texture.description.format;
+		renderTargetFormats.emplace_back(texture.description.format);
+	}
 
-		if (bindInfo.first == OutputBind::RTV)
-			renderTargetFormats.emplace_back(format);
-		else
+	for (const auto& [resource, bindInfo] : passes[passIndex]->outputBindInfo)
+	{
+		if (bindInfo.first == OutputBind::DSV)
 		{
-			depthStencilFormat = ConvertResourceFormatToTypedDepth(format);
+			const auto& texture = device->GetResourceManager().Get(resourceManager->GetTexture(resource));
+			depthStencilFormat = ConvertResourceFormatToTypedDepth(texture.description.format);
 		}
 	}
 
@@ -277,43 +602,192 @@ PipelineState& RenderGraph::RequestPipelineState(RenderDevice* device, const Ren
 		}
 	}
 
-	auto hash = std::hash<RenderPipelineLayout>{}(layout);
-	for (const auto format : renderTargetFormats)
+	// The description hash is cached by the layout, only the pass formats and permutation key are hashed per request.
+	const auto PassHash = [&](size_t descriptionHash, uint32_t key)
 	{
-		HashCombine(hash, format);
+		auto hash = descriptionHash;
+		for (const auto format : renderTargetFormats)
+		{
+			HashCombine(hash, format);
+		}
+		HashCombine(hash, depthStencilFormat);
+		HashCombine(hash, key);
+		return hash;
+	};
+
+	const auto PermutationHash = [&](uint32_t key)
+	{
+		return PassHash(layout.GetDescriptionHash(), key);
+	};
+
+	const auto hash = PermutationHash(layout.GetPermutationKey());
+
+	// The fallback's pipeline for this pass, if it's built. The pipeline lock must be held.
+	const auto FindFallback = [&]() -> PipelineState*
+	{
+		if (!layout.fallback)
+		{
+			return nullptr;
+		}
+
+		const auto fallbackHash = PassHash(layout.fallback->first, layout.fallback->second);
+		if (resourceManager->pendingPipelines.contains(fallbackHash))
+		{
+			return nullptr;
+		}
+
+		const auto it = resourceManager->passPipelines.find(fallbackHash);
+		return it != resourceManager->passPipelines.end() ? &it->second : nullptr;
+	};
+
+	// Passes request pipelines while recording in parallel. The lock only guards the pipeline maps, compilation happens
+	// outside of it so that passes requesting different pipelines compile concurrently. Nearly every request is for a
+	// pipeline that's already built, which only needs to read the maps.
+	{
+		std::shared_lock lock{ pipelineLock };
+
+		if (!resourceManager->pendingPipelines.contains(hash))
+		{
+			if (const auto it = resourceManager->passPipelines.find(hash); it != resourceManager->passPipelines.end())
+			{
+				return it->second;
+			}
+		}
+
+		if (resourceManager->backgroundPipelineHashes.contains(hash))
+		{
+			if (auto* const fallback = FindFallback())
+			{
+				return *fallback;
+			}
+		}
+	}
+
+	std::unique_lock lock{ pipelineLock };
+
+	// Another pass is already building this pipeline, wait for it instead of compiling it again.
+	if (const auto it = resourceManager->pendingPipelines.find(hash); it != resourceManager->pendingPipelines.end())
+	{
+		auto pending = it->second;
+		lock.unlock();
+		pending.wait();
+		lock.lock();
+
+		return resourceManager->passPipelines.at(hash);
 	}
-	HashCombine(hash, depthStencilFormat);
 
 	if (const auto it = resourceManager->passPipelines.find(hash); it != resourceManager->passPipelines.end())
 	{
 		return it->second;
 	}
 
-	else
+	// The full description of a permutation for just this pass. Note that the pass formats don't affect the layout's hash!
+	const auto PassDescription = [&](uint32_t key)
 	{
-		VGLog(logRendering, "Compiling new pipeline layout request for pass: '{}'", Str2WideStr(passes[passIndex]->stableName.data()));
+		auto result = layout.GetPermutationDescription(key);
+		if (auto* const description = std::get_if<GraphicsPipelineStateDescription>(&result))
+		{
+			description->renderTargetCount = renderTargetFormats.size();
+			std::memset(description->renderTargetFormats, DXGI_FORMAT_UNKNOWN, std::size(description->renderTargetFormats) * sizeof(DXGI_FORMAT));
+			std::copy(renderTargetFormats.begin(), renderTargetFormats.end(), std::begin(description->renderTargetFormats));
+			description->depthStencilFormat = depthStencilFormat;
+		}
 
-		PipelineState state{};
-		std::visit([device, &state, &renderTargetFormats, &depthStencilFormat](auto&& description)
+		return result;
+	};
+
+	// Draw with the fallback while the missing permutations compile in the background, instead of stalling the frame.
+	if (auto* const fallback = FindFallback())
+	{
+		if (!resourceManager->backgroundPipelineHashes.contains(hash))
 		{
-			// Modified description for just this pass. Note that this doesn't affect the hash!
-			auto passDescription = description;
+			VGLog(logRendering, "Compiling new pipeline layout request for pass: '{}' in the background, {} permutation(s).",
+				Str2WideStr(passes[passIndex]->stableName.data()), layout.GetPermutationCount());
 
-			using T = std::decay_t<decltype(description)>;
-			if constexpr (std::is_same_v<T, GraphicsPipelineStateDescription>)
+			std::vector<std::pair<size_t, decltype(PassDescription(0))>> requests;
+			for (uint32_t key = 0; key < layout.GetPermutationCount(); ++key)
 			{
-				passDescription.renderTargetCount = renderTargetFormats.size();
-				std::memset(passDescription.renderTargetFormats, DXGI_FORMAT_UNKNOWN, std::size(passDescription.renderTargetFormats) * sizeof(DXGI_FORMAT));
-				std::copy(renderTargetFormats.begin(), renderTargetFormats.end(), std::begin(passDescription.renderTargetFormats));
-				passDescription.depthStencilFormat = depthStencilFormat;
+				const auto permutationHash = PermutationHash(key);
+				if (resourceManager->passPipelines.contains(permutationHash) || resourceManager->backgroundPipelineHashes.contains(permutationHash))
+				{
+					continue;
+				}
+
+				requests.emplace_back(permutationHash, PassDescription(key));
+				resourceManager->backgroundPipelineHashes.emplace(permutationHash);
 			}
 
+			// Descriptions are copied, the pipeline maps aren't touched off of the render thread.
+			resourceManager->backgroundPipelines.emplace_back(std::async(std::launch::async, [device, requests = std::move(requests)]()
+			{
+				std::vector<std::pair<size_t, PipelineState>> built(requests.size());
+				std::transform(std::execution::par, requests.begin(), requests.end(), built.begin(), [device](const auto& request)
+				{
+					ScopedThreadPlacement placement{ ThreadPlacement::Efficiency };
+
+					std::pair<size_t, PipelineState> result{ request.first, PipelineState{} };
+					std::visit([device, &result](auto&& description)
+					{
+						using T = std::decay_t<decltype(description)>;
+						if constexpr (!std::is_same_v<T, std::monostate>)
+							result.second.Build(*device, description, result.first);
+					}, request.second);
+
+					return result;
+				});
+
+				return built;
+			}));
+		}
+
+		return *fallback;
+	}
+
+	VGLog(logRendering, "Compiling new pipeline layout request for pass: '{}', {} permutation(s).",
+		Str2WideStr(passes[passIndex]->stableName.data()), layout.GetPermutationCount());
+
+	// Claim every missing permutation, toggling a permutation macro later is then just a lookup. Map references are stable,
+	// so the pipelines are built in place once the lock is released.
+	std::promise<void> built;
+	const auto builtFuture = built.get_future().share();
+	std::vector<std::pair<uint32_t, PipelineState*>> claimed;
+	for (uint32_t key = 0; key < layout.GetPermutationCount(); ++key)
+	{
+		const auto permutationHash = PermutationHash(key);
+		if (resourceManager->passPipelines.contains(permutationHash))
+		{
+			continue;
+		}
+
+		claimed.emplace_back(key, &resourceManager->passPipelines[permutationHash]);
+		resourceManager->pendingPipelines.emplace(permutationHash, builtFuture);
+	}
+
+	lock.unlock();
+
+	// Shader compilers are per thread, so permutations compile in parallel.
+	std::for_each(std::execution::par, claimed.begin(), claimed.end(), [&](const auto& entry)
+	{
+		const auto key = entry.first;
+		auto* const state = entry.second;
+		std::visit([device, state, cacheKey = PermutationHash(key)](auto&& description)
+		{
+			using T = std::decay_t<decltype(description)>;
 			if constexpr (!std::is_same_v<T, std::monostate>)
-				state.Build(*device, passDescription);
-		}, layout.description);
+				state->Build(*device, description, cacheKey);
+		}, PassDescription(key));
+	});
+
+	lock.lock();
 
-		return resourceManager->passPipelines.emplace(std::move(hash), std::move(state)).first->second;
+	for (const auto& [key, state] : claimed)
+	{
+		resourceManager->pendingPipelines.erase(PermutationHash(key));
 	}
+
+	built.set_value();
+
+	return resourceManager->passPipelines.at(hash);
 }
 
 RenderPass& RenderGraph::AddPass(std::string_view stableName, ExecutionQueue execution, bool enabled)
@@ -325,6 +799,20 @@ void RenderGraph::Build()
 {
 	VGScopedCPUStat("Render Graph Build");
 
+	// The graph is recreated every frame, but its structure only changes when passes are toggled. Reuse the previous
+	// schedule when nothing changed, it has already been validated.
+	const auto hash = ComputeStructureHash();
+	auto& compiled = resourceManager->compiledGraph;
+
+	if (compiled && compiled->hash == hash)
+	{
+		sorted = compiled->sorted;
+
+		return;
+	}
+
+	VGLog(logRendering, "Render graph structure changed, rebuilding.");
+
 	for (const auto& pass : passes)
 	{
 		pass->Validate();
@@ -332,23 +820,102 @@ void RenderGraph::Build()
 
 	BuildAdjacencyLists();
 	TopologicalSort();
+
+	if (resourceManager->passCulling)
+	{
+		CullPasses();
+	}
+
 	BuildDepthMap();
+
+	compiled = CompiledRenderGraph{ hash, sorted };
 }
 
 void RenderGraph::Execute(RenderDevice* device)
 {
 	VGScopedCPUStat("Render Graph Execute");
 
+	// First and last passes using each non-persistent transient texture, nothing outside of that range needs its contents.
+	// Gathered before the transients are built, which consumes their descriptions.
+	std::unordered_map<RenderResource, std::pair<size_t, size_t>> transientUses;
+	for (const auto i : sorted)
+	{
+		if (!passes[i]->enabled)
+			continue;
+
+		const auto Use = [&](const RenderResource resource)
+		{
+			const auto it = resourceManager->transientTextureResources.find(resource);
+			if (it == resourceManager->transientTextureResources.end() || it->second.first.persistent || sinks.contains(resource))
+				return;
+
+			if (const auto use = transientUses.find(resource); use != transientUses.end())
+				use->second.second = i;
+			else
+				transientUses[resource] = std::make_pair(i, i);
+		};
+
+		for (const auto resource : passes[i]->reads) Use(resource);
+		for (const auto resource : passes[i]->writes) Use(resource);
+	}
+
 	resourceManager->BuildTransients(this);
 	resourceManager->BuildDescriptors(this);
+	resourceManager->ResetCounters(device->GetDirectList());  // Ahead of the barrier plan, which transitions the counters out of the copy.
 
-	passLists.reserve(passes.size());
+	const auto asyncCompute = *CvarGet("asyncCompute", int) > 0;
 
-	for (int i = 0; i < passes.size(); ++i)
+	BuildBarrierPlan(device, asyncCompute);
+
+	// Only passes that will be recorded need lists, culled and disabled passes are left null.
+	passLists.resize(passes.size(), nullptr);
+
+	for (const auto i : sorted)
 	{
-		passLists.emplace_back(std::move(device->AllocateFrameCommandList(this, D3D12_COMMAND_LIST_TYPE_DIRECT, i)));
+		if (!passes[i]->enabled)
+			continue;
+
+		const auto type = asyncCompute && passes[i]->queue == ExecutionQueue::Compute ? D3D12_COMMAND_LIST_TYPE_COMPUTE : D3D12_COMMAND_LIST_TYPE_DIRECT;
+		passLists[i] = device->AllocateFrameCommandList(this, type, i);
 	}
 
+	// Barrier counts are filled in as the barriers are injected.
+	if (resourceManager->captureTimeline)
+	{
+		auto& timeline = resourceManager->timeline;
+		timeline.order = sorted;
+		timeline.passes.assign(passes.size(), {});
+
+		for (const auto i : sorted)
+		{
+			timeline.passes[i].name = passes[i]->stableName;
+			timeline.passes[i].enabled = passes[i]->enabled;
+			timeline.passes[i].asyncCompute = passLists[i] && passLists[i]->Type() == D3D12_COMMAND_LIST_TYPE_COMPUTE;
+		}
+	}
+
+	struct RecordedPass
+	{
+		size_t index;
+		D3D12_COMMAND_LIST_TYPE type;
+		std::optional<size_t> dependency;  // Position of the latest pass on the other queue that must finish first.
+		std::optional<uint32_t> timerSlot;  // Timestamp slot in the GPU profiler, if the pass is timed.
+		std::optional<uint32_t> breadcrumbSlot;  // Marker slot of the GPU breadcrumbs.
+		std::optional<RenderPassTargets> renderPass;  // Graphics passes with outputs.
+	};
+
+	FrameVector<RecordedPass> recorded{ &device->GetFrameArena() };
+	recorded.reserve(sorted.size());
+
+	// Position of the most recent pass using each resource, per queue. Any use on the other queue creates a dependency, which
+	// covers write hazards as well as state transitions issued by passes that only read.
+	std::unordered_map<entt::entity, size_t> lastDirectUse;
+	std::unordered_map<entt::entity, size_t> lastComputeUse;
+
+	// Transitions out of graphics-only states for compute passes are placed on the latest direct list.
+	CommandList* handoffList = &device->GetDirectList();
+	std::optional<size_t> handoffPosition;
+
 	for (const auto i : sorted)
 	{
 		auto& pass = passes[i];
@@ -359,63 +926,156 @@ void RenderGraph::Execute(RenderDevice* device)
 			continue;  // Skip disabled passes.
 		}
 
-		VGScopedCPUTransientStat(pass->stableName.data());
-		VGScopedGPUTransientStat(pass->stableName.data(), device->GetDirectContext(), list->Native());
+		const auto position = recorded.size();
+		auto& entry = recorded.emplace_back(RecordedPass{ i, list->Type() });
+		entry.timerSlot = device->GetProfiler().AddPass(device->GetFrameIndex(), pass->stableName);
+		entry.breadcrumbSlot = device->GetBreadcrumbs().AddPass(device->GetFrameIndex(), pass->stableName);
+		const auto isCompute = entry.type == D3D12_COMMAND_LIST_TYPE_COMPUTE;
+		auto& sameQueueUse = isCompute ? lastComputeUse : lastDirectUse;
+		const auto& otherQueueUse = isCompute ? lastDirectUse : lastComputeUse;
+
+		const auto AddDependency = [&entry](size_t dependency)
+		{
+			entry.dependency = std::max(entry.dependency.value_or(0), dependency);
+		};
+
+		const auto TrackResource = [&](const RenderResource resource)
+		{
+			// Track the underlying resource, since a resource can be imported more than once.
+			const auto buffer = resourceManager->GetOptionalBuffer(resource);
+			const auto entity = buffer ? buffer->handle : resourceManager->GetTexture(resource).handle;
+
+			if (const auto it = otherQueueUse.find(entity); it != otherQueueUse.end())
+			{
+				AddDependency(it->second);
+			}
+
+			sameQueueUse[entity] = position;
+		};
 
-		InjectBarriers(device, i);
+		for (const auto resource : pass->reads) TrackResource(resource);
+		for (const auto resource : pass->writes) TrackResource(resource);
+
+		if (InjectBarriers(device, i, *handoffList) && handoffPosition)
+		{
+			AddDependency(*handoffPosition);  // Handoffs on the device list are already waited on.
+		}
+
+		if (!isCompute)
+		{
+			handoffList = list;
+			handoffPosition = position;
+		}
 
 		list->BindDescriptorAllocator(device->GetDescriptorAllocator());
 
 		if (pass->queue == ExecutionQueue::Graphics)
 		{
-			std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> renderTargets;
-			renderTargets.reserve(pass->outputBindInfo.size());
-			D3D12_CPU_DESCRIPTOR_HANDLE depthStencil;
-			bool hasDepthStencil = false;
+			// Passes writing through unordered access suspend their render pass around dispatches and barriers, so every
+			// segment stores its targets. Passes that only draw end in a single segment, which can skip storing transients
+			// that no later pass uses.
+			const bool unorderedAccess =
+				std::any_of(pass->bindInfo.begin(), pass->bindInfo.end(), [](const auto& entry) { return entry.second == ResourceBind::UAV; }) ||
+				std::any_of(pass->descriptorInfo.begin(), pass->descriptorInfo.end(), [](const auto& entry) { return GetViewUsage(entry.second) & BindFlag::UnorderedAccess; });
+
+			const auto BeginningAccess = [&](const RenderResource resource, LoadType load)
+			{
+				if (load == LoadType::Clear)
+				{
+					// The value given at creation, so the clear is a fast clear.
+					const auto clearValue = device->GetResourceManager().GetClearValue(resourceManager->GetTexture(resource));
 
-			for (const auto& [resource, info] : pass->outputBindInfo)
+					return D3D12_RENDER_PASS_BEGINNING_ACCESS{ .Type = D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_CLEAR, .Clear = { clearValue } };
+				}
+
+				// Nothing wrote to a transient before its first pass.
+				const auto use = transientUses.find(resource);
+				const bool first = use != transientUses.end() && use->second.first == i;
+
+				return D3D12_RENDER_PASS_BEGINNING_ACCESS{ .Type = first ? D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_DISCARD : D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_PRESERVE };
+			};
+
+			const auto EndingAccess = [&](const RenderResource resource)
 			{
-				const auto texture = resourceManager->GetTexture(resource);
-				auto& component = device->GetResourceManager().Get(texture);
+				const auto use = transientUses.find(resource);
+				const bool last = !unorderedAccess && use != transientUses.end() && use->second.second == i;
 
-				if (info.first == OutputBind::RTV)
+				return D3D12_RENDER_PASS_ENDING_ACCESS{ .Type = last ? D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_DISCARD : D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_PRESERVE };
+			};
+
+			RenderPassTargets targets{};
+			targets.flags = unorderedAccess ? D3D12_RENDER_PASS_FLAG_ALLOW_UAV_WRITES : D3D12_RENDER_PASS_FLAG_NONE;
+
+			// Slots must match the pipeline's render target formats, so bind in output order.
+			for (const auto resource : pass->renderTargets)
+			{
+				const auto& component = device->GetResourceManager().Get(resourceManager->GetTexture(resource));
+
+				targets.renderTargets[targets.renderTargetCount++] = D3D12_RENDER_PASS_RENDER_TARGET_DESC{
+					.cpuDescriptor = *component.RTV,
+					.BeginningAccess = BeginningAccess(resource, pass->outputBindInfo.at(resource).second),
+					.EndingAccess = EndingAccess(resource)
+				};
+			}
+
+			const auto SetDepthStencil = [&](const RenderResource resource, std::optional<LoadType> load)
+			{
+				const auto& component = device->GetResourceManager().Get(resourceManager->GetTexture(resource));
+				const auto format = ConvertResourceFormatToTypedDepth(component.description.format);
+				const auto stencil = IsResourceFormatStencil(format);
+
+				const auto noAccess = D3D12_RENDER_PASS_BEGINNING_ACCESS{ .Type = D3D12_RENDER_PASS_BEGINNING_ACCESS_TYPE_NO_ACCESS };
+				const auto noStore = D3D12_RENDER_PASS_ENDING_ACCESS{ .Type = D3D12_RENDER_PASS_ENDING_ACCESS_TYPE_NO_ACCESS };
+
+				// Stencil loads follow depth, clearing both together.
+				targets.depthStencil = D3D12_RENDER_PASS_DEPTH_STENCIL_DESC{
+					.cpuDescriptor = *component.DSV,
+					.DepthBeginningAccess = BeginningAccess(resource, load.value_or(LoadType::Preserve)),
+					.StencilBeginningAccess = stencil ? BeginningAccess(resource, load.value_or(LoadType::Preserve)) : noAccess,
+					.DepthEndingAccess = EndingAccess(resource),
+					.StencilEndingAccess = stencil ? EndingAccess(resource) : noStore
+				};
+
+				// Depth read as an input is bound read only.
+				if (!load)
 				{
-					renderTargets.emplace_back(*component.RTV);
+					targets.flags |= D3D12_RENDER_PASS_FLAG_BIND_READ_ONLY_DEPTH;
+					if (stencil)
+						targets.flags |= D3D12_RENDER_PASS_FLAG_BIND_READ_ONLY_STENCIL;
 				}
+			};
 
-				else if (info.first == OutputBind::DSV)
+			for (const auto& [resource, info] : pass->outputBindInfo)
+			{
+				if (info.first == OutputBind::DSV)
 				{
-					hasDepthStencil = true;
-					depthStencil = *component.DSV;
+					SetDepthStencil(resource, info.second);
 				}
 			}
 
 			// If we don't have a depth stencil output, we might still have one as an input.
-			if (!hasDepthStencil)
+			if (!targets.depthStencil)
 			{
 				for (const auto [resource, bind] : pass->bindInfo)
 				{
 					if (bind == ResourceBind::DSV)
 					{
-						const auto texture = resourceManager->GetTexture(resource);
-						auto& component = device->GetResourceManager().Get(texture);
-
-						hasDepthStencil = true;
-						depthStencil = *component.DSV;
+						SetDepthStencil(resource, std::nullopt);
 
 						break;
 					}
 				}
 			}
 
-			// #TODO: Replace with render passes.
-			list->Native()->OMSetRenderTargets(renderTargets.size(), renderTargets.size() > 0 ? renderTargets.data() : nullptr, false, hasDepthStencil ? &depthStencil : nullptr);
+			if (targets.renderTargetCount > 0 || targets.depthStencil)
+			{
+				entry.renderPass = targets;  // Begun when recording, so the pass timing covers the loads.
+			}
 
 			// If there's a bound render target, use the dimensions of that for the viewport and scissor. Otherwise, use the
-			// device render size. Maybe someday multiple viewports and scissors will be supported, but I have no use for this
+			// output resolution. Maybe someday multiple viewports and scissors will be supported, but I have no use for this
 			// right now.
-			uint32_t viewportWidth = device->renderWidth;
-			uint32_t viewportHeight = device->renderHeight;
+			auto [viewportWidth, viewportHeight] = GetOutputResolution(device);
 
 			for (const auto& [resource, info] : pass->outputBindInfo)
 			{
@@ -448,41 +1108,79 @@ void RenderGraph::Execute(RenderDevice* device)
 			};
 
 			list->Native()->RSSetScissorRects(1, &scissor);
+			list->Native()->OMSetStencilRef(0);
+		}
+	}
 
-			// #TODO: This should be the same as the color given during resource creation. Only store this value in one place.
-			const float ClearColor[] = { 0.f, 0.f, 0.f, 1.f };
+	// Barriers and output setup are resolved serially above, now the pass bodies can be recorded in parallel. Each pass
+	// has its own list, and transitions made inside of a pass are tracked locally.
+	for (const auto& entry : recorded)
+	{
+		passLists[entry.index]->BeginLocalStateTracking();
+	}
 
-			for (const auto& [resource, info] : pass->outputBindInfo)
-			{
-				if (info.second == LoadType::Clear)
-				{
-					const auto texture = resourceManager->GetTexture(resource);
-					auto& component = device->GetResourceManager().Get(texture);
+	const auto RecordPass = [this, device](const RecordedPass& entry)
+	{
+		auto& pass = passes[entry.index];
+		auto& list = passLists[entry.index];
 
-					if (info.first == OutputBind::RTV)
-					{
-						list->Native()->ClearRenderTargetView(*component.RTV, ClearColor, 0, nullptr);
-					}
+		VGScopedCPUTransientStat(pass->stableName.data());
+		VGScopedGPUTransientStat(pass->stableName.data(), device->GetQueueContext(list->Type()), list->Native());
 
-					else if (info.first == OutputBind::DSV)
-					{
-						// #TODO: Stencil clearing.
-						// #TODO: Retrieve clear color from the resource description.
-						list->Native()->ClearDepthStencilView(*component.DSV, D3D12_CLEAR_FLAG_DEPTH/* | D3D12_CLEAR_FLAG_STENCIL*/, 0.f, 0, 0, nullptr);  // Inverse Z.
-					}
-				}
-			}
+		if (entry.breadcrumbSlot)
+		{
+			device->GetBreadcrumbs().BeginPass(*list, device->GetFrameIndex(), *entry.breadcrumbSlot);
+		}
 
-			list->Native()->OMSetStencilRef(0);
+		if (entry.timerSlot)
+		{
+			device->GetProfiler().BeginPass(*list, device->GetFrameIndex(), *entry.timerSlot);
+		}
+
+		if (entry.renderPass)
+		{
+			list->BeginRenderPass(*entry.renderPass);
 		}
 
 		RenderPassResources resources{};
 		resources.resources = resourceManager;
-		resources.passIndex = i;
+		resources.passIndex = entry.index;
+
+		if (pass->predicate)
+		{
+			list->SetPredication(resourceManager->GetBuffer(pass->predicate->buffer), pass->predicate->offset);
+		}
 
 		pass->Execute(*list, resources);
 
-		// #TODO: End render pass.
+		if (pass->predicate)
+		{
+			list->ClearPredication();
+		}
+
+		list->EndRenderPass();
+
+		if (entry.timerSlot)
+		{
+			device->GetProfiler().EndPass(*list, device->GetFrameIndex(), *entry.timerSlot);
+		}
+
+		if (entry.breadcrumbSlot)
+		{
+			device->GetBreadcrumbs().EndPass(*list, device->GetFrameIndex(), *entry.breadcrumbSlot);
+		}
+
+		list->EndLocalStateTracking();
+	};
+
+	if (*CvarGet("parallelRecording", int) > 0)
+	{
+		std::for_each(std::execution::par, recorded.begin(), recorded.end(), RecordPass);
+	}
+
+	else
+	{
+		std::for_each(std::execution::seq, recorded.begin(), recorded.end(), RecordPass);
 	}
 
 	// After recording, we can get rid of the descriptors.
@@ -490,22 +1188,86 @@ void RenderGraph::Execute(RenderDevice* device)
 
 	// Close and submit the command lists.
 
-	std::vector<ID3D12CommandList*> commandLists;
-	commandLists.reserve(passLists.size() + 1);
+	for (auto& list : passLists)
+	{
+		if (!list)
+			continue;
+
+		list->FlushBarriers();
+		list->Close();
+	}
 
+	// Descriptors are written into a staging heap while recording, they must be in the shader-visible heap before any
+	// of the frame's work is submitted.
+	device->GetDescriptorAllocator().Flush();
+
+	// Resources evicted while idle are paged back in before anything in the frame can use them. The compute queue waits
+	// on the direct queue's first submission below.
+	device->GetResourceManager().SubmitResidency(device->GetDirectQueue());
+
+	// Large uploads on the copy queue come before everything else in the frame.
+	device->SubmitCopyList();
+
+	// The device list contains uploads and transitions that any pass may rely on, so submit it first, and have
+	// the compute queue wait on it.
 	device->GetDirectList().FlushBarriers();
 	device->GetDirectList().Close();
-	commandLists.emplace_back(device->GetDirectList().Native());
 
-	for (const auto i : sorted)
+	ID3D12CommandList* deviceList = device->GetDirectList().Native();
+	device->GetDirectQueue()->ExecuteCommandLists(1, &deviceList);
+	device->WaitQueue(D3D12_COMMAND_LIST_TYPE_COMPUTE, D3D12_COMMAND_LIST_TYPE_DIRECT, device->SignalQueue(D3D12_COMMAND_LIST_TYPE_DIRECT));
+
+	// Batch consecutive passes on the same queue, splitting batches whenever a cross-queue wait is needed. Passes
+	// are submitted in sorted order, so dependencies on the other queue have always been submitted already.
+
+	FrameVector<ID3D12CommandList*> batch{ &device->GetFrameArena() };
+	batch.reserve(recorded.size());
+	D3D12_COMMAND_LIST_TYPE batchType = D3D12_COMMAND_LIST_TYPE_DIRECT;
+	size_t batchStart = 0;
+
+	FrameVector<uint64_t> signalValues(recorded.size(), 0, &device->GetFrameArena());
+	uint64_t directWaitedValue = 0;  // Highest compute fence value the direct queue has waited on.
+	uint64_t computeWaitedValue = 0;  // Highest direct fence value the compute queue has waited on.
+
+	const auto Submit = [&](size_t end)
 	{
-		auto& list = passLists[i];
+		if (batch.size() > 0)
+		{
+			device->GetQueue(batchType)->ExecuteCommandLists(batch.size(), batch.data());
+			const auto value = device->SignalQueue(batchType);
+			std::fill(signalValues.begin() + batchStart, signalValues.begin() + end, value);
+			batch.clear();
+		}
 
-		list->FlushBarriers();
-		list->Close();
-		commandLists.emplace_back(list->Native());
+		batchStart = end;
+	};
+
+	for (size_t position = 0; position < recorded.size(); ++position)
+	{
+		const auto& entry = recorded[position];
+
+		if (entry.type != batchType)
+		{
+			Submit(position);
+			batchType = entry.type;
+		}
+
+		if (entry.dependency)
+		{
+			const auto isCompute = entry.type == D3D12_COMMAND_LIST_TYPE_COMPUTE;
+			const auto value = signalValues[*entry.dependency];
+			auto& waitedValue = isCompute ? computeWaitedValue : directWaitedValue;
+
+			if (value > waitedValue)
+			{
+				Submit(position);
+				device->WaitQueue(entry.type, isCompute ? D3D12_COMMAND_LIST_TYPE_DIRECT : D3D12_COMMAND_LIST_TYPE_COMPUTE, value);
+				waitedValue = value;
+			}
+		}
+
+		batch.emplace_back(passLists[entry.index]->Native());
 	}
 
-	// #TODO: Use the queue associated with the depth and execution type.
-	device->GetDirectQueue()->ExecuteCommandLists(commandLists.size(), commandLists.data());
+	Submit(recorded.size());
 }
\ No newline at end of file
@@ -6,12 +6,14 @@
 #include <Rendering/ResourceHandle.h>
 #include <Rendering/RenderPass.h>
 #include <Rendering/RenderGraphResourceManager.h>
+#include <Threading/ReaderWriterLock.h>
 
 #include <vector>
 #include <memory>
 #include <unordered_map>
 #include <stack>
 #include <string_view>
+#include <optional>
 
 class CommandList;
 class Renderer;
@@ -23,6 +25,20 @@ enum class ResourceTag
 	BackBuffer
 };
 
+// A resource used by a pass, along with the barriers planned for it.
+struct ResourceAccess
+{
+	entt::entity entity;
+	bool texture;
+	D3D12_RESOURCE_STATES state;
+	bool write = false;  // Written through a UAV, later UAV accesses must wait on it.
+	uint64_t mips = ~0ull;  // Mips accessed, UAV accesses only wait on writes to the same mips.
+
+	bool uavBarrier = false;  // Waits on a UAV write by the previous pass using the resource.
+	bool splitEnd = false;  // The transition was begun after the previous pass using the resource.
+	std::optional<D3D12_RESOURCE_STATES> splitBegin;  // Begins the transition of the next pass using the resource, on the same queue.
+};
+
 class RenderGraph
 {
 	friend class RenderGraphResourceManager;
@@ -30,32 +46,63 @@ class RenderGraph
 
 private:
 	std::vector<std::unique_ptr<RenderPass>> passes;
-	std::vector<std::shared_ptr<CommandList>> passLists;
-	std::unordered_map<size_t, std::vector<size_t>> adjacencyLists;
+	std::vector<CommandList*> passLists;  // Owned by the device's frame pools.
+	// Passes are dense indices, so per pass bookkeeping is indexed directly.
+	std::vector<std::vector<size_t>> adjacencyLists;
 	std::vector<size_t> sorted;
-	std::unordered_map<size_t, std::uint32_t> depthMap;
+	std::vector<std::uint32_t> depthMap;
+	std::vector<std::vector<ResourceAccess>> barrierPlan;
 
 	std::unordered_map<ResourceTag, RenderResource> taggedResources;
+	ResourceSet sinks;  // Resources consumed outside of the graph, tagged resources are implicitly sinks.
 
 	RenderGraphResourceManager* resourceManager = nullptr;
+	size_t resourceBase = 0;  // First resource ID of this graph, resources are hashed relative to it.
+	std::pair<uint32_t, uint32_t> outputResolution = { 0, 0 };  // Zero follows the back buffer.
+	BufferHandle frameCameras;  // Bound as a root descriptor to pipelines reading it, passes still declare their reads.
+
+	ReaderWriterLock pipelineLock;  // Lookups of built pipelines share it, every pass requests one each frame.
 
 private:
 	void BuildAdjacencyLists();
 	void DepthFirstSearch(size_t node, std::vector<bool>& visited, std::stack<size_t>& stack);
 	void TopologicalSort();
+	bool IsRootPass(const RenderPass& pass) const;
+	void CullPasses();  // Removes passes that don't contribute to any sink from the sorted order.
 	void BuildDepthMap();
 
-	void InjectBarriers(RenderDevice* device, size_t passId);
+	// Hashes the pass and resource declarations, independently of the resource IDs handed out this frame.
+	size_t ComputeStructureHash() const;
+
+	// Resolves the states each pass needs, and which barriers can be split or skipped, before recording any passes.
+	void BuildBarrierPlan(RenderDevice* device, bool asyncCompute);
+
+	// Returns true if any transitions were handed off to the direct queue, which happens when a compute queue pass
+	// uses resources that are in graphics-only states.
+	bool InjectBarriers(RenderDevice* device, size_t passId, CommandList& handoffList);
 
 public:
 	std::pair<uint32_t, uint32_t> GetBackBufferResolution(RenderDevice* device);
+	// Resolution the scene renders at, which transients without an explicit size follow. Can be smaller than the back
+	// buffer, such as when the editor's scene viewport doesn't cover the whole window.
+	std::pair<uint32_t, uint32_t> GetOutputResolution(RenderDevice* device);
+	void SetOutputResolution(uint32_t width, uint32_t height) { outputResolution = { width, height }; }
+	void SetFrameCameras(BufferHandle cameras) { frameCameras = cameras; }
+	BufferHandle GetFrameCameras() const noexcept { return frameCameras; }
+	ExecutionQueue GetPassQueue(size_t passIndex) const noexcept { return passes[passIndex]->queue; }
 
 public:
-	RenderGraph(RenderGraphResourceManager* resources) : resourceManager(resources) {};
+	RenderGraph(RenderGraphResourceManager* resources) : resourceManager(resources), resourceBase(resources->counter) {};
 
 	const RenderResource Import(const BufferHandle resource);
 	const RenderResource Import(const TextureHandle resource);
 	void Tag(const RenderResource resource, ResourceTag tag);
+	void MarkSink(const RenderResource resource);
+	// Texture carried across frames under a stable name, requests within a frame share it. Consecutive frames alternate
+	// between two textures, so the previous frame's contents are readable while the current frame writes. The previous
+	// texture is invalid on the first request, after a resize or description change, and after any frame that didn't
+	// request the history. Histories unused for a few frames are released.
+	HistoryResource CreateHistory(const std::wstring& name, const TransientTextureDescription& description);
 	PipelineState& RequestPipelineState(RenderDevice* device, const RenderPipelineLayout& layout, size_t passIndex);
 	RenderPass& AddPass(std::string_view stableName, ExecutionQueue execution, bool enabled = true);
 	void Build();
@@ -75,4 +122,15 @@ inline const RenderResource RenderGraph::Import(const TextureHandle resource)
 inline void RenderGraph::Tag(const RenderResource resource, ResourceTag tag)
 {
 	taggedResources[tag] = resource;
+	sinks.emplace(resource);
+}
+
+inline void RenderGraph::MarkSink(const RenderResource resource)
+{
+	sinks.emplace(resource);
+}
+
+inline HistoryResource RenderGraph::CreateHistory(const std::wstring& name, const TransientTextureDescription& description)
+{
+	return resourceManager->AddHistory(this, name, description);
 }
\ No newline at end of file
@@ -4,10 +4,13 @@
 
 #include <Rendering/Base.h>
 #include <Rendering/Resource.h>
+#include <Utility/HashCombine.h>
 
 #include <functional>
 #include <type_traits>
 #include <optional>
+#include <vector>
+#include <algorithm>
 
 // Typed resource for compile time validation.
 struct RenderResource
@@ -37,6 +40,61 @@ namespace std
 	};
 }
 
+// Sorted set of resources in contiguous storage. Passes only touch a handful of resources, so this avoids the per node
+// allocations of std::set, while keeping the ordering needed for intersections.
+class ResourceSet
+{
+private:
+	std::vector<RenderResource> resources;
+
+public:
+	using const_iterator = std::vector<RenderResource>::const_iterator;
+
+	void emplace(const RenderResource resource)
+	{
+		const auto it = std::lower_bound(resources.begin(), resources.end(), resource);
+		if (it == resources.end() || !(*it == resource))
+		{
+			resources.insert(it, resource);
+		}
+	}
+
+	bool contains(const RenderResource resource) const
+	{
+		return std::binary_search(resources.begin(), resources.end(), resource);
+	}
+
+	// True if any resource is in both sets.
+	bool Intersects(const ResourceSet& other) const
+	{
+		auto first = resources.begin();
+		auto second = other.resources.begin();
+		while (first != resources.end() && second != other.resources.end())
+		{
+			if (*first < *second) ++first;
+			else if (*second < *first) ++second;
+			else return true;
+		}
+
+		return false;
+	}
+
+	size_t size() const noexcept { return resources.size(); }
+	const_iterator begin() const noexcept { return resources.cbegin(); }
+	const_iterator end() const noexcept { return resources.cend(); }
+	const_iterator cbegin() const noexcept { return resources.cbegin(); }
+	const_iterator cend() const noexcept { return resources.cend(); }
+};
+
+// Texture carried across frames, see RenderGraph::CreateHistory().
+struct HistoryResource
+{
+	RenderResource current;  // Written this frame, read back as the previous texture next frame.
+	RenderResource previous;  // Contents of the last frame, zero without a valid history.
+
+	bool Valid() const noexcept { return previous.id != 0; }
+};
+
 struct TransientBufferDescription
 {
 	ResourceFrequency updateRate = ResourceFrequency::Dynamic;
@@ -44,10 +102,11 @@ struct TransientBufferDescription
 	size_t stride = 0;
 	bool uavCounter = false;
 	std::optional<DXGI_FORMAT> format;
+	bool persistent = false;  // Outlives the graph's last use, so the memory cannot be aliased by other transients.
 
 	bool operator==(const TransientBufferDescription& other) const noexcept
 	{
-		return updateRate == other.updateRate && size == other.size && stride == other.stride && uavCounter == other.uavCounter && format == other.format;
+		return updateRate == other.updateRate && size == other.size && stride == other.stride && uavCounter == other.uavCounter && format == other.format && persistent == other.persistent;
 	}
 };
 
@@ -59,6 +118,8 @@ struct TransientTextureDescription
 	float resolutionScale = 1.f;  // Only applies if using back buffer resolution.
 	DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
 	bool mipMapping = false;
+	bool persistent = false;  // Outlives the graph's last use, so the memory cannot be aliased by other transients.
+	TextureClearValue clearValue;  // Passes clearing the texture use this value, part of the description so reuse keeps fast clears.
 
 	bool operator==(const TransientTextureDescription& other) const noexcept
 	{
@@ -67,6 +128,36 @@ struct TransientTextureDescription
 			depth == other.depth &&
 			resolutionScale == other.resolutionScale &&
 			format == other.format &&
-			mipMapping == other.mipMapping;
+			mipMapping == other.mipMapping &&
+			persistent == other.persistent &&
+			clearValue == other.clearValue;
 	}
-};
\ No newline at end of file
+};
+
+namespace std
+{
+	template <>
+	struct hash<TransientBufferDescription>
+	{
+		size_t operator()(const TransientBufferDescription& description) const
+		{
+			size_t seed = 0;
+			HashCombine(seed, description.updateRate, description.size, description.stride, description.uavCounter, description.format, description.persistent);
+
+			return seed;
+		}
+	};
+
+	template <>
+	struct hash<TransientTextureDescription>
+	{
+		size_t operator()(const TransientTextureDescription& description) const
+		{
+			size_t seed = 0;
+			HashCombine(seed, description.width, description.height, description.depth, description.resolutionScale, description.format, description.mipMapping, description.persistent);
+			HashCombine(seed, description.clearValue.color[0], description.clearValue.color[1], description.clearValue.color[2], description.clearValue.color[3], description.clearValue.depth, description.clearValue.stencil);
+
+			return seed;
+		}
+	};
+}
\ No newline at end of file
@@ -4,19 +4,47 @@
 #include <Rendering/Device.h>
 #include <Rendering/RenderGraph.h>
 #include <Rendering/RenderPass.h>
+#include <Rendering/ResourceFormat.h>
+#include <Utility/AlignedSize.h>
+#include <Utility/HashCombine.h>
+#include <Threading/Thread.h>
 
-DescriptorHandle RenderGraphResourceManager::CreateDescriptorFromView(const RenderResource resource, ShaderResourceViewDescription viewDesc)
+#include <unordered_set>
+#include <execution>
+#include <chrono>
+
+size_t HashViewDescription(const ShaderResourceViewDescription& viewDesc)
+{
+	size_t hash = 0;
+	HashCombine(hash, viewDesc.data.index(), viewDesc.bind, viewDesc.heap);
+
+	if (const auto* bufferDesc = std::get_if<ShaderResourceViewDescription::BufferDesc>(&viewDesc.data))
+	{
+		HashCombine(hash, bufferDesc->start, bufferDesc->count);
+	}
+
+	else if (const auto* textureDesc = std::get_if<ShaderResourceViewDescription::TextureDesc>(&viewDesc.data))
+	{
+		HashCombine(hash, textureDesc->firstMip, textureDesc->mipLevels, textureDesc->mip);
+	}
+
+	return hash;
+}
+
+DescriptorHandle RenderGraphResourceManager::CreateDescriptorFromView(const RenderResource resource, ShaderResourceViewDescription viewDesc, bool persistent)
 {
 	VGScopedCPUStat("Create Descriptor From View");
 
+	// Views of imported resources only live for the frame, so they're bump allocated and released all at once by the
+	// descriptor allocator. Persistent views are released with their transient.
 	DescriptorHandle handle;
 	switch (viewDesc.heap)
 	{
 	case HeapType::Visible:
-		handle = device->AllocateDescriptor(DescriptorType::Default);
+		handle = persistent ? device->AllocateDescriptor(DescriptorType::Default) : device->GetDescriptorAllocator().AllocateFrame();
 		break;
 	case HeapType::NonVisible:
-		handle = device->GetDescriptorAllocator().AllocateNonVisible();
+		handle = persistent ? device->GetDescriptorAllocator().AllocateNonVisible() : device->GetDescriptorAllocator().AllocateFrameNonVisible();
 		break;
 	}
 
@@ -60,11 +88,7 @@ DescriptorHandle RenderGraphResourceManager::CreateDescriptorFromView(const Rend
 		// Using a depth stencil via SRV requires special formatting.
 		if (component.description.bindFlags & BindFlag::DepthStencil)
 		{
-			switch (srvDesc.Format)
-			{
-			case DXGI_FORMAT_R32_TYPELESS: srvDesc.Format = DXGI_FORMAT_R32_FLOAT; break;
-			case DXGI_FORMAT_R24G8_TYPELESS: srvDesc.Format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS; break;
-			}
+			srvDesc.Format = ConvertResourceFormatToTypedNonDepth(srvDesc.Format);
 		}
 
 		switch (component.Native()->GetDesc().Dimension)  // #TODO: Support texture arrays and multi-sample textures.
@@ -124,7 +148,8 @@ DescriptorHandle RenderGraphResourceManager::CreateDescriptorFromView(const Rend
 		}
 		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 
-		uavDesc.Format = srvDesc.Format;
+		// Typed UAVs can't be sRGB, shaders writing to them encode manually.
+		uavDesc.Format = IsResourceFormatSRGB(srvDesc.Format) ? ConvertResourceFormatToLinear(srvDesc.Format) : srvDesc.Format;
 	}
 
 	switch (viewDesc.bind)
@@ -141,6 +166,37 @@ DescriptorHandle RenderGraphResourceManager::CreateDescriptorFromView(const Rend
 	return std::move(handle);
 }
 
+RenderGraphResourceManager::TransientViewCache* RenderGraphResourceManager::GetTransientViewCache(const RenderResource resource)
+{
+	if (const auto buffer = GetOptionalBuffer(resource); buffer)
+	{
+		const auto it = transientBufferViews.find(buffer->handle);
+		return it != transientBufferViews.end() ? &it->second : nullptr;
+	}
+
+	if (const auto texture = GetOptionalTexture(resource); texture)
+	{
+		const auto it = transientTextureViews.find(texture->handle);
+		return it != transientTextureViews.end() ? &it->second : nullptr;
+	}
+
+	return nullptr;
+}
+
+void RenderGraphResourceManager::ReleaseTransientViews(std::unordered_map<entt::entity, TransientViewCache>& caches, entt::entity handle)
+{
+	if (const auto it = caches.find(handle); it != caches.end())
+	{
+		// The GPU may still be using the views this frame.
+		for (auto& [hash, descriptor] : it->second)
+		{
+			device->GetResourceManager().AddFrameDescriptor(device->GetFrameIndex(), std::move(descriptor));
+		}
+
+		caches.erase(it);
+	}
+}
+
 uint32_t RenderGraphResourceManager::GetDefaultDescriptor(const RenderResource resource, ResourceBind bind)
 {
 	switch (bind)
@@ -169,69 +225,331 @@ uint32_t RenderGraphResourceManager::GetDefaultDescriptor(const RenderResource r
 			return -1;
 		}
 		break;
+	case ResourceBind::AccelerationStructure:
+		if (auto buffer = GetOptionalBuffer(resource); buffer)
+		{
+			return device->GetResourceManager().Get(*buffer).SRV->bindlessIndex;
+		}
+		break;
 	}
 
 	return -1;
 }
 
-void RenderGraphResourceManager::SearchCrossFrameTransients(RenderGraph* graph)
+void RenderGraphResourceManager::ReleaseHistory(HistoryTexture& history)
+{
+	for (auto& texture : history.textures)
+	{
+		if (device->GetResourceManager().Valid(texture))
+		{
+			ReleaseTransientViews(transientTextureViews, texture.handle);
+			device->GetResourceManager().AddFrameResource(device->GetFrameIndex(), texture);
+		}
+
+		texture = {};
+	}
+
+	history.valid = false;
+}
+
+HistoryResource RenderGraphResourceManager::AddHistory(RenderGraph* graph, const std::wstring& name, const TransientTextureDescription& description)
 {
-	// We can't check if there's an intersection between pass->reads or pass->writes and the transient resource,
-	// since we can have multiple different resource handles pointing to the same underlying resource.
+	auto& history = histories[name];
+
+	// Requested earlier in this graph.
+	if (history.requestedGraph == graph->resourceBase)
+	{
+		VGAssert(history.description == description, "History requested with different descriptions within a frame.");
+
+		return { history.currentTag, history.previousTag };
+	}
 
-	for (auto& transientBuffer : transientBuffers)
+	auto width = description.width;
+	auto height = description.height;
+	if (width == 0 || height == 0)
+	{
+		const auto [outputWidth, outputHeight] = graph->GetOutputResolution(device);
+		width = static_cast<uint32_t>(outputWidth * description.resolutionScale);
+		height = static_cast<uint32_t>(outputHeight * description.resolutionScale);
+	}
+
+	if (!(history.description == description) || history.width != width || history.height != height)
+	{
+		ReleaseHistory(history);
+		history.description = description;
+		history.width = width;
+		history.height = height;
+		history.binds = 0;
+	}
+
+	// Last frame's texture becomes the previous one.
+	history.current ^= 1;
+	history.requestedGraph = graph->resourceBase;
+	history.currentTag = RenderResource{ counter++ };
+	history.previousTag = history.valid ? RenderResource{ counter++ } : RenderResource{ 0 };
+
+	return { history.currentTag, history.previousTag };
+}
+
+void RenderGraphResourceManager::BuildHistories(RenderGraph* graph, const std::unordered_set<RenderResource>& usedResources)
+{
+	const auto GetUsage = [this](const RenderResource resource)
 	{
-		for (const auto& pass : graph->passes)
+		const auto it = resourceUsage.find(resource);
+		return it != resourceUsage.end() ? it->second : 0u;
+	};
+
+	auto it = histories.begin();
+	while (it != histories.end())
+	{
+		auto& [name, history] = *it;
+
+		if (history.requestedGraph != graph->resourceBase)
 		{
-			std::vector<entt::entity> accessedHandles;
-			accessedHandles.reserve(pass->reads.size() + pass->writes.size());
+			// Skipped frames leave the history stale.
+			history.valid = false;
 
-			for (const auto read : pass->reads)
-			{
-				if (bufferResources.contains(read))
-					accessedHandles.emplace_back(bufferResources[read].handle);
-			}
-			for (const auto write : pass->writes)
+			if (++history.counter > transientExpiration)
 			{
-				if (bufferResources.contains(write))
-					accessedHandles.emplace_back(bufferResources[write].handle);
+				ReleaseHistory(history);
+				it = histories.erase(it);
+				continue;
 			}
 
-			const auto handle = bufferResources[transientBuffer.resource].handle;
-			if (std::find(accessedHandles.begin(), accessedHandles.end(), handle) != accessedHandles.end())
+			++it;
+			continue;
+		}
+
+		history.counter = 0;
+
+		// The previous texture is always read back, some passes use SRV's of resources in UAV states.
+		auto binds = history.binds | GetUsage(history.currentTag) | BindFlag::ShaderResource;
+		if (history.previousTag.id != 0)
+			binds |= GetUsage(history.previousTag);
+		if (binds & BindFlag::UnorderedAccess)
+			binds |= BindFlag::ShaderResource;
+
+		// Created on first use, and again if a pass binds the history in a new way, which loses the previous contents.
+		if (!device->GetResourceManager().Valid(history.textures[0]) || (binds & history.binds) != binds)
+		{
+			ReleaseHistory(history);
+
+			TextureDescription description{};
+			description.bindFlags = binds;
+			description.accessFlags = AccessFlag::CPURead | AccessFlag::CPUWrite | AccessFlag::GPUWrite;
+			description.width = history.width;
+			description.height = history.height;
+			description.depth = history.description.depth;
+			description.format = history.description.format;
+			description.mipMapping = history.description.mipMapping;
+			description.clearValue = history.description.clearValue;
+
+			for (auto& texture : history.textures)
 			{
-				transientBuffer.counter = 0;
-				break;
+				texture = device->GetResourceManager().Create(description, name);
+				transientTextureViews[texture.handle];
 			}
+
+			history.binds = binds;
+		}
+
+		textureResources[history.currentTag] = history.textures[history.current];
+		if (history.previousTag.id != 0)
+			textureResources[history.previousTag] = history.textures[history.current ^ 1];
+
+		// Only a recorded pass leaves contents for the next frame.
+		history.valid = usedResources.contains(history.currentTag);
+
+		++it;
+	}
+}
+
+std::unordered_map<RenderResource, ResourcePlacement> RenderGraphResourceManager::PlanAliasing(RenderGraph* graph, const std::unordered_map<RenderResource, BufferDescription>& bufferDescriptions,
+	const std::unordered_map<RenderResource, TextureDescription>& textureDescriptions)
+{
+	VGScopedCPUStat("Render Graph Plan Aliasing");
+
+	struct Lifetime
+	{
+		size_t first;  // Positions in the sorted pass order.
+		size_t last;
+	};
+
+	// Passes on the async compute queue overlap with direct queue passes, so the sorted order doesn't bound the lifetime of
+	// any resources they use.
+	const auto asyncCompute = *CvarGet("asyncCompute", int) > 0;
+
+	std::unordered_map<RenderResource, Lifetime> lifetimes;
+	std::unordered_set<RenderResource> asyncResources;
+
+	for (size_t position = 0; position < graph->sorted.size(); ++position)
+	{
+		const auto& pass = graph->passes[graph->sorted[position]];
+
+		const auto Use = [&](const RenderResource resource)
+		{
+			if (const auto it = lifetimes.find(resource); it != lifetimes.end())
+				it->second.last = position;
+			else
+				lifetimes[resource] = Lifetime{ position, position };
+
+			if (asyncCompute && pass->queue == ExecutionQueue::Compute)
+				asyncResources.emplace(resource);
+		};
+
+		for (const auto resource : pass->reads) Use(resource);
+		for (const auto resource : pass->writes) Use(resource);
+	}
+
+	struct Candidate
+	{
+		RenderResource resource;
+		TransientHeapType heap;
+		Lifetime lifetime;
+		D3D12_RESOURCE_ALLOCATION_INFO info;
+		uint64_t offset = 0;
+	};
+
+	std::vector<Candidate> candidates;
+	candidates.reserve(bufferDescriptions.size() + textureDescriptions.size());
+
+	const auto IsCandidate = [&](const RenderResource resource)
+	{
+		return lifetimes.contains(resource) && !asyncResources.contains(resource);
+	};
+
+	for (const auto& [resource, description] : bufferDescriptions)
+	{
+		// Dynamic buffers live in upload heaps, which we don't alias.
+		if (IsCandidate(resource) && !transientBufferResources[resource].first.persistent && description.updateRate == ResourceFrequency::Static)
+		{
+			candidates.emplace_back(resource, TransientHeapType::Buffer, lifetimes[resource], device->GetResourceManager().GetAllocationInfo(description));
 		}
 	}
 
-	for (auto& transientTexture : transientTextures)
+	for (const auto& [resource, description] : textureDescriptions)
 	{
-		for (const auto& pass : graph->passes)
+		if (IsCandidate(resource) && !transientTextureResources[resource].first.persistent)
 		{
-			std::vector<entt::entity> accessedHandles;
-			accessedHandles.reserve(pass->reads.size() + pass->writes.size());
+			const auto heap = description.bindFlags & (BindFlag::RenderTarget | BindFlag::DepthStencil) ? TransientHeapType::RenderTarget : TransientHeapType::Texture;
+			candidates.emplace_back(resource, heap, lifetimes[resource], device->GetResourceManager().GetAllocationInfo(description));
+		}
+	}
+
+	// Greedy placement, largest first. Each candidate is pushed past any already placed memory that's alive at the same time.
+	std::sort(candidates.begin(), candidates.end(), [](const auto& left, const auto& right)
+	{
+		return left.info.SizeInBytes > right.info.SizeInBytes;
+	});
 
-			for (const auto read : pass->reads)
+	std::array<uint64_t, static_cast<size_t>(TransientHeapType::Count)> requiredSizes{};
+	std::array<uint64_t, static_cast<size_t>(TransientHeapType::Count)> requiredAlignments{};
+	requiredAlignments.fill(D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		auto& candidate = candidates[i];
+
+		bool moved = true;
+		while (moved)
+		{
+			moved = false;
+
+			for (size_t j = 0; j < i; ++j)
 			{
-				if (textureResources.contains(read))
-					accessedHandles.emplace_back(textureResources[read].handle);
+				const auto& other = candidates[j];
+				if (other.heap != candidate.heap)
+					continue;
+
+				const auto lifetimesOverlap = candidate.lifetime.first <= other.lifetime.last && other.lifetime.first <= candidate.lifetime.last;
+				const auto memoryOverlaps = candidate.offset < other.offset + other.info.SizeInBytes && other.offset < candidate.offset + candidate.info.SizeInBytes;
+
+				if (lifetimesOverlap && memoryOverlaps)
+				{
+					candidate.offset = AlignedSize(other.offset + other.info.SizeInBytes, candidate.info.Alignment);
+					moved = true;
+				}
 			}
-			for (const auto write : pass->writes)
+		}
+
+		const auto heapIndex = static_cast<size_t>(candidate.heap);
+		requiredSizes[heapIndex] = std::max(requiredSizes[heapIndex], candidate.offset + candidate.info.SizeInBytes);
+		requiredAlignments[heapIndex] = std::max(requiredAlignments[heapIndex], candidate.info.Alignment);
+	}
+
+	// Grow heaps that can't fit this frame's transients. Anything placed in the old memory is retired along with it.
+	std::array<bool, static_cast<size_t>(TransientHeapType::Count)> heapValid{};
+
+	for (size_t i = 0; i < transientHeaps.size(); ++i)
+	{
+		auto& heap = transientHeaps[i];
+
+		if (requiredSizes[i] > heap.size)
+		{
+			if (heap.memory)
 			{
-				if (textureResources.contains(write))
-					accessedHandles.emplace_back(textureResources[write].handle);
+				const auto RetirePlaced = [this, &heap](auto& pools, auto& resources, auto& views)
+				{
+					for (auto& [hash, transients] : pools)
+					{
+						auto it = transients.begin();
+						while (it != transients.end())
+						{
+							if (it->placement && it->placement->memory == heap.memory.Get())
+							{
+								ReleaseTransientViews(views, resources[it->resource].handle);
+								device->GetResourceManager().AddFrameResource(device->GetFrameIndex(), resources[it->resource]);
+								it = transients.erase(it);
+							}
+
+							else
+							{
+								++it;
+							}
+						}
+					}
+				};
+
+				RetirePlaced(transientBufferPools, bufferResources, transientBufferViews);
+				RetirePlaced(transientTexturePools, textureResources, transientTextureViews);
+
+				device->GetResourceManager().AddFrameAllocation(device->GetFrameIndex(), std::move(heap.memory));
+				heap.size = 0;
 			}
 
-			const auto handle = textureResources[transientTexture.resource].handle;
-			if (std::find(accessedHandles.begin(), accessedHandles.end(), handle) != accessedHandles.end())
+			constexpr D3D12_HEAP_FLAGS heapFlags[] = {
+				D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS,
+				D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES,
+				D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES
+			};
+
+			D3D12_RESOURCE_ALLOCATION_INFO allocationInfo{};
+			allocationInfo.SizeInBytes = AlignedSize(requiredSizes[i], D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+			allocationInfo.Alignment = requiredAlignments[i];
+
+			heap.memory = device->GetResourceManager().AllocateMemory(allocationInfo, heapFlags[i], VGText("Transient heap"));
+			if (heap.memory)
 			{
-				transientTexture.counter = 0;
-				break;
+				heap.size = allocationInfo.SizeInBytes;
 			}
 		}
+
+		heapValid[i] = requiredSizes[i] > 0 && heap.memory;
+	}
+
+	std::unordered_map<RenderResource, ResourcePlacement> placements;
+
+	for (const auto& candidate : candidates)
+	{
+		const auto heapIndex = static_cast<size_t>(candidate.heap);
+		if (!heapValid[heapIndex])
+			continue;
+
+		placements[candidate.resource] = ResourcePlacement{ transientHeaps[heapIndex].memory.Get(), candidate.offset };
+		aliasedActivations[graph->sorted[candidate.lifetime.first]].emplace_back(candidate.resource);
 	}
+
+	return placements;
 }
 
 void RenderGraphResourceManager::BuildTransients(RenderGraph* graph)
@@ -239,60 +557,187 @@ void RenderGraphResourceManager::BuildTransients(RenderGraph* graph)
 	VGScopedCPUStat("Render Graph Build Transients");
 	VGScopedGPUStat("Render Graph Build Transients", device->GetDirectContext(), device->GetDirectList().Native());
 
-	// Transients used across frames need special handling.
-	SearchCrossFrameTransients(graph);
+	transientStats = {};
+
+	// Transients only used by culled or disabled passes are never created.
+	std::unordered_set<RenderResource> usedResources;
+	for (const auto passIndex : graph->sorted)
+	{
+		const auto& pass = graph->passes[passIndex];
+		if (pass->enabled)
+		{
+			usedResources.insert(pass->reads.cbegin(), pass->reads.cend());
+			usedResources.insert(pass->writes.cbegin(), pass->writes.cend());
+		}
+	}
+
+	std::erase_if(transientBufferResources, [&usedResources](const auto& entry) { return !usedResources.contains(entry.first); });
+	std::erase_if(transientTextureResources, [&usedResources](const auto& entry) { return !usedResources.contains(entry.first); });
+
+	const auto [outputWidth, outputHeight] = graph->GetOutputResolution(device);
 
-	// #TODO: Don't brute force search all passes to determine bind flags. Use a better approach.
+	// Resolve the full description of each transient first, memory aliasing needs them for placement. Bind flags come
+	// from the usage accumulated while passes declared their accesses.
+
+	const auto GetUsage = [this](const RenderResource resource)
+	{
+		const auto it = resourceUsage.find(resource);
+		return it != resourceUsage.end() ? it->second : 0u;
+	};
+
+	std::unordered_map<RenderResource, BufferDescription> bufferDescriptions;
 
 	for (const auto& [resource, info] : transientBufferResources)
 	{
-		bool foundReusable = false;
+		const auto usage = GetUsage(resource);
+		const bool hasConstantBuffer = usage & BindFlag::ConstantBuffer;
+		const bool hasShaderResource = usage & BindFlag::ShaderResource;
+		const bool hasUnorderedAccess = (usage & BindFlag::UnorderedAccess) || info.first.uavCounter;  // UAV counter implies UAV.
+
+		BufferDescription description{};
+		description.updateRate = info.first.updateRate;
+		description.bindFlags = 0;
+		description.accessFlags = AccessFlag::CPURead | AccessFlag::CPUWrite | AccessFlag::GPUWrite;
+		description.size = info.first.size;
+		description.stride = info.first.stride;
+		description.uavCounter = info.first.uavCounter;
+		description.format = info.first.format;
+
+		if (hasConstantBuffer) description.bindFlags |= BindFlag::ConstantBuffer;
+		if (hasShaderResource) description.bindFlags |= BindFlag::ShaderResource;
+		// Some passes use SRV's of resources in UAV states, like mipmap generation.
+		if (hasUnorderedAccess) description.bindFlags |= BindFlag::UnorderedAccess | BindFlag::ShaderResource;
+
+		bufferDescriptions[resource] = description;
+	}
 
-		bool hasConstantBuffer = false;
-		bool hasShaderResource = false;
-		bool hasUnorderedAccess = false;
+	std::unordered_map<RenderResource, TextureDescription> textureDescriptions;
 
-		for (const auto& pass : graph->passes)
+	for (const auto& [resource, info] : transientTextureResources)
+	{
+		const auto usage = GetUsage(resource);
+		const bool hasShaderResource = usage & BindFlag::ShaderResource;
+		const bool hasUnorderedAccess = usage & BindFlag::UnorderedAccess;
+		const bool hasRenderTarget = usage & BindFlag::RenderTarget;
+		const bool hasDepthStencil = usage & BindFlag::DepthStencil;
+
+		VGAssert(!(hasRenderTarget && hasDepthStencil), "Texture cannot have render target and depth stencil bindings!");
+
+		TextureDescription description{};
+		description.bindFlags = 0;  // Can't always assume SRV, depth stencils must be in a special state for that.
+		description.accessFlags = AccessFlag::CPURead | AccessFlag::CPUWrite | AccessFlag::GPUWrite;
+		description.width = info.first.width;
+		description.height = info.first.height;
+		description.depth = info.first.depth;
+		description.format = info.first.format;
+		description.mipMapping = info.first.mipMapping;
+		description.clearValue = info.first.clearValue;
+
+		if (hasShaderResource) description.bindFlags |= BindFlag::ShaderResource;
+		// Some passes use SRV's of resources in UAV states, like mipmap generation.
+		if (hasUnorderedAccess) description.bindFlags |= BindFlag::UnorderedAccess | BindFlag::ShaderResource;
+		if (hasRenderTarget) description.bindFlags |= BindFlag::RenderTarget;
+		if (hasDepthStencil) description.bindFlags |= BindFlag::DepthStencil;
+
+		if (description.width == 0 || description.height == 0)
 		{
-			if (pass->bindInfo.contains(resource))
+			description.width = outputWidth * info.first.resolutionScale;
+			description.height = outputHeight * info.first.resolutionScale;
+		}
+
+		textureDescriptions[resource] = description;
+	}
+
+	aliasedActivations.clear();
+
+	std::unordered_map<RenderResource, ResourcePlacement> placements;
+	if (transientAliasing)
+	{
+		placements = PlanAliasing(graph, bufferDescriptions, textureDescriptions);
+	}
+
+	const auto GetPlacement = [&placements](const RenderResource resource)
+	{
+		return placements.contains(resource) ? std::optional{ placements[resource] } : std::nullopt;
+	};
+
+	if (captureTimeline)
+	{
+		timeline.transients.clear();
+
+		std::unordered_map<RenderResource, std::pair<size_t, size_t>> lifetimes;
+		for (size_t position = 0; position < graph->sorted.size(); ++position)
+		{
+			const auto& pass = graph->passes[graph->sorted[position]];
+			if (!pass->enabled)
+				continue;
+
+			const auto Use = [&](const RenderResource resource)
+			{
+				if (const auto it = lifetimes.find(resource); it != lifetimes.end())
+					it->second.second = position;
+				else
+					lifetimes[resource] = std::make_pair(position, position);
+			};
+
+			for (const auto resource : pass->reads) Use(resource);
+			for (const auto resource : pass->writes) Use(resource);
+		}
+
+		const auto Capture = [&](const RenderResource resource, const std::wstring& name, bool texture, uint64_t size)
+		{
+			auto& transient = timeline.transients.emplace_back(name, texture, lifetimes[resource].first, lifetimes[resource].second);
+			transient.size = size;
+
+			if (const auto placement = GetPlacement(resource); placement)
 			{
-				switch (pass->bindInfo[resource])
+				for (size_t i = 0; i < transientHeaps.size(); ++i)
 				{
-				case ResourceBind::CBV: hasConstantBuffer = true; break;
-				case ResourceBind::SRV: hasShaderResource = true; break;
-				case ResourceBind::UAV: hasUnorderedAccess = true; break;
+					if (transientHeaps[i].memory.Get() == placement->memory)
+						transient.heap = i;
 				}
+
+				transient.offset = placement->offset;
 			}
-		}
+		};
 
-		// UAV counter implies UAV.
-		if (info.first.uavCounter)
-			hasUnorderedAccess = true;
+		for (const auto& [resource, info] : transientBufferResources)
+			Capture(resource, info.second, false, device->GetResourceManager().GetAllocationInfo(bufferDescriptions[resource]).SizeInBytes);
+		for (const auto& [resource, info] : transientTextureResources)
+			Capture(resource, info.second, true, device->GetResourceManager().GetAllocationInfo(textureDescriptions[resource]).SizeInBytes);
+	}
+
+	for (const auto& [resource, info] : transientBufferResources)
+	{
+		bool foundReusable = false;
+
+		const auto& description = bufferDescriptions[resource];
+		const auto placement = GetPlacement(resource);
+
+		auto& pool = transientBufferPools[std::hash<TransientBufferDescription>{}(info.first)];
 
 		if (transientReuse)
 		{
 			// Attempt to reuse an existing transient.
-			for (auto& transientBuffer : transientBuffers)
+			for (auto& transientBuffer : pool)
 			{
-				if (transientBuffer.counter > 0 && info.first == transientBuffer.description)
+				if (transientBuffer.counter > 0 && info.first == transientBuffer.description && placement == transientBuffer.placement)
 				{
 					// Verify the bind flags at least cover all the states we need in this pass.
-					if ((hasConstantBuffer && !(transientBuffer.binds & BindFlag::ConstantBuffer)) ||
-						(hasShaderResource && !(transientBuffer.binds & BindFlag::ShaderResource)) ||
-						(hasUnorderedAccess && !(transientBuffer.binds & BindFlag::UnorderedAccess)))
+					if ((description.bindFlags & transientBuffer.binds) != description.bindFlags)
 					{
 						continue;
 					}
 
 					foundReusable = true;
 					transientBuffer.counter = 0;
+					++transientStats.reused;
 					bufferResources[resource] = bufferResources[transientBuffer.resource];  // Duplicate the resource handle.
 
-					// If we have a UAV counter, we need to reset it.
+					// If we have a UAV counter, we need to reset it. Batched into a single barrier once all transients are built.
 					if (transientBuffer.description.uavCounter)
 					{
-						auto& bufferComponent = device->GetResourceManager().Get(bufferResources[resource]);
-						device->GetResourceManager().Write(bufferComponent.counterBuffer, { 0, 0, 0, 0 });  // #TODO: Use CopyBufferRegion with a clear buffer created once at startup.
+						pendingCounterResets.emplace_back(device->GetResourceManager().Get(bufferResources[resource]).counterBuffer);
 					}
 
 					device->GetResourceManager().NameResource(bufferResources[resource], info.second);
@@ -307,102 +752,67 @@ void RenderGraphResourceManager::BuildTransients(RenderGraph* graph)
 			// Fallback to creating a new buffer.
 			VGLog(logRendering, "Did not find a suitable buffer for transient reuse, creating a new buffer for '{}'.", info.second);
 
-			BufferDescription description{};
-			description.updateRate = info.first.updateRate;
-			description.bindFlags = 0;
-			description.accessFlags = AccessFlag::CPURead | AccessFlag::CPUWrite | AccessFlag::GPUWrite;
-			description.size = info.first.size;
-			description.stride = info.first.stride;
-			description.uavCounter = info.first.uavCounter;
-			description.format = info.first.format;
-
-			if (hasConstantBuffer) description.bindFlags |= BindFlag::ConstantBuffer;
-			if (hasShaderResource) description.bindFlags |= BindFlag::ShaderResource;
-			// Some passes use SRV's of resources in UAV states, like mipmap generation.
-			if (hasUnorderedAccess) description.bindFlags |= BindFlag::UnorderedAccess | BindFlag::ShaderResource;
-
-			const auto buffer = device->GetResourceManager().Create(description, info.second);
+			const auto buffer = device->GetResourceManager().Create(description, info.second, placement);
 			bufferResources[resource] = buffer;
+			transientBufferViews[buffer.handle];
 
-			transientBuffers.emplace_front(resource, 0, description.bindFlags, info.first);
+			pool.emplace_front(resource, 0, description.bindFlags, info.first, placement);
+			++transientStats.created;
 		}
 	}
 
 	transientBufferResources.clear();
 
 	// Built all transient buffers, destroy unused transients and reset state.
-	auto i = transientBuffers.begin();
-	while (i != transientBuffers.end())
+	for (auto& [hash, pool] : transientBufferPools)
 	{
-		// If the transient wasn't reused recently, discard it.
-		if (i->counter > transientExpiration)
+		auto i = pool.begin();
+		while (i != pool.end())
 		{
-			device->GetResourceManager().AddFrameResource(device->GetFrameIndex(), bufferResources[i->resource]);
-			i = transientBuffers.erase(i);
-		}
+			// If the transient wasn't reused recently, discard it.
+			if (i->counter > transientExpiration)
+			{
+				ReleaseTransientViews(transientBufferViews, bufferResources[i->resource].handle);
+				device->GetResourceManager().AddFrameResource(device->GetFrameIndex(), bufferResources[i->resource]);
+				i = pool.erase(i);
+			}
 
-		else
-		{
-			i->counter++;
-			++i;
+			else
+			{
+				i->counter++;
+				++i;
+			}
 		}
 	}
 
-	const auto [outputWidth, outputHeight] = graph->GetBackBufferResolution(device);
+	std::erase_if(transientBufferPools, [](const auto& entry) { return entry.second.empty(); });
 
 	for (const auto& [resource, info] : transientTextureResources)
 	{
 		bool foundReusable = false;
 
-		// We can't have both depth stencil and render target, so brute force search all passes to determine
-		// which binding we need.
-
-		bool hasShaderResource = false;
-		bool hasUnorderedAccess = false;
-		bool hasRenderTarget = false;
-		bool hasDepthStencil = false;
-
-		for (const auto& pass : graph->passes)
-		{
-			if (pass->bindInfo.contains(resource))
-			{
-				switch (pass->bindInfo[resource])
-				{
-				case ResourceBind::SRV: hasShaderResource = true; break;
-				case ResourceBind::UAV: hasUnorderedAccess = true; break;
-				case ResourceBind::DSV: hasDepthStencil = true; break;
-				}
-			}
-
-			if (pass->outputBindInfo.contains(resource))
-			{
-				const auto [bind, clear] = pass->outputBindInfo[resource];
-
-				if (bind == OutputBind::RTV) hasRenderTarget = true;
-				else if (bind == OutputBind::DSV) hasDepthStencil = true;
-			}
-		}
+		const auto& description = textureDescriptions[resource];
+		const auto placement = GetPlacement(resource);
 
-		VGAssert(!(hasRenderTarget && hasDepthStencil), "Texture cannot have render target and depth stencil bindings!");
+		auto& pool = transientTexturePools[std::hash<TransientTextureDescription>{}(info.first)];
 
 		if (transientReuse)
 		{
 			// Attempt to reuse an existing transient.
-			for (auto& transientTexture : transientTextures)
+			for (auto& transientTexture : pool)
 			{
-				if (transientTexture.counter > 0 && info.first == transientTexture.description)
+				if (transientTexture.counter > 0 && info.first == transientTexture.description && placement == transientTexture.placement &&
+					transientTexture.width == description.width && transientTexture.height == description.height)
 				{
 					// Verify the bind flags at least cover all the states we need in this pass.
-					if ((hasShaderResource && !(transientTexture.binds & BindFlag::ShaderResource)) ||
-						(hasUnorderedAccess && !(transientTexture.binds & BindFlag::UnorderedAccess)) ||
-						(hasRenderTarget && !(transientTexture.binds & BindFlag::RenderTarget)) ||
-						(hasDepthStencil && !(transientTexture.binds & BindFlag::DepthStencil)))
+					if ((description.bindFlags & transientTexture.binds) != description.bindFlags)
 					{
 						continue;
 					}
 
 					foundReusable = true;
 					transientTexture.counter = 0;
+					++transientStats.reused;
 					textureResources[resource] = textureResources[transientTexture.resource];  // Duplicate the resource handle.
 
 					device->GetResourceManager().NameResource(textureResources[resource], info.second);
@@ -417,63 +827,80 @@ void RenderGraphResourceManager::BuildTransients(RenderGraph* graph)
 			// Fallback to creating a new texture.
 			VGLog(logRendering, "Did not find a suitable texture for transient reuse, creating a new texture for '{}'.", info.second);
 
-			TextureDescription description{};
-			description.bindFlags = 0;  // Can't always assume SRV, depth stencils must be in a special state for that.
-			description.accessFlags = AccessFlag::CPURead | AccessFlag::CPUWrite | AccessFlag::GPUWrite;
-			description.width = info.first.width;
-			description.height = info.first.height;
-			description.depth = info.first.depth;
-			description.format = info.first.format;
-			description.mipMapping = info.first.mipMapping;
-
-			if (hasShaderResource) description.bindFlags |= BindFlag::ShaderResource;
-			// Some passes use SRV's of resources in UAV states, like mipmap generation.
-			if (hasUnorderedAccess) description.bindFlags |= BindFlag::UnorderedAccess | BindFlag::ShaderResource;
-			if (hasRenderTarget) description.bindFlags |= BindFlag::RenderTarget;
-			if (hasDepthStencil) description.bindFlags |= BindFlag::DepthStencil;
-
-			if (description.width == 0 || description.height == 0)
-			{
-				description.width = outputWidth * info.first.resolutionScale;
-				description.height = outputHeight * info.first.resolutionScale;
-			}
-
-			const auto texture = device->GetResourceManager().Create(description, info.second);
+			const auto texture = device->GetResourceManager().Create(description, info.second, placement);
 			textureResources[resource] = texture;
+			transientTextureViews[texture.handle];
 
-			transientTextures.emplace_front(resource, 0, description.bindFlags, info.first);
+			pool.emplace_front(resource, 0, description.bindFlags, info.first, placement, description.width, description.height);
+			++transientStats.created;
 		}
 	}
 
 	transientTextureResources.clear();
 
 	// Built all transient textures, destroy unused transients and reset state.
-	auto j = transientTextures.begin();
-	while (j != transientTextures.end())
+	for (auto& [hash, pool] : transientTexturePools)
 	{
-		// If the transient wasn't reused recently, discard it.
-		if (j->counter > transientExpiration)
+		auto j = pool.begin();
+		while (j != pool.end())
 		{
-			device->GetResourceManager().AddFrameResource(device->GetFrameIndex(), textureResources[j->resource]);
-			j = transientTextures.erase(j);
+			// If the transient wasn't reused recently, discard it.
+			if (j->counter > transientExpiration)
+			{
+				ReleaseTransientViews(transientTextureViews, textureResources[j->resource].handle);
+				device->GetResourceManager().AddFrameResource(device->GetFrameIndex(), textureResources[j->resource]);
+				j = pool.erase(j);
+			}
+
+			else
+			{
+				j->counter++;
+				++j;
+			}
 		}
+	}
+
+	std::erase_if(transientTexturePools, [](const auto& entry) { return entry.second.empty(); });
+
+	BuildHistories(graph, usedResources);
 
-		else
+	const auto CountPool = [this](const auto& pools, auto& resources, uint32_t& count)
+	{
+		for (const auto& [hash, pool] : pools)
 		{
-			j->counter++;
-			++j;
+			for (const auto& transient : pool)
+			{
+				++count;
+				if (!transient.placement)
+				{
+					transientStats.pooledBytes += device->GetResourceManager().Get(resources[transient.resource]).allocation->GetSize();
+				}
+			}
 		}
+	};
+
+	CountPool(transientBufferPools, bufferResources, transientStats.bufferCount);
+	CountPool(transientTexturePools, textureResources, transientStats.textureCount);
+
+	for (const auto& heap : transientHeaps)
+	{
+		transientStats.heapBytes += heap.size;
 	}
+
+	resourceUsage.clear();
 }
 
 void RenderGraphResourceManager::BuildDescriptors(RenderGraph* graph)
 {
 	VGScopedCPUStat("Render Graph Build Descriptors");
 
-	for (int i = 0; i < graph->passes.size(); ++i)
+	for (const auto i : graph->sorted)
 	{
 		const auto& pass = graph->passes[i];
 
+		if (!pass->enabled)
+			continue;  // Won't be recorded, and may use transients that weren't created.
+
 		for (const auto& [resource, requests] : pass->descriptorInfo)
 		{
 			// Check if we want a default descriptor or a custom set.
@@ -484,56 +911,223 @@ void RenderGraphResourceManager::BuildDescriptors(RenderGraph* graph)
 
 			else
 			{
+				auto* viewCache = GetTransientViewCache(resource);
+				auto& view = passViews[i].views[resource];
+
 				for (const auto& [name, request] : requests.descriptorRequests)
 				{
-					// #TODO: Don't recreate descriptors every frame.
-					auto descriptor = CreateDescriptorFromView(resource, request);
-					passViews[i].views[resource].descriptorIndices[name] = descriptor.bindlessIndex;
-					passViews[i].views[resource].fullDescriptors[name] = std::move(descriptor);
+					if (viewCache)
+					{
+						const auto hash = HashViewDescription(request);
+						auto it = viewCache->find(hash);
+						if (it == viewCache->end())
+						{
+							it = viewCache->emplace(hash, CreateDescriptorFromView(resource, request, true)).first;
+						}
+
+						view.descriptorIndices[name] = it->second.bindlessIndex;
+						view.cachedDescriptors[name] = &it->second;
+					}
+
+					else
+					{
+						auto descriptor = CreateDescriptorFromView(resource, request, false);
+						view.descriptorIndices[name] = descriptor.bindlessIndex;
+						view.fullDescriptors[name] = std::move(descriptor);
+					}
 				}
 			}
 		}
 	}
 }
+void RenderGraphResourceManager::ResetCounters(CommandList& list)
+{
+	if (pendingCounterResets.empty())
+		return;
+
+	auto& resourceManager = device->GetResourceManager();
+
+	if (!resourceManager.Valid(counterResetSource))
+	{
+		counterResetSource = resourceManager.Create(BufferDescription{
+			.updateRate = ResourceFrequency::Static,
+			.bindFlags = 0,
+			.accessFlags = AccessFlag::CPUWrite,
+			.size = 1,
+			.stride = sizeof(uint32_t)
+		}, VGText("Counter reset source"));
+		resourceManager.Write(counterResetSource, uint32_t{ 0 });
+	}
+
+	// The source is never used by the graph, so it stays in the copy source state.
+	list.TransitionBarrier(counterResetSource, D3D12_RESOURCE_STATE_COPY_SOURCE);
+
+	for (const auto counter : pendingCounterResets)
+	{
+		list.TransitionBarrier(counter, D3D12_RESOURCE_STATE_COPY_DEST);
+	}
+
+	list.FlushBarriers();
+
+	auto* source = resourceManager.Get(counterResetSource).Native();
+
+	for (const auto counter : pendingCounterResets)
+	{
+		list.Native()->CopyBufferRegion(resourceManager.Get(counter).Native(), 0, source, 0, sizeof(uint32_t));
+	}
+
+	pendingCounterResets.clear();
+}
+
 void RenderGraphResourceManager::DiscardTransients()
 {
 	VGScopedCPUStat("Render Graph Discard Transients");
 
-	for (const auto& transient : transientBuffers)
+	for (const auto& [hash, pool] : transientBufferPools)
 	{
-		device->GetResourceManager().AddFrameResource(device->GetFrameIndex(), bufferResources[transient.resource]);
+		for (const auto& transient : pool)
+		{
+			ReleaseTransientViews(transientBufferViews, bufferResources[transient.resource].handle);
+			device->GetResourceManager().AddFrameResource(device->GetFrameIndex(), bufferResources[transient.resource]);
+		}
+	}
+
+	transientBufferPools.clear();
+
+	for (const auto& [hash, pool] : transientTexturePools)
+	{
+		for (const auto& transient : pool)
+		{
+			ReleaseTransientViews(transientTextureViews, textureResources[transient.resource].handle);
+			device->GetResourceManager().AddFrameResource(device->GetFrameIndex(), textureResources[transient.resource]);
+		}
 	}
 
-	transientBuffers.clear();
+	transientTexturePools.clear();
 
-	for (const auto& transient : transientTextures)
+	for (auto& [name, history] : histories)
 	{
-		device->GetResourceManager().AddFrameResource(device->GetFrameIndex(), textureResources[transient.resource]);
+		ReleaseHistory(history);
 	}
 
-	transientTextures.clear();
+	histories.clear();
 }
 
 void RenderGraphResourceManager::DiscardDescriptors()
 {
 	VGScopedCPUStat("Render Graph Discard Descriptors");
 
-	for (auto& [pass, views] : passViews)
+	// Frame descriptors are reclaimed with their frame's partition, nothing to free.
+	passViews.clear();
+}
+
+void RenderGraphResourceManager::DiscardPipelines()
+{
+	// Waits for the background compiles, they were built from the discarded sources.
+	backgroundPipelines.clear();
+	backgroundPipelineHashes.clear();
+
+	passPipelines.clear();
+
+	for (auto& retired : retiredPipelines)
 	{
-		for (auto& [resource, view] : views.views)
+		retired.clear();
+	}
+}
+
+void RenderGraphResourceManager::UpdatePipelines()
+{
+	VGScopedCPUStat("Update Pipelines");
+
+	// The GPU is done with the frame that last used this slot.
+	retiredPipelines[device->GetFrameIndex()].clear();
+
+	if (pipelineReload.valid() && pipelineReload.wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready)
+	{
+		auto rebuilt = pipelineReload.get();
+		for (auto& [hash, state] : rebuilt)
 		{
-			for (auto it = view.fullDescriptors.begin(); it != view.fullDescriptors.end();)
+			// Keep the previous pipeline if the new sources failed to compile, or if the pipelines were discarded meanwhile.
+			const auto it = passPipelines.find(hash);
+			if (it == passPipelines.end() || !state.Native())
 			{
-				device->GetResourceManager().AddFrameDescriptor(device->GetFrameIndex(), std::move(it->second));
-				it = view.fullDescriptors.erase(it);
+				continue;
 			}
+
+			std::swap(it->second, state);
+			retiredPipelines[device->GetFrameIndex()].emplace_back(std::move(state));
 		}
+
+		VGLog(logRendering, "Hot reloaded {} pipeline(s).", rebuilt.size());
 	}
 
-	passViews.clear();
-}
+	for (auto it = backgroundPipelines.begin(); it != backgroundPipelines.end();)
+	{
+		if (it->wait_for(std::chrono::seconds{ 0 }) != std::future_status::ready)
+		{
+			++it;
+			continue;
+		}
 
-void RenderGraphResourceManager::DiscardPipelines()
-{
-	passPipelines.clear();
+		// A pass without a fallback may have compiled the same pipeline inline meanwhile.
+		for (auto& [hash, state] : it->get())
+		{
+			passPipelines.try_emplace(hash, std::move(state));
+			backgroundPipelineHashes.erase(hash);
+		}
+
+		it = backgroundPipelines.erase(it);
+	}
+
+	if (!pipelineReloadRequested || pipelineReload.valid())
+	{
+		return;
+	}
+
+	pipelineReloadRequested = false;
+
+	struct ReloadRequest
+	{
+		size_t hash;
+		GraphicsPipelineStateDescription graphicsDescription;
+		ComputePipelineStateDescription computeDescription;
+		std::optional<size_t> cacheKey;
+	};
+
+	std::vector<ReloadRequest> requests;
+	for (const auto& [hash, state] : passPipelines)
+	{
+		if (state.SourcesChanged())
+		{
+			requests.push_back({ hash, state.GetGraphicsDescription(), state.GetComputeDescription(), state.GetCacheKey() });
+		}
+	}
+
+	if (requests.empty())
+	{
+		return;
+	}
+
+	VGLog(logRendering, "Shader sources changed, rebuilding {} pipeline(s).", requests.size());
+
+	// Descriptions are copied, the pipeline map isn't touched off of the main thread.
+	pipelineReload = std::async(std::launch::async, [device = device, requests = std::move(requests)]()
+	{
+		std::vector<std::pair<size_t, PipelineState>> rebuilt(requests.size());
+		std::transform(std::execution::par, requests.begin(), requests.end(), rebuilt.begin(), [device](const ReloadRequest& request)
+		{
+			// Compiles run alongside the frame, which keeps drawing with the old pipelines.
+			ScopedThreadPlacement placement{ ThreadPlacement::Efficiency };
+
+			std::pair<size_t, PipelineState> result{ request.hash, PipelineState{} };
+			if (request.computeDescription.shader.first.empty())
+				result.second.Build(*device, request.graphicsDescription, request.cacheKey);
+			else
+				result.second.Build(*device, request.computeDescription, request.cacheKey);
+
+			return result;
+		});
+
+		return rebuilt;
+	});
 }
\ No newline at end of file
@@ -11,11 +11,14 @@
 #include <Rendering/PipelineState.h>
 
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <list>
 #include <vector>
 #include <optional>
 #include <algorithm>
+#include <array>
+#include <future>
 
 class RenderGraph;
 
@@ -25,6 +28,7 @@ struct TransientBuffer
 	uint8_t counter = 1;
 	uint32_t binds;
 	TransientBufferDescription description;
+	std::optional<ResourcePlacement> placement;  // Only set for memory aliased transients.
 };
 
 struct TransientTexture
@@ -33,6 +37,91 @@ struct TransientTexture
 	uint8_t counter = 1;
 	uint32_t binds;
 	TransientTextureDescription description;
+	std::optional<ResourcePlacement> placement;  // Only set for memory aliased transients.
+	uint32_t width;  // Resolved size, output relative descriptions match transients of any resolution.
+	uint32_t height;
+};
+
+// Double buffered texture owned by the graph across frames. Each frame writes one texture while the other still holds
+// the previous frame's contents.
+struct HistoryTexture
+{
+	TransientTextureDescription description;
+	uint32_t width = 0;  // Resolved size, output relative histories restart when the output resizes.
+	uint32_t height = 0;
+	uint32_t binds = 0;
+	std::array<TextureHandle, 2> textures;  // Created by the first build using the history.
+	uint32_t current = 0;
+	bool valid = false;  // The current texture was written by the last frame.
+	size_t counter = 0;  // Frames since the history was last requested.
+	std::optional<size_t> requestedGraph;  // Resource base of the graph that last requested the history.
+	RenderResource currentTag{ 0 };  // Tags handed out to the requesting graph.
+	RenderResource previousTag{ 0 };
+};
+
+// Resource heap tier 1 doesn't allow mixing resource classes in a single heap, so each class gets its own.
+enum class TransientHeapType
+{
+	Buffer,
+	Texture,
+	RenderTarget,  // Render targets and depth stencils.
+	Count
+};
+
+// Schedule of an executed graph, captured for visualizing pass order, barriers, and transient lifetimes.
+struct RenderGraphTimeline
+{
+	struct Pass
+	{
+		std::string_view name;  // Stable.
+		bool enabled = false;
+		bool asyncCompute = false;  // Recorded on the compute queue.
+		uint32_t transitions = 0;
+		uint32_t splitEnds = 0;  // Transitions completing a split barrier begun by an earlier pass.
+		uint32_t splitBegins = 0;  // Split transitions begun after the pass for a later pass.
+		uint32_t uavBarriers = 0;
+		uint32_t aliasingBarriers = 0;
+	};
+
+	struct Transient
+	{
+		std::wstring name;
+		bool texture = false;
+		size_t first = 0;  // Positions in the pass order.
+		size_t last = 0;
+		std::optional<size_t> heap;  // Aliasing heap index, only set for memory aliased transients.
+		uint64_t offset = 0;  // Within the heap.
+		uint64_t size = 0;
+	};
+
+	std::vector<size_t> order;  // Pass indices in execution order.
+	std::vector<Pass> passes;  // Indexed by pass index.
+	std::vector<Transient> transients;
+};
+
+// Memory shared by transients with non-overlapping lifetimes.
+struct TransientHeap
+{
+	ResourcePtr<D3D12MA::Allocation> memory;
+	uint64_t size = 0;
+};
+
+// Schedule of a built graph, reused by later graphs with an identical structure.
+struct CompiledRenderGraph
+{
+	size_t hash = 0;
+	std::vector<size_t> sorted;
+};
+
+// Transient pool state as of the last build.
+struct TransientPoolStats
+{
+	uint32_t bufferCount = 0;  // Pooled, including those not used by the last build.
+	uint32_t textureCount = 0;
+	uint64_t pooledBytes = 0;  // Transients with their own memory.
+	uint64_t heapBytes = 0;  // Aliasing heaps, shared by all placed transients.
+	uint32_t reused = 0;  // Transients of the last build served from the pool.
+	uint32_t created = 0;
 };
 
 struct RenderPassViews
@@ -46,11 +135,15 @@ class RenderGraphResourceManager
 
 public:
 	bool transientReuse = true;
+	bool transientAliasing = true;
+	bool passCulling = true;
+	static constexpr size_t defaultTransientExpiration = 4;
+	size_t transientExpiration = defaultTransientExpiration;  // How many frames it takes for unused transients to expire.
+	bool captureTimeline = false;  // Records the timeline of each executed graph.
 
 private:
 	RenderDevice* device = nullptr;
 	size_t counter = 0;
-	static constexpr size_t transientExpiration = 4;  // How many frames it takes for unused transients to expire.
 
 	std::unordered_map<RenderResource, BufferHandle> bufferResources;
 	std::unordered_map<RenderResource, TextureHandle> textureResources;
@@ -59,18 +152,58 @@ private:
 	std::unordered_map<RenderResource, std::pair<TransientBufferDescription, std::wstring>> transientBufferResources;
 	std::unordered_map<RenderResource, std::pair<TransientTextureDescription, std::wstring>> transientTextureResources;
 
-	// Resources created transiently, can be reused across frames.
-	std::list<TransientBuffer> transientBuffers;
-	std::list<TransientTexture> transientTextures;
+	// Resources created transiently, can be reused across frames. Pooled by description hash, so reuse only searches
+	// transients that can match.
+	std::unordered_map<size_t, std::list<TransientBuffer>> transientBufferPools;
+	std::unordered_map<size_t, std::list<TransientTexture>> transientTexturePools;
+
+	std::unordered_map<std::wstring, HistoryTexture> histories;  // Keyed by name.
+
+	// Bind flags accumulated as passes declare their accesses, used to create transients.
+	std::unordered_map<RenderResource, uint32_t> resourceUsage;
+
+	std::array<TransientHeap, static_cast<size_t>(TransientHeapType::Count)> transientHeaps;
+	std::unordered_map<size_t, std::vector<RenderResource>> aliasedActivations;  // Memory aliased transients, keyed by the first pass using them.
 
 	std::unordered_map<size_t, RenderPassViews> passViews;
 
+	// Views of transients persist for as long as the transient is reused, keyed by the view description hash.
+	using TransientViewCache = std::unordered_map<size_t, DescriptorHandle>;
+	std::unordered_map<entt::entity, TransientViewCache> transientBufferViews;
+	std::unordered_map<entt::entity, TransientViewCache> transientTextureViews;
+
+	BufferHandle counterResetSource;  // Zeroed once at creation, copied into the counters of reused transients.
+	std::vector<BufferHandle> pendingCounterResets;
+
 	std::unordered_map<size_t, PipelineState> passPipelines;
+	std::unordered_map<size_t, std::shared_future<void>> pendingPipelines;  // Claimed by a pass and still compiling.
+
+	// Hot reloading rebuilds only the pipelines with changed sources in the background, swapping them in between frames.
+	bool pipelineReloadRequested = false;
+	std::future<std::vector<std::pair<size_t, PipelineState>>> pipelineReload;
+	std::array<std::vector<PipelineState>, RenderDevice::frameCount> retiredPipelines;  // Replaced, but possibly still in use by the GPU.
+
+	// Layouts with a fallback compile in the background, the pipelines are added between frames once built.
+	std::unordered_set<size_t> backgroundPipelineHashes;
+	std::vector<std::future<std::vector<std::pair<size_t, PipelineState>>>> backgroundPipelines;
+
+	std::optional<CompiledRenderGraph> compiledGraph;
+
+	TransientPoolStats transientStats;
+	RenderGraphTimeline timeline;
 
 private:
-	DescriptorHandle CreateDescriptorFromView(const RenderResource resource, ShaderResourceViewDescription viewDesc);
+	DescriptorHandle CreateDescriptorFromView(const RenderResource resource, ShaderResourceViewDescription viewDesc, bool persistent);
+	TransientViewCache* GetTransientViewCache(const RenderResource resource);
+	void ReleaseTransientViews(std::unordered_map<entt::entity, TransientViewCache>& caches, entt::entity handle);
+	void ReleaseHistory(HistoryTexture& history);
+	void BuildHistories(RenderGraph* graph, const std::unordered_set<RenderResource>& usedResources);
 	uint32_t GetDefaultDescriptor(const RenderResource resource, ResourceBind bind);
 
+	// Places transients with non-overlapping lifetimes in the sorted pass order into shared memory.
+	std::unordered_map<RenderResource, ResourcePlacement> PlanAliasing(RenderGraph* graph, const std::unordered_map<RenderResource, BufferDescription>& bufferDescriptions,
+		const std::unordered_map<RenderResource, TextureDescription>& textureDescriptions);
+
 public:
 	void SetDevice(RenderDevice* inDevice);
 
@@ -78,13 +211,22 @@ public:
 	const RenderResource AddResource(const TextureHandle resource);
 	const RenderResource AddResource(const TransientBufferDescription& description, const std::wstring& name);
 	const RenderResource AddResource(const TransientTextureDescription& description, const std::wstring& name);
+	void AddUsage(const RenderResource resource, uint32_t bindFlags);
+	HistoryResource AddHistory(RenderGraph* graph, const std::wstring& name, const TransientTextureDescription& description);
 
-	void SearchCrossFrameTransients(RenderGraph* graph);
 	void BuildTransients(RenderGraph* graph);
 	void BuildDescriptors(RenderGraph* graph);
+	void ResetCounters(CommandList& list);  // Records the counter resets of the transients built this frame.
 	void DiscardTransients();
 	void DiscardDescriptors();
 	void DiscardPipelines();
+	void ReloadChangedPipelines();
+	void UpdatePipelines();  // Must be called between frames.
+
+	const TransientPoolStats& GetTransientStats() const noexcept { return transientStats; }
+	// Only updated while capturing.
+	const RenderGraphTimeline& GetTimeline() const noexcept { return timeline; }
+	size_t GetCompiledHash() const noexcept { return compiledGraph ? compiledGraph->hash : 0; }
 
 public:
 	const uint32_t GetDescriptor(size_t passIndex, const RenderResource resource, const std::string& name);
@@ -102,13 +244,20 @@ inline void RenderGraphResourceManager::SetDevice(RenderDevice* inDevice)
 	device = inDevice;
 }
 
+inline void RenderGraphResourceManager::ReloadChangedPipelines()
+{
+	pipelineReloadRequested = true;
+}
+
 inline const RenderResource RenderGraphResourceManager::AddResource(const BufferHandle resource)
 {
 	// #TODO: Resources can be re-imported, and this will just create a new entry to the same underlying resource, but with a different handle.
-	// This is probably an issue, will need to figure something out eventually.
+	// This is probably an issue, will need to figure something out eventually. Textures used across frames should be histories instead.
 
 	VGAssert(device->GetResourceManager().Valid(resource), "Cannot added invalid resource.");
 
+	device->GetResourceManager().MarkUsed(resource);  // Anything the graph imports may be used by this frame.
+
 	RenderResource result{ counter++ };
 	bufferResources[result] = resource;
 
@@ -121,6 +270,8 @@ inline const RenderResource RenderGraphResourceManager::AddResource(const Textur
 
 	VGAssert(device->GetResourceManager().Valid(resource), "Cannot added invalid resource.");
 
+	device->GetResourceManager().MarkUsed(resource);
+
 	RenderResource result{ counter++ };
 	textureResources[result] = resource;
 
@@ -143,6 +294,11 @@ inline const RenderResource RenderGraphResourceManager::AddResource(const Transi
 	return result;
 }
 
+inline void RenderGraphResourceManager::AddUsage(const RenderResource resource, uint32_t bindFlags)
+{
+	resourceUsage[resource] |= bindFlags;
+}
+
 inline const uint32_t RenderGraphResourceManager::GetDescriptor(size_t passIndex, const RenderResource resource, const std::string& name)
 {
 	VGAssert(passViews.contains(passIndex), "No descriptors requested by pass index %zu", passIndex);
@@ -163,7 +319,13 @@ inline const DescriptorHandle& RenderGraphResourceManager::GetFullDescriptor(siz
 	VGAssert(passViews.contains(passIndex), "No descriptors requested by pass index %zu", passIndex);
 	auto& passView = passViews[passIndex].views;
 	VGAssert(passView.contains(resource), "No descriptors created for resource.");
-	auto& descriptors = passView[resource].fullDescriptors;
+	auto& view = passView[resource];
+	if (const auto it = view.cachedDescriptors.find(name); it != view.cachedDescriptors.end())
+	{
+		return *it->second;
+	}
+
+	auto& descriptors = view.fullDescriptors;
 	VGAssert(descriptors.contains(name), "Failed to get full descriptor with name '%s' from resource.", name.data());
 
 	return descriptors[name];
@@ -6,11 +6,13 @@
 #include <Rendering/ResourceBind.h>
 #include <Rendering/RenderGraphResourceManager.h>
 #include <Rendering/ResourceView.h>
+#include <Utility/StackFunction.h>
 
-#include <set>
 #include <functional>
 #include <optional>
 #include <string_view>
+#include <vector>
+#include <algorithm>
 
 class CommandList;
 class RenderPassResources;
@@ -27,28 +29,42 @@ enum class ExecutionQueue
 	Compute
 };
 
+// GPU-written value a pass is predicated on.
+struct PassPredicate
+{
+	RenderResource buffer;
+	size_t offset;  // Byte offset of the 64-bit value, 8 byte aligned.
+};
+
 class RenderPass
 {
+public:
+	// Pass callbacks are stored inline, larger captures should be grouped into a struct and captured by reference.
+	static constexpr size_t bindingSize = 512;
+	using Binding = StackFunction<void(CommandList&, RenderPassResources&), bindingSize>;
+
 public:
 	std::string_view stableName;
 	ExecutionQueue queue;
 	bool enabled;
 
-	std::set<RenderResource> reads;
-	std::set<RenderResource> writes;
+	ResourceSet reads;
+	ResourceSet writes;
 
 	std::unordered_map<RenderResource, ResourceBind> bindInfo;
 	std::unordered_map<RenderResource, std::pair<OutputBind, LoadType>> outputBindInfo;
+	std::vector<RenderResource> renderTargets;  // Render target outputs in slot order, the order they were output in.
 	std::unordered_map<RenderResource, ResourceViewRequest> descriptorInfo;
+	std::optional<PassPredicate> predicate;
 
 private:
 	RenderGraphResourceManager* resourceManager;
-	std::function<void(CommandList&, RenderPassResources&)> binding;
+	Binding binding;
 
 #if !BUILD_RELEASE
 	// Used for validation.
-	std::set<RenderResource> creates;
-	std::set<RenderResource> outputs;
+	ResourceSet creates;
+	ResourceSet outputs;
 #endif
 
 public:
@@ -61,7 +77,16 @@ public:
 	void Write(const RenderResource resource, ResourceBind bind);  // Default view.
 	void Write(const RenderResource resource, ResourceViewRequest view);  // Custom view.
 	void Output(const RenderResource resource, OutputBind bind, LoadType load);
-	void Bind(std::function<void(CommandList&, RenderPassResources&)>&& function) noexcept;
+	// Skips the pass's work on the GPU while the 64-bit value at the offset is zero, such as a counter written by an earlier
+	// pass, without reading it back. Barriers still execute, so anything later passes rely on must not be produced here.
+	void Predicate(const RenderResource buffer, size_t offset = 0);
+	template <typename Functor>
+	void Bind(Functor&& function);
+
+	// Mips of a texture the pass accesses through its view, every mip for default views, buffers and outputs.
+	uint64_t GetMipMask(const RenderResource resource) const;
+	// Accessed in the unordered access state, where passes touching disjoint mips don't need to synchronize.
+	bool IsUnorderedAccess(const RenderResource resource) const;
 
 	void Validate() const;  // Internal validation invoked from the graph. Checks for conditions after completing the pass setup.
 	void Execute(CommandList& list, RenderPassResources& resources) const;
@@ -87,6 +112,31 @@ public:
 	const DescriptorHandle& GetDescriptor(const RenderResource resource, const std::string& name = "") const;
 };
 
+inline uint32_t GetBindUsage(ResourceBind bind)
+{
+	switch (bind)
+	{
+	case ResourceBind::CBV: return BindFlag::ConstantBuffer;
+	case ResourceBind::SRV: return BindFlag::ShaderResource;
+	case ResourceBind::UAV: return BindFlag::UnorderedAccess;
+	case ResourceBind::DSV: return BindFlag::DepthStencil;
+	case ResourceBind::AccelerationStructure: return BindFlag::AccelerationStructure;
+	}
+
+	return 0;
+}
+
+inline uint32_t GetViewUsage(const ResourceViewRequest& view)
+{
+	uint32_t usage = 0;
+	for (const auto& [name, request] : view.descriptorRequests)
+	{
+		usage |= GetBindUsage(request.bind);
+	}
+
+	return usage;
+}
+
 inline RenderPass::RenderPass(RenderGraphResourceManager* inResourceManager, std::string_view name, ExecutionQueue execution, bool isEnabled)
 	: resourceManager(inResourceManager), stableName(name), queue(execution), enabled(isEnabled) {}
 
@@ -119,13 +169,15 @@ inline void RenderPass::Read(const RenderResource resource, ResourceBind bind)
 	reads.emplace(resource);
 	bindInfo[resource] = bind;
 	descriptorInfo.emplace(std::make_pair(resource, ResourceViewRequest{}));  // Insert default view.
+	resourceManager->AddUsage(resource, GetBindUsage(bind));
 }
 
 inline void RenderPass::Read(const RenderResource resource, ResourceViewRequest view)
 {
 	reads.emplace(resource);
 	bindInfo[resource] = view.descriptorRequests.begin()->second.bind;
-	descriptorInfo[resource] = view;
+	resourceManager->AddUsage(resource, GetViewUsage(view));
+	descriptorInfo[resource] = std::move(view);
 }
 
 inline void RenderPass::Write(const RenderResource resource, ResourceBind bind)
@@ -133,28 +185,86 @@ inline void RenderPass::Write(const RenderResource resource, ResourceBind bind)
 	writes.emplace(resource);
 	bindInfo[resource] = bind;
 	descriptorInfo.emplace(std::make_pair(resource, ResourceViewRequest{}));  // Insert default view.
+	resourceManager->AddUsage(resource, GetBindUsage(bind));
 }
 
 inline void RenderPass::Write(const RenderResource resource, ResourceViewRequest view)
 {
 	writes.emplace(resource);
 	bindInfo[resource] = view.descriptorRequests.begin()->second.bind;
-	descriptorInfo[resource] = view;
+	resourceManager->AddUsage(resource, GetViewUsage(view));
+	descriptorInfo[resource] = std::move(view);
 }
 
 inline void RenderPass::Output(const RenderResource resource, OutputBind bind, LoadType load)
 {
 	writes.emplace(resource);
 	outputBindInfo[resource] = std::make_pair(bind, load);
+	if (bind == OutputBind::RTV && std::find(renderTargets.begin(), renderTargets.end(), resource) == renderTargets.end())
+	{
+		renderTargets.emplace_back(resource);
+	}
+
+	resourceManager->AddUsage(resource, bind == OutputBind::RTV ? BindFlag::RenderTarget : BindFlag::DepthStencil);
 
 #if !BUILD_RELEASE
 	outputs.emplace(resource);
 #endif
 }
 
-inline void RenderPass::Bind(std::function<void(CommandList&, RenderPassResources&)>&& function) noexcept
+inline void RenderPass::Predicate(const RenderResource buffer, size_t offset)
 {
-	binding = std::move(function);
+	predicate = PassPredicate{ buffer, offset };
+
+	// The buffer can also be read by the pass itself, the barrier plan combines the states.
+	if (!reads.contains(buffer))
+	{
+		reads.emplace(buffer);
+		bindInfo[buffer] = ResourceBind::Indirect;
+		descriptorInfo.emplace(std::make_pair(buffer, ResourceViewRequest{}));  // Insert default view.
+	}
+}
+
+template <typename Functor>
+inline void RenderPass::Bind(Functor&& function)
+{
+	binding = Binding{ std::forward<Functor>(function) };
+}
+
+inline uint64_t RenderPass::GetMipMask(const RenderResource resource) const
+{
+	constexpr auto allMips = ~0ull;
+
+	const auto it = descriptorInfo.find(resource);
+	if (it == descriptorInfo.end() || (it->second.descriptorRequests.empty() && it->second.extraMips == 0) || outputBindInfo.contains(resource))
+		return allMips;
+
+	uint64_t mask = it->second.extraMips;
+	for (const auto& [name, request] : it->second.descriptorRequests)
+	{
+		const auto* texture = std::get_if<ShaderResourceViewDescription::TextureDesc>(&request.data);
+		if (!texture)
+			return allMips;
+
+		if (request.bind == ResourceBind::UAV)
+		{
+			mask |= 1ull << texture->mip;
+		}
+
+		else
+		{
+			mask |= MipRangeMask(texture->firstMip, texture->mipLevels);
+		}
+	}
+
+	return mask;
+}
+
+inline bool RenderPass::IsUnorderedAccess(const RenderResource resource) const
+{
+	const auto it = bindInfo.find(resource);
+
+	return it != bindInfo.end() && it->second == ResourceBind::UAV && !outputBindInfo.contains(resource);
 }
 
 inline void RenderPass::Validate() const
@@ -163,14 +273,13 @@ inline void RenderPass::Validate() const
 	VGAssert(binding, "Pass validation failed in '%s': Render passes must have a Bind()'ing set.", stableName.data());
 
 	// Check that no resources are read and written in this pass. A write implies a read.
-	std::vector<RenderResource> overlap;
-	std::set_intersection(reads.cbegin(), reads.cend(), writes.cbegin(), writes.cend(), std::back_inserter(overlap));
-	VGAssert(overlap.size() == 0, "Pass validation failed in '%s': Cannot read and write to a single resource.", stableName.data());
-	overlap.clear();
+	VGAssert(!reads.Intersects(writes), "Pass validation failed in '%s': Cannot read and write to a single resource.", stableName.data());
+
+	VGAssert(!predicate || !writes.contains(predicate->buffer), "Pass validation failed in '%s': Cannot be predicated on a resource written in the same pass.", stableName.data());
+	VGAssert(!predicate || predicate->offset % 8 == 0, "Pass validation failed in '%s': Predicate offsets must be 8 byte aligned.", stableName.data());
 
 	// Check that no created resources are read in this pass.
-	std::set_intersection(reads.cbegin(), reads.cend(), creates.cbegin(), creates.cend(), std::back_inserter(overlap));
-	VGAssert(overlap.size() == 0, "Pass validation failed in '%s': Cannot read resources created in the same pass.", stableName.data());
+	VGAssert(!reads.Intersects(creates), "Pass validation failed in '%s': Cannot read resources created in the same pass.", stableName.data());
 
 	// Check that created resources that are written are not outputs, and that created resources without being written are outputs.
 
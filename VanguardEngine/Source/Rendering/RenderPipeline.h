@@ -8,6 +8,8 @@
 #include <Rendering/PipelineHash.h>
 
 #include <variant>
+#include <optional>
+#include <vector>
 #include <filesystem>
 #include <utility>
 #include <unordered_map>
@@ -43,9 +45,16 @@ class RenderPipelineLayout
 private:
 	std::variant<std::monostate, GraphicsDesc, ComputeDesc> description = std::monostate{};
 
+	std::vector<ShaderMacro> permutationMacros;  // Toggled by the permutation key, one bit per macro.
+	uint32_t permutationKey = 0;
+	mutable std::optional<size_t> descriptionHash;  // Excludes the permutation, layouts kept across frames only hash once.
+	std::optional<std::pair<size_t, uint32_t>> fallback;  // Description hash and permutation key, not part of the hash.
+
 private:
 	void InitDefaultGraphics()
 	{
+		descriptionHash.reset();
+
 		if (auto* value = std::get_if<GraphicsDesc>(&description); !value)
 		{
 			auto desc = GraphicsDesc{
@@ -107,6 +116,8 @@ private:
 
 	void InitDefaultCompute()
 	{
+		descriptionHash.reset();
+
 		if (auto* value = std::get_if<ComputeDesc>(&description); !value)
 		{
 			description = ComputePipelineStateDescription{};
@@ -126,26 +137,47 @@ public:
 		std::get<GraphicsDesc>(description).pixelShader = shader;
 		return *this;
 	}
+	RenderPipelineLayout& AmplificationShader(std::pair<std::filesystem::path, std::string> shader)
+	{
+		InitDefaultGraphics();
+		std::get<GraphicsDesc>(description).amplificationShader = shader;
+		return *this;
+	}
+	RenderPipelineLayout& MeshShader(std::pair<std::filesystem::path, std::string> shader)
+	{
+		InitDefaultGraphics();
+		std::get<GraphicsDesc>(description).meshShader = shader;
+		return *this;
+	}
 	RenderPipelineLayout& ComputeShader(std::pair<std::filesystem::path, std::string> shader)
 	{
 		InitDefaultCompute();
 		std::get<ComputeDesc>(description).shader = shader;
 		return *this;
 	}
-	RenderPipelineLayout& BlendMode(bool enabled, BlendMode mode)
+	// The shader has a variant for a fixed wave size, used when the device has a preferred size. See RenderDevice::GetWaveSize.
+	RenderPipelineLayout& WaveSpecialized()
+	{
+		InitDefaultCompute();
+		std::get<ComputeDesc>(description).waveSpecialized = true;
+		return *this;
+	}
+	// Blending of targets other than the first makes every target blend independently, each has to be given its mode.
+	RenderPipelineLayout& BlendMode(bool enabled, BlendMode mode, uint32_t target = 0)
 	{
 		InitDefaultGraphics();
 		auto& desc = std::get<GraphicsDesc>(description).blendDescription;
-		desc.RenderTarget[0].BlendEnable = enabled;
-		desc.RenderTarget[0].LogicOpEnable = false;
-		desc.RenderTarget[0].SrcBlend = mode.srcBlend;
-		desc.RenderTarget[0].DestBlend = mode.destBlend;
-		desc.RenderTarget[0].BlendOp = mode.blendOp;
-		desc.RenderTarget[0].SrcBlendAlpha = mode.srcBlendAlpha;
-		desc.RenderTarget[0].DestBlendAlpha = mode.destBlendAlpha;
-		desc.RenderTarget[0].BlendOpAlpha = mode.blendOpAlpha;
-		desc.RenderTarget[0].LogicOp = D3D12_LOGIC_OP_NOOP;
-		desc.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
+		desc.IndependentBlendEnable |= target > 0;
+		desc.RenderTarget[target].BlendEnable = enabled;
+		desc.RenderTarget[target].LogicOpEnable = false;
+		desc.RenderTarget[target].SrcBlend = mode.srcBlend;
+		desc.RenderTarget[target].DestBlend = mode.destBlend;
+		desc.RenderTarget[target].BlendOp = mode.blendOp;
+		desc.RenderTarget[target].SrcBlendAlpha = mode.srcBlendAlpha;
+		desc.RenderTarget[target].DestBlendAlpha = mode.destBlendAlpha;
+		desc.RenderTarget[target].BlendOpAlpha = mode.blendOpAlpha;
+		desc.RenderTarget[target].LogicOp = D3D12_LOGIC_OP_NOOP;
+		desc.RenderTarget[target].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
 		return *this;
 	}
 	RenderPipelineLayout& FillMode(D3D12_FILL_MODE mode)
@@ -160,10 +192,24 @@ public:
 		std::get<GraphicsDesc>(description).rasterizerDescription.CullMode = mode;
 		return *this;
 	}
+	RenderPipelineLayout& DepthBias(int bias, float slopeScaledBias, float clamp = 0.f)
+	{
+		InitDefaultGraphics();
+		std::get<GraphicsDesc>(description).rasterizerDescription.DepthBias = bias;
+		std::get<GraphicsDesc>(description).rasterizerDescription.SlopeScaledDepthBias = slopeScaledBias;
+		std::get<GraphicsDesc>(description).rasterizerDescription.DepthBiasClamp = clamp;
+		return *this;
+	}
+	RenderPipelineLayout& DepthClip(bool enabled)
+	{
+		InitDefaultGraphics();
+		std::get<GraphicsDesc>(description).rasterizerDescription.DepthClipEnable = enabled;
+		return *this;
+	}
 	RenderPipelineLayout& DepthEnabled(bool value, bool write = false, DepthTestFunction function = DepthTestFunction::Greater)
 	{
 		InitDefaultGraphics();
-		std::get<GraphicsDesc>(description).depthStencilDescription.DepthEnable = true;
+		std::get<GraphicsDesc>(description).depthStencilDescription.DepthEnable = value;
 		std::get<GraphicsDesc>(description).depthStencilDescription.DepthWriteMask = write ? D3D12_DEPTH_WRITE_MASK_ALL : D3D12_DEPTH_WRITE_MASK_ZERO;
 		switch (function)
 		{
@@ -189,6 +235,8 @@ public:
 	}
 	RenderPipelineLayout& Macro(const ShaderMacro& macro)
 	{
+		descriptionHash.reset();
+
 		std::visit([macro](auto&& desc)
 		{
 			using T = std::decay_t<decltype(desc)>;
@@ -199,6 +247,69 @@ public:
 		}, description);
 		return *this;
 	}
+	// Declares macros that can be toggled without building a new layout. All permutations are compiled together the first
+	// time any of them is requested, so toggling one later doesn't compile on the render thread.
+	RenderPipelineLayout& Permutations(std::vector<ShaderMacro> macros)
+	{
+		VGAssert(macros.size() <= 8, "Too many pipeline permutation macros.");
+		descriptionHash.reset();
+		permutationMacros = std::move(macros);
+		permutationKey = 0;
+		return *this;
+	}
+	// Each set bit enables the declared permutation macro at that index.
+	RenderPipelineLayout& Permutation(uint32_t key)
+	{
+		VGAssert(key < (1u << permutationMacros.size()), "Pipeline permutation key out of range.");
+		permutationKey = key;
+		return *this;
+	}
+
+	// Compiles in the background when not yet built, drawing with the fallback's pipeline in the meantime if it has one
+	// in the same pass. The fallback has to take the same bind data, and passes caching their results shouldn't use one.
+	RenderPipelineLayout& Fallback(const RenderPipelineLayout& layout)
+	{
+		fallback = std::make_pair(layout.GetDescriptionHash(), layout.permutationKey);
+		return *this;
+	}
+
+	uint32_t GetPermutationKey() const { return permutationKey; }
+	uint32_t GetPermutationCount() const { return 1u << permutationMacros.size(); }
+
+	size_t GetDescriptionHash() const
+	{
+		if (!descriptionHash)
+		{
+			auto hash = std::hash<decltype(description)>{}(description);
+			for (const auto& macro : permutationMacros)
+			{
+				HashCombine(hash, macro);
+			}
+
+			descriptionHash = hash;
+		}
+
+		return *descriptionHash;
+	}
+
+	// The full description of a permutation, with its macros appended.
+	auto GetPermutationDescription(uint32_t key) const
+	{
+		auto result = description;
+		std::visit([this, key](auto&& desc)
+		{
+			using T = std::decay_t<decltype(desc)>;
+			if constexpr (!std::is_same_v<T, std::monostate>)
+			{
+				for (size_t i = 0; i < permutationMacros.size(); ++i)
+				{
+					if (key & (1u << i))
+						desc.macros.emplace_back(permutationMacros[i]);
+				}
+			}
+		}, result);
+		return result;
+	}
 };
 
 namespace std
@@ -208,7 +319,9 @@ namespace std
 	{
 		size_t operator()(const RenderPipelineLayout& layout) const
 		{
-			return hash<decltype(RenderPipelineLayout::description)>{}(layout.description);
+			auto seed = layout.GetDescriptionHash();
+			HashCombine(seed, layout.permutationKey);
+			return seed;
 		}
 	};
 }
\ No newline at end of file
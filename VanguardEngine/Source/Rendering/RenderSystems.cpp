@@ -2,6 +2,8 @@
 
 #include <Rendering/RenderSystems.h>
 #include <Rendering/ShaderStructs.h>
+#include <Core/Input.h>
+#include <Utility/Math.h>
 
 #include <imgui.h>
 
@@ -48,6 +50,32 @@ XMMATRIX SpectatorCameraView(TransformComponent& transform, const CameraComponen
 	return XMMatrixLookAtRH(eyePosition, eyePosition + forward, upward);
 }
 
+namespace
+{
+	constexpr auto mouseSensitivity = 0.005f;  // Mouse counts to radians, before the camera's rotation speed.
+
+	// Refining the view of the current frame keeps the last frame's matrices.
+	void SetCameraView(const XMMATRIX& viewMatrix, const CameraComponent& camera, bool newFrame = true)
+	{
+		const auto [sceneWidth, sceneHeight] = Renderer::Get().GetSceneResolution();
+		const auto aspectRatio = static_cast<float>(sceneWidth) / static_cast<float>(sceneHeight);
+		// Inverse Z. The far plane of an infinite projection still bounds the light clusters and normalizes linear depth.
+		const auto projectionMatrix = *CvarGet("infiniteFarPlane", int) > 0 ?
+			PerspectiveFovInfiniteReversedRH(camera.fieldOfView / 2.f, aspectRatio, camera.nearPlane) :
+			XMMatrixPerspectiveFovRH(camera.fieldOfView / 2.f, aspectRatio, camera.farPlane, camera.nearPlane);
+
+		// #TODO: Support multiple cameras.
+		if (newFrame)
+		{
+			globalLastFrameViewMatrix = globalViewMatrix;
+			globalLastFrameProjectionMatrix = globalProjectionMatrix;
+		}
+
+		globalViewMatrix = viewMatrix;
+		globalProjectionMatrix = projectionMatrix;
+	}
+}
+
 void CameraSystem::Update(entt::registry& registry, float deltaTime)
 {
 	VGScopedCPUStat("Camera System");
@@ -62,9 +90,10 @@ void CameraSystem::Update(entt::registry& registry, float deltaTime)
 	bool moveDown = false;
 	bool moveSprint = false;
 
+	// With raw input, the rotation is applied separately right before rendering.
 	auto& io = ImGui::GetIO();
-	const auto pitchDelta = io.MouseDelta.y * 0.005f;
-	const auto yawDelta = io.MouseDelta.x * 0.005f;
+	const auto pitchDelta = Input::HasRawMouse() ? 0.f : io.MouseDelta.y * mouseSensitivity;
+	const auto yawDelta = Input::HasRawMouse() ? 0.f : io.MouseDelta.x * mouseSensitivity;
 
 	if (ImGui::IsKeyDown(ImGuiKey_W)) moveForward = true;
 	if (ImGui::IsKeyDown(ImGuiKey_S)) moveBackward = true;
@@ -78,18 +107,34 @@ void CameraSystem::Update(entt::registry& registry, float deltaTime)
 	registry.view<TransformComponent, const CameraComponent, const ControlComponent>().each([&](auto entity, auto& transform, const auto& camera)
 	{
 		auto viewMatrix = SpectatorCameraView(transform, camera, deltaTime, pitchDelta, yawDelta, moveForward, moveBackward, moveLeft, moveRight, moveUp, moveDown, moveSprint);
+		SetCameraView(viewMatrix, camera);
+	});
+}
 
-		const auto aspectRatio = static_cast<float>(Renderer::Get().device->renderWidth) / static_cast<float>(Renderer::Get().device->renderHeight);
-		const auto projectionMatrix = XMMatrixPerspectiveFovRH(camera.fieldOfView / 2.f, aspectRatio, camera.farPlane, camera.nearPlane);  // Inverse Z.
+void CameraSystem::UpdateLook(entt::registry& registry)
+{
+	VGScopedCPUStat("Camera Look");
 
-		// #TODO: Support multiple cameras.
-		globalLastFrameViewMatrix = globalViewMatrix;
-		globalLastFrameProjectionMatrix = globalProjectionMatrix;
-		globalViewMatrix = viewMatrix;
-		globalProjectionMatrix = projectionMatrix;
+	// Always drained, so motion while the editor has control doesn't turn the camera once control is taken.
+	const auto rawDelta = Input::ConsumeRawMouseDelta();
+	if (!rawDelta)
+		return;
+
+	const auto pitchDelta = rawDelta->second * mouseSensitivity;
+	const auto yawDelta = rawDelta->first * mouseSensitivity;
+
+	registry.view<TransformComponent, const CameraComponent, const ControlComponent>().each([&](auto entity, auto& transform, const auto& camera)
+	{
+		auto viewMatrix = SpectatorCameraView(transform, camera, 0.f, pitchDelta, yawDelta, false, false, false, false, false, false, false);
+		SetCameraView(viewMatrix, camera, false);
 	});
 }
 
+void CameraSystem::Place(TransformComponent& transform, const CameraComponent& camera)
+{
+	SetCameraView(SpectatorCameraView(transform, camera, 0.f, 0.f, 0.f, false, false, false, false, false, false, false), camera);
+}
+
 void TimeOfDaySystem::Update(entt::registry& registry, float deltaTime)
 {
 	VGScopedCPUStat("Time of Day System");
@@ -11,18 +11,37 @@
 #include <Rendering/ShaderStructs.h>
 #include <Utility/Reflection.h>
 
+#include <optional>
+#include <array>
+
 class Renderer;
 class CommandList;
 
 struct MeshSystem
 {
+	// Argument buffers are read both as indirect arguments and as instance data.
+	static constexpr D3D12_RESOURCE_STATES argumentState = D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT | D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER;
+
+	// Binds the argument buffer as instance data that never steps. Each draw starts at its argument's own index, so vertex
+	// shaders fetch the batch offset from the argument, and no root constants change between draws.
+	static void BindArguments(Renderer& renderer, CommandList& list, BufferHandle indirectRenderArgs);
+	// Draws one indirect argument per batch, or each material bucket's meshlet draws counted by the count buffer when
+	// provided. Bucket layouts draw every material bucket with its own pipeline, otherwise the bound pipeline is used.
+	// Bucketed draws cover the opaque buckets, or only the blended buckets when set.
 	template <typename T>
-	static void Render(Renderer& renderer, const entt::registry& registry, CommandList& list, T& bindData, BufferHandle indirectRenderArgs);
+	static void Render(Renderer& renderer, const entt::registry& registry, CommandList& list, T& bindData, BufferHandle indirectRenderArgs,
+		std::optional<BufferHandle> countBuffer = std::nullopt, const std::array<RenderPipelineLayout, materialPermutations>* bucketLayouts = nullptr,
+		bool blended = false);
 };
 
 struct CameraSystem
 {
 	static void Update(entt::registry& registry, float deltaTime);
+	// Applies the latest mouse motion to the controlled camera's rotation, on the main thread once the frame's simulation has
+	// finished. Without raw input, the rotation is part of the update instead.
+	static void UpdateLook(entt::registry& registry);
+	// Views from the camera's transform as is, for cameras driven by scripts instead of input.
+	static void Place(TransformComponent& transform, const CameraComponent& camera);
 };
 
 struct TimeOfDaySystem
@@ -35,22 +54,59 @@ VGMakeMemberCheck(materialIndex);
 
 // #TODO: Find a better solution than making this a template.
 
-template <typename T>
-void MeshSystem::Render(Renderer& renderer, const entt::registry& registry, CommandList& list, T& bindData, BufferHandle indirectRenderArgs)
+inline void MeshSystem::BindArguments(Renderer& renderer, CommandList& list, BufferHandle indirectRenderArgs)
 {
-	auto& indexBuffer = renderer.device->GetResourceManager().Get(renderer.meshFactory->indexBuffer);
-	D3D12_INDEX_BUFFER_VIEW indexView{
-		.BufferLocation = indexBuffer.Native()->GetGPUVirtualAddress(),
-		.SizeInBytes = static_cast<UINT>(indexBuffer.description.size * indexBuffer.description.stride),
-		.Format = DXGI_FORMAT_R32_UINT
+	auto& component = renderer.device->GetResourceManager().Get(indirectRenderArgs);
+
+	const D3D12_VERTEX_BUFFER_VIEW view{
+		.BufferLocation = component.Native()->GetGPUVirtualAddress(),
+		.SizeInBytes = static_cast<UINT>(component.description.size * component.description.stride),
+		.StrideInBytes = sizeof(MeshIndirectArgument)
 	};
-	list.Native()->IASetIndexBuffer(&indexView);
 
+	list.Native()->IASetVertexBuffers(0, 1, &view);
+}
+
+template <typename T>
+void MeshSystem::Render(Renderer& renderer, const entt::registry& registry, CommandList& list, T& bindData, BufferHandle indirectRenderArgs,
+	std::optional<BufferHandle> countBuffer, const std::array<RenderPipelineLayout, materialPermutations>* bucketLayouts, bool blended)
+{
+	// Each indirect argument binds its own index view.
 	bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
-	list.BindConstants("bindData", bindData);
 
-	auto& indirectBuffer = Renderer::Get().device->GetResourceManager().Get(indirectRenderArgs);
-	auto& counterBuffer = Renderer::Get().device->GetResourceManager().Get(indirectBuffer.counterBuffer);
+	auto& indirectBuffer = renderer.device->GetResourceManager().Get(indirectRenderArgs);
+
+	BindArguments(renderer, list, indirectRenderArgs);
+
+	// Native draws, the render pass may have been suspended since the pipeline was bound.
+	list.ResumeRenderPass();
+
+	if (!countBuffer && !bucketLayouts)
+	{
+		// One draw per batch, culling only changes each batch's instance count.
+		list.BindConstants("bindData", bindData);
+		list.Native()->ExecuteIndirect(renderer.meshIndirectCommandSignature.Get(), renderer.batchCount, indirectBuffer.Native(), 0, nullptr, 0);
+
+		return;
+	}
+
+	auto* counts = countBuffer ? renderer.device->GetResourceManager().Get(*countBuffer).Native() : nullptr;
+
+	for (uint32_t i = 0; i < materialPermutations; ++i)
+	{
+		const auto& bucket = renderer.materialBuckets[i];
+		const auto drawOffset = countBuffer ? bucket.meshletDrawOffset : bucket.batchOffset;
+		const auto maxDraws = countBuffer ? bucket.meshletDrawCount : bucket.batchCount;
+		if (maxDraws == 0 || ((i & MaterialFeatureBlend) != 0) != blended)
+			continue;
+
+		if (bucketLayouts)
+		{
+			list.BindPipeline((*bucketLayouts)[i]);  // Resets the root signature.
+		}
 
-	list.Native()->ExecuteIndirect(Renderer::Get().meshIndirectCommandSignature.Get(), Renderer::Get().renderableCount, indirectBuffer.Native(), 0, counterBuffer.Native(), 0);
+		list.BindConstants("bindData", bindData);
+		list.Native()->ExecuteIndirect(renderer.meshIndirectCommandSignature.Get(), maxDraws, indirectBuffer.Native(), drawOffset * sizeof(MeshIndirectArgument),
+			counts, i * sizeof(uint32_t));
+	}
 }
\ No newline at end of file
@@ -4,40 +4,123 @@
 #include <Rendering/Base.h>
 #include <Rendering/Device.h>
 #include <Rendering/CommandList.h>
-#include <Asset/TextureLoader.h>
 #include <Core/Config.h>
 #include <Utility/FilterKernel.h>
+#include <Threading/JobSystem.h>
 #include <Rendering/RenderPass.h>
 #include <Rendering/RenderPipeline.h>
 
+#include <stb_image.h>
+
 #include <vector>
 #include <cstring>
 #include <cmath>
+#include <algorithm>
 
-void RenderUtils::Initialize(RenderDevice* inDevice)
+void RenderUtils::Initialize(RenderDevice* inDevice, JobCounter& startupJobs)
 {
 	device = inDevice;
 
-	ComputePipelineStateDescription clearUAVStateDesc{};
-	clearUAVStateDesc.shader = { "ClearUAV.hlsl", "Main" };
-	clearUAVState.Build(*device, clearUAVStateDesc);
+	JobSystem::Get().Schedule([this]()
+	{
+		ComputePipelineStateDescription clearUAVStateDesc{};
+		clearUAVStateDesc.shader = { "ClearUAV.hlsl", "Main" };
+		clearUAVState.Build(*device, clearUAVStateDesc);
+	}, &startupJobs);
+
+	JobSystem::Get().Schedule([this]() { LoadBlueNoise(); }, &startupJobs);
+}
+
+void RenderUtils::FinishInitialize()
+{
+	CreateBlueNoise();
+}
+
+void RenderUtils::LoadBlueNoise()
+{
+	VGScopedCPUStat("Load Blue Noise");
+
+	// #TODO: Generate the base blue noise instead of loading from a file.
+	const auto path = Config::utilitiesPath / "BlueNoise128.png";
+	int width, height, components;
+	auto* source = stbi_load(path.generic_string().c_str(), &width, &height, &components, STBI_rgb_alpha);
+	if (!source)
+	{
+		VGLogError(logRendering, "Failed to load blue noise '{}': {}", path.generic_string(), stbi_failure_reason());
+		return;
+	}
+
+	// Slices are toroidally shifted by the R2 sequence, decorrelating them spatially, and offset in value by the golden
+	// ratio, which keeps each texel's values over time evenly distributed. See: https://extremelearning.com.au/unreasonable-effectiveness-of-quasirandom-sequences/
+	constexpr float goldenRatio = 0.61803398875f;
+	constexpr float r2X = 0.75487766624f;
+	constexpr float r2Y = 0.56984029099f;
+
+	const auto sliceSize = static_cast<size_t>(width) * height;
+	std::vector<uint8_t> texels(sliceSize * blueNoiseSlices);
+
+	for (uint32_t slice = 0; slice < blueNoiseSlices; ++slice)
+	{
+		const auto offsetX = static_cast<int>((0.5f + r2X * slice - std::floor(0.5f + r2X * slice)) * width);
+		const auto offsetY = static_cast<int>((0.5f + r2Y * slice - std::floor(0.5f + r2Y * slice)) * height);
+		const auto valueOffset = goldenRatio * slice;
+
+		for (int y = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x)
+			{
+				// Only the red channel, the others don't necessarily hold the same noise.
+				const auto sourceIndex = ((y + offsetY) % height) * width + (x + offsetX) % width;
+				const auto value = source[sourceIndex * 4] / 255.f + valueOffset;
+				texels[slice * sliceSize + y * width + x] = static_cast<uint8_t>(std::min((value - std::floor(value)) * 255.f + 0.5f, 255.f));
+			}
+		}
+	}
+
+	stbi_image_free(source);
 
-	// #TODO: Generate blue noise instead of loading from a file.
-	// #TODO: Fix format, we only need single channel, probably 16 bit precision.
-	blueNoise = AssetLoader::LoadTexture(*device, Config::utilitiesPath / "BlueNoise128.png", false);
+	blueNoiseTexels = std::move(texels);
+	blueNoiseWidth = static_cast<uint32_t>(width);
+	blueNoiseHeight = static_cast<uint32_t>(height);
+}
+
+void RenderUtils::CreateBlueNoise()
+{
+	if (blueNoiseTexels.empty())
+	{
+		return;
+	}
+
+	const TextureDescription blueNoiseDesc{
+		.bindFlags = BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::CPUWrite,
+		.width = blueNoiseWidth,
+		.height = blueNoiseHeight,
+		.depth = blueNoiseSlices,
+		.format = DXGI_FORMAT_R8_UNORM,
+		.array = true
+	};
+
+	blueNoise = device->GetResourceManager().Create(blueNoiseDesc, VGText("Spatiotemporal blue noise"));
+	device->GetResourceManager().Write(blueNoise, blueNoiseTexels);
+
+	blueNoiseTexels = {};
 }
 
 void RenderUtils::Destroy()
 {
-	device->GetResourceManager().Destroy(blueNoise);
+	if (device->GetResourceManager().Valid(blueNoise))
+		device->GetResourceManager().Destroy(blueNoise);
 }
 
 void RenderUtils::ClearUAV(CommandList& list, BufferHandle buffer, uint32_t bufferHandle, const DescriptorHandle& nonVisibleDescriptor)
 {
-	VGScopedGPUStat("Clear UAV", device->GetDirectContext(), list.Native());
+	VGScopedGPUStat("Clear UAV", device->GetQueueContext(list.Type()), list.Native());
 
 	auto& bufferComponent = device->GetResourceManager().Get(buffer);
 
+	list.SuspendRenderPass();  // Clears aren't allowed within a render pass.
+
 	// Only non-structured buffers can benefit from hardware fast path for clears.
 	if (bufferComponent.description.format)
 	{
@@ -68,54 +151,70 @@ void RenderUtils::ClearUAV(CommandList& list, BufferHandle buffer, uint32_t buff
 	}
 }
 
-void RenderUtils::GaussianBlurInternal(CommandList& list, RenderPassResources& resources, RenderResource inputTexture, RenderResource outputTexture, uint32_t radius, float sigma)
+void RenderUtils::GaussianBlurInternal(CommandList& list, RenderPassResources& resources, RenderResource inputTexture, RenderResource intermediateTexture,
+	RenderResource outputTexture, uint32_t radius, float sigma)
 {
 	if (sigma < 0.f)
 	{
 		sigma = float(radius) / 2.f;
 	}
 
+	const auto& inputComponent = device->GetResourceManager().Get(resources.GetTexture(inputTexture));
+	const auto& intermediateComponent = device->GetResourceManager().Get(resources.GetTexture(intermediateTexture));
+	const auto& outputComponent = device->GetResourceManager().Get(resources.GetTexture(outputTexture));
+
+	// The kernel is in texels of the intermediate, which is smaller than the input when downsampling.
+	const auto scale = static_cast<float>(intermediateComponent.description.width) / inputComponent.description.width;
+	radius = std::max(static_cast<uint32_t>(std::ceil(radius * scale)), 1u);
+	sigma *= scale;
+
 	const auto weights = GaussianKernel(radius, sigma);
-	const int packedWeightSize = std::ceil(radius / 4.f);
 
-	auto verticalLayout = RenderPipelineLayout{}
-		.ComputeShader({ "Utils/GaussianBlur.hlsl", "MainVertical" })
-		.Macro({ "KERNEL_RADIUS", radius - 1 })
-		.Macro({ "PACKED_WEIGHT_SIZE", packedWeightSize });
+	// Pairs of neighboring texels merge into a single linearly filtered tap, placed at their weighted center.
+	std::vector<float> taps;
+	taps.emplace_back(0.f);
+	taps.emplace_back(weights[0]);
+	for (uint32_t i = 1; i < radius; i += 2)
+	{
+		const auto firstWeight = weights[i];
+		const auto secondWeight = i + 1 < radius ? weights[i + 1] : 0.f;
+		const auto weight = firstWeight + secondWeight;
 
-	auto horizontalLayout = RenderPipelineLayout{}
-		.ComputeShader({ "Utils/GaussianBlur.hlsl", "MainHorizontal" })
-		.Macro({ "KERNEL_RADIUS", radius - 1 })
-		.Macro({ "PACKED_WEIGHT_SIZE", packedWeightSize });
+		taps.emplace_back((i * firstWeight + (i + 1) * secondWeight) / weight);
+		taps.emplace_back(weight);
+	}
 
-	// Can't use a traditional bindData structure, since the number of weights are determined at runtime.
-	std::vector<uint32_t> bindData;
-	bindData.resize(4 + radius);
-	bindData[0] = resources.Get(inputTexture);
-	bindData[1] = resources.Get(outputTexture);
-	// Memcpy to preserve data.
-	std::memcpy(bindData.data() + 4, weights.data(), weights.size() * sizeof(float));
+	const auto tapCount = static_cast<uint32_t>(taps.size() / 2);
+	const auto packedTapSize = (tapCount + 1) / 2;
 
-	const auto& inputComponent = device->GetResourceManager().Get(resources.GetTexture(inputTexture));
+	const auto layout = RenderPipelineLayout{}
+		.ComputeShader({ "Utils/GaussianBlur.hlsl", "Main" })
+		.Macro({ "TAP_COUNT", tapCount })
+		.Macro({ "PACKED_TAP_SIZE", packedTapSize });
 
-	auto dispatchX = inputComponent.description.width;
-	auto dispatchY = std::ceil(inputComponent.description.height / 64.f);
+	// Can't use a traditional bindData structure, since the number of taps are determined at runtime.
+	std::vector<uint32_t> bindData;
+	bindData.resize(4 + packedTapSize * 4);
+	bindData[0] = resources.Get(inputTexture, "srv");
+	bindData[1] = resources.Get(intermediateTexture, "uav");
+	const float verticalDirection[] = { 0.f, 1.f / intermediateComponent.description.height };
+	// Memcpy to preserve data.
+	std::memcpy(bindData.data() + 2, verticalDirection, sizeof(verticalDirection));
+	std::memcpy(bindData.data() + 4, taps.data(), taps.size() * sizeof(float));
 
-	list.BindPipeline(verticalLayout);
+	list.BindPipeline(layout);
 	list.BindConstants("bindData", bindData);
-	list.Dispatch(dispatchX, dispatchY, 1);
+	list.Dispatch(std::ceil(intermediateComponent.description.width / 8.f), std::ceil(intermediateComponent.description.height / 8.f), 1);
 
-	// The output texture is about to be read in as the input to the next pass, so synchronize.
-	list.UAVBarrier(resources.GetTexture(outputTexture));
+	// The intermediate is about to be read in as the input to the next pass, so synchronize.
+	list.UAVBarrier(resources.GetTexture(intermediateTexture));
 	list.FlushBarriers();
 
-	// Use the intermediate results in the output as the input to the second pass.
-	bindData[0] = resources.Get(outputTexture);
-
-	dispatchX = std::ceil(inputComponent.description.width / 64.f);
-	dispatchY = inputComponent.description.height;
+	bindData[0] = resources.Get(intermediateTexture, "srv");
+	bindData[1] = resources.Get(outputTexture, "uav");
+	const float horizontalDirection[] = { 1.f / intermediateComponent.description.width, 0.f };
+	std::memcpy(bindData.data() + 2, horizontalDirection, sizeof(horizontalDirection));
 
-	list.BindPipeline(horizontalLayout);
 	list.BindConstants("bindData", bindData);
-	list.Dispatch(dispatchX, dispatchY, 1);
+	list.Dispatch(std::ceil(outputComponent.description.width / 8.f), std::ceil(outputComponent.description.height / 8.f), 1);
 }
\ No newline at end of file
@@ -9,36 +9,59 @@
 #include <Rendering/DescriptorHeap.h>
 #include <Rendering/RenderGraphResource.h>
 
+#include <vector>
+#include <cstdint>
+
 class RenderDevice;
 class CommandList;
 class RenderPassResources;
+class JobCounter;
 
 class RenderUtils : public Singleton<RenderUtils>
 {
 public:
-	TextureHandle blueNoise;
+	// Spatiotemporal blue noise, single channel. Every slice is blue noise, and each texel steps through a low discrepancy
+	// sequence across the slices, so sampling a new slice each frame converges quickly under temporal accumulation.
+	static constexpr uint32_t blueNoiseSlices = 64;
+	TextureHandle blueNoise;  // 2D array of blueNoiseSlices slices.
 
 private:
 	RenderDevice* device = nullptr;
 	PipelineState clearUAVState;
 
-	void GaussianBlurInternal(CommandList& list, RenderPassResources& resources, RenderResource inputTexture, RenderResource outputTexture, uint32_t radius, float sigma);
+	// Decoded and shifted by a startup job, uploaded once it's done.
+	std::vector<uint8_t> blueNoiseTexels;
+	uint32_t blueNoiseWidth = 0;
+	uint32_t blueNoiseHeight = 0;
+
+	void LoadBlueNoise();
+	void CreateBlueNoise();
+	void GaussianBlurInternal(CommandList& list, RenderPassResources& resources, RenderResource inputTexture, RenderResource intermediateTexture,
+		RenderResource outputTexture, uint32_t radius, float sigma);
 
 public:
-	void Initialize(RenderDevice* inDevice);
+	// Builds the pipeline and loads the blue noise as startup jobs, neither touches the resource manager.
+	void Initialize(RenderDevice* inDevice, JobCounter& startupJobs);
+	// Creates the blue noise, once the startup jobs are done.
+	void FinishInitialize();
 	void Destroy();
 
 	void ClearUAV(CommandList& list, BufferHandle buffer, uint32_t bufferHandle, const DescriptorHandle& nonVisibleDescriptor);
-	void GaussianBlur(CommandList& list, RenderPassResources& resources, RenderResource texture, uint32_t radius, float sigma = -1.f);
-	void GaussianBlur(CommandList& list, RenderPassResources& resources, RenderResource inputTexture, RenderResource outputTexture, uint32_t radius, float sigma = -1.f);
+	// Blurs vertically into the intermediate, then horizontally into the output. Textures are bound through views named
+	// "srv" for reading and "uav" for writing. An intermediate smaller than the input blurs at its resolution, with the
+	// radius and sigma scaled to match, which is much cheaper for large radii.
+	void GaussianBlur(CommandList& list, RenderPassResources& resources, RenderResource texture, RenderResource intermediateTexture, uint32_t radius, float sigma = -1.f);
+	void GaussianBlur(CommandList& list, RenderPassResources& resources, RenderResource inputTexture, RenderResource intermediateTexture,
+		RenderResource outputTexture, uint32_t radius, float sigma = -1.f);
 };
 
-inline void RenderUtils::GaussianBlur(CommandList& list, RenderPassResources& resources, RenderResource texture, uint32_t radius, float sigma)
+inline void RenderUtils::GaussianBlur(CommandList& list, RenderPassResources& resources, RenderResource texture, RenderResource intermediateTexture, uint32_t radius, float sigma)
 {
-	GaussianBlurInternal(list, resources, texture, texture, radius, sigma);
+	GaussianBlurInternal(list, resources, texture, intermediateTexture, texture, radius, sigma);
 }
 
-inline void RenderUtils::GaussianBlur(CommandList& list, RenderPassResources& resources, RenderResource inputTexture, RenderResource outputTexture, uint32_t radius, float sigma)
+inline void RenderUtils::GaussianBlur(CommandList& list, RenderPassResources& resources, RenderResource inputTexture, RenderResource intermediateTexture,
+	RenderResource outputTexture, uint32_t radius, float sigma)
 {
-	GaussianBlurInternal(list, resources, inputTexture, outputTexture, radius, sigma);
+	GaussianBlurInternal(list, resources, inputTexture, intermediateTexture, outputTexture, radius, sigma);
 }
\ No newline at end of file
@@ -11,8 +11,11 @@
 #include <Rendering/ShaderStructs.h>
 #include <Core/Config.h>
 #include <Rendering/RenderUtils.h>
+#include <Rendering/QualityPreset.h>
 #include <Editor/Editor.h>
 #include <Utility/Math.h>
+#include <Threading/JobSystem.h>
+#include <Core/Memory.h>
 
 #include <vector>
 #include <utility>
@@ -20,91 +23,548 @@
 #include <cmath>
 #include <algorithm>
 #include <execution>
+#include <numeric>
+#include <tuple>
+#include <optional>
+#include <bit>
 
-void Renderer::CreateRootSignature()
+MeshRenderable Renderer::CreateRenderable(const MeshComponent& mesh, size_t subset) const
 {
-	VGScopedCPUStat("Create Indirect Root Signature");
+	const auto& bounds = mesh.subsets[subset];
+
+	XMFLOAT3 boundsCenter;
+	XMFLOAT3 boundsExtents;
+	XMStoreFloat3(&boundsCenter, (XMLoadFloat3(&bounds.boundsMax) + XMLoadFloat3(&bounds.boundsMin)) * 0.5f);
+	XMStoreFloat3(&boundsExtents, (XMLoadFloat3(&bounds.boundsMax) - XMLoadFloat3(&bounds.boundsMin)) * 0.5f);
+
+	return MeshRenderable{
+		.positionOffset = (uint32_t)(mesh.globalOffset.position + mesh.subsets[subset].localOffset.position),
+		.extraOffset = (uint32_t)(mesh.globalOffset.extra + mesh.subsets[subset].localOffset.extra),
+		.indexOffset = (uint32_t)(mesh.globalOffset.index + mesh.subsets[subset].localOffset.index),
+		.indexCount = (uint32_t)mesh.subsets[subset].indices,
+		.indexSize = (uint32_t)mesh.subsets[subset].indexSize,
+		.materialIndex = (uint32_t)mesh.subsets[subset].materialIndex,
+		.boundingSphereRadius = bounds.boundingSphereRadius,
+		.boundingSphereCenter = bounds.boundingSphereCenter,
+		.boundsCenter = boundsCenter,
+		.boundsExtents = boundsExtents,
+		.meshletOffset = (uint32_t)(mesh.globalOffset.meshlet + mesh.subsets[subset].localOffset.meshlet),
+		.meshletCount = (uint32_t)mesh.subsets[subset].meshlets,
+		.lodCount = (uint32_t)mesh.subsets[subset].lodCount,
+		.lods = mesh.subsets[subset].lods
+	};
+}
 
-	// Only using a single root signature, so we know all shaders will use the following signature object.
-	// This function is just used to aid indirect command signatures, which can require a root signature,
-	// and since root signatures are deserialized from shaders at runtime, this doesn't work well with command
-	// signatures... so just manually compile some shader here and let the runtime merge the root signature.
+BoundingBox Renderer::ComputeWorldBounds(const WorldTransformComponent& transform, const MeshComponent& mesh) const
+{
+	const auto worldMatrix = XMLoadFloat4x4(&transform.matrix);
 
-	const auto shader = CompileShader(Config::shadersPath / "ClearUAV", ShaderType::Compute, "Main", {});
-	if (!shader)
+	BoundingBox bounds;
+	for (size_t i = 0; i < mesh.subsets.size(); ++i)
 	{
-		VGLogCritical(logRendering, "Failed to create indirect root signature shader.");
+		BoundingBox subsetBounds;
+		BoundingBox::CreateFromPoints(subsetBounds, XMLoadFloat3(&mesh.subsets[i].boundsMin), XMLoadFloat3(&mesh.subsets[i].boundsMax));
+		subsetBounds.Transform(subsetBounds, worldMatrix);
+
+		if (i == 0)
+			bounds = subsetBounds;
+		else
+			BoundingBox::CreateMerged(bounds, bounds, subsetBounds);
 	}
 
-	const auto result = device->Native()->CreateRootSignature(0, shader->bytecode.data(), shader->bytecode.size(), IID_PPV_ARGS(rootSignature.Indirect()));
-	if (FAILED(result))
+	return bounds;
+}
+
+ObjectData Renderer::CreateObjectData(const MeshComponent& mesh, const MeshRenderable& renderable) const
+{
+	ObjectData instance;
+	instance.vertexMetadata = mesh.metadata;
+	instance.materialIndex = renderable.materialIndex;
+	instance.boundingSphereRadius = renderable.boundingSphereRadius;
+	instance.boundingSphereCenter = renderable.boundingSphereCenter;
+	instance.boundsCenter = renderable.boundsCenter;
+	instance.boundsExtents = renderable.boundsExtents;
+	instance.meshletOffset = renderable.meshletOffset;
+	instance.meshletCount = renderable.meshletCount;
+	instance.indexOffset = renderable.indexOffset;
+	instance.indexSize = renderable.indexSize;
+
+	// Apply offsets
+	const auto old = instance.vertexMetadata.channelOffsets[0][0];
+	for (int i = 0; i < vertexChannels / 4 + 1; ++i)
+	{
+		instance.vertexMetadata.channelOffsets[i].AddAll(renderable.extraOffset);
+	}
+	instance.vertexMetadata.channelOffsets[0][0] = old + renderable.positionOffset;
+
+	return instance;
+}
+
+uint32_t Renderer::AcquireBatch(const MeshRenderable& renderable)
+{
+	// Instances that draw the same subset with the same material are drawn in a single instanced draw. Each level of detail
+	// has its own record following the full detail one, instances only reference the first.
+	const BatchKey key{ renderable.indexOffset, renderable.indexCount, renderable.positionOffset, renderable.extraOffset, renderable.materialIndex };
+
+	if (const auto iter = batchLookup.find(key); iter != batchLookup.end())
+	{
+		for (uint32_t i = 0; i < renderable.lodCount; ++i)
+		{
+			++batchRecords[iter->second + i].references;
+		}
+
+		return iter->second;
+	}
+
+	const auto batch = batchAllocator.Allocate(renderable.lodCount);
+	if (!batch)
+	{
+		VGLogError(logRendering, "Exceeded the maximum of {} mesh batches.", maxBatches);
+
+		return invalidBatch;
+	}
+
+	if (*batch + renderable.lodCount > batchRecords.size())
+	{
+		batchRecords.resize(*batch + renderable.lodCount);
+	}
+
+	const auto indexBufferAddress = device->GetResourceManager().Get(meshFactory->indexBuffer).Native()->GetGPUVirtualAddress();
+
+	for (uint32_t i = 0; i < renderable.lodCount; ++i)
+	{
+		const auto& lod = renderable.lods[i];
+		const auto indexCount = (uint32_t)lod.indices;
+
+		batchRecords[*batch + i] = BatchRecord{
+			.key = key,
+			.argument = {
+				.indexView = {
+					.BufferLocation = indexBufferAddress + renderable.indexOffset + lod.indexOffset,
+					.SizeInBytes = indexCount * renderable.indexSize,
+					.Format = renderable.indexSize == sizeof(uint16_t) ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT
+				},
+				.batchId = 0,
+				.draw = {
+					.IndexCountPerInstance = indexCount,
+					.InstanceCount = 0,
+					.StartIndexLocation = 0,
+					.BaseVertexLocation = 0,
+					.StartInstanceLocation = 0
+				},
+				.bucket = 0,  // Assigned when the buckets are laid out.
+				.lodLevel = i,
+				.lodCount = renderable.lodCount,
+				.lodError = lod.error
+			},
+			.meshletCount = i == 0 ? renderable.meshletCount : 0,  // Meshlets are only built for the full detail level.
+			.references = 1,
+			.lodIndexOffset = (uint32_t)lod.indexOffset
+		};
+	}
+
+	batchLookup[key] = *batch;
+	batchesInvalidated = true;
+
+	return *batch;
+}
+
+void Renderer::ReleaseBatch(uint32_t batch)
+{
+	if (batch == invalidBatch)
+		return;
+
+	// Levels of detail mirror the references of their full detail record.
+	const auto lodCount = batchRecords[batch].argument.lodCount;
+	for (uint32_t i = 0; i < lodCount; ++i)
+	{
+		--batchRecords[batch + i].references;
+	}
+
+	auto& record = batchRecords[batch];
+	if (record.references == 0)
+	{
+		// Freed records are uploaded without an argument when the buckets are laid out again.
+		batchLookup.erase(record.key);
+		batchAllocator.Free(batch, lodCount);
+		batchesInvalidated = true;
+	}
+}
+
+void Renderer::AddInstances(const entt::registry& registry, entt::entity entity)
+{
+	const auto& transform = registry.get<WorldTransformComponent>(entity);
+	const auto& sourceMesh = registry.get<MeshComponent>(entity);
+	// Skinned entities draw their own skinned vertices.
+	const auto& mesh = registry.all_of<SkinComponent>(entity) ? skinning.AddInstance(entity, sourceMesh) : sourceMesh;
+	const auto count = static_cast<uint32_t>(mesh.subsets.size());
+
+	const auto offset = instanceAllocator.Allocate(count);
+	if (!offset)
+	{
+		VGLogError(logRendering, "Exceeded the maximum of {} mesh instances.", maxInstances);
+
+		return;
+	}
+
+	const auto transformIndex = transformAllocator.Allocate(1);
+	if (!transformIndex)
+	{
+		VGLogError(logRendering, "Exceeded the maximum of {} mesh transforms.", maxInstances);
+		instanceAllocator.Free(*offset, count);
+
+		return;
+	}
+
+	if (instanceAllocator.Size() > instanceEntities.size())
+	{
+		instanceEntities.resize(instanceAllocator.Size(), entt::null);
+	}
+
+	if (transformAllocator.Size() > transformEntities.size())
+	{
+		transformEntities.resize(transformAllocator.Size(), entt::null);
+		uploadedTransforms.resize(transformAllocator.Size());
+	}
+
+	SceneEntity sceneEntity{ .instanceOffset = *offset, .transformIndex = *transformIndex };
+	sceneEntity.batches.reserve(count);
+
+	for (size_t i = 0; i < mesh.subsets.size(); ++i)
+	{
+		sceneEntity.batches.emplace_back(AcquireBatch(CreateRenderable(mesh, i)));
+	}
+
+	std::fill_n(instanceEntities.begin() + *offset, count, entity);
+	pendingInstanceRanges.emplace_back(*offset, *offset + count);
+	transformEntities[*transformIndex] = entity;
+	uploadedTransforms[*transformIndex] = XMLoadFloat4x4(&transform.matrix);
+	pendingTransformEntities.emplace_back(entity);
+	sceneEntities[entity] = std::move(sceneEntity);
+	renderableCount += count;
+	instancesInvalidated = true;
+
+	if (count > 0)
 	{
-		VGLogCritical(logRendering, "Failed to create indirect root signature: {}", result);
+		sceneBvh.Insert(entity, ComputeWorldBounds(transform, mesh));
+		rayTracingScene.AddInstance(entity, sourceMesh, XMLoadFloat4x4(&transform.matrix));
+
+		// Skinned entities deform, a baked impostor can't follow them.
+		if (&mesh == &sourceMesh)
+		{
+			impostors.AddInstance(entity, sourceMesh, *offset);
+		}
 	}
 }
 
-std::vector<MeshRenderable> Renderer::UpdateObjects(const entt::registry& registry)
+void Renderer::RemoveInstances(entt::entity entity)
 {
-	VGScopedCPUStat("Update Instance Buffer");
+	skinning.RemoveInstance(entity);  // Before the scene entity check, additions can fail after skinning.
 
-	const auto instanceView = registry.view<const TransformComponent, const MeshComponent>();
+	const auto iter = sceneEntities.find(entity);
+	if (iter == sceneEntities.end())
+		return;
 
-	std::vector<MeshRenderable> renderables;
-	renderables.reserve(instanceView.size_hint());
-	std::vector<ObjectData> objectData;
-	objectData.reserve(instanceView.size_hint());
+	const auto& sceneEntity = iter->second;
+	const auto count = static_cast<uint32_t>(sceneEntity.batches.size());
 
-	size_t index = 0;
-	std::for_each(std::execution::seq, instanceView.begin(), instanceView.end(), [this, &registry, &index, &renderables, &objectData](auto entity)
+	for (const auto batch : sceneEntity.batches)
 	{
-		const auto& transform = registry.get<TransformComponent>(entity);
-		const auto& mesh = registry.get<MeshComponent>(entity);
+		ReleaseBatch(batch);
+	}
+
+	// Freed slots are uploaded as invalid instances, so the draw generation skips them.
+	std::fill_n(instanceEntities.begin() + sceneEntity.instanceOffset, count, entt::null);
+	pendingInstanceRanges.emplace_back(sceneEntity.instanceOffset, sceneEntity.instanceOffset + count);
+	instanceAllocator.Free(sceneEntity.instanceOffset, count);
+	transformEntities[sceneEntity.transformIndex] = entt::null;
+	transformAllocator.Free(sceneEntity.transformIndex, 1);
+	renderableCount -= count;
+	instancesInvalidated = true;
+
+	sceneEntities.erase(iter);
+	sceneBvh.Remove(entity);
+	rayTracingScene.RemoveInstance(entity);
+	impostors.RemoveInstance(entity);
+}
+
+void Renderer::MergeUploadRanges(std::vector<std::pair<uint32_t, uint32_t>>& ranges, size_t maxRanges)
+{
+	std::sort(ranges.begin(), ranges.end());
 
-		for (const auto& subset : mesh.subsets)
+	size_t merged = 0;
+	for (size_t i = 1; i < ranges.size(); ++i)
+	{
+		if (ranges[i].first <= ranges[merged].second)
 		{
-			const auto maxScale = std::max(std::max(transform.scale.x, transform.scale.y), transform.scale.z);
+			ranges[merged].second = std::max(ranges[merged].second, ranges[i].second);
+		}
 
-			MeshRenderable renderable{
-				.positionOffset = (uint32_t)(mesh.globalOffset.position + subset.localOffset.position),
-				.extraOffset = (uint32_t)(mesh.globalOffset.extra + subset.localOffset.extra),
-				.indexOffset = (uint32_t)(mesh.globalOffset.index + subset.localOffset.index) / sizeof(uint32_t),
-				.indexCount = (uint32_t)subset.indices,
-				.materialIndex = (uint32_t)subset.materialIndex,
-				.batchId = (uint32_t)index,  // every object in separate batch for now...
-				.boundingSphereRadius = subset.boundingSphereRadius * maxScale
-			};
-			renderables.emplace_back(renderable);
+		else
+		{
+			ranges[++merged] = ranges[i];
+		}
+	}
+
+	ranges.resize(std::min(ranges.size(), merged + 1));
+
+	// Every range is its own copy, past a point it's cheaper to upload everything between the first and last change.
+	if (ranges.size() > maxRanges)
+	{
+		ranges = { { ranges.front().first, ranges.back().second } };
+	}
+}
+
+void Renderer::UpdateDirtyObjects(const entt::registry& registry)
+{
+	VGScopedCPUStat("Update Dirty Instances");
+
+	// Every renderable is in the group, its transforms and meshes are looked up from the packed front of their pools.
+	const auto renderables = registry.group_if_exists<WorldTransformComponent, MeshComponent>();
 
-			const auto scaling = XMVectorSet(transform.scale.x, transform.scale.y, transform.scale.z, 0.f);
-			const auto translation = XMVectorSet(transform.translation.x, transform.translation.y, transform.translation.z, 0.f);
+	// Instance records only change when slots are allocated or freed. Moved entities only upload their shared transform,
+	// and entities that moved last frame are uploaded once more, so their previous transform stops trailing behind.
+	auto ranges = std::move(pendingInstanceRanges);
+	pendingInstanceRanges.clear();
 
-			const auto scalingMat = XMMatrixScalingFromVector(scaling);
-			const auto rotationMat = XMMatrixRotationX(-transform.rotation.x) * XMMatrixRotationY(-transform.rotation.y) * XMMatrixRotationZ(-transform.rotation.z);
-			const auto translationMat = XMMatrixTranslationFromVector(translation);
+	std::vector<entt::entity> dirtyTransforms = std::move(pendingTransformEntities);
+	pendingTransformEntities.clear();
+	dirtyTransforms.insert(dirtyTransforms.end(), movedEntities.begin(), movedEntities.end());
+	dirtyTransforms.insert(dirtyTransforms.end(), transformObserver.begin(), transformObserver.end());
 
-			ObjectData instance;
-			instance.worldMatrix = scalingMat * rotationMat * translationMat;
-			instance.vertexMetadata = mesh.metadata;
-			instance.materialIndex = renderable.materialIndex;
-			instance.boundingSphereRadius = renderable.boundingSphereRadius;
+	// The virtual shadow map still invalidates by instance, under every instance of a moved entity.
+	auto invalidationRanges = ranges;
+	std::vector<std::pair<uint32_t, uint32_t>> transformRanges;
+	transformRanges.reserve(dirtyTransforms.size());
+
+	for (const auto entity : dirtyTransforms)
+	{
+		if (const auto iter = sceneEntities.find(entity); iter != sceneEntities.end())
+		{
+			const auto offset = iter->second.instanceOffset;
+			invalidationRanges.emplace_back(offset, offset + static_cast<uint32_t>(iter->second.batches.size()));
+			transformRanges.emplace_back(iter->second.transformIndex, iter->second.transformIndex + 1);
+		}
+	}
 
-			// Apply offsets
-			const auto old = instance.vertexMetadata.channelOffsets[0][0];
-			for (int i = 0; i < vertexChannels / 4 + 1; ++i)
+	// Refit the moved entities, most stay within their fattened bounds and leave the tree untouched. Local shadows covering
+	// either the old or the new bounds render again.
+	for (const auto entity : transformObserver)
+	{
+		if (const auto iter = sceneEntities.find(entity); iter != sceneEntities.end() && !iter->second.batches.empty())
+		{
+			const auto [transform, mesh] = renderables.get<const WorldTransformComponent, const MeshComponent>(entity);
+			const auto bounds = ComputeWorldBounds(transform, mesh);
+			if (const auto lastBounds = sceneBvh.GetBounds(entity))
 			{
-				instance.vertexMetadata.channelOffsets[i].AddAll(renderable.extraOffset);
+				localShadows.InvalidateBounds(*lastBounds);
 			}
-			instance.vertexMetadata.channelOffsets[0][0] = old + renderable.positionOffset;
 
-			objectData.emplace_back(instance);
+			localShadows.InvalidateBounds(bounds);
+			sceneBvh.Update(entity, bounds);
+			rayTracingScene.UpdateTransform(entity, XMLoadFloat4x4(&transform.matrix));
+		}
+	}
+
+	movedEntities.assign(transformObserver.begin(), transformObserver.end());
+
+	if (!invalidationRanges.empty())
+	{
+		MergeUploadRanges(invalidationRanges, maxInstanceUploadRanges);
+		virtualShadows.InvalidateInstances(invalidationRanges);
+	}
+
+	if (!transformRanges.empty())
+	{
+		MergeUploadRanges(transformRanges, maxInstanceUploadRanges);
+	}
+
+	for (const auto [first, last] : transformRanges)
+	{
+		auto* transformData = static_cast<TransformData*>(device->GetResourceManager().ReserveWrite(transformBuffer, (last - first) * sizeof(TransformData), first * sizeof(TransformData)));
+		if (!transformData)
+		{
+			VGLogError(logRendering, "Failed to update transform buffer.");
 
-			++index;
+			return;
+		}
+
+		std::vector<uint32_t> rangeSlots;
+		rangeSlots.reserve(last - first);
+		for (auto index = first; index < last; ++index)
+		{
+			if (transformEntities[index] == entt::null)
+			{
+				transformData[index - first] = TransformData{ XMMatrixIdentity(), XMMatrixIdentity() };
+			}
+
+			else
+			{
+				rangeSlots.emplace_back(index);
+			}
+		}
+
+		// Ranges merged over entities that haven't moved upload them again unchanged, their previous transform is current.
+		// Slots are visited in order, so the previous transforms are read and the upload written linearly.
+		std::for_each(std::execution::par_unseq, rangeSlots.begin(), rangeSlots.end(), [&](auto index)
+		{
+			// Cached by the transform system.
+			const auto worldMatrix = XMLoadFloat4x4(&renderables.get<const WorldTransformComponent>(transformEntities[index]).matrix);
+
+			transformData[index - first] = TransformData{ worldMatrix, uploadedTransforms[index] };
+			uploadedTransforms[index] = worldMatrix;
+		});
+	}
+
+	if (ranges.empty())
+		return;
+
+	MergeUploadRanges(ranges, maxInstanceUploadRanges);
+
+	for (const auto [first, last] : ranges)
+	{
+		auto* objectData = static_cast<ObjectData*>(device->GetResourceManager().ReserveWrite(instanceBuffer, (last - first) * sizeof(ObjectData), first * sizeof(ObjectData)));
+		if (!objectData)
+		{
+			VGLogError(logRendering, "Failed to update instance buffer.");
+
+			return;
+		}
+
+		// Entities cover whole ranges of slots, step through them one entity or free slot at a time.
+		std::vector<entt::entity> rangeEntities;
+		for (auto index = first; index < last;)
+		{
+			const auto entity = instanceEntities[index];
+			if (entity == entt::null)
+			{
+				ObjectData freeSlot{};
+				freeSlot.batchIndex = invalidBatch;
+				objectData[index - first] = freeSlot;
+				++index;
+			}
+
+			else
+			{
+				rangeEntities.emplace_back(entity);
+				index += static_cast<uint32_t>(sceneEntities.at(entity).batches.size());
+			}
+		}
+
+		std::for_each(std::execution::par_unseq, rangeEntities.begin(), rangeEntities.end(), [&](auto entity)
+		{
+			const auto& mesh = skinning.GetMesh(entity, renderables.get<const MeshComponent>(entity));
+			const auto& sceneEntity = sceneEntities.at(entity);
+			const auto impostorIndex = impostors.GetImpostorIndex(entity);
+
+			// Subsets only carry their own draw range and material, the transform is shared.
+			for (size_t i = 0; i < mesh.subsets.size(); ++i)
+			{
+				auto object = CreateObjectData(mesh, CreateRenderable(mesh, i));
+				object.transformIndex = sceneEntity.transformIndex;
+				object.batchIndex = sceneEntity.batches[i];
+				object.impostorIndex = impostorIndex > 0 && i == 0 ? impostorIndex | Impostors::primaryFlag : impostorIndex;  // The first subset draws the quad.
+				objectData[sceneEntity.instanceOffset + i - first] = object;
+			}
+		});
+	}
+}
+
+void Renderer::GrowSceneBuffers()
+{
+	auto& resourceManager = device->GetResourceManager();
+
+	// Slots only grow the allocators' high water marks, so the buffers double at most a few times while a scene loads. The
+	// GPU written buffers are copied as well, since the draws are only regenerated when records change.
+	resourceManager.Grow(instanceBuffer, instanceAllocator.Size(), VGText("Instance buffer"));
+	resourceManager.Grow(meshInstanceBuffer, instanceAllocator.Size(), VGText("Mesh instance buffer"));
+	resourceManager.Grow(transformBuffer, transformAllocator.Size(), VGText("Transform buffer"));
+	resourceManager.Grow(batchRecordBuffer, batchAllocator.Size(), VGText("Mesh batch record buffer"));
+	resourceManager.Grow(meshIndirectRenderArgs, batchAllocator.Size(), VGText("Mesh indirect render argument buffer"));
+}
+
+void Renderer::UpdateBatchLayout()
+{
+	VGScopedCPUStat("Update Batch Layout");
+
+	const auto recordCount = batchAllocator.Size();
+
+	// Count the batches and the worst case meshlet draws of each material permutation.
+	std::array<uint32_t, materialPermutations> bucketBatches = {};
+	std::array<uint64_t, materialPermutations> bucketMeshlets = {};
+	uint64_t totalMeshlets = 0;
+	for (uint32_t i = 0; i < recordCount; ++i)
+	{
+		auto& record = batchRecords[i];
+		if (record.references == 0)
+			continue;
+
+		record.argument.bucket = materialFactory->GetFeatures(std::get<4>(record.key));
+		++bucketBatches[record.argument.bucket];
+		bucketMeshlets[record.argument.bucket] += static_cast<uint64_t>(record.meshletCount) * record.references;
+		totalMeshlets += static_cast<uint64_t>(record.meshletCount) * record.references;
+	}
+
+	// Scenes with more meshlets than the culled draw list holds share it proportionally.
+	uint32_t batchOffset = 0;
+	uint32_t meshletDrawOffset = 0;
+	for (uint32_t i = 0; i < materialPermutations; ++i)
+	{
+		auto meshletDraws = bucketMeshlets[i];
+		if (totalMeshlets > maxMeshletDraws)
+		{
+			meshletDraws = meshletDraws * maxMeshletDraws / totalMeshlets;
+		}
+
+		materialBuckets[i] = MaterialBucket{
+			.batchOffset = batchOffset,
+			.batchCount = bucketBatches[i],
+			.meshletDrawOffset = meshletDrawOffset,
+			.meshletDrawCount = static_cast<uint32_t>(meshletDraws)
+		};
+
+		batchOffset += bucketBatches[i];
+		meshletDrawOffset += static_cast<uint32_t>(meshletDraws);
+	}
+
+	// Every record is uploaded, since inserting a batch shifts the argument of every batch in later buckets.
+	std::array<uint32_t, materialPermutations> bucketCursors;
+	std::transform(materialBuckets.begin(), materialBuckets.end(), bucketCursors.begin(), [](const auto& bucket) { return bucket.batchOffset; });
+
+	std::vector<MeshBatchRecord> records;
+	records.reserve(recordCount);
+	maxMeshletChunks = 0;
+	for (uint32_t i = 0; i < recordCount; ++i)
+	{
+		const auto& record = batchRecords[i];
+		if (record.references == 0)
+		{
+			records.emplace_back(MeshBatchRecord{ .argumentIndex = invalidBatch });
+			continue;
 		}
-	});
 
-	device->GetResourceManager().Write(instanceBuffer, objectData);
+		records.emplace_back(MeshBatchRecord{ .argument = record.argument, .argumentIndex = bucketCursors[record.argument.bucket]++ });
+		maxMeshletChunks = std::max(maxMeshletChunks, (record.meshletCount + meshletGroupSize - 1) / meshletGroupSize);
+	}
+
+	if (!records.empty())
+	{
+		device->GetResourceManager().Write(batchRecordBuffer, records);
+	}
+
+	device->GetResourceManager().Write(materialBucketBuffer, materialBuckets);
+
+	batchCount = batchOffset;
+	batchesInvalidated = false;
+	materialRevision = materialFactory->GetRevision();
+
+	// Instances reference their batch's argument, so the instance lists are regenerated too.
+	instancesInvalidated = true;
+}
 
-	return renderables;
+void Renderer::OnMeshDestroyed(entt::registry& registry, entt::entity entity)
+{
+	RemoveInstances(entity);
 }
 
 void Renderer::UpdateCameraBuffer(const entt::registry& registry)
@@ -124,9 +584,18 @@ void Renderer::UpdateCameraBuffer(const entt::registry& registry)
 		fieldOfView = camera.fieldOfView;
 	});
 
-	auto& backBuffer = device->GetResourceManager().Get(device->GetBackBuffer());
+	const auto [sceneWidth, sceneHeight] = GetSceneResolution();
+
+	// Each frame samples a different sub-pixel position, which the temporal resolve accumulates.
+	XMFLOAT2 jitter = { 0.f, 0.f };
+	if (*CvarGet("temporalAA", int))
+	{
+		jitter = TemporalAntiAliasing::GetJitter(appFrame, sceneWidth, sceneHeight);
+	}
+
+	const auto jitteredProjection = XMMatrixMultiply(globalProjectionMatrix, XMMatrixTranslation(jitter.x, jitter.y, 0.f));
 
-	std::vector<Camera> cameras;
+	FrameVector<Camera> cameras{ &device->GetFrameArena() };
 
 	XMFLOAT3 lastFrameTranslation;
 	auto lastFrameTranslationVector = XMMatrixInverse(nullptr, globalLastFrameViewMatrix).r[3];
@@ -136,9 +605,9 @@ void Renderer::UpdateCameraBuffer(const entt::registry& registry)
 	cameras.emplace_back(Camera{
 		.position = XMFLOAT4{ translation.x, translation.y, translation.z, 0.f },
 		.view = globalViewMatrix,
-		.projection = globalProjectionMatrix,
+		.projection = jitteredProjection,
 		.inverseView = XMMatrixInverse(nullptr, globalViewMatrix),
-		.inverseProjection = XMMatrixInverse(nullptr, globalProjectionMatrix),
+		.inverseProjection = XMMatrixInverse(nullptr, jitteredProjection),
 		.lastFramePosition = XMFLOAT4{ lastFrameTranslation.x, lastFrameTranslation.y, lastFrameTranslation.z, 0.f },
 		.lastFrameView = globalLastFrameViewMatrix,
 		.lastFrameProjection = globalLastFrameProjectionMatrix,
@@ -147,9 +616,13 @@ void Renderer::UpdateCameraBuffer(const entt::registry& registry)
 		.nearPlane = nearPlane,
 		.farPlane = farPlane,
 		.fieldOfView = fieldOfView,
-		.aspectRatio = static_cast<float>(backBuffer.description.width) / static_cast<float>(backBuffer.description.height)
+		.aspectRatio = static_cast<float>(sceneWidth) / static_cast<float>(sceneHeight),
+		.jitter = jitter,
+		.lastFrameJitter = lastFrameJitter
 	});
 
+	lastFrameJitter = jitter;
+
 	// Frozen perspective camera.
 	const auto translationVector = XMMatrixInverse(nullptr, frozenView).r[3];
 	XMStoreFloat3(&translation, translationVector);
@@ -167,7 +640,7 @@ void Renderer::UpdateCameraBuffer(const entt::registry& registry)
 		.nearPlane = nearPlane,
 		.farPlane = farPlane,
 		.fieldOfView = fieldOfView,
-		.aspectRatio = static_cast<float>(backBuffer.description.width) / static_cast<float>(backBuffer.description.height)
+		.aspectRatio = static_cast<float>(sceneWidth) / static_cast<float>(sceneHeight)
 	});
 
 	const auto solarZenithAngle = registry.get<TimeOfDayComponent>(atmosphere.sunLight).solarZenithAngle;
@@ -200,146 +673,547 @@ void Renderer::UpdateCameraBuffer(const entt::registry& registry)
 		.nearPlane = sunNearPlane,
 		.farPlane = sunFarPlane,
 		.fieldOfView = 0,
-		.aspectRatio = static_cast<float>(backBuffer.description.width) / static_cast<float>(backBuffer.description.height)
+		.aspectRatio = static_cast<float>(sceneWidth) / static_cast<float>(sceneHeight)
 	});
 
+	// Fit to the unjittered projection, the jitter would shift the cascades every frame.
+	shadows.Update(globalViewMatrix, globalProjectionMatrix, nearPlane, farPlane, sunForward, sunUpward, cameras);
+	virtualShadows.Update(globalViewMatrix, sunForward, sunUpward, cameras);
+	reflectionProbes.AppendCameras(cameras);
+	localShadows.Update(XMLoadFloat3(&translation), cameras);
+
 	device->GetResourceManager().Write(cameraBuffer, cameras);
+
+	// Only the spectator and frozen cameras are culled against the Hi-Z, but every view gets its dimensions.
+	const auto [hiZWidth, hiZHeight, hiZMipCount] = OcclusionCulling::GetHiZDimensions(sceneWidth, sceneHeight);
+
+	FrameVector<CullingView> cullingViews{ &device->GetFrameArena() };
+	cullingViews.reserve(cameras.size());
+	for (const auto& camera : cameras)
+	{
+		cullingViews.emplace_back(CreateCullingView(camera, hiZWidth, hiZHeight, hiZMipCount));
+	}
+
+	device->GetResourceManager().Write(cullingViewBuffer, cullingViews);
+}
+
+CullingView Renderer::CreateCullingView(const Camera& camera, uint32_t hiZWidth, uint32_t hiZHeight, uint32_t hiZMipCount)
+{
+	const auto viewProjection = XMMatrixMultiply(camera.view, camera.projection);
+	const bool orthographic = camera.fieldOfView <= 0.f;
+
+	// Each column of the view projection is a clip space coordinate, the planes are sums of them.
+	// https://fgiesen.wordpress.com/2012/08/31/frustum-planes-from-the-projection-matrix/
+	const auto clip = XMMatrixTranspose(viewProjection);
+	const XMVECTOR planes[6] = {
+		clip.r[3] + clip.r[0],  // -w <= x
+		clip.r[3] - clip.r[0],  // x <= w
+		clip.r[3] + clip.r[1],  // -w <= y
+		clip.r[3] - clip.r[1],  // y <= w
+		// Inverse Z, z <= w. Orthographic views keep casters between the light and the near plane, shadow passes clamp
+		// their depth instead of clipping them.
+		orthographic ? XMVectorSet(0.f, 0.f, 0.f, 1.f) : clip.r[3] - clip.r[2],
+		clip.r[2]  // 0 <= z, degenerate with an infinite far plane.
+	};
+
+	CullingView view{
+		.view = camera.view,
+		.viewProjection = viewProjection,
+		.position = camera.position,
+		.projectionScale = { XMVectorGetX(camera.projection.r[0]), XMVectorGetY(camera.projection.r[1]) },
+		.nearPlane = camera.nearPlane,
+		.orthographic = orthographic ? 1u : 0u,
+		.hiZSize = { static_cast<float>(hiZWidth), static_cast<float>(hiZHeight) },
+		.hiZMipCount = hiZMipCount
+	};
+
+	for (int i = 0; i < 6; ++i)
+	{
+		const auto length = XMVectorGetX(XMVector3Length(planes[i]));
+
+		// Planes without a normal never cull.
+		XMStoreFloat4(&view.frustumPlanes[i], length > 1e-6f ? planes[i] / length : XMVectorSet(0.f, 0.f, 0.f, 1.f));
+	}
+
+	return view;
 }
 
 void Renderer::CreatePipelines()
 {
+	sceneClearLayout = RenderPipelineLayout{}
+		.ComputeShader({ "SceneSubmission", "ClearMain" });
+
+	sceneCountLayout = RenderPipelineLayout{}
+		.ComputeShader({ "SceneSubmission", "CountMain" });
+
+	sceneScanLayout = RenderPipelineLayout{}
+		.ComputeShader({ "SceneSubmission", "ScanMain" });
+
+	sceneScatterLayout = RenderPipelineLayout{}
+		.ComputeShader({ "SceneSubmission", "ScatterMain" });
+
+	meshCullResetLayout = RenderPipelineLayout{}
+		.ComputeShader({ "MeshCulling", "ResetMain" });
+
 	meshCullLayout = RenderPipelineLayout{}
-		.ComputeShader({ "MeshCulling", "Main" });
+		.ComputeShader({ "MeshCulling", "EarlyMain" });
 
-	prepassLayout = RenderPipelineLayout{}
+	meshCullLateLayout = RenderPipelineLayout{}
+		.ComputeShader({ "MeshCulling", "LateMain" })
+		.WaveSpecialized();
+
+	meshCullImpostorResetLayout = RenderPipelineLayout{}
+		.ComputeShader({ "MeshCulling", "ImpostorResetMain" });
+
+	meshletCullLayout = RenderPipelineLayout{}
+		.ComputeShader({ "MeshletCulling", "Main" });
+
+	const auto prepassLayout = RenderPipelineLayout{}
 		.VertexShader({ "Prepass", "VSMain" })
+		.PixelShader({ "Prepass", "PSMain" })
 		.DepthEnabled(true, true);
 
+	// Opaque buckets share one pipeline, keeping early depth testing in the prepass, which the forward pass's equal depth
+	// test then also gets without discarding.
+	for (uint32_t i = 0; i < materialPermutations; ++i)
+	{
+		auto bucketLayout = RenderPipelineLayout{ prepassLayout };
+		if (i & MaterialFeatureBaseColor)
+		{
+			bucketLayout.Macro({ "ALPHA_TEST" });
+		}
+
+		prepassBucketLayouts[i] = bucketLayout;
+		visibilityPrepassBucketLayouts[i] = RenderPipelineLayout{ bucketLayout }
+			.Macro({ "VISIBILITY_BUFFER" });
+		pickingPrepassBucketLayouts[i] = RenderPipelineLayout{ bucketLayout }
+			.Macro({ "PICKING" });
+	}
+
+	visibilityShadingLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Forward", "CSMain" });
+
 	forwardOpaqueLayout = RenderPipelineLayout{}
 		.VertexShader({ "Forward", "VSMain" })
 		.PixelShader({ "Forward", "PSMain" })
 		.DepthEnabled(true, false, DepthTestFunction::Equal);  // Prepass provides depth.
-}
 
-BufferHandle Renderer::CreateLightBuffer(const entt::registry& registry)
-{
-	VGScopedCPUStat("Create Light Buffer");
+	halfPrecisionBrdf = *CvarGet("halfPrecisionBrdf", int) > 0;
+	if (halfPrecisionBrdf)
+	{
+		visibilityShadingLayout.Macro({ "BRDF_HALF_PRECISION" });
+		forwardOpaqueLayout.Macro({ "BRDF_HALF_PRECISION" });
+	}
 
-	const auto lightView = registry.view<const TransformComponent, const LightComponent>();
-	const auto viewSize = lightView.size_hint();
+	// Weighted blended order independent transparency, the weighted colors are summed and the transmittances multiplied.
+	auto forwardTransparentLayout = RenderPipelineLayout{}
+		.VertexShader({ "Forward", "VSMain" })
+		.PixelShader({ "Forward", "TransparentPSMain" })
+		.DepthEnabled(true, false)  // Behind the opaque surfaces only.
+		.BlendMode(true, BlendMode{ .srcBlend = D3D12_BLEND_ONE, .destBlend = D3D12_BLEND_ONE, .srcBlendAlpha = D3D12_BLEND_ONE, .destBlendAlpha = D3D12_BLEND_ONE }, 0)
+		.BlendMode(true, BlendMode{ .srcBlend = D3D12_BLEND_ZERO, .destBlend = D3D12_BLEND_INV_SRC_COLOR, .srcBlendAlpha = D3D12_BLEND_ZERO, .destBlendAlpha = D3D12_BLEND_INV_SRC_ALPHA }, 1);
 
-	BufferDescription lightBufferDescription;
-	lightBufferDescription.updateRate = ResourceFrequency::Dynamic;
-	lightBufferDescription.bindFlags = BindFlag::ShaderResource;
-	lightBufferDescription.accessFlags = AccessFlag::CPUWrite;
-	lightBufferDescription.size = viewSize;
-	lightBufferDescription.stride = sizeof(Light);
+	if (halfPrecisionBrdf)
+	{
+		forwardTransparentLayout.Macro({ "BRDF_HALF_PRECISION" });
+	}
 
-	const auto bufferHandle = device->GetResourceManager().Create(lightBufferDescription, VGText("Light buffer"));
-	device->GetResourceManager().AddFrameResource(device->GetFrameIndex(), bufferHandle);
+	for (uint32_t i = 0; i < materialPermutations; ++i)
+	{
+		forwardOpaqueBucketLayouts[i] = RenderPipelineLayout{ forwardOpaqueLayout }
+			.Macro({ "MATERIAL_FEATURES", i });
+		forwardTransparentBucketLayouts[i] = RenderPipelineLayout{ forwardTransparentLayout }
+			.Macro({ "MATERIAL_FEATURES", i });
+	}
 
-	std::vector<Light> lights{};
-	lights.reserve(viewSize);
+	transparencyCompositeLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Transparency", "CompositeMain" });
 
-	size_t index = 0;
-	lightView.each([&](auto entity, const auto& transform, const auto& light)
-	{
-		const auto direction = XMVector3Rotate(XMVectorSet(1.f, 0.f, 0.f, 0.f), XMQuaternionRotationRollPitchYaw(transform.rotation.x, transform.rotation.y, -transform.rotation.z));
-		XMFLOAT3 directionUnpacked;
-		XMStoreFloat3(&directionUnpacked, direction);
+	// Meshlets aren't drawn by bucket, materials with a base color are alpha tested dynamically.
+	meshPrepassLayout = RenderPipelineLayout{}
+		.AmplificationShader({ "Prepass", "ASMain" })
+		.MeshShader({ "Prepass", "MSMain" })
+		.PixelShader({ "Prepass", "PSMain" })
+		.DepthEnabled(true, true)
+		.Macro({ "ALPHA_TEST" });
 
-		Light instance{
-			.position = transform.translation,
-			.type = static_cast<uint32_t>(light.type),
-			.color = light.color,
-			.luminance = 1.f,  // #TEMP
-			.direction = directionUnpacked
-		};
+	meshPickingPrepassLayout = RenderPipelineLayout{ meshPrepassLayout }
+		.Macro({ "PICKING" });
 
-		lights.emplace_back(instance);
-		++index;
-	});
+	meshForwardOpaqueLayout = RenderPipelineLayout{}
+		.AmplificationShader({ "Forward", "ASMain" })
+		.MeshShader({ "Forward", "MSMain" })
+		.PixelShader({ "Forward", "PSMain" })
+		.DepthEnabled(true, false, DepthTestFunction::Equal);  // Prepass provides depth.
 
-	device->GetResourceManager().Write(bufferHandle, lights);
+	impostorPrepassLayout = RenderPipelineLayout{}
+		.VertexShader({ "Prepass", "ImpostorVSMain" })
+		.PixelShader({ "Prepass", "ImpostorPSMain" })
+		.DepthEnabled(true, true)
+		.CullMode(D3D12_CULL_MODE_NONE)
+		.Macro({ "IMPOSTOR" });
+
+	impostorPickingPrepassLayout = RenderPipelineLayout{ impostorPrepassLayout }
+		.Macro({ "PICKING" });
+
+	// Quads write the depth of their resolved surface, the prepass already resolved the same depth.
+	impostorForwardLayout = RenderPipelineLayout{}
+		.VertexShader({ "Forward", "ImpostorVSMain" })
+		.PixelShader({ "Forward", "ImpostorPSMain" })
+		.DepthEnabled(true, false, DepthTestFunction::GreaterEqual)
+		.CullMode(D3D12_CULL_MODE_NONE)
+		.Macro({ "IMPOSTOR" });
+
+	if (halfPrecisionBrdf)
+	{
+		meshForwardOpaqueLayout.Macro({ "BRDF_HALF_PRECISION" });
+		impostorForwardLayout.Macro({ "BRDF_HALF_PRECISION" });
+	}
 
-	VGAssert(viewSize == index, "Mismatched entity count during buffer creation.");
+	postProcessLayout = RenderPipelineLayout{}
+		.ComputeShader({ "PostProcess", "Main" })
+		.Permutations({ { "ENABLE_TONEMAPPING" } });
 
-	return bufferHandle;
+	pickingLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Picking", "Main" });
 }
 
-Renderer::~Renderer()
+float Renderer::ComputeLightRange(const LightComponent& light, float cutoff)
 {
-	RenderUtils::Get().Destroy();
+	if (light.range > 0.f)
+		return light.range;
 
-	// Sync the device so that resource members in Renderer.h don't get destroyed while in-flight.
-	device->Synchronize();
+	// Distance at which the inverse square falloff of the brightest channel drops below the cutoff.
+	const auto intensity = std::max({ light.color.x, light.color.y, light.color.z, 0.f });
+	return std::sqrt(intensity / cutoff);
 }
 
-void Renderer::Initialize(std::unique_ptr<WindowFrame>&& inWindow, std::unique_ptr<RenderDevice>&& inDevice, entt::registry& registry)
+void Renderer::UpdateLights(const entt::registry& registry)
 {
-	VGScopedCPUStat("Renderer Initialize");
+	VGScopedCPUStat("Update Lights");
 
-	CvarCreate("meshCulling", "Controls compute-based mesh culling, 0=disabled, 1=frustum, 2=frustum+occlusion", 2);
-	CvarCreate("freeze", "Toggles freezing the camera in place, while still allowing for free fly movement. Used for debugging culling", +[]()
-	{
-		Renderer::Get().FreezeCamera();
-	});
-	CvarCreate("reloadShaders", "Deletes all shader pipelines, reloads on-demand from disk", +[]()
+	auto ranges = std::move(pendingLightRanges);
+	pendingLightRanges.clear();
+	ranges.reserve(ranges.size() + lightObserver.size() + reflectionProbes.GetCapturedProbes().size() + localShadows.GetChangedLights().size());
+
+	// New lights take a free slot, existing lights keep theirs. Probes completing their first capture are uploaded again
+	// with their cube.
+	const auto updateSlot = [&](entt::entity entity)
 	{
-		Renderer::Get().ReloadShaderPipelines();
-	});
-	CvarCreate("toneMappingEnabled", "Controls tone mapping as a post process step", 1);
-	
-	constexpr size_t maxVertices = 32 * 1024 * 1024;
+		if (!registry.all_of<TransformComponent, WorldTransformComponent>(entity) || !registry.any_of<LightComponent, ReflectionProbeComponent>(entity))
+			return;
 
-	window = std::move(inWindow);
-	device = std::move(inDevice);
-	meshFactory = std::make_unique<MeshFactory>(device.get(), maxVertices, maxVertices);
-	materialFactory = std::make_unique<MaterialFactory>(device.get(), 1024 * 8);
-	renderGraphResources.SetDevice(device.get());
+		auto iter = lightSlots.find(entity);
+		if (iter == lightSlots.end())
+		{
+			const auto slot = lightAllocator.Allocate(1);
+			if (!slot)
+			{
+				VGLogError(logRendering, "Exceeded the maximum of {} lights.", maxLights);
 
-	device->CheckFeatureSupport();
+				return;
+			}
+
+			if (lightAllocator.Size() > lightEntities.size())
+			{
+				lightEntities.resize(lightAllocator.Size(), entt::null);
+			}
+
+			lightEntities[*slot] = entity;
+			iter = lightSlots.emplace(entity, *slot).first;
+		}
+
+		ranges.emplace_back(iter->second, iter->second + 1);
+	};
+
+	for (const auto entity : lightObserver)
+	{
+		updateSlot(entity);
+	}
+
+	for (const auto entity : reflectionProbes.GetCapturedProbes())
+	{
+		updateSlot(entity);
+	}
+
+	for (const auto entity : localShadows.GetChangedLights())
+	{
+		updateSlot(entity);
+	}
+
+	lightObserver.clear();
+
+	// Derived ranges depend on the cutoff, every light is uploaded again when it changes.
+	const auto rangeCutoff = std::max(*CvarGet("lightRangeCutoff", float), std::numeric_limits<float>::min());
+	if (rangeCutoff != lightRangeCutoff)
+	{
+		lightRangeCutoff = rangeCutoff;
+		ranges.emplace_back(0, static_cast<uint32_t>(lightEntities.size()));
+	}
+
+	if (ranges.empty())
+		return;
+
+	MergeUploadRanges(ranges, maxInstanceUploadRanges);
+
+	for (const auto [first, last] : ranges)
+	{
+		auto* lights = static_cast<Light*>(device->GetResourceManager().ReserveWrite(lightBuffer, (last - first) * sizeof(Light), first * sizeof(Light)));
+		if (!lights)
+		{
+			VGLogError(logRendering, "Failed to update light buffer.");
+
+			return;
+		}
+
+		for (auto index = first; index < last; ++index)
+		{
+			const auto entity = index < lightEntities.size() ? lightEntities[index] : entt::null;
+			if (entity == entt::null)
+			{
+				// Free slots are skipped by light culling.
+				Light freeSlot{};
+				freeSlot.type = freeLightSlot;
+				lights[index - first] = freeSlot;
+
+				continue;
+			}
+
+			const auto& transform = registry.get<TransformComponent>(entity);
+			const auto& world = registry.get<WorldTransformComponent>(entity);
+
+			// Probes are binned with the lights, shading blends their cubes instead of lighting with them.
+			if (!registry.all_of<LightComponent>(entity))
+			{
+				const auto probeIndex = reflectionProbes.GetProbeIndex(entity);
+
+				Light probe{};
+				probe.position = world.translation;
+				probe.type = probeIndex ? probeLightType : freeLightSlot;  // Skipped until the first capture completes.
+				probe.areaExtents = { registry.get<ReflectionProbeComponent>(entity).radius, 0.f };
+				probe.probeIndex = probeIndex.value_or(0);
+				lights[index - first] = probe;
+
+				continue;
+			}
+
+			const auto& light = registry.get<LightComponent>(entity);
+
+			// Lights keep their own rotation convention, children are turned along with their parent.
+			auto rotation = XMQuaternionRotationRollPitchYaw(transform.rotation.x, transform.rotation.y, -transform.rotation.z);
+			if (const auto* relationship = registry.try_get<RelationshipComponent>(entity); relationship && relationship->parent != entt::null)
+			{
+				if (const auto* parent = registry.try_get<WorldTransformComponent>(relationship->parent))
+				{
+					rotation = XMQuaternionMultiply(rotation, XMLoadFloat4(&parent->rotation));
+				}
+			}
+
+			const auto direction = XMVector3Rotate(XMVectorSet(1.f, 0.f, 0.f, 0.f), rotation);
+			const auto tangent = XMVector3Rotate(XMVectorSet(0.f, 0.f, 1.f, 0.f), rotation);
+			XMFLOAT3 directionUnpacked;
+			XMStoreFloat3(&directionUnpacked, direction);
+			XMFLOAT3 tangentUnpacked;
+			XMStoreFloat3(&tangentUnpacked, tangent);
+
+			auto& uploaded = lights[index - first];
+			uploaded = Light{
+				.position = world.translation,
+				.type = static_cast<uint32_t>(light.type),
+				.color = light.color,
+				.luminance = 1.f,  // #TEMP
+				.direction = directionUnpacked,
+				.spotCosOuter = std::cos(light.outerConeAngle),
+				.tangent = tangentUnpacked,
+				.spotCosInner = std::cos(std::min(light.innerConeAngle, light.outerConeAngle)),
+				.areaExtents = { light.areaSize.x * 0.5f, light.areaSize.y * 0.5f },
+				.radius = ComputeLightRange(light, rangeCutoff)
+			};
+
+			// Shadows are cached against the uploaded light, and are only found by the lights once they're ready.
+			localShadows.UpdateLight(entity, uploaded);
+			uploaded.probeIndex = localShadows.GetShadowIndex(entity);
+		}
+	}
+}
+
+void Renderer::OnLightDestroyed(entt::registry& registry, entt::entity entity)
+{
+	const auto iter = lightSlots.find(entity);
+	if (iter == lightSlots.end())
+		return;
+
+	// Freed slots are uploaded as free lights, unless the allocator shrinks past them.
+	const auto slot = iter->second;
+	lightEntities[slot] = entt::null;
+	lightAllocator.Free(slot, 1);
+	if (slot < lightAllocator.Size())
+	{
+		pendingLightRanges.emplace_back(slot, slot + 1);
+	}
+
+	lightSlots.erase(iter);
+	localShadows.RemoveLight(entity);
+}
+
+Renderer::~Renderer()
+{
+	RenderUtils::Get().Destroy();
+
+	// Sync the device so that resource members in Renderer.h don't get destroyed while in-flight.
+	device->Synchronize();
+}
+
+void Renderer::Initialize(std::unique_ptr<WindowFrame>&& inWindow, std::unique_ptr<RenderDevice>&& inDevice, entt::registry& registry)
+{
+	VGScopedCPUStat("Renderer Initialize");
+
+	CvarCreate("meshCulling", "Controls compute-based mesh culling, 0=disabled, 1=frustum, 2=frustum+occlusion", 2);
+	CvarCreate("sceneDepthFormat", "Format of the scene's depth buffer, 0=24 bit unorm, 1=32 bit float, which with inverse Z is precise at any distance", 0);
+	CvarCreate("infiniteFarPlane", "Projects the camera with the far plane at infinity, geometry is no longer clipped by distance, 0=disabled, 1=enabled", 0);
+	CvarCreate("visibilityBuffer", "Shades opaque geometry in compute from the triangle IDs written by the prepass instead of rasterizing a forward pass, replaces mesh shading, 0=disabled, 1=enabled", 0);
+	CvarCreate("meshletCulling", "Controls per-meshlet culling of the forward and cluster passes, 0=disabled, 1=frustum+backface, 2=frustum+backface+occlusion", 2);
+	CvarCreate("vertexQuantization", "Controls compression of the vertex attributes of newly created meshes, 0=full precision, 1=quantized", 1);
+	CvarCreate("meshOptimization", "Controls reordering the indices and vertices of newly loaded meshes for vertex cache, overdraw and vertex fetch efficiency, 0=disabled, 1=enabled", 1);
+	CvarCreate("meshShaders", "Draws the prepass and forward pass with mesh shaders when supported by the device, culling meshlets in the amplification shader, 0=disabled, 1=enabled", 1);
+	CvarCreate("evictionIdleFrames", "Frames an evictable resource goes unused before it's evicted under memory pressure, it's paged back in when next used", 240);
+	CvarCreate("compactSceneColor", "Stores the HDR scene color as R11G11B10 float instead of R16G16B16A16 float when the device supports it, halving "
+		"its bandwidth from shading through the temporal resolve. Nothing reads its alpha, 0=disabled, 1=enabled", 1);
+	CvarCreate("halfPrecisionBrdf", "Evaluates the direct lighting BRDF of the forward and visibility buffer shading in minimum precision, 0=disabled, 1=enabled", 0);
+	CvarCreate("lightRangeCutoff", "Intensity below which point, spot and area lights without an authored range stop lighting, lower cutoffs bin each light into more froxels", 0.0001f);
+	CvarCreate("meshLodThreshold", "Projected simplification error in pixels up to which coarser mesh levels of detail are drawn, meshlet and visibility buffer draws always use full detail, 0=full detail", 1.f);
+	CvarCreate("freeze", "Toggles freezing the camera in place, while still allowing for free fly movement. Used for debugging culling", +[]()
+	{
+		Renderer::Get().FreezeCamera();
+	});
+	CvarCreate("reloadShaders", "Deletes all shader pipelines, reloads on-demand from disk", +[]()
+	{
+		Renderer::Get().ReloadShaderPipelines();
+	});
+	CvarCreate("toneMappingEnabled", "Controls tone mapping as a post process step", 1);
+	CvarCreate("memoryBudgetScaling", "Reduces transient lifetimes, streamed texture detail and cloud render scale when video memory usage nears the adapter's budget, 0=disabled, 1=enabled", 1);
+	CvarCreate("parallelRecording", "Controls parallel recording of render graph passes, 0=disabled, 1=enabled", 1);
+	CvarCreate("asyncCompute", "Controls execution of compute passes on the async compute queue, 0=disabled, 1=enabled", 1);
+	CvarCreate("splitBarriers", "Controls splitting render graph transitions between passes on the same queue, 0=disabled, 1=enabled", 1);
+	CvarCreate("framesInFlight", "Frames the CPU may record ahead of the GPU, 1 to 3. Fewer frames reduce input latency at the cost of throughput", 3);
+	CvarCreate("resizeDebounce", "Milliseconds the window size has to stay unchanged before the swap chain is resized", 100);
+	CvarCreate("frameRateLimit", "Caps the frame rate when vsync is off, saving power while uncapped. 0=uncapped", 0);
+	CvarCreate("backgroundFrameRate", "Caps the frame rate while the window is unfocused, with or without vsync. 0=uncapped", 15);
+	CvarCreate("gpuPipelineStatistics", "Queries the pipeline statistics of each render graph pass and reads back the culling counters, 0=disabled, 1=enabled", 0);
+	CvarCreate("gpuPassTiming", "Measures the GPU time of each render graph pass with timestamp queries, available without profiling builds, 0=disabled, 1=enabled", 1);
+	CvarCreate("temporalAA", "Jitters the projection each frame and accumulates the samples with a temporal resolve, 0=disabled, 1=enabled", 1);
+	CvarCreate("dynamicResolution", "Scales the resolution of the cloud passes to keep the GPU frame time at the target, 0=disabled, 1=enabled", 0);
+	CvarCreate("dynamicResolutionTarget", "GPU frame time targeted by dynamic resolution, in milliseconds", 16.6f);
+	CvarCreate("dynamicResolutionMinScale", "Lowest scale dynamic resolution can reduce to", 0.5f);
+	
+	constexpr size_t maxVertices = 32 * 1024 * 1024;
+
+	window = std::move(inWindow);
+	device = std::move(inDevice);
+	meshFactory = std::make_unique<MeshFactory>(device.get(), maxVertices, maxVertices);
+	materialFactory = std::make_unique<MaterialFactory>(device.get(), 1024 * 8);
+	renderGraphResources.SetDevice(device.get());
+	shaderWatcher.Watch(Config::shadersPath);
+
+	device->CheckFeatureSupport();
+
+	// Resources are only created on the main thread, but the file loads and standalone pipelines of the subsystems don't
+	// touch the resource manager. Those run as startup jobs from here on, overlapping the rest of the initialization, and
+	// their subsystems create the resources once they're done.
+	JobCounter startupJobs;
+	RenderUtils::Get().Initialize(device.get(), startupJobs);
+	clouds.Initialize(device.get(), startupJobs);
 
 	BufferDescription instanceBufferDesc{};
-	instanceBufferDesc.updateRate = ResourceFrequency::Dynamic;
+	instanceBufferDesc.updateRate = ResourceFrequency::Static;  // Partially rewritten while previous frames are in flight.
 	instanceBufferDesc.bindFlags = BindFlag::ShaderResource;
 	instanceBufferDesc.accessFlags = AccessFlag::CPUWrite;
-	instanceBufferDesc.size = 1024 * 1024 * 8;
+	instanceBufferDesc.size = initialInstances;  // Grows with the allocated slots.
 	instanceBufferDesc.stride = sizeof(ObjectData);
 
 	instanceBuffer = device->GetResourceManager().Create(instanceBufferDesc, VGText("Instance buffer"));
 
+	BufferDescription transformBufferDesc{};
+	transformBufferDesc.updateRate = ResourceFrequency::Static;  // Partially rewritten while previous frames are in flight.
+	transformBufferDesc.bindFlags = BindFlag::ShaderResource;
+	transformBufferDesc.accessFlags = AccessFlag::CPUWrite;
+	transformBufferDesc.size = initialInstances;
+	transformBufferDesc.stride = sizeof(TransformData);
+
+	transformBuffer = device->GetResourceManager().Create(transformBufferDesc, VGText("Transform buffer"));
+
+	// Owns the transform and mesh pools, which keeps every renderable packed at their front in the same order. Nothing else
+	// may own or sort either pool.
+	registry.group<WorldTransformComponent, MeshComponent>();
+
+	instanceObserver.connect(registry, entt::collector.group<WorldTransformComponent, MeshComponent>().update<MeshComponent>());
+	transformObserver.connect(registry, entt::collector.update<WorldTransformComponent>().where<MeshComponent>());
+	registry.on_destroy<MeshComponent>().connect<&Renderer::OnMeshDestroyed>(*this);
+
+	BufferDescription lightBufferDesc{};
+	lightBufferDesc.updateRate = ResourceFrequency::Static;  // Partially rewritten while previous frames are in flight.
+	lightBufferDesc.bindFlags = BindFlag::ShaderResource;
+	lightBufferDesc.accessFlags = AccessFlag::CPUWrite;
+	lightBufferDesc.size = maxLights;
+	lightBufferDesc.stride = sizeof(Light);
+
+	lightBuffer = device->GetResourceManager().Create(lightBufferDesc, VGText("Light buffer"));
+
+	lightObserver.connect(registry, entt::collector
+		.group<WorldTransformComponent, LightComponent>().update<LightComponent>()
+		.update<WorldTransformComponent>().where<LightComponent>()
+		.group<WorldTransformComponent, ReflectionProbeComponent>().update<ReflectionProbeComponent>()
+		.update<WorldTransformComponent>().where<ReflectionProbeComponent>());
+	registry.on_destroy<LightComponent>().connect<&Renderer::OnLightDestroyed>(*this);
+	registry.on_destroy<ReflectionProbeComponent>().connect<&Renderer::OnLightDestroyed>(*this);
+
 	BufferDescription cameraBufferDesc{};
 	cameraBufferDesc.updateRate = ResourceFrequency::Static;
 	cameraBufferDesc.bindFlags = BindFlag::ShaderResource;
 	cameraBufferDesc.accessFlags = AccessFlag::CPUWrite;
-	cameraBufferDesc.size = 3;  // #TODO: Better camera management.
+	cameraBufferDesc.size = LocalShadows::firstCameraIndex + LocalShadows::cameraCount;  // #TODO: Better camera management.
 	cameraBufferDesc.stride = sizeof(Camera);
 
 	cameraBuffer = device->GetResourceManager().Create(cameraBufferDesc, VGText("Camera buffer"));
 
+	BufferDescription cullingViewBufferDesc = cameraBufferDesc;
+	cullingViewBufferDesc.stride = sizeof(CullingView);
+
+	cullingViewBuffer = device->GetResourceManager().Create(cullingViewBufferDesc, VGText("Culling view buffer"));
+
 	userInterface = std::make_unique<UserInterfaceManager>(device.get());
 
-	CreateRootSignature();
 	CreatePipelines();
 
-	RenderUtils::Get().Initialize(device.get());
-
 	atmosphere.Initialize(device.get(), registry);
 	clusteredCulling.Initialize(device.get());
 	ibl.Initialize(device.get());
 	bloom.Initialize(device.get());
 	occlusionCulling.Initialize(device.get());
-	clouds.Initialize(device.get());
+	temporalAA.Initialize(device.get());
+	shadows.Initialize(device.get());
+	virtualShadows.Initialize(device.get());
+	localShadows.Initialize(device.get());
+	variableRateShading.Initialize(device.get());
+	rayTracingScene.Initialize(device.get(), meshFactory.get());
+	skinning.Initialize(device.get(), meshFactory.get());
+	impostors.Initialize(device.get(), meshFactory.get());
+	volumetricFog.Initialize(device.get());
+	screenSpaceLighting.Initialize(device.get());
+	reflectionProbes.Initialize(device.get(), registry);
+	textureStreamer.Initialize(device.get(), materialFactory.get());
+
+	JobSystem::Get().Wait(startupJobs);
+	RenderUtils::Get().FinishInitialize();
+	clouds.FinishInitialize();
+
+	// Every quality cvar exists by now, and the subsystems pick up changed values on their next frame.
+	ApplyQualityPreset(SelectQualityPreset(*device));
+	qualityGovernor.Initialize();
 
 	std::vector<D3D12_INDIRECT_ARGUMENT_DESC> meshIndirectArgDescs;
 	meshIndirectArgDescs.emplace_back(D3D12_INDIRECT_ARGUMENT_DESC{
-		.Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT,
-		.Constant = {
-			.RootParameterIndex = 0,
-			.DestOffsetIn32BitValues = 0,
-			.Num32BitValuesToSet = 1
-		}
+		.Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW
 	});
 	meshIndirectArgDescs.emplace_back(D3D12_INDIRECT_ARGUMENT_DESC{
 		.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED
@@ -352,256 +1226,1259 @@ void Renderer::Initialize(std::unique_ptr<WindowFrame>&& inWindow, std::unique_p
 		.NodeMask = 0
 	};
 
-	const auto result = device->Native()->CreateCommandSignature(&meshIndirectSignatureDesc, rootSignature.Get(), IID_PPV_ARGS(meshIndirectCommandSignature.Indirect()));
+	const auto result = device->Native()->CreateCommandSignature(&meshIndirectSignatureDesc, nullptr, IID_PPV_ARGS(meshIndirectCommandSignature.Indirect()));
 	if (FAILED(result))
 	{
 		VGLogError(logRendering, "Failed to create forward indirect command signature: {}", result);
 	}
 
+	batchRecordBuffer = device->GetResourceManager().Create(BufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.bindFlags = BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::CPUWrite,
+		.size = initialBatches,
+		.stride = sizeof(MeshBatchRecord)
+	}, VGText("Mesh batch record buffer"));
+
+	materialBucketBuffer = device->GetResourceManager().Create(BufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.bindFlags = BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::CPUWrite,
+		.size = materialPermutations,
+		.stride = sizeof(MaterialBucket)
+	}, VGText("Material bucket buffer"));
+	device->GetResourceManager().Write(materialBucketBuffer, materialBuckets);
+
+	// Generated by the scene submission pass.
 	meshIndirectRenderArgs = device->GetResourceManager().Create(BufferDescription{
 		.updateRate = ResourceFrequency::Static,
 		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
-		.accessFlags = AccessFlag::CPUWrite,
-		.size = 1024 * 1024 * 8,
-		.stride = sizeof(MeshIndirectArgument),
-		.uavCounter = true
+		.size = initialBatches,
+		.stride = sizeof(MeshIndirectArgument)
 	}, VGText("Mesh indirect render argument buffer"));
+
+	meshInstanceBuffer = device->GetResourceManager().Create(BufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
+		.size = initialInstances,
+		.stride = sizeof(MeshInstance)
+	}, VGText("Mesh instance buffer"));
+
+	// One bit per mesh instance.
+	const std::vector<uint32_t> visibilityWords(maxInstances / 32, 0);
+	for (auto& visibilityBuffer : visibilityBuffers)
+	{
+		visibilityBuffer = device->GetResourceManager().Create(BufferDescription{
+			.updateRate = ResourceFrequency::Static,
+			.bindFlags = BindFlag::ShaderResource | BindFlag::UnorderedAccess,
+			.accessFlags = AccessFlag::CPUWrite,
+			.size = visibilityWords.size(),
+			.stride = sizeof(uint32_t)
+		}, VGText("Mesh visibility buffer"));
+		device->GetResourceManager().Write(visibilityBuffer, visibilityWords);
+	}
+}
+
+void Renderer::UpdateMemoryPressure()
+{
+	VGScopedCPUStat("Update Memory Pressure");
+
+	const auto& budget = device->GetMemoryBudget();
+
+	auto pressure = MemoryPressure::None;
+	if (*CvarGet("memoryBudgetScaling", int) && budget.budget > 0)
+	{
+		const auto usage = static_cast<double>(budget.usage) / budget.budget;
+		if (usage > 0.95)
+		{
+			pressure = MemoryPressure::Critical;
+		}
+
+		else if (usage > 0.85)
+		{
+			pressure = MemoryPressure::High;
+		}
+
+		// Only relieve pressure well below the thresholds, otherwise freeing memory would immediately restore quality and
+		// oscillate around the budget.
+		if (usage > 0.75)
+		{
+			pressure = std::max(pressure, memoryPressure);
+		}
+	}
+
+	if (pressure == memoryPressure)
+	{
+		return;
+	}
+
+	VGLog(logRendering, "Memory pressure changed from {} to {}, using {} of {} MB.", static_cast<int>(memoryPressure), static_cast<int>(pressure),
+		budget.usage / (1024 * 1024), budget.budget / (1024 * 1024));
+
+	// Cheapest response first, unused transients are released sooner instead of waiting to be reused.
+	renderGraphResources.transientExpiration = pressure == MemoryPressure::None ? RenderGraphResourceManager::defaultTransientExpiration : 1;
+
+	// Then drop the top mips of the less noticeable texture channels, then of every streamed texture, and lower the cloud
+	// resolution which shrinks its transients.
+	textureStreamer.channelBias = pressure != MemoryPressure::None;
+	textureStreamer.mipBias = pressure == MemoryPressure::Critical ? 2 : 0;
+
+	if (pressure == MemoryPressure::Critical)
+	{
+		restoredCloudRenderScale = *CvarGet("cloudRenderScale", float);
+		CvarSet("cloudRenderScale", std::max(restoredCloudRenderScale * 0.5f, 0.1f));
+	}
+
+	else if (memoryPressure == MemoryPressure::Critical)
+	{
+		CvarSet("cloudRenderScale", restoredCloudRenderScale);
+	}
+
+	memoryPressure = pressure;
+}
+
+void Renderer::UpdateRenderScale()
+{
+	if (!*CvarGet("dynamicResolution", int))
+	{
+		renderScale = 1.f;
+	}
+
+	else if (renderScaleCooldown > 0)
+	{
+		--renderScaleCooldown;
+	}
+
+	else if (const auto gpuTime = device->GetGPUFrameTime(); gpuTime > 0.f)
+	{
+		// Quantized, so that the transient pool only ever sees a handful of sizes.
+		constexpr float step = 1.f / 16.f;
+
+		const auto target = *CvarGet("dynamicResolutionTarget", float);
+		const auto minScale = std::clamp(*CvarGet("dynamicResolutionMinScale", float), step, 1.f);
+
+		auto scale = renderScale;
+		if (gpuTime > target)
+		{
+			scale -= step;
+		}
+
+		// Only scale back up with some headroom, otherwise the scale would oscillate around the target.
+		else if (gpuTime < target * 0.85f)
+		{
+			scale += step;
+		}
+
+		scale = std::clamp(std::round(scale / step) * step, minScale, 1.f);
+		if (scale != renderScale)
+		{
+			renderScale = scale;
+
+			// Wait for frames rendered at the new scale to retire before measuring again.
+			renderScaleCooldown = RenderDevice::frameCount;
+		}
+	}
+
+	clouds.dynamicScale = renderScale;
 }
 
 void Renderer::Render(entt::registry& registry)
 {
 	VGScopedCPUStat("Render");
+	ScopedMemoryTag memoryTag{ MemoryTag::Rendering };
+
+	// Check if shaders need to be reloaded here since we might be requested at anytime during the frame.
+	if (shouldReloadShaders)
+	{
+		device->Synchronize();
+		renderGraphResources.DiscardPipelines();
+		shouldReloadShaders = false;
+	}
+
+	// Resized at the start of a frame, where the only work referencing the back buffers is from previous frames.
+	if (pendingResolution && std::chrono::steady_clock::now() - pendingResolution->requestTime >= std::chrono::milliseconds{ *CvarGet("resizeDebounce", int) })
+	{
+		const auto resolution = *std::exchange(pendingResolution, std::nullopt);
+		device->SetResolution(resolution.width, resolution.height, resolution.fullscreen);
+
+		// Transients are pooled by their resolved size, so the old sizes simply expire, and histories restart on their own.
+		clusteredCulling.MarkDirty();
+	}
+
+	if (shaderWatcher.Poll())
+	{
+		renderGraphResources.ReloadChangedPipelines();
+	}
+
+	renderGraphResources.UpdatePipelines();
+
+	if ((*CvarGet("halfPrecisionBrdf", int) > 0) != halfPrecisionBrdf)
+	{
+		// Only the precision differs, so shading keeps drawing with the previous pipelines while the new ones compile.
+		const auto previousVisibilityShadingLayout = visibilityShadingLayout;
+		const auto previousForwardOpaqueBucketLayouts = forwardOpaqueBucketLayouts;
+		const auto previousForwardTransparentBucketLayouts = forwardTransparentBucketLayouts;
+		const auto previousMeshForwardOpaqueLayout = meshForwardOpaqueLayout;
+		const auto previousImpostorForwardLayout = impostorForwardLayout;
+
+		CreatePipelines();
+
+		visibilityShadingLayout.Fallback(previousVisibilityShadingLayout);
+		for (uint32_t i = 0; i < materialPermutations; ++i)
+		{
+			forwardOpaqueBucketLayouts[i].Fallback(previousForwardOpaqueBucketLayouts[i]);
+			forwardTransparentBucketLayouts[i].Fallback(previousForwardTransparentBucketLayouts[i]);
+		}
+		meshForwardOpaqueLayout.Fallback(previousMeshForwardOpaqueLayout);
+		impostorForwardLayout.Fallback(previousImpostorForwardLayout);
+	}
+
+	// Replayed frames must do the same work, the responses would change it based on the replay itself.
+	if (!replaying)
+	{
+		UpdateMemoryPressure();
+		UpdateRenderScale();
+		qualityGovernor.Update(*device);
+
+		// Idle resources are paged out on our terms, instead of the driver paging under oversubscription.
+		if (memoryPressure != MemoryPressure::None)
+		{
+			device->GetResourceManager().EvictIdle(static_cast<size_t>(std::max(*CvarGet("evictionIdleFrames", int), 0)));
+		}
+	}
+
+	device->SetFramesInFlight(static_cast<uint32_t>(*CvarGet("framesInFlight", int)));
+	device->frameRateLimit = static_cast<uint32_t>(std::max(*CvarGet("frameRateLimit", int), 0));
+	device->backgroundFrameRateLimit = static_cast<uint32_t>(std::max(*CvarGet("backgroundFrameRate", int), 0));
+	device->background = !window->IsFocused();
+	device->GetProfiler().enabled = *CvarGet("gpuPassTiming", int) > 0;
+	device->GetProfiler().pipelineStatistics = *CvarGet("gpuPipelineStatistics", int) > 0;
+
+	if (!replaying)
+	{
+		textureStreamer.Update(registry);
+	}
+
+	// After the material loads and residency changes of this frame, which patch the material table.
+	materialFactory->Flush();
+
+	if (!replaying)
+	{
+		meshFactory->Update(registry);
+	}
+
+	// Defragmenting moves the meshes into a new index buffer, so rebase the index views of the live batch records. Moved
+	// meshes have their records rebuilt below.
+	const auto indexBufferAddress = device->GetResourceManager().Get(meshFactory->indexBuffer).Native()->GetGPUVirtualAddress();
+	if (indexBufferAddress != batchIndexBufferAddress)
+	{
+		for (auto& record : batchRecords)
+		{
+			if (record.references > 0)
+			{
+				record.argument.indexView.BufferLocation = indexBufferAddress + std::get<0>(record.key) + record.lodIndexOffset;
+			}
+		}
+
+		batchIndexBufferAddress = indexBufferAddress;
+		batchesInvalidated = true;
+	}
+
+	// Mesh entities added, changed or removed only patch their own instance and batch records, so the CPU cost scales with
+	// the changes instead of the scene size. Destroyed entities are released as they're destroyed.
+	for (const auto entity : instanceObserver)
+	{
+		RemoveInstances(entity);
+		if (registry.all_of<WorldTransformComponent, MeshComponent>(entity))
+		{
+			AddInstances(registry, entity);
+		}
+	}
+
+	instanceObserver.clear();
+
+	// Before anything writes to the new slots.
+	GrowSceneBuffers();
+
+	// Skinned entities deform every frame without moving, the shadows cached over them render again as if they moved.
+	skinning.ForEachEntity([&](entt::entity entity)
+	{
+		if (const auto bounds = sceneBvh.GetBounds(entity))
+		{
+			localShadows.InvalidateBounds(*bounds);
+			movedEntities.emplace_back(entity);
+		}
+	});
+
+	if (!pendingInstanceRanges.empty() || !transformObserver.empty() || !movedEntities.empty())
+	{
+		shadows.Invalidate();  // Cached cascades hold the old geometry.
+		if (!pendingInstanceRanges.empty())
+		{
+			virtualShadows.Invalidate();  // Freed slots no longer describe what they drew, moved instances are handled by range.
+			localShadows.Invalidate();  // Moved instances are handled by their bounds.
+		}
+
+		UpdateDirtyObjects(registry);
+		transformObserver.clear();
+	}
+
+	// Materials finishing their load can change permutation, moving their batches to another bucket.
+	if (batchesInvalidated || materialRevision != materialFactory->GetRevision())
+	{
+		UpdateBatchLayout();
+	}
+
+	// The draw arguments and batched instance lists are regenerated on the GPU from the records after any change.
+	const bool regenerateDraws = instancesInvalidated;
+	instancesInvalidated = false;
+
+	reflectionProbes.Update(registry);
+
+	UpdateCameraBuffer(registry);
+
+	UpdateLights(registry);
+
+	RenderGraph graph{ &renderGraphResources };
+	const auto [sceneWidth, sceneHeight] = GetSceneResolution();
+	graph.SetOutputResolution(sceneWidth, sceneHeight);
+
+	MeshResources meshResources;
+	meshResources.positionTag = graph.Import(meshFactory->vertexPositionBuffer);
+	meshResources.extraTag = graph.Import(meshFactory->vertexExtraBuffer);
+
+	skinning.Render(graph, registry, meshResources);
+
+	RenderResource materialBufferTag = graph.Import(materialFactory->materialBuffer);
+
+	auto backBufferTag = graph.Import(device->GetBackBuffer());
+	auto cameraBufferTag = graph.Import(cameraBuffer);
+	graph.SetFrameCameras(cameraBuffer);
+	auto cullingViewBufferTag = graph.Import(cullingViewBuffer);
+	auto instanceBufferTag = graph.Import(instanceBuffer);
+	auto transformBufferTag = graph.Import(transformBuffer);
+	auto lightBufferTag = graph.Import(lightBuffer);
+	auto meshIndirectRenderArgsTag = graph.Import(meshIndirectRenderArgs);
+	auto meshInstanceBufferTag = graph.Import(meshInstanceBuffer);
+	auto meshletBufferTag = graph.Import(meshFactory->meshletBuffer);
+	auto meshletVertexBufferTag = graph.Import(meshFactory->meshletVertexBuffer);
+	auto meshletTriangleBufferTag = graph.Import(meshFactory->meshletTriangleBuffer);
+
+	graph.Tag(backBufferTag, ResourceTag::BackBuffer);
+
+	if (regenerateDraws)
+	{
+		auto batchRecordBufferTag = graph.Import(batchRecordBuffer);
+
+		// The draw arguments persist across frames, recording on the graphics queue keeps the rewrite ordered after the
+		// previous frames' draws.
+		auto& scenePass = graph.AddPass("Scene Submission Pass", ExecutionQueue::Graphics);
+		auto batchInstanceCountTag = scenePass.Create(TransientBufferDescription{
+			.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+			.size = std::max(batchAllocator.Size(), 1u),
+			.stride = sizeof(uint32_t)
+		}, VGText("Batch instance count buffer"));
+		auto instanceBatchSlotTag = scenePass.Create(TransientBufferDescription{
+			.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+			.size = std::max(instanceAllocator.Size(), 1u),
+			.stride = sizeof(uint32_t)
+		}, VGText("Instance batch slot buffer"));
+		scenePass.Read(instanceBufferTag, ResourceBind::SRV);
+		scenePass.Read(batchRecordBufferTag, ResourceBind::SRV);
+		scenePass.Write(batchInstanceCountTag, ResourceBind::UAV);
+		scenePass.Write(instanceBatchSlotTag, ResourceBind::UAV);
+		scenePass.Write(meshIndirectRenderArgsTag, ResourceBind::UAV);
+		scenePass.Write(meshInstanceBufferTag, ResourceBind::UAV);
+		scenePass.Bind([&, batchRecordBufferTag, batchInstanceCountTag, instanceBatchSlotTag](CommandList& list, RenderPassResources& resources)
+		{
+			struct {
+				uint32_t objectBuffer;
+				uint32_t batchRecordBuffer;
+				uint32_t batchInstanceCountBuffer;
+				uint32_t instanceBatchSlotBuffer;
+				uint32_t argumentBuffer;
+				uint32_t instanceBuffer;
+				uint32_t recordCount;
+				uint32_t slotCount;
+			} bindData;
+
+			bindData.objectBuffer = resources.Get(instanceBufferTag);
+			bindData.batchRecordBuffer = resources.Get(batchRecordBufferTag);
+			bindData.batchInstanceCountBuffer = resources.Get(batchInstanceCountTag);
+			bindData.instanceBatchSlotBuffer = resources.Get(instanceBatchSlotTag);
+			bindData.argumentBuffer = resources.Get(meshIndirectRenderArgsTag);
+			bindData.instanceBuffer = resources.Get(meshInstanceBufferTag);
+			bindData.recordCount = batchAllocator.Size();
+			bindData.slotCount = instanceAllocator.Size();
+
+			constexpr auto groupSize = 64;
+
+			const auto barriers = [&]()
+			{
+				list.UAVBarrier(resources.GetBuffer(batchInstanceCountTag));
+				list.UAVBarrier(resources.GetBuffer(instanceBatchSlotTag));
+				list.UAVBarrier(resources.GetBuffer(meshIndirectRenderArgsTag));
+				list.FlushBarriers();
+			};
+
+			// Count the instances of each batch, then lay the batches out with a prefix sum, and scatter the instances into
+			// their batch's range.
+			list.BindPipeline(sceneClearLayout);
+			list.BindConstants("bindData", bindData);
+			list.Dispatch(std::ceil((float)bindData.recordCount / groupSize), 1, 1);
+			barriers();
+
+			list.BindPipeline(sceneCountLayout);
+			list.BindConstants("bindData", bindData);
+			list.Dispatch(std::ceil((float)bindData.slotCount / groupSize), 1, 1);
+			barriers();
+
+			list.BindPipeline(sceneScanLayout);
+			list.BindConstants("bindData", bindData);
+			list.Dispatch(1, 1, 1);
+			barriers();
+
+			list.BindPipeline(sceneScatterLayout);
+			list.BindConstants("bindData", bindData);
+			list.Dispatch(std::ceil((float)bindData.slotCount / groupSize), 1, 1);
+		});
+	}
+
+	// Mesh shaders replace the indirect vertex shader draws of the prepass and forward pass, and test each meshlet in the
+	// amplification shader. Falls back to the vertex shader path on devices without support.
+	// The visibility buffer writes triangle IDs from the indirect prepass, shading them in compute instead of the forward pass.
+	const bool visibilityBuffering = *CvarGet("visibilityBuffer", int) > 0;
+	const bool meshShading = device->SupportsMeshShaders() && *CvarGet("meshShaders", int) > 0 && !visibilityBuffering;
+	const auto hiZMipLevels = static_cast<uint32_t>(*CvarGet("hiZPyramidLevels", int));
+	const auto meshCullingLevel = *CvarGet("meshCulling", int);
+	const auto meshletCullingLevel = *CvarGet("meshletCulling", int);
+	const uint32_t meshletCullFlags = meshCullingLevel > 0 || meshletCullingLevel > 0 ? MeshletDrawCull : 0;
+	// Meshlets and triangle IDs address the full detail indices, so levels of detail are limited to the batched draws, which
+	// the prepass and forward pass must agree on.
+	const auto meshLodThreshold = *CvarGet("meshLodThreshold", float);
+	const bool meshLods = meshLodThreshold > 0.f && !meshShading && meshletCullingLevel == 0 && !visibilityBuffering;
+	const auto visibleInstanceCapacity = std::bit_ceil(std::max<size_t>(renderableCount, 1)) * maxMeshLods;
+	const auto argumentCapacity = std::bit_ceil(std::max<size_t>(batchCount, 1));
+	// Picking reads the visibility buffer when available, otherwise the prepass writes object IDs for the frame.
+	const auto pick = std::exchange(pendingPick, std::nullopt);
+	const bool pickingPrepass = pick && !visibilityBuffering;
+	const auto& prepassPipelines = visibilityBuffering ? visibilityPrepassBucketLayouts : (pickingPrepass ? pickingPrepassBucketLayouts : prepassBucketLayouts);
+	const auto& meshPrepassPipeline = pickingPrepass ? meshPickingPrepassLayout : meshPrepassLayout;
+	// Impostors replace distant instances in the batched draws of the main view, which the prepass and forward pass both draw
+	// from the same lists as the meshes.
+	const auto impostorScreenSize = *CvarGet("impostorScreenSize", float);
+	std::optional<ImpostorResources> impostorResources;
+	if (!meshShading && meshletCullingLevel == 0 && !visibilityBuffering)
+	{
+		impostorResources = impostors.Render(graph, ImpostorInputs{
+			.objectBuffer = instanceBufferTag,
+			.vertexPositions = meshResources.positionTag,
+			.vertexExtras = meshResources.extraTag,
+			.materialBuffer = materialBufferTag
+		});
+	}
+
+	std::vector<MeshDrawList> impostorDrawLists;  // Of the early and late phase, a single quad instanced per impostor.
+	const auto createImpostorDrawList = [&](RenderPass& pass)
+	{
+		auto& drawList = impostorDrawLists.emplace_back(MeshDrawList{
+			.indirectArgs = pass.Create(TransientBufferDescription{
+				.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+				.size = 1,
+				.stride = sizeof(D3D12_DRAW_ARGUMENTS)
+			}, VGText("Impostor indirect render argument buffer")),
+			.visibleInstances = pass.Create(TransientBufferDescription{
+				.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+				.size = std::max<size_t>(renderableCount, 1),
+				.stride = sizeof(uint32_t)
+			}, VGText("Impostor visible instance buffer"))
+		});
+		pass.Read(impostorResources->impostorBuffer, ResourceBind::SRV);
+		pass.Write(drawList.indirectArgs, ResourceBind::UAV);
+		pass.Write(drawList.visibleInstances, ResourceBind::UAV);
+	};
+
+	const auto readImpostorResources = [&](RenderPass& pass, size_t drawLists)
+	{
+		pass.Read(impostorResources->impostorBuffer, ResourceBind::SRV);
+		pass.Read(impostorResources->albedoAtlas, ResourceBind::SRV);
+		pass.Read(impostorResources->normalAtlas, ResourceBind::SRV);
+		pass.Read(impostorResources->depthAtlas, ResourceBind::SRV);
+		for (size_t i = 0; i < drawLists; ++i)
+		{
+			pass.Read(impostorDrawLists[i].indirectArgs, ResourceBind::Indirect);
+			pass.Read(impostorDrawLists[i].visibleInstances, ResourceBind::SRV);
+		}
+	};
+
+	const auto createMeshletDrawData = [&](RenderPassResources& resources, uint32_t flags, uint32_t drawVisibility, uint32_t skipVisibility, uint32_t hiZTexture)
+	{
+		return MeshletDrawData{
+			.meshletBuffer = resources.Get(meshletBufferTag),
+			.meshletVertexBuffer = resources.Get(meshletVertexBufferTag),
+			.meshletTriangleBuffer = resources.Get(meshletTriangleBufferTag),
+			.meshInstanceBuffer = resources.Get(meshInstanceBufferTag),
+			.drawVisibilityBuffer = drawVisibility,
+			.skipVisibilityBuffer = skipVisibility,
+			.flags = flags,
+			.hiZTexture = hiZTexture,
+			.hiZMipLevels = hiZMipLevels,
+			.instanceCount = static_cast<uint32_t>(renderableCount),
+			.instanceRowSize = 0,
+			.instanceOffset = 0,
+			.cullCameraIndex = cameraFrozen ? 1u : 0u,  // #TODO: Support multiple cameras.
+			.cullingViewBuffer = resources.Get(cullingViewBufferTag),
+			.transformBuffer = resources.Get(transformBufferTag)
+		};
+	};
+
+	// Requires the bound mesh pipeline's bind data to have a meshletData member. Group x covers the meshlets of an instance,
+	// groups y and z cover the instances.
+	const auto dispatchMeshlets = [&](CommandList& list, auto& bindData)
+	{
+		constexpr uint32_t maxDispatchSize = D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION;
+		constexpr uint32_t maxDispatchGroups = 1 << 22;  // Mesh shader dispatches are also limited in total groups.
+
+		const auto chunks = std::max(maxMeshletChunks, 1u);
+		const auto instancesPerDispatch = maxDispatchGroups / chunks;
+		for (uint32_t offset = 0; offset < renderableCount; offset += instancesPerDispatch)
+		{
+			const auto instances = std::min(static_cast<uint32_t>(renderableCount) - offset, instancesPerDispatch);
+			bindData.meshletData.instanceOffset = offset;
+			bindData.meshletData.instanceRowSize = std::min(instances, maxDispatchSize);
+
+			list.BindConstants("bindData", bindData);
+			list.DispatchMesh(chunks, bindData.meshletData.instanceRowSize, std::ceil((float)instances / bindData.meshletData.instanceRowSize));
+		}
+	};
+
+	// Two phase culling, the early phase draws instances visible last frame, then the late phase tests everything
+	// against a Hi-Z built from that depth, drawing the newly visible instances and recording visibility for next frame.
+	auto visibilityTag = graph.Import(visibilityBuffers[visibilityBufferIndex]);
+	auto nextVisibilityTag = graph.Import(visibilityBuffers[visibilityBufferIndex ^ 1]);
+	visibilityBufferIndex ^= 1;
+
+	auto& meshCullPass = graph.AddPass("Mesh Culling Pass", ExecutionQueue::Compute);
+	auto meshIndirectCulledRenderArgsTag = meshCullPass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+		.size = argumentCapacity,
+		.stride = sizeof(MeshIndirectArgument),
+		.uavCounter = true  // Counts the visible instances.
+	}, VGText("Mesh indirect culled render argument buffer"));
+	auto meshVisibleInstancesTag = meshCullPass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+		.size = visibleInstanceCapacity,  // A range per level of detail.
+		.stride = sizeof(uint32_t)
+	}, VGText("Mesh visible instance buffer"));
+	meshCullPass.Read(meshIndirectRenderArgsTag, ResourceBind::SRV);
+	meshCullPass.Read(meshInstanceBufferTag, ResourceBind::SRV);
+	meshCullPass.Write(meshIndirectCulledRenderArgsTag, ResourceBind::UAV);
+	meshCullPass.Write(meshVisibleInstancesTag, ResourceBind::UAV);
+	meshCullPass.Read(instanceBufferTag, ResourceBind::SRV);
+	meshCullPass.Read(transformBufferTag, ResourceBind::SRV);
+	meshCullPass.Read(cullingViewBufferTag, ResourceBind::SRV);
+	meshCullPass.Read(visibilityTag, ResourceBind::SRV);
+	if (impostorResources)
+	{
+		createImpostorDrawList(meshCullPass);
+	}
+	meshCullPass.Bind([&](CommandList& list, RenderPassResources& resources)
+	{
+		struct {
+			uint32_t inputBuffer;
+			uint32_t outputBuffer;
+			uint32_t instanceBuffer;
+			uint32_t visibleInstanceBuffer;
+			uint32_t objectBuffer;
+			uint32_t transformBuffer;
+			uint32_t cullingViewBuffer;
+			uint32_t cameraIndex;
+			uint32_t batchCount;
+			uint32_t instanceCount;
+			uint32_t cullingLevel;
+			uint32_t hiZTexture;
+			uint32_t hiZMipLevels;
+			uint32_t visibilityBuffer;
+			uint32_t nextVisibilityBuffer;
+			uint32_t lodResolution;
+			float lodErrorThreshold;
+			uint32_t countInstances;
+			uint32_t virtualPageTable;
+			uint32_t impostorBuffer;
+			uint32_t impostorArgumentBuffer;
+			uint32_t impostorInstanceBuffer;
+			uint32_t impostorResolution;
+			float impostorScreenSize;
+		} bindData;
+
+		bindData.inputBuffer = resources.Get(meshIndirectRenderArgsTag);
+		bindData.outputBuffer = resources.Get(meshIndirectCulledRenderArgsTag);
+		bindData.instanceBuffer = resources.Get(meshInstanceBufferTag);
+		bindData.visibleInstanceBuffer = resources.Get(meshVisibleInstancesTag);
+		bindData.objectBuffer = resources.Get(instanceBufferTag);
+		bindData.transformBuffer = resources.Get(transformBufferTag);
+		bindData.cullingViewBuffer = resources.Get(cullingViewBufferTag);
+		bindData.cameraIndex = cameraFrozen ? 1 : 0;  // #TODO: Support multiple cameras.
+		bindData.batchCount = batchCount;
+		bindData.instanceCount = renderableCount;
+		bindData.cullingLevel = meshCullingLevel;  // Culling disabled still compacts every instance.
+		bindData.hiZTexture = 0;  // Early phase only uses last frame's visibility.
+		bindData.hiZMipLevels = hiZMipLevels;
+		bindData.visibilityBuffer = resources.Get(visibilityTag);
+		bindData.nextVisibilityBuffer = 0;
+		bindData.lodResolution = meshLods ? GetSceneResolution().second : 0;
+		bindData.lodErrorThreshold = meshLodThreshold;
+		bindData.countInstances = device->GetProfiler().CollectingStatistics();
+		bindData.virtualPageTable = 0;
+		bindData.impostorBuffer = impostorResources ? resources.Get(impostorResources->impostorBuffer) : 0;
+		bindData.impostorArgumentBuffer = impostorResources ? resources.Get(impostorDrawLists[0].indirectArgs) : 0;
+		bindData.impostorInstanceBuffer = impostorResources ? resources.Get(impostorDrawLists[0].visibleInstances) : 0;
+		bindData.impostorResolution = GetSceneResolution().second;
+		bindData.impostorScreenSize = impostorScreenSize;
+
+		constexpr auto groupSize = 64;
+
+		// Start every batch with no instances.
+		list.BindPipeline(meshCullResetLayout);
+		list.BindConstants("bindData", bindData);
+		list.Dispatch(std::ceil((float)bindData.batchCount / groupSize), 1, 1);
+
+		if (impostorResources)
+		{
+			list.BindPipeline(meshCullImpostorResetLayout);
+			list.BindConstants("bindData", bindData);
+			list.Dispatch(1, 1, 1);
+
+			list.UAVBarrier(resources.GetBuffer(impostorDrawLists[0].indirectArgs));
+		}
+
+		list.UAVBarrier(resources.GetBuffer(meshIndirectCulledRenderArgsTag));
+		list.FlushBarriers();
+
+		list.BindPipeline(meshCullLayout);
+		list.BindConstants("bindData", bindData);
+		list.Dispatch(std::ceil((float)bindData.instanceCount / groupSize), 1, 1);
+
+		if (device->GetProfiler().CollectingStatistics())
+		{
+			const auto& arguments = device->GetResourceManager().Get(resources.GetBuffer(meshIndirectCulledRenderArgsTag));
+			device->GetProfiler().ReadCounter(list, device->GetFrameIndex(), "Early visible instances", arguments.counterBuffer, static_cast<uint32_t>(renderableCount));
+		}
+	});
+	
+	auto& prePass = graph.AddPass("Prepass", ExecutionQueue::Graphics);
+	// Nothing uses the stencil, the 24 bit format is kept as an option for its bandwidth on older hardware.
+	auto depthStencilTag = prePass.Create(TransientTextureDescription{
+		.format = *CvarGet("sceneDepthFormat", int) > 0 ? DXGI_FORMAT_R32_TYPELESS : DXGI_FORMAT_R24G8_TYPELESS
+	}, VGText("Depth stencil"));
+	std::optional<RenderResource> visibilityTextureTag;
+	if (visibilityBuffering)
+	{
+		visibilityTextureTag = prePass.Create(TransientTextureDescription{
+			.format = DXGI_FORMAT_R32G32_UINT
+		}, VGText("Visibility buffer"));
+		prePass.Output(*visibilityTextureTag, OutputBind::RTV, LoadType::Clear);
+	}
+	// Cleared to zero motion, which areas without geometry keep.
+	const auto motionVectorsTag = prePass.Create(TransientTextureDescription{
+		.format = DXGI_FORMAT_R16G16_FLOAT
+	}, VGText("Motion vectors"));
+	prePass.Output(motionVectorsTag, OutputBind::RTV, LoadType::Clear);
+	std::optional<RenderResource> objectIdTextureTag;
+	if (pickingPrepass)
+	{
+		objectIdTextureTag = prePass.Create(TransientTextureDescription{
+			.format = DXGI_FORMAT_R32_UINT
+		}, VGText("Object ID buffer"));
+		prePass.Output(*objectIdTextureTag, OutputBind::RTV, LoadType::Clear);
+	}
+	prePass.Read(instanceBufferTag, ResourceBind::SRV);
+	prePass.Read(transformBufferTag, ResourceBind::SRV);
+	prePass.Read(cameraBufferTag, ResourceBind::SRV);
+	prePass.Read(meshResources.positionTag, ResourceBind::SRV);
+	prePass.Read(meshResources.extraTag, ResourceBind::SRV);
+	prePass.Read(materialBufferTag, ResourceBind::SRV);
+	prePass.Read(meshIndirectCulledRenderArgsTag, ResourceBind::Indirect);
+	prePass.Read(meshVisibleInstancesTag, ResourceBind::SRV);
+	if (meshShading)
+	{
+		prePass.Read(meshletBufferTag, ResourceBind::SRV);
+		prePass.Read(meshletVertexBufferTag, ResourceBind::SRV);
+		prePass.Read(meshletTriangleBufferTag, ResourceBind::SRV);
+		prePass.Read(meshInstanceBufferTag, ResourceBind::SRV);
+		prePass.Read(visibilityTag, ResourceBind::SRV);
+		prePass.Read(cullingViewBufferTag, ResourceBind::SRV);
+	}
+	if (impostorResources)
+	{
+		readImpostorResources(prePass, 1);
+	}
+	prePass.Output(depthStencilTag, OutputBind::DSV, LoadType::Clear);
+	prePass.Bind([&](CommandList& list, RenderPassResources& resources)
+	{
+		struct {
+			uint32_t instanceBuffer;
+			uint32_t objectBuffer;
+			uint32_t cameraBuffer;
+			uint32_t cameraIndex;
+			uint32_t vertexPositionBuffer;
+			uint32_t vertexExtraBuffer;
+			uint32_t materialBuffer;
+			uint32_t padding;
+			union {
+				MeshletDrawData meshletData;
+				ImpostorDrawData impostorData;  // Impostor draws only.
+			};
+			uint32_t transformBuffer;
+		} bindData{};
+
+		bindData.instanceBuffer = resources.Get(meshVisibleInstancesTag);
+		bindData.objectBuffer = resources.Get(instanceBufferTag);
+		bindData.transformBuffer = resources.Get(transformBufferTag);
+		bindData.cameraBuffer = resources.Get(cameraBufferTag);
+		bindData.vertexPositionBuffer = resources.Get(meshResources.positionTag);
+		bindData.vertexExtraBuffer = resources.Get(meshResources.extraTag);
+		bindData.materialBuffer = resources.Get(materialBufferTag);
+
+		if (meshShading)
+		{
+			// Same instances as the early culling phase, the meshlets are culled individually.
+			const uint32_t flags = meshletCullFlags | (meshCullingLevel > 1 ? MeshletDrawRequireVisible : 0);
+			bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
+			bindData.meshletData = createMeshletDrawData(resources, flags, resources.Get(visibilityTag), 0, 0);
+
+			list.BindPipeline(meshPrepassPipeline);
+			dispatchMeshlets(list, bindData);
+
+			return;
+		}
+
+		MeshSystem::Render(Renderer::Get(), registry, list, bindData, resources.GetBuffer(meshIndirectCulledRenderArgsTag), std::nullopt, &prepassPipelines);
+
+		if (impostorResources)
+		{
+			bindData.instanceBuffer = resources.Get(impostorDrawLists[0].visibleInstances);
+			bindData.impostorData = impostors.GetDrawData(resources, *impostorResources);
+
+			list.BindPipeline(pickingPrepass ? impostorPickingPrepassLayout : impostorPrepassLayout);
+			list.BindConstants("bindData", bindData);
+			impostors.Draw(list, resources.GetBuffer(impostorDrawLists[0].indirectArgs));
+		}
+	});
+
+	// The Hi-Z and late culling share the late prepass, since the pyramid reads the depth that the late draws then write.
+	auto& latePrePass = graph.AddPass("Late Prepass", ExecutionQueue::Graphics);
+	auto meshLateRenderArgsTag = latePrePass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+		.size = argumentCapacity,
+		.stride = sizeof(MeshIndirectArgument),
+		.uavCounter = true  // Counts the newly visible instances.
+	}, VGText("Mesh indirect late render argument buffer"));
+	auto meshLateVisibleInstancesTag = latePrePass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+		.size = visibleInstanceCapacity,
+		.stride = sizeof(uint32_t)
+	}, VGText("Mesh late visible instance buffer"));
+	const auto hiZTag = occlusionCulling.AddHiZ(graph, latePrePass);
+	latePrePass.Read(meshIndirectRenderArgsTag, ResourceBind::SRV);
+	latePrePass.Read(meshInstanceBufferTag, ResourceBind::SRV);
+	latePrePass.Read(instanceBufferTag, ResourceBind::SRV);
+	latePrePass.Read(transformBufferTag, ResourceBind::SRV);
+	latePrePass.Read(cameraBufferTag, ResourceBind::SRV);
+	latePrePass.Read(cullingViewBufferTag, ResourceBind::SRV);
+	latePrePass.Read(meshResources.positionTag, ResourceBind::SRV);
+	latePrePass.Read(meshResources.extraTag, ResourceBind::SRV);
+	latePrePass.Read(materialBufferTag, ResourceBind::SRV);
+	latePrePass.Read(visibilityTag, ResourceBind::SRV);
+	latePrePass.Write(meshLateRenderArgsTag, ResourceBind::UAV);
+	latePrePass.Write(meshLateVisibleInstancesTag, ResourceBind::UAV);
+	latePrePass.Write(nextVisibilityTag, ResourceBind::UAV);
+	if (impostorResources)
+	{
+		createImpostorDrawList(latePrePass);
+		latePrePass.Read(impostorResources->albedoAtlas, ResourceBind::SRV);
+		latePrePass.Read(impostorResources->normalAtlas, ResourceBind::SRV);
+		latePrePass.Read(impostorResources->depthAtlas, ResourceBind::SRV);
+	}
+	if (meshShading)
+	{
+		latePrePass.Read(meshletBufferTag, ResourceBind::SRV);
+		latePrePass.Read(meshletVertexBufferTag, ResourceBind::SRV);
+		latePrePass.Read(meshletTriangleBufferTag, ResourceBind::SRV);
+	}
+	latePrePass.Output(depthStencilTag, OutputBind::DSV, LoadType::Preserve);
+	if (visibilityTextureTag)
+	{
+		latePrePass.Output(*visibilityTextureTag, OutputBind::RTV, LoadType::Preserve);
+	}
+	latePrePass.Output(motionVectorsTag, OutputBind::RTV, LoadType::Preserve);
+	if (objectIdTextureTag)
+	{
+		latePrePass.Output(*objectIdTextureTag, OutputBind::RTV, LoadType::Preserve);
+	}
+	latePrePass.Bind([&, hiZTag](CommandList& list, RenderPassResources& resources)
+	{
+		const auto depthStencil = resources.GetTexture(depthStencilTag);
+		const auto hiZ = resources.GetTexture(hiZTag);
+		const auto lateArgs = resources.GetBuffer(meshLateRenderArgsTag);
+		const auto lateInstances = resources.GetBuffer(meshLateVisibleInstancesTag);
+
+		// Disable Hi-Z updates when frozen.
+		if (!cameraFrozen)
+		{
+			list.TransitionBarrier(depthStencil, D3D12_RESOURCE_STATE_DEPTH_READ | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+			list.FlushBarriers();
+
+			occlusionCulling.GenerateHiZ(list, resources, depthStencil);
+		}
+
+		list.TransitionBarrier(hiZ, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		list.FlushBarriers();
+
+		struct {
+			uint32_t inputBuffer;
+			uint32_t outputBuffer;
+			uint32_t instanceBuffer;
+			uint32_t visibleInstanceBuffer;
+			uint32_t objectBuffer;
+			uint32_t transformBuffer;
+			uint32_t cullingViewBuffer;
+			uint32_t cameraIndex;
+			uint32_t batchCount;
+			uint32_t instanceCount;
+			uint32_t cullingLevel;
+			uint32_t hiZTexture;
+			uint32_t hiZMipLevels;
+			uint32_t visibilityBuffer;
+			uint32_t nextVisibilityBuffer;
+			uint32_t lodResolution;
+			float lodErrorThreshold;
+			uint32_t countInstances;
+			uint32_t virtualPageTable;
+			uint32_t impostorBuffer;
+			uint32_t impostorArgumentBuffer;
+			uint32_t impostorInstanceBuffer;
+			uint32_t impostorResolution;
+			float impostorScreenSize;
+		} cullBindData;
+
+		cullBindData.inputBuffer = resources.Get(meshIndirectRenderArgsTag);
+		cullBindData.outputBuffer = resources.Get(meshLateRenderArgsTag);
+		cullBindData.instanceBuffer = resources.Get(meshInstanceBufferTag);
+		cullBindData.visibleInstanceBuffer = resources.Get(meshLateVisibleInstancesTag);
+		cullBindData.objectBuffer = resources.Get(instanceBufferTag);
+		cullBindData.transformBuffer = resources.Get(transformBufferTag);
+		cullBindData.cullingViewBuffer = resources.Get(cullingViewBufferTag);
+		cullBindData.cameraIndex = cameraFrozen ? 1 : 0;  // #TODO: Support multiple cameras.
+		cullBindData.batchCount = batchCount;
+		cullBindData.instanceCount = renderableCount;
+		cullBindData.cullingLevel = meshCullingLevel;
+		cullBindData.hiZTexture = device->GetResourceManager().Get(hiZ).SRV->bindlessIndex;  // Pass only has the UAV views.
+		cullBindData.hiZMipLevels = hiZMipLevels;
+		cullBindData.visibilityBuffer = resources.Get(visibilityTag);
+		cullBindData.nextVisibilityBuffer = resources.Get(nextVisibilityTag);
+		cullBindData.lodResolution = meshLods ? GetSceneResolution().second : 0;
+		cullBindData.lodErrorThreshold = meshLodThreshold;
+		cullBindData.countInstances = device->GetProfiler().CollectingStatistics();
+		cullBindData.virtualPageTable = 0;
+		cullBindData.impostorBuffer = impostorResources ? resources.Get(impostorResources->impostorBuffer) : 0;
+		cullBindData.impostorArgumentBuffer = impostorResources ? resources.Get(impostorDrawLists[1].indirectArgs) : 0;
+		cullBindData.impostorInstanceBuffer = impostorResources ? resources.Get(impostorDrawLists[1].visibleInstances) : 0;
+		cullBindData.impostorResolution = GetSceneResolution().second;
+		cullBindData.impostorScreenSize = impostorScreenSize;
+
+		constexpr auto groupSize = 64;
+
+		list.BindPipeline(meshCullResetLayout);
+		list.BindConstants("bindData", cullBindData);
+		list.Dispatch(std::ceil((float)cullBindData.batchCount / groupSize), 1, 1);
+
+		if (impostorResources)
+		{
+			list.BindPipeline(meshCullImpostorResetLayout);
+			list.BindConstants("bindData", cullBindData);
+			list.Dispatch(1, 1, 1);
 
-	// Check if shaders need to be reloaded here since we might be requested at anytime during the frame.
-	if (shouldReloadShaders)
-	{
-		device->Synchronize();
-		renderGraphResources.DiscardPipelines();
-		shouldReloadShaders = false;
-	}
+			list.UAVBarrier(resources.GetBuffer(impostorDrawLists[1].indirectArgs));
+		}
 
-	// Only run once for now since this becomes the bottleneck running every frame with 100k+ objects.
-	static bool objectsUpdated = false;
-	if (!objectsUpdated)
-	{
-		objectsUpdated = true;
-		const auto renderables = UpdateObjects(registry);
-		renderableCount = renderables.size();
+		list.UAVBarrier(lateArgs);
+		list.FlushBarriers();
 
-		std::vector<MeshIndirectArgument> drawArguments;
-		drawArguments.reserve(renderables.size());
+		list.BindPipeline(meshCullLateLayout);
+		list.BindConstants("bindData", cullBindData);
+		list.Dispatch(std::ceil((float)cullBindData.instanceCount / groupSize), 1, 1);
 
-		for (const auto& renderable : renderables)
+		if (device->GetProfiler().CollectingStatistics())
 		{
-			drawArguments.emplace_back(MeshIndirectArgument{
-				.batchId = renderable.batchId,
-				.draw = {
-					.IndexCountPerInstance = renderable.indexCount,
-					.InstanceCount = 1,
-					.StartIndexLocation = renderable.indexOffset,
-					.BaseVertexLocation = 0,
-					.StartInstanceLocation = 0
-				}
-			});
+			const auto& arguments = device->GetResourceManager().Get(lateArgs);
+			device->GetProfiler().ReadCounter(list, device->GetFrameIndex(), "Late visible instances", arguments.counterBuffer, static_cast<uint32_t>(renderableCount));
 		}
 
-		device->GetResourceManager().Write(meshIndirectRenderArgs, drawArguments);
-	}
-	
-	UpdateCameraBuffer(registry);
+		list.TransitionBarrier(lateArgs, MeshSystem::argumentState);
+		list.TransitionBarrier(lateInstances, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		list.TransitionBarrier(depthStencil, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+		if (impostorResources)
+		{
+			list.TransitionBarrier(resources.GetBuffer(impostorDrawLists[1].indirectArgs), D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+			list.TransitionBarrier(resources.GetBuffer(impostorDrawLists[1].visibleInstances), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		}
+		list.FlushBarriers();
 
-	RenderGraph graph{ &renderGraphResources };
-	
-	const auto lightBuffer = CreateLightBuffer(registry);
+		struct {
+			uint32_t instanceBuffer;
+			uint32_t objectBuffer;
+			uint32_t cameraBuffer;
+			uint32_t cameraIndex;
+			uint32_t vertexPositionBuffer;
+			uint32_t vertexExtraBuffer;
+			uint32_t materialBuffer;
+			uint32_t padding;
+			union {
+				MeshletDrawData meshletData;
+				ImpostorDrawData impostorData;  // Impostor draws only.
+			};
+			uint32_t transformBuffer;
+		} bindData{};
 
-	MeshResources meshResources;
-	meshResources.positionTag = graph.Import(meshFactory->vertexPositionBuffer);
-	meshResources.extraTag = graph.Import(meshFactory->vertexExtraBuffer);
+		bindData.instanceBuffer = resources.Get(meshLateVisibleInstancesTag);
+		bindData.objectBuffer = resources.Get(instanceBufferTag);
+		bindData.transformBuffer = resources.Get(transformBufferTag);
+		bindData.cameraBuffer = resources.Get(cameraBufferTag);
+		bindData.vertexPositionBuffer = resources.Get(meshResources.positionTag);
+		bindData.vertexExtraBuffer = resources.Get(meshResources.extraTag);
+		bindData.materialBuffer = resources.Get(materialBufferTag);
 
-	RenderResource materialBufferTag = graph.Import(materialFactory->materialBuffer);
+		if (meshShading)
+		{
+			// The late phase only draws when occlusion culling, instances that became visible were not drawn early.
+			if (meshCullingLevel > 1)
+			{
+				const auto nextVisibility = resources.GetBuffer(nextVisibilityTag);
+				list.TransitionBarrier(nextVisibility, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+				list.FlushBarriers();
 
-	auto backBufferTag = graph.Import(device->GetBackBuffer());
-	auto cameraBufferTag = graph.Import(cameraBuffer);
-	auto instanceBufferTag = graph.Import(instanceBuffer);
-	auto lightBufferTag = graph.Import(lightBuffer);
-	auto meshIndirectRenderArgsTag = graph.Import(meshIndirectRenderArgs);
+				const uint32_t flags = meshletCullFlags | MeshletDrawRequireVisible | MeshletDrawExcludeVisible | (meshletCullingLevel > 1 ? MeshletDrawOcclusion : 0);
+				bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
+				bindData.meshletData = createMeshletDrawData(resources, flags, device->GetResourceManager().Get(nextVisibility).SRV->bindlessIndex,
+					resources.Get(visibilityTag), cullBindData.hiZTexture);  // Pass only has the UAV view of the new visibility.
 
-	graph.Tag(backBufferTag, ResourceTag::BackBuffer);
+				list.BindPipeline(meshPrepassPipeline);
+				dispatchMeshlets(list, bindData);
 
-	auto lastFrameHiZ = occlusionCulling.GetLastFrameHiZ();
+				list.TransitionBarrier(nextVisibility, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+			}
+		}
 
-	auto& meshCullPass = graph.AddPass("Mesh Culling Pass", ExecutionQueue::Compute);
-	auto meshIndirectCulledRenderArgsTag = meshCullPass.Create(TransientBufferDescription{
-		.updateRate = ResourceFrequency::Static,  // Need unordered-access.
-		.size = 1024 * 1024 * 8,
-		.stride = sizeof(MeshIndirectArgument),
-		.uavCounter = true
-	}, VGText("Mesh indirect culled render argument buffer"));
-	meshCullPass.Read(meshIndirectRenderArgsTag, ResourceBind::SRV);
-	meshCullPass.Write(meshIndirectCulledRenderArgsTag, ResourceBind::UAV);
-	meshCullPass.Read(instanceBufferTag, ResourceBind::SRV);
-	meshCullPass.Read(cameraBufferTag, ResourceBind::SRV);
-	if (*CvarGet("meshCulling", int) > 1 && lastFrameHiZ.id != 0)  // 0 first frame.
-		meshCullPass.Read(lastFrameHiZ, ResourceBind::SRV);
-	meshCullPass.Bind([&](CommandList& list, RenderPassResources& resources)
-	{
-		const auto meshCulling = *CvarGet("meshCulling", int);
+		else
+		{
+			MeshSystem::Render(Renderer::Get(), registry, list, bindData, lateArgs, std::nullopt, &prepassPipelines);
+		}
 
-		if (meshCulling > 0)
+		if (impostorResources)
 		{
-			list.BindPipeline(meshCullLayout);
+			bindData.instanceBuffer = resources.Get(impostorDrawLists[1].visibleInstances);
+			bindData.impostorData = impostors.GetDrawData(resources, *impostorResources);
+
+			list.BindPipeline(pickingPrepass ? impostorPickingPrepassLayout : impostorPrepassLayout);
+			list.BindConstants("bindData", bindData);
+			impostors.Draw(list, resources.GetBuffer(impostorDrawLists[1].indirectArgs));
+
+			// Restored along with the mesh lists.
+			list.TransitionBarrier(resources.GetBuffer(impostorDrawLists[1].indirectArgs), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+			list.TransitionBarrier(resources.GetBuffer(impostorDrawLists[1].visibleInstances), D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		}
+
+		// Restore the states the graph expects at the end of the pass.
+		list.TransitionBarrier(hiZ, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		list.TransitionBarrier(lateArgs, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		list.TransitionBarrier(lateInstances, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		list.FlushBarriers();
+	});
 
+	if (pick)
+	{
+		const auto objectIdTag = visibilityTextureTag ? *visibilityTextureTag : *objectIdTextureTag;
+
+		auto& pickingPass = graph.AddPass("Picking Pass", ExecutionQueue::Compute);
+		auto pickingBufferTag = pickingPass.Create(TransientBufferDescription{
+			.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+			.size = 1,
+			.stride = sizeof(uint32_t)
+		}, VGText("Picking buffer"));
+		pickingPass.Read(objectIdTag, ResourceBind::SRV);
+		pickingPass.Write(pickingBufferTag, ResourceBind::UAV);
+		pickingPass.Bind([&, objectIdTag, pickingBufferTag, pixel = *pick, callback = std::exchange(pickCallback, nullptr)](CommandList& list, RenderPassResources& resources)
+		{
 			struct {
-				uint32_t inputBuffer;
+				uint32_t objectIdTexture;
 				uint32_t outputBuffer;
-				uint32_t objectBuffer;
-				uint32_t cameraBuffer;
-				uint32_t cameraIndex;
-				uint32_t drawCount;
-				uint32_t cullingLevel;
-				uint32_t hiZTexture;
-				uint32_t hiZMipLevels;
+				XMUINT2 pixel;
 			} bindData;
 
-			bindData.inputBuffer = resources.Get(meshIndirectRenderArgsTag);
-			bindData.outputBuffer = resources.Get(meshIndirectCulledRenderArgsTag);
-			bindData.objectBuffer = resources.Get(instanceBufferTag);
-			bindData.cameraBuffer = resources.Get(cameraBufferTag);
-			bindData.cameraIndex = cameraFrozen ? 1 : 0;  // #TODO: Support multiple cameras.
-			bindData.drawCount = renderableCount;
-			bindData.cullingLevel = meshCulling;
-			bindData.hiZTexture = (meshCulling > 1 && lastFrameHiZ.id != 0) ? resources.Get(lastFrameHiZ) : 0;
-			bindData.hiZMipLevels = *CvarGet("hiZPyramidLevels", int);
-
-			if (lastFrameHiZ.id == 0)
-				bindData.cullingLevel = 1;  // Can't use hi-z first frame.
+			bindData.objectIdTexture = resources.Get(objectIdTag);
+			bindData.outputBuffer = resources.Get(pickingBufferTag);
+			bindData.pixel = { pixel.first, pixel.second };
 
+			list.BindPipeline(pickingLayout);
 			list.BindConstants("bindData", bindData);
+			list.Dispatch(1, 1, 1);
 
-			constexpr auto groupSize = 64;
-			const auto dispatchX = std::ceil((float)bindData.drawCount / groupSize);
-
-			list.Dispatch(dispatchX, 1, 1);
-		}
-
-		else
-		{
-			list.Copy(resources.GetBuffer(meshIndirectCulledRenderArgsTag), resources.GetBuffer(meshIndirectRenderArgsTag));
+			// Resolved through the instance slots once the frame retires, entities removed since then resolve to null.
+			device->GetResourceManager().RequestReadback(list, resources.GetBuffer(pickingBufferTag), 0, sizeof(uint32_t), [this, callback](auto data)
+			{
+				uint32_t objectId;
+				std::memcpy(&objectId, data.data(), sizeof(objectId));
 
-			// Need to update the counter resource as well.
+				entt::entity entity = entt::null;
+				if (objectId > 0 && objectId - 1 < instanceEntities.size())
+				{
+					entity = instanceEntities[objectId - 1];
+				}
 
-			auto& argsBuffer = device->GetResourceManager().Get(resources.GetBuffer(meshIndirectCulledRenderArgsTag));
+				if (callback)
+				{
+					callback(entity);
+				}
+			});
+		});
+	}
 
-			// Transition the counter buffer to copy destination here so we don't transition it in the direct list inside of Write().
-			// #TODO: Need to find a much better solution for this.
-			list.TransitionBarrier(argsBuffer.counterBuffer, D3D12_RESOURCE_STATE_COPY_DEST);
-			list.FlushBarriers();
+	// Casters are culled against each cascade separately, the view's culling results don't apply.
+	const ShadowInputs shadowInputs{
+		.cameraBuffer = cameraBufferTag,
+		.cullingViewBuffer = cullingViewBufferTag,
+		.objectBuffer = instanceBufferTag,
+		.transformBuffer = transformBufferTag,
+		.meshIndirectArgs = meshIndirectRenderArgsTag,
+		.meshInstances = meshInstanceBufferTag,
+		.vertexPositions = meshResources.positionTag
+	};
+	const auto shadowAtlasTag = shadows.Render(graph, shadowInputs);
+	const auto virtualShadowResources = virtualShadows.Render(graph, shadowInputs, depthStencilTag);
+	const auto localShadowAtlasTag = localShadows.Render(graph, shadowInputs);
+	const auto sceneAccelerationStructureTag = rayTracingScene.Render(graph, shadowInputs);
+
+	std::vector<MeshDrawList> meshDrawLists = {
+		{ meshIndirectCulledRenderArgsTag, meshVisibleInstancesTag },
+		{ meshLateRenderArgsTag, meshLateVisibleInstancesTag }
+	};
 
-			device->GetResourceManager().Write(argsBuffer.counterBuffer, (uint32_t)renderableCount);
-		}
-	});
-	
-	auto& prePass = graph.AddPass("Prepass", ExecutionQueue::Graphics);
-	auto depthStencilTag = prePass.Create(TransientTextureDescription{
-		.format = DXGI_FORMAT_R24G8_TYPELESS
-	}, VGText("Depth stencil"));
-	prePass.Read(instanceBufferTag, ResourceBind::SRV);
-	prePass.Read(cameraBufferTag, ResourceBind::SRV);
-	prePass.Read(meshResources.positionTag, ResourceBind::SRV);
-	prePass.Read(meshIndirectCulledRenderArgsTag, ResourceBind::Indirect);
-	prePass.Output(depthStencilTag, OutputBind::DSV, LoadType::Clear);
-	prePass.Bind([&](CommandList& list, RenderPassResources& resources)
+	// The depth is complete after the late prepass, so later passes only need the meshlets of visible instances that
+	// survive culling. Testing against the early Hi-Z is conservative, it contains a subset of the final depth.
+	if (meshletCullingLevel > 0)
 	{
-		struct {
-			uint32_t batchId;
-			uint32_t objectBuffer;
-			uint32_t cameraBuffer;
-			uint32_t cameraIndex;
-			uint32_t vertexPositionBuffer;
-		} bindData;
+		auto materialBucketTag = graph.Import(materialBucketBuffer);
+
+		BufferView bucketCountView{};
+		bucketCountView.UAV("uav_visible");
+		bucketCountView.UAV("uav_nonvisible", 0, 0, HeapType::NonVisible);
+
+		// Meshlet draws are written into their material bucket's region, each counted separately.
+		auto& meshletCullPass = graph.AddPass("Meshlet Culling Pass", ExecutionQueue::Compute);
+		auto meshletRenderArgsTag = meshletCullPass.Create(TransientBufferDescription{
+			.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+			.size = maxMeshletDraws,
+			.stride = sizeof(MeshIndirectArgument)
+		}, VGText("Meshlet indirect render argument buffer"));
+		auto meshletBucketCountTag = meshletCullPass.Create(TransientBufferDescription{
+			.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+			.size = materialPermutations,
+			.stride = sizeof(uint32_t)
+		}, VGText("Meshlet bucket draw count buffer"));
+		auto meshletInstancesTag = meshletCullPass.Create(TransientBufferDescription{
+			.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+			.size = maxMeshletDraws,
+			.stride = sizeof(uint32_t)
+		}, VGText("Meshlet visible instance buffer"));
+		meshletCullPass.Read(meshletBufferTag, ResourceBind::SRV);
+		meshletCullPass.Read(meshInstanceBufferTag, ResourceBind::SRV);
+		meshletCullPass.Read(instanceBufferTag, ResourceBind::SRV);
+		meshletCullPass.Read(transformBufferTag, ResourceBind::SRV);
+		meshletCullPass.Read(cullingViewBufferTag, ResourceBind::SRV);
+		meshletCullPass.Read(nextVisibilityTag, ResourceBind::SRV);
+		meshletCullPass.Read(hiZTag, ResourceBind::SRV);
+		meshletCullPass.Read(meshIndirectRenderArgsTag, ResourceBind::SRV);
+		meshletCullPass.Read(materialBucketTag, ResourceBind::SRV);
+		meshletCullPass.Write(meshletRenderArgsTag, ResourceBind::UAV);
+		meshletCullPass.Write(meshletBucketCountTag, bucketCountView);
+		meshletCullPass.Write(meshletInstancesTag, ResourceBind::UAV);
+		meshletCullPass.Bind([&, meshletBufferTag, meshletRenderArgsTag, meshletBucketCountTag, meshletInstancesTag, materialBucketTag, hiZTag](CommandList& list, RenderPassResources& resources)
+		{
+			struct {
+				uint32_t meshletBuffer;
+				uint32_t instanceBuffer;
+				uint32_t objectBuffer;
+				uint32_t transformBuffer;
+				uint32_t cullingViewBuffer;
+				uint32_t cameraIndex;
+				uint32_t visibilityBuffer;
+				uint32_t outputBuffer;
+				uint32_t visibleInstanceBuffer;
+				uint32_t instanceCount;
+				uint32_t cullingLevel;
+				uint32_t hiZTexture;
+				uint32_t hiZMipLevels;
+				uint32_t instanceRowSize;
+				uint32_t batchArgumentBuffer;
+				uint32_t bucketBuffer;
+				uint32_t bucketCountBuffer;
+			} bindData;
 
-		bindData.objectBuffer = resources.Get(instanceBufferTag);
-		bindData.cameraBuffer = resources.Get(cameraBufferTag);
-		bindData.vertexPositionBuffer = resources.Get(meshResources.positionTag);
+			constexpr uint32_t maxDispatchSize = D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION;
+
+			bindData.meshletBuffer = resources.Get(meshletBufferTag);
+			bindData.instanceBuffer = resources.Get(meshInstanceBufferTag);
+			bindData.objectBuffer = resources.Get(instanceBufferTag);
+			bindData.transformBuffer = resources.Get(transformBufferTag);
+			bindData.cullingViewBuffer = resources.Get(cullingViewBufferTag);
+			bindData.cameraIndex = cameraFrozen ? 1 : 0;  // #TODO: Support multiple cameras.
+			bindData.visibilityBuffer = resources.Get(nextVisibilityTag);
+			bindData.outputBuffer = resources.Get(meshletRenderArgsTag);
+			bindData.visibleInstanceBuffer = resources.Get(meshletInstancesTag);
+			bindData.instanceCount = renderableCount;
+			bindData.cullingLevel = meshletCullingLevel;
+			bindData.hiZTexture = resources.Get(hiZTag);
+			bindData.hiZMipLevels = hiZMipLevels;
+			bindData.instanceRowSize = std::min(static_cast<uint32_t>(renderableCount), maxDispatchSize);
+			bindData.batchArgumentBuffer = resources.Get(meshIndirectRenderArgsTag);
+			bindData.bucketBuffer = resources.Get(materialBucketTag);
+			bindData.bucketCountBuffer = resources.Get(meshletBucketCountTag, "uav_visible");
+
+			RenderUtils::Get().ClearUAV(list, resources.GetBuffer(meshletBucketCountTag), bindData.bucketCountBuffer, resources.GetDescriptor(meshletBucketCountTag, "uav_nonvisible"));
+
+			list.UAVBarrier(resources.GetBuffer(meshletBucketCountTag));
+			list.FlushBarriers();
 
-		list.BindPipeline(prepassLayout);
+			// One group per instance, tests 64 of the instance's meshlets at a time.
+			list.BindPipeline(meshletCullLayout);
+			list.BindConstants("bindData", bindData);
+			list.Dispatch(std::max(bindData.instanceRowSize, 1u), std::ceil((float)bindData.instanceCount / std::max(bindData.instanceRowSize, 1u)), 1);
+		});
 
-		MeshSystem::Render(Renderer::Get(), registry, list, bindData, resources.GetBuffer(meshIndirectCulledRenderArgsTag));
-	});
+		meshDrawLists = { { meshletRenderArgsTag, meshletInstancesTag, meshletBucketCountTag } };
+	}
 
 	// #TODO: Don't have this here.
-	const auto clusterResources = clusteredCulling.Render(graph, registry, cameraBufferTag, depthStencilTag, lightBufferTag, instanceBufferTag, meshResources, meshIndirectCulledRenderArgsTag);
+	clusteredCulling.SetVolumetricDistance(volumetricFog.Enabled() ? volumetricFog.GetRange() : 0.f);
+	const auto clusterResources = clusteredCulling.Render(graph, registry, cameraBufferTag, cullingViewBufferTag, depthStencilTag, lightBufferTag, lightAllocator.Size());
 	
 	// #TODO: Don't have this here.
 	const auto atmosphereResources = atmosphere.ImportResources(graph);
-	const auto [luminanceTexture, atmosphereIrradiance] = atmosphere.RenderEnvironmentMap(graph, atmosphereResources, cameraBufferTag, registry);
+	const auto environmentResources = atmosphere.RenderEnvironmentMap(graph, atmosphereResources, cameraBufferTag, registry, ibl.Convolving());
+	const auto atmosphereIrradiance = environmentResources.separableIrradiance;
 
 	// #TODO: Don't have this here.
-	const auto iblResources = ibl.UpdateLuts(graph, luminanceTexture, cameraBufferTag);
+	const auto iblResources = ibl.UpdateLuts(graph, environmentResources.luminanceTexture, cameraBufferTag, environmentResources.luminanceUpdated, environmentResources.fullRefresh);
 
 	// #TODO: Don't have this here.
-	occlusionCulling.Render(graph, cameraFrozen, depthStencilTag);
+	// A frozen camera keeps the Hi-Z of the frozen view.
+	const auto cloudResources = clouds.Render(graph, registry, atmosphere, cameraBufferTag, depthStencilTag, atmosphereIrradiance,
+		cameraFrozen ? std::nullopt : std::optional{ hiZTag });
+
+	const auto fogTag = volumetricFog.Render(graph, clusteredCulling, shadows, VolumetricFogInputs{
+		.cameraBuffer = cameraBufferTag,
+		.lightBuffer = lightBufferTag,
+		.clusterResources = clusterResources,
+		.atmosphereIrradiance = atmosphereIrradiance,
+		.cloudShadow = cloudResources.cloudShadow,
+		.shadowAtlas = shadowAtlasTag,
+		.weatherScroll = clouds.GetWeatherScroll()
+	});
 
-	// #TODO: Don't have this here.
-	const auto cloudResources = clouds.Render(graph, registry, atmosphere, cameraBufferTag, depthStencilTag, atmosphereIrradiance);
-
-	auto& forwardPass = graph.AddPass("Forward Pass", ExecutionQueue::Graphics);
-	const auto outputHDRTag = forwardPass.Create(TransientTextureDescription{
-		.format = DXGI_FORMAT_R16G16B16A16_FLOAT
-	}, VGText("Output HDR sRGB"));
-	forwardPass.Read(depthStencilTag, ResourceBind::DSV);
-	forwardPass.Read(instanceBufferTag, ResourceBind::SRV);
-	forwardPass.Read(cameraBufferTag, ResourceBind::SRV);
-	forwardPass.Read(lightBufferTag, ResourceBind::SRV);
-	forwardPass.Read(meshResources.positionTag, ResourceBind::SRV);
-	forwardPass.Read(meshResources.extraTag, ResourceBind::SRV);
-	forwardPass.Read(materialBufferTag, ResourceBind::SRV);
-	forwardPass.Read(clusterResources.lightList, ResourceBind::SRV);
-	forwardPass.Read(clusterResources.lightInfo, ResourceBind::SRV);
-	forwardPass.Read(iblResources.irradianceTag, ResourceBind::SRV);
-	forwardPass.Read(iblResources.prefilterTag, ResourceBind::SRV);
-	forwardPass.Read(iblResources.brdfTag, ResourceBind::SRV);
-	forwardPass.Read(atmosphereIrradiance, ResourceBind::SRV);
-	forwardPass.Read(cloudResources.weather, ResourceBind::SRV);
-	forwardPass.Read(meshIndirectCulledRenderArgsTag, ResourceBind::Indirect);
-	forwardPass.Output(outputHDRTag, OutputBind::RTV, LoadType::Clear);
-	forwardPass.Bind([&](CommandList& list, RenderPassResources& resources)
-	{
+	// Reads the Hi-Z pyramid of this frame's early depth, and the resolved color of the last frame.
+	const auto screenSpaceResources = screenSpaceLighting.Render(graph, ScreenSpaceInputs{
+		.cameraBuffer = cameraBufferTag,
+		.depthStencil = depthStencilTag,
+		.hiZ = hiZTag,
+		.motionVectors = motionVectorsTag,
+		.lastFrameColor = *CvarGet("temporalAA", int) ? temporalAA.GetHistory(graph) : RenderResource{ .id = 0 }
+	});
+
+	struct ForwardBindData {
+		uint32_t instanceBuffer;
+		uint32_t objectBuffer;
+		uint32_t cameraBuffer;
+		uint32_t cameraIndex;
+		uint32_t vertexPositionBuffer;
+		uint32_t vertexExtraBuffer;
+		uint32_t materialBuffer;
+		uint32_t lightBuffer;
+		uint32_t atmosphereIrradianceBuffer;
+		float globalWeatherCoverage;
+		uint32_t cloudShadowTexture;
+		uint32_t sceneAccelerationStructure;
 		ClusterData clusterData;
-		auto& gridInfo = clusteredCulling.GetGridInfo();
-		clusterData.lightListBuffer = resources.Get(clusterResources.lightList);
-		clusterData.lightInfoBuffer = resources.Get(clusterResources.lightInfo);
-		clusterData.froxelSize = *CvarGet("clusteredFroxelSize", int);
-		clusterData.dimensions[0] = gridInfo.x;
-		clusterData.dimensions[1] = gridInfo.y;
-		clusterData.dimensions[2] = gridInfo.z;
-		clusterData.logY = 1.f / std::log(gridInfo.depthFactor);
+		IblData iblData;
+		uint32_t outputResolution[2];
+		XMFLOAT2 weatherScroll;
+		union {
+			MeshletDrawData meshletData;
+			ImpostorDrawData impostorData;  // Impostor draws only.
+		};
+		uint32_t visibilityTexture;
+		uint32_t indexBuffer;
+		uint32_t outputTexture;
+		uint32_t transformBuffer;
+		ShadowData shadowData;
+		VirtualShadowData virtualShadowData;
+		uint32_t ambientOcclusionTexture;
+		uint32_t reflectionTexture;
+		uint32_t probeIrradianceBuffer;
+		uint32_t probePrefilterTexture;
+	};
+
+	const auto probeResources = reflectionProbes.ImportResources(graph);
+
+	// Shared by the forward pass and visibility buffer shading, which evaluate the same materials and lighting.
+	const auto readShadingResources = [&](RenderPass& pass)
+	{
+		pass.Read(instanceBufferTag, ResourceBind::SRV);
+		pass.Read(transformBufferTag, ResourceBind::SRV);
+		pass.Read(cameraBufferTag, ResourceBind::SRV);
+		pass.Read(lightBufferTag, ResourceBind::SRV);
+		pass.Read(meshResources.positionTag, ResourceBind::SRV);
+		pass.Read(meshResources.extraTag, ResourceBind::SRV);
+		pass.Read(materialBufferTag, ResourceBind::SRV);
+		pass.Read(clusterResources.lightList, ResourceBind::SRV);
+		pass.Read(clusterResources.lightInfo, ResourceBind::SRV);
+		pass.Read(clusterResources.directionalLightList, ResourceBind::SRV);
+		pass.Read(iblResources.irradianceTag, ResourceBind::SRV);
+		pass.Read(iblResources.prefilterTag, ResourceBind::SRV);
+		pass.Read(iblResources.brdfTag, ResourceBind::SRV);
+		pass.Read(atmosphereIrradiance, ResourceBind::SRV);
+		pass.Read(cloudResources.cloudShadow, ResourceBind::SRV);
+		pass.Read(shadowAtlasTag, ResourceBind::SRV);
+		pass.Read(localShadowAtlasTag, ResourceBind::SRV);
+		pass.Read(virtualShadowResources.pageTable, ResourceBind::SRV);
+		pass.Read(virtualShadowResources.physicalPages, ResourceBind::SRV);
+		pass.Read(probeResources.irradiance, ResourceBind::SRV);
+		pass.Read(probeResources.prefilter, ResourceBind::SRV);
+		if (screenSpaceResources.ambientOcclusion.id != 0)
+		{
+			pass.Read(screenSpaceResources.ambientOcclusion, ResourceBind::SRV);
+		}
+		if (screenSpaceResources.reflections.id != 0)
+		{
+			pass.Read(screenSpaceResources.reflections, ResourceBind::SRV);
+		}
+		if (sceneAccelerationStructureTag.id != 0)
+		{
+			pass.Read(sceneAccelerationStructureTag, ResourceBind::AccelerationStructure);
+		}
+	};
 
+	const auto createShadingData = [&](RenderPassResources& resources, TextureHandle output)
+	{
 		IblData iblData;
-		iblData.irradianceTexture = resources.Get(iblResources.irradianceTag);
+		iblData.irradianceBuffer = resources.Get(iblResources.irradianceTag);
 		iblData.prefilterTexture = resources.Get(iblResources.prefilterTag);
 		iblData.brdfTexture = resources.Get(iblResources.brdfTag);
 		iblData.prefilterLevels = ibl.GetPrefilterLevels();
 
-		struct {
-			uint32_t batchId;
-			uint32_t objectBuffer;
-			uint32_t cameraBuffer;
-			uint32_t cameraIndex;
-			uint32_t vertexPositionBuffer;
-			uint32_t vertexExtraBuffer;
-			uint32_t materialBuffer;
-			uint32_t lightBuffer;
-			uint32_t atmosphereIrradianceBuffer;
-			float globalWeatherCoverage;
-			uint32_t weatherTexture;
-			float padding;
-			ClusterData clusterData;
-			IblData iblData;
-			uint32_t outputResolution[2];
-		} bindData;
-
+		ForwardBindData bindData{};
 		bindData.objectBuffer = resources.Get(instanceBufferTag);
+		bindData.transformBuffer = resources.Get(transformBufferTag);
 		bindData.cameraBuffer = resources.Get(cameraBufferTag);
 		bindData.vertexPositionBuffer = resources.Get(meshResources.positionTag);
 		bindData.vertexExtraBuffer = resources.Get(meshResources.extraTag);
@@ -609,56 +2486,328 @@ void Renderer::Render(entt::registry& registry)
 		bindData.lightBuffer = resources.Get(lightBufferTag);
 		bindData.atmosphereIrradianceBuffer = resources.Get(atmosphereIrradiance);
 		bindData.globalWeatherCoverage = clouds.coverage;  // #TODO: Scale by precipitation?
-		bindData.weatherTexture = resources.Get(cloudResources.weather);
-		bindData.clusterData = clusterData;
+		bindData.cloudShadowTexture = resources.Get(cloudResources.cloudShadow);
+		bindData.sceneAccelerationStructure = sceneAccelerationStructureTag.id != 0 ? resources.Get(sceneAccelerationStructureTag) : 0;
+		bindData.weatherScroll = clouds.GetWeatherScroll();
+		bindData.clusterData = clusteredCulling.GetClusterData(resources, clusterResources);
 		bindData.iblData = iblData;
-
-		const auto& outputComponent = device->GetResourceManager().Get(resources.GetTexture(outputHDRTag));
+		bindData.shadowData = shadows.GetShadowData(resources, shadowAtlasTag);
+		bindData.shadowData.localShadowAtlas = resources.Get(localShadowAtlasTag);
+		bindData.virtualShadowData = virtualShadows.GetShadowData(resources, virtualShadowResources);
+		bindData.ambientOcclusionTexture = screenSpaceResources.ambientOcclusion.id != 0 ? resources.Get(screenSpaceResources.ambientOcclusion) : 0;
+		bindData.reflectionTexture = screenSpaceResources.reflections.id != 0 ? resources.Get(screenSpaceResources.reflections) : 0;
+		bindData.probeIrradianceBuffer = resources.Get(probeResources.irradiance);
+		bindData.probePrefilterTexture = resources.Get(probeResources.prefilter);
+
+		const auto& outputComponent = device->GetResourceManager().Get(output);
 		bindData.outputResolution[0] = outputComponent.description.width;
 		bindData.outputResolution[1] = outputComponent.description.height;
 
+		return bindData;
+	};
+
+	// Captures are shaded with the view's lighting, without the screen space inputs that only cover the view, or the
+	// probes themselves, which would feed back into their own captures.
+	const ProbeShading probeShading{
+		.read = readShadingResources,
+		.bind = [&](CommandList& list, RenderPassResources& resources, uint32_t cameraIndex, uint32_t instanceBuffer, TextureHandle output)
+		{
+			auto bindData = createShadingData(resources, output);
+			bindData.cameraIndex = cameraIndex;
+			bindData.instanceBuffer = instanceBuffer;
+			bindData.ambientOcclusionTexture = 0;
+			bindData.reflectionTexture = 0;
+			bindData.probeIrradianceBuffer = 0;
+			bindData.probePrefilterTexture = 0;
+
+			list.BindConstants("bindData", bindData);
+		}
+	};
+
+	reflectionProbes.Render(graph, ProbeInputs{
+		.cameraBuffer = cameraBufferTag,
+		.cullingViewBuffer = cullingViewBufferTag,
+		.objectBuffer = instanceBufferTag,
+		.transformBuffer = transformBufferTag,
+		.meshIndirectArgs = meshIndirectRenderArgsTag,
+		.meshInstances = meshInstanceBufferTag,
+		.skyLuminance = environmentResources.luminanceTexture
+	}, probeResources, probeShading);
+
+	// Coverage of transparent surfaces is accumulated in its own target, so the scene color doesn't need alpha.
+	const auto sceneColorFormat = device->SupportsCompactColorLoads() && *CvarGet("compactSceneColor", int) > 0 ?
+		DXGI_FORMAT_R11G11B10_FLOAT : DXGI_FORMAT_R16G16B16A16_FLOAT;
+
+	RenderResource outputHDRTag;
+	if (visibilityBuffering)
+	{
+		auto& shadingPass = graph.AddPass("Visibility Shading Pass", ExecutionQueue::Graphics);
+		outputHDRTag = shadingPass.Create(TransientTextureDescription{
+			.format = sceneColorFormat
+		}, VGText("Output HDR sRGB"));
+		readShadingResources(shadingPass);
+		shadingPass.Read(*visibilityTextureTag, ResourceBind::SRV);
+		shadingPass.Write(outputHDRTag, ResourceBind::UAV);
+		shadingPass.Bind([&, outputHDRTag](CommandList& list, RenderPassResources& resources)
 		{
 			VGScopedGPUStat("Opaque", device->GetDirectContext(), list.Native());
 
-			list.BindPipeline(forwardOpaqueLayout);
+			auto bindData = createShadingData(resources, resources.GetTexture(outputHDRTag));
+			bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
+			bindData.visibilityTexture = resources.Get(*visibilityTextureTag);
+			// The index buffer stays in an index and shader resource state, outside of the graph.
+			bindData.indexBuffer = device->GetResourceManager().Get(meshFactory->indexBuffer).SRV->bindlessIndex;
+			bindData.outputTexture = resources.Get(outputHDRTag);
+
+			list.BindPipeline(visibilityShadingLayout);
+			list.BindConstants("bindData", bindData);
+			list.Dispatch(std::ceil(bindData.outputResolution[0] / 8.f), std::ceil(bindData.outputResolution[1] / 8.f), 1);
+		});
+	}
+
+	else
+	{
+		const auto shadingRateTag = variableRateShading.Render(graph, ShadingRateInputs{
+			.lastFrameColor = *CvarGet("temporalAA", int) ? temporalAA.GetHistory(graph) : RenderResource{ .id = 0 },
+			.motionVectors = motionVectorsTag,
+			.width = sceneWidth,
+			.height = sceneHeight
+		});
+
+		auto& forwardPass = graph.AddPass("Forward Pass", ExecutionQueue::Graphics);
+		outputHDRTag = forwardPass.Create(TransientTextureDescription{
+			.format = sceneColorFormat
+		}, VGText("Output HDR sRGB"));
+		forwardPass.Read(depthStencilTag, ResourceBind::DSV);
+		if (shadingRateTag)
+		{
+			forwardPass.Read(*shadingRateTag, ResourceBind::ShadingRate);
+		}
+		readShadingResources(forwardPass);
+		if (meshShading)
+		{
+			forwardPass.Read(meshletBufferTag, ResourceBind::SRV);
+			forwardPass.Read(meshletVertexBufferTag, ResourceBind::SRV);
+			forwardPass.Read(meshletTriangleBufferTag, ResourceBind::SRV);
+			forwardPass.Read(meshInstanceBufferTag, ResourceBind::SRV);
+			forwardPass.Read(nextVisibilityTag, ResourceBind::SRV);
+			forwardPass.Read(cullingViewBufferTag, ResourceBind::SRV);
+			forwardPass.Read(hiZTag, ResourceBind::SRV);
+		}
+
+		else
+		{
+			for (const auto& drawList : meshDrawLists)
+			{
+				forwardPass.Read(drawList.indirectArgs, ResourceBind::Indirect);
+				forwardPass.Read(drawList.visibleInstances, ResourceBind::SRV);
+				if (drawList.drawCounts)
+				{
+					forwardPass.Read(*drawList.drawCounts, ResourceBind::Indirect);
+				}
+			}
 
-			MeshSystem::Render(Renderer::Get(), registry, list, bindData, resources.GetBuffer(meshIndirectCulledRenderArgsTag));
+			if (impostorResources)
+			{
+				readImpostorResources(forwardPass, impostorDrawLists.size());
+			}
 		}
+		forwardPass.Output(outputHDRTag, OutputBind::RTV, LoadType::Clear);
+		forwardPass.Bind([&, outputHDRTag, shadingRateTag](CommandList& list, RenderPassResources& resources)
+		{
+			auto bindData = createShadingData(resources, resources.GetTexture(outputHDRTag));
+
+			VGScopedGPUStat("Opaque", device->GetDirectContext(), list.Native());
+
+			if (shadingRateTag)
+			{
+				list.SetShadingRateImage(resources.GetTexture(*shadingRateTag));
+			}
+
+			if (meshShading)
+			{
+				// Every instance visible after the late phase, with the meshlet culling of the meshlet culling pass.
+				uint32_t flags = MeshletDrawRequireVisible;
+				if (meshletCullingLevel > 0) flags |= MeshletDrawCull;
+				if (meshletCullingLevel > 1) flags |= MeshletDrawOcclusion;
+
+				bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
+				bindData.meshletData = createMeshletDrawData(resources, flags, resources.Get(nextVisibilityTag), 0, resources.Get(hiZTag));
+
+				list.BindPipeline(meshForwardOpaqueLayout);
+				dispatchMeshlets(list, bindData);
+			}
+
+			else
+			{
+				// Each material bucket is drawn with the pipeline specialized on its features.
+				for (const auto& drawList : meshDrawLists)
+				{
+					bindData.instanceBuffer = resources.Get(drawList.visibleInstances);
+					MeshSystem::Render(Renderer::Get(), registry, list, bindData, resources.GetBuffer(drawList.indirectArgs),
+						drawList.drawCounts ? std::optional{ resources.GetBuffer(*drawList.drawCounts) } : std::nullopt, &forwardOpaqueBucketLayouts);
+				}
+
+				if (impostorResources)
+				{
+					bindData.impostorData = impostors.GetDrawData(resources, *impostorResources);
+					list.BindPipeline(impostorForwardLayout);
+
+					for (const auto& drawList : impostorDrawLists)
+					{
+						bindData.instanceBuffer = resources.Get(drawList.visibleInstances);
+						list.BindConstants("bindData", bindData);
+						impostors.Draw(list, resources.GetBuffer(drawList.indirectArgs));
+					}
+				}
+			}
+
+			if (shadingRateTag)
+			{
+				list.ClearShadingRateImage();  // Later passes recorded into the list shade at full rate.
+			}
+		});
+	}
+
+	// Blended materials are bucketed apart from the opaque ones, so the culled draws of their buckets are drawn on their own
+	// once the opaque depth is complete. Mesh shading draws every meshlet as opaque.
+	const bool transparency = !meshShading && std::any_of(materialBuckets.begin(), materialBuckets.end(), [i = 0u](const auto& bucket) mutable
+	{
+		return (i++ & MaterialFeatureBlend) && bucket.batchCount > 0;
 	});
 
+	std::optional<std::pair<RenderResource, RenderResource>> transparencyTags;  // Accumulation and revealage.
+	if (transparency)
+	{
+		auto& transparencyPass = graph.AddPass("Transparency Pass", ExecutionQueue::Graphics);
+		const auto accumulationTag = transparencyPass.Create(TransientTextureDescription{
+			.format = DXGI_FORMAT_R16G16B16A16_FLOAT,
+			.clearValue = { .color = { 0.f, 0.f, 0.f, 0.f } }
+		}, VGText("Transparency accumulation"));
+		const auto revealageTag = transparencyPass.Create(TransientTextureDescription{
+			.format = DXGI_FORMAT_R16_FLOAT,
+			.clearValue = { .color = { 1.f, 0.f, 0.f, 0.f } }
+		}, VGText("Transparency revealage"));
+		transparencyPass.Read(depthStencilTag, ResourceBind::DSV);
+		readShadingResources(transparencyPass);
+		for (const auto& drawList : meshDrawLists)
+		{
+			transparencyPass.Read(drawList.indirectArgs, ResourceBind::Indirect);
+			transparencyPass.Read(drawList.visibleInstances, ResourceBind::SRV);
+			if (drawList.drawCounts)
+			{
+				transparencyPass.Read(*drawList.drawCounts, ResourceBind::Indirect);
+			}
+		}
+		transparencyPass.Output(accumulationTag, OutputBind::RTV, LoadType::Clear);
+		transparencyPass.Output(revealageTag, OutputBind::RTV, LoadType::Clear);
+		transparencyPass.Bind([&, accumulationTag](CommandList& list, RenderPassResources& resources)
+		{
+			auto bindData = createShadingData(resources, resources.GetTexture(accumulationTag));
+
+			// Both culling phases, the blended buckets of each.
+			for (const auto& drawList : meshDrawLists)
+			{
+				bindData.instanceBuffer = resources.Get(drawList.visibleInstances);
+				MeshSystem::Render(Renderer::Get(), registry, list, bindData, resources.GetBuffer(drawList.indirectArgs),
+					drawList.drawCounts ? std::optional{ resources.GetBuffer(*drawList.drawCounts) } : std::nullopt, &forwardTransparentBucketLayouts, true);
+			}
+		});
+
+		transparencyTags = std::make_pair(accumulationTag, revealageTag);
+	}
+
 	// #TODO: Don't have this here.
-	atmosphere.Render(graph, clouds, atmosphereResources, cloudResources, cameraBufferTag, depthStencilTag, outputHDRTag, registry);
+	atmosphere.Render(graph, clouds, atmosphereResources, cloudResources, volumetricFog, fogTag, cameraBufferTag, depthStencilTag, outputHDRTag, registry);
+
+	// Composited over the sky, which the atmosphere fills in behind the opaque depth.
+	if (transparencyTags)
+	{
+		auto& compositePass = graph.AddPass("Transparency Composite Pass", ExecutionQueue::Compute);
+		compositePass.Read(transparencyTags->first, ResourceBind::SRV);
+		compositePass.Read(transparencyTags->second, ResourceBind::SRV);
+		compositePass.Write(outputHDRTag, ResourceBind::UAV);
+		compositePass.Bind([&, tags = *transparencyTags, outputHDRTag](CommandList& list, RenderPassResources& resources)
+		{
+			struct {
+				uint32_t accumulationTexture;
+				uint32_t revealageTexture;
+				uint32_t outputTexture;
+				float padding;
+				uint32_t outputResolution[2];
+			} bindData;
+
+			const auto& outputComponent = device->GetResourceManager().Get(resources.GetTexture(outputHDRTag));
+
+			bindData.accumulationTexture = resources.Get(tags.first);
+			bindData.revealageTexture = resources.Get(tags.second);
+			bindData.outputTexture = resources.Get(outputHDRTag);
+			bindData.outputResolution[0] = outputComponent.description.width;
+			bindData.outputResolution[1] = outputComponent.description.height;
+
+			list.BindPipeline(transparencyCompositeLayout);
+			list.BindConstants("bindData", bindData);
+			list.Dispatch(std::ceil(bindData.outputResolution[0] / 8.f), std::ceil(bindData.outputResolution[1] / 8.f), 1);
+		});
+	}
+
+	// Resolve the jittered samples before post processing, bloom would otherwise spread the jitter.
+	auto resolvedHDRTag = outputHDRTag;
+	if (*CvarGet("temporalAA", int))
+	{
+		resolvedHDRTag = temporalAA.Render(graph, TemporalInputs{
+			.color = outputHDRTag,
+			.depthStencil = depthStencilTag,
+			.motionVectors = motionVectorsTag,
+			.cameraBuffer = cameraBufferTag
+		});
+	}
 
 	// #TODO: Don't have this here.
-	bloom.Render(graph, outputHDRTag);
+	const auto bloomTag = bloom.Render(graph, resolvedHDRTag);
 
-	auto& postProcessPass = graph.AddPass("Post Process Pass", ExecutionQueue::Graphics);
+	// Bloom composition, tone mapping and sRGB encoding in a single pass.
+	auto& postProcessPass = graph.AddPass("Post Process Pass", ExecutionQueue::Compute);
 	const auto outputLDRTag = postProcessPass.Create(TransientTextureDescription{
 		.format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
 	}, VGText("Output LDR sRGB"));
-	postProcessPass.Read(outputHDRTag, ResourceBind::SRV);
-	postProcessPass.Output(outputLDRTag, OutputBind::RTV, LoadType::Clear);
-	postProcessPass.Bind([&](CommandList& list, RenderPassResources& resources)
+	postProcessPass.Read(resolvedHDRTag, ResourceBind::SRV);
+	postProcessPass.Read(bloomTag, ResourceBind::SRV);
+	postProcessPass.Write(outputLDRTag, TextureView{}
+		.UAV("", 0));
+	postProcessPass.Bind([&, resolvedHDRTag, bloomTag, outputLDRTag, toneMappingEnabled = *CvarGet("toneMappingEnabled", int)](CommandList& list, RenderPassResources& resources)
 	{
-		auto postProcessLayout = RenderPipelineLayout{}
-			.VertexShader({ "PostProcess", "VSMain" })
-			.PixelShader({ "PostProcess", "PSMain" })
-			.DepthEnabled(false);
+		list.BindPipeline(postProcessLayout.Permutation(toneMappingEnabled > 0 ? 1 : 0));
 
-		if (*CvarGet("toneMappingEnabled", int) > 0)
+		struct BindData
 		{
-			postProcessLayout.Macro({ "ENABLE_TONEMAPPING" });
-		}
+			uint32_t hdrTexture;
+			uint32_t bloomTexture;
+			uint32_t outputTexture;
+			float bloomIntensity;
+			float bloomInternalBlend;
+			XMFLOAT3 padding;
+		} bindData;
+
+		bindData.hdrTexture = resources.Get(resolvedHDRTag);
+		bindData.bloomTexture = resources.Get(bloomTag);
+		bindData.outputTexture = resources.Get(outputLDRTag);
+		bindData.bloomIntensity = bloom.intensity;
+		bindData.bloomInternalBlend = bloom.internalBlend;
+		list.BindConstants("bindData", bindData);
 
-		list.BindPipeline(postProcessLayout);
-		list.BindConstants("bindData", { resources.Get(outputHDRTag) });
+		const auto& outputComponent = device->GetResourceManager().Get(resources.GetTexture(outputLDRTag));
+		const auto dispatchX = (uint32_t)std::ceil(outputComponent.description.width / 8.f);
+		const auto dispatchY = (uint32_t)std::ceil(outputComponent.description.height / 8.f);
 
-		list.DrawFullscreenQuad();
+		list.Dispatch(dispatchX, dispatchY, 1);
 	});
 
 	// #TODO: Don't have this here.
 	Editor::Get().Render(graph, *device, *this, *graph.resourceManager, registry, cameraBufferTag, depthStencilTag, outputLDRTag, backBufferTag, clusterResources, cloudResources.weather);
 
+	graph.resourceManager->captureTimeline |= replaying;
+
 	auto& presentPass = graph.AddPass("Present", ExecutionQueue::Graphics);
 	presentPass.Read(backBufferTag, ResourceBind::Common);
 	presentPass.Bind([](CommandList& list, RenderPassResources& resources)
@@ -676,6 +2825,15 @@ void Renderer::Render(entt::registry& registry)
 
 	Editor::Get().Update();
 
+	// Resize between frames, so that the next frame's camera and transients agree on the resolution.
+	if (pendingSceneResolution != sceneResolution)
+	{
+		sceneResolution = pendingSceneResolution;
+
+		// Transients are pooled by their resolved size, and histories restart on their own.
+		clusteredCulling.MarkDirty();
+	}
+
 	appFrame++;
 }
 
@@ -694,12 +2852,34 @@ std::pair<uint32_t, uint32_t> Renderer::GetResolution() const
 	return std::make_pair(device->renderWidth, device->renderHeight);
 }
 
-void Renderer::SetResolution(uint32_t width, uint32_t height, bool fullscreen)
+std::pair<uint32_t, uint32_t> Renderer::GetSceneResolution() const
 {
-	device->SetResolution(width, height, fullscreen);
+	if (sceneResolution.first == 0 || sceneResolution.second == 0)
+	{
+		return GetResolution();
+	}
+
+	return std::make_pair(std::min(sceneResolution.first, device->renderWidth), std::min(sceneResolution.second, device->renderHeight));
+}
+
+void Renderer::SetSceneResolution(uint32_t width, uint32_t height)
+{
+	// Round up to a coarse step, so that resizing a viewport only produces a handful of distinct transient sizes
+	// for the pool to cycle through. The viewport crops the remainder.
+	constexpr uint32_t step = 64;
+
+	if (width == 0 || height == 0)
+	{
+		pendingSceneResolution = { 0, 0 };
+		return;
+	}
+
+	pendingSceneResolution = { (width + step - 1) / step * step, (height + step - 1) / step * step };
+}
 
-	renderGraphResources.DiscardTransients();
-	clusteredCulling.MarkDirty();
+void Renderer::SetResolution(uint32_t width, uint32_t height, bool fullscreen)
+{
+	pendingResolution = PendingResolution{ width, height, fullscreen, std::chrono::steady_clock::now() };
 }
 
 void Renderer::FreezeCamera()
@@ -717,6 +2897,12 @@ void Renderer::ReloadShaderPipelines()
 	shouldReloadShaders = true;
 }
 
+void Renderer::RequestPick(uint32_t x, uint32_t y, std::function<void(entt::entity)> callback)
+{
+	pendingPick = std::make_pair(x, y);
+	pickCallback = std::move(callback);
+}
+
 void Renderer::ResetAppTime()
 {
 	appTime = 0;
@@ -19,24 +19,66 @@
 #include <Rendering/Bloom.h>
 #include <Rendering/OcclusionCulling.h>
 #include <Rendering/Clouds.h>
+#include <Rendering/TemporalAntiAliasing.h>
+#include <Rendering/TextureStreaming.h>
+#include <Rendering/CascadedShadows.h>
+#include <Rendering/VirtualShadowMap.h>
+#include <Rendering/VolumetricFog.h>
+#include <Rendering/ScreenSpaceLighting.h>
+#include <Rendering/ReflectionProbes.h>
+#include <Rendering/LocalShadows.h>
+#include <Rendering/SceneBvh.h>
+#include <Rendering/Skinning.h>
+#include <Rendering/Impostors.h>
+#include <Rendering/VariableRateShading.h>
+#include <Rendering/RayTracingScene.h>
+#include <Rendering/QualityGovernor.h>
+#include <Utility/FreeListAllocator.h>
+#include <Utility/DirectoryWatcher.h>
 
 #include <entt/entt.hpp>
 
+#include <array>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <limits>
+#include <optional>
+#include <functional>
+#include <chrono>
+
 struct MeshRenderable
 {
 	uint32_t positionOffset;
 	uint32_t extraOffset;
-	uint32_t indexOffset;
+	uint32_t indexOffset;  // In bytes, subset index formats differ.
 	uint32_t indexCount;
+	uint32_t indexSize;
 	uint32_t materialIndex;
-	uint32_t batchId;
 	float boundingSphereRadius;
+	XMFLOAT3 boundingSphereCenter;
+	XMFLOAT3 boundsCenter;
+	XMFLOAT3 boundsExtents;
+	uint32_t meshletOffset;
+	uint32_t meshletCount;
+	uint32_t lodCount;
+	std::array<MeshLod, maxMeshLods> lods;  // Offsets relative to the index offset.
 };
 
 class CommandList;
+struct WorldTransformComponent;
+struct MeshComponent;
+struct LightComponent;
+struct ObjectData;
 
 class Renderer : public Singleton<Renderer>
 {
+	friend class CascadedShadows;
+	friend class VirtualShadowMap;
+	friend class LocalShadows;
+
 public:
 	std::unique_ptr<WindowFrame> window;
 	std::unique_ptr<RenderDevice> device;  // Destruct the device after all other resources.
@@ -53,37 +95,206 @@ public:
 	Bloom bloom;
 	OcclusionCulling occlusionCulling;
 	Clouds clouds;
+	TemporalAntiAliasing temporalAA;
+	TextureStreamer textureStreamer;
+	CascadedShadows shadows;
+	VirtualShadowMap virtualShadows;
+	VolumetricFog volumetricFog;
+	ScreenSpaceLighting screenSpaceLighting;
+	ReflectionProbes reflectionProbes;
+	LocalShadows localShadows;
+	VariableRateShading variableRateShading;
+	SceneBvh sceneBvh;  // World bounds of every mesh entity, refit as they move.
+	RayTracingScene rayTracingScene;
+	Skinning skinning;
+	Impostors impostors;
 
-	size_t renderableCount;
+	size_t renderableCount = 0;  // Instances.
+	size_t batchCount = 0;  // Instanced draws.
+	uint32_t maxMeshletChunks = 0;  // Amplification groups needed for the instance with the most meshlets.
+	std::array<MaterialBucket, materialPermutations> materialBuckets = {};  // Draws are laid out bucketed by material permutation.
 
-	ResourcePtr<ID3D12RootSignature> rootSignature;
 	ResourcePtr<ID3D12CommandSignature> meshIndirectCommandSignature;
 
 private:
 	RenderGraphResourceManager renderGraphResources;
+	DirectoryWatcher shaderWatcher;  // Triggers rebuilding pipelines with edited shaders.
 
 	BufferHandle instanceBuffer;
+	BufferHandle transformBuffer;  // One slot per mesh entity, shared by the entity's instances.
 	BufferHandle cameraBuffer;
+	BufferHandle cullingViewBuffer;  // Culling constants of each camera.
+
+	// Persistent light pool. Each light entity owns a stable slot, and only the slots of changed lights are uploaded.
+	entt::observer lightObserver;  // Light and reflection probe entities added, changed or moved.
+	std::unordered_map<entt::entity, uint32_t> lightSlots;
+	std::vector<entt::entity> lightEntities;  // Owning entity of each light slot, null for free slots.
+	std::vector<std::pair<uint32_t, uint32_t>> pendingLightRanges;  // Freed slots not yet uploaded.
+	static constexpr uint32_t maxLights = 1024 * 64;
+	static constexpr uint32_t freeLightSlot = std::numeric_limits<uint32_t>::max();  // Light type of free slots.
+	float lightRangeCutoff = 0.f;  // Cutoff the uploaded lights derived their ranges with.
+	static constexpr uint32_t probeLightType = 4;  // LightType::Probe in Light.hlsli.
+	FreeListAllocator lightAllocator{ maxLights };
+	BufferHandle lightBuffer;
+
+	// Persistent scene records. Each mesh entity owns a transform slot and a contiguous range of instance slots, one per
+	// subset, and every instance references the entity's transform and a batch record shared by all instances drawing the
+	// same subset with the same material. Entity changes only patch their own records, moving an entity only its transform,
+	// the draw arguments and batched instance lists are then regenerated on the GPU. Materials are already persistent
+	// records in the material factory.
+	struct SceneEntity
+	{
+		uint32_t instanceOffset;
+		uint32_t transformIndex;
+		std::vector<uint32_t> batches;  // Batch record of each subset.
+	};
+
+	using BatchKey = std::tuple<uint32_t, uint32_t, uint32_t, uint32_t, uint32_t>;
 
+	struct BatchRecord
+	{
+		BatchKey key;
+		MeshIndirectArgument argument;  // Draw template, the instance offset and count are generated on the GPU.
+		uint32_t meshletCount;
+		uint32_t references;
+		uint32_t lodIndexOffset;  // In bytes, relative to the key's index offset.
+	};
+
+	entt::observer instanceObserver;  // Mesh entities added or changed, their records are reallocated.
+	entt::observer transformObserver;  // Mesh entities with recomputed world transforms, only their transforms are uploaded.
+	std::vector<entt::entity> movedEntities;  // Transformed last frame, uploaded again once their previous transform catches up.
+	bool instancesInvalidated = false;  // Set when records change, the draws are regenerated on the GPU.
+	bool batchesInvalidated = false;  // Set when batch records are created or freed, the buckets are laid out again.
+	size_t materialRevision = 0;  // Material factory revision the buckets were laid out with.
+	std::unordered_map<entt::entity, SceneEntity> sceneEntities;
+	std::vector<entt::entity> instanceEntities;  // Owning entity of each instance slot, null for free slots.
+	std::vector<std::pair<uint32_t, uint32_t>> pendingInstanceRanges;  // Allocated or freed slots not yet uploaded.
+	static constexpr size_t maxInstanceUploadRanges = 256;
+	static constexpr uint32_t maxInstances = 1024 * 1024 * 8;  // Slots are addressable up to here, buffers grow with the scene.
+	static constexpr uint32_t initialInstances = 1024 * 64;
+	FreeListAllocator instanceAllocator{ maxInstances };
+	std::vector<entt::entity> transformEntities;  // Owning entity of each transform slot, null for free slots.
+	std::vector<XMMATRIX> uploadedTransforms;  // Of each transform slot, becomes the previous frame's transform of the next upload.
+	std::vector<entt::entity> pendingTransformEntities;  // Added entities whose transforms aren't uploaded yet.
+	FreeListAllocator transformAllocator{ maxInstances };
+
+	std::map<BatchKey, uint32_t> batchLookup;
+	std::vector<BatchRecord> batchRecords;
+	D3D12_GPU_VIRTUAL_ADDRESS batchIndexBufferAddress = 0;  // Index buffer the batch records' index views point into.
+	static constexpr uint32_t maxBatches = 1024 * 1024;
+	static constexpr uint32_t initialBatches = 1024 * 4;
+	static constexpr uint32_t invalidBatch = std::numeric_limits<uint32_t>::max();
+	FreeListAllocator batchAllocator{ maxBatches };
+	BufferHandle batchRecordBuffer;
+	BufferHandle materialBucketBuffer;
+
+	RenderPipelineLayout sceneClearLayout;
+	RenderPipelineLayout sceneCountLayout;
+	RenderPipelineLayout sceneScanLayout;
+	RenderPipelineLayout sceneScatterLayout;
+	RenderPipelineLayout meshCullResetLayout;
 	RenderPipelineLayout meshCullLayout;
-	RenderPipelineLayout prepassLayout;
+	RenderPipelineLayout meshCullLateLayout;
+	RenderPipelineLayout meshCullImpostorResetLayout;
+	RenderPipelineLayout meshletCullLayout;
+	// Alpha tested in the buckets of materials with a base color, opaque otherwise.
+	std::array<RenderPipelineLayout, materialPermutations> prepassBucketLayouts;
+	std::array<RenderPipelineLayout, materialPermutations> visibilityPrepassBucketLayouts;
+	std::array<RenderPipelineLayout, materialPermutations> pickingPrepassBucketLayouts;  // Also writes object IDs, only used while a pick is pending.
+	RenderPipelineLayout visibilityShadingLayout;
 	RenderPipelineLayout forwardOpaqueLayout;
+	std::array<RenderPipelineLayout, materialPermutations> forwardOpaqueBucketLayouts;  // Specialized on the bucket's material features.
+	std::array<RenderPipelineLayout, materialPermutations> forwardTransparentBucketLayouts;  // Only the blended buckets are drawn.
+	RenderPipelineLayout transparencyCompositeLayout;
+	// Mesh shader variants, only used when supported by the device.
+	RenderPipelineLayout meshPrepassLayout;
+	RenderPipelineLayout meshPickingPrepassLayout;
+	RenderPipelineLayout meshForwardOpaqueLayout;
+	// Impostor quads, only drawn with the batched draws.
+	RenderPipelineLayout impostorPrepassLayout;
+	RenderPipelineLayout impostorPickingPrepassLayout;
+	RenderPipelineLayout impostorForwardLayout;
 	RenderPipelineLayout postProcessLayout;
+	RenderPipelineLayout pickingLayout;
+	bool halfPrecisionBrdf = false;  // The forward layouts were created with half precision direct lighting.
 
 	BufferHandle meshIndirectRenderArgs;
+	BufferHandle meshInstanceBuffer;
+	static constexpr uint32_t maxMeshletDraws = 1024 * 1024;
+	static constexpr uint32_t meshletGroupSize = 64;  // Meshlets per amplification group.
+
+	// Per-instance visibility bits from the late culling phase, the early phase draws what was visible last frame.
+	// Ping-ponged, since the late phase reads last frame's bits to skip instances the early phase already drew.
+	std::array<BufferHandle, 2> visibilityBuffers;
+	uint32_t visibilityBufferIndex = 0;
+
+	XMFLOAT2 lastFrameJitter = { 0.f, 0.f };
 
 	bool cameraFrozen = false;
 	XMMATRIX frozenView;
 	XMMATRIX frozenProjection;
 
 	bool shouldReloadShaders = false;
+	bool replaying = false;
+
+	// Scene pixel to pick the object of in the next frame. The object ID is copied out of the prepass and read back once
+	// the frame retires, then resolved to its entity through the instance slots.
+	std::optional<std::pair<uint32_t, uint32_t>> pendingPick;
+	std::function<void(entt::entity)> pickCallback;
+
+	// Quality is scaled back while the adapter's memory usage nears its budget, and restored once usage drops.
+	enum class MemoryPressure
+	{
+		None,
+		High,
+		Critical
+	};
+
+	MemoryPressure memoryPressure = MemoryPressure::None;
+	float restoredCloudRenderScale = 0.f;  // Cloud render scale before critical pressure reduced it.
+
+	// Dynamic resolution, scales the passes that render below output resolution to keep the GPU frame time on target.
+	float renderScale = 1.f;
+	uint32_t renderScaleCooldown = 0;  // Frames until the next adjustment, the measured frame time lags behind.
+
+	QualityGovernor qualityGovernor;  // Steps effect quality on top of dynamic resolution.
+
+	// Resolution the scene renders at, zero follows the back buffer. The editor renders the scene at its viewport size.
+	std::pair<uint32_t, uint32_t> sceneResolution = { 0, 0 };
+	std::pair<uint32_t, uint32_t> pendingSceneResolution = { 0, 0 };  // Applied between frames.
+
+	// Back buffer resizes are debounced, so dragging the window's border only resizes the swap chain once it settles.
+	struct PendingResolution
+	{
+		uint32_t width;
+		uint32_t height;
+		bool fullscreen;
+		std::chrono::steady_clock::time_point requestTime;
+	};
+
+	std::optional<PendingResolution> pendingResolution;
 
 private:
-	void CreateRootSignature();
-	std::vector<MeshRenderable> UpdateObjects(const entt::registry& registry);
-	void UpdateCameraBuffer(const entt::registry& registry);
+	MeshRenderable CreateRenderable(const MeshComponent& mesh, size_t subset) const;
+	BoundingBox ComputeWorldBounds(const WorldTransformComponent& transform, const MeshComponent& mesh) const;  // Encloses every subset.
+	ObjectData CreateObjectData(const MeshComponent& mesh, const MeshRenderable& renderable) const;
+	uint32_t AcquireBatch(const MeshRenderable& renderable);
+	void ReleaseBatch(uint32_t batch);
+	void AddInstances(const entt::registry& registry, entt::entity entity);  // Allocates the entity's instance slots and batches.
+	void RemoveInstances(entt::entity entity);
+	static void MergeUploadRanges(std::vector<std::pair<uint32_t, uint32_t>>& ranges, size_t maxRanges);  // Sorts and merges touching ranges.
+	void UpdateDirtyObjects(const entt::registry& registry);  // Uploads changed instance and transform slots.
+	void UpdateBatchLayout();  // Buckets the batch records by material permutation and uploads them.
+	void GrowSceneBuffers();  // Grows the persistent instance, transform and batch buffers to the allocated slots.
+	void OnMeshDestroyed(entt::registry& registry, entt::entity entity);
+	void UpdateCameraBuffer(const entt::registry& registry);  // Also builds the culling view of each camera.
+	static CullingView CreateCullingView(const Camera& camera, uint32_t hiZWidth, uint32_t hiZHeight, uint32_t hiZMipCount);
 	void CreatePipelines();
-	BufferHandle CreateLightBuffer(const entt::registry& registry);
+	static float ComputeLightRange(const LightComponent& light, float cutoff);
+	void UpdateLights(const entt::registry& registry);  // Assigns light slots and uploads changed lights.
+	void OnLightDestroyed(entt::registry& registry, entt::entity entity);
+	void UpdateMemoryPressure();  // Applies or reverts the memory budget responses.
+	void UpdateRenderScale();  // Steps the dynamic resolution scale towards the GPU frame time target.
 
 public:
 	~Renderer();
@@ -100,15 +311,34 @@ public:
 	uint32_t GetAppFrame() const;
 
 	std::pair<uint32_t, uint32_t> GetResolution() const;
+	// Requests a back buffer resolution, applied at the start of a frame once requests stop arriving for the debounce delay.
 	void SetResolution(uint32_t width, uint32_t height, bool fullscreen);
+	// Output resolution of the scene passes, at most the back buffer resolution.
+	std::pair<uint32_t, uint32_t> GetSceneResolution() const;
+	// Requests a scene resolution for the next frame, zero follows the back buffer.
+	void SetSceneResolution(uint32_t width, uint32_t height);
 
 	void FreezeCamera();
+	// Renders the same frame over and over for benchmarking GPU work in isolation. Time stands still, and texture streaming,
+	// mesh loads and the memory and resolution responses are held, so with an unchanged registry every frame records the
+	// same graph. The executed graph's timeline is captured meanwhile.
+	void SetReplaying(bool enabled) { replaying = enabled; }
+	bool IsReplaying() const noexcept { return replaying; }
+	const RenderGraphTimeline& GetGraphTimeline() const noexcept { return renderGraphResources.GetTimeline(); }
+	// Structure hash of the last built graph, frames with the same hash executed the same passes.
+	size_t GetGraphHash() const noexcept { return renderGraphResources.GetCompiledHash(); }
 	void ReloadShaderPipelines();
+	// Reads back the entity drawn at the scene pixel, the callback receives null for empty pixels. Resolves a few frames
+	// later on the main thread, a newer request replaces a pending one.
+	void RequestPick(uint32_t x, uint32_t y, std::function<void(entt::entity)> callback);
 	void ResetAppTime();
 };
 
 inline void Renderer::SubmitFrameTime(uint32_t timeUs)
 {
 	lastFrameTime = static_cast<float>(timeUs);
-	appTime += lastFrameTime * 0.001 * 0.001;
+	if (!replaying)
+	{
+		appTime += lastFrameTime * 0.001 * 0.001;
+	}
 }
\ No newline at end of file
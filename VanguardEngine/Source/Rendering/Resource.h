@@ -6,7 +6,9 @@
 #include <Rendering/DescriptorHeap.h>
 #include <Rendering/ResourceHandle.h>
 
+#include <array>
 #include <optional>
+#include <vector>
 
 // #TODO: Fix Windows.h leaking.
 #include <D3D12MemAlloc.h>
@@ -27,6 +29,7 @@ enum BindFlag
 	DepthStencil = 1 << 3,
 	ShaderResource = 1 << 4,
 	UnorderedAccess = 1 << 5,
+	AccelerationStructure = 1 << 6,  // Static byte buffers only viewed as a ray tracing acceleration structure.
 };
 
 enum AccessFlag
@@ -45,6 +48,17 @@ struct BufferDescription
 	size_t stride;
 	bool uavCounter = false;
 	std::optional<DXGI_FORMAT> format;
+	bool evictable = false;  // Static only, see ResourceManager::EvictIdle.
+};
+
+// Render targets and depth stencils are created with this value, clears with any other value miss the fast clear path.
+struct TextureClearValue
+{
+	std::array<float, 4> color = { 0.f, 0.f, 0.f, 1.f };
+	float depth = 0.f;  // Inverse Z.
+	uint8_t stencil = 0;
+
+	bool operator==(const TextureClearValue&) const = default;
 };
 
 struct TextureDescription
@@ -57,6 +71,23 @@ struct TextureDescription
 	DXGI_FORMAT format;
 	bool mipMapping = false;  // Enables support for multiple mip levels, does not automatically generate mips.
 	bool array = false;  // Determines if this texture is 3D or an array, depth must be >0. Texture cubes must be arrays.
+	bool cubeArray = false;  // Views the array as consecutive texture cubes, depth must be a multiple of 6.
+	bool reserved = false;  // Created without memory, mips are made resident with ResourceManager::SetResidentMips. Shader resource 2D textures only.
+	uint32_t swizzle = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;  // Of the shader resource view, for formats storing fewer channels.
+	TextureClearValue clearValue;  // Render targets and depth stencils only.
+	bool evictable = false;  // See ResourceManager::EvictIdle. Not reserved.
+};
+
+// Location in existing memory to create a resource in, used for memory aliasing.
+struct ResourcePlacement
+{
+	D3D12MA::Allocation* memory = nullptr;
+	uint64_t offset = 0;  // In bytes, local to the allocation.
+
+	bool operator==(const ResourcePlacement& other) const noexcept
+	{
+		return memory == other.memory && offset == other.offset;
+	}
 };
 
 struct BufferComponent
@@ -72,10 +103,20 @@ struct BufferComponent
 
 	BufferHandle counterBuffer;
 
+	void* mappedPtr = nullptr;  // Dynamic buffers are persistently mapped.
+
 	// #TODO: Remove.
 	ID3D12Resource* Native() { return allocation->GetResource(); }
 };
 
+// Tiles of memory from the resource manager's tile pool, mapped to reserved resources.
+struct TileRange
+{
+	uint32_t page = 0;
+	uint32_t offset = 0;  // In tiles, local to the page.
+	uint32_t count = 0;  // Zero if unmapped.
+};
+
 struct TextureComponent
 {
 	ResourcePtr<D3D12MA::Allocation> allocation;
@@ -88,6 +129,17 @@ struct TextureComponent
 	std::optional<DescriptorHandle> SRV;
 	// #TODO: UAV support.
 
+	std::optional<D3D12_CLEAR_VALUE> optimizedClearValue;  // Given at creation, unset for textures that can't be fast cleared.
+#if !BUILD_RELEASE
+	bool slowClearReported = false;
+#endif
+
+	std::vector<DescriptorHandle> mipUAVs;  // Mip 1 onwards, created on the first mip generation.
+
+	// Reserved textures only. Tiles mapped to each standard mip, then to the packed mips.
+	std::vector<TileRange> tileRanges;
+	uint32_t residentMip = 0;  // Most detailed resident mip, the SRV is clamped to it.
+
 	// #TODO: Remove.
 	ID3D12Resource* Native() { return allocation->GetResource(); }
 };
\ No newline at end of file
@@ -9,7 +9,9 @@ enum class ResourceBind
 	UAV,
 	DSV,
 	Indirect,
-	Common
+	Common,
+	AccelerationStructure,  // Built or traced, never transitions. Builds synchronize with their own barriers.
+	ShadingRate  // Shading rate image of a graphics pass, see CommandList::SetShadingRateImage().
 };
 
 enum class OutputBind
@@ -114,11 +114,59 @@ inline uint32_t GetResourceFormatSize(DXGI_FORMAT format)
 	case DXGI_FORMAT_B8G8R8X8_TYPELESS:
 	case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
 		return 32;
+
+	// Block compressed formats are the average size of a texel within a 4x4 block.
+	case DXGI_FORMAT_BC1_TYPELESS:
+	case DXGI_FORMAT_BC1_UNORM:
+	case DXGI_FORMAT_BC1_UNORM_SRGB:
+	case DXGI_FORMAT_BC4_TYPELESS:
+	case DXGI_FORMAT_BC4_UNORM:
+	case DXGI_FORMAT_BC4_SNORM:
+		return 4;
+
+	case DXGI_FORMAT_BC2_TYPELESS:
+	case DXGI_FORMAT_BC2_UNORM:
+	case DXGI_FORMAT_BC2_UNORM_SRGB:
+	case DXGI_FORMAT_BC3_TYPELESS:
+	case DXGI_FORMAT_BC3_UNORM:
+	case DXGI_FORMAT_BC3_UNORM_SRGB:
+	case DXGI_FORMAT_BC5_TYPELESS:
+	case DXGI_FORMAT_BC5_UNORM:
+	case DXGI_FORMAT_BC5_SNORM:
+	case DXGI_FORMAT_BC6H_TYPELESS:
+	case DXGI_FORMAT_BC6H_UF16:
+	case DXGI_FORMAT_BC6H_SF16:
+	case DXGI_FORMAT_BC7_TYPELESS:
+	case DXGI_FORMAT_BC7_UNORM:
+	case DXGI_FORMAT_BC7_UNORM_SRGB:
+		return 8;
 	}
 
 	return 0;
 }
 
+inline bool IsResourceFormatBlockCompressed(DXGI_FORMAT format)
+{
+	return format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM ||
+		format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB;
+}
+
+// Returns the size in bytes of a tightly packed row, which for block compressed formats is a row of 4x4 blocks.
+inline uint32_t GetResourceFormatRowSize(DXGI_FORMAT format, uint32_t width)
+{
+	if (IsResourceFormatBlockCompressed(format))
+	{
+		return ((width + 3) / 4) * GetResourceFormatSize(format) * 2;  // 16 texels per block.
+	}
+
+	return width * GetResourceFormatSize(format) / 8;
+}
+
+inline uint32_t GetResourceFormatRowCount(DXGI_FORMAT format, uint32_t height)
+{
+	return IsResourceFormatBlockCompressed(format) ? (height + 3) / 4 : height;
+}
+
 inline bool IsResourceFormatSRGB(DXGI_FORMAT format)
 {
 	switch (format)
@@ -136,6 +184,20 @@ inline bool IsResourceFormatSRGB(DXGI_FORMAT format)
 	}
 }
 
+inline bool IsResourceFormatStencil(DXGI_FORMAT format)
+{
+	switch (format)
+	{
+	case DXGI_FORMAT_R32G8X24_TYPELESS:
+	case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+	case DXGI_FORMAT_R24G8_TYPELESS:
+	case DXGI_FORMAT_D24_UNORM_S8_UINT:
+		return true;
+	default:
+		return false;
+	}
+}
+
 inline DXGI_FORMAT ConvertResourceFormatToSRGB(DXGI_FORMAT linearFormat)
 {
 	switch (linearFormat)
@@ -175,6 +237,7 @@ inline DXGI_FORMAT ConvertResourceFormatToTypedDepth(DXGI_FORMAT typelessDepthFo
 	{
 	case DXGI_FORMAT_R32_TYPELESS: return DXGI_FORMAT_D32_FLOAT;
 	case DXGI_FORMAT_R24G8_TYPELESS: return DXGI_FORMAT_D24_UNORM_S8_UINT;
+	case DXGI_FORMAT_R16_TYPELESS: return DXGI_FORMAT_D16_UNORM;
 	default: return typelessDepthFormat;
 	}
 }
@@ -186,6 +249,7 @@ inline DXGI_FORMAT ConvertResourceFormatToTypedNonDepth(DXGI_FORMAT typelessDept
 	{
 	case DXGI_FORMAT_R32_TYPELESS: return DXGI_FORMAT_R32_FLOAT;
 	case DXGI_FORMAT_R24G8_TYPELESS: return DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+	case DXGI_FORMAT_R16_TYPELESS: return DXGI_FORMAT_R16_UNORM;
 	default: return typelessDepthFormat;
 	}
 }
\ No newline at end of file
@@ -4,7 +4,8 @@
 
 #include <entt/entt.hpp>
 
-// Lightweight type safe generational handles for render resources.
+// Lightweight type safe generational handles for render resources. Each indexes its component's slot in the resource
+// manager, see SlotMap.
 
 struct BufferHandle
 {
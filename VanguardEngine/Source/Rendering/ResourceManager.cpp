@@ -12,6 +12,7 @@
 #include <cstring>
 #include <algorithm>
 #include <cmath>
+#include <mutex>
 
 size_t ResourceManager::ComputeBufferWidth(const BufferDescription& description) const
 {
@@ -49,6 +50,19 @@ void ResourceManager::CreateResourceViews(BufferComponent& target)
 		device->Native()->CreateShaderResourceView(target.Native(), &viewDesc, *target.SRV);
 	}
 
+	if (target.description.bindFlags & BindFlag::AccelerationStructure)
+	{
+		target.SRV = device->AllocateDescriptor(DescriptorType::Default);
+
+		D3D12_SHADER_RESOURCE_VIEW_DESC viewDesc{};
+		viewDesc.Format = DXGI_FORMAT_UNKNOWN;
+		viewDesc.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;
+		viewDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		viewDesc.RaytracingAccelerationStructure.Location = target.Native()->GetGPUVirtualAddress();
+
+		device->Native()->CreateShaderResourceView(nullptr, &viewDesc, *target.SRV);  // Located by address, the resource must be null.
+	}
+
 	if (target.description.bindFlags & BindFlag::UnorderedAccess)
 	{
 		target.UAV = device->AllocateDescriptor(DescriptorType::Default);
@@ -175,7 +189,18 @@ void ResourceManager::CreateResourceViews(TextureComponent& target)
 				viewDesc.Texture2D.MostDetailedMip = 0;
 				viewDesc.Texture2D.MipLevels = -1;
 				viewDesc.Texture2D.PlaneSlice = 0;
-				viewDesc.Texture2D.ResourceMinLODClamp = 0.f;
+				viewDesc.Texture2D.ResourceMinLODClamp = static_cast<float>(target.residentMip);
+				break;
+			}
+
+			else if (target.description.cubeArray)
+			{
+				viewDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBEARRAY;
+				viewDesc.TextureCubeArray.MostDetailedMip = 0;
+				viewDesc.TextureCubeArray.MipLevels = -1;
+				viewDesc.TextureCubeArray.First2DArrayFace = 0;
+				viewDesc.TextureCubeArray.NumCubes = target.description.depth / 6;
+				viewDesc.TextureCubeArray.ResourceMinLODClamp = 0.f;
 				break;
 			}
 
@@ -208,7 +233,7 @@ void ResourceManager::CreateResourceViews(TextureComponent& target)
 		default:
 			VGLogError(logRendering, "Shader resource views for textures in {} dimension is unsupported.", target.Native()->GetDesc().Dimension);
 		}
-		viewDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		viewDesc.Shader4ComponentMapping = target.description.swizzle;
 
 		device->Native()->CreateShaderResourceView(target.Native(), &viewDesc, *target.SRV);
 	}
@@ -231,6 +256,24 @@ void ResourceManager::SetResourceName(ResourcePtr<D3D12MA::Allocation>& target,
 #endif
 }
 
+HRESULT ResourceManager::CreatePlacedResource(const ResourcePlacement& placement, const D3D12_RESOURCE_DESC& resourceDesc, D3D12_RESOURCE_STATES state, const D3D12_CLEAR_VALUE* clearValue, D3D12MA::Allocation** allocation)
+{
+	ID3D12Resource* rawResource = nullptr;
+
+	const auto result = device->allocator->CreateAliasingResource(placement.memory, placement.offset, &resourceDesc, state, clearValue, IID_PPV_ARGS(&rawResource));
+	if (FAILED(result))
+	{
+		return result;
+	}
+
+	// Placed resources don't own their memory, so wrap them in a manual allocation like swap chain surfaces. The allocation
+	// takes over our reference to the resource.
+	*allocation = new D3D12MA::Allocation{ device->allocator->m_Pimpl, 0, 0, false };
+	(*allocation)->CreateManual(rawResource, device->allocator->m_Pimpl);
+
+	return result;
+}
+
 void ResourceManager::ReportBufferAllocation(const BufferHandle handle)
 {
 	const auto description = Get(handle).Native()->GetDesc();
@@ -242,6 +285,13 @@ void ResourceManager::ReportBufferAllocation(const BufferHandle handle)
 
 void ResourceManager::ReportTextureAllocation(const TextureHandle handle)
 {
+	// Reserved textures have no memory of their own, their tiles are reported as they're mapped.
+	if (Get(handle).description.reserved)
+	{
+		memoryInfo.textureCount++;
+		return;
+	}
+
 	const auto description = Get(handle).Native()->GetDesc();
 	const auto allocation = device->Native()->GetResourceAllocationInfo(0, 1, &description);
 
@@ -260,6 +310,12 @@ void ResourceManager::ReportBufferFree(const BufferHandle handle)
 
 void ResourceManager::ReportTextureFree(const TextureHandle handle)
 {
+	if (Get(handle).description.reserved)
+	{
+		memoryInfo.textureCount--;
+		return;
+	}
+
 	const auto description = Get(handle).Native()->GetDesc();
 	const auto allocation = device->Native()->GetResourceAllocationInfo(0, 1, &description);
 
@@ -267,87 +323,214 @@ void ResourceManager::ReportTextureFree(const TextureHandle handle)
 	memoryInfo.textureBytes -= allocation.SizeInBytes;
 }
 
-void ResourceManager::Initialize(RenderDevice* inDevice, size_t bufferedFrames)
+bool ResourceManager::CreateUploadPage(size_t size, UploadPage& page)
 {
-	VGScopedCPUStat("Resource Manager Initialize");
+	VGScopedCPUStat("Create Upload Page");
 
-	device = inDevice;
-	frameCount = bufferedFrames;
+	D3D12_RESOURCE_DESC resourceDesc{};
+	resourceDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	resourceDesc.Width = size;
+	resourceDesc.Height = 1;
+	resourceDesc.DepthOrArraySize = 1;
+	resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+	resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;  // Buffers are always row major.
+	resourceDesc.MipLevels = 1;
+	resourceDesc.SampleDesc.Count = 1;
+	resourceDesc.SampleDesc.Quality = 0;
+	resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
 
-	uploadResources.resize(frameCount);
-	uploadOffsets.resize(frameCount);
-	uploadPtrs.resize(frameCount);
+	D3D12MA::ALLOCATION_DESC allocationDesc{};
+	allocationDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
+	allocationDesc.Flags = D3D12MA::ALLOCATION_FLAG_NONE;
 
-	frameBuffers.resize(frameCount);
-	frameTextures.resize(frameCount);
-	frameDescriptors.resize(frameCount);
+	ID3D12Resource* rawResource = nullptr;
+	D3D12MA::Allocation* allocationHandle = nullptr;
 
-	constexpr auto uploadResourceSize = 1024 * 1024 * 512;
+	// Upload heap resources must always be in generic read state.
+	auto result = device->allocator->CreateResource(&allocationDesc, &resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, &allocationHandle, IID_PPV_ARGS(&rawResource));
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to allocate write upload resource: {}", result);
+
+		return false;
+	}
 
-	for (uint32_t i = 0; i < frameCount; ++i)
+	page.allocation = std::move(ResourcePtr<D3D12MA::Allocation>{ allocationHandle });
+	page.size = size;
+	page.offset = 0;
+
+	D3D12_RANGE range{ 0, 0 };
+
+	result = allocationHandle->GetResource()->Map(0, &range, &page.mappedPtr);
+	if (FAILED(result))
 	{
-		D3D12_RESOURCE_DESC resourceDesc{};
-		resourceDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
-		resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		resourceDesc.Width = uploadResourceSize;
-		resourceDesc.Height = 1;
-		resourceDesc.DepthOrArraySize = 1;
-		resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
-		resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;  // Buffers are always row major.
-		resourceDesc.MipLevels = 1;
-		resourceDesc.SampleDesc.Count = 1;
-		resourceDesc.SampleDesc.Quality = 0;
-		resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+		VGLogError(logRendering, "Failed to map upload resource: {}", result);
 
-		D3D12MA::ALLOCATION_DESC allocationDesc{};
-		allocationDesc.HeapType = D3D12_HEAP_TYPE_UPLOAD;
-		allocationDesc.Flags = D3D12MA::ALLOCATION_FLAG_NONE;
+		return false;
+	}
 
-		ID3D12Resource* rawResource = nullptr;
-		D3D12MA::Allocation* allocationHandle = nullptr;
+	SetResourceName(page.allocation, VGText("Upload page"));
 
-		// Upload heap resources must always be in generic read state.
-		auto result = device->allocator->CreateResource(&allocationDesc, &resourceDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, &allocationHandle, IID_PPV_ARGS(&rawResource));
-		if (FAILED(result))
-		{
-			VGLogError(logRendering, "Failed to allocate write upload resource: {}", result);
+	return true;
+}
 
-			continue;
-		}
+std::pair<UploadPage*, size_t> ResourceManager::AllocateUpload(size_t size, size_t alignment)
+{
+	auto& pages = frameUploadPages[device->GetFrameIndex()];
 
-		D3D12_RANGE range{ 0, 0 };
+	if (pages.size())
+	{
+		auto& page = pages.back();
+		const auto offset = AlignedSize(page.offset, alignment);
 
-		result = allocationHandle->GetResource()->Map(0, &range, &uploadPtrs[i]);
-		if (FAILED(result))
+		if (offset + size <= page.size)
 		{
-			VGLogError(logRendering, "Failed to map upload resource: {}", result);
+			page.offset = offset + size;
 
-			continue;
+			return { &page, offset };
 		}
+	}
 
-		uploadResources[i] = std::move(ResourcePtr<D3D12MA::Allocation>{ allocationHandle });
+	// The current page is exhausted, move on to a free page that fits, or create a new one. Pages start at offset zero,
+	// which satisfies any upload alignment.
+	UploadPage page;
+
+	const auto freePage = std::find_if(freeUploadPages.begin(), freeUploadPages.end(), [size](const auto& page) { return page.size >= size; });
+	if (freePage != freeUploadPages.end())
+	{
+		page = std::move(*freePage);
+		freeUploadPages.erase(freePage);
+	}
 
-		SetResourceName(uploadResources[i], VGText("Upload heap"));
+	else if (!CreateUploadPage(std::max(uploadPageSize, AlignedSize(size, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT)), page))
+	{
+		return { nullptr, 0 };
 	}
 
+	page.offset = size;
+
+	return { &pages.emplace_back(std::move(page)), 0 };
+}
+
+bool ResourceManager::UseCopyQueue(entt::entity resource, D3D12_RESOURCE_STATES state, size_t size) const
+{
+	// Resources already used by the direct list this frame must stay there, the copy queue executes ahead of it.
+	return size >= copyQueueWriteSize && freshResources.contains(resource) && (state == D3D12_RESOURCE_STATE_COPY_DEST || state == D3D12_RESOURCE_STATE_COMMON);
+}
+
+ResourceManager::~ResourceManager()
+{
+	// The allocator must outlive any releases still in flight.
+	JobSystem::Get().Wait(releaseCounter);
+}
+
+void ResourceManager::Initialize(RenderDevice* inDevice, size_t bufferedFrames)
+{
+	VGScopedCPUStat("Resource Manager Initialize");
+
+	device = inDevice;
+	frameCount = bufferedFrames;
+
+	frameUploadPages.resize(frameCount);
+
+	frameBuffers.resize(frameCount);
+	frameTextures.resize(frameCount);
+	frameDescriptors.resize(frameCount);
+	frameAllocations.resize(frameCount);
+	frameTileReleases.resize(frameCount);
+	frameReadbacks.resize(frameCount);
+	readbackOffsets.resize(frameCount);
+
 	mipmapper.Initialize(*device);
+
+	const auto result = device->Native()->CreateFence(residencyFenceValue, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(residencyFence.Indirect()));
+	if (FAILED(result))
+	{
+		VGLogCritical(logRendering, "Failed to create residency fence: {}", result);
+	}
 }
 
-const BufferHandle ResourceManager::Create(const BufferDescription& description, const std::wstring_view name)
+ResourcePtr<D3D12MA::Allocation> ResourceManager::AllocateMemory(const D3D12_RESOURCE_ALLOCATION_INFO& info, D3D12_HEAP_FLAGS heapFlags, const std::wstring_view name)
 {
-	VGScopedCPUStat("Create Buffer");
+	VGScopedCPUStat("Allocate Memory");
 
-	// Early validation.
-	VGAssert(description.size > 0, "Failed to create buffer, must have non-zero size.");
-	if (description.bindFlags & BindFlag::ConstantBuffer)
+	D3D12MA::ALLOCATION_DESC allocationDesc{};
+	allocationDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+	allocationDesc.ExtraHeapFlags = heapFlags;
+	allocationDesc.Flags = D3D12MA::ALLOCATION_FLAG_COMMITTED;  // Memory blocks are typically large, give them their own heap.
+
+	D3D12MA::Allocation* allocationHandle = nullptr;
+
+	const auto result = device->allocator->AllocateMemory(&allocationDesc, &info, &allocationHandle);
+	if (FAILED(result))
 	{
-		VGAssert(ComputeBufferWidth(description) <= 65536, "Failed to create buffer, size of %zu exceeds maximum for a constant buffer.", ComputeBufferWidth(description));
+		VGLogError(logRendering, "Failed to allocate memory: {}", result);
+
+		return {};
 	}
-	if (description.uavCounter)
+
+	VGLog(logRendering, "Allocated {} MB memory block '{}'.", info.SizeInBytes / (1024 * 1024), name);
+
+#if !BUILD_RELEASE
+	allocationHandle->SetName(name.data());
+#endif
+
+	return ResourcePtr<D3D12MA::Allocation>{ allocationHandle };
+}
+
+ResourcePtr<D3D12MA::Allocation> ResourceManager::AllocateReadback(size_t size, const std::wstring_view name)
+{
+	VGScopedCPUStat("Allocate Readback");
+
+	D3D12_RESOURCE_DESC resourceDesc{};
+	resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	resourceDesc.Width = size;
+	resourceDesc.Height = 1;
+	resourceDesc.DepthOrArraySize = 1;
+	resourceDesc.MipLevels = 1;
+	resourceDesc.Format = DXGI_FORMAT_UNKNOWN;
+	resourceDesc.SampleDesc.Count = 1;
+	resourceDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	resourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+	D3D12MA::ALLOCATION_DESC allocationDesc{};
+	allocationDesc.HeapType = D3D12_HEAP_TYPE_READBACK;
+	allocationDesc.Flags = D3D12MA::ALLOCATION_FLAG_NONE;
+
+	ID3D12Resource* rawResource = nullptr;
+	D3D12MA::Allocation* allocationHandle = nullptr;
+
+	const auto result = device->allocator->CreateResource(&allocationDesc, &resourceDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, &allocationHandle, IID_PPV_ARGS(&rawResource));
+	if (FAILED(result))
 	{
-		VGAssert(description.bindFlags & BindFlag::UnorderedAccess, "Buffer cannot have a UAV counter without also having the unordered access bind flag.");
+		VGLogError(logRendering, "Failed to allocate readback buffer: {}", result);
+
+		return {};
 	}
 
+	rawResource->Release();  // The allocation holds its own reference.
+
+	ResourcePtr<D3D12MA::Allocation> allocation{ allocationHandle };
+	SetResourceName(allocation, name);
+
+	return allocation;
+}
+
+D3D12_RESOURCE_ALLOCATION_INFO ResourceManager::GetAllocationInfo(const BufferDescription& description) const
+{
+	const auto resourceDesc = CreateResourceDescription(description);
+	return device->Native()->GetResourceAllocationInfo(0, 1, &resourceDesc);
+}
+
+D3D12_RESOURCE_ALLOCATION_INFO ResourceManager::GetAllocationInfo(const TextureDescription& description) const
+{
+	const auto resourceDesc = CreateResourceDescription(description);
+	return device->Native()->GetResourceAllocationInfo(0, 1, &resourceDesc);
+}
+
+D3D12_RESOURCE_DESC ResourceManager::CreateResourceDescription(const BufferDescription& description) const
+{
 	D3D12_RESOURCE_DESC resourceDesc{};
 	resourceDesc.Alignment = 0;  // Let the device determine the alignment, see: https://docs.microsoft.com/en-us/windows/win32/api/d3d12/ns-d3d12-d3d12_resource_desc#alignment
 	resourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
@@ -367,7 +550,7 @@ const BufferHandle ResourceManager::Create(const BufferDescription& description,
 		resourceDesc.Width = AlignedSize(resourceDesc.Width, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 	}
 
-	if (description.bindFlags & BindFlag::UnorderedAccess)
+	if (description.bindFlags & (BindFlag::UnorderedAccess | BindFlag::AccelerationStructure))
 	{
 		resourceDesc.Flags |= D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
 	}
@@ -378,9 +561,41 @@ const BufferHandle ResourceManager::Create(const BufferDescription& description,
 		resourceDesc.Flags |= D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
 	}
 
+	return resourceDesc;
+}
+
+const BufferHandle ResourceManager::Create(const BufferDescription& description, const std::wstring_view name, const std::optional<ResourcePlacement>& placement)
+{
+	VGScopedCPUStat("Create Buffer");
+
+	// Early validation.
+	VGAssert(description.size > 0, "Failed to create buffer, must have non-zero size.");
+	if (description.bindFlags & BindFlag::ConstantBuffer)
+	{
+		VGAssert(ComputeBufferWidth(description) <= 65536, "Failed to create buffer, size of %zu exceeds maximum for a constant buffer.", ComputeBufferWidth(description));
+	}
+	if (description.uavCounter)
+	{
+		VGAssert(description.bindFlags & BindFlag::UnorderedAccess, "Buffer cannot have a UAV counter without also having the unordered access bind flag.");
+	}
+	if (placement)
+	{
+		VGAssert(description.updateRate == ResourceFrequency::Static, "Failed to create buffer, only static buffers can be placed.");
+	}
+	if (description.bindFlags & BindFlag::AccelerationStructure)
+	{
+		VGAssert(description.updateRate == ResourceFrequency::Static && description.bindFlags == BindFlag::AccelerationStructure, "Failed to create buffer, acceleration structures must be static and have no other views.");
+	}
+	if (description.evictable)
+	{
+		VGAssert(description.updateRate == ResourceFrequency::Static && !placement, "Failed to create buffer, only static buffers in their own heap can be evicted.");
+	}
+
+	const auto resourceDesc = CreateResourceDescription(description);
+
 	D3D12MA::ALLOCATION_DESC allocationDesc{};
 	allocationDesc.HeapType = description.updateRate == ResourceFrequency::Static ? D3D12_HEAP_TYPE_DEFAULT : D3D12_HEAP_TYPE_UPLOAD;
-	allocationDesc.Flags = D3D12MA::ALLOCATION_FLAG_NONE;
+	allocationDesc.Flags = description.evictable ? D3D12MA::ALLOCATION_FLAG_COMMITTED : D3D12MA::ALLOCATION_FLAG_NONE;
 
 	auto resourceState = D3D12_RESOURCE_STATE_COPY_DEST;
 
@@ -389,10 +604,18 @@ const BufferHandle ResourceManager::Create(const BufferDescription& description,
 		resourceState = D3D12_RESOURCE_STATE_GENERIC_READ;
 	}
 
+	// Acceleration structures can never leave their state.
+	else if (description.bindFlags & BindFlag::AccelerationStructure)
+	{
+		resourceState = D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE;
+	}
+
 	ID3D12Resource* rawResource = nullptr;
 	D3D12MA::Allocation* allocationHandle = nullptr;
 
-	auto result = device->allocator->CreateResource(&allocationDesc, &resourceDesc, resourceState, nullptr, &allocationHandle, IID_PPV_ARGS(&rawResource));
+	auto result = placement ?
+		CreatePlacedResource(*placement, resourceDesc, resourceState, nullptr, &allocationHandle) :
+		device->allocator->CreateResource(&allocationDesc, &resourceDesc, resourceState, nullptr, &allocationHandle, IID_PPV_ARGS(&rawResource));
 	if (FAILED(result))
 	{
 		VGLogError(logRendering, "Failed to allocate buffer: {}", result);
@@ -400,15 +623,36 @@ const BufferHandle ResourceManager::Create(const BufferDescription& description,
 		return { entt::null };
 	}
 
-	rawResource->Release();  // D3D12MA adds it's own ref, but we're not interested in maintaining both the allocation and the resource.
+	if (rawResource)
+	{
+		rawResource->Release();  // D3D12MA adds it's own ref, but we're not interested in maintaining both the allocation and the resource.
+	}
 
 	BufferComponent bufferComponent;
 	bufferComponent.allocation.Reset(allocationHandle);
 	bufferComponent.state = resourceState;
 	bufferComponent.description = description;
 
-	const auto handle = BufferHandle{ registry.create() };
-	registry.emplace<BufferComponent>(handle.handle, std::move(bufferComponent));
+	// Upload heap resources can stay mapped for their whole lifetime, so map dynamic buffers once instead of per write.
+	if (description.updateRate == ResourceFrequency::Dynamic && description.accessFlags & AccessFlag::CPUWrite)
+	{
+		D3D12_RANGE readRange{ 0, 0 };  // We don't want to read any data here, so set the end range equal to the begin range.
+
+		result = allocationHandle->GetResource()->Map(0, &readRange, &bufferComponent.mappedPtr);
+		if (FAILED(result))
+		{
+			VGLogError(logRendering, "Failed to map dynamic buffer: {}", result);
+
+			bufferComponent.mappedPtr = nullptr;
+		}
+	}
+
+	const auto handle = BufferHandle{ buffers.Insert(std::move(bufferComponent)) };
+
+	if (!placement)
+	{
+		freshResources.emplace(handle.handle);  // Placed resources share memory that could still be in use.
+	}
 
 	auto& component = Get(handle);
 
@@ -417,17 +661,16 @@ const BufferHandle ResourceManager::Create(const BufferDescription& description,
 
 	ReportBufferAllocation(handle);
 
+	if (description.evictable)
+	{
+		TrackResidency(handle.handle, component.Native(), component.allocation->GetSize());
+	}
+
 	return handle;
 }
 
-const TextureHandle ResourceManager::Create(const TextureDescription& description, const std::wstring_view name)
+D3D12_RESOURCE_DESC ResourceManager::CreateResourceDescription(const TextureDescription& description) const
 {
-	VGScopedCPUStat("Create Texture");
-
-	// Early validation.
-	VGAssert(description.width > 0 && description.height > 0 && description.depth > 0, "Failed to create texture, must have non-zero dimensions.");
-	VGAssert(!description.array || description.depth > 0, "Failed to create texture, array textures must have non-zero depth.");
-
 	D3D12_RESOURCE_DESC resourceDesc{};
 	resourceDesc.Alignment = 0;  // Let the device determine the alignment, see: https://docs.microsoft.com/en-us/windows/win32/api/d3d12/ns-d3d12-d3d12_resource_desc#alignment
 	resourceDesc.Dimension = description.height > 1 ? (description.depth > 1 && !description.array ? D3D12_RESOURCE_DIMENSION_TEXTURE3D : D3D12_RESOURCE_DIMENSION_TEXTURE2D) : D3D12_RESOURCE_DIMENSION_TEXTURE1D;
@@ -464,17 +707,57 @@ const TextureHandle ResourceManager::Create(const TextureDescription& descriptio
 		}
 	}
 
-	// Mipmapping requires a UAV.
-	if (description.bindFlags & BindFlag::UnorderedAccess || description.mipMapping)
+	// Mipmapping requires a UAV. Block compressed formats can't be written to, their mips are always written from the CPU.
+	if (description.bindFlags & BindFlag::UnorderedAccess || (description.mipMapping && !IsResourceFormatBlockCompressed(description.format)))
 	{
 		resourceDesc.Flags |= D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
 	}
 
+	return resourceDesc;
+}
+
+std::optional<D3D12_CLEAR_VALUE> ResourceManager::CreateClearValue(const TextureDescription& description) const
+{
+	D3D12_CLEAR_VALUE clearValue{};
+
+	if (description.bindFlags & BindFlag::RenderTarget)
+	{
+		clearValue.Format = description.format;
+		std::copy(description.clearValue.color.begin(), description.clearValue.color.end(), clearValue.Color);
+
+		return clearValue;
+	}
+
+	if (description.bindFlags & BindFlag::DepthStencil)
+	{
+		// We can't have a typeless clear value, so convert the format if needed.
+		clearValue.Format = ConvertResourceFormatToTypedDepth(description.format);
+		clearValue.DepthStencil.Depth = description.clearValue.depth;
+		clearValue.DepthStencil.Stencil = description.clearValue.stencil;
+
+		return clearValue;
+	}
+
+	return std::nullopt;
+}
+
+const TextureHandle ResourceManager::Create(const TextureDescription& description, const std::wstring_view name, const std::optional<ResourcePlacement>& placement)
+{
+	VGScopedCPUStat("Create Texture");
+
+	// Early validation.
+	VGAssert(description.width > 0 && description.height > 0 && description.depth > 0, "Failed to create texture, must have non-zero dimensions.");
+	VGAssert(!description.array || description.depth > 0, "Failed to create texture, array textures must have non-zero depth.");
+	VGAssert(!description.cubeArray || (description.array && description.depth % 6 == 0), "Failed to create texture, cube arrays must be arrays of whole cubes.");
+	VGAssert(!description.evictable || (!description.reserved && !placement), "Failed to create texture, only textures in their own heap can be evicted.");
+
+	const auto resourceDesc = CreateResourceDescription(description);
+
 	D3D12MA::ALLOCATION_DESC allocationDesc{};
 	allocationDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
 	allocationDesc.Flags = D3D12MA::ALLOCATION_FLAG_NONE;
 
-	if (description.bindFlags & BindFlag::RenderTarget)
+	if (description.bindFlags & BindFlag::RenderTarget || description.evictable)
 	{
 		// Render targets deserve their own partition. #TODO: Only apply this flag if the render target resolution is >=50% of the full screen resolution?
 		allocationDesc.Flags |= D3D12MA::ALLOCATION_FLAG_COMMITTED;
@@ -497,38 +780,33 @@ const TextureHandle ResourceManager::Create(const TextureDescription& descriptio
 	ID3D12Resource* rawResource = nullptr;
 	D3D12MA::Allocation* allocationHandle = nullptr;
 
-	D3D12_CLEAR_VALUE clearValue{};
-	bool useClearValue = false;
-
-	if (description.bindFlags & BindFlag::RenderTarget)
-	{
-		useClearValue = true;
+	const auto clearValue = CreateClearValue(description);
+	const bool useClearValue = clearValue.has_value();
 
-		clearValue.Format = description.format;
-		clearValue.Color[0] = 0.f;
-		clearValue.Color[1] = 0.f;
-		clearValue.Color[2] = 0.f;
-		clearValue.Color[3] = 1.f;
-	}
+	HRESULT result;
 
-	else if (description.bindFlags & BindFlag::DepthStencil)
+	if (description.reserved)
 	{
-		useClearValue = true;
-
-		clearValue.Format = description.format;
+		VGAssert(!placement, "Failed to create texture, reserved textures can't be placed.");
+		VGAssert(description.bindFlags == BindFlag::ShaderResource && description.depth == 1 && device->SupportsReservedResources(), "Failed to create texture, reserved textures must be 2D shader resources.");
 
-		// We can't have a typeless clear value, so convert the format if needed.
-		switch (clearValue.Format)
+		// Reserved resources only reserve address space, so wrap them in a manual allocation like placed resources.
+		result = device->Native()->CreateReservedResource(&resourceDesc, resourceState, nullptr, IID_PPV_ARGS(&rawResource));
+		if (SUCCEEDED(result))
 		{
-		case DXGI_FORMAT_R32_TYPELESS: clearValue.Format = DXGI_FORMAT_D32_FLOAT; break;
-		case DXGI_FORMAT_R24G8_TYPELESS: clearValue.Format = DXGI_FORMAT_D24_UNORM_S8_UINT; break;
+			allocationHandle = new D3D12MA::Allocation{ device->allocator->m_Pimpl, 0, 0, false };
+			allocationHandle->CreateManual(rawResource, device->allocator->m_Pimpl);
+			rawResource = nullptr;  // The allocation took over our reference.
 		}
+	}
 
-		clearValue.DepthStencil.Depth = 0.f;  // Inverse Z.
-		clearValue.DepthStencil.Stencil = 0;
+	else
+	{
+		result = placement ?
+			CreatePlacedResource(*placement, resourceDesc, resourceState, useClearValue ? &*clearValue : nullptr, &allocationHandle) :
+			device->allocator->CreateResource(&allocationDesc, &resourceDesc, resourceState, useClearValue ? &*clearValue : nullptr, &allocationHandle, IID_PPV_ARGS(&rawResource));
 	}
 
-	auto result = device->allocator->CreateResource(&allocationDesc, &resourceDesc, resourceState, useClearValue ? &clearValue : nullptr, &allocationHandle, IID_PPV_ARGS(&rawResource));
 	if (FAILED(result))
 	{
 		VGLogError(logRendering, "Failed to allocate texture: {}", result);
@@ -536,15 +814,28 @@ const TextureHandle ResourceManager::Create(const TextureDescription& descriptio
 		return { entt::null };
 	}
 
-	rawResource->Release();  // D3D12MA adds it's own ref, but we're not interested in maintaining both the allocation and the resource.
+	if (rawResource)
+	{
+		rawResource->Release();  // D3D12MA adds it's own ref, but we're not interested in maintaining both the allocation and the resource.
+	}
 
 	TextureComponent textureComponent;
 	textureComponent.allocation.Reset(allocationHandle);
 	textureComponent.state = resourceState;
 	textureComponent.description = description;
+	textureComponent.optimizedClearValue = clearValue;
+
+	if (description.reserved)
+	{
+		textureComponent.residentMip = textureComponent.Native()->GetDesc().MipLevels - 1;  // Nothing is resident yet.
+	}
+
+	const auto handle = TextureHandle{ textures.Insert(std::move(textureComponent)) };
 
-	const auto handle = TextureHandle{ registry.create() };
-	registry.emplace<TextureComponent>(handle.handle, std::move(textureComponent));
+	if (!placement)
+	{
+		freshResources.emplace(handle.handle);  // Placed resources share memory that could still be in use.
+	}
 
 	auto& component = Get(handle);
 
@@ -553,19 +844,49 @@ const TextureHandle ResourceManager::Create(const TextureDescription& descriptio
 
 	ReportTextureAllocation(handle);
 
+	if (description.evictable)
+	{
+		TrackResidency(handle.handle, component.Native(), component.allocation->GetSize());
+	}
+
 	return handle;
 }
 
-const TextureHandle ResourceManager::CreateFromSwapChain(void* surface, const std::wstring_view name)
+D3D12_CLEAR_VALUE ResourceManager::GetClearValue(TextureHandle handle)
 {
-	VGScopedCPUStat("Create From Swap Chain");
+	auto& component = Get(handle);
+	const auto clearValue = CreateClearValue(component.description);
 
-	TextureDescription description{};
-	description.bindFlags = BindFlag::RenderTarget;
-	description.accessFlags = AccessFlag::GPUWrite;
-	description.width = device->renderWidth;
-	description.height = device->renderHeight;
-	description.depth = 1;
+	VGAssert(clearValue, "Only render targets and depth stencils can be cleared.");
+
+#if !BUILD_RELEASE
+	const auto& optimized = component.optimizedClearValue;
+	const bool fast = optimized && optimized->Format == clearValue->Format && (component.description.bindFlags & BindFlag::RenderTarget ?
+		std::equal(std::begin(optimized->Color), std::end(optimized->Color), std::begin(clearValue->Color)) :
+		optimized->DepthStencil.Depth == clearValue->DepthStencil.Depth && optimized->DepthStencil.Stencil == clearValue->DepthStencil.Stencil);
+
+	if (!fast && !component.slowClearReported)
+	{
+		component.slowClearReported = true;
+
+		const auto name = component.allocation->GetName();
+		VGLogWarning(logRendering, "Clear of '{}' won't be a fast clear, the clear value differs from the one given at creation.", std::wstring_view{ name ? name : L"" });
+	}
+#endif
+
+	return *clearValue;
+}
+
+const TextureHandle ResourceManager::CreateFromSwapChain(void* surface, const std::wstring_view name)
+{
+	VGScopedCPUStat("Create From Swap Chain");
+
+	TextureDescription description{};
+	description.bindFlags = BindFlag::RenderTarget;
+	description.accessFlags = AccessFlag::GPUWrite;
+	description.width = device->renderWidth;
+	description.height = device->renderHeight;
+	description.depth = 1;
 	description.format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;  // SRGB swap chain.
 
 	TextureComponent textureComponent;
@@ -573,8 +894,7 @@ const TextureHandle ResourceManager::CreateFromSwapChain(void* surface, const st
 	textureComponent.state = D3D12_RESOURCE_STATE_COMMON;  // Swap chain back buffers always start out in the common state.
 	textureComponent.description = description;
 
-	const auto handle = TextureHandle{ registry.create() };
-	registry.emplace<TextureComponent>(handle.handle, std::move(textureComponent));
+	const auto handle = TextureHandle{ textures.Insert(std::move(textureComponent)) };
 
 	auto& component = Get(handle);
 
@@ -588,8 +908,21 @@ const TextureHandle ResourceManager::CreateFromSwapChain(void* surface, const st
 	return handle;
 }
 
-void ResourceManager::Write(BufferHandle target, const std::vector<uint8_t>& source, size_t targetOffset)
+void ResourceManager::Write(BufferHandle target, std::span<const std::byte> source, size_t targetOffset)
+{
+	auto* destination = ReserveWrite(target, source.size(), targetOffset);
+	if (destination)
+	{
+		std::memcpy(destination, source.data(), source.size());
+	}
+}
+
+void* ResourceManager::ReserveWrite(BufferHandle target, size_t size, size_t targetOffset)
 {
+	std::scoped_lock scopedLock{ lock };
+
+	TouchResidency(target.handle);
+
 	auto& component = Get(target);
 
 	if (component.description.updateRate == ResourceFrequency::Static)
@@ -597,26 +930,43 @@ void ResourceManager::Write(BufferHandle target, const std::vector<uint8_t>& sou
 		VGScopedCPUStat("Buffer Write Static");
 
 		VGAssert(component.description.accessFlags & AccessFlag::CPUWrite, "Failed to write to static buffer, no CPU write access.");
-		VGAssert(ComputeBufferWidth(component.description) - targetOffset >= source.size(),
-			"Failed to write to static buffer, source buffer is larger than target. Buffer width: %ull, source size: %ull, offset: %ull", ComputeBufferWidth(component.description), source.size(), targetOffset);
+		VGAssert(ComputeBufferWidth(component.description) - targetOffset >= size,
+			"Failed to write to static buffer, source buffer is larger than target. Buffer width: %ull, source size: %ull, offset: %ull", ComputeBufferWidth(component.description), size, targetOffset);
 
-		const auto frameIndex = device->GetFrameIndex();
-
-		VGAssert(uploadOffsets[frameIndex] + source.size() <= uploadResources[frameIndex]->GetResource()->GetDesc().Width, "Failed to write to static buffer, exhausted frame upload heap.");
+		const auto [uploadPage, uploadOffset] = AllocateUpload(size, 1);
+		if (!uploadPage)
+		{
+			VGLogError(logRendering, "Failed to write to static buffer, couldn't allocate upload memory.");
 
-		std::memcpy(static_cast<uint8_t*>(uploadPtrs[frameIndex]) + uploadOffsets[frameIndex], source.data(), source.size());
+			return nullptr;
+		}
 
-		// Ensure we're in the proper state.
-		if (component.state != D3D12_RESOURCE_STATE_COPY_DEST)
+		// The copy only executes once the frame is submitted, so it can be recorded before the upload memory is filled.
+		if (UseCopyQueue(target.handle, component.state, size))
 		{
-			device->GetDirectList().TransitionBarrier(target, D3D12_RESOURCE_STATE_COPY_DEST);
-			device->GetDirectList().FlushBarriers();
+			device->GetCopyList().Native()->CopyBufferRegion(component.Native(), targetOffset, uploadPage->allocation->GetResource(), uploadOffset, size);
+			device->copyListPending = true;
+
+			// Resources used on the copy queue decay to the common state once the copy finishes, before any direct queue use.
+			component.state = D3D12_RESOURCE_STATE_COMMON;
 		}
 
-		auto* targetCommandList = device->GetDirectList().Native();  // Small writes are more efficiently performed on the direct/compute queue.
-		targetCommandList->CopyBufferRegion(component.Native(), targetOffset, uploadResources[frameIndex]->GetResource(), uploadOffsets[frameIndex], source.size());
+		else
+		{
+			freshResources.erase(target.handle);
 
-		uploadOffsets[frameIndex] += source.size();
+			// Ensure we're in the proper state.
+			if (component.state != D3D12_RESOURCE_STATE_COPY_DEST)
+			{
+				device->GetDirectList().TransitionBarrier(target, D3D12_RESOURCE_STATE_COPY_DEST);
+				device->GetDirectList().FlushBarriers();
+			}
+
+			auto* targetCommandList = device->GetDirectList().Native();  // Small writes are more efficiently performed on the direct/compute queue.
+			targetCommandList->CopyBufferRegion(component.Native(), targetOffset, uploadPage->allocation->GetResource(), uploadOffset, size);
+		}
+
+		return static_cast<uint8_t*>(uploadPage->mappedPtr) + uploadOffset;
 	}
 
 	else
@@ -625,61 +975,91 @@ void ResourceManager::Write(BufferHandle target, const std::vector<uint8_t>& sou
 
 		VGAssert(component.state == D3D12_RESOURCE_STATE_GENERIC_READ, "Dynamic buffers must always be in the generic read state.");
 		VGAssert(component.description.accessFlags & AccessFlag::CPUWrite, "Failed to write to dynamic buffer, no CPU write access.");
-		VGAssert(ComputeBufferWidth(component.description) - targetOffset >= source.size(),
-			"Failed to write to dynamic buffer, source is larger than target. Buffer width: %ull, source size: %ull, offset: %ull", ComputeBufferWidth(component.description), source.size(), targetOffset);
+		VGAssert(ComputeBufferWidth(component.description) - targetOffset >= size,
+			"Failed to write to dynamic buffer, source is larger than target. Buffer width: %ull, source size: %ull, offset: %ull", ComputeBufferWidth(component.description), size, targetOffset);
 
-		void* mappedPtr = nullptr;
-
-		D3D12_RANGE readRange{ 0, 0 };  // We don't want to read any data here, so set the end range equal to the begin range.
-		D3D12_RANGE writeRange{ targetOffset, targetOffset + source.size() };
-
-		auto result = component.Native()->Map(0, &readRange, &mappedPtr);
-		if (FAILED(result))
+		if (!component.mappedPtr)
 		{
-			VGLogError(logRendering, "Failed to map buffer resource during resource write: {}", result);
+			VGLogError(logRendering, "Failed to write to dynamic buffer, buffer isn't mapped.");
 
-			return;
+			return nullptr;
 		}
 
-		auto* offsetMappedPtr = static_cast<uint8_t*>(mappedPtr) + targetOffset;
-		std::memcpy(offsetMappedPtr, source.data(), source.size());
+		return static_cast<uint8_t*>(component.mappedPtr) + targetOffset;
+	}
+}
 
-		component.Native()->Unmap(0, &writeRange);
+bool ResourceManager::Grow(BufferHandle& target, size_t size, const std::wstring_view name)
+{
+	auto description = Get(target).description;
+	if (size <= description.size)
+	{
+		return false;
 	}
+
+	VGScopedCPUStat("Grow Buffer");
+	VGAssert(description.updateRate == ResourceFrequency::Static, "Only static buffers can grow, dynamic buffers are rewritten every frame.");
+
+	const auto previous = target;
+	const auto previousWidth = ComputeBufferWidth(description);
+	description.size = std::max(size, description.size * 2);
+	target = Create(description, name);
+
+	// Writes later in the frame would otherwise go through the copy queue, which executes before the copy.
+	freshResources.erase(target.handle);
+	MarkUsed(previous);
+
+	device->GetDirectList().Copy(target, 0, previous, 0, previousWidth);
+	AddFrameResource(device->GetFrameIndex(), previous);  // Frames in flight can still be using it.
+
+	VGLog(logRendering, "Grew buffer '{}' to {} elements.", name, description.size);
+
+	return true;
 }
 
-void ResourceManager::Write(TextureHandle target, const std::vector<uint8_t>& source)
+void ResourceManager::Write(TextureHandle target, std::span<const std::byte> source, uint32_t mip)
 {
 	VGScopedCPUStat("Texture Write");
 
+	std::scoped_lock scopedLock{ lock };
+
+	TouchResidency(target.handle);
+
 	auto& component = Get(target);
 
 	VGAssert(component.description.accessFlags & AccessFlag::CPUWrite, "Failed to write to texture, no CPU write access.");
-	VGAssert(component.description.width * component.description.height * component.description.depth * (GetResourceFormatSize(component.description.format) / 8) >= source.size(),
-		"Failed to write to texture, source is larger than target.");
+	VGAssert(mip < component.Native()->GetDesc().MipLevels, "Failed to write to texture, mip is out of range.");
+	VGAssert(mip == 0 || component.description.depth == 1 || !component.description.array, "Failed to write to texture, array textures don't support writing individual mips.");
 
-	const auto frameIndex = device->GetFrameIndex();
+	const auto width = std::max(component.description.width >> mip, 1u);
+	const auto height = std::max(component.description.height >> mip, 1u);
+	// Array slices don't shrink with the mip.
+	const auto depth = component.description.array ? component.description.depth : std::max(component.description.depth >> mip, 1u);
+	const auto blockCompressed = IsResourceFormatBlockCompressed(component.description.format);
 
-	// Texture placed footprint source copies need to be aligned to D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT. Buffers don't
-	// need this alignment, so only align here.
-	uploadOffsets[frameIndex] = AlignedSize(uploadOffsets[frameIndex], D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+	// Rows of blocks for block compressed formats.
+	const auto sourceRowSize = GetResourceFormatRowSize(component.description.format, width);
+	const auto rowCount = GetResourceFormatRowCount(component.description.format, height);
+
+	VGAssert(static_cast<size_t>(sourceRowSize) * rowCount * depth >= source.size(),
+		"Failed to write to texture, source is larger than target.");
 
 	D3D12_TEXTURE_COPY_LOCATION sourceCopyDesc{};
-	sourceCopyDesc.pResource = uploadResources[frameIndex]->GetResource();
 	sourceCopyDesc.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
 
 	D3D12_RESOURCE_DESC targetDescriptionCopy = component.Native()->GetDesc();
 
+	// The footprint doesn't depend on the offset, get it before allocating upload memory to know the size needed.
 	uint64_t requiredCopySize;
-	device->Native()->GetCopyableFootprints(&targetDescriptionCopy, 0, 1, uploadOffsets[frameIndex], &sourceCopyDesc.PlacedFootprint, nullptr, nullptr, &requiredCopySize);
+	device->Native()->GetCopyableFootprints(&targetDescriptionCopy, mip, 1, 0, &sourceCopyDesc.PlacedFootprint, nullptr, nullptr, &requiredCopySize);
 
-	std::vector<uint8_t> alignedSource;
-	auto* sourcePtr = &source;  // We might need to change the source data if we hit a misalignment.
+	std::vector<std::byte> alignedSource;
+	auto sourceBytes = source;  // We might need to change the source data if we hit a misalignment.
 
 	// Check conditions could be improved, but we essentially need to check if the source data's rows aren't aligned to D3D12_TEXTURE_DATA_PITCH_ALIGNMENT.
 	// If they aren't, we need to pad the source data.
 	// https://docs.microsoft.com/en-us/windows/win32/direct3d12/upload-and-readback-of-texture-data
-	if ((component.description.width * GetResourceFormatSize(component.description.format) / 8) % D3D12_TEXTURE_DATA_PITCH_ALIGNMENT != 0)
+	if (sourceRowSize % D3D12_TEXTURE_DATA_PITCH_ALIGNMENT != 0)
 	{
 		VGScopedCPUStat("Source Padding");
 
@@ -687,45 +1067,78 @@ void ResourceManager::Write(TextureHandle target, const std::vector<uint8_t>& so
 		VGLog(logRendering, "Texture write misalignment, padding out source data.");
 
 		alignedSource.resize(
-			sourceCopyDesc.PlacedFootprint.Footprint.RowPitch *
-			component.description.height *
-			component.description.depth *
-			(GetResourceFormatSize(component.description.format) / 8));
+			static_cast<size_t>(sourceCopyDesc.PlacedFootprint.Footprint.RowPitch) *
+			rowCount *
+			depth);
 
 		VGAssert(source.size() < alignedSource.size(), "Expected different aligned size, something probably broke with texture writes.");
 
 		// #TODO: Assuming a full resource write here.
-		for (int i = 0; i < component.description.depth; ++i)
+		for (int i = 0; i < depth; ++i)
 		{
-			for (int j = 0; j < component.description.height; ++j)
+			for (int j = 0; j < rowCount; ++j)
 			{
 				const auto rowSize = sourceCopyDesc.PlacedFootprint.Footprint.RowPitch;
-				const auto sliceSize = rowSize * component.description.height;
+				const auto sliceSize = rowSize * rowCount;
 
 				const auto destOffset = j * rowSize + i * sliceSize;
-				const auto sourceOffset = j * component.description.width + i * component.description.width * component.description.height;
+				const auto sourceOffset = (j + i * rowCount) * sourceRowSize;
 
-				std::memcpy(alignedSource.data() + destOffset, source.data() + sourceOffset, component.description.width);
+				std::memcpy(alignedSource.data() + destOffset, source.data() + sourceOffset, sourceRowSize);
 			}
 		}
 
-		sourcePtr = &alignedSource;
+		sourceBytes = alignedSource;
 	}
 
-	VGAssert(uploadOffsets[frameIndex] + sourcePtr->size() <= uploadResources[frameIndex]->GetResource()->GetDesc().Width, "Failed to write to texture, exhausted frame upload heap.");
+	// Texture arrays need special handling.
+	// #TODO: Only texture 2D arrays are support for now.
+	const auto isArray = component.description.depth > 1 && component.description.array;
 
-	std::memcpy(static_cast<uint8_t*>(uploadPtrs[frameIndex]) + uploadOffsets[frameIndex], sourcePtr->data(), sourcePtr->size());
+	// Each array slice is copied from its own aligned footprint.
+	const auto uploadSize = isArray ? AlignedSize(requiredCopySize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT) * component.description.depth : requiredCopySize;
 
-	// Ensure we're in the proper state.
-	if (component.state != D3D12_RESOURCE_STATE_COPY_DEST)
+	// Texture placed footprint source copies need to be aligned to D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT. Buffers don't
+	// need this alignment, so only align here.
+	auto [uploadPage, uploadOffset] = AllocateUpload(std::max<size_t>(uploadSize, sourceBytes.size()), D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+	if (!uploadPage)
 	{
-		device->GetDirectList().TransitionBarrier(target, D3D12_RESOURCE_STATE_COPY_DEST);
-		device->GetDirectList().FlushBarriers();
+		VGLogError(logRendering, "Failed to write to texture, couldn't allocate upload memory.");
+
+		return;
 	}
 
-	// Texture arrays need special handling.
-	// #TODO: Only texture 2D arrays are support for now.
-	if (component.description.depth > 1 && component.description.array)
+	sourceCopyDesc.pResource = uploadPage->allocation->GetResource();
+	sourceCopyDesc.PlacedFootprint.Offset = uploadOffset;
+
+	std::memcpy(static_cast<uint8_t*>(uploadPage->mappedPtr) + uploadOffset, sourceBytes.data(), sourceBytes.size());
+
+	const auto copyQueue = UseCopyQueue(target.handle, component.state, sourceBytes.size());
+
+	if (copyQueue)
+	{
+		device->copyListPending = true;
+
+		// Resources used on the copy queue decay to the common state once the copy finishes, before any direct queue use.
+		component.state = D3D12_RESOURCE_STATE_COMMON;
+	}
+
+	else
+	{
+		freshResources.erase(target.handle);
+
+		// Ensure we're in the proper state.
+		if (component.state != D3D12_RESOURCE_STATE_COPY_DEST)
+		{
+			device->GetDirectList().TransitionBarrier(target, D3D12_RESOURCE_STATE_COPY_DEST);
+			device->GetDirectList().FlushBarriers();
+		}
+	}
+
+	// Small writes are more efficiently performed on the direct/compute queue.
+	auto* targetCommandList = copyQueue ? device->GetCopyList().Native() : device->GetDirectList().Native();
+
+	if (isArray)
 	{
 		int slices = component.description.depth;
 		for (int i = 0; i < slices; ++i)
@@ -740,16 +1153,15 @@ void ResourceManager::Write(TextureHandle target, const std::vector<uint8_t>& so
 			sourceBox.left = 0;
 			sourceBox.top = 0;
 			sourceBox.front = 0;
-			sourceBox.right = component.description.width;
-			sourceBox.bottom = component.description.height;
+			sourceBox.right = width;
+			sourceBox.bottom = height;
 			sourceBox.back = 1;
 
-			auto* targetCommandList = device->GetDirectList().Native();  // Small writes are more efficiently performed on the direct/compute queue.
 			targetCommandList->CopyTextureRegion(&targetCopyDesc, 0, 0, 0, &sourceCopyDesc, &sourceBox);
 
-			uploadOffsets[frameIndex] += requiredCopySize;
-			uploadOffsets[frameIndex] = AlignedSize(uploadOffsets[frameIndex], D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
-			device->Native()->GetCopyableFootprints(&targetDescriptionCopy, 0, 1, uploadOffsets[frameIndex], &sourceCopyDesc.PlacedFootprint, nullptr, nullptr, &requiredCopySize);
+			uploadOffset += requiredCopySize;
+			uploadOffset = AlignedSize(uploadOffset, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+			device->Native()->GetCopyableFootprints(&targetDescriptionCopy, 0, 1, uploadOffset, &sourceCopyDesc.PlacedFootprint, nullptr, nullptr, &requiredCopySize);
 		}
 	}
 
@@ -758,31 +1170,30 @@ void ResourceManager::Write(TextureHandle target, const std::vector<uint8_t>& so
 		D3D12_TEXTURE_COPY_LOCATION targetCopyDesc{};
 		targetCopyDesc.pResource = component.Native();
 		targetCopyDesc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-		targetCopyDesc.SubresourceIndex = 0;
+		targetCopyDesc.SubresourceIndex = mip;
 
 		// #TODO: Support custom copy sizes.
 		D3D12_BOX sourceBox{};
 		sourceBox.left = 0;
 		sourceBox.top = 0;
 		sourceBox.front = 0;
-		sourceBox.right = component.description.width;
-		sourceBox.bottom = component.description.height;
-		sourceBox.back = component.description.depth;
+		sourceBox.right = width;
+		sourceBox.bottom = height;
+		sourceBox.back = depth;
 
-		auto* targetCommandList = device->GetDirectList().Native();  // Small writes are more efficiently performed on the direct/compute queue.
-		targetCommandList->CopyTextureRegion(&targetCopyDesc, 0, 0, 0, &sourceCopyDesc, &sourceBox);
-
-		uploadOffsets[frameIndex] += requiredCopySize;
+		// Block compressed copies cover whole blocks, which the footprint is already sized to.
+		targetCommandList->CopyTextureRegion(&targetCopyDesc, 0, 0, 0, &sourceCopyDesc, blockCompressed ? nullptr : &sourceBox);
 	}
 }
 
 void ResourceManager::GenerateMipmaps(CommandList& list, TextureHandle texture)
 {
 	VGScopedCPUStat("Generate mipmaps");
-	VGScopedGPUStat("Generate mipmaps", device->GetDirectContext(), list.Native());
+	VGScopedGPUStat("Generate mipmaps", device->GetQueueContext(list.Type()), list.Native());
 
 	auto& textureComponent = Get(texture);
 	VGAssert(textureComponent.description.mipMapping, "Textures must have mipmapping enabled in order to generate mipmaps.");
+	VGAssert(!IsResourceFormatBlockCompressed(textureComponent.description.format), "Block compressed textures must be written with their mips.");
 
 	// Transition to UAV state.
 	list.TransitionBarrier(texture, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
@@ -799,13 +1210,430 @@ void ResourceManager::GenerateMipmaps(CommandList& list, TextureHandle texture)
 	}
 }
 
+bool ResourceManager::RequestReadback(CommandList& list, BufferHandle buffer, size_t offset, size_t size, ReadbackCallback callback)
+{
+	VGScopedCPUStat("Request Readback");
+
+	auto& component = Get(buffer);
+	VGAssert(offset + size <= component.description.size * component.description.stride, "Readback range exceeds the buffer.");
+
+	const auto frameIndex = device->GetFrameIndex();
+	size_t ringOffset = 0;
+
+	{
+		std::scoped_lock scopedLock{ lock };
+
+		if (!readbackRing)
+		{
+			readbackRing = AllocateReadback(readbackFrameSize * frameCount, VGText("Readback ring"));
+			if (!readbackRing)
+				return false;
+		}
+
+		const auto regionOffset = AlignedSize(readbackOffsets[frameIndex], 16);
+		if (regionOffset + size > readbackFrameSize)
+		{
+			VGLogWarning(logRendering, "Readback memory exhausted for the frame, dropping a {} byte readback.", size);
+			return false;
+		}
+
+		readbackOffsets[frameIndex] = regionOffset + size;
+		ringOffset = frameIndex * readbackFrameSize + regionOffset;
+		frameReadbacks[frameIndex].emplace_back(PendingReadback{ ringOffset, size, std::move(callback) });
+	}
+
+	// Readback heap resources never leave the copy dest state.
+	const auto state = list.GetState(buffer);
+	list.TransitionBarrier(buffer, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	list.FlushBarriers();
+	list.SuspendRenderPass();
+	list.Native()->CopyBufferRegion(readbackRing->GetResource(), ringOffset, component.Native(), offset, size);
+	list.TransitionBarrier(buffer, state);
+
+	return true;
+}
+
+bool ResourceManager::SetResidentMips(TextureHandle texture, uint32_t mip)
+{
+	VGScopedCPUStat("Set Resident Mips");
+
+	auto& component = Get(texture);
+	VGAssert(component.description.reserved, "Setting resident mips of a texture that isn't reserved.");
+
+	auto* resource = component.Native();
+	const auto mipLevels = static_cast<uint32_t>(resource->GetDesc().MipLevels);
+	mip = std::min(mip, mipLevels - 1);
+
+	UINT tileCount;
+	D3D12_PACKED_MIP_INFO packedMips;
+	D3D12_TILE_SHAPE tileShape;
+	UINT subresourceCount = mipLevels;
+	std::vector<D3D12_SUBRESOURCE_TILING> tilings(mipLevels);
+	device->Native()->GetResourceTiling(resource, &tileCount, &packedMips, &tileShape, &subresourceCount, 0, tilings.data());
+
+	const auto standardMips = static_cast<uint32_t>(packedMips.NumStandardMips);
+	component.tileRanges.resize(standardMips + 1);
+
+	// Least detailed first, so that running out of memory leaves a contiguous chain of resident mips. The packed mips
+	// can't be mapped individually, they're resident whenever any mip is.
+	auto residentMip = mip;
+	bool mapped = true;
+	for (int i = static_cast<int>(standardMips); i >= 0; --i)
+	{
+		const auto packed = static_cast<uint32_t>(i) == standardMips;
+		const auto tiles = packed ? packedMips.NumTilesForPackedMips : tilings[i].WidthInTiles * tilings[i].HeightInTiles * tilings[i].DepthInTiles;
+		if (tiles == 0)
+		{
+			continue;
+		}
+
+		const auto resident = mapped && (packed || static_cast<uint32_t>(i) >= mip);
+		auto& range = component.tileRanges[i];
+		if (resident == (range.count > 0))
+		{
+			continue;
+		}
+
+		D3D12_TILED_RESOURCE_COORDINATE coordinate{};
+		coordinate.Subresource = i;  // The first packed mip when mapping the packed mips.
+
+		D3D12_TILE_REGION_SIZE region{};
+		region.NumTiles = tiles;
+
+		if (resident)
+		{
+			const auto allocated = AllocateTiles(tiles);
+			if (!allocated)
+			{
+				VGLogError(logRendering, "Failed to allocate {} tiles for reserved texture mip {}.", tiles, i);
+
+				// Release every more detailed mip as well.
+				mapped = false;
+				residentMip = std::min(static_cast<uint32_t>(i) + 1, mipLevels - 1);
+
+				continue;
+			}
+
+			range = *allocated;
+
+			const auto& page = tilePages[range.page];
+			const auto rangeFlags = D3D12_TILE_RANGE_FLAG_NONE;
+			const auto heapOffset = static_cast<UINT>(page.memory->GetOffset() / D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES) + range.offset;
+			device->copyCommandQueue->UpdateTileMappings(resource, 1, &coordinate, &region, page.memory->GetHeap(), 1, &rangeFlags, &heapOffset, &tiles, D3D12_TILE_MAPPING_FLAG_NONE);
+
+			memoryInfo.textureBytes += static_cast<uint64_t>(tiles) * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+		}
+
+		else
+		{
+			// Frames in flight could still be sampling the mip.
+			std::scoped_lock scopedLock{ lock };
+			frameTileReleases[device->GetFrameIndex()].emplace_back(TileRelease{ texture, coordinate, region, range });
+			range = {};
+		}
+	}
+
+	// Writes of the new mips are ordered after the mapping once the frame's copy list submits, since the direct queue
+	// waits on it.
+	device->copyListPending = true;
+
+	if (residentMip != component.residentMip)
+	{
+		component.residentMip = residentMip;
+
+		// Frames in flight still use the old view.
+		if (component.SRV)
+		{
+			AddFrameDescriptor(device->GetFrameIndex(), std::move(*component.SRV));
+			component.SRV.reset();
+		}
+
+		CreateResourceViews(component);
+	}
+
+	return mapped;
+}
+
+std::optional<TileRange> ResourceManager::AllocateTiles(uint32_t count)
+{
+	for (uint32_t i = 0; i < tilePages.size(); ++i)
+	{
+		if (const auto offset = tilePages[i].tiles.Allocate(count); offset)
+		{
+			return TileRange{ i, *offset, count };
+		}
+	}
+
+	// Oversized mips get a page of their own.
+	const auto pageTiles = std::max(count, tilePageTiles);
+	auto memory = AllocateMemory({ static_cast<uint64_t>(pageTiles) * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES, D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES },
+		D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES, VGText("Tile pool page"));
+	if (!memory)
+	{
+		return std::nullopt;
+	}
+
+	auto& page = tilePages.emplace_back(TilePage{ std::move(memory), FreeListAllocator{ pageTiles } });
+
+	return TileRange{ static_cast<uint32_t>(tilePages.size() - 1), *page.tiles.Allocate(count), count };
+}
+
+void ResourceManager::ReleaseTiles(const TileRange& range)
+{
+	if (range.count == 0)
+	{
+		return;
+	}
+
+	tilePages[range.page].tiles.Free(range.offset, range.count);
+	memoryInfo.textureBytes -= static_cast<uint64_t>(range.count) * D3D12_TILED_RESOURCE_TILE_SIZE_IN_BYTES;
+}
+
+void ResourceManager::ResolveReadbacks(size_t frameIndex)
+{
+	auto& readbacks = frameReadbacks[frameIndex];
+	if (readbacks.empty())
+		return;
+
+	VGScopedCPUStat("Resolve Readbacks");
+
+	const D3D12_RANGE readRange{ frameIndex * readbackFrameSize, frameIndex * readbackFrameSize + readbackOffsets[frameIndex] };
+	void* mappedData = nullptr;
+
+	const auto result = readbackRing->GetResource()->Map(0, &readRange, &mappedData);
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to map the readback ring: {}", result);
+	}
+
+	else
+	{
+		for (const auto& readback : readbacks)
+		{
+			readback.callback({ static_cast<const std::byte*>(mappedData) + readback.offset, readback.size });
+		}
+
+		const D3D12_RANGE writtenRange{ 0, 0 };
+		readbackRing->GetResource()->Unmap(0, &writtenRange);
+	}
+
+	readbacks.clear();
+	readbackOffsets[frameIndex] = 0;
+}
+
+std::vector<GpuAllocationRecord> ResourceManager::QueryLargestAllocations(size_t count)
+{
+	std::vector<GpuAllocationRecord> records;
+
+	const auto AddRecord = [&records](const auto& allocation, bool texture)
+	{
+		// Placed resources and swap chain surfaces have a manual allocation of size zero.
+		if (allocation && allocation->GetSize() > 0)
+		{
+			const auto name = allocation->GetName();
+			records.push_back({ name ? name : L"Unnamed", allocation->GetSize(), texture });
+		}
+	};
+
+	buffers.Each([&](auto handle, const auto& component) { AddRecord(component.allocation, false); });
+	textures.Each([&](auto handle, const auto& component) { AddRecord(component.allocation, true); });
+
+	const auto sorted = std::min(count, records.size());
+	std::partial_sort(records.begin(), records.begin() + sorted, records.end(), [](const auto& left, const auto& right) { return left.size > right.size; });
+	records.resize(sorted);
+
+	return records;
+}
+
+void ResourceManager::TrackResidency(entt::entity resource, ID3D12Pageable* pageable, uint64_t size)
+{
+	evictableResources.emplace(resource, Residency{ .pageable = pageable, .size = size, .lastUsedFrame = currentFrame });
+}
+
+void ResourceManager::TouchResidency(entt::entity resource)
+{
+	const auto iter = evictableResources.find(resource);
+	if (iter == evictableResources.end())
+	{
+		return;
+	}
+
+	iter->second.lastUsedFrame = currentFrame;
+	if (iter->second.evicted)
+	{
+		iter->second.evicted = false;
+		pendingResidency.emplace_back(iter->second.pageable);
+	}
+}
+
+void ResourceManager::ReleaseResidency(entt::entity resource)
+{
+	const auto iter = evictableResources.find(resource);
+	if (iter == evictableResources.end())
+	{
+		return;
+	}
+
+	std::erase(pendingResidency, iter->second.pageable);
+	evictableResources.erase(iter);
+}
+
+void ResourceManager::MarkUsed(BufferHandle handle)
+{
+	std::scoped_lock scopedLock{ lock };
+
+	TouchResidency(handle.handle);
+}
+
+void ResourceManager::MarkUsed(TextureHandle handle)
+{
+	std::scoped_lock scopedLock{ lock };
+
+	TouchResidency(handle.handle);
+}
+
+uint64_t ResourceManager::EvictIdle(size_t idleFrames)
+{
+	VGScopedCPUStat("Evict Idle Resources");
+
+	// Frames in flight could still be using anything more recent.
+	idleFrames = std::max(idleFrames, frameCount);
+
+	std::vector<Residency*> evictions;
+	std::vector<ID3D12Pageable*> pageables;
+	uint64_t bytes = 0;
+
+	for (auto& [resource, residency] : evictableResources)
+	{
+		if (!residency.evicted && residency.lastUsedFrame + idleFrames < currentFrame)
+		{
+			evictions.emplace_back(&residency);
+			pageables.emplace_back(residency.pageable);
+			bytes += residency.size;
+		}
+	}
+
+	if (pageables.empty())
+	{
+		return 0;
+	}
+
+	const auto result = device->Native()->Evict(static_cast<UINT>(pageables.size()), pageables.data());
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to evict idle resources: {}", result);
+
+		return 0;
+	}
+
+	for (auto* residency : evictions)
+	{
+		residency->evicted = true;
+	}
+
+	VGLog(logRendering, "Evicted {} idle resources, {} MB.", pageables.size(), bytes / (1024 * 1024));
+
+	return bytes;
+}
+
+void ResourceManager::SubmitResidency(ID3D12CommandQueue* queue)
+{
+	if (pendingResidency.empty())
+	{
+		return;
+	}
+
+	VGScopedCPUStat("Submit Residency");
+
+	// Paging in happens asynchronously, only the GPU waits on it.
+	++residencyFenceValue;
+	auto result = device->Native()->EnqueueMakeResident(D3D12_RESIDENCY_FLAG_NONE, static_cast<UINT>(pendingResidency.size()), pendingResidency.data(),
+		residencyFence.Get(), residencyFenceValue);
+	if (FAILED(result))
+	{
+		// The frame uses these resources, so they must be resident even if it stalls.
+		VGLogWarning(logRendering, "Failed to enqueue making {} resources resident, making them resident immediately: {}", pendingResidency.size(), result);
+
+		result = device->Native()->MakeResident(static_cast<UINT>(pendingResidency.size()), pendingResidency.data());
+		if (FAILED(result))
+		{
+			VGLogCritical(logRendering, "Failed to make evicted resources resident: {}", result);
+		}
+
+		residencyFence->Signal(residencyFenceValue);
+	}
+
+	queue->Wait(residencyFence.Get(), residencyFenceValue);
+
+	pendingResidency.clear();
+}
+
 void ResourceManager::CleanupFrameResources(size_t frame)
 {
 	VGScopedCPUStat("Cleanup Frame Resources");
 
 	const size_t frameIndex = frame % frameCount;
+	currentFrame = frame;
+
+	// Bounds the releases to one frame's worth, in case the workers fell behind.
+	JobSystem::Get().Wait(releaseCounter);
 
-	uploadOffsets[frameIndex] = 0;
+	deferReleases = true;
+
+	// The frame's upload pages are no longer used by the GPU. Keep recently used pages around up to the retained size,
+	// oversized pages from large loads are always released.
+	memoryInfo.uploadFrameBytes = 0;
+
+	for (auto& page : frameUploadPages[frameIndex])
+	{
+		memoryInfo.uploadFrameBytes += page.offset;
+		page.offset = 0;
+		freeUploadPages.emplace_back(std::move(page));
+	}
+
+	frameUploadPages[frameIndex].clear();
+
+	ResolveReadbacks(frameIndex);
+
+	// Resources from the previous frame could now be in use by the GPU.
+	freshResources.clear();
+
+	size_t retainedSize = 0;
+	std::erase_if(freeUploadPages, [this, &retainedSize](auto& page)
+	{
+		if (page.size > uploadPageSize || retainedSize + page.size > uploadRetainedSize)
+		{
+			pendingReleases.emplace_back(std::move(page.allocation));
+			return true;
+		}
+
+		retainedSize += page.size;
+		return false;
+	});
+
+	memoryInfo.uploadPeakBytes = std::max(memoryInfo.uploadPeakBytes, memoryInfo.uploadFrameBytes);
+	memoryInfo.uploadPoolBytes = retainedSize;
+	for (const auto& pages : frameUploadPages)
+	{
+		for (const auto& page : pages)
+		{
+			memoryInfo.uploadPoolBytes += page.size;
+		}
+	}
+
+	// Unmapping isn't required before reusing the tiles, but a stale mapping would alias the next texture's memory.
+	for (const auto& release : frameTileReleases[frameIndex])
+	{
+		if (Valid(release.texture))
+		{
+			const auto rangeFlags = D3D12_TILE_RANGE_FLAG_NULL;
+			device->copyCommandQueue->UpdateTileMappings(Get(release.texture).Native(), 1, &release.coordinate, &release.region, nullptr, 1, &rangeFlags, nullptr, nullptr, D3D12_TILE_MAPPING_FLAG_NONE);
+		}
+
+		ReleaseTiles(release.range);
+	}
+
+	frameTileReleases[frameIndex].clear();
 
 	for (const auto buffer : frameBuffers[frameIndex])
 	{
@@ -827,4 +1655,29 @@ void ResourceManager::CleanupFrameResources(size_t frame)
 	}
 
 	frameDescriptors[frameIndex].clear();
+
+	// Memory can only be released after any resources placed in it, releases happen in order.
+	for (auto& allocation : frameAllocations[frameIndex])
+	{
+		pendingReleases.emplace_back(std::move(allocation));
+	}
+
+	frameAllocations[frameIndex].clear();
+
+	deferReleases = false;
+
+	if (!pendingReleases.empty())
+	{
+		JobSystem::Get().Schedule([releases = std::move(pendingReleases)]() mutable
+		{
+			VGScopedCPUStat("Release Frame Resources");
+
+			for (auto& allocation : releases)
+			{
+				allocation.Reset();
+			}
+		}, &releaseCounter);
+
+		pendingReleases = {};
+	}
 }
\ No newline at end of file
@@ -6,45 +6,184 @@
 #include <Rendering/Resource.h>
 #include <Rendering/ResourceHandle.h>
 #include <Rendering/Mipmapping.h>
+#include <Threading/CriticalSection.h>
+#include <Threading/JobSystem.h>
+#include <Utility/FreeListAllocator.h>
+#include <Utility/SlotMap.h>
 
 #include <D3D12MemAlloc.h>
 
 #include <vector>
 #include <memory>
+#include <string>
 #include <string_view>
 #include <iterator>
 #include <ranges>
+#include <span>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <unordered_set>
+#include <unordered_map>
+#include <utility>
+#include <functional>
 
 class RenderDevice;
 class CommandList;
 
+// Block of upload memory used to stage writes to static resources. Persistently mapped.
+struct UploadPage
+{
+	ResourcePtr<D3D12MA::Allocation> allocation;
+	void* mappedPtr = nullptr;
+	size_t size = 0;
+	size_t offset = 0;  // Bytes used so far.
+};
+
 struct GpuMemoryInfo
 {
 	uint32_t bufferCount = 0;
 	uint32_t textureCount = 0;
 	uint64_t bufferBytes = 0;
 	uint64_t textureBytes = 0;
+	uint64_t uploadFrameBytes = 0;  // Upload memory used by the last retired frame.
+	uint64_t uploadPeakBytes = 0;  // Most upload memory used by a single frame.
+	uint64_t uploadPoolBytes = 0;  // Upload pages held, in use or free.
 };
 
+// Resource owning its own memory, for finding the largest consumers.
+struct GpuAllocationRecord
+{
+	std::wstring name;
+	uint64_t size = 0;
+	bool texture = false;
+};
+
+// Adapter local memory as reported by the OS, which can change the budget at any time.
+struct GpuMemoryBudget
+{
+	uint64_t budget = 0;  // Zero if the adapter doesn't report a budget.
+	uint64_t usage = 0;
+};
+
+// Receives the bytes of a readback, only valid for the duration of the call.
+using ReadbackCallback = std::function<void(std::span<const std::byte>)>;
+
 class ResourceManager
 {
 private:
 	// #TODO: Weak pointer instead of raw pointer?
 	RenderDevice* device;
-	entt::registry registry;
+
+	// Handles index the components directly. Textures start halfway through the index space, so a handle is unique across
+	// both kinds of resources, and can key state shared by either.
+	static constexpr uint32_t firstTextureIndex = 1 << 19;
+	SlotMap<BufferComponent> buffers;
+	SlotMap<TextureComponent> textures{ firstTextureIndex };
 	size_t frameCount = 0;
 	
-	std::vector<ResourcePtr<D3D12MA::Allocation>> uploadResources;
-	std::vector<size_t> uploadOffsets;
-	std::vector<void*> uploadPtrs;
+	// Upload memory grows on demand in pages. Pages used by a frame are reclaimed once the frame retires, and idle pages
+	// past the retained size are released.
+	static constexpr size_t uploadPageSize = 1024 * 1024 * 32;
+	static constexpr size_t uploadRetainedSize = 1024 * 1024 * 128;
+	std::vector<std::vector<UploadPage>> frameUploadPages;
+	std::vector<UploadPage> freeUploadPages;
 
 	// Frame-temporary resources. Only persist for a single GPU frame.
 	std::vector<std::vector<TextureHandle>> frameTextures;
 	std::vector<std::vector<BufferHandle>> frameBuffers;
 	std::vector<std::vector<DescriptorHandle>> frameDescriptors;
+	std::vector<std::vector<ResourcePtr<D3D12MA::Allocation>>> frameAllocations;
+
+	// Releasing resources can be expensive, so retired frame resources give up their memory on a worker instead of the
+	// main thread. Only the allocations are released there, handles and descriptors are still freed on the main thread.
+	bool deferReleases = false;  // Destroyed resources hand their allocation to the pending releases.
+	std::vector<ResourcePtr<D3D12MA::Allocation>> pendingReleases;
+	JobCounter releaseCounter;
+
+	// Writes at least this large go through the copy queue when possible, smaller writes are cheaper on the direct list.
+	static constexpr size_t copyQueueWriteSize = 1024 * 1024;
+	// Resources created this frame, not yet used by the GPU. Only these can be written on the copy queue without it
+	// waiting on the other queues.
+	std::unordered_set<entt::entity> freshResources;
+
+	// Guards uploads and frame resources, which can be used by passes recording in parallel. Creation and destruction
+	// are not guarded, these must only happen on the main thread.
+	CriticalSection lock;
 
 	size_t ComputeBufferWidth(const BufferDescription& description) const;
 
+	bool CreateUploadPage(size_t size, UploadPage& page);
+	// Returns the page and offset of a region of the current frame's upload memory, or null on failure. Requires the lock.
+	std::pair<UploadPage*, size_t> AllocateUpload(size_t size, size_t alignment);
+	bool UseCopyQueue(entt::entity resource, D3D12_RESOURCE_STATES state, size_t size) const;
+
+	D3D12_RESOURCE_DESC CreateResourceDescription(const BufferDescription& description) const;
+	D3D12_RESOURCE_DESC CreateResourceDescription(const TextureDescription& description) const;
+	std::optional<D3D12_CLEAR_VALUE> CreateClearValue(const TextureDescription& description) const;  // Unset for textures without a target binding.
+	HRESULT CreatePlacedResource(const ResourcePlacement& placement, const D3D12_RESOURCE_DESC& resourceDesc, D3D12_RESOURCE_STATES state, const D3D12_CLEAR_VALUE* clearValue, D3D12MA::Allocation** allocation);
+
+	// Tile memory of reserved resources, pages are retained once created.
+	struct TilePage
+	{
+		ResourcePtr<D3D12MA::Allocation> memory;
+		FreeListAllocator tiles;
+	};
+
+	static constexpr uint32_t tilePageTiles = 1024;  // 64 MiB pages.
+	std::vector<TilePage> tilePages;
+
+	// Tiles of less detailed residencies, unmapped and released once the frames that could sample them retire.
+	struct TileRelease
+	{
+		TextureHandle texture;
+		D3D12_TILED_RESOURCE_COORDINATE coordinate;
+		D3D12_TILE_REGION_SIZE region;
+		TileRange range;
+	};
+
+	std::vector<std::vector<TileRelease>> frameTileReleases;
+
+	// Readbacks copy into the recording frame's region of a ring, and are handed to their callback once the frame retires.
+	static constexpr size_t readbackFrameSize = 1024 * 256;
+	ResourcePtr<D3D12MA::Allocation> readbackRing;
+
+	struct PendingReadback
+	{
+		size_t offset;  // Within the ring.
+		size_t size;
+		ReadbackCallback callback;
+	};
+
+	std::vector<std::vector<PendingReadback>> frameReadbacks;
+	std::vector<size_t> readbackOffsets;  // Bytes used of each frame's region.
+
+	void ResolveReadbacks(size_t frameIndex);
+
+	// Evictable resources get their own heap, so each can be paged out on its own. Uses through the render graph and
+	// writes mark them used, resources idle for long enough are evicted under memory pressure, and an evicted resource is
+	// made resident again ahead of the frame that next uses it.
+	struct Residency
+	{
+		ID3D12Pageable* pageable;
+		uint64_t size;
+		size_t lastUsedFrame;
+		bool evicted = false;
+	};
+
+	std::unordered_map<entt::entity, Residency> evictableResources;
+	std::vector<ID3D12Pageable*> pendingResidency;  // Evicted resources used by the frame being recorded.
+	ResourcePtr<ID3D12Fence> residencyFence;
+	uint64_t residencyFenceValue = 0;
+	size_t currentFrame = 0;  // Being recorded.
+
+	void TrackResidency(entt::entity resource, ID3D12Pageable* pageable, uint64_t size);
+	void TouchResidency(entt::entity resource);  // Requires the lock.
+	void ReleaseResidency(entt::entity resource);
+
+	std::optional<TileRange> AllocateTiles(uint32_t count);
+	void ReleaseTiles(const TileRange& range);
+
 	void CreateResourceViews(BufferComponent& target);
 	void CreateResourceViews(TextureComponent& target);
 	void SetResourceName(ResourcePtr<D3D12MA::Allocation>& target, const std::wstring_view name);
@@ -59,6 +198,7 @@ private:
 
 public:
 	ResourceManager() = default;
+	~ResourceManager();
 	ResourceManager(const ResourceManager&) = delete;
 	ResourceManager(ResourceManager&&) noexcept = delete;
 
@@ -67,12 +207,29 @@ public:
 
 	void Initialize(RenderDevice* inDevice, size_t bufferedFrames);
 
-	const BufferHandle Create(const BufferDescription& description, const std::wstring_view name);
-	const TextureHandle Create(const TextureDescription& description, const std::wstring_view name);
+	// Placed resources are created in existing memory instead of their own allocation, see ResourcePlacement.
+	const BufferHandle Create(const BufferDescription& description, const std::wstring_view name, const std::optional<ResourcePlacement>& placement = std::nullopt);
+	const TextureHandle Create(const TextureDescription& description, const std::wstring_view name, const std::optional<ResourcePlacement>& placement = std::nullopt);
 	
 	// Creates a texture from the swap chain surface.
 	const TextureHandle CreateFromSwapChain(void* surface, const std::wstring_view name);
 
+	// Allocates memory without a resource, which resources can then be placed in. Returns null on failure.
+	ResourcePtr<D3D12MA::Allocation> AllocateMemory(const D3D12_RESOURCE_ALLOCATION_INFO& info, D3D12_HEAP_FLAGS heapFlags, const std::wstring_view name);
+
+	// Allocates a CPU readable buffer in the copy dest state for reading resources back. Returns null on failure. Copies
+	// into it can only be read once the frame that recorded them has retired.
+	ResourcePtr<D3D12MA::Allocation> AllocateReadback(size_t size, const std::wstring_view name);
+
+	// Copies a range of the buffer for the CPU without stalling, the callback is invoked on the main thread once the frame
+	// recording the copy retires. The buffer is returned to its current state afterwards. Returns false if the frame's
+	// readback memory is exhausted, in which case the callback is never invoked.
+	bool RequestReadback(CommandList& list, BufferHandle buffer, size_t offset, size_t size, ReadbackCallback callback);
+
+	// Memory requirements of a resource, used when placing resources.
+	D3D12_RESOURCE_ALLOCATION_INFO GetAllocationInfo(const BufferDescription& description) const;
+	D3D12_RESOURCE_ALLOCATION_INFO GetAllocationInfo(const TextureDescription& description) const;
+
 	void NameResource(const BufferHandle handle, const std::wstring_view name);
 	void NameResource(const TextureHandle handle, const std::wstring_view name);
 
@@ -82,36 +239,71 @@ public:
 	BufferComponent& Get(BufferHandle handle);
 	TextureComponent& Get(TextureHandle handle);
 
+	// The value render targets and depth stencils are cleared with, in the typed format of their views. Non-release builds
+	// warn once per texture if the clear won't be a fast clear.
+	D3D12_CLEAR_VALUE GetClearValue(TextureHandle handle);
+
 	// Resource writing utilities. Source data can be discarded immediately. Offsets are in bytes.
 
 	// Writing a single unit of data.
 	template <typename T>
 	void Write(BufferHandle target, const T& source, size_t targetOffset = 0);
 	template <typename T>
-	void Write(TextureHandle target, const T& source);
+	void Write(TextureHandle target, const T& source, uint32_t mip = 0);
 	
-	// Writing an iterable type (list, vector, etc.) of data.
-	template <typename T> requires std::random_access_iterator<std::ranges::iterator_t<T>>
+	// Writing a contiguous container (vector, array, span, etc.) of data.
+	template <typename T> requires std::ranges::contiguous_range<T>
 	void Write(BufferHandle target, const T& source, size_t targetOffset = 0);
-	template <typename T> requires std::random_access_iterator<std::ranges::iterator_t<T>>
-	void Write(TextureHandle target, const T& source);
+	template <typename T> requires std::ranges::contiguous_range<T>
+	void Write(TextureHandle target, const T& source, uint32_t mip = 0);
 
-	// Writing a raw buffer of bytes.
-	void Write(BufferHandle target, const std::vector<uint8_t>& source, size_t targetOffset = 0);
-	void Write(TextureHandle target, const std::vector<uint8_t>& source);
+	// Writing raw bytes, copied directly into the upload or mapped memory.
+	void Write(BufferHandle target, std::span<const std::byte> source, size_t targetOffset = 0);
+	void Write(TextureHandle target, std::span<const std::byte> source, uint32_t mip = 0);  // Writes a single mip, array textures don't support mips other than 0.
+
+	// Reserves the memory for a buffer write, returning a pointer to fill in place, or null on failure. The memory must
+	// be filled before the frame is submitted, and is write-combined, so it should be written sequentially and never read.
+	void* ReserveWrite(BufferHandle target, size_t size, size_t targetOffset = 0);
+
+	// Grows a static buffer to at least the given number of elements, doubling its size at minimum, and returns true if
+	// it grew. The contents are copied into a new buffer on the direct list, ahead of the frame's later writes, and the
+	// old buffer is released once the frames in flight retire. The handle and its views change, only the main thread can
+	// grow buffers.
+	bool Grow(BufferHandle& target, size_t size, const std::wstring_view name);
 
 	void Destroy(BufferHandle handle);
 	void Destroy(TextureHandle handle);
 
 	void GenerateMipmaps(CommandList& list, TextureHandle texture);
 
+	// Evictable resources used by their handle instead of through the render graph, such as in a pass's own command
+	// lists, must be marked used by the frame. Safe to call while recording passes.
+	void MarkUsed(BufferHandle handle);
+	void MarkUsed(TextureHandle handle);
+	// Evicts the evictable resources unused for the given number of frames, never fewer than the frames in flight.
+	// Returns the bytes evicted.
+	uint64_t EvictIdle(size_t idleFrames);
+	// Makes the evicted resources used this frame resident again, the queue waits until they are. Must be called before
+	// submitting any of the frame's work.
+	void SubmitResidency(ID3D12CommandQueue* queue);
+
+	// Maps tiles for the reserved texture's mips from the given mip onwards, and clamps its SRV to them, which recreates
+	// the SRV. Mapping happens on the copy queue ahead of the frame's work, so new mips can be written immediately. Mips
+	// no longer resident are unmapped once the frames that could sample them retire. Returns false if out of memory, in
+	// which case only the least detailed mips that fit are resident.
+	bool SetResidentMips(TextureHandle texture, uint32_t mip);
+
 	void AddFrameResource(size_t frameIndex, const BufferHandle handle);
 	void AddFrameResource(size_t frameIndex, const TextureHandle handle);
 	void AddFrameDescriptor(size_t frameIndex, DescriptorHandle handle);
+	void AddFrameAllocation(size_t frameIndex, ResourcePtr<D3D12MA::Allocation>&& allocation);  // Released after the frame's resources.
 
 	void CleanupFrameResources(size_t frame);
 
 	GpuMemoryInfo QueryMemoryInfo() const { return memoryInfo; }
+	// The resources with the largest allocations, largest first. Placed resources are excluded, their memory is owned by
+	// what they're placed in. Visits every resource, only meant for tooling.
+	std::vector<GpuAllocationRecord> QueryLargestAllocations(size_t count);
 };
 
 inline void ResourceManager::NameResource(const BufferHandle handle, const std::wstring_view name)
@@ -126,69 +318,57 @@ inline void ResourceManager::NameResource(const TextureHandle handle, const std:
 
 inline bool ResourceManager::Valid(const BufferHandle handle) const
 {
-	return registry.valid(handle.handle);
+	return buffers.Valid(handle.handle);
 }
 
 inline bool ResourceManager::Valid(const TextureHandle handle) const
 {
-	return registry.valid(handle.handle);
+	return textures.Valid(handle.handle);
 }
 
 inline BufferComponent& ResourceManager::Get(BufferHandle handle)
 {
-	VGAssert(registry.valid(handle.handle), "Fetching invalid buffer handle.");
+	VGAssert(buffers.Valid(handle.handle), "Fetching invalid buffer handle.");
 
-	return registry.get<BufferComponent>(handle.handle);
+	return buffers.Get(handle.handle);
 }
 
 inline TextureComponent& ResourceManager::Get(TextureHandle handle)
 {
-	VGAssert(registry.valid(handle.handle), "Fetching invalid texture handle.");
+	VGAssert(textures.Valid(handle.handle), "Fetching invalid texture handle.");
 
-	return registry.get<TextureComponent>(handle.handle);
+	return textures.Get(handle.handle);
 }
 
 template <typename T>
 inline void ResourceManager::Write(BufferHandle target, const T& source, size_t targetOffset)
 {
-	std::vector<uint8_t> bytes;
-	bytes.resize(sizeof(T));
-	std::memcpy(bytes.data(), &source, sizeof(T));
-	Write(target, bytes, targetOffset);
+	Write(target, std::as_bytes(std::span{ &source, 1 }), targetOffset);
 }
 
 template <typename T>
-inline void ResourceManager::Write(TextureHandle target, const T& source)
+inline void ResourceManager::Write(TextureHandle target, const T& source, uint32_t mip)
 {
-	std::vector<uint8_t> bytes;
-	bytes.resize(sizeof(T));
-	std::memcpy(bytes.data(), &source, sizeof(T));
-	Write(target, bytes);
+	Write(target, std::as_bytes(std::span{ &source, 1 }), mip);
 }
 
 template <typename T>
-	requires std::random_access_iterator<std::ranges::iterator_t<T>>
+	requires std::ranges::contiguous_range<T>
 inline void ResourceManager::Write(BufferHandle target, const T& source, size_t targetOffset)
 {
-	std::vector<uint8_t> bytes;
-	bytes.resize(std::size(source) * sizeof(T::value_type));
-	std::memcpy(bytes.data(), source.data(), std::size(source) * sizeof(T::value_type));
-	Write(target, bytes, targetOffset);
+	Write(target, std::as_bytes(std::span{ std::ranges::data(source), std::ranges::size(source) }), targetOffset);
 }
 
 template <typename T>
-	requires std::random_access_iterator<std::ranges::iterator_t<T>>
-inline void ResourceManager::Write(TextureHandle target, const T& source)
+	requires std::ranges::contiguous_range<T>
+inline void ResourceManager::Write(TextureHandle target, const T& source, uint32_t mip)
 {
-	std::vector<uint8_t> bytes;
-	bytes.resize(std::size(source) * sizeof(T::value_type));
-	std::memcpy(bytes.data(), source.data(), std::size(source) * sizeof(T::value_type));
-	Write(target, bytes);
+	Write(target, std::as_bytes(std::span{ std::ranges::data(source), std::ranges::size(source) }), mip);
 }
 
 inline void ResourceManager::Destroy(BufferHandle handle)
 {
-	VGAssert(registry.valid(handle.handle), "Destroying invalid buffer handle.");
+	VGAssert(buffers.Valid(handle.handle), "Destroying invalid buffer handle.");
 
 	ReportBufferFree(handle);
 
@@ -196,14 +376,17 @@ inline void ResourceManager::Destroy(BufferHandle handle)
 	if (component.CBV) component.CBV->Free();
 	if (component.SRV) component.SRV->Free();
 	if (component.UAV) component.UAV->Free();
-	if (registry.valid(component.counterBuffer.handle)) Destroy(component.counterBuffer);
+	if (buffers.Valid(component.counterBuffer.handle)) Destroy(component.counterBuffer);
+	if (deferReleases) pendingReleases.emplace_back(std::move(component.allocation));
 
-	registry.destroy(handle.handle);
+	ReleaseResidency(handle.handle);
+	freshResources.erase(handle.handle);
+	buffers.Erase(handle.handle);
 }
 
 inline void ResourceManager::Destroy(TextureHandle handle)
 {
-	VGAssert(registry.valid(handle.handle), "Destroying invalid texture handle.");
+	VGAssert(textures.Valid(handle.handle), "Destroying invalid texture handle.");
 
 	ReportTextureFree(handle);
 
@@ -211,21 +394,35 @@ inline void ResourceManager::Destroy(TextureHandle handle)
 	if (component.RTV) component.RTV->Free();
 	if (component.DSV) component.DSV->Free();
 	if (component.SRV) component.SRV->Free();
+	for (auto& descriptor : component.mipUAVs) descriptor.Free();
+	for (const auto& range : component.tileRanges) ReleaseTiles(range);
+	if (deferReleases) pendingReleases.emplace_back(std::move(component.allocation));
 
-	registry.destroy(handle.handle);
+	ReleaseResidency(handle.handle);
+	freshResources.erase(handle.handle);
+	textures.Erase(handle.handle);
 }
 
 inline void ResourceManager::AddFrameResource(size_t frameIndex, const BufferHandle handle)
 {
+	std::scoped_lock scopedLock{ lock };
 	frameBuffers[frameIndex].emplace_back(handle);
 }
 
 inline void ResourceManager::AddFrameResource(size_t frameIndex, const TextureHandle handle)
 {
+	std::scoped_lock scopedLock{ lock };
 	frameTextures[frameIndex].emplace_back(handle);
 }
 
 inline void ResourceManager::AddFrameDescriptor(size_t frameIndex, DescriptorHandle handle)
 {
+	std::scoped_lock scopedLock{ lock };
 	frameDescriptors[frameIndex].emplace_back(std::move(handle));
+}
+
+inline void ResourceManager::AddFrameAllocation(size_t frameIndex, ResourcePtr<D3D12MA::Allocation>&& allocation)
+{
+	std::scoped_lock scopedLock{ lock };
+	frameAllocations[frameIndex].emplace_back(std::move(allocation));
 }
\ No newline at end of file
@@ -37,17 +37,27 @@ struct ShaderResourceViewDescription
 	HeapType heap;
 };
 
+// Bit per mip, negative levels extend to the last mip.
+inline uint64_t MipRangeMask(uint32_t firstMip, int32_t mipLevels)
+{
+	const auto range = mipLevels < 0 || firstMip + mipLevels >= 64 ? ~0ull : (1ull << (firstMip + mipLevels)) - 1;
+
+	return range & (~0ull << firstMip);
+}
+
 // Holds descriptors generated for a pass.
 struct ResourceView
 {
 	std::unordered_map<std::string, uint32_t> descriptorIndices;
-	std::unordered_map<std::string, DescriptorHandle> fullDescriptors;
+	std::unordered_map<std::string, DescriptorHandle> fullDescriptors;  // Only live for the frame.
+	std::unordered_map<std::string, const DescriptorHandle*> cachedDescriptors;  // Owned by the transient's view cache.
 };
 
 // Resource descriptors requested by a pass.
 struct ResourceViewRequest
 {
 	std::unordered_map<std::string, ShaderResourceViewDescription> descriptorRequests;
+	uint64_t extraMips = 0;  // Mips accessed without a descriptor of the view, such as mips generated within the pass.
 };
 
 struct BufferView : public ResourceViewRequest
@@ -60,6 +70,8 @@ struct TextureView : public ResourceViewRequest
 {
 	TextureView& SRV(const std::string& name, uint32_t firstMip = 0, int32_t mipLevels = -1, HeapType heap = HeapType::Visible);
 	TextureView& UAV(const std::string& name, uint32_t mip, HeapType heap = HeapType::Visible);
+	// Declares mips the pass touches outside of its descriptors, the graph orders passes by the mips they access.
+	TextureView& Mips(uint32_t firstMip, int32_t mipLevels = -1);
 };
 
 inline BufferView& BufferView::SRV(const std::string& name, size_t start, size_t count, HeapType heap)
@@ -102,5 +114,12 @@ inline TextureView& TextureView::UAV(const std::string& name, uint32_t mip, Heap
 	desc.mip = mip;
 	descriptorRequests[name] = ShaderResourceViewDescription{ desc, ResourceBind::UAV, heap };
 
+	return *this;
+}
+
+inline TextureView& TextureView::Mips(uint32_t firstMip, int32_t mipLevels)
+{
+	extraMips |= MipRangeMask(firstMip, mipLevels);
+
 	return *this;
 }
\ No newline at end of file
@@ -0,0 +1,437 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/SceneBvh.h>
+
+#include <algorithm>
+#include <array>
+
+namespace
+{
+	// Leaves are fattened by a fraction of their size, plus a minimum for small entities.
+	constexpr float fatMarginScale = 0.1f;
+	constexpr float fatMarginMinimum = 0.1f;
+
+	BoundingBox Merge(const BoundingBox& a, const BoundingBox& b)
+	{
+		BoundingBox result;
+		BoundingBox::CreateMerged(result, a, b);
+
+		return result;
+	}
+
+	// Half the surface area, only compared against other areas.
+	float Area(const BoundingBox& bounds)
+	{
+		const auto& e = bounds.Extents;
+		return e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+
+	BoundingBox Fatten(const BoundingBox& bounds)
+	{
+		BoundingBox result = bounds;
+		result.Extents.x += std::max(bounds.Extents.x * fatMarginScale, fatMarginMinimum);
+		result.Extents.y += std::max(bounds.Extents.y * fatMarginScale, fatMarginMinimum);
+		result.Extents.z += std::max(bounds.Extents.z * fatMarginScale, fatMarginMinimum);
+
+		return result;
+	}
+}
+
+int32_t SceneBvh::AllocateNode()
+{
+	if (freeNode == nullNode)
+	{
+		nodes.emplace_back();
+
+		return static_cast<int32_t>(nodes.size() - 1);
+	}
+
+	const auto index = freeNode;
+	freeNode = nodes[index].parent;
+	nodes[index] = Node{};
+
+	return index;
+}
+
+void SceneBvh::FreeNode(int32_t index)
+{
+	nodes[index].parent = freeNode;
+	nodes[index].entity = entt::null;
+	freeNode = index;
+}
+
+void SceneBvh::InsertLeaf(int32_t leaf)
+{
+	if (root == nullNode)
+	{
+		root = leaf;
+		nodes[leaf].parent = nullNode;
+
+		return;
+	}
+
+	// Descend towards the sibling that adds the least surface area to the tree. Pairing below a node grows the node
+	// and every ancestor, so that growth is inherited by the costs of the children.
+	const auto leafBounds = nodes[leaf].fatBounds;
+	auto index = root;
+	while (!nodes[index].IsLeaf())
+	{
+		const auto& node = nodes[index];
+		const auto area = Area(node.fatBounds);
+		const auto combinedArea = Area(Merge(node.fatBounds, leafBounds));
+		const auto cost = 2.f * combinedArea;
+		const auto inheritedCost = 2.f * (combinedArea - area);
+
+		const auto childCost = [&](int32_t child)
+		{
+			const auto& childNode = nodes[child];
+			const auto mergedArea = Area(Merge(childNode.fatBounds, leafBounds));
+			return (childNode.IsLeaf() ? mergedArea : mergedArea - Area(childNode.fatBounds)) + inheritedCost;
+		};
+
+		const auto leftCost = childCost(node.left);
+		const auto rightCost = childCost(node.right);
+		if (cost < leftCost && cost < rightCost)
+			break;
+
+		index = leftCost < rightCost ? node.left : node.right;
+	}
+
+	// The sibling and the leaf share a new parent in the sibling's place.
+	const auto sibling = index;
+	const auto oldParent = nodes[sibling].parent;
+	const auto newParent = AllocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].fatBounds = Merge(nodes[sibling].fatBounds, leafBounds);
+	nodes[newParent].height = nodes[sibling].height + 1;
+	nodes[newParent].left = sibling;
+	nodes[newParent].right = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent == nullNode)
+	{
+		root = newParent;
+	}
+
+	else
+	{
+		auto& parent = nodes[oldParent];
+		(parent.left == sibling ? parent.left : parent.right) = newParent;
+	}
+
+	RefitAncestors(newParent);
+}
+
+void SceneBvh::RemoveLeaf(int32_t leaf)
+{
+	if (leaf == root)
+	{
+		root = nullNode;
+
+		return;
+	}
+
+	// The sibling takes the place of the leaf's parent.
+	const auto parent = nodes[leaf].parent;
+	const auto grandParent = nodes[parent].parent;
+	const auto sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+	nodes[sibling].parent = grandParent;
+	FreeNode(parent);
+
+	if (grandParent == nullNode)
+	{
+		root = sibling;
+
+		return;
+	}
+
+	auto& grandParentNode = nodes[grandParent];
+	(grandParentNode.left == parent ? grandParentNode.left : grandParentNode.right) = sibling;
+
+	RefitAncestors(grandParent);
+}
+
+void SceneBvh::RefitAncestors(int32_t index)
+{
+	while (index != nullNode)
+	{
+		index = Balance(index);
+
+		auto& node = nodes[index];
+		node.height = 1 + std::max(nodes[node.left].height, nodes[node.right].height);
+		node.fatBounds = Merge(nodes[node.left].fatBounds, nodes[node.right].fatBounds);
+
+		index = node.parent;
+	}
+}
+
+int32_t SceneBvh::Balance(int32_t index)
+{
+	const auto& node = nodes[index];
+	if (node.IsLeaf() || node.height < 2)
+		return index;
+
+	const auto balance = nodes[node.right].height - nodes[node.left].height;
+	if (balance > 1)
+		return Rotate(index, node.right);
+
+	if (balance < -1)
+		return Rotate(index, node.left);
+
+	return index;
+}
+
+int32_t SceneBvh::Rotate(int32_t index, int32_t child)
+{
+	// The child moves up into the node's place, keeping its taller child. The shorter one replaces the child under the node.
+	auto& node = nodes[index];
+	auto& childNode = nodes[child];
+	const bool leftTaller = nodes[childNode.left].height > nodes[childNode.right].height;
+	const auto kept = leftTaller ? childNode.left : childNode.right;
+	const auto moved = leftTaller ? childNode.right : childNode.left;
+
+	childNode.parent = node.parent;
+	if (childNode.parent == nullNode)
+	{
+		root = child;
+	}
+
+	else
+	{
+		auto& parent = nodes[childNode.parent];
+		(parent.left == index ? parent.left : parent.right) = child;
+	}
+
+	(node.left == child ? node.left : node.right) = moved;
+	nodes[moved].parent = index;
+	node.parent = child;
+	node.height = 1 + std::max(nodes[node.left].height, nodes[node.right].height);
+	node.fatBounds = Merge(nodes[node.left].fatBounds, nodes[node.right].fatBounds);
+
+	childNode.left = index;
+	childNode.right = kept;
+	childNode.height = 1 + std::max(node.height, nodes[kept].height);
+	childNode.fatBounds = Merge(node.fatBounds, nodes[kept].fatBounds);
+
+	return child;
+}
+
+void SceneBvh::Insert(entt::entity entity, const BoundingBox& bounds)
+{
+	if (leaves.contains(entity))
+	{
+		Update(entity, bounds);
+
+		return;
+	}
+
+	const auto leaf = AllocateNode();
+	nodes[leaf].entity = entity;
+	nodes[leaf].bounds = bounds;
+	nodes[leaf].fatBounds = Fatten(bounds);
+	leaves[entity] = leaf;
+
+	InsertLeaf(leaf);
+}
+
+void SceneBvh::Remove(entt::entity entity)
+{
+	const auto iter = leaves.find(entity);
+	if (iter == leaves.end())
+		return;
+
+	RemoveLeaf(iter->second);
+	FreeNode(iter->second);
+	leaves.erase(iter);
+}
+
+void SceneBvh::Update(entt::entity entity, const BoundingBox& bounds)
+{
+	const auto iter = leaves.find(entity);
+	if (iter == leaves.end())
+	{
+		Insert(entity, bounds);
+
+		return;
+	}
+
+	const auto leaf = iter->second;
+	nodes[leaf].bounds = bounds;
+
+	if (nodes[leaf].fatBounds.Contains(bounds) == CONTAINS)
+		return;
+
+	RemoveLeaf(leaf);
+	nodes[leaf].fatBounds = Fatten(bounds);
+	InsertLeaf(leaf);
+}
+
+std::optional<BoundingBox> SceneBvh::GetBounds(entt::entity entity) const
+{
+	const auto iter = leaves.find(entity);
+	if (iter == leaves.end())
+		return std::nullopt;
+
+	return nodes[iter->second].bounds;
+}
+
+void SceneBvh::Clear()
+{
+	nodes.clear();
+	leaves.clear();
+	root = nullNode;
+	freeNode = nullNode;
+}
+
+void SceneBvh::QueryFrustum(const XMMATRIX& viewProjection, FunctionRef<bool(entt::entity)> visitor) const
+{
+	if (root == nullNode)
+		return;
+
+	// World space planes from the clip space bounds -w <= x <= w, -w <= y <= w, 0 <= z <= w. The far plane of an
+	// infinite inverse depth projection is degenerate, and never rejects anything.
+	const auto transposed = XMMatrixTranspose(viewProjection);
+	const std::array<XMVECTOR, 6> planes = {
+		transposed.r[3] + transposed.r[0],
+		transposed.r[3] - transposed.r[0],
+		transposed.r[3] + transposed.r[1],
+		transposed.r[3] - transposed.r[1],
+		transposed.r[2],
+		transposed.r[3] - transposed.r[2]
+	};
+
+	enum class Containment
+	{
+		Outside,
+		Intersecting,
+		Inside
+	};
+
+	const auto classify = [&planes](const BoundingBox& bounds)
+	{
+		const auto center = XMVectorSetW(XMLoadFloat3(&bounds.Center), 1.f);
+		const auto extents = XMLoadFloat3(&bounds.Extents);
+		auto result = Containment::Inside;
+		for (const auto& plane : planes)
+		{
+			const auto distance = XMVectorGetX(XMVector4Dot(plane, center));
+			const auto radius = XMVectorGetX(XMVector3Dot(XMVectorAbs(plane), extents));
+			if (distance + radius < 0.f)
+				return Containment::Outside;
+
+			if (distance - radius < 0.f)
+				result = Containment::Intersecting;
+		}
+
+		return result;
+	};
+
+	// Subtrees entirely inside the frustum are visited without further tests.
+	std::vector<std::pair<int32_t, bool>> stack;
+	stack.reserve(64);
+	stack.emplace_back(root, false);
+
+	while (!stack.empty())
+	{
+		const auto [index, inside] = stack.back();
+		stack.pop_back();
+
+		const auto& node = nodes[index];
+		auto nodeInside = inside;
+		if (!nodeInside)
+		{
+			const auto containment = classify(node.IsLeaf() ? node.bounds : node.fatBounds);
+			if (containment == Containment::Outside)
+				continue;
+
+			nodeInside = containment == Containment::Inside;
+		}
+
+		if (node.IsLeaf())
+		{
+			if (!visitor(node.entity))
+				return;
+		}
+
+		else
+		{
+			stack.emplace_back(node.left, nodeInside);
+			stack.emplace_back(node.right, nodeInside);
+		}
+	}
+}
+
+void SceneBvh::QuerySphere(const BoundingSphere& sphere, FunctionRef<bool(entt::entity)> visitor) const
+{
+	if (root == nullNode)
+		return;
+
+	std::vector<int32_t> stack;
+	stack.reserve(64);
+	stack.emplace_back(root);
+
+	while (!stack.empty())
+	{
+		const auto& node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!sphere.Intersects(node.IsLeaf() ? node.bounds : node.fatBounds))
+			continue;
+
+		if (node.IsLeaf())
+		{
+			if (!visitor(node.entity))
+				return;
+		}
+
+		else
+		{
+			stack.emplace_back(node.left);
+			stack.emplace_back(node.right);
+		}
+	}
+}
+
+std::optional<SceneBvh::RayHit> SceneBvh::Raycast(FXMVECTOR origin, FXMVECTOR direction, float maxDistance) const
+{
+	if (root == nullNode)
+		return std::nullopt;
+
+	std::optional<RayHit> closest;
+	auto closestDistance = maxDistance;
+
+	std::vector<int32_t> stack;
+	stack.reserve(64);
+	stack.emplace_back(root);
+
+	while (!stack.empty())
+	{
+		const auto& node = nodes[stack.back()];
+		stack.pop_back();
+
+		// Nodes further than the closest hit so far can't contain a closer one.
+		float distance;
+		if (!(node.IsLeaf() ? node.bounds : node.fatBounds).Intersects(origin, direction, distance))
+			continue;
+
+		distance = std::max(distance, 0.f);  // Origins inside the bounds report the exit behind them.
+		if (distance > closestDistance)
+			continue;
+
+		if (node.IsLeaf())
+		{
+			closest = RayHit{ .entity = node.entity, .distance = distance };
+			closestDistance = distance;
+		}
+
+		else
+		{
+			stack.emplace_back(node.left);
+			stack.emplace_back(node.right);
+		}
+	}
+
+	return closest;
+}
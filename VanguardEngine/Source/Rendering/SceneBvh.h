@@ -0,0 +1,78 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Utility/FunctionRef.h>
+
+#include <entt/entt.hpp>
+
+#include <DirectXCollision.h>
+
+#include <vector>
+#include <unordered_map>
+#include <optional>
+#include <limits>
+
+// Dynamic bounding volume hierarchy over the world space bounds of scene entities, for CPU queries such as picking or
+// gathering the entities near a point. Leaves store fattened bounds, so entities moving a little don't touch the tree,
+// and nodes are rotated on insertion to keep the tree balanced under continuous movement.
+class SceneBvh
+{
+public:
+	struct RayHit
+	{
+		entt::entity entity;
+		float distance;
+	};
+
+private:
+	static constexpr int32_t nullNode = -1;
+
+	struct Node
+	{
+		BoundingBox fatBounds;  // Encloses the children, or the leaf's bounds with margin.
+		BoundingBox bounds;  // Tight bounds, leaves only.
+		int32_t parent = nullNode;  // Next free node while in the free list.
+		int32_t left = nullNode;
+		int32_t right = nullNode;
+		int32_t height = 0;  // Leaves are at zero.
+		entt::entity entity = entt::null;
+
+		bool IsLeaf() const { return left == nullNode; }
+	};
+
+	std::vector<Node> nodes;
+	int32_t root = nullNode;
+	int32_t freeNode = nullNode;
+	std::unordered_map<entt::entity, int32_t> leaves;
+
+	int32_t AllocateNode();
+	void FreeNode(int32_t index);
+	void InsertLeaf(int32_t leaf);
+	void RemoveLeaf(int32_t leaf);
+	void RefitAncestors(int32_t index);  // Rebalances and recomputes the bounds from the node up to the root.
+	int32_t Balance(int32_t index);  // Returns the subtree's new root.
+	int32_t Rotate(int32_t index, int32_t child);
+
+public:
+	// Inserting an existing entity updates it instead.
+	void Insert(entt::entity entity, const BoundingBox& bounds);
+	void Remove(entt::entity entity);
+	// Leaves are only reinserted once the entity moves out of its fattened bounds.
+	void Update(entt::entity entity, const BoundingBox& bounds);
+	void Clear();
+
+	// Tight bounds the entity was last inserted or updated with.
+	std::optional<BoundingBox> GetBounds(entt::entity entity) const;
+
+	// Visits the entities intersecting the view projection's frustum, until the visitor returns false.
+	void QueryFrustum(const XMMATRIX& viewProjection, FunctionRef<bool(entt::entity)> visitor) const;
+	// Visits the entities intersecting the sphere, until the visitor returns false.
+	void QuerySphere(const BoundingSphere& sphere, FunctionRef<bool(entt::entity)> visitor) const;
+	// Nearest entity bounds hit by the ray, direction must be normalized.
+	std::optional<RayHit> Raycast(FXMVECTOR origin, FXMVECTOR direction, float maxDistance = std::numeric_limits<float>::max()) const;
+
+	size_t Size() const { return leaves.size(); }
+	int32_t Height() const { return root == nullNode ? 0 : nodes[root].height; }
+};
@@ -0,0 +1,196 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/ScreenSpaceLighting.h>
+#include <Rendering/Device.h>
+#include <Rendering/Renderer.h>
+#include <Rendering/RenderGraph.h>
+#include <Rendering/RenderPass.h>
+#include <Rendering/RenderGraphResourceManager.h>
+#include <Rendering/CommandList.h>
+
+#include <cmath>
+
+RenderResource ScreenSpaceLighting::AddAccumulation(RenderGraph& graph, std::string_view passName, const std::wstring& historyName, RenderResource current, DXGI_FORMAT format, RenderResource motionVectors)
+{
+	const auto history = graph.CreateHistory(historyName, TransientTextureDescription{
+		.resolutionScale = 0.5f,
+		.format = format
+	});
+	const auto accumulatedTag = history.current;
+
+	auto& accumulationPass = graph.AddPass(passName, ExecutionQueue::Compute);
+	accumulationPass.Read(current, ResourceBind::SRV);
+	accumulationPass.Read(motionVectors, ResourceBind::SRV);
+	if (history.Valid())
+	{
+		accumulationPass.Read(history.previous, ResourceBind::SRV);
+	}
+	accumulationPass.Write(accumulatedTag, TextureView{}.UAV("", 0));
+	accumulationPass.Bind([this, current, oldHistory=history.previous, motionVectors, accumulatedTag](CommandList& list, RenderPassResources& resources)
+	{
+		list.BindPipeline(accumulationLayout);
+
+		struct {
+			uint32_t currentTexture;
+			uint32_t historyTexture;
+			uint32_t motionTexture;
+			uint32_t outputTexture;
+			float historyWeight;
+		} bindData;
+
+		bindData.currentTexture = resources.Get(current);
+		bindData.historyTexture = 0;
+		if (oldHistory.id != 0)
+			bindData.historyTexture = resources.Get(oldHistory);
+		bindData.motionTexture = resources.Get(motionVectors);
+		bindData.outputTexture = resources.Get(accumulatedTag);
+		bindData.historyWeight = historyWeight;
+
+		list.BindConstants("bindData", bindData);
+
+		const auto& outputComponent = device->GetResourceManager().Get(resources.GetTexture(accumulatedTag));
+		const auto dispatchX = (uint32_t)std::ceil(outputComponent.description.width / 8.f);
+		const auto dispatchY = (uint32_t)std::ceil(outputComponent.description.height / 8.f);
+
+		list.Dispatch(dispatchX, dispatchY, 1);
+	});
+
+	return accumulatedTag;
+}
+
+void ScreenSpaceLighting::Initialize(RenderDevice* inDevice)
+{
+	device = inDevice;
+
+	occlusionEnabled = CvarCreate("screenSpaceAO", "Controls half resolution screen space ambient occlusion, 0=disabled, 1=enabled", 1);
+	reflectionsEnabled = CvarCreate("screenSpaceReflections", "Controls half resolution screen space reflections, requires temporalAA for the previous frame's color, 0=disabled, 1=enabled", 1);
+
+	occlusionLayout = RenderPipelineLayout{}
+		.ComputeShader({ "ScreenSpace/AmbientOcclusion", "Main" });
+
+	reflectionLayout = RenderPipelineLayout{}
+		.ComputeShader({ "ScreenSpace/Reflections", "Main" });
+
+	accumulationLayout = RenderPipelineLayout{}
+		.ComputeShader({ "ScreenSpace/Accumulation", "Main" });
+}
+
+ScreenSpaceResources ScreenSpaceLighting::Render(RenderGraph& graph, const ScreenSpaceInputs& inputs)
+{
+	ScreenSpaceResources result{ .ambientOcclusion = { .id = 0 }, .reflections = { .id = 0 } };
+
+	const auto frame = (uint32_t)Renderer::Get().GetAppFrame();
+
+	if (*occlusionEnabled > 0)
+	{
+		auto& occlusionPass = graph.AddPass("Ambient Occlusion Pass", ExecutionQueue::Compute);
+		const auto occlusionTag = occlusionPass.Create(TransientTextureDescription{
+			.resolutionScale = 0.5f,
+			.format = DXGI_FORMAT_R8_UNORM
+		}, VGText("Ambient occlusion"));
+		occlusionPass.Read(inputs.cameraBuffer, ResourceBind::SRV);
+		occlusionPass.Read(inputs.depthStencil, ResourceBind::SRV);
+		occlusionPass.Read(inputs.hiZ, ResourceBind::SRV);
+		occlusionPass.Write(occlusionTag, TextureView{}.UAV("", 0));
+		occlusionPass.Bind([this, inputs, occlusionTag, frame](CommandList& list, RenderPassResources& resources)
+		{
+			list.BindPipeline(occlusionLayout);
+
+			struct {
+				uint32_t cameraBuffer;
+				uint32_t cameraIndex;
+				uint32_t depthTexture;
+				uint32_t hiZTexture;
+				uint32_t outputTexture;
+				float radius;
+				float power;
+				uint32_t frame;
+			} bindData;
+
+			bindData.cameraBuffer = resources.Get(inputs.cameraBuffer);
+			bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
+			bindData.depthTexture = resources.Get(inputs.depthStencil);
+			bindData.hiZTexture = resources.Get(inputs.hiZ);
+			bindData.outputTexture = resources.Get(occlusionTag);
+			bindData.radius = occlusionRadius;
+			bindData.power = occlusionPower;
+			bindData.frame = frame;
+
+			list.BindConstants("bindData", bindData);
+
+			const auto& outputComponent = device->GetResourceManager().Get(resources.GetTexture(occlusionTag));
+			const auto dispatchX = (uint32_t)std::ceil(outputComponent.description.width / 8.f);
+			const auto dispatchY = (uint32_t)std::ceil(outputComponent.description.height / 8.f);
+
+			list.Dispatch(dispatchX, dispatchY, 1);
+		});
+
+		result.ambientOcclusion = AddAccumulation(graph, "Ambient Occlusion Accumulation Pass", VGText("Ambient occlusion history"), occlusionTag, DXGI_FORMAT_R8_UNORM, inputs.motionVectors);
+	}
+
+	else
+	{
+		lastFrameOcclusion.id = 0;
+	}
+
+	// Hits are shaded with the previous frame's resolved color, without it there's nothing to reflect.
+	if (*reflectionsEnabled > 0 && inputs.lastFrameColor.id != 0)
+	{
+		auto& reflectionPass = graph.AddPass("Screen Space Reflections Pass", ExecutionQueue::Compute);
+		const auto reflectionTag = reflectionPass.Create(TransientTextureDescription{
+			.resolutionScale = 0.5f,
+			.format = DXGI_FORMAT_R16G16B16A16_FLOAT
+		}, VGText("Screen space reflections"));
+		reflectionPass.Read(inputs.cameraBuffer, ResourceBind::SRV);
+		reflectionPass.Read(inputs.depthStencil, ResourceBind::SRV);
+		reflectionPass.Read(inputs.hiZ, ResourceBind::SRV);
+		reflectionPass.Read(inputs.motionVectors, ResourceBind::SRV);
+		reflectionPass.Read(inputs.lastFrameColor, ResourceBind::SRV);
+		reflectionPass.Write(reflectionTag, TextureView{}.UAV("", 0));
+		reflectionPass.Bind([this, inputs, reflectionTag](CommandList& list, RenderPassResources& resources)
+		{
+			list.BindPipeline(reflectionLayout);
+
+			struct {
+				uint32_t cameraBuffer;
+				uint32_t cameraIndex;
+				uint32_t depthTexture;
+				uint32_t hiZTexture;
+				uint32_t colorTexture;
+				uint32_t motionTexture;
+				uint32_t outputTexture;
+				uint32_t maxSteps;
+				float maxDistance;
+				float thickness;
+			} bindData;
+
+			bindData.cameraBuffer = resources.Get(inputs.cameraBuffer);
+			bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
+			bindData.depthTexture = resources.Get(inputs.depthStencil);
+			bindData.hiZTexture = resources.Get(inputs.hiZ);
+			bindData.colorTexture = resources.Get(inputs.lastFrameColor);
+			bindData.motionTexture = resources.Get(inputs.motionVectors);
+			bindData.outputTexture = resources.Get(reflectionTag);
+			bindData.maxSteps = reflectionSteps;
+			bindData.maxDistance = reflectionDistance;
+			bindData.thickness = reflectionThickness;
+
+			list.BindConstants("bindData", bindData);
+
+			const auto& outputComponent = device->GetResourceManager().Get(resources.GetTexture(reflectionTag));
+			const auto dispatchX = (uint32_t)std::ceil(outputComponent.description.width / 8.f);
+			const auto dispatchY = (uint32_t)std::ceil(outputComponent.description.height / 8.f);
+
+			list.Dispatch(dispatchX, dispatchY, 1);
+		});
+
+		result.reflections = AddAccumulation(graph, "Screen Space Reflections Accumulation Pass", VGText("Screen space reflections history"), reflectionTag, DXGI_FORMAT_R16G16B16A16_FLOAT, inputs.motionVectors);
+	}
+
+	else
+	{
+		lastFrameReflections.id = 0;
+	}
+
+	return result;
+}
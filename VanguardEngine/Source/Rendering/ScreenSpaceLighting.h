@@ -0,0 +1,57 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Rendering/RenderPipeline.h>
+#include <Rendering/RenderGraphResource.h>
+#include <Core/ConsoleVariable.h>
+
+class RenderDevice;
+class RenderGraph;
+
+struct ScreenSpaceInputs
+{
+	RenderResource cameraBuffer;
+	RenderResource depthStencil;
+	RenderResource hiZ;  // Farthest depth pyramid from occlusion culling.
+	RenderResource motionVectors;
+	RenderResource lastFrameColor;  // Resolved color of the previous frame, reflections are disabled without it.
+};
+
+struct ScreenSpaceResources
+{
+	RenderResource ambientOcclusion;  // Zero when disabled.
+	RenderResource reflections;  // Premultiplied by the confidence in alpha, zero when disabled.
+};
+
+// Half resolution ambient occlusion and reflections traced against the depth buffer and the Hi-Z pyramid, each accumulated
+// temporally. Forward shading applies the occlusion to the ambient lighting, and falls back to the IBL prefilter wherever
+// the reflections miss.
+class ScreenSpaceLighting
+{
+public:
+	float occlusionRadius = 1.f;  // View space, meters.
+	float occlusionPower = 1.5f;
+	uint32_t reflectionSteps = 64;
+	float reflectionDistance = 50.f;  // View space, meters.
+	float reflectionThickness = 0.5f;  // View space, meters.
+	float historyWeight = 0.9f;  // Blend weight of the reprojected history.
+
+private:
+	RenderDevice* device;
+
+	CvarHandle<int> occlusionEnabled;
+	CvarHandle<int> reflectionsEnabled;
+
+	RenderPipelineLayout occlusionLayout;
+	RenderPipelineLayout reflectionLayout;
+	RenderPipelineLayout accumulationLayout;
+
+	// Blends the current samples with the named history, returns the accumulated texture.
+	RenderResource AddAccumulation(RenderGraph& graph, std::string_view passName, const std::wstring& historyName, RenderResource current, DXGI_FORMAT format, RenderResource motionVectors);
+
+public:
+	void Initialize(RenderDevice* inDevice);
+	ScreenSpaceResources Render(RenderGraph& graph, const ScreenSpaceInputs& inputs);
+};
@@ -3,17 +3,162 @@
 #include <Rendering/Shader.h>
 #include <Core/Config.h>
 #include <Utility/StringTools.h>
+#include <Utility/HashCombine.h>
 
+#include <algorithm>
 #include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
 
 #include <Core/Windows/DirectX12Minimal.h>
 #include <dxcapi.h>
 #include <d3d12shader.h>
 
 // Interface objects exist for the duration of the application. Can be destroyed after initial compilation during release builds if necessary.
-static ResourcePtr<IDxcUtils> shaderUtils;
-static ResourcePtr<IDxcCompiler3> shaderCompiler;
-static ResourcePtr<IDxcIncludeHandler> shaderIncludeHandler;
+// DXC compilers aren't thread safe, each thread compiling shaders gets its own.
+static thread_local ResourcePtr<IDxcUtils> shaderUtils;
+static thread_local ResourcePtr<IDxcCompiler3> shaderCompiler;
+
+// Bump when the cache file layout changes.
+static constexpr uint32_t shaderCacheVersion = 1;
+
+size_t HashShaderSource(const void* data, size_t size)
+{
+	return std::hash<std::string_view>{}(std::string_view{ static_cast<const char*>(data), size });
+}
+
+struct ShaderInclude
+{
+	std::filesystem::file_time_type writeTime;
+	std::shared_ptr<const std::string> source;
+	size_t hash;
+};
+
+// Shared headers are included by nearly every shader, so their contents are kept in memory across compiles and only
+// read again once written. Shared by every compiling thread.
+static std::mutex shaderIncludeMutex;
+static std::unordered_map<std::wstring, ShaderInclude> shaderIncludes;
+
+std::optional<ShaderInclude> LoadShaderInclude(const std::filesystem::path& path)
+{
+	std::error_code error;
+	const auto writeTime = std::filesystem::last_write_time(path, error);
+	if (error)
+	{
+		return std::nullopt;
+	}
+
+	const auto key = path.lexically_normal().generic_wstring();
+
+	{
+		std::scoped_lock lock{ shaderIncludeMutex };
+
+		if (const auto it = shaderIncludes.find(key); it != shaderIncludes.end() && it->second.writeTime == writeTime)
+		{
+			return it->second;
+		}
+	}
+
+	VGScopedCPUStat("Load Shader Include");
+
+	std::ifstream stream{ path, std::ios::binary };
+	if (!stream.is_open())
+	{
+		return std::nullopt;
+	}
+
+	auto source = std::make_shared<std::string>(std::istreambuf_iterator<char>{ stream }, std::istreambuf_iterator<char>{});
+
+	ShaderInclude include{
+		.writeTime = writeTime,
+		.source = source,
+		.hash = HashShaderSource(source->data(), source->size())
+	};
+
+	std::scoped_lock lock{ shaderIncludeMutex };
+	shaderIncludes[key] = include;
+
+	return include;
+}
+
+// Serves includes from the shared include cache, recording every included file so that cached shaders are invalidated
+// when any of their includes change.
+class ShaderIncludeHandler : public IDxcIncludeHandler
+{
+public:
+	std::map<std::wstring, size_t> includes;  // Content hash of each include.
+
+	HRESULT STDMETHODCALLTYPE LoadSource(LPCWSTR fileName, IDxcBlob** includeSource) override
+	{
+		*includeSource = nullptr;
+
+		// Each include directory is tried in turn, failing lets the compiler move on to the next.
+		const auto include = LoadShaderInclude(fileName);
+		if (!include)
+		{
+			return E_FAIL;
+		}
+
+		ResourcePtr<IDxcBlobEncoding> blob;
+		const auto result = shaderUtils->CreateBlob(include->source->data(), static_cast<uint32_t>(include->source->size()), DXC_CP_UTF8, blob.Indirect());
+		if (FAILED(result))
+		{
+			return result;
+		}
+
+		includes[fileName] = include->hash;
+		*includeSource = blob.Release();
+
+		return S_OK;
+	}
+
+	HRESULT STDMETHODCALLTYPE QueryInterface(REFIID id, void** object) override
+	{
+		if (id == __uuidof(IDxcIncludeHandler) || id == __uuidof(IUnknown))
+		{
+			*object = this;
+			return S_OK;
+		}
+
+		*object = nullptr;
+		return E_NOINTERFACE;
+	}
+
+	// Only lives on the stack for the duration of a single compile, no reference counting needed.
+	ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+	ULONG STDMETHODCALLTYPE Release() override { return 1; }
+};
+
+void AddShaderSourceFile(Shader& shader, const std::filesystem::path& path)
+{
+	std::error_code error;
+	shader.sourceFiles.emplace_back(path, std::filesystem::last_write_time(path, error));
+}
+
+bool Shader::SourcesChanged() const
+{
+	std::error_code error;
+	for (const auto& [path, writeTime] : sourceFiles)
+	{
+		if (std::filesystem::last_write_time(path, error) != writeTime)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+std::filesystem::path GetShaderCachePath(size_t key)
+{
+	return Config::engineRootPath / "Cache" / "Shaders" / (std::to_string(key) + ".bin");
+}
 
 void ReflectShader(std::unique_ptr<Shader>& inShader, ID3D12ShaderReflection* reflection, const std::wstring& name)
 {
@@ -70,18 +215,170 @@ void ReflectShader(std::unique_ptr<Shader>& inShader, ID3D12ShaderReflection* re
 		default: VGLogError(logRendering, "Shader reflection for '{}' failed internally: Unknown resource bind type '{}'.", name, (int)bindDesc.Type);
 		}
 
-		inShader->reflection.resourceBindings.push_back({ bindDesc.Name, bindDesc.BindPoint, bindDesc.BindCount, bindDesc.Space, type });
+		size_t size = 0;
+		if (bindDesc.Type == D3D_SIT_CBUFFER)
+		{
+			auto* constantBuffer = reflection->GetConstantBufferByName(bindDesc.Name);
+
+			D3D12_SHADER_BUFFER_DESC bufferDesc;
+			if (constantBuffer && SUCCEEDED(constantBuffer->GetDesc(&bufferDesc)))
+			{
+				for (uint32_t j = 0; j < bufferDesc.Variables; ++j)
+				{
+					D3D12_SHADER_VARIABLE_DESC variableDesc;
+					if (SUCCEEDED(constantBuffer->GetVariableByIndex(j)->GetDesc(&variableDesc)))
+					{
+						size = std::max<size_t>(size, variableDesc.StartOffset + variableDesc.Size);
+					}
+				}
+			}
+		}
+
+		inShader->reflection.resourceBindings.push_back({ bindDesc.Name, bindDesc.BindPoint, bindDesc.BindCount, bindDesc.Space, type, size });
 	}
 
 	inShader->reflection.instructionCount = shaderDesc.InstructionCount;
 }
 
+void CreateShaderReflection(std::unique_ptr<Shader>& inShader, const void* data, size_t size, const std::wstring& name)
+{
+	DxcBuffer reflectionBuffer;
+	reflectionBuffer.Ptr = data;
+	reflectionBuffer.Size = size;
+	reflectionBuffer.Encoding = DXC_CP_ACP;
+
+	ResourcePtr<ID3D12ShaderReflection> reflection;
+	shaderUtils->CreateReflection(&reflectionBuffer, IID_PPV_ARGS(reflection.Indirect()));
+
+	ReflectShader(inShader, reflection.Get(), name);
+}
+
+template <typename T>
+void ReadCacheValue(std::ifstream& stream, T& value)
+{
+	stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+template <typename T>
+void WriteCacheValue(std::ofstream& stream, const T& value)
+{
+	stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+std::unique_ptr<Shader> LoadShaderCache(size_t key, const std::filesystem::path& path, const std::wstring& name)
+{
+	VGScopedCPUStat("Shader Cache Load");
+
+	std::ifstream cacheStream{ GetShaderCachePath(key), std::ios::binary };
+	if (!cacheStream.is_open())
+	{
+		return {};
+	}
+
+	uint32_t version = 0;
+	ReadCacheValue(cacheStream, version);
+	if (!cacheStream || version != shaderCacheVersion)
+	{
+		return {};
+	}
+
+	auto resultShader = std::make_unique<Shader>();
+	AddShaderSourceFile(*resultShader, path);
+
+	// The key only covers the root source file, includes are validated against their current contents.
+	uint32_t includeCount = 0;
+	ReadCacheValue(cacheStream, includeCount);
+	for (uint32_t i = 0; i < includeCount && cacheStream; ++i)
+	{
+		uint32_t pathLength = 0;
+		ReadCacheValue(cacheStream, pathLength);
+
+		std::wstring includePath(pathLength, L'\0');
+		cacheStream.read(reinterpret_cast<char*>(includePath.data()), pathLength * sizeof(wchar_t));
+
+		size_t includeHash = 0;
+		ReadCacheValue(cacheStream, includeHash);
+
+		if (!cacheStream)
+		{
+			break;
+		}
+
+		const auto include = LoadShaderInclude(includePath);
+		if (!include || include->hash != includeHash)
+		{
+			return {};
+		}
+
+		AddShaderSourceFile(*resultShader, includePath);
+	}
+
+	uint64_t bytecodeSize = 0;
+	ReadCacheValue(cacheStream, bytecodeSize);
+	resultShader->bytecode.resize(bytecodeSize);
+	cacheStream.read(reinterpret_cast<char*>(resultShader->bytecode.data()), bytecodeSize);
+
+	uint64_t reflectionSize = 0;
+	ReadCacheValue(cacheStream, reflectionSize);
+	std::vector<uint8_t> reflectionData(reflectionSize);
+	cacheStream.read(reinterpret_cast<char*>(reflectionData.data()), reflectionSize);
+
+	if (!cacheStream || bytecodeSize == 0)
+	{
+		VGLogWarning(logRendering, "Shader cache entry for '{}' is corrupt, recompiling.", name);
+
+		return {};
+	}
+
+	if (reflectionSize > 0)
+	{
+		CreateShaderReflection(resultShader, reflectionData.data(), reflectionData.size(), name);
+	}
+
+	return std::move(resultShader);
+}
+
+void SaveShaderCache(size_t key, const ShaderIncludeHandler& includeHandler, IDxcBlob* compiledShader, IDxcBlob* reflectionBlob)
+{
+	VGScopedCPUStat("Shader Cache Save");
+
+	const auto path = GetShaderCachePath(key);
+
+	std::error_code error;
+	std::filesystem::create_directories(path.parent_path(), error);
+
+	std::ofstream cacheStream{ path, std::ios::binary };
+	if (!cacheStream.is_open())
+	{
+		VGLogWarning(logRendering, "Failed to save shader cache entry at '{}'.", path.generic_wstring());
+
+		return;
+	}
+
+	WriteCacheValue(cacheStream, shaderCacheVersion);
+
+	WriteCacheValue(cacheStream, static_cast<uint32_t>(includeHandler.includes.size()));
+	for (const auto& [includePath, includeHash] : includeHandler.includes)
+	{
+		WriteCacheValue(cacheStream, static_cast<uint32_t>(includePath.size()));
+		cacheStream.write(reinterpret_cast<const char*>(includePath.data()), includePath.size() * sizeof(wchar_t));
+		WriteCacheValue(cacheStream, includeHash);
+	}
+
+	WriteCacheValue(cacheStream, static_cast<uint64_t>(compiledShader->GetBufferSize()));
+	cacheStream.write(static_cast<const char*>(compiledShader->GetBufferPointer()), compiledShader->GetBufferSize());
+
+	WriteCacheValue(cacheStream, static_cast<uint64_t>(reflectionBlob ? reflectionBlob->GetBufferSize() : 0));
+	if (reflectionBlob)
+	{
+		cacheStream.write(static_cast<const char*>(reflectionBlob->GetBufferPointer()), reflectionBlob->GetBufferSize());
+	}
+}
+
 std::unique_ptr<Shader> CompileShader(const std::filesystem::path& path, ShaderType type, std::string_view entry, const std::vector<ShaderMacro>& macros)
 {
 	VGScopedCPUStat("Compile Shader");
 
-	VGLog(logRendering, "Compiling shader: {}", path.generic_wstring());
-
 	if (!shaderUtils)
 	{
 		auto result = DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(shaderUtils.Indirect()));
@@ -100,15 +397,6 @@ std::unique_ptr<Shader> CompileShader(const std::filesystem::path& path, ShaderT
 		}
 	}
 
-	if (!shaderIncludeHandler)
-	{
-		auto result = shaderUtils->CreateDefaultIncludeHandler(shaderIncludeHandler.Indirect());
-		if (FAILED(result))
-		{
-			VGLogCritical(logRendering, "Failed to create DXC include handler: {}", result);
-		}
-	}
-
 	auto* compileTarget = VGText("");
 
 	switch (type)
@@ -116,6 +404,8 @@ std::unique_ptr<Shader> CompileShader(const std::filesystem::path& path, ShaderT
 	case ShaderType::Vertex: compileTarget = VGText("vs_6_6"); break;
 	case ShaderType::Pixel: compileTarget = VGText("ps_6_6"); break;
 	case ShaderType::Compute: compileTarget = VGText("cs_6_6"); break;
+	case ShaderType::Amplification: compileTarget = VGText("as_6_6"); break;
+	case ShaderType::Mesh: compileTarget = VGText("ms_6_6"); break;
 	}
 
 	auto pathModified = path;
@@ -181,12 +471,28 @@ std::unique_ptr<Shader> CompileShader(const std::filesystem::path& path, ShaderT
 		compileArguments.emplace_back(macro.data());
 	}
 
+	// The arguments cover the entry point, target profile, macros and build configuration.
+	auto cacheKey = HashShaderSource(sourceBuffer.Ptr, sourceBuffer.Size);
+	for (const auto* argument : compileArguments)
+	{
+		HashCombine(cacheKey, std::wstring_view{ argument });
+	}
+
+	if (auto cachedShader = LoadShaderCache(cacheKey, pathModified, stableShaderName); cachedShader)
+	{
+		return std::move(cachedShader);
+	}
+
+	VGLog(logRendering, "Compiling shader: {}", path.generic_wstring());
+
+	ShaderIncludeHandler includeHandler;
+
 	ResourcePtr<IDxcResult> compileResult;
 	result = shaderCompiler->Compile(
 		&sourceBuffer,
 		compileArguments.size() ? compileArguments.data() : nullptr,
 		static_cast<uint32_t>(compileArguments.size()),
-		shaderIncludeHandler.Get(),
+		&includeHandler,
 		IID_PPV_ARGS(compileResult.Indirect())
 	);
 
@@ -230,19 +536,17 @@ std::unique_ptr<Shader> CompileShader(const std::filesystem::path& path, ShaderT
 
 	std::memcpy(resultShader->bytecode.data(), compiledShader->GetBufferPointer(), compiledShader->GetBufferSize());
 
+	AddShaderSourceFile(*resultShader, pathModified);
+	for (const auto& [includePath, includeHash] : includeHandler.includes)
+	{
+		AddShaderSourceFile(*resultShader, includePath);
+	}
+
 	ResourcePtr<IDxcBlob> shaderReflectionBlob;
 	compileResult->GetOutput(DXC_OUT_REFLECTION, IID_PPV_ARGS(shaderReflectionBlob.Indirect()), nullptr);
 	if (shaderReflectionBlob)
 	{
-		DxcBuffer reflectionBuffer;
-		reflectionBuffer.Ptr = shaderReflectionBlob->GetBufferPointer();
-		reflectionBuffer.Size = shaderReflectionBlob->GetBufferSize();
-		reflectionBuffer.Encoding = DXC_CP_ACP;
-
-		ResourcePtr<ID3D12ShaderReflection> reflection;
-		shaderUtils->CreateReflection(&reflectionBuffer, IID_PPV_ARGS(reflection.Indirect()));
-
-		ReflectShader(resultShader, reflection.Get(), path.filename().generic_wstring());
+		CreateShaderReflection(resultShader, shaderReflectionBlob->GetBufferPointer(), shaderReflectionBlob->GetBufferSize(), path.filename().generic_wstring());
 	}
 
 	else
@@ -250,5 +554,7 @@ std::unique_ptr<Shader> CompileShader(const std::filesystem::path& path, ShaderT
 		VGLogWarning(logRendering, "Failed to retrieve shader reflection data.");
 	}
 
+	SaveShaderCache(cacheKey, includeHandler, compiledShader.Get(), shaderReflectionBlob.Get());
+
 	return std::move(resultShader);
 }
\ No newline at end of file
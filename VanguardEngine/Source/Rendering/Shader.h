@@ -9,7 +9,7 @@
 #include <memory>
 #include <filesystem>
 #include <string_view>
-#include <vector>
+#include <utility>
 
 struct ShaderReflection
 {
@@ -34,6 +34,7 @@ struct ShaderReflection
 		size_t bindCount;
 		size_t bindSpace;
 		ResourceBindType type;
+		size_t size = 0;  // Bytes of constant buffers up to the end of their last variable, without trailing padding.
 	};
 
 	std::vector<InputElement> inputElements;
@@ -46,12 +47,19 @@ enum class ShaderType
 	Vertex,
 	Pixel,
 	Compute,
+	Amplification,
+	Mesh,
 };
 
 struct Shader
 {
 	std::vector<uint8_t> bytecode;
 	ShaderReflection reflection;
+	// Root source and every include, with their write times when compiled.
+	std::vector<std::pair<std::filesystem::path, std::filesystem::file_time_type>> sourceFiles;
+
+	// True if any source file was written since compiling.
+	bool SourcesChanged() const;
 };
 
 std::unique_ptr<Shader> CompileShader(const std::filesystem::path& path, ShaderType type, std::string_view entry, const std::vector<ShaderMacro>& macros);
\ No newline at end of file
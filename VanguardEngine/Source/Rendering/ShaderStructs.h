@@ -24,8 +24,26 @@ struct Camera
 	float farPlane;
 	float fieldOfView;  // Horizontal, radians.
 	float aspectRatio;
+	XMFLOAT2 jitter;  // Clip space offset applied to the projection, the last frame matrices are unjittered.
+	XMFLOAT2 lastFrameJitter;
 };
 
+// Per-view constants of the culling shaders, indexed like the cameras. See Culling.hlsli.
+struct CullingView
+{
+	XMFLOAT4 frustumPlanes[6];  // World space, normalized and facing inwards. Left, right, bottom, top, near and far.
+	XMMATRIX view;
+	XMMATRIX viewProjection;
+	XMFLOAT4 position;  // World space.
+	XMFLOAT2 projectionScale;
+	float nearPlane;
+	uint32_t orthographic;
+	XMFLOAT2 hiZSize;
+	uint32_t hiZMipCount;
+	float padding;
+};
+
+// Kept on the CPU, and packed into PackedMaterialData when uploaded.
 struct MaterialData
 {
 	uint32_t baseColor;
@@ -37,7 +55,47 @@ struct MaterialData
 	XMFLOAT4 baseColorFactor;
 	float metallicFactor;
 	float roughnessFactor;
-	XMFLOAT2 padding;
+	// From the material's glTF sampler, the filtering follows the global anisotropy.
+	D3D12_TEXTURE_ADDRESS_MODE addressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+	D3D12_TEXTURE_ADDRESS_MODE addressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
+	bool blend = false;  // glTF BLEND alpha mode, drawn by the transparency pass instead of the opaque passes.
+};
+
+// Texture words hold the bindless index in their low bits, see Material.hlsli.
+struct PackedMaterialData
+{
+	uint32_t baseColor;  // Sampler heap index in the high bits.
+	uint32_t metallicRoughness;  // Metallic factor as a 12 bit unorm in the high bits.
+	uint32_t normal;  // Roughness factor as a 12 bit unorm in the high bits.
+	uint32_t occlusion;
+	uint32_t emissive;
+	uint32_t emissiveFactor;  // R11G11B10 float.
+	uint32_t baseColorFactor[2];  // Half precision.
+};
+
+static constexpr uint32_t materialTextureBits = 20;
+
+// Shader permutation of a material, one bit per texture it samples and one for blending. Draws are bucketed by permutation,
+// and the forward pass specializes a pipeline variant for each bucket, see Forward.hlsl.
+enum MaterialFeature
+{
+	MaterialFeatureBaseColor = 1 << 0,  // Also implies alpha testing.
+	MaterialFeatureMetallicRoughness = 1 << 1,
+	MaterialFeatureNormal = 1 << 2,
+	MaterialFeatureOcclusion = 1 << 3,
+	MaterialFeatureEmissive = 1 << 4,
+	MaterialFeatureBlend = 1 << 5,  // Skipped by the opaque passes.
+};
+
+constexpr uint32_t materialPermutations = 1 << 6;
+
+// Contiguous ranges of a material permutation's draws, in batch arguments and in culled meshlet draws.
+struct MaterialBucket
+{
+	uint32_t batchOffset;
+	uint32_t batchCount;
+	uint32_t meshletDrawOffset;
+	uint32_t meshletDrawCount;  // Upper bound on the bucket's meshlet draws.
 };
 
 struct Light
@@ -46,15 +104,20 @@ struct Light
 	uint32_t type;
 	XMFLOAT3 color;
 	float luminance;
-	XMFLOAT3 direction;
-	float padding;
+	XMFLOAT3 direction;  // Spot and area lights emit along the direction.
+	float spotCosOuter;
+	XMFLOAT3 tangent;  // Area light width axis.
+	float spotCosInner;
+	XMFLOAT2 areaExtents;  // Half width and height. Probes store their influence radius in x.
+	uint32_t probeIndex;  // Cube of the probe in the probe arrays. Point and spot lights store their first local shadow tile plus one, zero when unshadowed.
+	float radius;  // Influence range, attenuation reaches zero at it. Unused by directional lights and probes.
 };
 
 static const uint32_t vertexChannelPosition = 0;
 static const uint32_t vertexChannelNormal = 1;
 static const uint32_t vertexChannelTexcoord = 2;
 static const uint32_t vertexChannelTangent = 3;
-static const uint32_t vertexChannelBitangent = 4;
+static const uint32_t vertexChannelBitangent = 4;  // Never stored, derived from the normal and tangent.
 static const uint32_t vertexChannelColor = 5;
 static const uint32_t vertexChannels = 6;
 
@@ -70,9 +133,14 @@ struct uint128_t
 struct VertexMetadata
 {
 	uint32_t activeChannels;  // Bit mask of vertex attributes.
-	uint32_t padding[3];
+	uint32_t quantizedChannels;  // Bit mask of active attributes stored in their compressed format, see VertexAssembly.hlsli.
+	uint32_t padding[2];
 	uint128_t channelStrides[vertexChannels / 4 + 1];
 	uint128_t channelOffsets[vertexChannels / 4 + 1];
+	XMFLOAT3 positionMin;  // Quantized positions are relative to the mesh bounds.
+	float padding2;
+	XMFLOAT3 positionExtent;
+	float padding3;
 };
 
 struct VertexAssemblyData
@@ -90,29 +158,164 @@ struct ClusterData
 	float logY;
 	int32_t froxelSize;
 	uint32_t dimensions[3];
-	uint32_t padding2;
+	uint32_t directionalLightListBuffer;
 };
 
 struct IblData
 {
-	uint32_t irradianceTexture;
+	uint32_t irradianceBuffer;
 	uint32_t prefilterTexture;
 	uint32_t brdfTexture;
 	uint32_t prefilterLevels;
 };
 
-struct ObjectData
+// See Shadows.hlsli.
+struct ShadowData
+{
+	uint32_t shadowMap;
+	uint32_t cascadeCount;  // Zero when shadows are disabled.
+	uint32_t localShadowAtlas;  // Zero when the pass doesn't shade local lights.
+	float normalOffset;  // In shadow map texels.
+	float cascadeSplits[4];  // Far view space depth of each cascade.
+};
+
+// See VirtualShadows/Core.hlsli.
+struct VirtualShadowData
+{
+	uint32_t enabled;
+	uint32_t pageTable;
+	uint32_t physicalPages;
+	uint32_t cameraIndex;
+};
+
+// See Volumetrics/Fog.hlsli.
+struct FogData
+{
+	uint32_t integratedTexture;  // Zero when volumetric fog is disabled.
+	float range;
+	float padding[2];
+};
+
+// Shared by the objects of every subset of a mesh entity, so moving an entity only uploads its transform.
+struct TransformData
 {
 	XMMATRIX worldMatrix;
+	XMMATRIX lastFrameWorldMatrix;  // For motion vectors, matches the world matrix unless the transform changed last frame.
+};
+
+// Per subset record, only rewritten when the entity's mesh changes.
+struct ObjectData
+{
 	VertexMetadata vertexMetadata;
+	uint32_t transformIndex;
 	uint32_t materialIndex;
-	float boundingSphereRadius;
-	XMFLOAT2 padding;
+	float boundingSphereRadius;  // Object space, scaled by the transform's largest axis when culling.
+	uint32_t meshletOffset;
+	uint32_t meshletCount;
+	uint32_t batchIndex;  // Batch record of the instance, invalid for free instance slots.
+	uint32_t indexOffset;  // Subset's first index in bytes, for fetching triangles outside of draws.
+	uint32_t indexSize;
+	XMFLOAT3 boundingSphereCenter;  // Object space.
+	XMFLOAT3 boundsCenter;  // Object space box.
+	XMFLOAT3 boundsExtents;
+	uint32_t impostorIndex;  // Impostor record of the mesh plus one, zero without one. See Impostors.
+};
+
+// Culling bounds of a cluster of up to 124 triangles, in object space. Meshlet indices are contiguous in the index buffer,
+// offset relative to the subset's index view. The vertex and triangle offsets index the separate meshlet streams used by
+// mesh shaders.
+struct MeshletData
+{
+	XMFLOAT3 center;
+	float radius;
+	XMFLOAT3 coneApex;
+	float coneCutoff;  // Cosine of the cone's half angle.
+	XMFLOAT3 coneAxis;
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	uint32_t vertexOffset;
+	uint32_t vertexCount;
+	uint32_t triangleOffset;
+};
+
+// Mesh shader draw state, see MeshShading.hlsli.
+struct MeshletDrawData
+{
+	uint32_t meshletBuffer;
+	uint32_t meshletVertexBuffer;
+	uint32_t meshletTriangleBuffer;
+	uint32_t meshInstanceBuffer;
+	uint32_t drawVisibilityBuffer;
+	uint32_t skipVisibilityBuffer;
+	uint32_t flags;
+	uint32_t hiZTexture;
+	uint32_t hiZMipLevels;
+	uint32_t instanceCount;
+	uint32_t instanceRowSize;
+	uint32_t instanceOffset;
+	uint32_t cullCameraIndex;
+	uint32_t cullingViewBuffer;
+	uint32_t transformBuffer;
+	float padding;
+};
+
+// Impostor draw state, see Impostors.hlsli. Takes the place of the meshlet draw data in the bind data of impostor draws.
+struct ImpostorDrawData
+{
+	uint32_t impostorBuffer;
+	uint32_t albedoAtlas;
+	uint32_t normalAtlas;
+	uint32_t depthAtlas;
+	float padding[12];
+};
+
+static_assert(sizeof(ImpostorDrawData) == sizeof(MeshletDrawData));
+
+// Per mesh impostor record, see Impostors.hlsli.
+struct ImpostorData
+{
+	XMFLOAT3 center;  // Object space sphere around every subset.
+	float radius;
+	uint32_t slot;  // In the atlases.
+	uint32_t ready;  // Baked, distant instances draw it.
+	float padding[2];
+};
+
+enum MeshletDrawFlag
+{
+	MeshletDrawRequireVisible = 1 << 0,
+	MeshletDrawExcludeVisible = 1 << 1,
+	MeshletDrawCull = 1 << 2,
+	MeshletDrawOcclusion = 1 << 3,
 };
 
+// One per batch of instances sharing a mesh subset and material. Each batch binds the index view of its subset, since
+// subsets store 16 bit indices when their vertex count allows. The index view is first to keep its natural alignment.
+// Every level of detail of a batch has its own argument, consecutive after the full detail argument that instances
+// reference. Draws start at their argument's own index in the argument buffer, which vertex shaders fetch the batch
+// offset through, see MeshSystem::BindArguments().
 struct MeshIndirectArgument
 {
-	uint32_t batchId;
+	D3D12_INDEX_BUFFER_VIEW indexView;
+	uint32_t batchId;  // Offset of the batch's first instance in the instance list, not consumed by the command signature.
 	D3D12_DRAW_INDEXED_ARGUMENTS draw;
-	XMFLOAT2 padding;
+	uint32_t bucket;  // Material bucket of the batch, not consumed by the command signature.
+	uint32_t lodLevel;  // Of this argument.
+	uint32_t lodCount;  // Of the batch.
+	float lodError;  // Object space simplification error of the level.
+};
+
+// Persistent batch record, the argument index places the batch's draw within its material bucket.
+struct MeshBatchRecord
+{
+	MeshIndirectArgument argument;
+	uint32_t argumentIndex;
+	uint32_t padding;
+};
+
+// Instances are sorted by batch, each batch's instances are contiguous.
+struct MeshInstance
+{
+	uint32_t objectId;
+	uint32_t batch;
 };
\ No newline at end of file
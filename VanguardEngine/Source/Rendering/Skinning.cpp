@@ -0,0 +1,258 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/Skinning.h>
+#include <Rendering/Device.h>
+#include <Rendering/MeshFactory.h>
+#include <Rendering/RenderGraph.h>
+#include <Rendering/RenderPass.h>
+#include <Rendering/CommandList.h>
+#include <Core/CoreComponents.h>
+
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+	constexpr uint32_t groupSize = 64;  // Matches Skinning.hlsl.
+	constexpr uint32_t missingAttribute = ~0u;
+
+	struct BindData
+	{
+		uint32_t positionBuffer;
+		uint32_t extraBuffer;
+		uint32_t skinBuffer;
+		uint32_t jointBuffer;
+		uint32_t sourcePositionOffset;
+		uint32_t sourceExtraOffset;
+		uint32_t outputPositionOffset;
+		uint32_t outputExtraOffset;
+		uint32_t skinOffset;
+		uint32_t vertexCount;
+		uint32_t firstJoint;
+		uint32_t extraStride;
+		uint32_t normalOffset;
+		uint32_t tangentOffset;
+	};
+
+	// Extra attributes are interleaved, they all share the vertex's stride.
+	uint32_t GetExtraStride(const VertexMetadata& metadata)
+	{
+		for (uint32_t i = vertexChannelNormal; i < vertexChannels; ++i)
+		{
+			if (metadata.activeChannels & (1 << i))
+				return metadata.channelStrides[i / 4][i % 4];
+		}
+
+		return 0;
+	}
+
+	uint32_t GetExtraAttributeOffset(const VertexMetadata& metadata, uint32_t channel)
+	{
+		if ((metadata.activeChannels & (1 << channel)) == 0)
+			return missingAttribute;
+
+		return metadata.channelOffsets[channel / 4][channel % 4];
+	}
+}
+
+void Skinning::PatchRelocations()
+{
+	if (meshFactory->GetRevision() == meshRevision)
+		return;
+
+	meshRevision = meshFactory->GetRevision();
+
+	// Defragmenting moves both the source mesh and the skinned ranges, subsets are relative to them and stay valid.
+	for (auto& [entity, instance] : instances)
+	{
+		if (const auto offset = meshFactory->GetRelocation(instance.source.globalOffset.index))
+		{
+			instance.source.globalOffset = *offset;
+		}
+
+		if (const auto offset = meshFactory->GetRelocation(instance.vertices.index))
+		{
+			instance.vertices = *offset;
+		}
+
+		instance.mesh.globalOffset = instance.source.globalOffset;
+		instance.mesh.globalOffset.position = instance.vertices.position;
+		instance.mesh.globalOffset.extra = instance.vertices.extra;
+	}
+}
+
+Skinning::~Skinning()
+{
+	device->GetResourceManager().Destroy(jointBuffer);
+}
+
+void Skinning::Initialize(RenderDevice* inDevice, MeshFactory* inMeshFactory)
+{
+	device = inDevice;
+	meshFactory = inMeshFactory;
+	meshRevision = meshFactory->GetRevision();
+
+	skinningLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Skinning", "Main" });
+
+	BufferDescription jointDescription{};
+	jointDescription.updateRate = ResourceFrequency::Static;
+	jointDescription.bindFlags = BindFlag::ShaderResource;
+	jointDescription.accessFlags = AccessFlag::CPUWrite;
+	jointDescription.size = maxJoints;
+	jointDescription.stride = sizeof(XMFLOAT4X4);
+
+	jointBuffer = device->GetResourceManager().Create(jointDescription, VGText("Joint buffer"));
+}
+
+const MeshComponent& Skinning::AddInstance(entt::entity entity, const MeshComponent& mesh)
+{
+	// Skinned meshes are built with full precision positions, normals and tangents, the pass writes them back as floats.
+	constexpr auto skinnedChannels = (1 << vertexChannelPosition) | (1 << vertexChannelNormal) | (1 << vertexChannelTangent);
+	const auto skinned = std::any_of(mesh.subsets.begin(), mesh.subsets.end(), [](const auto& subset) { return subset.skinned; });
+	if (!skinned || (mesh.metadata.quantizedChannels & skinnedChannels) != 0)
+		return mesh;
+
+	PatchRelocations();
+
+	const auto positionStride = mesh.metadata.channelStrides[0][vertexChannelPosition];
+	const auto extraStride = GetExtraStride(mesh.metadata);
+
+	Instance instance{ .mesh = mesh, .source = mesh };
+	size_t positionSize = 0;
+	size_t extraSize = 0;
+
+	for (auto& subset : instance.mesh.subsets)
+	{
+		subset.localOffset.position = positionSize;
+		subset.localOffset.extra = extraSize;
+		positionSize += subset.vertices * positionStride;
+		extraSize += subset.vertices * extraStride;
+	}
+
+	const auto vertices = meshFactory->AllocateVertices(positionSize, extraSize);
+	if (!vertices)
+	{
+		VGLogError(logRendering, "Mesh buffers are out of space for skinned vertices, drawing the bind pose.");
+
+		return mesh;
+	}
+
+	instance.vertices = *vertices;
+	instance.mesh.globalOffset.position = vertices->position;
+	instance.mesh.globalOffset.extra = vertices->extra;
+
+	return (instances[entity] = std::move(instance)).mesh;
+}
+
+void Skinning::RemoveInstance(entt::entity entity)
+{
+	const auto iter = instances.find(entity);
+	if (iter == instances.end())
+		return;
+
+	PatchRelocations();
+
+	meshFactory->FreeVertices(iter->second.vertices);
+	instances.erase(iter);
+}
+
+const MeshComponent& Skinning::GetMesh(entt::entity entity, const MeshComponent& mesh) const
+{
+	const auto iter = instances.find(entity);
+
+	return iter != instances.end() ? iter->second.mesh : mesh;
+}
+
+void Skinning::Render(RenderGraph& graph, const entt::registry& registry, const MeshResources& meshResources)
+{
+	VGScopedCPUStat("Skinning");
+
+	PatchRelocations();
+
+	if (instances.empty())
+		return;
+
+	std::vector<XMFLOAT4X4> joints;
+	std::vector<BindData> dispatches;
+
+	for (const auto& [entity, instance] : instances)
+	{
+		const auto* skin = registry.try_get<SkinComponent>(entity);
+		const auto* transform = registry.try_get<WorldTransformComponent>(entity);
+		if (!skin || !transform)
+			continue;
+
+		if (joints.size() + skin->joints.size() > maxJoints)
+		{
+			VGLogWarning(logRendering, "Exceeded the maximum of {} skinned joints, remaining entities draw their last pose.", maxJoints);
+
+			break;
+		}
+
+		// Skinned vertices stay in the entity's space, the instance transform is applied when drawing.
+		const auto inverseWorld = XMMatrixInverse(nullptr, XMLoadFloat4x4(&transform->matrix));
+		const auto firstJoint = static_cast<uint32_t>(joints.size());
+
+		for (size_t i = 0; i < skin->joints.size(); ++i)
+		{
+			// Missing joints hold their influence in the bind pose.
+			auto jointMatrix = XMMatrixIdentity();
+			if (const auto* jointTransform = registry.try_get<WorldTransformComponent>(skin->joints[i]); jointTransform && i < skin->inverseBindMatrices.size())
+			{
+				jointMatrix = XMLoadFloat4x4(&skin->inverseBindMatrices[i]) * XMLoadFloat4x4(&jointTransform->matrix) * inverseWorld;
+			}
+
+			XMStoreFloat4x4(&joints.emplace_back(), jointMatrix);
+		}
+
+		const auto& source = instance.source;
+		const auto& mesh = instance.mesh;
+		const auto extraStride = GetExtraStride(source.metadata);
+
+		for (size_t i = 0; i < source.subsets.size(); ++i)
+		{
+			dispatches.emplace_back(BindData{
+				.sourcePositionOffset = static_cast<uint32_t>(source.globalOffset.position + source.subsets[i].localOffset.position),
+				.sourceExtraOffset = static_cast<uint32_t>(source.globalOffset.extra + source.subsets[i].localOffset.extra),
+				.outputPositionOffset = static_cast<uint32_t>(mesh.globalOffset.position + mesh.subsets[i].localOffset.position),
+				.outputExtraOffset = static_cast<uint32_t>(mesh.globalOffset.extra + mesh.subsets[i].localOffset.extra),
+				.skinOffset = source.subsets[i].skinned ? static_cast<uint32_t>(source.globalOffset.skin + source.subsets[i].localOffset.skin) : missingAttribute,
+				.vertexCount = static_cast<uint32_t>(source.subsets[i].vertices),
+				.firstJoint = firstJoint,
+				.extraStride = extraStride,
+				.normalOffset = GetExtraAttributeOffset(source.metadata, vertexChannelNormal),
+				.tangentOffset = GetExtraAttributeOffset(source.metadata, vertexChannelTangent)
+			});
+		}
+	}
+
+	if (dispatches.empty())
+		return;
+
+	device->GetResourceManager().Write(jointBuffer, joints);
+
+	const auto jointTag = graph.Import(jointBuffer);
+	const auto skinTag = graph.Import(meshFactory->vertexSkinBuffer);
+
+	auto& skinningPass = graph.AddPass("Skinning Pass", ExecutionQueue::Graphics);
+	skinningPass.Read(jointTag, ResourceBind::SRV);
+	skinningPass.Read(skinTag, ResourceBind::SRV);
+	skinningPass.Write(meshResources.positionTag, ResourceBind::UAV);
+	skinningPass.Write(meshResources.extraTag, ResourceBind::UAV);
+	skinningPass.Bind([this, dispatches = std::move(dispatches), jointTag, skinTag, meshResources](CommandList& list, RenderPassResources& resources)
+	{
+		list.BindPipeline(skinningLayout);
+
+		for (auto bindData : dispatches)
+		{
+			bindData.positionBuffer = resources.Get(meshResources.positionTag);
+			bindData.extraBuffer = resources.Get(meshResources.extraTag);
+			bindData.skinBuffer = resources.Get(skinTag);
+			bindData.jointBuffer = resources.Get(jointTag);
+
+			list.BindConstants("bindData", bindData);
+			list.Dispatch((bindData.vertexCount + groupSize - 1) / groupSize, 1, 1);
+		}
+	});
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Rendering/ResourceHandle.h>
+#include <Rendering/RenderPipeline.h>
+#include <Rendering/RenderComponents.h>
+#include <Rendering/ClusteredLightCulling.h>
+
+#include <entt/entt.hpp>
+
+#include <unordered_map>
+
+class RenderDevice;
+class RenderGraph;
+class MeshFactory;
+
+// Skins the meshes of entities with a skin once per frame, on the GPU, into vertex ranges owned by each entity. Instances
+// of the entity draw from those ranges, so every view and pass assembles the skinned vertices like any other mesh instead
+// of skinning them again. Positions, normals and tangents are skinned, the other attributes are copied along. Bounds,
+// meshlet cones and ray traced geometry stay those of the bind pose.
+class Skinning
+{
+public:
+	static constexpr uint32_t maxJoints = 1024 * 16;  // Across every skinned entity.
+
+private:
+	struct Instance
+	{
+		MeshComponent mesh;  // Drawn by the entity, the vertex offsets point at the skinned ranges.
+		MeshComponent source;
+		PrimitiveOffset vertices;  // Allocation of the skinned ranges.
+	};
+
+	RenderDevice* device;
+	MeshFactory* meshFactory;
+
+	RenderPipelineLayout skinningLayout;
+	BufferHandle jointBuffer;
+
+	std::unordered_map<entt::entity, Instance> instances;
+	size_t meshRevision = 0;
+
+	void PatchRelocations();
+
+public:
+	~Skinning();
+
+	void Initialize(RenderDevice* inDevice, MeshFactory* inMeshFactory);
+	// Allocates the entity's skinned ranges and returns the mesh its instances draw. Meshes without skin influences, or
+	// that don't fit, are returned as is and draw in the bind pose.
+	const MeshComponent& AddInstance(entt::entity entity, const MeshComponent& mesh);
+	void RemoveInstance(entt::entity entity);
+	// Mesh the entity's instances draw, the given mesh for entities that aren't skinned. Safe to call concurrently.
+	const MeshComponent& GetMesh(entt::entity entity, const MeshComponent& mesh) const;
+	// Visits every skinned entity.
+	template <typename F>
+	void ForEachEntity(F&& function) const;
+
+	// Uploads the joint matrices and skins every instance, before anything reads the vertex buffers.
+	void Render(RenderGraph& graph, const entt::registry& registry, const MeshResources& meshResources);
+};
+
+template <typename F>
+inline void Skinning::ForEachEntity(F&& function) const
+{
+	for (const auto& [entity, instance] : instances)
+	{
+		function(entity);
+	}
+}
\ No newline at end of file
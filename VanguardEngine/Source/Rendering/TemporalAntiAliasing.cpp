@@ -0,0 +1,118 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/TemporalAntiAliasing.h>
+#include <Rendering/RenderGraph.h>
+#include <Rendering/RenderPass.h>
+#include <Rendering/RenderGraphResourceManager.h>
+#include <Rendering/Device.h>
+#include <Rendering/CommandList.h>
+
+#include <cmath>
+
+namespace
+{
+	float Halton(uint32_t index, uint32_t base)
+	{
+		float fraction = 1.f;
+		float result = 0.f;
+
+		while (index > 0)
+		{
+			fraction /= base;
+			result += fraction * (index % base);
+			index /= base;
+		}
+
+		return result;
+	}
+}
+
+void TemporalAntiAliasing::Initialize(RenderDevice* inDevice)
+{
+	device = inDevice;
+
+	resolveLayout = RenderPipelineLayout{}
+		.ComputeShader({ "TemporalAA", "Main" });
+}
+
+XMFLOAT2 TemporalAntiAliasing::GetJitter(uint32_t frame, uint32_t width, uint32_t height)
+{
+	// Skip the first element, it's zero for both bases.
+	const auto index = (frame % jitterSamples) + 1;
+
+	// Pixel offsets within [-0.5, 0.5], converted to clip space where y points up.
+	const auto x = Halton(index, 2) - 0.5f;
+	const auto y = Halton(index, 3) - 0.5f;
+
+	return { 2.f * x / width, -2.f * y / height };
+}
+
+HistoryResource TemporalAntiAliasing::CreateHistory(RenderGraph& graph) const
+{
+	return graph.CreateHistory(VGText("Temporal history"), TransientTextureDescription{
+		.width = 0,
+		.height = 0,
+		.depth = 1,
+		.resolutionScale = 1.f,
+		.format = DXGI_FORMAT_R16G16B16A16_FLOAT
+	});
+}
+
+RenderResource TemporalAntiAliasing::GetHistory(RenderGraph& graph) const
+{
+	return CreateHistory(graph).previous;
+}
+
+RenderResource TemporalAntiAliasing::Render(RenderGraph& graph, const TemporalInputs& inputs)
+{
+	const auto history = CreateHistory(graph);
+	const auto historyTag = history.current;
+
+	auto& resolvePass = graph.AddPass("Temporal Resolve Pass", ExecutionQueue::Compute);
+	resolvePass.Read(inputs.cameraBuffer, ResourceBind::SRV);
+	resolvePass.Read(inputs.color, ResourceBind::SRV);
+	resolvePass.Read(inputs.depthStencil, ResourceBind::SRV);
+	resolvePass.Read(inputs.motionVectors, ResourceBind::SRV);
+	if (history.Valid())
+	{
+		resolvePass.Read(history.previous, ResourceBind::SRV);
+	}
+	resolvePass.Write(historyTag, TextureView{}
+		.UAV("", 0));
+	resolvePass.Bind([this, inputs, oldHistory=history.previous, historyTag](CommandList& list, RenderPassResources& resources)
+	{
+		list.BindPipeline(resolveLayout);
+
+		struct {
+			uint32_t cameraBuffer;
+			uint32_t cameraIndex;
+			uint32_t colorTexture;
+			uint32_t depthTexture;
+			uint32_t historyTexture;
+			uint32_t outputTexture;
+			float historyWeight;
+			uint32_t motionTexture;
+		} bindData;
+
+		bindData.cameraBuffer = resources.Get(inputs.cameraBuffer);
+		bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
+		bindData.colorTexture = resources.Get(inputs.color);
+		bindData.depthTexture = resources.Get(inputs.depthStencil);
+		bindData.historyTexture = 0;
+		if (oldHistory.id != 0)
+			bindData.historyTexture = resources.Get(oldHistory);
+		bindData.outputTexture = resources.Get(historyTag);
+		bindData.historyWeight = historyWeight;
+		bindData.motionTexture = resources.Get(inputs.motionVectors);
+
+		list.BindConstants("bindData", bindData);
+
+		const auto& outputComponent = device->GetResourceManager().Get(resources.GetTexture(historyTag));
+		const auto dispatchX = (uint32_t)std::ceil(outputComponent.description.width / 8.f);
+		const auto dispatchY = (uint32_t)std::ceil(outputComponent.description.height / 8.f);
+
+		list.Dispatch(dispatchX, dispatchY, 1);
+	});
+
+	return historyTag;
+}
\ No newline at end of file
@@ -0,0 +1,44 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Rendering/RenderPipeline.h>
+#include <Rendering/RenderGraphResource.h>
+
+class RenderDevice;
+class RenderGraph;
+
+// Inputs shared by every temporal resolve. Third party upscalers (FSR2, DLSS, XeSS) consume the same set, so they slot in
+// as alternative resolves of these inputs.
+struct TemporalInputs
+{
+	RenderResource color;  // Jittered HDR scene color.
+	RenderResource depthStencil;
+	RenderResource motionVectors;  // Unjittered, in UV units.
+	RenderResource cameraBuffer;
+};
+
+class TemporalAntiAliasing
+{
+private:
+	RenderDevice* device;
+
+	RenderPipelineLayout resolveLayout;
+
+	static constexpr uint32_t jitterSamples = 8;
+
+	HistoryResource CreateHistory(RenderGraph& graph) const;
+
+public:
+	float historyWeight = 0.9f;  // Blend weight of the reprojected history, higher values converge slower but smoother.
+
+public:
+	void Initialize(RenderDevice* inDevice);
+	// Sub-pixel projection offset of the frame in clip space, from a Halton (2, 3) sequence.
+	static XMFLOAT2 GetJitter(uint32_t frame, uint32_t width, uint32_t height);
+	// The previous frame's resolved color, zero without history.
+	RenderResource GetHistory(RenderGraph& graph) const;
+	// Returns the resolved HDR color, at the same resolution as the input.
+	RenderResource Render(RenderGraph& graph, const TemporalInputs& inputs);
+};
\ No newline at end of file
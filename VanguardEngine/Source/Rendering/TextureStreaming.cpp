@@ -0,0 +1,392 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/TextureStreaming.h>
+#include <Rendering/Device.h>
+#include <Rendering/Renderer.h>
+#include <Rendering/MaterialFactory.h>
+#include <Rendering/RenderComponents.h>
+#include <Rendering/ResourceFormat.h>
+#include <Core/CoreComponents.h>
+#include <Core/ConsoleVariable.h>
+#include <Utility/FrameArena.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+uint32_t TextureStreamer::GetMipCount(const StreamedTexture& texture)
+{
+	return static_cast<uint32_t>(texture.image.mips.size());
+}
+
+size_t TextureStreamer::GetResidentSize(const StreamedTexture& texture, uint32_t mip)
+{
+	const auto size = texture.image.mips[mip].size();
+
+	// The full mip chain adds a third.
+	return texture.mipmap ? size * 4 / 3 : size;
+}
+
+void TextureStreamer::GetChannelBiases(uint32_t* biases) const
+{
+	std::fill_n(biases, static_cast<size_t>(TextureChannel::Count), 0u);
+	if (!channelBias)
+	{
+		return;
+	}
+
+	biases[static_cast<size_t>(TextureChannel::BaseColor)] = std::max(*CvarGet("textureMipBiasBaseColor", int), 0);
+	biases[static_cast<size_t>(TextureChannel::MetallicRoughness)] = std::max(*CvarGet("textureMipBiasMetallicRoughness", int), 0);
+	biases[static_cast<size_t>(TextureChannel::Normal)] = std::max(*CvarGet("textureMipBiasNormal", int), 0);
+	biases[static_cast<size_t>(TextureChannel::Occlusion)] = std::max(*CvarGet("textureMipBiasOcclusion", int), 0);
+	biases[static_cast<size_t>(TextureChannel::Emissive)] = std::max(*CvarGet("textureMipBiasEmissive", int), 0);
+}
+
+uint32_t TextureStreamer::GetBiasMip(const StreamedTexture& texture, const uint32_t* channelBiases) const
+{
+	return std::min(mipBias + channelBiases[static_cast<size_t>(texture.channel)], texture.mipLimit);
+}
+
+void TextureStreamer::UpdateRequests(const entt::registry& registry)
+{
+	VGScopedCPUStat("Update Texture Requests");
+
+	uint32_t channelBiases[static_cast<size_t>(TextureChannel::Count)];
+	GetChannelBiases(channelBiases);
+
+	for (auto& texture : textures)
+	{
+		texture.biasMip = GetBiasMip(texture, channelBiases);
+	}
+
+	if (!*CvarGet("textureStreaming", int))
+	{
+		for (auto& texture : textures)
+		{
+			texture.requestedMip = texture.biasMip;
+		}
+
+		return;
+	}
+
+	XMFLOAT3 cameraPosition{};
+	float fieldOfView = 1.f;
+	registry.view<const TransformComponent, const CameraComponent>().each([&](auto entity, const auto& transform, const auto& camera)
+	{
+		// #TODO: Support more than one camera.
+		cameraPosition = transform.translation;
+		fieldOfView = camera.fieldOfView;
+	});
+
+	const auto sceneHeight = Renderer::Get().GetSceneResolution().second;
+	const auto pixelsPerUnit = sceneHeight / (2.f * std::tan(fieldOfView * 0.5f));  // At unit distance.
+	const auto camera = XMLoadFloat3(&cameraPosition);
+
+	// Largest projected size of each texture's material, textures without meshes keep their initial residency.
+	FrameVector<float> screenSizes(textures.size(), 0.f, &device->GetFrameArena());
+
+	// Linear over the renderer's group of renderables.
+	registry.group_if_exists<WorldTransformComponent, MeshComponent>().each([&](auto entity, const auto& transform, const auto& mesh)
+	{
+		const auto maxScale = transform.maxScale;
+		const auto worldMatrix = XMLoadFloat4x4(&transform.matrix);
+
+		for (const auto& subset : mesh.subsets)
+		{
+			const auto it = materialTextures.find(subset.materialIndex);
+			if (it == materialTextures.end())
+			{
+				continue;
+			}
+
+			// Projected diameter in pixels, assuming the texture spans the subset once. Unbounded when the camera is
+			// inside the subset's bounds.
+			const auto center = XMVector3Transform(XMLoadFloat3(&subset.boundingSphereCenter), worldMatrix);
+			const auto distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(center, camera)));
+			const auto radius = subset.boundingSphereRadius * maxScale;
+			const auto screenSize = distance > radius ? 2.f * radius * pixelsPerUnit / (distance - radius) : std::numeric_limits<float>::max();
+
+			for (const auto index : it->second)
+			{
+				screenSizes[index] = std::max(screenSizes[index], screenSize);
+			}
+		}
+	});
+
+	for (size_t i = 0; i < textures.size(); ++i)
+	{
+		auto& texture = textures[i];
+
+		// One texel per pixel.
+		auto mip = texture.initialMip;
+		if (screenSizes[i] > 0.f)
+		{
+			const auto texels = static_cast<float>(std::max(texture.image.width, texture.image.height));
+			mip = static_cast<uint32_t>(std::clamp(std::floor(std::log2(texels / screenSizes[i])), 0.f, static_cast<float>(texture.initialMip)));
+		}
+
+		texture.requestedMip = std::min(mip + texture.biasMip, texture.mipLimit);
+	}
+}
+
+size_t TextureStreamer::SetCommittedResidency(StreamedTexture& texture, uint32_t mip)
+{
+	auto& resourceManager = device->GetResourceManager();
+
+	TextureDescription description{
+		.bindFlags = BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::CPUWrite,
+		.width = std::max(texture.image.width >> mip, 1u),
+		.height = std::max(texture.image.height >> mip, 1u),
+		.format = texture.image.format,
+		.mipMapping = texture.mipmap,
+		.swizzle = texture.swizzle
+	};
+	const auto resource = resourceManager.Create(description, texture.name);
+
+	// The resource's mips are the source mips from the resident one down.
+	size_t uploadedBytes = 0;
+	const auto lastMip = texture.mipmap ? GetMipCount(texture) : mip + 1;
+	for (auto i = mip; i < lastMip; ++i)
+	{
+		resourceManager.Write(resource, texture.image.mips[i], i - mip);
+		uploadedBytes += texture.image.mips[i].size();
+	}
+
+	device->GetDirectList().TransitionBarrier(resource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+
+	if (resourceManager.Valid(texture.resource))
+	{
+		// The material write is ordered with the frame's work, while frames in flight can still sample the old residency.
+		materialFactory->WriteTexture(texture.material, texture.materialOffset, resourceManager.Get(resource).SRV->bindlessIndex);
+		resourceManager.AddFrameResource(device->GetFrameIndex(), texture.resource);
+		residentBytes -= GetResidentSize(texture, texture.residentMip);
+	}
+
+	texture.resource = resource;
+	texture.residentMip = mip;
+	residentBytes += GetResidentSize(texture, mip);
+
+	return uploadedBytes;
+}
+
+size_t TextureStreamer::SetReservedResidency(StreamedTexture& texture, uint32_t mip)
+{
+	auto& resourceManager = device->GetResourceManager();
+
+	const auto created = !resourceManager.Valid(texture.resource);
+	if (created)
+	{
+		// The full mip chain is reserved up front, so residency only changes which mips are mapped.
+		TextureDescription description{
+			.bindFlags = BindFlag::ShaderResource,
+			.accessFlags = AccessFlag::CPUWrite,
+			.width = texture.image.width,
+			.height = texture.image.height,
+			.format = texture.image.format,
+			.mipMapping = true,
+			.reserved = true,
+			.swizzle = texture.swizzle
+		};
+		texture.resource = resourceManager.Create(description, texture.name);
+	}
+
+	const auto previousMip = created ? GetMipCount(texture) : texture.residentMip;
+
+	resourceManager.SetResidentMips(texture.resource, mip);
+
+	auto& component = resourceManager.Get(texture.resource);
+	mip = component.residentMip;  // Less detailed if the tile pool ran out of memory.
+
+	// Upload the newly resident mips.
+	size_t uploadedBytes = 0;
+	for (auto i = mip; i < previousMip; ++i)
+	{
+		resourceManager.Write(texture.resource, texture.image.mips[i], i);
+		uploadedBytes += texture.image.mips[i].size();
+	}
+
+	if (uploadedBytes > 0)
+	{
+		device->GetDirectList().TransitionBarrier(texture.resource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	}
+
+	// The SRV was recreated with the new clamp.
+	if (!created && mip != texture.residentMip)
+	{
+		materialFactory->WriteTexture(texture.material, texture.materialOffset, component.SRV->bindlessIndex);
+	}
+
+	residentBytes -= created ? 0 : GetResidentSize(texture, texture.residentMip);
+	texture.residentMip = mip;
+	residentBytes += GetResidentSize(texture, mip);
+
+	return uploadedBytes;
+}
+
+size_t TextureStreamer::SetResidency(StreamedTexture& texture, uint32_t mip)
+{
+	VGScopedCPUStat("Set Texture Residency");
+
+	return texture.reserved ? SetReservedResidency(texture, mip) : SetCommittedResidency(texture, mip);
+}
+
+void TextureStreamer::Initialize(RenderDevice* inDevice, MaterialFactory* inMaterialFactory)
+{
+	device = inDevice;
+	materialFactory = inMaterialFactory;
+
+	CvarCreate("textureStreaming", "Streams material texture resolution based on the projected size of their meshes, 0=disabled (full resolution), 1=enabled", 1);
+	CvarCreate("textureStreamingBudget", "Memory budget of streamed material textures, in megabytes", 1024);
+	CvarCreate("textureStreamingReserved", "Streams newly created textures as reserved resources when supported, mapping mips from a tile pool instead of recreating the texture, 0=disabled, 1=enabled", 1);
+
+	// Less noticeable channels give up their detail first.
+	CvarCreate("textureMipBiasBaseColor", "Mips dropped from base color textures under memory pressure", 0);
+	CvarCreate("textureMipBiasMetallicRoughness", "Mips dropped from metallic roughness textures under memory pressure", 1);
+	CvarCreate("textureMipBiasNormal", "Mips dropped from normal textures under memory pressure", 0);
+	CvarCreate("textureMipBiasOcclusion", "Mips dropped from occlusion textures under memory pressure", 2);
+	CvarCreate("textureMipBiasEmissive", "Mips dropped from emissive textures under memory pressure", 0);
+}
+
+uint32_t TextureStreamer::Create(AssetLoader::TextureImage&& image, uint32_t swizzle, bool mipmap, TextureChannel channel, std::wstring_view name, size_t material, size_t materialOffset)
+{
+	VGScopedCPUStat("Create Streamed Texture");
+
+	auto& texture = textures.emplace_back();
+	texture.image = std::move(image);
+	texture.swizzle = swizzle;
+	texture.reserved = device->SupportsReservedResources() && *CvarGet("textureStreamingReserved", int);
+	texture.mipmap = mipmap || texture.reserved;  // Reserved residency streams individual mips.
+	texture.channel = channel;
+	texture.name = name;
+	texture.material = material;
+	texture.materialOffset = materialOffset;
+
+	const auto width = texture.image.width;
+	const auto height = texture.image.height;
+
+	// Committed block compressed textures are created at the resident mip's size, which must be whole blocks.
+	const auto IsWholeBlocks = [width, height](uint32_t mip)
+	{
+		const auto mipWidth = width >> mip;
+		const auto mipHeight = height >> mip;
+
+		return mipWidth > 0 && mipHeight > 0 && mipWidth % 4 == 0 && mipHeight % 4 == 0;
+	};
+
+	texture.mipLimit = GetMipCount(texture) - 1;
+	if (!texture.reserved && IsResourceFormatBlockCompressed(texture.image.format))
+	{
+		texture.mipLimit = 0;
+		while (texture.mipLimit + 1 < GetMipCount(texture) && IsWholeBlocks(texture.mipLimit + 1))
+		{
+			++texture.mipLimit;
+		}
+	}
+
+	while ((std::max(width, height) >> texture.initialMip) > initialSize && texture.initialMip < texture.mipLimit)
+	{
+		++texture.initialMip;
+	}
+
+	// Under memory pressure the biased mips are never uploaded.
+	uint32_t channelBiases[static_cast<size_t>(TextureChannel::Count)];
+	GetChannelBiases(channelBiases);
+	texture.biasMip = GetBiasMip(texture, channelBiases);
+
+	texture.requestedMip = std::max(texture.initialMip, texture.biasMip);
+	SetResidency(texture, texture.requestedMip);
+
+	materialTextures[material].emplace_back(textures.size() - 1);
+
+	return device->GetResourceManager().Get(texture.resource).SRV->bindlessIndex;
+}
+
+void TextureStreamer::Update(const entt::registry& registry)
+{
+	VGScopedCPUStat("Texture Streaming");
+
+	if (textures.empty())
+	{
+		return;
+	}
+
+	if (framesUntilRequest == 0)
+	{
+		UpdateRequests(registry);
+		framesUntilRequest = requestInterval;
+	}
+
+	--framesUntilRequest;
+
+	const auto budget = static_cast<size_t>(std::max(*CvarGet("textureStreamingBudget", int), 0)) * 1024 * 1024;
+	size_t uploadedBytes = 0;
+
+	// Release detail first, making room for the textures that need more. Requests must drop by more than a mip, so that
+	// meshes hovering around a mip boundary don't repeatedly stream the same mip in and out.
+	for (auto& texture : textures)
+	{
+		if (uploadedBytes >= uploadBytesPerFrame)
+		{
+			break;
+		}
+
+		if (texture.requestedMip > texture.residentMip + 1 || texture.residentMip < texture.biasMip)
+		{
+			uploadedBytes += SetResidency(texture, texture.requestedMip);
+		}
+	}
+
+	// Shrink the largest textures while over budget, which happens when the budget is lowered.
+	while (residentBytes > budget && uploadedBytes < uploadBytesPerFrame)
+	{
+		StreamedTexture* largest = nullptr;
+		for (auto& texture : textures)
+		{
+			if (texture.residentMip < texture.mipLimit && (!largest || GetResidentSize(texture, texture.residentMip) > GetResidentSize(*largest, largest->residentMip)))
+			{
+				largest = &texture;
+			}
+		}
+
+		if (!largest)
+		{
+			break;
+		}
+
+		uploadedBytes += SetResidency(*largest, largest->residentMip + 1);
+		largest->requestedMip = std::max(largest->requestedMip, largest->residentMip);  // Don't stream it straight back in.
+	}
+
+	// Textures furthest from their request first, a mip at a time so that every texture gets its lower mips before any
+	// gets its top mips.
+	FrameVector<StreamedTexture*> pending{ &device->GetFrameArena() };
+	for (auto& texture : textures)
+	{
+		if (texture.requestedMip < texture.residentMip)
+		{
+			pending.emplace_back(&texture);
+		}
+	}
+
+	std::sort(pending.begin(), pending.end(), [](const auto* left, const auto* right)
+	{
+		return left->residentMip - left->requestedMip > right->residentMip - right->requestedMip;
+	});
+
+	for (auto* texture : pending)
+	{
+		if (uploadedBytes >= uploadBytesPerFrame)
+		{
+			break;
+		}
+
+		const auto mip = texture->residentMip - 1;
+		if (residentBytes - GetResidentSize(*texture, texture->residentMip) + GetResidentSize(*texture, mip) > budget)
+		{
+			continue;
+		}
+
+		uploadedBytes += SetResidency(*texture, mip);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Rendering/ResourceHandle.h>
+#include <Asset/TextureLoader.h>
+
+#include <entt/entt.hpp>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+class RenderDevice;
+class MaterialFactory;
+
+// Material channel a texture feeds, each can be given its own mip bias under memory pressure.
+enum class TextureChannel
+{
+	BaseColor,
+	MetallicRoughness,
+	Normal,
+	Occlusion,
+	Emissive,
+	Count
+};
+
+// Streams the resolution of material textures based on how large their materials appear on screen. Textures are given
+// their full mip chain up front, either transcoded at import or loaded pre-baked, so residency changes are only copies.
+// Textures start with only their lowest mips resident, and are recreated one mip at a time as more detail is needed, within a memory budget.
+// Reserved textures map tiles for their resident mips and clamp their view to them, otherwise each residency change
+// creates a new texture. Either way the view changes, so the referencing material is patched with its new bindless
+// index on the GPU timeline, and the old view is released once the frames using it retire.
+class TextureStreamer
+{
+private:
+	struct StreamedTexture
+	{
+		AssetLoader::TextureImage image;  // Full mip chain, mapped from the texture cache when it was cached.
+		uint32_t swizzle;
+		bool mipmap;
+		TextureChannel channel;
+		bool reserved;  // Mips are mapped in place, otherwise the texture is recreated for each residency.
+		uint32_t mipLimit;  // Least detailed mip the texture can be resident at.
+		std::wstring name;
+
+		size_t material;
+		size_t materialOffset;  // Of the texture index within the material's data.
+
+		TextureHandle resource;
+		uint32_t residentMip = 0;  // Source mip which is the resource's most detailed.
+		uint32_t initialMip = 0;
+		uint32_t requestedMip = 0;
+		uint32_t biasMip = 0;  // Most detailed mip the biases allow.
+	};
+
+	RenderDevice* device;
+	MaterialFactory* materialFactory;
+
+	std::vector<StreamedTexture> textures;
+	std::unordered_map<size_t, std::vector<size_t>> materialTextures;  // Streamed textures of each material.
+	size_t residentBytes = 0;
+
+	static constexpr uint32_t initialSize = 128;  // Largest dimension of a texture's initial residency.
+	static constexpr size_t uploadBytesPerFrame = 1024 * 1024 * 32;  // Residency changes stop once exceeded.
+	static constexpr size_t requestInterval = 8;  // Frames between evaluating the requested mips.
+	size_t framesUntilRequest = 0;
+
+	static uint32_t GetMipCount(const StreamedTexture& texture);
+	static size_t GetResidentSize(const StreamedTexture& texture, uint32_t mip);
+
+	// Mips dropped from each channel, all zero unless channel biases are applied.
+	void GetChannelBiases(uint32_t* biases) const;
+	// Global and channel biases of the texture, clamped to its mip limit.
+	uint32_t GetBiasMip(const StreamedTexture& texture, const uint32_t* channelBiases) const;
+
+	// Estimates the mip each texture needs from the projected size of the meshes using its material.
+	void UpdateRequests(const entt::registry& registry);
+
+	// Makes the source mip the texture's most detailed, returning the uploaded bytes.
+	size_t SetResidency(StreamedTexture& texture, uint32_t mip);
+	size_t SetCommittedResidency(StreamedTexture& texture, uint32_t mip);  // Recreates the texture at the mip's size.
+	size_t SetReservedResidency(StreamedTexture& texture, uint32_t mip);  // Maps the mips, uploading the new ones.
+
+public:
+	uint32_t mipBias = 0;  // Extra mips dropped from every request, raised under memory pressure.
+	bool channelBias = false;  // Applies the per channel mip biases, set under memory pressure.
+
+	void Initialize(RenderDevice* inDevice, MaterialFactory* inMaterialFactory);
+
+	// Creates the texture at its initial low residency, returning its bindless index to write into the material. The image
+	// must contain its full mip chain, swizzle is that of the texture's view.
+	uint32_t Create(AssetLoader::TextureImage&& image, uint32_t swizzle, bool mipmap, TextureChannel channel, std::wstring_view name, size_t material, size_t materialOffset);
+
+	// Changes the residency of textures whose requested mip differs from what's resident.
+	void Update(const entt::registry& registry);
+
+	auto GetResidentBytes() const noexcept { return residentBytes; }
+};
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <Rendering/Renderer.h>
 #include <Core/Config.h>
 #include <Core/Input.h>
+#include <Core/Memory.h>
 #include <Window/WindowFrame.h>
 #include <Utility/AlignedSize.h>
 #include <Editor/ImGuiExtensions.h>
@@ -15,7 +16,10 @@
 #include <imgui.h>
 #include <d3dcompiler.h>
 
+#include <algorithm>
 #include <cstring>
+#include <optional>
+#include <span>
 
 struct FrameResources
 {
@@ -243,12 +247,13 @@ void UserInterfaceManager::NewFrame()
 void UserInterfaceManager::Render(CommandList& list, BufferHandle cameraBuffer)
 {
 	VGScopedCPUStat("UI Render");
+	ScopedMemoryTag memoryTag{ MemoryTag::UserInterface };
 
 	ImGui::Render();
 	auto* drawData = ImGui::GetDrawData();
 
-	// Avoid rendering when minimized
-	if (drawData->DisplaySize.x <= 0.0f || drawData->DisplaySize.y <= 0.0f)
+	// Avoid rendering when minimized, or when there's nothing to draw.
+	if (drawData->DisplaySize.x <= 0.0f || drawData->DisplaySize.y <= 0.0f || drawData->TotalVtxCount == 0)
 		return;
 
 	// FIXME: I'm assuming that this only gets called once per frame!
@@ -256,12 +261,13 @@ void UserInterfaceManager::Render(CommandList& list, BufferHandle cameraBuffer)
 	frameIndex = frameIndex + 1;
 	FrameResources* resources = &frameResources[frameIndex % numFramesInFlight];
 
-	// Create and grow vertex/index buffers if needed
+	// Create and grow vertex/index buffers if needed. Growth is geometric, so buffers are only recreated a handful of
+	// times while the interface settles.
 	if (resources->vertexBuffer.handle == entt::null || resources->vertexBufferSize < drawData->TotalVtxCount)
 	{
 		if (resources->vertexBuffer.handle != entt::null)
 			device->GetResourceManager().Destroy(resources->vertexBuffer);
-		resources->vertexBufferSize = drawData->TotalVtxCount + 5000;
+		resources->vertexBufferSize = std::max<size_t>(drawData->TotalVtxCount, resources->vertexBufferSize * 2);
 
 		BufferDescription vertexBufferDesc{
 			.updateRate = ResourceFrequency::Dynamic,
@@ -277,7 +283,7 @@ void UserInterfaceManager::Render(CommandList& list, BufferHandle cameraBuffer)
 	{
 		if (resources->indexBuffer.handle != entt::null)
 			device->GetResourceManager().Destroy(resources->indexBuffer);
-		resources->indexBufferSize = drawData->TotalIdxCount + 10000;
+		resources->indexBufferSize = std::max<size_t>(drawData->TotalIdxCount, resources->indexBufferSize * 2);
 
 		BufferDescription indexBufferDesc{
 			.updateRate = ResourceFrequency::Dynamic,
@@ -290,36 +296,89 @@ void UserInterfaceManager::Render(CommandList& list, BufferHandle cameraBuffer)
 		resources->indexBuffer = device->GetResourceManager().Create(indexBufferDesc, VGText("UI index buffer"));
 	}
 
-	// Upload vertex/index data into a single contiguous GPU buffer
-	std::vector<uint8_t> vertexData;
-	std::vector<uint8_t> indexData;
-	size_t vertexOffset = 0;
-	size_t indexOffset = 0;
+	// Copy the draw lists straight into the persistently mapped buffers, reserving each buffer once for the whole frame.
+	auto* vertexDestination = static_cast<ImDrawVert*>(device->GetResourceManager().ReserveWrite(resources->vertexBuffer, drawData->TotalVtxCount * sizeof(ImDrawVert)));
+	auto* indexDestination = static_cast<ImDrawIdx*>(device->GetResourceManager().ReserveWrite(resources->indexBuffer, drawData->TotalIdxCount * sizeof(ImDrawIdx)));
+	if (!vertexDestination || !indexDestination)
+		return;
+
 	for (int n = 0; n < drawData->CmdListsCount; n++)
 	{
 		const ImDrawList* cmd_list = drawData->CmdLists[n];
-		vertexData.resize(vertexData.size() + cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
-		indexData.resize(indexData.size() + cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
-		memcpy(vertexData.data() + vertexOffset, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
-		memcpy(indexData.data() + indexOffset, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
-		vertexOffset += cmd_list->VtxBuffer.Size * sizeof(ImDrawVert);
-		indexOffset += cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx);
+		std::memcpy(vertexDestination, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+		std::memcpy(indexDestination, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+		vertexDestination += cmd_list->VtxBuffer.Size;
+		indexDestination += cmd_list->IdxBuffer.Size;
 	}
 
-	device->GetResourceManager().Write(resources->vertexBuffer, vertexData);
-	device->GetResourceManager().Write(resources->indexBuffer, indexData);
-
 	// Setup desired DX state
 	XMMATRIX projectionMatrix = SetupRenderState(drawData, list, resources);
 	projectionMatrix = XMMatrixTranspose(projectionMatrix);
 
 	UserInterfaceState drawState{};  // Reset each frame.
 
+	struct Data
+	{
+		XMMATRIX projectionMatrix;
+		uint32_t cameraBuffer;
+		uint32_t vertexBuffer;
+		uint32_t vertexOffset;
+		uint32_t texture;
+		uint32_t depthLinearization;
+	} data;
+
+	data.projectionMatrix = projectionMatrix;
+	data.cameraBuffer = device->GetResourceManager().Get(cameraBuffer).SRV->bindlessIndex;
+	data.vertexBuffer = device->GetResourceManager().Get(resources->vertexBuffer).SRV->bindlessIndex;
+
+	// Consecutive commands sharing a texture, clip rect and vertex offset with contiguous indices are merged into a single
+	// draw. Bindings and scissors are only set when they change.
+	struct Batch
+	{
+		ImVec4 clipRect;
+		ImTextureID texture;
+		uint32_t vertexOffset;
+		uint32_t indexOffset;
+		uint32_t indexCount = 0;
+	};
+
+	std::optional<Batch> batch;
+	std::optional<Data> boundData;
+	std::optional<ImVec4> boundClipRect;
+	ImVec2 clip_off = drawData->DisplayPos;
+
+	const auto FlushBatch = [&]()
+	{
+		if (!batch)
+			return;
+
+		const auto& clipRect = batch->clipRect;
+		if (!boundClipRect || std::memcmp(&*boundClipRect, &clipRect, sizeof(ImVec4)) != 0)
+		{
+			const D3D12_RECT r = { (LONG)(clipRect.x - clip_off.x), (LONG)(clipRect.y - clip_off.y), (LONG)(clipRect.z - clip_off.x), (LONG)(clipRect.w - clip_off.y) };
+			list.Native()->RSSetScissorRects(1, &r);
+			boundClipRect = clipRect;
+		}
+
+		data.vertexOffset = batch->vertexOffset;
+		data.texture = *(uint32_t*)&batch->texture;
+		data.depthLinearization = drawState.linearizeDepth;
+		if (!boundData || std::memcmp(&*boundData, &data, sizeof(Data)) != 0)
+		{
+			list.BindConstants("data", data);
+			boundData = data;
+		}
+
+		list.ResumeRenderPass();
+		list.Native()->DrawIndexedInstanced(batch->indexCount, 1, batch->indexOffset, 0, 0);
+
+		batch.reset();
+	};
+
 	// Render command lists
 	// (Because we merged all buffers into a single one, we maintain our own offset into them)
 	int global_vtx_offset = 0;
 	int global_idx_offset = 0;
-	ImVec2 clip_off = drawData->DisplayPos;
 	for (int n = 0; n < drawData->CmdListsCount; n++)
 	{
 		const ImDrawList* cmd_list = drawData->CmdLists[n];
@@ -328,40 +387,42 @@ void UserInterfaceManager::Render(CommandList& list, BufferHandle cameraBuffer)
 			const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
 			if (pcmd->UserCallback != NULL)
 			{
+				// Callbacks can change any state, so they end the batch.
+				FlushBatch();
+
 				// User callback, registered via ImDrawList::AddCallback()
 				// (ImDrawCallback_ResetRenderState is a special callback value used by the user to request the renderer to reset render state.)
 				if (pcmd->UserCallback == ImDrawCallback_ResetRenderState)
+				{
 					SetupRenderState(drawData, list, resources);
+					boundData.reset();
+					boundClipRect.reset();
+				}
 				else
 					pcmd->UserCallback(&list, drawState);
 			}
 			else
 			{
-				const D3D12_RECT r = { (LONG)(pcmd->ClipRect.x - clip_off.x), (LONG)(pcmd->ClipRect.y - clip_off.y), (LONG)(pcmd->ClipRect.z - clip_off.x), (LONG)(pcmd->ClipRect.w - clip_off.y) };
-				list.Native()->RSSetScissorRects(1, &r);
+				const auto vertexOffset = pcmd->VtxOffset + global_vtx_offset;
+				const auto indexOffset = pcmd->IdxOffset + global_idx_offset;
 
-				struct Data
+				const bool mergeable = batch && batch->texture == pcmd->TextureId && batch->vertexOffset == vertexOffset &&
+					batch->indexOffset + batch->indexCount == indexOffset && std::memcmp(&batch->clipRect, &pcmd->ClipRect, sizeof(ImVec4)) == 0;
+
+				if (mergeable)
 				{
-					XMMATRIX projectionMatrix;
-					uint32_t cameraBuffer;
-					uint32_t vertexBuffer;
-					uint32_t vertexOffset;
-					uint32_t texture;
-					uint32_t depthLinearization;
-				} data;
-
-				data.projectionMatrix = projectionMatrix;
-				data.cameraBuffer = device->GetResourceManager().Get(cameraBuffer).SRV->bindlessIndex;
-				data.vertexBuffer = device->GetResourceManager().Get(resources->vertexBuffer).SRV->bindlessIndex;
-				data.vertexOffset = pcmd->VtxOffset + global_vtx_offset;
-				data.texture = *(uint32_t*)&pcmd->TextureId;
-				data.depthLinearization = drawState.linearizeDepth;
-				list.BindConstants("data", data);
-
-				list.Native()->DrawIndexedInstanced(pcmd->ElemCount, 1, pcmd->IdxOffset + global_idx_offset, 0, 0);
+					batch->indexCount += pcmd->ElemCount;
+				}
+
+				else
+				{
+					FlushBatch();
+					batch = Batch{ pcmd->ClipRect, pcmd->TextureId, vertexOffset, indexOffset, pcmd->ElemCount };
+				}
 			}
 		}
 		global_idx_offset += cmd_list->IdxBuffer.Size;
 		global_vtx_offset += cmd_list->VtxBuffer.Size;
 	}
-}
\ No newline at end of file
+
+	FlushBatch();}
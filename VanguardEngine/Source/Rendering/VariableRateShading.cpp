@@ -0,0 +1,67 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/VariableRateShading.h>
+#include <Rendering/Device.h>
+#include <Rendering/RenderGraph.h>
+#include <Rendering/RenderPass.h>
+#include <Rendering/CommandList.h>
+#include <Core/ConsoleVariable.h>
+
+void VariableRateShading::Initialize(RenderDevice* inDevice)
+{
+	device = inDevice;
+
+	rateLayout = RenderPipelineLayout{}
+		.ComputeShader({ "ShadingRate", "Main" });
+
+	CvarCreate("variableRateShading", "Aggressiveness of variable rate shading in the forward pass, higher values shade more tiles coarsely. "
+		"0=off, requires tier 2 variable rate shading", 1.f);
+}
+
+std::optional<RenderResource> VariableRateShading::Render(RenderGraph& graph, const ShadingRateInputs& inputs)
+{
+	const auto aggressiveness = *CvarGet("variableRateShading", float);
+	if (!device->SupportsVariableRateShading() || aggressiveness <= 0.f || inputs.lastFrameColor.id == 0)
+		return std::nullopt;
+
+	const auto tileSize = device->GetShadingRateTileSize();
+
+	// On the direct queue, the compute queue can't transition the image out of the shading rate state it's left in.
+	auto& ratePass = graph.AddPass("Shading Rate Pass", ExecutionQueue::Graphics);
+	const auto rateTag = ratePass.Create(TransientTextureDescription{
+		.width = (inputs.width + tileSize - 1) / tileSize,
+		.height = (inputs.height + tileSize - 1) / tileSize,
+		.format = DXGI_FORMAT_R8_UINT
+	}, VGText("Shading rate image"));
+	ratePass.Read(inputs.lastFrameColor, ResourceBind::SRV);
+	ratePass.Read(inputs.motionVectors, ResourceBind::SRV);
+	ratePass.Write(rateTag, TextureView{}
+		.UAV("", 0));
+	ratePass.Bind([this, inputs, rateTag, tileSize, aggressiveness](CommandList& list, RenderPassResources& resources)
+	{
+		struct {
+			uint32_t historyTexture;
+			uint32_t motionTexture;
+			uint32_t outputTexture;
+			uint32_t tileSize;
+			uint32_t outputResolution[2];
+			float contrastThreshold;
+			float motionScale;
+		} bindData;
+
+		bindData.historyTexture = resources.Get(inputs.lastFrameColor);
+		bindData.motionTexture = resources.Get(inputs.motionVectors);
+		bindData.outputTexture = resources.Get(rateTag);
+		bindData.tileSize = tileSize;
+		bindData.outputResolution[0] = inputs.width;
+		bindData.outputResolution[1] = inputs.height;
+		bindData.contrastThreshold = 0.04f * aggressiveness;  // Tonemapped luminance steps between neighboring pixels.
+		bindData.motionScale = 16.f;  // Pixels of motion halving a tile's contrast.
+
+		list.BindPipeline(rateLayout);
+		list.BindConstants("bindData", bindData);
+		list.Dispatch((inputs.width + tileSize - 1) / tileSize, (inputs.height + tileSize - 1) / tileSize, 1);
+	});
+
+	return rateTag;
+}
\ No newline at end of file
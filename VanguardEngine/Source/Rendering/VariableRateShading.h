@@ -0,0 +1,38 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Rendering/RenderPipeline.h>
+#include <Rendering/RenderGraphResource.h>
+
+#include <optional>
+
+class RenderDevice;
+class RenderGraph;
+
+struct ShadingRateInputs
+{
+	RenderResource lastFrameColor;  // Resolved color of the previous frame, every pixel shades at full rate without it.
+	RenderResource motionVectors;
+	uint32_t width;  // Scene resolution.
+	uint32_t height;
+};
+
+// Tier 2 variable rate shading. Each frame a shading rate image is built from the resolved color of the last frame,
+// reprojected by this frame's motion vectors. Tiles that were low in contrast shade coarser, and motion lowers the
+// contrast a tile needs, since the temporal resolve blurs moving surfaces anyway. Only draws can shade at a coarse rate,
+// compute passes such as the atmosphere composition keep shading every pixel.
+class VariableRateShading
+{
+private:
+	RenderDevice* device;
+
+	RenderPipelineLayout rateLayout;
+
+public:
+	void Initialize(RenderDevice* inDevice);
+	// Shading rate image of this frame, read with ResourceBind::ShadingRate. Nothing when unsupported, disabled, or
+	// without a last frame.
+	std::optional<RenderResource> Render(RenderGraph& graph, const ShadingRateInputs& inputs);
+};
\ No newline at end of file
@@ -0,0 +1,542 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/VirtualShadowMap.h>
+#include <Rendering/Device.h>
+#include <Rendering/Renderer.h>
+#include <Rendering/RenderSystems.h>
+#include <Rendering/RenderGraph.h>
+#include <Rendering/RenderPass.h>
+#include <Core/ConsoleVariable.h>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace
+{
+	// Cached pages store depth, so the depth range can't follow the view smoothly. It snaps in large steps instead, each
+	// of which invalidates every page.
+	constexpr float depthRange = 1000.f;  // Half of the light's depth range, in meters.
+	constexpr float depthSnap = 250.f;
+
+	constexpr uint32_t pageFlagReset = 1 << 0;
+	constexpr uint32_t pageFlagInvalidateAll = 1 << 1;
+
+	struct VirtualShadowPage
+	{
+		uint32_t physicalPage;
+		uint32_t tag;
+		uint32_t flags;
+		uint32_t lastUsedFrame;
+	};
+
+	struct PageBindData
+	{
+		uint32_t pageTable;
+		uint32_t physicalOwners;
+		uint32_t pageRequests;
+		uint32_t renderList;
+		uint32_t clearArguments;
+		uint32_t physicalPages;
+		uint32_t depthTexture;
+		uint32_t cameraBuffer;
+		uint32_t viewCameraIndex;
+		uint32_t shadowCameraIndex;
+		int32_t windowOrigin[2];
+		uint32_t depthResolution[2];
+		uint32_t invalidationRanges;
+		uint32_t invalidationRangeCount;
+		uint32_t objectBuffer;
+		uint32_t transformBuffer;
+		uint32_t frame;
+		uint32_t flags;
+	};
+}
+
+VirtualShadowMap::~VirtualShadowMap()
+{
+	device->GetResourceManager().Destroy(pageTable);
+	device->GetResourceManager().Destroy(physicalOwners);
+	device->GetResourceManager().Destroy(pageRequests);
+	device->GetResourceManager().Destroy(renderList);
+	device->GetResourceManager().Destroy(clearArguments);
+	device->GetResourceManager().Destroy(invalidationRangeBuffer);
+	device->GetResourceManager().Destroy(physicalPages);
+}
+
+void VirtualShadowMap::Initialize(RenderDevice* inDevice)
+{
+	device = inDevice;
+
+	markLayout = RenderPipelineLayout{}
+		.ComputeShader({ "VirtualShadows/Pages", "MarkMain" });
+
+	invalidateLayout = RenderPipelineLayout{}
+		.ComputeShader({ "VirtualShadows/Pages", "InvalidateMain" });
+
+	allocateLayout = RenderPipelineLayout{}
+		.ComputeShader({ "VirtualShadows/Pages", "AllocateMain" });
+
+	clearLayout = RenderPipelineLayout{}
+		.ComputeShader({ "VirtualShadows/Pages", "ClearMain" });
+
+	cullResetLayout = RenderPipelineLayout{}
+		.ComputeShader({ "MeshCulling", "ResetMain" });
+
+	cullLayout = RenderPipelineLayout{}
+		.ComputeShader({ "MeshCulling", "VirtualShadowMain" });
+
+	// No targets, depth is resolved with atomics in the pixel shader.
+	rasterLayout = RenderPipelineLayout{}
+		.VertexShader({ "VirtualShadows/Raster", "VSMain" })
+		.PixelShader({ "VirtualShadows/Raster", "PSMain" })
+		.DepthEnabled(false)
+		.DepthClip(false);
+
+	constexpr auto pageCount = pageTableSize * pageTableSize;
+	constexpr auto physicalPageCount = physicalPoolSize * physicalPoolSize;
+
+	pageTable = device->GetResourceManager().Create(BufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.bindFlags = BindFlag::UnorderedAccess | BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::GPUWrite,
+		.size = pageCount,
+		.stride = sizeof(VirtualShadowPage)
+	}, VGText("Virtual shadow page table"));
+
+	physicalOwners = device->GetResourceManager().Create(BufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.bindFlags = BindFlag::UnorderedAccess,
+		.accessFlags = AccessFlag::GPUWrite,
+		.size = physicalPageCount,
+		.stride = sizeof(uint32_t)
+	}, VGText("Virtual shadow physical page owners"));
+
+	pageRequests = device->GetResourceManager().Create(BufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.bindFlags = BindFlag::UnorderedAccess,
+		.accessFlags = AccessFlag::GPUWrite,
+		.size = pageCount,
+		.stride = sizeof(uint32_t)
+	}, VGText("Virtual shadow page requests"));
+
+	renderList = device->GetResourceManager().Create(BufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.bindFlags = BindFlag::UnorderedAccess | BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::GPUWrite,
+		.size = physicalPageCount,
+		.stride = sizeof(uint32_t)
+	}, VGText("Virtual shadow page render list"));
+
+	clearArguments = device->GetResourceManager().Create(BufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.bindFlags = BindFlag::UnorderedAccess | BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::GPUWrite,
+		.size = 3,
+		.stride = sizeof(uint32_t)
+	}, VGText("Virtual shadow page clear arguments"));
+
+	invalidationRangeBuffer = device->GetResourceManager().Create(BufferDescription{
+		.updateRate = ResourceFrequency::Static,
+		.bindFlags = BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::CPUWrite,
+		.size = maxInvalidationRanges,
+		.stride = sizeof(std::pair<uint32_t, uint32_t>)
+	}, VGText("Virtual shadow invalidation ranges"));
+
+	physicalPages = device->GetResourceManager().Create(TextureDescription{
+		.bindFlags = BindFlag::UnorderedAccess | BindFlag::ShaderResource,
+		.accessFlags = AccessFlag::GPUWrite,
+		.width = physicalPoolSize * pageSize,
+		.height = physicalPoolSize * pageSize,
+		.depth = 1,
+		.format = DXGI_FORMAT_R32_UINT,  // Depth as uint bits, for atomics.
+		.mipMapping = false
+	}, VGText("Virtual shadow physical pages"));
+
+	std::vector<D3D12_INDIRECT_ARGUMENT_DESC> clearIndirectArgDescs;
+	clearIndirectArgDescs.emplace_back(D3D12_INDIRECT_ARGUMENT_DESC{
+		.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DISPATCH
+	});
+
+	D3D12_COMMAND_SIGNATURE_DESC clearIndirectSignatureDesc{};
+	clearIndirectSignatureDesc.ByteStride = sizeof(D3D12_DISPATCH_ARGUMENTS);
+	clearIndirectSignatureDesc.NumArgumentDescs = clearIndirectArgDescs.size();
+	clearIndirectSignatureDesc.pArgumentDescs = clearIndirectArgDescs.data();
+	clearIndirectSignatureDesc.NodeMask = 0;
+
+	const auto result = device->Native()->CreateCommandSignature(&clearIndirectSignatureDesc, nullptr, IID_PPV_ARGS(clearSignature.Indirect()));
+	if (FAILED(result))
+	{
+		VGLogError(logRendering, "Failed to create virtual shadow page clear indirect command signature: {}", result);
+	}
+}
+
+void VirtualShadowMap::InvalidateInstances(std::span<const std::pair<uint32_t, uint32_t>> ranges)
+{
+	invalidationRanges.insert(invalidationRanges.end(), ranges.begin(), ranges.end());
+
+	// Past the limit, invalidate everything between the first and last range.
+	if (invalidationRanges.size() > maxInvalidationRanges)
+	{
+		const auto first = std::min_element(invalidationRanges.begin(), invalidationRanges.end(), [](const auto& left, const auto& right)
+		{
+			return left.first < right.first;
+		})->first;
+		const auto last = std::max_element(invalidationRanges.begin(), invalidationRanges.end(), [](const auto& left, const auto& right)
+		{
+			return left.second < right.second;
+		})->second;
+
+		invalidationRanges = { { first, last } };
+	}
+}
+
+void VirtualShadowMap::Update(const XMMATRIX& view, const XMVECTOR& sunDirection, const XMVECTOR& sunUpward, FrameVector<Camera>& cameras)
+{
+	VGAssert(cameras.size() == cameraIndex, "Virtual shadow camera must follow the existing cameras.");
+
+	enabled = *CvarGet("shadows", int) == 2;
+
+	// Changes aren't tracked while disabled.
+	if (!enabled)
+	{
+		invalidated = true;
+		invalidationRanges.clear();
+	}
+
+	// Small sun movements keep the last light view, cached pages are only valid for the view they rendered with.
+	XMFLOAT3 sun;
+	XMStoreFloat3(&sun, XMVector3Normalize(sunDirection));
+	if (sun.x * lastSunDirection.x + sun.y * lastSunDirection.y + sun.z * lastSunDirection.z < 0.99999f)
+	{
+		lastSunDirection = sun;
+		XMStoreFloat3(&lastSunUpward, sunUpward);
+		invalidated = true;
+	}
+
+	// The window spans the shadow distance in every direction from the view.
+	const auto newTexelSize = 2.f * *CvarGet("shadowDistance", float) / virtualResolution;
+	if (newTexelSize != texelSize)
+	{
+		texelSize = newTexelSize;
+		invalidated = true;
+	}
+
+	const auto lightView = XMMatrixLookToRH(XMVectorZero(), XMLoadFloat3(&lastSunDirection), XMLoadFloat3(&lastSunUpward));
+	const auto inverseLightView = XMMatrixInverse(nullptr, lightView);
+
+	XMFLOAT3 viewPosition;
+	XMStoreFloat3(&viewPosition, XMVector3Transform(XMMatrixInverse(nullptr, view).r[3], lightView));
+
+	// Whole pages, so the window moves without shifting any texels. Light space Y points up, texel rows go down.
+	const auto pageWorldSize = texelSize * pageSize;
+	windowOrigin[0] = static_cast<int32_t>(std::floor(viewPosition.x / pageWorldSize)) - static_cast<int32_t>(pageTableSize / 2);
+	windowOrigin[1] = static_cast<int32_t>(std::floor(-viewPosition.y / pageWorldSize)) - static_cast<int32_t>(pageTableSize / 2);
+
+	const auto newDepthCenter = std::round(-viewPosition.z / depthSnap) * depthSnap;
+	if (newDepthCenter != depthCenter)
+	{
+		depthCenter = newDepthCenter;
+		invalidated = true;
+	}
+
+	const auto left = windowOrigin[0] * pageWorldSize;
+	const auto top = -windowOrigin[1] * pageWorldSize;
+	const auto windowSize = virtualResolution * texelSize;
+
+	// Inverse Z, the near and far planes are swapped.
+	const auto projection = XMMatrixOrthographicOffCenterRH(left, left + windowSize, top - windowSize, top, depthCenter + depthRange, depthCenter - depthRange);
+	const auto inverseProjection = XMMatrixInverse(nullptr, projection);
+
+	XMFLOAT4 position;
+	XMStoreFloat4(&position, XMVector3Transform(XMVectorSet(left + windowSize * 0.5f, top - windowSize * 0.5f, -depthCenter, 1.f), inverseLightView));
+	position.w = 0.f;
+
+	cameras.emplace_back(Camera{
+		.position = position,
+		.view = lightView,
+		.projection = projection,
+		.inverseView = inverseLightView,
+		.inverseProjection = inverseProjection,
+		.lastFramePosition = position,
+		.lastFrameView = lightView,  // Motion is not needed for depth only passes.
+		.lastFrameProjection = projection,
+		.lastFrameInverseView = inverseLightView,
+		.lastFrameInverseProjection = inverseProjection,
+		.nearPlane = depthCenter - depthRange,
+		.farPlane = depthCenter + depthRange,
+		.fieldOfView = 0,
+		.aspectRatio = 1.f
+	});
+}
+
+VirtualShadowResources VirtualShadowMap::Render(RenderGraph& graph, const ShadowInputs& inputs, RenderResource depthStencil)
+{
+	const VirtualShadowResources shadowResources{
+		.pageTable = graph.Import(pageTable),
+		.physicalPages = graph.Import(physicalPages)
+	};
+
+	if (!enabled)
+	{
+		return shadowResources;
+	}
+
+	const auto physicalOwnersTag = graph.Import(physicalOwners);
+	const auto pageRequestsTag = graph.Import(pageRequests);
+	const auto renderListTag = graph.Import(renderList);
+	const auto clearArgumentsTag = graph.Import(clearArguments);
+	const auto invalidationRangesTag = graph.Import(invalidationRangeBuffer);
+
+	const auto rangeCount = static_cast<uint32_t>(invalidationRanges.size());
+	if (rangeCount > 0)
+	{
+		device->GetResourceManager().Write(invalidationRangeBuffer, invalidationRanges);
+	}
+
+	const auto flags = (resetPending ? pageFlagReset : 0) | (invalidated ? pageFlagInvalidateAll : 0);
+	const auto currentFrame = ++frame;  // Starts at one, reset pages were never used.
+
+	resetPending = false;
+	invalidated = false;
+	invalidationRanges.clear();
+
+	auto& pagePass = graph.AddPass("Virtual Shadow Page Pass", ExecutionQueue::Compute);
+	pagePass.Read(depthStencil, ResourceBind::SRV);
+	pagePass.Read(inputs.cameraBuffer, ResourceBind::SRV);
+	pagePass.Read(inputs.objectBuffer, ResourceBind::SRV);
+	pagePass.Read(inputs.transformBuffer, ResourceBind::SRV);
+	pagePass.Read(invalidationRangesTag, ResourceBind::SRV);
+	pagePass.Write(shadowResources.pageTable, ResourceBind::UAV);
+	pagePass.Write(physicalOwnersTag, ResourceBind::UAV);
+	pagePass.Write(pageRequestsTag, ResourceBind::UAV);
+	pagePass.Write(renderListTag, ResourceBind::UAV);
+	pagePass.Write(clearArgumentsTag, ResourceBind::UAV);
+	pagePass.Bind([this, inputs, depthStencil, shadowResources, physicalOwnersTag, pageRequestsTag, renderListTag, clearArgumentsTag,
+		invalidationRangesTag, rangeCount, flags, currentFrame](CommandList& list, RenderPassResources& resources)
+	{
+		const auto& depthComponent = device->GetResourceManager().Get(resources.GetTexture(depthStencil));
+		const auto pageTableBuffer = resources.GetBuffer(shadowResources.pageTable);
+		const auto requestBuffer = resources.GetBuffer(pageRequestsTag);
+
+		PageBindData bindData{};
+		bindData.pageTable = resources.Get(shadowResources.pageTable);
+		bindData.physicalOwners = resources.Get(physicalOwnersTag);
+		bindData.pageRequests = resources.Get(pageRequestsTag);
+		bindData.renderList = resources.Get(renderListTag);
+		bindData.clearArguments = resources.Get(clearArgumentsTag);
+		bindData.depthTexture = resources.Get(depthStencil);
+		bindData.cameraBuffer = resources.Get(inputs.cameraBuffer);
+		bindData.viewCameraIndex = 0;  // The depth buffer is always rendered from the spectator camera.
+		bindData.shadowCameraIndex = cameraIndex;
+		bindData.windowOrigin[0] = windowOrigin[0];
+		bindData.windowOrigin[1] = windowOrigin[1];
+		bindData.depthResolution[0] = depthComponent.description.width;
+		bindData.depthResolution[1] = depthComponent.description.height;
+		bindData.invalidationRanges = resources.Get(invalidationRangesTag);
+		bindData.invalidationRangeCount = rangeCount;
+		bindData.objectBuffer = resources.Get(inputs.objectBuffer);
+		bindData.transformBuffer = resources.Get(inputs.transformBuffer);
+		bindData.frame = currentFrame;
+		bindData.flags = flags;
+
+		list.BindPipeline(markLayout);
+		list.BindConstants("bindData", bindData);
+		list.Dispatch(std::ceil(bindData.depthResolution[0] / 8.f), std::ceil(bindData.depthResolution[1] / 8.f), 1);
+
+		// A full invalidation already covers every moved instance.
+		if (rangeCount > 0 && !(flags & (pageFlagReset | pageFlagInvalidateAll)))
+		{
+			list.BindPipeline(invalidateLayout);
+			list.BindConstants("bindData", bindData);
+			list.Dispatch(rangeCount, 1, 1);
+		}
+
+		list.UAVBarrier(pageTableBuffer);
+		list.UAVBarrier(requestBuffer);
+		list.FlushBarriers();
+
+		list.BindPipeline(allocateLayout);
+		list.BindConstants("bindData", bindData);
+		list.Dispatch(1, 1, 1);
+	});
+
+	// Rounded up, so the transients keep their size while the scene changes a little.
+	auto& renderer = Renderer::Get();
+	const auto argumentCapacity = std::bit_ceil(std::max<size_t>(renderer.batchCount, 1));
+	const auto instanceCapacity = std::bit_ceil(std::max<size_t>(renderer.renderableCount, 1)) * maxMeshLods;  // A range per level of detail.
+
+	auto& shadowPass = graph.AddPass("Virtual Shadow Pass", ExecutionQueue::Graphics);
+	const auto culledArgsTag = shadowPass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+		.size = argumentCapacity,
+		.stride = sizeof(MeshIndirectArgument),
+		.uavCounter = true  // Counts the visible casters.
+	}, VGText("Virtual shadow indirect render argument buffer"));
+	const auto visibleInstancesTag = shadowPass.Create(TransientBufferDescription{
+		.updateRate = ResourceFrequency::Static,  // Need unordered-access.
+		.size = instanceCapacity,
+		.stride = sizeof(uint32_t)
+	}, VGText("Virtual shadow visible instance buffer"));
+	shadowPass.Read(inputs.meshIndirectArgs, ResourceBind::SRV);
+	shadowPass.Read(inputs.meshInstances, ResourceBind::SRV);
+	shadowPass.Read(inputs.objectBuffer, ResourceBind::SRV);
+	shadowPass.Read(inputs.transformBuffer, ResourceBind::SRV);
+	shadowPass.Read(inputs.cameraBuffer, ResourceBind::SRV);
+	shadowPass.Read(inputs.cullingViewBuffer, ResourceBind::SRV);
+	shadowPass.Read(inputs.vertexPositions, ResourceBind::SRV);
+	shadowPass.Read(shadowResources.pageTable, ResourceBind::SRV);
+	shadowPass.Read(renderListTag, ResourceBind::SRV);
+	shadowPass.Read(clearArgumentsTag, ResourceBind::Indirect);
+	shadowPass.Write(culledArgsTag, ResourceBind::UAV);
+	shadowPass.Write(visibleInstancesTag, ResourceBind::UAV);
+	shadowPass.Write(shadowResources.physicalPages, ResourceBind::UAV);
+	shadowPass.Bind([this, inputs, shadowResources, renderListTag, clearArgumentsTag, culledArgsTag, visibleInstancesTag](CommandList& list, RenderPassResources& resources)
+	{
+		auto& renderer = Renderer::Get();
+
+		const auto culledArgs = resources.GetBuffer(culledArgsTag);
+		const auto visibleInstances = resources.GetBuffer(visibleInstancesTag);
+		const auto physicalPageTexture = resources.GetTexture(shadowResources.physicalPages);
+
+		// Clear the pages about to render, one group per 8x8 texels of each page.
+		PageBindData pageBindData{};
+		pageBindData.pageTable = resources.Get(shadowResources.pageTable);
+		pageBindData.renderList = resources.Get(renderListTag);
+		pageBindData.physicalPages = resources.Get(shadowResources.physicalPages);
+
+		list.BindPipeline(clearLayout);
+		list.BindConstants("bindData", pageBindData);
+
+		auto& clearComponent = device->GetResourceManager().Get(resources.GetBuffer(clearArgumentsTag));
+		list.SuspendRenderPass();  // Dispatches aren't allowed within a render pass.
+		list.Native()->ExecuteIndirect(clearSignature.Get(), 1, clearComponent.allocation->GetResource(), 0, nullptr, 0);
+
+		list.UAVBarrier(physicalPageTexture);
+		list.FlushBarriers();
+
+		struct {
+			uint32_t inputBuffer;
+			uint32_t outputBuffer;
+			uint32_t instanceBuffer;
+			uint32_t visibleInstanceBuffer;
+			uint32_t objectBuffer;
+			uint32_t transformBuffer;
+			uint32_t cullingViewBuffer;
+			uint32_t cameraIndex;
+			uint32_t batchCount;
+			uint32_t instanceCount;
+			uint32_t cullingLevel;
+			uint32_t hiZTexture;
+			uint32_t hiZMipLevels;
+			uint32_t visibilityBuffer;
+			uint32_t nextVisibilityBuffer;
+			uint32_t lodResolution;  // Cached pages keep the full detail level.
+			float lodErrorThreshold;
+			uint32_t countInstances;
+			uint32_t virtualPageTable;
+		} cullBindData{};
+
+		cullBindData.inputBuffer = resources.Get(inputs.meshIndirectArgs);
+		cullBindData.outputBuffer = resources.Get(culledArgsTag);
+		cullBindData.instanceBuffer = resources.Get(inputs.meshInstances);
+		cullBindData.visibleInstanceBuffer = resources.Get(visibleInstancesTag);
+		cullBindData.objectBuffer = resources.Get(inputs.objectBuffer);
+		cullBindData.transformBuffer = resources.Get(inputs.transformBuffer);
+		cullBindData.cullingViewBuffer = resources.Get(inputs.cullingViewBuffer);
+		cullBindData.cameraIndex = cameraIndex;
+		cullBindData.batchCount = renderer.batchCount;
+		cullBindData.instanceCount = renderer.renderableCount;
+		cullBindData.cullingLevel = 1;  // Frustum only.
+		cullBindData.countInstances = device->GetProfiler().CollectingStatistics();
+		cullBindData.virtualPageTable = resources.Get(shadowResources.pageTable);
+
+		constexpr auto groupSize = 64;
+
+		list.BindPipeline(cullResetLayout);
+		list.BindConstants("bindData", cullBindData);
+		list.Dispatch(std::ceil((float)cullBindData.batchCount / groupSize), 1, 1);
+
+		list.UAVBarrier(culledArgs);
+		list.FlushBarriers();
+
+		// Only casters covering a page that renders this frame survive, static scenes draw nothing.
+		list.BindPipeline(cullLayout);
+		list.BindConstants("bindData", cullBindData);
+		list.Dispatch(std::ceil((float)cullBindData.instanceCount / groupSize), 1, 1);
+
+		if (device->GetProfiler().CollectingStatistics())
+		{
+			const auto& arguments = device->GetResourceManager().Get(culledArgs);
+			device->GetProfiler().ReadCounter(list, device->GetFrameIndex(), "Virtual shadow casters", arguments.counterBuffer, static_cast<uint32_t>(renderer.renderableCount));
+		}
+
+		list.TransitionBarrier(culledArgs, MeshSystem::argumentState);
+		list.TransitionBarrier(visibleInstances, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+		list.FlushBarriers();
+
+		struct {
+			uint32_t instanceBuffer;
+			uint32_t objectBuffer;
+			uint32_t transformBuffer;
+			uint32_t cameraBuffer;
+			uint32_t cameraIndex;
+			uint32_t vertexPositionBuffer;
+			uint32_t pageTable;
+			uint32_t physicalPages;
+			int32_t windowOrigin[2];
+		} bindData{};
+
+		bindData.instanceBuffer = resources.Get(visibleInstancesTag);
+		bindData.objectBuffer = resources.Get(inputs.objectBuffer);
+		bindData.transformBuffer = resources.Get(inputs.transformBuffer);
+		bindData.cameraBuffer = resources.Get(inputs.cameraBuffer);
+		bindData.cameraIndex = cameraIndex;
+		bindData.vertexPositionBuffer = resources.Get(inputs.vertexPositions);
+		bindData.pageTable = resources.Get(shadowResources.pageTable);
+		bindData.physicalPages = resources.Get(shadowResources.physicalPages);
+		bindData.windowOrigin[0] = windowOrigin[0];
+		bindData.windowOrigin[1] = windowOrigin[1];
+
+		// The whole window in one viewport, pixels outside of rendering pages are rejected in the pixel shader.
+		const D3D12_VIEWPORT viewport{
+			.TopLeftX = 0.f,
+			.TopLeftY = 0.f,
+			.Width = static_cast<float>(virtualResolution),
+			.Height = static_cast<float>(virtualResolution),
+			.MinDepth = 0.f,
+			.MaxDepth = 1.f
+		};
+		const D3D12_RECT scissor{
+			.left = 0,
+			.top = 0,
+			.right = static_cast<LONG>(virtualResolution),
+			.bottom = static_cast<LONG>(virtualResolution)
+		};
+
+		list.BindPipeline(rasterLayout);
+		MeshSystem::BindArguments(renderer, list, culledArgs);
+		list.Native()->RSSetViewports(1, &viewport);
+		list.Native()->RSSetScissorRects(1, &scissor);
+		list.BindConstants("bindData", bindData);
+		list.Native()->ExecuteIndirect(renderer.meshIndirectCommandSignature.Get(), renderer.batchCount, device->GetResourceManager().Get(culledArgs).Native(), 0, nullptr, 0);
+
+		// Restore the states the graph expects at the end of the pass.
+		list.TransitionBarrier(culledArgs, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		list.TransitionBarrier(visibleInstances, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		list.FlushBarriers();
+	});
+
+	return shadowResources;
+}
+
+VirtualShadowData VirtualShadowMap::GetShadowData(RenderPassResources& resources, const VirtualShadowResources& shadowResources) const
+{
+	return VirtualShadowData{
+		.enabled = enabled ? 1u : 0u,
+		.pageTable = resources.Get(shadowResources.pageTable),
+		.physicalPages = resources.Get(shadowResources.physicalPages),
+		.cameraIndex = cameraIndex
+	};
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Rendering/ResourceHandle.h>
+#include <Rendering/RenderPipeline.h>
+#include <Rendering/RenderGraphResource.h>
+#include <Rendering/ShaderStructs.h>
+#include <Rendering/CascadedShadows.h>
+#include <Utility/FrameArena.h>
+
+#include <vector>
+#include <utility>
+#include <span>
+
+class RenderDevice;
+class RenderGraph;
+class RenderPassResources;
+
+struct VirtualShadowResources
+{
+	RenderResource pageTable;
+	RenderResource physicalPages;
+};
+
+// Sun shadows from one large virtual depth texture, anchored to the light's view and backed by a pool of physical pages.
+// Pages are requested by the view's depth buffer, and render once when first mapped, then only again after they're
+// invalidated by instances moving over them or by the sun moving. Static scenes render almost nothing per frame.
+class VirtualShadowMap
+{
+public:
+	static constexpr uint32_t cameraIndex = CascadedShadows::firstCameraIndex + CascadedShadows::cascadeCount;
+	// Matches VirtualShadows/Core.hlsli.
+	static constexpr uint32_t pageSize = 128;  // Texels per side of a page.
+	static constexpr uint32_t pageTableSize = 128;  // Pages per side of the virtual texture.
+	static constexpr uint32_t virtualResolution = pageSize * pageTableSize;  // The largest viewport.
+	static constexpr uint32_t physicalPoolSize = 32;  // Pages per side of the physical pool.
+	static constexpr uint32_t maxInvalidationRanges = 256;
+
+private:
+	RenderDevice* device;
+
+	RenderPipelineLayout markLayout;
+	RenderPipelineLayout invalidateLayout;
+	RenderPipelineLayout allocateLayout;
+	RenderPipelineLayout clearLayout;
+	RenderPipelineLayout cullResetLayout;
+	RenderPipelineLayout cullLayout;
+	RenderPipelineLayout rasterLayout;
+
+	ResourcePtr<ID3D12CommandSignature> clearSignature;
+
+	BufferHandle pageTable;
+	BufferHandle physicalOwners;
+	BufferHandle pageRequests;
+	BufferHandle renderList;
+	BufferHandle clearArguments;
+	BufferHandle invalidationRangeBuffer;
+	TextureHandle physicalPages;
+
+	bool enabled = false;
+	bool resetPending = true;  // The table and pool are uninitialized.
+	bool invalidated = true;
+	std::vector<std::pair<uint32_t, uint32_t>> invalidationRanges;  // Instance slots moved since the last render.
+	uint32_t frame = 0;
+
+	XMFLOAT3 lastSunDirection = { 0.f, 0.f, 0.f };
+	XMFLOAT3 lastSunUpward = { 0.f, 0.f, 0.f };
+	float texelSize = 0.f;
+	float depthCenter = 0.f;
+	int32_t windowOrigin[2] = { 0, 0 };  // World page of the window's first page.
+
+public:
+	~VirtualShadowMap();
+
+	void Initialize(RenderDevice* inDevice);
+	// Scene geometry changed in ways instance ranges can't describe, every page renders again.
+	void Invalidate() noexcept { invalidated = true; }
+	// Instance slots that moved, the pages under their current and last transforms render again.
+	void InvalidateInstances(std::span<const std::pair<uint32_t, uint32_t>> ranges);
+	// Centers the window on the view and appends the shadow camera, which must land at the camera index.
+	void Update(const XMMATRIX& view, const XMVECTOR& sunDirection, const XMVECTOR& sunUpward, FrameVector<Camera>& cameras);
+	// Requests pages from the complete depth buffer, and renders the pages that are missing or invalidated.
+	VirtualShadowResources Render(RenderGraph& graph, const ShadowInputs& inputs, RenderResource depthStencil);
+	VirtualShadowData GetShadowData(RenderPassResources& resources, const VirtualShadowResources& shadowResources) const;
+};
\ No newline at end of file
@@ -0,0 +1,160 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Rendering/VolumetricFog.h>
+#include <Rendering/Device.h>
+#include <Rendering/Renderer.h>
+#include <Rendering/RenderGraph.h>
+#include <Rendering/RenderPass.h>
+#include <Rendering/CascadedShadows.h>
+
+#include <cmath>
+
+void VolumetricFog::Initialize(RenderDevice* inDevice)
+{
+	device = inDevice;
+
+	enabled = CvarCreate("volumetricFog", "Controls froxel based volumetric fog, 0=disabled, 1=enabled", 1);
+	range = CvarCreate("volumetricFogRange", "View depth covered by the volumetric fog grid, in meters. Local lights are binned up to this depth", 128.f);
+
+	scatteringLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Volumetrics/FogScattering", "Main" });
+
+	integrationLayout = RenderPipelineLayout{}
+		.ComputeShader({ "Volumetrics/FogIntegration", "Main" });
+}
+
+RenderResource VolumetricFog::Render(RenderGraph& graph, const ClusteredLightCulling& clusteredCulling, const CascadedShadows& shadows, const VolumetricFogInputs& inputs)
+{
+	if (!Enabled())
+	{
+		return { .id = 0 };
+	}
+
+	// Golden ratio sequence, well distributed over any number of consecutive frames.
+	const auto frameJitter = std::fmod(Renderer::Get().GetAppFrame() * 0.618034f, 1.f);
+
+	const auto history = graph.CreateHistory(VGText("Volumetric fog scattering"), TransientTextureDescription{
+		.width = gridWidth,
+		.height = gridHeight,
+		.depth = gridDepth,
+		.format = DXGI_FORMAT_R16G16B16A16_FLOAT
+	});
+	const auto scatteringTag = history.current;
+
+	auto& scatteringPass = graph.AddPass("Volumetric Fog Scattering Pass", ExecutionQueue::Compute);
+	scatteringPass.Read(inputs.cameraBuffer, ResourceBind::SRV);
+	scatteringPass.Read(inputs.lightBuffer, ResourceBind::SRV);
+	scatteringPass.Read(inputs.clusterResources.lightList, ResourceBind::SRV);
+	scatteringPass.Read(inputs.clusterResources.lightInfo, ResourceBind::SRV);
+	scatteringPass.Read(inputs.clusterResources.directionalLightList, ResourceBind::SRV);
+	scatteringPass.Read(inputs.atmosphereIrradiance, ResourceBind::SRV);
+	scatteringPass.Read(inputs.cloudShadow, ResourceBind::SRV);
+	scatteringPass.Read(inputs.shadowAtlas, ResourceBind::SRV);
+	if (history.Valid())
+	{
+		scatteringPass.Read(history.previous, ResourceBind::SRV);
+	}
+	scatteringPass.Write(scatteringTag, TextureView{}.UAV("", 0));
+	scatteringPass.Bind([this, &clusteredCulling, &shadows, inputs, oldHistory=history.previous, scatteringTag, frameJitter](CommandList& list, RenderPassResources& resources)
+	{
+		list.BindPipeline(scatteringLayout);
+
+		struct {
+			uint32_t cameraBuffer;
+			uint32_t cameraIndex;
+			uint32_t lightBuffer;
+			uint32_t atmosphereIrradianceBuffer;
+			uint32_t cloudShadowTexture;
+			uint32_t historyTexture;
+			uint32_t outputTexture;
+			float range;
+			XMFLOAT3 albedo;
+			float density;
+			float heightFalloff;
+			float baseHeight;
+			float anisotropy;
+			float historyWeight;
+			XMFLOAT2 weatherScroll;
+			float jitter;
+			float padding;
+			uint32_t outputResolution[2];
+			float padding2[2];
+			ClusterData clusterData;
+			ShadowData shadowData;
+		} bindData;
+
+		bindData.cameraBuffer = resources.Get(inputs.cameraBuffer);
+		bindData.cameraIndex = 0;  // #TODO: Support multiple cameras.
+		bindData.lightBuffer = resources.Get(inputs.lightBuffer);
+		bindData.atmosphereIrradianceBuffer = resources.Get(inputs.atmosphereIrradiance);
+		bindData.cloudShadowTexture = resources.Get(inputs.cloudShadow);
+		bindData.historyTexture = 0;
+		if (oldHistory.id != 0)
+			bindData.historyTexture = resources.Get(oldHistory);
+		bindData.outputTexture = resources.Get(scatteringTag);
+		bindData.range = *range;
+		bindData.albedo = albedo;
+		bindData.density = density;
+		bindData.heightFalloff = heightFalloff;
+		bindData.baseHeight = baseHeight;
+		bindData.anisotropy = anisotropy;
+		bindData.historyWeight = historyWeight;
+		bindData.weatherScroll = inputs.weatherScroll;
+		bindData.jitter = frameJitter;
+		const auto [sceneWidth, sceneHeight] = Renderer::Get().GetSceneResolution();
+		bindData.outputResolution[0] = sceneWidth;
+		bindData.outputResolution[1] = sceneHeight;
+		bindData.clusterData = clusteredCulling.GetClusterData(resources, inputs.clusterResources);
+		bindData.shadowData = shadows.GetShadowData(resources, inputs.shadowAtlas);
+
+		list.BindConstants("bindData", bindData);
+
+		const auto dispatchX = (uint32_t)std::ceil(gridWidth / 4.f);
+		const auto dispatchY = (uint32_t)std::ceil(gridHeight / 4.f);
+		const auto dispatchZ = (uint32_t)std::ceil(gridDepth / 4.f);
+
+		list.Dispatch(dispatchX, dispatchY, dispatchZ);
+	});
+
+	auto& integrationPass = graph.AddPass("Volumetric Fog Integration Pass", ExecutionQueue::Compute);
+	const auto integratedTag = integrationPass.Create(TransientTextureDescription{
+		.width = gridWidth,
+		.height = gridHeight,
+		.depth = gridDepth,
+		.format = DXGI_FORMAT_R16G16B16A16_FLOAT
+	}, VGText("Volumetric fog integrated"));
+	integrationPass.Read(scatteringTag, ResourceBind::SRV);
+	integrationPass.Write(integratedTag, TextureView{}.UAV("", 0));
+	integrationPass.Bind([this, scatteringTag, integratedTag](CommandList& list, RenderPassResources& resources)
+	{
+		list.BindPipeline(integrationLayout);
+
+		struct {
+			uint32_t scatteringTexture;
+			uint32_t outputTexture;
+			float range;
+		} bindData;
+
+		bindData.scatteringTexture = resources.Get(scatteringTag);
+		bindData.outputTexture = resources.Get(integratedTag);
+		bindData.range = *range;
+
+		list.BindConstants("bindData", bindData);
+
+		const auto dispatchX = (uint32_t)std::ceil(gridWidth / 8.f);
+		const auto dispatchY = (uint32_t)std::ceil(gridHeight / 8.f);
+
+		list.Dispatch(dispatchX, dispatchY, 1);
+	});
+
+	return integratedTag;
+}
+
+FogData VolumetricFog::GetFogData(RenderPassResources& resources, RenderResource integratedFog) const
+{
+	FogData data{};
+	data.integratedTexture = integratedFog.id != 0 ? resources.Get(integratedFog) : 0;
+	data.range = *range;
+
+	return data;
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Rendering/Base.h>
+#include <Rendering/RenderPipeline.h>
+#include <Rendering/RenderGraphResource.h>
+#include <Rendering/ClusteredLightCulling.h>
+#include <Rendering/ShaderStructs.h>
+#include <Core/ConsoleVariable.h>
+
+class RenderDevice;
+class RenderGraph;
+class RenderPassResources;
+class CascadedShadows;
+
+struct VolumetricFogInputs
+{
+	RenderResource cameraBuffer;
+	RenderResource lightBuffer;
+	ClusterResources clusterResources;
+	RenderResource atmosphereIrradiance;
+	RenderResource cloudShadow;
+	RenderResource shadowAtlas;
+	XMFLOAT2 weatherScroll;
+};
+
+// Height fog integrated in a camera aligned froxel grid, lit by the sun and by the local lights of the cluster grid.
+// Every froxel takes one jittered sample per frame and blends it with the reprojected history, then a second pass
+// integrates the grid front to back so that applying the fog is a single fetch at the surface's depth.
+class VolumetricFog
+{
+public:
+	// Matches the 16:9 back buffer, froxels are independent of the cluster grid.
+	static constexpr uint32_t gridWidth = 160;
+	static constexpr uint32_t gridHeight = 90;
+	static constexpr uint32_t gridDepth = 64;
+
+	XMFLOAT3 albedo = { 1.f, 1.f, 1.f };
+	float density = 0.01f;  // Extinction at the base height, per meter.
+	float heightFalloff = 0.05f;  // Per meter above the base height.
+	float baseHeight = 0.f;  // World space, meters.
+	float anisotropy = 0.3f;  // Henyey-Greenstein eccentricity, positive scatters forwards.
+	float historyWeight = 0.9f;  // Blend weight of the reprojected history.
+
+private:
+	RenderDevice* device;
+
+	CvarHandle<int> enabled;
+	CvarHandle<float> range;
+
+	RenderPipelineLayout scatteringLayout;
+	RenderPipelineLayout integrationLayout;
+
+public:
+	void Initialize(RenderDevice* inDevice);
+	bool Enabled() const { return *enabled > 0; }
+	float GetRange() const { return *range; }
+	// Returns the integrated grid, sampled through FogData.
+	RenderResource Render(RenderGraph& graph, const ClusteredLightCulling& clusteredCulling, const CascadedShadows& shadows, const VolumetricFogInputs& inputs);
+	FogData GetFogData(RenderPassResources& resources, RenderResource integratedFog) const;
+};
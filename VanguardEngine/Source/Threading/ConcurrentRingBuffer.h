@@ -0,0 +1,157 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <cstdint>
+
+// Fixed capacity, lock free counterparts of RingBuffer. Unlike it they never overwrite, pushing into a full buffer fails.
+// Capacities are rounded up to a power of two.
+
+namespace Detail
+{
+	// Keeps the producer and consumer positions on separate cache lines.
+	constexpr size_t cacheLineSize = 64;
+}
+
+// One producer thread and one consumer thread. Wait free.
+template <typename T>
+class SpscRingBuffer
+{
+private:
+	std::unique_ptr<T[]> buffer;
+	size_t mask;
+
+	alignas(Detail::cacheLineSize) std::atomic<size_t> head = 0;  // Next element to pop, written by the consumer.
+	alignas(Detail::cacheLineSize) std::atomic<size_t> tail = 0;  // Next element to push, written by the producer.
+
+public:
+	SpscRingBuffer(size_t capacity) : buffer(std::make_unique<T[]>(std::bit_ceil(capacity))), mask(std::bit_ceil(capacity) - 1) {}
+
+	SpscRingBuffer(const SpscRingBuffer&) = delete;
+	SpscRingBuffer(SpscRingBuffer&&) noexcept = delete;
+
+	SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+	SpscRingBuffer& operator=(SpscRingBuffer&&) noexcept = delete;
+
+	// Producer only.
+	bool try_push(T element)
+	{
+		const auto position = tail.load(std::memory_order_relaxed);
+		if (position - head.load(std::memory_order_acquire) > mask)
+			return false;
+
+		buffer[position & mask] = std::move(element);
+		tail.store(position + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Consumer only.
+	std::optional<T> try_pop()
+	{
+		const auto position = head.load(std::memory_order_relaxed);
+		if (position == tail.load(std::memory_order_acquire))
+			return std::nullopt;
+
+		std::optional<T> element{ std::move(buffer[position & mask]) };
+		head.store(position + 1, std::memory_order_release);
+
+		return element;
+	}
+
+	// Approximate while either side is active.
+	size_t size() const
+	{
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	size_t capacity() const { return mask + 1; }
+};
+
+// Any number of producer threads and one consumer thread. Each slot carries a sequence number telling whose turn it is,
+// see Dmitry Vyukov's bounded MPMC queue. Pushing is lock free, popping is wait free.
+template <typename T>
+class MpscRingBuffer
+{
+private:
+	struct Slot
+	{
+		std::atomic<size_t> sequence;
+		T element;
+	};
+
+	std::unique_ptr<Slot[]> buffer;
+	size_t mask;
+
+	alignas(Detail::cacheLineSize) size_t head = 0;  // Only read by the consumer.
+	alignas(Detail::cacheLineSize) std::atomic<size_t> tail = 0;
+
+public:
+	MpscRingBuffer(size_t capacity) : buffer(std::make_unique<Slot[]>(std::bit_ceil(capacity))), mask(std::bit_ceil(capacity) - 1)
+	{
+		for (size_t i = 0; i <= mask; ++i)
+		{
+			buffer[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	MpscRingBuffer(const MpscRingBuffer&) = delete;
+	MpscRingBuffer(MpscRingBuffer&&) noexcept = delete;
+
+	MpscRingBuffer& operator=(const MpscRingBuffer&) = delete;
+	MpscRingBuffer& operator=(MpscRingBuffer&&) noexcept = delete;
+
+	bool try_push(T element)
+	{
+		auto position = tail.load(std::memory_order_relaxed);
+		while (true)
+		{
+			auto& slot = buffer[position & mask];
+			const auto sequence = slot.sequence.load(std::memory_order_acquire);
+			const auto difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+
+			if (difference == 0)
+			{
+				// The slot is free, claim it. On failure the position is reloaded.
+				if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					slot.element = std::move(element);
+					slot.sequence.store(position + 1, std::memory_order_release);
+
+					return true;
+				}
+			}
+
+			else if (difference < 0)
+			{
+				return false;  // The slot still holds an element from the previous lap, full.
+			}
+
+			else
+			{
+				position = tail.load(std::memory_order_relaxed);  // Another producer claimed it.
+			}
+		}
+	}
+
+	// Consumer only. A producer that claimed the next slot but hasn't finished writing it reads as empty.
+	std::optional<T> try_pop()
+	{
+		auto& slot = buffer[head & mask];
+		if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+			return std::nullopt;
+
+		std::optional<T> element{ std::move(slot.element) };
+		slot.sequence.store(head + mask + 1, std::memory_order_release);  // Free for the next lap.
+		++head;
+
+		return element;
+	}
+
+	size_t capacity() const { return mask + 1; }
+};
\ No newline at end of file
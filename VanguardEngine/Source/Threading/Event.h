@@ -0,0 +1,70 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Signaled once and waited on by any number of threads, until reset. Setting and checking never block, waiting sleeps on
+// the flag's address instead of a kernel event.
+class Event
+{
+private:
+	std::atomic<uint32_t> signaled = 0;
+
+public:
+	void Set() noexcept
+	{
+		// Skips the wake up if nothing could be waiting.
+		if (signaled.exchange(1, std::memory_order_release) == 0)
+		{
+			signaled.notify_all();
+		}
+	}
+
+	// Waiters woken before the reset still return.
+	void Reset() noexcept { signaled.store(0, std::memory_order_relaxed); }
+
+	bool IsSet() const noexcept { return signaled.load(std::memory_order_acquire) != 0; }
+
+	void Wait() const noexcept
+	{
+		while (signaled.load(std::memory_order_acquire) == 0)
+		{
+			signaled.wait(0, std::memory_order_acquire);
+		}
+	}
+};
+
+// Wait free counter that threads can block on until it drains to zero, e.g. for outstanding uploads.
+class Counter
+{
+private:
+	std::atomic<uint32_t> value = 0;
+
+public:
+	// Returns the previous value.
+	uint32_t Increment(uint32_t amount = 1) noexcept { return value.fetch_add(amount, std::memory_order_relaxed); }
+
+	// Returns the previous value. Releases the work done before the decrement to threads waiting for zero.
+	uint32_t Decrement(uint32_t amount = 1) noexcept
+	{
+		const auto previous = value.fetch_sub(amount, std::memory_order_acq_rel);
+		if (previous == amount)
+		{
+			value.notify_all();
+		}
+
+		return previous;
+	}
+
+	uint32_t Get() const noexcept { return value.load(std::memory_order_acquire); }
+
+	void WaitForZero() const noexcept
+	{
+		for (auto current = value.load(std::memory_order_acquire); current != 0; current = value.load(std::memory_order_acquire))
+		{
+			value.wait(current, std::memory_order_acquire);
+		}
+	}
+};
\ No newline at end of file
@@ -0,0 +1,185 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Threading/JobSystem.h>
+#include <Threading/Thread.h>
+#include <Core/Base.h>
+
+#include <mutex>
+#include <optional>
+#include <string>
+
+thread_local size_t JobSystem::threadIndex = 0;
+
+bool JobSystem::RunJob(size_t index)
+{
+	std::optional<QueuedJob> job;
+
+	{
+		auto& queue = *queues[index];
+		std::scoped_lock lock{ queue.lock };
+
+		if (!queue.jobs.empty())
+		{
+			job.emplace(std::move(queue.jobs.back()));
+			queue.jobs.pop_back();
+		}
+	}
+
+	// Steal from the opposite end of the victim's deque, taking its oldest and typically largest remaining work.
+	for (size_t offset = 1; !job && offset < queues.size(); ++offset)
+	{
+		auto& queue = *queues[(index + offset) % queues.size()];
+		std::scoped_lock lock{ queue.lock };
+
+		if (!queue.jobs.empty())
+		{
+			job.emplace(std::move(queue.jobs.front()));
+			queue.jobs.pop_front();
+		}
+	}
+
+	if (!job)
+	{
+		return false;
+	}
+
+	queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+
+	{
+		ScopedMemoryTag memoryTag{ job->memoryTag };
+		job->job();
+	}
+
+	if (job->counter)
+	{
+		job->counter->pending.fetch_sub(1, std::memory_order_release);
+	}
+
+	return true;
+}
+
+void JobSystem::WorkerMain(size_t index)
+{
+	threadIndex = index;
+
+	SetThreadName(("Job Worker " + std::to_string(index)).c_str());
+
+	// Jobs feed the frame, so workers take the performance cores left over by the main thread. The rest spill onto the
+	// efficiency cores rather than leaving them idle, since the workers have no notion of job priority.
+	const auto& topology = GetCpuTopology();
+	SetThreadPlacement(index < topology.performanceThreads ? ThreadPlacement::Performance : ThreadPlacement::Efficiency);
+
+	while (running.load(std::memory_order_acquire))
+	{
+		if (!RunJob(index))
+		{
+			std::unique_lock lock{ sleepLock };
+			sleepCondition.wait(lock, [this]()
+			{
+				return !running.load(std::memory_order_acquire) || queuedJobs.load(std::memory_order_relaxed) > 0;
+			});
+		}
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	Shutdown();
+}
+
+void JobSystem::Initialize(size_t workerCount)
+{
+	VGAssert(!running, "Job system is already running.");
+
+	if (workerCount == 0)
+	{
+		workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+	}
+
+	queues.reserve(workerCount + 1);
+	for (size_t i = 0; i < workerCount + 1; ++i)
+	{
+		queues.emplace_back(std::make_unique<JobQueue>());
+	}
+
+	running = true;
+
+	workers.reserve(workerCount);
+	for (size_t i = 0; i < workerCount; ++i)
+	{
+		workers.emplace_back(&JobSystem::WorkerMain, this, i + 1);
+	}
+
+	VGLog(logThreading, "Job system running with {} workers.", workerCount);
+
+	if (const auto& topology = GetCpuTopology(); topology.hybrid)
+	{
+		VGLog(logThreading, "Hybrid CPU with {} performance and {} efficiency threads.", topology.performanceThreads, topology.efficiencyThreads);
+	}
+}
+
+void JobSystem::Shutdown()
+{
+	if (!running)
+	{
+		return;
+	}
+
+	{
+		std::scoped_lock lock{ sleepLock };
+		running = false;
+	}
+
+	sleepCondition.notify_all();
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+
+	workers.clear();
+
+	while (RunJob(threadIndex));
+
+	queues.clear();
+}
+
+void JobSystem::Schedule(Job&& job, JobCounter* counter)
+{
+	if (!running.load(std::memory_order_acquire))
+	{
+		job();
+
+		return;
+	}
+
+	if (counter)
+	{
+		counter->pending.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	{
+		auto& queue = *queues[threadIndex];
+		std::scoped_lock lock{ queue.lock };
+		queue.jobs.push_back({ std::move(job), counter, GetMemoryTag() });
+	}
+
+	// Taking the lock orders the increment with a worker checking for jobs before sleeping, so the wake up isn't lost.
+	{
+		std::scoped_lock lock{ sleepLock };
+		queuedJobs.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	sleepCondition.notify_one();
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	while (!counter.IsDone())
+	{
+		if (!RunJob(threadIndex))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Utility/Singleton.h>
+#include <Utility/StackFunction.h>
+#include <Threading/CriticalSection.h>
+#include <Core/Memory.h>
+
+#include <entt/entt.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+// Counts the unfinished jobs scheduled with it. Dependencies are expressed by waiting on the counters of the jobs they
+// depend on.
+class JobCounter
+{
+	friend class JobSystem;
+
+private:
+	std::atomic<uint32_t> pending = 0;
+
+public:
+	bool IsDone() const noexcept { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Fixed pool of worker threads, each with its own deque of jobs. Threads run their newest job first, and once their deque
+// is empty steal the oldest job of another thread. Threads waiting on a counter run jobs until it's done instead of
+// blocking, so jobs may wait on the jobs they schedule. Threads outside of the pool schedule into the main thread's deque.
+class JobSystem : public Singleton<JobSystem>
+{
+public:
+	using Job = StackFunction<void(), 64>;
+
+private:
+	struct QueuedJob
+	{
+		Job job;
+		JobCounter* counter;
+		MemoryTag memoryTag;  // Of the scheduling thread, the job's allocations are accounted to it.
+	};
+
+	struct JobQueue
+	{
+		CriticalSection lock;
+		std::deque<QueuedJob> jobs;
+	};
+
+	std::vector<std::unique_ptr<JobQueue>> queues;  // One per thread, the first belongs to the main thread.
+	std::vector<std::thread> workers;
+	std::atomic<bool> running = false;
+	std::atomic<uint32_t> queuedJobs = 0;  // Wakes idle workers.
+	CriticalSection sleepLock;
+	std::condition_variable_any sleepCondition;
+
+	static thread_local size_t threadIndex;
+
+	// Runs a job from the thread's deque, or a stolen one. Returns false if every deque was empty.
+	bool RunJob(size_t index);
+	void WorkerMain(size_t index);
+
+public:
+	~JobSystem();
+
+	// Spawns the workers, one fewer than the hardware threads by default, leaving the main thread.
+	void Initialize(size_t workerCount = 0);
+	// Joins the workers, remaining jobs are run on the calling thread.
+	void Shutdown();
+
+	// Includes the main thread.
+	size_t GetThreadCount() const noexcept { return std::max(queues.size(), size_t{ 1 }); }
+
+	// Jobs run immediately on the calling thread if the system isn't running.
+	void Schedule(Job&& job, JobCounter* counter = nullptr);
+	// Runs jobs on the calling thread until the counter is done.
+	void Wait(JobCounter& counter);
+
+	// Invokes the function for each index in [0, count), in jobs of up to batchSize indices. Blocks until finished.
+	template <typename Function>
+	void ParallelFor(size_t count, size_t batchSize, Function&& function);
+	// Invokes the function for each entity of the view, the view must not change until finished.
+	template <typename View, typename Function>
+	void ParallelForEach(const View& view, size_t batchSize, Function&& function);
+};
+
+template <typename Function>
+void JobSystem::ParallelFor(size_t count, size_t batchSize, Function&& function)
+{
+	batchSize = std::max(batchSize, size_t{ 1 });
+
+	JobCounter counter;
+	for (size_t begin = 0; begin < count; begin += batchSize)
+	{
+		const auto end = std::min(begin + batchSize, count);
+		Schedule([&function, begin, end]()
+		{
+			for (auto i = begin; i < end; ++i)
+			{
+				function(i);
+			}
+		}, &counter);
+	}
+
+	Wait(counter);
+}
+
+template <typename View, typename Function>
+void JobSystem::ParallelForEach(const View& view, size_t batchSize, Function&& function)
+{
+	// Views over multiple components can't be indexed, so gather the entities first.
+	const std::vector<entt::entity> entities{ view.begin(), view.end() };
+
+	ParallelFor(entities.size(), batchSize, [&entities, &function](size_t index)
+	{
+		function(entities[index]);
+	});
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Threading/ReaderWriterLock.h>
+
+#include <pthread.h>
+
+static_assert(sizeof(pthread_rwlock_t) == sizeOfReaderWriterHandle, "Invalid pthread_rwlock_t size! Header requires update.");
+
+ReaderWriterLock::ReaderWriterLock()
+{
+	pthread_rwlock_init(reinterpret_cast<pthread_rwlock_t*>(handle), nullptr);
+}
+
+ReaderWriterLock::~ReaderWriterLock()
+{
+	pthread_rwlock_destroy(reinterpret_cast<pthread_rwlock_t*>(handle));
+}
+
+void ReaderWriterLock::lock()
+{
+	pthread_rwlock_wrlock(reinterpret_cast<pthread_rwlock_t*>(handle));
+}
+
+bool ReaderWriterLock::try_lock()
+{
+	return pthread_rwlock_trywrlock(reinterpret_cast<pthread_rwlock_t*>(handle)) == 0;
+}
+
+void ReaderWriterLock::unlock() noexcept
+{
+	pthread_rwlock_unlock(reinterpret_cast<pthread_rwlock_t*>(handle));
+}
+
+void ReaderWriterLock::lock_shared()
+{
+	pthread_rwlock_rdlock(reinterpret_cast<pthread_rwlock_t*>(handle));
+}
+
+bool ReaderWriterLock::try_lock_shared()
+{
+	return pthread_rwlock_tryrdlock(reinterpret_cast<pthread_rwlock_t*>(handle)) == 0;
+}
+
+void ReaderWriterLock::unlock_shared() noexcept
+{
+	pthread_rwlock_unlock(reinterpret_cast<pthread_rwlock_t*>(handle));
+}
\ No newline at end of file
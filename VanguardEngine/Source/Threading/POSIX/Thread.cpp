@@ -0,0 +1,17 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Threading/Thread.h>
+
+#include <thread>
+
+// Core classes aren't exposed portably, every core is treated alike and placement is left to the scheduler.
+const CpuTopology& GetCpuTopology()
+{
+	static const CpuTopology topology{ .performanceThreads = std::thread::hardware_concurrency() };
+
+	return topology;
+}
+
+void SetThreadPlacement(ThreadPlacement placement)
+{
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#if PLATFORM_WINDOWS
+constexpr auto sizeOfReaderWriterHandle = 8;
+#else
+constexpr auto sizeOfReaderWriterHandle = 56;
+#endif
+
+// Shared for readers and exclusive for writers, for read mostly data such as caches. Not recursive, and a shared lock
+// can't be upgraded. Meets the requirements of both std::unique_lock and std::shared_lock.
+struct ReaderWriterLock
+{
+private:
+	alignas(void*) unsigned char handle[sizeOfReaderWriterHandle];
+
+public:
+	ReaderWriterLock();
+	ReaderWriterLock(const ReaderWriterLock&) = delete;
+	ReaderWriterLock(ReaderWriterLock&&) noexcept = delete;
+	~ReaderWriterLock();
+
+	ReaderWriterLock& operator=(const ReaderWriterLock&) = delete;
+	ReaderWriterLock& operator=(ReaderWriterLock&&) noexcept = delete;
+
+	void lock();
+	bool try_lock();
+	void unlock() noexcept;
+
+	void lock_shared();
+	bool try_lock_shared();
+	void unlock_shared() noexcept;
+};
\ No newline at end of file
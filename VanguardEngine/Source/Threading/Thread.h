@@ -0,0 +1,47 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <common/TracySystem.hpp>
+
+#include <cstdint>
+
+// Names the calling thread in the profiler, and in debuggers and crash dumps through the platform's thread description.
+// The name is copied.
+inline void SetThreadName(const char* name)
+{
+	tracy::SetThreadName(name);
+}
+
+// Cores a thread prefers on hybrid CPUs. Without distinct classes of cores, placement is left to the OS scheduler.
+enum class ThreadPlacement
+{
+	Default,  // Any core.
+	Performance,  // Frame critical work, the main thread and the job workers.
+	Efficiency,  // Background work that shouldn't take cores from the frame.
+};
+
+struct CpuTopology
+{
+	uint32_t performanceThreads = 0;  // Logical processors of the most performant class, all of them if not hybrid.
+	uint32_t efficiencyThreads = 0;
+	bool hybrid = false;  // Cores come in more than one efficiency class.
+};
+
+// Detected once, on first use.
+const CpuTopology& GetCpuTopology();
+
+// Prefers the cores of the placement for the calling thread. Only a preference, the scheduler can still run the thread
+// elsewhere when the preferred cores are busy.
+void SetThreadPlacement(ThreadPlacement placement);
+
+// Places the calling thread for the scope, for work on pooled threads that go on to run unrelated work.
+class ScopedThreadPlacement
+{
+public:
+	explicit ScopedThreadPlacement(ThreadPlacement placement) { SetThreadPlacement(placement); }
+	~ScopedThreadPlacement() { SetThreadPlacement(ThreadPlacement::Default); }
+
+	ScopedThreadPlacement(const ScopedThreadPlacement&) = delete;
+	ScopedThreadPlacement& operator=(const ScopedThreadPlacement&) = delete;
+};
\ No newline at end of file
@@ -0,0 +1,46 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Threading/ReaderWriterLock.h>
+#include <Core/Windows/WindowsMinimal.h>
+
+static_assert(sizeof(SRWLOCK) == sizeOfReaderWriterHandle, "Invalid SRWLOCK size! Header requires update.");
+
+ReaderWriterLock::ReaderWriterLock()
+{
+	InitializeSRWLock(reinterpret_cast<SRWLOCK*>(handle));
+}
+
+ReaderWriterLock::~ReaderWriterLock()
+{
+	// Slim reader/writer locks don't need to be destroyed.
+}
+
+void ReaderWriterLock::lock()
+{
+	AcquireSRWLockExclusive(reinterpret_cast<SRWLOCK*>(handle));
+}
+
+bool ReaderWriterLock::try_lock()
+{
+	return TryAcquireSRWLockExclusive(reinterpret_cast<SRWLOCK*>(handle));
+}
+
+void ReaderWriterLock::unlock() noexcept
+{
+	ReleaseSRWLockExclusive(reinterpret_cast<SRWLOCK*>(handle));
+}
+
+void ReaderWriterLock::lock_shared()
+{
+	AcquireSRWLockShared(reinterpret_cast<SRWLOCK*>(handle));
+}
+
+bool ReaderWriterLock::try_lock_shared()
+{
+	return TryAcquireSRWLockShared(reinterpret_cast<SRWLOCK*>(handle));
+}
+
+void ReaderWriterLock::unlock_shared() noexcept
+{
+	ReleaseSRWLockShared(reinterpret_cast<SRWLOCK*>(handle));
+}
\ No newline at end of file
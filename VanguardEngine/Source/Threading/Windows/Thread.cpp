@@ -0,0 +1,105 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Threading/Thread.h>
+#include <Core/Windows/WindowsMinimal.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+namespace
+{
+	struct CpuSets
+	{
+		CpuTopology topology;
+		std::vector<ULONG> performance;
+		std::vector<ULONG> efficiency;
+	};
+
+	// Higher efficiency classes are the more performant cores, CPUs without distinct classes report the same class for
+	// every core. Runs before logging is up, so callers report the topology.
+	CpuSets DetectCpuSets()
+	{
+		CpuSets result;
+
+		ULONG length = 0;
+		GetSystemCpuSetInformation(nullptr, 0, &length, GetCurrentProcess(), 0);
+
+		std::vector<std::byte> buffer(length);
+		if (length == 0 || !GetSystemCpuSetInformation(reinterpret_cast<PSYSTEM_CPU_SET_INFORMATION>(buffer.data()), length, &length, GetCurrentProcess(), 0))
+		{
+			return result;  // Placement is left to the OS.
+		}
+
+		struct CpuSet
+		{
+			ULONG id;
+			BYTE efficiencyClass;
+		};
+
+		std::vector<CpuSet> sets;
+		BYTE highestClass = 0;
+		BYTE lowestClass = 0xFF;
+
+		// Entries are variably sized.
+		for (ULONG offset = 0; offset < length;)
+		{
+			const auto* information = reinterpret_cast<const SYSTEM_CPU_SET_INFORMATION*>(buffer.data() + offset);
+			if (information->Type == CpuSetInformation)
+			{
+				sets.push_back({ information->CpuSet.Id, information->CpuSet.EfficiencyClass });
+				highestClass = std::max(highestClass, information->CpuSet.EfficiencyClass);
+				lowestClass = std::min(lowestClass, information->CpuSet.EfficiencyClass);
+			}
+
+			offset += information->Size;
+		}
+
+		for (const auto& set : sets)
+		{
+			(set.efficiencyClass == highestClass ? result.performance : result.efficiency).emplace_back(set.id);
+		}
+
+		result.topology.performanceThreads = static_cast<uint32_t>(result.performance.size());
+		result.topology.efficiencyThreads = static_cast<uint32_t>(result.efficiency.size());
+		result.topology.hybrid = !sets.empty() && highestClass != lowestClass;
+
+		return result;
+	}
+
+	const CpuSets& GetCpuSets()
+	{
+		static const CpuSets sets = DetectCpuSets();
+
+		return sets;
+	}
+}
+
+const CpuTopology& GetCpuTopology()
+{
+	return GetCpuSets().topology;
+}
+
+void SetThreadPlacement(ThreadPlacement placement)
+{
+	const auto& sets = GetCpuSets();
+	if (!sets.topology.hybrid && placement != ThreadPlacement::Default)
+	{
+		return;
+	}
+
+	const std::vector<ULONG>* selected = nullptr;
+	if (placement == ThreadPlacement::Performance) selected = &sets.performance;
+	else if (placement == ThreadPlacement::Efficiency) selected = &sets.efficiency;
+
+	// An empty selection clears the preference. Failing only loses the preference.
+	if (selected)
+	{
+		SetThreadSelectedCpuSets(GetCurrentThread(), selected->data(), static_cast<ULONG>(selected->size()));
+	}
+
+	else
+	{
+		SetThreadSelectedCpuSets(GetCurrentThread(), nullptr, 0);
+	}
+}
\ No newline at end of file
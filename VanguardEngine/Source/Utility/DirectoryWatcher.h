@@ -0,0 +1,26 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <filesystem>
+
+// Watches a directory tree for file writes. Only reports that something changed, callers determine what did.
+class DirectoryWatcher
+{
+private:
+	void* handle = nullptr;
+
+public:
+	DirectoryWatcher() = default;
+	DirectoryWatcher(const DirectoryWatcher&) = delete;
+	DirectoryWatcher(DirectoryWatcher&&) noexcept = delete;
+	~DirectoryWatcher();
+
+	DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+	DirectoryWatcher& operator=(DirectoryWatcher&&) noexcept = delete;
+
+	void Watch(const std::filesystem::path& directory);
+
+	// Non-blocking, returns true if any file was written since the last poll.
+	bool Poll();
+};
\ No newline at end of file
@@ -0,0 +1,102 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <Threading/CriticalSection.h>
+
+#include <memory_resource>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// Linear allocator for CPU data which only lives for a single frame, reset once the frame's CPU work is done. Freeing is a
+// no-op. Allocations bump an atomic offset into the current block, so passes recording in parallel only take the lock
+// when a block fills up. Blocks are kept across resets, so a steady state frame doesn't touch the heap.
+class FrameArena : public std::pmr::memory_resource
+{
+private:
+	struct Block
+	{
+		std::unique_ptr<std::byte[]> data;
+		size_t size;
+		std::atomic<size_t> offset = 0;
+
+		Block(size_t inSize) : data(std::make_unique<std::byte[]>(inSize)), size(inSize) {}
+	};
+
+	static constexpr size_t blockSize = 1024 * 1024;
+
+	std::vector<std::unique_ptr<Block>> blocks;
+	std::atomic<Block*> current = nullptr;
+	size_t currentIndex = 0;
+	CriticalSection lock;  // Guards advancing to the next block.
+
+protected:
+	void* do_allocate(size_t bytes, size_t alignment) override;
+	void do_deallocate(void* pointer, size_t bytes, size_t alignment) override {}
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+public:
+	// Invalidates all allocations, must not be called while allocating.
+	void Reset();
+};
+
+// Containers allocating from a frame arena, which must not outlive the frame.
+template <typename T>
+using FrameVector = std::pmr::vector<T>;
+
+inline void* FrameArena::do_allocate(size_t bytes, size_t alignment)
+{
+	// Over-allocate so that aligning up always fits, avoids a compare exchange loop.
+	const auto paddedBytes = bytes + alignment - 1;
+
+	while (true)
+	{
+		auto* block = current.load(std::memory_order_acquire);
+		if (block)
+		{
+			const auto offset = block->offset.fetch_add(paddedBytes, std::memory_order_relaxed);
+			if (offset + paddedBytes <= block->size)
+			{
+				const auto address = reinterpret_cast<uintptr_t>(block->data.get()) + offset;
+				return reinterpret_cast<void*>((address + alignment - 1) & ~(uintptr_t)(alignment - 1));
+			}
+		}
+
+		std::scoped_lock scopedLock{ lock };
+
+		// Another thread may have already moved on.
+		if (current.load(std::memory_order_relaxed) != block)
+		{
+			continue;
+		}
+
+		if (block)
+		{
+			++currentIndex;
+		}
+
+		// Reuse blocks from previous frames when they're large enough, oversized allocations get their own block.
+		if (currentIndex >= blocks.size() || blocks[currentIndex]->size < paddedBytes)
+		{
+			blocks.insert(blocks.begin() + std::min(currentIndex, blocks.size()), std::make_unique<Block>(std::max(blockSize, paddedBytes)));
+		}
+
+		current.store(blocks[currentIndex].get(), std::memory_order_release);
+	}
+}
+
+inline void FrameArena::Reset()
+{
+	for (auto& block : blocks)
+	{
+		block->offset.store(0, std::memory_order_relaxed);
+	}
+
+	currentIndex = 0;
+	current.store(blocks.empty() ? nullptr : blocks.front().get(), std::memory_order_release);
+}
\ No newline at end of file
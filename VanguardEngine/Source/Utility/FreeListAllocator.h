@@ -0,0 +1,89 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <map>
+#include <optional>
+#include <iterator>
+#include <limits>
+#include <cstdint>
+
+// Allocates contiguous ranges of slots, reusing freed ranges first-fit before growing. Adjacent free ranges are merged,
+// and free ranges at the end shrink the allocator back down.
+class FreeListAllocator
+{
+private:
+	std::map<uint32_t, uint32_t> freeRanges;  // Offset to count.
+	uint32_t size = 0;  // Every slot below has been allocated at some point.
+	uint32_t capacity;
+
+public:
+	FreeListAllocator(uint32_t inCapacity = std::numeric_limits<uint32_t>::max()) : capacity(inCapacity) {}
+
+	// Returns the offset of the range, or nothing if the allocator is full.
+	std::optional<uint32_t> Allocate(uint32_t count);
+	void Free(uint32_t offset, uint32_t count);
+
+	// One past the last slot that may be in use.
+	uint32_t Size() const noexcept { return size; }
+};
+
+inline std::optional<uint32_t> FreeListAllocator::Allocate(uint32_t count)
+{
+	for (auto iter = freeRanges.begin(); iter != freeRanges.end(); ++iter)
+	{
+		const auto [offset, freeCount] = *iter;
+		if (freeCount >= count)
+		{
+			freeRanges.erase(iter);
+			if (freeCount > count)
+			{
+				freeRanges.emplace(offset + count, freeCount - count);
+			}
+
+			return offset;
+		}
+	}
+
+	if (count > capacity - size)
+	{
+		return std::nullopt;
+	}
+
+	const auto offset = size;
+	size += count;
+
+	return offset;
+}
+
+inline void FreeListAllocator::Free(uint32_t offset, uint32_t count)
+{
+	if (count == 0)
+		return;
+
+	auto iter = freeRanges.emplace(offset, count).first;
+
+	const auto next = std::next(iter);
+	if (next != freeRanges.end() && iter->first + iter->second == next->first)
+	{
+		iter->second += next->second;
+		freeRanges.erase(next);
+	}
+
+	if (iter != freeRanges.begin())
+	{
+		const auto previous = std::prev(iter);
+		if (previous->first + previous->second == iter->first)
+		{
+			previous->second += iter->second;
+			freeRanges.erase(iter);
+			iter = previous;
+		}
+	}
+
+	if (iter->first + iter->second == size)
+	{
+		size = iter->first;
+		freeRanges.erase(iter);
+	}
+}
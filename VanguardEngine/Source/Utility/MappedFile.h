@@ -0,0 +1,32 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <cstddef>
+
+// Read only view of a file, paged in by the OS as it's accessed instead of read up front.
+class MappedFile
+{
+private:
+	void* file = nullptr;
+	void* mapping = nullptr;
+	const std::byte* data = nullptr;
+	size_t size = 0;
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile(MappedFile&&) noexcept = delete;
+	~MappedFile();
+
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile& operator=(MappedFile&&) noexcept = delete;
+
+	// Fails for missing and empty files.
+	bool Open(const std::filesystem::path& path);
+	void Close();
+
+	std::span<const std::byte> Data() const noexcept { return { data, size }; }
+};
\ No newline at end of file
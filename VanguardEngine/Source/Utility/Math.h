@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <limits>
 #include <algorithm>
+#include <cmath>
 
 using namespace DirectX;
 
@@ -49,4 +50,72 @@ inline constexpr float RemapRange(float value, float inMin, float inMax, float o
 inline constexpr float RemapRangeClamped(float value, float inMin, float inMax, float outMin, float outMax)
 {
 	return std::clamp(RemapRange(value, inMin, inMax, outMin, outMax), outMin, outMax);
-}
\ No newline at end of file
+}
+// Equivalent to XMMatrixScalingFromVector(scale) * XMMatrixRotationX(rotation.x) * XMMatrixRotationY(rotation.y) *
+// XMMatrixRotationZ(rotation.z) * XMMatrixTranslationFromVector(translation), with a single sine/cosine evaluation and no
+// matrix multiplies.
+inline XMMATRIX XM_CALLCONV ComposeTransformMatrix(FXMVECTOR scale, FXMVECTOR rotation, FXMVECTOR translation)
+{
+	XMVECTOR sines;
+	XMVECTOR cosines;
+	XMVectorSinCos(&sines, &cosines, rotation);
+
+	XMFLOAT3 s;
+	XMFLOAT3 c;
+	XMStoreFloat3(&s, sines);
+	XMStoreFloat3(&c, cosines);
+
+	const auto sxsy = s.x * s.y;
+	const auto cxsy = c.x * s.y;
+
+	XMMATRIX result;
+	result.r[0] = XMVectorMultiply(XMVectorSet(c.y * c.z, c.y * s.z, -s.y, 0.f), XMVectorSplatX(scale));
+	result.r[1] = XMVectorMultiply(XMVectorSet(sxsy * c.z - c.x * s.z, sxsy * s.z + c.x * c.z, s.x * c.y, 0.f), XMVectorSplatY(scale));
+	result.r[2] = XMVectorMultiply(XMVectorSet(cxsy * c.z + s.x * s.z, cxsy * s.z - s.x * c.z, c.x * c.y, 0.f), XMVectorSplatZ(scale));
+	result.r[3] = XMVectorSetW(translation, 1.f);
+
+	return result;
+}
+
+// Right handed perspective projection with inverse Z and the far plane at infinity. Depth is nearPlane / view depth, so
+// precision is spent the same at every distance with a floating point depth buffer.
+inline XMMATRIX XM_CALLCONV PerspectiveFovInfiniteReversedRH(float fovAngleY, float aspectRatio, float nearPlane)
+{
+	const auto height = 1.f / std::tan(fovAngleY * 0.5f);
+	const auto width = height / aspectRatio;
+
+	return XMMATRIX{
+		width, 0.f, 0.f, 0.f,
+		0.f, height, 0.f, 0.f,
+		0.f, 0.f, 0.f, -1.f,
+		0.f, 0.f, nearPlane, 0.f
+	};
+}
+
+// Quaternion of XMMatrixRotationX(rotation.x) * XMMatrixRotationY(rotation.y) * XMMatrixRotationZ(rotation.z), the rotation
+// order of ComposeTransformMatrix.
+inline XMVECTOR XM_CALLCONV EulerToQuaternion(FXMVECTOR rotation)
+{
+	const auto x = XMQuaternionRotationNormal(g_XMIdentityR0, XMVectorGetX(rotation));
+	const auto y = XMQuaternionRotationNormal(g_XMIdentityR1, XMVectorGetY(rotation));
+	const auto z = XMQuaternionRotationNormal(g_XMIdentityR2, XMVectorGetZ(rotation));
+
+	return XMQuaternionMultiply(XMQuaternionMultiply(x, y), z);
+}
+
+// Inverse of EulerToQuaternion, the Y angle is kept within [-pi/2, pi/2].
+inline XMFLOAT3 XM_CALLCONV QuaternionToEuler(FXMVECTOR quaternion)
+{
+	XMFLOAT3X3 m;
+	XMStoreFloat3x3(&m, XMMatrixRotationQuaternion(quaternion));
+
+	const auto y = std::asin(std::clamp(-m._13, -1.f, 1.f));
+
+	// Gimbal lock, the X and Z rotations share an axis so Z is folded into X.
+	if (std::abs(m._13) > 0.9999f)
+	{
+		return { std::atan2(-m._32, m._22), y, 0.f };
+	}
+
+	return { std::atan2(m._23, m._33), y, std::atan2(m._12, m._11) };
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#pragma once
+
+#include <entt/entt.hpp>
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+// Generational slot map keyed by entity handles. Handles index their slot directly, and carry the slot's version so that
+// handles to destroyed values are rejected. Values live in fixed size pages, so references stay valid as the map grows.
+// Maps can start their indices at an offset, keeping the handles of several maps distinct from each other.
+template <typename T>
+class SlotMap
+{
+	using Traits = entt::entt_traits<entt::entity>;
+
+	static constexpr size_t pageSize = 256;
+	static constexpr auto nullVersion = Traits::to_version(entt::null);  // Reserved for the null handle.
+
+private:
+	std::vector<std::unique_ptr<T[]>> pages;
+	std::vector<uint32_t> versions;  // Current version of each slot.
+	std::vector<bool> occupied;
+	std::vector<uint32_t> freeSlots;
+	uint32_t firstIndex;
+	size_t count = 0;
+
+	size_t Slot(entt::entity handle) const noexcept { return static_cast<size_t>(Traits::to_entity(handle)) - firstIndex; }
+	T& At(size_t slot) noexcept { return pages[slot / pageSize][slot % pageSize]; }
+	const T& At(size_t slot) const noexcept { return pages[slot / pageSize][slot % pageSize]; }
+
+public:
+	SlotMap(uint32_t inFirstIndex = 0) : firstIndex(inFirstIndex) {}
+
+	entt::entity Insert(T&& value);
+	// Resets the slot's value, releasing what it owns, and invalidates every handle to it.
+	void Erase(entt::entity handle);
+
+	bool Valid(entt::entity handle) const noexcept;
+	T& Get(entt::entity handle) noexcept { return At(Slot(handle)); }
+	const T& Get(entt::entity handle) const noexcept { return At(Slot(handle)); }
+
+	size_t Size() const noexcept { return count; }
+
+	// Visits every value in slot order, as (handle, value).
+	template <typename F>
+	void Each(F&& function) const;
+};
+
+template <typename T>
+inline entt::entity SlotMap<T>::Insert(T&& value)
+{
+	size_t slot;
+	if (!freeSlots.empty())
+	{
+		slot = freeSlots.back();
+		freeSlots.pop_back();
+	}
+
+	else
+	{
+		slot = versions.size();
+		if (slot % pageSize == 0)
+		{
+			pages.emplace_back(std::make_unique<T[]>(pageSize));
+		}
+
+		versions.emplace_back(0);
+		occupied.emplace_back(false);
+	}
+
+	At(slot) = std::move(value);
+	occupied[slot] = true;
+	++count;
+
+	return Traits::construct(static_cast<Traits::entity_type>(firstIndex + slot), static_cast<Traits::version_type>(versions[slot]));
+}
+
+template <typename T>
+inline void SlotMap<T>::Erase(entt::entity handle)
+{
+	const auto slot = Slot(handle);
+
+	At(slot) = T{};
+	occupied[slot] = false;
+	--count;
+
+	versions[slot] = (versions[slot] + 1) % nullVersion;
+	freeSlots.emplace_back(static_cast<uint32_t>(slot));
+}
+
+template <typename T>
+inline bool SlotMap<T>::Valid(entt::entity handle) const noexcept
+{
+	// Wraps around for handles below the first index, including the null handle.
+	const auto slot = Slot(handle);
+
+	return slot < versions.size() && occupied[slot] && versions[slot] == Traits::to_version(handle);
+}
+
+template <typename T>
+template <typename F>
+inline void SlotMap<T>::Each(F&& function) const
+{
+	for (size_t slot = 0; slot < versions.size(); ++slot)
+	{
+		if (occupied[slot])
+		{
+			function(Traits::construct(static_cast<Traits::entity_type>(firstIndex + slot), static_cast<Traits::version_type>(versions[slot])), At(slot));
+		}
+	}
+}
\ No newline at end of file
@@ -2,66 +2,109 @@
 
 #pragma once
 
-#include <cstdlib>
+#include <cstddef>
+#include <functional>
+#include <type_traits>
 #include <utility>
 #include <new>
 
-template <typename>
+// Type erased callable stored inline, never allocates. Functors exceeding the storage fail to compile.
+template <typename, size_t = 32>
 struct StackFunction;
 
-template <typename Result, typename... ArgTypes>
-struct StackFunction<Result(ArgTypes...)>
+template <typename Result, typename... ArgTypes, size_t Size>
+struct StackFunction<Result(ArgTypes...), Size>
 {
-	static constexpr size_t size = 32;
+	static constexpr size_t size = Size;
 
 private:
-	char buffer[size];
+	alignas(std::max_align_t) std::byte buffer[size];
 
-	struct Concept
-	{
-		virtual Result operator()(ArgTypes...) const = 0;
-		virtual ~Concept() = default;
-	};
+	// Manual dispatch table, avoids the virtual call and the vtable pointer taking up storage.
+	Result(*invoke)(void*, ArgTypes&&...) = nullptr;
+	void(*relocate)(void* destination, void* source) = nullptr;  // Move constructs into the destination, then destroys the source.
+	void(*destroy)(void*) = nullptr;
 
-	template <typename Functor>
-	struct Model final : public Concept
+	void Reset() noexcept
 	{
-		Functor internal;
+		if (destroy)
+		{
+			destroy(buffer);
+		}
 
-		Model(Functor&& functor) : internal(functor) {}
+		invoke = nullptr;
+		relocate = nullptr;
+		destroy = nullptr;
+	}
 
-		virtual Result operator()(ArgTypes&&... args) const override
+	void MoveFrom(StackFunction& other) noexcept
+	{
+		if (other.invoke)
 		{
-			return internal(std::forward<ArgTypes>(args)...);
+			other.relocate(buffer, other.buffer);
+			invoke = std::exchange(other.invoke, nullptr);
+			relocate = std::exchange(other.relocate, nullptr);
+			destroy = std::exchange(other.destroy, nullptr);
 		}
-	};
+	}
 
 public:
+	StackFunction() noexcept = default;
+
 	template <typename Functor>
+		requires (!std::is_same_v<std::decay_t<Functor>, StackFunction>)
 	StackFunction(Functor&& functor)
 	{
-		static_assert(sizeof(functor) <= size, "Kernel functor cannot exceed set size");
+		using T = std::decay_t<Functor>;
+
+		static_assert(sizeof(T) <= size, "Functor exceeds the stack function's storage size.");
+		static_assert(alignof(T) <= alignof(std::max_align_t), "Functor is over-aligned for the stack function's storage.");
+		static_assert(std::is_nothrow_move_constructible_v<T>, "Functor must be nothrow move constructible.");
 
-		new(buffer) Model<Functor>{ std::forward<Functor>(functor) };
+		new(buffer) T{ std::forward<Functor>(functor) };
+
+		invoke = +[](void* object, ArgTypes&&... args) -> Result
+		{
+			return std::invoke(*static_cast<T*>(object), std::forward<ArgTypes>(args)...);
+		};
+		relocate = +[](void* destination, void* source)
+		{
+			new(destination) T{ std::move(*static_cast<T*>(source)) };
+			static_cast<T*>(source)->~T();
+		};
+		destroy = +[](void* object)
+		{
+			static_cast<T*>(object)->~T();
+		};
 	}
 
 	StackFunction(const StackFunction&) = delete;
 	StackFunction(StackFunction&& other) noexcept
 	{
-		std::swap(buffer, other.buffer);
+		MoveFrom(other);
 	}
 
 	StackFunction& operator=(const StackFunction&) = delete;
-	StackFunction& operator=(StackFunction&&) noexcept = delete;
-
-	template <typename... Ts>
-	Result operator()(Ts&&... args) const
+	StackFunction& operator=(StackFunction&& other) noexcept
 	{
-		return (reinterpret_cast<const Concept*>(buffer))->operator()(std::forward<Ts>(args)...);
+		if (this != &other)
+		{
+			Reset();
+			MoveFrom(other);
+		}
+
+		return *this;
 	}
 
 	~StackFunction()
 	{
-		(reinterpret_cast<Concept*>(buffer))->~Concept();
+		Reset();
+	}
+
+	explicit operator bool() const noexcept { return invoke != nullptr; }
+
+	Result operator()(ArgTypes... args) const
+	{
+		return invoke(const_cast<std::byte*>(buffer), std::forward<ArgTypes>(args)...);
 	}
 };
\ No newline at end of file
@@ -0,0 +1,45 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Utility/DirectoryWatcher.h>
+#include <Core/Base.h>
+#include <Core/Windows/WindowsMinimal.h>
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+	if (handle)
+	{
+		::FindCloseChangeNotification(handle);
+	}
+}
+
+void DirectoryWatcher::Watch(const std::filesystem::path& directory)
+{
+	if (handle)
+	{
+		::FindCloseChangeNotification(handle);
+		handle = nullptr;
+	}
+
+	const auto result = ::FindFirstChangeNotificationW(directory.c_str(), true, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+	if (result == INVALID_HANDLE_VALUE)
+	{
+		VGLogWarning(logCore, "Failed to watch directory '{}': {}", directory.generic_wstring(), ::GetLastError());
+
+		return;
+	}
+
+	handle = result;
+}
+
+bool DirectoryWatcher::Poll()
+{
+	if (!handle || ::WaitForSingleObject(handle, 0) != WAIT_OBJECT_0)
+	{
+		return false;
+	}
+
+	// Rearm for the next change.
+	::FindNextChangeNotification(handle);
+
+	return true;
+}
\ No newline at end of file
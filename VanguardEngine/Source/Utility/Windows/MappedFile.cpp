@@ -0,0 +1,75 @@
+// Copyright (c) 2019-2022 Andrew Depke
+
+#include <Utility/MappedFile.h>
+#include <Core/Base.h>
+#include <Core/Windows/WindowsMinimal.h>
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::filesystem::path& path)
+{
+	Close();
+
+	const auto fileHandle = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	file = fileHandle;
+
+	LARGE_INTEGER fileSize;
+	if (!::GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	mapping = ::CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+	{
+		VGLogWarning(logUtility, "Failed to map file '{}': {}", path.generic_wstring(), ::GetLastError());
+
+		Close();
+		return false;
+	}
+
+	data = static_cast<const std::byte*>(::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!data)
+	{
+		VGLogWarning(logUtility, "Failed to map view of file '{}': {}", path.generic_wstring(), ::GetLastError());
+
+		Close();
+		return false;
+	}
+
+	size = static_cast<size_t>(fileSize.QuadPart);
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+	{
+		::UnmapViewOfFile(data);
+	}
+
+	if (mapping)
+	{
+		::CloseHandle(mapping);
+	}
+
+	if (file)
+	{
+		::CloseHandle(file);
+	}
+
+	file = nullptr;
+	mapping = nullptr;
+	data = nullptr;
+	size = 0;
+}
\ No newline at end of file
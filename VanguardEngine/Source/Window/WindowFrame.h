@@ -28,6 +28,8 @@ private:
 	uint32_t width;
 	uint32_t height;
 	bool fullscreen = false;
+	bool minimized = false;
+	bool focused = true;
 
 	// Used to return to original window size when leaving fullscreen.
 	uint32_t oldWidth;
@@ -58,4 +60,14 @@ public:
 	{
 		return fullscreen;
 	}
+
+	bool IsMinimized() const noexcept
+	{
+		return minimized;
+	}
+
+	bool IsFocused() const noexcept
+	{
+		return focused;
+	}
 };
\ No newline at end of file
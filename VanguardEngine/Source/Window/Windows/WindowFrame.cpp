@@ -48,6 +48,8 @@ int64_t __stdcall WndProc(void* hWnd, uint32_t msg, uint64_t wParam, int64_t lPa
 		return ::DefWindowProc(static_cast<HWND>(hWnd), msg, wParam, lParam);
 
 	case WM_SIZE:
+		owningFrame->minimized = wParam == SIZE_MINIMIZED;
+
 		if (wParam != SIZE_MINIMIZED && owningFrame->onSizeChanged)
 		{
 			owningFrame->onSizeChanged(static_cast<uint32_t>(LOWORD(lParam)), static_cast<uint32_t>(HIWORD(lParam)));
@@ -57,7 +59,9 @@ int64_t __stdcall WndProc(void* hWnd, uint32_t msg, uint64_t wParam, int64_t lPa
 
 	case WM_ACTIVATE:
 		const auto active = LOWORD(wParam);
-		if (active == WA_ACTIVE || active == WA_CLICKACTIVE)
+		owningFrame->focused = active == WA_ACTIVE || active == WA_CLICKACTIVE;
+
+		if (owningFrame->focused)
 		{
 			if (owningFrame->onFocusChanged)
 			{
@@ -175,6 +175,10 @@ project "Engine"
 		omitframepointer "On"
 		exceptionhandling "Off"
 		
+		if EnableLogging then
+			defines { "SPDLOG_ACTIVE_LEVEL=3" }  -- Strips info logging at compile time, warnings and errors remain.
+		end
+		
 	filter { "configurations:not Release" }
 		buildoptions "/Ob1"  -- Inline VGForceInline's, this is necessary to prevent the logger from breaking on the wrong line. Use default expansion in release builds.
 		